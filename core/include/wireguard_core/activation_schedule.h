@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace wireguard_dart {
+
+/**
+ * The order a tunnel's peers are activated in when they are added to the driver a batch at a time, so that a hub
+ * with thousands of peers does not have all of them handshake at once. Peers with a priority go first, the lowest
+ * first; then those with a handshake, the most recent first, as their sessions were the ones in use; then the rest
+ * in the order they were configured. Not synchronized.
+ */
+class ActivationSchedule {
+public:
+  static constexpr int32_t kNoPriority = INT32_MAX;
+
+  struct Peer {
+    // Lower goes first
+    int32_t priority = kNoPriority;
+    // In milliseconds since 1970, 0 if there was none
+    uint64_t last_handshake_ms = 0;
+  };
+
+  // A batch_size of 0 takes every peer at once
+  ActivationSchedule(const std::vector<Peer> &peers, size_t batch_size);
+
+  /**
+   * The positions in peers of the next batch, in activation order
+   * @return Empty once every peer was taken
+   */
+  std::vector<uint32_t> Next();
+
+  size_t Taken() const { return taken_; }
+  size_t Total() const { return order_.size(); }
+  bool Done() const { return taken_ == order_.size(); }
+
+private:
+  std::vector<uint32_t> order_;
+  size_t batch_size_;
+  size_t taken_ = 0;
+};
+
+} // namespace wireguard_dart
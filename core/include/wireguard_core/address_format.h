@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wireguard_dart {
+
+// Allocation-free formatters for the address forms in WireGuard configurations, the reverse of the parsers in
+// address_parser.h. They write what inet_ntop writes, without its NUL, into a buffer the caller sized.
+
+// The longest text of each, e.g. "255.255.255.255" and "ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255"
+constexpr size_t kMaxIPv4AddressText = 15;
+constexpr size_t kMaxIPv6AddressText = 45;
+// A port or prefix length after its separator
+constexpr size_t kMaxPortText = 6;
+
+/**
+ * Write 4 address bytes in network order as a dotted quad
+ * @return The characters written
+ */
+size_t FormatIPv4Address(const uint8_t *address, char *out);
+
+/**
+ * Write 16 address bytes in network order as RFC 5952 recommends: lowercase hex without leading zeros, the first
+ * longest run of two or more zero groups compressed to "::", and IPv4-mapped addresses with a dotted quad tail
+ * @return The characters written
+ */
+size_t FormatIPv6Address(const uint8_t *address, char *out);
+
+/**
+ * Write a decimal number up to 65535, e.g. a port or a prefix length
+ * @return The characters written
+ */
+size_t FormatDecimal(uint16_t value, char *out);
+
+} // namespace wireguard_dart
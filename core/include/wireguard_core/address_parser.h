@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace wireguard_dart {
+
+// Allocation-free parsers for the address forms in WireGuard configurations. They accept exactly what
+// inet_pton accepts for the same family, but work on string_views and do not need NUL-terminated copies.
+// Addresses are written in network order.
+
+/**
+ * Parse a dotted-quad IPv4 address, e.g. "192.168.1.1", into 4 bytes
+ */
+bool ParseIPv4Address(std::string_view str, uint8_t *address);
+
+/**
+ * Parse an IPv6 address, including "::" compression and an embedded IPv4 tail, e.g. "::ffff:10.0.0.1", into
+ * 16 bytes
+ */
+bool ParseIPv6Address(std::string_view str, uint8_t *address);
+
+/**
+ * Parse a decimal CIDR prefix length no larger than max_cidr
+ */
+bool ParseCidr(std::string_view str, uint8_t max_cidr, uint8_t &cidr);
+
+/**
+ * Parse a decimal UDP port
+ */
+bool ParsePort(std::string_view str, uint16_t &port);
+
+} // namespace wireguard_dart
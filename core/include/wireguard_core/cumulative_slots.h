@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "peer_statistics.h"
+
+namespace wireguard_dart {
+
+/**
+ * Running totals of the bytes each tunnel and each of its peers sent and received, in a table of fixed-size slots
+ * laid out in memory the caller provides, such as a mapped file, so that they outlive the process and the adapter,
+ * whose driver counters start over from zero. Update adds what the driver counted since its last reading, in place.
+ *
+ * Every peer, and every tunnel for its totals, has a slot with two copies of its counters, written in turn and each
+ * sealed with a checksum last, so a crash part way through an update leaves the copy before it. Besides the totals a
+ * copy holds the driver's reading it was taken at and the adapter's LUID and instance marker: a reading below it, or
+ * of another LUID or instance, means the driver started counting over, and all of it is added instead of the
+ * difference. The marker tells apart an adapter recreated with the LUID of the one before. A tunnel's totals are the
+ * sums of what its peers added, so removing a peer takes nothing away from them.
+ *
+ * Slots are given back once their driver reading is of no more use: on a reset, those of peers removed from their
+ * tunnel and of tunnels and peers whose adapter is gone; and once all are taken, those of removed peers for the new
+ * peers that need one. A peer is known to be removed once its tunnel was updated without it in this process; a gone
+ * adapter's tunnel may still come back on a new one, so its slots wait for a reset. Not synchronized.
+ */
+class CumulativeSlots {
+public:
+  // Tunnel names are cut off at one byte less, in UTF-8
+  static constexpr size_t kMaxName = 64;
+
+  // The checksum covers the slot's key and everything after it in the copy, and is written last; zero for none
+  struct Copy {
+    uint64_t checksum;
+    // The newer of the two intact copies is the one with the higher sequence
+    uint64_t sequence;
+    uint64_t luid;
+    // Of the adapter instance behind the LUID, which the caller picks
+    uint64_t instance;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    // What the driver had counted when the copy was written, unused for a tunnel's totals
+    uint64_t driver_rx_bytes;
+    uint64_t driver_tx_bytes;
+    uint64_t since_ms;
+    uint64_t updated_ms;
+  };
+  // As laid out in memory; free while neither copy is intact
+  struct Slot {
+    char tunnel_name[kMaxName];
+    uint8_t public_key[kWireguardKeyLength];
+    uint32_t flags;
+    uint32_t reserved;
+    Copy copies[2];
+  };
+
+  struct Counts {
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+    // When counting began or was last reset, and when the counts last grew, in milliseconds since 1970
+    uint64_t since_ms = 0;
+    uint64_t updated_ms = 0;
+  };
+  struct Tunnel {
+    Counts totals;
+    std::map<PeerKey, Counts> peers;
+  };
+
+  // Whether the adapter instance of a LUID still exists; its driver counters are gone with it. Without one, every
+  // adapter is taken to exist.
+  using AdapterExists = std::function<bool(uint64_t luid, uint64_t instance)>;
+
+  explicit CumulativeSlots(AdapterExists adapter_exists = nullptr) : adapter_exists_(std::move(adapter_exists)) {}
+
+  // Take over the count slots at memory, all zero or as an earlier table left them, and index those taken
+  void Attach(Slot *slots, size_t count);
+
+  size_t Count() const { return count_; }
+  size_t Taken() const { return index_.size(); }
+
+  /**
+   * Add what the driver counted since the last update of each of the tunnel's peers, all of which are given
+   * @return false if a slot was needed and none could be had, so some of the traffic was not counted
+   */
+  bool Update(const std::string &tunnel_name, uint64_t luid, uint64_t instance,
+              const std::vector<PeerStatistics> &peers, uint64_t now_ms);
+
+  // The totals of the named tunnels, or of every tunnel counted with none. With reset they start over from zero as
+  // of now_ms, and the slots no longer of use are given back.
+  std::map<std::string, Tunnel> Read(const std::vector<std::string> &tunnel_names, bool reset, uint64_t now_ms);
+
+private:
+  // The slot of the tunnel's totals, or a peer's, claiming a free one if it has none; nullptr once all are taken
+  // and none can be given back
+  Slot *Find(const std::string &tunnel_name, const PeerKey *public_key);
+  // Whether the adapter the slot was last updated from is gone; memoizes the adapters asked about in gone
+  bool IsAdapterGone(size_t index, std::map<std::pair<uint64_t, uint64_t>, bool> &gone) const;
+  void Free(size_t index);
+  static std::string IndexKey(const std::string &tunnel_name, const PeerKey *public_key);
+
+  AdapterExists adapter_exists_;
+  Slot *slots_ = nullptr;
+  size_t count_ = 0;
+  // The taken slots, by tunnel name and public key; rebuilt on Attach
+  std::unordered_map<std::string, size_t> index_;
+  std::vector<size_t> free_;
+  // In memory only: by tunnel name the slots of its peers as of its latest update, or as attached before it; the
+  // slots of peers its updates left out since; and by slot the serial of the latest update that saw it
+  std::unordered_map<std::string, std::vector<size_t>> peers_;
+  std::set<size_t> removed_;
+  std::vector<uint64_t> seen_;
+  uint64_t serial_ = 0;
+};
+
+} // namespace wireguard_dart
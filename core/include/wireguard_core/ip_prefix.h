@@ -0,0 +1,140 @@
+#pragma once
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string_view>
+#include <vector>
+
+namespace wireguard_dart {
+
+// An address or allowed IP with its prefix length. The platforms copy it into WIREGUARD_ALLOWED_IP on
+// Windows and into netlink attributes on Linux.
+struct NetworkPrefix {
+  int family;  // AF_INET or AF_INET6
+  uint8_t address[16];
+  uint8_t prefix_length;
+};
+
+/**
+ * Parse "address/length", or a bare address for a host prefix. Surrounding spaces are not allowed.
+ */
+bool ParseNetworkPrefix(std::string_view str, NetworkPrefix &prefix);
+
+/**
+ * Reduce a set of IPv4/IPv6 prefixes to the smallest set of prefixes covering exactly the same addresses.
+ * Host bits are cleared, duplicates and prefixes inside another one are dropped, and sibling prefixes
+ * (e.g. 10.0.0.0/25 and 10.0.0.128/25) are merged into their parent, repeatedly.
+ * Entries of other address families are dropped. The result is sorted by family and address.
+ * @param prefixes The prefixes, in any order
+ * @return The aggregated prefixes
+ */
+std::vector<NetworkPrefix> AggregatePrefixes(const std::vector<NetworkPrefix> &prefixes);
+
+/**
+ * The addresses of allowed that are not in excluded, as the fewest prefixes that cover exactly those, for an
+ * ExcludedIPs line. Both lists become sorted, merged ranges of 128-bit addresses, which are subtracted in one
+ * pass; each remaining range is then cut into the largest aligned blocks it holds. O(n log n) in the number of
+ * prefixes, so "everything but the LAN" takes microseconds instead of a list computed and sent by the app.
+ * Entries of other address families are dropped. The result is sorted by family and address.
+ */
+std::vector<NetworkPrefix> SubtractPrefixes(const std::vector<NetworkPrefix> &allowed,
+                                            const std::vector<NetworkPrefix> &excluded);
+
+/**
+ * Replace default routes (0.0.0.0/0, ::/0) by their two halves, /1 each. Being more specific, these win over
+ * the physical default route without touching it or depending on metrics. Run it after AggregatePrefixes,
+ * which would merge the halves back.
+ * @return true if there was a default route
+ */
+bool SplitDefaultRoutes(std::vector<NetworkPrefix> &prefixes);
+
+/**
+ * Longest-prefix match over prefixes of both families, each with a value, e.g. the allowed IPs of every peer of
+ * every tunnel. A path-compressed binary radix trie in one array, with a node per prefix and per branch point, so
+ * at most two per prefix: a lookup only visits the nodes where the prefixes differ, not every bit. Built with
+ * Insert and then only read, which any number of threads may do at once.
+ */
+class PrefixTrie {
+public:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  /**
+   * Add a prefix with its value; host bits are ignored. A prefix added again keeps its first value.
+   * @return false for another address family or a length past the address
+   */
+  bool Insert(const NetworkPrefix &prefix, uint32_t value);
+
+  // The value of the longest prefix holding the address, 4 bytes for AF_INET and 16 for AF_INET6, or kNone
+  uint32_t Lookup(int family, const uint8_t *address) const;
+
+  void Clear();
+  // Distinct prefixes added
+  size_t Size() const { return size_; }
+  size_t MemoryBytes() const { return nodes_.capacity() * sizeof(Node); }
+
+private:
+  // The prefix as a left-aligned 128-bit key, IPv4 in the top 32 bits. Branch points have no value.
+  struct Node {
+    uint64_t high;
+    uint64_t low;
+    uint32_t child[2];
+    uint32_t value;
+    uint8_t length;
+  };
+
+  uint32_t AddNode(uint64_t high, uint64_t low, uint8_t length, uint32_t value);
+
+  std::vector<Node> nodes_;
+  uint32_t roots_[2] = {kNone, kNone};  // AF_INET, AF_INET6
+  size_t size_ = 0;
+};
+
+/**
+ * The routes of a tunnel kept as prefixes come and go, e.g. with its peers' allowed IPs: always what
+ * AggregatePrefixes gives for the prefixes added and not yet removed. A change only aggregates again below the
+ * route around each prefix it adds or removes, widened while that route merges with its sibling, and reports the
+ * routes that differ, so changing a few peers of a tunnel with thousands costs in proportion to those peers.
+ */
+class RouteSet {
+public:
+  // Start over with these prefixes; host bits are cleared and other address families dropped
+  void Assign(const std::vector<NetworkPrefix> &prefixes);
+
+  /**
+   * Add and remove one occurrence of each prefix, a prefix counting as often as it was added. Removing a prefix
+   * that is not there changes nothing.
+   * @param added_routes Appended the routes that are new, sorted by family and address
+   * @param removed_routes Appended the routes that are gone, likewise
+   */
+  void Change(const std::vector<NetworkPrefix> &added, const std::vector<NetworkPrefix> &removed,
+              std::vector<NetworkPrefix> *added_routes, std::vector<NetworkPrefix> *removed_routes);
+
+  // Sorted by family and address, as AggregatePrefixes returns them
+  std::vector<NetworkPrefix> Routes() const { return {routes_.begin(), routes_.end()}; }
+  // Distinct prefixes added
+  size_t PrefixCount() const { return counts_.size(); }
+  void Clear();
+
+private:
+  // By family, address and then length, the order AggregatePrefixes sorts in: a prefix comes right before the
+  // prefixes it contains. Compares the host bits too, which the set only holds cleared.
+  struct Less {
+    bool operator()(const NetworkPrefix &a, const NetworkPrefix &b) const;
+  };
+
+  // Aggregate the prefixes below the route around prefix again, or from prefix down if none holds it, widening
+  // the region while the result merges with its sibling route; added for a prefix just added, removed otherwise
+  void Reaggregate(NetworkPrefix prefix, bool added, std::map<NetworkPrefix, int, Less> *changes);
+
+  std::map<NetworkPrefix, uint32_t, Less> counts_;
+  std::set<NetworkPrefix, Less> routes_;
+};
+
+} // namespace wireguard_dart
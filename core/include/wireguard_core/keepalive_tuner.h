@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#include "peer_statistics.h"
+
+namespace wireguard_dart {
+
+/**
+ * Chooses the persistent keepalive of a peer configured with PersistentKeepalive = auto, from how its sessions
+ * hold up. The keepalive only has to come before the NAT in front of the tunnel forgets the mapping, whose
+ * timeout nobody announces. So the interval is raised while the handshakes keep coming and brought back below
+ * the one they stopped at, which bisects the binding timeout down to kResolution seconds.
+ *
+ * A mapping that expired shows as inbound silence: WireGuard answers every data packet it receives within
+ * KEEPALIVE_TIMEOUT, so data sent with nothing received for kSilenceMs afterwards counts as a failure of the
+ * interval, and the next bytes received as the recovery. Sent bytes only count as data beyond what keepalives and
+ * handshake retries send on their own, and a peer that only idles never fails. An interval that held for kHoldMs
+ * since it was set or recovered counts as good. Counters that go back, as for a peer that was replaced, start a
+ * new baseline and keep what was learned. Times are passed in, in milliseconds since 1970 like last_handshake_ms.
+ * Not synchronized.
+ */
+class KeepaliveTuner {
+public:
+  static constexpr uint16_t kDefaultMin = 15;
+  static constexpr uint16_t kDefaultMax = 120;
+  // Where the search starts, the interval most configurations use
+  static constexpr uint16_t kInitial = 25;
+  static constexpr uint64_t kHoldMs = 10 * 60 * 1000;
+  static constexpr uint16_t kResolution = 5;
+  // KEEPALIVE_TIMEOUT, within which a peer answers data, and a REKEY_TIMEOUT for a handshake on the way
+  static constexpr uint64_t kSilenceMs = (10 + 5) * 1000;
+  // What a handshake initiation and a keepalive add to the sent bytes, which are not data
+  static constexpr uint64_t kHandshakeBytes = 148;
+  static constexpr uint64_t kKeepaliveBytes = 32;
+  static constexpr uint64_t kRekeyTimeoutMs = 5 * 1000;
+
+  // Bounds in seconds, min at least 1 and at most max; start is the interval the peer has, 0 for InitialInterval
+  KeepaliveTuner(uint16_t min, uint16_t max, uint16_t start = 0);
+
+  // The interval a peer starts with until the tuner has chosen one
+  static uint16_t InitialInterval(uint16_t min, uint16_t max);
+
+  uint16_t Current() const { return current_; }
+
+  /**
+   * Take the peer's counters read at now_ms
+   * @return The interval to set on the peer, or 0 to keep the current one
+   */
+  uint16_t Update(const PeerStatistics &reading, uint64_t now_ms);
+
+private:
+  uint16_t SwitchTo(uint16_t interval, uint64_t now_ms);
+
+  uint16_t min_;
+  uint16_t max_;
+  uint16_t current_;
+  // The longest interval that held and the shortest that failed, 0 while unknown
+  uint16_t good_ = 0;
+  uint16_t bad_ = 0;
+  uint64_t held_since_ms_ = 0;
+  uint64_t updated_ms_ = 0;
+  uint64_t tx_bytes_ = 0;
+  uint64_t rx_bytes_ = 0;
+  // When data first went out since the last bytes came in, 0 if none did
+  uint64_t silent_since_ms_ = 0;
+  bool failing_ = false;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace wireguard_dart {
+
+// A peer's round trip times and losses over its latest in-tunnel probes; nothing while none was sent
+struct LinkQuality {
+  uint32_t probes = 0;
+  uint32_t lost = 0;
+  // Of the probes answered, in milliseconds; 0 while none was
+  uint32_t rtt_min_ms = 0;
+  uint32_t rtt_p50_ms = 0;
+  uint32_t rtt_p90_ms = 0;
+  uint32_t rtt_max_ms = 0;
+
+  double LossPercent() const { return probes != 0 ? 100.0 * lost / probes : 0; }
+};
+
+/**
+ * The outcomes of a peer's latest probes, each a round trip time or a loss, in a ring of a fixed number of them,
+ * so the quality follows the link as it is now instead of averaging over the whole session. Percentiles are of
+ * the nearest rank. Not synchronized.
+ */
+class LinkQualityWindow {
+public:
+  // A minute of probes at the prober's usual interval
+  static constexpr size_t kDefaultCapacity = 30;
+
+  explicit LinkQualityWindow(size_t capacity = kDefaultCapacity);
+
+  void RecordReply(uint32_t rtt_ms);
+  void RecordLoss();
+
+  LinkQuality Summarize() const;
+
+private:
+  void Record(uint32_t outcome);
+
+  // Round trip times in milliseconds and losses, the oldest overwritten first once the ring is full
+  std::vector<uint32_t> outcomes_;
+  size_t capacity_;
+  size_t next_ = 0;
+};
+
+} // namespace wireguard_dart
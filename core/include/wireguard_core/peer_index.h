@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "wireguard_key.h"
+
+namespace wireguard_dart {
+
+/**
+ * Index from a peer's 32 byte public key to its slot, e.g. its position in a configuration or in a reading of
+ * the driver. Open addressing with linear probing over 8 byte buckets, each a 32-bit hash of the key and the
+ * slot, kept at most half full. The keys stay where they are: key_at(slot) returns a pointer to the key of an
+ * indexed slot and is only called for a bucket whose hash matches. Clear keeps the buckets, so an index built
+ * again for the same peers allocates nothing.
+ */
+class PeerIndex {
+public:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  // Empty, keeping the buckets
+  void Clear();
+  // Room for count keys without growing
+  void Reserve(size_t count);
+
+  /**
+   * Index the key at slot
+   * @return kNone, or the slot of an equal key indexed before, which is left as it was
+   */
+  template <typename KeyAt>
+  uint32_t Insert(const uint8_t *key, uint32_t slot, const KeyAt &key_at);
+
+  // The slot of the key, or kNone
+  template <typename KeyAt>
+  uint32_t Find(const uint8_t *key, const KeyAt &key_at) const;
+
+  size_t Size() const { return size_; }
+  size_t MemoryBytes() const { return buckets_.capacity() * sizeof(Bucket); }
+
+  // Public keys are random, mixing 8 of their bytes spreads even chosen ones over the buckets
+  static uint32_t Hash(const uint8_t *key) {
+    uint64_t bits;
+    memcpy(&bits, key, sizeof(bits));
+    return static_cast<uint32_t>((bits * 0x9E3779B97F4A7C15ULL) >> 32);
+  }
+
+private:
+  struct Bucket {
+    uint32_t hash;
+    uint32_t slot;  // kNone while empty
+  };
+
+  // Rehash into bucket_count buckets, a power of two, from the hashes kept in the buckets
+  void Rehash(size_t bucket_count);
+
+  std::vector<Bucket> buckets_;
+  size_t size_ = 0;
+};
+
+template <typename KeyAt>
+uint32_t PeerIndex::Insert(const uint8_t *key, uint32_t slot, const KeyAt &key_at) {
+  if ((size_ + 1) * 2 > buckets_.size()) {
+    Rehash(buckets_.empty() ? 16 : buckets_.size() * 2);
+  }
+  uint32_t hash = Hash(key);
+  size_t mask = buckets_.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    Bucket &bucket = buckets_[i];
+    if (bucket.slot == kNone) {
+      bucket = {hash, slot};
+      size_++;
+      return kNone;
+    }
+    if (bucket.hash == hash && memcmp(key_at(bucket.slot), key, kWireguardKeyLength) == 0) {
+      return bucket.slot;
+    }
+  }
+}
+
+template <typename KeyAt>
+uint32_t PeerIndex::Find(const uint8_t *key, const KeyAt &key_at) const {
+  if (size_ == 0) {
+    return kNone;
+  }
+  uint32_t hash = Hash(key);
+  size_t mask = buckets_.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const Bucket &bucket = buckets_[i];
+    if (bucket.slot == kNone) {
+      return kNone;
+    }
+    if (bucket.hash == hash && memcmp(key_at(bucket.slot), key, kWireguardKeyLength) == 0) {
+      return bucket.slot;
+    }
+  }
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "link_quality.h"
+#include "peer_index.h"
+#include "wireguard_key.h"
+
+namespace wireguard_dart {
+
+using PeerKey = std::array<uint8_t, kWireguardKeyLength>;
+
+// Public keys are random, so a few of their bytes hash them well enough
+struct PeerKeyHash {
+  size_t operator()(const PeerKey &key) const {
+    size_t hash;
+    memcpy(&hash, key.data(), sizeof(hash));
+    return hash;
+  }
+};
+
+// One peer's counters as the driver or kernel reported them, with the throughput derived from the previous report
+struct PeerStatistics {
+  PeerKey public_key = {};
+  uint64_t rx_bytes = 0;
+  uint64_t tx_bytes = 0;
+  // In milliseconds since 1970, as Dart gets it, or 0 if there was none
+  uint64_t last_handshake_ms = 0;
+  // In seconds, 0 for none; of peers with PersistentKeepalive = auto the one tuned so far
+  uint16_t persistent_keepalive = 0;
+
+  // Bytes per second since the previous reading, and smoothed over about PeerRateTracker::kSmoothingSeconds
+  double rx_rate = 0;
+  double tx_rate = 0;
+  double rx_rate_ewma = 0;
+  double tx_rate_ewma = 0;
+
+  // From the in-tunnel probes of peers with a ProbeAddress, see LinkQualityProber on Windows
+  LinkQuality link_quality;
+};
+
+// A tunnel's counters, the sums over its peers and the latest handshake of any
+struct TunnelTotals {
+  uint64_t rx_bytes = 0;
+  uint64_t tx_bytes = 0;
+  uint64_t last_handshake_ms = 0;
+
+  bool operator==(const TunnelTotals &other) const {
+    return rx_bytes == other.rx_bytes && tx_bytes == other.tx_bytes && last_handshake_ms == other.last_handshake_ms;
+  }
+};
+TunnelTotals SumPeers(const std::vector<PeerStatistics> &peers);
+
+/**
+ * The peers in the compact layout of peerStatisticsBinary, which Dart reads in place instead of decoding.
+ * Little-endian; a header of uint16 version, uint16 record size, uint32 peer count and uint64 time of the
+ * reading in milliseconds since 1970, then one record per peer: the 32 byte public key, uint64 rx and tx bytes,
+ * uint64 latest handshake in milliseconds since 1970 (0 for none) and float64 smoothed rx and tx bytes per second.
+ * Encoded into encoded, reusing its capacity.
+ */
+constexpr uint16_t kPeerStatisticsVersion = 1;
+constexpr size_t kPeerStatisticsHeaderSize = 16;
+constexpr size_t kPeerStatisticsRecordSize = kWireguardKeyLength + 5 * 8;
+void EncodePeerStatistics(const std::vector<PeerStatistics> &peers, uint64_t now_unix_millis,
+                          std::vector<uint8_t> *encoded);
+
+/**
+ * Throughput of each peer from successive readings of its byte counters. A peer seen for the first time, and
+ * one whose counters went back, e.g. after the driver reset them, starts again with zero rates. Peers missing
+ * from a reading are forgotten. The peers are found by a PeerIndex kept across readings, which is only rebuilt
+ * when some are forgotten. Not synchronized; a tracker shared between threads needs a lock around Update.
+ */
+class PeerRateTracker {
+public:
+  static constexpr double kSmoothingSeconds = 5.0;
+
+  // Fill in the rates of the peers read at now_us, on a monotonic clock
+  void Update(std::vector<PeerStatistics> &peers, int64_t now_us);
+
+private:
+  struct Previous {
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+    int64_t at_us = 0;
+    double rx_rate = 0;
+    double tx_rate = 0;
+    double rx_rate_ewma = 0;
+    double tx_rate_ewma = 0;
+    uint64_t generation = 0;
+  };
+
+  // By slot of index_
+  std::vector<PeerKey> keys_;
+  std::vector<Previous> previous_;
+  PeerIndex index_;
+  uint64_t generation_ = 0;
+};
+
+} // namespace wireguard_dart
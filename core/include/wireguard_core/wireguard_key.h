@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace wireguard_dart {
+
+constexpr size_t kWireguardKeyLength = 32;
+// 43 significant characters plus one '=' of padding
+constexpr size_t kWireguardKeyBase64Length = 44;
+
+// A 44 character base64 key decoded into key's 32 bytes; false, with key unspecified, if it is anything else
+bool KeyFromBase64(std::string_view text, uint8_t *key);
+
+// A 32 byte key as base64, the way configurations write it
+std::string KeyToBase64(const uint8_t *key);
+
+// The same into kWireguardKeyBase64Length characters of text, for serializers that write into a buffer of their own
+void KeyToBase64(const uint8_t *key, char *text);
+
+} // namespace wireguard_dart
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wireguard_dart {
+
+constexpr size_t kX25519KeySize = 32;
+
+// The X25519 function of RFC 7748: scalar times the curve point with the u-coordinate point, in constant time
+void X25519(uint8_t out[kX25519KeySize], const uint8_t scalar[kX25519KeySize], const uint8_t point[kX25519KeySize]);
+
+// The public key of a private key, the private key times the base point
+void X25519PublicKey(uint8_t public_key[kX25519KeySize], const uint8_t private_key[kX25519KeySize]);
+
+// Clears and sets the bits RFC 7748 fixes in a scalar, which WireGuard applies to the private keys it stores
+void X25519Clamp(uint8_t key[kX25519KeySize]);
+
+} // namespace wireguard_dart
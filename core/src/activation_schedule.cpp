@@ -0,0 +1,27 @@
+#include "wireguard_core/activation_schedule.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace wireguard_dart {
+
+ActivationSchedule::ActivationSchedule(const std::vector<Peer> &peers, size_t batch_size)
+    : order_(peers.size()), batch_size_(batch_size == 0 ? peers.size() : batch_size) {
+  std::iota(order_.begin(), order_.end(), 0u);
+  // Stable, so that peers alike keep the configured order
+  std::stable_sort(order_.begin(), order_.end(), [&peers](uint32_t a, uint32_t b) {
+    if (peers[a].priority != peers[b].priority) {
+      return peers[a].priority < peers[b].priority;
+    }
+    return peers[a].last_handshake_ms > peers[b].last_handshake_ms;
+  });
+}
+
+std::vector<uint32_t> ActivationSchedule::Next() {
+  size_t count = (std::min)(batch_size_, order_.size() - taken_);
+  std::vector<uint32_t> batch(order_.begin() + taken_, order_.begin() + taken_ + count);
+  taken_ += count;
+  return batch;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,99 @@
+#include "wireguard_core/address_format.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+size_t FormatHexGroup(uint16_t group, char *out) {
+  size_t written = 0;
+  bool leading = true;
+  for (int shift = 12; shift >= 0; shift -= 4) {
+    uint8_t digit = (group >> shift) & 0xf;
+    if (leading && digit == 0 && shift != 0) {
+      continue;
+    }
+    leading = false;
+    out[written++] = kHexDigits[digit];
+  }
+  return written;
+}
+
+} // namespace
+
+size_t FormatDecimal(uint16_t value, char *out) {
+  char digits[5];
+  size_t count = 0;
+  do {
+    digits[count++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  for (size_t i = 0; i < count; i++) {
+    out[i] = digits[count - 1 - i];
+  }
+  return count;
+}
+
+size_t FormatIPv4Address(const uint8_t *address, char *out) {
+  size_t written = 0;
+  for (int i = 0; i < 4; i++) {
+    if (i != 0) {
+      out[written++] = '.';
+    }
+    written += FormatDecimal(address[i], out + written);
+  }
+  return written;
+}
+
+size_t FormatIPv6Address(const uint8_t *address, char *out) {
+  uint16_t groups[8];
+  for (int i = 0; i < 8; i++) {
+    groups[i] = static_cast<uint16_t>((address[2 * i] << 8) | address[2 * i + 1]);
+  }
+
+  bool mapped = groups[0] == 0 && groups[1] == 0 && groups[2] == 0 && groups[3] == 0 && groups[4] == 0 &&
+                groups[5] == 0xffff;
+  if (mapped) {
+    static const char kPrefix[] = "::ffff:";
+    for (size_t i = 0; i < sizeof(kPrefix) - 1; i++) {
+      out[i] = kPrefix[i];
+    }
+    return sizeof(kPrefix) - 1 + FormatIPv4Address(address + 12, out + sizeof(kPrefix) - 1);
+  }
+
+  // A single zero group is written out, not compressed
+  int best_start = -1;
+  int best_length = 1;
+  for (int i = 0; i < 8;) {
+    if (groups[i] != 0) {
+      i++;
+      continue;
+    }
+    int start = i;
+    while (i < 8 && groups[i] == 0) {
+      i++;
+    }
+    if (i - start > best_length) {
+      best_start = start;
+      best_length = i - start;
+    }
+  }
+
+  size_t written = 0;
+  for (int i = 0; i < 8; i++) {
+    if (i == best_start) {
+      out[written++] = ':';
+      out[written++] = ':';
+      i += best_length - 1;
+      continue;
+    }
+    if (i != 0 && i != best_start + best_length) {
+      out[written++] = ':';
+    }
+    written += FormatHexGroup(groups[i], out + written);
+  }
+  return written;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,180 @@
+#include "wireguard_core/address_parser.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+constexpr int HexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Decimal number of at most max_digits digits that is no larger than max_value; leading zeros are allowed
+bool ParseDecimal(std::string_view str, size_t max_digits, uint32_t max_value, uint32_t &value) {
+  if (str.empty() || str.size() > max_digits) {
+    return false;
+  }
+
+  uint32_t result = 0;
+  for (char c : str) {
+    if (!IsDigit(c)) {
+      return false;
+    }
+    result = result * 10 + static_cast<uint32_t>(c - '0');
+  }
+
+  if (result > max_value) {
+    return false;
+  }
+  value = result;
+  return true;
+}
+
+// Dotted quad into four bytes in network order. Like inet_pton, octets with leading zeros are rejected,
+// as some resolvers read them as octal.
+bool ParseDottedQuad(std::string_view str, uint8_t *bytes) {
+  int octets = 0;
+  size_t pos = 0;
+
+  while (octets < 4) {
+    size_t start = pos;
+    uint32_t value = 0;
+    while (pos < str.size() && IsDigit(str[pos]) && pos - start < 3) {
+      value = value * 10 + static_cast<uint32_t>(str[pos] - '0');
+      pos++;
+    }
+
+    size_t digits = pos - start;
+    if (digits == 0 || value > 255 || (digits > 1 && str[start] == '0')) {
+      return false;
+    }
+    bytes[octets++] = static_cast<uint8_t>(value);
+
+    if (octets < 4) {
+      if (pos >= str.size() || str[pos] != '.') {
+        return false;
+      }
+      pos++;
+    }
+  }
+
+  return pos == str.size();
+}
+
+} // namespace
+
+bool ParseIPv4Address(std::string_view str, uint8_t *address) {
+  uint8_t bytes[4];
+  if (!ParseDottedQuad(str, bytes)) {
+    return false;
+  }
+
+  memcpy(address, bytes, sizeof(bytes));
+  return true;
+}
+
+bool ParseIPv6Address(std::string_view str, uint8_t *address) {
+  uint8_t bytes[16] = {};
+  size_t count = 0;        // Bytes parsed so far
+  int compress_at = -1;    // Byte index where "::" was seen
+  size_t pos = 0;
+
+  if (str.size() >= 2 && str[0] == ':' && str[1] == ':') {
+    compress_at = 0;
+    pos = 2;
+  } else if (!str.empty() && str[0] == ':') {
+    return false;
+  }
+
+  while (pos < str.size()) {
+    size_t group_start = pos;
+    uint32_t value = 0;
+    while (pos < str.size() && pos - group_start < 4) {
+      int hex = HexValue(str[pos]);
+      if (hex < 0) {
+        break;
+      }
+      value = (value << 4) | static_cast<uint32_t>(hex);
+      pos++;
+    }
+
+    if (pos < str.size() && str[pos] == '.') {
+      // Embedded IPv4 address, which has to be the last 4 bytes
+      if (count + 4 > sizeof(bytes) || !ParseDottedQuad(str.substr(group_start), bytes + count)) {
+        return false;
+      }
+      count += 4;
+      pos = str.size();
+      break;
+    }
+
+    if (pos == group_start || count + 2 > sizeof(bytes)) {
+      return false;
+    }
+    bytes[count++] = static_cast<uint8_t>(value >> 8);
+    bytes[count++] = static_cast<uint8_t>(value & 0xFF);
+
+    if (pos == str.size()) {
+      break;
+    }
+    if (str[pos] != ':') {
+      // Not a separator, or a fifth hex digit
+      return false;
+    }
+    pos++;
+
+    if (pos < str.size() && str[pos] == ':') {
+      if (compress_at >= 0) {
+        return false;
+      }
+      compress_at = static_cast<int>(count);
+      pos++;
+    } else if (pos == str.size()) {
+      // Trailing single colon
+      return false;
+    }
+  }
+
+  if (compress_at >= 0) {
+    // "::" has to stand for at least one zero group
+    if (count == sizeof(bytes)) {
+      return false;
+    }
+    size_t tail = count - static_cast<size_t>(compress_at);
+    size_t gap = sizeof(bytes) - count;
+    memmove(bytes + compress_at + gap, bytes + compress_at, tail);
+    memset(bytes + compress_at, 0, gap);
+  } else if (count != sizeof(bytes)) {
+    return false;
+  }
+
+  memcpy(address, bytes, sizeof(bytes));
+  return true;
+}
+
+bool ParseCidr(std::string_view str, uint8_t max_cidr, uint8_t &cidr) {
+  uint32_t value;
+  if (!ParseDecimal(str, 3, max_cidr, value)) {
+    return false;
+  }
+  cidr = static_cast<uint8_t>(value);
+  return true;
+}
+
+bool ParsePort(std::string_view str, uint16_t &port) {
+  uint32_t value;
+  if (!ParseDecimal(str, 5, 65535, value)) {
+    return false;
+  }
+  port = static_cast<uint16_t>(value);
+  return true;
+}
+
+} // namespace wireguard_dart
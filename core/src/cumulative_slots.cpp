@@ -0,0 +1,312 @@
+#include "wireguard_core/cumulative_slots.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+namespace wireguard_dart {
+
+namespace {
+
+// The slot holds the tunnel's totals rather than a peer's
+constexpr uint32_t kTunnelTotals = 1;
+
+using Slot = CumulativeSlots::Slot;
+using Copy = CumulativeSlots::Copy;
+
+// FNV-1a, as the configuration text hash the first version of the file was written with
+uint64_t Hash(std::string_view bytes, uint64_t hash = 14695981039346656037ULL) {
+  for (unsigned char c : bytes) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t CopyChecksum(const Slot &slot, const Copy &copy) {
+  uint64_t checksum = Hash(std::string_view(reinterpret_cast<const char *>(&slot), offsetof(Slot, copies)));
+  const char *start = reinterpret_cast<const char *>(&copy) + sizeof(copy.checksum);
+  checksum = Hash(std::string_view(start, sizeof(copy) - sizeof(copy.checksum)), checksum);
+  // Never the marker of no copy
+  return checksum == 0 ? 1 : checksum;
+}
+
+// The newer intact copy, nullptr for a free slot
+const Copy *LatestCopy(const Slot &slot) {
+  const Copy *latest = nullptr;
+  for (const Copy &copy : slot.copies) {
+    if (copy.checksum != 0 && CopyChecksum(slot, copy) == copy.checksum &&
+        (!latest || copy.sequence > latest->sequence)) {
+      latest = &copy;
+    }
+  }
+  return latest;
+}
+
+// Over the older copy, so the newer one stays intact until this one is sealed
+void WriteCopy(Slot &slot, Copy copy) {
+  const Copy *latest = LatestCopy(slot);
+  copy.sequence = latest ? latest->sequence + 1 : 1;
+  Copy &target = slot.copies[copy.sequence % 2];
+  target.checksum = 0;
+  // The compiler may not move the seal before the fields it covers
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  memcpy(reinterpret_cast<char *>(&target) + sizeof(target.checksum),
+         reinterpret_cast<const char *>(&copy) + sizeof(copy.checksum), sizeof(copy) - sizeof(copy.checksum));
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  target.checksum = CopyChecksum(slot, target);
+}
+
+CumulativeSlots::Counts ToCounts(const Slot &slot) {
+  CumulativeSlots::Counts counts;
+  if (const auto *copy = LatestCopy(slot)) {
+    counts.rx_bytes = copy->rx_bytes;
+    counts.tx_bytes = copy->tx_bytes;
+    counts.since_ms = copy->since_ms;
+    counts.updated_ms = copy->updated_ms;
+  }
+  return counts;
+}
+
+std::string SlotName(const Slot &slot) {
+  return std::string(slot.tunnel_name, strnlen(slot.tunnel_name, CumulativeSlots::kMaxName));
+}
+
+// Whether the slot belongs to one of the named tunnels, or any tunnel with none named
+bool IsNamed(const Slot &slot, const std::vector<std::string> &tunnel_names) {
+  if (tunnel_names.empty()) {
+    return true;
+  }
+  std::string name = SlotName(slot);
+  return std::any_of(tunnel_names.begin(), tunnel_names.end(), [&name](const std::string &tunnel_name) {
+    return tunnel_name.substr(0, CumulativeSlots::kMaxName - 1) == name;
+  });
+}
+
+} // namespace
+
+void CumulativeSlots::Attach(Slot *slots, size_t count) {
+  slots_ = slots;
+  count_ = count;
+  index_.clear();
+  free_.clear();
+  peers_.clear();
+  removed_.clear();
+  seen_.assign(count, 0);
+  // Highest first, so slots are taken from the front
+  for (size_t i = count; i-- > 0;) {
+    const Slot &slot = slots_[i];
+    if (!LatestCopy(slot)) {
+      free_.push_back(i);
+      continue;
+    }
+    PeerKey public_key;
+    memcpy(public_key.data(), slot.public_key, public_key.size());
+    bool totals = (slot.flags & kTunnelTotals) != 0;
+    index_.emplace(IndexKey(SlotName(slot), totals ? nullptr : &public_key), i);
+    if (!totals) {
+      peers_[SlotName(slot)].push_back(i);
+    }
+  }
+}
+
+std::string CumulativeSlots::IndexKey(const std::string &tunnel_name, const PeerKey *public_key) {
+  std::string key = tunnel_name.substr(0, kMaxName - 1);
+  key.push_back('\0');
+  if (public_key) {
+    key.append(reinterpret_cast<const char *>(public_key->data()), public_key->size());
+  }
+  return key;
+}
+
+bool CumulativeSlots::IsAdapterGone(size_t index, std::map<std::pair<uint64_t, uint64_t>, bool> &gone) const {
+  const Copy *latest = LatestCopy(slots_[index]);
+  if (!adapter_exists_ || !latest || latest->luid == 0) {
+    return false;
+  }
+  std::pair<uint64_t, uint64_t> adapter(latest->luid, latest->instance);
+  auto known = gone.find(adapter);
+  if (known == gone.end()) {
+    known = gone.emplace(adapter, !adapter_exists_(latest->luid, latest->instance)).first;
+  }
+  return known->second;
+}
+
+void CumulativeSlots::Free(size_t index) {
+  Slot &slot = slots_[index];
+  PeerKey public_key;
+  memcpy(public_key.data(), slot.public_key, public_key.size());
+  std::string name = SlotName(slot);
+  index_.erase(IndexKey(name, (slot.flags & kTunnelTotals) ? nullptr : &public_key));
+  auto peers = peers_.find(name);
+  if (peers != peers_.end()) {
+    peers->second.erase(std::remove(peers->second.begin(), peers->second.end(), index), peers->second.end());
+  }
+  removed_.erase(index);
+  // Unsealed first, so a crash part way through leaves a free slot
+  slot.copies[0].checksum = 0;
+  slot.copies[1].checksum = 0;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  memset(&slot, 0, sizeof(slot));
+  seen_[index] = 0;
+  free_.push_back(index);
+}
+
+Slot *CumulativeSlots::Find(const std::string &tunnel_name, const PeerKey *public_key) {
+  std::string key = IndexKey(tunnel_name, public_key);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    return &slots_[it->second];
+  }
+  if (free_.empty()) {
+    // A tunnel's totals still count once its peers are gone, so only those of removed peers are given back
+    if (removed_.empty()) {
+      return nullptr;
+    }
+    Free(*removed_.begin());
+  }
+
+  size_t index = free_.back();
+  free_.pop_back();
+  index_.emplace(std::move(key), index);
+  // Both copies are free, so the key can be written before the first of them
+  Slot &slot = slots_[index];
+  memset(&slot, 0, sizeof(slot));
+  memcpy(slot.tunnel_name, tunnel_name.data(), (std::min)(tunnel_name.size(), kMaxName - 1));
+  if (public_key) {
+    memcpy(slot.public_key, public_key->data(), public_key->size());
+  } else {
+    slot.flags = kTunnelTotals;
+  }
+  return &slot;
+}
+
+bool CumulativeSlots::Update(const std::string &tunnel_name, uint64_t luid, uint64_t instance,
+                             const std::vector<PeerStatistics> &peers, uint64_t now_ms) {
+  if (!slots_) {
+    return true;
+  }
+  uint64_t serial = ++serial_;
+  Slot *tunnel = Find(tunnel_name, nullptr);
+  if (!tunnel) {
+    return false;
+  }
+  const Copy *tunnel_latest = LatestCopy(*tunnel);
+  Copy totals = tunnel_latest ? *tunnel_latest : Copy{};
+  if (!tunnel_latest) {
+    totals.since_ms = now_ms;
+  }
+
+  bool complete = true;
+  uint64_t rx_added = 0;
+  uint64_t tx_added = 0;
+  std::vector<size_t> seen;
+  seen.reserve(peers.size());
+  for (const PeerStatistics &peer : peers) {
+    Slot *slot = Find(tunnel_name, &peer.public_key);
+    if (!slot) {
+      complete = false;
+      continue;
+    }
+    size_t index = slot - slots_;
+    seen_[index] = serial;
+    seen.push_back(index);
+    // Back in the tunnel before its slot went to another peer
+    if (!removed_.empty()) {
+      removed_.erase(index);
+    }
+    const Copy *latest = LatestCopy(*slot);
+    Copy copy = latest ? *latest : Copy{};
+    if (!latest) {
+      copy.since_ms = now_ms;
+    }
+    // A new peer, a recreated adapter or a peer the driver dropped and added again: the reading is all new
+    bool restarted = !latest || copy.luid != luid || copy.instance != instance ||
+                     peer.rx_bytes < copy.driver_rx_bytes || peer.tx_bytes < copy.driver_tx_bytes;
+    uint64_t rx = restarted ? peer.rx_bytes : peer.rx_bytes - copy.driver_rx_bytes;
+    uint64_t tx = restarted ? peer.tx_bytes : peer.tx_bytes - copy.driver_tx_bytes;
+    // An idle peer's pages are not touched
+    if (!restarted && rx == 0 && tx == 0) {
+      continue;
+    }
+    copy.luid = luid;
+    copy.instance = instance;
+    copy.driver_rx_bytes = peer.rx_bytes;
+    copy.driver_tx_bytes = peer.tx_bytes;
+    copy.rx_bytes += rx;
+    copy.tx_bytes += tx;
+    if (rx != 0 || tx != 0) {
+      copy.updated_ms = now_ms;
+    }
+    WriteCopy(*slot, copy);
+    rx_added += rx;
+    tx_added += tx;
+  }
+  // Only now, so peers seen in the previous update are not taken for removed while this one goes through them
+  std::vector<size_t> &known = peers_[tunnel_name.substr(0, kMaxName - 1)];
+  for (size_t index : known) {
+    if (seen_[index] != serial) {
+      removed_.insert(index);
+    }
+  }
+  known = std::move(seen);
+
+  if (tunnel_latest && rx_added == 0 && tx_added == 0 && totals.luid == luid && totals.instance == instance) {
+    return complete;
+  }
+  totals.luid = luid;
+  totals.instance = instance;
+  totals.rx_bytes += rx_added;
+  totals.tx_bytes += tx_added;
+  if (rx_added != 0 || tx_added != 0) {
+    totals.updated_ms = now_ms;
+  }
+  WriteCopy(*tunnel, totals);
+  return complete;
+}
+
+std::map<std::string, CumulativeSlots::Tunnel> CumulativeSlots::Read(const std::vector<std::string> &tunnel_names,
+                                                                    bool reset, uint64_t now_ms) {
+  std::map<std::string, Tunnel> tunnels;
+  if (!slots_) {
+    return tunnels;
+  }
+  std::map<std::pair<uint64_t, uint64_t>, bool> gone;
+  std::vector<size_t> stale;
+  for (const auto &entry : index_) {
+    Slot &slot = slots_[entry.second];
+    if (!IsNamed(slot, tunnel_names)) {
+      continue;
+    }
+    Tunnel &tunnel = tunnels[SlotName(slot)];
+    if (slot.flags & kTunnelTotals) {
+      tunnel.totals = ToCounts(slot);
+    } else {
+      PeerKey public_key;
+      memcpy(public_key.data(), slot.public_key, public_key.size());
+      tunnel.peers[public_key] = ToCounts(slot);
+    }
+    if (!reset) {
+      continue;
+    }
+    if (removed_.count(entry.second) != 0 || IsAdapterGone(entry.second, gone)) {
+      stale.push_back(entry.second);
+      continue;
+    }
+    // The driver's reading stays, so only what it counts from now on is added
+    Copy copy = *LatestCopy(slot);
+    copy.rx_bytes = 0;
+    copy.tx_bytes = 0;
+    copy.since_ms = now_ms;
+    copy.updated_ms = 0;
+    WriteCopy(slot, copy);
+  }
+  for (size_t index : stale) {
+    Free(index);
+  }
+  return tunnels;
+}
+
+} // namespace wireguard_dart
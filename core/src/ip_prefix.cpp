@@ -0,0 +1,588 @@
+#include "wireguard_core/ip_prefix.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <tuple>
+
+#include "wireguard_core/address_parser.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// A prefix as a left-aligned 128-bit key, the path it takes through a binary radix trie. IPv4 addresses use
+// the top 32 bits, so both families share the same bit operations.
+struct PrefixKey {
+  uint64_t high;
+  uint64_t low;
+  uint8_t length;
+  int family;
+};
+
+// The first count bytes, left-aligned in 64 bits
+uint64_t ReadBigEndian64Prefix(const uint8_t *bytes, int count) {
+  uint64_t value = 0;
+  for (int i = 0; i < count; i++) {
+    value = (value << 8) | bytes[i];
+  }
+  return value << (8 * (8 - count));
+}
+
+void WriteBigEndian64(uint64_t value, uint8_t *bytes) {
+  for (int i = 7; i >= 0; i--) {
+    bytes[i] = static_cast<uint8_t>(value & 0xFF);
+    value >>= 8;
+  }
+}
+
+// Mask keeping the first length bits of a 64-bit half that starts at bit offset
+uint64_t HalfMask(int length, int offset) {
+  int bits = length - offset;
+  if (bits <= 0) {
+    return 0;
+  }
+  if (bits >= 64) {
+    return ~uint64_t{0};
+  }
+  return ~uint64_t{0} << (64 - bits);
+}
+
+PrefixKey Masked(const PrefixKey &key, int length) {
+  return PrefixKey{key.high & HalfMask(length, 0), key.low & HalfMask(length, 64), static_cast<uint8_t>(length),
+                   key.family};
+}
+
+bool SameBits(const PrefixKey &a, const PrefixKey &b) { return a.high == b.high && a.low == b.low; }
+
+// Bit index counts from the most significant bit
+bool BitAt(const PrefixKey &key, int index) {
+  return index < 64 ? ((key.high >> (63 - index)) & 1) != 0 : ((key.low >> (127 - index)) & 1) != 0;
+}
+
+bool Contains(const PrefixKey &outer, const PrefixKey &inner) {
+  return outer.family == inner.family && outer.length <= inner.length && SameBits(Masked(inner, outer.length), outer);
+}
+
+// Whether a and b are the two halves of one parent; a must be the lower one
+bool AreSiblings(const PrefixKey &a, const PrefixKey &b) {
+  if (a.family != b.family || a.length != b.length || a.length == 0) {
+    return false;
+  }
+  int parent_length = a.length - 1;
+  return !BitAt(a, parent_length) && BitAt(b, parent_length) &&
+         SameBits(Masked(a, parent_length), Masked(b, parent_length));
+}
+
+// The other half of the key's parent
+PrefixKey Sibling(const PrefixKey &key) {
+  PrefixKey sibling = key;
+  int index = key.length - 1;
+  if (index < 64) {
+    sibling.high ^= uint64_t{1} << (63 - index);
+  } else {
+    sibling.low ^= uint64_t{1} << (127 - index);
+  }
+  return sibling;
+}
+
+bool ToKey(const NetworkPrefix &prefix, PrefixKey &key) {
+  if (prefix.family == AF_INET && prefix.prefix_length <= 32) {
+    uint64_t address = ReadBigEndian64Prefix(prefix.address, 4);
+    key = Masked(PrefixKey{address, 0, prefix.prefix_length, AF_INET}, prefix.prefix_length);
+    return true;
+  }
+  if (prefix.family == AF_INET6 && prefix.prefix_length <= 128) {
+    key = Masked(PrefixKey{ReadBigEndian64Prefix(prefix.address, 8), ReadBigEndian64Prefix(prefix.address + 8, 8),
+                           prefix.prefix_length, AF_INET6},
+                 prefix.prefix_length);
+    return true;
+  }
+  return false;
+}
+
+NetworkPrefix FromKey(const PrefixKey &key) {
+  NetworkPrefix prefix = {};
+  prefix.family = key.family;
+  prefix.prefix_length = key.length;
+  uint8_t bytes[8];
+  WriteBigEndian64(key.high, bytes);
+  memcpy(prefix.address, bytes, key.family == AF_INET ? 4 : 8);
+  if (key.family == AF_INET6) {
+    WriteBigEndian64(key.low, prefix.address + 8);
+  }
+  return prefix;
+}
+
+// A range of addresses as left-aligned 128-bit keys, first and last inclusive
+struct AddressRange {
+  int family;
+  uint64_t first_high;
+  uint64_t first_low;
+  uint64_t last_high;
+  uint64_t last_low;
+};
+
+bool Less(uint64_t a_high, uint64_t a_low, uint64_t b_high, uint64_t b_low) {
+  return a_high < b_high || (a_high == b_high && a_low < b_low);
+}
+
+// value + 1, false if it wrapped around
+bool Increment(uint64_t &high, uint64_t &low) {
+  if (++low == 0) {
+    return ++high != 0;
+  }
+  return true;
+}
+
+// value - 1 of a value that is not zero
+void Decrement(uint64_t &high, uint64_t &low) {
+  if (low-- == 0) {
+    high--;
+  }
+}
+
+AddressRange ToRange(const PrefixKey &key) {
+  return AddressRange{key.family, key.high, key.low, key.high | ~HalfMask(key.length, 0),
+                      key.low | ~HalfMask(key.length, 64)};
+}
+
+// Sorted by family and first address, with overlapping and adjacent ranges merged
+std::vector<AddressRange> ToMergedRanges(const std::vector<NetworkPrefix> &prefixes) {
+  std::vector<AddressRange> ranges;
+  ranges.reserve(prefixes.size());
+  for (const auto &prefix : prefixes) {
+    PrefixKey key;
+    if (ToKey(prefix, key)) {
+      ranges.push_back(ToRange(key));
+    }
+  }
+  std::sort(ranges.begin(), ranges.end(), [](const AddressRange &a, const AddressRange &b) {
+    return std::tie(a.family, a.first_high, a.first_low) < std::tie(b.family, b.first_high, b.first_low);
+  });
+
+  std::vector<AddressRange> merged;
+  for (const auto &range : ranges) {
+    if (!merged.empty() && merged.back().family == range.family) {
+      AddressRange &last = merged.back();
+      uint64_t next_high = last.last_high;
+      uint64_t next_low = last.last_low;
+      // Up to the end of the address space the last range already covers everything after it
+      if (!Increment(next_high, next_low) || !Less(next_high, next_low, range.first_high, range.first_low)) {
+        if (Less(last.last_high, last.last_low, range.last_high, range.last_low)) {
+          last.last_high = range.last_high;
+          last.last_low = range.last_low;
+        }
+        continue;
+      }
+    }
+    merged.push_back(range);
+  }
+  return merged;
+}
+
+int CountTrailingZeros(uint64_t high, uint64_t low) {
+  int count = 0;
+  if (low == 0) {
+    count = 64;
+    low = high;
+    if (low == 0) {
+      return 128;
+    }
+  }
+  while ((low & 1) == 0) {
+    low >>= 1;
+    count++;
+  }
+  return count;
+}
+
+// floor(log2(size)) for the size of first..last, 128 for the whole address space
+int BlockBitsFitting(const AddressRange &range) {
+  uint64_t size_high = range.last_high - range.first_high - (range.last_low < range.first_low ? 1 : 0);
+  uint64_t size_low = range.last_low - range.first_low;
+  if (!Increment(size_high, size_low)) {
+    return 128;
+  }
+  int bits = 127;
+  while (!(bits >= 64 ? (size_high >> (bits - 64)) & 1 : (size_low >> bits) & 1)) {
+    bits--;
+  }
+  return bits;
+}
+
+// The largest aligned blocks that make up the range, which are the fewest prefixes covering it
+void AppendCover(AddressRange range, std::vector<NetworkPrefix> &result) {
+  while (true) {
+    int bits = (std::min)(CountTrailingZeros(range.first_high, range.first_low), BlockBitsFitting(range));
+    result.push_back(FromKey(PrefixKey{range.first_high, range.first_low, static_cast<uint8_t>(128 - bits),
+                                       range.family}));
+    if (bits == 128) {
+      return;
+    }
+    // Add 2^bits; past the end of the range or the address space is done
+    uint64_t step_high = bits >= 64 ? uint64_t{1} << (bits - 64) : 0;
+    uint64_t step_low = bits >= 64 ? 0 : uint64_t{1} << bits;
+    uint64_t low = range.first_low + step_low;
+    uint64_t high = range.first_high + step_high + (low < range.first_low ? 1 : 0);
+    if (Less(high, low, range.first_high, range.first_low) || (high == 0 && low == 0) ||
+        Less(range.last_high, range.last_low, high, low)) {
+      return;
+    }
+    range.first_high = high;
+    range.first_low = low;
+  }
+}
+
+} // namespace
+
+std::vector<NetworkPrefix> SubtractPrefixes(const std::vector<NetworkPrefix> &allowed,
+                                            const std::vector<NetworkPrefix> &excluded) {
+  std::vector<AddressRange> kept = ToMergedRanges(allowed);
+  std::vector<AddressRange> removed = ToMergedRanges(excluded);
+
+  std::vector<NetworkPrefix> result;
+  size_t next_removed = 0;
+  for (AddressRange range : kept) {
+    bool remaining = true;
+    // Skip exclusions of an earlier family or that end before this range
+    while (next_removed < removed.size() &&
+           (removed[next_removed].family < range.family ||
+            (removed[next_removed].family == range.family &&
+             Less(removed[next_removed].last_high, removed[next_removed].last_low, range.first_high,
+                  range.first_low)))) {
+      next_removed++;
+    }
+    // Cut out every exclusion that starts inside the range; the last one may reach into the next range
+    for (size_t i = next_removed; remaining && i < removed.size() && removed[i].family == range.family; i++) {
+      const AddressRange &cut = removed[i];
+      if (Less(range.last_high, range.last_low, cut.first_high, cut.first_low)) {
+        break;
+      }
+      if (Less(range.first_high, range.first_low, cut.first_high, cut.first_low)) {
+        AddressRange before = range;
+        before.last_high = cut.first_high;
+        before.last_low = cut.first_low;
+        Decrement(before.last_high, before.last_low);
+        AppendCover(before, result);
+      }
+      if (!Less(cut.last_high, cut.last_low, range.last_high, range.last_low)) {
+        remaining = false;
+        break;
+      }
+      range.first_high = cut.last_high;
+      range.first_low = cut.last_low;
+      Increment(range.first_high, range.first_low);
+    }
+    if (remaining) {
+      AppendCover(range, result);
+    }
+  }
+  return result;
+}
+
+std::vector<NetworkPrefix> AggregatePrefixes(const std::vector<NetworkPrefix> &prefixes) {
+  std::vector<PrefixKey> keys;
+  keys.reserve(prefixes.size());
+  for (const auto &prefix : prefixes) {
+    PrefixKey key;
+    if (ToKey(prefix, key)) {
+      keys.push_back(key);
+    }
+  }
+
+  // In trie pre-order: a prefix comes right before everything it contains
+  std::sort(keys.begin(), keys.end(), [](const PrefixKey &a, const PrefixKey &b) {
+    return std::tie(a.family, a.high, a.low, a.length) < std::tie(b.family, b.high, b.low, b.length);
+  });
+
+  // Walking in that order with a stack builds the trie bottom-up: covered prefixes are skipped, and whenever
+  // the top two entries are siblings they collapse into their parent, which may in turn pair up with the entry
+  // below it. Kept entries never overlap, so only the top of the stack has to be checked.
+  std::vector<PrefixKey> merged;
+  merged.reserve(keys.size());
+  for (const auto &key : keys) {
+    if (!merged.empty() && Contains(merged.back(), key)) {
+      continue;
+    }
+
+    merged.push_back(key);
+    while (merged.size() >= 2 && AreSiblings(merged[merged.size() - 2], merged.back())) {
+      merged.pop_back();
+      merged.back() = Masked(merged.back(), merged.back().length - 1);
+    }
+  }
+
+  std::vector<NetworkPrefix> result;
+  result.reserve(merged.size());
+  for (const auto &key : merged) {
+    result.push_back(FromKey(key));
+  }
+  return result;
+}
+
+bool SplitDefaultRoutes(std::vector<NetworkPrefix> &prefixes) {
+  bool split = false;
+  size_t count = prefixes.size();
+  for (size_t i = 0; i < count; i++) {
+    if (prefixes[i].prefix_length != 0 || (prefixes[i].family != AF_INET && prefixes[i].family != AF_INET6)) {
+      continue;
+    }
+
+    // The lower half keeps the all-zero address, the upper one only has the top bit set
+    NetworkPrefix upper = {};
+    upper.family = prefixes[i].family;
+    upper.prefix_length = 1;
+    upper.address[0] = 0x80;
+
+    prefixes[i].prefix_length = 1;
+    memset(prefixes[i].address, 0, sizeof(prefixes[i].address));
+    prefixes.push_back(upper);
+    split = true;
+  }
+  return split;
+}
+
+namespace {
+
+// Leading bits a and b have in common, 128 if they are equal
+int CommonLength(uint64_t a_high, uint64_t a_low, uint64_t b_high, uint64_t b_low) {
+  uint64_t differ = a_high ^ b_high;
+  int count = 0;
+  if (differ == 0) {
+    count = 64;
+    differ = a_low ^ b_low;
+    if (differ == 0) {
+      return 128;
+    }
+  }
+  while ((differ & (uint64_t{1} << 63)) == 0) {
+    differ <<= 1;
+    count++;
+  }
+  return count;
+}
+
+int TrieRoot(int family) { return family == AF_INET ? 0 : 1; }
+
+} // namespace
+
+uint32_t PrefixTrie::AddNode(uint64_t high, uint64_t low, uint8_t length, uint32_t value) {
+  nodes_.push_back(Node{high, low, {kNone, kNone}, value, length});
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+bool PrefixTrie::Insert(const NetworkPrefix &prefix, uint32_t value) {
+  PrefixKey key;
+  if (!ToKey(prefix, key)) {
+    return false;
+  }
+  // The link to follow, a root or a child of parent; indices, as adding nodes moves them
+  uint32_t parent = kNone;
+  bool side = false;
+  auto link = [&]() -> uint32_t & {
+    return parent == kNone ? roots_[TrieRoot(key.family)] : nodes_[parent].child[side];
+  };
+
+  while (true) {
+    uint32_t index = link();
+    if (index == kNone) {
+      uint32_t added = AddNode(key.high, key.low, key.length, value);
+      link() = added;
+      size_++;
+      return true;
+    }
+    const PrefixKey node{nodes_[index].high, nodes_[index].low, nodes_[index].length, key.family};
+    int common = std::min({CommonLength(key.high, key.low, node.high, node.low), int(key.length), int(node.length)});
+    if (common == node.length && common == key.length) {
+      if (nodes_[index].value == kNone) {
+        nodes_[index].value = value;
+        size_++;
+      }
+      return true;
+    }
+    if (common == node.length) {
+      parent = index;
+      side = BitAt(key, node.length);
+      continue;
+    }
+
+    // The new prefix holds the node, or both branch off where they differ
+    PrefixKey branch = Masked(key, common);
+    uint32_t added = AddNode(branch.high, branch.low, branch.length, common == key.length ? value : kNone);
+    nodes_[added].child[BitAt(node, common)] = index;
+    if (common != key.length) {
+      uint32_t leaf = AddNode(key.high, key.low, key.length, value);
+      nodes_[added].child[BitAt(key, common)] = leaf;
+    }
+    link() = added;
+    size_++;
+    return true;
+  }
+}
+
+uint32_t PrefixTrie::Lookup(int family, const uint8_t *address) const {
+  if (family != AF_INET && family != AF_INET6) {
+    return kNone;
+  }
+  const PrefixKey key{ReadBigEndian64Prefix(address, family == AF_INET ? 4 : 8),
+                      family == AF_INET ? 0 : ReadBigEndian64Prefix(address + 8, 8), 128, family};
+  uint32_t found = kNone;
+  for (uint32_t index = roots_[TrieRoot(family)]; index != kNone;) {
+    const Node &node = nodes_[index];
+    if (((key.high ^ node.high) & HalfMask(node.length, 0)) != 0 ||
+        ((key.low ^ node.low) & HalfMask(node.length, 64)) != 0) {
+      break;
+    }
+    if (node.value != kNone) {
+      found = node.value;
+    }
+    if (node.length == 128) {
+      break;
+    }
+    index = node.child[BitAt(key, node.length)];
+  }
+  return found;
+}
+
+void PrefixTrie::Clear() {
+  nodes_.clear();
+  roots_[0] = roots_[1] = kNone;
+  size_ = 0;
+}
+
+bool RouteSet::Less::operator()(const NetworkPrefix &a, const NetworkPrefix &b) const {
+  if (a.family != b.family) {
+    return a.family < b.family;
+  }
+  int order = memcmp(a.address, b.address, sizeof(a.address));
+  return order != 0 ? order < 0 : a.prefix_length < b.prefix_length;
+}
+
+void RouteSet::Assign(const std::vector<NetworkPrefix> &prefixes) {
+  Clear();
+  std::vector<NetworkPrefix> distinct;
+  distinct.reserve(prefixes.size());
+  for (const auto &prefix : prefixes) {
+    PrefixKey key;
+    if (ToKey(prefix, key) && counts_[FromKey(key)]++ == 0) {
+      distinct.push_back(FromKey(key));
+    }
+  }
+  std::vector<NetworkPrefix> routes = AggregatePrefixes(distinct);
+  routes_.insert(routes.begin(), routes.end());
+}
+
+void RouteSet::Change(const std::vector<NetworkPrefix> &added, const std::vector<NetworkPrefix> &removed,
+                      std::vector<NetworkPrefix> *added_routes, std::vector<NetworkPrefix> *removed_routes) {
+  // +1 for a route that appeared, -1 for one that went; one that goes in one region and comes back in a wider
+  // one nets out
+  std::map<NetworkPrefix, int, Less> changes;
+  for (const auto &prefix : removed) {
+    PrefixKey key;
+    if (!ToKey(prefix, key)) {
+      continue;
+    }
+    auto count = counts_.find(FromKey(key));
+    if (count == counts_.end() || --count->second > 0) {
+      continue;
+    }
+    counts_.erase(count);
+    // Still covered by a shorter prefix, the routes stay as they are; at most one lookup per bit
+    bool covered = false;
+    for (int length = 0; length < key.length && !covered; length++) {
+      covered = counts_.count(FromKey(Masked(key, length))) > 0;
+    }
+    if (!covered) {
+      Reaggregate(FromKey(key), false, &changes);
+    }
+  }
+  for (const auto &prefix : added) {
+    PrefixKey key;
+    if (ToKey(prefix, key) && counts_[FromKey(key)]++ == 0) {
+      Reaggregate(FromKey(key), true, &changes);
+    }
+  }
+
+  for (const auto &change : changes) {
+    if (change.second > 0) {
+      added_routes->push_back(change.first);
+    } else if (change.second < 0) {
+      removed_routes->push_back(change.first);
+    }
+  }
+}
+
+void RouteSet::Reaggregate(NetworkPrefix prefix, bool added, std::map<NetworkPrefix, int, Less> *changes) {
+  PrefixKey region;
+  ToKey(prefix, region);
+  // Routes never overlap, so one holding the prefix is the last that starts at or before it
+  auto after = routes_.upper_bound(prefix);
+  if (after != routes_.begin()) {
+    PrefixKey route;
+    ToKey(*std::prev(after), route);
+    if (Contains(route, region)) {
+      // A prefix added inside a route leaves it as it is
+      if (added) {
+        return;
+      }
+      region = route;
+    }
+  }
+
+  for (;;) {
+    // The prefixes inside the region follow one another, from the region's own place on
+    NetworkPrefix start = FromKey(region);
+    std::vector<NetworkPrefix> inside;
+    for (auto it = counts_.lower_bound(start); it != counts_.end(); ++it) {
+      PrefixKey key;
+      if (!ToKey(it->first, key) || !Contains(region, key)) {
+        break;
+      }
+      inside.push_back(it->first);
+    }
+    std::vector<NetworkPrefix> aggregated = AggregatePrefixes(inside);
+    if (aggregated.size() == 1 && aggregated[0].prefix_length == region.length && region.length > 0 &&
+        routes_.count(FromKey(Sibling(region))) > 0) {
+      region = Masked(region, region.length - 1);
+      continue;
+    }
+
+    auto first = routes_.lower_bound(start);
+    auto last = first;
+    for (PrefixKey route; last != routes_.end() && ToKey(*last, route) && Contains(region, route); ++last) {
+      (*changes)[*last]--;
+    }
+    routes_.erase(first, last);
+    for (const auto &route : aggregated) {
+      (*changes)[route]++;
+      routes_.insert(route);
+    }
+    return;
+  }
+}
+
+void RouteSet::Clear() {
+  counts_.clear();
+  routes_.clear();
+}
+
+bool ParseNetworkPrefix(std::string_view str, NetworkPrefix &prefix) {
+  size_t slash = str.find('/');
+  std::string_view address = str.substr(0, slash);
+  prefix = {};
+  if (ParseIPv4Address(address, prefix.address)) {
+    prefix.family = AF_INET;
+    prefix.prefix_length = 32;
+  } else if (ParseIPv6Address(address, prefix.address)) {
+    prefix.family = AF_INET6;
+    prefix.prefix_length = 128;
+  } else {
+    return false;
+  }
+  return slash == std::string_view::npos ||
+         ParseCidr(str.substr(slash + 1), prefix.prefix_length, prefix.prefix_length);
+}
+
+} // namespace wireguard_dart
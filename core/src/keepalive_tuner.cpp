@@ -0,0 +1,79 @@
+#include "wireguard_core/keepalive_tuner.h"
+
+#include <algorithm>
+
+namespace wireguard_dart {
+
+KeepaliveTuner::KeepaliveTuner(uint16_t min, uint16_t max, uint16_t start)
+    : min_(min), max_(max), current_(start == 0 ? InitialInterval(min, max) : std::min(std::max(start, min), max)) {}
+
+uint16_t KeepaliveTuner::InitialInterval(uint16_t min, uint16_t max) {
+  return std::min(std::max(kInitial, min), max);
+}
+
+uint16_t KeepaliveTuner::Update(const PeerStatistics &reading, uint64_t now_ms) {
+  bool baseline = updated_ms_ == 0 || reading.tx_bytes < tx_bytes_ || reading.rx_bytes < rx_bytes_;
+  bool received = !baseline && reading.rx_bytes > rx_bytes_;
+  // Only a peer that is sending data can be told apart from one that is just idle
+  uint64_t elapsed_ms = now_ms > updated_ms_ ? now_ms - updated_ms_ : 0;
+  uint64_t idle_bytes = kHandshakeBytes * (elapsed_ms / kRekeyTimeoutMs + 1) +
+                        kKeepaliveBytes * (elapsed_ms / (uint64_t(current_) * 1000) + 1);
+  bool sent_data = !baseline && reading.tx_bytes - tx_bytes_ > idle_bytes;
+  tx_bytes_ = reading.tx_bytes;
+  rx_bytes_ = reading.rx_bytes;
+  updated_ms_ = now_ms;
+  if (held_since_ms_ == 0) {
+    held_since_ms_ = now_ms;
+  }
+  if (baseline || received) {
+    silent_since_ms_ = 0;
+  } else if (sent_data && silent_since_ms_ == 0) {
+    silent_since_ms_ = now_ms;
+  }
+  // Nothing is learned before the first session
+  if (reading.last_handshake_ms == 0) {
+    return 0;
+  }
+
+  if (failing_) {
+    if (received) {
+      failing_ = false;
+      held_since_ms_ = now_ms;
+    }
+    return 0;
+  }
+  if (silent_since_ms_ != 0 && now_ms - silent_since_ms_ >= kSilenceMs) {
+    silent_since_ms_ = 0;
+    failing_ = true;
+    bad_ = current_;
+    // The network may have changed under an interval that held before
+    if (good_ >= bad_) {
+      good_ = 0;
+    }
+    return SwitchTo(good_ != 0 ? good_ : std::max<uint16_t>(min_, current_ / 2), now_ms);
+  }
+
+  if (now_ms - held_since_ms_ < kHoldMs) {
+    return 0;
+  }
+  held_since_ms_ = now_ms;
+  good_ = current_;
+  if (bad_ == 0) {
+    return SwitchTo(static_cast<uint16_t>(std::min<uint32_t>(max_, uint32_t(current_) * 2)), now_ms);
+  }
+  if (bad_ - good_ <= kResolution) {
+    return 0;
+  }
+  return SwitchTo(static_cast<uint16_t>((good_ + bad_) / 2), now_ms);
+}
+
+uint16_t KeepaliveTuner::SwitchTo(uint16_t interval, uint64_t now_ms) {
+  if (interval == current_) {
+    return 0;
+  }
+  current_ = interval;
+  held_since_ms_ = now_ms;
+  return interval;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,55 @@
+#include "wireguard_core/link_quality.h"
+
+#include <algorithm>
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr uint32_t kLost = UINT32_MAX;
+
+} // namespace
+
+LinkQualityWindow::LinkQualityWindow(size_t capacity) : capacity_(std::max(capacity, size_t(1))) {
+  outcomes_.reserve(capacity_);
+}
+
+void LinkQualityWindow::RecordReply(uint32_t rtt_ms) { Record(std::min(rtt_ms, kLost - 1)); }
+
+void LinkQualityWindow::RecordLoss() { Record(kLost); }
+
+void LinkQualityWindow::Record(uint32_t outcome) {
+  if (outcomes_.size() < capacity_) {
+    outcomes_.push_back(outcome);
+  } else {
+    outcomes_[next_] = outcome;
+  }
+  next_ = (next_ + 1) % capacity_;
+}
+
+LinkQuality LinkQualityWindow::Summarize() const {
+  LinkQuality quality;
+  quality.probes = static_cast<uint32_t>(outcomes_.size());
+  std::vector<uint32_t> rtts;
+  rtts.reserve(outcomes_.size());
+  for (uint32_t outcome : outcomes_) {
+    if (outcome != kLost) {
+      rtts.push_back(outcome);
+    }
+  }
+  quality.lost = quality.probes - static_cast<uint32_t>(rtts.size());
+  if (rtts.empty()) {
+    return quality;
+  }
+
+  std::sort(rtts.begin(), rtts.end());
+  // The smallest time at least percent of the replies took
+  auto rank = [&rtts](size_t percent) { return rtts[(rtts.size() * percent + 99) / 100 - 1]; };
+  quality.rtt_min_ms = rtts.front();
+  quality.rtt_p50_ms = rank(50);
+  quality.rtt_p90_ms = rank(90);
+  quality.rtt_max_ms = rtts.back();
+  return quality;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,39 @@
+#include "wireguard_core/peer_index.h"
+
+namespace wireguard_dart {
+
+void PeerIndex::Clear() {
+  for (Bucket &bucket : buckets_) {
+    bucket.slot = kNone;
+  }
+  size_ = 0;
+}
+
+void PeerIndex::Reserve(size_t count) {
+  size_t bucket_count = buckets_.empty() ? 16 : buckets_.size();
+  while (count * 2 > bucket_count) {
+    bucket_count *= 2;
+  }
+  if (bucket_count > buckets_.size()) {
+    Rehash(bucket_count);
+  }
+}
+
+void PeerIndex::Rehash(size_t bucket_count) {
+  std::vector<Bucket> old(bucket_count, Bucket{0, kNone});
+  old.swap(buckets_);
+  size_t mask = bucket_count - 1;
+  for (const Bucket &bucket : old) {
+    if (bucket.slot == kNone) {
+      continue;
+    }
+    // Keys are unique in the index, so the first free bucket is the one
+    size_t i = bucket.hash & mask;
+    while (buckets_[i].slot != kNone) {
+      i = (i + 1) & mask;
+    }
+    buckets_[i] = bucket;
+  }
+}
+
+} // namespace wireguard_dart
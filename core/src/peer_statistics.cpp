@@ -0,0 +1,115 @@
+#include "wireguard_core/peer_statistics.h"
+
+#include <cmath>
+
+namespace wireguard_dart {
+
+namespace {
+
+// The layout is little-endian, as every Windows and Linux target of Flutter is
+template <typename T>
+uint8_t *Put(uint8_t *out, T value) {
+  memcpy(out, &value, sizeof(value));
+  return out + sizeof(value);
+}
+
+} // namespace
+
+TunnelTotals SumPeers(const std::vector<PeerStatistics> &peers) {
+  TunnelTotals totals;
+  for (const PeerStatistics &peer : peers) {
+    totals.rx_bytes += peer.rx_bytes;
+    totals.tx_bytes += peer.tx_bytes;
+    if (peer.last_handshake_ms > totals.last_handshake_ms) {
+      totals.last_handshake_ms = peer.last_handshake_ms;
+    }
+  }
+  return totals;
+}
+
+void EncodePeerStatistics(const std::vector<PeerStatistics> &peers, uint64_t now_unix_millis,
+                          std::vector<uint8_t> *encoded) {
+  encoded->resize(kPeerStatisticsHeaderSize + peers.size() * kPeerStatisticsRecordSize);
+  uint8_t *out = encoded->data();
+  out = Put(out, kPeerStatisticsVersion);
+  out = Put(out, static_cast<uint16_t>(kPeerStatisticsRecordSize));
+  out = Put(out, static_cast<uint32_t>(peers.size()));
+  out = Put(out, now_unix_millis);
+  for (const PeerStatistics &peer : peers) {
+    memcpy(out, peer.public_key.data(), peer.public_key.size());
+    out += peer.public_key.size();
+    out = Put(out, peer.rx_bytes);
+    out = Put(out, peer.tx_bytes);
+    out = Put(out, peer.last_handshake_ms);
+    out = Put(out, peer.rx_rate_ewma);
+    out = Put(out, peer.tx_rate_ewma);
+  }
+}
+
+void PeerRateTracker::Update(std::vector<PeerStatistics> &peers, int64_t now_us) {
+  generation_++;
+  auto key_at = [this](uint32_t slot) { return keys_[slot].data(); };
+
+  size_t seen = 0;
+  for (PeerStatistics &peer : peers) {
+    uint32_t slot = index_.Find(peer.public_key.data(), key_at);
+    bool added = slot == PeerIndex::kNone;
+    if (added) {
+      slot = static_cast<uint32_t>(previous_.size());
+      keys_.push_back(peer.public_key);
+      previous_.emplace_back();
+      index_.Insert(peer.public_key.data(), slot, key_at);
+    }
+    Previous &previous = previous_[slot];
+    bool restart = added || peer.rx_bytes < previous.rx_bytes || peer.tx_bytes < previous.tx_bytes;
+    double seconds = static_cast<double>(now_us - previous.at_us) / 1e6;
+
+    if (restart) {
+      previous = Previous();
+    } else if (seconds > 0) {
+      double rx_rate = static_cast<double>(peer.rx_bytes - previous.rx_bytes) / seconds;
+      double tx_rate = static_cast<double>(peer.tx_bytes - previous.tx_bytes) / seconds;
+      // Weighted by the time since the previous reading, so irregular polling decays the same per second
+      double alpha = 1.0 - std::exp(-seconds / kSmoothingSeconds);
+      previous.rx_rate = rx_rate;
+      previous.tx_rate = tx_rate;
+      previous.rx_rate_ewma += alpha * (rx_rate - previous.rx_rate_ewma);
+      previous.tx_rate_ewma += alpha * (tx_rate - previous.tx_rate_ewma);
+    }
+    if (restart || seconds > 0) {
+      previous.rx_bytes = peer.rx_bytes;
+      previous.tx_bytes = peer.tx_bytes;
+      previous.at_us = now_us;
+    }
+    if (previous.generation != generation_) {
+      seen++;
+    }
+    previous.generation = generation_;
+
+    peer.rx_rate = previous.rx_rate;
+    peer.tx_rate = previous.tx_rate;
+    peer.rx_rate_ewma = previous.rx_rate_ewma;
+    peer.tx_rate_ewma = previous.tx_rate_ewma;
+  }
+
+  if (seen == previous_.size()) {
+    return;
+  }
+  // Some peers are gone, the others move up and are indexed again
+  size_t kept = 0;
+  for (size_t i = 0; i < previous_.size(); i++) {
+    if (previous_[i].generation == generation_) {
+      keys_[kept] = keys_[i];
+      previous_[kept] = previous_[i];
+      kept++;
+    }
+  }
+  keys_.resize(kept);
+  previous_.resize(kept);
+  index_.Clear();
+  for (size_t i = 0; i < kept; i++) {
+    index_.Insert(keys_[i].data(), static_cast<uint32_t>(i), key_at);
+  }
+}
+
+} // namespace wireguard_dart
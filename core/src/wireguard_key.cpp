@@ -0,0 +1,65 @@
+#include "wireguard_core/wireguard_key.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int Base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+} // namespace
+
+bool KeyFromBase64(std::string_view text, uint8_t *key) {
+  if (text.size() != kWireguardKeyBase64Length || text[kWireguardKeyBase64Length - 1] != '=') {
+    return false;
+  }
+  uint32_t bits = 0;
+  int bit_count = 0;
+  size_t written = 0;
+  for (size_t i = 0; i < kWireguardKeyBase64Length - 1; i++) {
+    int digit = Base64Value(text[i]);
+    if (digit < 0) {
+      return false;
+    }
+    bits = (bits << 6) | static_cast<uint32_t>(digit);
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      key[written++] = static_cast<uint8_t>(bits >> bit_count);
+    }
+  }
+  return written == kWireguardKeyLength;
+}
+
+std::string KeyToBase64(const uint8_t *key) {
+  std::string text(kWireguardKeyBase64Length, '=');
+  KeyToBase64(key, &text[0]);
+  return text;
+}
+
+void KeyToBase64(const uint8_t *key, char *text) {
+  size_t out = 0;
+  for (size_t i = 0; i + 3 <= kWireguardKeyLength; i += 3) {
+    uint32_t group = (uint32_t{key[i]} << 16) | (uint32_t{key[i + 1]} << 8) | key[i + 2];
+    text[out++] = kAlphabet[(group >> 18) & 0x3f];
+    text[out++] = kAlphabet[(group >> 12) & 0x3f];
+    text[out++] = kAlphabet[(group >> 6) & 0x3f];
+    text[out++] = kAlphabet[group & 0x3f];
+  }
+  // 32 bytes leave 2 over, 3 characters and the padding
+  uint32_t group = (uint32_t{key[30]} << 16) | (uint32_t{key[31]} << 8);
+  text[out++] = kAlphabet[(group >> 18) & 0x3f];
+  text[out++] = kAlphabet[(group >> 12) & 0x3f];
+  text[out++] = kAlphabet[(group >> 6) & 0x3f];
+  text[out] = '=';
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,373 @@
+#include "wireguard_core/x25519.h"
+
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace wireguard_dart {
+
+namespace {
+
+/**
+ * Elements of the field mod 2^255 - 19 in five limbs of 51 bits. Every operation runs the same instructions
+ * whatever the values, with no branch or table index on them, so the private key does not show in the timing.
+ * After Carry each limb is below 2^52, which keeps the sums of products in Mul within 128 bits.
+ */
+struct Fe {
+  uint64_t v[5];
+};
+
+constexpr uint64_t kMask51 = (uint64_t(1) << 51) - 1;
+
+// A 128-bit product or sum of products
+struct Wide {
+  uint64_t lo;
+  uint64_t hi;
+};
+
+inline Wide Mul64(uint64_t a, uint64_t b) {
+  Wide r;
+#if defined(_MSC_VER) && defined(_M_X64)
+  r.lo = _umul128(a, b, &r.hi);
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+  r.lo = a * b;
+  r.hi = __umulh(a, b);
+#else
+  unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  r.lo = static_cast<uint64_t>(product);
+  r.hi = static_cast<uint64_t>(product >> 64);
+#endif
+  return r;
+}
+
+inline void AddWide(Wide &acc, Wide x) {
+  uint64_t lo = acc.lo + x.lo;
+  acc.hi += x.hi + (lo < x.lo);
+  acc.lo = lo;
+}
+
+inline void AddWide(Wide &acc, uint64_t x) {
+  uint64_t lo = acc.lo + x;
+  acc.hi += (lo < x);
+  acc.lo = lo;
+}
+
+// The bits above the low 51
+inline uint64_t Shift51(Wide x) { return (x.lo >> 51) | (x.hi << 13); }
+
+inline void Carry(Fe &h) {
+  uint64_t c;
+  c = h.v[0] >> 51;
+  h.v[0] &= kMask51;
+  h.v[1] += c;
+  c = h.v[1] >> 51;
+  h.v[1] &= kMask51;
+  h.v[2] += c;
+  c = h.v[2] >> 51;
+  h.v[2] &= kMask51;
+  h.v[3] += c;
+  c = h.v[3] >> 51;
+  h.v[3] &= kMask51;
+  h.v[4] += c;
+  c = h.v[4] >> 51;
+  h.v[4] &= kMask51;
+  // 2^255 is 19 mod p
+  h.v[0] += c * 19;
+  c = h.v[0] >> 51;
+  h.v[0] &= kMask51;
+  h.v[1] += c;
+}
+
+inline void Add(Fe &h, const Fe &f, const Fe &g) {
+  for (int i = 0; i < 5; i++) {
+    h.v[i] = f.v[i] + g.v[i];
+  }
+  Carry(h);
+}
+
+// Adds 2p first, so no limb goes below zero
+inline void Sub(Fe &h, const Fe &f, const Fe &g) {
+  h.v[0] = f.v[0] + 0xfffffffffffdaULL - g.v[0];
+  for (int i = 1; i < 5; i++) {
+    h.v[i] = f.v[i] + 0xffffffffffffeULL - g.v[i];
+  }
+  Carry(h);
+}
+
+// Folds the five sums of products back into limbs
+inline void Reduce(Fe &h, Wide r0, Wide r1, Wide r2, Wide r3, Wide r4) {
+  AddWide(r1, Shift51(r0));
+  h.v[0] = r0.lo & kMask51;
+  AddWide(r2, Shift51(r1));
+  h.v[1] = r1.lo & kMask51;
+  AddWide(r3, Shift51(r2));
+  h.v[2] = r2.lo & kMask51;
+  AddWide(r4, Shift51(r3));
+  h.v[3] = r3.lo & kMask51;
+  uint64_t c = Shift51(r4);
+  h.v[4] = r4.lo & kMask51;
+  h.v[0] += c * 19;
+  c = h.v[0] >> 51;
+  h.v[0] &= kMask51;
+  h.v[1] += c;
+}
+
+void Mul(Fe &h, const Fe &f, const Fe &g) {
+  const uint64_t *a = f.v;
+  const uint64_t *b = g.v;
+  uint64_t b1_19 = b[1] * 19;
+  uint64_t b2_19 = b[2] * 19;
+  uint64_t b3_19 = b[3] * 19;
+  uint64_t b4_19 = b[4] * 19;
+
+  Wide r0 = Mul64(a[0], b[0]);
+  AddWide(r0, Mul64(a[1], b4_19));
+  AddWide(r0, Mul64(a[2], b3_19));
+  AddWide(r0, Mul64(a[3], b2_19));
+  AddWide(r0, Mul64(a[4], b1_19));
+
+  Wide r1 = Mul64(a[0], b[1]);
+  AddWide(r1, Mul64(a[1], b[0]));
+  AddWide(r1, Mul64(a[2], b4_19));
+  AddWide(r1, Mul64(a[3], b3_19));
+  AddWide(r1, Mul64(a[4], b2_19));
+
+  Wide r2 = Mul64(a[0], b[2]);
+  AddWide(r2, Mul64(a[1], b[1]));
+  AddWide(r2, Mul64(a[2], b[0]));
+  AddWide(r2, Mul64(a[3], b4_19));
+  AddWide(r2, Mul64(a[4], b3_19));
+
+  Wide r3 = Mul64(a[0], b[3]);
+  AddWide(r3, Mul64(a[1], b[2]));
+  AddWide(r3, Mul64(a[2], b[1]));
+  AddWide(r3, Mul64(a[3], b[0]));
+  AddWide(r3, Mul64(a[4], b4_19));
+
+  Wide r4 = Mul64(a[0], b[4]);
+  AddWide(r4, Mul64(a[1], b[3]));
+  AddWide(r4, Mul64(a[2], b[2]));
+  AddWide(r4, Mul64(a[3], b[1]));
+  AddWide(r4, Mul64(a[4], b[0]));
+
+  Reduce(h, r0, r1, r2, r3, r4);
+}
+
+// Half the products of Mul, the symmetric ones are doubled instead
+void Square(Fe &h, const Fe &f) {
+  const uint64_t *a = f.v;
+  uint64_t a0_2 = a[0] * 2;
+  uint64_t a1_2 = a[1] * 2;
+  uint64_t a1_38 = a[1] * 38;
+  uint64_t a2_38 = a[2] * 38;
+  uint64_t a3_38 = a[3] * 38;
+  uint64_t a3_19 = a[3] * 19;
+  uint64_t a4_19 = a[4] * 19;
+
+  Wide r0 = Mul64(a[0], a[0]);
+  AddWide(r0, Mul64(a1_38, a[4]));
+  AddWide(r0, Mul64(a2_38, a[3]));
+
+  Wide r1 = Mul64(a0_2, a[1]);
+  AddWide(r1, Mul64(a2_38, a[4]));
+  AddWide(r1, Mul64(a3_19, a[3]));
+
+  Wide r2 = Mul64(a0_2, a[2]);
+  AddWide(r2, Mul64(a[1], a[1]));
+  AddWide(r2, Mul64(a3_38, a[4]));
+
+  Wide r3 = Mul64(a0_2, a[3]);
+  AddWide(r3, Mul64(a1_2, a[2]));
+  AddWide(r3, Mul64(a4_19, a[4]));
+
+  Wide r4 = Mul64(a0_2, a[4]);
+  AddWide(r4, Mul64(a1_2, a[3]));
+  AddWide(r4, Mul64(a[2], a[2]));
+
+  Reduce(h, r0, r1, r2, r3, r4);
+}
+
+void SquareTimes(Fe &h, const Fe &f, int count) {
+  Square(h, f);
+  for (int i = 1; i < count; i++) {
+    Square(h, h);
+  }
+}
+
+// (a + 2) / 4 of the Montgomery form of Curve25519, per RFC 7748
+void MulA24(Fe &h, const Fe &f) {
+  Wide r[5];
+  for (int i = 0; i < 5; i++) {
+    r[i] = Mul64(f.v[i], 121665);
+  }
+  Reduce(h, r[0], r[1], r[2], r[3], r[4]);
+}
+
+// z^(p - 2), the inverse, by the addition chain of ref10
+void Invert(Fe &out, const Fe &z) {
+  Fe z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+  Square(z2, z);
+  SquareTimes(t, z2, 2);
+  Mul(z9, t, z);
+  Mul(z11, z9, z2);
+  Square(t, z11);
+  Mul(z2_5_0, t, z9);
+  SquareTimes(t, z2_5_0, 5);
+  Mul(z2_10_0, t, z2_5_0);
+  SquareTimes(t, z2_10_0, 10);
+  Mul(z2_20_0, t, z2_10_0);
+  SquareTimes(t, z2_20_0, 20);
+  Mul(t, t, z2_20_0);
+  SquareTimes(t, t, 10);
+  Mul(z2_50_0, t, z2_10_0);
+  SquareTimes(t, z2_50_0, 50);
+  Mul(z2_100_0, t, z2_50_0);
+  SquareTimes(t, z2_100_0, 100);
+  Mul(t, t, z2_100_0);
+  SquareTimes(t, t, 50);
+  Mul(t, t, z2_50_0);
+  SquareTimes(t, t, 5);
+  Mul(out, t, z11);
+}
+
+// Swaps f and g when swap is 1, leaves them when it is 0, with the same instructions either way
+inline void ConditionalSwap(Fe &f, Fe &g, uint64_t swap) {
+  uint64_t mask = 0 - swap;
+  for (int i = 0; i < 5; i++) {
+    uint64_t t = mask & (f.v[i] ^ g.v[i]);
+    f.v[i] ^= t;
+    g.v[i] ^= t;
+  }
+}
+
+inline uint64_t Load64(const uint8_t *bytes) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--) {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+inline void Store64(uint8_t *bytes, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+// Little endian, with the top bit ignored as RFC 7748 asks
+void FromBytes(Fe &h, const uint8_t bytes[kX25519KeySize]) {
+  uint64_t w0 = Load64(bytes);
+  uint64_t w1 = Load64(bytes + 8);
+  uint64_t w2 = Load64(bytes + 16);
+  uint64_t w3 = Load64(bytes + 24);
+  h.v[0] = w0 & kMask51;
+  h.v[1] = ((w0 >> 51) | (w1 << 13)) & kMask51;
+  h.v[2] = ((w1 >> 38) | (w2 << 26)) & kMask51;
+  h.v[3] = ((w2 >> 25) | (w3 << 39)) & kMask51;
+  h.v[4] = (w3 >> 12) & kMask51;
+}
+
+// Fully reduced below p, little endian
+void ToBytes(uint8_t bytes[kX25519KeySize], const Fe &f) {
+  Fe h = f;
+  Carry(h);
+  Carry(h);
+  // q is 1 when h is p or more, found by adding 19 and looking at the carry out of 2^255
+  uint64_t q = (h.v[0] + 19) >> 51;
+  q = (h.v[1] + q) >> 51;
+  q = (h.v[2] + q) >> 51;
+  q = (h.v[3] + q) >> 51;
+  q = (h.v[4] + q) >> 51;
+  h.v[0] += 19 * q;
+  uint64_t c;
+  c = h.v[0] >> 51;
+  h.v[0] &= kMask51;
+  h.v[1] += c;
+  c = h.v[1] >> 51;
+  h.v[1] &= kMask51;
+  h.v[2] += c;
+  c = h.v[2] >> 51;
+  h.v[2] &= kMask51;
+  h.v[3] += c;
+  c = h.v[3] >> 51;
+  h.v[3] &= kMask51;
+  h.v[4] += c;
+  h.v[4] &= kMask51;
+
+  Store64(bytes, h.v[0] | (h.v[1] << 51));
+  Store64(bytes + 8, (h.v[1] >> 13) | (h.v[2] << 38));
+  Store64(bytes + 16, (h.v[2] >> 26) | (h.v[3] << 25));
+  Store64(bytes + 24, (h.v[3] >> 39) | (h.v[4] << 12));
+}
+
+// Through volatile, so clearing a key that is not read again is not optimized away
+void Wipe(uint8_t *bytes, size_t size) {
+  volatile uint8_t *p = bytes;
+  for (size_t i = 0; i < size; i++) {
+    p[i] = 0;
+  }
+}
+
+} // namespace
+
+void X25519Clamp(uint8_t key[kX25519KeySize]) {
+  key[0] &= 248;
+  key[31] &= 127;
+  key[31] |= 64;
+}
+
+void X25519(uint8_t out[kX25519KeySize], const uint8_t scalar[kX25519KeySize], const uint8_t point[kX25519KeySize]) {
+  uint8_t k[kX25519KeySize];
+  memcpy(k, scalar, kX25519KeySize);
+  X25519Clamp(k);
+
+  // The Montgomery ladder of RFC 7748, one step per scalar bit
+  Fe x1, x2 = {{1, 0, 0, 0, 0}}, z2 = {{0, 0, 0, 0, 0}}, x3, z3 = {{1, 0, 0, 0, 0}};
+  FromBytes(x1, point);
+  x3 = x1;
+  uint64_t swap = 0;
+  Fe a, aa, b, bb, e, c, d, da, cb, t;
+  for (int bit = 254; bit >= 0; bit--) {
+    uint64_t k_bit = (k[bit >> 3] >> (bit & 7)) & 1;
+    swap ^= k_bit;
+    ConditionalSwap(x2, x3, swap);
+    ConditionalSwap(z2, z3, swap);
+    swap = k_bit;
+
+    Add(a, x2, z2);
+    Square(aa, a);
+    Sub(b, x2, z2);
+    Square(bb, b);
+    Sub(e, aa, bb);
+    Add(c, x3, z3);
+    Sub(d, x3, z3);
+    Mul(da, d, a);
+    Mul(cb, c, b);
+    Add(t, da, cb);
+    Square(x3, t);
+    Sub(t, da, cb);
+    Square(t, t);
+    Mul(z3, x1, t);
+    Mul(x2, aa, bb);
+    MulA24(t, e);
+    Add(t, aa, t);
+    Mul(z2, e, t);
+  }
+  ConditionalSwap(x2, x3, swap);
+  ConditionalSwap(z2, z3, swap);
+
+  Invert(z2, z2);
+  Mul(x2, x2, z2);
+  ToBytes(out, x2);
+
+  Wipe(k, sizeof(k));
+}
+
+void X25519PublicKey(uint8_t public_key[kX25519KeySize], const uint8_t private_key[kX25519KeySize]) {
+  static const uint8_t kBasePoint[kX25519KeySize] = {9};
+  X25519(public_key, private_key, kBasePoint);
+}
+
+} // namespace wireguard_dart
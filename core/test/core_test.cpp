@@ -0,0 +1,671 @@
+// Unit tests of the shared core, run with ctest from a standalone build of core/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "wireguard_core/activation_schedule.h"
+#include "wireguard_core/address_format.h"
+#include "wireguard_core/address_parser.h"
+#include "wireguard_core/cumulative_slots.h"
+#include "wireguard_core/ip_prefix.h"
+#include "wireguard_core/keepalive_tuner.h"
+#include "wireguard_core/link_quality.h"
+#include "wireguard_core/peer_index.h"
+#include "wireguard_core/peer_statistics.h"
+#include "wireguard_core/wireguard_key.h"
+#include "wireguard_core/x25519.h"
+
+namespace wireguard_dart {
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+  do {                                                                            \
+    if (!(condition)) {                                                           \
+      std::fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                                 \
+    }                                                                             \
+  } while (0)
+
+NetworkPrefix Prefix(const char *text) {
+  NetworkPrefix prefix;
+  if (!ParseNetworkPrefix(text, prefix)) {
+    std::fprintf(stderr, "could not parse %s\n", text);
+    failures++;
+  }
+  return prefix;
+}
+
+bool SamePrefix(const NetworkPrefix &a, const NetworkPrefix &b) {
+  return a.family == b.family && a.prefix_length == b.prefix_length &&
+         memcmp(a.address, b.address, a.family == AF_INET ? 4 : 16) == 0;
+}
+
+void TestAddressParser() {
+  uint8_t v4[4];
+  CHECK(ParseIPv4Address("192.168.1.254", v4));
+  CHECK(v4[0] == 192 && v4[1] == 168 && v4[2] == 1 && v4[3] == 254);
+  CHECK(!ParseIPv4Address("192.168.01.1", v4));
+  CHECK(!ParseIPv4Address("256.0.0.1", v4));
+  CHECK(!ParseIPv4Address("1.2.3", v4));
+  CHECK(!ParseIPv4Address("1.2.3.4 ", v4));
+
+  uint8_t v6[16];
+  CHECK(ParseIPv6Address("2001:db8::1", v6));
+  CHECK(v6[0] == 0x20 && v6[1] == 0x01 && v6[2] == 0x0d && v6[3] == 0xb8 && v6[15] == 1 && v6[14] == 0);
+  CHECK(ParseIPv6Address("::ffff:10.0.0.1", v6));
+  CHECK(v6[10] == 0xff && v6[11] == 0xff && v6[12] == 10 && v6[15] == 1);
+  CHECK(ParseIPv6Address("::", v6));
+  CHECK(!ParseIPv6Address("1::2::3", v6));
+  CHECK(!ParseIPv6Address("12345::", v6));
+  CHECK(!ParseIPv6Address("1:2:3:4:5:6:7:8:9", v6));
+
+  uint8_t cidr;
+  CHECK(ParseCidr("24", 32, cidr) && cidr == 24);
+  CHECK(!ParseCidr("33", 32, cidr));
+  CHECK(!ParseCidr("", 32, cidr));
+  uint16_t port;
+  CHECK(ParsePort("51820", port) && port == 51820);
+  CHECK(!ParsePort("65536", port));
+}
+
+void TestAddressFormat() {
+  auto v4 = [](const char *text) {
+    uint8_t address[4];
+    char out[kMaxIPv4AddressText];
+    CHECK(ParseIPv4Address(text, address));
+    return std::string(out, FormatIPv4Address(address, out));
+  };
+  CHECK(v4("0.0.0.0") == "0.0.0.0");
+  CHECK(v4("255.255.255.255") == "255.255.255.255");
+  CHECK(v4("10.0.100.9") == "10.0.100.9");
+
+  auto v6 = [](const char *text) {
+    uint8_t address[16];
+    char out[kMaxIPv6AddressText];
+    CHECK(ParseIPv6Address(text, address));
+    return std::string(out, FormatIPv6Address(address, out));
+  };
+  CHECK(v6("::") == "::");
+  CHECK(v6("::1") == "::1");
+  CHECK(v6("2001:0DB8:0:0:0:0:0:1") == "2001:db8::1");
+  CHECK(v6("fe80::") == "fe80::");
+  // A single zero group stays, and the first of two equally long runs is compressed
+  CHECK(v6("2001:db8:0:1:1:1:1:1") == "2001:db8:0:1:1:1:1:1");
+  CHECK(v6("2001:0:0:1:0:0:1:1") == "2001::1:0:0:1:1");
+  CHECK(v6("1:0:0:2:0:0:0:3") == "1:0:0:2::3");
+  CHECK(v6("::ffff:10.0.0.1") == "::ffff:10.0.0.1");
+  CHECK(v6("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff") == "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff");
+
+  char out[kMaxPortText];
+  CHECK(std::string(out, FormatDecimal(0, out)) == "0");
+  CHECK(std::string(out, FormatDecimal(65535, out)) == "65535");
+}
+
+void TestIpPrefix() {
+  NetworkPrefix prefix;
+  CHECK(ParseNetworkPrefix("10.0.0.0/8", prefix) && prefix.family == AF_INET && prefix.prefix_length == 8);
+  CHECK(ParseNetworkPrefix("10.0.0.1", prefix) && prefix.prefix_length == 32);
+  CHECK(ParseNetworkPrefix("fd00::/64", prefix) && prefix.family == AF_INET6 && prefix.prefix_length == 64);
+  CHECK(ParseNetworkPrefix("fd00::1", prefix) && prefix.prefix_length == 128);
+  CHECK(!ParseNetworkPrefix("10.0.0.0/33", prefix));
+  CHECK(!ParseNetworkPrefix("10.0.0.0/", prefix));
+  CHECK(!ParseNetworkPrefix("example.com/24", prefix));
+
+  // Siblings merge into their parent, which then covers the /26 inside it; host bits are cleared
+  std::vector<NetworkPrefix> aggregated = AggregatePrefixes(
+      {Prefix("10.0.0.128/25"), Prefix("10.0.0.5/25"), Prefix("10.0.0.64/26"), Prefix("fd00::1/128")});
+  CHECK(aggregated.size() == 2);
+  CHECK(aggregated.size() == 2 && SamePrefix(aggregated[0], Prefix("10.0.0.0/24")));
+  CHECK(aggregated.size() == 2 && SamePrefix(aggregated[1], Prefix("fd00::1/128")));
+
+  std::vector<NetworkPrefix> routes = {Prefix("0.0.0.0/0"), Prefix("::/0"), Prefix("10.0.0.0/8")};
+  CHECK(SplitDefaultRoutes(routes));
+  CHECK(routes.size() == 5);
+  CHECK(routes.size() == 5 && SamePrefix(routes[0], Prefix("0.0.0.0/1")) &&
+        SamePrefix(routes[3], Prefix("128.0.0.0/1")) && SamePrefix(routes[4], Prefix("8000::/1")));
+  std::vector<NetworkPrefix> no_default = {Prefix("10.0.0.0/8")};
+  CHECK(!SplitDefaultRoutes(no_default));
+
+  // Everything but 10/8 is the eight largest blocks around it
+  std::vector<NetworkPrefix> remaining = SubtractPrefixes({Prefix("0.0.0.0/0")}, {Prefix("10.0.0.0/8")});
+  const char *expected[] = {"0.0.0.0/5",  "8.0.0.0/7",  "11.0.0.0/8",  "12.0.0.0/6",
+                            "16.0.0.0/4", "32.0.0.0/3", "64.0.0.0/2", "128.0.0.0/1"};
+  CHECK(remaining.size() == 8);
+  for (size_t i = 0; i < remaining.size() && i < 8; i++) {
+    CHECK(SamePrefix(remaining[i], Prefix(expected[i])));
+  }
+
+  // Adjacent allowed prefixes form one range; exclusions overlap and cover both families
+  remaining = SubtractPrefixes({Prefix("10.0.0.0/24"), Prefix("10.0.1.0/24"), Prefix("fd00::/64")},
+                               {Prefix("10.0.0.0/25"), Prefix("10.0.0.64/26"), Prefix("10.0.1.128/25"),
+                                Prefix("10.0.1.0/32"), Prefix("fd00::1")});
+  CHECK(remaining.size() == 8 + 64);
+  CHECK(remaining.size() > 3 && SamePrefix(remaining[0], Prefix("10.0.0.128/25")) &&
+        SamePrefix(remaining[1], Prefix("10.0.1.1/32")) && SamePrefix(remaining[2], Prefix("10.0.1.2/31")) &&
+        SamePrefix(remaining[3], Prefix("10.0.1.4/30")));
+  CHECK(remaining.size() == 72 && SamePrefix(remaining[8], Prefix("fd00::/128")) &&
+        SamePrefix(remaining[71], Prefix("fd00::8000:0:0:0/65")));
+
+  CHECK(SubtractPrefixes({Prefix("::/0")}, {}).size() == 1);
+  CHECK(SubtractPrefixes({Prefix("::/0")}, {Prefix("::/1")}).size() == 1 &&
+        SamePrefix(SubtractPrefixes({Prefix("::/0")}, {Prefix("::/1")})[0], Prefix("8000::/1")));
+  CHECK(SubtractPrefixes({Prefix("10.0.0.0/8")}, {Prefix("0.0.0.0/0")}).empty());
+}
+
+void TestPrefixTrie() {
+  PrefixTrie trie;
+  uint8_t address[16];
+  CHECK(ParseIPv4Address("10.1.2.3", address) && trie.Lookup(AF_INET, address) == PrefixTrie::kNone);
+
+  // Nested, sibling and host prefixes, added out of order so that branch points are split in
+  CHECK(trie.Insert(Prefix("10.1.2.0/24"), 1));
+  CHECK(trie.Insert(Prefix("10.0.0.0/8"), 0));
+  CHECK(trie.Insert(Prefix("10.1.3.0/24"), 2));
+  CHECK(trie.Insert(Prefix("10.1.2.3/32"), 3));
+  CHECK(trie.Insert(Prefix("0.0.0.0/0"), 4));
+  CHECK(trie.Insert(Prefix("10.1.2.99/24"), 9));
+  CHECK(trie.Insert(Prefix("fd00::/64"), 5));
+  CHECK(trie.Insert(Prefix("fd00::1/128"), 6));
+  NetworkPrefix other = Prefix("10.0.0.0/8");
+  other.family = 0;
+  CHECK(!trie.Insert(other, 7));
+  CHECK(trie.Size() == 7);
+
+  const struct {
+    const char *address;
+    uint32_t value;
+  } expected[] = {{"10.1.2.3", 3},   {"10.1.2.4", 1}, {"10.1.3.200", 2}, {"10.2.0.1", 0},
+                  {"192.168.0.1", 4}, {"fd00::1", 6}, {"fd00::2", 5}};
+  for (const auto &lookup : expected) {
+    bool v4 = ParseIPv4Address(lookup.address, address);
+    CHECK(v4 || ParseIPv6Address(lookup.address, address));
+    CHECK(trie.Lookup(v4 ? AF_INET : AF_INET6, address) == lookup.value);
+  }
+  CHECK(ParseIPv6Address("fe80::1", address) && trie.Lookup(AF_INET6, address) == PrefixTrie::kNone);
+
+  // Against a scan of every prefix, over prefixes that share long paths
+  trie.Clear();
+  std::vector<NetworkPrefix> prefixes;
+  uint32_t seed = 1;
+  auto next = [&seed] {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+  };
+  for (uint32_t i = 0; i < 500; i++) {
+    NetworkPrefix prefix = {};
+    prefix.family = AF_INET6;
+    prefix.address[0] = 0xfd;
+    prefix.address[15] = static_cast<uint8_t>(next());
+    prefix.address[14] = static_cast<uint8_t>(next() & 3);
+    prefix.prefix_length = static_cast<uint8_t>(110 + next() % 19);
+    prefixes.push_back(AggregatePrefixes({prefix})[0]);
+    trie.Insert(prefix, i);
+  }
+  auto scan = [&prefixes](const uint8_t *target) {
+    uint32_t best = PrefixTrie::kNone;
+    int best_length = -1;
+    for (uint32_t i = 0; i < prefixes.size(); i++) {
+      NetworkPrefix host = {};
+      host.family = AF_INET6;
+      memcpy(host.address, target, 16);
+      host.prefix_length = prefixes[i].prefix_length;
+      if (prefixes[i].prefix_length > best_length && SamePrefix(AggregatePrefixes({host})[0], prefixes[i])) {
+        best = i;
+        best_length = prefixes[i].prefix_length;
+      }
+    }
+    return best;
+  };
+  for (int i = 0; i < 300; i++) {
+    uint8_t target[16] = {0xfd};
+    target[15] = static_cast<uint8_t>(next());
+    target[14] = static_cast<uint8_t>(next() & 3);
+    CHECK(trie.Lookup(AF_INET6, target) == scan(target));
+  }
+}
+
+void TestRouteSet() {
+  RouteSet routes;
+  routes.Assign({Prefix("10.0.0.0/25"), Prefix("fd00::/64")});
+  std::vector<NetworkPrefix> added;
+  std::vector<NetworkPrefix> removed;
+  // The sibling merges with the route
+  routes.Change({Prefix("10.0.0.128/25")}, {}, &added, &removed);
+  CHECK(added.size() == 1 && SamePrefix(added[0], Prefix("10.0.0.0/24")));
+  CHECK(removed.size() == 1 && SamePrefix(removed[0], Prefix("10.0.0.0/25")));
+  // Inside a route, or added twice and removed once, nothing changes
+  added.clear();
+  removed.clear();
+  routes.Change({Prefix("10.0.0.1/32"), Prefix("fd00::/64")}, {Prefix("fd00::/64")}, &added, &removed);
+  CHECK(added.empty() && removed.empty());
+  routes.Change({}, {Prefix("10.0.0.128/25")}, &added, &removed);
+  CHECK(added.size() == 1 && SamePrefix(added[0], Prefix("10.0.0.0/25")));
+  CHECK(removed.size() == 1 && SamePrefix(removed[0], Prefix("10.0.0.0/24")));
+  CHECK(routes.PrefixCount() == 3);
+
+  // Against aggregating everything, with the reported changes applied to the routes before
+  routes.Clear();
+  std::vector<NetworkPrefix> present;
+  std::vector<NetworkPrefix> expected_routes;
+  uint32_t seed = 7;
+  auto next = [&seed] {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+  };
+  for (int round = 0; round < 400; round++) {
+    std::vector<NetworkPrefix> to_add;
+    std::vector<NetworkPrefix> to_remove;
+    for (uint32_t i = next() % 4; i > 0; i--) {
+      NetworkPrefix prefix = {};
+      prefix.family = AF_INET;
+      prefix.address[0] = 10;
+      prefix.address[3] = static_cast<uint8_t>(next());
+      prefix.prefix_length = static_cast<uint8_t>(26 + next() % 7);
+      to_add.push_back(prefix);
+    }
+    for (uint32_t i = next() % 4; i > 0 && !present.empty(); i--) {
+      size_t index = next() % present.size();
+      to_remove.push_back(present[index]);
+      present.erase(present.begin() + index);
+    }
+    present.insert(present.end(), to_add.begin(), to_add.end());
+
+    added.clear();
+    removed.clear();
+    routes.Change(to_add, to_remove, &added, &removed);
+    for (const auto &route : removed) {
+      size_t before = expected_routes.size();
+      expected_routes.erase(std::remove_if(expected_routes.begin(), expected_routes.end(),
+                                           [&route](const NetworkPrefix &kept) { return SamePrefix(kept, route); }),
+                            expected_routes.end());
+      CHECK(expected_routes.size() == before - 1);
+    }
+    expected_routes.insert(expected_routes.end(), added.begin(), added.end());
+    std::sort(expected_routes.begin(), expected_routes.end(), [](const NetworkPrefix &a, const NetworkPrefix &b) {
+      return memcmp(a.address, b.address, sizeof(a.address)) < 0;
+    });
+
+    std::vector<NetworkPrefix> aggregated = AggregatePrefixes(present);
+    std::vector<NetworkPrefix> kept = routes.Routes();
+    CHECK(kept.size() == aggregated.size() && expected_routes.size() == aggregated.size());
+    for (size_t i = 0; i < kept.size() && i < aggregated.size() && i < expected_routes.size(); i++) {
+      CHECK(SamePrefix(kept[i], aggregated[i]) && SamePrefix(expected_routes[i], aggregated[i]));
+    }
+  }
+}
+
+void TestWireguardKey() {
+  const char *text = "yAnz5TF+lXXJte14tji3zlMNq+hd2rYUIgJBgB3fBmk=";
+  uint8_t key[kWireguardKeyLength];
+  CHECK(KeyFromBase64(text, key));
+  CHECK(key[0] == 0xc8 && key[1] == 0x09 && key[31] == 0x69);
+  CHECK(KeyToBase64(key) == text);
+  char buffer[kWireguardKeyBase64Length];
+  KeyToBase64(key, buffer);
+  CHECK(std::string(buffer, sizeof(buffer)) == text);
+
+  for (int i = 0; i < 32; i++) {
+    key[i] = static_cast<uint8_t>(i * 37 + 11);
+  }
+  uint8_t decoded[kWireguardKeyLength];
+  CHECK(KeyFromBase64(KeyToBase64(key), decoded) && memcmp(key, decoded, sizeof(key)) == 0);
+
+  CHECK(!KeyFromBase64("yAnz5TF+lXXJte14tji3zlMNq+hd2rYUIgJBgB3fBmk", key));
+  CHECK(!KeyFromBase64("yAnz5TF+lXXJte14tji3zlMNq+hd2rYUIgJBgB3fBmkA", key));
+  CHECK(!KeyFromBase64("yAnz5TF+lXXJte14tji3zlMNq+hd2rYUIgJBgB3fBm*=", key));
+}
+
+void TestPeerStatistics() {
+  std::vector<PeerStatistics> peers(2);
+  peers[0].public_key[0] = 1;
+  peers[0].rx_bytes = 1000;
+  peers[0].tx_bytes = 10;
+  peers[0].last_handshake_ms = 5;
+  peers[1].public_key[0] = 2;
+  peers[1].rx_bytes = 24;
+  peers[1].last_handshake_ms = 9;
+
+  TunnelTotals totals = SumPeers(peers);
+  CHECK(totals.rx_bytes == 1024 && totals.tx_bytes == 10 && totals.last_handshake_ms == 9);
+
+  std::vector<uint8_t> encoded;
+  EncodePeerStatistics(peers, 1234, &encoded);
+  CHECK(encoded.size() == kPeerStatisticsHeaderSize + 2 * kPeerStatisticsRecordSize);
+  uint16_t version, record_size;
+  uint32_t count;
+  uint64_t now, rx;
+  memcpy(&version, encoded.data(), 2);
+  memcpy(&record_size, encoded.data() + 2, 2);
+  memcpy(&count, encoded.data() + 4, 4);
+  memcpy(&now, encoded.data() + 8, 8);
+  memcpy(&rx, encoded.data() + kPeerStatisticsHeaderSize + kPeerStatisticsRecordSize + kWireguardKeyLength, 8);
+  CHECK(version == kPeerStatisticsVersion && record_size == kPeerStatisticsRecordSize && count == 2 && now == 1234);
+  CHECK(encoded[kPeerStatisticsHeaderSize + kPeerStatisticsRecordSize] == 2 && rx == 24);
+
+  // The first reading has no rate, the second one second later has the difference
+  PeerRateTracker tracker;
+  tracker.Update(peers, 0);
+  CHECK(peers[0].rx_rate == 0 && peers[0].rx_rate_ewma == 0);
+  peers[0].rx_bytes += 500;
+  tracker.Update(peers, 1000000);
+  CHECK(peers[0].rx_rate == 500 && peers[1].rx_rate == 0);
+  double alpha = 1.0 - std::exp(-1.0 / PeerRateTracker::kSmoothingSeconds);
+  CHECK(std::fabs(peers[0].rx_rate_ewma - 500 * alpha) < 1e-9);
+
+  // Counters that went back start over
+  peers[0].rx_bytes = 0;
+  tracker.Update(peers, 2000000);
+  CHECK(peers[0].rx_rate == 0 && peers[0].rx_rate_ewma == 0);
+
+  // A peer missing from a reading is forgotten and starts over when it comes back
+  std::vector<PeerStatistics> first = {peers[0]};
+  tracker.Update(first, 3000000);
+  peers[0].rx_bytes = first[0].rx_bytes + 100;
+  peers[1].rx_bytes += 100;
+  tracker.Update(peers, 4000000);
+  CHECK(peers[0].rx_rate == 100 && peers[1].rx_rate == 0);
+}
+
+void TestPeerIndex() {
+  std::vector<PeerKey> keys(100);
+  for (size_t i = 0; i < keys.size(); i++) {
+    // Keys that only differ past the hashed bytes still have to be told apart
+    keys[i][31] = static_cast<uint8_t>(i);
+  }
+  auto key_at = [&keys](uint32_t slot) { return keys[slot].data(); };
+
+  PeerIndex index;
+  CHECK(index.Find(keys[0].data(), key_at) == PeerIndex::kNone);
+  for (uint32_t i = 0; i < keys.size(); i++) {
+    CHECK(index.Insert(keys[i].data(), i, key_at) == PeerIndex::kNone);
+  }
+  CHECK(index.Size() == 100 && index.MemoryBytes() >= 200 * 8);
+  for (uint32_t i = 0; i < keys.size(); i++) {
+    CHECK(index.Find(keys[i].data(), key_at) == i);
+  }
+  PeerKey missing{};
+  missing[31] = 200;
+  CHECK(index.Find(missing.data(), key_at) == PeerIndex::kNone);
+
+  // A duplicate reports the slot it collides with and is not indexed
+  keys.push_back(keys[7]);
+  CHECK(index.Insert(keys[100].data(), 100, key_at) == 7);
+  CHECK(index.Size() == 100);
+
+  size_t memory = index.MemoryBytes();
+  index.Clear();
+  CHECK(index.Size() == 0 && index.Find(keys[7].data(), key_at) == PeerIndex::kNone);
+  index.Reserve(100);
+  CHECK(index.MemoryBytes() == memory);
+}
+
+PeerStatistics Reading(uint8_t key, uint64_t rx_bytes, uint64_t tx_bytes) {
+  PeerStatistics peer;
+  peer.public_key[0] = key;
+  peer.rx_bytes = rx_bytes;
+  peer.tx_bytes = tx_bytes;
+  return peer;
+}
+
+void TestCumulativeSlots() {
+  std::vector<CumulativeSlots::Slot> memory(4);
+  PeerKey p1 = Reading(1, 0, 0).public_key;
+  PeerKey p3 = Reading(3, 0, 0).public_key;
+
+  CumulativeSlots slots;
+  slots.Attach(memory.data(), memory.size());
+  CHECK(slots.Taken() == 0);
+  CHECK(slots.Update("a", 1, 1, {Reading(1, 100, 10), Reading(2, 50, 5)}, 1000));
+  CHECK(slots.Update("a", 1, 1, {Reading(1, 110, 10), Reading(2, 50, 5)}, 2000));
+  auto tunnels = slots.Read({}, false, 2000);
+  CHECK(tunnels["a"].totals.rx_bytes == 160 && tunnels["a"].totals.tx_bytes == 15);
+  CHECK(tunnels["a"].peers[p1].rx_bytes == 110 && tunnels["a"].totals.updated_ms == 2000);
+
+  // Full: the new tunnel gets the last slot and its peer none, as long as every peer is still in its tunnel
+  CHECK(!slots.Update("b", 2, 1, {Reading(3, 70, 7)}, 3000));
+  CHECK(slots.Taken() == 4 && slots.Read({"b"}, false, 3000)["b"].peers.empty());
+
+  // Once a tunnel is updated without a peer, its slot goes to the next peer that needs one
+  CHECK(slots.Update("a", 1, 1, {Reading(1, 110, 10)}, 4000));
+  CHECK(slots.Update("b", 2, 1, {Reading(3, 70, 7)}, 5000));
+  tunnels = slots.Read({}, false, 5000);
+  CHECK(tunnels["a"].totals.rx_bytes == 160 && tunnels["a"].peers.size() == 1);
+  CHECK(tunnels["b"].peers[p3].rx_bytes == 70 && tunnels["b"].totals.rx_bytes == 70);
+
+  // The slots are all in the memory, so a table attached to it again has the same counts
+  CumulativeSlots reopened([](uint64_t luid, uint64_t) { return luid != 2; });
+  reopened.Attach(memory.data(), memory.size());
+  CHECK(reopened.Taken() == 4 && reopened.Read({"a"}, false, 6000)["a"].totals.rx_bytes == 160);
+
+  // A reset gives back the slots of an adapter that is gone and zeroes the others, keeping the driver's reading
+  tunnels = reopened.Read({}, true, 7000);
+  CHECK(tunnels["b"].peers[p3].rx_bytes == 70 && tunnels["a"].totals.rx_bytes == 160);
+  CHECK(reopened.Taken() == 2);
+  CHECK(reopened.Update("a", 1, 1, {Reading(1, 110, 10)}, 8000));
+  tunnels = reopened.Read({}, false, 8000);
+  CHECK(tunnels.count("b") == 0 && tunnels["a"].totals.rx_bytes == 0 && tunnels["a"].totals.since_ms == 7000);
+
+  // A peer replaced in a full tunnel counts from the update after the one that left out the peer it replaces
+  CHECK(reopened.Update("a", 1, 1, {Reading(1, 110, 10), Reading(4, 1, 0), Reading(5, 2, 0)}, 9000));
+  CHECK(!reopened.Update("a", 1, 1, {Reading(1, 110, 10), Reading(4, 1, 0), Reading(6, 3, 0)}, 10000));
+  CHECK(reopened.Update("a", 1, 1, {Reading(1, 120, 10), Reading(4, 1, 0), Reading(6, 3, 0)}, 11000));
+  tunnels = reopened.Read({"a"}, false, 11000);
+  CHECK(tunnels["a"].peers.size() == 3 && tunnels["a"].totals.rx_bytes == 16);
+
+  // An adapter recreated with the LUID of the one before counts all of its reading, even above the last one
+  CHECK(reopened.Update("a", 1, 2, {Reading(1, 130, 10), Reading(4, 1, 0), Reading(6, 3, 0)}, 12000));
+  tunnels = reopened.Read({"a"}, false, 12000);
+  CHECK(tunnels["a"].peers[p1].rx_bytes == 140 && tunnels["a"].totals.rx_bytes == 150);
+
+  // The slots of an adapter that is gone wait for a reset rather than go to another tunnel
+  CumulativeSlots gone([](uint64_t luid, uint64_t instance) { return luid != 1 || instance != 2; });
+  gone.Attach(memory.data(), memory.size());
+  CHECK(!gone.Update("c", 3, 1, {Reading(7, 1, 0)}, 13000) && gone.Taken() == 4);
+  CHECK(gone.Read({}, true, 14000).count("a") == 1 && gone.Taken() == 0);
+}
+
+void TestKeepaliveTuner() {
+  constexpr uint64_t kHold = KeepaliveTuner::kHoldMs;
+  constexpr uint64_t kCheck = 10 * 1000;
+  PeerStatistics peer;
+  uint64_t now = 1700000000000;
+  // The peer keeps sending data; on a fresh path it answers, on a broken one nothing comes back for kSilenceMs
+  auto fresh = [&](KeepaliveTuner &tuner, uint64_t after) {
+    now += after;
+    peer.tx_bytes += 2000;
+    peer.rx_bytes += 2000;
+    peer.last_handshake_ms = now - 1000;
+    return tuner.Update(peer, now);
+  };
+  auto broken = [&](KeepaliveTuner &tuner) {
+    now += kCheck;
+    peer.tx_bytes += 2000;
+    uint16_t chosen = tuner.Update(peer, now);
+    now += KeepaliveTuner::kSilenceMs;
+    peer.tx_bytes += 2000;
+    return chosen != 0 ? chosen : tuner.Update(peer, now);
+  };
+
+  // A NAT that forgets after 33 s: the interval doubles until it fails, then bisects down to the resolution
+  KeepaliveTuner tuner(KeepaliveTuner::kDefaultMin, KeepaliveTuner::kDefaultMax);
+  CHECK(tuner.Current() == 25);
+  CHECK(fresh(tuner, 0) == 0);
+  CHECK(fresh(tuner, kHold / 2) == 0);
+  CHECK(fresh(tuner, kHold / 2) == 50);
+  CHECK(broken(tuner) == 25 && tuner.Current() == 25);
+  CHECK(broken(tuner) == 0);
+  CHECK(fresh(tuner, 0) == 0);
+  CHECK(fresh(tuner, kHold) == 37);
+  CHECK(broken(tuner) == 25);
+  CHECK(fresh(tuner, 0) == 0);
+  CHECK(fresh(tuner, kHold) == 31);
+  CHECK(fresh(tuner, kHold) == 34);
+  CHECK(broken(tuner) == 31);
+  CHECK(fresh(tuner, 0) == 0);
+  CHECK(fresh(tuner, kHold) == 0 && tuner.Current() == 31);
+
+  // An idle peer sends no data, only keepalives and handshakes, so silence is no failure
+  for (int i = 0; i < 10; i++) {
+    now += kCheck;
+    peer.tx_bytes += KeepaliveTuner::kKeepaliveBytes + KeepaliveTuner::kHandshakeBytes;
+    CHECK(tuner.Update(peer, now) == 0 && tuner.Current() == 31);
+  }
+  // Counters that went back, as for a replaced peer, are a new baseline; what was learned stays
+  KeepaliveTuner kept = tuner;
+  PeerStatistics replaced = peer;
+  replaced.tx_bytes = 100;
+  replaced.rx_bytes = 0;
+  CHECK(kept.Update(replaced, now + kCheck) == 0 && kept.Current() == 31);
+  replaced.tx_bytes += 2000;
+  CHECK(kept.Update(replaced, now + 2 * kCheck) == 0);
+  replaced.tx_bytes += 2000;
+  CHECK(kept.Update(replaced, now + 2 * kCheck + KeepaliveTuner::kSilenceMs) == 15);
+
+  // The interval that held fails once the network changes, and the search starts below it
+  CHECK(broken(tuner) == 15);
+  CHECK(fresh(tuner, 0) == 0);
+  CHECK(fresh(tuner, kHold) == 23);
+
+  // Within the bounds, and nothing is learned before the first handshake
+  KeepaliveTuner bounded(30, 40);
+  PeerStatistics idle;
+  CHECK(bounded.Current() == 30 && bounded.Update(idle, now) == 0 && bounded.Update(idle, now + kHold) == 0);
+  CHECK(fresh(bounded, 0) == 0);
+  CHECK(fresh(bounded, kHold) == 40);
+  CHECK(fresh(bounded, kHold) == 0 && bounded.Current() == 40);
+  KeepaliveTuner fixed(20, 20);
+  CHECK(fresh(fixed, 0) == 0);
+  CHECK(broken(fixed) == 0 && fixed.Current() == 20);
+  CHECK(KeepaliveTuner(15, 120, 31).Current() == 31 && KeepaliveTuner(15, 120, 5).Current() == 15);
+}
+
+void TestLinkQuality() {
+  LinkQualityWindow window(10);
+  CHECK(window.Summarize().probes == 0 && window.Summarize().LossPercent() == 0);
+  window.RecordLoss();
+  LinkQuality lost = window.Summarize();
+  CHECK(lost.probes == 1 && lost.lost == 1 && lost.LossPercent() == 100 && lost.rtt_p50_ms == 0);
+
+  // Nearest rank: the median of 1..9 is 5, the 90th percentile the 9th of them
+  for (uint32_t rtt = 9; rtt >= 1; rtt--) {
+    window.RecordReply(rtt);
+  }
+  LinkQuality quality = window.Summarize();
+  CHECK(quality.probes == 10 && quality.lost == 1 && std::fabs(quality.LossPercent() - 10) < 1e-9);
+  CHECK(quality.rtt_min_ms == 1 && quality.rtt_p50_ms == 5 && quality.rtt_p90_ms == 9 && quality.rtt_max_ms == 9);
+
+  // Only the latest probes count: the loss and the fast replies are pushed out of the ring
+  for (int i = 0; i < 10; i++) {
+    window.RecordReply(100 + i);
+  }
+  quality = window.Summarize();
+  CHECK(quality.probes == 10 && quality.lost == 0);
+  CHECK(quality.rtt_min_ms == 100 && quality.rtt_p50_ms == 104 && quality.rtt_p90_ms == 108 &&
+        quality.rtt_max_ms == 109);
+}
+
+void TestActivationSchedule() {
+  // Priorities first, then the most recent handshakes, then the configured order
+  std::vector<ActivationSchedule::Peer> peers(7);
+  peers[1].last_handshake_ms = 1000;
+  peers[2].priority = 5;
+  peers[3].last_handshake_ms = 3000;
+  peers[5].priority = 1;
+  peers[5].last_handshake_ms = 1;
+  ActivationSchedule schedule(peers, 3);
+  CHECK(schedule.Total() == 7 && schedule.Taken() == 0 && !schedule.Done());
+  CHECK((schedule.Next() == std::vector<uint32_t>{5, 2, 3}));
+  CHECK((schedule.Next() == std::vector<uint32_t>{1, 0, 4}));
+  CHECK(schedule.Taken() == 6);
+  CHECK((schedule.Next() == std::vector<uint32_t>{6}));
+  CHECK(schedule.Done() && schedule.Next().empty());
+
+  ActivationSchedule all(peers, 0);
+  CHECK(all.Next().size() == 7 && all.Done());
+  ActivationSchedule none({}, 10);
+  CHECK(none.Done() && none.Next().empty());
+}
+
+// 32 bytes from 64 hex digits
+std::vector<uint8_t> Hex32(const char *text) {
+  std::vector<uint8_t> bytes(kX25519KeySize);
+  for (size_t i = 0; i < bytes.size(); i++) {
+    unsigned value = 0;
+    std::sscanf(text + 2 * i, "%2x", &value);
+    bytes[i] = static_cast<uint8_t>(value);
+  }
+  return bytes;
+}
+
+void TestX25519() {
+  // The test vectors of RFC 7748 section 5.2; the second has the top bit of u set, which is ignored
+  uint8_t out[kX25519KeySize];
+  X25519(out, Hex32("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4").data(),
+         Hex32("e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c").data());
+  CHECK(memcmp(out, Hex32("c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552").data(), 32) == 0);
+  X25519(out, Hex32("4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d").data(),
+         Hex32("e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493").data());
+  CHECK(memcmp(out, Hex32("95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957").data(), 32) == 0);
+
+  // The iterated test: k and u start as the base point, then k becomes the result and u the previous k
+  std::vector<uint8_t> k = Hex32("0900000000000000000000000000000000000000000000000000000000000000");
+  std::vector<uint8_t> u = k;
+  for (int i = 1; i <= 1000; i++) {
+    X25519(out, k.data(), u.data());
+    u = k;
+    k.assign(out, out + kX25519KeySize);
+    if (i == 1) {
+      CHECK(k == Hex32("422c8e7a6227d7bca1350b3e2bb7279f7897b87bb6854b783c60e80311ae3079"));
+    }
+  }
+  CHECK(k == Hex32("684cf59ba83309552800ef566f2f4d3c1c3887c49360e3875f2eb94d99532c51"));
+
+  // The Diffie-Hellman of section 6.1: both public keys, and the same shared secret from either side
+  std::vector<uint8_t> alice = Hex32("77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a");
+  std::vector<uint8_t> bob = Hex32("5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb");
+  std::vector<uint8_t> alice_public(kX25519KeySize), bob_public(kX25519KeySize);
+  X25519PublicKey(alice_public.data(), alice.data());
+  X25519PublicKey(bob_public.data(), bob.data());
+  CHECK(alice_public == Hex32("8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a"));
+  CHECK(bob_public == Hex32("de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f"));
+  std::vector<uint8_t> shared = Hex32("4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742");
+  X25519(out, alice.data(), bob_public.data());
+  CHECK(memcmp(out, shared.data(), 32) == 0);
+  X25519(out, bob.data(), alice_public.data());
+  CHECK(memcmp(out, shared.data(), 32) == 0);
+
+  uint8_t key[kX25519KeySize];
+  memset(key, 0xff, sizeof(key));
+  X25519Clamp(key);
+  CHECK(key[0] == 0xf8 && key[31] == 0x7f && key[15] == 0xff);
+}
+
+} // namespace
+} // namespace wireguard_dart
+
+int main() {
+  wireguard_dart::TestAddressParser();
+  wireguard_dart::TestAddressFormat();
+  wireguard_dart::TestIpPrefix();
+  wireguard_dart::TestPrefixTrie();
+  wireguard_dart::TestRouteSet();
+  wireguard_dart::TestWireguardKey();
+  wireguard_dart::TestPeerStatistics();
+  wireguard_dart::TestPeerIndex();
+  wireguard_dart::TestCumulativeSlots();
+  wireguard_dart::TestKeepaliveTuner();
+  wireguard_dart::TestLinkQuality();
+  wireguard_dart::TestActivationSchedule();
+  wireguard_dart::TestX25519();
+  if (wireguard_dart::failures != 0) {
+    std::fprintf(stderr, "%d checks failed\n", wireguard_dart::failures);
+    return 1;
+  }
+  std::printf("All checks passed\n");
+  return 0;
+}
@@ -0,0 +1,151 @@
+import 'dart:async';
+import 'dart:developer';
+import 'dart:io';
+import 'dart:math';
+
+import 'package:flutter/foundation.dart';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:integration_test/integration_test.dart';
+import 'package:wireguard_dart/peer_statistics.dart';
+import 'package:wireguard_dart/peer_statistics_view.dart';
+import 'package:wireguard_dart/wireguard_dart_method_channel.dart';
+
+/// What the platform channels cost on Windows, before hot calls move to FFI or binary payloads: the latency of
+/// empty calls, `status` and a statistics payload of synthetic peers in map and binary form, each decoded the way
+/// the plugin decodes the real one, and of events from the moment the native side posts them to the platform
+/// thread until the listener has them, at several rates and payload sizes. Run it in profile mode with
+/// `test_driver/channel_benchmark.dart`, see the README, which writes the results to
+/// `build/channel_benchmark_<label>.json` for comparing releases.
+
+const _label = String.fromEnvironment('BENCHMARK_LABEL', defaultValue: 'dev');
+const _warmUpCalls = 50;
+const _calls = 2000;
+const _payloadPeers = [1, 100, 1000, 10000];
+const _eventRates = [100, 1000, 5000];
+const _eventPayloadBytes = [0, 1024, 65536];
+const _eventSeconds = 2;
+const _eventWarmUp = 20;
+
+final _plugin = MethodChannelWireguardDart();
+
+/// The percentiles of latencies in microseconds, by the nearest rank.
+Map<String, num> _summarize(List<int> latenciesUs) {
+  if (latenciesUs.isEmpty) return {'count': 0};
+  latenciesUs.sort();
+  int at(double quantile) => latenciesUs[min(latenciesUs.length - 1, (quantile * latenciesUs.length).floor())];
+  return {
+    'count': latenciesUs.length,
+    'p50Us': at(0.5),
+    'p90Us': at(0.9),
+    'p99Us': at(0.99),
+    'maxUs': latenciesUs.last,
+    'meanUs': latenciesUs.reduce((a, b) => a + b) / latenciesUs.length,
+  };
+}
+
+/// [call] after [_warmUpCalls] untimed ones, each timed from the call until its result is decoded.
+Future<Map<String, num>> _timeCalls(Future<void> Function() call, {int calls = _calls}) async {
+  for (var i = 0; i < _warmUpCalls; i++) {
+    await call();
+  }
+  final latenciesUs = <int>[];
+  final stopwatch = Stopwatch();
+  for (var i = 0; i < calls; i++) {
+    stopwatch
+      ..reset()
+      ..start();
+    await call();
+    stopwatch.stop();
+    latenciesUs.add(stopwatch.elapsedMicroseconds);
+  }
+  return _summarize(latenciesUs);
+}
+
+Future<void> _statsAsMap(int peers) async {
+  final result = await _plugin.methodChannel.invokeMethod(WireguardMethodChannelMethod.benchmarkCall.value, {
+    'peers': peers,
+  });
+  final decoded = <String, PeerStatistics>{};
+  for (final entry in (result as Map).entries) {
+    decoded[entry.key as String] = PeerStatistics.fromJson(Map<String, dynamic>.from(entry.value as Map));
+  }
+  if (decoded.length != peers) throw StateError('Expected $peers peers, got ${decoded.length}');
+}
+
+Future<void> _statsAsBinary(int peers) async {
+  final result = await _plugin.methodChannel.invokeMethod<Uint8List>(
+    WireguardMethodChannelMethod.benchmarkCall.value,
+    {'peers': peers, 'binary': true},
+  );
+  final view = PeerStatisticsView(result!);
+  var rxBytes = 0;
+  for (var i = 0; i < view.length; i++) {
+    rxBytes += view.rxBytes(i);
+  }
+  if (view.length != peers || (peers > 0 && rxBytes == 0)) throw StateError('Expected $peers peers');
+}
+
+/// Events at [eventsPerSecond] for [_eventSeconds], each with [payloadBytes], timed from their native enqueue on
+/// the clock of `Timeline.now`. Events that never came are counted as lost.
+Future<Map<String, num>> _timeEvents(int eventsPerSecond, int payloadBytes) async {
+  final count = eventsPerSecond * _eventSeconds;
+  final latenciesUs = <int>[];
+  var received = 0;
+  final done = Completer<void>();
+  final subscription = _plugin.benchmarkChannel.receiveBroadcastStream({
+    'eventsPerSecond': eventsPerSecond,
+    'count': count,
+    'payloadBytes': payloadBytes,
+  }).listen((event) {
+    final nowUs = Timeline.now;
+    final sequence = event['sequence'] as int;
+    received++;
+    if (sequence >= _eventWarmUp) latenciesUs.add(nowUs - (event['monotonicUs'] as int));
+    if (sequence == count - 1 && !done.isCompleted) done.complete();
+  });
+  await done.future.timeout(const Duration(seconds: _eventSeconds * 5), onTimeout: () {});
+  await subscription.cancel();
+  return {..._summarize(latenciesUs), 'lost': count - received};
+}
+
+void main() {
+  final binding = IntegrationTestWidgetsFlutterBinding.ensureInitialized();
+
+  testWidgets('channel round trips', (tester) async {
+    final calls = <String, Map<String, num>>{};
+    calls['empty'] = await _timeCalls(() => _plugin.methodChannel.invokeMethod<void>(
+          WireguardMethodChannelMethod.benchmarkCall.value,
+        ));
+    // Of a tunnel that does not exist, which still reads the adapter list as a real status call does
+    calls['status'] = await _timeCalls(() => _plugin.methodChannel.invokeMethod<String>(
+          WireguardMethodChannelMethod.status.value,
+          {'win32ServiceName': 'wg_dart_benchmark'},
+        ));
+    for (final peers in _payloadPeers) {
+      // Fewer calls for the large payloads, whose latencies vary less relative to their size
+      final count = peers >= 10000 ? _calls ~/ 10 : _calls;
+      calls['statsMap/$peers'] = await _timeCalls(() => _statsAsMap(peers), calls: count);
+      calls['statsBinary/$peers'] = await _timeCalls(() => _statsAsBinary(peers), calls: count);
+    }
+
+    final events = <String, Map<String, num>>{};
+    for (final rate in _eventRates) {
+      for (final payloadBytes in _eventPayloadBytes) {
+        events['$rate/s/${payloadBytes}B'] = await _timeEvents(rate, payloadBytes);
+      }
+    }
+
+    binding.reportData = {
+      'label': _label,
+      'mode': kReleaseMode ? 'release' : (kProfileMode ? 'profile' : 'debug'),
+      'os': Platform.operatingSystemVersion,
+      'processors': Platform.numberOfProcessors,
+      'timestamp': DateTime.now().toUtc().toIso8601String(),
+      'calls': calls,
+      'events': events,
+    };
+    for (final entry in {...calls, ...events}.entries) {
+      debugPrint('${entry.key}: ${entry.value}');
+    }
+  }, skip: !Platform.isWindows, timeout: const Timeout(Duration(minutes: 10)));
+}
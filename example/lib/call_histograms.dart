@@ -0,0 +1,59 @@
+/// One native call kind from [WireguardDart.getMetrics]: how many calls fell at or below each bucket bound.
+class CallHistogram {
+  final String call;
+
+  /// Upper bounds in seconds with the cumulative count of calls up to each, in increasing order.
+  final List<MapEntry<double, int>> buckets;
+  int count = 0;
+  double sumSeconds = 0;
+  double maxSeconds = 0;
+
+  CallHistogram(this.call) : buckets = [];
+
+  double get meanSeconds => count == 0 ? 0 : sumSeconds / count;
+
+  /// The bound of the first bucket that holds the [q] quantile, so the true value is at most this.
+  double quantile(double q) {
+    final rank = q * count;
+    for (final bucket in buckets) {
+      if (bucket.value >= rank) return bucket.key;
+    }
+    return maxSeconds;
+  }
+
+  /// The calls in each bucket on its own rather than cumulative, for drawing.
+  List<int> get bucketCounts {
+    final counts = <int>[];
+    var previous = 0;
+    for (final bucket in buckets) {
+      counts.add(bucket.value - previous);
+      previous = bucket.value;
+    }
+    return counts;
+  }
+}
+
+final _sample = RegExp(r'^(\w+)\{call="([^"]+)"(?:,le="([^"]+)")?\} (\S+)$');
+
+/// Parses the OpenMetrics text of [WireguardDart.getMetrics] into one histogram per call kind, by call name.
+Map<String, CallHistogram> parseCallHistograms(String text) {
+  final histograms = <String, CallHistogram>{};
+  for (final line in text.split('\n')) {
+    final match = _sample.firstMatch(line.trim());
+    if (match == null) continue;
+    final family = match.group(1)!;
+    final histogram = histograms.putIfAbsent(match.group(2)!, () => CallHistogram(match.group(2)!));
+    final value = double.tryParse(match.group(4)!) ?? 0;
+    if (family.endsWith('_max_seconds')) {
+      histogram.maxSeconds = value;
+    } else if (family.endsWith('_bucket')) {
+      final bound = match.group(3)!;
+      if (bound != '+Inf') histogram.buckets.add(MapEntry(double.parse(bound), value.toInt()));
+    } else if (family.endsWith('_count')) {
+      histogram.count = value.toInt();
+    } else if (family.endsWith('_sum')) {
+      histogram.sumSeconds = value;
+    }
+  }
+  return histograms;
+}
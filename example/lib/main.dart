@@ -12,6 +12,7 @@ import 'package:wireguard_dart/tunnel_statistics.dart';
 import 'package:intl/intl.dart';
 import 'package:path_provider/path_provider.dart';
 import 'package:wireguard_dart/wireguard_dart.dart';
+import 'package:wireguard_dart_example/perf_console.dart';
 import 'package:wireguard_dart_example/snackbar.dart';
 
 const tunBundleId = "network.mysterium.wireguardDartExample.tun";
@@ -319,171 +320,182 @@ class _MyAppState extends State<MyApp> {
   Widget build(BuildContext context) {
     return MaterialApp(
       scaffoldMessengerKey: snackbarKey,
-      home: Scaffold(
-        appBar: AppBar(
-          title: const Text('Plugin example app'),
+      home: DefaultTabController(
+        length: 2,
+        child: Scaffold(
+          appBar: AppBar(
+            title: const Text('Plugin example app'),
+            bottom: const TabBar(tabs: [Tab(text: 'Tunnel'), Tab(text: 'Performance')]),
+          ),
+          body: TabBarView(children: [
+            buildTunnelTab(),
+            const PerfConsole(bundleId: tunBundleId),
+          ]),
         ),
-        body: Container(
-          constraints: const BoxConstraints.expand(),
-          padding: const EdgeInsets.all(16),
-          child: SingleChildScrollView(
-            child: Column(
+      ),
+    );
+  }
+
+  Widget buildTunnelTab() {
+    return Container(
+      constraints: const BoxConstraints.expand(),
+      padding: const EdgeInsets.all(16),
+      child: SingleChildScrollView(
+        child: Column(
+          children: [
+            Wrap(
+              spacing: 10,
+              runSpacing: 10,
               children: [
-                Wrap(
-                  spacing: 10,
-                  runSpacing: 10,
-                  children: [
-                    TextButton(
-                      onPressed: generateKey,
-                      style: ButtonStyle(
-                          minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                          padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                          backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                          overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                      child: const Text(
-                        'Generate Key',
-                        style: TextStyle(color: Colors.white),
-                      ),
-                    ),
-                    if (Platform.isWindows)
-                      TextButton(
-                        onPressed: nativeInit,
-                        style: ButtonStyle(
-                            minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                            padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                            backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                            overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                        child: const Text(
-                          'Native initialization',
-                          style: TextStyle(color: Colors.white),
-                        ),
-                      ),
-                    TextButton(
-                      onPressed: checkTunnelConfiguration,
-                      style: ButtonStyle(
-                          minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                          padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                          backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                          overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                      child: const Text(
-                        'Is Tunnel Configured',
-                        style: TextStyle(color: Colors.white),
-                      ),
-                    ),
-                    TextButton(
-                      onPressed: setupTunnel,
-                      style: ButtonStyle(
-                          minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                          padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                          backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                          overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                      child: const Text(
-                        'Setup Tunnel',
-                        style: TextStyle(color: Colors.white),
-                      ),
-                    ),
-                    TextButton(
-                      onPressed: connect,
-                      style: ButtonStyle(
-                          minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                          padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                          backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                          overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                      child: const Text(
-                        'Connect',
-                        style: TextStyle(color: Colors.white),
-                      ),
-                    ),
-                    TextButton(
-                      onPressed: disconnect,
-                      style: ButtonStyle(
-                          minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                          padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                          backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                          overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                      child: const Text(
-                        'Disconnect',
-                        style: TextStyle(color: Colors.white),
-                      ),
-                    ),
-                    if (Platform.isIOS || Platform.isMacOS)
-                      TextButton(
-                        onPressed: removeTunnelConfiguration,
-                        style: ButtonStyle(
-                            minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                            padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                            backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                            overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                        child: const Text(
-                          'Remove tunnel configuration',
-                          style: TextStyle(color: Colors.white),
-                        ),
-                      ),
-                    TextButton(
-                      onPressed: status,
-                      style: ButtonStyle(
-                          minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                          padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                          backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                          overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                      child: const Text(
-                        'Query status',
-                        style: TextStyle(color: Colors.white),
-                      ),
+                TextButton(
+                  onPressed: generateKey,
+                  style: ButtonStyle(
+                      minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                      padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                      backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                      overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                  child: const Text(
+                    'Generate Key',
+                    style: TextStyle(color: Colors.white),
+                  ),
+                ),
+                if (Platform.isWindows)
+                  TextButton(
+                    onPressed: nativeInit,
+                    style: ButtonStyle(
+                        minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                        padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                        backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                        overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                    child: const Text(
+                      'Native initialization',
+                      style: TextStyle(color: Colors.white),
                     ),
-                    TextButton(
-                      onPressed: getTunnelStatistics,
-                      style: ButtonStyle(
-                          minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
-                          padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
-                          backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
-                          overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
-                      child: const Text(
-                        'Get tunnel statistics',
-                        style: TextStyle(color: Colors.white),
-                      ),
+                  ),
+                TextButton(
+                  onPressed: checkTunnelConfiguration,
+                  style: ButtonStyle(
+                      minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                      padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                      backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                      overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                  child: const Text(
+                    'Is Tunnel Configured',
+                    style: TextStyle(color: Colors.white),
+                  ),
+                ),
+                TextButton(
+                  onPressed: setupTunnel,
+                  style: ButtonStyle(
+                      minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                      padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                      backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                      overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                  child: const Text(
+                    'Setup Tunnel',
+                    style: TextStyle(color: Colors.white),
+                  ),
+                ),
+                TextButton(
+                  onPressed: connect,
+                  style: ButtonStyle(
+                      minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                      padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                      backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                      overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                  child: const Text(
+                    'Connect',
+                    style: TextStyle(color: Colors.white),
+                  ),
+                ),
+                TextButton(
+                  onPressed: disconnect,
+                  style: ButtonStyle(
+                      minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                      padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                      backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                      overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                  child: const Text(
+                    'Disconnect',
+                    style: TextStyle(color: Colors.white),
+                  ),
+                ),
+                if (Platform.isIOS || Platform.isMacOS)
+                  TextButton(
+                    onPressed: removeTunnelConfiguration,
+                    style: ButtonStyle(
+                        minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                        padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                        backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                        overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                    child: const Text(
+                      'Remove tunnel configuration',
+                      style: TextStyle(color: Colors.white),
                     ),
-                  ],
+                  ),
+                TextButton(
+                  onPressed: status,
+                  style: ButtonStyle(
+                      minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                      padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                      backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                      overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                  child: const Text(
+                    'Query status',
+                    style: TextStyle(color: Colors.white),
+                  ),
+                ),
+                TextButton(
+                  onPressed: getTunnelStatistics,
+                  style: ButtonStyle(
+                      minimumSize: WidgetStateProperty.all<Size>(const Size(100, 50)),
+                      padding: WidgetStateProperty.all(const EdgeInsets.fromLTRB(20, 15, 20, 15)),
+                      backgroundColor: WidgetStateProperty.all<Color>(Colors.blueAccent),
+                      overlayColor: WidgetStateProperty.all<Color>(Colors.white.withValues(alpha: 0.1))),
+                  child: const Text(
+                    'Get tunnel statistics',
+                    style: TextStyle(color: Colors.white),
+                  ),
                 ),
-                const SizedBox(height: 20),
-                Text("Query tunnel status: ${_status.name}"),
-                StreamBuilder<AdapterStatus>(
-                    initialData: const AdapterStatus(0, ConnectionStatus.unknown),
-                    stream: _statusStream,
-                    builder: (BuildContext context, AsyncSnapshot<AdapterStatus> snapshot) {
-                      // Check if the snapshot has data
-                      if (snapshot.hasData) {
-                        final statusData = snapshot.data!;
-                        return Text("Tunnel stream - LUID: ${statusData.luid}, Status: ${statusData.status.name}");
-                      }
-                      return const CircularProgressIndicator();
-                    }),
-                Text('Tunnel configured: $_checkTunnelConfiguration'),
-                Text('Tunnel setup: $_isTunnelSetup'),
-                Text('Key pair:\n Public key:${_keyPair?.publicKey}\n Private key:${_keyPair?.privateKey}'),
-                StreamBuilder<TunnelStatistics>(
-                    initialData: const TunnelStatistics(latestHandshake: 0, totalDownload: 0, totalUpload: 0),
-                    stream: _tunnelStatisticsStream,
-                    builder: (BuildContext context, AsyncSnapshot<TunnelStatistics> snapshot) {
-                      // Check if the snapshot has data and is a map containing the 'status' key
-                      if (snapshot.hasData) {
-                        final handshakeTime = DateTime.fromMillisecondsSinceEpoch(snapshot.data!.latestHandshake.toInt()).toLocal();
-                        return Text(
-                          """Tunnel statistics:
-                        Latest handshake: $handshakeTime
-                        Total download: ${snapshot.data?.totalDownload}
-                        Total Upload: ${snapshot.data?.totalUpload}
-                        Upload speed: ${uploadSpeedKBs.toStringAsFixed(2)} KB/s
-                        Download speed: ${downloadSpeedKBs.toStringAsFixed(2)} KB/s
-
-                            """,
-                        );
-                      }
-                      return const CircularProgressIndicator();
-                    }),
               ],
             ),
-          ),
+            const SizedBox(height: 20),
+            Text("Query tunnel status: ${_status.name}"),
+            StreamBuilder<AdapterStatus>(
+                initialData: const AdapterStatus(0, ConnectionStatus.unknown),
+                stream: _statusStream,
+                builder: (BuildContext context, AsyncSnapshot<AdapterStatus> snapshot) {
+                  // Check if the snapshot has data
+                  if (snapshot.hasData) {
+                    final statusData = snapshot.data!;
+                    return Text("Tunnel stream - LUID: ${statusData.luid}, Status: ${statusData.status.name}");
+                  }
+                  return const CircularProgressIndicator();
+                }),
+            Text('Tunnel configured: $_checkTunnelConfiguration'),
+            Text('Tunnel setup: $_isTunnelSetup'),
+            Text('Key pair:\n Public key:${_keyPair?.publicKey}\n Private key:${_keyPair?.privateKey}'),
+            StreamBuilder<TunnelStatistics>(
+                initialData: const TunnelStatistics(latestHandshake: 0, totalDownload: 0, totalUpload: 0),
+                stream: _tunnelStatisticsStream,
+                builder: (BuildContext context, AsyncSnapshot<TunnelStatistics> snapshot) {
+                  // Check if the snapshot has data and is a map containing the 'status' key
+                  if (snapshot.hasData) {
+                    final handshakeTime = DateTime.fromMillisecondsSinceEpoch(snapshot.data!.latestHandshake.toInt()).toLocal();
+                    return Text(
+                      """Tunnel statistics:
+                    Latest handshake: $handshakeTime
+                    Total download: ${snapshot.data?.totalDownload}
+                    Total Upload: ${snapshot.data?.totalUpload}
+                    Upload speed: ${uploadSpeedKBs.toStringAsFixed(2)} KB/s
+                    Download speed: ${downloadSpeedKBs.toStringAsFixed(2)} KB/s
+
+                        """,
+                    );
+                  }
+                  return const CircularProgressIndicator();
+                }),
+          ],
         ),
       ),
     );
@@ -0,0 +1,388 @@
+import 'dart:async';
+import 'dart:developer' as developer;
+import 'dart:io';
+
+import 'package:flutter/material.dart';
+import 'package:wireguard_dart/adapter_status.dart';
+import 'package:wireguard_dart/memory_stats.dart';
+import 'package:wireguard_dart/peer_statistics.dart';
+import 'package:wireguard_dart/phase_stats.dart';
+import 'package:wireguard_dart/tunnel_statistics.dart';
+import 'package:wireguard_dart/wireguard_dart.dart';
+import 'package:wireguard_dart_example/call_histograms.dart';
+import 'package:wireguard_dart_example/snackbar.dart';
+
+const stressTunnelName = "WiregardDartStress";
+
+/// Peers per synthetic configuration the stress mode offers.
+const stressPeerCounts = [10, 100, 1000, 10000, 50000];
+const stressCycleCounts = [10, 50, 200, 1000];
+
+/// A reference console for the plugin's performance: connect phase timings, per-peer throughput, status event
+/// rates and native call histograms, refreshed every second, and a stress mode that cycles a tunnel with large
+/// synthetic configurations to reproduce slow setups on a dev box.
+class PerfConsole extends StatefulWidget {
+  final String bundleId;
+
+  const PerfConsole({super.key, required this.bundleId});
+
+  @override
+  State<PerfConsole> createState() => _PerfConsoleState();
+}
+
+class _PerfConsoleState extends State<PerfConsole> {
+  final _wireguardDartPlugin = WireguardDart();
+  Timer? _refreshTimer;
+  StreamSubscription<AdapterStatus>? _statusSubscription;
+  StreamSubscription<Map<String, TunnelStatistics>>? _statisticsSubscription;
+
+  Map<String, PhaseStats> _perfStats = {};
+  Map<String, CallHistogram> _histograms = {};
+  MemoryStats? _memoryStats;
+
+  // Tunnel name to its peers by public key, refreshed on every statistics event of the tunnel
+  final Map<String, Map<String, PeerStatistics>> _peers = {};
+  final Map<String, TunnelStatistics> _tunnels = {};
+
+  int _statusEvents = 0;
+  int _statusEventsLastSecond = 0;
+  int _statusEventsPeak = 0;
+  int _statisticsEvents = 0;
+  int _statisticsEventsLastSecond = 0;
+  int _countedStatusEvents = 0;
+  int _countedStatisticsEvents = 0;
+
+  int _stressPeers = stressPeerCounts[2];
+  int _stressCycles = stressCycleCounts[0];
+  bool _stressRunning = false;
+  bool _stopStress = false;
+  int _stressCycle = 0;
+  final List<_StressCycle> _stressResults = [];
+
+  @override
+  void initState() {
+    super.initState();
+    _statusSubscription = _wireguardDartPlugin.statusStream(batched: true).listen(
+          (_) => _statusEvents++,
+          onError: (error) => developer.log('Status stream error', error: error.toString()),
+        );
+    _statisticsSubscription = _wireguardDartPlugin.statisticsStream().listen(
+          _onStatistics,
+          onError: (error) => developer.log('Statistics stream error', error: error.toString()),
+        );
+    _refreshTimer = Timer.periodic(const Duration(seconds: 1), (_) => _refresh());
+    _refresh();
+  }
+
+  @override
+  void dispose() {
+    _refreshTimer?.cancel();
+    _statusSubscription?.cancel();
+    _statisticsSubscription?.cancel();
+    _stopStress = true;
+    super.dispose();
+  }
+
+  void _onStatistics(Map<String, TunnelStatistics> tunnels) async {
+    _statisticsEvents++;
+    _tunnels.addAll(tunnels);
+    for (final tunnelName in tunnels.keys) {
+      try {
+        _peers[tunnelName] = await _wireguardDartPlugin.getPeerStatistics(tunnelName: tunnelName);
+      } catch (e) {
+        // The tunnel went away between the event and the read
+        _peers.remove(tunnelName);
+      }
+    }
+  }
+
+  Future<void> _refresh() async {
+    final statusRate = _statusEvents - _countedStatusEvents;
+    final statisticsRate = _statisticsEvents - _countedStatisticsEvents;
+    _countedStatusEvents = _statusEvents;
+    _countedStatisticsEvents = _statisticsEvents;
+
+    Map<String, PhaseStats> perfStats = _perfStats;
+    Map<String, CallHistogram> histograms = _histograms;
+    MemoryStats? memoryStats = _memoryStats;
+    try {
+      perfStats = await _wireguardDartPlugin.getPerfStats();
+      if (Platform.isWindows) {
+        histograms = parseCallHistograms(await _wireguardDartPlugin.getMetrics());
+        memoryStats = await _wireguardDartPlugin.getMemoryStats();
+      }
+    } catch (e) {
+      developer.log('Performance refresh', error: e.toString());
+    }
+    if (!mounted) return;
+    setState(() {
+      _statusEventsLastSecond = statusRate;
+      _statusEventsPeak = statusRate > _statusEventsPeak ? statusRate : _statusEventsPeak;
+      _statisticsEventsLastSecond = statisticsRate;
+      _perfStats = perfStats;
+      _histograms = histograms;
+      _memoryStats = memoryStats;
+    });
+  }
+
+  /// A configuration with [peers] peers, each with a /32 of its own in 10.64.0.0/10 and an endpoint in the
+  /// documentation range, so nothing is ever sent anywhere real.
+  Future<String> _syntheticConfig(int peers) async {
+    final interfaceKeys = await _wireguardDartPlugin.generateKeyPair();
+    final peerKeys = await _wireguardDartPlugin.generateKeyPairs(peers);
+    final config = StringBuffer()
+      ..writeln('[Interface]')
+      ..writeln('PrivateKey = ${interfaceKeys.privateKey}')
+      ..writeln('Address = 10.63.0.1/32');
+    for (var i = 0; i < peers; i++) {
+      config
+        ..writeln()
+        ..writeln('[Peer]')
+        ..writeln('PublicKey = ${peerKeys[i].publicKey}')
+        ..writeln('Endpoint = 192.0.2.${1 + i % 254}:51820')
+        ..writeln('AllowedIPs = 10.${64 + (i >> 16)}.${(i >> 8) & 255}.${i & 255}/32');
+    }
+    return config.toString();
+  }
+
+  Future<void> _runStress() async {
+    setState(() {
+      _stressRunning = true;
+      _stopStress = false;
+      _stressCycle = 0;
+      _stressResults.clear();
+    });
+    try {
+      final config = await _syntheticConfig(_stressPeers);
+      for (var cycle = 0; cycle < _stressCycles && !_stopStress; cycle++) {
+        final stopwatch = Stopwatch()..start();
+        await _wireguardDartPlugin.setupTunnel(bundleId: widget.bundleId, tunnelName: stressTunnelName, cfg: config);
+        final setupMs = stopwatch.elapsedMilliseconds;
+        await _wireguardDartPlugin.connect(tunnelName: stressTunnelName);
+        final connectMs = stopwatch.elapsedMilliseconds - setupMs;
+        await _wireguardDartPlugin.disconnect(tunnelName: stressTunnelName);
+        final disconnectMs = stopwatch.elapsedMilliseconds - setupMs - connectMs;
+        if (!mounted) return;
+        setState(() {
+          _stressCycle = cycle + 1;
+          _stressResults.add(_StressCycle(setupMs, connectMs, disconnectMs));
+        });
+      }
+      showSnackbar("Stress run finished after $_stressCycle cycles", type: MessageType.success);
+    } catch (e) {
+      developer.log('Stress run', error: e.toString());
+      showSnackbar("Stress run failed in cycle ${_stressCycle + 1}: ${e.toString()}", type: MessageType.error);
+    } finally {
+      if (mounted) {
+        setState(() => _stressRunning = false);
+      }
+    }
+  }
+
+  @override
+  Widget build(BuildContext context) {
+    return SingleChildScrollView(
+      padding: const EdgeInsets.all(16),
+      child: Column(
+        crossAxisAlignment: CrossAxisAlignment.start,
+        children: [
+          _section('Stress mode', _buildStress()),
+          _section('Connect phases', _buildPhases()),
+          _section('Peer throughput', _buildPeers()),
+          _section('Event rates', _buildEventRates()),
+          if (Platform.isWindows) _section('Native calls', _buildHistograms()),
+          if (_memoryStats != null) _section('Memory', _buildMemory(_memoryStats!)),
+        ],
+      ),
+    );
+  }
+
+  Widget _section(String title, Widget child) => Padding(
+        padding: const EdgeInsets.only(bottom: 24),
+        child: Column(
+          crossAxisAlignment: CrossAxisAlignment.start,
+          children: [
+            Text(title, style: Theme.of(context).textTheme.titleMedium),
+            const SizedBox(height: 8),
+            child,
+          ],
+        ),
+      );
+
+  Widget _table(List<String> header, List<List<String>> rows) => SingleChildScrollView(
+        scrollDirection: Axis.horizontal,
+        child: DataTable(
+          headingRowHeight: 32,
+          dataRowMinHeight: 24,
+          dataRowMaxHeight: 28,
+          columns: [for (final title in header) DataColumn(label: Text(title), numeric: title != header.first)],
+          rows: [
+            for (final row in rows) DataRow(cells: [for (final cell in row) DataCell(Text(cell))]),
+          ],
+        ),
+      );
+
+  Widget _buildStress() {
+    String median(Iterable<int> values) {
+      final sorted = values.toList()..sort();
+      return sorted.isEmpty ? '-' : '${sorted[sorted.length ~/ 2]} ms';
+    }
+
+    return Column(
+      crossAxisAlignment: CrossAxisAlignment.start,
+      children: [
+        Wrap(
+          spacing: 16,
+          crossAxisAlignment: WrapCrossAlignment.center,
+          children: [
+            const Text('Peers'),
+            DropdownButton<int>(
+              value: _stressPeers,
+              items: [for (final count in stressPeerCounts) DropdownMenuItem(value: count, child: Text('$count'))],
+              onChanged: _stressRunning ? null : (count) => setState(() => _stressPeers = count!),
+            ),
+            const Text('Cycles'),
+            DropdownButton<int>(
+              value: _stressCycles,
+              items: [for (final count in stressCycleCounts) DropdownMenuItem(value: count, child: Text('$count'))],
+              onChanged: _stressRunning ? null : (count) => setState(() => _stressCycles = count!),
+            ),
+            ElevatedButton(
+              onPressed: _stressRunning ? () => setState(() => _stopStress = true) : _runStress,
+              child: Text(_stressRunning ? 'Stop' : 'Start'),
+            ),
+            if (_stressRunning || _stressResults.isNotEmpty) Text('Cycle $_stressCycle of $_stressCycles'),
+          ],
+        ),
+        if (_stressResults.isNotEmpty)
+          Text('Median setup ${median(_stressResults.map((r) => r.setupMs))}, '
+              'connect ${median(_stressResults.map((r) => r.connectMs))}, '
+              'disconnect ${median(_stressResults.map((r) => r.disconnectMs))}; '
+              'last setup ${_stressResults.last.setupMs} ms'),
+      ],
+    );
+  }
+
+  Widget _buildPhases() {
+    if (_perfStats.isEmpty) return const Text('No tunnel set up yet');
+    return _table(
+      ['Phase', 'Count', 'Last ms', 'p50 ms', 'p90 ms', 'p99 ms', 'Max ms'],
+      [
+        for (final entry in _perfStats.entries)
+          [
+            entry.key,
+            '${entry.value.count}',
+            _ms(entry.value.lastUs),
+            _ms(entry.value.p50Us),
+            _ms(entry.value.p90Us),
+            _ms(entry.value.p99Us),
+            _ms(entry.value.maxUs),
+          ],
+      ],
+    );
+  }
+
+  Widget _buildPeers() {
+    if (_tunnels.isEmpty) return const Text('No statistics yet, connect a tunnel');
+    final rows = <List<String>>[];
+    for (final tunnel in _peers.entries) {
+      // The busiest peers only, a stress configuration has thousands
+      double busy(PeerStatistics peer) => peer.rxRateEwma + peer.txRateEwma;
+      final peers = tunnel.value.entries.toList()..sort((a, b) => busy(b.value).compareTo(busy(a.value)));
+      for (final peer in peers.take(10)) {
+        rows.add([
+          tunnel.key,
+          '${peer.key.substring(0, 8)}…',
+          _rate(peer.value.rxRateEwma),
+          _rate(peer.value.txRateEwma),
+          peer.value.handshakeAgeMs == null ? '-' : '${peer.value.handshakeAgeMs! ~/ 1000} s',
+        ]);
+      }
+    }
+    return _table(['Tunnel', 'Peer', 'Download', 'Upload', 'Handshake age'], rows);
+  }
+
+  Widget _buildEventRates() => Text('Status events: $_statusEventsLastSecond/s, peak $_statusEventsPeak/s, '
+      '$_statusEvents total\n'
+      'Statistics events: $_statisticsEventsLastSecond/s, $_statisticsEvents total');
+
+  Widget _buildHistograms() {
+    if (_histograms.isEmpty) return const Text('No native calls yet');
+    final calls = _histograms.values.toList()..sort((a, b) => b.sumSeconds.compareTo(a.sumSeconds));
+    return Column(
+      crossAxisAlignment: CrossAxisAlignment.start,
+      children: [
+        _table(
+          ['Call', 'Count', 'Mean ms', 'p50 ≤ ms', 'p99 ≤ ms', 'Max ms', 'Total ms'],
+          [
+            for (final call in calls)
+              [
+                call.call,
+                '${call.count}',
+                _seconds(call.meanSeconds),
+                _seconds(call.quantile(0.5)),
+                _seconds(call.quantile(0.99)),
+                _seconds(call.maxSeconds),
+                _seconds(call.sumSeconds),
+              ],
+          ],
+        ),
+        const SizedBox(height: 8),
+        for (final call in calls.take(6)) _HistogramBars(histogram: call),
+      ],
+    );
+  }
+
+  Widget _buildMemory(MemoryStats stats) => Text('Plugin heap ${_bytes(stats.totalBytes)}: configurations '
+      '${_bytes(stats.parsedConfigBytes)}, wire buffers ${_bytes(stats.wireBufferBytes)}, statistics '
+      '${_bytes(stats.statisticsBytes)}, logs ${_bytes(stats.logBytes)}, caches ${_bytes(stats.cacheBytes)}\n'
+      'Process working set ${_bytes(stats.workingSetBytes)}${stats.lowMemory ? ', low-memory mode' : ''}');
+
+  static String _ms(int microseconds) => (microseconds / 1000).toStringAsFixed(1);
+
+  static String _seconds(double seconds) => (seconds * 1000).toStringAsFixed(3);
+
+  static String _rate(double bytesPerSecond) => '${(bytesPerSecond / 1024).toStringAsFixed(1)} KB/s';
+
+  static String _bytes(int bytes) => '${(bytes / 1024).toStringAsFixed(0)} KB';
+}
+
+class _StressCycle {
+  final int setupMs;
+  final int connectMs;
+  final int disconnectMs;
+
+  const _StressCycle(this.setupMs, this.connectMs, this.disconnectMs);
+}
+
+/// The calls of one kind per power-of-two bucket, as a row of bars scaled to the fullest bucket.
+class _HistogramBars extends StatelessWidget {
+  final CallHistogram histogram;
+
+  const _HistogramBars({required this.histogram});
+
+  @override
+  Widget build(BuildContext context) {
+    final counts = histogram.bucketCounts;
+    final fullest = counts.fold<int>(1, (max, count) => count > max ? count : max);
+    return Padding(
+      padding: const EdgeInsets.symmetric(vertical: 4),
+      child: Row(
+        crossAxisAlignment: CrossAxisAlignment.end,
+        children: [
+          SizedBox(width: 220, child: Text(histogram.call, overflow: TextOverflow.ellipsis)),
+          for (var i = 0; i < counts.length; i++)
+            Tooltip(
+              message: '≤ ${(histogram.buckets[i].key * 1000).toStringAsFixed(3)} ms: ${counts[i]}',
+              child: Container(
+                width: 8,
+                height: 2 + 38 * counts[i] / fullest,
+                margin: const EdgeInsets.only(right: 1),
+                color: Colors.blueAccent,
+              ),
+            ),
+        ],
+      ),
+    );
+  }
+}
@@ -0,0 +1,15 @@
+import 'dart:convert';
+import 'dart:io';
+
+import 'package:integration_test/integration_test_driver.dart';
+
+/// Writes what `integration_test/channel_benchmark_test.dart` reports to `build/channel_benchmark_<label>.json`,
+/// one file per label, so the results of releases can be kept side by side and compared.
+Future<void> main() {
+  return integrationDriver(responseDataCallback: (data) async {
+    if (data == null) return;
+    final file = File('build/channel_benchmark_${data['label']}.json');
+    await file.create(recursive: true);
+    await file.writeAsString(const JsonEncoder.withIndent('  ').convert(data));
+  });
+}
@@ -0,0 +1,36 @@
+/// The kinds of event `WireguardDart.statusStream` sends, for asking it for some of them only.
+enum AdapterEventType {
+  /// A change of the adapter's `ConnectionStatus`, and the last status a new listener gets.
+  status('status'),
+
+  /// The adapter is up and all of its addresses are usable, see `AdapterStatus.readyAt`.
+  ready('ready'),
+
+  /// A peer went without a handshake for longer than the threshold given to `nativeInit`.
+  stale('stale'),
+
+  /// A stale peer completed a handshake again.
+  recovered('recovered'),
+  addressReady('addressReady'),
+  addressRemoved('addressRemoved'),
+  routeAdded('routeAdded'),
+  routeRemoved('routeRemoved'),
+
+  /// A peer's endpoint changed, see `AdapterStatus.endpoint`.
+  roamed('roamed'),
+
+  /// A batch of peers was added while the tunnel comes up a batch at a time, see `AdapterStatus.activatedPeers`.
+  activation('activation');
+
+  const AdapterEventType(this.value);
+  final String value;
+
+  /// The type of a status stream event, whose plain status changes have no `event`.
+  static AdapterEventType? fromEvent(String? event) {
+    if (event == null) return status;
+    for (final type in values) {
+      if (type.value == event) return type;
+    }
+    return null;
+  }
+}
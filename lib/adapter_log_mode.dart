@@ -0,0 +1,12 @@
+/// Whether the WireGuard driver logs about a tunnel's adapter on Windows, see `WireguardDart.setAdapterLogging`.
+enum AdapterLogMode {
+  /// The driver logs nothing about the adapter.
+  off,
+
+  /// The lines go into the adapter's ring; only warnings and errors also go into the native log, and an error
+  /// writes the ring there with it.
+  on,
+
+  /// The lines go into the adapter's ring and every one of them into the native log, after the tunnel's name.
+  onWithPrefix;
+}
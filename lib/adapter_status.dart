@@ -1,18 +1,117 @@
 import 'package:wireguard_dart/connection_status.dart';
 
+/// A change of an adapter's addresses or routes, sent on the status stream by Windows.
+enum AdapterNetworkChange {
+  /// An address finished duplicate address detection and is usable.
+  addressReady,
+
+  /// An address that was ready was removed.
+  addressRemoved,
+  routeAdded,
+  routeRemoved;
+
+  static AdapterNetworkChange? fromString(String? value) {
+    for (final change in values) {
+      if (change.name == value) return change;
+    }
+    return null;
+  }
+}
+
 class AdapterStatus {
   final int luid;
   final ConnectionStatus status;
 
-  const AdapterStatus(this.luid, this.status);
+  /// Set on the event sent once the adapter is up and all of its addresses are usable, to when that happened.
+  /// Traffic sent from then on does not race the interface coming up.
+  final DateTime? readyAt;
+
+  /// Set on the events sent when a peer went without a handshake for longer than the threshold given to
+  /// `nativeInit`, with [peerStale] true, and when it completed one again, to the peer's base64 public key.
+  final String? peerPublicKey;
+  final bool peerStale;
+
+  /// Set on the events sent when an address or route of the adapter changed, with [networkPrefix] the address
+  /// with its on-link prefix length or the route's destination, such as `10.0.0.2/24`.
+  final AdapterNetworkChange? networkChange;
+  final String? networkPrefix;
+
+  /// Set on the events sent when the peer with [peerPublicKey] roamed, when WireGuard moved it to the [endpoint]
+  /// it now hears from, from [previousEndpoint]. Both are `address:port`, with IPv6 addresses in brackets.
+  final String? previousEndpoint;
+  final String? endpoint;
+
+  /// Set on the events sent while a tunnel connected with a `PeerActivation` comes up, to how many of its
+  /// [totalPeers] were added so far. The last event of a connect has both the same.
+  final int? activatedPeers;
+  final int? totalPeers;
+
+  /// On Windows, when the event was sent, in microseconds on the clock of `Timeline.now` from `dart:developer`,
+  /// so that `monotonicUs - Timeline.now` taken before a call is how long after it the event came. With the
+  /// [correlationId] given to the latest `setupTunnel`, `setupAndConnect`, `connect` or `disconnect` of the
+  /// adapter's tunnel that had one. Neither takes part in equality.
+  final int? monotonicUs;
+  final String? correlationId;
+
+  const AdapterStatus(this.luid, this.status,
+      {this.readyAt,
+      this.peerPublicKey,
+      this.peerStale = false,
+      this.networkChange,
+      this.networkPrefix,
+      this.previousEndpoint,
+      this.endpoint,
+      this.activatedPeers,
+      this.totalPeers,
+      this.monotonicUs,
+      this.correlationId});
+
+  bool get isReady => readyAt != null;
+
+  bool get isPeerLiveness => peerPublicKey != null && endpoint == null;
+
+  bool get isNetworkChange => networkChange != null;
+
+  bool get isEndpointRoam => endpoint != null;
+
+  bool get isActivation => activatedPeers != null;
 
   @override
-  String toString() => 'AdapterStatus(luid: $luid, status: $status)';
+  String toString() => 'AdapterStatus(luid: $luid, status: $status${readyAt != null ? ', readyAt: $readyAt' : ''}'
+      '${peerPublicKey != null ? ', peerPublicKey: $peerPublicKey, peerStale: $peerStale' : ''}'
+      '${networkChange != null ? ', networkChange: ${networkChange!.name}, networkPrefix: $networkPrefix' : ''}'
+      '${endpoint != null ? ', previousEndpoint: $previousEndpoint, endpoint: $endpoint' : ''}'
+      '${activatedPeers != null ? ', activatedPeers: $activatedPeers, totalPeers: $totalPeers' : ''}'
+      '${correlationId != null ? ', correlationId: $correlationId' : ''})';
 
   @override
   bool operator ==(Object other) =>
-      identical(this, other) || other is AdapterStatus && runtimeType == other.runtimeType && luid == other.luid && status == other.status;
+      identical(this, other) ||
+      other is AdapterStatus &&
+          runtimeType == other.runtimeType &&
+          luid == other.luid &&
+          status == other.status &&
+          readyAt == other.readyAt &&
+          peerPublicKey == other.peerPublicKey &&
+          peerStale == other.peerStale &&
+          networkChange == other.networkChange &&
+          networkPrefix == other.networkPrefix &&
+          previousEndpoint == other.previousEndpoint &&
+          endpoint == other.endpoint &&
+          activatedPeers == other.activatedPeers &&
+          totalPeers == other.totalPeers;
 
   @override
-  int get hashCode => luid.hashCode ^ status.hashCode;
+  int get hashCode =>
+      luid.hashCode ^
+      status.hashCode ^
+      readyAt.hashCode ^
+      peerPublicKey.hashCode ^
+      peerStale.hashCode ^
+      networkChange.hashCode ^
+      networkPrefix.hashCode ^
+      previousEndpoint.hashCode ^
+      endpoint.hashCode ^
+      activatedPeers.hashCode ^
+      totalPeers.hashCode;
 }
@@ -0,0 +1,45 @@
+class ConfigValidation {
+  final bool valid;
+  final int? errorLine;
+  final int? errorColumn;
+  final int? configurationSize;
+  final int? peerCount;
+  final int? routeCount;
+  final int elapsedUs;
+
+  /// What [WireguardDart.validateConfig] found. A [valid] configuration has the [configurationSize] in bytes it
+  /// takes in the driver, its [peerCount] and the [routeCount] of the tunnel once overlapping and adjacent
+  /// allowed IPs are merged. An invalid one has the 1-based [errorLine] and [errorColumn] of the value that was
+  /// rejected; both are 0 when the configuration is invalid as a whole, such as without a private key.
+  /// [elapsedUs] is how long validating took.
+  const ConfigValidation({
+    required this.valid,
+    this.errorLine,
+    this.errorColumn,
+    this.configurationSize,
+    this.peerCount,
+    this.routeCount,
+    required this.elapsedUs,
+  });
+
+  /// Factory constructor that creates a [ConfigValidation] object from a JSON map.
+  factory ConfigValidation.fromJson(Map<String, dynamic> json) => ConfigValidation(
+      valid: json['valid'] as bool,
+      errorLine: json['errorLine'] as int?,
+      errorColumn: json['errorColumn'] as int?,
+      configurationSize: json['configurationSize'] as int?,
+      peerCount: json['peerCount'] as int?,
+      routeCount: json['routeCount'] as int?,
+      elapsedUs: json['elapsedUs'] as int);
+
+  /// Converts the [ConfigValidation] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'valid': valid,
+        if (errorLine != null) 'errorLine': errorLine,
+        if (errorColumn != null) 'errorColumn': errorColumn,
+        if (configurationSize != null) 'configurationSize': configurationSize,
+        if (peerCount != null) 'peerCount': peerCount,
+        if (routeCount != null) 'routeCount': routeCount,
+        'elapsedUs': elapsedUs,
+      };
+}
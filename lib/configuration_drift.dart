@@ -0,0 +1,45 @@
+class ConfigurationDrift {
+  final bool inSync;
+  final int hash;
+  final int expectedHash;
+  final bool interfaceChanged;
+  final List<String> missingPeers;
+  final List<String> unexpectedPeers;
+  final List<String> changedPeers;
+
+  /// How the configuration the driver runs differs from the one applied to the tunnel. [hash] and [expectedHash]
+  /// are over a canonical form of each, which are equal when [inSync]. Peers are given by their base64 public key:
+  /// [missingPeers] were applied but are not in the driver, [unexpectedPeers] are only in the driver, and
+  /// [changedPeers] differ in their keys, keepalive or allowed IPs. [interfaceChanged] is a different
+  /// private key, or listen port where one was configured.
+  const ConfigurationDrift({
+    required this.inSync,
+    required this.hash,
+    required this.expectedHash,
+    required this.interfaceChanged,
+    required this.missingPeers,
+    required this.unexpectedPeers,
+    required this.changedPeers,
+  });
+
+  /// Factory constructor that creates a [ConfigurationDrift] object from a JSON map.
+  factory ConfigurationDrift.fromJson(Map<String, dynamic> json) => ConfigurationDrift(
+      inSync: json['inSync'] as bool,
+      hash: json['hash'] as int,
+      expectedHash: json['expectedHash'] as int,
+      interfaceChanged: json['interfaceChanged'] as bool,
+      missingPeers: (json['missingPeers'] as List).cast<String>(),
+      unexpectedPeers: (json['unexpectedPeers'] as List).cast<String>(),
+      changedPeers: (json['changedPeers'] as List).cast<String>());
+
+  /// Converts the [ConfigurationDrift] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'inSync': inSync,
+        'hash': hash,
+        'expectedHash': expectedHash,
+        'interfaceChanged': interfaceChanged,
+        'missingPeers': missingPeers,
+        'unexpectedPeers': unexpectedPeers,
+        'changedPeers': changedPeers,
+      };
+}
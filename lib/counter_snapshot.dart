@@ -0,0 +1,76 @@
+import 'package:wireguard_dart/peer_statistics.dart';
+
+class InterfaceCounters {
+  final int inOctets;
+  final int outOctets;
+  final int inPackets;
+  final int outPackets;
+  final int inDiscards;
+  final int outDiscards;
+  final int inErrors;
+  final int outErrors;
+
+  /// Counters of the tunnel's network interface, which also count the packets the system dropped or failed
+  /// before they reached a peer.
+  const InterfaceCounters({
+    required this.inOctets,
+    required this.outOctets,
+    required this.inPackets,
+    required this.outPackets,
+    required this.inDiscards,
+    required this.outDiscards,
+    required this.inErrors,
+    required this.outErrors,
+  });
+
+  /// Factory constructor that creates an [InterfaceCounters] object from a JSON map.
+  factory InterfaceCounters.fromJson(Map<String, dynamic> json) => InterfaceCounters(
+      inOctets: json['inOctets'] as int,
+      outOctets: json['outOctets'] as int,
+      inPackets: json['inPackets'] as int,
+      outPackets: json['outPackets'] as int,
+      inDiscards: json['inDiscards'] as int,
+      outDiscards: json['outDiscards'] as int,
+      inErrors: json['inErrors'] as int,
+      outErrors: json['outErrors'] as int);
+
+  /// Converts the [InterfaceCounters] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'inOctets': inOctets,
+        'outOctets': outOctets,
+        'inPackets': inPackets,
+        'outPackets': outPackets,
+        'inDiscards': inDiscards,
+        'outDiscards': outDiscards,
+        'inErrors': inErrors,
+        'outErrors': outErrors,
+      };
+}
+
+class CounterSnapshot {
+  final int timestamp;
+  final InterfaceCounters interfaceCounters;
+  final Map<String, PeerStatistics> peers;
+
+  /// The peers of a tunnel, by base64 public key, and its interface counters, read back to back at
+  /// [timestamp] in milliseconds since the epoch. Rates and drop ratios between two snapshots line up.
+  const CounterSnapshot({
+    required this.timestamp,
+    required this.interfaceCounters,
+    required this.peers,
+  });
+
+  /// Factory constructor that creates a [CounterSnapshot] object from a JSON map.
+  factory CounterSnapshot.fromJson(Map<String, dynamic> json) => CounterSnapshot(
+      timestamp: json['timestamp'] as int,
+      interfaceCounters: InterfaceCounters.fromJson(Map<String, dynamic>.from(json['interface'] as Map)),
+      peers: (json['peers'] as Map).map((key, value) =>
+          MapEntry(key as String, PeerStatistics.fromJson(Map<String, dynamic>.from(value as Map)))));
+
+  /// Converts the [CounterSnapshot] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'timestamp': timestamp,
+        'interface': interfaceCounters.toJson(),
+        'peers': peers.map((key, value) => MapEntry(key, value.toJson())),
+      };
+}
@@ -0,0 +1,52 @@
+class CumulativeCounts {
+  final int rxBytes;
+  final int txBytes;
+  final int sinceMs;
+  final int updatedMs;
+
+  /// The bytes a tunnel or a peer received and sent since [sinceMs], when counting began or was last reset, up to
+  /// [updatedMs], when they last grew, both in milliseconds since the epoch; [updatedMs] is 0 before any traffic.
+  const CumulativeCounts({
+    required this.rxBytes,
+    required this.txBytes,
+    required this.sinceMs,
+    required this.updatedMs,
+  });
+
+  /// Factory constructor that creates a [CumulativeCounts] object from a JSON map.
+  factory CumulativeCounts.fromJson(Map<String, dynamic> json) => CumulativeCounts(
+      rxBytes: json['rxBytes'] as int,
+      txBytes: json['txBytes'] as int,
+      sinceMs: json['sinceMs'] as int,
+      updatedMs: json['updatedMs'] as int);
+
+  /// Converts the [CumulativeCounts] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'rxBytes': rxBytes,
+        'txBytes': txBytes,
+        'sinceMs': sinceMs,
+        'updatedMs': updatedMs,
+      };
+}
+
+class CumulativeStatistics {
+  final CumulativeCounts totals;
+  final Map<String, CumulativeCounts> peers;
+
+  /// The running totals of a tunnel, kept across restarts of the app and recreations of its adapter, and of each
+  /// of its [peers] by base64 public key. The [totals] are what the peers added up to, so a peer removed from the
+  /// tunnel takes nothing away from them.
+  const CumulativeStatistics({required this.totals, required this.peers});
+
+  /// Factory constructor that creates a [CumulativeStatistics] object from a JSON map.
+  factory CumulativeStatistics.fromJson(Map<String, dynamic> json) => CumulativeStatistics(
+      totals: CumulativeCounts.fromJson(json),
+      peers: (json['peers'] as Map? ?? const {}).map((key, value) =>
+          MapEntry(key as String, CumulativeCounts.fromJson(Map<String, dynamic>.from(value as Map)))));
+
+  /// Converts the [CumulativeStatistics] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        ...totals.toJson(),
+        'peers': peers.map((key, value) => MapEntry(key, value.toJson())),
+      };
+}
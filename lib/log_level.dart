@@ -0,0 +1,9 @@
+/// Severity of a line of the native log, lowest first
+enum LogLevel {
+  trace,
+  debug,
+  info,
+  warn,
+  error,
+  critical;
+}
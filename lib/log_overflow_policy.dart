@@ -0,0 +1,11 @@
+/// What the Windows plugin does with a log line when its log queue is full.
+enum LogOverflowPolicy {
+  /// Drop the oldest queued line to make room. Logging never waits.
+  overrunOldest,
+
+  /// Drop the new line. Logging never waits.
+  discardNew,
+
+  /// Wait until the log thread made room. Nothing is lost, but a burst of logging can hold up the caller.
+  block;
+}
@@ -0,0 +1,37 @@
+import 'package:wireguard_dart/log_level.dart';
+
+class LogRecord {
+  final LogLevel level;
+  final DateTime timestamp;
+  final String source;
+  final String message;
+  final int? monotonicUs;
+
+  /// One line of the native log as [WireguardDart.logStream] sends it. [source] is `plugin` for the plugin's own
+  /// lines and `wireguard.dll` for those of the WireGuard driver. On Windows [monotonicUs] is when it was logged,
+  /// on the clock of `AdapterStatus.monotonicUs`.
+  const LogRecord({
+    required this.level,
+    required this.timestamp,
+    required this.source,
+    required this.message,
+    this.monotonicUs,
+  });
+
+  /// Factory constructor that creates a [LogRecord] object from a JSON map.
+  factory LogRecord.fromJson(Map<String, dynamic> json) => LogRecord(
+      level: LogLevel.values.asNameMap()[json['level']] ?? LogLevel.info,
+      timestamp: DateTime.fromMillisecondsSinceEpoch(json['timestamp'] as int),
+      source: json['source'] as String,
+      message: json['message'] as String,
+      monotonicUs: json['monotonicUs'] as int?);
+
+  /// Converts the [LogRecord] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'level': level.name,
+        'timestamp': timestamp.millisecondsSinceEpoch,
+        'source': source,
+        'message': message,
+        if (monotonicUs != null) 'monotonicUs': monotonicUs,
+      };
+}
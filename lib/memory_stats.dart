@@ -0,0 +1,112 @@
+class MemoryStats {
+  final bool lowMemory;
+  final int parsedConfigBytes;
+  final int wireBufferBytes;
+  final int statisticsBytes;
+  final int logBytes;
+  final int cacheBytes;
+  final int totalBytes;
+  final int workingSetBytes;
+  final Map<String, TunnelMemoryStats> tunnels;
+  final Map<String, WorkingSetDelta> phases;
+
+  /// What the plugin holds on the heap, in bytes. [parsedConfigBytes] are the configurations applied to tunnels,
+  /// those streamed in but not set up yet, those compiled and not released and the last one validated,
+  /// [wireBufferBytes] the buffers configurations are read back from the driver into, [statisticsBytes] the
+  /// statistics history and recording, [logBytes] the recent log lines and [cacheBytes] resolved endpoint
+  /// hostnames, the key pool and the allowed IPs indexed for resolvePeerForAddresses.
+  /// [totalBytes] is their sum and [workingSetBytes] the working set of the whole process. [tunnels] has the share
+  /// of each tunnel, [phases] how the working set changed over each setup phase, by the phase names of
+  /// getPerfStats.
+  const MemoryStats({
+    required this.lowMemory,
+    required this.parsedConfigBytes,
+    required this.wireBufferBytes,
+    required this.statisticsBytes,
+    required this.logBytes,
+    required this.cacheBytes,
+    required this.totalBytes,
+    required this.workingSetBytes,
+    required this.tunnels,
+    required this.phases,
+  });
+
+  /// Factory constructor that creates a [MemoryStats] object from a JSON map.
+  factory MemoryStats.fromJson(Map<String, dynamic> json) => MemoryStats(
+      lowMemory: json['lowMemory'] as bool,
+      parsedConfigBytes: json['parsedConfigBytes'] as int,
+      wireBufferBytes: json['wireBufferBytes'] as int,
+      statisticsBytes: json['statisticsBytes'] as int,
+      logBytes: json['logBytes'] as int,
+      cacheBytes: json['cacheBytes'] as int,
+      totalBytes: json['totalBytes'] as int,
+      workingSetBytes: json['workingSetBytes'] as int,
+      tunnels: (json['tunnels'] as Map? ?? const {}).map((name, value) =>
+          MapEntry(name as String, TunnelMemoryStats.fromJson(Map<String, dynamic>.from(value as Map)))),
+      phases: (json['phases'] as Map? ?? const {}).map((name, value) =>
+          MapEntry(name as String, WorkingSetDelta.fromJson(Map<String, dynamic>.from(value as Map)))));
+
+  /// Converts the [MemoryStats] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'lowMemory': lowMemory,
+        'parsedConfigBytes': parsedConfigBytes,
+        'wireBufferBytes': wireBufferBytes,
+        'statisticsBytes': statisticsBytes,
+        'logBytes': logBytes,
+        'cacheBytes': cacheBytes,
+        'totalBytes': totalBytes,
+        'workingSetBytes': workingSetBytes,
+        'tunnels': tunnels.map((name, value) => MapEntry(name, value.toJson())),
+        'phases': phases.map((name, value) => MapEntry(name, value.toJson())),
+      };
+}
+
+class TunnelMemoryStats {
+  final int parsedConfigBytes;
+  final int wireBufferBytes;
+  final int cacheBytes;
+
+  /// The bytes one tunnel holds, see [MemoryStats]. [parsedConfigBytes] is 0 once low-memory mode released its
+  /// configuration.
+  const TunnelMemoryStats({
+    required this.parsedConfigBytes,
+    required this.wireBufferBytes,
+    required this.cacheBytes,
+  });
+
+  /// Factory constructor that creates a [TunnelMemoryStats] object from a JSON map.
+  factory TunnelMemoryStats.fromJson(Map<String, dynamic> json) => TunnelMemoryStats(
+      parsedConfigBytes: json['parsedConfigBytes'] as int,
+      wireBufferBytes: json['wireBufferBytes'] as int,
+      cacheBytes: json['cacheBytes'] as int);
+
+  /// Converts the [TunnelMemoryStats] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'parsedConfigBytes': parsedConfigBytes,
+        'wireBufferBytes': wireBufferBytes,
+        'cacheBytes': cacheBytes,
+      };
+}
+
+class WorkingSetDelta {
+  final int lastWorkingSetDelta;
+  final int maxWorkingSetDelta;
+
+  /// How many bytes the process working set grew over a phase, negative if it shrank: the last time it ran, and
+  /// the most of all the times it ran.
+  const WorkingSetDelta({
+    required this.lastWorkingSetDelta,
+    required this.maxWorkingSetDelta,
+  });
+
+  /// Factory constructor that creates a [WorkingSetDelta] object from a JSON map.
+  factory WorkingSetDelta.fromJson(Map<String, dynamic> json) => WorkingSetDelta(
+      lastWorkingSetDelta: json['lastWorkingSetDelta'] as int,
+      maxWorkingSetDelta: json['maxWorkingSetDelta'] as int);
+
+  /// Converts the [WorkingSetDelta] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'lastWorkingSetDelta': lastWorkingSetDelta,
+        'maxWorkingSetDelta': maxWorkingSetDelta,
+      };
+}
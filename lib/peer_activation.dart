@@ -0,0 +1,21 @@
+import 'dart:typed_data';
+
+/// How `WireguardDart.connect` brings up a tunnel with many peers on Windows: [batchSize] peers at a time, one
+/// batch every [interval], so that their first handshakes do not all go out in the same moment. The interval is
+/// from 10 ms to a minute.
+class PeerActivation {
+  final int batchSize;
+  final Duration interval;
+
+  /// Public keys, 32 bytes each, of the peers to add first, in this order. The others follow, those with the
+  /// most recent handshake first.
+  final List<Uint8List> priority;
+
+  const PeerActivation({required this.batchSize, required this.interval, this.priority = const []});
+
+  Map<String, dynamic> toJson() => {
+        'batchSize': batchSize,
+        'intervalMs': interval.inMilliseconds,
+        if (priority.isNotEmpty) 'priority': priority,
+      };
+}
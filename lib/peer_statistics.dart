@@ -0,0 +1,82 @@
+class PeerStatistics {
+  final int rxBytes;
+  final int txBytes;
+  final int latestHandshake;
+  final int? handshakeAgeMs;
+  final double rxRate;
+  final double txRate;
+  final double rxRateEwma;
+  final double txRateEwma;
+  final int? persistentKeepalive;
+  final int? probes;
+  final double? lossPercent;
+  final int? rttMinMs;
+  final int? rttP50Ms;
+  final int? rttP90Ms;
+  final int? rttMaxMs;
+
+  /// Counters of one peer of a tunnel. [latestHandshake] is in milliseconds since the epoch, 0 if there was
+  /// none, and [handshakeAgeMs] is null then. The rates are in bytes per second: [rxRate] and [txRate] since
+  /// the previous reading, [rxRateEwma] and [txRateEwma] smoothed over a few seconds. [persistentKeepalive] is
+  /// the keepalive in seconds the peer has on Windows, the one chosen so far for a peer with an automatic
+  /// keepalive, 0 for none.
+  ///
+  /// For a peer with a ProbeAddress on Windows, [probes] is how many of its latest in-tunnel pings the link
+  /// quality is taken over and [lossPercent] how many of them went unanswered. The round trip times of the
+  /// answered ones, in milliseconds, are [rttMinMs], the median [rttP50Ms], the 90th percentile [rttP90Ms] and
+  /// [rttMaxMs]. All are null for a peer that is not probed, the round trip times also while none was answered.
+  const PeerStatistics({
+    required this.rxBytes,
+    required this.txBytes,
+    required this.latestHandshake,
+    this.handshakeAgeMs,
+    required this.rxRate,
+    required this.txRate,
+    required this.rxRateEwma,
+    required this.txRateEwma,
+    this.persistentKeepalive,
+    this.probes,
+    this.lossPercent,
+    this.rttMinMs,
+    this.rttP50Ms,
+    this.rttP90Ms,
+    this.rttMaxMs,
+  });
+
+  /// Factory constructor that creates a [PeerStatistics] object from a JSON map.
+  factory PeerStatistics.fromJson(Map<String, dynamic> json) => PeerStatistics(
+      rxBytes: json['rxBytes'] as int,
+      txBytes: json['txBytes'] as int,
+      latestHandshake: json['latestHandshake'] as int,
+      handshakeAgeMs: json['handshakeAgeMs'] as int?,
+      rxRate: (json['rxRate'] as num).toDouble(),
+      txRate: (json['txRate'] as num).toDouble(),
+      rxRateEwma: (json['rxRateEwma'] as num).toDouble(),
+      txRateEwma: (json['txRateEwma'] as num).toDouble(),
+      persistentKeepalive: json['persistentKeepalive'] as int?,
+      probes: json['probes'] as int?,
+      lossPercent: (json['lossPercent'] as num?)?.toDouble(),
+      rttMinMs: json['rttMinMs'] as int?,
+      rttP50Ms: json['rttP50Ms'] as int?,
+      rttP90Ms: json['rttP90Ms'] as int?,
+      rttMaxMs: json['rttMaxMs'] as int?);
+
+  /// Converts the [PeerStatistics] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'rxBytes': rxBytes,
+        'txBytes': txBytes,
+        'latestHandshake': latestHandshake,
+        'handshakeAgeMs': handshakeAgeMs,
+        'rxRate': rxRate,
+        'txRate': txRate,
+        'rxRateEwma': rxRateEwma,
+        'txRateEwma': txRateEwma,
+        'persistentKeepalive': persistentKeepalive,
+        if (probes != null) 'probes': probes,
+        if (lossPercent != null) 'lossPercent': lossPercent,
+        if (rttMinMs != null) 'rttMinMs': rttMinMs,
+        if (rttP50Ms != null) 'rttP50Ms': rttP50Ms,
+        if (rttP90Ms != null) 'rttP90Ms': rttP90Ms,
+        if (rttMaxMs != null) 'rttMaxMs': rttMaxMs,
+      };
+}
@@ -0,0 +1,62 @@
+import 'dart:convert';
+import 'dart:typed_data';
+
+/// The peers of a tunnel as the native side encodes them for `peerStatisticsBinary`, read in place from the
+/// buffer instead of being decoded into maps. The layout is a 16 byte header, then one fixed-size record per
+/// peer with its public key, byte counters, latest handshake and smoothed rates; all little-endian.
+class PeerStatisticsView {
+  static const supportedVersion = 1;
+  static const _headerSize = 16;
+  static const _keyLength = 32;
+
+  final ByteData _data;
+  final int _recordSize;
+
+  /// The number of peers
+  final int length;
+
+  /// When the counters were read, in milliseconds since the epoch
+  final int timestamp;
+
+  PeerStatisticsView._(this._data, this._recordSize, this.length, this.timestamp);
+
+  /// Wraps the buffer without copying it. Throws a [FormatException] if it is not in a supported layout.
+  factory PeerStatisticsView(Uint8List bytes) {
+    final data = ByteData.sublistView(bytes);
+    if (data.lengthInBytes < _headerSize) {
+      throw const FormatException('Peer statistics buffer too short');
+    }
+    final version = data.getUint16(0, Endian.little);
+    final recordSize = data.getUint16(2, Endian.little);
+    final length = data.getUint32(4, Endian.little);
+    if (version != supportedVersion || recordSize < _keyLength + 40) {
+      throw FormatException('Unsupported peer statistics layout $version');
+    }
+    if (data.lengthInBytes < _headerSize + length * recordSize) {
+      throw const FormatException('Peer statistics buffer truncated');
+    }
+    return PeerStatisticsView._(data, recordSize, length, data.getUint64(8, Endian.little));
+  }
+
+  int _offset(int index) {
+    RangeError.checkValidIndex(index, this, 'index', length);
+    return _headerSize + index * _recordSize;
+  }
+
+  /// The raw public key of the peer, a view into the buffer
+  Uint8List publicKeyBytes(int index) =>
+      Uint8List.sublistView(_data, _offset(index), _offset(index) + _keyLength);
+
+  /// The public key of the peer in base64, as configurations write it
+  String publicKey(int index) => base64Encode(publicKeyBytes(index));
+
+  int rxBytes(int index) => _data.getUint64(_offset(index) + _keyLength, Endian.little);
+  int txBytes(int index) => _data.getUint64(_offset(index) + _keyLength + 8, Endian.little);
+
+  /// In milliseconds since the epoch, 0 if the peer never completed a handshake
+  int latestHandshake(int index) => _data.getUint64(_offset(index) + _keyLength + 16, Endian.little);
+
+  /// Smoothed bytes per second
+  double rxRateEwma(int index) => _data.getFloat64(_offset(index) + _keyLength + 24, Endian.little);
+  double txRateEwma(int index) => _data.getFloat64(_offset(index) + _keyLength + 32, Endian.little);
+}
@@ -0,0 +1,46 @@
+class PhaseStats {
+  final int count;
+  final int lastUs;
+  final int minUs;
+  final int maxUs;
+  final int meanUs;
+  final int p50Us;
+  final int p90Us;
+  final int p99Us;
+
+  /// Durations of one setup or connect phase, in microseconds. [count] is every time the phase ran; the
+  /// other values are over its most recent runs.
+  const PhaseStats({
+    required this.count,
+    required this.lastUs,
+    required this.minUs,
+    required this.maxUs,
+    required this.meanUs,
+    required this.p50Us,
+    required this.p90Us,
+    required this.p99Us,
+  });
+
+  /// Factory constructor that creates a [PhaseStats] object from a JSON map.
+  factory PhaseStats.fromJson(Map<String, dynamic> json) => PhaseStats(
+      count: json['count'] as int,
+      lastUs: json['lastUs'] as int,
+      minUs: json['minUs'] as int,
+      maxUs: json['maxUs'] as int,
+      meanUs: json['meanUs'] as int,
+      p50Us: json['p50Us'] as int,
+      p90Us: json['p90Us'] as int,
+      p99Us: json['p99Us'] as int);
+
+  /// Converts the [PhaseStats] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'count': count,
+        'lastUs': lastUs,
+        'minUs': minUs,
+        'maxUs': maxUs,
+        'meanUs': meanUs,
+        'p50Us': p50Us,
+        'p90Us': p90Us,
+        'p99Us': p99Us,
+      };
+}
@@ -0,0 +1,60 @@
+class ProcessTraffic {
+  final int pid;
+
+  /// The file name of the process's executable, empty when the plugin could not open the process
+  final String image;
+
+  /// Received and sent over TCP connections on the tunnel's addresses since the process was first seen there
+  final int rxBytes;
+  final int txBytes;
+
+  /// Over the time since the event before
+  final int rxBytesPerSecond;
+  final int txBytesPerSecond;
+
+  /// Sockets of the process on the tunnel's addresses. UDP sockets are counted but their bytes are not, and
+  /// sockets bound to every address cannot be told to be on the tunnel.
+  final int tcpConnections;
+  final int udpSockets;
+
+  /// The process has no socket on the tunnel any more; it is not sent again until it has one
+  final bool ended;
+
+  /// What one process sent and received over a tunnel, as the statistics stream reports it on Windows
+  const ProcessTraffic({
+    required this.pid,
+    required this.image,
+    required this.rxBytes,
+    required this.txBytes,
+    required this.rxBytesPerSecond,
+    required this.txBytesPerSecond,
+    required this.tcpConnections,
+    required this.udpSockets,
+    this.ended = false,
+  });
+
+  /// Factory constructor that creates a [ProcessTraffic] object from a JSON map.
+  factory ProcessTraffic.fromJson(Map<String, dynamic> json) => ProcessTraffic(
+      pid: json['pid'] as int,
+      image: json['image'] as String? ?? '',
+      rxBytes: json['rxBytes'] as int,
+      txBytes: json['txBytes'] as int,
+      rxBytesPerSecond: json['rxBytesPerSecond'] as int,
+      txBytesPerSecond: json['txBytesPerSecond'] as int,
+      tcpConnections: json['tcpConnections'] as int,
+      udpSockets: json['udpSockets'] as int,
+      ended: json['ended'] as bool? ?? false);
+
+  /// Converts the [ProcessTraffic] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'pid': pid,
+        'image': image,
+        'rxBytes': rxBytes,
+        'txBytes': txBytes,
+        'rxBytesPerSecond': rxBytesPerSecond,
+        'txBytesPerSecond': txBytesPerSecond,
+        'tcpConnections': tcpConnections,
+        'udpSockets': udpSockets,
+        'ended': ended,
+      };
+}
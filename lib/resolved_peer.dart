@@ -0,0 +1,18 @@
+class ResolvedPeer {
+  final String tunnelName;
+  final String publicKey;
+
+  /// The tunnel and the peer, by its base64 public key, that [WireguardDart.resolvePeerForAddresses] found for
+  /// an address.
+  const ResolvedPeer({required this.tunnelName, required this.publicKey});
+
+  /// Factory constructor that creates a [ResolvedPeer] object from a JSON map.
+  factory ResolvedPeer.fromJson(Map<String, dynamic> json) =>
+      ResolvedPeer(tunnelName: json['tunnelName'] as String, publicKey: json['publicKey'] as String);
+
+  /// Converts the [ResolvedPeer] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'tunnelName': tunnelName,
+        'publicKey': publicKey,
+      };
+}
@@ -0,0 +1,11 @@
+/// Which applications may use a tunnel on Windows, see `WireguardDart.setSplitTunnel`.
+enum SplitTunnelMode {
+  /// Every application may use the tunnel, the listed ones are ignored.
+  off,
+
+  /// Only the listed applications may use the tunnel.
+  include,
+
+  /// The listed applications may not use the tunnel.
+  exclude;
+}
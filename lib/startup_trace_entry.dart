@@ -0,0 +1,23 @@
+class StartupTraceEntry {
+  final String subsystem;
+  final int atUs;
+  final int tookUs;
+
+  /// One native subsystem that started: [atUs] microseconds after the plugin was registered, taking [tookUs].
+  const StartupTraceEntry({
+    required this.subsystem,
+    required this.atUs,
+    required this.tookUs,
+  });
+
+  /// Factory constructor that creates a [StartupTraceEntry] object from a JSON map.
+  factory StartupTraceEntry.fromJson(Map<String, dynamic> json) => StartupTraceEntry(
+      subsystem: json['subsystem'] as String, atUs: json['atUs'] as int, tookUs: json['tookUs'] as int);
+
+  /// Converts the [StartupTraceEntry] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'subsystem': subsystem,
+        'atUs': atUs,
+        'tookUs': tookUs,
+      };
+}
@@ -0,0 +1,50 @@
+import 'dart:typed_data';
+
+/// The recorded counters of a tunnel or peer over a window, as `getStatisticsHistory` returns them, read in
+/// place from the buffer. The layout is a 16 byte header, then one 24 byte record per point with its time and
+/// the rx and tx byte totals; all little-endian. The counters are totals, so the throughput between two points
+/// is their difference over the time between them.
+class StatisticsHistoryView {
+  static const supportedVersion = 1;
+  static const _headerSize = 16;
+
+  final ByteData _data;
+  final int _recordSize;
+
+  /// The number of points, oldest first
+  final int length;
+
+  /// The time between points, from the tier the window was read from
+  final Duration interval;
+
+  StatisticsHistoryView._(this._data, this._recordSize, this.length, this.interval);
+
+  /// Wraps the buffer without copying it. Throws a [FormatException] if it is not in a supported layout.
+  factory StatisticsHistoryView(Uint8List bytes) {
+    final data = ByteData.sublistView(bytes);
+    if (data.lengthInBytes < _headerSize) {
+      throw const FormatException('Statistics history buffer too short');
+    }
+    final version = data.getUint16(0, Endian.little);
+    final recordSize = data.getUint16(2, Endian.little);
+    final length = data.getUint32(4, Endian.little);
+    if (version != supportedVersion || recordSize < 24) {
+      throw FormatException('Unsupported statistics history layout $version');
+    }
+    if (data.lengthInBytes < _headerSize + length * recordSize) {
+      throw const FormatException('Statistics history buffer truncated');
+    }
+    return StatisticsHistoryView._(
+        data, recordSize, length, Duration(milliseconds: data.getUint32(8, Endian.little)));
+  }
+
+  int _offset(int index) {
+    RangeError.checkValidIndex(index, this, 'index', length);
+    return _headerSize + index * _recordSize;
+  }
+
+  /// In milliseconds since the epoch
+  int timestamp(int index) => _data.getUint64(_offset(index), Endian.little);
+  int rxBytes(int index) => _data.getUint64(_offset(index) + 8, Endian.little);
+  int txBytes(int index) => _data.getUint64(_offset(index) + 16, Endian.little);
+}
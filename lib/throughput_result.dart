@@ -0,0 +1,116 @@
+/// What `WireguardDart.runThroughputTest` sends through the tunnel.
+enum ThroughputProtocol {
+  /// Parallel TCP streams, whose retransmissions tell how the link copes.
+  tcp,
+
+  /// UDP datagrams as fast as they go out; only the endpoint can tell how many arrived.
+  udp;
+}
+
+class ThroughputResult {
+  final int streams;
+  final int elapsedMs;
+  final int bytesSent;
+  final int bytesDelivered;
+  final int goodputBps;
+  final int sendErrors;
+  final int? bytesRetransmitted;
+  final int? fastRetransmits;
+  final int? timeoutEpisodes;
+  final int? rttUs;
+  final int? mss;
+  final String? errorMessage;
+  final List<ThroughputSample> samples;
+
+  /// The outcome of a throughput test: how many [streams] reached the endpoint and what they sent over
+  /// [elapsedMs]. [bytesDelivered] are the [bytesSent] less those TCP still had unacknowledged at the end, and
+  /// [goodputBps] is that in bits per second; for UDP it is the rate sent. [sendErrors] are UDP sends that failed,
+  /// as they do while nothing listens at the endpoint.
+  ///
+  /// The TCP hints, summed over the streams, are null where Windows does not report them: [bytesRetransmitted],
+  /// [fastRetransmits], [timeoutEpisodes], the largest smoothed round trip time [rttUs] and the smallest segment
+  /// size [mss], which is low when the tunnel MTU is. [errorMessage] tells why a stream stopped early, and
+  /// [samples] what happened each second.
+  const ThroughputResult({
+    required this.streams,
+    required this.elapsedMs,
+    required this.bytesSent,
+    required this.bytesDelivered,
+    required this.goodputBps,
+    required this.sendErrors,
+    this.bytesRetransmitted,
+    this.fastRetransmits,
+    this.timeoutEpisodes,
+    this.rttUs,
+    this.mss,
+    this.errorMessage,
+    this.samples = const [],
+  });
+
+  /// Factory constructor that creates a [ThroughputResult] object from a JSON map.
+  factory ThroughputResult.fromJson(Map<String, dynamic> json) => ThroughputResult(
+      streams: json['streams'] as int,
+      elapsedMs: json['elapsedMs'] as int,
+      bytesSent: json['bytesSent'] as int,
+      bytesDelivered: json['bytesDelivered'] as int,
+      goodputBps: json['goodputBps'] as int,
+      sendErrors: json['sendErrors'] as int,
+      bytesRetransmitted: json['bytesRetransmitted'] as int?,
+      fastRetransmits: json['fastRetransmits'] as int?,
+      timeoutEpisodes: json['timeoutEpisodes'] as int?,
+      rttUs: json['rttUs'] as int?,
+      mss: json['mss'] as int?,
+      errorMessage: json['errorMessage'] as String?,
+      samples: (json['samples'] as List? ?? const [])
+          .map((sample) => ThroughputSample.fromJson(Map<String, dynamic>.from(sample as Map)))
+          .toList());
+
+  /// Converts the [ThroughputResult] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'streams': streams,
+        'elapsedMs': elapsedMs,
+        'bytesSent': bytesSent,
+        'bytesDelivered': bytesDelivered,
+        'goodputBps': goodputBps,
+        'sendErrors': sendErrors,
+        if (bytesRetransmitted != null) 'bytesRetransmitted': bytesRetransmitted,
+        if (fastRetransmits != null) 'fastRetransmits': fastRetransmits,
+        if (timeoutEpisodes != null) 'timeoutEpisodes': timeoutEpisodes,
+        if (rttUs != null) 'rttUs': rttUs,
+        if (mss != null) 'mss': mss,
+        if (errorMessage != null) 'errorMessage': errorMessage,
+        'samples': samples.map((sample) => sample.toJson()).toList(),
+      };
+}
+
+class ThroughputSample {
+  final int elapsedMs;
+  final int bytesSent;
+  final int? txBytes;
+  final int? rxBytes;
+
+  /// One second of a throughput test, ending [elapsedMs] after it started: the [bytesSent] by the test, and how
+  /// far the tunnel's counters moved, [txBytes] with the encryption overhead and [rxBytes] with the endpoint's
+  /// acknowledgements. The counters are null when they could not be read.
+  const ThroughputSample({
+    required this.elapsedMs,
+    required this.bytesSent,
+    this.txBytes,
+    this.rxBytes,
+  });
+
+  /// Factory constructor that creates a [ThroughputSample] object from a JSON map.
+  factory ThroughputSample.fromJson(Map<String, dynamic> json) => ThroughputSample(
+      elapsedMs: json['elapsedMs'] as int,
+      bytesSent: json['bytesSent'] as int,
+      txBytes: json['txBytes'] as int?,
+      rxBytes: json['rxBytes'] as int?);
+
+  /// Converts the [ThroughputSample] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'elapsedMs': elapsedMs,
+        'bytesSent': bytesSent,
+        if (txBytes != null) 'txBytes': txBytes,
+        if (rxBytes != null) 'rxBytes': rxBytes,
+      };
+}
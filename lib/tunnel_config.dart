@@ -0,0 +1,202 @@
+import 'dart:typed_data';
+
+/// An IPv4 or IPv6 address, as its 4 or 16 bytes, with a prefix length.
+class IpPrefix {
+  final Uint8List address;
+  final int prefixLength;
+
+  const IpPrefix(this.address, this.prefixLength);
+
+  @override
+  String toString() {
+    return 'IpPrefix{address: $address, prefixLength: $prefixLength}';
+  }
+}
+
+/// A peer of a [TunnelConfig]. Keys are their raw 32 bytes, not base64.
+class TunnelPeerConfig {
+  final Uint8List publicKey;
+  final Uint8List? presharedKey;
+
+  /// The 4 or 16 bytes of the endpoint address. Leave it out and set [endpointHost] instead to have a
+  /// hostname resolved.
+  final Uint8List? endpointAddress;
+  final String? endpointHost;
+  final int? endpointPort;
+  final int? persistentKeepalive;
+
+  /// With [keepaliveAuto] on Windows, the keepalive is tuned to the NAT in front of the tunnel instead of fixed,
+  /// between [keepaliveMin] and [keepaliveMax] seconds, 15 and 120 if left out. [persistentKeepalive] is ignored.
+  final bool keepaliveAuto;
+  final int? keepaliveMin;
+  final int? keepaliveMax;
+  final List<IpPrefix> allowedIps;
+
+  /// The 4 or 16 bytes of an address inside the tunnel that answers pings, such as the peer's own tunnel address.
+  /// Windows then measures the round trip time and loss to it, which the peer statistics report.
+  final Uint8List? probeAddress;
+
+  const TunnelPeerConfig({
+    required this.publicKey,
+    this.presharedKey,
+    this.endpointAddress,
+    this.endpointHost,
+    this.endpointPort,
+    this.persistentKeepalive,
+    this.keepaliveAuto = false,
+    this.keepaliveMin,
+    this.keepaliveMax,
+    this.allowedIps = const [],
+    this.probeAddress,
+  });
+
+  /// A peer as exportTunnelConfiguration answers it, the reverse of [toMap].
+  factory TunnelPeerConfig.fromMap(Map<Object?, Object?> map) {
+    final endpoint = map['endpoint'];
+    return TunnelPeerConfig(
+      publicKey: map['publicKey'] as Uint8List,
+      presharedKey: map['presharedKey'] as Uint8List?,
+      endpointAddress: endpoint is Uint8List ? endpoint : null,
+      endpointHost: endpoint is String ? endpoint : null,
+      endpointPort: map['endpointPort'] as int?,
+      persistentKeepalive: map['persistentKeepalive'] is int ? map['persistentKeepalive'] as int : null,
+      allowedIps: unpackPrefixes(map['allowedIps'] as Uint8List?),
+    );
+  }
+
+  /// The peer as setupTunnelStructured sends it, allowed IPs packed into one byte list.
+  Map<String, Object> toMap() => {
+        'publicKey': publicKey,
+        if (presharedKey != null) 'presharedKey': presharedKey!,
+        if (endpointAddress != null || endpointHost != null) 'endpoint': endpointAddress ?? endpointHost!,
+        if (endpointPort != null) 'endpointPort': endpointPort!,
+        if (keepaliveAuto)
+          'persistentKeepalive': keepaliveMin == null && keepaliveMax == null
+              ? 'auto'
+              : 'auto:${keepaliveMin ?? 15}-${keepaliveMax ?? 120}'
+        else if (persistentKeepalive != null)
+          'persistentKeepalive': persistentKeepalive!,
+        'allowedIps': packPrefixes(allowedIps),
+        if (probeAddress != null) 'probeAddress': probeAddress!,
+      };
+}
+
+/// A WireGuard configuration as values, the same settings as the INI text [setupTunnel] takes. Keys are their
+/// raw 32 bytes, not base64.
+class TunnelConfig {
+  final Uint8List? privateKey;
+  final Uint8List? publicKey;
+  final int? listenPort;
+
+  /// Left out, the MTU is 1420; with [mtuAuto] it is measured on the path to the endpoints.
+  final int? mtu;
+  final bool mtuAuto;
+  final List<IpPrefix> addresses;
+
+  /// The 4 or 16 bytes of each DNS server address.
+  final List<Uint8List> dnsServers;
+  final List<String> dnsSearchDomains;
+
+  /// Only names in these domains, and their subdomains, are resolved by [dnsServers]; everything else stays with
+  /// the system's resolver. On Windows they are installed as NRPT rules.
+  final List<String> splitDnsDomains;
+
+  /// DSCP markings as entries of the QoS key, e.g. `ms-teams.exe:46`, `udp/3478-3481:46` or `tunnel:46`. On
+  /// Windows they are installed as policy-based QoS policies.
+  final List<String> qosRules;
+  final int? metric;
+  final bool? automaticMetric;
+  final bool? routerDiscovery;
+  final int? dadTransmits;
+  final List<TunnelPeerConfig> peers;
+
+  const TunnelConfig({
+    this.privateKey,
+    this.publicKey,
+    this.listenPort,
+    this.mtu,
+    this.mtuAuto = false,
+    this.addresses = const [],
+    this.dnsServers = const [],
+    this.dnsSearchDomains = const [],
+    this.splitDnsDomains = const [],
+    this.qosRules = const [],
+    this.metric,
+    this.automaticMetric,
+    this.routerDiscovery,
+    this.dadTransmits,
+    this.peers = const [],
+  });
+
+  /// A configuration as exportTunnelConfiguration answers it, the reverse of [toMap] for what it sets.
+  factory TunnelConfig.fromMap(Map<Object?, Object?> map) => TunnelConfig(
+        privateKey: map['privateKey'] as Uint8List?,
+        publicKey: map['publicKey'] as Uint8List?,
+        listenPort: map['listenPort'] as int?,
+        addresses: unpackPrefixes(map['addresses'] as Uint8List?),
+        peers: [
+          for (final peer in map['peers'] as List? ?? const []) TunnelPeerConfig.fromMap(peer as Map<Object?, Object?>)
+        ],
+      );
+
+  /// The configuration as setupTunnelStructured sends it, addresses packed into byte lists.
+  Map<String, Object> toMap() => {
+        if (privateKey != null) 'privateKey': privateKey!,
+        if (publicKey != null) 'publicKey': publicKey!,
+        if (listenPort != null) 'listenPort': listenPort!,
+        if (mtuAuto) 'mtu': 'auto' else if (mtu != null) 'mtu': mtu!,
+        'addresses': packPrefixes(addresses),
+        'dnsServers': packAddresses(dnsServers),
+        'dnsSearchDomains': dnsSearchDomains,
+        if (splitDnsDomains.isNotEmpty) 'splitDnsDomains': splitDnsDomains,
+        if (qosRules.isNotEmpty) 'qosRules': qosRules,
+        if (metric != null) 'metric': metric!,
+        if (automaticMetric != null) 'automaticMetric': automaticMetric!,
+        if (routerDiscovery != null) 'routerDiscovery': routerDiscovery!,
+        if (dadTransmits != null) 'dadTransmits': dadTransmits!,
+        'peers': [for (final peer in peers) peer.toMap()],
+      };
+}
+
+int _family(Uint8List address) {
+  if (address.length != 4 && address.length != 16) {
+    throw ArgumentError.value(address, 'address', 'must be 4 or 16 bytes');
+  }
+  return address.length == 4 ? 4 : 6;
+}
+
+/// Each prefix as a family byte (4 or 6), the prefix length and the address bytes, back to back.
+Uint8List packPrefixes(List<IpPrefix> prefixes) {
+  final builder = BytesBuilder(copy: false);
+  for (final prefix in prefixes) {
+    builder.addByte(_family(prefix.address));
+    builder.addByte(prefix.prefixLength);
+    builder.add(prefix.address);
+  }
+  return builder.takeBytes();
+}
+
+/// The prefixes of [packPrefixes], from [packed]; a record cut short ends the list.
+List<IpPrefix> unpackPrefixes(Uint8List? packed) {
+  final prefixes = <IpPrefix>[];
+  var offset = 0;
+  while (packed != null && offset + 2 <= packed.length) {
+    final length = packed[offset] == 4 ? 4 : 16;
+    if (offset + 2 + length > packed.length) {
+      break;
+    }
+    prefixes.add(IpPrefix(Uint8List.sublistView(packed, offset + 2, offset + 2 + length), packed[offset + 1]));
+    offset += 2 + length;
+  }
+  return prefixes;
+}
+
+/// Each address as a family byte (4 or 6) and the address bytes, back to back.
+Uint8List packAddresses(List<Uint8List> addresses) {
+  final builder = BytesBuilder(copy: false);
+  for (final address in addresses) {
+    builder.addByte(_family(address));
+    builder.add(address);
+  }
+  return builder.takeBytes();
+}
@@ -0,0 +1,48 @@
+class TunnelTransition {
+  final int elapsedMs;
+  final String? errorCode;
+  final String? errorMessage;
+
+  /// How one tunnel of a `WireguardDart.connectTunnels` or `disconnectTunnels` call did: [elapsedMs] from the
+  /// start of the call until it was done, and the [errorCode] and [errorMessage] that `connect` or `disconnect`
+  /// would have failed with, null if it succeeded.
+  const TunnelTransition({required this.elapsedMs, this.errorCode, this.errorMessage});
+
+  bool get succeeded => errorCode == null;
+
+  /// Factory constructor that creates a [TunnelTransition] object from a JSON map.
+  factory TunnelTransition.fromJson(Map<String, dynamic> json) => TunnelTransition(
+      elapsedMs: json['elapsedMs'] as int,
+      errorCode: json['errorCode'] as String?,
+      errorMessage: json['errorMessage'] as String?);
+
+  /// Converts the [TunnelTransition] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'elapsedMs': elapsedMs,
+        if (errorCode != null) 'errorCode': errorCode,
+        if (errorMessage != null) 'errorMessage': errorMessage,
+      };
+}
+
+class TunnelGroupResult {
+  final int elapsedMs;
+  final Map<String, TunnelTransition> tunnels;
+
+  /// What `WireguardDart.connectTunnels` and `disconnectTunnels` answer once every tunnel is done: [elapsedMs]
+  /// for the whole group, and how each of the [tunnels] did, by tunnel name.
+  const TunnelGroupResult({required this.elapsedMs, required this.tunnels});
+
+  bool get succeeded => tunnels.values.every((tunnel) => tunnel.succeeded);
+
+  /// Factory constructor that creates a [TunnelGroupResult] object from a JSON map.
+  factory TunnelGroupResult.fromJson(Map<String, dynamic> json) => TunnelGroupResult(
+      elapsedMs: json['elapsedMs'] as int,
+      tunnels: (json['tunnels'] as Map? ?? const {}).map((name, tunnel) => MapEntry(
+          name as String, TunnelTransition.fromJson(Map<String, dynamic>.from(tunnel as Map)))));
+
+  /// Converts the [TunnelGroupResult] object to a JSON map.
+  Map<String, dynamic> toJson() => {
+        'elapsedMs': elapsedMs,
+        'tunnels': tunnels.map((name, tunnel) => MapEntry(name, tunnel.toJson())),
+      };
+}
@@ -1,8 +1,22 @@
+import 'package:wireguard_dart/counter_snapshot.dart';
+import 'package:wireguard_dart/process_traffic.dart';
+
 class TunnelStatistics {
   final int totalDownload;
   final int totalUpload;
   final int latestHandshake;
 
+  /// Only on the statistics stream of Windows, when asked for
+  final InterfaceCounters? interfaceCounters;
+
+  /// Only on the statistics stream of Windows: when the counters were read, on the clock of
+  /// `AdapterStatus.monotonicUs`
+  final int? monotonicUs;
+
+  /// Only on the statistics stream of Windows, when asked for: the processes whose traffic over the tunnel or
+  /// sockets on it changed since the event before
+  final List<ProcessTraffic>? processes;
+
   /// Constructor of the [TunnelStatistics] class that receives
   /// [totalDownload], [totalUpload], and [latestHandshake] as parameters.
   /// [totalDownload] and [totalUpload] are the total bytes downloaded
@@ -12,18 +26,34 @@ class TunnelStatistics {
     required this.totalDownload,
     required this.totalUpload,
     required this.latestHandshake,
+    this.interfaceCounters,
+    this.monotonicUs,
+    this.processes,
   });
 
   /// Factory constructor that creates a [TunnelStatistics] object from a JSON map.
   factory TunnelStatistics.fromJson(Map<String, dynamic> json) => TunnelStatistics(
       totalDownload: json['totalDownload'] as int,
       totalUpload: json['totalUpload'] as int,
-      latestHandshake: json['latestHandshake'] as int);
+      latestHandshake: json['latestHandshake'] as int,
+      interfaceCounters: json['interface'] is Map
+          ? InterfaceCounters.fromJson(Map<String, dynamic>.from(json['interface'] as Map))
+          : null,
+      monotonicUs: json['monotonicUs'] as int?,
+      processes: json['processes'] is List
+          ? (json['processes'] as List)
+              .whereType<Map>()
+              .map((process) => ProcessTraffic.fromJson(Map<String, dynamic>.from(process)))
+              .toList()
+          : null);
 
   /// Converts the [TunnelStatistics] object to a JSON map.
   Map<String, dynamic> toJson() => {
         'totalDownload': totalDownload,
         'totalUpload': totalUpload,
         'latestHandshake': latestHandshake,
+        if (interfaceCounters != null) 'interface': interfaceCounters!.toJson(),
+        if (monotonicUs != null) 'monotonicUs': monotonicUs,
+        if (processes != null) 'processes': processes!.map((process) => process.toJson()).toList(),
       };
 }
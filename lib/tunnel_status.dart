@@ -0,0 +1,37 @@
+import 'package:wireguard_dart/connection_status.dart';
+
+/// One tunnel's entry in the answer of `statusAll`.
+class TunnelStatus {
+  final ConnectionStatus status;
+
+  /// Unset for a tunnel whose adapter has no interface yet
+  final int? luid;
+
+  /// When the tunnel went into [status], in milliseconds since the Unix epoch and in microseconds on the clock of
+  /// `Timeline.now` from `dart:developer`. Unset for a tunnel the plugin does not observe, whose status is the one
+  /// the driver last reported.
+  final DateTime? changedAt;
+  final int? changedAtMonotonicUs;
+
+  /// The latest handshake of any of the tunnel's peers, unset before the first
+  final DateTime? latestHandshake;
+
+  const TunnelStatus(this.status, {this.luid, this.changedAt, this.changedAtMonotonicUs, this.latestHandshake});
+
+  factory TunnelStatus.fromMap(Map<dynamic, dynamic> map) {
+    final changedAt = map['changedAt'] as int?;
+    final latestHandshake = map['latestHandshake'] as int?;
+    return TunnelStatus(
+      ConnectionStatus.fromString(map['status'] as String? ?? ''),
+      luid: map['luid'] as int?,
+      changedAt: changedAt != null ? DateTime.fromMillisecondsSinceEpoch(changedAt) : null,
+      changedAtMonotonicUs: map['changedAtMonotonicUs'] as int?,
+      latestHandshake:
+          latestHandshake != null && latestHandshake > 0 ? DateTime.fromMillisecondsSinceEpoch(latestHandshake) : null,
+    );
+  }
+
+  @override
+  String toString() => 'TunnelStatus(status: $status, luid: $luid, changedAt: $changedAt, '
+      'latestHandshake: $latestHandshake)';
+}
@@ -1,5 +1,29 @@
+import 'dart:typed_data';
+
+import 'package:wireguard_dart/adapter_event_type.dart';
+import 'package:wireguard_dart/adapter_log_mode.dart';
+import 'package:wireguard_dart/config_validation.dart';
+import 'package:wireguard_dart/configuration_drift.dart';
+import 'package:wireguard_dart/counter_snapshot.dart';
+import 'package:wireguard_dart/cumulative_statistics.dart';
 import 'package:wireguard_dart/key_pair.dart';
+import 'package:wireguard_dart/log_level.dart';
+import 'package:wireguard_dart/log_record.dart';
+import 'package:wireguard_dart/log_overflow_policy.dart';
+import 'package:wireguard_dart/memory_stats.dart';
+import 'package:wireguard_dart/peer_activation.dart';
+import 'package:wireguard_dart/peer_statistics.dart';
+import 'package:wireguard_dart/peer_statistics_view.dart';
+import 'package:wireguard_dart/phase_stats.dart';
+import 'package:wireguard_dart/resolved_peer.dart';
+import 'package:wireguard_dart/split_tunnel_mode.dart';
+import 'package:wireguard_dart/startup_trace_entry.dart';
+import 'package:wireguard_dart/statistics_history_view.dart';
+import 'package:wireguard_dart/throughput_result.dart';
+import 'package:wireguard_dart/tunnel_config.dart';
+import 'package:wireguard_dart/tunnel_group_result.dart';
 import 'package:wireguard_dart/tunnel_statistics.dart';
+import 'package:wireguard_dart/tunnel_status.dart';
 import 'package:wireguard_dart/adapter_status.dart';
 
 import 'connection_status.dart';
@@ -10,38 +34,563 @@ class WireguardDart {
     return WireguardDartPlatform.instance.generateKeyPair();
   }
 
-  Future<void> nativeInit({String? logFilePath}) {
-    return WireguardDartPlatform.instance.nativeInit(logFilePath: logFilePath);
+  /// A key pair as 64 raw bytes, the 32 byte public key followed by the 32 byte private key. Windows only; for
+  /// keys that are used as bytes, it saves encoding them as base64 and decoding them again.
+  Future<Uint8List> generateKeyPairBinary() {
+    return WireguardDartPlatform.instance.generateKeyPairBinary();
+  }
+
+  /// [count] key pairs in one call. Windows generates them in parallel and logs once for the batch; elsewhere
+  /// this makes one [generateKeyPair] call per pair.
+  Future<List<KeyPair>> generateKeyPairs(int count) {
+    return WireguardDartPlatform.instance.generateKeyPairs(count);
+  }
+
+  /// [count] key pairs as raw bytes, 64 per pair: the 32 byte public key followed by the 32 byte private key.
+  /// Windows only; saves encoding every key as base64 when they are stored or sent on in binary.
+  Future<Uint8List> generateKeyPairsBinary(int count) {
+    return WireguardDartPlatform.instance.generateKeyPairsBinary(count);
+  }
+
+  /// [count] random preshared keys as base64, from one call to the system's random number generator. Windows only.
+  Future<List<String>> generatePresharedKeys(int count) {
+    return WireguardDartPlatform.instance.generatePresharedKeys(count);
+  }
+
+  /// [count] random preshared keys as raw bytes, 32 per key. Windows only.
+  Future<Uint8List> generatePresharedKeysBinary(int count) {
+    return WireguardDartPlatform.instance.generatePresharedKeysBinary(count);
+  }
+
+  /// The base64 public key of a base64 [privateKey]. Windows only. Its tunnel configurations can also leave out
+  /// the interface's PublicKey, which is then derived from the PrivateKey the same way.
+  Future<String> derivePublicKey(String privateKey) {
+    return WireguardDartPlatform.instance.derivePublicKey(privateKey);
   }
 
+  /// The 32 byte public key of a 32 byte [privateKey], without base64 either way. Windows only.
+  Future<Uint8List> derivePublicKeyBinary(Uint8List privateKey) {
+    return WireguardDartPlatform.instance.derivePublicKeyBinary(privateKey);
+  }
+
+  /// The public keys of [privateKeys] in one call, in the same order. Windows derives them in parallel.
+  Future<List<String>> derivePublicKeys(List<String> privateKeys) {
+    return WireguardDartPlatform.instance.derivePublicKeys(privateKeys);
+  }
+
+  /// With [cacheConfigurations], Windows keeps each parsed tunnel configuration in a binary file next to
+  /// [logFilePath], so the same configuration is set up without parsing on the next start. Like the
+  /// configuration text, those files contain the private key.
+  ///
+  /// With [journalState], Windows records what it set up on each adapter in a file next to [logFilePath]. After
+  /// the app crashed, this call reattaches to the adapters that are still there: one whose addresses and routes
+  /// are all in place is adopted, and with [cacheConfigurations] setting up its configuration again does nothing;
+  /// from any other the recorded rows are removed, without scanning the system tables.
+  ///
+  /// With [cumulativeCounters], Windows keeps running totals of every tunnel and peer in a memory-mapped file
+  /// next to [logFilePath], updated in place once a second and carried across restarts of the app and
+  /// recreations of the adapter, see [getCumulativeStatistics].
+  ///
+  /// The adapters named in [prewarmTunnelNames] are opened or created in the background on Windows, so the
+  /// first [setupTunnel] for them does not wait for the driver to create a network device.
+  ///
+  /// With [handshakeStaleThreshold], Windows watches every peer's latest handshake and sends an [AdapterStatus]
+  /// on [statusStream] when a peer goes without one for longer, and again when it recovers. Windows also sends one
+  /// when an address of an observed adapter becomes usable or is removed and when one of its routes is added or
+  /// removed, see [AdapterStatus.networkChange].
+  ///
+  /// [statusStream] only sends an adapter's status when it changed. With [statusCoalesceWindow], Windows reads it
+  /// once per burst of interface notifications, after the window, instead of on every one of them.
+  ///
+  /// Every [endpointRoamingInterval], 5 seconds by default, Windows reads the endpoint WireGuard sends each peer's
+  /// packets to. When a peer roamed, its new address is kept off the tunnel routes like a configured endpoint, and
+  /// an [AdapterStatus] with [AdapterStatus.endpoint] is sent on [statusStream]. Zero turns the check off.
+  ///
+  /// Windows writes [logFilePath] from a background thread, so logging never waits for the disk. Up to
+  /// [logQueueSize] lines, 8192 by default, wait to be written; past that [logOverflowPolicy] decides, by
+  /// default dropping the oldest. Errors are written out at once and everything else within a second.
+  ///
+  /// With [maxLogBytes], Windows moves [logFilePath] aside once it reaches that size, and with [dailyLogFiles]
+  /// it starts a file named by the date every midnight instead. Either way [maxLogFiles] of the older files are
+  /// kept, 3 by default.
+  ///
+  /// Windows writes each line as its local date and time to the millisecond, the first letter of its level and
+  /// its message, adding the logging thread's ID while logging at `debug` level. [logPattern] replaces that with an
+  /// spdlog pattern of the app's own, in which `%*` is the same cached date and time.
+  ///
+  /// Windows adapters get a GUID derived from [bundleId] and the tunnel name, so an adapter created again
+  /// after a crash or reinstall is the same network to Windows. [setupTunnel] uses its own bundle ID and
+  /// falls back to this one. An empty bundle ID fails with `INVALID_ARGUMENT`, as every app would share its GUIDs.
+  ///
+  /// With [keyPoolSize], Windows generates up to that many key pairs in the background, at most 1024, so
+  /// [generateKeyPair] returns one at once. They are kept in memory that is never paged to disk. Zero removes
+  /// the pool.
+  ///
+  /// With [removeOrphanAdapters], Windows deletes in the background the network devices of adapters this plugin
+  /// created that are no longer present, such as those left behind by crashes. Adapters in use and those of other
+  /// WireGuard clients are not touched. Deleting a device needs the app to run elevated.
+  ///
+  /// Windows watches every driver and IP Helper call in progress. One that has not returned after [hangDeadline],
+  /// 10 seconds by default, is logged as an error with its thread and how long it has run, and the flight recorder
+  /// is dumped next to [logFilePath]; with [hangMinidump] a minidump of the app is written there too, at most one
+  /// every 10 minutes. A zero [hangDeadline] turns the watchdog off; one that is negative or longer than a day
+  /// fails with `INVALID_ARGUMENT`.
+  Future<void> nativeInit({
+    String? logFilePath,
+    bool? cacheConfigurations,
+    bool? journalState,
+    bool? cumulativeCounters,
+    List<String>? prewarmTunnelNames,
+    String? bundleId,
+    bool? statisticsHistory,
+    Duration? handshakeStaleThreshold,
+    Duration? statusCoalesceWindow,
+    Duration? endpointRoamingInterval,
+    int? logQueueSize,
+    LogOverflowPolicy? logOverflowPolicy,
+    int? maxLogBytes,
+    int? maxLogFiles,
+    bool? dailyLogFiles,
+    String? logPattern,
+    int? keyPoolSize,
+    bool? removeOrphanAdapters,
+    Duration? hangDeadline,
+    bool? hangMinidump,
+  }) {
+    return WireguardDartPlatform.instance.nativeInit(
+      logFilePath: logFilePath,
+      cacheConfigurations: cacheConfigurations,
+      journalState: journalState,
+      cumulativeCounters: cumulativeCounters,
+      prewarmTunnelNames: prewarmTunnelNames,
+      bundleId: bundleId,
+      statisticsHistory: statisticsHistory,
+      handshakeStaleThreshold: handshakeStaleThreshold,
+      statusCoalesceWindow: statusCoalesceWindow,
+      endpointRoamingInterval: endpointRoamingInterval,
+      logQueueSize: logQueueSize,
+      logOverflowPolicy: logOverflowPolicy,
+      maxLogBytes: maxLogBytes,
+      maxLogFiles: maxLogFiles,
+      dailyLogFiles: dailyLogFiles,
+      logPattern: logPattern,
+      keyPoolSize: keyPoolSize,
+      removeOrphanAdapters: removeOrphanAdapters,
+      hangDeadline: hangDeadline,
+      hangMinidump: hangMinidump,
+    );
+  }
+
+  /// The result has the adapter's `luid` and `timings`, the microseconds each phase of this setup took, keyed
+  /// like [getPerfStats]. On Windows, `driver` has the running driver `version`, whether this setup `installed`
+  /// it and how many microseconds that took as `installUs`.
+  ///
+  /// With [killSwitch], Windows blocks all traffic that does not go through the tunnel, except to the peer
+  /// endpoints, DHCP and loopback, for as long as the tunnel's networking is set up.
+  ///
+  /// On Windows a setup that has not finished [timeoutMs] after the call fails with `TIMEOUT`, and one
+  /// [cancelOperation] is called for with its [operationId] fails with `CANCELLED`. Either way it stops at the end
+  /// of the phase it is in and rolls back what it changed.
+  ///
+  /// On Windows the status events of the tunnel carry [correlationId] from then on, until another call for it
+  /// gives one, and a map result or error details carry it with the `monotonicUs` the call was answered at; see
+  /// [AdapterStatus.monotonicUs]. [setupAndConnect], [connect] and [disconnect] take it the same way.
   Future<Map<String, dynamic>?> setupTunnel({
     required String bundleId,
     required String tunnelName,
     required String cfg,
+    bool? killSwitch,
+    int? timeoutMs,
+    int? operationId,
+    String? correlationId,
   }) {
     return WireguardDartPlatform.instance.setupTunnel(
       bundleId: bundleId,
       tunnelName: tunnelName,
       cfg: cfg,
+      killSwitch: killSwitch,
+      timeoutMs: timeoutMs,
+      operationId: operationId,
+      correlationId: correlationId,
+    );
+  }
+
+  /// Same as [setupTunnel], for configurations too large to pass as one string.
+  /// The configuration is sent in the chunks [cfg] emits; they may split lines anywhere.
+  Future<Map<String, dynamic>?> setupTunnelFromChunks({
+    required String bundleId,
+    required String tunnelName,
+    required Stream<String> cfg,
+    bool? killSwitch,
+  }) {
+    return WireguardDartPlatform.instance.setupTunnelFromChunks(
+      bundleId: bundleId,
+      tunnelName: tunnelName,
+      cfg: cfg,
+      killSwitch: killSwitch,
+    );
+  }
+
+  /// [setupTunnel] for each of [tunnels], configurations by tunnel name, all set up in parallel. The result has
+  /// an entry for every tunnel: what [setupTunnel] answers, or `errorCode` and `errorMessage` if its setup failed.
+  /// Windows takes this call, like [getStatisticsHistory], [getMetrics] and [getRecentLogs], on a background
+  /// thread, so the configurations are not decoded on the UI thread.
+  Future<Map<String, Map<String, dynamic>?>> setupTunnels({
+    required String bundleId,
+    required Map<String, String> tunnels,
+    bool? killSwitch,
+  }) {
+    return WireguardDartPlatform.instance.setupTunnels(
+      bundleId: bundleId,
+      tunnels: tunnels,
+      killSwitch: killSwitch,
+    );
+  }
+
+  /// [setupTunnel] followed by [connect] in one call, without the adapter passing through DOWN in between.
+  /// Next to `luid`, the result has `timings` like [setupTunnel], including `connect`. [timeoutMs] and
+  /// [operationId] are those of [setupTunnel]; abandoned once the tunnel is set up, it is kept down for [connect].
+  /// [precheck] and [activation] are those of [connect], the precheck's probes running while the tunnel is set up.
+  Future<Map<String, dynamic>?> setupAndConnect({
+    required String bundleId,
+    required String tunnelName,
+    required String cfg,
+    bool? killSwitch,
+    int? timeoutMs,
+    int? operationId,
+    String? correlationId,
+    bool? precheck,
+    PeerActivation? activation,
+  }) {
+    return WireguardDartPlatform.instance.setupAndConnect(
+      bundleId: bundleId,
+      tunnelName: tunnelName,
+      cfg: cfg,
+      killSwitch: killSwitch,
+      timeoutMs: timeoutMs,
+      operationId: operationId,
+      correlationId: correlationId,
+      precheck: precheck,
+      activation: activation,
+    );
+  }
+
+  /// Abandon the [setupTunnel] or [setupAndConnect] started with [operationId], also while it still waits behind
+  /// earlier calls for its tunnel. Returns whether it was still in progress; it then fails with `CANCELLED`.
+  Future<bool> cancelOperation({required int operationId}) {
+    return WireguardDartPlatform.instance.cancelOperation(operationId: operationId);
+  }
+
+  /// Same as [setupTunnel], for a configuration already held as values. Keys and addresses go to Windows as
+  /// raw bytes and are written straight into the driver's configuration, with no INI text to format and parse
+  /// and no base64. The result is the same as that of [setupTunnel].
+  Future<Map<String, dynamic>?> setupTunnelStructured({
+    required String bundleId,
+    required String tunnelName,
+    required TunnelConfig config,
+    bool? killSwitch,
+  }) {
+    return WireguardDartPlatform.instance.setupTunnelStructured(
+      bundleId: bundleId,
+      tunnelName: tunnelName,
+      config: config,
+      killSwitch: killSwitch,
+    );
+  }
+
+  /// Windows only: same as [setupTunnel], for a configuration file at [path], such as one another process wrote.
+  /// Windows maps the file into memory and parses it in place, so a configuration of megabytes is neither read
+  /// into Dart nor encoded for the channel. The file must not be open for writing while it is read. The result
+  /// is the same as that of [setupTunnel]; an invalid configuration fails with the line it is invalid at.
+  Future<Map<String, dynamic>?> setupTunnelFromFile({
+    required String bundleId,
+    required String tunnelName,
+    required String path,
+    bool? killSwitch,
+  }) {
+    return WireguardDartPlatform.instance.setupTunnelFromFile(
+      bundleId: bundleId,
+      tunnelName: tunnelName,
+      path: path,
+      killSwitch: killSwitch,
+    );
+  }
+
+  /// Applies [cfg] to a tunnel that was set up before, without taking it down. Only the peers that changed are
+  /// sent to the driver and addresses and routes are updated in place, so a connected tunnel stays connected and
+  /// unchanged peers keep their sessions. [killSwitch] is left as it was when null.
+  Future<Map<String, dynamic>?> updateTunnel({
+    required String tunnelName,
+    required String cfg,
+    bool? killSwitch,
+  }) {
+    return WireguardDartPlatform.instance.updateTunnel(
+      tunnelName: tunnelName,
+      cfg: cfg,
+      killSwitch: killSwitch,
+    );
+  }
+
+  /// Windows only: parses [cfg] once and returns a handle to the result, for a configuration that is checked now
+  /// and applied later or applied to several tunnels. [setupTunnelCompiled] and [updateTunnelCompiled] take the
+  /// handle in place of the text, which then neither goes over the method channel nor through the parser again.
+  /// An invalid configuration fails with the line it is invalid at. The parse is kept until [releaseConfig].
+  Future<int> compileConfig({required String cfg}) {
+    return WireguardDartPlatform.instance.compileConfig(cfg: cfg);
+  }
+
+  /// Windows only: checks [cfg] without setting anything up, fast enough to run on every edit. The driver,
+  /// the resolver and the network tables are left alone. The result says whether the configuration is valid,
+  /// with its size, peers and routes, or where it is invalid.
+  Future<ConfigValidation> validateConfig({required String cfg}) {
+    return WireguardDartPlatform.instance.validateConfig(cfg: cfg);
+  }
+
+  /// Frees the configuration [compileConfig] returned [configHandle] for. Tunnels set up from it keep running;
+  /// releasing a handle again does nothing.
+  Future<void> releaseConfig({required int configHandle}) {
+    return WireguardDartPlatform.instance.releaseConfig(configHandle: configHandle);
+  }
+
+  /// Windows only: same as [setupTunnel], for a configuration compiled with [compileConfig].
+  ///
+  /// The compiled configuration can serve as a template for tunnels that share their peers and differ in their
+  /// interface: [privateKey], in base64, [addresses], such as `10.0.0.2/32`, and [listenPort] take the place of
+  /// the template's, and the rest is copied as it was parsed. Invalid ones fail with `CONFIGURATION_FAILED`, an empty
+  /// [addresses] or a listen port out of range with `INVALID_ARGUMENT`.
+  Future<Map<String, dynamic>?> setupTunnelCompiled({
+    required String bundleId,
+    required String tunnelName,
+    required int configHandle,
+    bool? killSwitch,
+    String? privateKey,
+    List<String>? addresses,
+    int? listenPort,
+  }) {
+    return WireguardDartPlatform.instance.setupTunnelCompiled(
+      bundleId: bundleId,
+      tunnelName: tunnelName,
+      configHandle: configHandle,
+      killSwitch: killSwitch,
+      privateKey: privateKey,
+      addresses: addresses,
+      listenPort: listenPort,
     );
   }
 
+  /// Windows only: same as [updateTunnel], for a configuration compiled with [compileConfig], with the overrides
+  /// of [setupTunnelCompiled].
+  Future<Map<String, dynamic>?> updateTunnelCompiled({
+    required String tunnelName,
+    required int configHandle,
+    bool? killSwitch,
+    String? privateKey,
+    List<String>? addresses,
+    int? listenPort,
+  }) {
+    return WireguardDartPlatform.instance.updateTunnelCompiled(
+      tunnelName: tunnelName,
+      configHandle: configHandle,
+      killSwitch: killSwitch,
+      privateKey: privateKey,
+      addresses: addresses,
+      listenPort: listenPort,
+    );
+  }
+
+  /// Windows only: adds [peers] to a tunnel that was set up before, or changes the ones it already has, for a hub
+  /// with many peers that come and go. Only these peers go to the driver, in one call, and only the routes that
+  /// change are added, so the cost follows the size of the change and not that of the configuration. The other
+  /// peers keep their sessions. Fails in low-memory mode, which does not keep the configuration to change.
+  Future<void> addPeers({required String tunnelName, required List<TunnelPeerConfig> peers}) {
+    return WireguardDartPlatform.instance.addPeers(tunnelName: tunnelName, peers: peers);
+  }
+
+  /// Windows only: removes the peers with [publicKeys], 32 bytes each, from a tunnel like [addPeers] adds them.
+  /// Keys the tunnel has no peer for are ignored. The kill switch no longer lets their endpoints through. The
+  /// configuration cache and the journal catch up with a burst of changes about a second after the last one.
+  Future<void> removePeers({required String tunnelName, required List<Uint8List> publicKeys}) {
+    return WireguardDartPlatform.instance.removePeers(tunnelName: tunnelName, publicKeys: publicKeys);
+  }
+
+  /// Windows only: updates the tunnel like [updateTunnel] whenever the configuration file at [path] is written,
+  /// for configurations that another process keeps on disk. A burst of writes is applied once, shortly after the
+  /// last one. A null [path] stops watching; failed updates are only logged.
+  Future<void> watchConfigFile({required String tunnelName, String? path}) {
+    return WireguardDartPlatform.instance.watchConfigFile(tunnelName: tunnelName, path: path);
+  }
+
+  /// With [warmUp] on Windows, the peers send keepalives as soon as the tunnel is up, so the first handshake
+  /// completes before the app sends anything; the status stream reports `connected` once it has.
+  ///
+  /// Windows resolves the [prefetchHosts], at most 64, as soon as the tunnel's addresses are usable, the moment
+  /// the ready event is sent on the status stream. They go through the system's resolver and so the tunnel's DNS
+  /// servers, and the app's first requests to them find their answers cached. Failures are only logged.
+  ///
+  /// With [precheck] on Windows, the connect first checks the network on the physical interface: a request for
+  /// Microsoft's connectivity test page, as Windows makes to detect captive portals, and one datagram to each peer
+  /// endpoint. It fails with `CAPTIVE_PORTAL` when the test page is redirected or answered by something else, and
+  /// with `ENDPOINT_UNREACHABLE` when every endpoint is reported unreachable, rather than leaving the tunnel to retry
+  /// its handshake. The check takes at most two seconds; whatever it cannot tell does not fail the connect.
+  ///
+  /// With [activation] on Windows, a tunnel with more peers than its batch size comes up with the first batch
+  /// only, and the others are added a batch at a time, so that hundreds of handshakes do not go out at once. The
+  /// status stream sends an [AdapterEventType.activation] event for each batch; until the last one,
+  /// [verifyTunnelConfiguration] reports the peers still to come as missing. It only applies to a tunnel that is
+  /// down, and a configuration update while it runs adds all remaining peers at once.
   Future<void> connect({
     required String tunnelName,
+    bool? warmUp,
+    String? correlationId,
+    List<String>? prefetchHosts,
+    bool? precheck,
+    PeerActivation? activation,
   }) {
-    return WireguardDartPlatform.instance.connect(tunnelName: tunnelName);
+    return WireguardDartPlatform.instance.connect(
+      tunnelName: tunnelName,
+      warmUp: warmUp,
+      correlationId: correlationId,
+      prefetchHosts: prefetchHosts,
+      precheck: precheck,
+      activation: activation,
+    );
+  }
+
+  Future<void> disconnect({required String tunnelName, String? correlationId}) {
+    return WireguardDartPlatform.instance.disconnect(tunnelName: tunnelName, correlationId: correlationId);
+  }
+
+  /// Windows only: [connect] each of [tunnelNames] at once, for switching to a profile of several tunnels. Every
+  /// tunnel connects on its own worker, in parallel with the others, and while the group comes up the status of
+  /// its adapters is read once per burst of interface changes rather than on every one. Answers when all are done,
+  /// with how long the group took and how each tunnel did; one failing does not stop the others.
+  Future<TunnelGroupResult> connectTunnels({required List<String> tunnelNames, bool? warmUp}) {
+    return WireguardDartPlatform.instance.connectTunnels(tunnelNames: tunnelNames, warmUp: warmUp);
+  }
+
+  /// Windows only: [disconnect] each of [tunnelNames] at once, in parallel like [connectTunnels].
+  Future<TunnelGroupResult> disconnectTunnels({required List<String> tunnelNames}) {
+    return WireguardDartPlatform.instance.disconnectTunnels(tunnelNames: tunnelNames);
+  }
+
+  /// Windows only: runs the tunnel with the configuration [cfg] as a Windows service of its own, which starts with
+  /// Windows, so the tunnel is up before the app is and stays up after it exits. Needs an elevated app. An adapter
+  /// the app set up for [tunnelName] is removed first.
+  ///
+  /// From then on [connect] and [disconnect] start and stop the service, status and statistics read its adapter,
+  /// and [nativeInit] attaches to it without setting anything up. [setupTunnel] and [updateTunnel] refuse the
+  /// tunnel; installing again replaces its configuration.
+  Future<void> installTunnelService({required String tunnelName, required String cfg}) {
+    return WireguardDartPlatform.instance.installTunnelService(tunnelName: tunnelName, cfg: cfg);
+  }
+
+  /// Windows only: stops and deletes the service installed by [installTunnelService], with its configuration.
+  Future<void> removeTunnelService({required String tunnelName}) {
+    return WireguardDartPlatform.instance.removeTunnelService(tunnelName: tunnelName);
+  }
+
+  /// Windows only: lets only the [apps] use the tunnel with [SplitTunnelMode.include], or keeps them off it with
+  /// [SplitTunnelMode.exclude]. Apps are executable paths, or package SIDs (`S-1-15-2-...`) of packaged apps.
+  ///
+  /// Takes effect at once, without reconnecting, and lasts until the tunnel is removed; calling again only changes
+  /// the rules of the apps that changed. An app is blocked from the tunnel rather than routed around it, so an
+  /// excluded app only gets out while the tunnel does not carry the routes it needs.
+  Future<void> setSplitTunnel({required String tunnelName, required SplitTunnelMode mode, List<String>? apps}) {
+    return WireguardDartPlatform.instance.setSplitTunnel(tunnelName: tunnelName, mode: mode, apps: apps);
+  }
+
+  /// Windows only: whether the WireGuard driver logs about the adapter of [tunnelName], and where the lines go.
+  /// Each adapter keeps its last 64 driver lines in a ring of its own, which [getAdapterLog] reads; with
+  /// [AdapterLogMode.on], the mode a new adapter starts with, only warnings and errors also reach the native log,
+  /// so a hub of many tunnels does not write every handshake to disk. An error, or a failed driver call about the
+  /// adapter, writes the ring to the native log. Lasts until the tunnel is removed.
+  Future<void> setAdapterLogging({required String tunnelName, required AdapterLogMode mode}) {
+    return WireguardDartPlatform.instance.setAdapterLogging(tunnelName: tunnelName, mode: mode);
   }
 
-  Future<void> disconnect({required String tunnelName}) {
-    return WireguardDartPlatform.instance.disconnect(tunnelName: tunnelName);
+  /// Windows only: the last driver lines about the adapter of [tunnelName], at most [maxLines] of them, oldest
+  /// first and formatted like [getRecentLogs]. The lines stay in the ring.
+  Future<List<String>> getAdapterLog({required String tunnelName, int? maxLines}) {
+    return WireguardDartPlatform.instance.getAdapterLog(tunnelName: tunnelName, maxLines: maxLines);
+  }
+
+  /// Windows only: keeps [standbyTunnel] ready to take over from [primaryTunnel] within milliseconds. Both stay up
+  /// with the same routes and only their interface metrics differ, so Windows sends through the primary. Once a
+  /// peer of the primary has had no handshake for the `handshakeStaleSeconds` given to [nativeInit], and none of the
+  /// standby's is stale, the primary's metric is raised above the standby's and traffic moves over; it moves back
+  /// once the primary's peers stayed live for 30 seconds. Peers of either tunnel without a `PersistentKeepalive`
+  /// get one of 25 seconds while grouped, so the tunnel not carrying traffic keeps handshaking. Without
+  /// `handshakeStaleSeconds` nothing fails over.
+  ///
+  /// A tunnel is in one group at a time, and a new group replaces the one either tunnel was in. The metrics apply
+  /// again when a tunnel of the group is set up again.
+  Future<void> setFailoverGroup({required String primaryTunnel, required String standbyTunnel}) {
+    return WireguardDartPlatform.instance.setFailoverGroup(primaryTunnel: primaryTunnel, standbyTunnel: standbyTunnel);
+  }
+
+  /// Windows only: ends the failover group [tunnelName] is the primary or standby of, leaving the metrics as they
+  /// are. Returns whether it was in one.
+  Future<bool> removeFailoverGroup({required String tunnelName}) {
+    return WireguardDartPlatform.instance.removeFailoverGroup(tunnelName: tunnelName);
+  }
+
+  /// Windows only: sends as much as the tunnel takes to [target], an `address:port` reached through it, for
+  /// [duration], at most a minute, to tell a slow link from a slow server or a poor MTU. With
+  /// [ThroughputProtocol.tcp], the default, [streams] connections run in parallel, 4 unless given and at most 16; the
+  /// endpoint has to accept them and discard what it reads, as a discard service does. With
+  /// [ThroughputProtocol.udp] datagrams of 1200 bytes go out as fast as they can.
+  ///
+  /// The test runs in the background without holding the platform thread; other calls for the tunnel, such as
+  /// [updateTunnel], wait until it is done. It fails with `THROUGHPUT_TEST_FAILED` when no stream reached the
+  /// target.
+  Future<ThroughputResult> runThroughputTest({
+    required String tunnelName,
+    required String target,
+    required Duration duration,
+    ThroughputProtocol? protocol,
+    int? streams,
+  }) {
+    return WireguardDartPlatform.instance.runThroughputTest(
+        tunnelName: tunnelName, target: target, duration: duration, protocol: protocol, streams: streams);
   }
 
   Future<ConnectionStatus> status() {
     return WireguardDartPlatform.instance.status();
   }
 
-  Stream<AdapterStatus> statusStream() {
-    return WireguardDartPlatform.instance.statusStream();
+  /// On Windows, the status of every tunnel the plugin has an adapter for, by tunnel name, with its LUID, when it
+  /// last changed and its latest handshake, in one call. Nothing reads the driver: statuses come from what the status
+  /// stream observed, or what the plugin last set or read for a tunnel it does not observe, and handshakes from the
+  /// last read of the statistics sampler or another call, so refreshing a dashboard of many tunnels stays cheap. A
+  /// tunnel whose state was never read reports `unknown`.
+  Future<Map<String, TunnelStatus>> statusAll() {
+    return WireguardDartPlatform.instance.statusAll();
+  }
+
+  /// On Windows a tunnel that is brought up is [ConnectionStatus.connecting] until a peer completed a handshake,
+  /// and [ConnectionStatus.disconnecting] from [disconnect] until its interface is down. A new listener first gets
+  /// the last status of every observed adapter, so there is no need to ask [status] when subscribing.
+  ///
+  /// With [batched], Windows sends the changes it gathered at once as one list instead of one message each, which
+  /// saves channel crossings when many tunnels change together; the stream still has one [AdapterStatus] each.
+  ///
+  /// With [tunnelNames], [luids] or [events], the stream only has the events of those tunnels or adapters, of
+  /// those types. Windows filters them natively: all status streams of an app share one listen, each one a
+  /// subscription with its filter, and an event crosses the channel once for all the subscriptions it matched and
+  /// not at all for none, so many widgets that each watch one tunnel cost no more than one stream. [batched] does
+  /// not matter there, events are always batched. Other platforms filter in Dart and ignore [tunnelNames].
+  ///
+  /// On Linux the [AdapterStatus.luid] is the interface index [setupTunnel] answers with, a tunnel is
+  /// [ConnectionStatus.connected] while its interface is up, and address changes are sent too. Only the changes
+  /// after subscribing are sent.
+  Stream<AdapterStatus> statusStream({
+    bool batched = false,
+    List<String>? tunnelNames,
+    List<int>? luids,
+    Set<AdapterEventType>? events,
+  }) {
+    return WireguardDartPlatform.instance
+        .statusStream(batched: batched, tunnelNames: tunnelNames, luids: luids, events: events);
   }
 
   Future<bool> checkTunnelConfiguration({required String bundleId, required String tunnelName}) {
@@ -51,6 +600,30 @@ class WireguardDart {
     );
   }
 
+  /// Windows only: reads the configuration the driver runs back and compares it with the one applied, for example
+  /// after another tool touched the adapter. Endpoints are not compared, since peers roam and the plugin moves
+  /// hostname and failover endpoints on its own. Reapplying only the peers in the drift heals it.
+  Future<ConfigurationDrift> verifyTunnelConfiguration({required String tunnelName}) {
+    return WireguardDartPlatform.instance.verifyTunnelConfiguration(tunnelName: tunnelName);
+  }
+
+  /// Windows only: the configuration the driver runs, read back from it rather than taken from what Dart last
+  /// sent, as configuration text for a support report. Only what the driver holds is there: the private key, listen
+  /// port and peers, not the addresses, DNS or MTU. With [redactKeys] the private key and preshared keys are
+  /// commented out as `(redacted)`. A hub of 10,000 peers takes milliseconds.
+  Future<String> exportTunnelConfiguration({required String tunnelName, bool redactKeys = true}) {
+    return WireguardDartPlatform.instance.exportTunnelConfiguration(tunnelName: tunnelName, redactKeys: redactKeys);
+  }
+
+  /// Windows only: same as [exportTunnelConfiguration], as values, with [redactKeys] leaving the keys out.
+  Future<TunnelConfig> exportTunnelConfigurationStructured({required String tunnelName, bool redactKeys = true}) {
+    return WireguardDartPlatform.instance
+        .exportTunnelConfigurationStructured(tunnelName: tunnelName, redactKeys: redactKeys);
+  }
+
+  /// On Windows the tunnel's adapter is closed, the addresses and routes the plugin recorded on it are removed and
+  /// its network device is deleted, so it does not linger as a hidden device. Its cached configuration and state
+  /// journal entry are forgotten. A tunnel installed as a service has to be removed with [removeTunnelService].
   Future<void> removeTunnelConfiguration({required String bundleId, required String tunnelName}) {
     return WireguardDartPlatform.instance.removeTunnelConfiguration(
       bundleId: bundleId,
@@ -61,4 +634,177 @@ class WireguardDart {
   Future<TunnelStatistics?> getTunnelStatistics() {
     return WireguardDartPlatform.instance.getTunnelStatistics();
   }
+
+  /// The statistics of every tunnel, sampled natively every [interval] while the stream has a listener. Each
+  /// event only has the tunnels whose counters changed since the one before, by tunnel name. The interval of
+  /// the first listener applies to all of them. With [interfaceCounters], each tunnel also has the
+  /// [TunnelStatistics.interfaceCounters] read in the same tick. With [processTraffic], a tunnel also comes
+  /// with the [TunnelStatistics.processes] whose traffic or sockets on it changed, with their byte rates, to tell
+  /// which applications fill the tunnel; reading their bytes needs the app to run elevated.
+  Stream<Map<String, TunnelStatistics>> statisticsStream({
+    Duration interval = const Duration(seconds: 1),
+    bool interfaceCounters = false,
+    bool processTraffic = false,
+  }) {
+    return WireguardDartPlatform.instance
+        .statisticsStream(interval: interval, interfaceCounters: interfaceCounters, processTraffic: processTraffic);
+  }
+
+  /// The counters, handshake age and throughput of every peer of the tunnel, or of the newest tunnel without
+  /// [tunnelName], by base64 public key. The rates come from the readings of the previous call.
+  Future<Map<String, PeerStatistics>> getPeerStatistics({String? tunnelName}) {
+    return WireguardDartPlatform.instance.getPeerStatistics(tunnelName: tunnelName);
+  }
+
+  /// The same as [getPeerStatistics] in one binary buffer, for tunnels with many peers: nothing is decoded
+  /// until a value is read from the view.
+  Future<PeerStatisticsView> getPeerStatisticsView({String? tunnelName}) {
+    return WireguardDartPlatform.instance.getPeerStatisticsView(tunnelName: tunnelName);
+  }
+
+  /// The counters of the tunnel, or with [publicKey] of one of its peers, over the last [window], recorded
+  /// natively so the history outlives the isolate. Windows records it while [nativeInit] had
+  /// `statisticsHistory` set: once a second for the last 5 minutes, every 10 seconds for an hour and every
+  /// minute for a day; peers keep a minute, 15 minutes and an hour. The finest tier that spans the window is used.
+  Future<StatisticsHistoryView> getStatisticsHistory({
+    required String tunnelName,
+    required Duration window,
+    String? publicKey,
+  }) {
+    return WireguardDartPlatform.instance.getStatisticsHistory(
+      tunnelName: tunnelName,
+      window: window,
+      publicKey: publicKey,
+    );
+  }
+
+  /// The peers of the tunnel, or of the newest tunnel without [tunnelName], together with the interface
+  /// counters with its discards and errors, read back to back.
+  Future<CounterSnapshot> getCounterSnapshot({String? tunnelName}) {
+    return WireguardDartPlatform.instance.getCounterSnapshot(tunnelName: tunnelName);
+  }
+
+  /// Windows only: the running totals kept with `nativeInit(cumulativeCounters: true)`, by tunnel name, of the
+  /// [tunnelNames] or of every tunnel counted. The driver's counters start over whenever an adapter is created,
+  /// these add up what it counted across all of them. With [reset] the totals read start over from zero, at once,
+  /// as for a new billing period.
+  Future<Map<String, CumulativeStatistics>> getCumulativeStatistics({List<String>? tunnelNames, bool? reset}) {
+    return WireguardDartPlatform.instance.getCumulativeStatistics(tunnelNames: tunnelNames, reset: reset);
+  }
+
+  /// Windows only: the tunnel and peer that traffic to each of [addresses] goes to, in the same order, by the
+  /// longest allowed IP holding it among every applied configuration; null for an address none holds or that
+  /// is not an IP address. The allowed IPs are indexed when a configuration is applied, so a lookup takes
+  /// microseconds and never waits for a tunnel being set up.
+  Future<List<ResolvedPeer?>> resolvePeerForAddresses(List<String> addresses) {
+    return WireguardDartPlatform.instance.resolvePeerForAddresses(addresses);
+  }
+
+  /// Appends the counters of every tunnel to the file at [path] once a second until [stopStatsRecording], for
+  /// long soak runs. Windows writes fixed-width binary records in the background, after those already in the
+  /// file; `windows/tools` has a converter to CSV.
+  Future<void> startStatsRecording({required String path}) {
+    return WireguardDartPlatform.instance.startStatsRecording(path: path);
+  }
+
+  /// Stops the recording. The result has how many records it `recordsWritten`, and `recordsDropped` because
+  /// the disk fell behind.
+  Future<Map<String, dynamic>?> stopStatsRecording() {
+    return WireguardDartPlatform.instance.stopStatsRecording();
+  }
+
+  /// How long the phases of setting up and connecting tunnels took this session, by phase: `libraryLoad`,
+  /// `adapter`, `cache`, `parse`, `build`, `setConfiguration`, `interface`, `addresses`, `routes`, `dns`,
+  /// `connect`, `handshake`, the time from UP to the first completed handshake, and `driverInstall` when a setup
+  /// had to install the driver.
+  Future<Map<String, PhaseStats>> getPerfStats() {
+    return WireguardDartPlatform.instance.getPerfStats();
+  }
+
+  /// The native subsystems started so far this process, in the order they started: `plugin`, `tracing`,
+  /// `library`, `tunnelWorkers`, `bulkChannel`, `ioReactor`, `interfaceNotifications`, `statisticsSampler` and
+  /// `powerMonitor`. Each starts at its first use, so one missing was not needed yet. Windows only.
+  Future<List<StartupTraceEntry>> getStartupTrace() {
+    return WireguardDartPlatform.instance.getStartupTrace();
+  }
+
+  /// Send the [getMetrics] samples and the log records at or above [minLevel], warnings by default, to a collector
+  /// at [host]:[port] over UDP every [interval], a minute by default, without going through the app. Each batch is
+  /// split into datagrams of at most 1200 bytes, of which at most [maxDatagramsPerInterval] (64) are sent; samples
+  /// that did not change since the batch before are left out but for every tenth batch. Records are only seen once
+  /// [nativeInit] created the file logger. Replaces an earlier export. Windows only.
+  Future<void> startTelemetryExport({
+    required String host,
+    required int port,
+    Duration? interval,
+    int? maxDatagramsPerInterval,
+    LogLevel? minLevel,
+  }) {
+    return WireguardDartPlatform.instance.startTelemetryExport(
+      host: host,
+      port: port,
+      interval: interval,
+      maxDatagramsPerInterval: maxDatagramsPerInterval,
+      minLevel: minLevel,
+    );
+  }
+
+  /// Stop what [startTelemetryExport] started. Windows only.
+  Future<void> stopTelemetryExport() {
+    return WireguardDartPlatform.instance.stopTelemetryExport();
+  }
+
+  /// What the plugin holds in memory, by kind and by tunnel, with the process working set and how each setup
+  /// phase changed it. Windows only.
+  Future<MemoryStats> getMemoryStats() {
+    return WireguardDartPlatform.instance.getMemoryStats();
+  }
+
+  /// For machines short on memory: with [enabled], a tunnel keeps only the hash of its configuration once it is
+  /// set up, recent logs keep 200 lines and the statistics history less time. Updates then replace every peer
+  /// instead of only the changed ones, [verifyTunnelConfiguration] fails and a warm-up on connect does nothing
+  /// until the configuration is applied again. Windows only.
+  Future<void> setLowMemoryMode({required bool enabled}) {
+    return WireguardDartPlatform.instance.setLowMemoryMode(enabled: enabled);
+  }
+
+  /// Latency histograms of every WireGuard driver and IP Helper call this process made, in the OpenMetrics text
+  /// format, ready to forward to a metrics backend. Windows only; the buckets are powers of two nanoseconds.
+  /// The `wireguard_dart_compute_pool_*` families follow: the threads that generate key pairs in batches, how many
+  /// tasks wait for them, how many they ran and how many they took from each other. Then
+  /// `wireguard_dart_background_wakeups_total` and `wireguard_dart_background_wakeups_per_minute`, by `thread`: how
+  /// often each background thread of the plugin woke up, to check what an idle tunnel costs on battery.
+  /// `wireguard_dart_cpu_cycles_total` and `wireguard_dart_threads`, by `component`, the plugin's CPU cycles and
+  /// running threads: each background thread, the tunnel workers, compute pool, I/O reactor, log writer and the
+  /// threads of single operations, and `platform_methods` and `platform_tasks` for its time on the platform thread,
+  /// next to `wireguard_dart_process_cpu_cycles_total` for the whole process. Last the
+  /// counters to alert on failure rates with: `wireguard_dart_method_calls_total` by `method` and
+  /// `wireguard_dart_call_outcomes_total` by driver or IP Helper `call`, each by `outcome`, `ok` or the class of
+  /// the error such as `notFound`, `accessDenied`, `transient` or `timeout`, and `wireguard_dart_cache_lookups_total`
+  /// by `cache` and `result`, `hit` or `miss`.
+  Future<String> getMetrics() {
+    return WireguardDartPlatform.instance.getMetrics();
+  }
+
+  /// Log lines below [level] are left out from now on, `debug` and above by default. Windows release builds
+  /// leave out `debug` and `trace` lines when they are compiled.
+  Future<void> setLogLevel(LogLevel level) {
+    return WireguardDartPlatform.instance.setLogLevel(level);
+  }
+
+  /// The latest lines of the native log, oldest first, each as its local date and time to the millisecond, the
+  /// first letter of its level and its message, whatever `logPattern` [nativeInit] was given: at most
+  /// [maxLines] of them at [minLevel] or above. Windows answers from memory, the last 2000 lines, without reading
+  /// the file; lines logged a moment ago may still be on their way. Empty before [nativeInit] set a log file.
+  Future<List<String>> getRecentLogs({int? maxLines, LogLevel? minLevel}) {
+    return WireguardDartPlatform.instance.getRecentLogs(maxLines: maxLines, minLevel: minLevel);
+  }
+
+  /// The lines of the native log as they are written, at [minLevel] or above, without the log file being read.
+  /// Windows sends a message repeated within 5 seconds once, followed by a line with how many times it was
+  /// skipped, and at most [maxRecordsPerSecond] lines a second, 200 by default; a `warn` line tells how many were
+  /// dropped over that. Nothing is sent before [nativeInit] set a log file.
+  Stream<LogRecord> logStream({int? maxRecordsPerSecond, LogLevel? minLevel}) {
+    return WireguardDartPlatform.instance.logStream(maxRecordsPerSecond: maxRecordsPerSecond, minLevel: minLevel);
+  }
 }
@@ -0,0 +1,135 @@
+import 'dart:ffi';
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'package:ffi/ffi.dart';
+import 'package:wireguard_dart/connection_status.dart';
+import 'package:wireguard_dart/peer_statistics_view.dart';
+import 'package:wireguard_dart/tunnel_statistics.dart';
+
+final class _Totals extends Struct {
+  @Uint64()
+  external int rxBytes;
+  @Uint64()
+  external int txBytes;
+  @Uint64()
+  external int latestHandshake;
+}
+
+typedef _StatusNative = Int32 Function(Pointer<Utf8> tunnelName);
+typedef _Status = int Function(Pointer<Utf8> tunnelName);
+typedef _TotalsNative = Int32 Function(Pointer<Utf8> tunnelName, Pointer<_Totals> totals);
+typedef _TotalsFunction = int Function(Pointer<Utf8> tunnelName, Pointer<_Totals> totals);
+typedef _PeerStatisticsNative = Int64 Function(Pointer<Utf8> tunnelName, Pointer<Uint8> buffer, Int64 capacity);
+typedef _PeerStatistics = int Function(Pointer<Utf8> tunnelName, Pointer<Uint8> buffer, int capacity);
+
+/// Synchronous reads straight from the Windows plugin DLL, for polling [status], [tunnelStatistics] and
+/// [peerStatistics] without the method channel's encoding and trip through the platform thread. Each call
+/// returns null where the method call would fail, or when the plugin is not registered.
+class WireguardDartFfi {
+  // In the order of the native ConnectionStatus
+  static const _statuses = [
+    ConnectionStatus.connected,
+    ConnectionStatus.disconnected,
+    ConnectionStatus.connecting,
+    ConnectionStatus.disconnecting,
+    ConnectionStatus.unknown,
+  ];
+
+  final _Status _status;
+  final _TotalsFunction _totals;
+  final _PeerStatistics _peerStatistics;
+  // Kept across calls and grown when a snapshot does not fit
+  Pointer<Uint8> _buffer = nullptr;
+  int _capacity = 0;
+
+  WireguardDartFfi._(DynamicLibrary library)
+      : _status = library.lookupFunction<_StatusNative, _Status>('WireguardDartFfiStatus'),
+        _totals = library.lookupFunction<_TotalsNative, _TotalsFunction>('WireguardDartFfiTotals'),
+        _peerStatistics =
+            library.lookupFunction<_PeerStatisticsNative, _PeerStatistics>('WireguardDartFfiPeerStatistics');
+
+  /// The plugin DLL's reads, or null off Windows or when the DLL is not loaded in this process.
+  static WireguardDartFfi? open() {
+    if (!Platform.isWindows) {
+      return null;
+    }
+    try {
+      return WireguardDartFfi._(DynamicLibrary.open('wireguard_dart_plugin.dll'));
+    } on ArgumentError {
+      return null;
+    }
+  }
+
+  /// Like [WireguardDart.status] for the tunnel named [tunnelName].
+  ConnectionStatus? status(String tunnelName) {
+    final name = tunnelName.toNativeUtf8();
+    try {
+      final status = _status(name);
+      return status >= 0 && status < _statuses.length ? _statuses[status] : null;
+    } finally {
+      malloc.free(name);
+    }
+  }
+
+  /// Like [WireguardDart.getTunnelStatistics], of the newest tunnel without [tunnelName].
+  TunnelStatistics? tunnelStatistics({String? tunnelName}) {
+    final name = tunnelName?.toNativeUtf8() ?? nullptr;
+    final totals = malloc<_Totals>();
+    try {
+      if (_totals(name, totals) != 0) {
+        return null;
+      }
+      return TunnelStatistics(
+        totalDownload: totals.ref.rxBytes,
+        totalUpload: totals.ref.txBytes,
+        latestHandshake: totals.ref.latestHandshake,
+      );
+    } finally {
+      malloc.free(totals);
+      if (name != nullptr) {
+        malloc.free(name);
+      }
+    }
+  }
+
+  /// Like [WireguardDart.getPeerStatisticsView], of the newest tunnel without [tunnelName]. The view has a copy of
+  /// the snapshot of its own.
+  PeerStatisticsView? peerStatistics({String? tunnelName}) {
+    final name = tunnelName?.toNativeUtf8() ?? nullptr;
+    try {
+      var size = _peerStatistics(name, _buffer, _capacity);
+      if (size > _capacity) {
+        _grow(size);
+        size = _peerStatistics(name, _buffer, _capacity);
+      }
+      // Peers added between the two calls leave it too small again, which the next call makes up for
+      if (size < 0 || size > _capacity) {
+        return null;
+      }
+      return PeerStatisticsView(Uint8List.fromList(_buffer.asTypedList(size)));
+    } finally {
+      if (name != nullptr) {
+        malloc.free(name);
+      }
+    }
+  }
+
+  void _grow(int size) {
+    if (_buffer != nullptr) {
+      malloc.free(_buffer);
+    }
+    // Room for a few more peers, so one more does not mean another round
+    _capacity = size + size ~/ 4;
+    _buffer = malloc<Uint8>(_capacity);
+  }
+
+  /// Frees the snapshot buffer; the reads can still be used and allocate it again.
+  void close() {
+    if (_buffer != nullptr) {
+      malloc.free(_buffer);
+      _buffer = nullptr;
+      _capacity = 0;
+    }
+  }
+}
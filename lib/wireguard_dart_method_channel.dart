@@ -1,24 +1,104 @@
+import 'dart:async';
 import 'dart:convert';
+import 'dart:math';
 
 import 'package:flutter/foundation.dart';
 import 'package:flutter/services.dart';
+import 'package:wireguard_dart/adapter_event_type.dart';
+import 'package:wireguard_dart/adapter_log_mode.dart';
 import 'package:wireguard_dart/connection_status.dart';
+import 'package:wireguard_dart/config_validation.dart';
+import 'package:wireguard_dart/configuration_drift.dart';
+import 'package:wireguard_dart/counter_snapshot.dart';
+import 'package:wireguard_dart/cumulative_statistics.dart';
 import 'package:wireguard_dart/key_pair.dart';
+import 'package:wireguard_dart/log_level.dart';
+import 'package:wireguard_dart/log_record.dart';
+import 'package:wireguard_dart/log_overflow_policy.dart';
+import 'package:wireguard_dart/memory_stats.dart';
+import 'package:wireguard_dart/peer_activation.dart';
 import 'package:wireguard_dart/adapter_status.dart';
+import 'package:wireguard_dart/peer_statistics.dart';
+import 'package:wireguard_dart/peer_statistics_view.dart';
+import 'package:wireguard_dart/phase_stats.dart';
+import 'package:wireguard_dart/resolved_peer.dart';
+import 'package:wireguard_dart/split_tunnel_mode.dart';
+import 'package:wireguard_dart/startup_trace_entry.dart';
+import 'package:wireguard_dart/statistics_history_view.dart';
+import 'package:wireguard_dart/throughput_result.dart';
+import 'package:wireguard_dart/tunnel_config.dart';
+import 'package:wireguard_dart/tunnel_group_result.dart';
 import 'package:wireguard_dart/tunnel_statistics.dart';
+import 'package:wireguard_dart/tunnel_status.dart';
 
 import 'wireguard_dart_platform_interface.dart';
 
 enum WireguardMethodChannelMethod {
   generateKeyPair('generateKeyPair'),
+  generateKeyPairBinary('generateKeyPairBinary'),
+  generateKeyPairs('generateKeyPairs'),
+  generateKeyPairsBinary('generateKeyPairsBinary'),
+  generatePresharedKeys('generatePresharedKeys'),
+  generatePresharedKeysBinary('generatePresharedKeysBinary'),
+  derivePublicKey('derivePublicKey'),
+  derivePublicKeys('derivePublicKeys'),
   nativeInit('nativeInit'),
   setupTunnel('setupTunnel'),
+  setupTunnels('setupTunnels'),
+  setupAndConnect('setupAndConnect'),
+  setupTunnelStructured('setupTunnelStructured'),
+  setupTunnelFromFile('setupTunnelFromFile'),
+  setupTunnelCompiled('setupTunnelCompiled'),
+  cancelOperation('cancelOperation'),
+  updateTunnel('updateTunnel'),
+  updateTunnelCompiled('updateTunnelCompiled'),
+  addPeers('addPeers'),
+  removePeers('removePeers'),
+  compileConfig('compileConfig'),
+  releaseConfig('releaseConfig'),
+  validateConfig('validateConfig'),
+  resolvePeerForAddresses('resolvePeerForAddresses'),
+  watchConfigFile('watchConfigFile'),
   connect('connect'),
   disconnect('disconnect'),
+  connectTunnels('connectTunnels'),
+  disconnectTunnels('disconnectTunnels'),
+  runThroughputTest('runThroughputTest'),
+  installTunnelService('installTunnelService'),
+  removeTunnelService('removeTunnelService'),
+  setSplitTunnel('setSplitTunnel'),
+  setAdapterLogging('setAdapterLogging'),
+  getAdapterLog('getAdapterLog'),
+  setFailoverGroup('setFailoverGroup'),
+  removeFailoverGroup('removeFailoverGroup'),
   status('status'),
+  statusAll('statusAll'),
+  subscribeStatus('subscribeStatus'),
+  unsubscribeStatus('unsubscribeStatus'),
   checkTunnelConfiguration('checkTunnelConfiguration'),
+  verifyTunnelConfiguration('verifyTunnelConfiguration'),
   removeTunnelConfiguration('removeTunnelConfiguration'),
-  tunnelStatistics('tunnelStatistics');
+  tunnelStatistics('tunnelStatistics'),
+  peerStatistics('peerStatistics'),
+  peerStatisticsBinary('peerStatisticsBinary'),
+  getStatisticsHistory('getStatisticsHistory'),
+  counterSnapshot('counterSnapshot'),
+  getCumulativeStatistics('getCumulativeStatistics'),
+  startStatsRecording('startStatsRecording'),
+  stopStatsRecording('stopStatsRecording'),
+  getPerfStats('getPerfStats'),
+  getMemoryStats('getMemoryStats'),
+  setLowMemoryMode('setLowMemoryMode'),
+  getMetrics('getMetrics'),
+  beginTunnelConfiguration('beginTunnelConfiguration'),
+  appendTunnelConfiguration('appendTunnelConfiguration'),
+  getRecentLogs('getRecentLogs'),
+  setLogLevel('setLogLevel'),
+  getStartupTrace('getStartupTrace'),
+  benchmarkCall('benchmarkCall'),
+  startTelemetryExport('startTelemetryExport'),
+  stopTelemetryExport('stopTelemetryExport'),
+  exportTunnelConfiguration('exportTunnelConfiguration');
 
   const WireguardMethodChannelMethod(this.value);
   final String value;
@@ -28,6 +108,26 @@ class MethodChannelWireguardDart extends WireguardDartPlatform {
   @visibleForTesting
   final methodChannel = const MethodChannel('wireguard_dart');
   final statusChannel = const EventChannel('wireguard_dart/status');
+  final statisticsChannel = const EventChannel('wireguard_dart/statistics');
+  final logsChannel = const EventChannel('wireguard_dart/logs');
+  // Only for the channel benchmark of the example app, with benchmarkCall; Windows only
+  final benchmarkChannel = const EventChannel('wireguard_dart/benchmark');
+  @visibleForTesting
+  final bulkChannel = const MethodChannel('wireguard_dart/bulk');
+  bool _bulkChannelMissing = false;
+
+  // Calls with large arguments or results go to the channel Windows handles off its platform thread, the rest
+  // of the platforms answer them on the main channel
+  Future<T?> _invokeBulk<T>(String method, [Object? arguments]) async {
+    if (!_bulkChannelMissing) {
+      try {
+        return await bulkChannel.invokeMethod<T>(method, arguments);
+      } on MissingPluginException {
+        _bulkChannelMissing = true;
+      }
+    }
+    return methodChannel.invokeMethod<T>(method, arguments);
+  }
 
   @override
   Future<KeyPair> generateKeyPair() async {
@@ -39,20 +139,390 @@ class MethodChannelWireguardDart extends WireguardDartPlatform {
   }
 
   @override
-  Future<void> nativeInit({String? logFilePath}) async {
+  Future<Uint8List> generateKeyPairBinary() async {
+    final result = await methodChannel.invokeMethod<Uint8List>(WireguardMethodChannelMethod.generateKeyPairBinary.value);
+    if (result == null || result.length != 64) {
+      throw StateError('Could not generate keypair');
+    }
+    return result;
+  }
+
+  @override
+  Future<List<KeyPair>> generateKeyPairs(int count) async {
+    final List<dynamic>? result;
+    try {
+      result = await methodChannel.invokeListMethod(WireguardMethodChannelMethod.generateKeyPairs.value, {'count': count});
+    } on MissingPluginException {
+      // Platforms without batches make one call per key pair
+      return [for (var i = 0; i < count; i++) await generateKeyPair()];
+    }
+    return [
+      for (final pair in result ?? const [])
+        if (pair is Map && pair['publicKey'] is String && pair['privateKey'] is String)
+          KeyPair(pair['publicKey'] as String, pair['privateKey'] as String),
+    ];
+  }
+
+  @override
+  Future<Uint8List> generateKeyPairsBinary(int count) async {
+    final result = await methodChannel.invokeMethod<Uint8List>(WireguardMethodChannelMethod.generateKeyPairsBinary.value, {
+      'count': count,
+    });
+    return result ?? Uint8List(0);
+  }
+
+  @override
+  Future<List<String>> generatePresharedKeys(int count) async {
+    final result = await methodChannel.invokeListMethod<String>(WireguardMethodChannelMethod.generatePresharedKeys.value, {
+      'count': count,
+    });
+    return result ?? const [];
+  }
+
+  @override
+  Future<Uint8List> generatePresharedKeysBinary(int count) async {
+    final result = await methodChannel.invokeMethod<Uint8List>(WireguardMethodChannelMethod.generatePresharedKeysBinary.value, {
+      'count': count,
+    });
+    return result ?? Uint8List(0);
+  }
+
+  @override
+  Future<String> derivePublicKey(String privateKey) async {
+    final result = await methodChannel.invokeMethod<String>(WireguardMethodChannelMethod.derivePublicKey.value, {
+      'privateKey': privateKey,
+    });
+    if (result == null) {
+      throw StateError('Could not derive public key');
+    }
+    return result;
+  }
+
+  @override
+  Future<Uint8List> derivePublicKeyBinary(Uint8List privateKey) async {
+    final result = await methodChannel.invokeMethod<Uint8List>(WireguardMethodChannelMethod.derivePublicKey.value, {
+      'privateKey': privateKey,
+    });
+    if (result == null) {
+      throw StateError('Could not derive public key');
+    }
+    return result;
+  }
+
+  @override
+  Future<List<String>> derivePublicKeys(List<String> privateKeys) async {
+    final List<String>? result;
+    try {
+      result = await methodChannel.invokeListMethod<String>(WireguardMethodChannelMethod.derivePublicKeys.value, {
+        'privateKeys': privateKeys,
+      });
+    } on MissingPluginException {
+      // Platforms without batches make one call per key
+      return [for (final privateKey in privateKeys) await derivePublicKey(privateKey)];
+    }
+    return result ?? const [];
+  }
+
+  @override
+  Future<void> nativeInit({
+    String? logFilePath,
+    bool? cacheConfigurations,
+    bool? journalState,
+    bool? cumulativeCounters,
+    List<String>? prewarmTunnelNames,
+    String? bundleId,
+    bool? statisticsHistory,
+    Duration? handshakeStaleThreshold,
+    Duration? statusCoalesceWindow,
+    Duration? endpointRoamingInterval,
+    int? logQueueSize,
+    LogOverflowPolicy? logOverflowPolicy,
+    int? maxLogBytes,
+    int? maxLogFiles,
+    bool? dailyLogFiles,
+    String? logPattern,
+    int? keyPoolSize,
+    bool? removeOrphanAdapters,
+    Duration? hangDeadline,
+    bool? hangMinidump,
+  }) async {
     await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.nativeInit.value, {
       if (logFilePath != null) 'logFilePath': logFilePath,
+      if (cacheConfigurations != null) 'cacheConfigurations': cacheConfigurations,
+      if (journalState != null) 'journalState': journalState,
+      if (cumulativeCounters != null) 'cumulativeCounters': cumulativeCounters,
+      if (prewarmTunnelNames != null) 'prewarmTunnelNames': prewarmTunnelNames,
+      if (bundleId != null) 'bundleId': bundleId,
+      if (statisticsHistory != null) 'statisticsHistory': statisticsHistory,
+      if (handshakeStaleThreshold != null) 'handshakeStaleSeconds': handshakeStaleThreshold.inSeconds,
+      if (statusCoalesceWindow != null) 'statusCoalesceMs': statusCoalesceWindow.inMilliseconds,
+      if (endpointRoamingInterval != null) 'endpointRoamingSeconds': endpointRoamingInterval.inSeconds,
+      if (logQueueSize != null) 'logQueueSize': logQueueSize,
+      if (logOverflowPolicy != null) 'logOverflowPolicy': logOverflowPolicy.name,
+      if (maxLogBytes != null) 'maxLogBytes': maxLogBytes,
+      if (maxLogFiles != null) 'maxLogFiles': maxLogFiles,
+      if (dailyLogFiles != null) 'dailyLogFiles': dailyLogFiles,
+      if (logPattern != null) 'logPattern': logPattern,
+      if (keyPoolSize != null) 'keyPoolSize': keyPoolSize,
+      if (removeOrphanAdapters != null) 'removeOrphanAdapters': removeOrphanAdapters,
+      if (hangDeadline != null) 'hangDeadlineMs': hangDeadline.inMilliseconds,
+      if (hangMinidump != null) 'hangMinidump': hangMinidump,
     });
   }
 
   @override
-  Future<Map<String, dynamic>?> setupTunnel({required String bundleId, required String tunnelName, required String cfg}) async {
+  Future<Map<String, dynamic>?> setupTunnel({
+    required String bundleId,
+    required String tunnelName,
+    required String cfg,
+    bool? killSwitch,
+    int? timeoutMs,
+    int? operationId,
+    String? correlationId,
+  }) async {
     final args = {
       'bundleId': bundleId,
       'tunnelName': tunnelName,
       'cfg': cfg,
+      if (killSwitch != null) 'killSwitch': killSwitch,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+      if (operationId != null) 'operationId': operationId,
+      if (correlationId != null) 'correlationId': correlationId,
     };
     final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.setupTunnel.value, args);
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<Map<String, dynamic>?> setupTunnelFromChunks({
+    required String bundleId,
+    required String tunnelName,
+    required Stream<String> cfg,
+    bool? killSwitch,
+  }) async {
+    try {
+      await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.beginTunnelConfiguration.value, {
+        'tunnelName': tunnelName,
+      });
+    } on MissingPluginException {
+      // Platforms without chunked parsing get the whole configuration at once
+      return setupTunnel(bundleId: bundleId, tunnelName: tunnelName, cfg: await cfg.join(), killSwitch: killSwitch);
+    }
+
+    await for (final chunk in cfg) {
+      await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.appendTunnelConfiguration.value, {
+        'tunnelName': tunnelName,
+        'chunk': chunk,
+      });
+    }
+
+    // Without cfg, the native side uses the configuration streamed above
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.setupTunnel.value, {
+      'bundleId': bundleId,
+      'tunnelName': tunnelName,
+      if (killSwitch != null) 'killSwitch': killSwitch,
+    });
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<Map<String, Map<String, dynamic>?>> setupTunnels({
+    required String bundleId,
+    required Map<String, String> tunnels,
+    bool? killSwitch,
+  }) async {
+    final result = await _invokeBulk(WireguardMethodChannelMethod.setupTunnels.value, {
+      'bundleId': bundleId,
+      'tunnels': [
+        for (final tunnel in tunnels.entries)
+          {
+            'tunnelName': tunnel.key,
+            'cfg': tunnel.value,
+            if (killSwitch != null) 'killSwitch': killSwitch,
+          },
+      ],
+    });
+    final results = <String, Map<String, dynamic>?>{};
+    if (result is Map) {
+      for (final entry in result.entries) {
+        if (entry.key is String) {
+          results[entry.key as String] = _stringKeyedMap(entry.value);
+        }
+      }
+    }
+    return results;
+  }
+
+  @override
+  Future<Map<String, dynamic>?> setupAndConnect({
+    required String bundleId,
+    required String tunnelName,
+    required String cfg,
+    bool? killSwitch,
+    int? timeoutMs,
+    int? operationId,
+    String? correlationId,
+    bool? precheck,
+    PeerActivation? activation,
+  }) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.setupAndConnect.value, {
+      'bundleId': bundleId,
+      'tunnelName': tunnelName,
+      'cfg': cfg,
+      if (killSwitch != null) 'killSwitch': killSwitch,
+      if (timeoutMs != null) 'timeoutMs': timeoutMs,
+      if (operationId != null) 'operationId': operationId,
+      if (correlationId != null) 'correlationId': correlationId,
+      if (precheck != null) 'precheck': precheck,
+      if (activation != null) 'activation': activation.toJson(),
+    });
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<bool> cancelOperation({required int operationId}) async {
+    final result = await methodChannel.invokeMethod<bool>(WireguardMethodChannelMethod.cancelOperation.value, {
+      'operationId': operationId,
+    });
+    return result ?? false;
+  }
+
+  @override
+  Future<Map<String, dynamic>?> setupTunnelStructured({
+    required String bundleId,
+    required String tunnelName,
+    required TunnelConfig config,
+    bool? killSwitch,
+  }) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.setupTunnelStructured.value, {
+      'bundleId': bundleId,
+      'tunnelName': tunnelName,
+      'config': config.toMap(),
+      if (killSwitch != null) 'killSwitch': killSwitch,
+    });
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<Map<String, dynamic>?> setupTunnelFromFile({
+    required String bundleId,
+    required String tunnelName,
+    required String path,
+    bool? killSwitch,
+  }) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.setupTunnelFromFile.value, {
+      'bundleId': bundleId,
+      'tunnelName': tunnelName,
+      'path': path,
+      if (killSwitch != null) 'killSwitch': killSwitch,
+    });
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<Map<String, dynamic>?> updateTunnel({
+    required String tunnelName,
+    required String cfg,
+    bool? killSwitch,
+  }) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.updateTunnel.value, {
+      'tunnelName': tunnelName,
+      'cfg': cfg,
+      if (killSwitch != null) 'killSwitch': killSwitch,
+    });
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<int> compileConfig({required String cfg}) async {
+    final result = await methodChannel.invokeMethod<int>(WireguardMethodChannelMethod.compileConfig.value, {
+      'cfg': cfg,
+    });
+    return result as int;
+  }
+
+  @override
+  Future<ConfigValidation> validateConfig({required String cfg}) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.validateConfig.value, {
+      'cfg': cfg,
+    });
+    return ConfigValidation.fromJson(Map<String, dynamic>.from(result as Map));
+  }
+
+  @override
+  Future<void> releaseConfig({required int configHandle}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.releaseConfig.value, {
+      'configHandle': configHandle,
+    });
+  }
+
+  @override
+  Future<Map<String, dynamic>?> setupTunnelCompiled({
+    required String bundleId,
+    required String tunnelName,
+    required int configHandle,
+    bool? killSwitch,
+    String? privateKey,
+    List<String>? addresses,
+    int? listenPort,
+  }) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.setupTunnelCompiled.value, {
+      'bundleId': bundleId,
+      'tunnelName': tunnelName,
+      'configHandle': configHandle,
+      if (killSwitch != null) 'killSwitch': killSwitch,
+      if (privateKey != null) 'privateKey': privateKey,
+      if (addresses != null) 'addresses': addresses,
+      if (listenPort != null) 'listenPort': listenPort,
+    });
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<Map<String, dynamic>?> updateTunnelCompiled({
+    required String tunnelName,
+    required int configHandle,
+    bool? killSwitch,
+    String? privateKey,
+    List<String>? addresses,
+    int? listenPort,
+  }) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.updateTunnelCompiled.value, {
+      'tunnelName': tunnelName,
+      'configHandle': configHandle,
+      if (killSwitch != null) 'killSwitch': killSwitch,
+      if (privateKey != null) 'privateKey': privateKey,
+      if (addresses != null) 'addresses': addresses,
+      if (listenPort != null) 'listenPort': listenPort,
+    });
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<void> addPeers({required String tunnelName, required List<TunnelPeerConfig> peers}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.addPeers.value, {
+      'tunnelName': tunnelName,
+      'peers': [for (final peer in peers) peer.toMap()],
+    });
+  }
+
+  @override
+  Future<void> removePeers({required String tunnelName, required List<Uint8List> publicKeys}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.removePeers.value, {
+      'tunnelName': tunnelName,
+      'publicKeys': publicKeys,
+    });
+  }
+
+  @override
+  Future<void> watchConfigFile({required String tunnelName, String? path}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.watchConfigFile.value, {
+      'tunnelName': tunnelName,
+      if (path != null) 'path': path,
+    });
+  }
+
+  Map<String, dynamic>? _stringKeyedMap(dynamic result) {
     if (result == null) {
       return null;
     }
@@ -73,17 +543,124 @@ class MethodChannelWireguardDart extends WireguardDartPlatform {
   }
 
   @override
-  Future<void> connect({required String tunnelName}) async {
-    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.connect.value, {'tunnelName': tunnelName});
+  Future<void> connect({
+    required String tunnelName,
+    bool? warmUp,
+    String? correlationId,
+    List<String>? prefetchHosts,
+    bool? precheck,
+    PeerActivation? activation,
+  }) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.connect.value, {
+      'tunnelName': tunnelName,
+      if (warmUp != null) 'warmUp': warmUp,
+      if (correlationId != null) 'correlationId': correlationId,
+      if (prefetchHosts != null) 'prefetchHosts': prefetchHosts,
+      if (precheck != null) 'precheck': precheck,
+      if (activation != null) 'activation': activation.toJson(),
+    });
   }
 
   @override
-  Future<void> disconnect({required String tunnelName}) async {
+  Future<void> disconnect({required String tunnelName, String? correlationId}) async {
     await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.disconnect.value, {
       'tunnelName': tunnelName,
+      if (correlationId != null) 'correlationId': correlationId,
     });
   }
 
+  @override
+  Future<TunnelGroupResult> connectTunnels({required List<String> tunnelNames, bool? warmUp}) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.connectTunnels.value, {
+      'tunnelNames': tunnelNames,
+      if (warmUp != null) 'warmUp': warmUp,
+    });
+    return TunnelGroupResult.fromJson(Map<String, dynamic>.from(result as Map));
+  }
+
+  @override
+  Future<TunnelGroupResult> disconnectTunnels({required List<String> tunnelNames}) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.disconnectTunnels.value, {
+      'tunnelNames': tunnelNames,
+    });
+    return TunnelGroupResult.fromJson(Map<String, dynamic>.from(result as Map));
+  }
+
+  @override
+  Future<void> installTunnelService({required String tunnelName, required String cfg}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.installTunnelService.value, {
+      'tunnelName': tunnelName,
+      'cfg': cfg,
+    });
+  }
+
+  @override
+  Future<void> removeTunnelService({required String tunnelName}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.removeTunnelService.value, {
+      'tunnelName': tunnelName,
+    });
+  }
+
+  @override
+  Future<void> setSplitTunnel({required String tunnelName, required SplitTunnelMode mode, List<String>? apps}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.setSplitTunnel.value, {
+      'tunnelName': tunnelName,
+      'mode': mode.name,
+      if (apps != null) 'apps': apps,
+    });
+  }
+
+  @override
+  Future<void> setAdapterLogging({required String tunnelName, required AdapterLogMode mode}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.setAdapterLogging.value, {
+      'tunnelName': tunnelName,
+      'mode': mode.name,
+    });
+  }
+
+  @override
+  Future<List<String>> getAdapterLog({required String tunnelName, int? maxLines}) async {
+    final result = await methodChannel.invokeMethod<List<dynamic>>(WireguardMethodChannelMethod.getAdapterLog.value, {
+      'tunnelName': tunnelName,
+      if (maxLines != null) 'maxLines': maxLines,
+    });
+    return result?.cast<String>() ?? <String>[];
+  }
+
+  @override
+  Future<void> setFailoverGroup({required String primaryTunnel, required String standbyTunnel}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.setFailoverGroup.value, {
+      'primaryTunnel': primaryTunnel,
+      'standbyTunnel': standbyTunnel,
+    });
+  }
+
+  @override
+  Future<bool> removeFailoverGroup({required String tunnelName}) async {
+    final result = await methodChannel.invokeMethod<bool>(WireguardMethodChannelMethod.removeFailoverGroup.value, {
+      'tunnelName': tunnelName,
+    });
+    return result ?? false;
+  }
+
+  @override
+  Future<ThroughputResult> runThroughputTest({
+    required String tunnelName,
+    required String target,
+    required Duration duration,
+    ThroughputProtocol? protocol,
+    int? streams,
+  }) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.runThroughputTest.value, {
+      'tunnelName': tunnelName,
+      'target': target,
+      'durationMs': duration.inMilliseconds,
+      if (protocol != null) 'protocol': protocol.name,
+      if (streams != null) 'streams': streams,
+    });
+    return ThroughputResult.fromJson(Map<String, dynamic>.from(result as Map));
+  }
+
   @override
   Future<ConnectionStatus> status() async {
     final result = await methodChannel.invokeMethod<String>(WireguardMethodChannelMethod.status.value);
@@ -91,23 +668,75 @@ class MethodChannelWireguardDart extends WireguardDartPlatform {
   }
 
   @override
-  Stream<AdapterStatus> statusStream() {
-    return statusChannel.receiveBroadcastStream().distinct().where((val) {
-      // Only process events that are Maps with both luid and status
-      if (val is! Map) return false;
+  Future<Map<String, TunnelStatus>> statusAll() async {
+    final result = await methodChannel.invokeMapMethod<String, dynamic>(WireguardMethodChannelMethod.statusAll.value);
+    return (result ?? {}).map((name, value) => MapEntry(name, TunnelStatus.fromMap(value as Map)));
+  }
 
-      final luidValue = val['luid'];
-      final statusValue = val['status'];
+  @override
+  Stream<AdapterStatus> statusStream({
+    bool batched = false,
+    List<String>? tunnelNames,
+    List<int>? luids,
+    Set<AdapterEventType>? events,
+  }) {
+    if (!kIsWeb && defaultTargetPlatform == TargetPlatform.windows) {
+      return _statusRouter.subscribe({
+        if (luids != null) 'luids': luids,
+        if (tunnelNames != null) 'tunnelNames': tunnelNames,
+        if (events != null) 'events': [for (final type in events) type.value],
+      });
+    }
+    // Windows and Linux only send transitions, each event is new; batched, a list of them at a time
+    return statusChannel
+        .receiveBroadcastStream(batched ? {'batched': true} : null)
+        .expand((val) => val is List ? val : [val])
+        .where((val) =>
+            val is Map &&
+            (luids == null || luids.contains(val['luid'])) &&
+            (events == null || events.contains(AdapterEventType.fromEvent(val['event'] as String?))))
+        .map(_adapterStatus)
+        .whereType<AdapterStatus>();
+  }
 
-      return luidValue is int && statusValue is String;
-    }).map((val) {
-      final Map event = val as Map;
-      final int luid = event['luid'] as int;
-      final String statusString = event['status'] as String;
-      final ConnectionStatus status = ConnectionStatus.fromString(statusString);
+  // Every status stream on Windows shares one routed listen, see _StatusRouter
+  late final _statusRouter = _StatusRouter(this);
 
-      return AdapterStatus(luid, status);
-    });
+  // Null for events that are not Maps with both luid and status
+  static AdapterStatus? _adapterStatus(dynamic val) {
+    if (val is! Map || val['luid'] is! int || val['status'] is! String) return null;
+    final Map event = val;
+    final int luid = event['luid'] as int;
+    final String statusString = event['status'] as String;
+    final ConnectionStatus status = ConnectionStatus.fromString(statusString);
+    final timestamp = event['timestamp'];
+    final DateTime? readyAt =
+        event['event'] == 'ready' && timestamp is int ? DateTime.fromMicrosecondsSinceEpoch(timestamp) : null;
+
+    final publicKey = event['publicKey'];
+    final bool isLiveness = (event['event'] == 'stale' || event['event'] == 'recovered') && publicKey is String;
+    final endpoint = event['endpoint'];
+    final bool isRoam = event['event'] == 'roamed' && publicKey is String && endpoint is String;
+
+    final prefix = event['prefix'];
+    final networkChange = prefix is String ? AdapterNetworkChange.fromString(event['event'] as String?) : null;
+
+    final activatedPeers = event['activatedPeers'];
+    final totalPeers = event['totalPeers'];
+    final bool isActivation = event['event'] == 'activation' && activatedPeers is int && totalPeers is int;
+
+    return AdapterStatus(luid, status,
+        readyAt: readyAt,
+        peerPublicKey: isLiveness || isRoam ? publicKey : null,
+        peerStale: isLiveness && event['event'] == 'stale',
+        networkChange: networkChange,
+        networkPrefix: networkChange != null ? prefix : null,
+        previousEndpoint: isRoam ? event['previousEndpoint'] as String? : null,
+        endpoint: isRoam ? endpoint : null,
+        activatedPeers: isActivation ? activatedPeers : null,
+        totalPeers: isActivation ? totalPeers : null,
+        monotonicUs: event['monotonicUs'] as int?,
+        correlationId: event['correlationId'] as String?);
   }
 
   @override
@@ -122,6 +751,35 @@ class MethodChannelWireguardDart extends WireguardDartPlatform {
     return result as bool;
   }
 
+  @override
+  Future<ConfigurationDrift> verifyTunnelConfiguration({required String tunnelName}) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.verifyTunnelConfiguration.value, {
+      'tunnelName': tunnelName,
+    });
+    return ConfigurationDrift.fromJson(Map<String, dynamic>.from(result as Map));
+  }
+
+  @override
+  Future<String> exportTunnelConfiguration({required String tunnelName, bool redactKeys = true}) async {
+    final result = await methodChannel.invokeMethod<String>(WireguardMethodChannelMethod.exportTunnelConfiguration.value, {
+      'tunnelName': tunnelName,
+      'format': 'ini',
+      'redactKeys': redactKeys,
+    });
+    return result ?? '';
+  }
+
+  @override
+  Future<TunnelConfig> exportTunnelConfigurationStructured({required String tunnelName, bool redactKeys = true}) async {
+    final result = await methodChannel.invokeMethod<Map<Object?, Object?>>(
+        WireguardMethodChannelMethod.exportTunnelConfiguration.value, {
+      'tunnelName': tunnelName,
+      'format': 'structured',
+      'redactKeys': redactKeys,
+    });
+    return TunnelConfig.fromMap(result ?? const {});
+  }
+
   @override
   Future<void> removeTunnelConfiguration({required String bundleId, required String tunnelName}) async {
     await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.removeTunnelConfiguration.value, {
@@ -140,4 +798,265 @@ class MethodChannelWireguardDart extends WireguardDartPlatform {
       throw Exception(e);
     }
   }
+
+  @override
+  Stream<Map<String, TunnelStatistics>> statisticsStream({
+    Duration interval = const Duration(seconds: 1),
+    bool interfaceCounters = false,
+    bool processTraffic = false,
+  }) {
+    return statisticsChannel.receiveBroadcastStream({
+      'intervalMs': interval.inMilliseconds,
+      'interfaceCounters': interfaceCounters,
+      'processTraffic': processTraffic,
+    }).map((val) {
+      final stats = <String, TunnelStatistics>{};
+      if (val is Map) {
+        for (final entry in val.entries) {
+          final tunnel = _stringKeyedMap(entry.value);
+          if (entry.key is String && tunnel != null) {
+            stats[entry.key as String] = TunnelStatistics.fromJson(tunnel);
+          }
+        }
+      }
+      return stats;
+    }).where((stats) => stats.isNotEmpty);
+  }
+
+  @override
+  Future<Map<String, PeerStatistics>> getPeerStatistics({String? tunnelName}) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.peerStatistics.value, {
+      if (tunnelName != null) 'tunnelName': tunnelName,
+    });
+    final peers = <String, PeerStatistics>{};
+    if (result is Map) {
+      for (final entry in result.entries) {
+        final peer = _stringKeyedMap(entry.value);
+        if (entry.key is String && peer != null) {
+          peers[entry.key as String] = PeerStatistics.fromJson(peer);
+        }
+      }
+    }
+    return peers;
+  }
+
+  @override
+  Future<PeerStatisticsView> getPeerStatisticsView({String? tunnelName}) async {
+    final result = await methodChannel.invokeMethod<Uint8List>(WireguardMethodChannelMethod.peerStatisticsBinary.value, {
+      if (tunnelName != null) 'tunnelName': tunnelName,
+    });
+    return PeerStatisticsView(result ?? Uint8List(0));
+  }
+
+  @override
+  Future<StatisticsHistoryView> getStatisticsHistory({
+    required String tunnelName,
+    required Duration window,
+    String? publicKey,
+  }) async {
+    final result = await _invokeBulk<Uint8List>(WireguardMethodChannelMethod.getStatisticsHistory.value, {
+      'tunnelName': tunnelName,
+      'windowMs': window.inMilliseconds,
+      if (publicKey != null) 'publicKey': publicKey,
+    });
+    return StatisticsHistoryView(result ?? Uint8List(0));
+  }
+
+  @override
+  Future<CounterSnapshot> getCounterSnapshot({String? tunnelName}) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.counterSnapshot.value, {
+      if (tunnelName != null) 'tunnelName': tunnelName,
+    });
+    return CounterSnapshot.fromJson(Map<String, dynamic>.from(result as Map));
+  }
+
+  @override
+  Future<Map<String, CumulativeStatistics>> getCumulativeStatistics({List<String>? tunnelNames, bool? reset}) async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.getCumulativeStatistics.value, {
+      if (tunnelNames != null) 'tunnelNames': tunnelNames,
+      if (reset != null) 'reset': reset,
+    });
+    return (result as Map? ?? const {}).map((name, tunnel) =>
+        MapEntry(name as String, CumulativeStatistics.fromJson(Map<String, dynamic>.from(tunnel as Map))));
+  }
+
+  @override
+  Future<List<ResolvedPeer?>> resolvePeerForAddresses(List<String> addresses) async {
+    final result = await methodChannel.invokeMethod<List<Object?>>(
+        WireguardMethodChannelMethod.resolvePeerForAddresses.value, {'addresses': addresses});
+    return (result ?? [])
+        .map((peer) => peer == null ? null : ResolvedPeer.fromJson(Map<String, dynamic>.from(peer as Map)))
+        .toList();
+  }
+
+  @override
+  Future<void> startStatsRecording({required String path}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.startStatsRecording.value, {
+      'path': path,
+    });
+  }
+
+  @override
+  Future<Map<String, dynamic>?> stopStatsRecording() async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.stopStatsRecording.value);
+    return _stringKeyedMap(result);
+  }
+
+  @override
+  Future<String> getMetrics() async {
+    final result = await _invokeBulk<String>(WireguardMethodChannelMethod.getMetrics.value);
+    return result ?? '';
+  }
+
+  @override
+  Future<void> setLogLevel(LogLevel level) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.setLogLevel.value, {'level': level.name});
+  }
+
+  @override
+  Future<List<String>> getRecentLogs({int? maxLines, LogLevel? minLevel}) async {
+    final result = await _invokeBulk<List<dynamic>>(WireguardMethodChannelMethod.getRecentLogs.value, {
+      if (maxLines != null) 'maxLines': maxLines,
+      if (minLevel != null) 'minLevel': minLevel.name,
+    });
+    return result?.cast<String>() ?? <String>[];
+  }
+
+  @override
+  Stream<LogRecord> logStream({int? maxRecordsPerSecond, LogLevel? minLevel}) {
+    // Windows sends the records of each drain of its queue as one list
+    return logsChannel
+        .receiveBroadcastStream({
+          if (maxRecordsPerSecond != null) 'maxRecordsPerSecond': maxRecordsPerSecond,
+          if (minLevel != null) 'minLevel': minLevel.name,
+        })
+        .expand((val) => val is List ? val : [val])
+        .map(_stringKeyedMap)
+        .where((record) => record != null)
+        .map((record) => LogRecord.fromJson(record!));
+  }
+
+  @override
+  Future<Map<String, PhaseStats>> getPerfStats() async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.getPerfStats.value);
+    final stats = <String, PhaseStats>{};
+    if (result is Map) {
+      for (final entry in result.entries) {
+        final phase = _stringKeyedMap(entry.value);
+        if (entry.key is String && phase != null) {
+          stats[entry.key as String] = PhaseStats.fromJson(phase);
+        }
+      }
+    }
+    return stats;
+  }
+
+  @override
+  Future<List<StartupTraceEntry>> getStartupTrace() async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.getStartupTrace.value);
+    return (result as List? ?? const [])
+        .map(_stringKeyedMap)
+        .where((entry) => entry != null)
+        .map((entry) => StartupTraceEntry.fromJson(entry!))
+        .toList();
+  }
+
+  @override
+  Future<void> startTelemetryExport({
+    required String host,
+    required int port,
+    Duration? interval,
+    int? maxDatagramsPerInterval,
+    LogLevel? minLevel,
+  }) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.startTelemetryExport.value, {
+      'host': host,
+      'port': port,
+      if (interval != null) 'intervalMs': interval.inMilliseconds,
+      if (maxDatagramsPerInterval != null) 'maxDatagrams': maxDatagramsPerInterval,
+      if (minLevel != null) 'minLevel': minLevel.name,
+    });
+  }
+
+  @override
+  Future<void> stopTelemetryExport() async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.stopTelemetryExport.value);
+  }
+
+  @override
+  Future<MemoryStats> getMemoryStats() async {
+    final result = await methodChannel.invokeMethod(WireguardMethodChannelMethod.getMemoryStats.value);
+    return MemoryStats.fromJson(Map<String, dynamic>.from(result as Map));
+  }
+
+  @override
+  Future<void> setLowMemoryMode({required bool enabled}) async {
+    await methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.setLowMemoryMode.value, {'enabled': enabled});
+  }
+}
+
+/// Shares one listen of the Windows status channel between every status stream. Each stream's filter is a
+/// subscription of the plugin's, which sends an event once with the ids of the subscriptions it matched and not
+/// at all when it matched none, so that a dashboard of many tunnels does not get every tunnel's events once per
+/// widget. An event channel has one listener per engine, so separate listens would also replace each other.
+class _StatusRouter {
+  _StatusRouter(this._plugin);
+
+  final MethodChannelWireguardDart _plugin;
+  // Every engine's listener gets the events of all subscriptions, so ids are salted to not match another's
+  final int _salt = Random().nextInt(1 << 30) << 20;
+  int _nextId = 0;
+  final _subscriptions = <int, StreamController<AdapterStatus>>{};
+  StreamSubscription<dynamic>? _listen;
+
+  Stream<AdapterStatus> subscribe(Map<String, Object> filter) {
+    int? id;
+    late final StreamController<AdapterStatus> controller;
+    controller = StreamController<AdapterStatus>.broadcast(
+      onListen: () {
+        final subscription = id = _salt + _nextId++;
+        _subscriptions[subscription] = controller;
+        // Listening comes first on the platform thread, and clears the subscriptions of an earlier listen
+        _listen ??= _plugin.statusChannel
+            .receiveBroadcastStream({'batched': true, 'routed': true}).listen(_dispatch, onError: _error);
+        _plugin.methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.subscribeStatus.value, {
+          'subscription': subscription,
+          ...filter,
+        }).catchError((Object error, StackTrace stackTrace) {
+          if (_subscriptions[subscription] == controller) controller.addError(error, stackTrace);
+        });
+      },
+      onCancel: () async {
+        final subscription = id;
+        if (subscription == null || _subscriptions.remove(subscription) == null) return;
+        if (_subscriptions.isEmpty) {
+          final listen = _listen;
+          _listen = null;
+          await listen?.cancel();
+          return;
+        }
+        await _plugin.methodChannel.invokeMethod<void>(WireguardMethodChannelMethod.unsubscribeStatus.value, {
+          'subscription': subscription,
+        });
+      },
+    );
+    return controller.stream;
+  }
+
+  void _dispatch(dynamic batch) {
+    for (final event in batch is List ? batch : [batch]) {
+      final ids = event is Map ? event['subscriptions'] : null;
+      final status = ids is List ? MethodChannelWireguardDart._adapterStatus(event) : null;
+      if (status == null) continue;
+      for (final id in ids as List) {
+        _subscriptions[id]?.add(status);
+      }
+    }
+  }
+
+  void _error(Object error, StackTrace stackTrace) {
+    for (final controller in _subscriptions.values) {
+      controller.addError(error, stackTrace);
+    }
+  }
 }
@@ -1,8 +1,32 @@
+import 'dart:typed_data';
+
 import 'package:plugin_platform_interface/plugin_platform_interface.dart';
+import 'package:wireguard_dart/adapter_event_type.dart';
+import 'package:wireguard_dart/config_validation.dart';
+import 'package:wireguard_dart/configuration_drift.dart';
+import 'package:wireguard_dart/counter_snapshot.dart';
+import 'package:wireguard_dart/cumulative_statistics.dart';
+import 'package:wireguard_dart/memory_stats.dart';
+import 'package:wireguard_dart/peer_activation.dart';
+import 'package:wireguard_dart/peer_statistics.dart';
+import 'package:wireguard_dart/peer_statistics_view.dart';
+import 'package:wireguard_dart/phase_stats.dart';
+import 'package:wireguard_dart/resolved_peer.dart';
+import 'package:wireguard_dart/startup_trace_entry.dart';
+import 'package:wireguard_dart/statistics_history_view.dart';
+import 'package:wireguard_dart/throughput_result.dart';
+import 'package:wireguard_dart/tunnel_config.dart';
+import 'package:wireguard_dart/tunnel_group_result.dart';
 import 'package:wireguard_dart/tunnel_statistics.dart';
+import 'package:wireguard_dart/tunnel_status.dart';
 
 import 'connection_status.dart';
 import 'key_pair.dart';
+import 'log_level.dart';
+import 'log_record.dart';
+import 'log_overflow_policy.dart';
+import 'split_tunnel_mode.dart';
+import 'adapter_log_mode.dart';
 import 'adapter_status.dart';
 import 'wireguard_dart_method_channel.dart';
 
@@ -31,7 +55,60 @@ abstract class WireguardDartPlatform extends PlatformInterface {
     throw UnimplementedError('generateKeyPair() has not been implemented');
   }
 
-  Future<void> nativeInit({String? logFilePath}) {
+  Future<Uint8List> generateKeyPairBinary() {
+    throw UnimplementedError('generateKeyPairBinary() has not been implemented');
+  }
+
+  Future<List<KeyPair>> generateKeyPairs(int count) {
+    throw UnimplementedError('generateKeyPairs() has not been implemented');
+  }
+
+  Future<Uint8List> generateKeyPairsBinary(int count) {
+    throw UnimplementedError('generateKeyPairsBinary() has not been implemented');
+  }
+
+  Future<List<String>> generatePresharedKeys(int count) {
+    throw UnimplementedError('generatePresharedKeys() has not been implemented');
+  }
+
+  Future<Uint8List> generatePresharedKeysBinary(int count) {
+    throw UnimplementedError('generatePresharedKeysBinary() has not been implemented');
+  }
+
+  Future<String> derivePublicKey(String privateKey) {
+    throw UnimplementedError('derivePublicKey() has not been implemented');
+  }
+
+  Future<Uint8List> derivePublicKeyBinary(Uint8List privateKey) {
+    throw UnimplementedError('derivePublicKeyBinary() has not been implemented');
+  }
+
+  Future<List<String>> derivePublicKeys(List<String> privateKeys) {
+    throw UnimplementedError('derivePublicKeys() has not been implemented');
+  }
+
+  Future<void> nativeInit({
+    String? logFilePath,
+    bool? cacheConfigurations,
+    bool? journalState,
+    bool? cumulativeCounters,
+    List<String>? prewarmTunnelNames,
+    String? bundleId,
+    bool? statisticsHistory,
+    Duration? handshakeStaleThreshold,
+    Duration? statusCoalesceWindow,
+    Duration? endpointRoamingInterval,
+    int? logQueueSize,
+    LogOverflowPolicy? logOverflowPolicy,
+    int? maxLogBytes,
+    int? maxLogFiles,
+    bool? dailyLogFiles,
+    String? logPattern,
+    int? keyPoolSize,
+    bool? removeOrphanAdapters,
+    Duration? hangDeadline,
+    bool? hangMinidump,
+  }) {
     throw UnimplementedError('nativeInit() has not been implemented');
   }
 
@@ -39,23 +116,197 @@ abstract class WireguardDartPlatform extends PlatformInterface {
     required String bundleId,
     required String tunnelName,
     required String cfg,
+    bool? killSwitch,
+    int? timeoutMs,
+    int? operationId,
+    String? correlationId,
   }) {
     throw UnimplementedError('setupTunnel() has not been implemented');
   }
 
-  Future<void> connect({required String tunnelName}) {
+  Future<Map<String, dynamic>?> setupTunnelFromChunks({
+    required String bundleId,
+    required String tunnelName,
+    required Stream<String> cfg,
+    bool? killSwitch,
+  }) {
+    throw UnimplementedError('setupTunnelFromChunks() has not been implemented');
+  }
+
+  Future<Map<String, Map<String, dynamic>?>> setupTunnels({
+    required String bundleId,
+    required Map<String, String> tunnels,
+    bool? killSwitch,
+  }) {
+    throw UnimplementedError('setupTunnels() has not been implemented');
+  }
+
+  Future<Map<String, dynamic>?> setupAndConnect({
+    required String bundleId,
+    required String tunnelName,
+    required String cfg,
+    bool? killSwitch,
+    int? timeoutMs,
+    int? operationId,
+    String? correlationId,
+    bool? precheck,
+    PeerActivation? activation,
+  }) {
+    throw UnimplementedError('setupAndConnect() has not been implemented');
+  }
+
+  Future<bool> cancelOperation({required int operationId}) {
+    throw UnimplementedError('cancelOperation() has not been implemented');
+  }
+
+  Future<Map<String, dynamic>?> setupTunnelStructured({
+    required String bundleId,
+    required String tunnelName,
+    required TunnelConfig config,
+    bool? killSwitch,
+  }) {
+    throw UnimplementedError('setupTunnelStructured() has not been implemented');
+  }
+
+  Future<Map<String, dynamic>?> setupTunnelFromFile({
+    required String bundleId,
+    required String tunnelName,
+    required String path,
+    bool? killSwitch,
+  }) {
+    throw UnimplementedError('setupTunnelFromFile() has not been implemented');
+  }
+
+  Future<Map<String, dynamic>?> updateTunnel({
+    required String tunnelName,
+    required String cfg,
+    bool? killSwitch,
+  }) {
+    throw UnimplementedError('updateTunnel() has not been implemented');
+  }
+
+  Future<int> compileConfig({required String cfg}) {
+    throw UnimplementedError('compileConfig() has not been implemented');
+  }
+
+  Future<ConfigValidation> validateConfig({required String cfg}) {
+    throw UnimplementedError('validateConfig() has not been implemented');
+  }
+
+  Future<void> releaseConfig({required int configHandle}) {
+    throw UnimplementedError('releaseConfig() has not been implemented');
+  }
+
+  Future<Map<String, dynamic>?> setupTunnelCompiled({
+    required String bundleId,
+    required String tunnelName,
+    required int configHandle,
+    bool? killSwitch,
+    String? privateKey,
+    List<String>? addresses,
+    int? listenPort,
+  }) {
+    throw UnimplementedError('setupTunnelCompiled() has not been implemented');
+  }
+
+  Future<Map<String, dynamic>?> updateTunnelCompiled({
+    required String tunnelName,
+    required int configHandle,
+    bool? killSwitch,
+    String? privateKey,
+    List<String>? addresses,
+    int? listenPort,
+  }) {
+    throw UnimplementedError('updateTunnelCompiled() has not been implemented');
+  }
+
+  Future<void> addPeers({required String tunnelName, required List<TunnelPeerConfig> peers}) {
+    throw UnimplementedError('addPeers() has not been implemented');
+  }
+
+  Future<void> removePeers({required String tunnelName, required List<Uint8List> publicKeys}) {
+    throw UnimplementedError('removePeers() has not been implemented');
+  }
+
+  Future<void> watchConfigFile({required String tunnelName, String? path}) {
+    throw UnimplementedError('watchConfigFile() has not been implemented');
+  }
+
+  Future<void> connect({
+    required String tunnelName,
+    bool? warmUp,
+    String? correlationId,
+    List<String>? prefetchHosts,
+    bool? precheck,
+    PeerActivation? activation,
+  }) {
     throw UnimplementedError('connect() has not been implemented');
   }
 
-  Future<void> disconnect({required String tunnelName}) {
+  Future<void> disconnect({required String tunnelName, String? correlationId}) {
     throw UnimplementedError('disconnect() has not been implemented');
   }
 
+  Future<TunnelGroupResult> connectTunnels({required List<String> tunnelNames, bool? warmUp}) {
+    throw UnimplementedError('connectTunnels() has not been implemented');
+  }
+
+  Future<TunnelGroupResult> disconnectTunnels({required List<String> tunnelNames}) {
+    throw UnimplementedError('disconnectTunnels() has not been implemented');
+  }
+
+  Future<void> installTunnelService({required String tunnelName, required String cfg}) {
+    throw UnimplementedError('installTunnelService() has not been implemented');
+  }
+
+  Future<void> removeTunnelService({required String tunnelName}) {
+    throw UnimplementedError('removeTunnelService() has not been implemented');
+  }
+
+  Future<void> setSplitTunnel({required String tunnelName, required SplitTunnelMode mode, List<String>? apps}) {
+    throw UnimplementedError('setSplitTunnel() has not been implemented');
+  }
+
+  Future<void> setAdapterLogging({required String tunnelName, required AdapterLogMode mode}) {
+    throw UnimplementedError('setAdapterLogging() has not been implemented');
+  }
+
+  Future<List<String>> getAdapterLog({required String tunnelName, int? maxLines}) {
+    throw UnimplementedError('getAdapterLog() has not been implemented');
+  }
+
+  Future<void> setFailoverGroup({required String primaryTunnel, required String standbyTunnel}) {
+    throw UnimplementedError('setFailoverGroup() has not been implemented');
+  }
+
+  Future<bool> removeFailoverGroup({required String tunnelName}) {
+    throw UnimplementedError('removeFailoverGroup() has not been implemented');
+  }
+
+  Future<ThroughputResult> runThroughputTest({
+    required String tunnelName,
+    required String target,
+    required Duration duration,
+    ThroughputProtocol? protocol,
+    int? streams,
+  }) {
+    throw UnimplementedError('runThroughputTest() has not been implemented');
+  }
+
   Future<ConnectionStatus> status() {
     throw UnimplementedError('status() has not been implemented');
   }
 
-  Stream<AdapterStatus> statusStream() {
+  Future<Map<String, TunnelStatus>> statusAll() {
+    throw UnimplementedError('statusAll() has not been implemented');
+  }
+
+  Stream<AdapterStatus> statusStream({
+    bool batched = false,
+    List<String>? tunnelNames,
+    List<int>? luids,
+    Set<AdapterEventType>? events,
+  }) {
     throw UnimplementedError('statusStream() has not been implemented');
   }
 
@@ -66,6 +317,18 @@ abstract class WireguardDartPlatform extends PlatformInterface {
     throw UnimplementedError('checkTunnelConfiguration() has not been implemented');
   }
 
+  Future<ConfigurationDrift> verifyTunnelConfiguration({required String tunnelName}) {
+    throw UnimplementedError('verifyTunnelConfiguration() has not been implemented');
+  }
+
+  Future<String> exportTunnelConfiguration({required String tunnelName, bool redactKeys = true}) {
+    throw UnimplementedError('exportTunnelConfiguration() has not been implemented');
+  }
+
+  Future<TunnelConfig> exportTunnelConfigurationStructured({required String tunnelName, bool redactKeys = true}) {
+    throw UnimplementedError('exportTunnelConfigurationStructured() has not been implemented');
+  }
+
   Future<void> removeTunnelConfiguration({required String bundleId, required String tunnelName}) {
     throw UnimplementedError('removeTunnelConfiguration() has not been implemented');
   }
@@ -73,4 +336,94 @@ abstract class WireguardDartPlatform extends PlatformInterface {
   Future<TunnelStatistics?> getTunnelStatistics() {
     throw UnimplementedError('getTunnelStatistics() has not been implemented');
   }
+
+  Stream<Map<String, TunnelStatistics>> statisticsStream({
+    Duration interval = const Duration(seconds: 1),
+    bool interfaceCounters = false,
+    bool processTraffic = false,
+  }) {
+    throw UnimplementedError('statisticsStream() has not been implemented');
+  }
+
+  Future<Map<String, PeerStatistics>> getPeerStatistics({String? tunnelName}) {
+    throw UnimplementedError('getPeerStatistics() has not been implemented');
+  }
+
+  Future<PeerStatisticsView> getPeerStatisticsView({String? tunnelName}) {
+    throw UnimplementedError('getPeerStatisticsView() has not been implemented');
+  }
+
+  Future<StatisticsHistoryView> getStatisticsHistory({
+    required String tunnelName,
+    required Duration window,
+    String? publicKey,
+  }) {
+    throw UnimplementedError('getStatisticsHistory() has not been implemented');
+  }
+
+  Future<CounterSnapshot> getCounterSnapshot({String? tunnelName}) {
+    throw UnimplementedError('getCounterSnapshot() has not been implemented');
+  }
+
+  Future<Map<String, CumulativeStatistics>> getCumulativeStatistics({List<String>? tunnelNames, bool? reset}) {
+    throw UnimplementedError('getCumulativeStatistics() has not been implemented');
+  }
+
+  Future<List<ResolvedPeer?>> resolvePeerForAddresses(List<String> addresses) {
+    throw UnimplementedError('resolvePeerForAddresses() has not been implemented');
+  }
+
+  Future<void> startStatsRecording({required String path}) {
+    throw UnimplementedError('startStatsRecording() has not been implemented');
+  }
+
+  Future<Map<String, dynamic>?> stopStatsRecording() {
+    throw UnimplementedError('stopStatsRecording() has not been implemented');
+  }
+
+  Future<String> getMetrics() {
+    throw UnimplementedError('getMetrics() has not been implemented');
+  }
+
+  Future<Map<String, PhaseStats>> getPerfStats() {
+    throw UnimplementedError('getPerfStats() has not been implemented');
+  }
+
+  Future<List<StartupTraceEntry>> getStartupTrace() {
+    throw UnimplementedError('getStartupTrace() has not been implemented');
+  }
+
+  Future<void> startTelemetryExport({
+    required String host,
+    required int port,
+    Duration? interval,
+    int? maxDatagramsPerInterval,
+    LogLevel? minLevel,
+  }) {
+    throw UnimplementedError('startTelemetryExport() has not been implemented');
+  }
+
+  Future<void> stopTelemetryExport() {
+    throw UnimplementedError('stopTelemetryExport() has not been implemented');
+  }
+
+  Future<MemoryStats> getMemoryStats() {
+    throw UnimplementedError('getMemoryStats() has not been implemented');
+  }
+
+  Future<void> setLowMemoryMode({required bool enabled}) {
+    throw UnimplementedError('setLowMemoryMode() has not been implemented');
+  }
+
+  Future<void> setLogLevel(LogLevel level) {
+    throw UnimplementedError('setLogLevel() has not been implemented');
+  }
+
+  Future<List<String>> getRecentLogs({int? maxLines, LogLevel? minLevel}) {
+    throw UnimplementedError('getRecentLogs() has not been implemented');
+  }
+
+  Stream<LogRecord> logStream({int? maxRecordsPerSecond, LogLevel? minLevel}) {
+    throw UnimplementedError('logStream() has not been implemented');
+  }
 }
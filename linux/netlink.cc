@@ -0,0 +1,315 @@
+#include "netlink.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <cstring>
+
+namespace wireguard_dart {
+
+namespace {
+
+// Big enough for any single reply the kernel sends on a socket of ours.
+constexpr size_t kReceiveBufferSize = 32 * 1024;
+
+// A batch is sent once it reaches this size, or the number of requests
+// whose acknowledgements fit the socket's receive buffer until they are read.
+constexpr size_t kBatchSize = 64 * 1024;
+constexpr int kSocketReceiveBufferSize = 1024 * 1024;
+// What an acknowledgement takes of the receive buffer: each is a datagram of
+// its own, charged with its whole allocation rather than its 36 bytes
+constexpr size_t kAckBufferCost = 1024;
+// A reply the kernel has not sent by then is not coming
+constexpr int kReplyTimeoutMs = 5000;
+
+}  // namespace
+
+NetlinkMessage::NetlinkMessage(uint16_t type, uint16_t flags)
+    : buffer_(NLMSG_HDRLEN) {
+  nlmsghdr* nlh = header();
+  nlh->nlmsg_len = NLMSG_HDRLEN;
+  nlh->nlmsg_type = type;
+  nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+}
+
+void NetlinkMessage::PutHeader(const void* header, size_t size) {
+  const auto* bytes = static_cast<const uint8_t*>(header);
+  buffer_.insert(buffer_.end(), bytes, bytes + size);
+  Align();
+}
+
+void NetlinkMessage::PutAttr(uint16_t type, const void* data, size_t size) {
+  nlattr attr = {};
+  attr.nla_len = static_cast<uint16_t>(NLA_HDRLEN + size);
+  attr.nla_type = type;
+  const auto* attr_bytes = reinterpret_cast<const uint8_t*>(&attr);
+  buffer_.insert(buffer_.end(), attr_bytes, attr_bytes + sizeof(attr));
+  buffer_.resize(buffer_.size() + NLA_HDRLEN - sizeof(attr));
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  buffer_.insert(buffer_.end(), bytes, bytes + size);
+  Align();
+}
+
+void NetlinkMessage::PutString(uint16_t type, const std::string& value) {
+  PutAttr(type, value.c_str(), value.size() + 1);
+}
+
+size_t NetlinkMessage::BeginNested(uint16_t type) {
+  size_t offset = buffer_.size();
+  PutAttr(type | NLA_F_NESTED, nullptr, 0);
+  return offset;
+}
+
+void NetlinkMessage::EndNested(size_t offset) {
+  auto* attr = reinterpret_cast<nlattr*>(buffer_.data() + offset);
+  attr->nla_len = static_cast<uint16_t>(buffer_.size() - offset);
+}
+
+void NetlinkMessage::Align() {
+  buffer_.resize(NLMSG_ALIGN(buffer_.size()));
+  header()->nlmsg_len = static_cast<uint32_t>(buffer_.size());
+}
+
+void ForEachAttr(const void* data, size_t size, size_t header_size,
+                 const std::function<void(const nlattr* attr)>& visit) {
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  size_t offset = NLA_ALIGN(header_size);
+  while (offset + NLA_HDRLEN <= size) {
+    const auto* attr = reinterpret_cast<const nlattr*>(bytes + offset);
+    if (attr->nla_len < NLA_HDRLEN || offset + attr->nla_len > size) {
+      return;
+    }
+    visit(attr);
+    offset += NLA_ALIGN(attr->nla_len);
+  }
+}
+
+const void* AttrData(const nlattr* attr) {
+  return reinterpret_cast<const uint8_t*>(attr) + NLA_HDRLEN;
+}
+
+size_t AttrSize(const nlattr* attr) { return attr->nla_len - NLA_HDRLEN; }
+
+uint16_t AttrType(const nlattr* attr) { return attr->nla_type & NLA_TYPE_MASK; }
+
+NetlinkSocket::~NetlinkSocket() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+int NetlinkSocket::Open(int protocol) {
+  fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+  if (fd_ < 0) {
+    return -errno;
+  }
+  sockaddr_nl address = {};
+  address.nl_family = AF_NETLINK;
+  if (bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    int error = -errno;
+    close(fd_);
+    fd_ = -1;
+    return error;
+  }
+  // Extended acks carry a message for EINVAL and the like; optional
+  int on = 1;
+  setsockopt(fd_, SOL_NETLINK, NETLINK_EXT_ACK, &on, sizeof(on));
+  // Failed requests are not echoed back whole in their acknowledgement
+  setsockopt(fd_, SOL_NETLINK, NETLINK_CAP_ACK, &on, sizeof(on));
+  // SO_RCVBUF is capped at net.core.rmem_max, about 200 KB by default;
+  // SO_RCVBUFFORCE is not, with the CAP_NET_ADMIN the plugin has anyway
+  if (setsockopt(fd_, SOL_SOCKET, SO_RCVBUFFORCE, &kSocketReceiveBufferSize,
+                 sizeof(kSocketReceiveBufferSize)) < 0) {
+    setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &kSocketReceiveBufferSize,
+               sizeof(kSocketReceiveBufferSize));
+  }
+  int granted = 0;
+  socklen_t granted_size = sizeof(granted);
+  if (getsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &granted, &granted_size) < 0 ||
+      granted <= 0) {
+    granted = 0;
+  }
+  // Half of it, for the notifications and replies that come in between
+  batch_requests_ =
+      std::max<size_t>(1, static_cast<size_t>(granted) / 2 / kAckBufferCost);
+  receive_buffer_.resize(kReceiveBufferSize);
+  return 0;
+}
+
+int NetlinkSocket::Subscribe(uint32_t group) {
+  if (setsockopt(fd_, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group,
+                 sizeof(group)) < 0) {
+    return -errno;
+  }
+  return 0;
+}
+
+int NetlinkSocket::Request(NetlinkMessage& message,
+                           const ReplyHandler& on_reply) {
+  nlmsghdr* request = message.header();
+  request->nlmsg_flags |= NLM_F_ACK;
+  request->nlmsg_seq = ++sequence_;
+
+  sockaddr_nl kernel = {};
+  kernel.nl_family = AF_NETLINK;
+  if (sendto(fd_, message.data(), message.size(), 0,
+             reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0) {
+    return -errno;
+  }
+
+  for (;;) {
+    ssize_t received = Receive();
+    if (received < 0) {
+      return static_cast<int>(received);
+    }
+    size_t remaining = static_cast<size_t>(received);
+    for (auto* reply = reinterpret_cast<const nlmsghdr*>(receive_buffer_.data());
+         NLMSG_OK(reply, remaining); reply = NLMSG_NEXT(reply, remaining)) {
+      if (reply->nlmsg_seq != sequence_) {
+        // Left over from a request that failed before reading all of it
+        continue;
+      }
+      if (reply->nlmsg_type == NLMSG_ERROR) {
+        const auto* ack = static_cast<const nlmsgerr*>(NLMSG_DATA(reply));
+        return ack->error;
+      }
+      if (reply->nlmsg_type == NLMSG_DONE) {
+        return 0;
+      }
+      if (on_reply) {
+        on_reply(reply);
+      }
+    }
+  }
+}
+
+int NetlinkSocket::ReadAvailable(const ReplyHandler& on_message) {
+  for (;;) {
+    ssize_t received = recv(fd_, receive_buffer_.data(),
+                            receive_buffer_.size(), MSG_DONTWAIT);
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -errno;
+    }
+    size_t remaining = static_cast<size_t>(received);
+    for (auto* message =
+             reinterpret_cast<const nlmsghdr*>(receive_buffer_.data());
+         NLMSG_OK(message, remaining);
+         message = NLMSG_NEXT(message, remaining)) {
+      on_message(message);
+    }
+  }
+}
+
+ssize_t NetlinkSocket::Receive() {
+  for (;;) {
+    pollfd readable = {fd_, POLLIN, 0};
+    int ready = poll(&readable, 1, kReplyTimeoutMs);
+    if (ready == 0) {
+      return -ETIMEDOUT;
+    }
+    ssize_t received = ready < 0 ? -1
+                                 : recv(fd_, receive_buffer_.data(),
+                                        receive_buffer_.size(), MSG_DONTWAIT);
+    if (received >= 0) {
+      return received;
+    }
+    if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+      return -errno;
+    }
+  }
+}
+
+int NetlinkSocket::ReceiveAcks(
+    uint32_t first, uint32_t last, const std::function<void(const nlmsgerr* ack)>& on_ack) {
+  for (;;) {
+    ssize_t received = Receive();
+    if (received < 0) {
+      return static_cast<int>(received);
+    }
+    size_t remaining = static_cast<size_t>(received);
+    for (auto* reply = reinterpret_cast<const nlmsghdr*>(receive_buffer_.data());
+         NLMSG_OK(reply, remaining); reply = NLMSG_NEXT(reply, remaining)) {
+      if (reply->nlmsg_type != NLMSG_ERROR || reply->nlmsg_seq < first ||
+          reply->nlmsg_seq > last) {
+        continue;
+      }
+      on_ack(static_cast<const nlmsgerr*>(NLMSG_DATA(reply)));
+      // Acknowledged in order, so the last one ends the batch
+      if (reply->nlmsg_seq == last) {
+        return 0;
+      }
+    }
+  }
+}
+
+void NetlinkBatch::Add(NetlinkMessage& message) {
+  if (!buffer_.empty() && (buffer_.size() + message.size() > kBatchSize ||
+                           pending_ >= socket_->batch_requests_)) {
+    Send();
+  }
+  nlmsghdr* request = message.header();
+  request->nlmsg_flags |= NLM_F_ACK;
+  request->nlmsg_seq = ++socket_->sequence_;
+  buffer_.insert(buffer_.end(), message.data(),
+                 message.data() + message.size());
+  pending_++;
+}
+
+int NetlinkBatch::Finish(size_t* failed) {
+  if (!buffer_.empty()) {
+    Send();
+  }
+  if (failed) {
+    *failed = failed_;
+  }
+  int error = first_error_;
+  first_error_ = 0;
+  failed_ = 0;
+  return error;
+}
+
+void NetlinkBatch::Send() {
+  auto fail = [this](int error, size_t count) {
+    if (first_error_ == 0) {
+      first_error_ = error;
+    }
+    failed_ += count;
+  };
+
+  sockaddr_nl kernel = {};
+  kernel.nl_family = AF_NETLINK;
+  if (sendto(socket_->fd_, buffer_.data(), buffer_.size(), 0,
+             reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0) {
+    fail(-errno, pending_);
+  } else {
+    size_t acknowledged = 0;
+    uint32_t last = socket_->sequence_;
+    uint32_t first = last - static_cast<uint32_t>(pending_) + 1;
+    int error = socket_->ReceiveAcks(first, last, [&](const nlmsgerr* ack) {
+      acknowledged++;
+      if (ack->error < 0) {
+        fail(ack->error, 1);
+      }
+    });
+    if (error < 0) {
+      // Acknowledgements were dropped (-ENOBUFS) or did not come
+      // (-ETIMEDOUT); the requests they were for may have failed
+      fail(error, pending_ - acknowledged);
+    }
+  }
+  buffer_.clear();
+  pending_ = 0;
+}
+
+std::string NetlinkError(int error, const char* operation) {
+  return std::string(strerror(-error)) + " (" + operation + ")";
+}
+
+}  // namespace wireguard_dart
@@ -0,0 +1,132 @@
+#ifndef WIREGUARD_DART_NETLINK_H_
+#define WIREGUARD_DART_NETLINK_H_
+
+#include <linux/netlink.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace wireguard_dart {
+
+// A netlink request under construction: the header, the family header and
+// the attributes, each aligned as the kernel expects.
+class NetlinkMessage {
+ public:
+  NetlinkMessage(uint16_t type, uint16_t flags);
+
+  // Appends the fixed family header (ifinfomsg, rtmsg, genlmsghdr, ...).
+  void PutHeader(const void* header, size_t size);
+  void PutAttr(uint16_t type, const void* data, size_t size);
+  void PutU8(uint16_t type, uint8_t value) { PutAttr(type, &value, sizeof(value)); }
+  void PutU16(uint16_t type, uint16_t value) { PutAttr(type, &value, sizeof(value)); }
+  void PutU32(uint16_t type, uint32_t value) { PutAttr(type, &value, sizeof(value)); }
+  // Includes the terminating NUL, as the kernel's string policies want.
+  void PutString(uint16_t type, const std::string& value);
+
+  // Nested attributes go between BeginNested and EndNested with the offset it
+  // returned.
+  size_t BeginNested(uint16_t type);
+  void EndNested(size_t offset);
+
+  nlmsghdr* header() { return reinterpret_cast<nlmsghdr*>(buffer_.data()); }
+  const uint8_t* data() const { return buffer_.data(); }
+  size_t size() const { return buffer_.size(); }
+
+ private:
+  void Align();
+
+  std::vector<uint8_t> buffer_;
+};
+
+// Calls visit with each attribute of a message after its family header of
+// header_size bytes, or of a nested attribute with header_size 0.
+void ForEachAttr(const void* data, size_t size, size_t header_size,
+                 const std::function<void(const nlattr* attr)>& visit);
+const void* AttrData(const nlattr* attr);
+size_t AttrSize(const nlattr* attr);
+uint16_t AttrType(const nlattr* attr);
+
+// A netlink socket of one protocol. Requests are answered in order; each
+// waits for its acknowledgement, so errors are reported by the call that
+// caused them.
+class NetlinkSocket {
+ public:
+  // Called with each reply message that is not the acknowledgement.
+  using ReplyHandler = std::function<void(const nlmsghdr* reply)>;
+
+  NetlinkSocket() = default;
+  ~NetlinkSocket();
+
+  NetlinkSocket(const NetlinkSocket&) = delete;
+  NetlinkSocket& operator=(const NetlinkSocket&) = delete;
+
+  // 0 or a negative errno.
+  int Open(int protocol);
+  bool IsOpen() const { return fd_ >= 0; }
+  int fd() const { return fd_; }
+  // Joins a multicast group, such as RTNLGRP_LINK, whose messages are then
+  // read with ReadAvailable.
+  int Subscribe(uint32_t group);
+
+  // Sends message with NLM_F_ACK and reads up to its acknowledgement, or the
+  // end of a dump. 0 or the negative errno the kernel answered with.
+  int Request(NetlinkMessage& message, const ReplyHandler& on_reply = nullptr);
+
+  // Passes every message already received to on_message without waiting for
+  // more. 0, or -ENOBUFS if the kernel dropped messages for want of room.
+  int ReadAvailable(const ReplyHandler& on_message);
+
+ private:
+  friend class NetlinkBatch;
+
+  // Waits for the next datagram, up to kReplyTimeoutMs. Its size, or
+  // -ETIMEDOUT or the negative errno of recv; -ENOBUFS if the kernel dropped
+  // replies for want of room.
+  ssize_t Receive();
+  // Reads the acknowledgements of sequence numbers first to last, passing
+  // each to on_ack.
+  int ReceiveAcks(uint32_t first, uint32_t last,
+                  const std::function<void(const nlmsgerr* ack)>& on_ack);
+
+  int fd_ = -1;
+  uint32_t sequence_ = 0;
+  std::vector<uint8_t> receive_buffer_;
+  // Requests a batch may hold, so their acknowledgements fit the receive
+  // buffer the kernel granted
+  size_t batch_requests_ = 0;
+};
+
+// Requests that need no reply, packed many to a send. The kernel handles
+// them one after another and acknowledges each, so a failed one does not
+// stop the rest; the acknowledgements are read once per send. A batch holds
+// no more requests than the socket's receive buffer has room to acknowledge,
+// and acknowledgements that were dropped or do not come count as failed.
+class NetlinkBatch {
+ public:
+  explicit NetlinkBatch(NetlinkSocket* socket) : socket_(socket) {}
+
+  // Copies message into the batch, sending the batch first if it is full.
+  void Add(NetlinkMessage& message);
+  // Sends the rest and waits for it. 0, or the first error of any request in
+  // the batch, with failed set to how many failed.
+  int Finish(size_t* failed = nullptr);
+
+ private:
+  void Send();
+
+  NetlinkSocket* socket_;
+  std::vector<uint8_t> buffer_;
+  size_t pending_ = 0;
+  int first_error_ = 0;
+  size_t failed_ = 0;
+};
+
+// "Operation not permitted (setting up the link)" and the like.
+std::string NetlinkError(int error, const char* operation);
+
+}  // namespace wireguard_dart
+
+#endif  // WIREGUARD_DART_NETLINK_H_
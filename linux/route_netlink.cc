@@ -0,0 +1,188 @@
+#include "route_netlink.h"
+
+#include <errno.h>
+#include <linux/fib_rules.h>
+#include <linux/if.h>
+#include <linux/if_addr.h>
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+
+#include <cstring>
+
+namespace wireguard_dart {
+
+namespace {
+
+size_t AddressSize(const NetworkPrefix& prefix) {
+  return prefix.family == AF_INET ? 4 : 16;
+}
+
+// The kernel refuses a route whose destination has host bits set, which
+// AllowedIPs may have.
+void NetworkAddress(const NetworkPrefix& prefix, uint8_t* network) {
+  memcpy(network, prefix.address, AddressSize(prefix));
+  for (size_t bit = prefix.prefix_length; bit < AddressSize(prefix) * 8; bit++) {
+    network[bit / 8] &= static_cast<uint8_t>(~(0x80 >> (bit % 8)));
+  }
+}
+
+NetlinkMessage LinkMessage(uint16_t type, uint16_t flags, int ifindex) {
+  NetlinkMessage message(type, flags);
+  ifinfomsg header = {};
+  header.ifi_family = AF_UNSPEC;
+  header.ifi_index = ifindex;
+  message.PutHeader(&header, sizeof(header));
+  return message;
+}
+
+}  // namespace
+
+int RouteNetlink::CreateWireguardLink(const std::string& name, int* ifindex) {
+  NetlinkMessage message =
+      LinkMessage(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, 0);
+  message.PutString(IFLA_IFNAME, name);
+  size_t link_info = message.BeginNested(IFLA_LINKINFO);
+  message.PutString(IFLA_INFO_KIND, "wireguard");
+  message.EndNested(link_info);
+  int error = socket_.Request(message);
+  if (error < 0 && error != -EEXIST) {
+    return error;
+  }
+  unsigned flags;
+  return GetLink(name, ifindex, &flags);
+}
+
+int RouteNetlink::DeleteLink(int ifindex) {
+  NetlinkMessage message = LinkMessage(RTM_DELLINK, 0, ifindex);
+  return socket_.Request(message);
+}
+
+int RouteNetlink::GetLink(const std::string& name, int* ifindex,
+                          unsigned* flags) {
+  NetlinkMessage message = LinkMessage(RTM_GETLINK, 0, 0);
+  message.PutString(IFLA_IFNAME, name);
+  *ifindex = 0;
+  int error = socket_.Request(message, [&](const nlmsghdr* reply) {
+    if (reply->nlmsg_type == RTM_NEWLINK) {
+      const auto* link = static_cast<const ifinfomsg*>(NLMSG_DATA(reply));
+      *ifindex = link->ifi_index;
+      *flags = link->ifi_flags;
+    }
+  });
+  if (error < 0) {
+    return error;
+  }
+  return *ifindex != 0 ? 0 : -ENODEV;
+}
+
+int RouteNetlink::SetLinkUp(int ifindex, bool up) {
+  NetlinkMessage message(RTM_NEWLINK, 0);
+  ifinfomsg header = {};
+  header.ifi_family = AF_UNSPEC;
+  header.ifi_index = ifindex;
+  header.ifi_flags = up ? IFF_UP : 0;
+  header.ifi_change = IFF_UP;
+  message.PutHeader(&header, sizeof(header));
+  return socket_.Request(message);
+}
+
+int RouteNetlink::SetMtu(int ifindex, uint32_t mtu) {
+  NetlinkMessage message = LinkMessage(RTM_NEWLINK, 0, ifindex);
+  message.PutU32(IFLA_MTU, mtu);
+  return socket_.Request(message);
+}
+
+int RouteNetlink::AddAddresses(int ifindex,
+                               const std::vector<NetworkPrefix>& addresses,
+                               size_t* failed) {
+  NetlinkBatch batch(&socket_);
+  for (const NetworkPrefix& address : addresses) {
+    NetlinkMessage message(RTM_NEWADDR, NLM_F_CREATE | NLM_F_REPLACE);
+    ifaddrmsg header = {};
+    header.ifa_family = static_cast<uint8_t>(address.family);
+    header.ifa_prefixlen = address.prefix_length;
+    header.ifa_scope = RT_SCOPE_UNIVERSE;
+    header.ifa_index = static_cast<uint32_t>(ifindex);
+    message.PutHeader(&header, sizeof(header));
+    message.PutAttr(IFA_LOCAL, address.address, AddressSize(address));
+    message.PutAttr(IFA_ADDRESS, address.address, AddressSize(address));
+    batch.Add(message);
+  }
+  return batch.Finish(failed);
+}
+
+int RouteNetlink::AddRoutes(int ifindex,
+                            const std::vector<NetworkPrefix>& prefixes,
+                            uint32_t table, size_t* failed) {
+  NetlinkBatch batch(&socket_);
+  for (const NetworkPrefix& prefix : prefixes) {
+    NetlinkMessage message(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE);
+    rtmsg header = {};
+    header.rtm_family = static_cast<uint8_t>(prefix.family);
+    header.rtm_dst_len = prefix.prefix_length;
+    // Tables past 255 only fit RTA_TABLE
+    header.rtm_table =
+        static_cast<uint8_t>(table < 256 ? table : RT_TABLE_UNSPEC);
+    header.rtm_protocol = RTPROT_BOOT;
+    header.rtm_scope = RT_SCOPE_LINK;
+    header.rtm_type = RTN_UNICAST;
+    message.PutHeader(&header, sizeof(header));
+    message.PutU32(RTA_TABLE, table);
+    if (prefix.prefix_length > 0) {
+      uint8_t network[16];
+      NetworkAddress(prefix, network);
+      message.PutAttr(RTA_DST, network, AddressSize(prefix));
+    }
+    message.PutU32(RTA_OIF, static_cast<uint32_t>(ifindex));
+    batch.Add(message);
+  }
+  return batch.Finish(failed);
+}
+
+int RouteNetlink::AddDefaultRouteRules(int family, uint32_t fwmark,
+                                       uint32_t table) {
+  // Rules without a priority are not found to exist, so connecting again
+  // would stack another pair
+  ChangeRules(RTM_DELRULE, family, fwmark, table);
+  return ChangeRules(RTM_NEWRULE, family, fwmark, table);
+}
+
+int RouteNetlink::DeleteDefaultRouteRules(int family, uint32_t fwmark,
+                                          uint32_t table) {
+  return ChangeRules(RTM_DELRULE, family, fwmark, table);
+}
+
+int RouteNetlink::ChangeRules(uint16_t type, int family, uint32_t fwmark,
+                              uint32_t table) {
+  uint16_t flags = type == RTM_NEWRULE ? NLM_F_CREATE | NLM_F_EXCL : 0;
+
+  // not fwmark <fwmark> table <table>
+  NetlinkMessage to_tunnel(type, flags);
+  fib_rule_hdr tunnel_rule = {};
+  tunnel_rule.family = static_cast<uint8_t>(family);
+  tunnel_rule.action = FR_ACT_TO_TBL;
+  tunnel_rule.flags = FIB_RULE_INVERT;
+  to_tunnel.PutHeader(&tunnel_rule, sizeof(tunnel_rule));
+  to_tunnel.PutU32(FRA_FWMARK, fwmark);
+  to_tunnel.PutU32(FRA_TABLE, table);
+  int error = socket_.Request(to_tunnel);
+  if (error < 0 && error != -EEXIST && error != -ENOENT) {
+    return error;
+  }
+
+  // table main suppress_prefixlength 0
+  NetlinkMessage main_table(type, flags);
+  fib_rule_hdr main_rule = {};
+  main_rule.family = static_cast<uint8_t>(family);
+  main_rule.action = FR_ACT_TO_TBL;
+  main_table.PutHeader(&main_rule, sizeof(main_rule));
+  main_table.PutU32(FRA_TABLE, RT_TABLE_MAIN);
+  main_table.PutU32(FRA_SUPPRESS_PREFIXLEN, 0);
+  error = socket_.Request(main_table);
+  if (error < 0 && error != -EEXIST && error != -ENOENT) {
+    return error;
+  }
+  return 0;
+}
+
+}  // namespace wireguard_dart
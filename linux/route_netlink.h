@@ -0,0 +1,50 @@
+#ifndef WIREGUARD_DART_ROUTE_NETLINK_H_
+#define WIREGUARD_DART_ROUTE_NETLINK_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "netlink.h"
+#include "tunnel_config.h"
+
+namespace wireguard_dart {
+
+// Links, addresses, routes and routing rules over rtnetlink, what ip(8) does.
+// Every call returns 0 or a negative errno.
+class RouteNetlink {
+ public:
+  int Open() { return socket_.Open(NETLINK_ROUTE); }
+
+  // Creates a WireGuard link named name, or finds the one already there.
+  int CreateWireguardLink(const std::string& name, int* ifindex);
+  int DeleteLink(int ifindex);
+  // -ENODEV if there is no link named name.
+  int GetLink(const std::string& name, int* ifindex, unsigned* flags);
+  int SetLinkUp(int ifindex, bool up);
+  int SetMtu(int ifindex, uint32_t mtu);
+
+  // Replaces addresses of the same prefix. Sent in batches, many to a
+  // syscall; every address is tried, failed counts those that could not be
+  // added and the first error is returned.
+  int AddAddresses(int ifindex, const std::vector<NetworkPrefix>& addresses,
+                   size_t* failed = nullptr);
+  // Routes to prefixes through the link in table, batched as AddAddresses.
+  int AddRoutes(int ifindex, const std::vector<NetworkPrefix>& prefixes,
+                uint32_t table, size_t* failed = nullptr);
+
+  // The wg-quick rules for a default route through the tunnel: packets not
+  // marked fwmark go by table, and the main table is used for everything but
+  // its default route.
+  int AddDefaultRouteRules(int family, uint32_t fwmark, uint32_t table);
+  int DeleteDefaultRouteRules(int family, uint32_t fwmark, uint32_t table);
+
+ private:
+  int ChangeRules(uint16_t type, int family, uint32_t fwmark, uint32_t table);
+
+  NetlinkSocket socket_;
+};
+
+}  // namespace wireguard_dart
+
+#endif  // WIREGUARD_DART_ROUTE_NETLINK_H_
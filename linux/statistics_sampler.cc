@@ -0,0 +1,53 @@
+#include "statistics_sampler.h"
+
+namespace wireguard_dart {
+
+StatisticsSampler::StatisticsSampler(TunnelManager* tunnels, Listener listener)
+    : tunnels_(tunnels), listener_(std::move(listener)) {}
+
+StatisticsSampler::~StatisticsSampler() { Stop(); }
+
+void StatisticsSampler::Start(guint interval_ms) {
+  Stop();
+  source_ = g_timeout_add(interval_ms, OnTick, this);
+  // The first totals go out right away instead of an interval later
+  Sample();
+}
+
+void StatisticsSampler::Stop() {
+  if (source_ != 0) {
+    g_source_remove(source_);
+    source_ = 0;
+  }
+  last_emitted_.clear();
+}
+
+gboolean StatisticsSampler::OnTick(gpointer user_data) {
+  static_cast<StatisticsSampler*>(user_data)->Sample();
+  return G_SOURCE_CONTINUE;
+}
+
+void StatisticsSampler::Sample() {
+  changes_.clear();
+  // While a method call has the tunnels, the next tick reads them
+  tunnels_->TryReadEachTunnel(&peers_, [this](const std::string& name,
+                                              bool read) {
+    if (!read) {
+      // Not up yet, or gone; sent in full once it can be read again
+      last_emitted_.erase(name);
+      return;
+    }
+    TunnelTotals totals = SumPeers(peers_);
+    auto it = last_emitted_.find(name);
+    if (it != last_emitted_.end() && it->second == totals) {
+      return;
+    }
+    last_emitted_[name] = totals;
+    changes_.emplace_back(name, totals);
+  });
+  if (!changes_.empty()) {
+    listener_(changes_);
+  }
+}
+
+}  // namespace wireguard_dart
@@ -0,0 +1,52 @@
+#ifndef WIREGUARD_DART_STATISTICS_SAMPLER_H_
+#define WIREGUARD_DART_STATISTICS_SAMPLER_H_
+
+#include <glib.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tunnel_manager.h"
+#include "wireguard_core/peer_statistics.h"
+
+namespace wireguard_dart {
+
+// Reads every tunnel at the interval the statistics stream's listener asked
+// for and passes on those whose totals changed, as the Windows sampler does.
+// Runs as a GLib timeout on the main thread, skipping a tick while a method
+// call on the worker has the tunnels; the peer buffer is reused between
+// readings, so a steady tick allocates nothing per peer.
+class StatisticsSampler {
+ public:
+  using Changes = std::vector<std::pair<std::string, TunnelTotals>>;
+  using Listener = std::function<void(const Changes& changes)>;
+
+  StatisticsSampler(TunnelManager* tunnels, Listener listener);
+  ~StatisticsSampler();
+
+  StatisticsSampler(const StatisticsSampler&) = delete;
+  StatisticsSampler& operator=(const StatisticsSampler&) = delete;
+
+  // A running sampler restarts at the new interval, sending every tunnel
+  // again.
+  void Start(guint interval_ms);
+  void Stop();
+
+ private:
+  static gboolean OnTick(gpointer user_data);
+  void Sample();
+
+  TunnelManager* tunnels_;
+  Listener listener_;
+  guint source_ = 0;
+  std::vector<PeerStatistics> peers_;
+  std::map<std::string, TunnelTotals> last_emitted_;
+  Changes changes_;
+};
+
+}  // namespace wireguard_dart
+
+#endif  // WIREGUARD_DART_STATISTICS_SAMPLER_H_
@@ -0,0 +1,234 @@
+#include "status_observer.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <glib-unix.h>
+#include <linux/if.h>
+#include <linux/if_addr.h>
+#include <linux/rtnetlink.h>
+
+namespace wireguard_dart {
+
+namespace {
+
+const char* LinkStatus(unsigned flags) {
+  return (flags & IFF_UP) ? "connected" : "disconnected";
+}
+
+}  // namespace
+
+StatusObserver::StatusObserver(Listener listener)
+    : listener_(std::move(listener)) {}
+
+StatusObserver::~StatusObserver() { Stop(); }
+
+bool StatusObserver::Start(std::string* error) {
+  if (source_ != 0) {
+    return true;
+  }
+  auto socket = std::make_unique<NetlinkSocket>();
+  int result = socket->Open(NETLINK_ROUTE);
+  for (uint32_t group :
+       {RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR, RTNLGRP_IPV6_IFADDR}) {
+    if (result == 0) {
+      result = socket->Subscribe(group);
+    }
+  }
+  if (result < 0) {
+    *error = NetlinkError(result, "subscribing to link notifications");
+    return false;
+  }
+  socket_ = std::move(socket);
+  source_ = g_unix_fd_add(socket_->fd(), G_IO_IN, OnReadable, this);
+  return true;
+}
+
+void StatusObserver::Stop() {
+  if (source_ != 0) {
+    g_source_remove(source_);
+    source_ = 0;
+  }
+  socket_.reset();
+}
+
+void StatusObserver::Watch(int ifindex) { watched_[ifindex] = Watched(); }
+
+gboolean StatusObserver::OnReadable(gint fd, GIOCondition condition,
+                                    gpointer user_data) {
+  auto* self = static_cast<StatusObserver*>(user_data);
+  std::vector<StatusEvent> events;
+  int result = self->socket_->ReadAvailable([&](const nlmsghdr* message) {
+    switch (message->nlmsg_type) {
+      case RTM_NEWLINK:
+      case RTM_DELLINK:
+        self->HandleLink(message, &events);
+        break;
+      case RTM_NEWADDR:
+      case RTM_DELADDR:
+        self->HandleAddress(message, &events);
+        break;
+    }
+  });
+  if (result == -ENOBUFS) {
+    self->Resync(&events);
+  }
+  if (!events.empty()) {
+    self->listener_(events);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+void StatusObserver::Resync(std::vector<StatusEvent>* events) {
+  // A socket of its own, so notifications queued meanwhile are still read
+  // from the subscribed one after the dumps
+  NetlinkSocket dump;
+  int result = dump.Open(NETLINK_ROUTE);
+  std::set<int> present;
+  if (result == 0) {
+    NetlinkMessage links(RTM_GETLINK, NLM_F_DUMP);
+    ifinfomsg link = {};
+    link.ifi_family = AF_UNSPEC;
+    links.PutHeader(&link, sizeof(link));
+    result = dump.Request(links, [&](const nlmsghdr* message) {
+      if (message->nlmsg_type == RTM_NEWLINK) {
+        const auto* found = static_cast<const ifinfomsg*>(NLMSG_DATA(message));
+        present.insert(found->ifi_index);
+        HandleLink(message, events);
+      }
+    });
+  }
+  if (result < 0) {
+    // The next notification of each link is sent even if it looks like no
+    // change
+    for (auto& [ifindex, watched] : watched_) {
+      watched.status.clear();
+    }
+    return;
+  }
+  // Links deleted while notifications were dropped
+  for (auto it = watched_.begin(); it != watched_.end();) {
+    if (present.count(it->first) > 0) {
+      ++it;
+      continue;
+    }
+    if (it->second.status != "disconnected") {
+      events->push_back({it->first, "disconnected", {}, {}});
+    }
+    it = watched_.erase(it);
+  }
+
+  // The dump rebuilds the ready addresses; only those not ready before are
+  // reported, and those missing from it as removed
+  std::map<int, std::set<std::string>> previous;
+  for (auto& [ifindex, watched] : watched_) {
+    previous[ifindex].swap(watched.ready_prefixes);
+  }
+  std::vector<StatusEvent> dumped;
+  NetlinkMessage addresses(RTM_GETADDR, NLM_F_DUMP);
+  ifaddrmsg address = {};
+  address.ifa_family = AF_UNSPEC;
+  addresses.PutHeader(&address, sizeof(address));
+  result = dump.Request(addresses, [&](const nlmsghdr* message) {
+    if (message->nlmsg_type == RTM_NEWADDR) {
+      HandleAddress(message, &dumped);
+    }
+  });
+  if (result < 0) {
+    for (auto& [ifindex, prefixes] : previous) {
+      watched_[ifindex].ready_prefixes.swap(prefixes);
+    }
+    return;
+  }
+  for (StatusEvent& event : dumped) {
+    if (previous[event.ifindex].erase(event.prefix) == 0) {
+      events->push_back(std::move(event));
+    }
+  }
+  for (const auto& [ifindex, prefixes] : previous) {
+    const std::string& status = watched_[ifindex].status;
+    for (const std::string& prefix : prefixes) {
+      events->push_back({ifindex, status.empty() ? "disconnected" : status,
+                         "addressRemoved", prefix});
+    }
+  }
+}
+
+void StatusObserver::HandleLink(const nlmsghdr* message,
+                                std::vector<StatusEvent>* events) {
+  const auto* link = static_cast<const ifinfomsg*>(NLMSG_DATA(message));
+  auto it = watched_.find(link->ifi_index);
+  if (it == watched_.end()) {
+    return;
+  }
+  // A deleted link is gone for good; a link of the same name gets a new index
+  std::string status = message->nlmsg_type == RTM_DELLINK
+                           ? "disconnected"
+                           : LinkStatus(link->ifi_flags);
+  if (status != it->second.status) {
+    it->second.status = status;
+    events->push_back({link->ifi_index, status, {}, {}});
+  }
+  if (message->nlmsg_type == RTM_DELLINK) {
+    watched_.erase(it);
+  }
+}
+
+void StatusObserver::HandleAddress(const nlmsghdr* message,
+                                   std::vector<StatusEvent>* events) {
+  const auto* address = static_cast<const ifaddrmsg*>(NLMSG_DATA(message));
+  auto it = watched_.find(static_cast<int>(address->ifa_index));
+  if (it == watched_.end()) {
+    return;
+  }
+
+  const void* local = nullptr;
+  const void* peer = nullptr;
+  uint32_t flags = address->ifa_flags;
+  ForEachAttr(NLMSG_DATA(message), message->nlmsg_len - NLMSG_HDRLEN,
+              sizeof(ifaddrmsg), [&](const nlattr* attr) {
+                switch (AttrType(attr)) {
+                  case IFA_LOCAL:
+                    local = AttrData(attr);
+                    break;
+                  case IFA_ADDRESS:
+                    peer = AttrData(attr);
+                    break;
+                  case IFA_FLAGS:
+                    flags = *static_cast<const uint32_t*>(AttrData(attr));
+                    break;
+                }
+              });
+  // IFA_LOCAL is the address of our end where there is one
+  const void* bytes = local ? local : peer;
+  char text[INET6_ADDRSTRLEN];
+  if (bytes == nullptr ||
+      inet_ntop(address->ifa_family, bytes, text, sizeof(text)) == nullptr) {
+    return;
+  }
+  std::string prefix =
+      std::string(text) + "/" + std::to_string(address->ifa_prefixlen);
+
+  Watched& watched = it->second;
+  const char* event = nullptr;
+  if (message->nlmsg_type == RTM_NEWADDR &&
+      !(flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED))) {
+    // Tentative addresses are reported again once duplicate address
+    // detection is done
+    if (watched.ready_prefixes.insert(prefix).second) {
+      event = "addressReady";
+    }
+  } else if (message->nlmsg_type == RTM_DELADDR ||
+             (flags & IFA_F_DADFAILED)) {
+    if (watched.ready_prefixes.erase(prefix) > 0) {
+      event = "addressRemoved";
+    }
+  }
+  if (event != nullptr) {
+    std::string status =
+        watched.status.empty() ? "disconnected" : watched.status;
+    events->push_back({static_cast<int>(address->ifa_index), status, event,
+                       prefix});
+  }
+}
+
+}  // namespace wireguard_dart
@@ -0,0 +1,71 @@
+#ifndef WIREGUARD_DART_STATUS_OBSERVER_H_
+#define WIREGUARD_DART_STATUS_OBSERVER_H_
+
+#include <glib.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "netlink.h"
+
+namespace wireguard_dart {
+
+// A status change of a watched link: its status, and for address changes
+// event ("addressReady" or "addressRemoved") with prefix ("10.0.0.2/24").
+struct StatusEvent {
+  int ifindex;
+  std::string status;
+  std::string event;
+  std::string prefix;
+};
+
+// Link and address notifications of the tunnels, the Linux counterpart of
+// the Windows NetworkAdapterStatusObserver. The rtnetlink socket is a source
+// of the GLib main loop, so there is no thread of its own and no polling;
+// the listener is called on the main thread with the transitions of one read.
+class StatusObserver {
+ public:
+  using Listener = std::function<void(const std::vector<StatusEvent>& events)>;
+
+  explicit StatusObserver(Listener listener);
+  ~StatusObserver();
+
+  StatusObserver(const StatusObserver&) = delete;
+  StatusObserver& operator=(const StatusObserver&) = delete;
+
+  // Subscribes to RTNLGRP_LINK and the address groups. False, with error
+  // set, if the socket could not be set up.
+  bool Start(std::string* error);
+  void Stop();
+
+  // Only watched links are reported. A link watched again is reported anew.
+  void Watch(int ifindex);
+
+ private:
+  struct Watched {
+    std::string status;  // empty until the first notification
+    std::set<std::string> ready_prefixes;
+  };
+
+  static gboolean OnReadable(gint fd, GIOCondition condition,
+                             gpointer user_data);
+  void HandleLink(const nlmsghdr* message, std::vector<StatusEvent>* events);
+  void HandleAddress(const nlmsghdr* message,
+                     std::vector<StatusEvent>* events);
+  // After notifications were dropped: dumps the links and addresses and
+  // reports how the watched ones differ from what was last sent.
+  void Resync(std::vector<StatusEvent>* events);
+
+  Listener listener_;
+  std::unique_ptr<NetlinkSocket> socket_;
+  guint source_ = 0;
+  std::map<int, Watched> watched_;
+};
+
+}  // namespace wireguard_dart
+
+#endif  // WIREGUARD_DART_STATUS_OBSERVER_H_
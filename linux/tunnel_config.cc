@@ -0,0 +1,179 @@
+#include "tunnel_config.h"
+
+#include <netdb.h>
+
+#include <charconv>
+#include <cstring>
+
+namespace wireguard_dart {
+
+namespace {
+
+enum class Section { kNone, kInterface, kPeer, kUnknown };
+
+std::string_view Trim(std::string_view value) {
+  const char* kSpace = " \t\r";
+  size_t start = value.find_first_not_of(kSpace);
+  if (start == std::string_view::npos) {
+    return {};
+  }
+  size_t end = value.find_last_not_of(kSpace);
+  return value.substr(start, end - start + 1);
+}
+
+template <typename T>
+bool ParseUnsigned(std::string_view value, T* out) {
+  auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), *out);
+  return ec == std::errc() && end == value.data() + value.size();
+}
+
+bool ParsePrefixList(std::string_view value,
+                     std::vector<NetworkPrefix>* prefixes) {
+  while (!value.empty()) {
+    size_t comma = value.find(',');
+    std::string_view item = Trim(value.substr(0, comma));
+    if (!item.empty()) {
+      NetworkPrefix prefix;
+      if (!ParseNetworkPrefix(item, prefix)) {
+        return false;
+      }
+      prefixes->push_back(prefix);
+    }
+    if (comma == std::string_view::npos) {
+      break;
+    }
+    value.remove_prefix(comma + 1);
+  }
+  return true;
+}
+
+// host:port or [v6 address]:port; hostnames are resolved here, as wg does.
+bool ParseEndpoint(std::string_view value, sockaddr_storage* endpoint) {
+  size_t colon = value.rfind(':');
+  if (colon == std::string_view::npos || colon == 0) {
+    return false;
+  }
+  std::string host(value.substr(0, colon));
+  std::string port(value.substr(colon + 1));
+  if (host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_protocol = IPPROTO_UDP;
+  addrinfo* resolved = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &resolved) != 0 ||
+      resolved == nullptr) {
+    return false;
+  }
+  memcpy(endpoint, resolved->ai_addr, resolved->ai_addrlen);
+  freeaddrinfo(resolved);
+  return true;
+}
+
+bool ParseInterfaceKey(std::string_view key, std::string_view value,
+                       TunnelConfig* config) {
+  if (key == "PrivateKey") {
+    return config->has_private_key = KeyFromBase64(value, config->private_key);
+  } else if (key == "ListenPort") {
+    return config->has_listen_port = ParseUnsigned(value, &config->listen_port);
+  } else if (key == "MTU") {
+    // The path MTU is not measured on Linux; auto keeps the kernel default
+    return value == "auto" || ParseUnsigned(value, &config->mtu);
+  } else if (key == "Address") {
+    return ParsePrefixList(value, &config->addresses);
+  }
+
+  // Ignore unknown keys
+  return true;
+}
+
+bool ParsePeerKey(std::string_view key, std::string_view value,
+                  PeerConfig* peer) {
+  if (key == "PublicKey") {
+    return peer->has_public_key = KeyFromBase64(value, peer->public_key);
+  } else if (key == "PresharedKey") {
+    return peer->has_preshared_key = KeyFromBase64(value, peer->preshared_key);
+  } else if (key == "PersistentKeepalive") {
+    return value == "off" ||
+           ParseUnsigned(value, &peer->persistent_keepalive);
+  } else if (key == "Endpoint") {
+    return peer->has_endpoint = ParseEndpoint(value, &peer->endpoint);
+  } else if (key == "AllowedIPs") {
+    return ParsePrefixList(value, &peer->allowed_ips);
+  } else if (key == "ExcludedIPs") {
+    return ParsePrefixList(value, &peer->excluded_ips);
+  }
+
+  // Ignore unknown keys
+  return true;
+}
+
+}  // namespace
+
+bool ParseTunnelConfig(std::string_view text, TunnelConfig* config,
+                       std::string* error) {
+  Section section = Section::kNone;
+  size_t line_number = 0;
+  while (!text.empty()) {
+    size_t newline = text.find('\n');
+    std::string_view line = text.substr(0, newline);
+    text = newline == std::string_view::npos ? std::string_view()
+                                             : text.substr(newline + 1);
+    line_number++;
+
+    // Everything after '#' is a comment, as in wg-quick
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty() || line[0] == ';') {
+      continue;
+    }
+
+    if (line.front() == '[' && line.back() == ']') {
+      std::string_view name = line.substr(1, line.size() - 2);
+      if (name == "Interface") {
+        section = Section::kInterface;
+      } else if (name == "Peer") {
+        section = Section::kPeer;
+        config->peers.emplace_back();
+      } else {
+        section = Section::kUnknown;
+      }
+      continue;
+    }
+
+    size_t equals = line.find('=');
+    if (equals == std::string_view::npos) {
+      continue;
+    }
+    std::string_view key = Trim(line.substr(0, equals));
+    std::string_view value = Trim(line.substr(equals + 1));
+
+    bool parsed = true;
+    if (section == Section::kInterface) {
+      parsed = ParseInterfaceKey(key, value, config);
+    } else if (section == Section::kPeer) {
+      parsed = ParsePeerKey(key, value, &config->peers.back());
+    }
+    if (!parsed) {
+      *error = "Invalid " + std::string(key) + " on line " +
+               std::to_string(line_number);
+      return false;
+    }
+  }
+
+  for (PeerConfig& peer : config->peers) {
+    if (!peer.has_public_key) {
+      *error = "A peer has no PublicKey";
+      return false;
+    }
+    peer.configured_ips = peer.allowed_ips;
+    if (!peer.excluded_ips.empty()) {
+      peer.allowed_ips = SubtractPrefixes(peer.allowed_ips, peer.excluded_ips);
+    }
+  }
+  return true;
+}
+
+}  // namespace wireguard_dart
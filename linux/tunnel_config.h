@@ -0,0 +1,52 @@
+#ifndef WIREGUARD_DART_TUNNEL_CONFIG_H_
+#define WIREGUARD_DART_TUNNEL_CONFIG_H_
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "wireguard_core/ip_prefix.h"
+#include "wireguard_core/wireguard_key.h"
+
+namespace wireguard_dart {
+
+struct PeerConfig {
+  uint8_t public_key[kWireguardKeyLength];
+  bool has_public_key = false;
+  uint8_t preshared_key[kWireguardKeyLength];
+  bool has_preshared_key = false;
+  sockaddr_storage endpoint = {};
+  bool has_endpoint = false;
+  uint16_t persistent_keepalive = 0;
+  // ExcludedIPs already taken out
+  std::vector<NetworkPrefix> allowed_ips;
+  std::vector<NetworkPrefix> excluded_ips;
+  // AllowedIPs as written, before ExcludedIPs were taken out, which decide
+  // whether the tunnel takes all traffic of a family
+  std::vector<NetworkPrefix> configured_ips;
+};
+
+// A wg-quick configuration, the same keys the Windows parser takes; the
+// Windows only ones (Metric, DNS, ...) are ignored.
+struct TunnelConfig {
+  uint8_t private_key[kWireguardKeyLength];
+  bool has_private_key = false;
+  uint16_t listen_port = 0;
+  bool has_listen_port = false;
+  uint32_t mtu = 0;  // 0 leaves the kernel default
+  std::vector<NetworkPrefix> addresses;
+  std::vector<PeerConfig> peers;
+};
+
+// Parses text into config, resolving hostname endpoints on the way. False,
+// with error set, if a value is malformed or a hostname does not resolve.
+bool ParseTunnelConfig(std::string_view text, TunnelConfig* config,
+                       std::string* error);
+
+}  // namespace wireguard_dart
+
+#endif  // WIREGUARD_DART_TUNNEL_CONFIG_H_
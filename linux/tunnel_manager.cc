@@ -0,0 +1,305 @@
+#include "tunnel_manager.h"
+
+#include <errno.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace wireguard_dart {
+
+namespace {
+
+// wg-quick's routing table for default routes, also the fwmark of the
+// tunnel's own packets; each further tunnel takes the next one
+constexpr uint32_t kFirstRouteTable = 51820;
+
+// The peers' allowed IPs, or with configured those written before
+// ExcludedIPs were taken out, as the fewest prefixes, one route each, as on
+// Windows
+std::vector<NetworkPrefix> AggregatedAllowedIps(const TunnelConfig& config,
+                                                bool configured = false) {
+  std::vector<NetworkPrefix> allowed_ips;
+  for (const PeerConfig& peer : config.peers) {
+    const auto& ips = configured ? peer.configured_ips : peer.allowed_ips;
+    allowed_ips.insert(allowed_ips.end(), ips.begin(), ips.end());
+  }
+  return AggregatePrefixes(allowed_ips);
+}
+
+// The families the tunnel takes all traffic of, which goes by the
+// tunnel's table and its rules. Decided from the aggregated prefixes, in
+// which halves such as 0.0.0.0/1 and 128.0.0.0/1 have merged into a default
+// route, as configured: a full tunnel with ExcludedIPs taken out of it has
+// no default route left, yet its routes still have to stay off the endpoint,
+// which only the fwmark does, while the excluded prefixes fall through the
+// rules to the main table.
+std::vector<int> FullFamilies(const TunnelConfig& config) {
+  std::vector<int> families;
+  for (const NetworkPrefix& prefix : AggregatedAllowedIps(config, true)) {
+    if (prefix.prefix_length == 0) {
+      families.push_back(prefix.family);
+    }
+  }
+  return families;
+}
+
+bool Contains(const std::vector<int>& families, int family) {
+  return std::find(families.begin(), families.end(), family) != families.end();
+}
+
+// "adding 3 of 500 routes"
+std::string FailedCount(size_t failed, size_t total, const char* what) {
+  return "adding " + std::to_string(failed) + " of " + std::to_string(total) +
+         " " + what;
+}
+
+}  // namespace
+
+bool TunnelManager::Open(std::string* error) {
+  if (opened_) {
+    return true;
+  }
+  // Without the module, tunnels fall back to userspace
+  kernel_ = wireguard_.Open() == 0;
+  int result = route_.Open();
+  if (result < 0) {
+    *error = NetlinkError(result, "opening rtnetlink");
+    return false;
+  }
+  opened_ = true;
+  return true;
+}
+
+bool TunnelManager::CreateLink(const std::string& name, Tunnel* tunnel,
+                               std::string* error) {
+  if (kernel_) {
+    int result = route_.CreateWireguardLink(name, &tunnel->ifindex);
+    // A kernel can have the generic netlink family but no link kind, as in
+    // some containers
+    if (result != -EOPNOTSUPP) {
+      if (result < 0) {
+        *error = NetlinkError(result, "creating the link");
+        return false;
+      }
+      return true;
+    }
+  }
+  tunnel->userspace = true;
+  if (UapiDevice::Launch(name, error) < 0) {
+    return false;
+  }
+  unsigned flags;
+  int result = route_.GetLink(name, &tunnel->ifindex, &flags);
+  if (result < 0) {
+    *error = NetlinkError(result, "finding the userspace link");
+    return false;
+  }
+  return true;
+}
+
+uint32_t TunnelManager::FreeTable() const {
+  for (uint32_t table = kFirstRouteTable;; table++) {
+    bool taken = std::any_of(
+        tunnels_.begin(), tunnels_.end(),
+        [table](const auto& entry) { return entry.second.table == table; });
+    if (!taken) {
+      return table;
+    }
+  }
+}
+
+bool TunnelManager::Setup(const std::string& name, std::string_view config,
+                          int* ifindex, std::string* error) {
+  if (name.empty() || name.size() >= IFNAMSIZ) {
+    *error = "Tunnel names are 1 to 15 characters on Linux";
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto existing = tunnels_.find(name);
+  Tunnel tunnel;
+  tunnel.table =
+      existing != tunnels_.end() ? existing->second.table : FreeTable();
+  if (!SetupLocked(name, config, &tunnel, error)) {
+    // A tunnel set up before keeps its link
+    if (existing == tunnels_.end() && tunnel.ifindex != 0) {
+      route_.DeleteLink(tunnel.ifindex);
+    }
+    return false;
+  }
+
+  *ifindex = tunnel.ifindex;
+  tunnels_[name] = std::move(tunnel);
+  newest_ = name;
+  return true;
+}
+
+bool TunnelManager::SetupLocked(const std::string& name,
+                                std::string_view config, Tunnel* tunnel,
+                                std::string* error) {
+  if (!ParseTunnelConfig(config, &tunnel->config, error) || !Open(error)) {
+    return false;
+  }
+
+  if (!CreateLink(name, tunnel, error)) {
+    return false;
+  }
+  tunnel->routes = AggregatedAllowedIps(tunnel->config);
+  tunnel->full_families = FullFamilies(tunnel->config);
+  uint32_t fwmark = tunnel->full_families.empty() ? 0 : tunnel->table;
+  int result = tunnel->userspace
+                   ? uapi_.SetDevice(name, tunnel->config, fwmark)
+                   : wireguard_.SetDevice(name, tunnel->config, fwmark);
+  if (result < 0) {
+    *error = NetlinkError(result, "configuring the device");
+    return false;
+  }
+  if (tunnel->config.mtu != 0) {
+    result = route_.SetMtu(tunnel->ifindex, tunnel->config.mtu);
+    if (result < 0) {
+      *error = NetlinkError(result, "setting the MTU");
+      return false;
+    }
+  }
+  size_t failed = 0;
+  result = route_.AddAddresses(tunnel->ifindex, tunnel->config.addresses,
+                               &failed);
+  if (result < 0) {
+    *error = NetlinkError(
+        result,
+        FailedCount(failed, tunnel->config.addresses.size(), "addresses")
+            .c_str());
+    return false;
+  }
+  return true;
+}
+
+bool TunnelManager::Connect(const std::string& name, std::string* error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = tunnels_.find(name);
+  if (it == tunnels_.end()) {
+    *error = "Tunnel " + name + " is not set up";
+    return false;
+  }
+  const Tunnel& tunnel = it->second;
+
+  int result = route_.SetLinkUp(tunnel.ifindex, true);
+  if (result < 0) {
+    *error = NetlinkError(result, "bringing the link up");
+    return false;
+  }
+  // The routes of a full tunnel's families go to their own table, so the
+  // main one keeps the route to the endpoints
+  std::vector<NetworkPrefix> routes;
+  std::vector<NetworkPrefix> default_routes;
+  for (const NetworkPrefix& prefix : tunnel.routes) {
+    (Contains(tunnel.full_families, prefix.family) ? default_routes : routes)
+        .push_back(prefix);
+  }
+  size_t failed = 0;
+  result = route_.AddRoutes(tunnel.ifindex, routes, RT_TABLE_MAIN, &failed);
+  if (result == 0) {
+    result =
+        route_.AddRoutes(tunnel.ifindex, default_routes, tunnel.table, &failed);
+  }
+  if (result < 0) {
+    *error = NetlinkError(
+        result,
+        FailedCount(failed, routes.size() + default_routes.size(), "routes")
+            .c_str());
+    return false;
+  }
+  for (int family : tunnel.full_families) {
+    result = route_.AddDefaultRouteRules(family, tunnel.table, tunnel.table);
+    if (result < 0) {
+      *error = NetlinkError(result, "adding routing rules");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TunnelManager::Disconnect(const std::string& name, std::string* error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = tunnels_.find(name);
+  if (it == tunnels_.end()) {
+    // Nothing of ours to take down
+    return true;
+  }
+  const Tunnel& tunnel = it->second;
+
+  for (int family : tunnel.full_families) {
+    route_.DeleteDefaultRouteRules(family, tunnel.table, tunnel.table);
+  }
+  int result = route_.SetLinkUp(tunnel.ifindex, false);
+  if (result < 0 && result != -ENODEV) {
+    *error = NetlinkError(result, "bringing the link down");
+    return false;
+  }
+  return true;
+}
+
+const char* TunnelManager::Status(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return StatusLocked(name);
+}
+
+const char* TunnelManager::StatusLocked(const std::string& name) {
+  std::string error;
+  int ifindex;
+  unsigned flags;
+  if (!Open(&error) || route_.GetLink(name, &ifindex, &flags) < 0) {
+    return "disconnected";
+  }
+  return (flags & IFF_UP) ? "connected" : "disconnected";
+}
+
+const char* TunnelManager::NewestStatus() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return newest_.empty() ? "disconnected" : StatusLocked(newest_);
+}
+
+bool TunnelManager::ReadPeers(const std::string* name,
+                              std::vector<PeerStatistics>* peers,
+                              std::string* error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = tunnels_.find(name ? *name : newest_);
+  if (it == tunnels_.end()) {
+    *error = "No tunnel to read statistics from";
+    return false;
+  }
+  return ReadPeersLocked(it->first, &it->second, peers, error);
+}
+
+bool TunnelManager::TryReadEachTunnel(
+    std::vector<PeerStatistics>* peers,
+    const std::function<void(const std::string& name, bool read)>& visit) {
+  std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return false;
+  }
+  for (auto& [name, tunnel] : tunnels_) {
+    std::string error;
+    visit(name, ReadPeersLocked(name, &tunnel, peers, &error));
+  }
+  return true;
+}
+
+bool TunnelManager::ReadPeersLocked(const std::string& name, Tunnel* tunnel,
+                                    std::vector<PeerStatistics>* peers,
+                                    std::string* error) {
+  int result = tunnel->userspace ? uapi_.GetPeers(name, peers)
+                                 : wireguard_.GetPeers(name, peers);
+  if (result < 0) {
+    *error = NetlinkError(result, "reading the device");
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  tunnel->rates.Update(
+      *peers,
+      std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+  return true;
+}
+
+}  // namespace wireguard_dart
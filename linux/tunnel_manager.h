@@ -0,0 +1,96 @@
+#ifndef WIREGUARD_DART_TUNNEL_MANAGER_H_
+#define WIREGUARD_DART_TUNNEL_MANAGER_H_
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "route_netlink.h"
+#include "tunnel_config.h"
+#include "uapi_device.h"
+#include "wireguard_core/peer_statistics.h"
+#include "wireguard_netlink.h"
+
+namespace wireguard_dart {
+
+// The tunnels of the plugin as kernel WireGuard links, each set up, brought
+// up and down with a few netlink messages. Without the kernel module a
+// tunnel runs on a userspace implementation instead, configured over its
+// UAPI socket; routes and addresses are the same either way. Method calls
+// are made from the plugin's worker thread, the statistics sampler reads from
+// the GLib main thread; a mutex keeps them apart. Needs CAP_NET_ADMIN.
+class TunnelManager {
+ public:
+  // Creates the link if needed and gives it config's keys, peers and
+  // addresses, leaving it down. A tunnel set up again gets the new config;
+  // a link created for a new tunnel is deleted again if the setup fails.
+  bool Setup(const std::string& name, std::string_view config, int* ifindex,
+             std::string* error);
+  // Brings the link up and routes the peers' allowed IPs through it.
+  bool Connect(const std::string& name, std::string* error);
+  // Brings the link down, which takes its routes with it. The link is kept
+  // for the next connect.
+  bool Disconnect(const std::string& name, std::string* error);
+  // "connected" while the link is up, "disconnected" otherwise.
+  const char* Status(const std::string& name);
+  // Status of the tunnel set up last, "disconnected" before any.
+  const char* NewestStatus();
+
+  // Reads the peers of the tunnel, or of the one set up last without a name,
+  // with their rates since the previous reading. See
+  // WireguardNetlink::GetPeers for how peers is reused.
+  bool ReadPeers(const std::string* name, std::vector<PeerStatistics>* peers,
+                 std::string* error);
+  // Reads every tunnel as ReadPeers, calling visit with whether it could be
+  // read. Does nothing and returns false while a method call has the tunnels,
+  // so the main thread never waits for a setup.
+  bool TryReadEachTunnel(
+      std::vector<PeerStatistics>* peers,
+      const std::function<void(const std::string& name, bool read)>& visit);
+
+ private:
+  struct Tunnel {
+    TunnelConfig config;
+    // The peers' allowed IPs, aggregated
+    std::vector<NetworkPrefix> routes;
+    // The address families the tunnel takes all traffic of, whose routes go
+    // to table behind the fwmark rules
+    std::vector<int> full_families;
+    // The tunnel's own routing table, also the fwmark of its packets, so
+    // that full tunnels do not share rules
+    uint32_t table = 0;
+    int ifindex = 0;
+    // Runs on UapiDevice rather than the kernel module
+    bool userspace = false;
+    PeerRateTracker rates;
+  };
+
+  bool Open(std::string* error);
+
+  // Creates the link, on the kernel module if it can
+  bool CreateLink(const std::string& name, Tunnel* tunnel, std::string* error);
+  // The lowest table from kFirstRouteTable no other tunnel has
+  uint32_t FreeTable() const;
+  bool SetupLocked(const std::string& name, std::string_view config,
+                   Tunnel* tunnel, std::string* error);
+  const char* StatusLocked(const std::string& name);
+  bool ReadPeersLocked(const std::string& name, Tunnel* tunnel,
+                       std::vector<PeerStatistics>* peers,
+                       std::string* error);
+
+  std::mutex mutex_;
+  bool opened_ = false;
+  bool kernel_ = false;
+  WireguardNetlink wireguard_;
+  UapiDevice uapi_;
+  RouteNetlink route_;
+  std::map<std::string, Tunnel> tunnels_;
+  std::string newest_;
+};
+
+}  // namespace wireguard_dart
+
+#endif  // WIREGUARD_DART_TUNNEL_MANAGER_H_
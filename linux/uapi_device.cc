@@ -0,0 +1,313 @@
+#include "uapi_device.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+extern char** environ;
+
+namespace wireguard_dart {
+
+namespace {
+
+// Where wireguard-go and the other implementations listen
+constexpr char kSocketDirectory[] = "/var/run/wireguard/";
+// How long a launched implementation gets to open its socket
+constexpr auto kLaunchTimeout = std::chrono::seconds(5);
+
+std::string SocketPath(const std::string& name) {
+  return kSocketDirectory + name + ".sock";
+}
+
+// The implementation to launch, see UapiDevice::Launch
+std::string Implementation() {
+  const char* configured = getenv("WG_QUICK_USERSPACE_IMPLEMENTATION");
+  if (configured != nullptr && configured[0] != '\0') {
+    return configured;
+  }
+  char executable[PATH_MAX];
+  ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable));
+  if (length > 0 && static_cast<size_t>(length) < sizeof(executable)) {
+    std::string bundled(executable, length);
+    bundled = bundled.substr(0, bundled.rfind('/') + 1) + "lib/wireguard-go";
+    if (access(bundled.c_str(), X_OK) == 0) {
+      return bundled;
+    }
+  }
+  return "wireguard-go";
+}
+
+void AppendHex(const uint8_t* data, size_t size, std::string* out) {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  for (size_t i = 0; i < size; i++) {
+    out->push_back(kDigits[data[i] >> 4]);
+    out->push_back(kDigits[data[i] & 0xf]);
+  }
+}
+
+bool ParseHex(std::string_view hex, uint8_t* out, size_t size) {
+  if (hex.size() != size * 2) {
+    return false;
+  }
+  auto digit = [](char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  for (size_t i = 0; i < size; i++) {
+    int high = digit(hex[i * 2]);
+    int low = digit(hex[i * 2 + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    out[i] = static_cast<uint8_t>(high << 4 | low);
+  }
+  return true;
+}
+
+uint64_t ParseU64(std::string_view value) {
+  uint64_t result = 0;
+  for (char c : value) {
+    if (c < '0' || c > '9') {
+      break;
+    }
+    result = result * 10 + static_cast<uint64_t>(c - '0');
+  }
+  return result;
+}
+
+// "192.0.2.1:51820" or "[2001:db8::1]:51820"
+void AppendEndpoint(const sockaddr_storage& endpoint, std::string* out) {
+  char address[INET6_ADDRSTRLEN];
+  if (endpoint.ss_family == AF_INET) {
+    auto in = reinterpret_cast<const sockaddr_in*>(&endpoint);
+    inet_ntop(AF_INET, &in->sin_addr, address, sizeof(address));
+    *out += address;
+    *out += ':' + std::to_string(ntohs(in->sin_port));
+  } else {
+    auto in6 = reinterpret_cast<const sockaddr_in6*>(&endpoint);
+    inet_ntop(AF_INET6, &in6->sin6_addr, address, sizeof(address));
+    *out += '[';
+    *out += address;
+    *out += "]:" + std::to_string(ntohs(in6->sin6_port));
+  }
+}
+
+void AppendPrefix(const NetworkPrefix& prefix, std::string* out) {
+  char address[INET6_ADDRSTRLEN];
+  inet_ntop(prefix.family, prefix.address, address, sizeof(address));
+  *out += address;
+  *out += '/' + std::to_string(prefix.prefix_length);
+}
+
+// Calls visit with each key=value line of reply, which ends with a blank one.
+template <typename Visit>
+void ForEachLine(std::string_view reply, Visit visit) {
+  while (!reply.empty()) {
+    size_t end = reply.find('\n');
+    std::string_view line = reply.substr(0, end);
+    reply = end == std::string_view::npos ? std::string_view()
+                                          : reply.substr(end + 1);
+    size_t equals = line.find('=');
+    if (equals != std::string_view::npos) {
+      visit(line.substr(0, equals), line.substr(equals + 1));
+    }
+  }
+}
+
+// The errno= a reply ends with, as a negative errno
+int ReplyError(std::string_view reply) {
+  int error = -EPROTO;
+  ForEachLine(reply, [&](std::string_view key, std::string_view value) {
+    if (key == "errno") {
+      error = -static_cast<int>(ParseU64(value));
+    }
+  });
+  return error;
+}
+
+}  // namespace
+
+bool UapiDevice::IsRunning(const std::string& name) {
+  struct stat info;
+  return stat(SocketPath(name).c_str(), &info) == 0 && S_ISSOCK(info.st_mode);
+}
+
+int UapiDevice::Launch(const std::string& name, std::string* error) {
+  if (IsRunning(name)) {
+    return 0;
+  }
+  std::string implementation = Implementation();
+  std::string name_arg = name;
+  char* argv[] = {implementation.data(), name_arg.data(), nullptr};
+  pid_t pid;
+  int result = posix_spawnp(&pid, implementation.c_str(), nullptr, nullptr,
+                            argv, environ);
+  if (result != 0) {
+    *error = "Neither the wireguard kernel module nor " + implementation +
+             " is available: " + strerror(result);
+    return -result;
+  }
+  // wireguard-go creates the interface and its socket, then daemonizes and
+  // exits
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      *error = std::string("waiting for ") + implementation + ": " +
+               strerror(errno);
+      return -errno;
+    }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    *error = implementation + " failed to start " + name;
+    return -EIO;
+  }
+  auto deadline = std::chrono::steady_clock::now() + kLaunchTimeout;
+  while (!IsRunning(name)) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      *error = implementation + " did not open " + SocketPath(name);
+      return -ETIMEDOUT;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return 0;
+}
+
+int UapiDevice::Exchange(const std::string& name, const std::string& request) {
+  std::string path = SocketPath(name);
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return -ENAMETOOLONG;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -errno;
+  }
+  int error = 0;
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+      0) {
+    error = -errno;
+  }
+  for (size_t sent = 0; error == 0 && sent < request.size();) {
+    ssize_t n = send(fd, request.data() + sent, request.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n < 0 && errno != EINTR) {
+      error = -errno;
+    } else if (n > 0) {
+      sent += static_cast<size_t>(n);
+    }
+  }
+  reply_.clear();
+  char buffer[4096];
+  while (error == 0 && (reply_.size() < 2 ||
+                        reply_.compare(reply_.size() - 2, 2, "\n\n") != 0)) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0 && errno != EINTR) {
+      error = -errno;
+    } else if (n == 0) {
+      error = -ECONNRESET;
+    } else if (n > 0) {
+      reply_.append(buffer, static_cast<size_t>(n));
+    }
+  }
+  close(fd);
+  return error;
+}
+
+int UapiDevice::SetDevice(const std::string& name, const TunnelConfig& config,
+                          uint32_t fwmark) {
+  request_ = "set=1\n";
+  if (config.has_private_key) {
+    request_ += "private_key=";
+    AppendHex(config.private_key, kWireguardKeyLength, &request_);
+    request_ += '\n';
+  }
+  if (config.has_listen_port) {
+    request_ += "listen_port=" + std::to_string(config.listen_port) + '\n';
+  }
+  request_ += "fwmark=" + std::to_string(fwmark) + '\n';
+  request_ += "replace_peers=true\n";
+  for (const PeerConfig& peer : config.peers) {
+    if (!peer.has_public_key) {
+      continue;
+    }
+    request_ += "public_key=";
+    AppendHex(peer.public_key, kWireguardKeyLength, &request_);
+    request_ += '\n';
+    if (peer.has_preshared_key) {
+      request_ += "preshared_key=";
+      AppendHex(peer.preshared_key, kWireguardKeyLength, &request_);
+      request_ += '\n';
+    }
+    if (peer.has_endpoint) {
+      request_ += "endpoint=";
+      AppendEndpoint(peer.endpoint, &request_);
+      request_ += '\n';
+    }
+    request_ += "persistent_keepalive_interval=" +
+                std::to_string(peer.persistent_keepalive) + '\n';
+    request_ += "replace_allowed_ips=true\n";
+    for (const NetworkPrefix& prefix : peer.allowed_ips) {
+      request_ += "allowed_ip=";
+      AppendPrefix(prefix, &request_);
+      request_ += '\n';
+    }
+  }
+  request_ += '\n';
+
+  int error = Exchange(name, request_);
+  return error < 0 ? error : ReplyError(reply_);
+}
+
+int UapiDevice::GetPeers(const std::string& name,
+                         std::vector<PeerStatistics>* peers) {
+  int error = Exchange(name, "get=1\n\n");
+  if (error < 0) {
+    return error;
+  }
+  // Peers are overwritten in place, as by WireguardNetlink::GetPeers
+  size_t count = 0;
+  PeerStatistics* peer = nullptr;
+  uint64_t handshake_sec = 0;
+  ForEachLine(reply_, [&](std::string_view key, std::string_view value) {
+    if (key == "public_key") {
+      if (count == peers->size()) {
+        peers->emplace_back();
+      }
+      peer = &(*peers)[count++];
+      *peer = PeerStatistics();
+      ParseHex(value, peer->public_key.data(), kWireguardKeyLength);
+    } else if (peer == nullptr) {
+      // The device's own keys and port
+    } else if (key == "rx_bytes") {
+      peer->rx_bytes = ParseU64(value);
+    } else if (key == "tx_bytes") {
+      peer->tx_bytes = ParseU64(value);
+    } else if (key == "last_handshake_time_sec") {
+      handshake_sec = ParseU64(value);
+      peer->last_handshake_ms = handshake_sec * 1000;
+    } else if (key == "last_handshake_time_nsec") {
+      peer->last_handshake_ms =
+          handshake_sec * 1000 + ParseU64(value) / 1000000;
+    }
+  });
+  peers->resize(count);
+  return ReplyError(reply_);
+}
+
+}  // namespace wireguard_dart
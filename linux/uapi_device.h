@@ -0,0 +1,42 @@
+#ifndef WIREGUARD_DART_UAPI_DEVICE_H_
+#define WIREGUARD_DART_UAPI_DEVICE_H_
+
+#include <string>
+#include <vector>
+
+#include "tunnel_config.h"
+#include "wireguard_core/peer_statistics.h"
+
+namespace wireguard_dart {
+
+// A userspace WireGuard device, wireguard-go or another implementation of
+// the cross-platform UAPI, for kernels without the wireguard module. The
+// implementation owns the TUN interface and the data plane; it is configured
+// and read over its UAPI socket with the same calls as WireguardNetlink.
+// Every call returns 0 or a negative errno.
+class UapiDevice {
+ public:
+  // Starts the implementation for an interface named name and waits until it
+  // is up. The binary is $WG_QUICK_USERSPACE_IMPLEMENTATION, as for wg-quick,
+  // else wireguard-go next to the app in lib/ or on the PATH.
+  static int Launch(const std::string& name, std::string* error);
+  // Whether an implementation is serving name already.
+  static bool IsRunning(const std::string& name);
+
+  int SetDevice(const std::string& name, const TunnelConfig& config,
+                uint32_t fwmark);
+  // As WireguardNetlink::GetPeers; the reply is read into a buffer that is
+  // kept between readings.
+  int GetPeers(const std::string& name, std::vector<PeerStatistics>* peers);
+
+ private:
+  // Sends request and reads the reply up to its blank line into reply_.
+  int Exchange(const std::string& name, const std::string& request);
+
+  std::string request_;
+  std::string reply_;
+};
+
+}  // namespace wireguard_dart
+
+#endif  // WIREGUARD_DART_UAPI_DEVICE_H_
@@ -5,6 +5,14 @@
 #include <sys/utsname.h>
 
 #include <cstring>
+#include <string>
+#include <vector>
+
+#include "statistics_sampler.h"
+#include "status_observer.h"
+#include "tunnel_manager.h"
+#include "wireguard_core/peer_statistics.h"
+#include "wireguard_core/wireguard_key.h"
 
 #define WIREGUARD_DART_PLUGIN(obj) \
   (G_TYPE_CHECK_INSTANCE_CAST((obj), wireguard_dart_plugin_get_type(), \
@@ -12,16 +20,332 @@
 
 struct _WireguardDartPlugin {
   GObject parent_instance;
+
+  // Runs the tunnel method calls one at a time and in order, off the main
+  // thread, as their netlink requests and a userspace launch block
+  GThreadPool* workers;
+  wireguard_dart::TunnelManager* tunnels;
+  wireguard_dart::StatusObserver* status_observer;
+  FlEventChannel* status_channel;
+  // Set by the listener, to get the events of each read as one list
+  bool status_batched;
+  wireguard_dart::StatisticsSampler* statistics_sampler;
+  FlEventChannel* statistics_channel;
+  // Reused by every statistics call on the worker, so reading peers does not
+  // allocate
+  std::vector<wireguard_dart::PeerStatistics>* peers;
+  std::vector<uint8_t>* encoded_peers;
 };
 
 G_DEFINE_TYPE(WireguardDartPlugin, wireguard_dart_plugin, g_object_get_type())
 
+// A method call on its way through the worker and back to the main thread,
+// holding a reference to both the plugin and the call
+struct MethodJob {
+  WireguardDartPlugin* self;
+  FlMethodCall* method_call;
+  FlMethodResponse* response;
+  // Set by a successful setupTunnel, for the status observer to watch
+  int watch_ifindex;
+};
+
+// The string argument name of a map of arguments, or nullptr.
+static const gchar* string_arg(FlValue* args, const gchar* name) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return nullptr;
+  }
+  FlValue* value = fl_value_lookup_string(args, name);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+    return nullptr;
+  }
+  return fl_value_get_string(value);
+}
+
+static FlMethodResponse* missing_arg_response(const gchar* name) {
+  g_autofree gchar* message =
+      g_strdup_printf("Argument '%s' is required", name);
+  return FL_METHOD_RESPONSE(
+      fl_method_error_response_new("INVALID_ARGUMENT", message, nullptr));
+}
+
+static FlMethodResponse* error_response(const gchar* code,
+                                        const std::string& message) {
+  return FL_METHOD_RESPONSE(
+      fl_method_error_response_new(code, message.c_str(), nullptr));
+}
+
+static FlMethodResponse* setup_tunnel(WireguardDartPlugin* self,
+                                      FlValue* args, int* watch_ifindex) {
+  const gchar* tunnel_name = string_arg(args, "tunnelName");
+  if (tunnel_name == nullptr) {
+    return missing_arg_response("tunnelName");
+  }
+  const gchar* cfg = string_arg(args, "cfg");
+  if (cfg == nullptr) {
+    return missing_arg_response("cfg");
+  }
+
+  int ifindex = 0;
+  std::string error;
+  if (!self->tunnels->Setup(tunnel_name, cfg, &ifindex, &error)) {
+    return error_response("SETUP_FAILED", error);
+  }
+  *watch_ifindex = ifindex;
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "ifindex", fl_value_new_int(ifindex));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+static FlMethodResponse* connect_tunnel(WireguardDartPlugin* self,
+                                        FlValue* args, bool connect) {
+  const gchar* tunnel_name = string_arg(args, "tunnelName");
+  if (tunnel_name == nullptr) {
+    return missing_arg_response("tunnelName");
+  }
+
+  std::string error;
+  bool done = connect ? self->tunnels->Connect(tunnel_name, &error)
+                      : self->tunnels->Disconnect(tunnel_name, &error);
+  if (!done) {
+    return error_response(connect ? "CONNECT_FAILED" : "DISCONNECT_FAILED",
+                          error);
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+static FlMethodResponse* tunnel_status(WireguardDartPlugin* self,
+                                       FlValue* args) {
+  // status() sends no tunnel name from Dart; the Windows argument is taken too
+  const gchar* tunnel_name = string_arg(args, "tunnelName");
+  if (tunnel_name == nullptr) {
+    tunnel_name = string_arg(args, "win32ServiceName");
+  }
+  const char* status =
+      tunnel_name != nullptr ? self->tunnels->Status(tunnel_name)
+                             : self->tunnels->NewestStatus();
+  g_autoptr(FlValue) result = fl_value_new_string(status);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+static FlMethodResponse* tunnel_statistics(WireguardDartPlugin* self,
+                                           FlValue* args) {
+  const gchar* tunnel_name = string_arg(args, "tunnelName");
+  std::string name = tunnel_name != nullptr ? tunnel_name : "";
+  std::string error;
+  if (!self->tunnels->ReadPeers(tunnel_name != nullptr ? &name : nullptr,
+                                self->peers, &error)) {
+    return error_response("STATISTICS_FAILED", error);
+  }
+
+  wireguard_dart::TunnelTotals totals = wireguard_dart::SumPeers(*self->peers);
+  g_autofree gchar* json = g_strdup_printf(
+      "{\"totalDownload\":%" G_GUINT64_FORMAT
+      ",\"totalUpload\":%" G_GUINT64_FORMAT
+      ",\"latestHandshake\":%" G_GUINT64_FORMAT "}",
+      totals.rx_bytes, totals.tx_bytes, totals.last_handshake_ms);
+  g_autoptr(FlValue) result = fl_value_new_string(json);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+static FlMethodResponse* peer_statistics(WireguardDartPlugin* self,
+                                         FlValue* args, bool binary) {
+  const gchar* tunnel_name = string_arg(args, "tunnelName");
+  std::string name = tunnel_name != nullptr ? tunnel_name : "";
+  std::string error;
+  if (!self->tunnels->ReadPeers(tunnel_name != nullptr ? &name : nullptr,
+                                self->peers, &error)) {
+    return error_response("STATISTICS_FAILED", error);
+  }
+  uint64_t now_ms = static_cast<uint64_t>(g_get_real_time() / 1000);
+
+  // Arrives in Dart as a Uint8List, read in place
+  if (binary) {
+    wireguard_dart::EncodePeerStatistics(*self->peers, now_ms,
+                                         self->encoded_peers);
+    g_autoptr(FlValue) result = fl_value_new_uint8_list(
+        self->encoded_peers->data(), self->encoded_peers->size());
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+  }
+
+  g_autoptr(FlValue) result = fl_value_new_map();
+  for (const auto& peer : *self->peers) {
+    FlValue* value = fl_value_new_map();
+    fl_value_set_string_take(value, "rxBytes",
+                             fl_value_new_int(peer.rx_bytes));
+    fl_value_set_string_take(value, "txBytes",
+                             fl_value_new_int(peer.tx_bytes));
+    fl_value_set_string_take(value, "latestHandshake",
+                             fl_value_new_int(peer.last_handshake_ms));
+    // Null for a peer that never completed a handshake
+    fl_value_set_string_take(
+        value, "handshakeAgeMs",
+        peer.last_handshake_ms != 0 && now_ms >= peer.last_handshake_ms
+            ? fl_value_new_int(now_ms - peer.last_handshake_ms)
+            : fl_value_new_null());
+    fl_value_set_string_take(value, "rxRate",
+                             fl_value_new_float(peer.rx_rate));
+    fl_value_set_string_take(value, "txRate",
+                             fl_value_new_float(peer.tx_rate));
+    fl_value_set_string_take(value, "rxRateEwma",
+                             fl_value_new_float(peer.rx_rate_ewma));
+    fl_value_set_string_take(value, "txRateEwma",
+                             fl_value_new_float(peer.tx_rate_ewma));
+    fl_value_set_string_take(
+        result, wireguard_dart::KeyToBase64(peer.public_key.data()).c_str(),
+        value);
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+static void send_statistics(
+    WireguardDartPlugin* self,
+    const wireguard_dart::StatisticsSampler::Changes& changes) {
+  g_autoptr(FlValue) event = fl_value_new_map();
+  for (const auto& [name, totals] : changes) {
+    FlValue* value = fl_value_new_map();
+    fl_value_set_string_take(value, "totalDownload",
+                             fl_value_new_int(totals.rx_bytes));
+    fl_value_set_string_take(value, "totalUpload",
+                             fl_value_new_int(totals.tx_bytes));
+    fl_value_set_string_take(value, "latestHandshake",
+                             fl_value_new_int(totals.last_handshake_ms));
+    fl_value_set_string_take(event, name.c_str(), value);
+  }
+  fl_event_channel_send(self->statistics_channel, event, nullptr, nullptr);
+}
+
+static FlMethodErrorResponse* statistics_listen_cb(FlEventChannel* channel,
+                                                   FlValue* args,
+                                                   gpointer user_data) {
+  WireguardDartPlugin* self = WIREGUARD_DART_PLUGIN(user_data);
+  // interfaceCounters is Windows only
+  FlValue* interval = args != nullptr &&
+                              fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                          ? fl_value_lookup_string(args, "intervalMs")
+                          : nullptr;
+  int64_t interval_ms = interval != nullptr &&
+                                fl_value_get_type(interval) == FL_VALUE_TYPE_INT
+                            ? fl_value_get_int(interval)
+                            : 1000;
+  self->statistics_sampler->Start(
+      static_cast<guint>(CLAMP(interval_ms, 100, G_MAXINT)));
+  return nullptr;
+}
+
+static FlMethodErrorResponse* statistics_cancel_cb(FlEventChannel* channel,
+                                                   FlValue* args,
+                                                   gpointer user_data) {
+  WIREGUARD_DART_PLUGIN(user_data)->statistics_sampler->Stop();
+  return nullptr;
+}
+
+// The ifindex goes in luid, the key Windows uses for the adapter.
+static FlValue* status_event_value(const wireguard_dart::StatusEvent& event) {
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "luid", fl_value_new_int(event.ifindex));
+  fl_value_set_string_take(value, "status",
+                           fl_value_new_string(event.status.c_str()));
+  if (!event.event.empty()) {
+    fl_value_set_string_take(value, "event",
+                             fl_value_new_string(event.event.c_str()));
+    fl_value_set_string_take(value, "prefix",
+                             fl_value_new_string(event.prefix.c_str()));
+  }
+  return value;
+}
+
+static void send_status_events(
+    WireguardDartPlugin* self,
+    const std::vector<wireguard_dart::StatusEvent>& events) {
+  if (self->status_batched) {
+    g_autoptr(FlValue) list = fl_value_new_list();
+    for (const auto& event : events) {
+      fl_value_append_take(list, status_event_value(event));
+    }
+    fl_event_channel_send(self->status_channel, list, nullptr, nullptr);
+    return;
+  }
+  for (const auto& event : events) {
+    g_autoptr(FlValue) value = status_event_value(event);
+    fl_event_channel_send(self->status_channel, value, nullptr, nullptr);
+  }
+}
+
+static FlMethodErrorResponse* status_listen_cb(FlEventChannel* channel,
+                                               FlValue* args,
+                                               gpointer user_data) {
+  WireguardDartPlugin* self = WIREGUARD_DART_PLUGIN(user_data);
+  FlValue* batched = args != nullptr &&
+                             fl_value_get_type(args) == FL_VALUE_TYPE_MAP
+                         ? fl_value_lookup_string(args, "batched")
+                         : nullptr;
+  self->status_batched = batched != nullptr &&
+                         fl_value_get_type(batched) == FL_VALUE_TYPE_BOOL &&
+                         fl_value_get_bool(batched);
+
+  std::string error;
+  if (!self->status_observer->Start(&error)) {
+    return fl_method_error_response_new("STATUS_FAILED", error.c_str(),
+                                        nullptr);
+  }
+  return nullptr;
+}
+
+static FlMethodErrorResponse* status_cancel_cb(FlEventChannel* channel,
+                                               FlValue* args,
+                                               gpointer user_data) {
+  WIREGUARD_DART_PLUGIN(user_data)->status_observer->Stop();
+  return nullptr;
+}
+
+// On the main thread, once the worker is done with the call.
+static gboolean method_job_done_cb(gpointer data) {
+  MethodJob* job = static_cast<MethodJob*>(data);
+  if (job->watch_ifindex != 0) {
+    job->self->status_observer->Watch(job->watch_ifindex);
+  }
+  fl_method_call_respond(job->method_call, job->response, nullptr);
+  g_object_unref(job->response);
+  g_object_unref(job->method_call);
+  g_object_unref(job->self);
+  delete job;
+  return G_SOURCE_REMOVE;
+}
+
+// The tunnel methods, on the worker.
+static void run_method_job(gpointer data, gpointer user_data) {
+  MethodJob* job = static_cast<MethodJob*>(data);
+  WireguardDartPlugin* self = job->self;
+  const gchar* method = fl_method_call_get_name(job->method_call);
+  FlValue* args = fl_method_call_get_args(job->method_call);
+  FlMethodResponse* response = nullptr;
+
+  if (strcmp(method, "setupTunnel") == 0) {
+    response = setup_tunnel(self, args, &job->watch_ifindex);
+  } else if (strcmp(method, "connect") == 0) {
+    response = connect_tunnel(self, args, true);
+  } else if (strcmp(method, "disconnect") == 0) {
+    response = connect_tunnel(self, args, false);
+  } else if (strcmp(method, "status") == 0) {
+    response = tunnel_status(self, args);
+  } else if (strcmp(method, "tunnelStatistics") == 0) {
+    response = tunnel_statistics(self, args);
+  } else if (strcmp(method, "peerStatistics") == 0) {
+    response = peer_statistics(self, args, false);
+  } else if (strcmp(method, "peerStatisticsBinary") == 0) {
+    response = peer_statistics(self, args, true);
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+  }
+
+  job->response = response;
+  g_main_context_invoke(nullptr, method_job_done_cb, job);
+}
+
 // Called when a method call is received from Flutter.
 static void wireguard_dart_plugin_handle_method_call(
     WireguardDartPlugin* self,
     FlMethodCall* method_call) {
-  g_autoptr(FlMethodResponse) response = nullptr;
-
   const gchar* method = fl_method_call_get_name(method_call);
 
   if (strcmp(method, "getPlatformVersion") == 0) {
@@ -29,15 +353,38 @@ static void wireguard_dart_plugin_handle_method_call(
     uname(&uname_data);
     g_autofree gchar *version = g_strdup_printf("Linux %s", uname_data.version);
     g_autoptr(FlValue) result = fl_value_new_string(version);
-    response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
-  } else {
-    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
   }
 
-  fl_method_call_respond(method_call, response, nullptr);
+  MethodJob* job = new MethodJob{
+      WIREGUARD_DART_PLUGIN(g_object_ref(self)),
+      FL_METHOD_CALL(g_object_ref(method_call)), nullptr, 0};
+  g_thread_pool_push(self->workers, job, nullptr);
 }
 
 static void wireguard_dart_plugin_dispose(GObject* object) {
+  WireguardDartPlugin* self = WIREGUARD_DART_PLUGIN(object);
+  // Every queued call holds a reference, so the worker has none left
+  if (self->workers != nullptr) {
+    g_thread_pool_free(self->workers, FALSE, TRUE);
+    self->workers = nullptr;
+  }
+  delete self->statistics_sampler;
+  self->statistics_sampler = nullptr;
+  g_clear_object(&self->statistics_channel);
+  delete self->peers;
+  self->peers = nullptr;
+  delete self->encoded_peers;
+  self->encoded_peers = nullptr;
+  delete self->status_observer;
+  self->status_observer = nullptr;
+  g_clear_object(&self->status_channel);
+  delete self->tunnels;
+  self->tunnels = nullptr;
+
   G_OBJECT_CLASS(wireguard_dart_plugin_parent_class)->dispose(object);
 }
 
@@ -45,7 +392,22 @@ static void wireguard_dart_plugin_class_init(WireguardDartPluginClass* klass) {
   G_OBJECT_CLASS(klass)->dispose = wireguard_dart_plugin_dispose;
 }
 
-static void wireguard_dart_plugin_init(WireguardDartPlugin* self) {}
+static void wireguard_dart_plugin_init(WireguardDartPlugin* self) {
+  // At most one thread at a time, so calls run in the order Dart made them
+  self->workers = g_thread_pool_new(run_method_job, nullptr, 1, FALSE, nullptr);
+  self->tunnels = new wireguard_dart::TunnelManager();
+  self->status_observer = new wireguard_dart::StatusObserver(
+      [self](const std::vector<wireguard_dart::StatusEvent>& events) {
+        send_status_events(self, events);
+      });
+  self->statistics_sampler = new wireguard_dart::StatisticsSampler(
+      self->tunnels,
+      [self](const wireguard_dart::StatisticsSampler::Changes& changes) {
+        send_statistics(self, changes);
+      });
+  self->peers = new std::vector<wireguard_dart::PeerStatistics>();
+  self->encoded_peers = new std::vector<uint8_t>();
+}
 
 static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
                            gpointer user_data) {
@@ -66,5 +428,19 @@ void wireguard_dart_plugin_register_with_registrar(FlPluginRegistrar* registrar)
                                             g_object_ref(plugin),
                                             g_object_unref);
 
+  plugin->status_channel =
+      fl_event_channel_new(fl_plugin_registrar_get_messenger(registrar),
+                           "wireguard_dart/status", FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(
+      plugin->status_channel, status_listen_cb, status_cancel_cb,
+      g_object_ref(plugin), g_object_unref);
+
+  plugin->statistics_channel =
+      fl_event_channel_new(fl_plugin_registrar_get_messenger(registrar),
+                           "wireguard_dart/statistics", FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(
+      plugin->statistics_channel, statistics_listen_cb, statistics_cancel_cb,
+      g_object_ref(plugin), g_object_unref);
+
   g_object_unref(plugin);
 }
@@ -0,0 +1,197 @@
+#include "wireguard_netlink.h"
+
+#include <errno.h>
+#include <linux/genetlink.h>
+#include <linux/time_types.h>
+#include <linux/wireguard.h>
+
+#include <cstring>
+
+namespace wireguard_dart {
+
+namespace {
+
+// Nested attribute lengths are 16 bits, so the peers of a large
+// configuration are split across messages, as wg(8) does.
+constexpr size_t kMaxMessageSize = 32 * 1024;
+
+NetlinkMessage GenericMessage(uint16_t family, uint8_t command,
+                              uint16_t flags) {
+  NetlinkMessage message(family, flags);
+  genlmsghdr header = {};
+  header.cmd = command;
+  header.version = 1;
+  message.PutHeader(&header, sizeof(header));
+  return message;
+}
+
+size_t EndpointSize(const sockaddr_storage& endpoint) {
+  return endpoint.ss_family == AF_INET ? sizeof(sockaddr_in)
+                                       : sizeof(sockaddr_in6);
+}
+
+// A nested attribute's own attributes
+void ForEachNested(const nlattr* nest,
+                   const std::function<void(const nlattr* attr)>& visit) {
+  ForEachAttr(AttrData(nest), AttrSize(nest), 0, visit);
+}
+
+}  // namespace
+
+int WireguardNetlink::Open() {
+  int error = socket_.Open(NETLINK_GENERIC);
+  if (error < 0) {
+    return error;
+  }
+
+  NetlinkMessage message = GenericMessage(GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+  message.PutString(CTRL_ATTR_FAMILY_NAME, WG_GENL_NAME);
+  error = socket_.Request(message, [this](const nlmsghdr* reply) {
+    ForEachAttr(NLMSG_DATA(reply), reply->nlmsg_len - NLMSG_HDRLEN,
+                GENL_HDRLEN, [this](const nlattr* attr) {
+                  if (AttrType(attr) == CTRL_ATTR_FAMILY_ID) {
+                    family_id_ = *static_cast<const uint16_t*>(AttrData(attr));
+                  }
+                });
+  });
+  if (error < 0) {
+    return error;
+  }
+  return family_id_ != 0 ? 0 : -ENOENT;
+}
+
+int WireguardNetlink::SetDevice(const std::string& name,
+                                const TunnelConfig& config, uint32_t fwmark) {
+  size_t peer_index = 0;
+  size_t allowed_ip_index = 0;
+  bool first = true;
+  do {
+    NetlinkMessage message = GenericMessage(family_id_, WG_CMD_SET_DEVICE, 0);
+    message.PutString(WGDEVICE_A_IFNAME, name);
+    if (first) {
+      message.PutU32(WGDEVICE_A_FLAGS, WGDEVICE_F_REPLACE_PEERS);
+      if (config.has_private_key) {
+        message.PutAttr(WGDEVICE_A_PRIVATE_KEY, config.private_key,
+                        kWireguardKeyLength);
+      }
+      if (config.has_listen_port) {
+        message.PutU16(WGDEVICE_A_LISTEN_PORT, config.listen_port);
+      }
+      message.PutU32(WGDEVICE_A_FWMARK, fwmark);
+    }
+
+    size_t peers = message.BeginNested(WGDEVICE_A_PEERS);
+    while (peer_index < config.peers.size() &&
+           message.size() < kMaxMessageSize) {
+      const PeerConfig& peer = config.peers[peer_index];
+      size_t peer_nest = message.BeginNested(0);
+      message.PutAttr(WGPEER_A_PUBLIC_KEY, peer.public_key,
+                      kWireguardKeyLength);
+      // A peer continued from the previous message only gets more allowed IPs
+      if (allowed_ip_index == 0) {
+        message.PutU32(WGPEER_A_FLAGS, WGPEER_F_REPLACE_ALLOWEDIPS);
+        if (peer.has_preshared_key) {
+          message.PutAttr(WGPEER_A_PRESHARED_KEY, peer.preshared_key,
+                          kWireguardKeyLength);
+        }
+        if (peer.has_endpoint) {
+          message.PutAttr(WGPEER_A_ENDPOINT, &peer.endpoint,
+                          EndpointSize(peer.endpoint));
+        }
+        message.PutU16(WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL,
+                       peer.persistent_keepalive);
+      }
+
+      size_t allowed_ips = message.BeginNested(WGPEER_A_ALLOWEDIPS);
+      for (; allowed_ip_index < peer.allowed_ips.size() &&
+             message.size() < kMaxMessageSize;
+           allowed_ip_index++) {
+        const NetworkPrefix& prefix = peer.allowed_ips[allowed_ip_index];
+        size_t allowed_ip = message.BeginNested(0);
+        message.PutU16(WGALLOWEDIP_A_FAMILY,
+                       static_cast<uint16_t>(prefix.family));
+        message.PutAttr(WGALLOWEDIP_A_IPADDR, prefix.address,
+                        prefix.family == AF_INET ? 4 : 16);
+        message.PutU8(WGALLOWEDIP_A_CIDR_MASK, prefix.prefix_length);
+        message.EndNested(allowed_ip);
+      }
+      message.EndNested(allowed_ips);
+      message.EndNested(peer_nest);
+
+      if (allowed_ip_index == peer.allowed_ips.size()) {
+        peer_index++;
+        allowed_ip_index = 0;
+      }
+    }
+    message.EndNested(peers);
+
+    int error = socket_.Request(message);
+    if (error < 0) {
+      return error;
+    }
+    first = false;
+  } while (peer_index < config.peers.size());
+  return 0;
+}
+
+int WireguardNetlink::GetPeers(const std::string& name,
+                               std::vector<PeerStatistics>* peers) {
+  NetlinkMessage message =
+      GenericMessage(family_id_, WG_CMD_GET_DEVICE, NLM_F_DUMP);
+  message.PutString(WGDEVICE_A_IFNAME, name);
+
+  size_t count = 0;
+  auto read_peer = [&](const nlattr* peer_nest) {
+    PeerStatistics peer;
+    ForEachNested(peer_nest, [&](const nlattr* attr) {
+      switch (AttrType(attr)) {
+        case WGPEER_A_PUBLIC_KEY:
+          if (AttrSize(attr) == kWireguardKeyLength) {
+            memcpy(peer.public_key.data(), AttrData(attr), kWireguardKeyLength);
+          }
+          break;
+        case WGPEER_A_RX_BYTES:
+          memcpy(&peer.rx_bytes, AttrData(attr), sizeof(uint64_t));
+          break;
+        case WGPEER_A_TX_BYTES:
+          memcpy(&peer.tx_bytes, AttrData(attr), sizeof(uint64_t));
+          break;
+        case WGPEER_A_LAST_HANDSHAKE_TIME: {
+          __kernel_timespec time;
+          memcpy(&time, AttrData(attr), sizeof(time));
+          peer.last_handshake_ms =
+              static_cast<uint64_t>(time.tv_sec) * 1000 +
+              static_cast<uint64_t>(time.tv_nsec) / 1000000;
+          break;
+        }
+      }
+    });
+    // A peer with many allowed IPs continues in the next part, its key first
+    // again; its counters came with the first part
+    if (count > 0 && (*peers)[count - 1].public_key == peer.public_key) {
+      return;
+    }
+    if (count < peers->size()) {
+      (*peers)[count] = peer;
+    } else {
+      peers->push_back(peer);
+    }
+    count++;
+  };
+
+  int error = socket_.Request(message, [&](const nlmsghdr* reply) {
+    if (reply->nlmsg_type != family_id_) {
+      return;
+    }
+    ForEachAttr(NLMSG_DATA(reply), reply->nlmsg_len - NLMSG_HDRLEN,
+                GENL_HDRLEN, [&](const nlattr* attr) {
+                  if (AttrType(attr) == WGDEVICE_A_PEERS) {
+                    ForEachNested(attr, read_peer);
+                  }
+                });
+  });
+  peers->resize(count);
+  return error;
+}
+
+}  // namespace wireguard_dart
@@ -0,0 +1,38 @@
+#ifndef WIREGUARD_DART_WIREGUARD_NETLINK_H_
+#define WIREGUARD_DART_WIREGUARD_NETLINK_H_
+
+#include <string>
+#include <vector>
+
+#include "netlink.h"
+#include "tunnel_config.h"
+#include "wireguard_core/peer_statistics.h"
+
+namespace wireguard_dart {
+
+// The kernel WireGuard generic netlink family, the interface wg(8) uses.
+class WireguardNetlink {
+ public:
+  // 0 or a negative errno; -ENOENT if the wireguard module is not loaded.
+  int Open();
+
+  // Replaces the device's keys, port and peers with those of config, in one
+  // message unless the peers need more. fwmark, unless 0, marks the tunnel's
+  // own packets so policy routing can keep them out of it.
+  int SetDevice(const std::string& name, const TunnelConfig& config,
+                uint32_t fwmark);
+
+  // Reads the counters of the device's peers into peers with one
+  // WG_CMD_GET_DEVICE dump, however many parts it comes in. peers is
+  // overwritten in place, so a buffer reused between readings allocates
+  // nothing once it has grown to the number of peers.
+  int GetPeers(const std::string& name, std::vector<PeerStatistics>* peers);
+
+ private:
+  NetlinkSocket socket_;
+  uint16_t family_id_ = 0;
+};
+
+}  // namespace wireguard_dart
+
+#endif  // WIREGUARD_DART_WIREGUARD_NETLINK_H_
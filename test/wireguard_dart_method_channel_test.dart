@@ -1,5 +1,20 @@
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'package:flutter/foundation.dart';
 import 'package:flutter/services.dart';
 import 'package:flutter_test/flutter_test.dart';
+import 'package:wireguard_dart/adapter_event_type.dart';
+import 'package:wireguard_dart/adapter_log_mode.dart';
+import 'package:wireguard_dart/adapter_status.dart';
+import 'package:wireguard_dart/connection_status.dart';
+import 'package:wireguard_dart/cumulative_statistics.dart';
+import 'package:wireguard_dart/log_level.dart';
+import 'package:wireguard_dart/peer_activation.dart';
+import 'package:wireguard_dart/split_tunnel_mode.dart';
+import 'package:wireguard_dart/throughput_result.dart';
+import 'package:wireguard_dart/tunnel_config.dart';
+import 'package:wireguard_dart/tunnel_group_result.dart';
 import 'package:wireguard_dart/wireguard_dart_method_channel.dart';
 
 void main() {
@@ -15,12 +30,230 @@ void main() {
           return null;
         case 'setupTunnel':
           return null;
+        case 'setupAndConnect':
+          expect(call.arguments, {
+            'bundleId': 'bundleId',
+            'tunnelName': 'tunnelName',
+            'cfg': 'cfg',
+            'timeoutMs': 5000,
+            'operationId': 3,
+          });
+          return {'luid': 1};
+        case 'cancelOperation':
+          return call.arguments['operationId'] == 3;
         case 'status':
           return null;
+        case 'statusAll':
+          return {
+            'tunnelName': {
+              'luid': 42,
+              'status': 'connected',
+              'changedAt': 1700000000000,
+              'changedAtMonotonicUs': 123456,
+              'latestHandshake': 1700000001000,
+            },
+            'other': {'status': 'disconnected'},
+          };
         case 'connect':
+          if (call.arguments['activation'] != null) {
+            expect(call.arguments, {
+              'tunnelName': 'tunnelName',
+              'activation': {
+                'batchSize': 50,
+                'intervalMs': 250,
+                'priority': [Uint8List(32)]
+              }
+            });
+          } else if (call.arguments['precheck'] != null) {
+            expect(call.arguments, {'tunnelName': 'tunnelName', 'precheck': true});
+          } else if (call.arguments['prefetchHosts'] != null) {
+            expect(call.arguments, {
+              'tunnelName': 'tunnelName',
+              'prefetchHosts': ['api.example.com', 'cdn.example.com']
+            });
+          } else if (call.arguments['correlationId'] != null) {
+            expect(call.arguments, {'tunnelName': 'tunnelName', 'warmUp': true, 'correlationId': 'call-7'});
+          }
           return null;
         case 'disconnect':
           return null;
+        case 'connectTunnels':
+          expect(call.arguments, {
+            'tunnelNames': ['eu', 'us'],
+            'warmUp': true
+          });
+          return {
+            'elapsedMs': 340,
+            'tunnels': {
+              'eu': {'elapsedMs': 120},
+              'us': {'elapsedMs': 340, 'errorCode': 'ADAPTER_NOT_FOUND', 'errorMessage': 'Adapter not found'},
+            },
+          };
+        case 'disconnectTunnels':
+          expect(call.arguments, {
+            'tunnelNames': ['eu']
+          });
+          return {
+            'elapsedMs': 15,
+            'tunnels': {
+              'eu': {'elapsedMs': 15}
+            },
+          };
+        case 'getCumulativeStatistics':
+          expect(call.arguments, {
+            'tunnelNames': ['eu'],
+            'reset': true
+          });
+          return {
+            'eu': {
+              'rxBytes': 3000,
+              'txBytes': 1000,
+              'sinceMs': 1700000000000,
+              'updatedMs': 1700000600000,
+              'peers': {
+                'key=': {'rxBytes': 3000, 'txBytes': 1000, 'sinceMs': 1700000000000, 'updatedMs': 1700000600000},
+              },
+            },
+          };
+        case 'installTunnelService':
+          expect(call.arguments, {'tunnelName': 'tunnelName', 'cfg': 'cfg'});
+          return null;
+        case 'setSplitTunnel':
+          expect(call.arguments, {
+            'tunnelName': 'tunnelName',
+            'mode': 'include',
+            'apps': ['S-1-15-2-1']
+          });
+          return null;
+        case 'setAdapterLogging':
+          expect(call.arguments, {'tunnelName': 'tunnelName', 'mode': 'onWithPrefix'});
+          return null;
+        case 'getAdapterLog':
+          expect(call.arguments, {'tunnelName': 'tunnelName', 'maxLines': 2});
+          return ['[tunnelName] [info] Handshake for peer 1 did not complete', '[tunnelName] [warn] Sending handshake'];
+        case 'setFailoverGroup':
+          expect(call.arguments, {'primaryTunnel': 'eu', 'standbyTunnel': 'us'});
+          return null;
+        case 'removeFailoverGroup':
+          return call.arguments['tunnelName'] == 'eu';
+        case 'runThroughputTest':
+          expect(call.arguments, {
+            'tunnelName': 'tunnelName',
+            'target': '10.0.0.1:9',
+            'durationMs': 2000,
+            'protocol': 'udp',
+          });
+          return {
+            'streams': 4,
+            'elapsedMs': 2000,
+            'bytesSent': 25000000,
+            'bytesDelivered': 25000000,
+            'goodputBps': 100000000,
+            'sendErrors': 3,
+            'samples': [
+              {'elapsedMs': 1000, 'bytesSent': 12500000, 'txBytes': 13000000, 'rxBytes': 0},
+              {'elapsedMs': 2000, 'bytesSent': 12500000},
+            ],
+          };
+        case 'setupTunnelCompiled':
+          expect(call.arguments, {
+            'bundleId': 'bundleId',
+            'tunnelName': 'site2',
+            'configHandle': 7,
+            'privateKey': 'key=',
+            'addresses': ['10.0.0.2/32', 'fd00::2/128'],
+            'listenPort': 51821,
+          });
+          return {'luid': 12345};
+        case 'exportTunnelConfiguration':
+          expect(call.arguments['redactKeys'], isTrue);
+          if (call.arguments['format'] == 'ini') {
+            return '[Interface]\n# PrivateKey = (redacted)\n';
+          }
+          return {
+            'listenPort': 51820,
+            'peers': [
+              {
+                'publicKey': Uint8List(32),
+                'endpoint': Uint8List.fromList([198, 51, 100, 7]),
+                'endpointPort': 51820,
+                'allowedIps': Uint8List.fromList([4, 8, 10, 0, 0, 0, 6, 64, 0xfd, ...List.filled(15, 0)]),
+              },
+            ],
+          };
+        case 'verifyTunnelConfiguration':
+          return {
+            'inSync': false,
+            'hash': 1,
+            'expectedHash': 2,
+            'interfaceChanged': false,
+            'missingPeers': <Object?>[],
+            'unexpectedPeers': <Object?>['dW5leHBlY3RlZA=='],
+            'changedPeers': <Object?>[],
+          };
+        case 'getMetrics':
+          return '# EOF';
+        case 'getStartupTrace':
+          return [
+            {'subsystem': 'plugin', 'atUs': 0, 'tookUs': 40},
+            {'subsystem': 'library', 'atUs': 350000, 'tookUs': 12000},
+          ];
+        case 'startTelemetryExport':
+          expect(call.arguments, {
+            'host': '192.0.2.10',
+            'port': 8125,
+            'intervalMs': 30000,
+            'maxDatagrams': 16,
+            'minLevel': 'error',
+          });
+          return null;
+        case 'getMemoryStats':
+          return {
+            'lowMemory': true,
+            'parsedConfigBytes': 0,
+            'wireBufferBytes': 512,
+            'statisticsBytes': 4096,
+            'logBytes': 65536,
+            'cacheBytes': 64,
+            'totalBytes': 70208,
+            'workingSetBytes': 20000000,
+            'tunnels': {
+              'tunnelName': {'parsedConfigBytes': 0, 'wireBufferBytes': 512, 'cacheBytes': 64},
+            },
+            'phases': {
+              'setConfiguration': {'lastWorkingSetDelta': -4096, 'maxWorkingSetDelta': 8192},
+            },
+          };
+        case 'setLowMemoryMode':
+          expect(call.arguments, {'enabled': true});
+          return null;
+        case 'validateConfig':
+          return call.arguments['cfg'] == 'valid'
+              ? {'valid': true, 'configurationSize': 448, 'peerCount': 2, 'routeCount': 3, 'elapsedUs': 12}
+              : {'valid': false, 'errorLine': 4, 'errorColumn': 14, 'elapsedUs': 9};
+        case 'addPeers':
+          expect(call.arguments['tunnelName'], 'hub');
+          expect(call.arguments['peers'], [
+            {
+              'publicKey': Uint8List(32),
+              'allowedIps': Uint8List.fromList([4, 32, 10, 0, 0, 2]),
+            }
+          ]);
+          return null;
+        case 'removePeers':
+          expect(call.arguments, {
+            'tunnelName': 'hub',
+            'publicKeys': [Uint8List(32)],
+          });
+          return null;
+        case 'resolvePeerForAddresses':
+          expect(call.arguments, {
+            'addresses': ['10.0.0.2', '8.8.8.8']
+          });
+          return [
+            {'tunnelName': 'wg0', 'publicKey': 'key'},
+            null
+          ];
         default:
           throw MissingPluginException();
       }
@@ -34,4 +267,277 @@ void main() {
   test('getPlatformVersion', () async {
     await platform.disconnect(tunnelName: 'tunnelName');
   });
+
+  test('installTunnelService sends the tunnel name and configuration', () async {
+    await platform.installTunnelService(tunnelName: 'tunnelName', cfg: 'cfg');
+  });
+
+  test('setSplitTunnel sends the mode by name', () async {
+    await platform.setSplitTunnel(tunnelName: 'tunnelName', mode: SplitTunnelMode.include, apps: ['S-1-15-2-1']);
+  });
+
+  test('adapter logging sends the mode by name and the log comes back as lines', () async {
+    await platform.setAdapterLogging(tunnelName: 'tunnelName', mode: AdapterLogMode.onWithPrefix);
+    expect(await platform.getAdapterLog(tunnelName: 'tunnelName', maxLines: 2), hasLength(2));
+  });
+
+  test('failover groups are set by primary and standby and removed by either', () async {
+    await platform.setFailoverGroup(primaryTunnel: 'eu', standbyTunnel: 'us');
+    expect(await platform.removeFailoverGroup(tunnelName: 'eu'), isTrue);
+    expect(await platform.removeFailoverGroup(tunnelName: 'asia'), isFalse);
+  });
+
+  test('runThroughputTest sends the duration in milliseconds and decodes the samples', () async {
+    final result = await platform.runThroughputTest(
+        tunnelName: 'tunnelName',
+        target: '10.0.0.1:9',
+        duration: const Duration(seconds: 2),
+        protocol: ThroughputProtocol.udp);
+    expect(result.goodputBps, 100000000);
+    expect(result.sendErrors, 3);
+    expect(result.bytesRetransmitted, isNull);
+    expect(result.samples, hasLength(2));
+    expect(result.samples[0].txBytes, 13000000);
+    expect(result.samples[1].txBytes, isNull);
+  });
+
+  test('verifyTunnelConfiguration decodes the drift', () async {
+    final drift = await platform.verifyTunnelConfiguration(tunnelName: 'tunnelName');
+    expect(drift.inSync, isFalse);
+    expect(drift.unexpectedPeers, ['dW5leHBlY3RlZA==']);
+    expect(drift.missingPeers, isEmpty);
+  });
+
+  test('statusAll decodes every tunnel', () async {
+    final statuses = await platform.statusAll();
+    expect(statuses.keys, unorderedEquals(['tunnelName', 'other']));
+    final tunnel = statuses['tunnelName']!;
+    expect(tunnel.status, ConnectionStatus.connected);
+    expect(tunnel.luid, 42);
+    expect(tunnel.changedAt, DateTime.fromMillisecondsSinceEpoch(1700000000000));
+    expect(tunnel.changedAtMonotonicUs, 123456);
+    expect(tunnel.latestHandshake, DateTime.fromMillisecondsSinceEpoch(1700000001000));
+    final other = statuses['other']!;
+    expect(other.status, ConnectionStatus.disconnected);
+    expect(other.luid, isNull);
+    expect(other.latestHandshake, isNull);
+  });
+
+  test('statusStream on Windows shares one routed listen and dispatches events by subscription', () async {
+    debugDefaultTargetPlatformOverride = TargetPlatform.windows;
+    addTearDown(() => debugDefaultTargetPlatformOverride = null);
+    final messenger = TestDefaultBinaryMessengerBinding.instance.defaultBinaryMessenger;
+    final subscribed = <Map>[];
+    final unsubscribed = <Object?>[];
+    messenger.setMockMethodCallHandler(channel, (call) async {
+      if (call.method == 'subscribeStatus') subscribed.add(call.arguments as Map);
+      if (call.method == 'unsubscribeStatus') unsubscribed.add(call.arguments['subscription']);
+      return null;
+    });
+    final listens = <Object?>[];
+    var cancels = 0;
+    late MockStreamHandlerEventSink sink;
+    messenger.setMockStreamHandler(
+        platform.statusChannel,
+        MockStreamHandler.inline(onListen: (arguments, events) {
+          listens.add(arguments);
+          sink = events;
+        }, onCancel: (arguments) => cancels++));
+    addTearDown(() => messenger.setMockStreamHandler(platform.statusChannel, null));
+
+    final tunnelEvents = <AdapterStatus>[];
+    final readyEvents = <AdapterStatus>[];
+    final tunnel = platform.statusStream(tunnelNames: ['office']).listen(tunnelEvents.add);
+    final ready = platform.statusStream(luids: [7], events: {AdapterEventType.ready}).listen(readyEvents.add);
+    await pumpEventQueue();
+
+    expect(listens, [
+      {'batched': true, 'routed': true}
+    ]);
+    final tunnelId = subscribed[0]['subscription'] as int;
+    final readyId = subscribed[1]['subscription'] as int;
+    expect(tunnelId, isNot(readyId));
+    expect(subscribed[0], {
+      'subscription': tunnelId,
+      'tunnelNames': ['office']
+    });
+    expect(subscribed[1], {
+      'subscription': readyId,
+      'luids': [7],
+      'events': ['ready']
+    });
+
+    sink.success([
+      {
+        'luid': 7,
+        'status': 'connected',
+        'subscriptions': [tunnelId]
+      },
+      {
+        'luid': 7,
+        'status': 'connected',
+        'event': 'ready',
+        'timestamp': 1700000000000000,
+        'subscriptions': [tunnelId, readyId]
+      },
+      // Of another engine's subscription
+      {
+        'luid': 8,
+        'status': 'connected',
+        'subscriptions': [tunnelId + readyId]
+      },
+    ]);
+    await pumpEventQueue();
+    expect(tunnelEvents.map((event) => event.isReady), [false, true]);
+    expect(readyEvents.single.readyAt, DateTime.fromMicrosecondsSinceEpoch(1700000000000000));
+
+    await tunnel.cancel();
+    expect(unsubscribed, [tunnelId]);
+    expect(cancels, 0);
+    // The last subscription cancels the listen, which drops the subscriptions natively
+    await ready.cancel();
+    expect(unsubscribed, [tunnelId]);
+    expect(cancels, 1);
+  });
+
+  test('exportTunnelConfiguration answers the text or decodes the values', () async {
+    final text = await platform.exportTunnelConfiguration(tunnelName: 'tunnelName');
+    expect(text, startsWith('[Interface]'));
+
+    final config = await platform.exportTunnelConfigurationStructured(tunnelName: 'tunnelName');
+    expect(config.privateKey, isNull);
+    expect(config.listenPort, 51820);
+    final peer = config.peers.single;
+    expect(peer.endpointAddress, [198, 51, 100, 7]);
+    expect(peer.allowedIps.map((prefix) => prefix.prefixLength), [8, 64]);
+    expect(peer.allowedIps[1].address.length, 16);
+  });
+
+  test('getMemoryStats decodes tunnels and phases', () async {
+    await platform.setLowMemoryMode(enabled: true);
+    final stats = await platform.getMemoryStats();
+    expect(stats.lowMemory, isTrue);
+    expect(stats.tunnels['tunnelName']?.wireBufferBytes, 512);
+    expect(stats.phases['setConfiguration']?.lastWorkingSetDelta, -4096);
+  });
+
+  test('getStartupTrace decodes the subsystems in order', () async {
+    final entries = await platform.getStartupTrace();
+    expect(entries.map((entry) => entry.subsystem), ['plugin', 'library']);
+    expect(entries[1].atUs, 350000);
+    expect(entries[1].tookUs, 12000);
+  });
+
+  test('startTelemetryExport sends the interval in milliseconds', () async {
+    await platform.startTelemetryExport(
+      host: '192.0.2.10',
+      port: 8125,
+      interval: const Duration(seconds: 30),
+      maxDatagramsPerInterval: 16,
+      minLevel: LogLevel.error,
+    );
+  });
+
+  test('validateConfig decodes sizes or the error position', () async {
+    final valid = await platform.validateConfig(cfg: 'valid');
+    expect(valid.valid, isTrue);
+    expect(valid.peerCount, 2);
+    expect(valid.routeCount, 3);
+    expect(valid.errorLine, isNull);
+
+    final invalid = await platform.validateConfig(cfg: 'invalid');
+    expect(invalid.valid, isFalse);
+    expect(invalid.errorLine, 4);
+    expect(invalid.errorColumn, 14);
+    expect(invalid.configurationSize, isNull);
+  });
+
+  test('resolvePeerForAddresses keeps the order and the addresses without a peer', () async {
+    final peers = await platform.resolvePeerForAddresses(['10.0.0.2', '8.8.8.8']);
+    expect(peers, hasLength(2));
+    expect(peers[0]?.tunnelName, 'wg0');
+    expect(peers[0]?.publicKey, 'key');
+    expect(peers[1], isNull);
+  });
+
+  test('addPeers and removePeers send peers as values and keys as bytes', () async {
+    await platform.addPeers(tunnelName: 'hub', peers: [
+      TunnelPeerConfig(publicKey: Uint8List(32), allowedIps: [IpPrefix(Uint8List.fromList([10, 0, 0, 2]), 32)]),
+    ]);
+    await platform.removePeers(tunnelName: 'hub', publicKeys: [Uint8List(32)]);
+  });
+
+  test('setupAndConnect sends the timeout and operation id, cancelOperation the id', () async {
+    final result = await platform.setupAndConnect(
+        bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'cfg', timeoutMs: 5000, operationId: 3);
+    expect(result?['luid'], 1);
+    expect(await platform.cancelOperation(operationId: 3), isTrue);
+    expect(await platform.cancelOperation(operationId: 4), isFalse);
+  });
+
+  test('connect sends the correlation id', () async {
+    await platform.connect(tunnelName: 'tunnelName', warmUp: true, correlationId: 'call-7');
+  });
+
+  test('connect sends the hostnames to prefetch', () async {
+    await platform.connect(tunnelName: 'tunnelName', prefetchHosts: ['api.example.com', 'cdn.example.com']);
+  });
+
+  test('connect asks for the precheck', () async {
+    await platform.connect(tunnelName: 'tunnelName', precheck: true);
+  });
+
+  test('connect sends the peer activation', () async {
+    final activation =
+        PeerActivation(batchSize: 50, interval: const Duration(milliseconds: 250), priority: [Uint8List(32)]);
+    await platform.connect(tunnelName: 'tunnelName', activation: activation);
+  });
+
+  test('connectTunnels answers how each tunnel did', () async {
+    final result = await platform.connectTunnels(tunnelNames: ['eu', 'us'], warmUp: true);
+    expect(result.elapsedMs, 340);
+    expect(result.succeeded, isFalse);
+    expect(result.tunnels['eu']!.succeeded, isTrue);
+    expect(result.tunnels['eu']!.elapsedMs, 120);
+    expect(result.tunnels['us']!.errorCode, 'ADAPTER_NOT_FOUND');
+  });
+
+  test('disconnectTunnels answers how each tunnel did', () async {
+    final result = await platform.disconnectTunnels(tunnelNames: ['eu']);
+    expect(result, isA<TunnelGroupResult>());
+    expect(result.succeeded, isTrue);
+    expect(result.tunnels['eu']!.toJson(), {'elapsedMs': 15});
+  });
+
+  test('getCumulativeStatistics answers the totals by tunnel and peer', () async {
+    final result = await platform.getCumulativeStatistics(tunnelNames: ['eu'], reset: true);
+    expect(result['eu'], isA<CumulativeStatistics>());
+    expect(result['eu']!.totals.rxBytes, 3000);
+    expect(result['eu']!.totals.updatedMs, 1700000600000);
+    expect(result['eu']!.peers['key=']!.txBytes, 1000);
+  });
+
+  test('setupTunnelCompiled sends the overrides of the template', () async {
+    final result = await platform.setupTunnelCompiled(
+        bundleId: 'bundleId',
+        tunnelName: 'site2',
+        configHandle: 7,
+        privateKey: 'key=',
+        addresses: ['10.0.0.2/32', 'fd00::2/128'],
+        listenPort: 51821);
+    expect(result?['luid'], 12345);
+  });
+
+  test('bulk calls fall back to the main channel', () async {
+    expect(await platform.getMetrics(), '# EOF');
+  });
+
+  test('Windows methods match the Dart method list', () {
+    final header = File('windows/wireguard_methods.h').readAsStringSync();
+    final windowsMethods = RegExp(r'X\(\w+, "(\w+)"\)').allMatches(header).map((match) => match.group(1)!).toSet();
+    final dartMethods = WireguardMethodChannelMethod.values.map((method) => method.value).toSet();
+
+    expect(windowsMethods, isNotEmpty);
+    expect(windowsMethods, dartMethods);
+  });
 }
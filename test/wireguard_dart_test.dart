@@ -1,11 +1,37 @@
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'package:flutter/services.dart';
 import 'package:flutter_test/flutter_test.dart';
 import 'package:mockito/annotations.dart';
 import 'package:mockito/mockito.dart';
 import 'package:plugin_platform_interface/plugin_platform_interface.dart';
+import 'package:wireguard_dart/adapter_event_type.dart';
+import 'package:wireguard_dart/adapter_log_mode.dart';
+import 'package:wireguard_dart/config_validation.dart';
 import 'package:wireguard_dart/connection_status.dart';
+import 'package:wireguard_dart/counter_snapshot.dart';
+import 'package:wireguard_dart/cumulative_statistics.dart';
 import 'package:wireguard_dart/key_pair.dart';
+import 'package:wireguard_dart/log_level.dart';
+import 'package:wireguard_dart/log_record.dart';
+import 'package:wireguard_dart/log_overflow_policy.dart';
 import 'package:wireguard_dart/adapter_status.dart';
+import 'package:wireguard_dart/peer_activation.dart';
+import 'package:wireguard_dart/peer_statistics.dart';
+import 'package:wireguard_dart/peer_statistics_view.dart';
+import 'package:wireguard_dart/phase_stats.dart';
+import 'package:wireguard_dart/resolved_peer.dart';
+import 'package:wireguard_dart/split_tunnel_mode.dart';
+import 'package:wireguard_dart/startup_trace_entry.dart';
+import 'package:wireguard_dart/statistics_history_view.dart';
+import 'package:wireguard_dart/throughput_result.dart';
+import 'package:wireguard_dart/tunnel_config.dart';
+import 'package:wireguard_dart/tunnel_group_result.dart';
+import 'package:wireguard_dart/tunnel_statistics.dart';
+import 'package:wireguard_dart/tunnel_status.dart';
 import 'package:wireguard_dart/wireguard_dart.dart';
+import 'package:wireguard_dart/wireguard_dart_ffi.dart';
 import 'package:wireguard_dart/wireguard_dart_platform_interface.dart';
 
 import 'wireguard_dart_test.mocks.dart' as base_mock;
@@ -35,6 +61,70 @@ void main() {
       verify(mockWireGuardDartPlatform.generateKeyPair()).called(1);
     });
 
+    test('should generate key pairs in one batch', () async {
+      final keyPairs = [KeyPair('publicKey1', 'privateKey1'), KeyPair('publicKey2', 'privateKey2')];
+      when(mockWireGuardDartPlatform.generateKeyPairs(2)).thenAnswer((_) async => keyPairs);
+
+      final result = await wireguardDart.generateKeyPairs(2);
+
+      expect(result, keyPairs);
+      verify(mockWireGuardDartPlatform.generateKeyPairs(2)).called(1);
+    });
+
+    test('should generate key pairs as binary records', () async {
+      final records = Uint8List(128);
+      when(mockWireGuardDartPlatform.generateKeyPairsBinary(2)).thenAnswer((_) async => records);
+
+      final result = await wireguardDart.generateKeyPairsBinary(2);
+
+      expect(result.length, 128);
+      verify(mockWireGuardDartPlatform.generateKeyPairsBinary(2)).called(1);
+    });
+
+    test('should generate a key pair as bytes', () async {
+      when(mockWireGuardDartPlatform.generateKeyPairBinary()).thenAnswer((_) async => Uint8List(64));
+
+      final result = await wireguardDart.generateKeyPairBinary();
+
+      expect(result.length, 64);
+      verify(mockWireGuardDartPlatform.generateKeyPairBinary()).called(1);
+    });
+
+    test('should derive a public key from private key bytes', () async {
+      final privateKey = Uint8List(32);
+      when(mockWireGuardDartPlatform.derivePublicKeyBinary(privateKey)).thenAnswer((_) async => Uint8List(32));
+
+      final result = await wireguardDart.derivePublicKeyBinary(privateKey);
+
+      expect(result.length, 32);
+      verify(mockWireGuardDartPlatform.derivePublicKeyBinary(privateKey)).called(1);
+    });
+
+    test('should generate preshared keys in one batch', () async {
+      when(mockWireGuardDartPlatform.generatePresharedKeys(2)).thenAnswer((_) async => ['psk1', 'psk2']);
+      when(mockWireGuardDartPlatform.generatePresharedKeysBinary(2)).thenAnswer((_) async => Uint8List(64));
+
+      expect(await wireguardDart.generatePresharedKeys(2), ['psk1', 'psk2']);
+      expect((await wireguardDart.generatePresharedKeysBinary(2)).length, 64);
+      verify(mockWireGuardDartPlatform.generatePresharedKeys(2)).called(1);
+      verify(mockWireGuardDartPlatform.generatePresharedKeysBinary(2)).called(1);
+    });
+
+    test('should not open the FFI reads off Windows', () {
+      expect(WireguardDartFfi.open(), isNull);
+    }, skip: Platform.isWindows);
+
+    test('should derive public keys from private keys', () async {
+      when(mockWireGuardDartPlatform.derivePublicKey('privateKey1')).thenAnswer((_) async => 'publicKey1');
+      when(mockWireGuardDartPlatform.derivePublicKeys(['privateKey1', 'privateKey2']))
+          .thenAnswer((_) async => ['publicKey1', 'publicKey2']);
+
+      expect(await wireguardDart.derivePublicKey('privateKey1'), 'publicKey1');
+      expect(await wireguardDart.derivePublicKeys(['privateKey1', 'privateKey2']), ['publicKey1', 'publicKey2']);
+      verify(mockWireGuardDartPlatform.derivePublicKey('privateKey1')).called(1);
+      verify(mockWireGuardDartPlatform.derivePublicKeys(['privateKey1', 'privateKey2'])).called(1);
+    });
+
     test('should handle error when generating key pair', () async {
       when(mockWireGuardDartPlatform.generateKeyPair()).thenThrow(Exception('Failed to generate key pair'));
 
@@ -50,6 +140,113 @@ void main() {
       verify(mockWireGuardDartPlatform.nativeInit()).called(1);
     });
 
+    test('should pass cacheConfigurations when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(logFilePath: 'wireguard.log', cacheConfigurations: true))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(logFilePath: 'wireguard.log', cacheConfigurations: true);
+
+      verify(mockWireGuardDartPlatform.nativeInit(logFilePath: 'wireguard.log', cacheConfigurations: true)).called(1);
+    });
+
+    test('should pass journalState when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(logFilePath: 'wireguard.log', journalState: true))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(logFilePath: 'wireguard.log', journalState: true);
+
+      verify(mockWireGuardDartPlatform.nativeInit(logFilePath: 'wireguard.log', journalState: true)).called(1);
+    });
+
+    test('should pass cumulativeCounters when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(logFilePath: 'wireguard.log', cumulativeCounters: true))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(logFilePath: 'wireguard.log', cumulativeCounters: true);
+
+      verify(mockWireGuardDartPlatform.nativeInit(logFilePath: 'wireguard.log', cumulativeCounters: true)).called(1);
+    });
+
+    test('should pass prewarmTunnelNames when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(prewarmTunnelNames: ['site-a', 'site-b'])).thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(prewarmTunnelNames: ['site-a', 'site-b']);
+
+      verify(mockWireGuardDartPlatform.nativeInit(prewarmTunnelNames: ['site-a', 'site-b'])).called(1);
+    });
+
+    test('should pass the log queue settings when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(logQueueSize: 1024, logOverflowPolicy: LogOverflowPolicy.discardNew))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(logQueueSize: 1024, logOverflowPolicy: LogOverflowPolicy.discardNew);
+
+      verify(mockWireGuardDartPlatform.nativeInit(logQueueSize: 1024, logOverflowPolicy: LogOverflowPolicy.discardNew))
+          .called(1);
+    });
+
+    test('should pass the log rotation settings when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(maxLogBytes: 10 << 20, maxLogFiles: 5))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(maxLogBytes: 10 << 20, maxLogFiles: 5);
+
+      verify(mockWireGuardDartPlatform.nativeInit(maxLogBytes: 10 << 20, maxLogFiles: 5)).called(1);
+    });
+
+    test('should pass the log pattern when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(logPattern: '%* %l %v')).thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(logPattern: '%* %l %v');
+
+      verify(mockWireGuardDartPlatform.nativeInit(logPattern: '%* %l %v')).called(1);
+    });
+
+    test('should pass statusCoalesceWindow when initializing native', () async {
+      const window = Duration(milliseconds: 250);
+      when(mockWireGuardDartPlatform.nativeInit(statusCoalesceWindow: window)).thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(statusCoalesceWindow: window);
+
+      verify(mockWireGuardDartPlatform.nativeInit(statusCoalesceWindow: window)).called(1);
+    });
+
+    test('should pass endpointRoamingInterval when initializing native', () async {
+      const interval = Duration(seconds: 10);
+      when(mockWireGuardDartPlatform.nativeInit(endpointRoamingInterval: interval))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(endpointRoamingInterval: interval);
+
+      verify(mockWireGuardDartPlatform.nativeInit(endpointRoamingInterval: interval)).called(1);
+    });
+
+    test('should pass keyPoolSize when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(keyPoolSize: 16)).thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(keyPoolSize: 16);
+
+      verify(mockWireGuardDartPlatform.nativeInit(keyPoolSize: 16)).called(1);
+    });
+
+    test('should pass removeOrphanAdapters when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(removeOrphanAdapters: true)).thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(removeOrphanAdapters: true);
+
+      verify(mockWireGuardDartPlatform.nativeInit(removeOrphanAdapters: true)).called(1);
+    });
+
+    test('should pass the hang watchdog options when initializing native', () async {
+      when(mockWireGuardDartPlatform.nativeInit(hangDeadline: anyNamed('hangDeadline'), hangMinidump: true))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.nativeInit(hangDeadline: const Duration(seconds: 30), hangMinidump: true);
+
+      verify(mockWireGuardDartPlatform.nativeInit(hangDeadline: const Duration(seconds: 30), hangMinidump: true))
+          .called(1);
+    });
+
     test('should handle error when initializing native', () async {
       when(mockWireGuardDartPlatform.nativeInit()).thenThrow(Exception('Failed to initialize native'));
 
@@ -66,6 +263,16 @@ void main() {
       verify(mockWireGuardDartPlatform.setupTunnel(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'config')).called(1);
     });
 
+    test('should pass the kill switch option when setting up tunnel', () async {
+      when(mockWireGuardDartPlatform.setupTunnel(
+              bundleId: anyNamed('bundleId'), tunnelName: anyNamed('tunnelName'), cfg: anyNamed('cfg'), killSwitch: anyNamed('killSwitch')))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.setupTunnel(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'config', killSwitch: true);
+
+      verify(mockWireGuardDartPlatform.setupTunnel(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'config', killSwitch: true)).called(1);
+    });
+
     test('should handle error when setting up tunnel', () async {
       when(mockWireGuardDartPlatform.setupTunnel(bundleId: anyNamed('bundleId'), tunnelName: anyNamed('tunnelName'), cfg: anyNamed('cfg')))
           .thenThrow(Exception('Failed to setup tunnel'));
@@ -74,6 +281,469 @@ void main() {
       verify(mockWireGuardDartPlatform.setupTunnel(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'config')).called(1);
     });
 
+    test('should setup tunnel from chunks successfully', () async {
+      final chunks = Stream<String>.fromIterable(['[Interface]\n', 'PrivateKey = key\n']);
+      when(mockWireGuardDartPlatform.setupTunnelFromChunks(bundleId: anyNamed('bundleId'), tunnelName: anyNamed('tunnelName'), cfg: anyNamed('cfg')))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.setupTunnelFromChunks(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: chunks);
+
+      verify(mockWireGuardDartPlatform.setupTunnelFromChunks(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: chunks)).called(1);
+    });
+
+    test('should setup several tunnels in one call', () async {
+      final tunnels = {'site-a': 'config-a', 'site-b': 'config-b'};
+      when(mockWireGuardDartPlatform.setupTunnels(bundleId: anyNamed('bundleId'), tunnels: anyNamed('tunnels'))).thenAnswer((_) async => {
+            'site-a': {'luid': 1},
+            'site-b': {'errorCode': 'CONFIGURATION_FAILED', 'errorMessage': 'Failed'},
+          });
+
+      final result = await wireguardDart.setupTunnels(bundleId: 'bundleId', tunnels: tunnels);
+
+      expect(result['site-a']?['luid'], 1);
+      expect(result['site-b']?['errorCode'], 'CONFIGURATION_FAILED');
+      verify(mockWireGuardDartPlatform.setupTunnels(bundleId: 'bundleId', tunnels: tunnels)).called(1);
+    });
+
+    test('should setup and connect in one call', () async {
+      when(mockWireGuardDartPlatform.setupAndConnect(bundleId: anyNamed('bundleId'), tunnelName: anyNamed('tunnelName'), cfg: anyNamed('cfg')))
+          .thenAnswer((_) async => {'luid': 12345, 'timings': {'connect': 10}});
+
+      final result = await wireguardDart.setupAndConnect(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'config');
+
+      expect(result?['luid'], 12345);
+      verify(mockWireGuardDartPlatform.setupAndConnect(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'config')).called(1);
+    });
+
+    test('should pass the timeout and operation id of a setup and cancel it', () async {
+      when(mockWireGuardDartPlatform.setupTunnel(
+              bundleId: anyNamed('bundleId'),
+              tunnelName: anyNamed('tunnelName'),
+              cfg: anyNamed('cfg'),
+              timeoutMs: anyNamed('timeoutMs'),
+              operationId: anyNamed('operationId')))
+          .thenAnswer((_) async => {'luid': 12345});
+      when(mockWireGuardDartPlatform.cancelOperation(operationId: anyNamed('operationId'))).thenAnswer((_) async => true);
+
+      await wireguardDart.setupTunnel(bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'config', timeoutMs: 5000, operationId: 3);
+      final cancelled = await wireguardDart.cancelOperation(operationId: 3);
+
+      expect(cancelled, isTrue);
+      verify(mockWireGuardDartPlatform.setupTunnel(
+              bundleId: 'bundleId', tunnelName: 'tunnelName', cfg: 'config', timeoutMs: 5000, operationId: 3))
+          .called(1);
+      verify(mockWireGuardDartPlatform.cancelOperation(operationId: 3)).called(1);
+    });
+
+    test('should setup tunnel from a structured config', () async {
+      final config = TunnelConfig(
+        privateKey: Uint8List(32),
+        addresses: [IpPrefix(Uint8List.fromList([10, 0, 0, 2]), 24)],
+        dnsServers: [Uint8List.fromList([10, 0, 0, 1])],
+        splitDnsDomains: ['corp.example'],
+        qosRules: ['tunnel:46'],
+        peers: [
+          TunnelPeerConfig(
+            publicKey: Uint8List(32),
+            endpointAddress: Uint8List.fromList([192, 0, 2, 1]),
+            endpointPort: 51820,
+            allowedIps: [IpPrefix(Uint8List(16), 0)],
+            probeAddress: Uint8List.fromList([10, 0, 0, 1]),
+          ),
+          TunnelPeerConfig(publicKey: Uint8List(32), keepaliveAuto: true, keepaliveMax: 60),
+        ],
+      );
+      when(mockWireGuardDartPlatform.setupTunnelStructured(
+              bundleId: anyNamed('bundleId'), tunnelName: anyNamed('tunnelName'), config: anyNamed('config')))
+          .thenAnswer((_) async => {'luid': 12345});
+
+      final result =
+          await wireguardDart.setupTunnelStructured(bundleId: 'bundleId', tunnelName: 'tunnelName', config: config);
+
+      expect(result?['luid'], 12345);
+      expect(config.toMap()['addresses'], [4, 24, 10, 0, 0, 2]);
+      expect(config.toMap()['splitDnsDomains'], ['corp.example']);
+      expect(const TunnelConfig().toMap().containsKey('splitDnsDomains'), isFalse);
+      expect(config.toMap()['qosRules'], ['tunnel:46']);
+      expect(const TunnelConfig().toMap().containsKey('qosRules'), isFalse);
+      final peers = config.toMap()['peers'] as List;
+      expect(peers.first['allowedIps'], [6, 0, ...List.filled(16, 0)]);
+      expect(peers.last['persistentKeepalive'], 'auto:15-60');
+      expect(peers.first['probeAddress'], [10, 0, 0, 1]);
+      expect((peers.last as Map).containsKey('probeAddress'), isFalse);
+      verify(mockWireGuardDartPlatform.setupTunnelStructured(bundleId: 'bundleId', tunnelName: 'tunnelName', config: config))
+          .called(1);
+    });
+
+    test('should setup tunnel from a configuration file', () async {
+      when(mockWireGuardDartPlatform.setupTunnelFromFile(
+              bundleId: anyNamed('bundleId'), tunnelName: anyNamed('tunnelName'), path: anyNamed('path')))
+          .thenAnswer((_) async => {'luid': 12345});
+
+      final result = await wireguardDart.setupTunnelFromFile(
+          bundleId: 'bundleId', tunnelName: 'tunnelName', path: r'C:\ProgramData\agent\wg0.conf');
+
+      expect(result?['luid'], 12345);
+      verify(mockWireGuardDartPlatform.setupTunnelFromFile(
+              bundleId: 'bundleId', tunnelName: 'tunnelName', path: r'C:\ProgramData\agent\wg0.conf'))
+          .called(1);
+    });
+
+    test('should update tunnel successfully', () async {
+      when(mockWireGuardDartPlatform.updateTunnel(tunnelName: anyNamed('tunnelName'), cfg: anyNamed('cfg')))
+          .thenAnswer((_) async => {'luid': 12345});
+
+      final result = await wireguardDart.updateTunnel(tunnelName: 'tunnelName', cfg: 'config');
+
+      expect(result, {'luid': 12345});
+      verify(mockWireGuardDartPlatform.updateTunnel(tunnelName: 'tunnelName', cfg: 'config')).called(1);
+    });
+
+    test('should validate a configuration', () async {
+      when(mockWireGuardDartPlatform.validateConfig(cfg: anyNamed('cfg'))).thenAnswer((_) async =>
+          const ConfigValidation(valid: false, errorLine: 3, errorColumn: 14, elapsedUs: 20));
+
+      final validation = await wireguardDart.validateConfig(cfg: 'config');
+
+      expect(validation.valid, isFalse);
+      expect(validation.errorLine, 3);
+      verify(mockWireGuardDartPlatform.validateConfig(cfg: 'config')).called(1);
+    });
+
+    test('should resolve the peers of addresses', () async {
+      when(mockWireGuardDartPlatform.resolvePeerForAddresses(any))
+          .thenAnswer((_) async => [const ResolvedPeer(tunnelName: 'wg0', publicKey: 'key'), null]);
+
+      final peers = await wireguardDart.resolvePeerForAddresses(['10.0.0.2', '8.8.8.8']);
+
+      expect(peers.first?.tunnelName, 'wg0');
+      expect(peers.last, isNull);
+      verify(mockWireGuardDartPlatform.resolvePeerForAddresses(['10.0.0.2', '8.8.8.8'])).called(1);
+    });
+
+    test('should add and remove peers', () async {
+      final peer = TunnelPeerConfig(publicKey: Uint8List(32), allowedIps: [IpPrefix(Uint8List(4), 32)]);
+      when(mockWireGuardDartPlatform.addPeers(tunnelName: anyNamed('tunnelName'), peers: anyNamed('peers')))
+          .thenAnswer((_) async {});
+      when(mockWireGuardDartPlatform.removePeers(
+              tunnelName: anyNamed('tunnelName'), publicKeys: anyNamed('publicKeys')))
+          .thenAnswer((_) async {});
+
+      await wireguardDart.addPeers(tunnelName: 'hub', peers: [peer]);
+      await wireguardDart.removePeers(tunnelName: 'hub', publicKeys: [peer.publicKey]);
+
+      verify(mockWireGuardDartPlatform.addPeers(tunnelName: 'hub', peers: [peer])).called(1);
+      verify(mockWireGuardDartPlatform.removePeers(tunnelName: 'hub', publicKeys: [peer.publicKey])).called(1);
+    });
+
+    test('should set up and update tunnels from a compiled configuration', () async {
+      when(mockWireGuardDartPlatform.compileConfig(cfg: anyNamed('cfg'))).thenAnswer((_) async => 7);
+      when(mockWireGuardDartPlatform.setupTunnelCompiled(
+              bundleId: anyNamed('bundleId'), tunnelName: anyNamed('tunnelName'), configHandle: anyNamed('configHandle')))
+          .thenAnswer((_) async => {'luid': 12345});
+      when(mockWireGuardDartPlatform.updateTunnelCompiled(
+              tunnelName: anyNamed('tunnelName'), configHandle: anyNamed('configHandle')))
+          .thenAnswer((_) async => {'luid': 12345});
+      when(mockWireGuardDartPlatform.releaseConfig(configHandle: anyNamed('configHandle'))).thenAnswer((_) async {});
+
+      final handle = await wireguardDart.compileConfig(cfg: 'config');
+      final setup = await wireguardDart.setupTunnelCompiled(bundleId: 'bundleId', tunnelName: 'wg0', configHandle: handle);
+      final update = await wireguardDart.updateTunnelCompiled(tunnelName: 'wg1', configHandle: handle);
+      await wireguardDart.releaseConfig(configHandle: handle);
+
+      expect(handle, 7);
+      expect(setup?['luid'], 12345);
+      expect(update?['luid'], 12345);
+      verify(mockWireGuardDartPlatform.compileConfig(cfg: 'config')).called(1);
+      verify(mockWireGuardDartPlatform.setupTunnelCompiled(bundleId: 'bundleId', tunnelName: 'wg0', configHandle: 7))
+          .called(1);
+      verify(mockWireGuardDartPlatform.updateTunnelCompiled(tunnelName: 'wg1', configHandle: 7)).called(1);
+      verify(mockWireGuardDartPlatform.releaseConfig(configHandle: 7)).called(1);
+    });
+
+    test('should set up tunnels from a compiled template with overrides', () async {
+      when(mockWireGuardDartPlatform.setupTunnelCompiled(
+              bundleId: anyNamed('bundleId'),
+              tunnelName: anyNamed('tunnelName'),
+              configHandle: anyNamed('configHandle'),
+              privateKey: anyNamed('privateKey'),
+              addresses: anyNamed('addresses'),
+              listenPort: anyNamed('listenPort')))
+          .thenAnswer((_) async => {'luid': 12345});
+
+      final setup = await wireguardDart.setupTunnelCompiled(
+          bundleId: 'bundleId', tunnelName: 'site2', configHandle: 7, privateKey: 'key=', addresses: ['10.0.0.2/32']);
+
+      expect(setup?['luid'], 12345);
+      verify(mockWireGuardDartPlatform.setupTunnelCompiled(
+              bundleId: 'bundleId',
+              tunnelName: 'site2',
+              configHandle: 7,
+              privateKey: 'key=',
+              addresses: ['10.0.0.2/32'])).called(1);
+    });
+
+    test('should watch a config file', () async {
+      when(mockWireGuardDartPlatform.watchConfigFile(tunnelName: anyNamed('tunnelName'), path: anyNamed('path')))
+          .thenAnswer((_) async {});
+
+      await wireguardDart.watchConfigFile(tunnelName: 'tunnelName', path: r'C:\agent\wg0.conf');
+
+      verify(mockWireGuardDartPlatform.watchConfigFile(tunnelName: 'tunnelName', path: r'C:\agent\wg0.conf')).called(1);
+    });
+
+    test('should get peer statistics successfully', () async {
+      const peers = {
+        'key=': PeerStatistics(
+            rxBytes: 100,
+            txBytes: 50,
+            latestHandshake: 0,
+            rxRate: 10,
+            txRate: 5,
+            rxRateEwma: 8,
+            txRateEwma: 4,
+            persistentKeepalive: 31),
+      };
+      when(mockWireGuardDartPlatform.getPeerStatistics(tunnelName: anyNamed('tunnelName')))
+          .thenAnswer((_) async => peers);
+
+      final result = await wireguardDart.getPeerStatistics(tunnelName: 'tunnelName');
+
+      expect(result['key=']?.rxRateEwma, 8);
+      expect(result['key=']?.handshakeAgeMs, null);
+      expect(result['key=']?.persistentKeepalive, 31);
+      verify(mockWireGuardDartPlatform.getPeerStatistics(tunnelName: 'tunnelName')).called(1);
+    });
+
+    test('should read peer statistics from the binary view', () async {
+      final data = ByteData(16 + 72)
+        ..setUint16(0, 1, Endian.little)
+        ..setUint16(2, 72, Endian.little)
+        ..setUint32(4, 1, Endian.little)
+        ..setUint64(8, 1700000000000, Endian.little)
+        ..setUint8(16, 7)
+        ..setUint64(48, 100, Endian.little)
+        ..setUint64(56, 50, Endian.little)
+        ..setUint64(64, 1699999990000, Endian.little)
+        ..setFloat64(72, 8.5, Endian.little)
+        ..setFloat64(80, 4.25, Endian.little);
+      when(mockWireGuardDartPlatform.getPeerStatisticsView(tunnelName: anyNamed('tunnelName')))
+          .thenAnswer((_) async => PeerStatisticsView(data.buffer.asUint8List()));
+
+      final view = await wireguardDart.getPeerStatisticsView(tunnelName: 'tunnelName');
+
+      expect(view.length, 1);
+      expect(view.timestamp, 1700000000000);
+      expect(view.publicKeyBytes(0)[0], 7);
+      expect(view.rxBytes(0), 100);
+      expect(view.txBytes(0), 50);
+      expect(view.latestHandshake(0), 1699999990000);
+      expect(view.rxRateEwma(0), 8.5);
+      expect(view.txRateEwma(0), 4.25);
+      expect(() => PeerStatisticsView(Uint8List(8)), throwsFormatException);
+    });
+
+    test('should read statistics history from the binary view', () async {
+      final data = ByteData(16 + 2 * 24)
+        ..setUint16(0, 1, Endian.little)
+        ..setUint16(2, 24, Endian.little)
+        ..setUint32(4, 2, Endian.little)
+        ..setUint32(8, 1000, Endian.little)
+        ..setUint64(16, 1700000000000, Endian.little)
+        ..setUint64(24, 100, Endian.little)
+        ..setUint64(40, 1700000001000, Endian.little)
+        ..setUint64(48, 300, Endian.little)
+        ..setUint64(56, 40, Endian.little);
+      when(mockWireGuardDartPlatform.getStatisticsHistory(
+              tunnelName: anyNamed('tunnelName'), window: anyNamed('window'), publicKey: anyNamed('publicKey')))
+          .thenAnswer((_) async => StatisticsHistoryView(data.buffer.asUint8List()));
+
+      final view =
+          await wireguardDart.getStatisticsHistory(tunnelName: 'tunnelName', window: const Duration(minutes: 5));
+
+      expect(view.length, 2);
+      expect(view.interval, const Duration(seconds: 1));
+      expect(view.timestamp(1), 1700000001000);
+      expect(view.rxBytes(1) - view.rxBytes(0), 200);
+      expect(view.txBytes(1), 40);
+      verify(mockWireGuardDartPlatform.getStatisticsHistory(
+              tunnelName: 'tunnelName', window: const Duration(minutes: 5), publicKey: null))
+          .called(1);
+    });
+
+    test('should get a counter snapshot successfully', () async {
+      final snapshot = CounterSnapshot.fromJson({
+        'timestamp': 1700000000000,
+        'interface': {
+          'inOctets': 1000,
+          'outOctets': 2000,
+          'inPackets': 10,
+          'outPackets': 20,
+          'inDiscards': 1,
+          'outDiscards': 2,
+          'inErrors': 0,
+          'outErrors': 0,
+        },
+        'peers': {
+          'key=': {
+            'rxBytes': 100,
+            'txBytes': 50,
+            'latestHandshake': 0,
+            'handshakeAgeMs': null,
+            'rxRate': 0,
+            'txRate': 0,
+            'rxRateEwma': 0,
+            'txRateEwma': 0,
+            'probes': 30,
+            'lossPercent': 10,
+            'rttMinMs': 12,
+            'rttP50Ms': 15,
+            'rttP90Ms': 40,
+            'rttMaxMs': 55,
+          },
+        },
+      });
+      when(mockWireGuardDartPlatform.getCounterSnapshot(tunnelName: anyNamed('tunnelName')))
+          .thenAnswer((_) async => snapshot);
+
+      final result = await wireguardDart.getCounterSnapshot(tunnelName: 'tunnelName');
+
+      expect(result.interfaceCounters.outDiscards, 2);
+      expect(result.peers['key=']?.rxBytes, 100);
+      expect(result.peers['key=']?.lossPercent, 10.0);
+      expect(result.peers['key=']?.rttP90Ms, 40);
+      verify(mockWireGuardDartPlatform.getCounterSnapshot(tunnelName: 'tunnelName')).called(1);
+    });
+
+    test('should get the cumulative statistics', () async {
+      const counts = CumulativeCounts(rxBytes: 3000, txBytes: 1000, sinceMs: 1, updatedMs: 2);
+      when(mockWireGuardDartPlatform.getCumulativeStatistics(
+              tunnelNames: anyNamed('tunnelNames'), reset: anyNamed('reset')))
+          .thenAnswer((_) async => {'eu': const CumulativeStatistics(totals: counts, peers: {'key=': counts})});
+
+      final result = await wireguardDart.getCumulativeStatistics(tunnelNames: ['eu'], reset: true);
+
+      expect(result['eu']?.totals.rxBytes, 3000);
+      expect(result['eu']?.peers['key=']?.txBytes, 1000);
+      verify(mockWireGuardDartPlatform.getCumulativeStatistics(tunnelNames: ['eu'], reset: true)).called(1);
+    });
+
+    test('should start and stop a stats recording', () async {
+      when(mockWireGuardDartPlatform.startStatsRecording(path: anyNamed('path'))).thenAnswer((_) async {});
+      when(mockWireGuardDartPlatform.stopStatsRecording())
+          .thenAnswer((_) async => {'recordsWritten': 3600, 'recordsDropped': 0});
+
+      await wireguardDart.startStatsRecording(path: 'soak.wgsr');
+      final result = await wireguardDart.stopStatsRecording();
+
+      expect(result?['recordsWritten'], 3600);
+      verify(mockWireGuardDartPlatform.startStatsRecording(path: 'soak.wgsr')).called(1);
+      verify(mockWireGuardDartPlatform.stopStatsRecording()).called(1);
+    });
+
+    test('should set the log level successfully', () async {
+      when(mockWireGuardDartPlatform.setLogLevel(LogLevel.warn)).thenAnswer((_) async => Future.value());
+
+      await wireguardDart.setLogLevel(LogLevel.warn);
+
+      verify(mockWireGuardDartPlatform.setLogLevel(LogLevel.warn)).called(1);
+    });
+
+    test('should get recent logs successfully', () async {
+      const lines = ['[2026-01-01 12:00:00.000] [wireguard_dart] [warning] Handshake is stale'];
+      when(mockWireGuardDartPlatform.getRecentLogs(maxLines: 50, minLevel: LogLevel.warn))
+          .thenAnswer((_) async => lines);
+
+      final result = await wireguardDart.getRecentLogs(maxLines: 50, minLevel: LogLevel.warn);
+
+      expect(result, lines);
+      verify(mockWireGuardDartPlatform.getRecentLogs(maxLines: 50, minLevel: LogLevel.warn)).called(1);
+    });
+
+    test('should get log stream successfully', () async {
+      final record = LogRecord(
+          level: LogLevel.warn,
+          timestamp: DateTime.fromMillisecondsSinceEpoch(1700000000123),
+          source: 'wireguard.dll',
+          message: 'Handshake did not complete');
+      when(mockWireGuardDartPlatform.logStream(
+              maxRecordsPerSecond: anyNamed('maxRecordsPerSecond'), minLevel: anyNamed('minLevel')))
+          .thenAnswer((_) => Stream<LogRecord>.fromIterable([record]));
+
+      final result = await wireguardDart.logStream(maxRecordsPerSecond: 50, minLevel: LogLevel.info).first;
+
+      expect(result.source, 'wireguard.dll');
+      expect(result.message, 'Handshake did not complete');
+      verify(mockWireGuardDartPlatform.logStream(maxRecordsPerSecond: 50, minLevel: LogLevel.info)).called(1);
+    });
+
+    test('should get metrics successfully', () async {
+      const metrics = 'wireguard_dart_call_duration_seconds_count{call="WireGuardSetConfiguration"} 1\n# EOF\n';
+      when(mockWireGuardDartPlatform.getMetrics()).thenAnswer((_) async => metrics);
+
+      final result = await wireguardDart.getMetrics();
+
+      expect(result, metrics);
+      verify(mockWireGuardDartPlatform.getMetrics()).called(1);
+    });
+
+    test('should get perf stats successfully', () async {
+      const stats = {'connect': PhaseStats(count: 2, lastUs: 900, minUs: 800, maxUs: 900, meanUs: 850, p50Us: 800, p90Us: 800, p99Us: 800)};
+      when(mockWireGuardDartPlatform.getPerfStats()).thenAnswer((_) async => stats);
+
+      final result = await wireguardDart.getPerfStats();
+
+      expect(result['connect']?.meanUs, 850);
+      verify(mockWireGuardDartPlatform.getPerfStats()).called(1);
+    });
+
+    test('should pass the correlation id to connect', () async {
+      when(mockWireGuardDartPlatform.connect(
+              tunnelName: anyNamed('tunnelName'), correlationId: anyNamed('correlationId')))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.connect(tunnelName: 'tunnelName', correlationId: 'call-7');
+
+      verify(mockWireGuardDartPlatform.connect(tunnelName: 'tunnelName', correlationId: 'call-7')).called(1);
+    });
+
+    test('should get the startup trace successfully', () async {
+      const entries = [StartupTraceEntry(subsystem: 'tunnelWorkers', atUs: 1200, tookUs: 300)];
+      when(mockWireGuardDartPlatform.getStartupTrace()).thenAnswer((_) async => entries);
+
+      final result = await wireguardDart.getStartupTrace();
+
+      expect(result.single.subsystem, 'tunnelWorkers');
+      verify(mockWireGuardDartPlatform.getStartupTrace()).called(1);
+    });
+
+    test('should export the tunnel configuration successfully', () async {
+      when(mockWireGuardDartPlatform.exportTunnelConfiguration(
+              tunnelName: anyNamed('tunnelName'), redactKeys: anyNamed('redactKeys')))
+          .thenAnswer((_) async => '[Interface]\nListenPort = 51820\n');
+
+      final result = await wireguardDart.exportTunnelConfiguration(tunnelName: 'tunnelName');
+
+      expect(result, contains('ListenPort = 51820'));
+      verify(mockWireGuardDartPlatform.exportTunnelConfiguration(tunnelName: 'tunnelName', redactKeys: true)).called(1);
+    });
+
+    test('should start the telemetry export successfully', () async {
+      when(mockWireGuardDartPlatform.startTelemetryExport(
+              host: anyNamed('host'),
+              port: anyNamed('port'),
+              interval: anyNamed('interval'),
+              maxDatagramsPerInterval: anyNamed('maxDatagramsPerInterval'),
+              minLevel: anyNamed('minLevel')))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.startTelemetryExport(host: '192.0.2.10', port: 8125, interval: const Duration(seconds: 30));
+
+      verify(mockWireGuardDartPlatform.startTelemetryExport(
+              host: '192.0.2.10', port: 8125, interval: const Duration(seconds: 30)))
+          .called(1);
+    });
+
     test('should connect successfully', () async {
       when(mockWireGuardDartPlatform.connect(tunnelName: anyNamed('tunnelName'))).thenAnswer((_) async => Future.value());
 
@@ -86,6 +756,46 @@ void main() {
       )).called(1);
     });
 
+    test('should connect with a warm-up', () async {
+      when(mockWireGuardDartPlatform.connect(tunnelName: anyNamed('tunnelName'), warmUp: anyNamed('warmUp')))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.connect(tunnelName: 'tunnelName', warmUp: true);
+
+      verify(mockWireGuardDartPlatform.connect(tunnelName: 'tunnelName', warmUp: true)).called(1);
+    });
+
+    test('should connect with hostnames to prefetch', () async {
+      when(mockWireGuardDartPlatform.connect(
+              tunnelName: anyNamed('tunnelName'), prefetchHosts: anyNamed('prefetchHosts')))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.connect(tunnelName: 'tunnelName', prefetchHosts: ['api.example.com']);
+
+      verify(mockWireGuardDartPlatform.connect(tunnelName: 'tunnelName', prefetchHosts: ['api.example.com'])).called(1);
+    });
+
+    test('should connect with staged peer activation', () async {
+      final activation = PeerActivation(
+          batchSize: 50, interval: const Duration(milliseconds: 200), priority: [Uint8List(32)..[0] = 1]);
+      when(mockWireGuardDartPlatform.connect(tunnelName: anyNamed('tunnelName'), activation: anyNamed('activation')))
+          .thenAnswer((_) async => Future.value());
+
+      await wireguardDart.connect(tunnelName: 'tunnelName', activation: activation);
+
+      verify(mockWireGuardDartPlatform.connect(tunnelName: 'tunnelName', activation: activation)).called(1);
+    });
+
+    test('should pass the captive-portal error of a precheck on', () async {
+      when(mockWireGuardDartPlatform.connect(tunnelName: anyNamed('tunnelName'), precheck: anyNamed('precheck')))
+          .thenThrow(PlatformException(code: 'CAPTIVE_PORTAL', message: 'The network has a captive portal'));
+
+      expect(
+        () => wireguardDart.connect(tunnelName: 'tunnelName', precheck: true),
+        throwsA(isA<PlatformException>().having((e) => e.code, 'code', 'CAPTIVE_PORTAL')),
+      );
+    });
+
     test('should handle error when connecting', () async {
       when(mockWireGuardDartPlatform.connect(
         tunnelName: anyNamed('tunnelName'),
@@ -116,6 +826,107 @@ void main() {
       verify(mockWireGuardDartPlatform.disconnect(tunnelName: 'tunnelName')).called(1);
     });
 
+    test('should connect and disconnect a group of tunnels', () async {
+      const connected = TunnelGroupResult(elapsedMs: 200, tunnels: {
+        'eu': TunnelTransition(elapsedMs: 150),
+        'us': TunnelTransition(elapsedMs: 200),
+      });
+      const disconnected = TunnelGroupResult(elapsedMs: 30, tunnels: {'home': TunnelTransition(elapsedMs: 30)});
+      when(mockWireGuardDartPlatform.connectTunnels(tunnelNames: anyNamed('tunnelNames'), warmUp: anyNamed('warmUp')))
+          .thenAnswer((_) async => connected);
+      when(mockWireGuardDartPlatform.disconnectTunnels(tunnelNames: anyNamed('tunnelNames')))
+          .thenAnswer((_) async => disconnected);
+
+      expect((await wireguardDart.disconnectTunnels(tunnelNames: ['home'])).succeeded, isTrue);
+      final result = await wireguardDart.connectTunnels(tunnelNames: ['eu', 'us']);
+
+      expect(result.tunnels.keys, ['eu', 'us']);
+      expect(result.succeeded, isTrue);
+      verify(mockWireGuardDartPlatform.disconnectTunnels(tunnelNames: ['home'])).called(1);
+      verify(mockWireGuardDartPlatform.connectTunnels(tunnelNames: ['eu', 'us'])).called(1);
+    });
+
+    test('should install and remove a tunnel service', () async {
+      when(mockWireGuardDartPlatform.installTunnelService(tunnelName: anyNamed('tunnelName'), cfg: anyNamed('cfg')))
+          .thenAnswer((_) async {});
+      when(mockWireGuardDartPlatform.removeTunnelService(tunnelName: anyNamed('tunnelName'))).thenAnswer((_) async {});
+
+      await wireguardDart.installTunnelService(tunnelName: 'tunnelName', cfg: 'cfg');
+      await wireguardDart.removeTunnelService(tunnelName: 'tunnelName');
+
+      verify(mockWireGuardDartPlatform.installTunnelService(tunnelName: 'tunnelName', cfg: 'cfg')).called(1);
+      verify(mockWireGuardDartPlatform.removeTunnelService(tunnelName: 'tunnelName')).called(1);
+    });
+
+    test('should set a split tunnel', () async {
+      when(mockWireGuardDartPlatform.setSplitTunnel(
+              tunnelName: anyNamed('tunnelName'), mode: anyNamed('mode'), apps: anyNamed('apps')))
+          .thenAnswer((_) async {});
+
+      await wireguardDart.setSplitTunnel(
+          tunnelName: 'tunnelName', mode: SplitTunnelMode.exclude, apps: [r'C:\Program Files\App\app.exe']);
+
+      verify(mockWireGuardDartPlatform.setSplitTunnel(
+          tunnelName: 'tunnelName', mode: SplitTunnelMode.exclude, apps: [r'C:\Program Files\App\app.exe'])).called(1);
+    });
+
+    test('should set the adapter logging and read the adapter log', () async {
+      when(mockWireGuardDartPlatform.setAdapterLogging(tunnelName: anyNamed('tunnelName'), mode: anyNamed('mode')))
+          .thenAnswer((_) async {});
+      when(mockWireGuardDartPlatform.getAdapterLog(tunnelName: anyNamed('tunnelName'), maxLines: anyNamed('maxLines')))
+          .thenAnswer((_) async => ['[2026-10-15 09:30:00.000] [tunnelName] [info] Keypair 1 created for peer 1']);
+
+      await wireguardDart.setAdapterLogging(tunnelName: 'tunnelName', mode: AdapterLogMode.off);
+      final lines = await wireguardDart.getAdapterLog(tunnelName: 'tunnelName', maxLines: 10);
+
+      expect(lines, hasLength(1));
+      verify(mockWireGuardDartPlatform.setAdapterLogging(tunnelName: 'tunnelName', mode: AdapterLogMode.off)).called(1);
+      verify(mockWireGuardDartPlatform.getAdapterLog(tunnelName: 'tunnelName', maxLines: 10)).called(1);
+    });
+
+    test('should set and remove a failover group', () async {
+      when(mockWireGuardDartPlatform.setFailoverGroup(
+              primaryTunnel: anyNamed('primaryTunnel'), standbyTunnel: anyNamed('standbyTunnel')))
+          .thenAnswer((_) async {});
+      when(mockWireGuardDartPlatform.removeFailoverGroup(tunnelName: anyNamed('tunnelName')))
+          .thenAnswer((_) async => true);
+
+      await wireguardDart.setFailoverGroup(primaryTunnel: 'eu', standbyTunnel: 'us');
+      final removed = await wireguardDart.removeFailoverGroup(tunnelName: 'us');
+
+      expect(removed, isTrue);
+      verify(mockWireGuardDartPlatform.setFailoverGroup(primaryTunnel: 'eu', standbyTunnel: 'us')).called(1);
+      verify(mockWireGuardDartPlatform.removeFailoverGroup(tunnelName: 'us')).called(1);
+    });
+
+    test('should run a throughput test', () async {
+      const throughput = ThroughputResult(
+          streams: 4,
+          elapsedMs: 10000,
+          bytesSent: 125000000,
+          bytesDelivered: 124000000,
+          goodputBps: 99200000,
+          sendErrors: 0,
+          bytesRetransmitted: 65536,
+          mss: 1380);
+      when(mockWireGuardDartPlatform.runThroughputTest(
+              tunnelName: anyNamed('tunnelName'),
+              target: anyNamed('target'),
+              duration: anyNamed('duration'),
+              protocol: anyNamed('protocol'),
+              streams: anyNamed('streams')))
+          .thenAnswer((_) async => throughput);
+
+      final result = await wireguardDart.runThroughputTest(
+          tunnelName: 'tunnelName', target: '[fd00::1]:9', duration: const Duration(seconds: 10), streams: 4);
+
+      expect(result.goodputBps, 99200000);
+      expect(result.toJson()['mss'], 1380);
+      verify(mockWireGuardDartPlatform.runThroughputTest(
+              tunnelName: 'tunnelName', target: '[fd00::1]:9', duration: const Duration(seconds: 10), streams: 4))
+          .called(1);
+    });
+
     test('should get status successfully', () async {
       const status = ConnectionStatus.connected;
       when(mockWireGuardDartPlatform.status()).thenAnswer((_) async => status);
@@ -133,23 +944,214 @@ void main() {
       verify(mockWireGuardDartPlatform.status()).called(1);
     });
 
+    test('should get the status of all tunnels', () async {
+      final statuses = {'tunnelName': const TunnelStatus(ConnectionStatus.connected, luid: 42)};
+      when(mockWireGuardDartPlatform.statusAll()).thenAnswer((_) async => statuses);
+
+      final result = await wireguardDart.statusAll();
+
+      expect(result['tunnelName']!.luid, 42);
+      verify(mockWireGuardDartPlatform.statusAll()).called(1);
+    });
+
     test('should get status stream successfully', () async {
       final statusStream = Stream<AdapterStatus>.fromIterable([const AdapterStatus(12345, ConnectionStatus.connected)]);
-      when(mockWireGuardDartPlatform.statusStream()).thenAnswer((_) => statusStream);
+      when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched'))).thenAnswer((_) => statusStream);
 
       final result = wireguardDart.statusStream();
 
       final firstResult = await result.first;
       expect(firstResult.luid, 12345); // Check LUID
       expect(firstResult.status, ConnectionStatus.connected); // Check status
-      verify(mockWireGuardDartPlatform.statusStream()).called(1);
+      verify(mockWireGuardDartPlatform.statusStream(batched: false)).called(1);
+    });
+
+    test('should pass ready events through the status stream', () async {
+      final readyAt = DateTime.fromMicrosecondsSinceEpoch(1700000000123456);
+      final statusStream = Stream<AdapterStatus>.fromIterable([
+        const AdapterStatus(12345, ConnectionStatus.connected),
+        AdapterStatus(12345, ConnectionStatus.connected, readyAt: readyAt),
+      ]);
+      when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched'))).thenAnswer((_) => statusStream);
+
+      final results = await wireguardDart.statusStream().toList();
+
+      expect(results[0].isReady, false);
+      expect(results[1].isReady, true);
+      expect(results[1].readyAt, readyAt);
+      expect(results[0] == results[1], false);
+    });
+
+    test('should pass status stream filters to the platform', () async {
+      when(mockWireGuardDartPlatform.statusStream(
+        batched: anyNamed('batched'),
+        tunnelNames: anyNamed('tunnelNames'),
+        luids: anyNamed('luids'),
+        events: anyNamed('events'),
+      )).thenAnswer((_) => const Stream.empty());
+
+      await wireguardDart.statusStream(tunnelNames: ['office'], events: {AdapterEventType.status}).toList();
+
+      verify(mockWireGuardDartPlatform.statusStream(
+        batched: false,
+        tunnelNames: ['office'],
+        luids: null,
+        events: {AdapterEventType.status},
+      )).called(1);
+    });
+
+    test('should get statistics stream successfully', () async {
+      final statisticsStream = Stream<Map<String, TunnelStatistics>>.fromIterable([
+        {'tunnel': const TunnelStatistics(totalDownload: 100, totalUpload: 50, latestHandshake: 1700000000123)},
+      ]);
+      when(mockWireGuardDartPlatform.statisticsStream(
+              interval: anyNamed('interval'),
+              interfaceCounters: anyNamed('interfaceCounters'),
+              processTraffic: anyNamed('processTraffic')))
+          .thenAnswer((_) => statisticsStream);
+
+      final result = await wireguardDart.statisticsStream(interval: const Duration(milliseconds: 500)).first;
+
+      expect(result['tunnel']?.totalDownload, 100);
+      verify(mockWireGuardDartPlatform.statisticsStream(
+              interval: const Duration(milliseconds: 500), interfaceCounters: false, processTraffic: false))
+          .called(1);
+    });
+
+    test('should pass process traffic through the statistics stream', () async {
+      final statistics = TunnelStatistics.fromJson({
+        'totalDownload': 100,
+        'totalUpload': 50,
+        'latestHandshake': 1700000000123,
+        'processes': [
+          {
+            'pid': 4242,
+            'image': 'browser.exe',
+            'rxBytes': 90000,
+            'txBytes': 4000,
+            'rxBytesPerSecond': 45000,
+            'txBytesPerSecond': 2000,
+            'tcpConnections': 3,
+            'udpSockets': 1,
+            'ended': false,
+          },
+          {
+            'pid': 77,
+            'image': '',
+            'rxBytes': 10,
+            'txBytes': 10,
+            'rxBytesPerSecond': 0,
+            'txBytesPerSecond': 0,
+            'tcpConnections': 0,
+            'udpSockets': 0,
+            'ended': true,
+          },
+        ],
+      });
+      when(mockWireGuardDartPlatform.statisticsStream(
+              interval: anyNamed('interval'),
+              interfaceCounters: anyNamed('interfaceCounters'),
+              processTraffic: anyNamed('processTraffic')))
+          .thenAnswer((_) => Stream.value({'tunnel': statistics}));
+
+      final result = await wireguardDart.statisticsStream(processTraffic: true).first;
+
+      final processes = result['tunnel']!.processes!;
+      expect(processes.length, 2);
+      expect(processes[0].image, 'browser.exe');
+      expect(processes[0].rxBytesPerSecond, 45000);
+      expect(processes[0].tcpConnections, 3);
+      expect(processes[1].ended, true);
+      expect(result['tunnel']!.toJson()['processes'], hasLength(2));
+      verify(mockWireGuardDartPlatform.statisticsStream(
+              interval: const Duration(seconds: 1), interfaceCounters: false, processTraffic: true))
+          .called(1);
+    });
+
+    test('should pass peer liveness events through the status stream', () async {
+      final statusStream = Stream<AdapterStatus>.fromIterable([
+        const AdapterStatus(12345, ConnectionStatus.connected, peerPublicKey: 'key=', peerStale: true),
+        const AdapterStatus(12345, ConnectionStatus.connected, peerPublicKey: 'key='),
+      ]);
+      when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched'))).thenAnswer((_) => statusStream);
+
+      final results = await wireguardDart.statusStream().toList();
+
+      expect(results[0].isPeerLiveness, true);
+      expect(results[0].peerStale, true);
+      expect(results[1].peerStale, false);
+      expect(results[0] == results[1], false);
+    });
+
+    test('should pass address and route events through the status stream', () async {
+      final statusStream = Stream<AdapterStatus>.fromIterable([
+        const AdapterStatus(12345, ConnectionStatus.connected,
+            networkChange: AdapterNetworkChange.addressReady, networkPrefix: '10.0.0.2/24'),
+        const AdapterStatus(12345, ConnectionStatus.connected,
+            networkChange: AdapterNetworkChange.routeRemoved, networkPrefix: '0.0.0.0/0'),
+      ]);
+      when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched'))).thenAnswer((_) => statusStream);
+
+      final results = await wireguardDart.statusStream().toList();
+
+      expect(results[0].isNetworkChange, true);
+      expect(results[0].networkChange, AdapterNetworkChange.addressReady);
+      expect(results[0].networkPrefix, '10.0.0.2/24');
+      expect(results[1].networkChange, AdapterNetworkChange.routeRemoved);
+      expect(results[0] == results[1], false);
+    });
+
+    test('should pass endpoint roaming events through the status stream', () async {
+      final statusStream = Stream<AdapterStatus>.fromIterable([
+        const AdapterStatus(12345, ConnectionStatus.connected,
+            peerPublicKey: 'key=', previousEndpoint: '198.51.100.1:51820', endpoint: '[2001:db8::1]:51820'),
+      ]);
+      when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched'))).thenAnswer((_) => statusStream);
+
+      final results = await wireguardDart.statusStream().toList();
+
+      expect(results[0].isEndpointRoam, true);
+      expect(results[0].isPeerLiveness, false);
+      expect(results[0].peerPublicKey, 'key=');
+      expect(results[0].previousEndpoint, '198.51.100.1:51820');
+      expect(results[0].endpoint, '[2001:db8::1]:51820');
+    });
+
+    test('should pass peer activation progress through the status stream', () async {
+      final statusStream = Stream<AdapterStatus>.fromIterable([
+        const AdapterStatus(12345, ConnectionStatus.connecting, activatedPeers: 50, totalPeers: 200),
+        const AdapterStatus(12345, ConnectionStatus.connected, activatedPeers: 200, totalPeers: 200),
+      ]);
+      when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched'))).thenAnswer((_) => statusStream);
+
+      final results = await wireguardDart.statusStream().toList();
+
+      expect(results[0].isActivation, true);
+      expect(results[0].isEndpointRoam, false);
+      expect(results[0].activatedPeers, 50);
+      expect(results[1].activatedPeers, results[1].totalPeers);
+      expect(results[0] == results[1], false);
+    });
+
+    test('should pass batched to the status stream', () async {
+      final statusStream = Stream<AdapterStatus>.fromIterable([
+        const AdapterStatus(1, ConnectionStatus.connected),
+        const AdapterStatus(2, ConnectionStatus.connecting),
+      ]);
+      when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched'))).thenAnswer((_) => statusStream);
+
+      final results = await wireguardDart.statusStream(batched: true).toList();
+
+      expect(results.map((status) => status.luid), [1, 2]);
+      verify(mockWireGuardDartPlatform.statusStream(batched: true)).called(1);
     });
 
     test('should handle error when getting status stream', () async {
-      when(mockWireGuardDartPlatform.statusStream()).thenThrow(Exception('Failed to get status stream'));
+      when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched')))
+          .thenThrow(Exception('Failed to get status stream'));
 
       expect(() => wireguardDart.statusStream(), throwsException);
-      verify(mockWireGuardDartPlatform.statusStream()).called(1);
+      verify(mockWireGuardDartPlatform.statusStream(batched: false)).called(1);
     });
 
     test('should check tunnel configuration successfully', () async {
@@ -230,10 +1232,11 @@ void main() {
   });
 
   test('should throw not implemented exception for statusStream', () async {
-    when(mockWireGuardDartPlatform.statusStream()).thenThrow(UnimplementedError('statusStream not implemented'));
+    when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched')))
+        .thenThrow(UnimplementedError('statusStream not implemented'));
 
     expect(() => wireguardDart.statusStream(), throwsA(isA<UnimplementedError>()));
-    verify(mockWireGuardDartPlatform.statusStream()).called(1);
+    verify(mockWireGuardDartPlatform.statusStream(batched: false)).called(1);
   });
 
   test('should throw not implemented exception for checkTunnelConfiguration', () async {
@@ -277,10 +1280,11 @@ void main() {
   });
 
   test('should throw not implemented exception for statusStream', () async {
-    when(mockWireGuardDartPlatform.statusStream()).thenThrow(UnimplementedError('statusStream not implemented'));
+    when(mockWireGuardDartPlatform.statusStream(batched: anyNamed('batched')))
+        .thenThrow(UnimplementedError('statusStream not implemented'));
 
     expect(() => wireguardDart.statusStream(), throwsA(isA<UnimplementedError>()));
-    verify(mockWireGuardDartPlatform.statusStream()).called(1);
+    verify(mockWireGuardDartPlatform.statusStream(batched: false)).called(1);
   });
 
   test('should throw not implemented exception for checkTunnelConfiguration', () async {
@@ -0,0 +1,140 @@
+#include "adapter_devices.h"
+
+#include <cfgmgr32.h>
+#include <devguid.h>
+#include <objbase.h>
+#include <setupapi.h>
+
+#pragma comment(lib, "cfgmgr32.lib")
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "setupapi.lib")
+
+#include <cwchar>
+#include <vector>
+
+namespace wireguard_dart {
+
+namespace adapter_devices {
+
+namespace {
+
+// A string or multi-string device property, empty if the device has none
+std::vector<wchar_t> StringProperty(HDEVINFO devices, SP_DEVINFO_DATA *device, DWORD property) {
+  DWORD bytes = 0;
+  SetupDiGetDeviceRegistryPropertyW(devices, device, property, nullptr, nullptr, 0, &bytes);
+  if (bytes == 0) {
+    return {};
+  }
+  // Two more for the terminators a registry value may lack
+  std::vector<wchar_t> value(bytes / sizeof(wchar_t) + 2, L'\0');
+  if (!SetupDiGetDeviceRegistryPropertyW(devices, device, property, nullptr, reinterpret_cast<BYTE *>(value.data()),
+                                         bytes, nullptr)) {
+    return {};
+  }
+  return value;
+}
+
+bool HasHardwareId(HDEVINFO devices, SP_DEVINFO_DATA *device) {
+  std::vector<wchar_t> ids = StringProperty(devices, device, SPDRP_HARDWAREID);
+  for (const wchar_t *id = ids.data(); !ids.empty() && *id; id += wcslen(id) + 1) {
+    if (_wcsicmp(id, kHardwareId) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The driver records the tunnel type as the device description
+bool HasTunnelType(HDEVINFO devices, SP_DEVINFO_DATA *device, const std::wstring &tunnel_type) {
+  std::vector<wchar_t> description = StringProperty(devices, device, SPDRP_DEVICEDESC);
+  return !description.empty() && _wcsicmp(description.data(), tunnel_type.c_str()) == 0;
+}
+
+GUID InterfaceGuid(HDEVINFO devices, SP_DEVINFO_DATA *device) {
+  GUID guid = {};
+  HKEY key = SetupDiOpenDevRegKey(devices, device, DICS_FLAG_GLOBAL, 0, DIREG_DRV, KEY_QUERY_VALUE);
+  if (key == INVALID_HANDLE_VALUE) {
+    return guid;
+  }
+  wchar_t text[64] = {};
+  DWORD bytes = sizeof(text) - sizeof(wchar_t);
+  DWORD type = 0;
+  if (RegQueryValueExW(key, L"NetCfgInstanceId", nullptr, &type, reinterpret_cast<BYTE *>(text), &bytes) ==
+          ERROR_SUCCESS &&
+      type == REG_SZ && FAILED(IIDFromString(text, &guid))) {
+    guid = {};
+  }
+  RegCloseKey(key);
+  return guid;
+}
+
+bool IsPresent(SP_DEVINFO_DATA *device) {
+  ULONG status = 0;
+  ULONG problem = 0;
+  return CM_Get_DevNode_Status(&status, &problem, device->DevInst, 0) == CR_SUCCESS;
+}
+
+// Visit the WireGuard devices of the net class, present or not, until visit returns false
+template <typename Visit>
+DWORD ForEachDevice(Visit visit) {
+  // Without DIGCF_PRESENT the devices of adapters that went away are listed too
+  HDEVINFO devices = SetupDiGetClassDevsExW(&GUID_DEVCLASS_NET, nullptr, nullptr, 0, nullptr, nullptr, nullptr);
+  if (devices == INVALID_HANDLE_VALUE) {
+    return GetLastError();
+  }
+  SP_DEVINFO_DATA device = {};
+  device.cbSize = sizeof(device);
+  for (DWORD i = 0; SetupDiEnumDeviceInfo(devices, i, &device); i++) {
+    if (HasHardwareId(devices, &device) && !visit(devices, &device)) {
+      break;
+    }
+  }
+  SetupDiDestroyDeviceInfoList(devices);
+  return ERROR_SUCCESS;
+}
+
+DWORD RemoveDevice(HDEVINFO devices, SP_DEVINFO_DATA *device) {
+  SP_REMOVEDEVICE_PARAMS params = {};
+  params.ClassInstallHeader.cbSize = sizeof(SP_CLASSINSTALL_HEADER);
+  params.ClassInstallHeader.InstallFunction = DIF_REMOVE;
+  params.Scope = DI_REMOVEDEVICE_GLOBAL;
+  if (!SetupDiSetClassInstallParamsW(devices, device, &params.ClassInstallHeader, sizeof(params)) ||
+      !SetupDiCallClassInstaller(DIF_REMOVE, devices, device)) {
+    return GetLastError();
+  }
+  return ERROR_SUCCESS;
+}
+
+} // namespace
+
+DWORD Remove(const GUID &guid) {
+  DWORD removed = ERROR_SUCCESS;
+  DWORD listed = ForEachDevice([&guid, &removed](HDEVINFO devices, SP_DEVINFO_DATA *device) {
+    if (!IsEqualGUID(InterfaceGuid(devices, device), guid)) {
+      return true;
+    }
+    removed = RemoveDevice(devices, device);
+    return false;
+  });
+  return listed != ERROR_SUCCESS ? listed : removed;
+}
+
+size_t RemoveOrphaned(const std::wstring &tunnel_type, size_t *failed) {
+  size_t removed = 0;
+  *failed = 0;
+  ForEachDevice([&tunnel_type, &removed, failed](HDEVINFO devices, SP_DEVINFO_DATA *device) {
+    if (!IsPresent(device) && HasTunnelType(devices, device, tunnel_type)) {
+      if (RemoveDevice(devices, device) == ERROR_SUCCESS) {
+        removed++;
+      } else {
+        (*failed)++;
+      }
+    }
+    return true;
+  });
+  return removed;
+}
+
+} // namespace adapter_devices
+
+} // namespace wireguard_dart
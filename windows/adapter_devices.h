@@ -0,0 +1,37 @@
+#pragma once
+
+#include <windows.h>
+
+#include <cstddef>
+#include <string>
+
+namespace wireguard_dart {
+
+/**
+ * The network devices of the WireGuard driver, through SetupAPI. Closing an adapter only removes its device when
+ * this process created it; one that was opened, or left behind by a crash or by a version of the plugin that gave
+ * every adapter a random GUID, stays on as a device of its own, hidden once it is no longer present. Every one of
+ * those slows down device enumeration and the start of the network stack. Removing a device needs an elevated app.
+ */
+namespace adapter_devices {
+
+// The hardware ID of every adapter the WireGuard driver creates
+constexpr wchar_t kHardwareId[] = L"WireGuard";
+
+/**
+ * Remove the WireGuard device with this interface GUID, present or not
+ * @return ERROR_SUCCESS, also when there is no such device, or the Windows error of the removal
+ */
+DWORD Remove(const GUID &guid);
+
+/**
+ * Remove the devices of the tunnel type that are no longer present. A device another process has open is present,
+ * so only adapters nobody can be using are removed.
+ * @param failed Set to how many devices could not be removed
+ * @return How many devices were removed
+ */
+size_t RemoveOrphaned(const std::wstring &tunnel_type, size_t *failed);
+
+} // namespace adapter_devices
+
+} // namespace wireguard_dart
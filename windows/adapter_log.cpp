@@ -0,0 +1,172 @@
+#include "adapter_log.h"
+
+#include <chrono>
+#include <cwchar>
+#include <limits>
+#include <mutex>
+
+#include "plugin_logger.h"
+#include "spdlog/pattern_formatter.h"
+#include "spdlog/spdlog.h"
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// FILETIME ticks between 1601 and the Unix epoch
+constexpr uint64_t kUnixEpochFiletime = 116444736000000000ULL;
+
+// Takes the "<interface index>: " the driver puts before the lines of an adapter off the line
+bool TakeIndexPrefix(std::string_view *line, NET_IFINDEX *index) {
+  uint64_t value = 0;
+  size_t digits = 0;
+  while (digits < line->size() && digits < 10 && (*line)[digits] >= '0' && (*line)[digits] <= '9') {
+    value = value * 10 + ((*line)[digits] - '0');
+    digits++;
+  }
+  if (digits == 0 || value > std::numeric_limits<NET_IFINDEX>::max() || line->size() < digits + 2 || (*line)[digits] != ':' ||
+      (*line)[digits + 1] != ' ') {
+    return false;
+  }
+  *index = static_cast<NET_IFINDEX>(value);
+  line->remove_prefix(digits + 2);
+  return true;
+}
+
+// Into the file log, stamped with the time the driver logged it and after the tunnel's name if there is one
+void LogDriverLine(spdlog::logger *logger, spdlog::level::level_enum level, spdlog::log_clock::time_point time,
+                   std::string_view tunnel_name, std::string_view message) {
+  spdlog::memory_buf_t buffer;
+  buffer.append(kDriverLogPrefix, kDriverLogPrefix + sizeof(kDriverLogPrefix) - 1);
+  if (!tunnel_name.empty()) {
+    buffer.append(tunnel_name.data(), tunnel_name.data() + tunnel_name.size());
+    buffer.append(std::string_view(": "));
+  }
+  buffer.append(message.data(), message.data() + message.size());
+  logger->log(time, spdlog::source_loc{}, level, spdlog::string_view_t(buffer.data(), buffer.size()));
+}
+
+} // namespace
+
+AdapterLogs &AdapterLogs::Instance() {
+  static AdapterLogs logs;
+  return logs;
+}
+
+VOID CALLBACK AdapterLogs::LoggerCallback(WIREGUARD_LOGGER_LEVEL level, DWORD64 timestamp, LPCWSTR message) {
+  spdlog::level::level_enum spdlog_level;
+  switch (level) {
+    case WIREGUARD_LOG_INFO:
+      spdlog_level = spdlog::level::info;
+      break;
+    case WIREGUARD_LOG_WARN:
+      spdlog_level = spdlog::level::warn;
+      break;
+    case WIREGUARD_LOG_ERR:
+      spdlog_level = spdlog::level::err;
+      break;
+    default:
+      return;
+  }
+  // Even below the file logger's level, as a line about an adapter goes into its ring
+  if (!message) {
+    return;
+  }
+
+  // Converted into spdlog's own buffer, which only goes to the heap for messages longer than it holds inline;
+  // ASCII messages are copied without a Windows call
+  size_t message_length = wcslen(message);
+  spdlog::memory_buf_t buffer;
+  buffer.resize(message_length * kMaxUtf8PerWide);
+  size_t written =
+      WideToUtf8(std::wstring_view(message, message_length), buffer.data(), message_length * kMaxUtf8PerWide);
+
+  // Stamped with the time the driver logged it, not when the callback got around to it
+  auto time = spdlog::log_clock::now();
+  if (timestamp > kUnixEpochFiletime) {
+    time = spdlog::log_clock::time_point(std::chrono::duration_cast<spdlog::log_clock::duration>(
+        std::chrono::nanoseconds((timestamp - kUnixEpochFiletime) * 100)));
+  }
+  Instance().Route(spdlog_level, time, std::string_view(buffer.data(), written));
+}
+
+void AdapterLogs::Register(NET_IFINDEX index, const std::string &tunnel_name, AdapterLogMode mode,
+                           std::shared_ptr<LogRing> ring) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  entries_[index] = Entry{tunnel_name, mode, std::move(ring)};
+}
+
+void AdapterLogs::Unregister(NET_IFINDEX index) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  entries_.erase(index);
+}
+
+void AdapterLogs::Route(spdlog::level::level_enum level, spdlog::log_clock::time_point time, std::string_view line) {
+  spdlog::logger *logger = PluginLogger::Current();
+  std::string_view message = line;
+  NET_IFINDEX index = 0;
+  Entry entry;
+  bool registered = false;
+  if (TakeIndexPrefix(&message, &index)) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto found = entries_.find(index);
+    if (found != entries_.end()) {
+      entry = found->second;
+      registered = true;
+    }
+  }
+  if (!registered) {
+    if (logger->should_log(level)) {
+      LogDriverLine(logger, level, time, {}, line);
+    }
+    return;
+  }
+
+  // Named after the tunnel, which the formatted records of the ring show
+  spdlog::details::log_msg msg(time, spdlog::source_loc{}, entry.tunnel_name, level,
+                               spdlog::string_view_t(message.data(), message.size()));
+  entry.ring->log(msg);
+  if (entry.mode == AdapterLogMode::kOn && level >= spdlog::level::err) {
+    // With the lines that led up to it
+    Dump(entry.tunnel_name, *entry.ring, "a driver error", level);
+    return;
+  }
+  if ((entry.mode == AdapterLogMode::kOnWithPrefix || level >= spdlog::level::warn) && logger->should_log(level)) {
+    LogDriverLine(logger, level, time, entry.tunnel_name, message);
+  }
+}
+
+void AdapterLogs::Dump(const std::string &tunnel_name, LogRing &ring, std::string_view reason,
+                       spdlog::level::level_enum level) {
+  spdlog::logger *logger = PluginLogger::Current();
+  if (!logger->should_log(level)) {
+    return;
+  }
+  std::vector<spdlog::details::log_msg_buffer> records = ring.TakeRaw();
+  if (records.empty()) {
+    return;
+  }
+  // One record at the level of the dump, so the file logger's level does not hold back the info lines in it
+  spdlog::pattern_formatter formatter("%H:%M:%S.%e %l %v", spdlog::pattern_time_type::local, "");
+  std::string header = std::string(kDriverLogPrefix) + "Driver log of tunnel " + tunnel_name + " after " +
+                       std::string(reason) + ", " + std::to_string(records.size()) + " lines:";
+  spdlog::memory_buf_t text;
+  text.append(header.data(), header.data() + header.size());
+  for (const auto &record : records) {
+    text.push_back('\n');
+    formatter.format(record, text);
+  }
+  logger->log(level, spdlog::string_view_t(text.data(), text.size()));
+}
+
+size_t AdapterLogs::MemoryBytes() {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (const auto &entry : entries_) {
+    bytes += entry.second.ring->MemoryBytes();
+  }
+  return bytes;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <windows.h>
+#include <ifdef.h>
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "log_ring.h"
+#include "spdlog/common.h"
+#include "wireguard.h"
+
+namespace wireguard_dart {
+
+// Put before the lines the WireGuard driver logs, so they can be told apart from the plugin's own
+constexpr char kDriverLogPrefix[] = "[wireguard.dll] ";
+
+// Where the driver's lines about an adapter go, see WireguardAdapter::SetLogMode
+enum class AdapterLogMode {
+  // The driver logs nothing about the adapter
+  kOff,
+  // Into the adapter's ring, and only warnings and errors into the file log
+  kOn,
+  // Into the adapter's ring and every line into the file log, after the tunnel's name
+  kOnWithPrefix,
+};
+
+/**
+ * Sorts the lines the driver logs by adapter. A logging adapter has the driver put its interface index before each
+ * of its lines (WIREGUARD_ADAPTER_LOG_ON_WITH_PREFIX), by which the line goes into the ring of the adapter
+ * registered under that index rather than the file log, so a hub of many tunnels does not write every handshake to
+ * disk. An error line writes the ring to the file log, with the lines that led up to it. Lines of no registered
+ * adapter, such as those of the library about creating one, go to the file log as they are.
+ *
+ * Safe from any thread; the library calls the logger callback from threads of its own.
+ */
+class AdapterLogs {
+public:
+  // Per adapter, each slot allocated up front
+  static constexpr size_t kRingLines = 64;
+
+  static AdapterLogs &Instance();
+
+  // The WIREGUARD_LOGGER_CALLBACK to hand WireGuardSetLogger, which routes each line to Instance()
+  static VOID CALLBACK LoggerCallback(WIREGUARD_LOGGER_LEVEL level, DWORD64 timestamp, LPCWSTR message);
+
+  // Replaces what was registered under the index
+  void Register(NET_IFINDEX index, const std::string &tunnel_name, AdapterLogMode mode, std::shared_ptr<LogRing> ring);
+  void Unregister(NET_IFINDEX index);
+
+  // A line the driver logged, in UTF-8 and after kDriverLogPrefix
+  void Route(spdlog::level::level_enum level, spdlog::log_clock::time_point time, std::string_view line);
+
+  // Write the records of the ring to the file log as one record at the level, oldest first, and empty the ring
+  static void Dump(const std::string &tunnel_name, LogRing &ring, std::string_view reason,
+                   spdlog::level::level_enum level);
+
+  // The rings of the registered adapters
+  size_t MemoryBytes();
+
+private:
+  struct Entry {
+    std::string tunnel_name;
+    AdapterLogMode mode;
+    std::shared_ptr<LogRing> ring;
+  };
+
+  std::shared_mutex mutex_;
+  std::unordered_map<NET_IFINDEX, Entry> entries_;
+};
+
+} // namespace wireguard_dart
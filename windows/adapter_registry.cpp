@@ -0,0 +1,124 @@
+#include "adapter_registry.h"
+
+#include <mutex>
+
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+WireguardAdapter *AdapterRegistry::FindByName(const std::string &name) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return FindByNameLocked(name);
+}
+
+WireguardAdapter *AdapterRegistry::FindByLuid(const NET_LUID &luid) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return FindByLuidLocked(luid);
+}
+
+WireguardAdapter *AdapterRegistry::FindByNameLocked(const std::string &name) const {
+  auto it = by_name_.find(name);
+  return it != by_name_.end() ? it->second.adapter.get() : nullptr;
+}
+
+WireguardAdapter *AdapterRegistry::FindByLuidLocked(const NET_LUID &luid) const {
+  auto it = by_luid_.find(luid.Value);
+  return it != by_luid_.end() ? it->second : nullptr;
+}
+
+bool AdapterRegistry::GetLuidLocked(const std::string &name, NET_LUID *luid) const {
+  auto it = by_name_.find(name);
+  if (it == by_name_.end() || !it->second.has_luid) {
+    return false;
+  }
+  *luid = it->second.luid;
+  return true;
+}
+
+void AdapterRegistry::ForEachLocked(
+    const std::function<void(const std::string &name, WireguardAdapter *adapter)> &visit) const {
+  for (const auto &entry : by_name_) {
+    visit(entry.first, entry.second.adapter.get());
+  }
+}
+
+bool AdapterRegistry::Empty() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return by_name_.empty();
+}
+
+void AdapterRegistry::Add(std::unique_ptr<WireguardAdapter> adapter) {
+  if (!adapter) {
+    return;
+  }
+
+  // Outside the lock, both are a conversion or a driver call
+  Entry entry;
+  entry.has_luid = adapter->GetLUID(&entry.luid);
+  std::string name = WideToUtf8(adapter->GetName());
+  entry.adapter = std::move(adapter);
+
+  std::unique_ptr<WireguardAdapter> replaced;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto existing = by_name_.find(name);
+    if (existing != by_name_.end()) {
+      if (existing->second.has_luid) {
+        by_luid_.erase(existing->second.luid.Value);
+      }
+      replaced = std::move(existing->second.adapter);
+      by_name_.erase(existing);
+    }
+
+    entry.sequence = next_sequence_++;
+    if (entry.has_luid) {
+      by_luid_[entry.luid.Value] = entry.adapter.get();
+    }
+    newest_ = entry.adapter.get();
+    by_name_.emplace(std::move(name), std::move(entry));
+  }
+}
+
+std::unique_ptr<WireguardAdapter> AdapterRegistry::Remove(const std::string &name) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto it = by_name_.find(name);
+  if (it == by_name_.end()) {
+    return nullptr;
+  }
+
+  if (it->second.has_luid) {
+    by_luid_.erase(it->second.luid.Value);
+  }
+  std::unique_ptr<WireguardAdapter> adapter = std::move(it->second.adapter);
+  by_name_.erase(it);
+  if (newest_ == adapter.get()) {
+    UpdateNewestLocked();
+  }
+  return adapter;
+}
+
+std::vector<std::unique_ptr<WireguardAdapter>> AdapterRegistry::RemoveAll() {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  std::vector<std::unique_ptr<WireguardAdapter>> adapters;
+  adapters.reserve(by_name_.size());
+  for (auto &entry : by_name_) {
+    adapters.push_back(std::move(entry.second.adapter));
+  }
+  by_name_.clear();
+  by_luid_.clear();
+  newest_ = nullptr;
+  return adapters;
+}
+
+void AdapterRegistry::UpdateNewestLocked() {
+  // Only after removing the newest one, which is rare enough for a scan
+  const Entry *newest = nullptr;
+  for (const auto &entry : by_name_) {
+    if (!newest || entry.second.sequence > newest->sequence) {
+      newest = &entry.second;
+    }
+  }
+  newest_ = newest ? newest->adapter.get() : nullptr;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <windows.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "wireguard_adapter.h"
+
+namespace wireguard_dart {
+
+/**
+ * The plugin's adapters, indexed by UTF-8 tunnel name and by LUID, the two ways method calls and status
+ * events identify them. The LUID is read from the driver once, when the adapter is added.
+ *
+ * Lookups share the lock, so status and statistics reads do not wait for each other. A pointer found stays
+ * valid until its adapter is removed, which only the worker of that tunnel does; readers on other threads
+ * keep a lock from LockShared while they use it.
+ */
+class AdapterRegistry {
+public:
+  std::shared_lock<std::shared_mutex> LockShared() const { return std::shared_lock<std::shared_mutex>(mutex_); }
+
+  WireguardAdapter *FindByName(const std::string &name) const;
+  WireguardAdapter *FindByLuid(const NET_LUID &luid) const;
+  // The same, with a lock from LockShared held by the caller
+  WireguardAdapter *FindByNameLocked(const std::string &name) const;
+  WireguardAdapter *FindByLuidLocked(const NET_LUID &luid) const;
+  // The LUID read when the adapter was added, without a driver call; false if it is unknown
+  bool GetLuidLocked(const std::string &name, NET_LUID *luid) const;
+
+  // The adapter added last that is still in the registry, or nullptr; with a lock from LockShared held
+  WireguardAdapter *NewestLocked() const { return newest_; }
+  bool Empty() const;
+  // Every adapter with its tunnel name, with a lock from LockShared held
+  void ForEachLocked(const std::function<void(const std::string &name, WireguardAdapter *adapter)> &visit) const;
+
+  // Replaces an adapter of the same name
+  void Add(std::unique_ptr<WireguardAdapter> adapter);
+
+  // Take adapters out; they are handed back so that they are destroyed without the lock held
+  std::unique_ptr<WireguardAdapter> Remove(const std::string &name);
+  std::vector<std::unique_ptr<WireguardAdapter>> RemoveAll();
+
+private:
+  struct Entry {
+    std::unique_ptr<WireguardAdapter> adapter;
+    bool has_luid = false;
+    NET_LUID luid = {};
+    uint64_t sequence = 0;
+  };
+
+  // With the exclusive lock held
+  void UpdateNewestLocked();
+
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<std::string, Entry> by_name_;
+  std::unordered_map<uint64_t, WireguardAdapter *> by_luid_;
+  WireguardAdapter *newest_ = nullptr;
+  uint64_t next_sequence_ = 0;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,105 @@
+#include "adapter_teardown.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include "flight_recorder.h"
+#include "plugin_logger.h"
+#include "spdlog/spdlog.h"
+#include "wireguard_network_config.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// Shared with the workers, which may outlive the call that started them
+struct Teardown {
+  std::vector<std::unique_ptr<WireguardAdapter>> adapters;
+  NetworkTableSnapshot snapshot;
+  PluginLogger logger;
+  std::atomic<size_t> next{0};
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t done = 0;
+};
+
+void TearDown(const std::shared_ptr<Teardown> &teardown) {
+  while (true) {
+    size_t index = teardown->next++;
+    if (index >= teardown->adapters.size()) {
+      return;
+    }
+
+    std::unique_ptr<WireguardAdapter> &adapter = teardown->adapters[index];
+    if (adapter && adapter->IsValid()) {
+      try {
+        if (!adapter->CleanupNetworking(&teardown->snapshot)) {
+          teardown->logger->warn("Failed to cleanup networking for adapter during shutdown");
+        }
+      } catch (...) {
+        // Destructor must not throw
+        teardown->logger->error("Exception during network cleanup in destructor");
+      }
+    }
+    adapter.reset();
+
+    std::lock_guard<std::mutex> lock(teardown->mutex);
+    teardown->done++;
+    teardown->finished.notify_all();
+  }
+}
+
+} // namespace
+
+size_t TearDownAdapters(std::vector<std::unique_ptr<WireguardAdapter>> adapters, std::chrono::milliseconds deadline) {
+  if (adapters.empty()) {
+    return 0;
+  }
+
+  auto give_up_at = std::chrono::steady_clock::now() + deadline;
+  auto teardown = std::make_shared<Teardown>();
+  teardown->adapters = std::move(adapters);
+  if (!teardown->snapshot.Take()) {
+    teardown->logger->warn("Failed to snapshot the network tables, adapters scan them for cleanup themselves");
+  }
+
+  size_t total = teardown->adapters.size();
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < (std::min)(total, kTeardownWorkers); i++) {
+    try {
+      workers.emplace_back(TearDown, teardown);
+    } catch (const std::system_error &) {
+      break;
+    }
+  }
+  // The calling thread only keeps the deadline, unless there is no worker to do the work
+  if (workers.empty()) {
+    TearDown(teardown);
+  }
+
+  std::unique_lock<std::mutex> lock(teardown->mutex);
+  bool all_done =
+      teardown->finished.wait_until(lock, give_up_at, [&teardown, total] { return teardown->done == total; });
+  size_t remaining = total - teardown->done;
+  lock.unlock();
+
+  for (auto &worker : workers) {
+    if (all_done) {
+      worker.join();
+    } else {
+      // Keeps the teardown state alive until it returns; the adapters' callbacks into the plugin were stopped
+      worker.detach();
+    }
+  }
+  if (!all_done) {
+    teardown->logger->warn("Shutdown deadline reached with {} adapters still being cleaned up", remaining);
+    FlightRecorder::Instance().Dump("Shutdown deadline reached");
+  }
+  return remaining;
+}
+
+} // namespace wireguard_dart
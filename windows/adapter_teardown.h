@@ -0,0 +1,26 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "wireguard_adapter.h"
+
+namespace wireguard_dart {
+
+// Longest the plugin holds up app exit to clean up its adapters
+constexpr std::chrono::milliseconds kTeardownDeadline{3000};
+constexpr size_t kTeardownWorkers = 8;
+
+/**
+ * Clean up the networking of the adapters and close them, several at a time, with one table snapshot for the
+ * rows their ledgers do not know. Waits until the deadline at most: adapters still being cleaned up then are left
+ * to finish on their own threads, or to the reconciliation of the next setup after a restart if the process exits
+ * first. Those threads may outlive the caller, whose callbacks the adapters must not call any more, see
+ * WireguardAdapter::StopCallbacks.
+ * @return The number of adapters that were not torn down by the deadline
+ */
+size_t TearDownAdapters(std::vector<std::unique_ptr<WireguardAdapter>> adapters, std::chrono::milliseconds deadline);
+
+} // namespace wireguard_dart
@@ -0,0 +1,305 @@
+#include "app_split_tunnel.h"
+
+#include <sddl.h>
+
+#include <set>
+
+#pragma comment(lib, "fwpuclnt.lib")
+#pragma comment(lib, "rpcrt4.lib")
+
+#include "spdlog/spdlog.h"
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr UINT8 kAppWeight = 12;
+constexpr UINT8 kTunnelWeight = 0;
+// Just below the kill switch, a block in either sublayer wins over a permit in the other anyway
+constexpr UINT16 kSublayerWeight = 0xFFFE;
+
+wchar_t kName[] = L"WireGuard Dart split tunnel";
+
+const GUID *kLayers[] = {&FWPM_LAYER_ALE_AUTH_CONNECT_V4, &FWPM_LAYER_ALE_AUTH_CONNECT_V6,
+                         &FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4, &FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6};
+const GUID *kConnectLayers[] = {&FWPM_LAYER_ALE_AUTH_CONNECT_V4, &FWPM_LAYER_ALE_AUTH_CONNECT_V6};
+
+constexpr UINT16 kDnsPort = 53;
+
+constexpr wchar_t kPackageSidPrefix[] = L"S-1-15-2-";
+
+bool IsPackageSid(const std::wstring &app) { return app.rfind(kPackageSidPrefix, 0) == 0; }
+
+} // namespace
+
+AppSplitTunnel::~AppSplitTunnel() { Stop(); }
+
+bool AppSplitTunnel::Apply(const NET_LUID &tunnel_luid, Mode mode, const std::vector<std::wstring> &apps,
+                           std::string *error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (mode == Mode::kOff) {
+    StopLocked();
+    return true;
+  }
+  if (!engine_ && !OpenLocked(error)) {
+    return false;
+  }
+
+  std::set<std::wstring> wanted(apps.begin(), apps.end());
+  // Another mode or interface changes every filter, still in the one transaction
+  bool reset = mode != mode_ || tunnel_luid.Value != tunnel_luid_.Value;
+
+  DWORD result = FwpmTransactionBegin0(engine_, 0);
+  if (result != ERROR_SUCCESS) {
+    *error = "Failed to begin split tunnel transaction: error " + std::to_string(result);
+    logger_->error("{}", *error);
+    return false;
+  }
+
+  NET_LUID previous_luid = tunnel_luid_;
+  Mode previous_mode = mode_;
+  tunnel_luid_ = tunnel_luid;
+  mode_ = mode;
+
+  bool ok = true;
+  std::vector<UINT64> mode_filters;
+  size_t removed = 0;
+  if (reset) {
+    for (UINT64 filter_id : mode_filters_) {
+      ok = ok && FwpmFilterDeleteById0(engine_, filter_id) == ERROR_SUCCESS;
+    }
+    ok = ok && AddModeFiltersLocked(mode_filters);
+  }
+  for (const auto &entry : app_filters_) {
+    if (!reset && wanted.count(entry.first) > 0) {
+      continue;
+    }
+    for (UINT64 filter_id : entry.second) {
+      ok = ok && FwpmFilterDeleteById0(engine_, filter_id) == ERROR_SUCCESS;
+    }
+    removed++;
+  }
+
+  std::map<std::wstring, std::vector<UINT64>> added;
+  for (const auto &app : wanted) {
+    if (ok && (reset || app_filters_.count(app) == 0)) {
+      ok = AddAppFiltersLocked(app, added[app], error);
+    }
+  }
+  if (ok) {
+    result = FwpmTransactionCommit0(engine_);
+    ok = result == ERROR_SUCCESS;
+    if (!ok) {
+      *error = "Failed to commit split tunnel filters: error " + std::to_string(result);
+    }
+  }
+
+  if (!ok) {
+    FwpmTransactionAbort0(engine_);
+    tunnel_luid_ = previous_luid;
+    mode_ = previous_mode;
+    if (error->empty()) {
+      *error = "Failed to update split tunnel filters";
+    }
+    logger_->error("{}", *error);
+    return false;
+  }
+
+  if (reset) {
+    mode_filters_ = std::move(mode_filters);
+    app_filters_.clear();
+  } else {
+    for (auto it = app_filters_.begin(); it != app_filters_.end();) {
+      it = wanted.count(it->first) > 0 ? std::next(it) : app_filters_.erase(it);
+    }
+  }
+  app_filters_.insert(added.begin(), added.end());
+  logger_->info("Split tunnel {} {} applications: {} added, {} removed",
+                mode == Mode::kInclude ? "includes" : "excludes", app_filters_.size(), added.size(), removed);
+  return true;
+}
+
+void AppSplitTunnel::Stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  StopLocked();
+}
+
+bool AppSplitTunnel::OpenLocked(std::string *error) {
+  // Dynamic: should the process go away without Stop, the engine removes every filter with the session
+  FWPM_SESSION0 session = {};
+  session.displayData.name = kName;
+  session.flags = FWPM_SESSION_FLAG_DYNAMIC;
+
+  DWORD result = FwpmEngineOpen0(nullptr, RPC_C_AUTHN_WINNT, nullptr, &session, &engine_);
+  if (result != ERROR_SUCCESS) {
+    engine_ = nullptr;
+    *error = "Failed to open the filtering engine: error " + std::to_string(result);
+    logger_->error("{}", *error);
+    return false;
+  }
+  if (UuidCreate(&sublayer_key_) != RPC_S_OK) {
+    *error = "Failed to create the split tunnel sublayer key";
+    logger_->error("{}", *error);
+    StopLocked();
+    return false;
+  }
+
+  FWPM_SUBLAYER0 sublayer = {};
+  sublayer.subLayerKey = sublayer_key_;
+  sublayer.displayData.name = kName;
+  sublayer.weight = kSublayerWeight;
+  result = FwpmSubLayerAdd0(engine_, &sublayer, nullptr);
+  if (result != ERROR_SUCCESS) {
+    *error = "Failed to add the split tunnel sublayer: error " + std::to_string(result);
+    logger_->error("{}", *error);
+    StopLocked();
+    return false;
+  }
+  return true;
+}
+
+void AppSplitTunnel::StopLocked() {
+  if (engine_) {
+    // Closing the dynamic session deletes the sublayer and all of its filters at once
+    FwpmEngineClose0(engine_);
+    engine_ = nullptr;
+    logger_->info("Split tunnel removed");
+  }
+  mode_ = Mode::kOff;
+  tunnel_luid_ = {};
+  mode_filters_.clear();
+  app_filters_.clear();
+}
+
+bool AppSplitTunnel::AddModeFiltersLocked(std::vector<UINT64> &filter_ids) {
+  // Only include mode keeps the applications that are not listed off the tunnel
+  if (mode_ != Mode::kInclude) {
+    return true;
+  }
+
+  UINT64 tunnel_luid = tunnel_luid_.Value;
+  for (const GUID *layer : kLayers) {
+    FWPM_FILTER_CONDITION0 tunnel = {};
+    tunnel.fieldKey = FWPM_CONDITION_IP_LOCAL_INTERFACE;
+    tunnel.matchType = FWP_MATCH_EQUAL;
+    tunnel.conditionValue.type = FWP_UINT64;
+    tunnel.conditionValue.uint64 = &tunnel_luid;
+    UINT64 filter_id = 0;
+    if (!AddFilterLocked(*layer, kTunnelWeight, FWP_ACTION_BLOCK, &tunnel, 1, &filter_id)) {
+      return false;
+    }
+    filter_ids.push_back(filter_id);
+  }
+
+  // The included applications resolve names through the DNS client service, which runs in svchost.exe and
+  // would be blocked with everything else; only its DNS queries go through
+  wchar_t system_directory[MAX_PATH];
+  UINT length = GetSystemDirectoryW(system_directory, MAX_PATH);
+  if (length == 0 || length >= MAX_PATH) {
+    logger_->error("Failed to find the system directory: error {}", GetLastError());
+    return false;
+  }
+  FWP_BYTE_BLOB *svchost_id = nullptr;
+  DWORD result =
+      FwpmGetAppIdFromFileName0((std::wstring(system_directory, length) + L"\\svchost.exe").c_str(), &svchost_id);
+  if (result != ERROR_SUCCESS) {
+    logger_->error("No application ID for svchost.exe: error {}", result);
+    return false;
+  }
+  FWPM_FILTER_CONDITION0 dns[3] = {};
+  dns[0].fieldKey = FWPM_CONDITION_IP_LOCAL_INTERFACE;
+  dns[0].matchType = FWP_MATCH_EQUAL;
+  dns[0].conditionValue.type = FWP_UINT64;
+  dns[0].conditionValue.uint64 = &tunnel_luid;
+  dns[1].fieldKey = FWPM_CONDITION_ALE_APP_ID;
+  dns[1].matchType = FWP_MATCH_EQUAL;
+  dns[1].conditionValue.type = FWP_BYTE_BLOB_TYPE;
+  dns[1].conditionValue.byteBlob = svchost_id;
+  dns[2].fieldKey = FWPM_CONDITION_IP_REMOTE_PORT;
+  dns[2].matchType = FWP_MATCH_EQUAL;
+  dns[2].conditionValue.type = FWP_UINT16;
+  dns[2].conditionValue.uint16 = kDnsPort;
+  bool ok = true;
+  for (const GUID *layer : kConnectLayers) {
+    UINT64 filter_id = 0;
+    ok = ok && AddFilterLocked(*layer, kAppWeight, FWP_ACTION_PERMIT, dns, 3, &filter_id);
+    if (ok) {
+      filter_ids.push_back(filter_id);
+    }
+  }
+  FwpmFreeMemory0(reinterpret_cast<void **>(&svchost_id));
+  return ok;
+}
+
+bool AppSplitTunnel::AddAppFiltersLocked(const std::wstring &app, std::vector<UINT64> &filter_ids,
+                                         std::string *error) {
+  FWPM_FILTER_CONDITION0 conditions[2] = {};
+  UINT64 tunnel_luid = tunnel_luid_.Value;
+  conditions[0].fieldKey = FWPM_CONDITION_IP_LOCAL_INTERFACE;
+  conditions[0].matchType = FWP_MATCH_EQUAL;
+  conditions[0].conditionValue.type = FWP_UINT64;
+  conditions[0].conditionValue.uint64 = &tunnel_luid;
+  conditions[1].matchType = FWP_MATCH_EQUAL;
+
+  FWP_BYTE_BLOB *app_id = nullptr;
+  PSID package_sid = nullptr;
+  if (IsPackageSid(app)) {
+    if (!ConvertStringSidToSidW(app.c_str(), &package_sid)) {
+      *error = "Invalid package SID: " + WideToUtf8(app);
+      return false;
+    }
+    conditions[1].fieldKey = FWPM_CONDITION_ALE_PACKAGE_ID;
+    conditions[1].conditionValue.type = FWP_SID;
+    conditions[1].conditionValue.sid = static_cast<SID *>(package_sid);
+  } else {
+    DWORD result = FwpmGetAppIdFromFileName0(app.c_str(), &app_id);
+    if (result != ERROR_SUCCESS) {
+      *error = "No application ID for " + WideToUtf8(app) + ": error " + std::to_string(result);
+      return false;
+    }
+    conditions[1].fieldKey = FWPM_CONDITION_ALE_APP_ID;
+    conditions[1].conditionValue.type = FWP_BYTE_BLOB_TYPE;
+    conditions[1].conditionValue.byteBlob = app_id;
+  }
+
+  UINT32 action = mode_ == Mode::kInclude ? FWP_ACTION_PERMIT : FWP_ACTION_BLOCK;
+  bool ok = true;
+  for (const GUID *layer : kLayers) {
+    UINT64 filter_id = 0;
+    ok = ok && AddFilterLocked(*layer, kAppWeight, action, conditions, 2, &filter_id);
+    if (ok) {
+      filter_ids.push_back(filter_id);
+    }
+  }
+
+  if (app_id) {
+    FwpmFreeMemory0(reinterpret_cast<void **>(&app_id));
+  }
+  if (package_sid) {
+    LocalFree(package_sid);
+  }
+  return ok;
+}
+
+bool AppSplitTunnel::AddFilterLocked(const GUID &layer, UINT8 weight, UINT32 action,
+                                     FWPM_FILTER_CONDITION0 *conditions, UINT32 condition_count, UINT64 *filter_id) {
+  FWPM_FILTER0 filter = {};
+  filter.displayData.name = kName;
+  filter.layerKey = layer;
+  filter.subLayerKey = sublayer_key_;
+  filter.weight.type = FWP_UINT8;
+  filter.weight.uint8 = weight;
+  filter.numFilterConditions = condition_count;
+  filter.filterCondition = conditions;
+  filter.action.type = action;
+
+  DWORD result = FwpmFilterAdd0(engine_, &filter, nullptr, filter_id);
+  if (result != ERROR_SUCCESS) {
+    logger_->error("Failed to add split tunnel filter: error {}", result);
+    return false;
+  }
+  return true;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <fwpmu.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * Decides per application whether it may use the tunnel, with Windows Filtering Platform filters on the tunnel
+ * interface in a dynamic session and a sublayer of their own, like KillSwitch. Applications are given by the
+ * path of their executable, or by the package SID (S-1-15-2-...) of a packaged app.
+ *
+ * In include mode only the listed applications may connect through the tunnel, and the DNS client service's
+ * queries to port 53 that resolve names for them; in exclude mode the listed ones may not. A filter can only
+ * permit or block a connection, moving one to another interface takes a callout driver, so an application kept
+ * off the tunnel only gets out while the tunnel does not carry its routes.
+ *
+ * Every change is one filtering transaction that adds and deletes only the filters of the applications that
+ * changed, so the tunnel stays up and the other applications keep their connections.
+ */
+class AppSplitTunnel {
+public:
+  enum class Mode { kOff, kInclude, kExclude };
+
+  AppSplitTunnel() = default;
+  ~AppSplitTunnel();
+
+  AppSplitTunnel(const AppSplitTunnel &) = delete;
+  AppSplitTunnel &operator=(const AppSplitTunnel &) = delete;
+
+  /**
+   * Install the filters for the tunnel, or bring installed ones up to date
+   * @param tunnel_luid The tunnel interface
+   * @param mode kOff removes every filter
+   * @param apps Executable paths or package SIDs
+   * @param error Set to why the filters could not be applied; the earlier ones then stay in place
+   */
+  bool Apply(const NET_LUID &tunnel_luid, Mode mode, const std::vector<std::wstring> &apps, std::string *error);
+
+  void Stop();
+
+private:
+  bool OpenLocked(std::string *error);
+  void StopLocked();
+
+  // These run inside a transaction that the caller commits
+  bool AddModeFiltersLocked(std::vector<UINT64> &filter_ids);
+  bool AddAppFiltersLocked(const std::wstring &app, std::vector<UINT64> &filter_ids, std::string *error);
+  bool AddFilterLocked(const GUID &layer, UINT8 weight, UINT32 action, FWPM_FILTER_CONDITION0 *conditions,
+                       UINT32 condition_count, UINT64 *filter_id);
+
+  std::mutex mutex_;
+  HANDLE engine_ = nullptr;
+  GUID sublayer_key_ = {};
+  NET_LUID tunnel_luid_ = {};
+  Mode mode_ = Mode::kOff;
+  std::vector<UINT64> mode_filters_;
+  std::map<std::wstring, std::vector<UINT64>> app_filters_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
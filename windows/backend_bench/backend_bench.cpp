@@ -0,0 +1,605 @@
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <psapi.h>
+#include <ws2tcpip.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "io_reactor.h"
+#include "key_generator.h"
+#include "perf_stats.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include "string_conversions.h"
+#include "throughput_test.h"
+#include "tunnel_service.h"
+#include "wireguard_adapter.h"
+#include "wireguard_core/wireguard_key.h"
+#include "wireguard_library.h"
+
+// Runs the same scenarios on both ways the plugin can run a tunnel, the adapter it drives through wireguard.dll and
+// the tunnel service of tunnel_service.h, against a peer on a second adapter reached over loopback, and prints the
+// results as JSON. Creates adapters, routes and services, so it has to run elevated with wireguard.dll, tunnel.dll
+// and wireguard_dart_service.exe next to it. The tunnel addresses are in 10.214.0.0/24 and the routes and the
+// throughput target inside 198.18.0.0/15, the range reserved for benchmarking.
+
+namespace wireguard_dart {
+namespace {
+
+constexpr wchar_t kTunnelType[] = L"WireGuardDartBench";
+constexpr char kTunnelName[] = "WgDartBench";
+constexpr wchar_t kPeerName[] = L"WgDartBenchPeer";
+constexpr int kPeerPort = 51872;
+constexpr std::chrono::seconds kHandshakeTimeout{10};
+constexpr std::chrono::milliseconds kHandshakePollInterval{2};
+// Discard, inside the routes of the tunnel; the peer drops what it decrypts, so only the sending side is measured
+constexpr char kThroughputTarget[] = "198.18.0.9";
+constexpr uint16_t kThroughputPort = 9;
+
+struct Options {
+  int runs = 10;
+  int peers = 1000;
+  int routes = 64;
+  int polls = 1000;
+  int throughput_seconds = 10;
+  // Both when empty
+  std::string backend;
+  bool verbose = false;
+};
+
+bool ParseOptions(int argc, char **argv, Options *options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    auto number = [&](int *out) {
+      if (!value) {
+        return false;
+      }
+      *out = static_cast<int>(std::strtol(value, nullptr, 10));
+      i++;
+      return true;
+    };
+    if (arg == "--runs" && number(&options->runs)) {
+    } else if (arg == "--peers" && number(&options->peers)) {
+    } else if (arg == "--routes" && number(&options->routes)) {
+    } else if (arg == "--polls" && number(&options->polls)) {
+    } else if (arg == "--throughput-seconds" && number(&options->throughput_seconds)) {
+    } else if (arg == "--backend" && value && (std::string(value) == "driver" || std::string(value) == "service")) {
+      options->backend = value;
+      i++;
+    } else if (arg == "--verbose") {
+      options->verbose = true;
+    } else {
+      return false;
+    }
+  }
+  return options->runs > 0 && options->peers > 0 && options->routes >= 0 && options->polls > 0 &&
+         options->throughput_seconds >= 0;
+}
+
+void PrintUsage() {
+  std::printf(
+      "Usage: wireguard_dart_backend_bench [--backend driver|service] [--runs N] [--peers N] [--routes N]\n"
+      "                                    [--polls N] [--throughput-seconds N] [--verbose]\n");
+}
+
+struct KeyPair {
+  std::string public_key;
+  std::string private_key;
+};
+
+bool GenerateKeys(KeyPair *keys) {
+  uint8_t public_key[kWireguardKeyLength];
+  uint8_t private_key[kWireguardKeyLength];
+  if (!GenerateKeyPair(public_key, private_key)) {
+    return false;
+  }
+  keys->public_key = KeyToBase64(public_key);
+  keys->private_key = KeyToBase64(private_key);
+  SecureZeroMemory(private_key, sizeof(private_key));
+  return true;
+}
+
+std::string HostPrefix(uint32_t address) {
+  return std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xFF) + "." +
+         std::to_string((address >> 8) & 0xFF) + "." + std::to_string(address & 0xFF) + "/32";
+}
+
+std::string PeerConfig(const KeyPair &peer, const KeyPair &tunnel) {
+  return "[Interface]\nPrivateKey = " + peer.private_key + "\nListenPort = " + std::to_string(kPeerPort) +
+         "\nAddress = 10.214.0.1/32\n\n[Peer]\nPublicKey = " + tunnel.public_key + "\nAllowedIPs = 10.214.0.2/32\n";
+}
+
+/**
+ * The tunnel to the peer with routes from first_route on, and extra_peers more peers without endpoints, each with a
+ * host route of its own further up the range. The keepalive has the tunnel handshake as soon as it is up, on both
+ * backends alike.
+ */
+std::string TunnelConfig(const KeyPair &tunnel, const KeyPair &peer, int routes, uint32_t first_route,
+                         const std::vector<std::string> &extra_peers) {
+  std::string text = "[Interface]\nPrivateKey = " + tunnel.private_key + "\nAddress = 10.214.0.2/32\n\n[Peer]\n" +
+                     "PublicKey = " + peer.public_key + "\nEndpoint = 127.0.0.1:" + std::to_string(kPeerPort) +
+                     "\nPersistentKeepalive = 25\nAllowedIPs = 10.214.0.1/32";
+  for (int i = 0; i < routes; i++) {
+    text += ", " + HostPrefix(first_route + static_cast<uint32_t>(i));
+  }
+  text += "\n";
+  for (size_t i = 0; i < extra_peers.size(); i++) {
+    text += "\n[Peer]\nPublicKey = " + extra_peers[i] + "\nAllowedIPs = " +
+            HostPrefix(0xC6130000u + static_cast<uint32_t>(i)) + "\n"; // 198.19.0.0 + i
+  }
+  return text;
+}
+
+// Microseconds of each run of a scenario
+using Samples = std::vector<int64_t>;
+
+int64_t Percentile(Samples samples, double fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(fraction * static_cast<double>(samples.size() - 1) + 0.5);
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+std::string SamplesJson(const Samples &samples) {
+  if (samples.empty()) {
+    return "null";
+  }
+  return "{\"count\": " + std::to_string(samples.size()) + ", \"p50Us\": " + std::to_string(Percentile(samples, 0.5)) +
+         ", \"p90Us\": " + std::to_string(Percentile(samples, 0.9)) +
+         ", \"minUs\": " + std::to_string(*std::min_element(samples.begin(), samples.end())) +
+         ", \"maxUs\": " + std::to_string(*std::max_element(samples.begin(), samples.end())) + "}";
+}
+
+int64_t FiletimeValue(const FILETIME &time) {
+  return static_cast<int64_t>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime);
+}
+
+// User and kernel time of a process in microseconds, 0 without it
+int64_t ProcessCpuMicroseconds(HANDLE process) {
+  FILETIME created, exited, kernel, user;
+  if (!process || !GetProcessTimes(process, &created, &exited, &kernel, &user)) {
+    return 0;
+  }
+  return (FiletimeValue(kernel) + FiletimeValue(user)) / 10;
+}
+
+int64_t WorkingSetBytes(HANDLE process) {
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!process || !GetProcessMemoryInfo(process, &counters, sizeof(counters))) {
+    return 0;
+  }
+  return static_cast<int64_t>(counters.WorkingSetSize);
+}
+
+// Busy and total time of every processor together, in microseconds
+struct SystemTimes {
+  int64_t busy = 0;
+  int64_t total = 0;
+};
+
+SystemTimes ReadSystemTimes() {
+  FILETIME idle, kernel, user;
+  SystemTimes times;
+  if (GetSystemTimes(&idle, &kernel, &user)) {
+    // Kernel time includes the idle time
+    times.total = (FiletimeValue(kernel) + FiletimeValue(user)) / 10;
+    times.busy = times.total - FiletimeValue(idle) / 10;
+  }
+  return times;
+}
+
+struct HandleCloser {
+  void operator()(HANDLE handle) const { CloseHandle(handle); }
+};
+using ProcessHandle = std::unique_ptr<std::remove_pointer_t<HANDLE>, HandleCloser>;
+
+// The process of the tunnel's service while it runs
+ProcessHandle OpenServiceProcess(const std::string &tunnel_name) {
+  SC_HANDLE manager = OpenSCManagerW(nullptr, nullptr, SC_MANAGER_CONNECT);
+  if (!manager) {
+    return nullptr;
+  }
+  std::wstring service_name = L"WireGuardTunnel$" + Utf8ToWide(tunnel_name);
+  SC_HANDLE service = OpenServiceW(manager, service_name.c_str(), SERVICE_QUERY_STATUS);
+  SERVICE_STATUS_PROCESS status = {};
+  DWORD size = 0;
+  bool found = service && QueryServiceStatusEx(service, SC_STATUS_PROCESS_INFO, reinterpret_cast<BYTE *>(&status),
+                                               sizeof(status), &size);
+  if (service) {
+    CloseServiceHandle(service);
+  }
+  CloseServiceHandle(manager);
+  if (!found || status.dwProcessId == 0) {
+    return nullptr;
+  }
+  return ProcessHandle(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, status.dwProcessId));
+}
+
+// Polls the driver until a peer completed a handshake after since, in 100ns intervals since 1601
+bool WaitForHandshake(const WireguardAdapter &adapter, uint64_t since) {
+  auto deadline = std::chrono::steady_clock::now() + kHandshakeTimeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    WireguardAdapter::Totals totals;
+    if (adapter.GetTotals(&totals) && totals.last_handshake > since) {
+      return true;
+    }
+    std::this_thread::sleep_for(kHandshakePollInterval);
+  }
+  return false;
+}
+
+uint64_t FiletimeNow() {
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  return static_cast<uint64_t>(FiletimeValue(now));
+}
+
+/**
+ * One way of running the tunnel. Each call brings it to the state it names and returns once traffic flows, that is
+ * once a peer completed a handshake, or false with GetLastError. The adapter is the one the app reads the counters
+ * of, opened on the service's for that backend.
+ */
+class Backend {
+public:
+  virtual ~Backend() = default;
+
+  virtual const char *Name() const = 0;
+  virtual bool Up(const std::string &config) = 0;
+  virtual bool Reconnect() = 0;
+  virtual bool Swap(const std::string &config) = 0;
+  virtual void Down() = 0;
+  // The process besides this one whose CPU and memory the tunnel costs, nullptr for none
+  virtual ProcessHandle HelperProcess() const { return nullptr; }
+
+  WireguardAdapter *Adapter() const { return adapter_.get(); }
+
+protected:
+  std::unique_ptr<WireguardAdapter> adapter_;
+};
+
+class DriverBackend : public Backend {
+public:
+  explicit DriverBackend(std::shared_ptr<WireguardLibrary> library) : library_(std::move(library)) {}
+
+  const char *Name() const override { return "driver"; }
+
+  bool Up(const std::string &config) override {
+    uint64_t since = FiletimeNow();
+    adapter_ = WireguardAdapter::Create(library_, Utf8ToWide(kTunnelName), kTunnelType);
+    return adapter_ && adapter_->ApplyConfiguration(config) && adapter_->ConfigureNetworking() &&
+           adapter_->SetState(WIREGUARD_ADAPTER_STATE_UP) && WaitForHandshake(*adapter_, since);
+  }
+
+  bool Reconnect() override {
+    if (!adapter_->SetState(WIREGUARD_ADAPTER_STATE_DOWN)) {
+      return false;
+    }
+    uint64_t since = FiletimeNow();
+    return adapter_->SetState(WIREGUARD_ADAPTER_STATE_UP) && WaitForHandshake(*adapter_, since);
+  }
+
+  // The session with the peer survives the swap, so traffic flows as soon as the networking is in place
+  bool Swap(const std::string &config) override {
+    return adapter_->ApplyConfiguration(config) && adapter_->ConfigureNetworking();
+  }
+
+  void Down() override {
+    if (adapter_) {
+      adapter_->SetState(WIREGUARD_ADAPTER_STATE_DOWN);
+      adapter_->CleanupNetworking();
+      adapter_.reset();
+    }
+  }
+
+private:
+  std::shared_ptr<WireguardLibrary> library_;
+};
+
+class ServiceBackend : public Backend {
+public:
+  explicit ServiceBackend(std::shared_ptr<WireguardLibrary> library) : library_(std::move(library)) {}
+
+  const char *Name() const override { return "service"; }
+
+  bool Up(const std::string &config) override {
+    // The service replaces its adapter, the handle to the one it had would keep it from going away
+    adapter_.reset();
+    uint64_t since = FiletimeNow();
+    return Fail(tunnel_service::Install(kTunnelName, config)) && Attach(since);
+  }
+
+  bool Reconnect() override {
+    adapter_.reset();
+    if (!Fail(tunnel_service::Stop(kTunnelName))) {
+      return false;
+    }
+    uint64_t since = FiletimeNow();
+    return Fail(tunnel_service::Start(kTunnelName)) && Attach(since);
+  }
+
+  // Installing over the running service restarts it with the new configuration
+  bool Swap(const std::string &config) override { return Up(config); }
+
+  void Down() override {
+    adapter_.reset();
+    tunnel_service::Remove(kTunnelName);
+  }
+
+  ProcessHandle HelperProcess() const override { return OpenServiceProcess(kTunnelName); }
+
+private:
+  static bool Fail(DWORD error) {
+    SetLastError(error);
+    return error == ERROR_SUCCESS;
+  }
+
+  // The service created a new adapter, whose counters are read over a handle of its own
+  bool Attach(uint64_t since) {
+    adapter_ = WireguardAdapter::Open(library_, Utf8ToWide(kTunnelName));
+    if (!adapter_) {
+      return false;
+    }
+    adapter_->SetServiceOwned();
+    return WaitForHandshake(*adapter_, since);
+  }
+
+  std::shared_ptr<WireguardLibrary> library_;
+};
+
+/**
+ * Runs the step runs times, each timed from its start until it returned, and the untimed reset after each; false
+ * with the step's error
+ */
+bool Measure(int runs, const std::function<bool()> &step, Samples *samples,
+             const std::function<void()> &reset = nullptr) {
+  for (int i = 0; i < runs; i++) {
+    int64_t started = PerfCounterMicroseconds();
+    if (!step()) {
+      return false;
+    }
+    samples->push_back(PerfCounterMicroseconds() - started);
+    if (reset) {
+      reset();
+    }
+  }
+  return true;
+}
+
+// The cost of one counter read the app makes when it polls the statistics
+Samples MeasurePolling(WireguardAdapter &adapter, int polls) {
+  Samples samples;
+  WireguardAdapter::CounterSnapshot snapshot;
+  for (int i = 0; i < polls; i++) {
+    int64_t started = PerfCounterMicroseconds();
+    if (!adapter.GetCounterSnapshot(&snapshot)) {
+      break;
+    }
+    samples.push_back(PerfCounterMicroseconds() - started);
+  }
+  return samples;
+}
+
+// UDP through the tunnel for the given time, with the CPU and memory it took; null when it could not start
+std::string MeasureThroughput(Backend &backend, IoReactor *reactor, int seconds) {
+  NET_LUID luid;
+  ThroughputTest::Options test_options;
+  if (seconds == 0 || !backend.Adapter()->GetLUID(&luid) ||
+      ConvertInterfaceLuidToIndex(&luid, &test_options.interface_index) != NO_ERROR) {
+    return "null";
+  }
+  test_options.protocol = ThroughputTest::Protocol::kUdp;
+  test_options.duration = std::chrono::seconds(seconds);
+  test_options.target.si_family = AF_INET;
+  inet_pton(AF_INET, kThroughputTarget, &test_options.target.Ipv4.sin_addr);
+  test_options.target.Ipv4.sin_port = htons(kThroughputPort);
+
+  ProcessHandle helper = backend.HelperProcess();
+  HANDLE self = GetCurrentProcess();
+  int64_t self_cpu = ProcessCpuMicroseconds(self);
+  int64_t helper_cpu = ProcessCpuMicroseconds(helper.get());
+  SystemTimes system = ReadSystemTimes();
+  int64_t self_peak = WorkingSetBytes(self);
+  int64_t helper_peak = WorkingSetBytes(helper.get());
+
+  ThroughputTest test(reactor, test_options);
+  if (!test.Start()) {
+    return "null";
+  }
+  while (!test.Finished()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    self_peak = (std::max)(self_peak, WorkingSetBytes(self));
+    helper_peak = (std::max)(helper_peak, WorkingSetBytes(helper.get()));
+  }
+  ThroughputTest::Result result = test.Stop();
+
+  SystemTimes system_after = ReadSystemTimes();
+  int64_t system_total = system_after.total - system.total;
+  int64_t system_busy_permille =
+      system_total > 0 ? (system_after.busy - system.busy) * 1000 / system_total : 0;
+  return "{\"bytesSent\": " + std::to_string(result.bytes_sent) +
+         ", \"sentBps\": " + std::to_string(result.GoodputBitsPerSecond()) +
+         ", \"sendErrors\": " + std::to_string(result.send_errors) +
+         ", \"elapsedMs\": " + std::to_string(result.elapsed_ms) +
+         ", \"appCpuUs\": " + std::to_string(ProcessCpuMicroseconds(self) - self_cpu) +
+         ", \"helperCpuUs\": " + std::to_string(ProcessCpuMicroseconds(helper.get()) - helper_cpu) +
+         ", \"systemBusyPermille\": " + std::to_string(system_busy_permille) +
+         ", \"appPeakWorkingSet\": " + std::to_string(self_peak) +
+         ", \"helperPeakWorkingSet\": " + std::to_string(helper_peak) + "}";
+}
+
+// Every scenario on one backend, as a JSON object; false with the scenario that failed
+bool RunBackend(Backend &backend, const Options &options, const std::string &config,
+                const std::string &swapped_config, const std::string &hub_config, IoReactor *reactor,
+                std::string *json, std::string *failed) {
+  auto fail = [&backend, failed](const char *scenario) {
+    *failed = std::string(backend.Name()) + " " + scenario + " (error " + std::to_string(GetLastError()) + ")";
+    backend.Down();
+    return false;
+  };
+  auto log = [&backend, &options](const char *scenario) {
+    if (options.verbose) {
+      std::fprintf(stderr, "%s: %s\n", backend.Name(), scenario);
+    }
+  };
+
+  // From nothing to traffic flowing, torn down again after each run
+  log("cold start");
+  Samples cold_start;
+  if (!Measure(options.runs, [&] { return backend.Up(config); }, &cold_start, [&] { backend.Down(); })) {
+    return fail("cold start");
+  }
+
+  log("warm reconnect");
+  Samples warm_reconnect;
+  if (!backend.Up(config)) {
+    return fail("warm reconnect setup");
+  }
+  int64_t app_working_set = ProcessWorkingSetBytes();
+  int64_t helper_working_set = WorkingSetBytes(backend.HelperProcess().get());
+  if (!Measure(options.runs, [&] { return backend.Reconnect(); }, &warm_reconnect)) {
+    return fail("warm reconnect");
+  }
+
+  // There and back in every run, so both directions are timed as often, each into its own samples, and the
+  // tunnel is on config again for what follows
+  log("config swap");
+  Samples config_swap;
+  Samples config_swap_back;
+  for (int i = 0; i < options.runs; i++) {
+    if (!Measure(1, [&] { return backend.Swap(swapped_config); }, &config_swap) ||
+        !Measure(1, [&] { return backend.Swap(config); }, &config_swap_back)) {
+      return fail("config swap");
+    }
+  }
+
+  log("stats polling");
+  Samples polling = MeasurePolling(*backend.Adapter(), options.polls);
+
+  log("throughput");
+  std::string throughput = MeasureThroughput(backend, reactor, options.throughput_seconds);
+  backend.Down();
+
+  // The cold start of a hub, and what polling its peers costs
+  log("hub");
+  Samples hub_start;
+  if (!Measure(1, [&] { return backend.Up(hub_config); }, &hub_start)) {
+    return fail("hub");
+  }
+  Samples hub_polling = MeasurePolling(*backend.Adapter(), options.polls);
+  int64_t hub_app_working_set = ProcessWorkingSetBytes();
+  int64_t hub_helper_working_set = WorkingSetBytes(backend.HelperProcess().get());
+  backend.Down();
+
+  *json = "{\"coldStart\": " + SamplesJson(cold_start) + ", \"warmReconnect\": " + SamplesJson(warm_reconnect) +
+          ", \"configSwap\": " + SamplesJson(config_swap) + ", \"configSwapBack\": " + SamplesJson(config_swap_back) +
+          ", \"statsPoll\": " + SamplesJson(polling) +
+          ", \"hubColdStart\": " + SamplesJson(hub_start) + ", \"hubStatsPoll\": " + SamplesJson(hub_polling) +
+          ", \"throughput\": " + throughput + ", \"memory\": {\"appWorkingSet\": " + std::to_string(app_working_set) +
+          ", \"helperWorkingSet\": " + std::to_string(helper_working_set) +
+          ", \"hubAppWorkingSet\": " + std::to_string(hub_app_working_set) +
+          ", \"hubHelperWorkingSet\": " + std::to_string(hub_helper_working_set) + "}}";
+  return true;
+}
+
+int RunBench(const Options &options) {
+  std::shared_ptr<WireguardLibrary> library = WireguardLibrary::Create();
+  if (!library) {
+    std::fprintf(stderr, "Failed to load wireguard.dll, it has to be next to the executable\n");
+    return 2;
+  }
+
+  KeyPair peer_keys;
+  KeyPair tunnel_keys;
+  if (!GenerateKeys(&peer_keys) || !GenerateKeys(&tunnel_keys)) {
+    std::fprintf(stderr, "Failed to generate keys\n");
+    return 2;
+  }
+  std::vector<std::string> hub_peers;
+  for (int i = 1; i < options.peers; i++) {
+    KeyPair keys;
+    if (!GenerateKeys(&keys)) {
+      std::fprintf(stderr, "Failed to generate keys\n");
+      return 2;
+    }
+    hub_peers.push_back(keys.public_key);
+  }
+  // The swapped configuration routes another block, so the networking changes along with it
+  const std::string config = TunnelConfig(tunnel_keys, peer_keys, options.routes, 0xC6120000u, {});
+  const std::string swapped_config = TunnelConfig(tunnel_keys, peer_keys, options.routes, 0xC6121000u, {});
+  const std::string hub_config = TunnelConfig(tunnel_keys, peer_keys, options.routes, 0xC6120000u, hub_peers);
+
+  // The peer stays up for the whole run, only the tunnel comes and goes
+  auto peer = WireguardAdapter::Create(library, kPeerName, kTunnelType);
+  if (!peer || !peer->ApplyConfiguration(PeerConfig(peer_keys, tunnel_keys)) || !peer->ConfigureNetworking() ||
+      !peer->SetState(WIREGUARD_ADAPTER_STATE_UP)) {
+    std::fprintf(stderr, "Failed to set up the peer adapter (error %lu), is the benchmark running elevated?\n",
+                 GetLastError());
+    return 2;
+  }
+
+  IoReactor reactor;
+  std::vector<std::unique_ptr<Backend>> backends;
+  if (options.backend.empty() || options.backend == "driver") {
+    backends.push_back(std::make_unique<DriverBackend>(library));
+  }
+  if (options.backend.empty() || options.backend == "service") {
+    backends.push_back(std::make_unique<ServiceBackend>(library));
+  }
+
+  std::string results;
+  int exit_code = 0;
+  for (const auto &backend : backends) {
+    std::string json;
+    std::string failed;
+    if (!RunBackend(*backend, options, config, swapped_config, hub_config, &reactor, &json, &failed)) {
+      std::fprintf(stderr, "Failed in %s\n", failed.c_str());
+      exit_code = 1;
+      break;
+    }
+    results += std::string(results.empty() ? "" : ", ") + "\"" + backend->Name() + "\": " + json;
+  }
+
+  peer->SetState(WIREGUARD_ADAPTER_STATE_DOWN);
+  peer->CleanupNetworking();
+  peer.reset();
+  if (exit_code != 0) {
+    return exit_code;
+  }
+
+  std::printf("{\"runs\": %d, \"peers\": %d, \"routes\": %d, \"polls\": %d, \"throughputSeconds\": %d, "
+              "\"backends\": {%s}}\n",
+              options.runs, options.peers, options.routes, options.polls, options.throughput_seconds,
+              results.c_str());
+  return 0;
+}
+
+} // namespace
+} // namespace wireguard_dart
+
+int main(int argc, char **argv) {
+  wireguard_dart::Options options;
+  if (!wireguard_dart::ParseOptions(argc, argv, &options)) {
+    wireguard_dart::PrintUsage();
+    return 2;
+  }
+  // Stdout is the JSON alone
+  spdlog::set_default_logger(spdlog::stderr_color_mt("backend_bench"));
+  spdlog::set_level(options.verbose ? spdlog::level::info : spdlog::level::warn);
+  return wireguard_dart::RunBench(options);
+}
@@ -0,0 +1,74 @@
+#include "background_method_channel.h"
+
+#include <flutter/standard_method_codec.h>
+
+#include <vector>
+
+namespace wireguard_dart {
+
+namespace {
+
+// Encodes the answer on the thread that gives it and sends the envelope from the platform thread
+class EncodingResult : public flutter::MethodResult<flutter::EncodableValue> {
+public:
+  EncodingResult(PlatformTaskRunner *platform_tasks, flutter::BinaryReply reply)
+      : platform_tasks_(platform_tasks), reply_(std::move(reply)) {}
+
+protected:
+  void SuccessInternal(const flutter::EncodableValue *result) override {
+    Send(flutter::StandardMethodCodec::GetInstance().EncodeSuccessEnvelope(result));
+  }
+
+  void ErrorInternal(const std::string &error_code, const std::string &error_message,
+                     const flutter::EncodableValue *error_details) override {
+    Send(flutter::StandardMethodCodec::GetInstance().EncodeErrorEnvelope(error_code, error_message, error_details));
+  }
+
+  void NotImplementedInternal() override { Send(nullptr); }
+
+private:
+  void Send(std::unique_ptr<std::vector<uint8_t>> envelope) {
+    std::shared_ptr<std::vector<uint8_t>> data(std::move(envelope));
+    platform_tasks_->Post([reply = reply_, data]() {
+      // An empty reply is how the engine learns the method is not implemented
+      data ? reply(data->data(), data->size()) : reply(nullptr, 0);
+    });
+  }
+
+  PlatformTaskRunner *platform_tasks_;
+  flutter::BinaryReply reply_;
+};
+
+} // namespace
+
+BackgroundMethodChannel::BackgroundMethodChannel(flutter::BinaryMessenger *messenger, std::string name,
+                                                 PlatformTaskRunner *platform_tasks, Handler handler)
+    : messenger_(messenger),
+      name_(std::move(name)),
+      platform_tasks_(platform_tasks),
+      handler_(std::move(handler)),
+      tasks_(1, "bulkChannel") {
+  messenger_->SetMessageHandler(name_, [this](const uint8_t *message, size_t message_size,
+                                              flutter::BinaryReply reply) {
+    HandleMessage(message, message_size, std::move(reply));
+  });
+}
+
+BackgroundMethodChannel::~BackgroundMethodChannel() { messenger_->SetMessageHandler(name_, nullptr); }
+
+void BackgroundMethodChannel::HandleMessage(const uint8_t *message, size_t message_size, flutter::BinaryReply reply) {
+  // The engine owns the message only until this returns
+  std::vector<uint8_t> bytes(message, message + message_size);
+  tasks_.Post(name_, [this, bytes = std::move(bytes), reply = std::move(reply)]() {
+    auto result = std::make_unique<EncodingResult>(platform_tasks_, reply);
+    std::unique_ptr<flutter::MethodCall<flutter::EncodableValue>> call =
+        flutter::StandardMethodCodec::GetInstance().DecodeMethodCall(bytes.data(), bytes.size());
+    if (!call) {
+      result->NotImplemented();
+      return;
+    }
+    handler_(*call, std::move(result));
+  });
+}
+
+} // namespace wireguard_dart
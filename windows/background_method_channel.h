@@ -0,0 +1,49 @@
+#pragma once
+
+#include <flutter/binary_messenger.h>
+#include <flutter/encodable_value.h>
+#include <flutter/method_call.h>
+#include <flutter/method_result.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "platform_task_runner.h"
+#include "tunnel_task_queue.h"
+
+namespace wireguard_dart {
+
+/**
+ * A method channel whose calls are decoded, handled and their results encoded on a serial background thread,
+ * for calls with large arguments or results. Only handing the encoded reply to the engine is left to the platform
+ * thread, so those payloads do not compete with frame rendering there. Handlers may answer from any thread.
+ *
+ * The Windows embedder has no background task queues for channels, so this stands in for one.
+ */
+class BackgroundMethodChannel {
+public:
+  using Handler = std::function<void(const flutter::MethodCall<flutter::EncodableValue> &call,
+                                     std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result)>;
+
+  // Must be created on the platform thread, platform_tasks is where the replies are sent from
+  BackgroundMethodChannel(flutter::BinaryMessenger *messenger, std::string name, PlatformTaskRunner *platform_tasks,
+                          Handler handler);
+  // Stops taking calls and waits for the one being handled; the queued ones are dropped
+  ~BackgroundMethodChannel();
+
+  BackgroundMethodChannel(const BackgroundMethodChannel &) = delete;
+  BackgroundMethodChannel &operator=(const BackgroundMethodChannel &) = delete;
+
+private:
+  void HandleMessage(const uint8_t *message, size_t message_size, flutter::BinaryReply reply);
+
+  flutter::BinaryMessenger *messenger_;
+  std::string name_;
+  PlatformTaskRunner *platform_tasks_;
+  Handler handler_;
+  // One worker, so the calls run in the order they were made
+  TunnelTaskQueue tasks_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,259 @@
+#include "background_threads.h"
+
+#include <algorithm>
+#include <system_error>
+
+#include "cpu_accounting.h"
+#include "plugin_logger.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr std::chrono::minutes kMinute{1};
+
+// Relative due times are negative, in 100 ns units
+LARGE_INTEGER RelativeDueTime(std::chrono::steady_clock::duration delay) {
+  LARGE_INTEGER due;
+  auto units = std::chrono::duration_cast<std::chrono::duration<int64_t, std::ratio<1, 10000000>>>(delay).count();
+  due.QuadPart = -(std::max)(units, int64_t(1));
+  return due;
+}
+
+ULONG ToleranceMs(std::chrono::milliseconds tolerable_delay) {
+  return static_cast<ULONG>((std::max)(tolerable_delay.count(), std::chrono::milliseconds::rep(0)));
+}
+
+} // namespace
+
+const char *BackgroundThreadName(BackgroundThread thread) {
+  switch (thread) {
+    case BackgroundThread::kStatisticsSampler:
+      return "statistics_sampler";
+    case BackgroundThread::kStatisticsRecorder:
+      return "statistics_recorder";
+    case BackgroundThread::kLogFlush:
+      return "log_flush";
+    case BackgroundThread::kKeyPool:
+      return "key_pool";
+    case BackgroundThread::kEndpointFailover:
+      return "endpoint_failover";
+    case BackgroundThread::kKeepaliveTuning:
+      return "keepalive_tuning";
+    case BackgroundThread::kPathMtuProber:
+      return "path_mtu_prober";
+    case BackgroundThread::kPeerActivation:
+      return "peer_activation";
+    case BackgroundThread::kHangWatchdog:
+      return "hang_watchdog";
+    case BackgroundThread::kTelemetry:
+      return "telemetry";
+    default:
+      return "unknown";
+  }
+}
+
+void ThrottleCurrentThread() {
+  THREAD_POWER_THROTTLING_STATE state = {};
+  state.Version = THREAD_POWER_THROTTLING_CURRENT_VERSION;
+  state.ControlMask = THREAD_POWER_THROTTLING_EXECUTION_SPEED;
+  state.StateMask = THREAD_POWER_THROTTLING_EXECUTION_SPEED;
+  SetThreadInformation(GetCurrentThread(), ThreadPowerThrottling, &state, sizeof(state));
+}
+
+WakeupCounts &WakeupCounts::Instance() {
+  static WakeupCounts counts;
+  return counts;
+}
+
+void WakeupCounts::RollLocked(Minute &minute, Clock::time_point now) {
+  auto elapsed = now - minute.start;
+  if (elapsed < kMinute) {
+    return;
+  }
+  // A thread that slept through a whole minute did not wake in it
+  minute.last_minute = elapsed < 2 * kMinute ? minute.this_minute : 0;
+  minute.this_minute = 0;
+  minute.start = now - elapsed % kMinute;
+}
+
+void WakeupCounts::Count(BackgroundThread thread) {
+  auto now = Clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  Minute &minute = minutes_[static_cast<size_t>(thread)];
+  RollLocked(minute, now);
+  minute.total++;
+  minute.this_minute++;
+}
+
+WakeupCounts::Counts WakeupCounts::Read(BackgroundThread thread) {
+  auto now = Clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  Minute &minute = minutes_[static_cast<size_t>(thread)];
+  RollLocked(minute, now);
+  return {minute.total, minute.last_minute};
+}
+
+std::string WakeupCounts::OpenMetricsFamilies() {
+  static const char kWakeups[] = "wireguard_dart_background_wakeups";
+  static const char kPerMinute[] = "wireguard_dart_background_wakeups_per_minute";
+
+  std::string totals;
+  std::string per_minute;
+  for (size_t i = 0; i < static_cast<size_t>(BackgroundThread::kCount); i++) {
+    auto thread = static_cast<BackgroundThread>(i);
+    Counts counts = Read(thread);
+    std::string labels = std::string("{thread=\"") + BackgroundThreadName(thread) + "\"}";
+    totals += std::string(kWakeups) + "_total" + labels + " " + std::to_string(counts.total) + "\n";
+    per_minute += std::string(kPerMinute) + labels + " " + std::to_string(counts.last_minute) + "\n";
+  }
+
+  std::string text;
+  text += std::string("# TYPE ") + kWakeups + " counter\n";
+  text += std::string("# HELP ") + kWakeups + " Times a background thread of the plugin woke up.\n";
+  text += totals;
+  text += std::string("# TYPE ") + kPerMinute + " gauge\n";
+  text += std::string("# HELP ") + kPerMinute + " Times a background thread woke up in the last whole minute.\n";
+  text += per_minute;
+  return text;
+}
+
+CoalescingWait::CoalescingWait(BackgroundThread kind) : kind_(kind) {
+  timer_ = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+  notified_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+  if (!timer_ || !notified_) {
+    if (timer_) {
+      CloseHandle(timer_);
+      timer_ = nullptr;
+    }
+    if (notified_) {
+      CloseHandle(notified_);
+      notified_ = nullptr;
+    }
+  }
+}
+
+CoalescingWait::~CoalescingWait() {
+  if (timer_) {
+    CloseHandle(timer_);
+  }
+  if (notified_) {
+    CloseHandle(notified_);
+  }
+}
+
+void CoalescingWait::Notify() {
+  if (notified_) {
+    SetEvent(notified_);
+  } else {
+    fallback_.notify_all();
+  }
+}
+
+bool CoalescingWait::WaitUntil(std::unique_lock<std::mutex> &lock, std::chrono::steady_clock::time_point at,
+                               std::chrono::milliseconds tolerable_delay, const std::function<bool()> &done) {
+  if (!notified_) {
+    bool result = at == std::chrono::steady_clock::time_point::max() ? (fallback_.wait(lock, done), true)
+                                                                     : fallback_.wait_until(lock, at, done);
+    WakeupCounts::Instance().Count(kind_);
+    return result;
+  }
+
+  HANDLE handles[] = {notified_, timer_};
+  while (!done()) {
+    DWORD count = 1;
+    DWORD timeout = INFINITE;
+    if (at != std::chrono::steady_clock::time_point::max()) {
+      auto now = std::chrono::steady_clock::now();
+      if (at <= now) {
+        return false;
+      }
+      LARGE_INTEGER due = RelativeDueTime(at - now);
+      if (SetWaitableTimerEx(timer_, &due, 0, nullptr, nullptr, nullptr, ToleranceMs(tolerable_delay))) {
+        count = 2;
+      } else {
+        if (!timer_failed_) {
+          timer_failed_ = true;
+          PluginLogger::Current()->warn("Failed to set the coalescing timer of the {} thread: Windows error {}",
+                                        BackgroundThreadName(kind_), GetLastError());
+        }
+        // Still on time, only without the coalescing
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(at - now);
+        timeout = static_cast<DWORD>((std::min)(left.count(), std::chrono::milliseconds::rep(INFINITE - 1)));
+      }
+    }
+
+    lock.unlock();
+    DWORD wait = WaitForMultipleObjects(count, handles, FALSE, timeout);
+    lock.lock();
+    WakeupCounts::Instance().Count(kind_);
+    if (count == 2 && wait != WAIT_OBJECT_0 + 1) {
+      // Woken before the deadline, which the next wait sets again; no need for the timer to fire meanwhile
+      CancelWaitableTimer(timer_);
+    }
+  }
+  return true;
+}
+
+PeriodicThread::~PeriodicThread() { Stop(); }
+
+bool PeriodicThread::Start(std::chrono::milliseconds interval, std::chrono::milliseconds tolerable_delay,
+                           std::function<void()> tick) {
+  Stop();
+
+  timer_ = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+  stop_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  LARGE_INTEGER due = RelativeDueTime(interval);
+  LONG period = static_cast<LONG>((std::max)(interval.count(), std::chrono::milliseconds::rep(1)));
+  if (!timer_ || !stop_) {
+    Stop();
+    return false;
+  }
+  if (!SetWaitableTimerEx(timer_, &due, period, nullptr, nullptr, nullptr, ToleranceMs(tolerable_delay))) {
+    PluginLogger::Current()->error("Failed to set the timer of the {} thread: Windows error {}",
+                                   BackgroundThreadName(kind_), GetLastError());
+    Stop();
+    return false;
+  }
+  try {
+    worker_ = std::thread(&PeriodicThread::Run, this, std::move(tick));
+  } catch (const std::system_error &) {
+    Stop();
+    return false;
+  }
+  return true;
+}
+
+void PeriodicThread::Stop() {
+  if (worker_.joinable()) {
+    SetEvent(stop_);
+    worker_.join();
+  }
+  if (timer_) {
+    CancelWaitableTimer(timer_);
+    CloseHandle(timer_);
+    timer_ = nullptr;
+  }
+  if (stop_) {
+    CloseHandle(stop_);
+    stop_ = nullptr;
+  }
+}
+
+void PeriodicThread::Run(std::function<void()> tick) {
+  ThrottleCurrentThread();
+  ScopedThreadCpu cpu(kind_);
+
+  HANDLE handles[] = {stop_, timer_};
+  while (true) {
+    DWORD wait = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    WakeupCounts::Instance().Count(kind_);
+    if (wait != WAIT_OBJECT_0 + 1) {
+      return;
+    }
+    tick();
+  }
+}
+
+} // namespace wireguard_dart
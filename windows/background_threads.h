@@ -0,0 +1,143 @@
+#pragma once
+
+#include <windows.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace wireguard_dart {
+
+// The plugin threads that only do background work, by what they are counted as
+enum class BackgroundThread {
+  kStatisticsSampler,
+  kStatisticsRecorder,
+  kLogFlush,
+  kKeyPool,
+  kEndpointFailover,
+  kKeepaliveTuning,
+  kPathMtuProber,
+  kPeerActivation,
+  kHangWatchdog,
+  kTelemetry,
+  kCount,
+};
+
+const char *BackgroundThreadName(BackgroundThread thread);
+
+/**
+ * Give the calling thread EcoQoS: Windows may then run it on efficiency cores at low clock speeds instead of waking
+ * a performance core for it. Only for threads nothing waits for interactively. Before Windows 10 1709 the request
+ * is ignored.
+ */
+void ThrottleCurrentThread();
+
+/**
+ * How often each background thread woke up, from a wait of its own, so the idle cost of the plugin can be read
+ * back, e.g. on battery. A wakeup is counted whatever woke the thread: its timer, a notification or a stop.
+ */
+class WakeupCounts {
+public:
+  static WakeupCounts &Instance();
+
+  void Count(BackgroundThread thread);
+
+  struct Counts {
+    uint64_t total = 0;
+    // In the last whole minute
+    uint64_t last_minute = 0;
+  };
+  Counts Read(BackgroundThread thread);
+
+  // The families wireguard_dart_background_wakeups (counter) and wireguard_dart_background_wakeups_per_minute
+  // (gauge), by thread
+  std::string OpenMetricsFamilies();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Minute {
+    uint64_t total = 0;
+    uint64_t this_minute = 0;
+    uint64_t last_minute = 0;
+    Clock::time_point start;
+  };
+
+  // Move on to the minute now falls in
+  static void RollLocked(Minute &minute, Clock::time_point now);
+
+  std::mutex mutex_;
+  std::array<Minute, static_cast<size_t>(BackgroundThread::kCount)> minutes_;
+};
+
+/**
+ * A wait for a deadline that lets Windows coalesce the wakeup with other timers: the deadline is set on a waitable
+ * timer with SetWaitableTimerEx and a tolerable delay, where a condition variable would wake the thread on the
+ * exact millisecond. Used like a condition variable with a single waiter; each return from the wait counts as a
+ * wakeup of its thread. Falls back to a condition variable without its handles.
+ */
+class CoalescingWait {
+public:
+  explicit CoalescingWait(BackgroundThread kind);
+  ~CoalescingWait();
+
+  CoalescingWait(const CoalescingWait &) = delete;
+  CoalescingWait &operator=(const CoalescingWait &) = delete;
+
+  // Wake the waiter, which then checks its predicate again; the caller changes what it reads under the lock
+  void Notify();
+
+  /**
+   * Wait with the lock released until done() is true or at passed, by up to tolerable_delay later; the lock is
+   * held again on return and while done is called. time_point::max waits for a notification only.
+   * @return done()
+   */
+  bool WaitUntil(std::unique_lock<std::mutex> &lock, std::chrono::steady_clock::time_point at,
+                 std::chrono::milliseconds tolerable_delay, const std::function<bool()> &done);
+  bool WaitFor(std::unique_lock<std::mutex> &lock, std::chrono::steady_clock::duration timeout,
+               std::chrono::milliseconds tolerable_delay, const std::function<bool()> &done) {
+    return WaitUntil(lock, std::chrono::steady_clock::now() + timeout, tolerable_delay, done);
+  }
+
+private:
+  BackgroundThread kind_;
+  HANDLE timer_ = nullptr;
+  // Auto-reset, so a Notify between the check and the wait is not lost
+  HANDLE notified_ = nullptr;
+  std::condition_variable fallback_;
+  // Logged the first time only, a timer that cannot be set fails every wait
+  bool timer_failed_ = false;
+};
+
+/**
+ * A thread of its own that calls tick every interval, on a periodic coalescing timer and with EcoQoS, for
+ * housekeeping such as flushing logs. Start replaces an earlier run; the destructor stops it.
+ */
+class PeriodicThread {
+public:
+  explicit PeriodicThread(BackgroundThread kind) : kind_(kind) {}
+  ~PeriodicThread();
+
+  PeriodicThread(const PeriodicThread &) = delete;
+  PeriodicThread &operator=(const PeriodicThread &) = delete;
+
+  bool Start(std::chrono::milliseconds interval, std::chrono::milliseconds tolerable_delay, std::function<void()> tick);
+  // Returns once a tick in progress returned
+  void Stop();
+
+private:
+  void Run(std::function<void()> tick);
+
+  BackgroundThread kind_;
+  HANDLE timer_ = nullptr;
+  HANDLE stop_ = nullptr;
+  std::thread worker_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,99 @@
+#include "bench_support.h"
+
+#include <libbase64.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+#include "wireguard.h"
+
+static std::atomic<size_t> g_allocations{0};
+
+void *operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+namespace wireguard_dart {
+
+namespace {
+
+std::string RandomKey(std::mt19937 &rng) {
+  char raw[WIREGUARD_KEY_LENGTH];
+  for (auto &byte : raw) {
+    byte = static_cast<char>(rng() & 0xFF);
+  }
+
+  char encoded[64];
+  size_t encoded_size = 0;
+  base64_encode(raw, sizeof(raw), encoded, &encoded_size, 0);
+  return std::string(encoded, encoded_size);
+}
+
+std::string Hex(unsigned value) {
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%x", value);
+  return buffer;
+}
+
+} // namespace
+
+size_t AllocationCount() { return g_allocations.load(std::memory_order_relaxed); }
+
+std::string GenerateConfig(const ConfigShape &shape) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::string config;
+
+  config += "[Interface]\n";
+  config += "PrivateKey = " + RandomKey(rng) + "\n";
+  config += "ListenPort = 51820\n";
+  config += "Address = 10.0.0.2/32, fd00::2/128\n";
+  config += "MTU = 1420\n";
+
+  // Each allowed IP gets its own block, numbered across the whole configuration
+  unsigned block = 0;
+  for (int i = 0; i < shape.peers; i++) {
+    config += "\n[Peer]\n";
+    config += "PublicKey = " + RandomKey(rng) + "\n";
+    config += "PresharedKey = " + RandomKey(rng) + "\n";
+
+    config += "AllowedIPs = ";
+    for (int j = 0; j < shape.allowed_ips_per_peer; j++, block++) {
+      if (j > 0) {
+        config += ", ";
+      }
+
+      if (percent(rng) < shape.ipv6_percent) {
+        config += shape.host_routes ? "fd00::" + Hex(block >> 16) + ":" + Hex(block & 0xFFFF) + "/128"
+                                    : "fd00:" + Hex(block >> 16) + ":" + Hex(block & 0xFFFF) + "::/64";
+      } else {
+        unsigned a = (block >> 16) & 0xFF;
+        unsigned b = (block >> 8) & 0xFF;
+        unsigned c = block & 0xFF;
+        if (shape.host_routes) {
+          config += "10." + std::to_string(a) + "." + std::to_string(b) + "." + std::to_string(c) + "/32";
+        } else {
+          config += "10." + std::to_string(c) + "." + std::to_string(b) + ".0/24";
+        }
+      }
+    }
+    config += "\n";
+
+    config += "Endpoint = 192.0.2." + std::to_string(i & 0xFF) + ":51820\n";
+    config += "PersistentKeepalive = 25\n";
+  }
+
+  return config;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace wireguard_dart {
+
+// Heap allocations made by the process so far. Every operator new is counted, so a benchmark can report its
+// allocations per item alongside its throughput.
+size_t AllocationCount();
+
+/**
+ * Shape of a synthetic configuration
+ */
+struct ConfigShape {
+  int peers = 1;
+  int allowed_ips_per_peer = 3;  // AllowedIPs density
+  int ipv6_percent = 33;         // Share of allowed IPs that are IPv6
+  bool host_routes = false;      // /32 and /128 prefixes from one contiguous block, as generated configs have
+};
+
+/**
+ * Deterministic configuration shaped like a real one: a full interface section and shape.peers peers, each
+ * with a preshared key, an endpoint, a keepalive and shape.allowed_ips_per_peer allowed IPs.
+ */
+std::string GenerateConfig(const ConfigShape &shape);
+
+} // namespace wireguard_dart
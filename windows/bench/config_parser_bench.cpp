@@ -0,0 +1,147 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "bench_support.h"
+#include "config_export.h"
+#include "wireguard_config_parser.h"
+
+namespace wireguard_dart {
+namespace {
+
+ConfigShape ShapeFromArgs(const benchmark::State& state) {
+  ConfigShape shape;
+  shape.peers = static_cast<int>(state.range(0));
+  shape.allowed_ips_per_peer = static_cast<int>(state.range(1));
+  shape.ipv6_percent = static_cast<int>(state.range(2));
+  return shape;
+}
+
+void BM_Parse(benchmark::State& state) {
+  const ConfigShape shape = ShapeFromArgs(state);
+  const std::string config = GenerateConfig(shape);
+
+  size_t allocations = 0;
+  size_t buffer_allocations = 0;
+  size_t wire_size = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    WireguardConfigParser parser;
+    bool ok = parser.Parse(config);
+    benchmark::DoNotOptimize(ok);
+    allocations += AllocationCount() - before;
+    buffer_allocations += parser.GetBufferAllocationCount();
+    wire_size = parser.CalculateConfigurationSize();
+    if (!ok) {
+      state.SkipWithError("Failed to parse generated configuration");
+      break;
+    }
+  }
+
+  double iterations = static_cast<double>(state.iterations());
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(config.size()));
+  state.counters["allocs_per_peer"] = static_cast<double>(allocations) / (iterations * shape.peers);
+  state.counters["buffer_allocs"] = static_cast<double>(buffer_allocations) / iterations;
+  state.counters["bytes_per_peer"] = static_cast<double>(wire_size) / shape.peers;
+}
+BENCHMARK(BM_Parse)
+    ->ArgNames({"peers", "allowed_ips", "ipv6_pct"})
+    ->ArgsProduct({{1, 10, 100, 1000, 10000, 50000}, {1, 8}, {0, 50}});
+
+// One parser reused for every iteration, as the adapter does for repeated setups: after the first parse the
+// buffers are already large enough, so parsing should not allocate at all. From kParallelMinPeers on, only the
+// arenas of the parallel parse are allocated anew.
+void BM_ParseReused(benchmark::State& state) {
+  ConfigShape shape;
+  shape.peers = static_cast<int>(state.range(0));
+  const std::string config = GenerateConfig(shape);
+
+  WireguardConfigParser parser;
+  parser.Parse(config);
+
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    bool ok = parser.Parse(config);
+    benchmark::DoNotOptimize(ok);
+    allocations += AllocationCount() - before;
+    if (!ok) {
+      state.SkipWithError("Failed to parse generated configuration");
+      break;
+    }
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(config.size()));
+  state.counters["allocs_per_parse"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+  state.counters["buffer_bytes"] = static_cast<double>(parser.GetBufferCapacity());
+}
+BENCHMARK(BM_ParseReused)->ArgName("peers")->Arg(1)->Arg(100)->Arg(10000);
+
+// Copying the parsed configuration out with CalculateConfigurationSize/BuildConfiguration
+void BM_BuildConfiguration(benchmark::State& state) {
+  const ConfigShape shape = ShapeFromArgs(state);
+  WireguardConfigParser parser;
+  if (!parser.Parse(GenerateConfig(shape))) {
+    state.SkipWithError("Failed to parse generated configuration");
+    return;
+  }
+
+  std::vector<uint64_t> buffer;
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    DWORD size = parser.CalculateConfigurationSize();
+    buffer.resize((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    DWORD written = parser.BuildConfiguration(buffer.data(), size);
+    benchmark::DoNotOptimize(written);
+    benchmark::ClobberMemory();
+    allocations += AllocationCount() - before;
+  }
+
+  double iterations = static_cast<double>(state.iterations());
+  DWORD size = parser.CalculateConfigurationSize();
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * size);
+  state.counters["allocs_per_peer"] = static_cast<double>(allocations) / (iterations * shape.peers);
+  state.counters["bytes_per_peer"] = static_cast<double>(size) / shape.peers;
+}
+BENCHMARK(BM_BuildConfiguration)
+    ->ArgNames({"peers", "allowed_ips", "ipv6_pct"})
+    ->ArgsProduct({{1, 100, 10000, 50000}, {1, 8}, {50}});
+
+// Writing the configuration the driver would read back out as text, as exportTunnelConfiguration does, into a
+// string kept across iterations
+void BM_ExportConfigurationText(benchmark::State& state) {
+  const ConfigShape shape = ShapeFromArgs(state);
+  WireguardConfigParser parser;
+  if (!parser.Parse(GenerateConfig(shape))) {
+    state.SkipWithError("Failed to parse generated configuration");
+    return;
+  }
+  DWORD size = parser.CalculateConfigurationSize();
+  std::vector<uint64_t> driver((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  parser.BuildConfiguration(driver.data(), size);
+  const auto* data = reinterpret_cast<const BYTE*>(driver.data());
+
+  std::string text;
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    ExportConfigurationText(data, size, state.range(3) != 0, &text);
+    benchmark::DoNotOptimize(text.data());
+    allocations += AllocationCount() - before;
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(text.size()));
+  state.counters["allocs_per_export"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+  state.counters["text_bytes_per_peer"] = static_cast<double>(text.size()) / shape.peers;
+}
+BENCHMARK(BM_ExportConfigurationText)
+    ->ArgNames({"peers", "allowed_ips", "ipv6_pct", "redact"})
+    ->ArgsProduct({{1, 100, 10000, 50000}, {1, 8}, {50}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace wireguard_dart
+
+BENCHMARK_MAIN();
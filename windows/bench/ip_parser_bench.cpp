@@ -0,0 +1,167 @@
+#include <benchmark/benchmark.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ip_address_parser.h"
+
+namespace wireguard_dart {
+namespace {
+
+// Inputs close to valid addresses, so that the edge cases (leading zeros, octet and group limits, "::"
+// placement, embedded IPv4) are hit often rather than rejected on the first character
+std::string RandomAddressLike(std::mt19937 &rng) {
+  static const char kAlphabet[] = "0123456789abcdefABCDEF::::....";
+  std::uniform_int_distribution<size_t> length(0, 45);
+  std::uniform_int_distribution<size_t> pick(0, sizeof(kAlphabet) - 2);
+
+  std::string str(length(rng), '\0');
+  for (auto &c : str) {
+    c = kAlphabet[pick(rng)];
+  }
+  return str;
+}
+
+std::string RandomIPv4(std::mt19937 &rng) {
+  return std::to_string(rng() & 0xFF) + "." + std::to_string(rng() & 0xFF) + "." + std::to_string(rng() & 0xFF) +
+         "." + std::to_string(rng() & 0xFF);
+}
+
+// Formats a random IPv6 address through inet_ntop, which compresses zero runs and may emit an IPv4 tail
+std::string RandomIPv6(std::mt19937 &rng) {
+  IN6_ADDR address;
+  for (auto &byte : address.s6_addr) {
+    // Plenty of zero bytes so that "::" shows up
+    byte = (rng() % 3 == 0) ? static_cast<BYTE>(rng() & 0xFF) : 0;
+  }
+  char buffer[INET6_ADDRSTRLEN];
+  inet_ntop(AF_INET6, &address, buffer, sizeof(buffer));
+  return buffer;
+}
+
+// Differential check against inet_pton: both must accept the same strings and produce the same bytes
+bool CheckAgainstInetPton(const std::string &str) {
+  IN_ADDR expected4, actual4;
+  bool expected4_ok = inet_pton(AF_INET, str.c_str(), &expected4) == 1;
+  bool actual4_ok = ParseIPv4Address(str, actual4);
+  if (expected4_ok != actual4_ok || (expected4_ok && memcmp(&expected4, &actual4, sizeof(IN_ADDR)) != 0)) {
+    std::fprintf(stderr, "IPv4 mismatch for \"%s\": inet_pton %d, parser %d\n", str.c_str(), expected4_ok,
+                 actual4_ok);
+    return false;
+  }
+
+  IN6_ADDR expected6, actual6;
+  bool expected6_ok = inet_pton(AF_INET6, str.c_str(), &expected6) == 1;
+  bool actual6_ok = ParseIPv6Address(str, actual6);
+  if (expected6_ok != actual6_ok || (expected6_ok && memcmp(&expected6, &actual6, sizeof(IN6_ADDR)) != 0)) {
+    std::fprintf(stderr, "IPv6 mismatch for \"%s\": inet_pton %d, parser %d\n", str.c_str(), expected6_ok,
+                 actual6_ok);
+    return false;
+  }
+
+  return true;
+}
+
+bool RunDifferentialCheck() {
+  static const char *kEdgeCases[] = {
+      "",          "0.0.0.0",      "255.255.255.255", "256.0.0.1",     "1.2.3",         "1.2.3.4.5",
+      "01.2.3.4",  "1..2.3",       "1.2.3.4 ",        "::",            ":::",           "::1",
+      "1::",       "1:2:3:4:5:6:7:8", "1:2:3:4:5:6:7::", "::2:3:4:5:6:7:8", "1:2:3:4:5:6:7:8:9", "1::2::3",
+      "12345::",   "::ffff:1.2.3.4", "::1.2.3.4",     "1:2:3:4:5:6:1.2.3.4", "1:2:3:4:5:6:7:1.2.3.4", "fe80::1%1",
+      ":1::",      "1:",           "abcd:EF01::",     "::ffff:01.2.3.4",
+  };
+
+  bool ok = true;
+  for (const char *edge_case : kEdgeCases) {
+    ok &= CheckAgainstInetPton(edge_case);
+  }
+
+  std::mt19937 rng(7);
+  for (int i = 0; i < 200000; i++) {
+    ok &= CheckAgainstInetPton(RandomAddressLike(rng));
+    ok &= CheckAgainstInetPton(RandomIPv4(rng));
+    ok &= CheckAgainstInetPton(RandomIPv6(rng));
+  }
+  return ok;
+}
+
+std::vector<std::string> MakeInputs(std::string (*generate)(std::mt19937 &)) {
+  std::mt19937 rng(42);
+  std::vector<std::string> inputs;
+  for (int i = 0; i < 1024; i++) {
+    inputs.push_back(generate(rng));
+  }
+  return inputs;
+}
+
+void BM_ParseIPv4(benchmark::State &state) {
+  auto inputs = MakeInputs(RandomIPv4);
+  size_t i = 0;
+  for (auto _ : state) {
+    IN_ADDR address;
+    benchmark::DoNotOptimize(ParseIPv4Address(inputs[i++ & 1023], address));
+    benchmark::DoNotOptimize(address);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseIPv4);
+
+void BM_InetPtonIPv4(benchmark::State &state) {
+  auto inputs = MakeInputs(RandomIPv4);
+  size_t i = 0;
+  for (auto _ : state) {
+    IN_ADDR address;
+    benchmark::DoNotOptimize(inet_pton(AF_INET, inputs[i++ & 1023].c_str(), &address));
+    benchmark::DoNotOptimize(address);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InetPtonIPv4);
+
+void BM_ParseIPv6(benchmark::State &state) {
+  auto inputs = MakeInputs(RandomIPv6);
+  size_t i = 0;
+  for (auto _ : state) {
+    IN6_ADDR address;
+    benchmark::DoNotOptimize(ParseIPv6Address(inputs[i++ & 1023], address));
+    benchmark::DoNotOptimize(address);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseIPv6);
+
+void BM_InetPtonIPv6(benchmark::State &state) {
+  auto inputs = MakeInputs(RandomIPv6);
+  size_t i = 0;
+  for (auto _ : state) {
+    IN6_ADDR address;
+    benchmark::DoNotOptimize(inet_pton(AF_INET6, inputs[i++ & 1023].c_str(), &address));
+    benchmark::DoNotOptimize(address);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_InetPtonIPv6);
+
+} // namespace
+} // namespace wireguard_dart
+
+int main(int argc, char **argv) {
+  WSADATA wsa_data;
+  WSAStartup(MAKEWORD(2, 2), &wsa_data);
+
+  if (!wireguard_dart::RunDifferentialCheck()) {
+    std::fprintf(stderr, "Differential check against inet_pton failed\n");
+    return 1;
+  }
+  std::printf("Differential check against inet_pton passed\n");
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
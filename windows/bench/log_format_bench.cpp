@@ -0,0 +1,67 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <string>
+
+#include "bench_support.h"
+#include "log_format.h"
+#include "spdlog/details/log_msg.h"
+#include "spdlog/pattern_formatter.h"
+
+namespace wireguard_dart {
+namespace {
+
+// One record per millisecond of log time, so the second changes every thousand records like on a busy log
+void FormatRecords(benchmark::State &state, spdlog::formatter &formatter) {
+  const std::string message = "Setup tunnel completed successfully for tunnel: wg-office";
+  spdlog::details::log_msg msg(spdlog::source_loc{}, "wireguard_dart", spdlog::level::info,
+                               spdlog::string_view_t(message.data(), message.size()));
+  const auto start = msg.time;
+
+  size_t allocations = 0;
+  size_t bytes = 0;
+  int64_t record = 0;
+  spdlog::memory_buf_t formatted;
+  for (auto _ : state) {
+    msg.time = start + std::chrono::milliseconds(record++);
+    formatted.clear();
+    size_t before = AllocationCount();
+    formatter.format(msg, formatted);
+    allocations += AllocationCount() - before;
+    bytes += formatted.size();
+    benchmark::DoNotOptimize(formatted.data());
+  }
+
+  state.counters["bytes"] = static_cast<double>(bytes) / static_cast<double>(state.iterations());
+  state.counters["allocs"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+
+// spdlog's default, "[%Y-%m-%d %H:%M:%S.%e] [%n] [%l] %v", which the file log had before
+void BM_FormatDefaultPattern(benchmark::State &state) {
+  spdlog::pattern_formatter formatter;
+  FormatRecords(state, formatter);
+}
+BENCHMARK(BM_FormatDefaultPattern);
+
+// The same timestamp through the built-in flags, each formatted for every record
+void BM_FormatBuiltinTimestamp(benchmark::State &state) {
+  spdlog::pattern_formatter formatter("%Y-%m-%d %H:%M:%S.%e %L %v");
+  FormatRecords(state, formatter);
+}
+BENCHMARK(BM_FormatBuiltinTimestamp);
+
+void BM_FormatLeanPattern(benchmark::State &state) {
+  auto formatter = MakeLogFormatter(kLeanLogPattern);
+  FormatRecords(state, *formatter);
+}
+BENCHMARK(BM_FormatLeanPattern);
+
+// At debug level, with the thread ID looked up for every record
+void BM_FormatDebugPattern(benchmark::State &state) {
+  auto formatter = MakeLogFormatter(kDebugLogPattern);
+  FormatRecords(state, *formatter);
+}
+BENCHMARK(BM_FormatDebugPattern);
+
+} // namespace
+} // namespace wireguard_dart
@@ -0,0 +1,52 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "bench_support.h"
+#include "prefix_aggregation.h"
+#include "wireguard_config_parser.h"
+
+namespace wireguard_dart {
+namespace {
+
+// Collects the allowed IPs of every peer, the way WireguardAdapter::ConfigureNetworking does
+std::vector<WIREGUARD_ALLOWED_IP> CollectAllowedIPs(const ConfigShape &shape) {
+  WireguardConfigParser parser;
+  parser.Parse(GenerateConfig(shape));
+
+  std::vector<WIREGUARD_ALLOWED_IP> all_allowed_ips;
+  parser.GetConfiguration().ForEachPeer(
+      [&all_allowed_ips](const WIREGUARD_PEER &, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+        all_allowed_ips.insert(all_allowed_ips.end(), allowed_ips, allowed_ips + count);
+      });
+  return all_allowed_ips;
+}
+
+void BM_AggregatePrefixes(benchmark::State &state) {
+  ConfigShape shape;
+  shape.peers = static_cast<int>(state.range(0));
+  shape.allowed_ips_per_peer = 4;
+  shape.host_routes = state.range(1) != 0;
+  const auto prefixes = CollectAllowedIPs(shape);
+
+  size_t routes = 0;
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    auto aggregated = AggregatePrefixes(prefixes);
+    allocations += AllocationCount() - before;
+    routes = aggregated.size();
+    benchmark::DoNotOptimize(aggregated.data());
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * prefixes.size()));
+  state.counters["prefixes"] = static_cast<double>(prefixes.size());
+  state.counters["routes"] = static_cast<double>(routes);
+  state.counters["allocs"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_AggregatePrefixes)
+    ->ArgNames({"peers", "host_routes"})
+    ->ArgsProduct({{100, 1000, 10000, 50000}, {0, 1}});
+
+} // namespace
+} // namespace wireguard_dart
@@ -0,0 +1,91 @@
+#include <benchmark/benchmark.h>
+#include <winsock2.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <cstdio>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+#include "wireguard_network_config.h"
+
+// Installs real routes, so it has to run elevated. They go onto the loopback interface inside 198.18.0.0/15,
+// the range reserved for benchmarking, and are removed again after every iteration.
+
+namespace wireguard_dart {
+namespace {
+
+bool FindLoopbackLuid(NET_LUID &luid) {
+  PMIB_IF_TABLE2 table = nullptr;
+  if (GetIfTable2(&table) != NO_ERROR) {
+    return false;
+  }
+
+  bool found = false;
+  for (ULONG i = 0; i < table->NumEntries && !found; i++) {
+    if (table->Table[i].Type == IF_TYPE_SOFTWARE_LOOPBACK) {
+      luid = table->Table[i].InterfaceLuid;
+      found = true;
+    }
+  }
+  FreeMibTable(table);
+  return found;
+}
+
+std::vector<WIREGUARD_ALLOWED_IP> BenchmarkPrefixes(size_t count) {
+  std::vector<WIREGUARD_ALLOWED_IP> prefixes(count);
+  for (size_t i = 0; i < count; i++) {
+    uint32_t address = 0xC6120000u + static_cast<uint32_t>(i);  // 198.18.0.0 + i
+    prefixes[i].AddressFamily = AF_INET;
+    prefixes[i].Address.V4.s_addr = htonl(address);
+    prefixes[i].Cidr = 32;
+  }
+  return prefixes;
+}
+
+void BM_InstallRoutes(benchmark::State &state) {
+  NET_LUID luid;
+  if (!FindLoopbackLuid(luid)) {
+    state.SkipWithError("No loopback interface found");
+    return;
+  }
+
+  const auto prefixes = BenchmarkPrefixes(static_cast<size_t>(state.range(0)));
+  NetworkLedger ledger;
+  WireguardNetworkConfig net_config(luid, &ledger);
+  net_config.SetRouteWorkers(static_cast<unsigned>(state.range(1)));
+
+  for (auto _ : state) {
+    bool ok = net_config.ConfigureRoutes(prefixes);
+
+    state.PauseTiming();
+    net_config.RemoveRoutes();
+    state.ResumeTiming();
+
+    if (!ok) {
+      state.SkipWithError("Failed to install routes, is the benchmark running elevated?");
+      break;
+    }
+  }
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * prefixes.size()));
+}
+BENCHMARK(BM_InstallRoutes)
+    ->ArgNames({"prefixes", "workers"})
+    ->ArgsProduct({{1000, 10000, 50000}, {1, WireguardNetworkConfig::kDefaultRouteWorkers}})
+    ->Unit(benchmark::kMillisecond)
+    ->Iterations(3);
+
+} // namespace
+} // namespace wireguard_dart
+
+int main(int argc, char **argv) {
+  // Per-route logging would dominate the measurement
+  spdlog::set_level(spdlog::level::warn);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,249 @@
+#include <benchmark/benchmark.h>
+#include <windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "encodable_keys.h"
+#include "network_adapter_status_observer.h"
+#include "platform_task_runner.h"
+#include "spdlog/spdlog.h"
+
+// Runs the status observer on interface change notifications fed from the benchmark threads rather than the
+// system's, with interface statuses the benchmark flips, so it needs neither adapters nor elevation. The platform
+// thread is a thread of its own pumping the task runner's messages, as the Flutter engine's thread does.
+
+namespace wireguard_dart {
+namespace {
+
+constexpr uint64_t kFirstLuid = 0x10000;
+// Of every 16 notifications this many are for interfaces of other adapters, as most of the system's are
+constexpr uint64_t kForeignPer16 = 12;
+constexpr uint64_t kForeignInterfaces = 64;
+// One in this many notifications of an observed adapter comes with its interface going up or down
+constexpr uint64_t kFlipEvery = 8;
+
+class CountingSink : public flutter::EventSink<flutter::EncodableValue> {
+public:
+  explicit CountingSink(std::atomic<uint64_t> *events) : events_(events) {}
+
+protected:
+  void SuccessInternal(const flutter::EncodableValue *event) override {
+    const auto *batch = event ? std::get_if<flutter::EncodableList>(event) : nullptr;
+    events_->fetch_add(batch ? batch->size() : 1, std::memory_order_relaxed);
+  }
+  void ErrorInternal(const std::string &, const std::string &, const flutter::EncodableValue *) override {}
+  void EndOfStreamInternal() override {}
+
+private:
+  std::atomic<uint64_t> *events_;
+};
+
+// Registers for nothing and reads each interface's status from a flag the benchmark flips
+class SyntheticObserver : public NetworkAdapterStatusObserver {
+public:
+  SyntheticObserver(PlatformTaskRunner *platform_tasks, size_t adapters)
+      : NetworkAdapterStatusObserver(platform_tasks), up_(adapters) {}
+
+  void Flip(size_t adapter) { up_[adapter].fetch_xor(1, std::memory_order_relaxed); }
+  uint64_t StatusReads() const { return status_reads_.load(std::memory_order_relaxed); }
+
+protected:
+  bool RegisterNotifications() override { return true; }
+  void CancelNotifications(HANDLE, HANDLE, HANDLE) override {}
+
+  ConnectionStatus GetInterfaceStatus(const NET_LUID &luid) const override {
+    status_reads_.fetch_add(1, std::memory_order_relaxed);
+    return up_[luid.Value - kFirstLuid].load(std::memory_order_relaxed) ? ConnectionStatus::connected
+                                                                         : ConnectionStatus::disconnected;
+  }
+
+private:
+  std::vector<std::atomic<int>> up_;
+  mutable std::atomic<uint64_t> status_reads_{0};
+};
+
+// The thread events are drained and sent on, owning the task runner's window
+class PlatformThread {
+public:
+  PlatformThread() {
+    std::promise<void> started;
+    std::future<void> ready = started.get_future();
+    thread_ = std::thread([this, &started] {
+      PlatformTaskRunner runner;
+      runner_ = &runner;
+      thread_id_ = GetCurrentThreadId();
+      started.set_value();
+      MSG message;
+      while (GetMessageW(&message, nullptr, 0, 0) > 0) {
+        DispatchMessageW(&message);
+      }
+    });
+    ready.wait();
+  }
+
+  ~PlatformThread() {
+    PostThreadMessageW(thread_id_, WM_QUIT, 0, 0);
+    thread_.join();
+  }
+
+  PlatformTaskRunner *Runner() const { return runner_; }
+
+  // Runs the task on the platform thread once every event queued before was drained, and waits for it
+  void Run(const std::function<void()> &task) {
+    std::promise<void> done;
+    runner_->Post([&task, &done] {
+      task();
+      done.set_value();
+    });
+    done.get_future().wait();
+  }
+
+private:
+  std::thread thread_;
+  PlatformTaskRunner *runner_ = nullptr;
+  DWORD thread_id_ = 0;
+};
+
+// An observer of the adapters with a listener on its status stream
+struct Replay {
+  Replay(size_t adapters, std::chrono::milliseconds coalesce_window, bool batched)
+      : observer(platform.Runner(), adapters) {
+    observer.SetCoalesceWindow(coalesce_window);
+    for (size_t i = 0; i < adapters; i++) {
+      NET_LUID luid;
+      luid.Value = kFirstLuid + i;
+      observer.StartObserving(luid);
+    }
+    flutter::EncodableValue arguments(flutter::EncodableMap{{keys::kBatched, flutter::EncodableValue(batched)}});
+    platform.Run([this, &arguments] { observer.OnListen(&arguments, std::make_unique<CountingSink>(&events)); });
+  }
+
+  ~Replay() {
+    platform.Run([this] { observer.OnCancel(nullptr); });
+    observer.StopAllObserving();
+  }
+
+  PlatformThread platform;
+  SyntheticObserver observer;
+  std::atomic<uint64_t> events{0};
+};
+
+std::unique_ptr<Replay> g_replay;
+
+// Notifications from every benchmark thread at once, most of them for other interfaces, as the system sends them
+void BM_InterfaceNotifications(benchmark::State &state) {
+  const size_t adapters = static_cast<size_t>(state.range(0));
+  const std::chrono::milliseconds coalesce_window(state.range(1));
+  uint64_t reads_before = 0;
+  uint64_t events_before = 0;
+  NetworkAdapterStatusObserver::DrainStatistics drains_before;
+  if (state.thread_index() == 0) {
+    g_replay = std::make_unique<Replay>(adapters, coalesce_window, state.range(2) != 0);
+    reads_before = g_replay->observer.StatusReads();
+    events_before = g_replay->events.load();
+    drains_before = g_replay->observer.GetDrainStatistics();
+  }
+
+  MIB_IPINTERFACE_ROW row = {};
+  uint64_t sequence = static_cast<uint64_t>(state.thread_index()) * 7919;
+  // Only set by thread 0, which the other threads see once the loop started
+  SyntheticObserver *observer = nullptr;
+  for (auto _ : state) {
+    if (!observer) {
+      observer = &g_replay->observer;
+    }
+    uint64_t n = sequence++;
+    if (n % 16 < kForeignPer16) {
+      row.InterfaceLuid.Value = kFirstLuid + adapters + n % kForeignInterfaces;
+    } else {
+      size_t adapter = static_cast<size_t>(n % adapters);
+      if ((n / 16) % kFlipEvery == 0) {
+        observer->Flip(adapter);
+      }
+      row.InterfaceLuid.Value = kFirstLuid + adapter;
+    }
+    observer->OnInterfaceChange(&row, MibParameterNotification);
+  }
+
+  if (state.thread_index() != 0) {
+    return;
+  }
+  if (coalesce_window.count() > 0) {
+    // For the last burst's timer
+    std::this_thread::sleep_for(coalesce_window * 4);
+  }
+  g_replay->platform.Run([] {});
+
+  const double notifications = static_cast<double>(state.iterations()) * state.threads();
+  const double changes = notifications * (16 - kForeignPer16) / 16;
+  const double reads = static_cast<double>(g_replay->observer.StatusReads() - reads_before);
+  const double events = static_cast<double>(g_replay->events.load() - events_before);
+  NetworkAdapterStatusObserver::DrainStatistics drains = g_replay->observer.GetDrainStatistics();
+  const double drained = static_cast<double>(drains.events - drains_before.events);
+  const double drain_count = static_cast<double>(drains.drains - drains_before.drains);
+  g_replay.reset();
+
+  state.SetItemsProcessed(static_cast<int64_t>(notifications));
+  // Below 1 as coalescing saves status reads, and events below reads as unchanged statuses are not sent
+  state.counters["reads_per_change"] = changes > 0 ? reads / changes : 0;
+  state.counters["events_per_change"] = changes > 0 ? events / changes : 0;
+  state.counters["events_per_drain"] = drain_count > 0 ? drained / drain_count : 0;
+  state.counters["max_depth"] = static_cast<double>(drains.max_depth);
+  state.counters["dropped"] = static_cast<double>(drains.dropped - drains_before.dropped);
+  state.counters["drain_us_per_event"] =
+      drained > 0 ? static_cast<double>(drains.drain_us - drains_before.drain_us) / drained : 0;
+}
+BENCHMARK(BM_InterfaceNotifications)
+    ->ArgNames({"adapters", "coalesce_ms", "batched"})
+    ->ArgsProduct({{1, 16}, {0, 5}, {0, 1}})
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// A burst of status changes, one for each adapter, until the platform thread sent them all
+void BM_DrainBurst(benchmark::State &state) {
+  const size_t burst = static_cast<size_t>(state.range(0));
+  Replay replay(burst, std::chrono::milliseconds(0), state.range(1) != 0);
+  NetworkAdapterStatusObserver::DrainStatistics before = replay.observer.GetDrainStatistics();
+
+  MIB_IPINTERFACE_ROW row = {};
+  for (auto _ : state) {
+    for (size_t adapter = 0; adapter < burst; adapter++) {
+      replay.observer.Flip(adapter);
+      row.InterfaceLuid.Value = kFirstLuid + adapter;
+      replay.observer.OnInterfaceChange(&row, MibParameterNotification);
+    }
+    replay.platform.Run([] {});
+  }
+
+  NetworkAdapterStatusObserver::DrainStatistics after = replay.observer.GetDrainStatistics();
+  const double drained = static_cast<double>(after.events - before.events);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * burst));
+  state.counters["drains_per_burst"] =
+      static_cast<double>(after.drains - before.drains) / static_cast<double>(state.iterations());
+  state.counters["drain_us_per_event"] =
+      drained > 0 ? static_cast<double>(after.drain_us - before.drain_us) / drained : 0;
+}
+BENCHMARK(BM_DrainBurst)
+    ->ArgNames({"burst", "batched"})
+    ->ArgsProduct({{1, 16, 64, static_cast<int64_t>(NetworkAdapterStatusObserver::kEventQueueCapacity)}, {0, 1}})
+    ->UseRealTime();
+
+} // namespace
+} // namespace wireguard_dart
+
+int main(int argc, char **argv) {
+  // Every status change is logged at info
+  spdlog::set_level(spdlog::level::warn);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
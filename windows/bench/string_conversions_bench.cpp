@@ -0,0 +1,106 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "bench_support.h"
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+namespace {
+
+// Mostly ASCII with some multi-byte characters, like tunnel names and log messages
+std::string MakeUtf8(size_t length) {
+  static const char *kPieces[] = {"wg-tunnel", "-", "\xC3\xA9", "0", "\xE2\x82\xAC", "peer"};
+  std::string str;
+  for (size_t i = 0; str.size() < length; i++) {
+    str += kPieces[i % (sizeof(kPieces) / sizeof(kPieces[0]))];
+  }
+  return str;
+}
+
+void BM_Utf8ToWide(benchmark::State &state) {
+  const std::string str = MakeUtf8(static_cast<size_t>(state.range(0)));
+
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    auto wide = Utf8ToWide(str);
+    benchmark::DoNotOptimize(wide.data());
+    allocations += AllocationCount() - before;
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * str.size()));
+  state.counters["allocs"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_Utf8ToWide)->Arg(16)->Arg(256)->Arg(4096);
+
+void BM_WideToUtf8(benchmark::State &state) {
+  const std::wstring wide = Utf8ToWide(MakeUtf8(static_cast<size_t>(state.range(0))));
+
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    auto str = WideToUtf8(wide);
+    benchmark::DoNotOptimize(str.data());
+    allocations += AllocationCount() - before;
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * wide.size() * sizeof(wchar_t)));
+  state.counters["allocs"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_WideToUtf8)->Arg(16)->Arg(256)->Arg(4096);
+
+// Tunnel and adapter names, which take the ASCII path
+void BM_WideToUtf8Ascii(benchmark::State &state) {
+  const std::wstring wide(static_cast<size_t>(state.range(0)), L'w');
+
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    auto str = WideToUtf8(wide);
+    benchmark::DoNotOptimize(str.data());
+    allocations += AllocationCount() - before;
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * wide.size() * sizeof(wchar_t)));
+  state.counters["allocs"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_WideToUtf8Ascii)->Arg(16)->Arg(256);
+
+// Into a string kept across iterations, which allocates only the first time
+void BM_Utf8ToWideInto(benchmark::State &state) {
+  const std::string str = MakeUtf8(static_cast<size_t>(state.range(0)));
+
+  std::wstring wide;
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    Utf8ToWide(str, &wide);
+    benchmark::DoNotOptimize(wide.data());
+    allocations += AllocationCount() - before;
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * str.size()));
+  state.counters["allocs"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_Utf8ToWideInto)->Arg(16)->Arg(256)->Arg(4096);
+
+void BM_WideAsUtf8(benchmark::State &state) {
+  const std::wstring wide = Utf8ToWide(MakeUtf8(static_cast<size_t>(state.range(0))));
+
+  size_t allocations = 0;
+  for (auto _ : state) {
+    size_t before = AllocationCount();
+    WideAsUtf8 str(wide);
+    benchmark::DoNotOptimize(str.c_str());
+    allocations += AllocationCount() - before;
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * wide.size() * sizeof(wchar_t)));
+  state.counters["allocs"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+// 64 fits the inline buffer, 256 does not
+BENCHMARK(BM_WideAsUtf8)->Arg(16)->Arg(64)->Arg(256);
+
+} // namespace
+} // namespace wireguard_dart
@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <string_view>
+
+#include "bench_support.h"
+#include "text_scanner.h"
+
+namespace wireguard_dart {
+namespace {
+
+std::string LargeConfig(int peers) {
+  ConfigShape shape;
+  shape.peers = peers;
+  shape.allowed_ips_per_peer = 8;
+  return GenerateConfig(shape);
+}
+
+// Every line with its '#' and '=' through LineScanner at the level given as the first argument
+void BM_ScanLines(benchmark::State &state) {
+  const auto level = static_cast<ScanLevel>(state.range(0));
+  if (!IsScanLevelSupported(level)) {
+    state.SkipWithError("Instruction set not supported on this processor");
+    return;
+  }
+  const std::string config = LargeConfig(static_cast<int>(state.range(1)));
+  state.SetLabel(ScanLevelName(level));
+
+  for (auto _ : state) {
+    LineScanner scanner(config, level);
+    ScannedLine line;
+    size_t delimiters = 0;
+    while (scanner.Next(&line)) {
+      delimiters += line.comment + line.equals;
+    }
+    benchmark::DoNotOptimize(delimiters);
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(config.size()));
+}
+BENCHMARK(BM_ScanLines)
+    ->ArgNames({"level", "peers"})
+    ->ArgsProduct({{static_cast<int>(ScanLevel::kScalar), static_cast<int>(ScanLevel::kSse2),
+                    static_cast<int>(ScanLevel::kNeon)},
+                   {1000, 20000}});
+
+// The same through one find per newline, '#' and '=', as the tokenizer searched before the scanner
+void BM_ScanLinesFind(benchmark::State &state) {
+  const std::string config = LargeConfig(static_cast<int>(state.range(0)));
+  const std::string_view text = config;
+
+  for (auto _ : state) {
+    size_t delimiters = 0;
+    for (size_t line_start = 0; line_start < text.size();) {
+      size_t line_end = text.find('\n', line_start);
+      if (line_end == std::string_view::npos) {
+        line_end = text.size();
+      }
+      std::string_view line = text.substr(line_start, line_end - line_start);
+      delimiters += line.find('#') + line.find('=');
+      line_start = line_end + 1;
+    }
+    benchmark::DoNotOptimize(delimiters);
+  }
+
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(config.size()));
+}
+BENCHMARK(BM_ScanLinesFind)->ArgName("peers")->Arg(1000)->Arg(20000);
+
+} // namespace
+} // namespace wireguard_dart
@@ -0,0 +1,189 @@
+#include "call_metrics.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace wireguard_dart {
+
+namespace {
+
+// The OpenMetrics buckets, powers of two nanoseconds
+constexpr unsigned kFirstExportedExponent = 10;
+constexpr unsigned kLastExportedExponent = 35;
+
+// In seconds, as OpenMetrics wants them; sums in fixed point, so they do not lose digits as they grow
+std::string Seconds(uint64_t nanoseconds, bool fixed = false) {
+  char buffer[48];
+  std::snprintf(buffer, sizeof(buffer), fixed ? "%.9f" : "%.12g", static_cast<double>(nanoseconds) / 1e9);
+  return buffer;
+}
+
+} // namespace
+
+const char *MeteredCallName(MeteredCall call) {
+  switch (call) {
+    case MeteredCall::kWireGuardCreateAdapter:
+      return "WireGuardCreateAdapter";
+    case MeteredCall::kWireGuardOpenAdapter:
+      return "WireGuardOpenAdapter";
+    case MeteredCall::kWireGuardCloseAdapter:
+      return "WireGuardCloseAdapter";
+    case MeteredCall::kWireGuardDeleteDriver:
+      return "WireGuardDeleteDriver";
+    case MeteredCall::kWireGuardGetAdapterLUID:
+      return "WireGuardGetAdapterLUID";
+    case MeteredCall::kWireGuardGetRunningDriverVersion:
+      return "WireGuardGetRunningDriverVersion";
+    case MeteredCall::kWireGuardSetLogger:
+      return "WireGuardSetLogger";
+    case MeteredCall::kWireGuardSetAdapterLogging:
+      return "WireGuardSetAdapterLogging";
+    case MeteredCall::kWireGuardSetAdapterState:
+      return "WireGuardSetAdapterState";
+    case MeteredCall::kWireGuardGetAdapterState:
+      return "WireGuardGetAdapterState";
+    case MeteredCall::kWireGuardSetConfiguration:
+      return "WireGuardSetConfiguration";
+    case MeteredCall::kWireGuardGetConfiguration:
+      return "WireGuardGetConfiguration";
+    case MeteredCall::kGetIpInterfaceEntry:
+      return "GetIpInterfaceEntry";
+    case MeteredCall::kSetIpInterfaceEntry:
+      return "SetIpInterfaceEntry";
+    case MeteredCall::kSetInterfaceDnsSettings:
+      return "SetInterfaceDnsSettings";
+    case MeteredCall::kDnsFlushResolverCacheEntry:
+      return "DnsFlushResolverCacheEntry_W";
+    case MeteredCall::kGetUnicastIpAddressTable:
+      return "GetUnicastIpAddressTable";
+    case MeteredCall::kCreateUnicastIpAddressEntry:
+      return "CreateUnicastIpAddressEntry";
+    case MeteredCall::kDeleteUnicastIpAddressEntry:
+      return "DeleteUnicastIpAddressEntry";
+    case MeteredCall::kGetIpForwardTable2:
+      return "GetIpForwardTable2";
+    case MeteredCall::kCreateIpForwardEntry2:
+      return "CreateIpForwardEntry2";
+    case MeteredCall::kDeleteIpForwardEntry2:
+      return "DeleteIpForwardEntry2";
+    case MeteredCall::kCancelMibChangeNotify2:
+      return "CancelMibChangeNotify2";
+    case MeteredCall::kCount:
+      break;
+  }
+  return "unknown";
+}
+
+size_t LatencyHistogram::BucketOf(uint64_t nanoseconds) {
+  if (nanoseconds < kSubBuckets) {
+    return static_cast<size_t>(nanoseconds);
+  }
+  unsigned exponent = 63;
+  while (!(nanoseconds >> exponent)) {
+    exponent--;
+  }
+  if (exponent >= kMaxExponent) {
+    return kBuckets - 1;
+  }
+  // The top kSubBucketBits bits below the leading one pick the bucket within its power of two
+  unsigned shift = exponent - kSubBucketBits;
+  return (shift + 1) * kSubBuckets + static_cast<size_t>((nanoseconds >> shift) - kSubBuckets);
+}
+
+uint64_t LatencyHistogram::BucketLowerBound(size_t bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  size_t shift = bucket / kSubBuckets - 1;
+  return static_cast<uint64_t>(kSubBuckets + bucket % kSubBuckets) << shift;
+}
+
+void LatencyHistogram::Record(uint64_t nanoseconds) {
+  buckets_[BucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+  sum_ns_.fetch_add(nanoseconds, std::memory_order_relaxed);
+  uint64_t max = max_ns_.load(std::memory_order_relaxed);
+  while (nanoseconds > max && !max_ns_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::Read(Snapshot *snapshot) const {
+  // From the buckets, so the count always matches them
+  snapshot->count = 0;
+  for (size_t i = 0; i < kBuckets; i++) {
+    snapshot->buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    snapshot->count += snapshot->buckets[i];
+  }
+  snapshot->sum_ns = sum_ns_.load(std::memory_order_relaxed);
+  snapshot->max_ns = max_ns_.load(std::memory_order_relaxed);
+}
+
+CallMetrics &CallMetrics::Instance() {
+  static CallMetrics instance;
+  return instance;
+}
+
+std::string CallMetrics::OpenMetricsText(const std::string &more_families) const {
+  static const char kFamily[] = "wireguard_dart_call_duration_seconds";
+  static const char kMaxFamily[] = "wireguard_dart_call_duration_max_seconds";
+
+  std::vector<LatencyHistogram::Snapshot> snapshots(histograms_.size());
+  for (size_t i = 0; i < histograms_.size(); i++) {
+    histograms_[i].Read(&snapshots[i]);
+  }
+  auto labels_of = [](size_t call) {
+    return std::string("{call=\"") + MeteredCallName(static_cast<MeteredCall>(call)) + "\"";
+  };
+
+  std::string text;
+  text += std::string("# TYPE ") + kFamily + " histogram\n";
+  text += std::string("# UNIT ") + kFamily + " seconds\n";
+  text += std::string("# HELP ") + kFamily + " Duration of WireGuard driver and IP Helper calls.\n";
+
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    const LatencyHistogram::Snapshot &snapshot = snapshots[i];
+    if (snapshot.count == 0) {
+      continue;
+    }
+    std::string labels = labels_of(i);
+
+    // A power of two is where a bucket starts, so the cumulative count below it is exact
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (unsigned exponent = kFirstExportedExponent; exponent <= kLastExportedExponent; exponent++) {
+      uint64_t bound = uint64_t{1} << exponent;
+      for (; bucket < LatencyHistogram::kBuckets && LatencyHistogram::BucketLowerBound(bucket) < bound; bucket++) {
+        cumulative += snapshot.buckets[bucket];
+      }
+      text += std::string(kFamily) + "_bucket" + labels + ",le=\"" + Seconds(bound) + "\"} " +
+              std::to_string(cumulative) + "\n";
+    }
+    text += std::string(kFamily) + "_bucket" + labels + ",le=\"+Inf\"} " + std::to_string(snapshot.count) + "\n";
+    text += std::string(kFamily) + "_count" + labels + "} " + std::to_string(snapshot.count) + "\n";
+    text += std::string(kFamily) + "_sum" + labels + "} " + Seconds(snapshot.sum_ns, true) + "\n";
+  }
+
+  text += std::string("# TYPE ") + kMaxFamily + " gauge\n";
+  text += std::string("# UNIT ") + kMaxFamily + " seconds\n";
+  text += std::string("# HELP ") + kMaxFamily + " Longest WireGuard driver or IP Helper call of each kind.\n";
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    if (snapshots[i].count != 0) {
+      text += std::string(kMaxFamily) + labels_of(i) + "} " + Seconds(snapshots[i].max_ns) + "\n";
+    }
+  }
+
+  static const char kRetriesFamily[] = "wireguard_dart_call_retries";
+  text += std::string("# TYPE ") + kRetriesFamily + " counter\n";
+  text += std::string("# HELP ") + kRetriesFamily +
+          " WireGuard driver and IP Helper calls made again after a transient error.\n";
+  for (size_t i = 0; i < retries_.size(); i++) {
+    uint64_t retries = retries_[i].load(std::memory_order_relaxed);
+    if (retries != 0) {
+      text += std::string(kRetriesFamily) + "_total" + labels_of(i) + "} " + std::to_string(retries) + "\n";
+    }
+  }
+  text += more_families;
+  text += "# EOF\n";
+  return text;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <windows.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "flight_recorder.h"
+#include "hang_watchdog.h"
+#include "perf_stats.h"
+
+namespace wireguard_dart {
+
+// The driver and IP Helper calls whose latency is measured
+enum class MeteredCall : size_t {
+  kWireGuardCreateAdapter,
+  kWireGuardOpenAdapter,
+  kWireGuardCloseAdapter,
+  kWireGuardDeleteDriver,
+  kWireGuardGetAdapterLUID,
+  kWireGuardGetRunningDriverVersion,
+  kWireGuardSetLogger,
+  kWireGuardSetAdapterLogging,
+  kWireGuardSetAdapterState,
+  kWireGuardGetAdapterState,
+  kWireGuardSetConfiguration,
+  kWireGuardGetConfiguration,
+  kGetIpInterfaceEntry,
+  kSetIpInterfaceEntry,
+  kSetInterfaceDnsSettings,
+  kDnsFlushResolverCacheEntry,
+  kGetUnicastIpAddressTable,
+  kCreateUnicastIpAddressEntry,
+  kDeleteUnicastIpAddressEntry,
+  kGetIpForwardTable2,
+  kCreateIpForwardEntry2,
+  kDeleteIpForwardEntry2,
+  kCancelMibChangeNotify2,
+  kCount
+};
+
+// The name of the Windows function, as in the metrics
+const char *MeteredCallName(MeteredCall call);
+
+/**
+ * Durations in log-linear buckets, as HDR histograms keep them: exact below kSubBuckets nanoseconds, above
+ * that every power of two is split into kSubBuckets equal buckets, so any duration is known to within 1/16.
+ * Recording is a few relaxed atomic additions, safe from any thread without a lock.
+ */
+class LatencyHistogram {
+public:
+  static constexpr unsigned kSubBucketBits = 4;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  // Durations of 2^kMaxExponent ns, about 4.9 hours, and longer share the last bucket
+  static constexpr unsigned kMaxExponent = 44;
+  static constexpr size_t kBuckets = (kMaxExponent - kSubBucketBits + 1) * kSubBuckets;
+
+  struct Snapshot {
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+    std::array<uint64_t, kBuckets> buckets = {};
+  };
+
+  static size_t BucketOf(uint64_t nanoseconds);
+  // The shortest duration in the bucket
+  static uint64_t BucketLowerBound(size_t bucket);
+
+  void Record(uint64_t nanoseconds);
+  // Not one atomic read: the sum and maximum may include calls recorded meanwhile that the buckets do not
+  void Read(Snapshot *snapshot) const;
+
+private:
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_ = {};
+  std::atomic<uint64_t> sum_ns_{0};
+  std::atomic<uint64_t> max_ns_{0};
+};
+
+/**
+ * The latency histogram of every metered call, for the whole process, so the calls can be timed wherever they
+ * are made without threading a pointer through
+ */
+class CallMetrics {
+public:
+  static CallMetrics &Instance();
+
+  void Record(MeteredCall call, uint64_t nanoseconds) {
+    histograms_[static_cast<size_t>(call)].Record(nanoseconds);
+  }
+  const LatencyHistogram &Histogram(MeteredCall call) const { return histograms_[static_cast<size_t>(call)]; }
+
+  // A call failed transiently and is made again, see RetryTransient
+  void RecordRetry(MeteredCall call) { retries_[static_cast<size_t>(call)].fetch_add(1, std::memory_order_relaxed); }
+  uint64_t Retries(MeteredCall call) const {
+    return retries_[static_cast<size_t>(call)].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * The calls made so far in the OpenMetrics text format, labelled by call: the histogram family
+   * wireguard_dart_call_duration_seconds, with a bucket at every power of two nanoseconds from about 1us to 34s,
+   * the gauge family wireguard_dart_call_duration_max_seconds with the longest call and the counter family
+   * wireguard_dart_call_retries with the transient failures that were retried. more_families, in the same
+   * format, are put before the closing # EOF.
+   */
+  std::string OpenMetricsText(const std::string &more_families = std::string()) const;
+
+private:
+  std::array<LatencyHistogram, static_cast<size_t>(MeteredCall::kCount)> histograms_;
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(MeteredCall::kCount)> retries_ = {};
+};
+
+// Times its own lifetime into the histogram of the call, which the hang watchdog watches meanwhile
+class ScopedCallTimer {
+public:
+  explicit ScopedCallTimer(MeteredCall call)
+      : call_(call), start_ns_(PerfCounterNanoseconds()), hang_watch_(MeteredCallName(call)) {}
+  ~ScopedCallTimer() {
+    int64_t elapsed = PerfCounterNanoseconds() - start_ns_;
+    CallMetrics::Instance().Record(call_, elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0);
+  }
+
+  ScopedCallTimer(const ScopedCallTimer &) = delete;
+  ScopedCallTimer &operator=(const ScopedCallTimer &) = delete;
+
+private:
+  MeteredCall call_;
+  int64_t start_ns_;
+  ScopedHangWatch hang_watch_;
+};
+
+// Call the function, timing it as the call, and keep its result and last error in the flight recorder
+template <typename Func, typename... Args>
+auto MeteredInvoke(MeteredCall call, Func &&func, Args &&...args)
+    -> decltype(std::forward<Func>(func)(std::forward<Args>(args)...)) {
+  using Result = decltype(std::forward<Func>(func)(std::forward<Args>(args)...));
+  ScopedCallTimer timer(call);
+  if constexpr (std::is_void_v<Result>) {
+    std::forward<Func>(func)(std::forward<Args>(args)...);
+    FlightRecorder::Instance().Record(FlightEvent::kCall, MeteredCallName(call), 0);
+  } else {
+    Result result = std::forward<Func>(func)(std::forward<Args>(args)...);
+    // Recording leaves the last error as the call set it
+    FlightRecorder::Instance().Record(FlightEvent::kCall, MeteredCallName(call), FlightValue(result), GetLastError());
+    return result;
+  }
+}
+
+// A function pointer that is timed on every call, used like the pointer itself
+template <typename Func>
+class MeteredFunction {
+public:
+  MeteredFunction(Func func, MeteredCall call) : func_(func), call_(call) {}
+
+  template <typename... Args>
+  auto operator()(Args &&...args) const -> decltype(std::declval<Func>()(std::forward<Args>(args)...)) {
+    return MeteredInvoke(call_, func_, std::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const { return func_ != nullptr; }
+
+private:
+  Func func_;
+  MeteredCall call_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <flutter/encodable_value.h>
+#include <flutter/event_channel.h>
+
+#include <windows.h>
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "platform_task_runner.h"
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * The benchmark stream, for measuring what the event channel costs rather than what any real stream does. A
+ * listener asks for a number of events at a rate, each with a payload of some size; a thread of its own builds
+ * them on a high-resolution timer, stamps each with PerfCounterMicroseconds right before posting it to the
+ * platform thread, the way the status and statistics streams hand their events over, and the platform thread
+ * sends it as it is. The listener's `Timeline.now` when the event arrives, less its `monotonicUs`, is the
+ * delivery latency from the native enqueue. Events that fall behind the schedule go out at once rather than
+ * being skipped, so a rate the platform thread cannot keep up with shows as latency.
+ */
+class ChannelBenchmarkStream : public flutter::StreamHandler<flutter::EncodableValue> {
+public:
+  static constexpr int64_t kDefaultEventsPerSecond = 100;
+  static constexpr int64_t kMaxEventsPerSecond = 100000;
+  static constexpr int64_t kDefaultCount = 1000;
+  static constexpr int64_t kMaxPayloadBytes = 16 * 1024 * 1024;
+
+  // Events are sent through platform_tasks, which must outlive the stream
+  explicit ChannelBenchmarkStream(PlatformTaskRunner *platform_tasks);
+  virtual ~ChannelBenchmarkStream();
+
+  ChannelBenchmarkStream(const ChannelBenchmarkStream &) = delete;
+  ChannelBenchmarkStream &operator=(const ChannelBenchmarkStream &) = delete;
+
+protected:
+  // The arguments may hold "eventsPerSecond", "count" and "payloadBytes"
+  virtual std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+  OnListenInternal(const flutter::EncodableValue *arguments,
+                   std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> &&events) override;
+
+  virtual std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+  OnCancelInternal(const flutter::EncodableValue *arguments) override;
+
+private:
+  void Stop();
+  void Run(uint64_t run, int64_t events_per_second, int64_t count, size_t payload_bytes);
+  // On the platform thread; events of an earlier listener are dropped
+  void Emit(uint64_t run, flutter::EncodableValue event);
+
+  PlatformTaskRunner *platform_tasks_;
+  // Only used on the platform thread
+  std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> sink_;
+  uint64_t run_ = 0;
+  HANDLE stop_event_ = nullptr;
+  std::thread worker_;
+
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
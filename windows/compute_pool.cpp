@@ -0,0 +1,206 @@
+#include "compute_pool.h"
+
+#include <algorithm>
+#include <system_error>
+
+#include "cpu_accounting.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// The pool and worker index of the calling thread, if it is a worker
+thread_local const ComputePool *current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+// What the threads of a ParallelFor share; held by the helpers, which may start after it is over
+struct ParallelRuns {
+  const ComputePool::Body *body = nullptr;
+  size_t count = 0;
+  size_t grain = 0;
+  size_t runs = 0;
+  std::atomic<size_t> next{0};
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t done = 0;
+
+  // Take runs until there are none left
+  void Take() {
+    size_t taken = 0;
+    for (size_t run = next.fetch_add(1, std::memory_order_relaxed); run < runs;
+         run = next.fetch_add(1, std::memory_order_relaxed)) {
+      size_t begin = run * grain;
+      (*body)(begin, (std::min)(begin + grain, count));
+      taken++;
+    }
+    if (taken > 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      done += taken;
+      if (done == runs) {
+        finished.notify_all();
+      }
+    }
+  }
+};
+
+} // namespace
+
+ComputePool &ComputePool::Shared() {
+  // Never destroyed: joining its threads while the module unloads would wait on the loader lock
+  static ComputePool *pool = new ComputePool(DefaultWorkers());
+  return *pool;
+}
+
+size_t ComputePool::DefaultWorkers() {
+  size_t cores = std::thread::hardware_concurrency();
+  return cores > kEngineCores + 1 ? cores - kEngineCores : 1;
+}
+
+ComputePool::ComputePool(size_t workers) {
+  for (size_t i = 0; i < workers; i++) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  size_t started = 0;
+  try {
+    for (; started < workers_.size(); started++) {
+      workers_[started]->thread = std::thread(&ComputePool::Run, this, started);
+    }
+  } catch (const std::system_error &) {
+    // Nothing is queued yet, the workers that did not start are simply left out
+    workers_.resize(started);
+  }
+}
+
+ComputePool::~ComputePool() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+void ComputePool::Submit(Task task) {
+  if (workers_.empty()) {
+    task();
+    return;
+  }
+  size_t index = current_pool == this ? current_worker
+                                      : next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+  {
+    // Counted under the deque's lock, which taking the task needs too
+    std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+    workers_[index]->tasks.push_back(std::move(task));
+    queued_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // A worker between checking the count and waiting holds the lock, so it cannot miss the wake
+  { std::lock_guard<std::mutex> lock(wake_mutex_); }
+  wake_.notify_one();
+}
+
+void ComputePool::ParallelFor(size_t count, size_t grain, const Body &body) {
+  if (count == 0) {
+    return;
+  }
+  grain = (std::max)(grain, size_t{1});
+  size_t runs = (count + grain - 1) / grain;
+  if (runs == 1 || workers_.empty()) {
+    body(0, count);
+    return;
+  }
+
+  auto shared = std::make_shared<ParallelRuns>();
+  shared->body = &body;
+  shared->count = count;
+  shared->grain = grain;
+  shared->runs = runs;
+  // The calling thread is one of the takers
+  size_t helpers = (std::min)(runs - 1, workers_.size());
+  for (size_t i = 0; i < helpers; i++) {
+    Submit([shared]() { shared->Take(); });
+  }
+  shared->Take();
+
+  std::unique_lock<std::mutex> lock(shared->mutex);
+  shared->finished.wait(lock, [&shared] { return shared->done == shared->runs; });
+}
+
+ComputePool::Stats ComputePool::ReadStats() const {
+  Stats stats;
+  stats.workers = workers_.size();
+  stats.queued = queued_.load(std::memory_order_relaxed);
+  stats.executed = executed_.load(std::memory_order_relaxed);
+  stats.steals = steals_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+std::string ComputePool::OpenMetricsFamilies() const {
+  static const char kWorkers[] = "wireguard_dart_compute_pool_workers";
+  static const char kQueued[] = "wireguard_dart_compute_pool_queued_tasks";
+  static const char kExecuted[] = "wireguard_dart_compute_pool_tasks";
+  static const char kSteals[] = "wireguard_dart_compute_pool_steals";
+
+  Stats stats = ReadStats();
+  std::string text;
+  text += std::string("# TYPE ") + kWorkers + " gauge\n";
+  text += std::string("# HELP ") + kWorkers + " Threads of the compute pool.\n";
+  text += std::string(kWorkers) + " " + std::to_string(stats.workers) + "\n";
+  text += std::string("# TYPE ") + kQueued + " gauge\n";
+  text += std::string("# HELP ") + kQueued + " Tasks waiting in the deques of the compute pool.\n";
+  text += std::string(kQueued) + " " + std::to_string(stats.queued) + "\n";
+  text += std::string("# TYPE ") + kExecuted + " counter\n";
+  text += std::string("# HELP ") + kExecuted + " Tasks the compute pool ran.\n";
+  text += std::string(kExecuted) + "_total " + std::to_string(stats.executed) + "\n";
+  text += std::string("# TYPE ") + kSteals + " counter\n";
+  text += std::string("# HELP ") + kSteals + " Tasks a compute pool worker took from the deque of another.\n";
+  text += std::string(kSteals) + "_total " + std::to_string(stats.steals) + "\n";
+  return text;
+}
+
+void ComputePool::Run(size_t index) {
+  ScopedThreadCpu cpu(CpuComponent::kComputePool);
+  current_pool = this;
+  current_worker = index;
+  while (true) {
+    Task task;
+    if (TakeTask(index, &task)) {
+      task();
+      executed_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_.wait(lock, [this] { return stopping_ || queued_.load(std::memory_order_relaxed) > 0; });
+    if (stopping_) {
+      return;
+    }
+  }
+}
+
+bool ComputePool::TakeTask(size_t index, Task *task) {
+  {
+    Worker &own = *workers_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      *task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  for (size_t i = 1; i < workers_.size(); i++) {
+    Worker &victim = *workers_[(index + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      steals_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wireguard_dart {
+
+/**
+ * Threads for CPU-bound work, shared by the whole process so that batches of keys, large configurations and the
+ * like never run more threads at once than there are cores to spare. kEngineCores are left to the platform and
+ * raster threads of the Flutter engine. Each worker has a deque of its own: it runs its newest task first and,
+ * when it has none, steals the oldest task of another, so work split on a worker stays there while idle workers
+ * spread it.
+ */
+class ComputePool {
+public:
+  using Task = std::function<void()>;
+  // Called with [begin, end) runs of the indices; must not throw
+  using Body = std::function<void(size_t begin, size_t end)>;
+
+  static constexpr size_t kEngineCores = 2;
+
+  // The process's pool, started on first use and kept until the process exits
+  static ComputePool &Shared();
+
+  // The cores minus kEngineCores, at least one
+  static size_t DefaultWorkers();
+
+  explicit ComputePool(size_t workers);
+  // Runs the tasks still queued, then stops the workers
+  ~ComputePool();
+
+  ComputePool(const ComputePool &) = delete;
+  ComputePool &operator=(const ComputePool &) = delete;
+
+  // From a worker onto its own deque, from any other thread onto each worker's in turn
+  void Submit(Task task);
+
+  /**
+   * Call body for runs of at most grain indices that cover [0, count) and return once all of them returned. The
+   * calling thread takes runs too, so a task of the pool may call it, and without workers it takes all of them.
+   */
+  void ParallelFor(size_t count, size_t grain, const Body &body);
+
+  size_t WorkerCount() const { return workers_.size(); }
+
+  struct Stats {
+    size_t workers = 0;
+    // Tasks waiting in the deques right now
+    size_t queued = 0;
+    uint64_t executed = 0;
+    // Tasks a worker took from the deque of another
+    uint64_t steals = 0;
+  };
+  Stats ReadStats() const;
+
+  // The stats as OpenMetrics families, for getMetrics to put before its # EOF
+  std::string OpenMetricsFamilies() const;
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  void Run(size_t index);
+  // The newest task of the worker's own deque, or else the oldest of another's
+  bool TakeTask(size_t index, Task *task);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+  std::atomic<size_t> queued_{0};
+  // The worker the next task from outside the pool goes to
+  std::atomic<size_t> next_worker_{0};
+  std::atomic<uint64_t> executed_{0};
+  std::atomic<uint64_t> steals_{0};
+};
+
+} // namespace wireguard_dart
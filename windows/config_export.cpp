@@ -0,0 +1,126 @@
+#include "config_export.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "wireguard_core/address_format.h"
+#include "wireguard_core/wireguard_key.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// The longest text of each record: the interface, a peer with every line but its allowed IPs, and one allowed IP
+// with its separator
+constexpr size_t kInterfaceTextBytes = 128;
+constexpr size_t kPeerTextBytes = 256;
+constexpr size_t kAllowedIpTextBytes = kMaxIPv6AddressText + kMaxPortText + 2;
+
+// Appends at a cursor into a buffer that was sized for everything written
+class TextWriter {
+public:
+  explicit TextWriter(char *out) : out_(out) {}
+
+  template <size_t N> void Literal(const char (&text)[N]) {
+    memcpy(out_, text, N - 1);
+    out_ += N - 1;
+  }
+  void Key(const BYTE *key) {
+    KeyToBase64(key, out_);
+    out_ += kWireguardKeyBase64Length;
+  }
+  void Decimal(uint16_t value) { out_ += FormatDecimal(value, out_); }
+  void Address(ADDRESS_FAMILY family, const void *address) {
+    const auto *address_bytes = static_cast<const uint8_t *>(address);
+    out_ += family == AF_INET ? FormatIPv4Address(address_bytes, out_) : FormatIPv6Address(address_bytes, out_);
+  }
+  char *Cursor() const { return out_; }
+
+private:
+  char *out_;
+};
+
+} // namespace
+
+void ExportConfigurationText(const BYTE *data, DWORD bytes, bool redact, std::string *text) {
+  text->clear();
+  const WIREGUARD_INTERFACE *iface = DriverInterface(data, bytes);
+  if (!iface) {
+    return;
+  }
+  // Whatever the driver did not use for peers may be allowed IPs, so this bounds the text however they are split
+  size_t records = bytes - sizeof(WIREGUARD_INTERFACE);
+  size_t peers = std::min<size_t>(iface->PeersCount, records / sizeof(WIREGUARD_PEER));
+  size_t allowed_ips = (records - peers * sizeof(WIREGUARD_PEER)) / sizeof(WIREGUARD_ALLOWED_IP);
+  text->resize(kInterfaceTextBytes + peers * kPeerTextBytes + allowed_ips * kAllowedIpTextBytes);
+
+  char *begin = &(*text)[0];
+  TextWriter out(begin);
+  out.Literal("[Interface]\n");
+  if (iface->Flags & WIREGUARD_INTERFACE_HAS_PRIVATE_KEY) {
+    if (redact) {
+      out.Literal("# PrivateKey = (redacted)\n");
+    } else {
+      out.Literal("PrivateKey = ");
+      out.Key(iface->PrivateKey);
+      out.Literal("\n");
+    }
+  }
+  if ((iface->Flags & WIREGUARD_INTERFACE_HAS_LISTEN_PORT) && iface->ListenPort != 0) {
+    out.Literal("ListenPort = ");
+    out.Decimal(iface->ListenPort);
+    out.Literal("\n");
+  }
+
+  ForEachDriverPeer(data, bytes, [&out, redact](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips,
+                                          DWORD allowed_ip_count) {
+    out.Literal("\n[Peer]\nPublicKey = ");
+    out.Key(peer.PublicKey);
+    out.Literal("\n");
+    if ((peer.Flags & WIREGUARD_PEER_HAS_PRESHARED_KEY) && !IsZeroKey(peer.PresharedKey)) {
+      if (redact) {
+        out.Literal("# PresharedKey = (redacted)\n");
+      } else {
+        out.Literal("PresharedKey = ");
+        out.Key(peer.PresharedKey);
+        out.Literal("\n");
+      }
+    }
+    if (allowed_ip_count > 0) {
+      out.Literal("AllowedIPs = ");
+      for (DWORD i = 0; i < allowed_ip_count; i++) {
+        if (i != 0) {
+          out.Literal(", ");
+        }
+        out.Address(allowed_ips[i].AddressFamily, &allowed_ips[i].Address);
+        out.Literal("/");
+        out.Decimal(allowed_ips[i].Cidr);
+      }
+      out.Literal("\n");
+    }
+    if (peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) {
+      const SOCKADDR_INET &endpoint = peer.Endpoint;
+      if (endpoint.si_family == AF_INET) {
+        out.Literal("Endpoint = ");
+        out.Address(AF_INET, &endpoint.Ipv4.sin_addr);
+        out.Literal(":");
+        out.Decimal(ntohs(endpoint.Ipv4.sin_port));
+        out.Literal("\n");
+      } else if (endpoint.si_family == AF_INET6) {
+        out.Literal("Endpoint = [");
+        out.Address(AF_INET6, &endpoint.Ipv6.sin6_addr);
+        out.Literal("]:");
+        out.Decimal(ntohs(endpoint.Ipv6.sin6_port));
+        out.Literal("\n");
+      }
+    }
+    if ((peer.Flags & WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE) && peer.PersistentKeepalive != 0) {
+      out.Literal("PersistentKeepalive = ");
+      out.Decimal(peer.PersistentKeepalive);
+      out.Literal("\n");
+    }
+  });
+  text->resize(static_cast<size_t>(out.Cursor() - begin));
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+
+#include <cstring>
+#include <string>
+
+#include "wireguard.h"
+
+namespace wireguard_dart {
+
+// The configuration a WireGuard adapter runs, as WIREGUARD_GET_CONFIGURATION_FUNC reads it into data, written back
+// out for exportTunnelConfiguration. Only what the driver holds is there: the interface's keys and listen port and
+// each peer's keys, endpoint, keepalive and allowed IPs, not the addresses, DNS or MTU, which are set on the
+// interface instead. With redact the private key and the preshared keys are left out. Records the driver cut short
+// are left out as well. ExportStructuredConfig writes the same as values.
+
+/**
+ * As the text of a configuration file, with a redacted key as a comment in its place. The longest text each record
+ * can take is added up from the size of data, so the text is written into one buffer that is sized once, and only
+ * shrunk at the end.
+ */
+void ExportConfigurationText(const BYTE *data, DWORD bytes, bool redact, std::string *text);
+
+// The interface at the start of data, or nullptr if data is too short for one
+inline const WIREGUARD_INTERFACE *DriverInterface(const BYTE *data, DWORD bytes) {
+  return bytes >= sizeof(WIREGUARD_INTERFACE) ? reinterpret_cast<const WIREGUARD_INTERFACE *>(data) : nullptr;
+}
+
+// Calls visit(peer, allowed_ips, count) for each peer of data that is whole within bytes
+template <typename Visit> void ForEachDriverPeer(const BYTE *data, DWORD bytes, Visit &&visit) {
+  const WIREGUARD_INTERFACE *iface = DriverInterface(data, bytes);
+  size_t offset = sizeof(WIREGUARD_INTERFACE);
+  for (DWORD i = 0; iface && i < iface->PeersCount && offset + sizeof(WIREGUARD_PEER) <= bytes; i++) {
+    const auto *peer = reinterpret_cast<const WIREGUARD_PEER *>(data + offset);
+    offset += sizeof(WIREGUARD_PEER);
+    if (offset + static_cast<size_t>(peer->AllowedIPsCount) * sizeof(WIREGUARD_ALLOWED_IP) > bytes) {
+      return;
+    }
+    visit(*peer, reinterpret_cast<const WIREGUARD_ALLOWED_IP *>(data + offset), peer->AllowedIPsCount);
+    offset += peer->AllowedIPsCount * sizeof(WIREGUARD_ALLOWED_IP);
+  }
+}
+
+// A preshared key the driver reports for a peer without one is all zeros
+inline bool IsZeroKey(const BYTE *key) {
+  static const BYTE kZero[WIREGUARD_KEY_LENGTH] = {};
+  return memcmp(key, kZero, WIREGUARD_KEY_LENGTH) == 0;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,241 @@
+#include "config_file_watcher.h"
+
+#include <vector>
+
+#include "spdlog/spdlog.h"
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr DWORD kNotifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+// Plenty for the handful of changes a directory sees per wait; an overflow still counts as a change
+constexpr DWORD kNotifyBufferSize = 16 * 1024;
+constexpr size_t kReadChunk = 64 * 1024;
+// A file that cannot be opened this many times in a row is left until it changes again
+constexpr int kReadAttempts = 8;
+
+bool Mentions(const BYTE *buffer, const std::wstring &file_name) {
+  const BYTE *entry = buffer;
+  while (true) {
+    const auto *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(entry);
+    if (CompareStringOrdinal(info->FileName, static_cast<int>(info->FileNameLength / sizeof(wchar_t)),
+                             file_name.c_str(), static_cast<int>(file_name.size()), TRUE) == CSTR_EQUAL) {
+      return true;
+    }
+    if (info->NextEntryOffset == 0) {
+      return false;
+    }
+    entry += info->NextEntryOffset;
+  }
+}
+
+} // namespace
+
+struct ConfigFileWatcher::Watched {
+  std::string tunnel_name;
+  std::wstring path;
+  std::wstring file_name;
+  Changed changed;
+  HANDLE directory = INVALID_HANDLE_VALUE;
+
+  // Held while a completion or the debounce timer handles the watch, and by Stop
+  std::mutex mutex;
+  bool stopped = false;
+  // The text last delivered, or found when the watch started
+  std::string text;
+  IoReactor::TimerId settle_timer = 0;
+  int failed_reads = 0;
+  // Filled by the read in flight, which keeps the watch alive until it completed
+  alignas(DWORD) BYTE buffer[kNotifyBufferSize];
+};
+
+ConfigFileWatcher::~ConfigFileWatcher() { UnwatchAll(); }
+
+bool ConfigFileWatcher::Watch(const std::string &tunnel_name, const std::wstring &path, Changed changed,
+                              std::string *error) {
+  size_t separator = path.find_last_of(L"\\/");
+  if (separator == std::wstring::npos || separator + 1 == path.size()) {
+    *error = "Path must name a file in a directory";
+    return false;
+  }
+  if (!reactor_->IsValid()) {
+    *error = "Files cannot be watched without the I/O reactor";
+    return false;
+  }
+
+  auto watched = std::make_shared<Watched>();
+  watched->tunnel_name = tunnel_name;
+  watched->path = path;
+  watched->file_name = path.substr(separator + 1);
+  watched->changed = std::move(changed);
+  std::wstring directory = path.substr(0, separator);
+  // A path in the root of a drive keeps its backslash
+  if (directory.size() == 2 && directory[1] == L':') {
+    directory += L'\\';
+  }
+
+  watched->directory =
+      CreateFileW(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                  nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+  if (watched->directory == INVALID_HANDLE_VALUE) {
+    *error = "Failed to open directory " + WideToUtf8(directory) + ": error " + std::to_string(GetLastError());
+    return false;
+  }
+  if (!reactor_->Associate(watched->directory)) {
+    *error = "Failed to watch directory " + WideToUtf8(directory) + ": error " + std::to_string(GetLastError());
+    Stop(std::move(watched));
+    return false;
+  }
+  ReadText(watched->path, &watched->text);
+  if (!Read(reactor_, watched)) {
+    *error = "Failed to watch directory " + WideToUtf8(directory) + ": error " + std::to_string(GetLastError());
+    Stop(std::move(watched));
+    return false;
+  }
+
+  std::shared_ptr<Watched> previous;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    previous = std::move(watches_[tunnel_name]);
+    watches_[tunnel_name] = std::move(watched);
+  }
+  Stop(std::move(previous));
+  logger_->info("Watching {} for tunnel {}", WideToUtf8(path), tunnel_name);
+  return true;
+}
+
+void ConfigFileWatcher::Unwatch(const std::string &tunnel_name) {
+  std::shared_ptr<Watched> watched;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = watches_.find(tunnel_name);
+    if (it == watches_.end()) {
+      return;
+    }
+    watched = std::move(it->second);
+    watches_.erase(it);
+  }
+  Stop(std::move(watched));
+  logger_->info("Stopped watching the configuration file of tunnel {}", tunnel_name);
+}
+
+void ConfigFileWatcher::UnwatchAll() {
+  std::map<std::string, std::shared_ptr<Watched>> watches;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    watches.swap(watches_);
+  }
+  for (auto &entry : watches) {
+    Stop(std::move(entry.second));
+  }
+}
+
+void ConfigFileWatcher::Stop(std::shared_ptr<Watched> watched) {
+  if (!watched) {
+    return;
+  }
+  {
+    // Waits for a delivery in progress; whatever runs after sees the watch stopped
+    std::lock_guard<std::mutex> lock(watched->mutex);
+    watched->stopped = true;
+    if (watched->settle_timer) {
+      reactor_->Cancel(watched->settle_timer);
+    }
+  }
+  // The read in flight completes as cancelled and lets go of the watch
+  if (watched->directory != INVALID_HANDLE_VALUE) {
+    CancelIoEx(watched->directory, nullptr);
+    CloseHandle(watched->directory);
+  }
+}
+
+bool ConfigFileWatcher::Read(IoReactor *reactor, const std::shared_ptr<Watched> &watched) {
+  return reactor->StartIo(
+      [&watched](OVERLAPPED *overlapped) {
+        return ReadDirectoryChangesW(watched->directory, watched->buffer, sizeof(watched->buffer), FALSE,
+                                     kNotifyFilter, nullptr, overlapped, nullptr) != FALSE;
+      },
+      [reactor, watched](DWORD error, DWORD bytes) { OnChanges(reactor, watched, error, bytes); });
+}
+
+void ConfigFileWatcher::OnChanges(IoReactor *reactor, const std::shared_ptr<Watched> &watched, DWORD error,
+                                  DWORD bytes) {
+  PluginLogger logger;
+  std::lock_guard<std::mutex> lock(watched->mutex);
+  if (watched->stopped) {
+    return;
+  }
+  if (error != ERROR_SUCCESS && error != ERROR_NOTIFY_ENUM_DIR) {
+    logger->error("Stopped watching the configuration file of tunnel {}: error {}", watched->tunnel_name, error);
+    return;
+  }
+  // No entries means they did not fit in the buffer, and the file may be among them
+  if (error == ERROR_NOTIFY_ENUM_DIR || bytes == 0 || Mentions(watched->buffer, watched->file_name)) {
+    watched->failed_reads = 0;
+    Debounce(reactor, watched);
+  }
+  if (!Read(reactor, watched)) {
+    logger->error("Stopped watching the configuration file of tunnel {}: error {}", watched->tunnel_name,
+                  GetLastError());
+  }
+}
+
+void ConfigFileWatcher::Debounce(IoReactor *reactor, const std::shared_ptr<Watched> &watched) {
+  if (watched->settle_timer) {
+    reactor->Cancel(watched->settle_timer);
+  }
+  watched->settle_timer = reactor->Schedule(kDebounce, [reactor, watched]() { OnSettled(reactor, watched); });
+}
+
+void ConfigFileWatcher::OnSettled(IoReactor *reactor, const std::shared_ptr<Watched> &watched) {
+  PluginLogger logger;
+  std::lock_guard<std::mutex> lock(watched->mutex);
+  if (watched->stopped) {
+    return;
+  }
+  watched->settle_timer = 0;
+  std::string text;
+  if (!ReadText(watched->path, &text)) {
+    // Writers that replace the file leave it missing or locked for a moment
+    if (++watched->failed_reads < kReadAttempts) {
+      Debounce(reactor, watched);
+    }
+    return;
+  }
+  watched->failed_reads = 0;
+  if (text.empty() || text == watched->text) {
+    return;
+  }
+  watched->text = text;
+  logger->info("Configuration file of tunnel {} changed", watched->tunnel_name);
+  // Under the watch's lock, so that Stop returns only once the tunnel has its text
+  watched->changed(watched->tunnel_name, std::move(text));
+}
+
+bool ConfigFileWatcher::ReadText(const std::wstring &path, std::string *text) {
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  text->clear();
+  std::vector<char> chunk(kReadChunk);
+  bool ok = true;
+  while (true) {
+    DWORD read = 0;
+    if (!ReadFile(file, chunk.data(), static_cast<DWORD>(chunk.size()), &read, nullptr)) {
+      ok = false;
+      break;
+    }
+    if (read == 0) {
+      break;
+    }
+    text->append(chunk.data(), read);
+  }
+  CloseHandle(file);
+  return ok;
+}
+
+} // namespace wireguard_dart
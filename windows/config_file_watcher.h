@@ -0,0 +1,67 @@
+#pragma once
+
+#include <windows.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "io_reactor.h"
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * Watches the configuration files of tunnels and hands over their text once they were written. Each file keeps an
+ * overlapped ReadDirectoryChangesW of its directory going on the reactor, so renaming a new file over it counts as
+ * much as writing it in place, and no watch has a thread of its own. A burst of writes is delivered once, kDebounce
+ * after the last of them, and only when the text differs from the one delivered before.
+ */
+class ConfigFileWatcher {
+public:
+  // Called on a reactor thread, for one change of a tunnel's file at a time
+  using Changed = std::function<void(const std::string &tunnel_name, std::string text)>;
+
+  static constexpr std::chrono::milliseconds kDebounce{250};
+
+  // The reactor has to outlive the watcher
+  explicit ConfigFileWatcher(IoReactor *reactor) : reactor_(reactor) {}
+  ~ConfigFileWatcher();
+
+  ConfigFileWatcher(const ConfigFileWatcher &) = delete;
+  ConfigFileWatcher &operator=(const ConfigFileWatcher &) = delete;
+
+  /**
+   * Watch the file at path for the tunnel, replacing the tunnel's earlier watch. Its current text counts as
+   * delivered, only a change is.
+   * @param error Set to why the directory could not be watched
+   */
+  bool Watch(const std::string &tunnel_name, const std::wstring &path, Changed changed, std::string *error);
+
+  // Once it returns, the tunnel's Changed is not running and will not be called again
+  void Unwatch(const std::string &tunnel_name);
+  void UnwatchAll();
+
+private:
+  struct Watched;
+
+  // Start the next read of the directory's changes
+  static bool Read(IoReactor *reactor, const std::shared_ptr<Watched> &watched);
+  static void OnChanges(IoReactor *reactor, const std::shared_ptr<Watched> &watched, DWORD error, DWORD bytes);
+  // Deliver the file once the burst of writes is over
+  static void OnSettled(IoReactor *reactor, const std::shared_ptr<Watched> &watched);
+  static void Debounce(IoReactor *reactor, const std::shared_ptr<Watched> &watched);
+  // Read the whole file, false while it cannot be opened, for example between a delete and a rename
+  static bool ReadText(const std::wstring &path, std::string *text);
+  void Stop(std::shared_ptr<Watched> watched);
+
+  IoReactor *reactor_;
+  std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<Watched>> watches_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,231 @@
+#include "connect_precheck.h"
+
+#include <winhttp.h>
+#include <ws2tcpip.h>
+
+#include <algorithm>
+#include <string_view>
+#include <thread>
+
+#include "cpu_accounting.h"
+#include "spdlog/spdlog.h"
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+constexpr std::chrono::milliseconds ConnectPrecheck::kPortalTimeout;
+constexpr std::chrono::milliseconds ConnectPrecheck::kEndpointWait;
+constexpr size_t ConnectPrecheck::kMaxEndpoints;
+
+namespace {
+
+// What Windows' own network connectivity status indicator asks for, and what it answers without a portal
+constexpr wchar_t kPortalHost[] = L"www.msftconnecttest.com";
+constexpr wchar_t kPortalPath[] = L"/connecttest.txt";
+constexpr std::string_view kPortalBody = "Microsoft Connect Test";
+
+std::string EndpointToString(const SOCKADDR_INET &endpoint) {
+  char text[INET6_ADDRSTRLEN] = {};
+  if (endpoint.si_family == AF_INET) {
+    inet_ntop(AF_INET, &endpoint.Ipv4.sin_addr, text, sizeof(text));
+    return std::string(text) + ":" + std::to_string(ntohs(endpoint.Ipv4.sin_port));
+  }
+  if (endpoint.si_family == AF_INET6) {
+    inet_ntop(AF_INET6, &endpoint.Ipv6.sin6_addr, text, sizeof(text));
+    return "[" + std::string(text) + "]:" + std::to_string(ntohs(endpoint.Ipv6.sin6_port));
+  }
+  return std::string();
+}
+
+} // namespace
+
+ConnectPrecheck::ConnectPrecheck()
+    : portal_(std::make_shared<PortalProbe>()), started_(std::chrono::steady_clock::now()) {
+  // Detached, so that a connect that fails before Finish does not wait for it; it only holds the shared state
+  std::thread(&ConnectPrecheck::RunPortalProbe, portal_).detach();
+}
+
+ConnectPrecheckResult ConnectPrecheck::Finish(const std::vector<SOCKADDR_INET> &endpoints) {
+  ConnectPrecheckResult result;
+  std::string endpoint_detail;
+  bool unreachable = AllEndpointsUnreachable(endpoints, &endpoint_detail);
+
+  PortalVerdict portal;
+  std::string location;
+  {
+    std::unique_lock<std::mutex> lock(portal_->mutex);
+    portal_->done.wait_until(lock, started_ + kPortalTimeout,
+                             [this] { return portal_->verdict != PortalVerdict::kPending; });
+    portal = portal_->verdict;
+    location = portal_->location;
+  }
+  result.elapsed_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started_).count();
+
+  // A portal also makes the endpoints look unreachable, so it is the better answer
+  if (portal == PortalVerdict::kCaptive) {
+    result.verdict = ConnectPrecheckResult::Verdict::kCaptivePortal;
+    result.detail = location;
+  } else if (unreachable) {
+    result.verdict = ConnectPrecheckResult::Verdict::kEndpointUnreachable;
+    result.detail = endpoint_detail;
+  }
+  logger_->info("Connect precheck in {} us: portal probe {}, {} endpoints {}", result.elapsed_us,
+                portal == PortalVerdict::kReachable ? "reached the internet"
+                : portal == PortalVerdict::kCaptive ? "found a captive portal"
+                                                    : "had no answer",
+                endpoints.size(), unreachable ? "unreachable" : "not reported unreachable");
+  return result;
+}
+
+void ConnectPrecheck::RunPortalProbe(std::shared_ptr<PortalProbe> probe) {
+  ScopedThreadCpu cpu(CpuComponent::kOperations);
+  PortalVerdict verdict = PortalVerdict::kUnknown;
+  std::string location;
+
+  // Without a proxy, as the tunnel's datagrams go, and without following a portal's redirect
+  HINTERNET session =
+      WinHttpOpen(L"Microsoft NCSI", WINHTTP_ACCESS_TYPE_NO_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+  HINTERNET connection = session ? WinHttpConnect(session, kPortalHost, INTERNET_DEFAULT_HTTP_PORT, 0) : nullptr;
+  HINTERNET request = connection ? WinHttpOpenRequest(connection, L"GET", kPortalPath, nullptr, WINHTTP_NO_REFERER,
+                                                      WINHTTP_DEFAULT_ACCEPT_TYPES, 0)
+                                 : nullptr;
+  if (request) {
+    int timeout_ms = static_cast<int>(kPortalTimeout.count());
+    WinHttpSetTimeouts(request, timeout_ms, timeout_ms, timeout_ms, timeout_ms);
+    DWORD features = WINHTTP_DISABLE_REDIRECTS | WINHTTP_DISABLE_COOKIES;
+    WinHttpSetOption(request, WINHTTP_OPTION_DISABLE_FEATURE, &features, sizeof(features));
+
+    DWORD status = 0;
+    DWORD status_size = sizeof(status);
+    if (WinHttpSendRequest(request, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) &&
+        WinHttpReceiveResponse(request, nullptr) &&
+        WinHttpQueryHeaders(request, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                            WINHTTP_HEADER_NAME_BY_INDEX, &status, &status_size, WINHTTP_NO_HEADER_INDEX)) {
+      if (status >= 300 && status < 400) {
+        wchar_t buffer[512];
+        DWORD bytes = sizeof(buffer);
+        if (WinHttpQueryHeaders(request, WINHTTP_QUERY_LOCATION, WINHTTP_HEADER_NAME_BY_INDEX, buffer, &bytes,
+                                WINHTTP_NO_HEADER_INDEX)) {
+          location = WideToUtf8(std::wstring_view(buffer, bytes / sizeof(wchar_t)));
+        }
+        verdict = PortalVerdict::kCaptive;
+      } else if (status == 511) {
+        // Network Authentication Required, the status meant for portals
+        verdict = PortalVerdict::kCaptive;
+      } else if (status == 200) {
+        // A portal that answers in place of the server has a page of its own
+        char body[64];
+        size_t length = 0;
+        DWORD read = 0;
+        while (length < sizeof(body) &&
+               WinHttpReadData(request, body + length, static_cast<DWORD>(sizeof(body) - length), &read) && read > 0) {
+          length += read;
+        }
+        verdict = std::string_view(body, length) == kPortalBody ? PortalVerdict::kReachable : PortalVerdict::kCaptive;
+      }
+      // Any other status, like a proxy's refusal, is no verdict
+    }
+  }
+  if (request) {
+    WinHttpCloseHandle(request);
+  }
+  if (connection) {
+    WinHttpCloseHandle(connection);
+  }
+  if (session) {
+    WinHttpCloseHandle(session);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(probe->mutex);
+    probe->verdict = verdict;
+    probe->location = std::move(location);
+  }
+  probe->done.notify_all();
+}
+
+bool ConnectPrecheck::AllEndpointsUnreachable(const std::vector<SOCKADDR_INET> &endpoints, std::string *detail) {
+  WSADATA wsa_data;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+    return false;
+  }
+
+  struct Probe {
+    SOCKET socket;
+    const SOCKADDR_INET *endpoint;
+    // Set once the endpoint was reported unreachable
+    int error;
+  };
+  std::vector<Probe> probes;
+  for (size_t i = 0; i < endpoints.size() && probes.size() < kMaxEndpoints; i++) {
+    const SOCKADDR_INET &endpoint = endpoints[i];
+    if (endpoint.si_family != AF_INET && endpoint.si_family != AF_INET6) {
+      continue;
+    }
+    SOCKET probe_socket = socket(endpoint.si_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (probe_socket == INVALID_SOCKET) {
+      continue;
+    }
+    u_long nonblocking = 1;
+    ioctlsocket(probe_socket, FIONBIO, &nonblocking);
+    // Connected, so that an ICMP error about the endpoint fails the next receive. One zero byte, which a WireGuard
+    // peer drops as a message of no type; no route fails at once.
+    int length = endpoint.si_family == AF_INET ? sizeof(SOCKADDR_IN) : sizeof(SOCKADDR_IN6);
+    const char byte = 0;
+    int error = 0;
+    if (connect(probe_socket, reinterpret_cast<const sockaddr *>(&endpoint), length) == SOCKET_ERROR ||
+        send(probe_socket, &byte, 1, 0) == SOCKET_ERROR) {
+      error = WSAGetLastError();
+    }
+    probes.push_back(Probe{probe_socket, &endpoint, error});
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + kEndpointWait;
+  for (;;) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    for (const Probe &probe : probes) {
+      if (probe.error == 0) {
+        FD_SET(probe.socket, &readable);
+      }
+    }
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+    if (readable.fd_count == 0 || left.count() <= 0) {
+      break;
+    }
+    timeval timeout = {static_cast<long>(left.count() / 1000000), static_cast<long>(left.count() % 1000000)};
+    if (select(0, &readable, nullptr, nullptr, &timeout) <= 0) {
+      break;
+    }
+    for (Probe &probe : probes) {
+      if (probe.error != 0 || !FD_ISSET(probe.socket, &readable)) {
+        continue;
+      }
+      char buffer[64];
+      if (recv(probe.socket, buffer, sizeof(buffer), 0) != SOCKET_ERROR) {
+        // Whatever answered, the endpoint is there; it is left out of the select from now on
+        probe.error = -1;
+        continue;
+      }
+      int error = WSAGetLastError();
+      if (error != WSAEWOULDBLOCK && error != WSAEMSGSIZE) {
+        probe.error = error;
+      }
+    }
+  }
+
+  bool all_unreachable = !probes.empty();
+  for (const Probe &probe : probes) {
+    if (probe.error <= 0) {
+      all_unreachable = false;
+    } else if (detail->empty()) {
+      *detail = EndpointToString(*probe.endpoint) + ": Windows error " + std::to_string(probe.error);
+    }
+    closesocket(probe.socket);
+  }
+  WSACleanup();
+  return all_unreachable;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+struct ConnectPrecheckResult {
+  enum class Verdict {
+    // Nothing obviously in the way; the handshake decides
+    kClear,
+    // The portal probe was redirected or answered by something else than the probe server
+    kCaptivePortal,
+    // Every endpoint probed was reported unreachable, by the route table or an ICMP error
+    kEndpointUnreachable,
+  };
+  Verdict verdict = Verdict::kClear;
+  // Where a captive portal redirected to, or which endpoint could not be reached and why
+  std::string detail;
+  // From the start of the portal probe
+  int64_t elapsed_us = 0;
+};
+
+/**
+ * What a connect can tell about the network in the time it takes to set up the adapter, so that it fails at once
+ * rather than after WireGuard's handshake retries when the network is obviously not going to carry the tunnel.
+ * Constructing it starts an NCSI-style probe on a thread of its own: an HTTP request for Microsoft's connect test
+ * page without a proxy and without following redirects, which a captive portal redirects or answers itself. Finish
+ * then sends one datagram to each peer endpoint and waits for the portal probe; a connected UDP socket reports the
+ * ICMP errors of a network or host that is not there. WireGuard peers do not answer stray datagrams, so silence is
+ * no verdict, and neither is a portal probe that failed or timed out: only what is obvious fails a connect.
+ *
+ * The tunnel must not be up yet, so that both probes take the path of the physical interface.
+ */
+class ConnectPrecheck {
+public:
+  // The portal probe's whole budget, and what Finish waits for it at most
+  static constexpr std::chrono::milliseconds kPortalTimeout{2000};
+  // For the ICMP errors of the endpoint probes to come back
+  static constexpr std::chrono::milliseconds kEndpointWait{300};
+  static constexpr size_t kMaxEndpoints = 8;
+
+  ConnectPrecheck();
+  // Does not wait for the portal probe, which finishes on its own within kPortalTimeout
+  ~ConnectPrecheck() = default;
+
+  ConnectPrecheck(const ConnectPrecheck &) = delete;
+  ConnectPrecheck &operator=(const ConnectPrecheck &) = delete;
+
+  // Probe the endpoints, ports included, and give the verdict of both probes. Once.
+  ConnectPrecheckResult Finish(const std::vector<SOCKADDR_INET> &endpoints);
+
+private:
+  enum class PortalVerdict { kPending, kReachable, kCaptive, kUnknown };
+  // Shared with the probe thread, which may outlive the precheck
+  struct PortalProbe {
+    std::mutex mutex;
+    std::condition_variable done;
+    PortalVerdict verdict = PortalVerdict::kPending;
+    std::string location;
+  };
+
+  static void RunPortalProbe(std::shared_ptr<PortalProbe> probe);
+  // Whether there was an endpoint to probe and each of them was reported unreachable, the first with detail
+  static bool AllEndpointsUnreachable(const std::vector<SOCKADDR_INET> &endpoints, std::string *detail);
+
+  std::shared_ptr<PortalProbe> portal_;
+  std::chrono::steady_clock::time_point started_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -19,6 +19,16 @@ std::string ConnectionStatusToString(const ConnectionStatus status) {
   }
 }
 
+ConnectionStatus ConnectionStatusFromString(const std::string &status) {
+  for (ConnectionStatus candidate : {ConnectionStatus::connected, ConnectionStatus::disconnected,
+                                     ConnectionStatus::connecting, ConnectionStatus::disconnecting}) {
+    if (status == ConnectionStatusToString(candidate)) {
+      return candidate;
+    }
+  }
+  return ConnectionStatus::unknown;
+}
+
 ConnectionStatus ConnectionStatusFromIfOperStatus(IF_OPER_STATUS operStatus) {
   switch (operStatus) {
     case IfOperStatusUp:
@@ -35,4 +45,38 @@ ConnectionStatus ConnectionStatusFromIfOperStatus(IF_OPER_STATUS operStatus) {
   }
 }
 
+ConnectionStatus ConnectionStateMachine::OnInterfaceStatus(ConnectionStatus interface_status) {
+  interface_status_ = interface_status;
+  if (interface_status != ConnectionStatus::connected) {
+    disconnecting_ = false;
+  }
+  return Status();
+}
+
+ConnectionStatus ConnectionStateMachine::OnConnecting() {
+  handshake_seen_ = false;
+  disconnecting_ = false;
+  return Status();
+}
+
+ConnectionStatus ConnectionStateMachine::OnHandshake() {
+  handshake_seen_ = true;
+  return Status();
+}
+
+ConnectionStatus ConnectionStateMachine::OnDisconnecting(bool disconnecting) {
+  disconnecting_ = disconnecting;
+  return Status();
+}
+
+ConnectionStatus ConnectionStateMachine::Status() const {
+  if (interface_status_ != ConnectionStatus::connected) {
+    return interface_status_;
+  }
+  if (disconnecting_) {
+    return ConnectionStatus::disconnecting;
+  }
+  return handshake_seen_ ? ConnectionStatus::connected : ConnectionStatus::connecting;
+}
+
 } // namespace wireguard_dart
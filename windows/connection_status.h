@@ -12,8 +12,35 @@ enum ConnectionStatus { connected, disconnected, connecting, disconnecting, unkn
 
 std::string ConnectionStatusToString(const ConnectionStatus status);
 
+// unknown for anything ConnectionStatusToString does not return
+ConnectionStatus ConnectionStatusFromString(const std::string &status);
+
 ConnectionStatus ConnectionStatusFromIfOperStatus(IF_OPER_STATUS operStatus);
 
+/**
+ * The status of a tunnel from its interface status and handshake progress. The interface is up as soon as the
+ * adapter is, before any peer answered, so an up interface is connecting until a handshake completes after the
+ * adapter was brought up, and disconnecting from the request to bring it down until it is down.
+ */
+class ConnectionStateMachine {
+public:
+  // Each returns the status afterwards
+  ConnectionStatus OnInterfaceStatus(ConnectionStatus interface_status);
+  // The adapter is about to be brought up
+  ConnectionStatus OnConnecting();
+  // A peer completed a handshake since the adapter was brought up
+  ConnectionStatus OnHandshake();
+  // The adapter is about to be brought down, or with false, bringing it down failed
+  ConnectionStatus OnDisconnecting(bool disconnecting);
+
+  ConnectionStatus Status() const;
+
+private:
+  ConnectionStatus interface_status_ = ConnectionStatus::unknown;
+  bool handshake_seen_ = false;
+  bool disconnecting_ = false;
+};
+
 } // namespace wireguard_dart
 
 #endif
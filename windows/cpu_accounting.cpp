@@ -0,0 +1,103 @@
+#include "cpu_accounting.h"
+
+#include <algorithm>
+
+namespace wireguard_dart {
+
+const char *CpuComponentName(CpuComponent component) {
+  switch (component) {
+    case CpuComponent::kPlatformMethods:
+      return "platform_methods";
+    case CpuComponent::kPlatformTasks:
+      return "platform_tasks";
+    case CpuComponent::kTunnelWorkers:
+      return "tunnel_workers";
+    case CpuComponent::kComputePool:
+      return "compute_pool";
+    case CpuComponent::kIoReactor:
+      return "io_reactor";
+    case CpuComponent::kLogWriter:
+      return "log_writer";
+    case CpuComponent::kOperations:
+      return "operations";
+    default:
+      return "unknown";
+  }
+}
+
+CpuAccounting &CpuAccounting::Instance() {
+  static CpuAccounting accounting;
+  return accounting;
+}
+
+const char *CpuAccounting::AccountName(size_t account) {
+  return account < kComponents ? CpuComponentName(static_cast<CpuComponent>(account))
+                               : BackgroundThreadName(static_cast<BackgroundThread>(account - kComponents));
+}
+
+void CpuAccounting::Register(size_t account) {
+  // Its own handle, which stays valid for reading the cycles while the thread runs
+  HANDLE handle = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, GetCurrentThreadId());
+  if (!handle) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  threads_.push_back(Thread{account, GetCurrentThreadId(), handle});
+}
+
+void CpuAccounting::UnregisterCurrentThread() {
+  DWORD id = GetCurrentThreadId();
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto thread = std::find_if(threads_.begin(), threads_.end(), [id](const Thread &thread) { return thread.id == id; });
+  if (thread == threads_.end()) {
+    return;
+  }
+  ULONG64 cycles = 0;
+  if (QueryThreadCycleTime(thread->handle, &cycles)) {
+    retired_[thread->account].fetch_add(cycles, std::memory_order_relaxed);
+  }
+  CloseHandle(thread->handle);
+  threads_.erase(thread);
+}
+
+std::string CpuAccounting::OpenMetricsFamilies() {
+  static const char kCycles[] = "wireguard_dart_cpu_cycles";
+  static const char kThreads[] = "wireguard_dart_threads";
+  static const char kProcessCycles[] = "wireguard_dart_process_cpu_cycles";
+
+  std::array<uint64_t, kAccounts> cycles;
+  std::array<size_t, kAccounts> threads = {};
+  for (size_t i = 0; i < kAccounts; i++) {
+    cycles[i] = retired_[i].load(std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Thread &thread : threads_) {
+      ULONG64 thread_cycles = 0;
+      if (QueryThreadCycleTime(thread.handle, &thread_cycles)) {
+        cycles[thread.account] += thread_cycles;
+      }
+      threads[thread.account]++;
+    }
+  }
+  ULONG64 process_cycles = 0;
+  QueryProcessCycleTime(GetCurrentProcess(), &process_cycles);
+
+  std::string text;
+  text += std::string("# TYPE ") + kCycles + " counter\n";
+  text += std::string("# HELP ") + kCycles + " CPU cycles the plugin used, by component.\n";
+  for (size_t i = 0; i < kAccounts; i++) {
+    text += std::string(kCycles) + "_total{component=\"" + AccountName(i) + "\"} " + std::to_string(cycles[i]) + "\n";
+  }
+  text += std::string("# TYPE ") + kThreads + " gauge\n";
+  text += std::string("# HELP ") + kThreads + " Threads of the plugin that are running, by component.\n";
+  for (size_t i = 0; i < kAccounts; i++) {
+    text += std::string(kThreads) + "{component=\"" + AccountName(i) + "\"} " + std::to_string(threads[i]) + "\n";
+  }
+  text += std::string("# TYPE ") + kProcessCycles + " counter\n";
+  text += std::string("# HELP ") + kProcessCycles + " CPU cycles of the whole process, the app's included.\n";
+  text += std::string(kProcessCycles) + "_total " + std::to_string(process_cycles) + "\n";
+  return text;
+}
+
+} // namespace wireguard_dart
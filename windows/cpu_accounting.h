@@ -0,0 +1,117 @@
+#pragma once
+
+#include <windows.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "background_threads.h"
+
+namespace wireguard_dart {
+
+// What the plugin spends CPU on besides its background threads, which count by their BackgroundThread
+enum class CpuComponent {
+  // Method call handlers on the platform thread
+  kPlatformMethods,
+  // Tasks and signals posted to the platform thread, which send the stream events
+  kPlatformTasks,
+  kTunnelWorkers,
+  kComputePool,
+  kIoReactor,
+  // The thread that writes the log file
+  kLogWriter,
+  // Threads of a single operation, such as the handshake wait of a connect or its precheck
+  kOperations,
+  kCount,
+};
+
+const char *CpuComponentName(CpuComponent component);
+
+/**
+ * The CPU cycles the plugin's own threads used, by component, from QueryThreadCycleTime, so the plugin's idle and
+ * steady-state cost can be told apart from the app's. Threads register when they start and unregister before they
+ * return, which adds what they used to the component for good; time the plugin spends on threads it does not own,
+ * as in handlers on the platform thread, is added as it is measured. Reading the counters costs one
+ * QueryThreadCycleTime per live thread and never stops a thread.
+ */
+class CpuAccounting {
+public:
+  static CpuAccounting &Instance();
+
+  // The calling thread's cycles, from its start, count towards the component until it unregisters
+  void RegisterCurrentThread(CpuComponent component) { Register(static_cast<size_t>(component)); }
+  void RegisterCurrentThread(BackgroundThread thread) { Register(kComponents + static_cast<size_t>(thread)); }
+  void UnregisterCurrentThread();
+
+  // Cycles a thread the plugin does not own spent on the component
+  void AddCycles(CpuComponent component, uint64_t cycles) {
+    retired_[static_cast<size_t>(component)].fetch_add(cycles, std::memory_order_relaxed);
+  }
+
+  /**
+   * The counter family wireguard_dart_cpu_cycles_total, labelled by component, the gauge family
+   * wireguard_dart_threads with the live threads of each, and the counter wireguard_dart_process_cpu_cycles_total
+   * with the cycles of the whole process, to relate the others to
+   */
+  std::string OpenMetricsFamilies();
+
+private:
+  static constexpr size_t kComponents = static_cast<size_t>(CpuComponent::kCount);
+  static constexpr size_t kAccounts = kComponents + static_cast<size_t>(BackgroundThread::kCount);
+
+  struct Thread {
+    size_t account;
+    DWORD id;
+    HANDLE handle;
+  };
+
+  CpuAccounting() = default;
+
+  void Register(size_t account);
+  static const char *AccountName(size_t account);
+
+  std::mutex mutex_;
+  std::vector<Thread> threads_;
+  // Cycles of threads that are gone and of measured sections
+  std::array<std::atomic<uint64_t>, kAccounts> retired_ = {};
+};
+
+// Counts the calling thread towards a component for its lifetime, from the top of the thread's function
+class ScopedThreadCpu {
+public:
+  explicit ScopedThreadCpu(CpuComponent component) { CpuAccounting::Instance().RegisterCurrentThread(component); }
+  explicit ScopedThreadCpu(BackgroundThread thread) { CpuAccounting::Instance().RegisterCurrentThread(thread); }
+  ~ScopedThreadCpu() { CpuAccounting::Instance().UnregisterCurrentThread(); }
+
+  ScopedThreadCpu(const ScopedThreadCpu &) = delete;
+  ScopedThreadCpu &operator=(const ScopedThreadCpu &) = delete;
+};
+
+// Adds the cycles the calling thread spends in its lifetime to a component, for threads the plugin does not own
+class ScopedCpuCycles {
+public:
+  explicit ScopedCpuCycles(CpuComponent component) : component_(component) {
+    QueryThreadCycleTime(GetCurrentThread(), &start_);
+  }
+  ~ScopedCpuCycles() {
+    ULONG64 end = 0;
+    QueryThreadCycleTime(GetCurrentThread(), &end);
+    if (end > start_) {
+      CpuAccounting::Instance().AddCycles(component_, end - start_);
+    }
+  }
+
+  ScopedCpuCycles(const ScopedCpuCycles &) = delete;
+  ScopedCpuCycles &operator=(const ScopedCpuCycles &) = delete;
+
+private:
+  CpuComponent component_;
+  ULONG64 start_ = 0;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,112 @@
+#include "cumulative_counters.h"
+
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x43434757;  // "WGCC"
+
+struct CountersHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t reserved;
+};
+
+constexpr size_t kFileSize = sizeof(CountersHeader) + CumulativeCounters::kSlots * sizeof(CumulativeSlots::Slot);
+
+} // namespace
+
+CumulativeCounters::CumulativeCounters()
+    : slots_([](uint64_t luid, uint64_t instance) {
+        NET_LUID adapter;
+        adapter.Value = luid;
+        NET_IFINDEX index;
+        return ConvertInterfaceLuidToIndex(&adapter, &index) == NO_ERROR && index == instance;
+      }) {}
+
+CumulativeCounters::~CumulativeCounters() {
+  if (view_) {
+    UnmapViewOfFile(view_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+  }
+}
+
+bool CumulativeCounters::Open(const std::wstring &path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (view_) {
+    return true;
+  }
+
+  file_ = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size = {};
+  GetFileSizeEx(file_, &size);
+  bool fresh = static_cast<uint64_t>(size.QuadPart) != kFileSize;
+
+  // Mapping the file at its full size also grows a new or truncated one to it
+  mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(kFileSize), nullptr);
+  if (!mapping_) {
+    return false;
+  }
+  view_ = static_cast<BYTE *>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, kFileSize));
+  if (!view_) {
+    return false;
+  }
+
+  CountersHeader header;
+  memcpy(&header, view_, sizeof(header));
+  if (fresh || header.magic != kMagic || header.version != kVersion || header.slot_count != kSlots) {
+    memset(view_, 0, kFileSize);
+    header = {kMagic, kVersion, static_cast<uint32_t>(kSlots), 0};
+    memcpy(view_, &header, sizeof(header));
+  }
+
+  slots_.Attach(reinterpret_cast<CumulativeSlots::Slot *>(view_ + sizeof(CountersHeader)), kSlots);
+  logger_->info("Cumulative counters opened with {} of {} slots taken", slots_.Taken(), kSlots);
+  return true;
+}
+
+bool CumulativeCounters::IsOpen() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return view_ != nullptr;
+}
+
+void CumulativeCounters::Update(const std::string &tunnel_name, const NET_LUID &luid, NET_IFINDEX index,
+                                const std::vector<PeerStatistics> &peers, uint64_t now_ms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!view_) {
+    return;
+  }
+  if (slots_.Update(tunnel_name, luid.Value, index, peers, now_ms)) {
+    full_logged_ = false;
+  } else if (!full_logged_) {
+    logger_->warn("All {} cumulative counter slots are taken, new peers are not counted until peers are removed "
+                  "or the counters are reset",
+                  kSlots);
+    full_logged_ = true;
+  }
+}
+
+std::map<std::string, CumulativeCounters::Tunnel>
+CumulativeCounters::Read(const std::vector<std::string> &tunnel_names, bool reset, uint64_t now_ms) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!view_) {
+    return {};
+  }
+  return slots_.Read(tunnel_names, reset, now_ms);
+}
+
+} // namespace wireguard_dart
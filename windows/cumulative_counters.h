@@ -0,0 +1,72 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "peer_statistics.h"
+#include "plugin_logger.h"
+#include "wireguard_core/cumulative_slots.h"
+
+namespace wireguard_dart {
+
+/**
+ * Running totals of the bytes each tunnel and each of its peers sent and received, kept in a memory-mapped file
+ * across restarts of the app and recreations of the adapter, whose driver counters start over from zero. The
+ * statistics sampler adds what the driver counted since its last reading, in place; the pages of a mapped file
+ * reach the disk on their own, also after the process died, so keeping the totals costs no writes of its own.
+ * The slots in the file, and when they are given back, are those of CumulativeSlots. The instance marker of an
+ * adapter is its interface index: Windows keeps the LUID of an adapter's GUID, which the plugin derives from the
+ * tunnel name, for the adapter recreated with it, but hands out the index anew to every adapter that arrives. An
+ * adapter is gone once its LUID no longer converts to the index it was counted with.
+ */
+class CumulativeCounters {
+public:
+  // Bumped whenever the slot layout changes; a file of another version starts over empty
+  static constexpr uint32_t kVersion = 2;
+  // Peers and tunnels together, in a file of about 500 KB; once all are taken and none can be given back, new
+  // peers are not counted
+  static constexpr size_t kSlots = 2048;
+
+  using Counts = CumulativeSlots::Counts;
+  using Tunnel = CumulativeSlots::Tunnel;
+
+  CumulativeCounters();
+  ~CumulativeCounters();
+
+  CumulativeCounters(const CumulativeCounters &) = delete;
+  CumulativeCounters &operator=(const CumulativeCounters &) = delete;
+
+  // Open the file at path, creating it if needed; false with the error in GetLastError if it cannot be mapped
+  bool Open(const std::wstring &path);
+  bool IsOpen() const;
+
+  // Add what the driver counted since the last update of each peer, of the adapter at luid and index; on the
+  // sampler thread
+  void Update(const std::string &tunnel_name, const NET_LUID &luid, NET_IFINDEX index,
+              const std::vector<PeerStatistics> &peers, uint64_t now_ms);
+
+  // The totals of the named tunnels, or of every tunnel counted with none. With reset they start over from zero
+  // as of now_ms, under the same lock as the reading, so no update falls between the two, and the slots of removed
+  // peers and of adapters that are gone are given back.
+  std::map<std::string, Tunnel> Read(const std::vector<std::string> &tunnel_names, bool reset, uint64_t now_ms);
+
+private:
+  mutable std::mutex mutex_;
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+  BYTE *view_ = nullptr;
+  CumulativeSlots slots_;
+  // Logged once for every time all slots were taken
+  bool full_logged_ = false;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
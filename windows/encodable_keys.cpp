@@ -0,0 +1,11 @@
+#include "encodable_keys.h"
+
+namespace wireguard_dart {
+namespace keys {
+
+#define WIREGUARD_DART_DEFINE_KEY(name, string) const flutter::EncodableValue name(string);
+WIREGUARD_DART_KEYS(WIREGUARD_DART_DEFINE_KEY)
+#undef WIREGUARD_DART_DEFINE_KEY
+
+} // namespace keys
+} // namespace wireguard_dart
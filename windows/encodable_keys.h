@@ -0,0 +1,211 @@
+#pragma once
+
+#include <flutter/encodable_value.h>
+
+namespace wireguard_dart {
+
+// Every argument and result map key the plugin uses, as identifier and string
+#define WIREGUARD_DART_KEYS(X)                       \
+  X(kActivatedPeers, "activatedPeers")               \
+  X(kActivation, "activation")                       \
+  X(kAddresses, "addresses")                         \
+  X(kAllowedIps, "allowedIps")                       \
+  X(kApps, "apps")                                   \
+  X(kAtUs, "atUs")                                   \
+  X(kAutomaticMetric, "automaticMetric")             \
+  X(kBatchSize, "batchSize")                         \
+  X(kBatched, "batched")                             \
+  X(kBinary, "binary")                               \
+  X(kBundleId, "bundleId")                           \
+  X(kBytesDelivered, "bytesDelivered")               \
+  X(kBytesRetransmitted, "bytesRetransmitted")       \
+  X(kBytesSent, "bytesSent")                         \
+  X(kCacheBytes, "cacheBytes")                       \
+  X(kCacheConfigurations, "cacheConfigurations")     \
+  X(kCfg, "cfg")                                     \
+  X(kChangedAt, "changedAt")                         \
+  X(kChangedAtMonotonicUs, "changedAtMonotonicUs")   \
+  X(kChangedPeers, "changedPeers")                   \
+  X(kChunk, "chunk")                                 \
+  X(kConfig, "config")                               \
+  X(kConfigHandle, "configHandle")                   \
+  X(kConfigurationSize, "configurationSize")         \
+  X(kCorrelationId, "correlationId")                 \
+  X(kCount, "count")                                 \
+  X(kCumulativeCounters, "cumulativeCounters")       \
+  X(kDadTransmits, "dadTransmits")                   \
+  X(kDailyLogFiles, "dailyLogFiles")                 \
+  X(kDnsSearchDomains, "dnsSearchDomains")           \
+  X(kDnsServers, "dnsServers")                       \
+  X(kDriver, "driver")                               \
+  X(kDurationMs, "durationMs")                       \
+  X(kElapsedMs, "elapsedMs")                         \
+  X(kElapsedUs, "elapsedUs")                         \
+  X(kEnabled, "enabled")                             \
+  X(kEnded, "ended")                                 \
+  X(kEndpoint, "endpoint")                           \
+  X(kEndpointPort, "endpointPort")                   \
+  X(kEndpointRoamingSeconds, "endpointRoamingSeconds")\
+  X(kErrorCode, "errorCode")                         \
+  X(kErrorColumn, "errorColumn")                     \
+  X(kErrorLine, "errorLine")                         \
+  X(kErrorMessage, "errorMessage")                   \
+  X(kEvent, "event")                                 \
+  X(kEvents, "events")                               \
+  X(kEventsPerSecond, "eventsPerSecond")             \
+  X(kExpectedHash, "expectedHash")                   \
+  X(kFastRetransmits, "fastRetransmits")             \
+  X(kFormat, "format")                               \
+  X(kGoodputBps, "goodputBps")                       \
+  X(kHandshakeAgeMs, "handshakeAgeMs")               \
+  X(kHandshakeStaleSeconds, "handshakeStaleSeconds") \
+  X(kHangDeadlineMs, "hangDeadlineMs")               \
+  X(kHangMinidump, "hangMinidump")                   \
+  X(kHash, "hash")                                   \
+  X(kHost, "host")                                   \
+  X(kImage, "image")                                 \
+  X(kInSync, "inSync")                               \
+  X(kInstallUs, "installUs")                         \
+  X(kInstalled, "installed")                         \
+  X(kInterface, "interface")                         \
+  X(kInterfaceChanged, "interfaceChanged")           \
+  X(kInterfaceCounters, "interfaceCounters")         \
+  X(kIntervalMs, "intervalMs")                       \
+  X(kJournalState, "journalState")                   \
+  X(kKeyPoolSize, "keyPoolSize")                     \
+  X(kKillSwitch, "killSwitch")                       \
+  X(kLastUs, "lastUs")                               \
+  X(kLastWorkingSetDelta, "lastWorkingSetDelta")     \
+  X(kLatestHandshake, "latestHandshake")             \
+  X(kLevel, "level")                                 \
+  X(kListenPort, "listenPort")                       \
+  X(kLogBytes, "logBytes")                           \
+  X(kLogFilePath, "logFilePath")                     \
+  X(kLogOverflowPolicy, "logOverflowPolicy")         \
+  X(kLogPattern, "logPattern")                       \
+  X(kLogQueueSize, "logQueueSize")                   \
+  X(kLossPercent, "lossPercent")                     \
+  X(kLowMemory, "lowMemory")                         \
+  X(kLuid, "luid")                                   \
+  X(kLuids, "luids")                                 \
+  X(kMaxDatagrams, "maxDatagrams")                   \
+  X(kMaxLines, "maxLines")                           \
+  X(kMaxLogBytes, "maxLogBytes")                     \
+  X(kMaxLogFiles, "maxLogFiles")                     \
+  X(kMaxRecordsPerSecond, "maxRecordsPerSecond")     \
+  X(kMaxUs, "maxUs")                                 \
+  X(kMaxWorkingSetDelta, "maxWorkingSetDelta")       \
+  X(kMeanUs, "meanUs")                               \
+  X(kMessage, "message")                             \
+  X(kMetric, "metric")                               \
+  X(kMinLevel, "minLevel")                           \
+  X(kMinUs, "minUs")                                 \
+  X(kMissingPeers, "missingPeers")                   \
+  X(kMode, "mode")                                   \
+  X(kMonotonicUs, "monotonicUs")                     \
+  X(kMss, "mss")                                     \
+  X(kMtu, "mtu")                                     \
+  X(kOperationId, "operationId")                     \
+  X(kP50Us, "p50Us")                                 \
+  X(kP90Us, "p90Us")                                 \
+  X(kP99Us, "p99Us")                                 \
+  X(kParsedConfigBytes, "parsedConfigBytes")         \
+  X(kPath, "path")                                   \
+  X(kPayload, "payload")                             \
+  X(kPayloadBytes, "payloadBytes")                   \
+  X(kPeerCount, "peerCount")                         \
+  X(kPeers, "peers")                                 \
+  X(kPersistentKeepalive, "persistentKeepalive")     \
+  X(kPhases, "phases")                               \
+  X(kPid, "pid")                                     \
+  X(kPort, "port")                                   \
+  X(kPrecheck, "precheck")                           \
+  X(kPrefetchHosts, "prefetchHosts")                 \
+  X(kPrefix, "prefix")                               \
+  X(kPresharedKey, "presharedKey")                   \
+  X(kPreviousEndpoint, "previousEndpoint")           \
+  X(kPrewarmTunnelNames, "prewarmTunnelNames")       \
+  X(kPrimaryTunnel, "primaryTunnel")                 \
+  X(kPriority, "priority")                           \
+  X(kPrivateKey, "privateKey")                       \
+  X(kPrivateKeys, "privateKeys")                     \
+  X(kProbeAddress, "probeAddress")                   \
+  X(kProbes, "probes")                               \
+  X(kProcessTraffic, "processTraffic")               \
+  X(kProcesses, "processes")                         \
+  X(kProtocol, "protocol")                           \
+  X(kPublicKey, "publicKey")                         \
+  X(kPublicKeys, "publicKeys")                       \
+  X(kQosRules, "qosRules")                           \
+  X(kRecordsDropped, "recordsDropped")               \
+  X(kRecordsWritten, "recordsWritten")               \
+  X(kRedactKeys, "redactKeys")                       \
+  X(kRemoveOrphanAdapters, "removeOrphanAdapters")   \
+  X(kReset, "reset")                                 \
+  X(kRouteCount, "routeCount")                       \
+  X(kRouted, "routed")                               \
+  X(kRouterDiscovery, "routerDiscovery")             \
+  X(kRttMaxMs, "rttMaxMs")                           \
+  X(kRttMinMs, "rttMinMs")                           \
+  X(kRttP50Ms, "rttP50Ms")                           \
+  X(kRttP90Ms, "rttP90Ms")                           \
+  X(kRttUs, "rttUs")                                 \
+  X(kRxBytes, "rxBytes")                             \
+  X(kRxBytesPerSecond, "rxBytesPerSecond")           \
+  X(kRxRate, "rxRate")                               \
+  X(kRxRateEwma, "rxRateEwma")                       \
+  X(kSamples, "samples")                             \
+  X(kSendErrors, "sendErrors")                       \
+  X(kSequence, "sequence")                           \
+  X(kSinceMs, "sinceMs")                             \
+  X(kSource, "source")                               \
+  X(kSplitDnsDomains, "splitDnsDomains")             \
+  X(kStandbyTunnel, "standbyTunnel")                 \
+  X(kStatisticsBytes, "statisticsBytes")             \
+  X(kStatisticsHistory, "statisticsHistory")         \
+  X(kStatus, "status")                               \
+  X(kStatusCoalesceMs, "statusCoalesceMs")           \
+  X(kStreams, "streams")                             \
+  X(kSubscription, "subscription")                   \
+  X(kSubscriptions, "subscriptions")                 \
+  X(kSubsystem, "subsystem")                         \
+  X(kTarget, "target")                               \
+  X(kTcpConnections, "tcpConnections")               \
+  X(kTimeoutEpisodes, "timeoutEpisodes")             \
+  X(kTimeoutMs, "timeoutMs")                         \
+  X(kTimestamp, "timestamp")                         \
+  X(kTimings, "timings")                             \
+  X(kTookUs, "tookUs")                               \
+  X(kTotalBytes, "totalBytes")                       \
+  X(kTotalDownload, "totalDownload")                 \
+  X(kTotalPeers, "totalPeers")                       \
+  X(kTotalUpload, "totalUpload")                     \
+  X(kTunnelName, "tunnelName")                       \
+  X(kTunnelNames, "tunnelNames")                     \
+  X(kTunnels, "tunnels")                             \
+  X(kTxBytes, "txBytes")                             \
+  X(kTxBytesPerSecond, "txBytesPerSecond")           \
+  X(kTxRate, "txRate")                               \
+  X(kTxRateEwma, "txRateEwma")                       \
+  X(kUdpSockets, "udpSockets")                       \
+  X(kUnexpectedPeers, "unexpectedPeers")             \
+  X(kUpdatedMs, "updatedMs")                         \
+  X(kValid, "valid")                                 \
+  X(kVersion, "version")                             \
+  X(kWarmUp, "warmUp")                               \
+  X(kWin32ServiceName, "win32ServiceName")           \
+  X(kWindowMs, "windowMs")                           \
+  X(kWireBufferBytes, "wireBufferBytes")             \
+  X(kWorkingSetBytes, "workingSetBytes")
+
+/**
+ * Map keys built once at load, so a lookup compares against a ready EncodableValue instead of constructing one
+ * from a string literal every time, and result maps copy a key instead of building it.
+ */
+namespace keys {
+#define WIREGUARD_DART_DECLARE_KEY(name, string) extern const flutter::EncodableValue name;
+WIREGUARD_DART_KEYS(WIREGUARD_DART_DECLARE_KEY)
+#undef WIREGUARD_DART_DECLARE_KEY
+} // namespace keys
+
+} // namespace wireguard_dart
@@ -0,0 +1,465 @@
+#include "endpoint_bypass_routes.h"
+
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <ws2tcpip.h>
+
+#include "call_metrics.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+BYTE HostLength(ADDRESS_FAMILY family) { return family == AF_INET ? 32 : 128; }
+
+bool Contains(const IpPrefix &prefix, const IpPrefix &inner) {
+  if (prefix.family != inner.family || prefix.length > inner.length) {
+    return false;
+  }
+  int full_bytes = prefix.length / 8;
+  if (memcmp(prefix.address, inner.address, full_bytes) != 0) {
+    return false;
+  }
+  int rest = prefix.length % 8;
+  BYTE mask = static_cast<BYTE>(0xFF << (8 - rest));
+  return rest == 0 || (prefix.address[full_bytes] & mask) == (inner.address[full_bytes] & mask);
+}
+
+bool SameAddress(const SOCKADDR_INET &a, const SOCKADDR_INET &b) {
+  if (a.si_family != b.si_family) {
+    return false;
+  }
+  if (a.si_family == AF_INET) {
+    return a.Ipv4.sin_addr.s_addr == b.Ipv4.sin_addr.s_addr;
+  }
+  return memcmp(&a.Ipv6.sin6_addr, &b.Ipv6.sin6_addr, sizeof(a.Ipv6.sin6_addr)) == 0;
+}
+
+std::string AddressToString(const SOCKADDR_INET &address) {
+  char text[INET6_ADDRSTRLEN] = {};
+  if (address.si_family == AF_INET) {
+    inet_ntop(AF_INET, &address.Ipv4.sin_addr, text, sizeof(text));
+  } else if (address.si_family == AF_INET6) {
+    inet_ntop(AF_INET6, &address.Ipv6.sin6_addr, text, sizeof(text));
+  }
+  return text;
+}
+
+} // namespace
+
+EndpointBypassRoutes::EndpointBypassRoutes() {}
+
+EndpointBypassRoutes::~EndpointBypassRoutes() { Stop(); }
+
+bool EndpointBypassRoutes::Start(const NET_LUID &tunnel_luid, std::shared_ptr<const SharedRoutes> routes,
+                                 const std::vector<SOCKADDR_INET> &endpoints, uint64_t generation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  tunnel_luid_ = tunnel_luid;
+  generation_ = generation;
+  routes_.clear();
+  for (const auto &route : routes->routes) {
+    routes_.insert(IpPrefix::From(route));
+  }
+
+  std::map<IpPrefix, Pin> wanted;
+  for (const auto &endpoint : endpoints) {
+    if (endpoint.si_family == AF_INET || endpoint.si_family == AF_INET6) {
+      wanted.emplace(IpPrefix::From(endpoint, HostLength(endpoint.si_family)), Pin());
+    }
+  }
+  for (const auto &entry : added_) {
+    if (entry.second == generation) {
+      wanted.emplace(entry.first, Pin());
+    }
+  }
+  added_.clear();
+  endpoints_.clear();
+  for (const auto &entry : wanted) {
+    endpoints_.insert(entry.first);
+  }
+
+  for (auto it = wanted.begin(); it != wanted.end();) {
+    it = IsCoveredLocked(it->first) ? std::next(it) : wanted.erase(it);
+  }
+
+  // Pins of endpoints still wanted are kept as they are, RepinLocked moves them if they went stale
+  for (const auto &entry : pins_) {
+    auto kept = wanted.find(entry.first);
+    if (kept != wanted.end()) {
+      kept->second = entry.second;
+    } else if (entry.second.pinned) {
+      RemovePin(entry.first, entry.second);
+    }
+  }
+  pins_ = std::move(wanted);
+  started_ = true;
+
+  std::vector<IpPrefix> endpoints_to_pin;
+  for (const auto &entry : pins_) {
+    endpoints_to_pin.push_back(entry.first);
+  }
+  RepinLocked(endpoints_to_pin);
+  logger_->info("Pinned {} endpoints inside the tunnel routes to physical interfaces", pins_.size());
+
+  if (!notification_handle_) {
+    DWORD result = NotifyRouteChange2(AF_UNSPEC, RouteChangeCallback, this, FALSE, &notification_handle_);
+    if (result != NO_ERROR) {
+      notification_handle_ = nullptr;
+      logger_->error("Failed to register for route change notifications: Windows error {}", result);
+      return false;
+    }
+  }
+  return true;
+}
+
+void EndpointBypassRoutes::AddEndpoint(const SOCKADDR_INET &endpoint, uint64_t generation) {
+  if (endpoint.si_family != AF_INET && endpoint.si_family != AF_INET6) {
+    return;
+  }
+  IpPrefix prefix = IpPrefix::From(endpoint, HostLength(endpoint.si_family));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!started_) {
+    added_[prefix] = generation;
+    return;
+  }
+  if (generation != generation_) {
+    return;
+  }
+  endpoints_.insert(prefix);
+  if (!IsCoveredLocked(prefix) || pins_.count(prefix) > 0) {
+    return;
+  }
+
+  pins_.emplace(prefix, Pin());
+  RepinLocked({prefix});
+}
+
+void EndpointBypassRoutes::RemoveEndpoint(const SOCKADDR_INET &endpoint, uint64_t generation) {
+  if (endpoint.si_family != AF_INET && endpoint.si_family != AF_INET6) {
+    return;
+  }
+  IpPrefix prefix = IpPrefix::From(endpoint, HostLength(endpoint.si_family));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!started_ || generation != generation_) {
+    return;
+  }
+  endpoints_.erase(prefix);
+  auto pin = pins_.find(prefix);
+  if (pin == pins_.end()) {
+    return;
+  }
+  if (pin->second.pinned) {
+    RemovePin(pin->first, pin->second);
+  }
+  pins_.erase(pin);
+  logger_->info("Unpinned endpoint {}, no peer uses it any more", AddressToString(endpoint));
+}
+
+void EndpointBypassRoutes::ChangeRoutes(const std::vector<WIREGUARD_ALLOWED_IP> &added,
+                                        const std::vector<WIREGUARD_ALLOWED_IP> &removed) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!started_) {
+    return;
+  }
+  for (const auto &route : removed) {
+    routes_.erase(IpPrefix::From(route));
+  }
+  for (const auto &route : added) {
+    routes_.insert(IpPrefix::From(route));
+  }
+
+  // Endpoints are host prefixes, so within a family they are ordered by address and those inside a route are
+  // next to each other
+  auto first_inside = [](const auto &entries, const IpPrefix &route) {
+    IpPrefix first = route;
+    first.length = HostLength(route.family);
+    return entries.lower_bound(first);
+  };
+  for (const auto &removed_route : removed) {
+    IpPrefix route = IpPrefix::From(removed_route);
+    for (auto pin = first_inside(pins_, route); pin != pins_.end() && Contains(route, pin->first);) {
+      if (IsCoveredLocked(pin->first)) {
+        ++pin;
+        continue;
+      }
+      if (pin->second.pinned) {
+        RemovePin(pin->first, pin->second);
+      }
+      pin = pins_.erase(pin);
+    }
+  }
+  std::vector<IpPrefix> endpoints_to_pin;
+  for (const auto &added_route : added) {
+    IpPrefix route = IpPrefix::From(added_route);
+    for (auto endpoint = first_inside(endpoints_, route); endpoint != endpoints_.end() && Contains(route, *endpoint);
+         ++endpoint) {
+      if (pins_.emplace(*endpoint, Pin()).second) {
+        endpoints_to_pin.push_back(*endpoint);
+      }
+    }
+  }
+  if (!endpoints_to_pin.empty()) {
+    RepinLocked(endpoints_to_pin);
+  }
+}
+
+void EndpointBypassRoutes::Repin() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!started_ || pins_.empty()) {
+    return;
+  }
+  std::vector<IpPrefix> endpoints;
+  for (const auto &entry : pins_) {
+    endpoints.push_back(entry.first);
+  }
+  RepinLocked(endpoints);
+}
+
+void EndpointBypassRoutes::Stop() {
+  // CancelMibChangeNotify2 waits for running callbacks, which take the lock
+  HANDLE handle_to_cancel = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    started_ = false;
+    added_.clear();
+    routes_.clear();
+    endpoints_.clear();
+    handle_to_cancel = notification_handle_;
+    notification_handle_ = nullptr;
+  }
+
+  if (handle_to_cancel) {
+    DWORD result = MeteredInvoke(MeteredCall::kCancelMibChangeNotify2, CancelMibChangeNotify2, handle_to_cancel);
+    if (result != NO_ERROR) {
+      logger_->warn("Failed to cancel route change notifications: Windows error {}", result);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  RemoveAllPinsLocked();
+}
+
+VOID CALLBACK EndpointBypassRoutes::RouteChangeCallback(PVOID caller_context, PMIB_IPFORWARD_ROW2 row,
+                                                        MIB_NOTIFICATION_TYPE notification_type) {
+  auto *bypass_routes = static_cast<EndpointBypassRoutes *>(caller_context);
+  if (!bypass_routes || notification_type == MibInitialNotification) {
+    return;
+  }
+
+  bypass_routes->HandleRouteChange(row, notification_type);
+}
+
+void EndpointBypassRoutes::HandleRouteChange(const MIB_IPFORWARD_ROW2 *row, MIB_NOTIFICATION_TYPE notification_type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!started_ || pins_.empty()) {
+    return;
+  }
+
+  // Without a row anything may have changed
+  if (!row) {
+    std::vector<IpPrefix> endpoints;
+    for (const auto &entry : pins_) {
+      endpoints.push_back(entry.first);
+    }
+    RepinLocked(endpoints);
+    return;
+  }
+
+  // Changes to the tunnel's own routes and our pins going in are echoes of what we did
+  if (row->InterfaceLuid.Value == tunnel_luid_.Value) {
+    return;
+  }
+  if (IsOwnRouteLocked(*row)) {
+    if (notification_type != MibDeleteInstance) {
+      return;
+    }
+    // Someone else removed a pin, put it back
+    IpPrefix endpoint = IpPrefix::From(row->DestinationPrefix.Prefix, row->DestinationPrefix.PrefixLength);
+    pins_[endpoint].pinned = false;
+  }
+
+  // Only endpoints inside the changed prefix can have a different best route now
+  IpPrefix changed = IpPrefix::From(row->DestinationPrefix.Prefix, row->DestinationPrefix.PrefixLength);
+  std::vector<IpPrefix> affected;
+  for (const auto &entry : pins_) {
+    if (Contains(changed, entry.first)) {
+      affected.push_back(entry.first);
+    }
+  }
+  if (!affected.empty()) {
+    RepinLocked(affected);
+  }
+}
+
+bool EndpointBypassRoutes::IsCoveredLocked(const IpPrefix &endpoint) const {
+  // Routes never overlap, so one lookup per length finds the route holding the endpoint
+  SOCKADDR_INET address = endpoint.ToSockaddr();
+  for (int length = 0; length <= endpoint.length; length++) {
+    if (routes_.count(IpPrefix::From(address, static_cast<UINT8>(length))) > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool EndpointBypassRoutes::IsOwnRouteLocked(const MIB_IPFORWARD_ROW2 &row) const {
+  const SOCKADDR_INET &destination = row.DestinationPrefix.Prefix;
+  if ((destination.si_family != AF_INET && destination.si_family != AF_INET6) ||
+      row.DestinationPrefix.PrefixLength != HostLength(destination.si_family)) {
+    return false;
+  }
+
+  auto pin = pins_.find(IpPrefix::From(destination, row.DestinationPrefix.PrefixLength));
+  return pin != pins_.end() && pin->second.pinned && pin->second.luid.Value == row.InterfaceLuid.Value &&
+         SameAddress(pin->second.next_hop, row.NextHop);
+}
+
+void EndpointBypassRoutes::RepinLocked(const std::vector<IpPrefix> &endpoints) {
+  for (ADDRESS_FAMILY family : {static_cast<ADDRESS_FAMILY>(AF_INET), static_cast<ADDRESS_FAMILY>(AF_INET6)}) {
+    bool any = false;
+    for (const auto &endpoint : endpoints) {
+      any = any || endpoint.family == family;
+    }
+    if (!any) {
+      continue;
+    }
+
+    PMIB_IPFORWARD_TABLE2 routes = nullptr;
+    DWORD result = GetIpForwardTable2(family, &routes);
+    if (result != NO_ERROR) {
+      logger_->error("Failed to get IP forward table: Windows error {}", result);
+      continue;
+    }
+    PMIB_IPINTERFACE_TABLE interfaces = nullptr;
+    result = GetIpInterfaceTable(family, &interfaces);
+    if (result != NO_ERROR) {
+      logger_->error("Failed to get IP interface table: Windows error {}", result);
+      FreeMibTable(routes);
+      continue;
+    }
+
+    for (const auto &endpoint : endpoints) {
+      if (endpoint.family != family) {
+        continue;
+      }
+
+      Pin &current = pins_[endpoint];
+      Pin best;
+      best.pinned = FindBestRouteLocked(endpoint, *routes, *interfaces, best.luid, best.next_hop);
+      if (best.pinned == current.pinned &&
+          (!best.pinned || (best.luid.Value == current.luid.Value && SameAddress(best.next_hop, current.next_hop)))) {
+        continue;
+      }
+
+      if (current.pinned) {
+        RemovePin(endpoint, current);
+      }
+      if (!best.pinned) {
+        logger_->warn("No physical route to endpoint {}", AddressToString(endpoint.ToSockaddr()));
+      } else if (!InstallPin(endpoint, best)) {
+        best.pinned = false;
+      } else {
+        logger_->info("Pinned endpoint {} to interface {} via {}", AddressToString(endpoint.ToSockaddr()),
+                      best.luid.Value, AddressToString(best.next_hop));
+      }
+      current = best;
+    }
+
+    FreeMibTable(interfaces);
+    FreeMibTable(routes);
+  }
+}
+
+bool EndpointBypassRoutes::FindBestRouteLocked(const IpPrefix &endpoint, const MIB_IPFORWARD_TABLE2 &routes,
+                                               const MIB_IPINTERFACE_TABLE &interfaces, NET_LUID &luid,
+                                               SOCKADDR_INET &next_hop) const {
+  // Longest prefix match over everything but the tunnel, ties going to the lower route plus interface metric
+  // like the stack's own route selection
+  const MIB_IPFORWARD_ROW2 *best = nullptr;
+  ULONG best_metric = 0;
+  for (ULONG i = 0; i < routes.NumEntries; i++) {
+    const MIB_IPFORWARD_ROW2 &row = routes.Table[i];
+    if (row.InterfaceLuid.Value == tunnel_luid_.Value || row.Loopback || IsOwnRouteLocked(row)) {
+      continue;
+    }
+    if (best && row.DestinationPrefix.PrefixLength < best->DestinationPrefix.PrefixLength) {
+      continue;
+    }
+    if (!Contains(IpPrefix::From(row.DestinationPrefix.Prefix, row.DestinationPrefix.PrefixLength), endpoint)) {
+      continue;
+    }
+
+    const MIB_IPINTERFACE_ROW *iface = nullptr;
+    for (ULONG j = 0; j < interfaces.NumEntries && !iface; j++) {
+      if (interfaces.Table[j].InterfaceLuid.Value == row.InterfaceLuid.Value) {
+        iface = &interfaces.Table[j];
+      }
+    }
+    if (!iface || !iface->Connected) {
+      continue;
+    }
+
+    ULONG metric = row.Metric + iface->Metric;
+    if (!best || row.DestinationPrefix.PrefixLength > best->DestinationPrefix.PrefixLength || metric < best_metric) {
+      best = &row;
+      best_metric = metric;
+    }
+  }
+
+  if (!best) {
+    return false;
+  }
+  luid = best->InterfaceLuid;
+  next_hop = best->NextHop;
+  return true;
+}
+
+bool EndpointBypassRoutes::InstallPin(const IpPrefix &endpoint, const Pin &pin) {
+  MIB_IPFORWARD_ROW2 row;
+  InitializeIpForwardEntry(&row);
+  row.InterfaceLuid = pin.luid;
+  row.DestinationPrefix.Prefix = endpoint.ToSockaddr();
+  row.DestinationPrefix.PrefixLength = endpoint.length;
+  row.NextHop = pin.next_hop;
+  row.Metric = 0;
+  row.Protocol = MIB_IPPROTO_NETMGMT;
+
+  DWORD result = CreateIpForwardEntry2(&row);
+  if (result != NO_ERROR && result != ERROR_OBJECT_ALREADY_EXISTS) {
+    logger_->error("Failed to add bypass route for endpoint {}: Windows error {}",
+                   AddressToString(row.DestinationPrefix.Prefix), result);
+    return false;
+  }
+  return true;
+}
+
+void EndpointBypassRoutes::RemovePin(const IpPrefix &endpoint, const Pin &pin) {
+  MIB_IPFORWARD_ROW2 row;
+  InitializeIpForwardEntry(&row);
+  row.InterfaceLuid = pin.luid;
+  row.DestinationPrefix.Prefix = endpoint.ToSockaddr();
+  row.DestinationPrefix.PrefixLength = endpoint.length;
+  row.NextHop = pin.next_hop;
+
+  DWORD result = DeleteIpForwardEntry2(&row);
+  if (result != NO_ERROR && result != ERROR_NOT_FOUND) {
+    logger_->warn("Failed to remove bypass route for endpoint {}: Windows error {}",
+                  AddressToString(row.DestinationPrefix.Prefix), result);
+  }
+}
+
+void EndpointBypassRoutes::RemoveAllPinsLocked() {
+  for (const auto &entry : pins_) {
+    if (entry.second.pinned) {
+      RemovePin(entry.first, entry.second);
+    }
+  }
+  pins_.clear();
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "plugin_logger.h"
+#include "prefix_aggregation.h"
+#include "wireguard.h"
+#include "wireguard_network_config.h"
+
+namespace wireguard_dart {
+
+/**
+ * Keeps the traffic to peer endpoints off the tunnel. When the tunnel's routes cover an endpoint, e.g. with a
+ * 0.0.0.0/0 AllowedIPs, the handshake packets would otherwise be routed into the tunnel itself. Each such
+ * endpoint gets a host route through the best physical route to it, and the route table is watched so the
+ * host route follows that best route whenever it changes, e.g. after roaming to another network.
+ */
+class EndpointBypassRoutes {
+public:
+  EndpointBypassRoutes();
+  ~EndpointBypassRoutes();
+
+  EndpointBypassRoutes(const EndpointBypassRoutes &) = delete;
+  EndpointBypassRoutes &operator=(const EndpointBypassRoutes &) = delete;
+
+  /**
+   * Pin the endpoints that fall inside the tunnel's routes, replacing any pinned before
+   * @param tunnel_luid The tunnel interface, whose routes are never used for a bypass route
+   * @param routes The routes installed on the tunnel, then kept up to date by ChangeRoutes
+   * @param endpoints The peer endpoints, ports are ignored
+   * @param generation The configuration these came from, see AddEndpoint
+   */
+  bool Start(const NET_LUID &tunnel_luid, std::shared_ptr<const SharedRoutes> routes,
+             const std::vector<SOCKADDR_INET> &endpoints, uint64_t generation);
+
+  /**
+   * Add an endpoint that became known later, like a resolved hostname. One added before Start is kept
+   * by it as long as the generation matches.
+   */
+  void AddEndpoint(const SOCKADDR_INET &endpoint, uint64_t generation);
+
+  // Remove the pin of an endpoint no peer sends to any more, as after the peer roamed away from it
+  void RemoveEndpoint(const SOCKADDR_INET &endpoint, uint64_t generation);
+
+  /**
+   * Follow the routes of a peer change, see RouteSet: endpoints inside the routes added are pinned and pins no
+   * route covers any more removed. Only the endpoints inside the routes that changed are looked at.
+   */
+  void ChangeRoutes(const std::vector<WIREGUARD_ALLOWED_IP> &added, const std::vector<WIREGUARD_ALLOWED_IP> &removed);
+
+  // Move every pin to the current best route now, as after a resume, when route notifications may be late
+  void Repin();
+
+  // Remove every bypass route and stop watching the route table
+  void Stop();
+
+private:
+  // A host route keeping an endpoint on a physical interface
+  struct Pin {
+    bool pinned = false;
+    NET_LUID luid = {};
+    SOCKADDR_INET next_hop = {};
+  };
+
+  static VOID CALLBACK RouteChangeCallback(PVOID caller_context, PMIB_IPFORWARD_ROW2 row,
+                                           MIB_NOTIFICATION_TYPE notification_type);
+  void HandleRouteChange(const MIB_IPFORWARD_ROW2 *row, MIB_NOTIFICATION_TYPE notification_type);
+
+  bool IsCoveredLocked(const IpPrefix &endpoint) const;
+  bool IsOwnRouteLocked(const MIB_IPFORWARD_ROW2 &row) const;
+  // Move the pins of these endpoints to their current best physical route, from one table snapshot per family
+  void RepinLocked(const std::vector<IpPrefix> &endpoints);
+  bool FindBestRouteLocked(const IpPrefix &endpoint, const MIB_IPFORWARD_TABLE2 &routes,
+                           const MIB_IPINTERFACE_TABLE &interfaces, NET_LUID &luid, SOCKADDR_INET &next_hop) const;
+  bool InstallPin(const IpPrefix &endpoint, const Pin &pin);
+  void RemovePin(const IpPrefix &endpoint, const Pin &pin);
+  void RemoveAllPinsLocked();
+
+  std::mutex mutex_;
+  bool started_ = false;
+  NET_LUID tunnel_luid_ = {};
+  uint64_t generation_ = 0;
+  // The tunnel's routes, which never overlap
+  std::set<IpPrefix> routes_;
+  // Every endpoint given since Start, pinned or not, for the routes a peer change adds
+  std::set<IpPrefix> endpoints_;
+  std::map<IpPrefix, Pin> pins_;
+  // Endpoints added while not started, with the generation they belong to
+  std::map<IpPrefix, uint64_t> added_;
+
+  HANDLE notification_handle_ = nullptr;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,218 @@
+#include "endpoint_failover.h"
+
+#include <icmpapi.h>
+
+#include <algorithm>
+#include <limits>
+#include <system_error>
+
+#include "cpu_accounting.h"
+#include "spdlog/spdlog.h"
+#include "wireguard_core/peer_index.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr WORD kProbePayloadSize = 32;
+
+uint64_t NowUnixMillis() {
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  return FiletimeToUnixMillis((static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime);
+}
+
+} // namespace
+
+EndpointFailover::~EndpointFailover() { Stop(); }
+
+void EndpointFailover::Start(const std::vector<Peer> &peers, ReadPeers read_peers, Apply apply) {
+  Stop();
+
+  std::vector<Watched> watched;
+  for (const auto &peer : peers) {
+    if (peer.candidates.size() > 1) {
+      Watched entry;
+      entry.peer = peer;
+      watched.push_back(std::move(entry));
+    }
+  }
+  if (watched.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  try {
+    worker_ = std::thread(&EndpointFailover::Run, this, std::move(watched), std::move(read_peers), std::move(apply));
+  } catch (const std::system_error &) {
+    logger_->warn("Peers with alternate endpoints stay on their configured endpoint");
+  }
+}
+
+void EndpointFailover::Stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker = std::move(worker_);
+  }
+  wake_.Notify();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+bool EndpointFailover::Wait(std::chrono::steady_clock::duration timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !wake_.WaitFor(lock, timeout, kCheckTolerance, [this] { return stopping_.load(); });
+}
+
+void EndpointFailover::Run(std::vector<Watched> watched, ReadPeers read_peers, Apply apply) {
+  // The probes time their round trips on threads of their own
+  ThrottleCurrentThread();
+  ScopedThreadCpu cpu(BackgroundThread::kEndpointFailover);
+
+  std::vector<Watched *> all;
+  for (auto &entry : watched) {
+    all.push_back(&entry);
+  }
+  Rank(all);
+  if (stopping_) {
+    return;
+  }
+  for (auto &entry : watched) {
+    entry.switched = std::chrono::steady_clock::now();
+    // The configured endpoint is in place already
+    if (entry.ranking.front() != 0) {
+      logger_->info("Moving a peer to its fastest endpoint, candidate {} of {}", entry.ranking.front() + 1,
+                    entry.peer.candidates.size());
+      apply(entry.peer.public_key, entry.peer.candidates[entry.ranking.front()]);
+    }
+  }
+
+  // A reading is matched to the watched peers through their keys instead of searching it for each of them
+  PeerIndex index;
+  auto key_at = [&watched](uint32_t slot) { return watched[slot].peer.public_key; };
+  for (size_t i = 0; i < watched.size(); i++) {
+    index.Insert(watched[i].peer.public_key, static_cast<uint32_t>(i), key_at);
+  }
+
+  std::vector<PeerStatistics> peers;
+  while (Wait(kCheckInterval)) {
+    if (!read_peers(&peers)) {
+      continue;
+    }
+    auto now = std::chrono::steady_clock::now();
+    uint64_t now_ms = NowUnixMillis();
+    constexpr uint64_t stale_ms = std::chrono::milliseconds(kStaleHandshake).count();
+
+    for (const PeerStatistics &statistics : peers) {
+      uint32_t slot = index.Find(statistics.public_key.data(), key_at);
+      if (slot == PeerIndex::kNone) {
+        continue;
+      }
+      Watched &entry = watched[slot];
+      // Only a peer that is trying to get through can be told apart from one that is just idle
+      bool sent = statistics.tx_bytes > entry.tx_bytes;
+      entry.tx_bytes = statistics.tx_bytes;
+      bool handshake_fresh = statistics.last_handshake_ms != 0 && now_ms - statistics.last_handshake_ms < stale_ms;
+      if (!sent || handshake_fresh || now - entry.switched < kStaleHandshake) {
+        continue;
+      }
+
+      entry.current++;
+      if (entry.current == entry.ranking.size()) {
+        // Every candidate was tried, the network may have changed since they were ranked
+        Rank({&entry});
+        if (stopping_) {
+          return;
+        }
+        entry.current = 0;
+      }
+      size_t candidate = entry.ranking[entry.current];
+      logger_->warn("No handshake for {} s, failing a peer over to endpoint candidate {} of {}",
+                    kStaleHandshake.count(), candidate + 1, entry.peer.candidates.size());
+      apply(entry.peer.public_key, entry.peer.candidates[candidate]);
+      entry.switched = now;
+    }
+  }
+}
+
+void EndpointFailover::Rank(const std::vector<Watched *> &watched) {
+  std::vector<std::vector<int64_t>> round_trips(watched.size());
+  std::vector<std::thread> probes;
+  for (size_t i = 0; i < watched.size(); i++) {
+    const std::vector<SOCKADDR_INET> &candidates = watched[i]->peer.candidates;
+    round_trips[i].resize(candidates.size());
+    for (size_t j = 0; j < candidates.size(); j++) {
+      int64_t *result = &round_trips[i][j];
+      const SOCKADDR_INET *address = &candidates[j];
+      try {
+        probes.emplace_back([this, result, address] { *result = RoundTrip(*address); });
+      } catch (const std::system_error &) {
+        *result = RoundTrip(*address);
+      }
+    }
+  }
+  for (auto &probe : probes) {
+    probe.join();
+  }
+
+  for (size_t i = 0; i < watched.size(); i++) {
+    const std::vector<int64_t> &times = round_trips[i];
+    std::vector<size_t> &ranking = watched[i]->ranking;
+    ranking.resize(times.size());
+    for (size_t j = 0; j < ranking.size(); j++) {
+      ranking[j] = j;
+    }
+    auto key = [&times](size_t j) { return times[j] > 0 ? times[j] : (std::numeric_limits<int64_t>::max)(); };
+    std::stable_sort(ranking.begin(), ranking.end(), [&key](size_t a, size_t b) { return key(a) < key(b); });
+    watched[i]->current = 0;
+  }
+}
+
+int64_t EndpointFailover::RoundTrip(const SOCKADDR_INET &address) const {
+  bool ipv4 = address.si_family == AF_INET;
+  if (!ipv4 && address.si_family != AF_INET6) {
+    return 0;
+  }
+  HANDLE icmp = ipv4 ? IcmpCreateFile() : Icmp6CreateFile();
+  if (icmp == INVALID_HANDLE_VALUE) {
+    return 0;
+  }
+
+  BYTE payload[kProbePayloadSize] = {};
+  BYTE reply[sizeof(ICMP_ECHO_REPLY) + sizeof(ICMPV6_ECHO_REPLY) + kProbePayloadSize + 8 + sizeof(IO_STATUS_BLOCK)];
+  int64_t best = 0;
+  for (int attempt = 0; attempt < kProbeAttempts && !stopping_; attempt++) {
+    auto sent = std::chrono::steady_clock::now();
+    DWORD replies;
+    ULONG status;
+    if (ipv4) {
+      replies = IcmpSendEcho2(icmp, nullptr, nullptr, nullptr, address.Ipv4.sin_addr.s_addr, payload,
+                              kProbePayloadSize, nullptr, reply, sizeof(reply), kProbeTimeoutMs);
+      status = replies > 0 ? reinterpret_cast<const ICMP_ECHO_REPLY *>(reply)->Status : IP_REQ_TIMED_OUT;
+    } else {
+      sockaddr_in6 source = {};
+      source.sin6_family = AF_INET6;
+      sockaddr_in6 destination = address.Ipv6;
+      destination.sin6_port = 0;
+      replies = Icmp6SendEcho2(icmp, nullptr, nullptr, nullptr, &source, &destination, payload, kProbePayloadSize,
+                               nullptr, reply, sizeof(reply), kProbeTimeoutMs);
+      status = replies > 0 ? reinterpret_cast<const ICMPV6_ECHO_REPLY *>(reply)->Status : IP_REQ_TIMED_OUT;
+    }
+    if (status != IP_SUCCESS) {
+      continue;
+    }
+    // Timed here rather than taken from the reply, which only counts whole milliseconds
+    int64_t elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent).count();
+    best = best == 0 ? (std::max<int64_t>)(elapsed, 1) : (std::min)(best, elapsed);
+  }
+
+  IcmpCloseHandle(icmp);
+  return best;
+}
+
+} // namespace wireguard_dart
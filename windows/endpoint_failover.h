@@ -0,0 +1,87 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "background_threads.h"
+#include "peer_statistics.h"
+#include "plugin_logger.h"
+#include "wireguard.h"
+
+namespace wireguard_dart {
+
+/**
+ * Moves peers with more than one Endpoint line to their fastest endpoint, and on to the next one when the
+ * handshakes over it stop. The candidates of all peers are pinged at once and ranked by round trip; WireGuard
+ * answers nothing but a handshake of a known key, so an ICMP echo is the closest a probe gets. Endpoints that do
+ * not answer keep their order from the configuration, after those that did.
+ *
+ * A peer counts as cut off when it kept sending without a handshake for kStaleHandshake, longer than the
+ * protocol lets a session live. It is moved to the next candidate in the ranking; after the last one the
+ * candidates are probed and ranked again.
+ */
+class EndpointFailover {
+public:
+  struct Peer {
+    BYTE public_key[WIREGUARD_KEY_LENGTH];
+    // The configured endpoint first, then the alternates
+    std::vector<SOCKADDR_INET> candidates;
+  };
+  // Every peer's counters from the driver
+  using ReadPeers = std::function<bool(std::vector<PeerStatistics> *peers)>;
+  // Called from the failover thread to set the endpoint on the peer
+  using Apply = std::function<void(const BYTE *public_key, const SOCKADDR_INET &endpoint)>;
+
+  static constexpr DWORD kProbeTimeoutMs = 1000;
+  static constexpr int kProbeAttempts = 3;
+  static constexpr std::chrono::seconds kCheckInterval{10};
+  // A check may come this much later, where Windows coalesces the wakeup with other timers
+  static constexpr std::chrono::milliseconds kCheckTolerance{1000};
+  // REJECT_AFTER_TIME, after which a session without a new handshake is dead
+  static constexpr std::chrono::seconds kStaleHandshake{180};
+
+  EndpointFailover() = default;
+  ~EndpointFailover();
+
+  EndpointFailover(const EndpointFailover &) = delete;
+  EndpointFailover &operator=(const EndpointFailover &) = delete;
+
+  // Probe the candidates and watch the peers, replacing an earlier run; peers with one candidate are ignored
+  void Start(const std::vector<Peer> &peers, ReadPeers read_peers, Apply apply);
+  void Stop();
+
+private:
+  struct Watched {
+    Peer peer;
+    // Indices into peer.candidates, fastest first, and the one in use
+    std::vector<size_t> ranking;
+    size_t current = 0;
+    std::chrono::steady_clock::time_point switched;
+    uint64_t tx_bytes = 0;
+  };
+
+  void Run(std::vector<Watched> watched, ReadPeers read_peers, Apply apply);
+  // Ping every candidate of every peer in parallel and rank each peer's
+  void Rank(const std::vector<Watched *> &watched);
+  // Shortest of a few echoes to the address in microseconds, or 0 if none was answered
+  int64_t RoundTrip(const SOCKADDR_INET &address) const;
+  // Wait for the next check, false once stopped
+  bool Wait(std::chrono::steady_clock::duration timeout);
+
+  std::mutex mutex_;
+  CoalescingWait wake_{BackgroundThread::kEndpointFailover};
+  // Also read by the probing threads
+  std::atomic<bool> stopping_{false};
+  std::thread worker_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
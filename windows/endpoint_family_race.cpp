@@ -0,0 +1,248 @@
+#include "endpoint_family_race.h"
+
+#include <icmpapi.h>
+#include <ws2tcpip.h>
+
+#include <algorithm>
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+constexpr std::chrono::milliseconds EndpointFamilyRace::kAttemptDelay;
+constexpr DWORD EndpointFamilyRace::kProbeTimeoutMs;
+constexpr size_t EndpointFamilyRace::kMaxNetworks;
+constexpr std::chrono::minutes EndpointFamilyRace::kRememberFor;
+
+namespace {
+
+constexpr WORD kPayloadSize = 32;
+constexpr DWORD kReplySize = sizeof(ICMP_ECHO_REPLY) + sizeof(ICMPV6_ECHO_REPLY) + kPayloadSize + 8 +
+                             sizeof(IO_STATUS_BLOCK);
+
+std::string AddressToString(const SOCKADDR_INET &address) {
+  char text[INET6_ADDRSTRLEN] = {};
+  if (address.si_family == AF_INET) {
+    inet_ntop(AF_INET, &address.Ipv4.sin_addr, text, sizeof(text));
+  } else if (address.si_family == AF_INET6) {
+    inet_ntop(AF_INET6, &address.Ipv6.sin6_addr, text, sizeof(text));
+  }
+  return text;
+}
+
+const char *FamilyName(ADDRESS_FAMILY family) { return family == AF_INET6 ? "IPv6" : "IPv4"; }
+
+} // namespace
+
+// One echo request, sent asynchronously with an event that is set once it is answered or timed out
+struct EndpointFamilyRace::Echo {
+  explicit Echo(const SOCKADDR_INET &destination) : address(destination) {
+    icmp = address.si_family == AF_INET ? IcmpCreateFile() : Icmp6CreateFile();
+    event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  }
+
+  ~Echo() {
+    if (icmp != INVALID_HANDLE_VALUE) {
+      IcmpCloseHandle(icmp);
+    }
+    if (event) {
+      CloseHandle(event);
+    }
+  }
+
+  // False if it did not go out, which counts as no answer
+  bool Send() {
+    if (icmp == INVALID_HANDLE_VALUE || !event) {
+      return false;
+    }
+    static const BYTE kPayload[kPayloadSize] = {};
+    DWORD replies;
+    if (address.si_family == AF_INET) {
+      replies = IcmpSendEcho2(icmp, event, nullptr, nullptr, address.Ipv4.sin_addr.s_addr,
+                              const_cast<BYTE *>(kPayload), kPayloadSize, nullptr, reply, kReplySize, kProbeTimeoutMs);
+    } else {
+      sockaddr_in6 source = {};
+      source.sin6_family = AF_INET6;
+      sockaddr_in6 destination = address.Ipv6;
+      destination.sin6_port = 0;
+      replies = Icmp6SendEcho2(icmp, event, nullptr, nullptr, &source, &destination, const_cast<BYTE *>(kPayload),
+                               kPayloadSize, nullptr, reply, kReplySize, kProbeTimeoutMs);
+    }
+    if (replies != 0) {
+      SetEvent(event);
+    } else if (GetLastError() != ERROR_IO_PENDING) {
+      return false;
+    }
+    pending = true;
+    return true;
+  }
+
+  // Once the event is set
+  bool Answered() {
+    pending = false;
+    if (address.si_family == AF_INET) {
+      const auto *echo = reinterpret_cast<const ICMP_ECHO_REPLY *>(reply);
+      return IcmpParseReplies(reply, kReplySize) > 0 && echo->Status == IP_SUCCESS;
+    }
+    const auto *echo = reinterpret_cast<const ICMPV6_ECHO_REPLY *>(reply);
+    return Icmp6ParseReplies(reply, kReplySize) > 0 && echo->Status == IP_SUCCESS;
+  }
+
+  bool Done() const { return !pending || WaitForSingleObject(event, 0) == WAIT_OBJECT_0; }
+
+  SOCKADDR_INET address;
+  HANDLE icmp = INVALID_HANDLE_VALUE;
+  HANDLE event = nullptr;
+  bool pending = false;
+  BYTE reply[kReplySize];
+};
+
+EndpointFamilyRace &EndpointFamilyRace::Instance() {
+  static EndpointFamilyRace race;
+  return race;
+}
+
+EndpointFamilyRace::EndpointFamilyRace() = default;
+
+EndpointFamilyRace::~EndpointFamilyRace() {
+  // Only destroyed at process exit; echoes still in flight may be written to, so they are left to the system
+  for (auto &echo : retired_) {
+    if (!echo->Done()) {
+      echo.release();
+    }
+  }
+}
+
+SOCKADDR_INET EndpointFamilyRace::Choose(const SOCKADDR_INET &address, const SOCKADDR_INET &alternate,
+                                         const NET_LUID &tunnel_luid) {
+  if (alternate.si_family != AF_INET && alternate.si_family != AF_INET6) {
+    return address;
+  }
+  GUID network;
+  bool known = NetworkOf(address, alternate, tunnel_luid, &network);
+  if (!known) {
+    return address;
+  }
+  ADDRESS_FAMILY family = Find(network);
+  if (family == AF_UNSPEC) {
+    family = Race(address, alternate);
+    if (family == AF_UNSPEC) {
+      logger_->info("Neither {} nor {} answered, the endpoint stays on {}", AddressToString(address),
+                    AddressToString(alternate), FamilyName(address.si_family));
+      return address;
+    }
+    logger_->info("{} answered first of {} and {}, remembered for this network", FamilyName(family),
+                  AddressToString(address), AddressToString(alternate));
+    Remember(network, family);
+  }
+  return family == alternate.si_family ? alternate : address;
+}
+
+SOCKADDR_INET EndpointFamilyRace::Remembered(const SOCKADDR_INET &address, const SOCKADDR_INET &alternate,
+                                             const NET_LUID &tunnel_luid) {
+  if (alternate.si_family != AF_INET && alternate.si_family != AF_INET6) {
+    return address;
+  }
+  GUID network;
+  if (!NetworkOf(address, alternate, tunnel_luid, &network)) {
+    return address;
+  }
+  return Find(network) == alternate.si_family ? alternate : address;
+}
+
+bool EndpointFamilyRace::NetworkOf(const SOCKADDR_INET &address, const SOCKADDR_INET &alternate,
+                                   const NET_LUID &tunnel_luid, GUID *network) {
+  // A host without IPv6 has no route for the alternate, and the other way round
+  for (const SOCKADDR_INET *destination : {&address, &alternate}) {
+    MIB_IPFORWARD_ROW2 route;
+    SOCKADDR_INET source = {};
+    if (GetBestRoute2(nullptr, 0, nullptr, destination, 0, &route, &source) != NO_ERROR) {
+      continue;
+    }
+    if (route.InterfaceLuid.Value == tunnel_luid.Value) {
+      return false;
+    }
+    MIB_IF_ROW2 row = {};
+    row.InterfaceLuid = route.InterfaceLuid;
+    if (GetIfEntry2(&row) != NO_ERROR) {
+      continue;
+    }
+    *network = row.NetworkGuid;
+    return true;
+  }
+  return false;
+}
+
+ADDRESS_FAMILY EndpointFamilyRace::Race(const SOCKADDR_INET &first, const SOCKADDR_INET &second) {
+  std::unique_ptr<Echo> echoes[2] = {std::make_unique<Echo>(first), std::make_unique<Echo>(second)};
+  auto deadline = std::chrono::steady_clock::now() + kAttemptDelay + std::chrono::milliseconds(kProbeTimeoutMs);
+  ADDRESS_FAMILY winner = AF_UNSPEC;
+
+  // The second family goes once the first had its head start, or as soon as the first failed
+  if (echoes[0]->Send() &&
+      WaitForSingleObject(echoes[0]->event, static_cast<DWORD>(kAttemptDelay.count())) == WAIT_OBJECT_0 &&
+      echoes[0]->Answered()) {
+    winner = first.si_family;
+  }
+  if (winner == AF_UNSPEC) {
+    echoes[1]->Send();
+  }
+  while (winner == AF_UNSPEC) {
+    HANDLE events[2];
+    size_t indices[2];
+    DWORD count = 0;
+    for (size_t i = 0; i < 2; i++) {
+      if (echoes[i]->pending) {
+        events[count] = echoes[i]->event;
+        indices[count++] = i;
+      }
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    if (count == 0 || left.count() <= 0) {
+      break;
+    }
+    DWORD waited = WaitForMultipleObjects(count, events, FALSE, static_cast<DWORD>(left.count()));
+    if (waited >= WAIT_OBJECT_0 + count) {
+      break;
+    }
+    size_t index = indices[waited - WAIT_OBJECT_0];
+    if (echoes[index]->Answered()) {
+      winner = echoes[index]->address.si_family;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [](const auto &echo) { return echo->Done(); }),
+                 retired_.end());
+  for (auto &echo : echoes) {
+    if (!echo->Done()) {
+      retired_.push_back(std::move(echo));
+    }
+  }
+  return winner;
+}
+
+ADDRESS_FAMILY EndpointFamilyRace::Find(const GUID &network) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  for (const Network &entry : networks_) {
+    if (IsEqualGUID(entry.id, network) && now - entry.raced < kRememberFor) {
+      return entry.family;
+    }
+  }
+  return AF_UNSPEC;
+}
+
+void EndpointFamilyRace::Remember(const GUID &network, ADDRESS_FAMILY family) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  networks_.erase(std::remove_if(networks_.begin(), networks_.end(),
+                                 [&network](const Network &entry) { return IsEqualGUID(entry.id, network); }),
+                  networks_.end());
+  if (networks_.size() >= kMaxNetworks) {
+    networks_.erase(networks_.begin());
+  }
+  networks_.push_back(Network{network, family, std::chrono::steady_clock::now()});
+}
+
+} // namespace wireguard_dart
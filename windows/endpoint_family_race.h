@@ -0,0 +1,83 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * Picks between the IPv4 and the IPv6 address of an endpoint hostname that has both, in the manner of Happy
+ * Eyeballs (RFC 8305), so that an IPv6 path that is broken on the local network does not leave the peer trying
+ * to handshake over it until the handshake times out. An echo goes to the address the system ordered first, and
+ * one to the other once kAttemptDelay passed without an answer; the first family to answer wins. WireGuard
+ * answers nothing but a handshake of a known key, so an ICMP echo stands in for the handshake, as it does for
+ * EndpointFailover. When neither answers, as where ICMP is filtered, the system's order stands.
+ *
+ * The winner is remembered for the network the endpoint is reached over, by the network GUID of the physical
+ * interface, so that later connects on the same network take it without racing again.
+ */
+class EndpointFamilyRace {
+public:
+  // RFC 8305's recommended Connection Attempt Delay
+  static constexpr std::chrono::milliseconds kAttemptDelay{250};
+  static constexpr DWORD kProbeTimeoutMs = 1000;
+  // Networks whose winner is remembered; the least recently raced make way
+  static constexpr size_t kMaxNetworks = 32;
+  // How long a winner is taken without racing again, so a network whose IPv6 got fixed gets to use it
+  static constexpr std::chrono::minutes kRememberFor{10};
+
+  static EndpointFamilyRace &Instance();
+
+  /**
+   * Which of address, the system's first, and alternate, of the other family, the endpoint is set to: the family
+   * remembered for the current network, or the winner of a race, which blocks for up to kAttemptDelay and
+   * kProbeTimeoutMs. Ports are kept as they are. Where the best route to the endpoint is the tunnel's own, as
+   * once a full tunnel is up, an echo would only test the tunnel, so nothing is raced.
+   */
+  SOCKADDR_INET Choose(const SOCKADDR_INET &address, const SOCKADDR_INET &alternate, const NET_LUID &tunnel_luid);
+
+  // The same without racing: the remembered family if there is one for the current network, else address
+  SOCKADDR_INET Remembered(const SOCKADDR_INET &address, const SOCKADDR_INET &alternate,
+                           const NET_LUID &tunnel_luid);
+
+private:
+  struct Network {
+    GUID id;
+    ADDRESS_FAMILY family;
+    std::chrono::steady_clock::time_point raced;
+  };
+  struct Echo;
+
+  EndpointFamilyRace();
+  ~EndpointFamilyRace();
+
+  // The network GUID of the physical interface the best route to either address leaves over; false where the
+  // route is unknown or the tunnel's
+  static bool NetworkOf(const SOCKADDR_INET &address, const SOCKADDR_INET &alternate, const NET_LUID &tunnel_luid,
+                        GUID *network);
+  // The family that answered first, AF_UNSPEC if neither did
+  ADDRESS_FAMILY Race(const SOCKADDR_INET &first, const SOCKADDR_INET &second);
+
+  ADDRESS_FAMILY Find(const GUID &network);
+  void Remember(const GUID &network, ADDRESS_FAMILY family);
+
+  std::mutex mutex_;
+  // Most recently raced last
+  std::vector<Network> networks_;
+  // Echoes that lost a race while still in flight, kept until they complete since the system writes their replies
+  std::vector<std::unique_ptr<Echo>> retired_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,207 @@
+#include "endpoint_path_watcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <ws2tcpip.h>
+
+#include "call_metrics.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+bool SameAddress(const SOCKADDR_INET &a, const SOCKADDR_INET &b) {
+  if (a.si_family != b.si_family) {
+    return false;
+  }
+  if (a.si_family == AF_INET) {
+    return a.Ipv4.sin_addr.s_addr == b.Ipv4.sin_addr.s_addr;
+  }
+  if (a.si_family == AF_INET6) {
+    return memcmp(&a.Ipv6.sin6_addr, &b.Ipv6.sin6_addr, sizeof(a.Ipv6.sin6_addr)) == 0;
+  }
+  return true;
+}
+
+std::string AddressToString(const SOCKADDR_INET &address) {
+  char text[INET6_ADDRSTRLEN] = {};
+  if (address.si_family == AF_INET) {
+    inet_ntop(AF_INET, &address.Ipv4.sin_addr, text, sizeof(text));
+  } else if (address.si_family == AF_INET6) {
+    inet_ntop(AF_INET6, &address.Ipv6.sin6_addr, text, sizeof(text));
+  }
+  return text;
+}
+
+} // namespace
+
+EndpointPathWatcher::EndpointPathWatcher() {}
+
+EndpointPathWatcher::~EndpointPathWatcher() { Stop(); }
+
+bool EndpointPathWatcher::Start(const NET_LUID &tunnel_luid, const std::vector<Endpoint> &endpoints,
+                                PathChanged changed) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tunnel_luid_ = tunnel_luid;
+    changed_ = std::move(changed);
+    watched_.clear();
+    for (const auto &endpoint : endpoints) {
+      if (endpoint.address.si_family != AF_INET && endpoint.address.si_family != AF_INET6) {
+        continue;
+      }
+      Watched watched;
+      watched.endpoint = endpoint;
+      FindPath(endpoint.address, &watched.path);
+      watched_.push_back(watched);
+    }
+    started_ = true;
+    logger_->info("Watching the paths to {} endpoints", watched_.size());
+  }
+
+  bool registered = true;
+  if (!route_notification_handle_) {
+    DWORD result = NotifyRouteChange2(AF_UNSPEC, RouteChangeCallback, this, FALSE, &route_notification_handle_);
+    if (result != NO_ERROR) {
+      route_notification_handle_ = nullptr;
+      logger_->error("Failed to register for route change notifications: Windows error {}", result);
+      registered = false;
+    }
+  }
+  if (!address_notification_handle_) {
+    DWORD result =
+        NotifyUnicastIpAddressChange(AF_UNSPEC, AddressChangeCallback, this, FALSE, &address_notification_handle_);
+    if (result != NO_ERROR) {
+      address_notification_handle_ = nullptr;
+      logger_->error("Failed to register for address change notifications: Windows error {}", result);
+      registered = false;
+    }
+  }
+  return registered;
+}
+
+void EndpointPathWatcher::AddEndpoint(const Endpoint &endpoint) {
+  if (endpoint.address.si_family != AF_INET && endpoint.address.si_family != AF_INET6) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!started_) {
+    return;
+  }
+  Watched watched;
+  watched.endpoint = endpoint;
+  FindPath(endpoint.address, &watched.path);
+  for (auto &existing : watched_) {
+    if (memcmp(existing.endpoint.public_key, endpoint.public_key, sizeof(endpoint.public_key)) == 0) {
+      existing = watched;
+      return;
+    }
+  }
+  watched_.push_back(watched);
+}
+
+void EndpointPathWatcher::RemoveEndpoints(const std::function<bool(const BYTE *public_key)> &removed) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  watched_.erase(std::remove_if(watched_.begin(), watched_.end(),
+                                [&removed](const Watched &watched) { return removed(watched.endpoint.public_key); }),
+                 watched_.end());
+}
+
+void EndpointPathWatcher::Stop() {
+  // CancelMibChangeNotify2 waits for running callbacks, which take the lock
+  HANDLE route_handle_to_cancel = nullptr;
+  HANDLE address_handle_to_cancel = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    started_ = false;
+    route_handle_to_cancel = route_notification_handle_;
+    route_notification_handle_ = nullptr;
+    address_handle_to_cancel = address_notification_handle_;
+    address_notification_handle_ = nullptr;
+  }
+
+  if (route_handle_to_cancel) {
+    MeteredInvoke(MeteredCall::kCancelMibChangeNotify2, CancelMibChangeNotify2, route_handle_to_cancel);
+  }
+  if (address_handle_to_cancel) {
+    MeteredInvoke(MeteredCall::kCancelMibChangeNotify2, CancelMibChangeNotify2, address_handle_to_cancel);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  watched_.clear();
+  changed_ = nullptr;
+}
+
+VOID CALLBACK EndpointPathWatcher::RouteChangeCallback(PVOID caller_context, PMIB_IPFORWARD_ROW2 row,
+                                                       MIB_NOTIFICATION_TYPE notification_type) {
+  auto *watcher = static_cast<EndpointPathWatcher *>(caller_context);
+  if (!watcher || notification_type == MibInitialNotification) {
+    return;
+  }
+  watcher->Recheck(row ? &row->InterfaceLuid : nullptr);
+}
+
+VOID CALLBACK EndpointPathWatcher::AddressChangeCallback(PVOID caller_context, PMIB_UNICASTIPADDRESS_ROW row,
+                                                         MIB_NOTIFICATION_TYPE notification_type) {
+  auto *watcher = static_cast<EndpointPathWatcher *>(caller_context);
+  if (!watcher || notification_type == MibInitialNotification) {
+    return;
+  }
+  watcher->Recheck(row ? &row->InterfaceLuid : nullptr);
+}
+
+void EndpointPathWatcher::Recheck(const NET_LUID *changed_interface) {
+  std::vector<Endpoint> moved;
+  PathChanged changed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The tunnel's own routes and addresses are never the path to an endpoint
+    if (!started_ || (changed_interface && changed_interface->Value == tunnel_luid_.Value)) {
+      return;
+    }
+    for (auto &watched : watched_) {
+      Path path;
+      // A path that went away is not reported, the one that replaces it is
+      if (!FindPath(watched.endpoint.address, &path) || SamePath(path, watched.path)) {
+        continue;
+      }
+      logger_->info("Path to endpoint {} moved to interface {} via {}", AddressToString(watched.endpoint.address),
+                    path.luid.Value, AddressToString(path.next_hop));
+      watched.path = path;
+      moved.push_back(watched.endpoint);
+    }
+    if (moved.empty()) {
+      return;
+    }
+    changed = changed_;
+  }
+
+  if (changed) {
+    changed(moved);
+  }
+}
+
+bool EndpointPathWatcher::FindPath(const SOCKADDR_INET &destination, Path *path) const {
+  MIB_IPFORWARD_ROW2 route;
+  SOCKADDR_INET source = {};
+  DWORD result = GetBestRoute2(nullptr, 0, nullptr, &destination, 0, &route, &source);
+  if (result != NO_ERROR) {
+    *path = Path();
+    return false;
+  }
+  path->known = true;
+  path->luid = route.InterfaceLuid;
+  path->next_hop = route.NextHop;
+  path->source = source;
+  return true;
+}
+
+bool EndpointPathWatcher::SamePath(const Path &a, const Path &b) {
+  return a.known == b.known && (!a.known || (a.luid.Value == b.luid.Value && SameAddress(a.next_hop, b.next_hop) &&
+                                             SameAddress(a.source, b.source)));
+}
+
+} // namespace wireguard_dart
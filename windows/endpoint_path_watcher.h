@@ -0,0 +1,91 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "plugin_logger.h"
+#include "wireguard.h"
+
+namespace wireguard_dart {
+
+/**
+ * Gets a handshake going on the new path as soon as the network under the tunnel changes, e.g. after resume or
+ * moving from Wi-Fi to ethernet, instead of the tunnel sitting stale until a keepalive or the WireGuard timers.
+ * The best route to every peer endpoint, its interface, next hop and source address, is looked up again on each
+ * route or address change outside the tunnel, and the endpoints whose path changed are handed to the callback to
+ * be set on their peers again.
+ */
+class EndpointPathWatcher {
+public:
+  struct Endpoint {
+    BYTE public_key[WIREGUARD_KEY_LENGTH];
+    SOCKADDR_INET address;
+  };
+  // Called from a notification thread, without the watcher's lock
+  using PathChanged = std::function<void(const std::vector<Endpoint> &endpoints)>;
+
+  EndpointPathWatcher();
+  ~EndpointPathWatcher();
+
+  EndpointPathWatcher(const EndpointPathWatcher &) = delete;
+  EndpointPathWatcher &operator=(const EndpointPathWatcher &) = delete;
+
+  /**
+   * Watch the paths to these endpoints, replacing an earlier run
+   * @param tunnel_luid The tunnel interface, changes to its own routes and addresses are ignored
+   * @param endpoints The peer endpoints with the peers' public keys
+   * @param changed Called with the endpoints whose path changed
+   */
+  bool Start(const NET_LUID &tunnel_luid, const std::vector<Endpoint> &endpoints, PathChanged changed);
+
+  // Include an endpoint that became known later, like a resolved hostname, replacing the peer's earlier one
+  void AddEndpoint(const Endpoint &endpoint);
+
+  // Stop watching the endpoints of the peers removed(public_key) is true for, in one pass
+  void RemoveEndpoints(const std::function<bool(const BYTE *public_key)> &removed);
+
+  void Stop();
+
+private:
+  // How an endpoint is reached
+  struct Path {
+    bool known = false;
+    NET_LUID luid = {};
+    SOCKADDR_INET next_hop = {};
+    SOCKADDR_INET source = {};
+  };
+  struct Watched {
+    Endpoint endpoint;
+    Path path;
+  };
+
+  static VOID CALLBACK RouteChangeCallback(PVOID caller_context, PMIB_IPFORWARD_ROW2 row,
+                                           MIB_NOTIFICATION_TYPE notification_type);
+  static VOID CALLBACK AddressChangeCallback(PVOID caller_context, PMIB_UNICASTIPADDRESS_ROW row,
+                                             MIB_NOTIFICATION_TYPE notification_type);
+
+  // Look up every path again and report the changed ones, unless the change was on the tunnel
+  void Recheck(const NET_LUID *changed_interface);
+  bool FindPath(const SOCKADDR_INET &destination, Path *path) const;
+  static bool SamePath(const Path &a, const Path &b);
+
+  std::mutex mutex_;
+  bool started_ = false;
+  NET_LUID tunnel_luid_ = {};
+  std::vector<Watched> watched_;
+  PathChanged changed_;
+
+  HANDLE route_notification_handle_ = nullptr;
+  HANDLE address_notification_handle_ = nullptr;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
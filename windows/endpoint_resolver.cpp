@@ -0,0 +1,170 @@
+#include "endpoint_resolver.h"
+
+#include <ws2tcpip.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+constexpr std::chrono::seconds EndpointResolver::kCacheLifetime;
+
+struct EndpointResolver::Query {
+  // Must stay the first member, the completion routine only gets the OVERLAPPED back
+  WSAOVERLAPPED overlapped = {};
+  PADDRINFOEXW result = nullptr;
+  HANDLE cancel_handle = nullptr;
+  EndpointResolver *owner = nullptr;
+  std::string host;
+  std::wstring wide_host;
+  std::shared_ptr<ResolvedCallback> callback;
+};
+
+EndpointResolver::~EndpointResolver() {
+  std::vector<HANDLE> cancel_handles;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Query *query : outstanding_) {
+      cancel_handles.push_back(query->cancel_handle);
+    }
+  }
+
+  // Cancelling may complete the query on this thread, so it is done without holding the lock
+  for (HANDLE &cancel_handle : cancel_handles) {
+    GetAddrInfoExCancel(&cancel_handle);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  queries_done_.wait(lock, [this] { return outstanding_.empty(); });
+}
+
+bool EndpointResolver::Lookup(const std::string &host, SOCKADDR_INET &address) {
+  SOCKADDR_INET alternate;
+  return Lookup(host, address, alternate);
+}
+
+bool EndpointResolver::Lookup(const std::string &host, SOCKADDR_INET &address, SOCKADDR_INET &alternate) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto entry = cache_.find(host);
+  if (entry == cache_.end()) {
+    return false;
+  }
+
+  if (entry->second.expires <= std::chrono::steady_clock::now()) {
+    cache_.erase(entry);
+    return false;
+  }
+
+  address = entry->second.address;
+  alternate = entry->second.alternate;
+  return true;
+}
+
+size_t EndpointResolver::CacheBytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (const auto &entry : cache_) {
+    bytes += sizeof(entry) + entry.first.capacity();
+  }
+  return bytes;
+}
+
+void EndpointResolver::ResolveAsync(const std::vector<std::string> &hosts, ResolvedCallback callback) {
+  auto shared_callback = std::make_shared<ResolvedCallback>(std::move(callback));
+
+  ADDRINFOEXW hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_protocol = IPPROTO_UDP;
+
+  for (const auto &host : hosts) {
+    auto query = std::make_unique<Query>();
+    query->owner = this;
+    query->host = host;
+    query->wide_host = Utf8ToWide(host);
+    query->callback = shared_callback;
+
+    Query *raw_query = query.get();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      outstanding_.push_back(raw_query);
+    }
+
+    int result = GetAddrInfoExW(raw_query->wide_host.c_str(), nullptr, NS_DNS, nullptr, &hints, &raw_query->result,
+                                nullptr, &raw_query->overlapped, QueryCompleted, &raw_query->cancel_handle);
+    if (result == WSA_IO_PENDING) {
+      // Owned by the completion routine from here on
+      query.release();
+      continue;
+    }
+    // Answered right away, for which the completion routine is not called. It is run on a system thread like
+    // the others, the caller may hold a lock the callback takes.
+    if (result == NO_ERROR && TrySubmitThreadpoolCallback(CompleteAnswered, raw_query, nullptr)) {
+      query.release();
+      continue;
+    }
+
+    // Failed to start; anything else means the completion routine will not run
+    if (raw_query->result) {
+      FreeAddrInfoExW(raw_query->result);
+      raw_query->result = nullptr;
+    }
+    FinishQuery(query.release(), nullptr, nullptr);
+  }
+}
+
+void CALLBACK EndpointResolver::CompleteAnswered(PTP_CALLBACK_INSTANCE, void *context) {
+  QueryCompleted(NO_ERROR, 0, &static_cast<Query *>(context)->overlapped);
+}
+
+void CALLBACK EndpointResolver::QueryCompleted(DWORD error, DWORD bytes, LPWSAOVERLAPPED overlapped) {
+  Query *query = reinterpret_cast<Query *>(overlapped);
+
+  // Answers come in the system's preferred order; the first usable one of each family is kept, in that order
+  SOCKADDR_INET addresses[2] = {};
+  size_t resolved = 0;
+  if (error == NO_ERROR) {
+    for (PADDRINFOEXW info = query->result; info && resolved < 2; info = info->ai_next) {
+      bool seen = resolved > 0 && addresses[0].si_family == info->ai_family;
+      if (!seen && info->ai_family == AF_INET && info->ai_addrlen >= sizeof(SOCKADDR_IN)) {
+        memcpy(&addresses[resolved++].Ipv4, info->ai_addr, sizeof(SOCKADDR_IN));
+      } else if (!seen && info->ai_family == AF_INET6 && info->ai_addrlen >= sizeof(SOCKADDR_IN6)) {
+        memcpy(&addresses[resolved++].Ipv6, info->ai_addr, sizeof(SOCKADDR_IN6));
+      }
+    }
+  }
+
+  if (query->result) {
+    FreeAddrInfoExW(query->result);
+    query->result = nullptr;
+  }
+
+  query->owner->FinishQuery(query, resolved > 0 ? &addresses[0] : nullptr, resolved > 1 ? &addresses[1] : nullptr);
+}
+
+void EndpointResolver::FinishQuery(Query *query, const SOCKADDR_INET *address, const SOCKADDR_INET *alternate) {
+  std::unique_ptr<Query> owned_query(query);
+
+  if (address) {
+    SOCKADDR_INET no_alternate = {};
+    no_alternate.si_family = AF_UNSPEC;
+    std::lock_guard<std::mutex> lock(mutex_);
+    cache_[query->host] =
+        CacheEntry{*address, alternate ? *alternate : no_alternate, std::chrono::steady_clock::now() + kCacheLifetime};
+  }
+
+  (*query->callback)(query->host, address, alternate);
+
+  // Only now may the destructor return, the callback may still use its captures until here
+  std::lock_guard<std::mutex> lock(mutex_);
+  outstanding_.erase(std::remove(outstanding_.begin(), outstanding_.end(), query), outstanding_.end());
+  if (outstanding_.empty()) {
+    queries_done_.notify_all();
+  }
+}
+
+} // namespace wireguard_dart
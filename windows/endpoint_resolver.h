@@ -0,0 +1,78 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace wireguard_dart {
+
+/**
+ * Resolves peer endpoint hostnames with asynchronous GetAddrInfoExW lookups and caches the answers.
+ * All lookups requested together are in flight at the same time, so resolving many hostnames costs
+ * about one resolver round-trip. A hostname with both A and AAAA records keeps the first address of each family,
+ * the one the system ordered first as its address and the other as its alternate, see EndpointFamilyRace.
+ */
+class EndpointResolver {
+public:
+  // GetAddrInfoExW does not report record TTLs, so answers are kept for a fixed time
+  static constexpr std::chrono::seconds kCacheLifetime{300};
+
+  // Called once per hostname on a system thread; address is nullptr if resolution failed, alternate if the
+  // hostname has addresses of one family only
+  using ResolvedCallback =
+      std::function<void(const std::string &host, const SOCKADDR_INET *address, const SOCKADDR_INET *alternate)>;
+
+  EndpointResolver() = default;
+
+  // Cancels outstanding lookups and waits for their callbacks to finish
+  ~EndpointResolver();
+
+  EndpointResolver(const EndpointResolver &) = delete;
+  EndpointResolver &operator=(const EndpointResolver &) = delete;
+
+  /**
+   * Look up a fresh cached address for host
+   * @param host The hostname
+   * @param address Receives the address, without a port
+   * @return true if a cached address was found
+   */
+  bool Lookup(const std::string &host, SOCKADDR_INET &address);
+  // The same, with the address of the other family in alternate, whose si_family is AF_UNSPEC if there is none
+  bool Lookup(const std::string &host, SOCKADDR_INET &address, SOCKADDR_INET &alternate);
+
+  /**
+   * Start resolving hosts concurrently. Successful answers are cached before callback runs.
+   */
+  void ResolveAsync(const std::vector<std::string> &hosts, ResolvedCallback callback);
+
+  // Bytes the cached answers take, counting their map nodes and hostnames
+  size_t CacheBytes();
+
+private:
+  struct Query;
+
+  static void CALLBACK QueryCompleted(DWORD error, DWORD bytes, LPWSAOVERLAPPED overlapped);
+  // QueryCompleted for a lookup GetAddrInfoExW answered before it returned
+  static void CALLBACK CompleteAnswered(PTP_CALLBACK_INSTANCE instance, void *context);
+  void FinishQuery(Query *query, const SOCKADDR_INET *address, const SOCKADDR_INET *alternate);
+
+  struct CacheEntry {
+    SOCKADDR_INET address;
+    SOCKADDR_INET alternate;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  std::mutex mutex_;
+  std::condition_variable queries_done_;
+  std::map<std::string, CacheEntry> cache_;
+  std::vector<Query *> outstanding_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,226 @@
+#include "failover_groups.h"
+
+#include "call_metrics.h"
+#include "spdlog/spdlog.h"
+#include "transient_retry.h"
+
+namespace wireguard_dart {
+
+FailoverGroups::FailoverGroups(IoReactor *reactor) : reactor_(reactor), owner_(std::make_shared<Owner>()) {
+  owner_->groups = this;
+}
+
+FailoverGroups::~FailoverGroups() {
+  {
+    std::lock_guard<std::mutex> lock(owner_->mutex);
+    owner_->groups = nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : groups_) {
+    CancelFailbackLocked(entry.second);
+  }
+}
+
+DWORD FailoverGroups::Set(const std::string &primary, const NET_LUID &primary_luid, const std::string &standby,
+                          const NET_LUID &standby_luid) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::string &tunnel_name : {primary, standby}) {
+    if (Group *previous = FindLocked(tunnel_name)) {
+      CancelFailbackLocked(*previous);
+      std::string previous_primary = previous->primary;
+      groups_.erase(previous_primary);
+    }
+  }
+  Group &group = groups_[primary];
+  group.primary = primary;
+  group.primary_luid = primary_luid;
+  group.standby = standby;
+  group.standby_luid = standby_luid;
+
+  DWORD error = SetMetric(standby_luid, kStandbyMetric);
+  if (error == ERROR_SUCCESS) {
+    error = SetMetric(primary_luid, kPrimaryMetric);
+  }
+  if (error != ERROR_SUCCESS) {
+    groups_.erase(primary);
+    return error;
+  }
+  logger_->info("Tunnel {} fails over to tunnel {}", primary, standby);
+  // Either may be stale already
+  UpdateLocked(group);
+  return ERROR_SUCCESS;
+}
+
+bool FailoverGroups::Remove(const std::string &tunnel_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Group *group = FindLocked(tunnel_name);
+  if (!group) {
+    return false;
+  }
+  CancelFailbackLocked(*group);
+  std::string primary = group->primary;
+  groups_.erase(primary);
+  logger_->info("Tunnel {} no longer fails over", primary);
+  return true;
+}
+
+std::vector<std::string> FailoverGroups::Members(const std::string &tunnel_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Group *group = FindLocked(tunnel_name);
+  if (!group) {
+    return {};
+  }
+  return {group->primary, group->standby};
+}
+
+void FailoverGroups::OnLiveness(const std::string &tunnel_name, const PeerKey &public_key, bool stale) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (stale) {
+    stale_peers_[tunnel_name].insert(public_key);
+  } else if (auto peers = stale_peers_.find(tunnel_name); peers != stale_peers_.end()) {
+    peers->second.erase(public_key);
+    if (peers->second.empty()) {
+      stale_peers_.erase(peers);
+    }
+  }
+  if (Group *group = FindLocked(tunnel_name)) {
+    UpdateLocked(*group);
+  }
+}
+
+bool FailoverGroups::Reapply(const std::string &tunnel_name, const NET_LUID &luid) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Group *group = FindLocked(tunnel_name);
+  if (!group) {
+    return false;
+  }
+  ULONG metric;
+  if (tunnel_name == group->primary) {
+    group->primary_luid = luid;
+    metric = group->failed_over ? kDemotedMetric : kPrimaryMetric;
+  } else {
+    group->standby_luid = luid;
+    metric = kStandbyMetric;
+  }
+  DWORD error = SetMetric(luid, metric);
+  if (error != ERROR_SUCCESS) {
+    logger_->error("Failed to set the failover metric of tunnel {}: Windows error {}", tunnel_name, error);
+  }
+  return true;
+}
+
+FailoverGroups::Group *FailoverGroups::FindLocked(const std::string &tunnel_name) {
+  auto primary = groups_.find(tunnel_name);
+  if (primary != groups_.end()) {
+    return &primary->second;
+  }
+  for (auto &entry : groups_) {
+    if (entry.second.standby == tunnel_name) {
+      return &entry.second;
+    }
+  }
+  return nullptr;
+}
+
+void FailoverGroups::UpdateLocked(Group &group) {
+  bool primary_stale = stale_peers_.count(group.primary) != 0;
+  if (group.failed_over) {
+    if (primary_stale) {
+      CancelFailbackLocked(group);
+    } else if (group.failback_timer == 0) {
+      ScheduleFailbackLocked(group);
+    }
+    return;
+  }
+  // Nothing is gained by moving to a standby that is stale as well
+  if (!primary_stale || stale_peers_.count(group.standby) != 0) {
+    return;
+  }
+  // Only the primary's metric changes, so traffic moves with this one call per family
+  DWORD error = SetMetric(group.primary_luid, kDemotedMetric);
+  if (error != ERROR_SUCCESS) {
+    logger_->error("Failed to fail over from tunnel {}: Windows error {}", group.primary, error);
+    return;
+  }
+  group.failed_over = true;
+  logger_->warn("Tunnel {} is stale, failed over to tunnel {}", group.primary, group.standby);
+}
+
+void FailoverGroups::ScheduleFailbackLocked(Group &group) {
+  uint64_t serial = ++failback_serial_;
+  group.failback_serial = serial;
+  group.failback_timer = reactor_->Schedule(kFailbackHold, [owner = owner_, primary = group.primary, serial]() {
+    std::lock_guard<std::mutex> lock(owner->mutex);
+    if (owner->groups) {
+      owner->groups->FailBack(primary, serial);
+    }
+  });
+  if (group.failback_timer == 0) {
+    logger_->warn("Failed to time the failback to tunnel {}, it waits for the next liveness change", group.primary);
+    return;
+  }
+  logger_->info("Tunnel {} recovered, failing back from tunnel {} unless it goes stale within {} s", group.primary,
+                group.standby, kFailbackHold.count());
+}
+
+void FailoverGroups::CancelFailbackLocked(Group &group) {
+  if (group.failback_timer != 0) {
+    // One already running finds another serial or no timer
+    reactor_->Cancel(group.failback_timer);
+    group.failback_timer = 0;
+  }
+}
+
+void FailoverGroups::FailBack(const std::string &primary, uint64_t serial) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = groups_.find(primary);
+  if (found == groups_.end()) {
+    return;
+  }
+  Group &group = found->second;
+  // Cancelled too late
+  if (group.failback_timer == 0 || group.failback_serial != serial) {
+    return;
+  }
+  group.failback_timer = 0;
+  DWORD error = SetMetric(group.primary_luid, kPrimaryMetric);
+  if (error != ERROR_SUCCESS) {
+    logger_->error("Failed to fail back to tunnel {}: Windows error {}", primary, error);
+    ScheduleFailbackLocked(group);
+    return;
+  }
+  group.failed_over = false;
+  logger_->info("Tunnel {} stayed live, failed back from tunnel {}", primary, group.standby);
+}
+
+DWORD FailoverGroups::SetMetric(const NET_LUID &luid, ULONG metric) {
+  for (ADDRESS_FAMILY family : {static_cast<ADDRESS_FAMILY>(AF_INET), static_cast<ADDRESS_FAMILY>(AF_INET6)}) {
+    MIB_IPINTERFACE_ROW row;
+    InitializeIpInterfaceEntry(&row);
+    row.InterfaceLuid = luid;
+    row.Family = family;
+    DWORD result = MeteredInvoke(MeteredCall::kGetIpInterfaceEntry, GetIpInterfaceEntry, &row);
+    if (result == ERROR_NOT_FOUND) {
+      // The family is not bound to the interface, and has no routes to compete with
+      continue;
+    }
+    if (result != NO_ERROR) {
+      return result;
+    }
+    if (row.Metric == metric && !row.UseAutomaticMetric) {
+      continue;
+    }
+    row.Metric = metric;
+    row.UseAutomaticMetric = FALSE;
+    row.SitePrefixLength = 0;
+    result = RetryTransient(MeteredCall::kSetIpInterfaceEntry, [&row]() {
+      return MeteredInvoke(MeteredCall::kSetIpInterfaceEntry, SetIpInterfaceEntry, &row);
+    });
+    if (result != NO_ERROR) {
+      return result;
+    }
+  }
+  return ERROR_SUCCESS;
+}
+
+} // namespace wireguard_dart
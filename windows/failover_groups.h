@@ -0,0 +1,103 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "io_reactor.h"
+#include "peer_statistics.h"
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * Pairs of a primary and a standby tunnel that are both up with the same routes, told apart only by their interface
+ * metrics, so Windows sends everything through the one with the lower. While a peer of the primary is stale, see
+ * StatisticsSampler::SetStaleThreshold, and none of the standby is, the primary's metric is raised above the
+ * standby's with one SetIpInterfaceEntry per family and traffic moves over at once; it is lowered again once every
+ * peer of the primary stayed live for kFailbackHold. Liveness comes from handshakes, so the tunnel not carrying the
+ * traffic has to be probed to keep handshaking, see WireguardAdapter::SetProbing. Safe from any thread.
+ */
+class FailoverGroups {
+public:
+  static constexpr ULONG kPrimaryMetric = 5;
+  static constexpr ULONG kStandbyMetric = 10;
+  static constexpr ULONG kDemotedMetric = 15;
+  // So that a primary recovering only for a moment does not have traffic move back and forth
+  static constexpr std::chrono::seconds kFailbackHold{30};
+
+  // Failbacks are timed on the reactor
+  explicit FailoverGroups(IoReactor *reactor);
+  ~FailoverGroups();
+
+  FailoverGroups(const FailoverGroups &) = delete;
+  FailoverGroups &operator=(const FailoverGroups &) = delete;
+
+  /**
+   * Group the primary with the standby, replacing a group either was in, and set their metrics. A tunnel set up
+   * again keeps its metric only when Reapply is called for it. Returns the Windows error of setting a metric.
+   */
+  DWORD Set(const std::string &primary, const NET_LUID &primary_luid, const std::string &standby,
+            const NET_LUID &standby_luid);
+  // Drop the group of a primary or standby, leaving the metrics as they are; false without one
+  bool Remove(const std::string &tunnel_name);
+  // The primary and standby of the tunnel's group, none without one
+  std::vector<std::string> Members(const std::string &tunnel_name);
+
+  // From the staleness detector; a removed peer is no longer stale
+  void OnLiveness(const std::string &tunnel_name, const PeerKey &public_key, bool stale);
+  /**
+   * Set the tunnel's metric again after a setup, possibly of a new adapter, replaced its interface settings
+   * @return false if the tunnel is in no group
+   */
+  bool Reapply(const std::string &tunnel_name, const NET_LUID &luid);
+
+private:
+  struct Group {
+    std::string primary;
+    NET_LUID primary_luid = {};
+    std::string standby;
+    NET_LUID standby_luid = {};
+    bool failed_over = false;
+    // While failed over and the primary is live; the serial tells a timer that ran late from the latest one
+    IoReactor::TimerId failback_timer = 0;
+    uint64_t failback_serial = 0;
+  };
+  // Tells a failback timer running during the destruction that the groups are gone
+  struct Owner {
+    std::mutex mutex;
+    FailoverGroups *groups;
+  };
+
+  // The group the tunnel is the primary or standby of, nullptr for none
+  Group *FindLocked(const std::string &tunnel_name);
+  // Fail over, or time the failback, as the liveness of the group's tunnels asks for
+  void UpdateLocked(Group &group);
+  void ScheduleFailbackLocked(Group &group);
+  void CancelFailbackLocked(Group &group);
+  // Once the failback timer of the primary's group ran
+  void FailBack(const std::string &primary, uint64_t serial);
+  DWORD SetMetric(const NET_LUID &luid, ULONG metric);
+
+  IoReactor *reactor_;
+  std::shared_ptr<Owner> owner_;
+  std::mutex mutex_;
+  // By primary
+  std::map<std::string, Group> groups_;
+  // The stale peers of every tunnel, whether grouped or not, so a group formed later starts from their liveness
+  std::map<std::string, std::unordered_set<PeerKey, PeerKeyHash>> stale_peers_;
+  uint64_t failback_serial_ = 0;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,159 @@
+#include "flight_recorder.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace wireguard_dart {
+
+namespace {
+
+const char *const kEventNames[] = {"enter", "exit", "phase", "call", "status", "error", "hang"};
+
+const wchar_t kDumpPrefix[] = L"\\wireguard_dart.flight.";
+
+} // namespace
+
+FlightRecorder &FlightRecorder::Instance() {
+  static FlightRecorder recorder;
+  return recorder;
+}
+
+FlightRecorder::~FlightRecorder() {
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+void FlightRecorder::SetDumpDirectory(const std::wstring &directory) {
+  // The dumps of earlier runs, newest first by when they were written
+  std::vector<std::pair<uint64_t, std::wstring>> dumps;
+  WIN32_FIND_DATAW found;
+  HANDLE find = directory.empty() ? INVALID_HANDLE_VALUE
+                                  : FindFirstFileW((directory + kDumpPrefix + L"*.txt").c_str(), &found);
+  if (find != INVALID_HANDLE_VALUE) {
+    do {
+      uint64_t written =
+          (static_cast<uint64_t>(found.ftLastWriteTime.dwHighDateTime) << 32) | found.ftLastWriteTime.dwLowDateTime;
+      dumps.emplace_back(written, found.cFileName);
+    } while (FindNextFileW(find, &found));
+    FindClose(find);
+  }
+  std::sort(dumps.begin(), dumps.end(), std::greater<>());
+  for (size_t i = kKeptDumps; i < dumps.size(); i++) {
+    DeleteFileW((directory + L"\\" + dumps[i].second).c_str());
+  }
+
+  std::lock_guard<std::mutex> lock(dump_mutex_);
+  dump_directory_ = directory;
+}
+
+std::wstring FlightRecorder::DumpDirectory() {
+  std::lock_guard<std::mutex> lock(dump_mutex_);
+  return dump_directory_;
+}
+
+bool FlightRecorder::Dump(const std::string &reason) {
+  Snapshot snapshot;
+  {
+    std::lock_guard<std::mutex> lock(dump_mutex_);
+    if (!TakeSnapshotLocked(reason, &snapshot)) {
+      return false;
+    }
+  }
+  return Write(snapshot);
+}
+
+bool FlightRecorder::DumpInBackground(const std::string &reason) {
+  auto snapshot = std::make_unique<Snapshot>();
+  std::lock_guard<std::mutex> lock(dump_mutex_);
+  if (!TakeSnapshotLocked(reason, snapshot.get())) {
+    return false;
+  }
+  // Long done, dumps being kMinDumpInterval apart
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+  try {
+    writer_ = std::thread([snapshot = std::move(snapshot)] { Write(*snapshot); });
+  } catch (const std::system_error &) {
+    return false;
+  }
+  return true;
+}
+
+bool FlightRecorder::TakeSnapshotLocked(const std::string &reason, Snapshot *snapshot) {
+  auto now = std::chrono::steady_clock::now();
+  if (dump_directory_.empty() || (dumped_ && now - last_dump_ < kMinDumpInterval)) {
+    return false;
+  }
+  dumped_ = true;
+  last_dump_ = now;
+
+  // Copied out first, so the ring moves on as little as possible while it is read
+  uint64_t end = next_.load(std::memory_order_acquire);
+  uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+  snapshot->records.reserve(static_cast<size_t>(end - begin));
+  for (uint64_t index = begin; index < end; index++) {
+    const Slot &slot = slots_[index & (kCapacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+      continue;
+    }
+    Snapshot::Record copy = {slot.qpc.load(std::memory_order_relaxed),    slot.name.load(std::memory_order_relaxed),
+                             slot.value.load(std::memory_order_relaxed),  slot.thread.load(std::memory_order_relaxed),
+                             slot.event.load(std::memory_order_relaxed),  slot.detail.load(std::memory_order_relaxed)};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == index + 1) {
+      snapshot->records.push_back(copy);
+    }
+  }
+
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  snapshot->qpc = counter.QuadPart;
+  snapshot->unix_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  snapshot->reason = reason;
+  // By process, so a new run does not overwrite the dumps of the one before
+  snapshot->path = dump_directory_ + kDumpPrefix + std::to_wstring(GetCurrentProcessId()) + L"." +
+                   std::to_wstring(dumps_++ % kDumpFiles) + L".txt";
+  return true;
+}
+
+bool FlightRecorder::Write(const Snapshot &snapshot) {
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+
+  // Times are microseconds before the dump, which the log has the time of
+  std::string text = "# " + snapshot.reason + ", " + std::to_string(snapshot.unix_ms) + " ms since 1970, " +
+                     std::to_string(snapshot.records.size()) + " records\n# us thread event name value detail\n";
+  char line[160];
+  for (const Snapshot::Record &record : snapshot.records) {
+    int64_t before_us = (snapshot.qpc - record.qpc) * 1000000 / frequency.QuadPart;
+    const char *event = record.event < std::size(kEventNames) ? kEventNames[record.event] : "?";
+    int length = snprintf(line, sizeof(line), "-%" PRId64 " %" PRIu32 " %s %s %" PRId64 " %" PRIu32 "\n", before_us,
+                          record.thread, event, record.name ? record.name : "-", record.value, record.detail);
+    if (length > 0) {
+      text.append(line, (std::min)(static_cast<size_t>(length), sizeof(line) - 1));
+    }
+  }
+
+  HANDLE file = CreateFileW(snapshot.path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  DWORD written = 0;
+  BOOL success = WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, nullptr);
+  CloseHandle(file);
+  return success && written == text.size();
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <windows.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace wireguard_dart {
+
+// What a flight record stands for; value and detail mean something different for each
+enum class FlightEvent : uint32_t {
+  // A TraceRegion began, value is its items or -1
+  kRegionEnter,
+  kRegionExit,
+  // A PhaseTimer phase ended, value is its duration in microseconds
+  kPhase,
+  // A metered driver or IP Helper call returned, value is its result and detail the thread's last error
+  kCall,
+  // The status observer read an interface, value is its LUID and detail the ConnectionStatus
+  kInterfaceStatus,
+  // A method was answered with an error, detail is its ErrorClass
+  kMethodError,
+  // A watched call ran past its deadline, value is how long it has run in milliseconds and detail its thread
+  kHang,
+};
+
+/**
+ * The last kCapacity records of what the process did, kept at all times so that a failure in the field can be
+ * read back at a finer grain than the info-level log: regions and phases, driver call results, observer events and
+ * method errors, each with its performance counter and thread. Recording is a few relaxed atomic stores into a
+ * fixed ring, with no lock or allocation, safe from any thread. Names are string literals, only read on a dump.
+ *
+ * Dump writes the ring as text to the next of kDumpFiles files of the process in the directory of the log file, at
+ * most once per kMinDumpInterval, so errors in a loop cost one dump; of the dumps of earlier runs the newest
+ * kKeptDumps stay. The ring is copied on the calling thread, and DumpInBackground leaves formatting and writing it
+ * to a thread of its own. A record being written while the ring is read is left out.
+ */
+class FlightRecorder {
+public:
+  static constexpr size_t kCapacity = 4096;
+  static constexpr size_t kDumpFiles = 4;
+  static constexpr size_t kKeptDumps = 16;
+  static constexpr std::chrono::seconds kMinDumpInterval{5};
+
+  static FlightRecorder &Instance();
+
+  ~FlightRecorder();
+
+  void Record(FlightEvent event, const char *name, int64_t value, uint32_t detail = 0) {
+    uint64_t index = next_.fetch_add(1, std::memory_order_relaxed);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    Slot &slot = slots_[index & (kCapacity - 1)];
+    // Zero while the fields are written, so a reader skips the slot
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.qpc.store(counter.QuadPart, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.thread.store(GetCurrentThreadId(), std::memory_order_relaxed);
+    slot.event.store(static_cast<uint32_t>(event), std::memory_order_relaxed);
+    slot.detail.store(detail, std::memory_order_relaxed);
+    slot.sequence.store(index + 1, std::memory_order_release);
+  }
+
+  // Where dumps go, removing all but the newest kKeptDumps found there; nothing is dumped before
+  void SetDumpDirectory(const std::wstring &directory);
+  // Empty until set, for other dumps to go next to these
+  std::wstring DumpDirectory();
+
+  /**
+   * Write the records, oldest first, after a line with the reason
+   * @return false if nothing was written: no directory, too soon after the last dump, or the file failed
+   */
+  bool Dump(const std::string &reason);
+  // Dump, for threads that must not wait for the file, such as the platform thread; false if it was skipped
+  bool DumpInBackground(const std::string &reason);
+
+  uint64_t Recorded() const { return next_.load(std::memory_order_relaxed); }
+
+private:
+  static_assert((kCapacity & (kCapacity - 1)) == 0, "The ring is indexed by masking");
+
+  struct Slot {
+    // The record's index plus one once it is complete
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<int64_t> qpc{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<int64_t> value{0};
+    std::atomic<uint32_t> thread{0};
+    std::atomic<uint32_t> event{0};
+    std::atomic<uint32_t> detail{0};
+  };
+
+  // The ring as read for a dump, with where and when it goes
+  struct Snapshot {
+    struct Record {
+      int64_t qpc;
+      const char *name;
+      int64_t value;
+      uint32_t thread;
+      uint32_t event;
+      uint32_t detail;
+    };
+    std::string reason;
+    std::wstring path;
+    std::vector<Record> records;
+    int64_t qpc = 0;
+    int64_t unix_ms = 0;
+  };
+
+  // Copy the ring out, false when it is not to be dumped now
+  bool TakeSnapshotLocked(const std::string &reason, Snapshot *snapshot);
+  static bool Write(const Snapshot &snapshot);
+
+  std::atomic<uint64_t> next_{0};
+  std::array<Slot, kCapacity> slots_;
+
+  std::mutex dump_mutex_;
+  std::wstring dump_directory_;
+  std::chrono::steady_clock::time_point last_dump_;
+  bool dumped_ = false;
+  size_t dumps_ = 0;
+  // The last DumpInBackground, joined before the next one
+  std::thread writer_;
+};
+
+// The result of a metered call as a flight record value: pointers and handles as 0 or 1
+template <typename Result>
+int64_t FlightValue(const Result &result) {
+  if constexpr (std::is_pointer_v<Result>) {
+    return result != nullptr;
+  } else if constexpr (std::is_integral_v<Result> || std::is_enum_v<Result>) {
+    return static_cast<int64_t>(result);
+  } else {
+    return 0;
+  }
+}
+
+} // namespace wireguard_dart
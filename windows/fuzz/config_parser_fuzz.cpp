@@ -0,0 +1,160 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "wireguard_config_parser.h"
+
+// libFuzzer target for WireguardConfigParser, which takes configurations from apps and files no one checked. Each
+// input is parsed whole and streamed in chunks, which have to agree, and its wire format is built. Its cost is held
+// to linear bounds: allocations and time per input byte, and the same input repeated kRepeat times may cost at most
+// kRepeat times as much, with some slack. An input over a bound aborts, so libFuzzer keeps it as a crash.
+
+static std::atomic<uint64_t> g_allocations{0};
+static std::atomic<uint64_t> g_allocated_bytes{0};
+
+void *operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+namespace wireguard_dart {
+namespace {
+
+constexpr size_t kRepeat = 8;
+// An ExcludedIPs host prefix takes up to 128 prefixes out of the allowed ones, each a WIREGUARD_ALLOWED_IP, from a
+// few bytes of text; buffers that double take up to twice what they hold
+constexpr uint64_t kBytesPerInputByte = 2048;
+constexpr uint64_t kAllocationsPerInputByte = 4;
+constexpr uint64_t kFixedBytes = 1 << 20;
+constexpr uint64_t kFixedAllocations = 256;
+// Generous, as time is noisy under the sanitizers and on a busy machine
+constexpr int64_t kNanosecondsPerInputByte = 20000;
+constexpr int64_t kFixedNanoseconds = 50000000;
+// How much more than kRepeat times the cost the repeated input may take
+constexpr uint64_t kRepeatSlack = 4;
+
+struct Cost {
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+  int64_t nanoseconds = 0;
+};
+
+struct Outcome {
+  bool parsed = false;
+  size_t error_line = 0;
+  std::vector<uint8_t> wire;
+};
+
+[[noreturn]] void Fail(const char *what) {
+  fprintf(stderr, "%s\n", what);
+  std::abort();
+}
+
+void CheckBound(const char *what, uint64_t value, uint64_t bound, size_t size) {
+  if (value > bound) {
+    fprintf(stderr, "%s: %llu over the bound of %llu for %zu input bytes\n", what,
+            static_cast<unsigned long long>(value), static_cast<unsigned long long>(bound), size);
+    std::abort();
+  }
+}
+
+Outcome Collect(const WireguardConfigParser &parser, bool parsed) {
+  Outcome outcome;
+  outcome.parsed = parsed;
+  outcome.error_line = parser.GetErrorLine();
+  if (!parsed) {
+    return outcome;
+  }
+  DWORD size = parser.CalculateConfigurationSize();
+  outcome.wire.resize(size);
+  if (parser.BuildConfiguration(outcome.wire.data(), size) != size) {
+    Fail("BuildConfiguration wrote less than CalculateConfigurationSize");
+  }
+  if (size > 0 && parser.BuildConfiguration(outcome.wire.data(), size - 1) != 0) {
+    Fail("BuildConfiguration wrote into a buffer too small");
+  }
+  parser.GetRoutes();
+  return outcome;
+}
+
+// Parse and build the text, and what that cost
+Outcome ParseWhole(std::string_view text, Cost *cost) {
+  uint64_t allocations = g_allocations.load(std::memory_order_relaxed);
+  uint64_t bytes = g_allocated_bytes.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  Outcome outcome;
+  {
+    WireguardConfigParser parser;
+    outcome = Collect(parser, parser.Parse(text));
+  }
+  cost->nanoseconds =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  cost->allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+  cost->bytes = g_allocated_bytes.load(std::memory_order_relaxed) - bytes;
+  return outcome;
+}
+
+Outcome ParseStreamed(std::string_view text, size_t chunk) {
+  WireguardConfigParser parser;
+  parser.BeginParse();
+  bool parsed = true;
+  for (size_t offset = 0; offset < text.size() && parsed; offset += chunk) {
+    parsed = parser.Feed(text.substr(offset, chunk));
+  }
+  parsed = parser.Finish() && parsed;
+  return Collect(parser, parsed);
+}
+
+} // namespace
+} // namespace wireguard_dart
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  using namespace wireguard_dart;
+  std::string_view text(reinterpret_cast<const char *>(data), size);
+
+  Cost cost;
+  Outcome whole = ParseWhole(text, &cost);
+  CheckBound("Bytes allocated", cost.bytes, kBytesPerInputByte * size + kFixedBytes, size);
+  CheckBound("Allocations", cost.allocations, kAllocationsPerInputByte * size + kFixedAllocations, size);
+  CheckBound("Nanoseconds", static_cast<uint64_t>(cost.nanoseconds),
+             static_cast<uint64_t>(kNanosecondsPerInputByte) * size + kFixedNanoseconds, size);
+
+  // Chunks split lines, keys and values anywhere; the first byte picks their size
+  size_t chunk = size > 0 ? 1 + data[0] % 64 : 1;
+  Outcome streamed = ParseStreamed(text, chunk);
+  if (streamed.parsed != whole.parsed || streamed.error_line != whole.error_line || streamed.wire != whole.wire) {
+    Fail("Parsing in chunks came to a different outcome than parsing whole");
+  }
+
+  // Each line of the repeated input costs what it did once, so anything superlinear in the number of lines,
+  // peers or prefixes shows; kRepeat copies of a large input also take the parallel path
+  std::string repeated;
+  repeated.reserve((size + 1) * kRepeat);
+  for (size_t i = 0; i < kRepeat; i++) {
+    repeated.append(text).push_back('\n');
+  }
+  Cost repeated_cost;
+  ParseWhole(repeated, &repeated_cost);
+  const uint64_t factor = kRepeat * kRepeatSlack;
+  CheckBound("Bytes allocated when repeated", repeated_cost.bytes, factor * cost.bytes + kFixedBytes,
+             repeated.size());
+  CheckBound("Allocations when repeated", repeated_cost.allocations, factor * cost.allocations + kFixedAllocations,
+             repeated.size());
+  CheckBound("Nanoseconds when repeated", static_cast<uint64_t>(repeated_cost.nanoseconds),
+             factor * static_cast<uint64_t>(cost.nanoseconds) + kFixedNanoseconds, repeated.size());
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include "handshake_waiter.h"
+
+#include <system_error>
+
+#include "cpu_accounting.h"
+#include "perf_stats.h"
+
+namespace wireguard_dart {
+
+HandshakeWaiter::~HandshakeWaiter() { Stop(); }
+
+void HandshakeWaiter::Start(Poll poll, Done done, Finished finished) {
+  Stop();
+
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  uint64_t since = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  try {
+    worker_ = std::thread(&HandshakeWaiter::Run, this, std::move(poll), std::move(done), finished, since,
+                          PerfCounterMicroseconds());
+  } catch (const std::system_error &) {
+    // Only the measurement is lost
+    if (finished) {
+      finished();
+    }
+  }
+}
+
+void HandshakeWaiter::Stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker = std::move(worker_);
+  }
+  wake_.notify_all();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void HandshakeWaiter::Run(Poll poll, Done done, Finished finished, uint64_t since, int64_t start_us) {
+  ScopedThreadCpu cpu(CpuComponent::kOperations);
+  Wait(poll, done, since, start_us);
+  if (finished) {
+    finished();
+  }
+}
+
+void HandshakeWaiter::Wait(const Poll &poll, const Done &done, uint64_t since, int64_t start_us) {
+  auto deadline = std::chrono::steady_clock::now() + kTimeout;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_ && std::chrono::steady_clock::now() < deadline) {
+    lock.unlock();
+    bool completed = poll(since);
+    lock.lock();
+    if (completed) {
+      if (!stopping_) {
+        lock.unlock();
+        done(PerfCounterMicroseconds() - start_us);
+      }
+      return;
+    }
+    wake_.wait_for(lock, kPollInterval, [this] { return stopping_; });
+  }
+}
+
+} // namespace wireguard_dart
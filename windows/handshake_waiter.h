@@ -0,0 +1,51 @@
+#pragma once
+
+#include <windows.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace wireguard_dart {
+
+/**
+ * Times how long a tunnel that was just brought up takes to complete its first handshake. The driver has no
+ * handshake notification, so the poll callback is asked on a background thread every kPollInterval until it
+ * reports a handshake or kTimeout passes.
+ */
+class HandshakeWaiter {
+public:
+  // Whether a handshake completed after the given FILETIME, in 100ns intervals since 1601
+  using Poll = std::function<bool(uint64_t since)>;
+  // Called from the waiting thread with the microseconds from Start to the handshake
+  using Done = std::function<void(int64_t microseconds)>;
+  // Called last from the waiting thread however the wait ended, also when it timed out or was stopped
+  using Finished = std::function<void()>;
+
+  static constexpr std::chrono::milliseconds kPollInterval{20};
+  static constexpr std::chrono::seconds kTimeout{30};
+
+  HandshakeWaiter() = default;
+  ~HandshakeWaiter();
+
+  HandshakeWaiter(const HandshakeWaiter &) = delete;
+  HandshakeWaiter &operator=(const HandshakeWaiter &) = delete;
+
+  // Start timing from now, replacing a wait still running
+  void Start(Poll poll, Done done, Finished finished = nullptr);
+  void Stop();
+
+private:
+  void Run(Poll poll, Done done, Finished finished, uint64_t since, int64_t start_us);
+  void Wait(const Poll &poll, const Done &done, uint64_t since, int64_t start_us);
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+  std::thread worker_;
+};
+
+} // namespace wireguard_dart
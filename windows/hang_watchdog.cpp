@@ -0,0 +1,219 @@
+#include "hang_watchdog.h"
+
+#include <dbghelp.h>
+
+#include <system_error>
+#include <vector>
+
+#include "cpu_accounting.h"
+#include "flight_recorder.h"
+#include "perf_stats.h"
+#include "spdlog/spdlog.h"
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+constexpr size_t HangWatchdog::kSlots;
+constexpr std::chrono::milliseconds HangWatchdog::kDefaultDeadline;
+constexpr std::chrono::milliseconds HangWatchdog::kCheckInterval;
+constexpr std::chrono::milliseconds HangWatchdog::kCheckTolerance;
+constexpr std::chrono::minutes HangWatchdog::kMinMinidumpInterval;
+constexpr size_t HangWatchdog::kMinidumpFiles;
+constexpr size_t HangWatchdog::kUnwatched;
+
+namespace {
+
+using MiniDumpWriteDumpFn = decltype(&MiniDumpWriteDump);
+
+// Loaded on the first minidump, so a process that never hangs does not map dbghelp.dll
+MiniDumpWriteDumpFn LoadMiniDumpWriteDump() {
+  static const MiniDumpWriteDumpFn function = [] {
+    HMODULE dbghelp = LoadLibraryExW(L"dbghelp.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+    return dbghelp ? reinterpret_cast<MiniDumpWriteDumpFn>(GetProcAddress(dbghelp, "MiniDumpWriteDump")) : nullptr;
+  }();
+  return function;
+}
+
+} // namespace
+
+HangWatchdog &HangWatchdog::Instance() {
+  static HangWatchdog watchdog;
+  return watchdog;
+}
+
+HangWatchdog::~HangWatchdog() {
+  // Only destroyed at process exit, when the thread is gone and must not be joined under the loader lock
+  if (worker_.joinable()) {
+    worker_.detach();
+  }
+}
+
+void HangWatchdog::Start(std::chrono::milliseconds deadline, bool write_minidump) {
+  Stop();
+  if (deadline.count() <= 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  write_minidump_ = write_minidump;
+  try {
+    worker_ = std::thread(&HangWatchdog::Run, this);
+  } catch (const std::system_error &) {
+    logger_->error("Failed to start the hang watchdog, native calls are not watched");
+    return;
+  }
+  deadline_ns_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(deadline).count(),
+                     std::memory_order_relaxed);
+}
+
+void HangWatchdog::Stop() {
+  // Calls beginning from now on are not watched; those in progress still give their slots back
+  deadline_ns_.store(0, std::memory_order_relaxed);
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker = std::move(worker_);
+  }
+  wake_.Notify();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+size_t HangWatchdog::Claim(const char *name, int64_t deadline_ns) {
+  // Starting at a slot of the thread's own, so that threads rarely contend for one
+  size_t first = GetCurrentThreadId() % kSlots;
+  for (size_t i = 0; i < kSlots; i++) {
+    size_t index = (first + i) % kSlots;
+    Slot &slot = slots_[index];
+    bool expected = false;
+    if (slot.taken.load(std::memory_order_relaxed) ||
+        !slot.taken.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      continue;
+    }
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start_ns.store(PerfCounterNanoseconds(), std::memory_order_relaxed);
+    slot.deadline_ns.store(deadline_ns, std::memory_order_relaxed);
+    slot.thread.store(GetCurrentThreadId(), std::memory_order_relaxed);
+    slot.sequence.store(next_sequence_.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_release);
+    // The watchdog only looks at the slots while a call is in progress
+    if (in_flight_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+      { std::lock_guard<std::mutex> lock(mutex_); }
+      wake_.Notify();
+    }
+    return index;
+  }
+  return kUnwatched;
+}
+
+void HangWatchdog::Release(size_t index) {
+  Slot &slot = slots_[index];
+  int64_t elapsed_ns = PerfCounterNanoseconds() - slot.start_ns.load(std::memory_order_relaxed);
+  if (elapsed_ns >= slot.deadline_ns.load(std::memory_order_relaxed)) {
+    logger_->warn("{} returned after {} ms, past the hang deadline", slot.name.load(std::memory_order_relaxed),
+                  elapsed_ns / 1000000);
+  }
+  slot.sequence.store(0, std::memory_order_release);
+  in_flight_.fetch_sub(1, std::memory_order_acq_rel);
+  slot.taken.store(false, std::memory_order_release);
+}
+
+void HangWatchdog::Run() {
+  ThrottleCurrentThread();
+  ScopedThreadCpu cpu(BackgroundThread::kHangWatchdog);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    if (in_flight_.load(std::memory_order_acquire) == 0) {
+      wake_.WaitUntil(lock, std::chrono::steady_clock::time_point::max(), kCheckTolerance,
+                      [this] { return stopping_.load() || in_flight_.load(std::memory_order_acquire) > 0; });
+      continue;
+    }
+    if (wake_.WaitFor(lock, kCheckInterval, kCheckTolerance, [this] { return stopping_.load(); })) {
+      break;
+    }
+    lock.unlock();
+    Check();
+    lock.lock();
+  }
+}
+
+void HangWatchdog::Check() {
+  struct Hang {
+    const char *name;
+    int64_t elapsed_ms;
+    uint32_t thread;
+  };
+  std::vector<Hang> hangs;
+  int64_t now_ns = PerfCounterNanoseconds();
+  for (size_t i = 0; i < kSlots; i++) {
+    const Slot &slot = slots_[i];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence == 0 || reported_[i] == sequence) {
+      continue;
+    }
+    Hang hang = {slot.name.load(std::memory_order_relaxed), 0, slot.thread.load(std::memory_order_relaxed)};
+    int64_t elapsed_ns = now_ns - slot.start_ns.load(std::memory_order_relaxed);
+    int64_t deadline_ns = slot.deadline_ns.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Another call took the slot while it was read
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence || elapsed_ns < deadline_ns) {
+      continue;
+    }
+    reported_[i] = sequence;
+    hang.elapsed_ms = elapsed_ns / 1000000;
+    hangs.push_back(hang);
+  }
+  if (hangs.empty()) {
+    return;
+  }
+
+  for (const Hang &hang : hangs) {
+    logger_->error("{} on thread {} has not returned after {} ms", hang.name ? hang.name : "?", hang.thread,
+                   hang.elapsed_ms);
+    FlightRecorder::Instance().Record(FlightEvent::kHang, hang.name, hang.elapsed_ms, hang.thread);
+  }
+  std::string reason = std::string(hangs[0].name ? hangs[0].name : "?") + " hung for " +
+                       std::to_string(hangs[0].elapsed_ms) + " ms";
+  FlightRecorder::Instance().Dump(reason);
+  if (write_minidump_.load(std::memory_order_relaxed)) {
+    WriteMinidump(reason);
+  }
+}
+
+bool HangWatchdog::WriteMinidump(const std::string &reason) {
+  auto now = std::chrono::steady_clock::now();
+  if (minidumped_ && now - last_minidump_ < kMinMinidumpInterval) {
+    return false;
+  }
+  std::wstring directory = FlightRecorder::Instance().DumpDirectory();
+  MiniDumpWriteDumpFn write_dump = LoadMiniDumpWriteDump();
+  if (directory.empty() || !write_dump) {
+    return false;
+  }
+  minidumped_ = true;
+  last_minidump_ = now;
+
+  std::wstring path =
+      directory + L"\\wireguard_dart.hang." + std::to_wstring(minidumps_++ % kMinidumpFiles) + L".dmp";
+  HANDLE file =
+      CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    logger_->warn("Failed to create the minidump '{}': Windows error {}", WideToUtf8(path), GetLastError());
+    return false;
+  }
+  // The stacks of all threads and what they run, without the heap, which is large and holds the keys
+  auto type = static_cast<MINIDUMP_TYPE>(MiniDumpNormal | MiniDumpWithThreadInfo | MiniDumpWithUnloadedModules);
+  BOOL written = write_dump(GetCurrentProcess(), GetCurrentProcessId(), file, type, nullptr, nullptr, nullptr);
+  DWORD error = GetLastError();
+  CloseHandle(file);
+  if (!written) {
+    logger_->warn("Failed to write the minidump '{}': Windows error {}", WideToUtf8(path), error);
+    return false;
+  }
+  logger_->info("Minidump of {} written to '{}'", reason, WideToUtf8(path));
+  return true;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <windows.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "background_threads.h"
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * Keeps track of the driver and IP Helper calls in progress, so that one that never returns, as
+ * CancelMibChangeNotify2, WireGuardCreateAdapter and SetIpInterfaceEntry have been seen to on broken machines, is
+ * named in the log rather than only holding up whatever waits for it. Every metered call takes one of kSlots
+ * slots for as long as it runs, with a few relaxed atomic stores and no lock; calls made while all slots are taken
+ * are not watched.
+ *
+ * While Start is in effect and any call is in progress, a thread of its own looks at the slots every
+ * kCheckInterval. A call still running past the deadline is logged once as an error with its thread and how long
+ * it has run, recorded in the flight recorder and dumped with it, and, if asked for, a minidump of the process is
+ * written next to the flight recorder's dumps, with the stacks of all threads to tell where the call is stuck. With
+ * nothing in progress the thread waits for the next call and does not wake up.
+ */
+class HangWatchdog {
+public:
+  static constexpr size_t kSlots = 64;
+  static constexpr std::chrono::milliseconds kDefaultDeadline{10000};
+  // The longest deadline Start takes; it is kept in nanoseconds, and a day is far past any call worth watching
+  static constexpr std::chrono::milliseconds kMaxDeadline{24 * 60 * 60 * 1000};
+  static constexpr std::chrono::milliseconds kCheckInterval{1000};
+  // A check may come this much later, where Windows coalesces the wakeup with other timers
+  static constexpr std::chrono::milliseconds kCheckTolerance{250};
+  // Minidumps are large and one per hang is enough to tell where it is, so they are rarer than flight dumps
+  static constexpr std::chrono::minutes kMinMinidumpInterval{10};
+  static constexpr size_t kMinidumpFiles = 2;
+  // What Begin returns for a call that is not watched
+  static constexpr size_t kUnwatched = kSlots;
+
+  static HangWatchdog &Instance();
+
+  /**
+   * Watch the calls from now on, each against the deadline it had when it began, replacing an earlier run. A zero
+   * deadline only stops watching.
+   */
+  void Start(std::chrono::milliseconds deadline, bool write_minidump);
+  void Stop();
+
+  // A call named by a string literal begins on this thread; the slot it took is for End
+  size_t Begin(const char *name) {
+    int64_t deadline_ns = deadline_ns_.load(std::memory_order_relaxed);
+    if (deadline_ns == 0) {
+      return kUnwatched;
+    }
+    return Claim(name, deadline_ns);
+  }
+  void End(size_t slot) {
+    if (slot != kUnwatched) {
+      Release(slot);
+    }
+  }
+
+  // The calls in progress that are watched
+  size_t InFlight() const { return in_flight_.load(std::memory_order_relaxed); }
+
+private:
+  struct Slot {
+    std::atomic<bool> taken{false};
+    // Nonzero once the fields below are those of the call in the slot, unique to it
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<int64_t> start_ns{0};
+    std::atomic<int64_t> deadline_ns{0};
+    std::atomic<uint32_t> thread{0};
+  };
+
+  HangWatchdog() = default;
+  ~HangWatchdog();
+
+  size_t Claim(const char *name, int64_t deadline_ns);
+  void Release(size_t slot);
+  void Run();
+  // Log, record and dump the calls past their deadlines that were not reported yet
+  void Check();
+  bool WriteMinidump(const std::string &reason);
+
+  std::array<Slot, kSlots> slots_;
+  std::atomic<uint64_t> next_sequence_{0};
+  std::atomic<size_t> in_flight_{0};
+  // Zero while not watching
+  std::atomic<int64_t> deadline_ns_{0};
+
+  std::mutex mutex_;
+  CoalescingWait wake_{BackgroundThread::kHangWatchdog};
+  std::atomic<bool> stopping_{false};
+  std::atomic<bool> write_minidump_{false};
+  std::thread worker_;
+
+  // Only used on the watchdog thread: the sequence of the call last reported from each slot
+  std::array<uint64_t, kSlots> reported_ = {};
+  bool minidumped_ = false;
+  std::chrono::steady_clock::time_point last_minidump_;
+  size_t minidumps_ = 0;
+
+  PluginLogger logger_;
+};
+
+// Watches a call for its lifetime, see HangWatchdog
+class ScopedHangWatch {
+public:
+  explicit ScopedHangWatch(const char *name) : slot_(HangWatchdog::Instance().Begin(name)) {}
+  ~ScopedHangWatch() { HangWatchdog::Instance().End(slot_); }
+
+  ScopedHangWatch(const ScopedHangWatch &) = delete;
+  ScopedHangWatch &operator=(const ScopedHangWatch &) = delete;
+
+private:
+  size_t slot_;
+};
+
+} // namespace wireguard_dart
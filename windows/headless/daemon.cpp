@@ -0,0 +1,425 @@
+#include <winsock2.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "adapter_log.h"
+#include "connection_status.h"
+#include "log_format.h"
+#include "mapped_file.h"
+#include "plugin_logger.h"
+#include "spdlog/sinks/basic_file_sink.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+#include "spdlog/spdlog.h"
+#include "statistics_recorder.h"
+#include "string_conversions.h"
+#include "wireguard_adapter.h"
+#include "wireguard_library.h"
+
+// Runs the tunnels of a directory of WireGuard configurations without Flutter: every <name>.conf is a tunnel called
+// name, brought up when the file appears, reconfigured when its text changes and torn down when it goes. Creates
+// adapters and routes, so it has to run elevated with wireguard.dll next to it. From a console it stops cleanly on
+// Ctrl+C, Ctrl+Break, logoff and shutdown; with --service it runs as a Windows service and stops when the service
+// control manager stops it or the system shuts down.
+
+namespace wireguard_dart {
+namespace {
+
+// Of the daemon's adapters, so the plugin's orphan sweep, which goes by its own tunnel type, leaves them alone
+constexpr wchar_t kTunnelType[] = L"WireGuardDartDaemon";
+// What the stable adapter GUIDs are derived from, in place of an app's bundle ID
+constexpr char kBundleId[] = "wireguard_dart_daemon";
+// Ignored for a service of its own process, which is what the daemon is installed as
+constexpr wchar_t kServiceName[] = L"wireguard_dart_daemon";
+// How long a stop may take, tearing down every tunnel
+constexpr DWORD kStopWaitHintMs = 30000;
+
+struct Options {
+  std::wstring config_dir;
+  std::string log_file;
+  std::wstring record_file;
+  DWORD poll_seconds = 5;
+  bool verbose = false;
+  bool service = false;
+};
+
+bool ParseOptions(int argc, char **argv, Options *options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (arg == "--config-dir" && value) {
+      options->config_dir = Utf8ToWide(value);
+      i++;
+    } else if (arg == "--log" && value) {
+      options->log_file = value;
+      i++;
+    } else if (arg == "--record" && value) {
+      options->record_file = Utf8ToWide(value);
+      i++;
+    } else if (arg == "--poll-seconds" && value) {
+      options->poll_seconds = static_cast<DWORD>((std::max)(1L, std::strtol(value, nullptr, 10)));
+      i++;
+    } else if (arg == "--verbose") {
+      options->verbose = true;
+    } else if (arg == "--service") {
+      options->service = true;
+    } else {
+      return false;
+    }
+  }
+  return !options->config_dir.empty();
+}
+
+void PrintUsage() {
+  std::fprintf(stderr,
+               "Usage: wireguard_dart_daemon --config-dir DIR [--poll-seconds N] [--log FILE] [--record FILE] "
+               "[--verbose] [--service]\n"
+               "  --config-dir DIR   Run a tunnel for each DIR\\<name>.conf, checked every poll\n"
+               "  --poll-seconds N   How often to check the directory and the tunnels, 5 by default\n"
+               "  --log FILE         Log to the file instead of the console\n"
+               "  --record FILE      Append the statistics of each tunnel to a recording every poll\n"
+               "  --verbose          Log at debug level rather than info\n"
+               "  --service          Run as a Windows service, installed with this command line; give --log too,\n"
+               "                     a service has no console\n");
+}
+
+HANDLE g_stop_event = nullptr;
+
+BOOL WINAPI ConsoleCtrlHandler(DWORD ctrl_type) {
+  switch (ctrl_type) {
+    case CTRL_C_EVENT:
+    case CTRL_BREAK_EVENT:
+    case CTRL_CLOSE_EVENT:
+    case CTRL_LOGOFF_EVENT:
+    case CTRL_SHUTDOWN_EVENT:
+      SetEvent(g_stop_event);
+      // Windows ends the process once this returns for close, logoff and shutdown, so wait for the teardown
+      if (ctrl_type != CTRL_C_EVENT && ctrl_type != CTRL_BREAK_EVENT) {
+        Sleep(INFINITE);
+      }
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+SERVICE_STATUS_HANDLE g_service_status = nullptr;
+
+void ReportServiceStatus(DWORD state, DWORD exit_code = 0) {
+  SERVICE_STATUS status = {};
+  status.dwServiceType = SERVICE_WIN32_OWN_PROCESS;
+  status.dwCurrentState = state;
+  status.dwControlsAccepted = state == SERVICE_RUNNING ? SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_SHUTDOWN : 0;
+  status.dwWin32ExitCode = exit_code == 0 ? NO_ERROR : ERROR_SERVICE_SPECIFIC_ERROR;
+  status.dwServiceSpecificExitCode = exit_code;
+  status.dwWaitHint = state == SERVICE_START_PENDING || state == SERVICE_STOP_PENDING ? kStopWaitHintMs : 0;
+  SetServiceStatus(g_service_status, &status);
+}
+
+DWORD WINAPI ServiceCtrlHandler(DWORD control, DWORD, LPVOID, LPVOID) {
+  switch (control) {
+    case SERVICE_CONTROL_STOP:
+    case SERVICE_CONTROL_SHUTDOWN:
+      ReportServiceStatus(SERVICE_STOP_PENDING);
+      SetEvent(g_stop_event);
+      return NO_ERROR;
+    case SERVICE_CONTROL_INTERROGATE:
+      return NO_ERROR;
+    default:
+      return ERROR_CALL_NOT_IMPLEMENTED;
+  }
+}
+
+struct Tunnel {
+  std::unique_ptr<WireguardAdapter> adapter;
+  ConnectionStateMachine state;
+  ConnectionStatus reported = ConnectionStatus::unknown;
+  // The last handshake before the adapter came up, so only a newer one counts as connected
+  uint64_t handshake_before_up = 0;
+};
+
+class Daemon {
+public:
+  Daemon(std::shared_ptr<WireguardLibrary> library, const Options &options)
+      : library_(std::move(library)), options_(options) {}
+
+  // Until the stop event is set; then every tunnel is torn down
+  int Run() {
+    if (!options_.record_file.empty() && !recorder_.Start(options_.record_file)) {
+      logger_->error("Failed to start the recording: Windows error {}", GetLastError());
+      return 2;
+    }
+    do {
+      Scan();
+      Poll();
+    } while (WaitForSingleObject(g_stop_event, options_.poll_seconds * 1000) == WAIT_TIMEOUT);
+
+    logger_->info("Stopping, tearing down {} tunnels", tunnels_.size());
+    while (!tunnels_.empty()) {
+      TearDown(tunnels_.begin()->first);
+    }
+    recorder_.Stop();
+    return 0;
+  }
+
+private:
+  // Bring the tunnels in line with the directory
+  void Scan() {
+    std::map<std::wstring, std::wstring> files;
+    WIN32_FIND_DATAW entry;
+    HANDLE find = FindFirstFileW((options_.config_dir + L"\\*.conf").c_str(), &entry);
+    if (find != INVALID_HANDLE_VALUE) {
+      do {
+        std::wstring file_name = entry.cFileName;
+        if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+          files[file_name.substr(0, file_name.size() - 5)] = options_.config_dir + L"\\" + file_name;
+        }
+      } while (FindNextFileW(find, &entry));
+      FindClose(find);
+    } else if (GetLastError() != ERROR_FILE_NOT_FOUND) {
+      // The tunnels stay as they are while the directory cannot be read
+      logger_->error("Failed to list {}: Windows error {}", WideToUtf8(options_.config_dir), GetLastError());
+      return;
+    }
+
+    for (auto it = tunnels_.begin(); it != tunnels_.end();) {
+      auto next = std::next(it);
+      if (files.find(it->first) == files.end()) {
+        TearDown(it->first);
+      }
+      it = next;
+    }
+    for (auto it = failed_.begin(); it != failed_.end();) {
+      it = files.find(it->first) == files.end() ? failed_.erase(it) : std::next(it);
+    }
+    for (const auto &file : files) {
+      MappedFile mapped;
+      if (!mapped.Open(file.second)) {
+        // Most likely being written right now; the next poll picks it up
+        logger_->warn("Failed to read {}: Windows error {}", WideToUtf8(file.second), GetLastError());
+        continue;
+      }
+      std::string text(mapped.Text());
+      mapped.Close();
+      auto found = tunnels_.find(file.first);
+      if (found == tunnels_.end()) {
+        // A configuration that failed is tried again once its text changes, not every poll
+        auto failed = failed_.find(file.first);
+        if (failed == failed_.end() || failed->second != text) {
+          failed_.erase(file.first);
+          BringUp(file.first, text);
+        }
+      } else if (!found->second.adapter->IsConfigurationApplied(text)) {
+        Reconfigure(file.first, found->second, text);
+      }
+    }
+  }
+
+  void BringUp(const std::wstring &name, const std::string &text) {
+    const std::string tunnel_name = WideToUtf8(name);
+    auto adapter = WireguardAdapter::Open(library_, name);
+    if (!adapter) {
+      GUID guid = WireguardAdapter::StableGuid(kBundleId, name);
+      adapter = WireguardAdapter::Create(library_, name, kTunnelType, &guid);
+    }
+    if (!adapter) {
+      logger_->error("Failed to create the adapter of {}: Windows error {}", tunnel_name, GetLastError());
+      failed_[name] = text;
+      return;
+    }
+    if (!adapter->ApplyConfiguration(text) || !adapter->ConfigureNetworking()) {
+      logger_->error("Failed to configure {}: Windows error {}", tunnel_name, GetLastError());
+      adapter->CleanupNetworking();
+      failed_[name] = text;
+      return;
+    }
+
+    Tunnel tunnel;
+    WireguardAdapter::Totals totals;
+    if (adapter->GetTotals(&totals)) {
+      tunnel.handshake_before_up = totals.last_handshake;
+    }
+    tunnel.state.OnConnecting();
+    if (!adapter->SetState(WIREGUARD_ADAPTER_STATE_UP)) {
+      logger_->error("Failed to bring {} up: Windows error {}", tunnel_name, GetLastError());
+      adapter->CleanupNetworking();
+      failed_[name] = text;
+      return;
+    }
+    tunnel.adapter = std::move(adapter);
+    logger_->info("Tunnel {} is up", tunnel_name);
+    tunnels_.emplace(name, std::move(tunnel));
+  }
+
+  // Only the changed peers go to the driver, the adapter stays up
+  void Reconfigure(const std::wstring &name, Tunnel &tunnel, const std::string &text) {
+    const std::string tunnel_name = WideToUtf8(name);
+    if (!tunnel.adapter->ApplyConfiguration(text) || !tunnel.adapter->ConfigureNetworking()) {
+      logger_->error("Failed to reconfigure {}, it keeps what was applied before: Windows error {}", tunnel_name,
+                     GetLastError());
+      return;
+    }
+    logger_->info("Tunnel {} reconfigured", tunnel_name);
+  }
+
+  void TearDown(const std::wstring &name) {
+    auto found = tunnels_.find(name);
+    Tunnel &tunnel = found->second;
+    tunnel.state.OnDisconnecting(true);
+    if (!tunnel.adapter->SetState(WIREGUARD_ADAPTER_STATE_DOWN)) {
+      logger_->warn("Failed to bring {} down: Windows error {}", WideToUtf8(name), GetLastError());
+    }
+    tunnel.adapter->CleanupNetworking();
+    logger_->info("Tunnel {} is down", WideToUtf8(name));
+    tunnels_.erase(found);
+  }
+
+  // Log the tunnels whose status changed and record their statistics
+  void Poll() {
+    uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+    for (auto &entry : tunnels_) {
+      Tunnel &tunnel = entry.second;
+      NET_LUID luid;
+      MIB_IF_ROW2 if_row = {};
+      if (tunnel.adapter->GetLUID(&luid)) {
+        if_row.InterfaceLuid = luid;
+        tunnel.state.OnInterfaceStatus(GetIfEntry2(&if_row) == NO_ERROR
+                                           ? ConnectionStatusFromIfOperStatus(if_row.OperStatus)
+                                           : ConnectionStatus::unknown);
+      }
+      WireguardAdapter::Totals totals;
+      bool have_totals = tunnel.adapter->GetTotals(&totals);
+      if (have_totals && totals.last_handshake > tunnel.handshake_before_up) {
+        tunnel.state.OnHandshake();
+      }
+
+      const std::string tunnel_name = WideToUtf8(entry.first);
+      ConnectionStatus status = tunnel.state.Status();
+      if (status != tunnel.reported) {
+        logger_->info("Tunnel {} is {}", tunnel_name, ConnectionStatusToString(status));
+        tunnel.reported = status;
+      }
+
+      if (recorder_.IsRecording()) {
+        StatisticsRecord record{};
+        record.time_ms = now_ms;
+        std::memcpy(record.tunnel_name, tunnel_name.data(),
+                    (std::min)(tunnel_name.size(), sizeof(record.tunnel_name) - 1));
+        if (have_totals) {
+          record.rx_bytes = totals.rx_bytes;
+          record.tx_bytes = totals.tx_bytes;
+          record.last_handshake_ms = totals.LastHandshakeUnixMillis();
+        }
+        record.in_discards = if_row.InDiscards;
+        record.out_discards = if_row.OutDiscards;
+        record.in_errors = if_row.InErrors;
+        record.out_errors = if_row.OutErrors;
+        recorder_.Push(record);
+      }
+    }
+  }
+
+  std::shared_ptr<WireguardLibrary> library_;
+  const Options &options_;
+  std::map<std::wstring, Tunnel> tunnels_;
+  // The text of each configuration that could not be brought up
+  std::map<std::wstring, std::string> failed_;
+  StatisticsRecorder recorder_;
+  PluginLogger logger_;
+};
+
+int RunDaemon(const Options &options) {
+  std::shared_ptr<spdlog::logger> logger;
+  try {
+    logger = options.log_file.empty()
+                 ? spdlog::stdout_color_mt("wireguard_dart_daemon")
+                 : spdlog::basic_logger_mt("wireguard_dart_daemon", options.log_file);
+  } catch (const spdlog::spdlog_ex &e) {
+    std::fprintf(stderr, "Failed to open the log: %s\n", e.what());
+    return 2;
+  }
+  logger->set_level(options.verbose ? spdlog::level::debug : spdlog::level::info);
+  logger->set_formatter(MakeLogFormatter(LogPatternFor(logger->level(), "")));
+  logger->flush_on(spdlog::level::warn);
+  PluginLogger::Install(logger);
+
+  std::shared_ptr<WireguardLibrary> library = WireguardLibrary::Create();
+  if (!library) {
+    std::fprintf(stderr, "Failed to load wireguard.dll, it has to be next to the executable\n");
+    return 2;
+  }
+  library->SetLogger()(AdapterLogs::LoggerCallback);
+
+  if (options.service) {
+    ReportServiceStatus(SERVICE_RUNNING);
+  } else if (!SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE)) {
+    std::fprintf(stderr, "Failed to install the console handler (error %lu)\n", GetLastError());
+    return 2;
+  }
+  int result;
+  {
+    Daemon daemon(library, options);
+    result = daemon.Run();
+  }
+  library->SetLogger()(nullptr);
+  logger->flush();
+  return result;
+}
+
+// Set by main before the service control manager calls ServiceMain on a thread of its own
+const Options *g_service_options = nullptr;
+
+void WINAPI ServiceMain(DWORD, LPWSTR *) {
+  g_service_status = RegisterServiceCtrlHandlerExW(kServiceName, ServiceCtrlHandler, nullptr);
+  if (!g_service_status) {
+    return;
+  }
+  ReportServiceStatus(SERVICE_START_PENDING);
+  int result = RunDaemon(*g_service_options);
+  ReportServiceStatus(SERVICE_STOPPED, static_cast<DWORD>(result));
+}
+
+} // namespace
+} // namespace wireguard_dart
+
+int main(int argc, char **argv) {
+  wireguard_dart::Options options;
+  if (!wireguard_dart::ParseOptions(argc, argv, &options)) {
+    wireguard_dart::PrintUsage();
+    return 2;
+  }
+  // Before any handler that sets it is installed
+  wireguard_dart::g_stop_event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  if (!wireguard_dart::g_stop_event) {
+    std::fprintf(stderr, "Failed to create the stop event (error %lu)\n", GetLastError());
+    return 2;
+  }
+  if (!options.service) {
+    return wireguard_dart::RunDaemon(options);
+  }
+
+  // Returns once the service has stopped
+  wireguard_dart::g_service_options = &options;
+  SERVICE_TABLE_ENTRYW services[] = {{const_cast<LPWSTR>(wireguard_dart::kServiceName), wireguard_dart::ServiceMain},
+                                     {nullptr, nullptr}};
+  if (!StartServiceCtrlDispatcherW(services)) {
+    std::fprintf(stderr,
+                 "Failed to connect to the service control manager (error %lu), --service is only for a service's "
+                 "command line\n",
+                 GetLastError());
+    return 2;
+  }
+  return 0;
+}
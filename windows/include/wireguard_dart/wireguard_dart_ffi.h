@@ -0,0 +1,44 @@
+#ifndef FLUTTER_PLUGIN_WIREGUARD_DART_FFI_H_
+#define FLUTTER_PLUGIN_WIREGUARD_DART_FFI_H_
+
+#include <stdint.h>
+
+#include "wireguard_dart_plugin_c_api.h"
+
+// Synchronous reads for dart:ffi, callable from any thread without the method channel. tunnel_name is UTF-8; NULL
+// reads the newest adapter where the matching method call takes an optional tunnelName. Every call returns one of
+// the negative codes below on failure.
+
+#define WIREGUARD_DART_FFI_NO_PLUGIN -1    // The plugin is not registered, or is being destroyed
+#define WIREGUARD_DART_FFI_NOT_FOUND -2    // No valid adapter of that name
+#define WIREGUARD_DART_FFI_READ_FAILED -3  // The driver could not be read
+#define WIREGUARD_DART_FFI_INVALID_ARGUMENT -4
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct WireguardDartTotals {
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+  // Milliseconds since the epoch, 0 if no peer ever completed a handshake
+  uint64_t latest_handshake;
+} WireguardDartTotals;
+
+// The status as the status method answers it: 0 connected, 1 disconnected, 2 connecting, 3 disconnecting,
+// 4 unknown. An adapter that does not exist is disconnected.
+FLUTTER_PLUGIN_EXPORT int32_t WireguardDartFfiStatus(const char *tunnel_name);
+
+// The totals of tunnelStatistics; 0 on success
+FLUTTER_PLUGIN_EXPORT int32_t WireguardDartFfiTotals(const char *tunnel_name, WireguardDartTotals *totals);
+
+// The peers in the layout of peerStatisticsBinary. Returns the size of the snapshot, which is only written to
+// buffer when capacity is at least that size; a caller with a smaller buffer grows it and calls again.
+FLUTTER_PLUGIN_EXPORT int64_t WireguardDartFfiPeerStatistics(const char *tunnel_name, uint8_t *buffer,
+                                                             int64_t capacity);
+
+#if defined(__cplusplus)
+}  // extern "C"
+#endif
+
+#endif  // FLUTTER_PLUGIN_WIREGUARD_DART_FFI_H_
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace wireguard_dart {
+
+// 64-bit FNV-1a of bytes, continuing from hash, to find interned values by their content
+constexpr uint64_t kHashBytesSeed = 14695981039346656037ULL;
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t hash = kHashBytesSeed) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * Immutable values shared by everyone who holds an equal one, found by a hash of their content, e.g. the same
+ * corporate ranges in the configurations of several tunnels. The table only holds them weakly: a value is freed
+ * with its last holder, and the entries of freed values are swept out as the table grows. Safe from any thread.
+ */
+template <typename T>
+class InternTable {
+public:
+  /**
+   * The value with this hash that matches(value) is true for, or else the one make() returns, which is shared
+   * from then on. make runs without the lock, so values that take long to build do not hold up each other; it
+   * must leave what matches compares with as it was, which is checked again once the lock is taken back.
+   */
+  template <typename Matches, typename Make>
+  std::shared_ptr<const T> Intern(uint64_t hash, const Matches &matches, const Make &make) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (std::shared_ptr<const T> found = FindLocked(hash, matches)) {
+        return found;
+      }
+    }
+    std::shared_ptr<const T> made = std::make_shared<T>(make());
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Another thread may have made the same value meanwhile
+    if (std::shared_ptr<const T> found = FindLocked(hash, matches)) {
+      return found;
+    }
+    if (values_.size() >= sweep_at_) {
+      SweepLocked();
+    }
+    values_.emplace(hash, made);
+    return made;
+  }
+
+  // Every value still held, each once however many hold it
+  void ForEach(const std::function<void(const T &value)> &visit) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : values_) {
+      if (std::shared_ptr<const T> value = entry.second.lock()) {
+        visit(*value);
+      }
+    }
+  }
+
+private:
+  static constexpr size_t kMinSweepAt = 64;
+
+  template <typename Matches>
+  std::shared_ptr<const T> FindLocked(uint64_t hash, const Matches &matches) {
+    auto range = values_.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+      std::shared_ptr<const T> value = it->second.lock();
+      if (!value) {
+        it = values_.erase(it);
+      } else if (matches(*value)) {
+        return value;
+      } else {
+        ++it;
+      }
+    }
+    return nullptr;
+  }
+
+  // Drop the entries of freed values; the next sweep comes once the table has doubled from what is left
+  void SweepLocked() {
+    for (auto it = values_.begin(); it != values_.end();) {
+      it = it->second.expired() ? values_.erase(it) : std::next(it);
+    }
+    sweep_at_ = values_.size() * 2 > kMinSweepAt ? values_.size() * 2 : kMinSweepAt;
+  }
+
+  mutable std::mutex mutex_;
+  std::unordered_multimap<uint64_t, std::weak_ptr<const T>> values_;
+  size_t sweep_at_ = kMinSweepAt;
+};
+
+} // namespace wireguard_dart
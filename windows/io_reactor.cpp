@@ -0,0 +1,202 @@
+#include "io_reactor.h"
+
+#include <memory>
+#include <system_error>
+
+#include "cpu_accounting.h"
+#include "startup_trace.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// The completion key tells the packets apart; handles are associated with kIoKey
+constexpr ULONG_PTR kIoKey = 0;
+constexpr ULONG_PTR kTaskKey = 1;
+// Makes a thread look at the timers again, after one was scheduled before all the others
+constexpr ULONG_PTR kWakeKey = 2;
+constexpr ULONG_PTR kStopKey = 3;
+
+} // namespace
+
+struct IoReactor::Operation {
+  // First, so that the OVERLAPPED a completion hands back is the operation
+  OVERLAPPED overlapped = {};
+  Completion completion;
+};
+
+IoReactor::IoReactor(size_t threads) : thread_count_(threads) {
+  port_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, static_cast<DWORD>(threads));
+}
+
+IoReactor::~IoReactor() {
+  if (!port_) {
+    return;
+  }
+  // A reactor never used stays without threads, and one starting on another thread is waited for
+  std::call_once(threads_started_, [] {});
+  for (size_t i = 0; i < threads_.size(); i++) {
+    PostQueuedCompletionStatus(port_, 0, kStopKey, nullptr);
+  }
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+
+  // Whatever is still queued belongs to nobody any more
+  DWORD bytes;
+  ULONG_PTR key;
+  OVERLAPPED *overlapped;
+  while (GetQueuedCompletionStatus(port_, &bytes, &key, &overlapped, 0) || overlapped) {
+    if (key == kTaskKey) {
+      delete reinterpret_cast<Task *>(overlapped);
+    } else if (key == kIoKey && overlapped) {
+      delete reinterpret_cast<Operation *>(overlapped);
+    }
+  }
+  CloseHandle(port_);
+}
+
+bool IoReactor::StartThreads() {
+  if (!port_) {
+    return false;
+  }
+  std::call_once(threads_started_, [this] {
+    ScopedStartup startup("ioReactor");
+    try {
+      for (size_t i = 0; i < thread_count_; i++) {
+        threads_.emplace_back(&IoReactor::Run, this);
+      }
+    } catch (const std::system_error &) {
+      // The threads that did start carry the load
+    }
+  });
+  return !threads_.empty();
+}
+
+bool IoReactor::Associate(HANDLE handle) {
+  if (!StartThreads()) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return false;
+  }
+  return CreateIoCompletionPort(handle, port_, kIoKey, 0) == port_;
+}
+
+bool IoReactor::StartIo(const std::function<bool(OVERLAPPED *overlapped)> &start, Completion completion) {
+  if (!StartThreads()) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return false;
+  }
+  auto operation = std::make_unique<Operation>();
+  operation->completion = std::move(completion);
+  pending_io_.fetch_add(1, std::memory_order_relaxed);
+  if (!start(&operation->overlapped)) {
+    DWORD error = GetLastError();
+    pending_io_.fetch_sub(1, std::memory_order_relaxed);
+    operation.reset();
+    SetLastError(error);
+    return false;
+  }
+  // The completion packet owns it now
+  operation.release();
+  return true;
+}
+
+void IoReactor::Post(Task task) {
+  if (!StartThreads()) {
+    task();
+    return;
+  }
+  auto packet = std::make_unique<Task>(std::move(task));
+  if (PostQueuedCompletionStatus(port_, 0, kTaskKey, reinterpret_cast<OVERLAPPED *>(packet.get()))) {
+    packet.release();
+  } else {
+    (*packet)();
+  }
+}
+
+IoReactor::TimerId IoReactor::Schedule(std::chrono::milliseconds delay, Task task) {
+  if (!StartThreads()) {
+    return 0;
+  }
+  Clock::time_point due = Clock::now() + delay;
+  TimerId timer;
+  bool earliest;
+  {
+    std::lock_guard<std::mutex> lock(timers_mutex_);
+    timer = next_timer_++;
+    timers_.emplace(std::make_pair(due, timer), std::move(task));
+    timer_due_.emplace(timer, due);
+    earliest = timers_.begin()->first.second == timer;
+  }
+  // The threads wait no longer than until the earliest timer, a later one they find in time
+  if (earliest) {
+    PostQueuedCompletionStatus(port_, 0, kWakeKey, nullptr);
+  }
+  return timer;
+}
+
+bool IoReactor::Cancel(TimerId timer) {
+  std::lock_guard<std::mutex> lock(timers_mutex_);
+  auto it = timer_due_.find(timer);
+  if (it == timer_due_.end()) {
+    return false;
+  }
+  timers_.erase(std::make_pair(it->second, timer));
+  timer_due_.erase(it);
+  return true;
+}
+
+bool IoReactor::TakeDueTimer(Task *task, DWORD *wait) {
+  std::lock_guard<std::mutex> lock(timers_mutex_);
+  if (timers_.empty()) {
+    *wait = INFINITE;
+    return false;
+  }
+  auto earliest = timers_.begin();
+  Clock::time_point now = Clock::now();
+  if (earliest->first.first > now) {
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(earliest->first.first - now);
+    *wait = static_cast<DWORD>(left.count());
+    return false;
+  }
+  *task = std::move(earliest->second);
+  timer_due_.erase(earliest->first.second);
+  timers_.erase(earliest);
+  return true;
+}
+
+void IoReactor::Run() {
+  ScopedThreadCpu cpu(CpuComponent::kIoReactor);
+  while (true) {
+    Task timer_task;
+    DWORD wait;
+    while (TakeDueTimer(&timer_task, &wait)) {
+      timer_task();
+      timer_task = nullptr;
+    }
+
+    DWORD bytes = 0;
+    ULONG_PTR key = 0;
+    OVERLAPPED *overlapped = nullptr;
+    BOOL ok = GetQueuedCompletionStatus(port_, &bytes, &key, &overlapped, wait);
+    DWORD error = ok ? ERROR_SUCCESS : GetLastError();
+    if (!overlapped) {
+      // A timeout sends the thread back to the timers, anything but a wake or a timeout means the port is gone
+      if (ok ? key == kStopKey : error != WAIT_TIMEOUT) {
+        return;
+      }
+      continue;
+    }
+
+    if (key == kTaskKey) {
+      std::unique_ptr<Task> task(reinterpret_cast<Task *>(overlapped));
+      (*task)();
+      continue;
+    }
+    std::unique_ptr<Operation> operation(reinterpret_cast<Operation *>(overlapped));
+    pending_io_.fetch_sub(1, std::memory_order_relaxed);
+    operation->completion(error, bytes);
+  }
+}
+
+} // namespace wireguard_dart
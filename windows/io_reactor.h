@@ -0,0 +1,92 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace wireguard_dart {
+
+/**
+ * One I/O completion port with a few threads that run everything the plugin waits for in the background: overlapped
+ * calls on handles associated with it, timers and posted tasks. However many tunnels and watches there are, they
+ * share these threads instead of each keeping one of its own. Work that has to reach Flutter is handed on to the
+ * PlatformTaskRunner, the one queue to the platform thread.
+ *
+ * Callbacks run on any of the reactor threads, so they must not block for long; the tunnel workers are the place
+ * for calls into the driver.
+ */
+class IoReactor {
+public:
+  using Task = std::function<void()>;
+  // Called on a reactor thread with ERROR_SUCCESS or the error the overlapped call completed with
+  using Completion = std::function<void(DWORD error, DWORD bytes)>;
+  // Never 0, so that 0 can mean no timer
+  using TimerId = uint64_t;
+
+  static constexpr size_t kDefaultThreads = 2;
+
+  // Only creates the port; the threads start with the first handle, call, task or timer given to the reactor
+  explicit IoReactor(size_t threads = kDefaultThreads);
+  // Stops the threads; overlapped calls still pending are dropped without their completions
+  ~IoReactor();
+
+  IoReactor(const IoReactor &) = delete;
+  IoReactor &operator=(const IoReactor &) = delete;
+
+  // Whether the port exists; without it nothing can be associated or scheduled and posted tasks run on the caller
+  bool IsValid() const { return port_ != nullptr; }
+
+  // Deliver the completions of a handle opened with FILE_FLAG_OVERLAPPED to the reactor, for as long as it is open
+  bool Associate(HANDLE handle);
+
+  /**
+   * Issue an overlapped call: start is given the OVERLAPPED to pass to it and returns whether the call was made, as
+   * the call does. When it was, completion runs once it completed, also when it was cancelled or failed later.
+   * When it was not, completion is dropped and GetLastError is the call's error.
+   */
+  bool StartIo(const std::function<bool(OVERLAPPED *overlapped)> &start, Completion completion);
+
+  void Post(Task task);
+
+  // Run the task on a reactor thread once delay passed; 0 when the reactor is not valid
+  TimerId Schedule(std::chrono::milliseconds delay, Task task);
+  // False when the timer already ran or is running; the caller keeps its own lock to wait for that
+  bool Cancel(TimerId timer);
+
+  // Overlapped calls started and not completed yet
+  size_t PendingIo() const { return pending_io_.load(std::memory_order_relaxed); }
+
+private:
+  struct Operation;
+  using Clock = std::chrono::steady_clock;
+
+  // False when no thread could be started, or there is no port
+  bool StartThreads();
+  void Run();
+  // Pop the earliest timer if it is due, or else how long until it is
+  bool TakeDueTimer(Task *task, DWORD *wait);
+
+  HANDLE port_ = nullptr;
+  size_t thread_count_;
+  std::once_flag threads_started_;
+  // Only read once threads_started_ is set
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> pending_io_{0};
+
+  std::mutex timers_mutex_;
+  // By due time, then by ID so timers due at once run in the order they were scheduled
+  std::map<std::pair<Clock::time_point, TimerId>, Task> timers_;
+  std::map<TimerId, Clock::time_point> timer_due_;
+  TimerId next_timer_ = 1;
+};
+
+} // namespace wireguard_dart
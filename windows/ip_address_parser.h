@@ -0,0 +1,28 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+
+#include <string_view>
+
+#include "wireguard_core/address_parser.h"
+
+namespace wireguard_dart {
+
+// The shared address parsers of wireguard_core, for the Win32 address types
+
+/**
+ * Parse a dotted-quad IPv4 address, e.g. "192.168.1.1"
+ */
+inline bool ParseIPv4Address(std::string_view str, IN_ADDR &address) {
+  return ParseIPv4Address(str, reinterpret_cast<uint8_t *>(&address));
+}
+
+/**
+ * Parse an IPv6 address, including "::" compression and an embedded IPv4 tail, e.g. "::ffff:10.0.0.1"
+ */
+inline bool ParseIPv6Address(std::string_view str, IN6_ADDR &address) {
+  return ParseIPv6Address(str, reinterpret_cast<uint8_t *>(&address));
+}
+
+} // namespace wireguard_dart
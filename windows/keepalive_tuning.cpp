@@ -0,0 +1,122 @@
+#include "keepalive_tuning.h"
+
+#include <cstring>
+#include <system_error>
+
+#include "cpu_accounting.h"
+#include "spdlog/spdlog.h"
+#include "wireguard_core/peer_index.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+uint64_t NowUnixMillis() {
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  return FiletimeToUnixMillis((static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime);
+}
+
+} // namespace
+
+KeepaliveTuning::~KeepaliveTuning() { Stop(); }
+
+void KeepaliveTuning::Start(const std::vector<Peer> &peers, ReadPeers read_peers, Apply apply) {
+  Stop();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Tuned> tuned;
+  tuned.reserve(peers.size());
+  for (const auto &peer : peers) {
+    PeerKey key;
+    memcpy(key.data(), peer.public_key, key.size());
+    auto learned = learned_.find(key);
+    if (learned == learned_.end() || learned->second.peer.min != peer.min || learned->second.peer.max != peer.max) {
+      tuned.push_back({peer, KeepaliveTuner(peer.min, peer.max, peer.current)});
+      continue;
+    }
+    // A peer that was replaced came with the configured interval again
+    Tuned &entry = tuned.emplace_back(learned->second);
+    entry.peer = peer;
+    entry.unapplied = entry.tuner.Current() != peer.current ? entry.tuner.Current() : 0;
+  }
+  // Peers that are gone are forgotten
+  learned_.clear();
+  if (tuned.empty()) {
+    return;
+  }
+
+  stopping_ = false;
+  try {
+    worker_ = std::thread(&KeepaliveTuning::Run, this, std::move(tuned), std::move(read_peers), std::move(apply));
+  } catch (const std::system_error &) {
+    logger_->warn("Peers with an automatic keepalive keep their current interval");
+    KeepLearnedLocked(tuned);
+  }
+}
+
+void KeepaliveTuning::KeepLearnedLocked(std::vector<Tuned> &tuned) {
+  for (Tuned &entry : tuned) {
+    PeerKey key;
+    memcpy(key.data(), entry.peer.public_key, key.size());
+    learned_.insert_or_assign(key, std::move(entry));
+  }
+}
+
+void KeepaliveTuning::Stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker = std::move(worker_);
+  }
+  wake_.Notify();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+bool KeepaliveTuning::Wait(std::chrono::steady_clock::duration timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !wake_.WaitFor(lock, timeout, kCheckTolerance, [this] { return stopping_.load(); });
+}
+
+void KeepaliveTuning::Run(std::vector<Tuned> tuned, ReadPeers read_peers, Apply apply) {
+  ThrottleCurrentThread();
+  ScopedThreadCpu cpu(BackgroundThread::kKeepaliveTuning);
+
+  PeerIndex index;
+  auto key_at = [&tuned](uint32_t slot) { return tuned[slot].peer.public_key; };
+  for (size_t i = 0; i < tuned.size(); i++) {
+    index.Insert(tuned[i].peer.public_key, static_cast<uint32_t>(i), key_at);
+  }
+
+  std::vector<PeerStatistics> peers;
+  while (Wait(kCheckInterval)) {
+    if (!read_peers(&peers)) {
+      continue;
+    }
+    uint64_t now_ms = NowUnixMillis();
+    for (const PeerStatistics &statistics : peers) {
+      uint32_t slot = index.Find(statistics.public_key.data(), key_at);
+      if (slot == PeerIndex::kNone) {
+        continue;
+      }
+      Tuned &entry = tuned[slot];
+      WORD previous = entry.tuner.Current();
+      if (WORD chosen = entry.tuner.Update(statistics, now_ms)) {
+        logger_->info("{} the keepalive of a peer from {} s to {} s", chosen > previous ? "Raising" : "Lowering",
+                      previous, chosen);
+        entry.unapplied = chosen;
+      }
+      if (entry.unapplied != 0 && apply(entry.peer.public_key, entry.unapplied)) {
+        entry.unapplied = 0;
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  KeepLearnedLocked(tuned);
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "background_threads.h"
+#include "peer_statistics.h"
+#include "plugin_logger.h"
+#include "wireguard.h"
+#include "wireguard_core/keepalive_tuner.h"
+
+namespace wireguard_dart {
+
+/**
+ * Tunes the keepalive of the peers configured with PersistentKeepalive = auto. Like EndpointFailover, the
+ * driver's counters are read every kCheckInterval; each peer has a KeepaliveTuner that is given them and whose
+ * choice is set on the peer as soon as it makes one.
+ */
+class KeepaliveTuning {
+public:
+  struct Peer {
+    BYTE public_key[WIREGUARD_KEY_LENGTH];
+    // Bounds of the interval in seconds, and the one the peer has now
+    WORD min;
+    WORD max;
+    WORD current;
+  };
+  // Every peer's counters from the driver
+  using ReadPeers = std::function<bool(std::vector<PeerStatistics> *peers)>;
+  // Called from the tuning thread to set the keepalive on the peer, false to be called again on the next check
+  using Apply = std::function<bool(const BYTE *public_key, WORD keepalive)>;
+
+  static constexpr std::chrono::seconds kCheckInterval{10};
+  // A check may come this much later, where Windows coalesces the wakeup with other timers
+  static constexpr std::chrono::milliseconds kCheckTolerance{1000};
+
+  KeepaliveTuning() = default;
+  ~KeepaliveTuning();
+
+  KeepaliveTuning(const KeepaliveTuning &) = delete;
+  KeepaliveTuning &operator=(const KeepaliveTuning &) = delete;
+
+  /**
+   * Watch the peers and tune their keepalives, replacing an earlier run. A peer the earlier run tuned with the
+   * same bounds goes on from what was learned about it, and gets the interval chosen for it back; the others
+   * start from their current interval.
+   */
+  void Start(const std::vector<Peer> &peers, ReadPeers read_peers, Apply apply);
+  void Stop();
+
+private:
+  struct Tuned {
+    Peer peer;
+    KeepaliveTuner tuner;
+    // A choice apply did not take yet, 0 for none
+    WORD unapplied = 0;
+  };
+
+  void Run(std::vector<Tuned> tuned, ReadPeers read_peers, Apply apply);
+  // Keep the tuners of a run that ended for the next Start, under mutex_
+  void KeepLearnedLocked(std::vector<Tuned> &tuned);
+  // Wait for the next check, false once stopped
+  bool Wait(std::chrono::steady_clock::duration timeout);
+
+  std::mutex mutex_;
+  CoalescingWait wake_{BackgroundThread::kKeepaliveTuning};
+  std::atomic<bool> stopping_{false};
+  std::thread worker_;
+  // The tuners of the last run, by public key, until the next Start
+  std::unordered_map<PeerKey, Tuned, PeerKeyHash> learned_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -1,29 +1,101 @@
+#include <windows.h>
+
+#include <bcrypt.h>
+
+#include <atomic>
+#include <cstring>
 #include <string>
-#include <utility>
+#include <string_view>
+#include <vector>
 
-#include "libbase64.h"
-#include "tunnel.h"
+#include "key_generator.h"
+
+#include "compute_pool.h"
+#include "x25519.h"
 
 namespace wireguard_dart {
 
 const size_t kKeyLen = 32;
-const size_t kBase64BufferSize = kKeyLen * 2;  // Min size = src * 4/3 https://github.com/aklomp/base64#base64_encode
+// Fewer keys than this per run cost more to hand to another thread than they save
+const size_t kMinKeysPerThread = 32;
+
+namespace {
 
-std::pair<std::string, std::string> GenerateKeyPair() {
-  char public_key_bytes[kKeyLen];
-  char private_key_bytes[kKeyLen];
-  WireGuardGenerateKeypair((unsigned char *)public_key_bytes, (unsigned char *)private_key_bytes);
+// A random private key and its public key; false if the system's generator failed
+bool GenerateKeyPairBytes(uint8_t *public_key, uint8_t *private_key) {
+  if (!X25519GeneratePrivateKey(private_key)) {
+    return false;
+  }
+  X25519PublicKey(public_key, private_key);
+  return true;
+}
+
+// Calls fill(first, end) for runs of [0, count) on the compute pool, the calling thread taking runs as well
+template <typename Fill>
+void FillInParallel(size_t count, Fill fill) {
+  ComputePool::Shared().ParallelFor(count, kMinKeysPerThread, fill);
+}
 
-  char b64_buf[kBase64BufferSize];
-  size_t b64_output_len;
+}  // namespace
 
-  base64_encode(public_key_bytes, kKeyLen, b64_buf, &b64_output_len, 0);
-  const std::string public_key_b64(b64_buf, 0, b64_output_len);
+bool GenerateKeyPair(uint8_t *public_key, uint8_t *private_key) {
+  return GenerateKeyPairBytes(public_key, private_key);
+}
 
-  base64_encode(private_key_bytes, kKeyLen, b64_buf, &b64_output_len, 0);
-  const std::string private_key_b64(b64_buf, 0, b64_output_len);
+std::vector<uint8_t> GenerateKeyPairs(size_t count) {
+  if (count == 0) {
+    return {};
+  }
+
+  std::vector<uint8_t> records(count * kKeyLen * 2);
+  std::atomic<bool> failed{false};
+  auto generate_range = [&records, &failed](size_t first, size_t end) {
+    for (size_t i = first; i < end && !failed.load(std::memory_order_relaxed); i++) {
+      uint8_t *record = records.data() + i * kKeyLen * 2;
+      if (!GenerateKeyPairBytes(record, record + kKeyLen)) {
+        failed.store(true, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  FillInParallel(count, generate_range);
+  if (failed.load()) {
+    SecureZeroMemory(records.data(), records.size());
+    return {};
+  }
+  return records;
+}
+
+std::vector<uint8_t> GeneratePresharedKeys(size_t count) {
+  std::vector<uint8_t> keys(count * kKeyLen);
+  if (keys.empty() || !BCRYPT_SUCCESS(BCryptGenRandom(nullptr, keys.data(), static_cast<ULONG>(keys.size()),
+                                                      BCRYPT_USE_SYSTEM_PREFERRED_RNG))) {
+    return {};
+  }
+  return keys;
+}
+
+std::string DerivePublicKey(std::string_view private_key) {
+  uint8_t private_key_bytes[kKeyLen];
+  if (!KeyFromBase64(private_key, private_key_bytes)) {
+    // It may have got part of the way
+    SecureZeroMemory(private_key_bytes, sizeof(private_key_bytes));
+    return {};
+  }
+  uint8_t public_key_bytes[kKeyLen];
+  X25519PublicKey(public_key_bytes, private_key_bytes);
+  SecureZeroMemory(private_key_bytes, sizeof(private_key_bytes));
+  return KeyToBase64(public_key_bytes);
+}
 
-  return std::make_pair(public_key_b64, private_key_b64);
+std::vector<std::string> DerivePublicKeys(const std::vector<std::string_view> &private_keys) {
+  std::vector<std::string> public_keys(private_keys.size());
+  FillInParallel(private_keys.size(), [&private_keys, &public_keys](size_t first, size_t end) {
+    for (size_t i = first; i < end; i++) {
+      public_keys[i] = DerivePublicKey(private_keys[i]);
+    }
+  });
+  return public_keys;
 }
 
 }  // namespace wireguard_dart
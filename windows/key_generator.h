@@ -1,12 +1,38 @@
 #ifndef WIREGUARD_DART_KEY_GENERATOR_H
 #define WIREGUARD_DART_KEY_GENERATOR_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
-#include <utility>
+#include <string_view>
+#include <vector>
+
+#include "wireguard_core/wireguard_key.h"
 
 namespace wireguard_dart {
 
-std::pair<std::string, std::string> GenerateKeyPair();
+// A random 32 byte private key and its public key; false if the system's random number generator failed
+bool GenerateKeyPair(uint8_t *public_key, uint8_t *private_key);
+
+// Key pairs a batch may ask for at most, 8 MB of keys
+constexpr size_t kMaxKeyPairBatch = 131072;
+
+// count key pairs as records of the 32 byte public key followed by the 32 byte private key, generated on a thread
+// per core for large batches; empty if the system's random number generator failed
+std::vector<uint8_t> GenerateKeyPairs(size_t count);
+
+// Preshared keys a batch may ask for at most, 8 MB of keys
+constexpr size_t kMaxPresharedKeyBatch = 262144;
+
+// count random 32 byte preshared keys back to back, from one call to the system's generator; empty if it failed
+std::vector<uint8_t> GeneratePresharedKeys(size_t count);
+
+// The base64 public key of a base64 private key; empty if private_key is not a base64 32 byte key
+std::string DerivePublicKey(std::string_view private_key);
+
+// The public keys of private_keys in the same order, on a thread per core for large batches; each empty where its
+// private key is not a base64 32 byte key
+std::vector<std::string> DerivePublicKeys(const std::vector<std::string_view> &private_keys);
 
 }
 
@@ -0,0 +1,101 @@
+#include "key_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+
+#include "background_threads.h"
+#include "cpu_accounting.h"
+#include "x25519.h"
+
+namespace wireguard_dart {
+
+KeyPool::KeyPool(size_t capacity)
+    : capacity_((std::min)((std::max)(capacity, size_t(1)), kMaxCapacity)),
+      low_water_((std::max)(capacity_ / 2, size_t(1))) {
+  size_t size = capacity_ * kRecordSize;
+  records_ = static_cast<uint8_t *>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+  // Past the working set quota the pairs are still kept, only without the guarantee they stay off the page file
+  locked_ = records_ && VirtualLock(records_, size);
+  if (!records_) {
+    return;
+  }
+  try {
+    worker_ = std::thread(&KeyPool::Run, this);
+  } catch (const std::system_error &) {
+    // An empty pool, every Take fails and the caller generates its own pairs
+  }
+}
+
+KeyPool::~KeyPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+  if (records_) {
+    size_t size = capacity_ * kRecordSize;
+    SecureZeroMemory(records_, size);
+    if (locked_) {
+      VirtualUnlock(records_, size);
+    }
+    VirtualFree(records_, 0, MEM_RELEASE);
+  }
+}
+
+bool KeyPool::Take(uint8_t public_key[32], uint8_t private_key[32]) {
+  bool refill;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ == 0) {
+      return false;
+    }
+    count_--;
+    uint8_t *record = records_ + count_ * kRecordSize;
+    memcpy(public_key, record, 32);
+    memcpy(private_key, record + 32, 32);
+    SecureZeroMemory(record, kRecordSize);
+    refill = count_ < low_water_;
+  }
+  if (refill) {
+    wake_.notify_one();
+  }
+  return true;
+}
+
+void KeyPool::Run() {
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+  ThrottleCurrentThread();
+  ScopedThreadCpu cpu(BackgroundThread::kKeyPool);
+
+  uint8_t record[kRecordSize];
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    if (count_ == capacity_) {
+      wake_.wait(lock, [this] { return stopping_ || count_ < low_water_; });
+      WakeupCounts::Instance().Count(BackgroundThread::kKeyPool);
+      continue;
+    }
+
+    // Generated outside the lock, so Take never waits for a pair being made
+    lock.unlock();
+    bool generated = X25519GeneratePrivateKey(record + 32);
+    if (generated) {
+      X25519PublicKey(record, record + 32);
+    }
+    lock.lock();
+
+    if (!generated) {
+      // Without random bytes there is nothing to fill with; Take falls back to the caller once the pool is empty
+      break;
+    }
+    memcpy(records_ + count_ * kRecordSize, record, kRecordSize);
+    count_++;
+  }
+  SecureZeroMemory(record, sizeof(record));
+}
+
+} // namespace wireguard_dart
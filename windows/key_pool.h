@@ -0,0 +1,56 @@
+#pragma once
+
+#include <windows.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace wireguard_dart {
+
+/**
+ * Key pairs generated ahead of time, so generateKeyPair only copies one out. A thread of lowest priority, with
+ * EcoQoS, fills the pool up to its capacity and then sleeps until taking pairs leaves fewer than half of it. The
+ * pairs are kept in memory locked into the working set, so they are never paged to disk, and zeroed when taken and
+ * when the pool is destroyed.
+ */
+class KeyPool {
+public:
+  // 64 KB of locked memory, well within the working set Windows gives a process by default
+  static constexpr size_t kMaxCapacity = 1024;
+
+  // capacity is clamped to 1..kMaxCapacity; the pool starts filling at once
+  explicit KeyPool(size_t capacity);
+  ~KeyPool();
+
+  KeyPool(const KeyPool &) = delete;
+  KeyPool &operator=(const KeyPool &) = delete;
+
+  size_t Capacity() const { return capacity_; }
+  // The locked records, allocated for the whole capacity up front
+  size_t MemoryBytes() const { return capacity_ * kRecordSize; }
+
+  // Moves a pair out of the pool; false if it is empty, and then the caller generates its own
+  bool Take(uint8_t public_key[32], uint8_t private_key[32]);
+
+private:
+  static constexpr size_t kRecordSize = 64;
+
+  void Run();
+
+  size_t capacity_;
+  size_t low_water_;
+  // capacity_ records of the public key followed by the private key, the first count_ of them filled
+  uint8_t *records_;
+  bool locked_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  size_t count_ = 0;
+  bool stopping_ = false;
+  std::thread worker_;
+};
+
+} // namespace wireguard_dart
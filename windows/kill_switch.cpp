@@ -0,0 +1,393 @@
+#include "kill_switch.h"
+
+#include <cstring>
+#include <set>
+#include <string>
+
+#pragma comment(lib, "fwpuclnt.lib")
+#pragma comment(lib, "rpcrt4.lib")
+
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr UINT8 kPermitWeight = 12;
+constexpr UINT8 kBlockWeight = 0;
+// Above the sublayers other software usually adds, so that their permits cannot override our block
+constexpr UINT16 kSublayerWeight = 0xFFFF;
+
+constexpr UINT8 kProtocolTcp = 6;
+constexpr UINT8 kProtocolUdp = 17;
+
+wchar_t kName[] = L"WireGuard Dart kill switch";
+
+const GUID *kConnectLayers[] = {&FWPM_LAYER_ALE_AUTH_CONNECT_V4, &FWPM_LAYER_ALE_AUTH_CONNECT_V6};
+const GUID *kAllLayers[] = {&FWPM_LAYER_ALE_AUTH_CONNECT_V4, &FWPM_LAYER_ALE_AUTH_CONNECT_V6,
+                            &FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4, &FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6};
+
+bool IsV4Layer(const GUID *layer) {
+  return layer == &FWPM_LAYER_ALE_AUTH_CONNECT_V4 || layer == &FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4;
+}
+
+FWPM_FILTER_CONDITION0 Condition(const GUID &field, FWP_MATCH_TYPE match) {
+  FWPM_FILTER_CONDITION0 condition = {};
+  condition.fieldKey = field;
+  condition.matchType = match;
+  return condition;
+}
+
+FWPM_FILTER_CONDITION0 Uint8Condition(const GUID &field, UINT8 value) {
+  FWPM_FILTER_CONDITION0 condition = Condition(field, FWP_MATCH_EQUAL);
+  condition.conditionValue.type = FWP_UINT8;
+  condition.conditionValue.uint8 = value;
+  return condition;
+}
+
+FWPM_FILTER_CONDITION0 Uint16Condition(const GUID &field, UINT16 value) {
+  FWPM_FILTER_CONDITION0 condition = Condition(field, FWP_MATCH_EQUAL);
+  condition.conditionValue.type = FWP_UINT16;
+  condition.conditionValue.uint16 = value;
+  return condition;
+}
+
+} // namespace
+
+KillSwitch::KillSwitch() {}
+
+KillSwitch::~KillSwitch() { Stop(); }
+
+bool KillSwitch::Start(const NET_LUID &tunnel_luid, const std::vector<SOCKADDR_INET> &endpoints) {
+  std::vector<EndpointKey> keys;
+  for (const auto &endpoint : endpoints) {
+    EndpointKey key;
+    if (ToEndpointKey(endpoint, key)) {
+      keys.push_back(key);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (engine_ && tunnel_luid_.Value == tunnel_luid.Value) {
+    return UpdateEndpointsLocked(keys);
+  }
+
+  StopLocked();
+  return InstallLocked(tunnel_luid, keys);
+}
+
+bool KillSwitch::AddEndpoint(const SOCKADDR_INET &endpoint) {
+  EndpointKey key;
+  if (!ToEndpointKey(endpoint, key)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!engine_ || endpoint_filters_.count(key) > 0) {
+    return true;
+  }
+
+  DWORD result = FwpmTransactionBegin0(engine_, 0);
+  if (result != ERROR_SUCCESS) {
+    logger_->error("Failed to begin kill switch transaction: error {}", result);
+    return false;
+  }
+
+  std::vector<UINT64> filter_ids;
+  if (!AddEndpointFiltersLocked(key, filter_ids) || (result = FwpmTransactionCommit0(engine_)) != ERROR_SUCCESS) {
+    FwpmTransactionAbort0(engine_);
+    logger_->error("Failed to permit endpoint in the kill switch: error {}", result);
+    return false;
+  }
+
+  endpoint_filters_.emplace(key, std::move(filter_ids));
+  return true;
+}
+
+bool KillSwitch::RemoveEndpoint(const SOCKADDR_INET &endpoint) {
+  EndpointKey key;
+  if (!ToEndpointKey(endpoint, key)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto filters = endpoint_filters_.find(key);
+  if (!engine_ || filters == endpoint_filters_.end()) {
+    return true;
+  }
+
+  DWORD result = FwpmTransactionBegin0(engine_, 0);
+  if (result != ERROR_SUCCESS) {
+    logger_->error("Failed to begin kill switch transaction: error {}", result);
+    return false;
+  }
+  bool ok = true;
+  for (UINT64 filter_id : filters->second) {
+    result = FwpmFilterDeleteById0(engine_, filter_id);
+    ok = ok && result == ERROR_SUCCESS;
+  }
+  if (!ok || (result = FwpmTransactionCommit0(engine_)) != ERROR_SUCCESS) {
+    FwpmTransactionAbort0(engine_);
+    logger_->error("Failed to remove endpoint from the kill switch: error {}", result);
+    return false;
+  }
+
+  endpoint_filters_.erase(filters);
+  return true;
+}
+
+void KillSwitch::Stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  StopLocked();
+}
+
+bool KillSwitch::IsActive() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return engine_ != nullptr;
+}
+
+bool KillSwitch::ToEndpointKey(const SOCKADDR_INET &endpoint, EndpointKey &key) {
+  if (endpoint.si_family == AF_INET) {
+    key = EndpointKey(IpPrefix::From(endpoint, 32), ntohs(endpoint.Ipv4.sin_port));
+    return true;
+  }
+  if (endpoint.si_family == AF_INET6) {
+    key = EndpointKey(IpPrefix::From(endpoint, 128), ntohs(endpoint.Ipv6.sin6_port));
+    return true;
+  }
+  return false;
+}
+
+bool KillSwitch::InstallLocked(const NET_LUID &tunnel_luid, const std::vector<EndpointKey> &endpoints) {
+  // Dynamic: should the process go away without Stop, the engine removes every filter with the session
+  FWPM_SESSION0 session = {};
+  session.displayData.name = kName;
+  session.flags = FWPM_SESSION_FLAG_DYNAMIC;
+
+  DWORD result = FwpmEngineOpen0(nullptr, RPC_C_AUTHN_WINNT, nullptr, &session, &engine_);
+  if (result != ERROR_SUCCESS) {
+    engine_ = nullptr;
+    logger_->error("Failed to open the filtering engine: error {}", result);
+    return false;
+  }
+  if (UuidCreate(&sublayer_key_) != RPC_S_OK) {
+    logger_->error("Failed to create the kill switch sublayer key");
+    StopLocked();
+    return false;
+  }
+  tunnel_luid_ = tunnel_luid;
+
+  result = FwpmTransactionBegin0(engine_, 0);
+  if (result != ERROR_SUCCESS) {
+    logger_->error("Failed to begin kill switch transaction: error {}", result);
+    StopLocked();
+    return false;
+  }
+
+  FWPM_SUBLAYER0 sublayer = {};
+  sublayer.subLayerKey = sublayer_key_;
+  sublayer.displayData.name = kName;
+  sublayer.weight = kSublayerWeight;
+  result = FwpmSubLayerAdd0(engine_, &sublayer, nullptr);
+
+  bool ok = result == ERROR_SUCCESS && AddBaseFiltersLocked();
+  std::map<EndpointKey, std::vector<UINT64>> endpoint_filters;
+  for (size_t i = 0; ok && i < endpoints.size(); i++) {
+    if (endpoint_filters.count(endpoints[i]) == 0) {
+      ok = AddEndpointFiltersLocked(endpoints[i], endpoint_filters[endpoints[i]]);
+    }
+  }
+  if (ok) {
+    result = FwpmTransactionCommit0(engine_);
+    ok = result == ERROR_SUCCESS;
+  }
+
+  if (!ok) {
+    FwpmTransactionAbort0(engine_);
+    logger_->error("Failed to install the kill switch: error {}", result);
+    StopLocked();
+    return false;
+  }
+
+  endpoint_filters_ = std::move(endpoint_filters);
+  logger_->info("Kill switch installed with {} permitted endpoints", endpoint_filters_.size());
+  return true;
+}
+
+bool KillSwitch::UpdateEndpointsLocked(const std::vector<EndpointKey> &endpoints) {
+  std::set<EndpointKey> wanted(endpoints.begin(), endpoints.end());
+
+  DWORD result = FwpmTransactionBegin0(engine_, 0);
+  if (result != ERROR_SUCCESS) {
+    logger_->error("Failed to begin kill switch transaction: error {}", result);
+    return false;
+  }
+
+  // Only the difference goes into the transaction, the filters of unchanged endpoints stay as they are
+  bool ok = true;
+  size_t removed = 0;
+  for (const auto &entry : endpoint_filters_) {
+    if (wanted.count(entry.first) > 0) {
+      continue;
+    }
+    for (UINT64 filter_id : entry.second) {
+      result = FwpmFilterDeleteById0(engine_, filter_id);
+      ok = ok && result == ERROR_SUCCESS;
+    }
+    removed++;
+  }
+
+  std::map<EndpointKey, std::vector<UINT64>> added;
+  for (const auto &endpoint : wanted) {
+    if (ok && endpoint_filters_.count(endpoint) == 0) {
+      ok = AddEndpointFiltersLocked(endpoint, added[endpoint]);
+    }
+  }
+  if (ok) {
+    result = FwpmTransactionCommit0(engine_);
+    ok = result == ERROR_SUCCESS;
+  }
+
+  if (!ok) {
+    FwpmTransactionAbort0(engine_);
+    logger_->error("Failed to update the kill switch endpoints: error {}", result);
+    return false;
+  }
+
+  for (auto it = endpoint_filters_.begin(); it != endpoint_filters_.end();) {
+    it = wanted.count(it->first) > 0 ? std::next(it) : endpoint_filters_.erase(it);
+  }
+  endpoint_filters_.insert(added.begin(), added.end());
+  if (removed > 0 || !added.empty()) {
+    logger_->info("Kill switch endpoints updated: {} added, {} removed", added.size(), removed);
+  }
+  return true;
+}
+
+void KillSwitch::StopLocked() {
+  if (engine_) {
+    // Closing the dynamic session deletes the sublayer and all of its filters at once
+    FwpmEngineClose0(engine_);
+    engine_ = nullptr;
+    logger_->info("Kill switch removed");
+  }
+  endpoint_filters_.clear();
+  tunnel_luid_ = {};
+}
+
+bool KillSwitch::AddBaseFiltersLocked() {
+  UINT64 tunnel_luid = tunnel_luid_.Value;
+
+  for (const GUID *layer : kAllLayers) {
+    bool v4 = IsV4Layer(layer);
+
+    // The tunnel itself
+    FWPM_FILTER_CONDITION0 tunnel = Condition(FWPM_CONDITION_IP_LOCAL_INTERFACE, FWP_MATCH_EQUAL);
+    tunnel.conditionValue.type = FWP_UINT64;
+    tunnel.conditionValue.uint64 = &tunnel_luid;
+    if (!AddFilterLocked(*layer, kPermitWeight, FWP_ACTION_PERMIT, &tunnel, 1)) {
+      return false;
+    }
+
+    FWPM_FILTER_CONDITION0 loopback = Condition(FWPM_CONDITION_FLAGS, FWP_MATCH_FLAGS_ALL_SET);
+    loopback.conditionValue.type = FWP_UINT32;
+    loopback.conditionValue.uint32 = FWP_CONDITION_FLAG_IS_LOOPBACK;
+    if (!AddFilterLocked(*layer, kPermitWeight, FWP_ACTION_PERMIT, &loopback, 1)) {
+      return false;
+    }
+
+    // DHCP, or the physical interfaces would lose their leases while the tunnel is down
+    FWPM_FILTER_CONDITION0 dhcp[] = {
+        Uint8Condition(FWPM_CONDITION_IP_PROTOCOL, kProtocolUdp),
+        Uint16Condition(FWPM_CONDITION_IP_LOCAL_PORT, v4 ? 68 : 546),
+        Uint16Condition(FWPM_CONDITION_IP_REMOTE_PORT, v4 ? 67 : 547),
+    };
+    if (!AddFilterLocked(*layer, kPermitWeight, FWP_ACTION_PERMIT, dhcp, 3)) {
+      return false;
+    }
+
+    if (!AddFilterLocked(*layer, kBlockWeight, FWP_ACTION_BLOCK, nullptr, 0)) {
+      return false;
+    }
+  }
+
+  // DNS from this process only, endpoint hostnames cannot resolve through a tunnel that is not up yet
+  wchar_t module_path[MAX_PATH];
+  DWORD length = GetModuleFileNameW(nullptr, module_path, MAX_PATH);
+  FWP_BYTE_BLOB *app_id = nullptr;
+  if (length == 0 || length == MAX_PATH || FwpmGetAppIdFromFileName0(module_path, &app_id) != ERROR_SUCCESS) {
+    logger_->warn("Kill switch blocks DNS for endpoint hostnames, the application ID is unavailable");
+    return true;
+  }
+
+  bool ok = true;
+  for (const GUID *layer : kConnectLayers) {
+    for (UINT8 protocol : {kProtocolUdp, kProtocolTcp}) {
+      FWPM_FILTER_CONDITION0 dns[] = {
+          Condition(FWPM_CONDITION_ALE_APP_ID, FWP_MATCH_EQUAL),
+          Uint8Condition(FWPM_CONDITION_IP_PROTOCOL, protocol),
+          Uint16Condition(FWPM_CONDITION_IP_REMOTE_PORT, 53),
+      };
+      dns[0].conditionValue.type = FWP_BYTE_BLOB_TYPE;
+      dns[0].conditionValue.byteBlob = app_id;
+      ok = ok && AddFilterLocked(*layer, kPermitWeight, FWP_ACTION_PERMIT, dns, 3);
+    }
+  }
+  FwpmFreeMemory0(reinterpret_cast<void **>(&app_id));
+  return ok;
+}
+
+bool KillSwitch::AddEndpointFiltersLocked(const EndpointKey &endpoint, std::vector<UINT64> &filter_ids) {
+  bool v4 = endpoint.first.family == AF_INET;
+  FWP_BYTE_ARRAY16 v6_address;
+  memcpy(v6_address.byteArray16, endpoint.first.address, sizeof(v6_address.byteArray16));
+
+  FWPM_FILTER_CONDITION0 conditions[] = {
+      Condition(FWPM_CONDITION_IP_REMOTE_ADDRESS, FWP_MATCH_EQUAL),
+      Uint8Condition(FWPM_CONDITION_IP_PROTOCOL, kProtocolUdp),
+      Uint16Condition(FWPM_CONDITION_IP_REMOTE_PORT, endpoint.second),
+  };
+  if (v4) {
+    UINT32 address;
+    memcpy(&address, endpoint.first.address, sizeof(address));
+    conditions[0].conditionValue.type = FWP_UINT32;
+    conditions[0].conditionValue.uint32 = ntohl(address);
+  } else {
+    conditions[0].conditionValue.type = FWP_BYTE_ARRAY16_TYPE;
+    conditions[0].conditionValue.byteArray16 = &v6_address;
+  }
+
+  // Outgoing handshakes and the first packet the endpoint sends us
+  const GUID &connect = v4 ? FWPM_LAYER_ALE_AUTH_CONNECT_V4 : FWPM_LAYER_ALE_AUTH_CONNECT_V6;
+  const GUID &recv_accept = v4 ? FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V4 : FWPM_LAYER_ALE_AUTH_RECV_ACCEPT_V6;
+  for (const GUID *layer : {&connect, &recv_accept}) {
+    UINT64 filter_id = 0;
+    if (!AddFilterLocked(*layer, kPermitWeight, FWP_ACTION_PERMIT, conditions, 3, &filter_id)) {
+      return false;
+    }
+    filter_ids.push_back(filter_id);
+  }
+  return true;
+}
+
+bool KillSwitch::AddFilterLocked(const GUID &layer, UINT8 weight, UINT32 action, FWPM_FILTER_CONDITION0 *conditions,
+                                 UINT32 condition_count, UINT64 *filter_id) {
+  FWPM_FILTER0 filter = {};
+  filter.displayData.name = kName;
+  filter.layerKey = layer;
+  filter.subLayerKey = sublayer_key_;
+  filter.weight.type = FWP_UINT8;
+  filter.weight.uint8 = weight;
+  filter.numFilterConditions = condition_count;
+  filter.filterCondition = conditions;
+  filter.action.type = action;
+
+  DWORD result = FwpmFilterAdd0(engine_, &filter, nullptr, filter_id);
+  if (result != ERROR_SUCCESS) {
+    logger_->error("Failed to add kill switch filter: error {}", result);
+    return false;
+  }
+  return true;
+}
+
+} // namespace wireguard_dart
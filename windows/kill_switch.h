@@ -0,0 +1,80 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+#include <fwpmu.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "plugin_logger.h"
+#include "wireguard_network_config.h"
+
+namespace wireguard_dart {
+
+/**
+ * Blocks all traffic that does not go through the tunnel, using the Windows Filtering Platform.
+ * Everything lives in a sublayer of its own in a dynamic WFP session, so the filters go away with the
+ * session if the process dies. Permitted are: the tunnel interface, loopback, DHCP and DHCPv6, UDP to and
+ * from each peer endpoint, and DNS lookups by this process so that endpoint hostnames can still resolve.
+ *
+ * Each change is one filtering transaction, so there is never a moment with only part of the rules in place.
+ */
+class KillSwitch {
+public:
+  KillSwitch();
+  ~KillSwitch();
+
+  KillSwitch(const KillSwitch &) = delete;
+  KillSwitch &operator=(const KillSwitch &) = delete;
+
+  /**
+   * Install the kill switch for the tunnel, or bring the endpoint rules of an installed one up to date,
+   * adding and deleting only the filters of endpoints that changed
+   * @param tunnel_luid The tunnel interface
+   * @param endpoints The peer endpoints, with their ports
+   */
+  bool Start(const NET_LUID &tunnel_luid, const std::vector<SOCKADDR_INET> &endpoints);
+
+  // Permit one more endpoint, like a resolved hostname; a no-op when not active
+  bool AddEndpoint(const SOCKADDR_INET &endpoint);
+
+  // Stop permitting an endpoint, like one of a removed peer; a no-op when not active or not permitted
+  bool RemoveEndpoint(const SOCKADDR_INET &endpoint);
+
+  // Remove every filter, which unblocks all traffic
+  void Stop();
+
+  bool IsActive() const;
+
+private:
+  // Endpoint address and port
+  using EndpointKey = std::pair<IpPrefix, WORD>;
+
+  static bool ToEndpointKey(const SOCKADDR_INET &endpoint, EndpointKey &key);
+
+  bool InstallLocked(const NET_LUID &tunnel_luid, const std::vector<EndpointKey> &endpoints);
+  bool UpdateEndpointsLocked(const std::vector<EndpointKey> &endpoints);
+  void StopLocked();
+
+  // These run inside a transaction that the caller commits
+  bool AddBaseFiltersLocked();
+  bool AddEndpointFiltersLocked(const EndpointKey &endpoint, std::vector<UINT64> &filter_ids);
+  bool AddFilterLocked(const GUID &layer, UINT8 weight, UINT32 action, FWPM_FILTER_CONDITION0 *conditions,
+                       UINT32 condition_count, UINT64 *filter_id = nullptr);
+
+  mutable std::mutex mutex_;
+  HANDLE engine_ = nullptr;
+  GUID sublayer_key_ = {};
+  NET_LUID tunnel_luid_ = {};
+  std::map<EndpointKey, std::vector<UINT64>> endpoint_filters_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,312 @@
+#include "link_quality_prober.h"
+
+#include <icmpapi.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "plugin_logger.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr WORD kPayloadSize = 32;
+// Room for the reply header, the echoed payload and an ICMP error
+constexpr DWORD kReplySize =
+    sizeof(ICMP_ECHO_REPLY) + sizeof(ICMPV6_ECHO_REPLY) + kPayloadSize + 8 + sizeof(IO_STATUS_BLOCK);
+
+bool SameAddress(const SOCKADDR_INET &a, const SOCKADDR_INET &b) {
+  if (a.si_family != b.si_family) {
+    return false;
+  }
+  return a.si_family == AF_INET ? a.Ipv4.sin_addr.s_addr == b.Ipv4.sin_addr.s_addr
+                                : memcmp(&a.Ipv6.sin6_addr, &b.Ipv6.sin6_addr, sizeof(IN6_ADDR)) == 0;
+}
+
+} // namespace
+
+struct LinkQualityProber::Probe {
+  ~Probe() {
+    if (event) {
+      CloseHandle(event);
+    }
+  }
+
+  // Send the next echo, or count a loss if it could not go out
+  void Send(HANDLE icmp);
+  // Count the echo that completed as answered or lost
+  void TakeReply();
+
+  SOCKADDR_INET source = {};
+  SOCKADDR_INET address = {};
+  LinkQualityWindow window;
+  // Set once the echo in flight was answered or timed out
+  HANDLE event = nullptr;
+  bool pending = false;
+  // Filled by the echo in flight, which keeps the probe alive until it completed
+  alignas(void *) BYTE reply[kReplySize];
+};
+
+struct LinkQualityProber::State {
+  explicit State(IoReactor *reactor) : reactor(reactor) {}
+  ~State();
+
+  IoReactor *reactor;
+  std::mutex mutex;
+  bool stopped = false;
+  bool power_saving = false;
+  IoReactor::TimerId timer = 0;
+  HANDLE icmp4 = INVALID_HANDLE_VALUE;
+  HANDLE icmp6 = INVALID_HANDLE_VALUE;
+  bool icmp_failed = false;
+  std::map<std::string, std::unordered_map<PeerKey, std::unique_ptr<Probe>, PeerKeyHash>> tunnels;
+  // Probes that were dropped with an echo in flight, until it completed
+  std::vector<std::unique_ptr<Probe>> retired;
+  PluginLogger logger;
+};
+
+void LinkQualityProber::Probe::Send(HANDLE icmp) {
+  static const BYTE kPayload[kPayloadSize] = {};
+  ResetEvent(event);
+  DWORD replies;
+  if (address.si_family == AF_INET) {
+    replies = IcmpSendEcho2Ex(icmp, event, nullptr, nullptr, source.Ipv4.sin_addr.s_addr, address.Ipv4.sin_addr.s_addr,
+                              const_cast<BYTE *>(kPayload), kPayloadSize, nullptr, reply, kReplySize, kTimeoutMs);
+  } else {
+    sockaddr_in6 from = source.Ipv6;
+    sockaddr_in6 to = address.Ipv6;
+    replies = Icmp6SendEcho2(icmp, event, nullptr, nullptr, &from, &to, const_cast<BYTE *>(kPayload), kPayloadSize,
+                             nullptr, reply, kReplySize, kTimeoutMs);
+  }
+  if (replies != 0) {
+    TakeReply();
+  } else if (GetLastError() == ERROR_IO_PENDING) {
+    pending = true;
+  } else {
+    // Failed before it went out, as it does while the tunnel is down and its address gone
+    window.RecordLoss();
+  }
+}
+
+void LinkQualityProber::Probe::TakeReply() {
+  pending = false;
+  if (address.si_family == AF_INET) {
+    const auto *echo = reinterpret_cast<const ICMP_ECHO_REPLY *>(reply);
+    if (IcmpParseReplies(reply, kReplySize) > 0 && echo->Status == IP_SUCCESS) {
+      window.RecordReply(echo->RoundTripTime);
+      return;
+    }
+  } else {
+    const auto *echo = reinterpret_cast<const ICMPV6_ECHO_REPLY *>(reply);
+    if (Icmp6ParseReplies(reply, kReplySize) > 0 && echo->Status == IP_SUCCESS) {
+      window.RecordReply(echo->RoundTripTime);
+      return;
+    }
+  }
+  window.RecordLoss();
+}
+
+LinkQualityProber::State::~State() {
+  // The echoes in flight write into their probes until they complete, which takes at most their timeout
+  auto wait = [](const std::unique_ptr<Probe> &probe) {
+    if (probe->pending) {
+      WaitForSingleObject(probe->event, 2 * kTimeoutMs);
+    }
+  };
+  std::for_each(retired.begin(), retired.end(), wait);
+  for (const auto &tunnel : tunnels) {
+    for (const auto &entry : tunnel.second) {
+      wait(entry.second);
+    }
+  }
+  if (icmp4 != INVALID_HANDLE_VALUE) {
+    IcmpCloseHandle(icmp4);
+  }
+  if (icmp6 != INVALID_HANDLE_VALUE) {
+    IcmpCloseHandle(icmp6);
+  }
+}
+
+LinkQualityProber::LinkQualityProber(IoReactor *reactor) : state_(std::make_shared<State>(reactor)) {}
+
+LinkQualityProber::~LinkQualityProber() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  state_->stopped = true;
+  // A round already running finds it stopped, and the state goes with the last of them
+  if (state_->timer != 0) {
+    state_->reactor->Cancel(state_->timer);
+    state_->timer = 0;
+  }
+}
+
+void LinkQualityProber::SetTunnel(const std::string &tunnel_name, const WireguardConfigParser &config) {
+  // Echoes go out from the tunnel's first address of their family
+  SOCKADDR_INET source4 = {};
+  SOCKADDR_INET source6 = {};
+  for (const WIREGUARD_ALLOWED_IP &address : config.GetInterface().addresses) {
+    if (address.AddressFamily == AF_INET && source4.si_family == AF_UNSPEC) {
+      source4.Ipv4.sin_family = AF_INET;
+      source4.Ipv4.sin_addr = address.Address.V4;
+    } else if (address.AddressFamily == AF_INET6 && source6.si_family == AF_UNSPEC) {
+      source6.Ipv6.sin6_family = AF_INET6;
+      source6.Ipv6.sin6_addr = address.Address.V6;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  auto previous = state_->tunnels.find(tunnel_name);
+  std::unordered_map<PeerKey, std::unique_ptr<Probe>, PeerKeyHash> probes;
+  for (const ProbeAddress &probe_address : config.GetProbeAddresses()) {
+    const auto *peer =
+        reinterpret_cast<const WIREGUARD_PEER *>(config.GetConfiguration().At(probe_address.peer_offset));
+    PeerKey key;
+    memcpy(key.data(), peer->PublicKey, key.size());
+    const SOCKADDR_INET &source = probe_address.address.si_family == AF_INET ? source4 : source6;
+    if (source.si_family == AF_UNSPEC) {
+      state_->logger->warn("Tunnel {} has no address to probe a peer from in the family of its ProbeAddress",
+                           tunnel_name);
+      continue;
+    }
+
+    std::unique_ptr<Probe> probe;
+    if (previous != state_->tunnels.end()) {
+      auto kept = previous->second.find(key);
+      if (kept != previous->second.end() && SameAddress(kept->second->address, probe_address.address) &&
+          SameAddress(kept->second->source, source)) {
+        probe = std::move(kept->second);
+        previous->second.erase(kept);
+      }
+    }
+    if (!probe) {
+      probe = std::make_unique<Probe>();
+      probe->event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+      if (!probe->event) {
+        state_->logger->warn("Failed to create the event of a link quality probe: Windows error {}", GetLastError());
+        continue;
+      }
+      probe->source = source;
+      probe->address = probe_address.address;
+    }
+    probes[key] = std::move(probe);
+  }
+
+  if (previous != state_->tunnels.end()) {
+    for (auto &entry : previous->second) {
+      if (entry.second->pending) {
+        state_->retired.push_back(std::move(entry.second));
+      }
+    }
+    state_->tunnels.erase(previous);
+  }
+  if (probes.empty()) {
+    return;
+  }
+  state_->logger->info("Probing the link quality of {} peers of tunnel {}", probes.size(), tunnel_name);
+  state_->tunnels.emplace(tunnel_name, std::move(probes));
+  // Not right away, so the first echoes do not go out before the first handshake could
+  if (state_->timer == 0) {
+    ScheduleLocked(state_, state_->power_saving ? kPowerSavingInterval : kInterval);
+  }
+}
+
+void LinkQualityProber::RemoveTunnel(const std::string &tunnel_name) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  auto tunnel = state_->tunnels.find(tunnel_name);
+  if (tunnel == state_->tunnels.end()) {
+    return;
+  }
+  for (auto &entry : tunnel->second) {
+    if (entry.second->pending) {
+      state_->retired.push_back(std::move(entry.second));
+    }
+  }
+  state_->tunnels.erase(tunnel);
+  // The retired probes are left to the destructor; nothing else needs another round
+  if (state_->tunnels.empty() && state_->timer != 0 && state_->reactor->Cancel(state_->timer)) {
+    state_->timer = 0;
+  }
+}
+
+void LinkQualityProber::SetPowerSaving(bool saving) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  state_->power_saving = saving;
+  // The round already waiting moves to the new interval; one running schedules the next with it anyway
+  if (state_->timer != 0 && state_->reactor->Cancel(state_->timer)) {
+    state_->timer = 0;
+    ScheduleLocked(state_, saving ? kPowerSavingInterval : kInterval);
+  }
+}
+
+void LinkQualityProber::Fill(const std::string &tunnel_name, std::vector<PeerStatistics> &peers) const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  auto tunnel = state_->tunnels.find(tunnel_name);
+  if (tunnel == state_->tunnels.end()) {
+    return;
+  }
+  for (PeerStatistics &peer : peers) {
+    auto probe = tunnel->second.find(peer.public_key);
+    if (probe != tunnel->second.end()) {
+      peer.link_quality = probe->second->window.Summarize();
+    }
+  }
+}
+
+void LinkQualityProber::ScheduleLocked(const std::shared_ptr<State> &state, std::chrono::milliseconds delay) {
+  state->timer = state->reactor->Schedule(delay, [state]() { Round(state); });
+  if (state->timer == 0) {
+    state->logger->warn("Link quality cannot be probed without the I/O reactor");
+  }
+}
+
+void LinkQualityProber::Round(const std::shared_ptr<State> &state) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->timer = 0;
+  if (state->stopped) {
+    return;
+  }
+
+  auto completed = [](const std::unique_ptr<Probe> &probe) {
+    return WaitForSingleObject(probe->event, 0) == WAIT_OBJECT_0;
+  };
+  state->retired.erase(std::remove_if(state->retired.begin(), state->retired.end(), completed),
+                       state->retired.end());
+
+  for (auto &tunnel : state->tunnels) {
+    for (auto &entry : tunnel.second) {
+      Probe &probe = *entry.second;
+      if (probe.pending) {
+        // Still out past its timeout, so no other echo is sent alongside it
+        if (!completed(entry.second)) {
+          continue;
+        }
+        probe.TakeReply();
+      }
+
+      bool ipv4 = probe.address.si_family == AF_INET;
+      HANDLE &icmp = ipv4 ? state->icmp4 : state->icmp6;
+      if (icmp == INVALID_HANDLE_VALUE) {
+        icmp = ipv4 ? IcmpCreateFile() : Icmp6CreateFile();
+        if (icmp == INVALID_HANDLE_VALUE) {
+          if (!state->icmp_failed) {
+            state->icmp_failed = true;
+            state->logger->error("Failed to open an ICMP handle for link quality probes: Windows error {}",
+                                 GetLastError());
+          }
+          continue;
+        }
+      }
+      probe.Send(icmp);
+    }
+  }
+
+  if (!state->tunnels.empty()) {
+    ScheduleLocked(state, state->power_saving ? kPowerSavingInterval : kInterval);
+  }
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "io_reactor.h"
+#include "peer_statistics.h"
+#include "wireguard_config_parser.h"
+
+namespace wireguard_dart {
+
+/**
+ * Measures the link to the peers with a ProbeAddress: every kInterval, one ICMP echo goes to each of them
+ * through the tunnel, from the tunnel's own address of the family so that none can leave through another
+ * interface. The echoes are sent with IcmpSendEcho2Ex and Icmp6SendEcho2 without waiting; the next round, on the
+ * same reactor timer, takes their replies into the peer's LinkQualityWindow before it sends new ones. An echo
+ * still out by then is not followed by another. There are no rounds while no peer is probed, and while power
+ * is saved they come every kPowerSavingInterval.
+ */
+class LinkQualityProber {
+public:
+  static constexpr std::chrono::milliseconds kInterval{2000};
+  static constexpr std::chrono::milliseconds kPowerSavingInterval{30000};
+  // Below kInterval, so an echo is answered or given up on before the round that takes it in
+  static constexpr DWORD kTimeoutMs = 1000;
+
+  // The reactor has to outlive the prober
+  explicit LinkQualityProber(IoReactor *reactor);
+  ~LinkQualityProber();
+
+  LinkQualityProber(const LinkQualityProber &) = delete;
+  LinkQualityProber &operator=(const LinkQualityProber &) = delete;
+
+  /**
+   * Probe the peers of config that have a ProbeAddress, replacing those the tunnel had. A peer probed at the
+   * same address as before keeps its window.
+   */
+  void SetTunnel(const std::string &tunnel_name, const WireguardConfigParser &config);
+  void RemoveTunnel(const std::string &tunnel_name);
+
+  // On battery saver or with the display off, see PowerMonitor
+  void SetPowerSaving(bool saving);
+
+  // Set the link_quality of the tunnel's peers that are probed
+  void Fill(const std::string &tunnel_name, std::vector<PeerStatistics> &peers) const;
+
+private:
+  struct Probe;
+  struct State;
+
+  // Take in the replies of the round before and send the next echoes, on a reactor thread
+  static void Round(const std::shared_ptr<State> &state);
+  static void ScheduleLocked(const std::shared_ptr<State> &state, std::chrono::milliseconds delay);
+
+  // Shared with the timer task, which may still run while the prober is destroyed
+  std::shared_ptr<State> state_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,45 @@
+#include "log_format.h"
+
+#include <cstdio>
+#include <utility>
+
+namespace wireguard_dart {
+
+void CachedTimestampFlag::format(const spdlog::details::log_msg &msg, const std::tm &tm_time,
+                                 spdlog::memory_buf_t &dest) {
+  auto since_epoch = msg.time.time_since_epoch();
+  auto second = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+  if (second != cached_second_) {
+    // tm_time is the local time of the record, which the pattern formatter itself only converts once per second
+    std::snprintf(cached_, sizeof(cached_), "%04d-%02d-%02d %02d:%02d:%02d.", tm_time.tm_year + 1900,
+                  tm_time.tm_mon + 1, tm_time.tm_mday, tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+    cached_second_ = second;
+  }
+  dest.append(cached_, cached_ + sizeof(cached_) - 1);
+  auto millis = static_cast<unsigned>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch - second).count());
+  const char digits[3] = {static_cast<char>('0' + millis / 100), static_cast<char>('0' + millis / 10 % 10),
+                          static_cast<char>('0' + millis % 10)};
+  dest.append(digits, digits + 3);
+}
+
+std::unique_ptr<spdlog::custom_flag_formatter> CachedTimestampFlag::clone() const {
+  return std::make_unique<CachedTimestampFlag>();
+}
+
+std::string LogPatternFor(spdlog::level::level_enum level, const std::string &override_pattern) {
+  if (!override_pattern.empty()) {
+    return override_pattern;
+  }
+  return level <= spdlog::level::debug ? kDebugLogPattern : kLeanLogPattern;
+}
+
+std::unique_ptr<spdlog::pattern_formatter> MakeLogFormatter(const std::string &pattern, std::string eol) {
+  auto formatter = std::make_unique<spdlog::pattern_formatter>(spdlog::pattern_time_type::local, std::move(eol));
+  formatter->add_flag<CachedTimestampFlag>(kCachedTimestampFlag).set_pattern(pattern);
+  // Which set_pattern only turns on for the built-in time flags; the conversion is cached per second as well
+  formatter->need_localtime(true);
+  return formatter;
+}
+
+} // namespace wireguard_dart
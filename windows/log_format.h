@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "spdlog/common.h"
+#include "spdlog/details/os.h"
+#include "spdlog/formatter.h"
+#include "spdlog/pattern_formatter.h"
+
+namespace wireguard_dart {
+
+// The date and time to the millisecond, like %Y-%m-%d %H:%M:%S.%e, with all but the milliseconds formatted once
+// per second
+constexpr char kCachedTimestampFlag = '*';
+
+// The file log's records: the cached timestamp, the level as one letter and the message. The driver's lines carry
+// kDriverLogPrefix as their source tag, the plugin's own lines none.
+constexpr char kLeanLogPattern[] = "%* %L %v";
+// The same with the ID of the logging thread, which takes a lookup per record, only while logging at debug level
+constexpr char kDebugLogPattern[] = "%* %L %t %v";
+
+/**
+ * Formats kCachedTimestampFlag. spdlog's own time flags format each field of the cached broken-down time again for
+ * every record; this keeps the text up to the seconds and only appends the milliseconds while the second has not
+ * changed. A formatter has one per sink, used under the sink's mutex.
+ */
+class CachedTimestampFlag : public spdlog::custom_flag_formatter {
+public:
+  void format(const spdlog::details::log_msg &msg, const std::tm &tm_time, spdlog::memory_buf_t &dest) override;
+  std::unique_ptr<spdlog::custom_flag_formatter> clone() const override;
+
+private:
+  std::chrono::seconds cached_second_{-1};
+  // "YYYY-MM-DD HH:MM:SS."
+  char cached_[21] = {};
+};
+
+// The pattern the host app gave, otherwise the lean one for the level
+std::string LogPatternFor(spdlog::level::level_enum level, const std::string &override_pattern);
+
+// A local-time formatter of the pattern that also knows kCachedTimestampFlag, ending records with eol
+std::unique_ptr<spdlog::pattern_formatter> MakeLogFormatter(const std::string &pattern,
+                                                            std::string eol = spdlog::details::os::default_eol);
+
+} // namespace wireguard_dart
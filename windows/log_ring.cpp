@@ -0,0 +1,50 @@
+#include "log_ring.h"
+
+namespace wireguard_dart {
+
+LogRing::LogRing(size_t capacity) : capacity_(capacity), queue_(capacity) {}
+
+void LogRing::SetCapacity(size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (capacity == capacity_) {
+    return;
+  }
+  spdlog::details::circular_q<spdlog::details::log_msg_buffer> queue(capacity);
+  size_t size = queue_.size();
+  for (size_t i = size > capacity ? size - capacity : 0; i < size; i++) {
+    queue.push_back(spdlog::details::log_msg_buffer(queue_.at(i)));
+  }
+  queue_ = std::move(queue);
+  capacity_ = capacity;
+}
+
+std::vector<spdlog::details::log_msg_buffer> LogRing::LastRaw() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<spdlog::details::log_msg_buffer> records;
+  records.reserve(queue_.size());
+  for (size_t i = 0; i < queue_.size(); i++) {
+    records.push_back(queue_.at(i));
+  }
+  return records;
+}
+
+std::vector<spdlog::details::log_msg_buffer> LogRing::TakeRaw() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<spdlog::details::log_msg_buffer> records;
+  records.reserve(queue_.size());
+  while (!queue_.empty()) {
+    records.push_back(std::move(queue_.front()));
+    queue_.pop_front();
+  }
+  return records;
+}
+
+size_t LogRing::MemoryBytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // circular_q keeps one slot more than it holds
+  return (capacity_ + 1) * sizeof(spdlog::details::log_msg_buffer);
+}
+
+void LogRing::sink_it_(const spdlog::details::log_msg &msg) { queue_.push_back(spdlog::details::log_msg_buffer{msg}); }
+
+} // namespace wireguard_dart
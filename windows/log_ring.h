@@ -0,0 +1,40 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "spdlog/details/circular_q.h"
+#include "spdlog/details/log_msg_buffer.h"
+#include "spdlog/sinks/base_sink.h"
+
+namespace wireguard_dart {
+
+/**
+ * The latest records of the file logger, like spdlog's ringbuffer_sink, but with a capacity that can change while
+ * the logger writes to it. Every slot is allocated up front, so low-memory mode shrinks it.
+ */
+class LogRing : public spdlog::sinks::base_sink<std::mutex> {
+public:
+  explicit LogRing(size_t capacity);
+
+  // Keeps the newest records that fit
+  void SetCapacity(size_t capacity);
+
+  // The records, oldest first
+  std::vector<spdlog::details::log_msg_buffer> LastRaw();
+  // The same, leaving the ring empty
+  std::vector<spdlog::details::log_msg_buffer> TakeRaw();
+
+  // The slots, each with the inline buffer its message is formatted into; longer messages take more
+  size_t MemoryBytes();
+
+protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override;
+  void flush_() override {}
+
+private:
+  size_t capacity_;
+  spdlog::details::circular_q<spdlog::details::log_msg_buffer> queue_;
+};
+
+} // namespace wireguard_dart
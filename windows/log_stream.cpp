@@ -0,0 +1,191 @@
+#include "log_stream.h"
+
+#include <cstring>
+
+#include "adapter_log.h"
+#include "encodable_keys.h"
+#include "perf_stats.h"
+#include "spdlog/sinks/base_sink.h"
+#include "utils.h"
+
+namespace wireguard_dart {
+
+// Hands the records that made it past the duplicate filter to the stream, until the stream is gone
+class LogStream::RecordSink : public spdlog::sinks::base_sink<std::mutex> {
+public:
+  explicit RecordSink(LogStream *stream) : stream_(stream) {}
+
+  // Waits for a record being handed over
+  void Detach() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stream_ = nullptr;
+  }
+
+protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override {
+    if (stream_) {
+      stream_->Push(msg);
+    }
+  }
+
+  void flush_() override {}
+
+private:
+  LogStream *stream_;
+};
+
+LogStream::LogStream(PlatformTaskRunner *platform_tasks)
+    : platform_tasks_(platform_tasks),
+      record_sink_(std::make_shared<RecordSink>(this)),
+      filter_(std::make_shared<spdlog::sinks::dup_filter_sink_mt>(kDuplicateWindow)),
+      drain_signal_([this] { Drain(); }) {
+  filter_->add_sink(record_sink_);
+  filter_->set_level(spdlog::level::off);
+}
+
+LogStream::~LogStream() { record_sink_->Detach(); }
+
+std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+LogStream::OnListenInternal(const flutter::EncodableValue *arguments,
+                            std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> &&events) {
+  // Without the platform thread to hand records to, the sink could only be used from the log thread
+  if (!platform_tasks_ || !platform_tasks_->IsValid()) {
+    return std::make_unique<flutter::StreamHandlerError<flutter::EncodableValue>>(
+        "LOG_STREAM_UNAVAILABLE", "The logs stream needs the platform task window", nullptr);
+  }
+  sink_ = std::move(events);
+
+  size_t max_records_per_second = kDefaultMaxRecordsPerSecond;
+  auto min_level = spdlog::level::trace;
+  const auto *args = arguments ? std::get_if<flutter::EncodableMap>(arguments) : nullptr;
+  const auto *rate = args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kMaxRecordsPerSecond)) : nullptr;
+  if (rate && *rate > 0) {
+    max_records_per_second = static_cast<size_t>(*rate);
+  }
+  const auto *min_level_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kMinLevel)) : nullptr;
+  if (min_level_name) {
+    min_level = spdlog::level::from_str(*min_level_name);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.clear();
+    max_records_per_second_ = max_records_per_second;
+    window_start_ = std::chrono::steady_clock::now();
+    window_records_ = 0;
+    dropped_ = 0;
+  }
+  filter_->set_level(min_level);
+  return nullptr;
+}
+
+std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+LogStream::OnCancelInternal(const flutter::EncodableValue *arguments) {
+  filter_->set_level(spdlog::level::off);
+  sink_.reset();
+  return nullptr;
+}
+
+void LogStream::Push(const spdlog::details::log_msg &msg) {
+  Record record;
+  record.level = msg.level;
+  record.timestamp_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(msg.time.time_since_epoch()).count();
+  // The log thread gets the record some time after it was logged, which the wall clock tells
+  auto since_logged = std::chrono::system_clock::now() - msg.time;
+  record.monotonic_us =
+      PerfCounterMicroseconds() - std::chrono::duration_cast<std::chrono::microseconds>(since_logged).count();
+  spdlog::string_view_t payload = msg.payload;
+  size_t prefix_length = sizeof(kDriverLogPrefix) - 1;
+  record.from_driver =
+      payload.size() >= prefix_length && memcmp(payload.data(), kDriverLogPrefix, prefix_length) == 0;
+  if (record.from_driver) {
+    payload = spdlog::string_view_t(payload.data() + prefix_length, payload.size() - prefix_length);
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (now - window_start_ >= std::chrono::seconds(1)) {
+      window_start_ = now;
+      window_records_ = 0;
+    }
+    if (window_records_ >= max_records_per_second_ || pending_.size() >= kMaxPendingRecords) {
+      dropped_++;
+      return;
+    }
+    window_records_++;
+    record.message.assign(payload.data(), payload.size());
+    pending_.push_back(std::move(record));
+  }
+  // One drain for everything pushed until the platform thread gets to it
+  platform_tasks_->Raise(&drain_signal_);
+}
+
+void LogStream::Drain() {
+  std::vector<Record> records;
+  uint64_t dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    records.swap(pending_);
+    dropped = dropped_;
+    dropped_ = 0;
+  }
+  if (!sink_) {
+    return;
+  }
+
+  flutter::EncodableList batch;
+  batch.reserve(records.size() + 1);
+  for (const Record &record : records) {
+    batch.push_back(RecordValue(record));
+  }
+  // Told in the stream itself, logging it would only add to what is dropped
+  if (dropped > 0) {
+    Record record;
+    record.level = spdlog::level::warn;
+    record.timestamp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              std::chrono::system_clock::now().time_since_epoch())
+                              .count();
+    record.from_driver = false;
+    record.message = "Dropped " + std::to_string(dropped) + " log records over the stream's rate";
+    batch.push_back(RecordValue(record));
+  }
+  if (!batch.empty()) {
+    sink_->Success(flutter::EncodableValue(std::move(batch)));
+  }
+}
+
+flutter::EncodableValue LogStream::RecordValue(const Record &record) {
+  // By the names of LogLevel in Dart rather than spdlog's
+  const char *level;
+  switch (record.level) {
+    case spdlog::level::trace:
+      level = "trace";
+      break;
+    case spdlog::level::debug:
+      level = "debug";
+      break;
+    case spdlog::level::warn:
+      level = "warn";
+      break;
+    case spdlog::level::err:
+      level = "error";
+      break;
+    case spdlog::level::critical:
+      level = "critical";
+      break;
+    default:
+      level = "info";
+      break;
+  }
+  flutter::EncodableMap value;
+  value[keys::kLevel] = flutter::EncodableValue(level);
+  value[keys::kTimestamp] = flutter::EncodableValue(record.timestamp_ms);
+  value[keys::kMonotonicUs] = flutter::EncodableValue(record.monotonic_us);
+  value[keys::kSource] = flutter::EncodableValue(record.from_driver ? "wireguard.dll" : "plugin");
+  value[keys::kMessage] = flutter::EncodableValue(record.message);
+  return flutter::EncodableValue(value);
+}
+
+} // namespace wireguard_dart
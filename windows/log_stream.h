@@ -0,0 +1,85 @@
+#pragma once
+
+#include <flutter/encodable_value.h>
+#include <flutter/event_channel.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "platform_task_runner.h"
+#include "spdlog/common.h"
+#include "spdlog/sinks/dup_filter_sink.h"
+
+namespace wireguard_dart {
+
+/**
+ * The logs stream: the records of the plugin's file logger as they are written, each with its level, time, source
+ * and message. Its sink runs on the log thread behind a dup_filter_sink, so a message repeated within
+ * kDuplicateWindow, like the driver's handshake retries, becomes one record and a count of the skipped ones. The
+ * records are rate limited per second and wait in a list until the platform thread drains them, sending all of
+ * them as one event. Without a listener the sink is off and the logger does not call it.
+ */
+class LogStream : public flutter::StreamHandler<flutter::EncodableValue> {
+public:
+  static constexpr std::chrono::seconds kDuplicateWindow{5};
+  static constexpr size_t kDefaultMaxRecordsPerSecond = 200;
+  // Records waiting for the platform thread, past which they are dropped and counted like those over the rate
+  static constexpr size_t kMaxPendingRecords = 2048;
+
+  // Records are sent through platform_tasks, which must outlive the stream
+  explicit LogStream(PlatformTaskRunner *platform_tasks);
+  virtual ~LogStream();
+
+  LogStream(const LogStream &) = delete;
+  LogStream &operator=(const LogStream &) = delete;
+
+  // For the sinks of the file logger; the logger may outlive the stream, which stops taking records when destroyed
+  spdlog::sink_ptr Sink() const { return filter_; }
+
+protected:
+  // The arguments may hold "maxRecordsPerSecond", and "minLevel" to leave out the records below it
+  virtual std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+  OnListenInternal(const flutter::EncodableValue *arguments,
+                   std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> &&events) override;
+
+  virtual std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+  OnCancelInternal(const flutter::EncodableValue *arguments) override;
+
+private:
+  struct Record {
+    spdlog::level::level_enum level;
+    int64_t timestamp_ms;
+    // When it was logged, see PerfCounterMicroseconds
+    int64_t monotonic_us;
+    bool from_driver;
+    std::string message;
+  };
+  class RecordSink;
+
+  // On the log thread, after the duplicate filter
+  void Push(const spdlog::details::log_msg &msg);
+  // On the platform thread
+  void Drain();
+  static flutter::EncodableValue RecordValue(const Record &record);
+
+  PlatformTaskRunner *platform_tasks_;
+  std::shared_ptr<RecordSink> record_sink_;
+  std::shared_ptr<spdlog::sinks::dup_filter_sink_mt> filter_;
+  PlatformTaskRunner::Signal drain_signal_;
+  // Only used on the platform thread
+  std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> sink_;
+
+  // Guards the records and the rate between the log thread and the platform thread
+  std::mutex mutex_;
+  std::vector<Record> pending_;
+  size_t max_records_per_second_ = kDefaultMaxRecordsPerSecond;
+  std::chrono::steady_clock::time_point window_start_;
+  size_t window_records_ = 0;
+  uint64_t dropped_ = 0;
+};
+
+} // namespace wireguard_dart
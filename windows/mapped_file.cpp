@@ -0,0 +1,73 @@
+#include "mapped_file.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+int InPageErrorFilter(DWORD code) {
+  return code == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH;
+}
+
+} // namespace
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const std::wstring &path) {
+  Close();
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) {
+    DWORD error = GetLastError();
+    CloseHandle(file);
+    SetLastError(error);
+    return false;
+  }
+  // A mapping of an empty file cannot be created
+  if (file_size.QuadPart == 0) {
+    CloseHandle(file);
+    return true;
+  }
+
+  // The view keeps the mapping and the file open
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  DWORD error = GetLastError();
+  CloseHandle(file);
+  if (!mapping) {
+    SetLastError(error);
+    return false;
+  }
+  view_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  error = GetLastError();
+  CloseHandle(mapping);
+  if (!view_) {
+    SetLastError(error);
+    return false;
+  }
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  return true;
+}
+
+// No object with a destructor may live in this frame, which __try does not allow
+bool MappedFile::Read(const std::function<void(std::string_view text)> &read) const {
+  __try {
+    read(std::string_view(static_cast<const char *>(view_), size_));
+  } __except (InPageErrorFilter(GetExceptionCode())) {
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::Close() {
+  if (view_) {
+    UnmapViewOfFile(view_);
+  }
+  view_ = nullptr;
+  size_ = 0;
+}
+
+} // namespace wireguard_dart
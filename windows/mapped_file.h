@@ -0,0 +1,43 @@
+#pragma once
+
+#include <windows.h>
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace wireguard_dart {
+
+/**
+ * A file mapped read-only into memory, so that a large file is read in place from the page cache instead of being
+ * copied into a buffer first. The file is opened without write sharing: a writer cannot shorten it under the view,
+ * and a file that is open for writing right now fails to open with ERROR_SHARING_VIOLATION.
+ */
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // false, with GetLastError telling why, when the file cannot be opened or mapped
+  bool Open(const std::wstring &path);
+
+  /**
+   * Calls read with the contents, which are valid only during the call; an empty file has no view and gives an
+   * empty text. A page that cannot be read in, from a network share that went away or a failing disk, raises
+   * EXCEPTION_IN_PAGE_ERROR on access; that ends read midway and gives false, so whatever read was building must
+   * be thrown away.
+   */
+  bool Read(const std::function<void(std::string_view text)> &read) const;
+
+  void Close();
+
+private:
+  const void *view_ = nullptr;
+  size_t size_ = 0;
+};
+
+} // namespace wireguard_dart
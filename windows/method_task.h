@@ -0,0 +1,110 @@
+#pragma once
+
+#include <windows.h>
+
+#include <chrono>
+#include <coroutine>
+#include <functional>
+#include <utility>
+
+#include "io_reactor.h"
+#include "plugin_logger.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+/**
+ * The return type of method handlers written as coroutines. A handler starts at once on the calling thread, runs
+ * until the first co_await that has to wait and is resumed through its AsyncContext; its frame is freed when it
+ * returns. The parameters go with the frame, so a handler that takes its result and its tunnel's hold by value
+ * answers and lets go of the tunnel by returning.
+ */
+struct MethodTask {
+  struct promise_type {
+    MethodTask get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    // Handlers report failures through their result, an exception that escapes one is a bug
+    void unhandled_exception() noexcept { PluginLogger()->error("Method handler ended with an exception"); }
+  };
+};
+
+/**
+ * Where the awaits of a coroutine handler wait and how it carries on afterwards. The reactor does the waiting and
+ * resume hands the coroutine to the thread it continues on, a tunnel worker, so that it may call into the driver
+ * again. Without a reactor or resume, awaits block the calling thread the way plain handlers do.
+ */
+struct AsyncContext {
+  IoReactor *reactor = nullptr;
+  std::function<void(std::coroutine_handle<> handle)> resume;
+
+  bool CanSuspend() const { return reactor && reactor->IsValid() && resume; }
+};
+
+/**
+ * co_await WaitUntil(context, done, interval, timeout) asks done every interval until it returns true, without a
+ * thread waiting in between: ERROR_SUCCESS once done did, ERROR_TIMEOUT when timeout passed first, and
+ * ERROR_NO_SYSTEM_RESOURCES, at once, when the reactor could not schedule the next time to ask. done is asked on a
+ * reactor thread, so it has to be quick.
+ */
+class WaitUntil {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  WaitUntil(AsyncContext context, std::function<bool()> done, std::chrono::milliseconds interval,
+            std::chrono::milliseconds timeout)
+      : context_(std::move(context)), done_(std::move(done)), interval_(interval),
+        deadline_(Clock::now() + timeout) {}
+
+  bool await_ready() {
+    if (done_()) {
+      completed_ = true;
+      return true;
+    }
+    if (context_.CanSuspend()) {
+      return false;
+    }
+    while (!(completed_ = done_()) && Clock::now() < deadline_) {
+      Sleep(static_cast<DWORD>(interval_.count()));
+    }
+    return true;
+  }
+
+  // Not suspended when the first time to ask could not be scheduled
+  bool await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    return Schedule();
+  }
+
+  DWORD await_resume() const { return completed_ ? ERROR_SUCCESS : error_; }
+
+private:
+  bool Schedule() {
+    IoReactor::TimerId timer = context_.reactor->Schedule(interval_, [this]() {
+      completed_ = done_();
+      if (!completed_ && Clock::now() < deadline_ && Schedule()) {
+        return;
+      }
+      // The awaiter lives in the frame the resumption may free
+      auto resume = std::move(context_.resume);
+      resume(handle_);
+    });
+    if (timer == 0) {
+      PluginLogger()->error("Failed to schedule a wait, it ends early");
+      error_ = ERROR_NO_SYSTEM_RESOURCES;
+      return false;
+    }
+    return true;
+  }
+
+  AsyncContext context_;
+  std::function<bool()> done_;
+  std::chrono::milliseconds interval_;
+  Clock::time_point deadline_;
+  std::coroutine_handle<> handle_;
+  bool completed_ = false;
+  DWORD error_ = ERROR_TIMEOUT;
+};
+
+} // namespace wireguard_dart
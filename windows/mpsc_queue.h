@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace wireguard_dart {
+
+/**
+ * A bounded queue that any number of threads push to without a lock, and one thread pops from. Every cell has a
+ * sequence number that tells whether it is free for the push of the current lap or holds a value for the pop, so
+ * producers only contend on one atomic increment. A full queue refuses the push instead of waiting.
+ */
+template <typename T, size_t Capacity>
+class MpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  MpscQueue() {
+    for (size_t i = 0; i < Capacity; i++) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // From any thread; false if the queue is full
+  bool TryPush(const T &value) {
+    Cell *cell;
+    size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[position & (Capacity - 1)];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (difference == 0) {
+        if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        return false;
+      } else {
+        position = enqueue_position_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // From the consumer thread only; false if the queue is empty
+  bool TryPop(T *value) {
+    Cell &cell = cells_[dequeue_position_ & (Capacity - 1)];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeue_position_ + 1) < 0) {
+      return false;
+    }
+    *value = cell.value;
+    cell.sequence.store(dequeue_position_ + Capacity, std::memory_order_release);
+    dequeue_position_++;
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::array<Cell, Capacity> cells_;
+  // Apart, so that producers and the consumer do not share a cache line
+  alignas(64) std::atomic<size_t> enqueue_position_{0};
+  alignas(64) size_t dequeue_position_ = 0;
+};
+
+} // namespace wireguard_dart
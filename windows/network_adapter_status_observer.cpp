@@ -1,30 +1,98 @@
 #include "network_adapter_status_observer.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ws2tcpip.h>
 
+#include <flutter/event_stream_handler_functions.h>
+
+#include "call_metrics.h"
 #include "connection_status.h"
+#include "encodable_keys.h"
+#include "perf_stats.h"
 #include "spdlog/spdlog.h"
+#include "startup_trace.h"
+#include "trace_events.h"
+#include "utils.h"
 
 namespace wireguard_dart {
 
-NetworkAdapterStatusObserver::NetworkAdapterStatusObserver()
-    : interface_notification_handle_(nullptr), notifications_registered_(false) {
-  try {
-    logger_ = spdlog::get("wireguard_dart");
-    if (!logger_) {
-      logger_ = spdlog::default_logger();
-      logger_->info("NetworkAdapterStatusObserver initialized with default logger");
-    }
-  } catch (const std::exception &e) {
-    // Fallback to default logger if initialization fails
-    logger_ = spdlog::default_logger();
-    logger_->warn("Failed to initialize named logger, using default: {}", e.what());
+namespace {
+
+// The event types status filters name, in the order of their bits in StatusFilter::event_types
+constexpr const char *kEventTypeNames[] = {"status",         "ready",      "stale",        "recovered", "addressReady",
+                                           "addressRemoved", "routeAdded", "routeRemoved", "roamed",    "activation"};
+
+// Copy at most size - 1 bytes, so the copy stays terminated
+template <size_t size>
+void CopyTruncated(char (&destination)[size], const std::string &source) {
+  size_t length = (std::min)(source.size(), size - 1);
+  std::memcpy(destination, source.data(), length);
+  destination[length] = '\0';
+}
+
+std::string PrefixToString(const SOCKADDR_INET &address, unsigned length) {
+  char text[INET6_ADDRSTRLEN] = {};
+  if (address.si_family == AF_INET) {
+    inet_ntop(AF_INET, &address.Ipv4.sin_addr, text, sizeof(text));
+  } else if (address.si_family == AF_INET6) {
+    inet_ntop(AF_INET6, &address.Ipv6.sin6_addr, text, sizeof(text));
+  } else {
+    return std::string();
+  }
+  return std::string(text) + "/" + std::to_string(length);
+}
+
+std::string EndpointToString(const SOCKADDR_INET &endpoint) {
+  char text[INET6_ADDRSTRLEN] = {};
+  if (endpoint.si_family == AF_INET) {
+    inet_ntop(AF_INET, &endpoint.Ipv4.sin_addr, text, sizeof(text));
+    return std::string(text) + ":" + std::to_string(ntohs(endpoint.Ipv4.sin_port));
+  }
+  if (endpoint.si_family == AF_INET6) {
+    inet_ntop(AF_INET6, &endpoint.Ipv6.sin6_addr, text, sizeof(text));
+    return "[" + std::string(text) + "]:" + std::to_string(ntohs(endpoint.Ipv6.sin6_port));
   }
+  return std::string();
 }
 
-NetworkAdapterStatusObserver::~NetworkAdapterStatusObserver() { Cleanup(); }
+} // namespace
+
+NetworkAdapterStatusObserver::NetworkAdapterStatusObserver(PlatformTaskRunner *platform_tasks)
+    : platform_tasks_(platform_tasks), drain_signal_([this] { DrainEvents(); }),
+      interface_notification_handle_(nullptr), address_notification_handle_(nullptr),
+      route_notification_handle_(nullptr), notifications_registered_(false) {
+  PublishObserved({});
+}
+
+NetworkAdapterStatusObserver::~NetworkAdapterStatusObserver() {
+  Cleanup();
+  if (coalesce_timer_) {
+    SetThreadpoolTimer(coalesce_timer_, nullptr, 0, 0);
+    WaitForThreadpoolTimerCallbacks(coalesce_timer_, TRUE);
+    CloseThreadpoolTimer(coalesce_timer_);
+  }
+}
+
+void NetworkAdapterStatusObserver::SetCoalesceWindow(std::chrono::milliseconds window) {
+  std::lock_guard<std::mutex> lock(adapters_mutex_);
+  if (window.count() > 0 && !coalesce_timer_) {
+    coalesce_timer_ = CreateThreadpoolTimer(CoalesceTimerCallback, this, nullptr);
+    if (!coalesce_timer_) {
+      logger_->warn("Failed to create the status coalescing timer: {}", GetLastError());
+      return;
+    }
+  }
+  coalesce_window_ = window.count() > 0 ? window : std::chrono::milliseconds(0);
+  logger_->info("Status changes coalesced over {} ms", coalesce_window_.count());
+}
 
-void NetworkAdapterStatusObserver::StartObserving(const NET_LUID &luid) {
+void NetworkAdapterStatusObserver::StartObserving(const NET_LUID &luid, const std::string &tunnel_name) {
+  if (!tunnel_name.empty()) {
+    std::lock_guard<std::mutex> lock(correlation_mutex_);
+    tunnel_names_[luid.Value] = tunnel_name;
+  }
   std::lock_guard<std::mutex> lock(adapters_mutex_);
 
   auto found_adapter = GetMonitoredAdapter(luid);
@@ -36,25 +104,27 @@ void NetworkAdapterStatusObserver::StartObserving(const NET_LUID &luid) {
 
   // Register for Windows API notifications if not already registered
   if (!notifications_registered_) {
-    DWORD result =
-        NotifyIpInterfaceChange(AF_UNSPEC, IpInterfaceChangeCallback, this, FALSE, &interface_notification_handle_);
-    if (result != NO_ERROR) {
-      logger_->error("Failed to register for interface change notifications: {}", result);
+    ScopedStartup startup("interfaceNotifications");
+    if (!RegisterNotifications()) {
       return;
     }
-
     notifications_registered_ = true;
-    logger_->info("Registered for global network change notifications");
   }
 
-  monitored_adapters_.push_back(luid);
+  std::vector<uint64_t> observed = *observed_luids_.load(std::memory_order_relaxed);
+  observed.insert(std::upper_bound(observed.begin(), observed.end(), luid.Value), luid.Value);
+  PublishObserved(std::move(observed));
 
   logger_->info("Started monitoring adapter with LUID: {}", luid.Value);
 
+  // Seeds the observed status, notifications only come with changes
+  std::string current_status =
+      ConnectionStatusToString(connection_states_[luid.Value].OnInterfaceStatus(GetInterfaceStatus(luid)));
+  SetObservedStatusLocked(luid.Value, current_status);
+
   // Send initial status
-  if (sink_) {
-    std::string current_status = GetInterfaceStatus(luid);
-    NotifyStatusChange(luid, current_status);
+  if (NotifyStatusChange(luid, current_status)) {
+    emitted_status_[luid.Value] = current_status;
   }
 }
 
@@ -64,62 +134,133 @@ void NetworkAdapterStatusObserver::StopObserving(const NET_LUID &luid) {
   // IpInterfaceChangeCallback can be called meanwhile by a system thread
   // Locking here & in the callback will deadlock.
   HANDLE notification_handle_to_cancel = nullptr;
+  HANDLE address_handle_to_cancel = nullptr;
+  HANDLE route_handle_to_cancel = nullptr;
+  bool cancel = false;
   {
     std::lock_guard<std::mutex> lock(adapters_mutex_);
+    pending_ready_.erase(luid.Value);
+    ready_addresses_.erase(luid.Value);
+    observed_status_.erase(luid.Value);
+    connection_states_.erase(luid.Value);
+    emitted_status_.erase(luid.Value);
+    coalescing_.erase(luid.Value);
+    {
+      std::lock_guard<std::mutex> correlation_lock(correlation_mutex_);
+      correlation_ids_.erase(luid.Value);
+    }
 
-    auto it = std::find_if(monitored_adapters_.begin(), monitored_adapters_.end(),
-                           [&luid](const NET_LUID &monitored_luid) { return monitored_luid.Value == luid.Value; });
+    std::vector<uint64_t> observed = *observed_luids_.load(std::memory_order_relaxed);
+    auto it = std::lower_bound(observed.begin(), observed.end(), luid.Value);
 
-    if (it != monitored_adapters_.end()) {
+    if (it != observed.end() && *it == luid.Value) {
       logger_->info("Stopped monitoring adapter with LUID: {}", luid.Value);
 
-      monitored_adapters_.erase(it);
+      observed.erase(it);
+      bool none_left = observed.empty();
+      PublishObserved(std::move(observed));
 
       // If no more adapters are being monitored, clean up global notifications
-      if (monitored_adapters_.empty() && notifications_registered_) {
+      if (none_left && notifications_registered_) {
         // Store handle locally to avoid potential race conditions
         notification_handle_to_cancel = interface_notification_handle_;
         interface_notification_handle_ = nullptr;
+        address_handle_to_cancel = address_notification_handle_;
+        address_notification_handle_ = nullptr;
+        route_handle_to_cancel = route_notification_handle_;
+        route_notification_handle_ = nullptr;
         notifications_registered_ = false;
+        cancel = true;
       }
     }
   }
 
   // Call CancelMibChangeNotify2 outside the lock
-  if (notification_handle_to_cancel) {
-    logger_->debug("Canceling network change notifications...");
-    DWORD result = CancelMibChangeNotify2(notification_handle_to_cancel);
-    if (result != NO_ERROR) {
-      logger_->warn("Failed to cancel MIB change notifications: {}", result);
-    } else {
-      logger_->info("Successfully unregistered global network change notifications");
-    }
+  if (cancel) {
+    CancelNotifications(notification_handle_to_cancel, address_handle_to_cancel, route_handle_to_cancel);
   }
 }
 
 void NetworkAdapterStatusObserver::StopAllObserving() {
   HANDLE handle_to_cancel = nullptr;
+  HANDLE address_handle_to_cancel = nullptr;
+  HANDLE route_handle_to_cancel = nullptr;
+  bool cancel = false;
 
   {
     std::lock_guard<std::mutex> lock(adapters_mutex_);
 
-    monitored_adapters_.clear();
+    PublishObserved({});
+    pending_ready_.clear();
+    ready_addresses_.clear();
+    observed_status_.clear();
+    connection_states_.clear();
+    emitted_status_.clear();
+    coalescing_.clear();
+    {
+      std::lock_guard<std::mutex> correlation_lock(correlation_mutex_);
+      correlation_ids_.clear();
+    }
 
     if (notifications_registered_) {
       handle_to_cancel = interface_notification_handle_;
       interface_notification_handle_ = nullptr;
+      address_handle_to_cancel = address_notification_handle_;
+      address_notification_handle_ = nullptr;
+      route_handle_to_cancel = route_notification_handle_;
+      route_notification_handle_ = nullptr;
       notifications_registered_ = false;
+      cancel = true;
     }
   } // Lock is released here
 
   // Call CancelMibChangeNotify2 outside the lock to avoid deadlock
-  if (handle_to_cancel) {
-    logger_->info("Canceling all network change notifications...");
-    DWORD result = CancelMibChangeNotify2(handle_to_cancel);
+  if (cancel) {
+    CancelNotifications(handle_to_cancel, address_handle_to_cancel, route_handle_to_cancel);
+  }
+}
+
+bool NetworkAdapterStatusObserver::RegisterNotifications() {
+  // The initial notification reconciles the adapters with the interface table, see SeedInterfaceStatus
+  DWORD result =
+      NotifyIpInterfaceChange(AF_UNSPEC, IpInterfaceChangeCallback, this, TRUE, &interface_notification_handle_);
+  if (result != NO_ERROR) {
+    interface_notification_handle_ = nullptr;
+    logger_->error("Failed to register for interface change notifications: {}", result);
+    return false;
+  }
+
+  // Address and route changes only drive their own events, the status stream works without them
+  result = NotifyUnicastIpAddressChange(AF_UNSPEC, UnicastAddressChangeCallback, this, FALSE,
+                                        &address_notification_handle_);
+  if (result != NO_ERROR) {
+    address_notification_handle_ = nullptr;
+    logger_->warn("Failed to register for address change notifications: {}", result);
+  }
+  result = NotifyRouteChange2(AF_UNSPEC, RouteChangeCallback, this, FALSE, &route_notification_handle_);
+  if (result != NO_ERROR) {
+    route_notification_handle_ = nullptr;
+    logger_->warn("Failed to register for route change notifications: {}", result);
+  }
+  logger_->info("Registered for global network change notifications");
+  return true;
+}
+
+void NetworkAdapterStatusObserver::CancelNotifications(HANDLE interface_handle, HANDLE address_handle,
+                                                       HANDLE route_handle) {
+  if (address_handle) {
+    MeteredInvoke(MeteredCall::kCancelMibChangeNotify2, CancelMibChangeNotify2, address_handle);
+  }
+  if (route_handle) {
+    MeteredInvoke(MeteredCall::kCancelMibChangeNotify2, CancelMibChangeNotify2, route_handle);
+  }
+  if (interface_handle) {
+    SPDLOG_LOGGER_DEBUG(logger_, "Canceling network change notifications...");
+    DWORD result = MeteredInvoke(MeteredCall::kCancelMibChangeNotify2, CancelMibChangeNotify2, interface_handle);
     if (result != NO_ERROR) {
       logger_->warn("Failed to cancel MIB change notifications: {}", result);
     } else {
-      logger_->info("Stopped monitoring all adapters and unregistered notifications");
+      logger_->info("Successfully unregistered global network change notifications");
     }
   }
 }
@@ -131,14 +272,57 @@ bool NetworkAdapterStatusObserver::IsMonitoring(const NET_LUID &luid) const {
   return found_adapter.has_value();
 }
 
+std::optional<std::string> NetworkAdapterStatusObserver::GetObservedStatus(const NET_LUID &luid) const {
+  std::lock_guard<std::mutex> lock(adapters_mutex_);
+  auto it = observed_status_.find(luid.Value);
+  return it != observed_status_.end() ? std::optional<std::string>(it->second.status) : std::nullopt;
+}
+
+std::optional<NetworkAdapterStatusObserver::ObservedStatus>
+NetworkAdapterStatusObserver::GetObservedTransition(const NET_LUID &luid) const {
+  std::lock_guard<std::mutex> lock(adapters_mutex_);
+  auto it = observed_status_.find(luid.Value);
+  return it != observed_status_.end() ? std::optional<ObservedStatus>(it->second) : std::nullopt;
+}
+
+void NetworkAdapterStatusObserver::SetObservedStatusLocked(uint64_t luid, const std::string &status) {
+  ObservedStatus &observed = observed_status_[luid];
+  if (observed.since_ms != 0 && observed.status == status) {
+    return;
+  }
+  observed.status = status;
+  observed.since_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+  observed.since_monotonic_us = PerfCounterMicroseconds();
+}
+
 VOID CALLBACK NetworkAdapterStatusObserver::IpInterfaceChangeCallback(PVOID caller_context, PMIB_IPINTERFACE_ROW row,
                                                                       MIB_NOTIFICATION_TYPE notification_type) {
   auto *observer = static_cast<NetworkAdapterStatusObserver *>(caller_context);
-  if (!observer || !row) {
+  if (observer) {
+    observer->OnInterfaceChange(row, notification_type);
+  }
+}
+
+void NetworkAdapterStatusObserver::OnInterfaceChange(const MIB_IPINTERFACE_ROW *row,
+                                                     MIB_NOTIFICATION_TYPE notification_type) {
+  // Without a row, on a thread of its own once the registration completed
+  if (notification_type == MibInitialNotification) {
+    TraceRegion trace_region("InterfaceSeed");
+    SeedInterfaceStatus();
+    return;
+  }
+  if (!row) {
     return;
   }
 
-  observer->HandleInterfaceChange(row->InterfaceLuid, notification_type);
+  // Most notifications are for interfaces of other adapters, which are skipped without taking the mutex
+  if (!IsObserved(row->InterfaceLuid.Value)) {
+    return;
+  }
+  TraceRegion trace_region("InterfaceChange");
+  HandleInterfaceChange(row->InterfaceLuid, notification_type);
 }
 
 void NetworkAdapterStatusObserver::HandleInterfaceChange(const NET_LUID &luid,
@@ -149,58 +333,782 @@ void NetworkAdapterStatusObserver::HandleInterfaceChange(const NET_LUID &luid,
     if (!GetMonitoredAdapter(luid).has_value()) {
       return;
     }
+    if (coalesce_window_.count() > 0) {
+      // The first change of a burst arms the timer, the rest only join it
+      bool first = coalescing_.empty();
+      coalescing_.insert(luid.Value);
+      if (first) {
+        ULARGE_INTEGER relative;
+        relative.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(coalesce_window_.count() * 10000));
+        FILETIME due_time;
+        due_time.dwLowDateTime = relative.LowPart;
+        due_time.dwHighDateTime = relative.HighPart;
+        SetThreadpoolTimer(coalesce_timer_, &due_time, 0, 0);
+      }
+      return;
+    }
+  }
+  SPDLOG_LOGGER_DEBUG(logger_, "Interface change for adapter LUID {}: {}", luid.Value,
+                      static_cast<int>(notification_type));
+  ReportInterfaceStatus(luid);
+}
+
+VOID CALLBACK NetworkAdapterStatusObserver::CoalesceTimerCallback(PTP_CALLBACK_INSTANCE instance, PVOID context,
+                                                                  PTP_TIMER timer) {
+  auto *observer = static_cast<NetworkAdapterStatusObserver *>(context);
+  std::unordered_set<uint64_t> luids;
+  {
+    std::lock_guard<std::mutex> lock(observer->adapters_mutex_);
+    luids.swap(observer->coalescing_);
+  }
+  TraceRegion trace_region("CoalescedInterfaceChange", static_cast<int64_t>(luids.size()));
+  for (uint64_t value : luids) {
+    NET_LUID luid;
+    luid.Value = value;
+    observer->ReportInterfaceStatus(luid);
+  }
+}
+
+void NetworkAdapterStatusObserver::SeedInterfaceStatus() {
+  std::vector<uint64_t> luids;
+  {
+    std::lock_guard<std::mutex> lock(adapters_mutex_);
+    luids = *observed_luids_.load(std::memory_order_relaxed);
+  }
+  if (luids.empty()) {
+    return;
+  }
+
+  // One read of every interface, without the counters, instead of one per adapter
+  PMIB_IF_TABLE2 table = nullptr;
+  DWORD result = GetIfTable2Ex(MibIfTableNormalWithoutStatistics, &table);
+  if (result != NO_ERROR) {
+    logger_->warn("Failed to read the interface table: {}", result);
+    return;
+  }
+  for (ULONG i = 0; i < table->NumEntries; i++) {
+    const MIB_IF_ROW2 &if_row = table->Table[i];
+    if (!std::binary_search(luids.begin(), luids.end(), if_row.InterfaceLuid.Value)) {
+      continue;
+    }
+    ConnectionStatus interface_status = ConnectionStatusFromIfOperStatus(if_row.OperStatus);
+    UpdateConnectionState(if_row.InterfaceLuid, [interface_status](ConnectionStateMachine &state) {
+      return state.OnInterfaceStatus(interface_status);
+    });
+  }
+  FreeMibTable(table);
+}
+
+void NetworkAdapterStatusObserver::ReportInterfaceStatus(const NET_LUID &luid) {
+  {
+    std::lock_guard<std::mutex> lock(adapters_mutex_);
+    if (!GetMonitoredAdapter(luid).has_value()) {
+      return;
+    }
+  }
+
+  ConnectionStatus interface_status = GetInterfaceStatus(luid);
+  FlightRecorder::Instance().Record(FlightEvent::kInterfaceStatus, "InterfaceStatus", static_cast<int64_t>(luid.Value),
+                                    static_cast<uint32_t>(interface_status));
+  UpdateConnectionState(
+      luid, [interface_status](ConnectionStateMachine &state) { return state.OnInterfaceStatus(interface_status); });
+
+  // Coming up can be the last thing the ready event was waiting for
+  CheckAddressReadiness(luid);
+}
+
+void NetworkAdapterStatusObserver::NotifyConnecting(const NET_LUID &luid) {
+  UpdateConnectionState(luid, [](ConnectionStateMachine &state) { return state.OnConnecting(); });
+}
+
+void NetworkAdapterStatusObserver::NotifyHandshake(const NET_LUID &luid) {
+  UpdateConnectionState(luid, [](ConnectionStateMachine &state) { return state.OnHandshake(); });
+}
+
+void NetworkAdapterStatusObserver::NotifyDisconnecting(const NET_LUID &luid, bool disconnecting) {
+  UpdateConnectionState(
+      luid, [disconnecting](ConnectionStateMachine &state) { return state.OnDisconnecting(disconnecting); });
+}
+
+void NetworkAdapterStatusObserver::UpdateConnectionState(const NET_LUID &luid, const ConnectionStateChange &change) {
+  std::string status;
+  bool changed = false;
+  {
+    // Not for an adapter whose observation stopped meanwhile
+    std::lock_guard<std::mutex> lock(adapters_mutex_);
+    if (!GetMonitoredAdapter(luid).has_value()) {
+      return;
+    }
+    status = ConnectionStatusToString(change(connection_states_[luid.Value]));
+    SetObservedStatusLocked(luid.Value, status);
+    auto emitted = emitted_status_.find(luid.Value);
+    // Only recorded as emitted once queued, so a status dropped on a full queue goes out with the next change
+    changed = (emitted == emitted_status_.end() || emitted->second != status) && NotifyStatusChange(luid, status);
+    if (changed) {
+      emitted_status_[luid.Value] = status;
+    }
+  }
+  if (changed) {
+    logger_->info("Status of adapter LUID {} is now {}", luid.Value, status);
+  }
+}
+
+void NetworkAdapterStatusObserver::WatchAddressReadiness(const NET_LUID &luid,
+                                                         const std::vector<WIREGUARD_ALLOWED_IP> &addresses) {
+  std::vector<SOCKADDR_INET> pending;
+  for (const auto &address : addresses) {
+    SOCKADDR_INET sockaddr = {};
+    sockaddr.si_family = address.AddressFamily;
+    if (address.AddressFamily == AF_INET) {
+      sockaddr.Ipv4.sin_addr = address.Address.V4;
+    } else if (address.AddressFamily == AF_INET6) {
+      sockaddr.Ipv6.sin6_addr = address.Address.V6;
+    } else {
+      continue;
+    }
+    pending.push_back(sockaddr);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(adapters_mutex_);
+    if (!GetMonitoredAdapter(luid).has_value()) {
+      logger_->warn("Not watching address readiness of unobserved adapter with LUID: {}", luid.Value);
+      return;
+    }
+    pending_ready_[luid.Value] = std::move(pending);
+  }
+
+  // The addresses may be usable already, in which case no notification is coming
+  CheckAddressReadiness(luid);
+}
+
+VOID CALLBACK NetworkAdapterStatusObserver::UnicastAddressChangeCallback(PVOID caller_context,
+                                                                         PMIB_UNICASTIPADDRESS_ROW row,
+                                                                         MIB_NOTIFICATION_TYPE notification_type) {
+  auto *observer = static_cast<NetworkAdapterStatusObserver *>(caller_context);
+  if (!observer || !row || notification_type == MibInitialNotification ||
+      !observer->IsObserved(row->InterfaceLuid.Value)) {
+    return;
+  }
+
+  TraceRegion trace_region("AddressChange");
+  observer->HandleAddressChange(*row, notification_type);
+  observer->CheckAddressReadiness(row->InterfaceLuid);
+}
+
+VOID CALLBACK NetworkAdapterStatusObserver::RouteChangeCallback(PVOID caller_context, PMIB_IPFORWARD_ROW2 row,
+                                                                MIB_NOTIFICATION_TYPE notification_type) {
+  auto *observer = static_cast<NetworkAdapterStatusObserver *>(caller_context);
+  if (!observer || !row || notification_type == MibInitialNotification ||
+      !observer->IsObserved(row->InterfaceLuid.Value)) {
+    return;
   }
 
-  std::string status = GetInterfaceStatus(luid);
-  logger_->info("Interface change for adapter LUID {}: {} -> {}", luid.Value, static_cast<int>(notification_type),
-                status);
-  NotifyStatusChange(luid, status);
+  TraceRegion trace_region("RouteChange");
+  observer->HandleRouteChange(*row, notification_type);
 }
 
-void NetworkAdapterStatusObserver::NotifyStatusChange(const NET_LUID &luid, const std::string &status) {
-  if (sink_) {
-    flutter::EncodableMap status_map;
-    status_map[flutter::EncodableValue("status")] = flutter::EncodableValue(status);
-    status_map[flutter::EncodableValue("luid")] = flutter::EncodableValue(static_cast<int64_t>(luid.Value));
+void NetworkAdapterStatusObserver::HandleAddressChange(const MIB_UNICASTIPADDRESS_ROW &row,
+                                                       MIB_NOTIFICATION_TYPE notification_type) {
+  if (notification_type == MibDeleteInstance) {
+    std::string prefix = PrefixToString(row.Address, row.OnLinkPrefixLength);
+    {
+      std::lock_guard<std::mutex> lock(adapters_mutex_);
+      auto ready = ready_addresses_.find(row.InterfaceLuid.Value);
+      if (ready == ready_addresses_.end() || ready->second.erase(prefix) == 0) {
+        return;
+      }
+    }
+    logger_->info("Address {} of adapter LUID {} was removed", prefix, row.InterfaceLuid.Value);
+    NotifyNetworkChange(row.InterfaceLuid, StatusEvent::Kind::kAddressRemoved, prefix);
+    return;
+  }
 
-    sink_->Success(flutter::EncodableValue(status_map));
+  // The row of a notification may only have the keys filled in
+  MIB_UNICASTIPADDRESS_ROW current;
+  InitializeUnicastIpAddressEntry(&current);
+  current.InterfaceLuid = row.InterfaceLuid;
+  current.Address = row.Address;
+  if (GetUnicastIpAddressEntry(&current) != NO_ERROR || current.DadState != IpDadStatePreferred) {
+    return;
   }
+  std::string prefix = PrefixToString(current.Address, current.OnLinkPrefixLength);
+  {
+    std::lock_guard<std::mutex> lock(adapters_mutex_);
+    if (!GetMonitoredAdapter(row.InterfaceLuid).has_value() ||
+        !ready_addresses_[row.InterfaceLuid.Value].insert(prefix).second) {
+      return;
+    }
+  }
+  NotifyNetworkChange(row.InterfaceLuid, StatusEvent::Kind::kAddressReady, prefix);
 }
 
-std::string NetworkAdapterStatusObserver::GetInterfaceStatus(const NET_LUID &luid) const {
-  MIB_IF_ROW2 if_row;
+void NetworkAdapterStatusObserver::HandleRouteChange(const MIB_IPFORWARD_ROW2 &row,
+                                                     MIB_NOTIFICATION_TYPE notification_type) {
+  if (notification_type != MibAddInstance && notification_type != MibDeleteInstance) {
+    return;
+  }
+  bool added = notification_type == MibAddInstance;
+  std::string prefix = PrefixToString(row.DestinationPrefix.Prefix, row.DestinationPrefix.PrefixLength);
+  SPDLOG_LOGGER_DEBUG(logger_, "Route {} of adapter LUID {} was {}", prefix, row.InterfaceLuid.Value,
+                      added ? "added" : "removed");
+  NotifyNetworkChange(row.InterfaceLuid, added ? StatusEvent::Kind::kRouteAdded : StatusEvent::Kind::kRouteRemoved,
+                      prefix);
+}
+
+void NetworkAdapterStatusObserver::NotifyNetworkChange(const NET_LUID &luid, StatusEvent::Kind kind,
+                                                       const std::string &prefix) {
+  if (!listening_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::optional<std::string> status = GetObservedStatus(luid);
+
+  StatusEvent event;
+  event.kind = kind;
+  CopyTruncated(event.status, status ? *status : ConnectionStatusToString(ConnectionStatus::connected));
+  event.luid = luid.Value;
+  CopyTruncated(event.prefix, prefix);
+  Enqueue(event);
+}
+
+void NetworkAdapterStatusObserver::CheckAddressReadiness(const NET_LUID &luid) {
+  std::vector<SOCKADDR_INET> addresses;
+  {
+    std::lock_guard<std::mutex> lock(adapters_mutex_);
+    auto pending = pending_ready_.find(luid.Value);
+    if (pending == pending_ready_.end()) {
+      return;
+    }
+    addresses = pending->second;
+  }
+
+  if (!AreAddressesReady(luid, addresses)) {
+    return;
+  }
+
+  // Another notification may have got here first, only one of them sends the event
+  {
+    std::lock_guard<std::mutex> lock(adapters_mutex_);
+    if (pending_ready_.erase(luid.Value) == 0) {
+      return;
+    }
+  }
+  logger_->info("All {} addresses of adapter LUID {} are ready", addresses.size(), luid.Value);
+  NotifyReady(luid);
+  if (ready_callback_) {
+    ready_callback_(luid);
+  }
+}
+
+bool NetworkAdapterStatusObserver::AreAddressesReady(const NET_LUID &luid,
+                                                     const std::vector<SOCKADDR_INET> &addresses) const {
+  if (GetInterfaceStatus(luid) != ConnectionStatus::connected) {
+    return false;
+  }
+
+  for (const auto &address : addresses) {
+    MIB_UNICASTIPADDRESS_ROW row;
+    InitializeUnicastIpAddressEntry(&row);
+    row.InterfaceLuid = luid;
+    row.Address = address;
+    if (GetUnicastIpAddressEntry(&row) != NO_ERROR || row.DadState != IpDadStatePreferred) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void NetworkAdapterStatusObserver::NotifyReady(const NET_LUID &luid) {
+  if (!listening_.load(std::memory_order_acquire)) {
+    return;
+  }
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  std::optional<std::string> status = GetObservedStatus(luid);
+
+  StatusEvent event;
+  event.kind = StatusEvent::Kind::kReady;
+  CopyTruncated(event.status, status ? *status : ConnectionStatusToString(ConnectionStatus::connected));
+  event.luid = luid.Value;
+  event.time = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+  Enqueue(event);
+}
+
+void NetworkAdapterStatusObserver::NotifyPeerLiveness(const NET_LUID &luid, const std::string &public_key, bool stale,
+                                                      int64_t latest_handshake) {
+  logger_->info("Peer {} of adapter LUID {} {}", public_key, luid.Value, stale ? "is stale" : "recovered");
+  if (!listening_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::optional<std::string> status = GetObservedStatus(luid);
+
+  StatusEvent event;
+  event.kind = StatusEvent::Kind::kLiveness;
+  event.stale = stale;
+  CopyTruncated(event.status, status ? *status : ConnectionStatusToString(ConnectionStatus::connected));
+  event.luid = luid.Value;
+  event.time = latest_handshake;
+  CopyTruncated(event.public_key, public_key);
+  Enqueue(event);
+}
+
+void NetworkAdapterStatusObserver::NotifyEndpointRoamed(const NET_LUID &luid, const std::string &public_key,
+                                                        const SOCKADDR_INET &previous, const SOCKADDR_INET &current) {
+  std::string previous_text = EndpointToString(previous);
+  std::string current_text = EndpointToString(current);
+  logger_->info("Peer {} of adapter LUID {} roamed from {} to {}", public_key, luid.Value, previous_text,
+                current_text);
+  if (!listening_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::optional<std::string> status = GetObservedStatus(luid);
+
+  StatusEvent event;
+  event.kind = StatusEvent::Kind::kRoamed;
+  CopyTruncated(event.status, status ? *status : ConnectionStatusToString(ConnectionStatus::connected));
+  event.luid = luid.Value;
+  CopyTruncated(event.public_key, public_key);
+  CopyTruncated(event.previous_endpoint, previous_text);
+  CopyTruncated(event.endpoint, current_text);
+  Enqueue(event);
+}
+
+void NetworkAdapterStatusObserver::NotifyActivation(const NET_LUID &luid, uint64_t activated, uint64_t total) {
+  if (!listening_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::optional<std::string> status = GetObservedStatus(luid);
+
+  StatusEvent event;
+  event.kind = StatusEvent::Kind::kActivation;
+  CopyTruncated(event.status, status ? *status : ConnectionStatusToString(ConnectionStatus::connecting));
+  event.luid = luid.Value;
+  event.activated = activated;
+  event.total = total;
+  Enqueue(event);
+}
+
+bool NetworkAdapterStatusObserver::NotifyStatusChange(const NET_LUID &luid, const std::string &status) {
+  if (!listening_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  StatusEvent event;
+  event.kind = StatusEvent::Kind::kStatus;
+  CopyTruncated(event.status, status);
+  event.luid = luid.Value;
+  return Enqueue(event);
+}
+
+void NetworkAdapterStatusObserver::SetCorrelationId(const NET_LUID &luid, const std::string &correlation_id) {
+  std::lock_guard<std::mutex> lock(correlation_mutex_);
+  if (correlation_id.empty()) {
+    correlation_ids_.erase(luid.Value);
+  } else {
+    correlation_ids_[luid.Value] = correlation_id.substr(0, sizeof(StatusEvent::correlation_id) - 1);
+  }
+}
+
+void NetworkAdapterStatusObserver::StampCorrelation(StatusEvent &event) {
+  std::lock_guard<std::mutex> lock(correlation_mutex_);
+  auto it = correlation_ids_.find(event.luid);
+  if (it != correlation_ids_.end()) {
+    memcpy(event.correlation_id, it->second.c_str(), it->second.size() + 1);
+  }
+}
+
+bool NetworkAdapterStatusObserver::Enqueue(const StatusEvent &queued) {
+  StatusEvent event = queued;
+  event.monotonic_us = PerfCounterMicroseconds();
+  StampCorrelation(event);
+  if (!platform_tasks_ || !platform_tasks_->IsValid()) {
+    Deliver(event);
+    return true;
+  }
+  bool pushed = events_.TryPush(event);
+  if (!pushed) {
+    dropped_events_.fetch_add(1, std::memory_order_relaxed);
+  }
+  platform_tasks_->Raise(&drain_signal_);
+  return pushed;
+}
+
+void NetworkAdapterStatusObserver::DrainEvents() {
+  int64_t started_us = PerfCounterMicroseconds();
+  uint64_t depth = 0;
+  std::vector<StatusEvent> drained;
+  StatusEvent event;
+  while (events_.TryPop(&event)) {
+    drained.push_back(event);
+    depth++;
+  }
+  for (auto &[engine, listener] : listeners_) {
+    Send(listener, drained);
+  }
+  uint64_t dropped = dropped_events_.exchange(0, std::memory_order_relaxed);
+  if (dropped > 0) {
+    logger_->warn("Dropped {} status events, the platform thread fell behind", dropped);
+  }
+
+  drains_.fetch_add(1, std::memory_order_relaxed);
+  drained_events_.fetch_add(depth, std::memory_order_relaxed);
+  if (depth > max_drain_depth_.load(std::memory_order_relaxed)) {
+    max_drain_depth_.store(depth, std::memory_order_relaxed);
+  }
+  dropped_total_.fetch_add(dropped, std::memory_order_relaxed);
+  drain_us_.fetch_add(PerfCounterMicroseconds() - started_us, std::memory_order_relaxed);
+}
+
+NetworkAdapterStatusObserver::DrainStatistics NetworkAdapterStatusObserver::GetDrainStatistics() const {
+  DrainStatistics statistics;
+  statistics.drains = drains_.load(std::memory_order_relaxed);
+  statistics.events = drained_events_.load(std::memory_order_relaxed);
+  statistics.max_depth = max_drain_depth_.load(std::memory_order_relaxed);
+  statistics.dropped = dropped_total_.load(std::memory_order_relaxed);
+  statistics.drain_us = drain_us_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+void NetworkAdapterStatusObserver::Deliver(const StatusEvent &event) {
+  for (auto &[engine, listener] : listeners_) {
+    Send(listener, {event});
+  }
+}
+
+void NetworkAdapterStatusObserver::Send(Listener &listener, const std::vector<StatusEvent> &events) {
+  flutter::EncodableList batch;
+  flutter::EncodableList subscriptions;
+  for (const StatusEvent &event : events) {
+    if (!Route(listener, event, &subscriptions)) {
+      continue;
+    }
+    if (listener.batched) {
+      batch.push_back(EventValue(event, &subscriptions));
+    } else {
+      listener.sink->Success(EventValue(event, &subscriptions));
+    }
+  }
+  if (!batch.empty()) {
+    listener.sink->Success(flutter::EncodableValue(std::move(batch)));
+  }
+}
+
+bool NetworkAdapterStatusObserver::Route(const Listener &listener, const StatusEvent &event,
+                                         flutter::EncodableList *subscriptions) {
+  subscriptions->clear();
+  if (listener.filter && !Matches(*listener.filter, event)) {
+    return false;
+  }
+  if (!listener.routed) {
+    return true;
+  }
+  for (const auto &[id, filter] : listener.subscriptions) {
+    if (Matches(filter, event)) {
+      subscriptions->push_back(flutter::EncodableValue(id));
+    }
+  }
+  return !subscriptions->empty();
+}
+
+bool NetworkAdapterStatusObserver::Matches(const StatusFilter &filter, const StatusEvent &event) {
+  if ((filter.event_types & EventTypeBit(event)) == 0) {
+    return false;
+  }
+  if (filter.luids.empty() && filter.tunnel_names.empty()) {
+    return true;
+  }
+  if (std::find(filter.luids.begin(), filter.luids.end(), event.luid) != filter.luids.end()) {
+    return true;
+  }
+  if (filter.tunnel_names.empty()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(correlation_mutex_);
+  auto name = tunnel_names_.find(event.luid);
+  return name != tunnel_names_.end() &&
+         std::find(filter.tunnel_names.begin(), filter.tunnel_names.end(), name->second) != filter.tunnel_names.end();
+}
+
+uint32_t NetworkAdapterStatusObserver::EventTypeBit(const StatusEvent &event) {
+  // In the order of kEventTypeNames, stale and recovered apart
+  switch (event.kind) {
+    case StatusEvent::Kind::kStatus:
+      return 1u << 0;
+    case StatusEvent::Kind::kReady:
+      return 1u << 1;
+    case StatusEvent::Kind::kLiveness:
+      return event.stale ? 1u << 2 : 1u << 3;
+    case StatusEvent::Kind::kAddressReady:
+      return 1u << 4;
+    case StatusEvent::Kind::kAddressRemoved:
+      return 1u << 5;
+    case StatusEvent::Kind::kRouteAdded:
+      return 1u << 6;
+    case StatusEvent::Kind::kRouteRemoved:
+      return 1u << 7;
+    case StatusEvent::Kind::kRoamed:
+      return 1u << 8;
+    case StatusEvent::Kind::kActivation:
+      return 1u << 9;
+  }
+  return 0;
+}
+
+bool NetworkAdapterStatusObserver::ParseFilter(const flutter::EncodableMap &arguments, StatusFilter *filter,
+                                               std::string *error) {
+  *filter = StatusFilter();
+  if (const auto *luids = std::get_if<flutter::EncodableList>(ValueOrNull(arguments, keys::kLuids))) {
+    for (const flutter::EncodableValue &luid : *luids) {
+      if (const auto *luid64 = std::get_if<int64_t>(&luid)) {
+        filter->luids.push_back(static_cast<uint64_t>(*luid64));
+      } else if (const auto *luid32 = std::get_if<int32_t>(&luid)) {
+        filter->luids.push_back(static_cast<uint64_t>(static_cast<uint32_t>(*luid32)));
+      } else {
+        *error = "Argument 'luids' must be a list of integers";
+        return false;
+      }
+    }
+  }
+  if (const auto *names = std::get_if<flutter::EncodableList>(ValueOrNull(arguments, keys::kTunnelNames))) {
+    for (const flutter::EncodableValue &name : *names) {
+      const auto *text = std::get_if<std::string>(&name);
+      if (!text) {
+        *error = "Argument 'tunnelNames' must be a list of strings";
+        return false;
+      }
+      filter->tunnel_names.push_back(*text);
+    }
+  }
+  if (const auto *types = std::get_if<flutter::EncodableList>(ValueOrNull(arguments, keys::kEvents))) {
+    filter->event_types = 0;
+    for (const flutter::EncodableValue &type : *types) {
+      const auto *text = std::get_if<std::string>(&type);
+      auto found = text ? std::find(std::begin(kEventTypeNames), std::end(kEventTypeNames), *text)
+                        : std::end(kEventTypeNames);
+      if (found == std::end(kEventTypeNames)) {
+        *error = "Argument 'events' must be a list of status event types, like 'status' or 'ready'";
+        return false;
+      }
+      filter->event_types |= 1u << (found - std::begin(kEventTypeNames));
+    }
+  }
+  return true;
+}
+
+void NetworkAdapterStatusObserver::Subscribe(uint64_t engine, int64_t id, StatusFilter filter) {
+  // A listen starts without subscriptions, so there is nothing to keep for an engine not listening
+  auto found = listeners_.find(engine);
+  if (found == listeners_.end() || !found->second.routed) {
+    return;
+  }
+  Listener &listener = found->second;
+  const StatusFilter &subscription = listener.subscriptions[id] = std::move(filter);
+
+  // The last status of each adapter, as a new listener gets them
+  std::vector<StatusEvent> replay;
+  {
+    std::lock_guard<std::mutex> lock(adapters_mutex_);
+    replay = ObservedStatusLocked();
+  }
+  flutter::EncodableList batch;
+  for (StatusEvent &event : replay) {
+    StampCorrelation(event);
+  }
+  for (const StatusEvent &event : replay) {
+    if (Matches(subscription, event)) {
+      flutter::EncodableList subscriptions{flutter::EncodableValue(id)};
+      if (listener.batched) {
+        batch.push_back(EventValue(event, &subscriptions));
+      } else {
+        listener.sink->Success(EventValue(event, &subscriptions));
+      }
+    }
+  }
+  if (!batch.empty()) {
+    listener.sink->Success(flutter::EncodableValue(std::move(batch)));
+  }
+}
+
+void NetworkAdapterStatusObserver::Unsubscribe(uint64_t engine, int64_t id) {
+  auto found = listeners_.find(engine);
+  if (found != listeners_.end()) {
+    found->second.subscriptions.erase(id);
+  }
+}
+
+std::vector<NetworkAdapterStatusObserver::StatusEvent> NetworkAdapterStatusObserver::ObservedStatusLocked() const {
+  std::vector<StatusEvent> events;
+  for (const auto &[luid_value, observed] : observed_status_) {
+    StatusEvent event;
+    event.kind = StatusEvent::Kind::kStatus;
+    CopyTruncated(event.status, observed.status);
+    event.luid = luid_value;
+    event.monotonic_us = PerfCounterMicroseconds();
+    events.push_back(event);
+  }
+  return events;
+}
+
+flutter::EncodableValue NetworkAdapterStatusObserver::EventValue(const StatusEvent &event,
+                                                                 flutter::EncodableList *subscriptions) {
+  flutter::EncodableMap event_map;
+  event_map[keys::kStatus] = flutter::EncodableValue(std::string(event.status));
+  event_map[keys::kLuid] = flutter::EncodableValue(static_cast<int64_t>(event.luid));
+  event_map[keys::kMonotonicUs] = flutter::EncodableValue(event.monotonic_us);
+  if (event.correlation_id[0] != '\0') {
+    event_map[keys::kCorrelationId] = flutter::EncodableValue(std::string(event.correlation_id));
+  }
+  if (subscriptions && !subscriptions->empty()) {
+    event_map[keys::kSubscriptions] = flutter::EncodableValue(std::move(*subscriptions));
+  }
+  switch (event.kind) {
+    case StatusEvent::Kind::kStatus:
+      break;
+    case StatusEvent::Kind::kReady:
+      event_map[keys::kEvent] = flutter::EncodableValue("ready");
+      event_map[keys::kTimestamp] = flutter::EncodableValue(event.time);
+      break;
+    case StatusEvent::Kind::kLiveness:
+      event_map[keys::kEvent] = flutter::EncodableValue(event.stale ? "stale" : "recovered");
+      event_map[keys::kPublicKey] = flutter::EncodableValue(std::string(event.public_key));
+      event_map[keys::kLatestHandshake] = flutter::EncodableValue(event.time);
+      break;
+    case StatusEvent::Kind::kAddressReady:
+      event_map[keys::kEvent] = flutter::EncodableValue("addressReady");
+      event_map[keys::kPrefix] = flutter::EncodableValue(std::string(event.prefix));
+      break;
+    case StatusEvent::Kind::kAddressRemoved:
+      event_map[keys::kEvent] = flutter::EncodableValue("addressRemoved");
+      event_map[keys::kPrefix] = flutter::EncodableValue(std::string(event.prefix));
+      break;
+    case StatusEvent::Kind::kRouteAdded:
+      event_map[keys::kEvent] = flutter::EncodableValue("routeAdded");
+      event_map[keys::kPrefix] = flutter::EncodableValue(std::string(event.prefix));
+      break;
+    case StatusEvent::Kind::kRouteRemoved:
+      event_map[keys::kEvent] = flutter::EncodableValue("routeRemoved");
+      event_map[keys::kPrefix] = flutter::EncodableValue(std::string(event.prefix));
+      break;
+    case StatusEvent::Kind::kRoamed:
+      event_map[keys::kEvent] = flutter::EncodableValue("roamed");
+      event_map[keys::kPublicKey] = flutter::EncodableValue(std::string(event.public_key));
+      event_map[keys::kPreviousEndpoint] = flutter::EncodableValue(std::string(event.previous_endpoint));
+      event_map[keys::kEndpoint] = flutter::EncodableValue(std::string(event.endpoint));
+      break;
+    case StatusEvent::Kind::kActivation:
+      event_map[keys::kEvent] = flutter::EncodableValue("activation");
+      event_map[keys::kActivatedPeers] = flutter::EncodableValue(static_cast<int64_t>(event.activated));
+      event_map[keys::kTotalPeers] = flutter::EncodableValue(static_cast<int64_t>(event.total));
+      break;
+  }
+  return flutter::EncodableValue(std::move(event_map));
+}
+
+ConnectionStatus NetworkAdapterStatusObserver::GetInterfaceStatus(const NET_LUID &luid) const {
+  MIB_IF_ROW2 if_row = {};
   if_row.InterfaceLuid = luid;
 
-  DWORD result = GetIfEntry2(&if_row);
+  // Only the oper status is wanted; the counters are what makes the full read slow
+  DWORD result = GetIfEntry2Ex(MibIfEntryNormalWithoutStatistics, &if_row);
   if (result != NO_ERROR) {
     logger_->error("Failed to get interface entry: {}", result);
-    return ConnectionStatusToString(ConnectionStatus::unknown);
+    return ConnectionStatus::unknown;
   }
 
-  auto if_oper_status = ConnectionStatusFromIfOperStatus(if_row.OperStatus);
-  return ConnectionStatusToString(if_oper_status);
+  return ConnectionStatusFromIfOperStatus(if_row.OperStatus);
 }
 
 void NetworkAdapterStatusObserver::Cleanup() { StopAllObserving(); }
 
 std::optional<NET_LUID> NetworkAdapterStatusObserver::GetMonitoredAdapter(const NET_LUID &luid) const {
-  auto it = std::find_if(monitored_adapters_.begin(), monitored_adapters_.end(),
-                         [&luid](const NET_LUID &monitored_luid) { return monitored_luid.Value == luid.Value; });
-  return (it != monitored_adapters_.end()) ? std::optional<NET_LUID>(*it) : std::nullopt;
+  return IsObserved(luid.Value) ? std::optional<NET_LUID>(luid) : std::nullopt;
+}
+
+bool NetworkAdapterStatusObserver::IsObserved(uint64_t luid) const {
+  // Counted before the array is loaded, so a change that finds no reader cannot free the one loaded here
+  observed_readers_.fetch_add(1, std::memory_order_seq_cst);
+  const std::vector<uint64_t> *observed = observed_luids_.load(std::memory_order_seq_cst);
+  bool found = std::binary_search(observed->begin(), observed->end(), luid);
+  observed_readers_.fetch_sub(1, std::memory_order_release);
+  return found;
+}
+
+void NetworkAdapterStatusObserver::PublishObserved(std::vector<uint64_t> &&luids) {
+  published_luids_.push_back(std::make_unique<const std::vector<uint64_t>>(std::move(luids)));
+  observed_luids_.store(published_luids_.back().get(), std::memory_order_seq_cst);
+  // A reader counted after this loads the new array, so with none counted now the replaced ones are unreachable.
+  // One running keeps them until a later change finds none.
+  if (published_luids_.size() > 1 && observed_readers_.load(std::memory_order_seq_cst) == 0) {
+    published_luids_.erase(published_luids_.begin(), published_luids_.end() - 1);
+  }
+}
+
+std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+NetworkAdapterStatusObserver::Listen(uint64_t engine, const flutter::EncodableValue *arguments,
+                                     std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> events) {
+  Listener listener;
+  if (const auto *options = arguments ? std::get_if<flutter::EncodableMap>(arguments) : nullptr) {
+    const auto *batched = std::get_if<bool>(ValueOrNull(*options, keys::kBatched));
+    listener.batched = batched && *batched;
+    const auto *routed = std::get_if<bool>(ValueOrNull(*options, keys::kRouted));
+    listener.routed = routed && *routed;
+    StatusFilter filter;
+    std::string error;
+    if (!ParseFilter(*options, &filter, &error)) {
+      return std::make_unique<flutter::StreamHandlerError<flutter::EncodableValue>>("INVALID_ARGUMENT", error,
+                                                                                    nullptr);
+    }
+    if (!filter.luids.empty() || !filter.tunnel_names.empty() || filter.event_types != kAllEventTypes) {
+      listener.filter = std::move(filter);
+    }
+  }
+  listener.sink = std::move(events);
+
+  // A new listener gets the last status of every adapter from the observation, without asking the system again.
+  // Under the lock, with what was queued sent first, so a change is either part of the replay or sent after it.
+  std::lock_guard<std::mutex> lock(adapters_mutex_);
+  DrainEvents();
+  std::vector<StatusEvent> replay = ObservedStatusLocked();
+  for (StatusEvent &event : replay) {
+    StampCorrelation(event);
+  }
+  if (listeners_.empty()) {
+    listening_.store(true, std::memory_order_release);
+    emitted_status_.clear();
+    for (const StatusEvent &event : replay) {
+      emitted_status_[event.luid] = event.status;
+    }
+  }
+  Listener &added = listeners_[engine] = std::move(listener);
+  Send(added, replay);
+  return nullptr;
+}
+
+void NetworkAdapterStatusObserver::Cancel(uint64_t engine) {
+  listeners_.erase(engine);
+  if (listeners_.empty()) {
+    listening_.store(false, std::memory_order_release);
+  }
+}
+
+std::unique_ptr<flutter::StreamHandler<flutter::EncodableValue>> NetworkAdapterStatusObserver::HandlerFor(
+    uint64_t engine) {
+  return std::make_unique<flutter::StreamHandlerFunctions<>>(
+      [this, engine](const flutter::EncodableValue *arguments, std::unique_ptr<flutter::EventSink<>> &&events)
+          -> std::unique_ptr<flutter::StreamHandlerError<>> { return Listen(engine, arguments, std::move(events)); },
+      [this, engine](const flutter::EncodableValue *) -> std::unique_ptr<flutter::StreamHandlerError<>> {
+        Cancel(engine);
+        return nullptr;
+      });
 }
 
 std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
 NetworkAdapterStatusObserver::OnListenInternal(const flutter::EncodableValue *arguments,
                                                std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> &&events) {
-  sink_ = std::move(events);
-  return nullptr;
+  return Listen(kOwnChannel, arguments, std::move(events));
 }
 
 std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
 NetworkAdapterStatusObserver::OnCancelInternal(const flutter::EncodableValue *arguments) {
-  if (sink_) {
-    sink_.reset();
-  }
+  Cancel(kOwnChannel);
   return nullptr;
 }
 
@@ -4,11 +4,16 @@
 #include <flutter/encodable_value.h>
 #include <flutter/event_channel.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 // Windows API include order is important to avoid conflicts
@@ -18,24 +23,162 @@
 #include <iphlpapi.h>
 #include <netioapi.h>
 
-namespace spdlog {
-class logger;
-} // namespace spdlog
+#include <map>
+
+#include "connection_status.h"
+#include "mpsc_queue.h"
+#include "platform_task_runner.h"
+#include "plugin_logger.h"
+#include "wireguard.h"
 
 namespace wireguard_dart {
 
+/**
+ * Sends the status of the observed adapters on the status stream, along with their addresses becoming usable or
+ * removed and their routes added or removed, from one set of interface, address and route notifications. The system
+ * calls back on its own threads, which only queue fixed-size event records without a lock; the platform thread
+ * drains them in batches and is the only one that uses the sinks. Each engine listens with its own options and
+ * subscriptions, see HandlerFor.
+ */
 class NetworkAdapterStatusObserver : public flutter::StreamHandler<flutter::EncodableValue> {
 public:
-  NetworkAdapterStatusObserver();
+  static constexpr size_t kEventQueueCapacity = 256;
+
+  // Without a valid runner, events are sent from the thread they happen on
+  explicit NetworkAdapterStatusObserver(PlatformTaskRunner *platform_tasks = nullptr);
   virtual ~NetworkAdapterStatusObserver();
 
-  void StartObserving(const NET_LUID &luid);
+  // The tunnel name is what subscriptions filtering by tunnel name match the adapter's events by
+  void StartObserving(const NET_LUID &luid, const std::string &tunnel_name = std::string());
   void StopObserving(const NET_LUID &luid);
   void StopAllObserving();
 
   bool IsMonitoring(const NET_LUID &luid) const;
 
+  /**
+   * Read the status of an adapter only once the window has passed since the first interface change of a burst,
+   * so that a burst costs one GetIfEntry2Ex. Zero, the default, reads it on every notification. Either way only
+   * transitions are sent on the status stream.
+   */
+  void SetCoalesceWindow(std::chrono::milliseconds window);
+
+  /**
+   * The status of an observed adapter as of its last interface change notification, without asking the
+   * system; nullopt until there is an observation. A new listener on the status stream gets these first.
+   */
+  std::optional<std::string> GetObservedStatus(const NET_LUID &luid) const;
+
+  // An observed status with when the adapter moved into it, in milliseconds since 1970 and on the clock of
+  // monotonicUs
+  struct ObservedStatus {
+    std::string status;
+    int64_t since_ms = 0;
+    int64_t since_monotonic_us = 0;
+  };
+  // The same as GetObservedStatus, with the time of the last transition
+  std::optional<ObservedStatus> GetObservedTransition(const NET_LUID &luid) const;
+
+  /**
+   * Send a "ready" event on the status stream, with the time in microseconds since the epoch, as soon as the
+   * interface is up and every one of these addresses has finished duplicate address detection. Replaces an
+   * earlier watch of the same adapter; the adapter has to be observed.
+   */
+  void WatchAddressReadiness(const NET_LUID &luid, const std::vector<WIREGUARD_ALLOWED_IP> &addresses);
+
+  // Called on the notification's thread when the addresses of a watch all became usable, whether or not the status
+  // stream has a listener. Set once, before any adapter is observed.
+  using ReadyCallback = std::function<void(const NET_LUID &luid)>;
+  void SetReadyCallback(ReadyCallback callback) { ready_callback_ = std::move(callback); }
+
+  /**
+   * Send a "stale" event on the status stream when a peer's latest handshake got older than the stale
+   * threshold, and "recovered" when it completed one again, with the base64 public key and the handshake in
+   * milliseconds since the epoch, 0 if there was none. On the platform thread.
+   */
+  void NotifyPeerLiveness(const NET_LUID &luid, const std::string &public_key, bool stale, int64_t latest_handshake);
+
+  /**
+   * Send a "roamed" event on the status stream when the driver moved a peer to another endpoint, with the base64
+   * public key and the previous and current endpoint as "address:port", IPv6 addresses in brackets. From any thread.
+   */
+  void NotifyEndpointRoamed(const NET_LUID &luid, const std::string &public_key, const SOCKADDR_INET &previous,
+                            const SOCKADDR_INET &current);
+
+  // Send an "activation" event on the status stream with how many of the tunnel's peers are in the driver, after
+  // each batch of a staged activation, see WireguardAdapter::StagePeerActivation. From any thread.
+  void NotifyActivation(const NET_LUID &luid, uint64_t activated, uint64_t total);
+
+  /**
+   * Progress of bringing an observed adapter up or down, which its interface status does not show: once it is
+   * up it is connecting until NotifyHandshake, and disconnecting after NotifyDisconnecting until it is down.
+   * Each sends the status on the stream if it changed. From any thread.
+   */
+  void NotifyConnecting(const NET_LUID &luid);
+  void NotifyHandshake(const NET_LUID &luid);
+  // With false when bringing the adapter down failed
+  void NotifyDisconnecting(const NET_LUID &luid, bool disconnecting = true);
+
+  /**
+   * Every event of the adapter sent from now on carries the ID, which the app gave the call that set it up or
+   * brought it up or down, until another replaces it; empty for none. Up to 63 characters are kept. From any thread.
+   */
+  void SetCorrelationId(const NET_LUID &luid, const std::string &correlation_id);
+
+  /**
+   * Where the interface change notifications come in, as the system calls it: first the initial notification,
+   * without a row, then one for each change of any interface, most of them of other adapters. From any thread, so
+   * recorded or synthetic notifications can be fed in at any rate.
+   */
+  void OnInterfaceChange(const MIB_IPINTERFACE_ROW *row, MIB_NOTIFICATION_TYPE notification_type);
+
+  // Of the events queued for the platform thread, since the observer was created
+  struct DrainStatistics {
+    uint64_t drains = 0;
+    uint64_t events = 0;
+    // The most events one drain found queued
+    uint64_t max_depth = 0;
+    uint64_t dropped = 0;
+    // Spent draining, sending on the stream included
+    int64_t drain_us = 0;
+  };
+  DrainStatistics GetDrainStatistics() const;
+
+  static constexpr uint32_t kAllEventTypes = ~0u;
+  /**
+   * Which events a listener or subscription of the status stream is sent: those of an adapter with one of the
+   * LUIDs or tunnel names, of one of the event types, an empty list matching every adapter or type. The types are
+   * "status" for status changes and the names in "event" for the rest.
+   */
+  struct StatusFilter {
+    std::vector<uint64_t> luids;
+    std::vector<std::string> tunnel_names;
+    uint32_t event_types = kAllEventTypes;
+  };
+  // From the "luids", "tunnelNames" and "events" of listen or subscribe arguments; false, with the reason, when
+  // one of them is not a list of what it should be
+  static bool ParseFilter(const flutter::EncodableMap &arguments, StatusFilter *filter, std::string *error);
+
+  /**
+   * For an engine whose listener asked for "routed", so that many subscribers share the one listen the engine has:
+   * each event goes out once, with the IDs of the subscriptions it matches in "subscriptions", and not at all when
+   * it matches none. Subscribing sends the new subscription alone the last status of each observed adapter it
+   * matches; the same ID replaces a subscription of the engine. IDs are the engine's own; a new listen starts
+   * without any and cancelling drops them. On the platform thread.
+   */
+  void Subscribe(uint64_t engine, int64_t id, StatusFilter filter);
+  void Unsubscribe(uint64_t engine, int64_t id);
+
+  /**
+   * The stream handler for an engine's status channel, so that every engine listens with its own options. Listening
+   * through the observer itself is the same as listening as engine kOwnChannel. Cancel drops the engine's
+   * listener, as when it cancels, for an engine going away without.
+   */
+  std::unique_ptr<flutter::StreamHandler<flutter::EncodableValue>> HandlerFor(uint64_t engine);
+  void Cancel(uint64_t engine);
+  static constexpr uint64_t kOwnChannel = 0;
+
 protected:
+  // As engine kOwnChannel, see Listen
   virtual std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
   OnListenInternal(const flutter::EncodableValue *arguments,
                    std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> &&events) override;
@@ -43,28 +186,182 @@ protected:
   virtual std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
   OnCancelInternal(const flutter::EncodableValue *arguments) override;
 
+  /**
+   * Register for the system's interface, address and route change notifications, with the mutex held; false if
+   * the interface changes could not be registered for. Cancelled with the handles taken out, without the mutex.
+   * Overridden, along with GetInterfaceStatus, to run the observer on notifications fed to OnInterfaceChange.
+   */
+  virtual bool RegisterNotifications();
+  virtual void CancelNotifications(HANDLE interface_handle, HANDLE address_handle, HANDLE route_handle);
+  // From the interface's oper status alone, read without the interface counters
+  virtual ConnectionStatus GetInterfaceStatus(const NET_LUID &luid) const;
+
 private:
+  // What an engine asked for when it listened; on the platform thread
+  struct Listener;
+
+  struct StatusEvent {
+    enum class Kind : uint8_t {
+      kStatus,
+      kReady,
+      kLiveness,
+      kAddressReady,
+      kAddressRemoved,
+      kRouteAdded,
+      kRouteRemoved,
+      kRoamed,
+      kActivation
+    };
+
+    Kind kind = Kind::kStatus;
+    bool stale = false;
+    // Long enough for every ConnectionStatus name
+    char status[16] = {};
+    uint64_t luid = 0;
+    // Microseconds since the epoch for ready, the latest handshake in milliseconds for liveness
+    int64_t time = 0;
+    // Base64, for liveness and roaming
+    char public_key[48] = {};
+    // The address with its on-link prefix length, or the route's destination prefix
+    char prefix[64] = {};
+    // With the port, for roaming
+    char previous_endpoint[64] = {};
+    char endpoint[64] = {};
+    // Peers in the driver and in the configuration, for activation
+    uint64_t activated = 0;
+    uint64_t total = 0;
+    // When it was queued, see PerfCounterMicroseconds, and the adapter's correlation ID then
+    int64_t monotonic_us = 0;
+    char correlation_id[64] = {};
+  };
+
   std::optional<NET_LUID> GetMonitoredAdapter(const NET_LUID &luid) const;
+  // Without the mutex, wait-free, for the system callbacks to skip the interfaces of other adapters
+  bool IsObserved(uint64_t luid) const;
+  // With the mutex held, replaces the observed LUIDs, and frees the replaced ones unless IsObserved is running
+  void PublishObserved(std::vector<uint64_t> &&luids);
+
+  // From any thread; the event is dropped and counted if the queue is full, which returns false
+  bool Enqueue(const StatusEvent &event);
+  void StampCorrelation(StatusEvent &event);
+  // On the platform thread
+  void DrainEvents();
+  void Deliver(const StatusEvent &event);
+  // To one listener, as one list if it asked for "batched"
+  void Send(Listener &listener, const std::vector<StatusEvent> &events);
+  // With the subscriptions it is for, when there are any, which it takes
+  static flutter::EncodableValue EventValue(const StatusEvent &event, flutter::EncodableList *subscriptions = nullptr);
+  // Of the event types a filter names
+  static uint32_t EventTypeBit(const StatusEvent &event);
+  bool Matches(const StatusFilter &filter, const StatusEvent &event);
+  // Whether the event goes out to the listener at all, and when routed which subscriptions it is for
+  bool Route(const Listener &listener, const StatusEvent &event, flutter::EncodableList *subscriptions);
+  // The last status of every observed adapter, as events
+  std::vector<StatusEvent> ObservedStatusLocked() const;
+
+  /**
+   * The arguments may hold "batched", a filter as ParseFilter reads it that every event has to match, and
+   * "routed", see Subscribe. Replaces the engine's listener; the new one gets the observed status first.
+   */
+  std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+  Listen(uint64_t engine, const flutter::EncodableValue *arguments,
+         std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> events);
 
   // Static callback for Windows API
   static VOID CALLBACK IpInterfaceChangeCallback(PVOID caller_context, PMIB_IPINTERFACE_ROW row,
                                                  MIB_NOTIFICATION_TYPE notification_type);
 
+  static VOID CALLBACK UnicastAddressChangeCallback(PVOID caller_context, PMIB_UNICASTIPADDRESS_ROW row,
+                                                    MIB_NOTIFICATION_TYPE notification_type);
+
+  static VOID CALLBACK RouteChangeCallback(PVOID caller_context, PMIB_IPFORWARD_ROW2 row,
+                                           MIB_NOTIFICATION_TYPE notification_type);
+
+  static VOID CALLBACK CoalesceTimerCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_TIMER timer);
+
   void HandleInterfaceChange(const NET_LUID &luid, MIB_NOTIFICATION_TYPE notification_type);
-  void NotifyStatusChange(const NET_LUID &luid, const std::string &status);
-  std::string GetInterfaceStatus(const NET_LUID &luid) const;
+  // Read the status and send it if it differs from the last one sent for the adapter
+  void ReportInterfaceStatus(const NET_LUID &luid);
+  /**
+   * From the initial notification of a registration: bring the state of every observed adapter up to date from
+   * one read of the interface table, covering a change that came while the notifications were being registered
+   */
+  void SeedInterfaceStatus();
+  void HandleAddressChange(const MIB_UNICASTIPADDRESS_ROW &row, MIB_NOTIFICATION_TYPE notification_type);
+  void HandleRouteChange(const MIB_IPFORWARD_ROW2 &row, MIB_NOTIFICATION_TYPE notification_type);
+  void NotifyNetworkChange(const NET_LUID &luid, StatusEvent::Kind kind, const std::string &prefix);
+  void CheckAddressReadiness(const NET_LUID &luid);
+  bool AreAddressesReady(const NET_LUID &luid, const std::vector<SOCKADDR_INET> &addresses) const;
+  void NotifyReady(const NET_LUID &luid);
+  // False if the status was not sent, so the last one emitted stays as it was
+  bool NotifyStatusChange(const NET_LUID &luid, const std::string &status);
+  // Applies the change to the adapter's state machine and sends the status if it differs from the last one sent
+  using ConnectionStateChange = std::function<ConnectionStatus(ConnectionStateMachine &)>;
+  void UpdateConnectionState(const NET_LUID &luid, const ConnectionStateChange &change);
+  // Keeps the time of the transition when the status is the one it was
+  void SetObservedStatusLocked(uint64_t luid, const std::string &status);
   void Cleanup();
 
   mutable std::mutex adapters_mutex_;
-  std::vector<NET_LUID> monitored_adapters_;
+  // Sorted LUIDs of the observed adapters, never changed once published: a change publishes a new array. The
+  // replaced ones are kept until a change finds no IsObserved running; the last one is the current one.
+  std::atomic<const std::vector<uint64_t> *> observed_luids_{nullptr};
+  std::vector<std::unique_ptr<const std::vector<uint64_t>>> published_luids_;
+  // Calls of IsObserved running, each of which may be reading any published array
+  mutable std::atomic<int> observed_readers_{0};
+  // Interface status and handshake progress of each observed adapter, by LUID
+  std::unordered_map<uint64_t, ConnectionStateMachine> connection_states_;
+  // Last status seen for each observed adapter and when it changed to it, by LUID
+  std::unordered_map<uint64_t, ObservedStatus> observed_status_;
+  // Last status sent on the stream for each adapter, by LUID, so that repeated notifications send nothing
+  std::unordered_map<uint64_t, std::string> emitted_status_;
+  // Adapters with a change waiting for the coalescing timer, by LUID
+  std::unordered_set<uint64_t> coalescing_;
+  std::chrono::milliseconds coalesce_window_{0};
+  PTP_TIMER coalesce_timer_ = nullptr;
+  // Addresses still to become usable, by adapter LUID
+  std::unordered_map<uint64_t, std::vector<SOCKADDR_INET>> pending_ready_;
+  // Addresses sent as ready, by adapter LUID, so that parameter changes of a usable address send nothing
+  std::unordered_map<uint64_t, std::set<std::string>> ready_addresses_;
+  ReadyCallback ready_callback_;
+
+  struct Listener {
+    std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> sink;
+    // A drain sends all its events as one list
+    bool batched = false;
+    // What every event sent has to match
+    std::optional<StatusFilter> filter;
+    // See Subscribe
+    bool routed = false;
+    std::map<int64_t, StatusFilter> subscriptions;
+  };
+  // By engine. Only used on the platform thread; the other threads go by listening_, whether there are any
+  std::map<uint64_t, Listener> listeners_;
+  std::atomic<bool> listening_{false};
 
-  std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> sink_;
+  PlatformTaskRunner *platform_tasks_;
+  MpscQueue<StatusEvent, kEventQueueCapacity> events_;
+  PlatformTaskRunner::Signal drain_signal_;
+  std::atomic<uint64_t> dropped_events_{0};
+  // Only written by the platform thread
+  std::atomic<uint64_t> drains_{0};
+  std::atomic<uint64_t> drained_events_{0};
+  std::atomic<uint64_t> max_drain_depth_{0};
+  std::atomic<uint64_t> dropped_total_{0};
+  std::atomic<int64_t> drain_us_{0};
+  // Apart from adapters_mutex_, which Enqueue is called with and without
+  std::mutex correlation_mutex_;
+  std::unordered_map<uint64_t, std::string> correlation_ids_;
+  // Under correlation_mutex_ as well. Kept after an adapter is no longer observed, for its events still queued.
+  std::unordered_map<uint64_t, std::string> tunnel_names_;
 
   // Notification handle for interface changes
   HANDLE interface_notification_handle_;
+  HANDLE address_notification_handle_;
+  HANDLE route_notification_handle_;
   bool notifications_registered_;
 
-  std::shared_ptr<spdlog::logger> logger_;
+  PluginLogger logger_;
 };
 
 } // namespace wireguard_dart
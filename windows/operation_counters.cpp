@@ -0,0 +1,155 @@
+#include "operation_counters.h"
+
+#include "transient_retry.h"
+
+namespace wireguard_dart {
+
+const char *ErrorClassName(ErrorClass error_class) {
+  switch (error_class) {
+    case ErrorClass::kInvalidArgument:
+      return "invalidArgument";
+    case ErrorClass::kNotFound:
+      return "notFound";
+    case ErrorClass::kAlreadyExists:
+      return "alreadyExists";
+    case ErrorClass::kAccessDenied:
+      return "accessDenied";
+    case ErrorClass::kTransient:
+      return "transient";
+    case ErrorClass::kTimeout:
+      return "timeout";
+    case ErrorClass::kCancelled:
+      return "cancelled";
+    case ErrorClass::kUnsupported:
+      return "unsupported";
+    default:
+      return "other";
+  }
+}
+
+ErrorClass ClassifyWin32Error(DWORD error, MeteredCall call) {
+  switch (error) {
+    case ERROR_INVALID_PARAMETER:
+    case ERROR_INVALID_DATA:
+    case ERROR_BAD_ARGUMENTS:
+    case ERROR_INVALID_NAME:
+      return ErrorClass::kInvalidArgument;
+    case ERROR_ALREADY_EXISTS:
+    case ERROR_OBJECT_ALREADY_EXISTS:
+    case ERROR_FILE_EXISTS:
+      return ErrorClass::kAlreadyExists;
+    case ERROR_ACCESS_DENIED:
+    case ERROR_PRIVILEGE_NOT_HELD:
+    case ERROR_ELEVATION_REQUIRED:
+      return ErrorClass::kAccessDenied;
+    case ERROR_TIMEOUT:
+    case ERROR_SEM_TIMEOUT:
+    case WAIT_TIMEOUT:
+      return ErrorClass::kTimeout;
+    case ERROR_CANCELLED:
+    case ERROR_OPERATION_ABORTED:
+      return ErrorClass::kCancelled;
+    case ERROR_NOT_SUPPORTED:
+    case ERROR_CALL_NOT_IMPLEMENTED:
+      return ErrorClass::kUnsupported;
+    default:
+      break;
+  }
+  // A missing interface is transient for some calls right after the adapter was created
+  if (call != MeteredCall::kCount && IsTransientError(call, error)) {
+    return ErrorClass::kTransient;
+  }
+  switch (error) {
+    case ERROR_NOT_FOUND:
+    case ERROR_FILE_NOT_FOUND:
+    case ERROR_PATH_NOT_FOUND:
+    case ERROR_OBJECT_NOT_FOUND:
+    case ERROR_DEV_NOT_EXIST:
+      return ErrorClass::kNotFound;
+    case ERROR_BUSY:
+    case ERROR_RETRY:
+    case ERROR_NOT_READY:
+    case ERROR_DEVICE_NOT_AVAILABLE:
+    case ERROR_SHARING_VIOLATION:
+    case ERROR_LOCK_VIOLATION:
+    case ERROR_NO_SYSTEM_RESOURCES:
+      return ErrorClass::kTransient;
+    default:
+      return ErrorClass::kOther;
+  }
+}
+
+ErrorClass ClassifyErrorCode(const std::string &code) {
+  if (code == "TIMEOUT") {
+    return ErrorClass::kTimeout;
+  }
+  if (code == "CANCELLED") {
+    return ErrorClass::kCancelled;
+  }
+  if (code == "TUNNEL_SERVICE_INSTALLED") {
+    return ErrorClass::kAlreadyExists;
+  }
+  if (code.find("NOT_FOUND") != std::string::npos || code == "WIREGUARD_LIBRARY_NOT_AVAILABLE") {
+    return ErrorClass::kNotFound;
+  }
+  // INVALID_CONFIG and ADAPTER_INVALID alike
+  if (code.find("INVALID") != std::string::npos) {
+    return ErrorClass::kInvalidArgument;
+  }
+  return ErrorClass::kOther;
+}
+
+OperationCounters &OperationCounters::Instance() {
+  static OperationCounters instance;
+  return instance;
+}
+
+std::string OperationCounters::OpenMetricsFamilies() const {
+  static const char kMethodCalls[] = "wireguard_dart_method_calls";
+  static const char kCallOutcomes[] = "wireguard_dart_call_outcomes";
+  static const char kCacheLookups[] = "wireguard_dart_cache_lookups";
+
+  auto outcome_name = [](size_t outcome) {
+    return outcome == kSucceeded ? "ok" : ErrorClassName(static_cast<ErrorClass>(outcome));
+  };
+  auto samples = [this, &outcome_name](const char *family, const char *label, size_t slot, const std::string &name) {
+    std::string text;
+    for (size_t outcome = 0; outcome < kOutcomes; outcome++) {
+      uint64_t count = counts_[slot][outcome].load(std::memory_order_relaxed);
+      if (count != 0) {
+        text += std::string(family) + "_total{" + label + "=\"" + name + "\",outcome=\"" + outcome_name(outcome) +
+                "\"} " + std::to_string(count) + "\n";
+      }
+    }
+    return text;
+  };
+
+  std::string text;
+  text += std::string("# TYPE ") + kMethodCalls + " counter\n";
+  text += std::string("# HELP ") + kMethodCalls + " Method calls answered, by outcome.\n";
+  for (size_t i = 0; i < kMethods; i++) {
+    text += samples(kMethodCalls, "method", MethodSlot(static_cast<WireguardMethod>(i)),
+                    std::string(method_table::kNames[i]));
+  }
+  text += std::string("# TYPE ") + kCallOutcomes + " counter\n";
+  text += std::string("# HELP ") + kCallOutcomes + " WireGuard driver and IP Helper calls made, by outcome.\n";
+  for (size_t i = 0; i < kCalls; i++) {
+    auto call = static_cast<MeteredCall>(i);
+    text += samples(kCallOutcomes, "call", CallSlot(call), MeteredCallName(call));
+  }
+  text += std::string("# TYPE ") + kCacheLookups + " counter\n";
+  text += std::string("# HELP ") + kCacheLookups + " Lookups in the plugin's caches, by result.\n";
+  static const char *const kCacheNames[] = {"configuration", "keyPool"};
+  for (size_t i = 0; i < lookups_.size(); i++) {
+    for (size_t hit = 0; hit < 2; hit++) {
+      uint64_t count = lookups_[i][hit].load(std::memory_order_relaxed);
+      if (count != 0) {
+        text += std::string(kCacheLookups) + "_total{cache=\"" + kCacheNames[i] + "\",result=\"" +
+                (hit ? "hit" : "miss") + "\"} " + std::to_string(count) + "\n";
+      }
+    }
+  }
+  return text;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <windows.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "call_metrics.h"
+#include "wireguard_methods.h"
+
+namespace wireguard_dart {
+
+// What a failure was, whatever operation it was of; alerts go by these rather than by the exact error
+enum class ErrorClass : size_t {
+  kInvalidArgument,
+  kNotFound,
+  kAlreadyExists,
+  kAccessDenied,
+  kTransient,
+  kTimeout,
+  kCancelled,
+  kUnsupported,
+  kOther,
+  kCount
+};
+
+const char *ErrorClassName(ErrorClass error_class);
+// The class of a Win32 error; call tells the errors that are transient for it, see IsTransientError
+ErrorClass ClassifyWin32Error(DWORD error, MeteredCall call = MeteredCall::kCount);
+// The class of the error code a method answered with, such as ADAPTER_NOT_FOUND or TIMEOUT
+ErrorClass ClassifyErrorCode(const std::string &code);
+
+// The caches whose lookups are counted
+enum class CountedCache : size_t { kConfiguration, kKeyPool, kCount };
+
+/**
+ * How often every method and every metered driver or IP Helper call succeeded and failed, by error class, and how
+ * often the caches answered. A fixed table of relaxed atomic counters, so counting is one addition from any thread
+ * without a lock; read back with getMetrics. Driver calls are counted where their Win32 error is known, which is
+ * every call made through RetryTransient.
+ */
+class OperationCounters {
+public:
+  static OperationCounters &Instance();
+
+  void CountMethod(WireguardMethod method) { Add(MethodSlot(method), kSucceeded); }
+  void CountMethod(WireguardMethod method, ErrorClass error_class) {
+    Add(MethodSlot(method), static_cast<size_t>(error_class));
+  }
+  // ERROR_SUCCESS counts as a success
+  void CountCall(MeteredCall call, DWORD error) {
+    Add(CallSlot(call), error == ERROR_SUCCESS ? kSucceeded : static_cast<size_t>(ClassifyWin32Error(error, call)));
+  }
+  void CountLookup(CountedCache cache, bool hit) {
+    lookups_[static_cast<size_t>(cache)][hit ? 1 : 0].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * The counter families wireguard_dart_method_calls, labelled by method and outcome, wireguard_dart_call_outcomes,
+   * labelled by call and outcome, and wireguard_dart_cache_lookups, labelled by cache and result, in the OpenMetrics
+   * text format. The outcome is ok or the error class; only the counts that are not zero are listed.
+   */
+  std::string OpenMetricsFamilies() const;
+
+private:
+  // The error classes, then the successes
+  static constexpr size_t kSucceeded = static_cast<size_t>(ErrorClass::kCount);
+  static constexpr size_t kOutcomes = kSucceeded + 1;
+  static constexpr size_t kMethods = method_table::kCount;
+  static constexpr size_t kCalls = static_cast<size_t>(MeteredCall::kCount);
+
+  static size_t MethodSlot(WireguardMethod method) { return static_cast<size_t>(method); }
+  static size_t CallSlot(MeteredCall call) { return kMethods + static_cast<size_t>(call); }
+  void Add(size_t slot, size_t outcome) { counts_[slot][outcome].fetch_add(1, std::memory_order_relaxed); }
+
+  std::array<std::array<std::atomic<uint64_t>, kOutcomes>, kMethods + kCalls> counts_ = {};
+  // Misses, then hits
+  std::array<std::array<std::atomic<uint64_t>, 2>, static_cast<size_t>(CountedCache::kCount)> lookups_ = {};
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,40 @@
+#include "operation_token.h"
+
+namespace wireguard_dart {
+
+OperationRegistry::Operation OperationRegistry::Begin(std::optional<int64_t> id, std::chrono::milliseconds timeout) {
+  Operation operation;
+  operation.token = std::make_shared<OperationToken>(timeout);
+  std::lock_guard<std::mutex> lock(mutex_);
+  operation.id = id ? *id : next_private_id_--;
+  // An id Dart uses again replaces the earlier operation, which then cannot be cancelled any more
+  operations_[operation.id] = operation.token;
+  return operation;
+}
+
+std::shared_ptr<OperationToken> OperationRegistry::Find(int64_t id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = operations_.find(id);
+  return it != operations_.end() ? it->second : nullptr;
+}
+
+void OperationRegistry::End(const Operation &operation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = operations_.find(operation.id);
+  // Unless a later operation took over the id
+  if (it != operations_.end() && it->second == operation.token) {
+    operations_.erase(it);
+  }
+}
+
+bool OperationRegistry::Cancel(int64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = operations_.find(id);
+  if (it == operations_.end()) {
+    return false;
+  }
+  it->second->Cancel();
+  return true;
+}
+
+} // namespace wireguard_dart
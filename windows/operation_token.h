@@ -0,0 +1,69 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace wireguard_dart {
+
+/**
+ * Lets a long operation, such as setupTunnel, be abandoned: once cancelOperation asked for it or once its deadline
+ * passed. The operation checks between its phases, where it can still roll back what it changed; a driver or IP
+ * Helper call in progress is not interrupted. Safe from any thread.
+ */
+class OperationToken {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // No deadline with a timeout of 0
+  explicit OperationToken(std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+      : deadline_(timeout.count() > 0 ? Clock::now() + timeout : Clock::time_point::max()) {}
+
+  void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+
+  // ERROR_SUCCESS while the operation may go on, else why it must stop: ERROR_CANCELLED or ERROR_TIMEOUT
+  DWORD Check() const {
+    if (cancelled_.load(std::memory_order_relaxed)) {
+      return ERROR_CANCELLED;
+    }
+    return Clock::now() >= deadline_ ? ERROR_TIMEOUT : ERROR_SUCCESS;
+  }
+
+private:
+  std::atomic<bool> cancelled_{false};
+  Clock::time_point deadline_;
+};
+
+/**
+ * The operations in progress by the id Dart gave them, so cancelOperation can reach one from the platform thread
+ * while it runs on a tunnel worker. Operations without an id get one of their own, below 0, that Dart never sees.
+ */
+class OperationRegistry {
+public:
+  struct Operation {
+    int64_t id = 0;
+    std::shared_ptr<OperationToken> token;
+  };
+
+  // Start tracking an operation, from now on, so the time it waits behind the tunnel's earlier calls counts
+  // towards its timeout
+  Operation Begin(std::optional<int64_t> id, std::chrono::milliseconds timeout);
+  // The token of the operation, nullptr once it ended
+  std::shared_ptr<OperationToken> Find(int64_t id) const;
+  void End(const Operation &operation);
+  // Whether an operation with the id was still in progress
+  bool Cancel(int64_t id);
+
+private:
+  mutable std::mutex mutex_;
+  std::map<int64_t, std::shared_ptr<OperationToken>> operations_;
+  int64_t next_private_id_ = -1;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,261 @@
+#include "path_mtu_prober.h"
+
+#include <icmpapi.h>
+
+#include <algorithm>
+
+#include "background_threads.h"
+#include "call_metrics.h"
+#include "cpu_accounting.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr DWORD kIcmpHeaderSize = 8;
+constexpr DWORD kIpv4HeaderSize = 20;
+constexpr DWORD kIpv6HeaderSize = 40;
+// Smallest packet every link of the family has to carry
+constexpr DWORD kIpv4MinimumMtu = 576;
+constexpr DWORD kIpv6MinimumMtu = 1280;
+constexpr DWORD kAttemptsPerSize = 2;
+
+// MTU of the interface the endpoint is currently routed through
+DWORD RouteMtu(const SOCKADDR_INET &endpoint) {
+  MIB_IPFORWARD_ROW2 route;
+  SOCKADDR_INET source;
+  if (GetBestRoute2(nullptr, 0, nullptr, &endpoint, 0, &route, &source) != NO_ERROR) {
+    return 0;
+  }
+
+  MIB_IPINTERFACE_ROW iface;
+  InitializeIpInterfaceEntry(&iface);
+  iface.InterfaceLuid = route.InterfaceLuid;
+  iface.Family = endpoint.si_family;
+  if (GetIpInterfaceEntry(&iface) != NO_ERROR) {
+    return 0;
+  }
+  return iface.NlMtu;
+}
+
+} // namespace
+
+PathMtuProber::PathMtuProber() {}
+
+PathMtuProber::~PathMtuProber() { Stop(); }
+
+bool PathMtuProber::Start(const NET_LUID &tunnel_luid, const std::vector<SOCKADDR_INET> &endpoints,
+                          ApplyCallback apply) {
+  Stop();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tunnel_luid_ = tunnel_luid;
+    endpoints_.clear();
+    for (const auto &endpoint : endpoints) {
+      if (endpoint.si_family == AF_INET || endpoint.si_family == AF_INET6) {
+        endpoints_.push_back(endpoint);
+      }
+    }
+    apply_ = std::move(apply);
+    applied_mtu_ = 0;
+    probe_requested_ = true;
+    stopping_ = false;
+  }
+  worker_ = std::thread(&PathMtuProber::Run, this);
+
+  DWORD result = NotifyRouteChange2(AF_UNSPEC, RouteChangeCallback, this, FALSE, &notification_handle_);
+  if (result != NO_ERROR) {
+    notification_handle_ = nullptr;
+    logger_->error("Failed to register for route change notifications: Windows error {}", result);
+    return false;
+  }
+  return true;
+}
+
+void PathMtuProber::AddEndpoint(const SOCKADDR_INET &endpoint) {
+  if (endpoint.si_family != AF_INET && endpoint.si_family != AF_INET6) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!worker_.joinable()) {
+    return;
+  }
+  endpoints_.push_back(endpoint);
+  probe_requested_ = true;
+  wake_.notify_one();
+}
+
+void PathMtuProber::Stop() {
+  // CancelMibChangeNotify2 waits for running callbacks, which take the lock
+  HANDLE handle_to_cancel = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    handle_to_cancel = notification_handle_;
+    notification_handle_ = nullptr;
+  }
+  wake_.notify_all();
+
+  if (handle_to_cancel) {
+    DWORD result = MeteredInvoke(MeteredCall::kCancelMibChangeNotify2, CancelMibChangeNotify2, handle_to_cancel);
+    if (result != NO_ERROR) {
+      logger_->warn("Failed to cancel route change notifications: Windows error {}", result);
+    }
+  }
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+VOID CALLBACK PathMtuProber::RouteChangeCallback(PVOID caller_context, PMIB_IPFORWARD_ROW2 row,
+                                                 MIB_NOTIFICATION_TYPE notification_type) {
+  auto *prober = static_cast<PathMtuProber *>(caller_context);
+  if (!prober || notification_type == MibInitialNotification) {
+    return;
+  }
+  if (row && row->InterfaceLuid.Value == prober->tunnel_luid_.Value) {
+    return;
+  }
+
+  prober->RequestProbe();
+}
+
+void PathMtuProber::RequestProbe() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  probe_requested_ = true;
+  wake_.notify_one();
+}
+
+void PathMtuProber::Run() {
+  ThrottleCurrentThread();
+  ScopedThreadCpu cpu(BackgroundThread::kPathMtuProber);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool first = true;
+  while (!stopping_) {
+    wake_.wait(lock, [this] { return stopping_ || probe_requested_; });
+    WakeupCounts::Instance().Count(BackgroundThread::kPathMtuProber);
+    if (!first) {
+      // Let the routes settle, the requests coming in meanwhile are covered by this probe
+      wake_.wait_for(lock, kSettleDelay, [this] { return stopping_.load(); });
+    }
+    if (stopping_) {
+      break;
+    }
+    first = false;
+    probe_requested_ = false;
+    std::vector<SOCKADDR_INET> endpoints = endpoints_;
+    lock.unlock();
+
+    DWORD mtu = 0;
+    for (const auto &endpoint : endpoints) {
+      DWORD path_mtu = ProbePathMtu(endpoint);
+      if (path_mtu == 0) {
+        continue;
+      }
+      DWORD overhead = endpoint.si_family == AF_INET ? kIpv4Overhead : kIpv6Overhead;
+      DWORD tunnel_mtu = (std::max)(path_mtu > overhead ? path_mtu - overhead : 0, kMinimumTunnelMtu);
+      mtu = mtu == 0 ? tunnel_mtu : (std::min)(mtu, tunnel_mtu);
+    }
+
+    lock.lock();
+    if (mtu == 0) {
+      logger_->warn("Could not measure the path MTU to any of {} endpoints", endpoints.size());
+    } else if (mtu != applied_mtu_ && !stopping_) {
+      applied_mtu_ = mtu;
+      ApplyCallback apply = apply_;
+      lock.unlock();
+      logger_->info("Path MTU probe sets tunnel MTU to {}", mtu);
+      apply(mtu);
+      lock.lock();
+    }
+  }
+}
+
+DWORD PathMtuProber::ProbePathMtu(const SOCKADDR_INET &endpoint) {
+  bool ipv4 = endpoint.si_family == AF_INET;
+  HANDLE icmp = ipv4 ? IcmpCreateFile() : Icmp6CreateFile();
+  if (icmp == INVALID_HANDLE_VALUE) {
+    logger_->error("Failed to open an ICMP handle: Windows error {}", GetLastError());
+    return 0;
+  }
+
+  DWORD lower = ipv4 ? kIpv4MinimumMtu : kIpv6MinimumMtu;
+  DWORD upper = RouteMtu(endpoint);
+  if (upper == 0) {
+    upper = 1500;
+  }
+
+  // The usual answer is the full link MTU, which takes one probe. Otherwise binary search between a size that
+  // fits and one that does not.
+  DWORD result = 0;
+  if (upper <= lower || FitsPath(icmp, endpoint, upper)) {
+    result = upper;
+  } else if (FitsPath(icmp, endpoint, lower)) {
+    DWORD fits = lower;
+    DWORD too_big = upper;
+    while (too_big - fits > 1 && !stopping_) {
+      DWORD middle = fits + (too_big - fits) / 2;
+      if (FitsPath(icmp, endpoint, middle)) {
+        fits = middle;
+      } else {
+        too_big = middle;
+      }
+    }
+    result = stopping_ ? 0 : fits;
+  }
+
+  IcmpCloseHandle(icmp);
+  return result;
+}
+
+bool PathMtuProber::FitsPath(HANDLE icmp, const SOCKADDR_INET &endpoint, DWORD packet_size) {
+  bool ipv4 = endpoint.si_family == AF_INET;
+  DWORD headers = (ipv4 ? kIpv4HeaderSize : kIpv6HeaderSize) + kIcmpHeaderSize;
+  std::vector<BYTE> payload(packet_size - headers);
+  // Room for the reply header, the echoed payload and an ICMP error
+  std::vector<BYTE> reply(sizeof(ICMP_ECHO_REPLY) + sizeof(ICMPV6_ECHO_REPLY) + payload.size() + 8 +
+                          sizeof(IO_STATUS_BLOCK));
+
+  IP_OPTION_INFORMATION options = {};
+  options.Ttl = 128;
+  options.Flags = IP_FLAG_DF;
+
+  // A lost probe is retried, so that only a size that keeps failing counts as too big
+  for (DWORD attempt = 0; attempt < kAttemptsPerSize && !stopping_; attempt++) {
+    DWORD replies;
+    if (ipv4) {
+      replies = IcmpSendEcho2(icmp, nullptr, nullptr, nullptr, endpoint.Ipv4.sin_addr.s_addr, payload.data(),
+                              static_cast<WORD>(payload.size()), &options, reply.data(),
+                              static_cast<DWORD>(reply.size()), kProbeTimeoutMs);
+    } else {
+      sockaddr_in6 source = {};
+      source.sin6_family = AF_INET6;
+      sockaddr_in6 destination = endpoint.Ipv6;
+      destination.sin6_port = 0;
+      replies = Icmp6SendEcho2(icmp, nullptr, nullptr, nullptr, &source, &destination, payload.data(),
+                               static_cast<WORD>(payload.size()), &options, reply.data(),
+                               static_cast<DWORD>(reply.size()), kProbeTimeoutMs);
+    }
+
+    // Without a reply the status comes from the last error
+    ULONG status = GetLastError();
+    if (replies > 0) {
+      status = ipv4 ? reinterpret_cast<const ICMP_ECHO_REPLY *>(reply.data())->Status
+                    : reinterpret_cast<const ICMPV6_ECHO_REPLY *>(reply.data())->Status;
+    }
+    if (status == IP_SUCCESS) {
+      return true;
+    }
+    // Too big is a definite answer, only timeouts are worth another try
+    if (status == IP_PACKET_TOO_BIG) {
+      return false;
+    }
+  }
+  return false;
+}
+
+} // namespace wireguard_dart
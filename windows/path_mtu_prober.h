@@ -0,0 +1,87 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * Measures the path MTU to the peer endpoints for MTU = auto and sizes the tunnel to fit inside it.
+ * Each endpoint is probed with ICMP echoes that must not be fragmented, binary searching between the
+ * protocol minimum and the MTU of the interface the endpoint is routed through. The smallest path, less
+ * the WireGuard encapsulation overhead of its address family, is handed to the apply callback. Probing runs
+ * on a background thread and again whenever a route outside the tunnel changes.
+ *
+ * Endpoints that do not answer pings cannot be measured; the tunnel keeps its current MTU for them.
+ */
+class PathMtuProber {
+public:
+  using ApplyCallback = std::function<void(DWORD mtu)>;
+
+  // Outer IP header, UDP header and the 32 bytes WireGuard adds to every data packet
+  static constexpr DWORD kIpv4Overhead = 20 + 8 + 32;
+  static constexpr DWORD kIpv6Overhead = 40 + 8 + 32;
+  // Below this the interface would lose IPv6
+  static constexpr DWORD kMinimumTunnelMtu = 1280;
+  // Route changes come in bursts while a network comes up
+  static constexpr std::chrono::milliseconds kSettleDelay{2000};
+  static constexpr DWORD kProbeTimeoutMs = 1000;
+
+  PathMtuProber();
+  ~PathMtuProber();
+
+  PathMtuProber(const PathMtuProber &) = delete;
+  PathMtuProber &operator=(const PathMtuProber &) = delete;
+
+  /**
+   * Start probing these endpoints, replacing an earlier run
+   * @param tunnel_luid The tunnel interface, changes to its own routes do not trigger a probe
+   * @param endpoints The peer endpoints, ports are ignored
+   * @param apply Called from the probing thread with each new tunnel MTU
+   */
+  bool Start(const NET_LUID &tunnel_luid, const std::vector<SOCKADDR_INET> &endpoints, ApplyCallback apply);
+
+  // Include an endpoint that became known later, like a resolved hostname, and probe again
+  void AddEndpoint(const SOCKADDR_INET &endpoint);
+
+  void Stop();
+
+private:
+  static VOID CALLBACK RouteChangeCallback(PVOID caller_context, PMIB_IPFORWARD_ROW2 row,
+                                           MIB_NOTIFICATION_TYPE notification_type);
+  void RequestProbe();
+  void Run();
+
+  // Largest packet that reaches the endpoint unfragmented, or 0 if it could not be measured
+  DWORD ProbePathMtu(const SOCKADDR_INET &endpoint);
+  bool FitsPath(HANDLE icmp, const SOCKADDR_INET &endpoint, DWORD packet_size);
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool probe_requested_ = false;
+  std::atomic<bool> stopping_{false};
+  NET_LUID tunnel_luid_ = {};
+  std::vector<SOCKADDR_INET> endpoints_;
+  ApplyCallback apply_;
+  DWORD applied_mtu_ = 0;
+
+  std::thread worker_;
+  HANDLE notification_handle_ = nullptr;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,79 @@
+#include "peer_activation.h"
+
+#include <algorithm>
+#include <system_error>
+
+#include "cpu_accounting.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+constexpr std::chrono::milliseconds PeerActivation::kTolerance;
+constexpr std::chrono::milliseconds PeerActivation::kRetryDelay;
+
+PeerActivation::~PeerActivation() { Stop(); }
+
+void PeerActivation::Start(std::vector<std::vector<PeerKey>> batches, size_t activated, size_t total,
+                           std::chrono::milliseconds interval, AddBatch add_batch, Progress progress) {
+  Stop();
+  if (batches.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  running_.store(true, std::memory_order_release);
+  try {
+    worker_ = std::thread(&PeerActivation::Run, this, std::move(batches), activated, total, interval,
+                          std::move(add_batch), std::move(progress));
+  } catch (const std::system_error &) {
+    running_.store(false, std::memory_order_release);
+    logger_->error("Failed to start the peer activation, {} of {} peers stay inactive", total - activated, total);
+  }
+}
+
+void PeerActivation::Stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker = std::move(worker_);
+  }
+  wake_.Notify();
+  if (worker.joinable()) {
+    worker.join();
+  }
+  running_.store(false, std::memory_order_release);
+}
+
+bool PeerActivation::Wait(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !wake_.WaitFor(lock, timeout, kTolerance, [this] { return stopping_.load(); });
+}
+
+void PeerActivation::Run(std::vector<std::vector<PeerKey>> batches, size_t activated, size_t total,
+                         std::chrono::milliseconds interval, AddBatch add_batch, Progress progress) {
+  ScopedThreadCpu cpu(BackgroundThread::kPeerActivation);
+  size_t next = 0;
+  std::chrono::milliseconds wait = interval;
+  while (next < batches.size() && Wait(wait)) {
+    size_t added = 0;
+    if (!add_batch(batches[next], &added)) {
+      wait = (std::max)(interval, kRetryDelay);
+      continue;
+    }
+    wait = interval;
+    activated += added;
+    total -= batches[next].size() - added;
+    next++;
+    progress(activated, total);
+  }
+  if (next == batches.size()) {
+    logger_->info("Activated all {} peers", total);
+  } else {
+    logger_->info("Peer activation stopped with {} of {} peers active", activated, total);
+  }
+  running_.store(false, std::memory_order_release);
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "background_threads.h"
+#include "plugin_logger.h"
+#include "wireguard_core/peer_statistics.h"
+
+namespace wireguard_dart {
+
+/**
+ * Adds the peers a tunnel came up without to the driver a batch every interval, see
+ * WireguardAdapter::StagePeerActivation. The batches are fixed when it starts; a batch add cannot take yet, because
+ * the adapter is busy, is tried again after the next interval, and no sooner than kRetryDelay.
+ */
+class PeerActivation {
+public:
+  /**
+   * Called from the activation thread to add the peers, false to be called again with the same batch
+   * @param added Set to how many of the batch were added, without those removed from the configuration since
+   */
+  using AddBatch = std::function<bool(const std::vector<PeerKey> &batch, size_t *added)>;
+  /**
+   * After each batch, with the peers the driver has of those staged; peers removed before their batch came leave
+   * the total, so the last call has activated == total
+   */
+  using Progress = std::function<void(size_t activated, size_t total)>;
+
+  // A batch may go this much later, where Windows coalesces the wakeup with other timers
+  static constexpr std::chrono::milliseconds kTolerance{10};
+  // The least wait before a batch that could not be added is tried again
+  static constexpr std::chrono::milliseconds kRetryDelay{100};
+
+  PeerActivation() = default;
+  ~PeerActivation();
+
+  PeerActivation(const PeerActivation &) = delete;
+  PeerActivation &operator=(const PeerActivation &) = delete;
+
+  /**
+   * Add the batches one interval apart, the first one interval from now, replacing an earlier run
+   * @param activated The peers the driver already has, which count towards the progress
+   */
+  void Start(std::vector<std::vector<PeerKey>> batches, size_t activated, size_t total,
+             std::chrono::milliseconds interval, AddBatch add_batch, Progress progress);
+  // Leaves the batches not added yet out; returns once a batch in progress was added
+  void Stop();
+  // Whether there are batches left to add
+  bool IsRunning() const { return running_.load(std::memory_order_acquire); }
+
+private:
+  void Run(std::vector<std::vector<PeerKey>> batches, size_t activated, size_t total,
+           std::chrono::milliseconds interval, AddBatch add_batch, Progress progress);
+  // Wait for the next batch, false once stopped
+  bool Wait(std::chrono::milliseconds timeout);
+
+  std::mutex mutex_;
+  CoalescingWait wake_{BackgroundThread::kPeerActivation};
+  std::atomic<bool> stopping_{false};
+  std::atomic<bool> running_{false};
+  std::thread worker_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+#include "wireguard_core/peer_statistics.h"
+
+namespace wireguard_dart {
+
+// PeerStatistics, the rate tracker and the peerStatisticsBinary layout are shared with Linux in wireguard_core;
+// the driver reports handshakes as FILETIMEs, which these convert
+
+// A FILETIME, in 100ns intervals since 1601, in milliseconds since 1970 as Dart gets it; 0 stays 0
+inline uint64_t FiletimeToUnixMillis(uint64_t filetime) {
+  constexpr uint64_t kUnixEpoch = 116444736000000000ULL;
+  return filetime > kUnixEpoch ? (filetime - kUnixEpoch) / 10000 : 0;
+}
+
+// Milliseconds since 1970 as a FILETIME, the inverse of FiletimeToUnixMillis; 0 stays 0
+inline uint64_t UnixMillisToFiletime(uint64_t unix_millis) {
+  constexpr uint64_t kUnixEpoch = 116444736000000000ULL;
+  return unix_millis != 0 ? unix_millis * 10000 + kUnixEpoch : 0;
+}
+
+} // namespace wireguard_dart
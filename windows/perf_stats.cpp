@@ -0,0 +1,122 @@
+#include "perf_stats.h"
+
+#include <psapi.h>
+
+#include <algorithm>
+
+#pragma comment(lib, "psapi.lib")
+
+#include "trace_events.h"
+
+namespace wireguard_dart {
+
+int64_t PerfCounterMicroseconds() {
+  static const int64_t frequency = []() {
+    LARGE_INTEGER value;
+    QueryPerformanceFrequency(&value);
+    return static_cast<int64_t>(value.QuadPart);
+  }();
+
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  // Split so that the multiplication cannot overflow on a long uptime
+  int64_t ticks = counter.QuadPart;
+  return (ticks / frequency) * 1000000 + (ticks % frequency) * 1000000 / frequency;
+}
+
+int64_t PerfCounterNanoseconds() {
+  static const int64_t frequency = []() {
+    LARGE_INTEGER value;
+    QueryPerformanceFrequency(&value);
+    return static_cast<int64_t>(value.QuadPart);
+  }();
+
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  int64_t ticks = counter.QuadPart;
+  return (ticks / frequency) * 1000000000 + (ticks % frequency) * 1000000000 / frequency;
+}
+
+int64_t ProcessWorkingSetBytes() {
+  PROCESS_MEMORY_COUNTERS counters = {};
+  counters.cb = sizeof(counters);
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return static_cast<int64_t>(counters.WorkingSetSize);
+}
+
+void PerfStats::Record(const std::string &phase, int64_t microseconds, int64_t working_set_delta) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Samples &samples = phases_[phase];
+  samples.window[samples.next] = microseconds;
+  samples.next = (samples.next + 1) % kWindow;
+  samples.last_working_set_delta = working_set_delta;
+  if (samples.count == 0 || working_set_delta > samples.max_working_set_delta) {
+    samples.max_working_set_delta = working_set_delta;
+  }
+  samples.count++;
+}
+
+std::map<std::string, PerfStats::Summary> PerfStats::Snapshot() const {
+  std::map<std::string, Samples> phases;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases = phases_;
+  }
+
+  std::map<std::string, Summary> summaries;
+  for (const auto &entry : phases) {
+    const Samples &samples = entry.second;
+    size_t size = static_cast<size_t>((std::min)(samples.count, static_cast<uint64_t>(kWindow)));
+    std::vector<int64_t> sorted(samples.window.begin(), samples.window.begin() + size);
+    std::sort(sorted.begin(), sorted.end());
+
+    Summary summary;
+    summary.count = samples.count;
+    summary.last_us = samples.window[(samples.next + kWindow - 1) % kWindow];
+    summary.min_us = sorted.front();
+    summary.max_us = sorted.back();
+    int64_t total = 0;
+    for (int64_t sample : sorted) {
+      total += sample;
+    }
+    summary.mean_us = total / static_cast<int64_t>(size);
+    // Nearest rank
+    auto percentile = [&sorted](size_t percent) { return sorted[(sorted.size() - 1) * percent / 100]; };
+    summary.p50_us = percentile(50);
+    summary.p90_us = percentile(90);
+    summary.p99_us = percentile(99);
+    summary.last_working_set_delta = samples.last_working_set_delta;
+    summary.max_working_set_delta = samples.max_working_set_delta;
+    summaries[entry.first] = summary;
+  }
+  return summaries;
+}
+
+PhaseTimer::PhaseTimer(PerfStats *stats)
+    : stats_(stats), phase_start_us_(PerfCounterMicroseconds()),
+      phase_start_working_set_(stats ? ProcessWorkingSetBytes() : 0) {}
+
+void PhaseTimer::Lap(const char *phase) {
+  int64_t now = PerfCounterMicroseconds();
+  int64_t duration = now - phase_start_us_;
+  phase_start_us_ = now;
+  phases_.emplace_back(phase, duration);
+  if (stats_) {
+    // Read after the clock, so the duration leaves the call out
+    int64_t working_set = ProcessWorkingSetBytes();
+    stats_->Record(phase, duration, working_set - phase_start_working_set_);
+    phase_start_working_set_ = working_set;
+  }
+  TracePhase(phase, duration);
+}
+
+void PhaseTimer::Skip() {
+  phase_start_us_ = PerfCounterMicroseconds();
+  if (stats_) {
+    phase_start_working_set_ = ProcessWorkingSetBytes();
+  }
+}
+
+} // namespace wireguard_dart
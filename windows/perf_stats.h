@@ -0,0 +1,93 @@
+#pragma once
+
+#include <windows.h>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "operation_token.h"
+
+namespace wireguard_dart {
+
+// Microseconds on the performance counter, for durations only
+int64_t PerfCounterMicroseconds();
+int64_t PerfCounterNanoseconds();
+
+// The working set of this process in bytes, 0 if it cannot be read
+int64_t ProcessWorkingSetBytes();
+
+/**
+ * Durations of the setup and connect phases, by phase name. Each phase keeps its last kWindow samples, so the
+ * summary follows recent behaviour rather than averaging over the whole session. Besides its duration each phase
+ * records how much the process working set grew or shrank over it. Safe to use from any thread.
+ */
+class PerfStats {
+public:
+  static constexpr size_t kWindow = 128;
+
+  struct Summary {
+    // Every sample ever recorded; the rest are over the window
+    uint64_t count = 0;
+    int64_t last_us = 0;
+    int64_t min_us = 0;
+    int64_t max_us = 0;
+    int64_t mean_us = 0;
+    int64_t p50_us = 0;
+    int64_t p90_us = 0;
+    int64_t p99_us = 0;
+    // Working set change over the phase in bytes, the last one and the largest growth
+    int64_t last_working_set_delta = 0;
+    int64_t max_working_set_delta = 0;
+  };
+
+  void Record(const std::string &phase, int64_t microseconds, int64_t working_set_delta = 0);
+  std::map<std::string, Summary> Snapshot() const;
+
+private:
+  struct Samples {
+    std::array<int64_t, kWindow> window = {};
+    size_t next = 0;
+    uint64_t count = 0;
+    int64_t last_working_set_delta = 0;
+    int64_t max_working_set_delta = 0;
+  };
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Samples> phases_;
+};
+
+/**
+ * Splits one operation into consecutive phases: each Lap ends the phase running since the previous one, keeps
+ * its duration and records it in the stats. Carries the operation's token to where its phases end, which is
+ * where it may be abandoned. Used by a single thread at a time.
+ */
+class PhaseTimer {
+public:
+  explicit PhaseTimer(PerfStats *stats = nullptr);
+
+  void Lap(const char *phase);
+  // Start the next phase now, leaving the time since the last lap out
+  void Skip();
+
+  void SetOperation(std::shared_ptr<OperationToken> operation) { operation_ = std::move(operation); }
+  // OperationToken::Check of the operation, ERROR_SUCCESS without one
+  DWORD Abandoned() const { return operation_ ? operation_->Check() : ERROR_SUCCESS; }
+
+  // The phases in the order they ended, with their microseconds
+  const std::vector<std::pair<std::string, int64_t>> &Phases() const { return phases_; }
+
+private:
+  PerfStats *stats_;
+  int64_t phase_start_us_;
+  int64_t phase_start_working_set_;
+  std::vector<std::pair<std::string, int64_t>> phases_;
+  std::shared_ptr<OperationToken> operation_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,108 @@
+#include "platform_task_runner.h"
+
+#include "cpu_accounting.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr wchar_t kWindowClassName[] = L"WireguardDartPlatformTaskRunner";
+
+HINSTANCE ModuleInstance() {
+  // The plugin DLL rather than the executable, so the class goes away with the module that owns its procedure
+  HMODULE module = nullptr;
+  GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                     reinterpret_cast<LPCWSTR>(&ModuleInstance), &module);
+  return module;
+}
+
+} // namespace
+
+PlatformTaskRunner::PlatformTaskRunner() {
+  HINSTANCE instance = ModuleInstance();
+
+  WNDCLASSEXW window_class = {};
+  window_class.cbSize = sizeof(window_class);
+  window_class.lpfnWndProc = WindowProc;
+  window_class.hInstance = instance;
+  window_class.lpszClassName = kWindowClassName;
+  // Fails harmlessly when an earlier instance registered the class already
+  RegisterClassExW(&window_class);
+
+  window_ = CreateWindowExW(0, kWindowClassName, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, instance, nullptr);
+  if (window_) {
+    SetWindowLongPtrW(window_, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+  }
+}
+
+PlatformTaskRunner::~PlatformTaskRunner() {
+  if (window_) {
+    SetWindowLongPtrW(window_, GWLP_USERDATA, 0);
+    DestroyWindow(window_);
+  }
+}
+
+void PlatformTaskRunner::Post(Task task) {
+  if (!window_) {
+    task();
+    return;
+  }
+
+  bool was_empty;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    was_empty = tasks_.empty();
+    tasks_.push_back(std::move(task));
+  }
+  // One message covers every task queued until it is handled
+  if (was_empty) {
+    PostMessageW(window_, kRunTasksMessage, 0, 0);
+  }
+}
+
+void PlatformTaskRunner::Raise(Signal *signal) {
+  if (!window_) {
+    signal->run();
+    return;
+  }
+  // A signal already in the message queue runs for this raise too
+  if (!signal->pending.exchange(true, std::memory_order_acq_rel)) {
+    PostMessageW(window_, kSignalMessage, 0, reinterpret_cast<LPARAM>(signal));
+  }
+}
+
+LRESULT CALLBACK PlatformTaskRunner::WindowProc(HWND window, UINT message, WPARAM wparam, LPARAM lparam) {
+  if (message == kRunTasksMessage) {
+    auto *runner = reinterpret_cast<PlatformTaskRunner *>(GetWindowLongPtrW(window, GWLP_USERDATA));
+    if (runner) {
+      ScopedCpuCycles cycles(CpuComponent::kPlatformTasks);
+      runner->RunTasks();
+    }
+    return 0;
+  }
+  if (message == kSignalMessage) {
+    auto *runner = reinterpret_cast<PlatformTaskRunner *>(GetWindowLongPtrW(window, GWLP_USERDATA));
+    auto *signal = reinterpret_cast<Signal *>(lparam);
+    if (runner && signal) {
+      // Cleared first, so a raise while it runs posts it again
+      signal->pending.store(false, std::memory_order_release);
+      ScopedCpuCycles cycles(CpuComponent::kPlatformTasks);
+      signal->run();
+    }
+    return 0;
+  }
+  return DefWindowProcW(window, message, wparam, lparam);
+}
+
+void PlatformTaskRunner::RunTasks() {
+  std::deque<Task> tasks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks.swap(tasks_);
+  }
+  for (auto &task : tasks) {
+    task();
+  }
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace wireguard_dart {
+
+/**
+ * Runs tasks posted from any thread on the thread that created it, through the messages of a message-only
+ * window. Method results and event sinks may only be used on the platform thread, so this is how work done
+ * on other threads reports back.
+ */
+class PlatformTaskRunner {
+public:
+  using Task = std::function<void()>;
+
+  // Must be created on the thread the tasks are to run on
+  PlatformTaskRunner();
+  // Tasks that have not run yet are dropped
+  ~PlatformTaskRunner();
+
+  PlatformTaskRunner(const PlatformTaskRunner &) = delete;
+  PlatformTaskRunner &operator=(const PlatformTaskRunner &) = delete;
+
+  // Whether the window exists; without it tasks run on the posting thread
+  bool IsValid() const { return window_ != nullptr; }
+
+  void Post(Task task);
+
+  /**
+   * A function run on the platform thread after Raise, once for all the raises made before it runs. Raise takes
+   * no lock and does not allocate, for callers that must return quickly, like system notification callbacks. The
+   * signal has to outlive the runner.
+   */
+  struct Signal {
+    explicit Signal(Task run) : run(std::move(run)) {}
+
+    Task run;
+    std::atomic<bool> pending{false};
+  };
+  void Raise(Signal *signal);
+
+private:
+  static constexpr UINT kRunTasksMessage = WM_APP + 0x57;
+  static constexpr UINT kSignalMessage = WM_APP + 0x58;
+
+  static LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wparam, LPARAM lparam);
+  void RunTasks();
+
+  HWND window_ = nullptr;
+  std::mutex mutex_;
+  std::deque<Task> tasks_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,42 @@
+#include "plugin_logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+std::atomic<spdlog::logger *> installed_logger{nullptr};
+
+// Every logger ever installed, which only grows by what nativeInit creates. Never destroyed, a teardown worker
+// left running at exit may still be logging.
+std::mutex installed_loggers_mutex;
+std::vector<std::shared_ptr<spdlog::logger>> &InstalledLoggers() {
+  static auto *loggers = new std::vector<std::shared_ptr<spdlog::logger>>();
+  return *loggers;
+}
+
+} // namespace
+
+spdlog::logger *PluginLogger::Current() {
+  spdlog::logger *logger = installed_logger.load(std::memory_order_acquire);
+  return logger ? logger : spdlog::default_logger_raw();
+}
+
+void PluginLogger::Install(std::shared_ptr<spdlog::logger> logger) {
+  std::lock_guard<std::mutex> lock(installed_loggers_mutex);
+  if (logger) {
+    auto &loggers = InstalledLoggers();
+    if (std::find(loggers.begin(), loggers.end(), logger) == loggers.end()) {
+      loggers.push_back(logger);
+    }
+  }
+  installed_logger.store(logger.get(), std::memory_order_release);
+}
+
+} // namespace wireguard_dart
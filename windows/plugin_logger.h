@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+
+namespace spdlog {
+class logger;
+} // namespace spdlog
+
+namespace wireguard_dart {
+
+/**
+ * A handle on the one logger of the whole plugin, used like a pointer to it. Every component keeps one instead of
+ * looking a logger up in the spdlog registry when it is created, so the file logger nativeInit installs reaches the
+ * objects that already exist, and each line costs one atomic read rather than the registry's mutex.
+ */
+class PluginLogger {
+public:
+  spdlog::logger *operator->() const { return Current(); }
+
+  // The installed logger, or spdlog's default logger while none is
+  static spdlog::logger *Current();
+
+  /**
+   * Log to this logger from now on, nullptr going back to the default logger. Installed loggers are kept for the
+   * rest of the process, so a line being logged on another thread never outlives its logger.
+   */
+  static void Install(std::shared_ptr<spdlog::logger> logger);
+};
+
+} // namespace wireguard_dart
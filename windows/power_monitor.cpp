@@ -0,0 +1,128 @@
+#include "power_monitor.h"
+
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// As in winnt.h, which only declares them unless INITGUID came first
+constexpr GUID kPowerSavingStatus = {0xe00958c0, 0xc213, 0x4ace, {0xac, 0x77, 0xfe, 0xcc, 0xed, 0x2e, 0xee, 0xa5}};
+constexpr GUID kConsoleDisplayState = {0x6fe69556, 0x704a, 0x47a0, {0x8f, 0x24, 0xc2, 0x8d, 0x93, 0x6f, 0xda, 0x47}};
+
+} // namespace
+
+PowerMonitor::~PowerMonitor() { Stop(); }
+
+bool PowerMonitor::Start(SavingChanged saving_changed, Resumed resumed) {
+  Stop();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    saving_changed_ = std::move(saving_changed);
+    resumed_ = std::move(resumed);
+    battery_saver_ = false;
+    display_off_ = false;
+    saving_ = false;
+  }
+
+  parameters_.Callback = Callback;
+  parameters_.Context = this;
+  DWORD result = PowerSettingRegisterNotification(&kPowerSavingStatus, DEVICE_NOTIFY_CALLBACK, &parameters_,
+                                                  &saver_notification_);
+  if (result != ERROR_SUCCESS) {
+    saver_notification_ = nullptr;
+    logger_->warn("Failed to register for battery saver notifications: Windows error {}", result);
+  }
+  result = PowerSettingRegisterNotification(&kConsoleDisplayState, DEVICE_NOTIFY_CALLBACK, &parameters_,
+                                            &display_notification_);
+  if (result != ERROR_SUCCESS) {
+    display_notification_ = nullptr;
+    logger_->warn("Failed to register for display state notifications: Windows error {}", result);
+  }
+  result = PowerRegisterSuspendResumeNotification(DEVICE_NOTIFY_CALLBACK, &parameters_, &suspend_notification_);
+  if (result != ERROR_SUCCESS) {
+    suspend_notification_ = nullptr;
+    logger_->warn("Failed to register for resume notifications: Windows error {}", result);
+  }
+  return saver_notification_ || display_notification_ || suspend_notification_;
+}
+
+void PowerMonitor::Stop() {
+  if (saver_notification_) {
+    PowerSettingUnregisterNotification(saver_notification_);
+    saver_notification_ = nullptr;
+  }
+  if (display_notification_) {
+    PowerSettingUnregisterNotification(display_notification_);
+    display_notification_ = nullptr;
+  }
+  if (suspend_notification_) {
+    PowerUnregisterSuspendResumeNotification(suspend_notification_);
+    suspend_notification_ = nullptr;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  saving_changed_ = nullptr;
+  resumed_ = nullptr;
+  idle_.wait(lock, [this] { return calling_ == 0; });
+}
+
+void PowerMonitor::CallUnlocked(std::unique_lock<std::mutex> &lock, const std::function<void()> &call) {
+  calling_++;
+  lock.unlock();
+  call();
+  lock.lock();
+  if (--calling_ == 0) {
+    idle_.notify_all();
+  }
+}
+
+ULONG CALLBACK PowerMonitor::Callback(PVOID context, ULONG type, PVOID setting) {
+  auto *monitor = static_cast<PowerMonitor *>(context);
+  if (!monitor) {
+    return ERROR_SUCCESS;
+  }
+  if (type == PBT_POWERSETTINGCHANGE && setting) {
+    monitor->HandleSetting(*static_cast<const POWERBROADCAST_SETTING *>(setting));
+  } else if (type == PBT_APMSUSPEND) {
+    monitor->logger_->info("System is going to sleep");
+  } else if (type == PBT_APMRESUMEAUTOMATIC) {
+    monitor->logger_->info("System resumed from sleep");
+    std::unique_lock<std::mutex> lock(monitor->mutex_);
+    if (monitor->resumed_) {
+      monitor->CallUnlocked(lock, monitor->resumed_);
+    }
+  }
+  return ERROR_SUCCESS;
+}
+
+void PowerMonitor::HandleSetting(const POWERBROADCAST_SETTING &setting) {
+  if (setting.DataLength < sizeof(DWORD)) {
+    return;
+  }
+  DWORD value;
+  memcpy(&value, setting.Data, sizeof(value));
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (IsEqualGUID(setting.PowerSetting, kPowerSavingStatus)) {
+    battery_saver_ = value != 0;
+  } else if (IsEqualGUID(setting.PowerSetting, kConsoleDisplayState)) {
+    // Dimmed, 2, still counts as on
+    display_off_ = value == 0;
+  } else {
+    return;
+  }
+  bool saving = battery_saver_ || display_off_;
+  if (saving == saving_) {
+    return;
+  }
+  saving_ = saving;
+  logger_->info("Power saving {} (battery saver {}, display {})", saving ? "on" : "off", battery_saver_ ? "on" : "off",
+                display_off_ ? "off" : "on");
+  if (saving_changed_) {
+    CallUnlocked(lock, [saving_changed = saving_changed_, saving]() { saving_changed(saving); });
+  }
+}
+
+} // namespace wireguard_dart
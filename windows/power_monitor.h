@@ -0,0 +1,62 @@
+#pragma once
+
+#include <windows.h>
+#include <powrprof.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * Follows the power state the plugin's polling adapts to. Battery saver and the display being off count as
+ * saving power; a resume from sleep is reported once the system is back, before the user may be. Registered
+ * with PowerSettingRegisterNotification and PowerRegisterSuspendResumeNotification as callbacks, so no window
+ * is needed. The callbacks run on a system thread, without the monitor's lock, and should return quickly.
+ */
+class PowerMonitor {
+public:
+  // Whether power is being saved now; the registration reports the current state first
+  using SavingChanged = std::function<void(bool saving)>;
+  // PBT_APMRESUMEAUTOMATIC
+  using Resumed = std::function<void()>;
+
+  PowerMonitor() = default;
+  ~PowerMonitor();
+
+  PowerMonitor(const PowerMonitor &) = delete;
+  PowerMonitor &operator=(const PowerMonitor &) = delete;
+
+  // Replaces an earlier run; false if no notification could be registered
+  bool Start(SavingChanged saving_changed, Resumed resumed);
+  // Waits for the callbacks still running
+  void Stop();
+
+private:
+  static ULONG CALLBACK Callback(PVOID context, ULONG type, PVOID setting);
+  void HandleSetting(const POWERBROADCAST_SETTING &setting);
+  // With lock held on mutex_: run call without it, so a callback that waits, like for the adapters, holds up
+  // neither the other notifications nor Stop's unregistering
+  void CallUnlocked(std::unique_lock<std::mutex> &lock, const std::function<void()> &call);
+
+  DEVICE_NOTIFY_SUBSCRIBE_PARAMETERS parameters_ = {};
+  HPOWERNOTIFY saver_notification_ = nullptr;
+  HPOWERNOTIFY display_notification_ = nullptr;
+  HPOWERNOTIFY suspend_notification_ = nullptr;
+
+  std::mutex mutex_;
+  SavingChanged saving_changed_;
+  Resumed resumed_;
+  bool battery_saver_ = false;
+  bool display_off_ = false;
+  bool saving_ = false;
+  // Callbacks running without the mutex, which Stop waits to end
+  int calling_ = 0;
+  std::condition_variable idle_;
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,111 @@
+#include "prefix_aggregation.h"
+
+#include <cstring>
+
+namespace wireguard_dart {
+
+bool ToNetworkPrefix(const WIREGUARD_ALLOWED_IP &allowed_ip, NetworkPrefix &prefix) {
+  prefix = {};
+  prefix.family = allowed_ip.AddressFamily;
+  prefix.prefix_length = allowed_ip.Cidr;
+  if (allowed_ip.AddressFamily == AF_INET) {
+    memcpy(prefix.address, &allowed_ip.Address.V4, 4);
+  } else if (allowed_ip.AddressFamily == AF_INET6) {
+    memcpy(prefix.address, &allowed_ip.Address.V6, 16);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+// Back from the shared prefixes of wireguard_core
+
+WIREGUARD_ALLOWED_IP FromPrefix(const NetworkPrefix &prefix) {
+  WIREGUARD_ALLOWED_IP allowed_ip = {};
+  allowed_ip.AddressFamily = static_cast<ADDRESS_FAMILY>(prefix.family);
+  allowed_ip.Cidr = prefix.prefix_length;
+  if (prefix.family == AF_INET) {
+    memcpy(&allowed_ip.Address.V4, prefix.address, 4);
+  } else {
+    memcpy(&allowed_ip.Address.V6, prefix.address, 16);
+  }
+  return allowed_ip;
+}
+
+std::vector<NetworkPrefix> ToPrefixes(const std::vector<WIREGUARD_ALLOWED_IP> &allowed_ips) {
+  std::vector<NetworkPrefix> converted;
+  converted.reserve(allowed_ips.size());
+  for (const auto &allowed_ip : allowed_ips) {
+    NetworkPrefix prefix;
+    if (ToNetworkPrefix(allowed_ip, prefix)) {
+      converted.push_back(prefix);
+    }
+  }
+  return converted;
+}
+
+std::vector<WIREGUARD_ALLOWED_IP> FromPrefixes(const std::vector<NetworkPrefix> &prefixes) {
+  std::vector<WIREGUARD_ALLOWED_IP> result;
+  result.reserve(prefixes.size());
+  for (const auto &prefix : prefixes) {
+    result.push_back(FromPrefix(prefix));
+  }
+  return result;
+}
+
+} // namespace
+
+std::vector<WIREGUARD_ALLOWED_IP> AggregatePrefixes(const std::vector<WIREGUARD_ALLOWED_IP> &prefixes) {
+  return FromPrefixes(AggregatePrefixes(ToPrefixes(prefixes)));
+}
+
+std::vector<WIREGUARD_ALLOWED_IP> SubtractPrefixes(const std::vector<WIREGUARD_ALLOWED_IP> &allowed,
+                                                   const std::vector<WIREGUARD_ALLOWED_IP> &excluded) {
+  return FromPrefixes(SubtractPrefixes(ToPrefixes(allowed), ToPrefixes(excluded)));
+}
+
+bool SplitDefaultRoutes(std::vector<WIREGUARD_ALLOWED_IP> &prefixes) {
+  bool split = false;
+  size_t count = prefixes.size();
+  for (size_t i = 0; i < count; i++) {
+    NetworkPrefix prefix;
+    if (prefixes[i].Cidr != 0 || !ToNetworkPrefix(prefixes[i], prefix)) {
+      continue;
+    }
+    std::vector<NetworkPrefix> halves = {prefix};
+    SplitDefaultRoutes(halves);
+    prefixes[i] = FromPrefix(halves[0]);
+    prefixes.push_back(FromPrefix(halves[1]));
+    split = true;
+  }
+  return split;
+}
+
+void AssignRoutes(RouteSet &routes, const std::vector<WIREGUARD_ALLOWED_IP> &allowed_ips) {
+  routes.Assign(ToPrefixes(allowed_ips));
+}
+
+void ChangeRoutes(RouteSet &routes, const std::vector<WIREGUARD_ALLOWED_IP> &added,
+                  const std::vector<WIREGUARD_ALLOWED_IP> &removed, std::vector<WIREGUARD_ALLOWED_IP> *added_routes,
+                  std::vector<WIREGUARD_ALLOWED_IP> *removed_routes) {
+  std::vector<NetworkPrefix> added_prefixes;
+  std::vector<NetworkPrefix> removed_prefixes;
+  routes.Change(ToPrefixes(added), ToPrefixes(removed), &added_prefixes, &removed_prefixes);
+  *added_routes = FromPrefixes(added_prefixes);
+  *removed_routes = FromPrefixes(removed_prefixes);
+  SplitDefaultRoutes(*added_routes);
+  SplitDefaultRoutes(*removed_routes);
+}
+
+std::shared_ptr<const SharedRoutes> AggregateRoutesShared(std::vector<WIREGUARD_ALLOWED_IP> allowed_ips) {
+  auto shared = std::make_shared<SharedRoutes>();
+  // Every route is a kernel round-trip, so overlapping and adjacent prefixes are collapsed first
+  shared->routes = AggregatePrefixes(allowed_ips);
+  shared->default_split = SplitDefaultRoutes(shared->routes);
+  shared->allowed_ips = std::move(allowed_ips);
+  return shared;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "wireguard.h"
+#include "wireguard_core/ip_prefix.h"
+
+namespace wireguard_dart {
+
+// The driver's allowed IP as a prefix of wireguard_core; false for another address family
+bool ToNetworkPrefix(const WIREGUARD_ALLOWED_IP &allowed_ip, NetworkPrefix &prefix);
+
+/**
+ * Reduce a set of IPv4/IPv6 prefixes to the smallest set of prefixes covering exactly the same addresses.
+ * Host bits are cleared, duplicates and prefixes inside another one are dropped, and sibling prefixes
+ * (e.g. 10.0.0.0/25 and 10.0.0.128/25) are merged into their parent, repeatedly.
+ * Entries of other address families are dropped. The result is sorted by family and address.
+ * @param prefixes The prefixes, in any order
+ * @return The aggregated prefixes
+ */
+std::vector<WIREGUARD_ALLOWED_IP> AggregatePrefixes(const std::vector<WIREGUARD_ALLOWED_IP> &prefixes);
+
+/**
+ * The addresses of allowed that are not in excluded, as the fewest prefixes covering exactly those, sorted by
+ * family and address. See the SubtractPrefixes of wireguard_core.
+ */
+std::vector<WIREGUARD_ALLOWED_IP> SubtractPrefixes(const std::vector<WIREGUARD_ALLOWED_IP> &allowed,
+                                                   const std::vector<WIREGUARD_ALLOWED_IP> &excluded);
+
+/**
+ * Replace default routes (0.0.0.0/0, ::/0) by their two halves, /1 each. Being more specific, these win over
+ * the physical default route without touching it or depending on metrics, which keeps that route around for
+ * the endpoint bypass routes. Run it after AggregatePrefixes, which would merge the halves back.
+ * @return true if there was a default route
+ */
+bool SplitDefaultRoutes(std::vector<WIREGUARD_ALLOWED_IP> &prefixes);
+
+// Start routes over with these allowed IPs, see RouteSet
+void AssignRoutes(RouteSet &routes, const std::vector<WIREGUARD_ALLOWED_IP> &allowed_ips);
+
+/**
+ * Add and remove allowed IPs of routes, see RouteSet::Change, with default routes in the routes that changed
+ * split as SplitDefaultRoutes does, as they are installed
+ */
+void ChangeRoutes(RouteSet &routes, const std::vector<WIREGUARD_ALLOWED_IP> &added,
+                  const std::vector<WIREGUARD_ALLOWED_IP> &removed, std::vector<WIREGUARD_ALLOWED_IP> *added_routes,
+                  std::vector<WIREGUARD_ALLOWED_IP> *removed_routes);
+
+/**
+ * The routes of a list of allowed IPs, with the list they came from
+ */
+struct SharedRoutes {
+  std::vector<WIREGUARD_ALLOWED_IP> allowed_ips;
+  // AggregatePrefixes, then SplitDefaultRoutes
+  std::vector<WIREGUARD_ALLOWED_IP> routes;
+  bool default_split = false;
+};
+
+/**
+ * The routes of allowed_ips, for the networking setup and the endpoint bypass routes of a tunnel to hold alike.
+ * Tunnels rarely route exactly the same list, so they are not shared between tunnels.
+ */
+std::shared_ptr<const SharedRoutes> AggregateRoutesShared(std::vector<WIREGUARD_ALLOWED_IP> allowed_ips);
+
+} // namespace wireguard_dart
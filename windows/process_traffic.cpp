@@ -0,0 +1,377 @@
+#include "process_traffic.h"
+
+#include <tcpestats.h>
+
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// Read a table into buffer, growing it until the table fits; read(table, size) returns what the table call does
+template <typename Read>
+bool ReadTable(std::vector<BYTE> &buffer, Read read) {
+  for (int attempt = 0; attempt < 4; attempt++) {
+    if (buffer.empty()) {
+      buffer.resize(16 * 1024);
+    }
+    ULONG size = static_cast<ULONG>(buffer.size());
+    DWORD result = read(buffer.data(), &size);
+    if (result == NO_ERROR) {
+      return true;
+    }
+    if (result != ERROR_INSUFFICIENT_BUFFER) {
+      return false;
+    }
+    // Connections come and go between the calls, so with some room to spare
+    buffer.resize(size + size / 4);
+  }
+  return false;
+}
+
+} // namespace
+
+bool ProcessTrafficMeter::ConnectionKey::operator<(const ConnectionKey &other) const {
+  if (family != other.family) {
+    return family < other.family;
+  }
+  if (local_port != other.local_port) {
+    return local_port < other.local_port;
+  }
+  if (remote_port != other.remote_port) {
+    return remote_port < other.remote_port;
+  }
+  int local_order = std::memcmp(local, other.local, sizeof(local));
+  if (local_order != 0) {
+    return local_order < 0;
+  }
+  return std::memcmp(remote, other.remote, sizeof(remote)) < 0;
+}
+
+ProcessTrafficMeter::~ProcessTrafficMeter() { Reset(); }
+
+bool ProcessTrafficMeter::Sample(const std::vector<Interface> &interfaces, std::vector<TunnelProcesses> *changes) {
+  changes->clear();
+  if (!ReadLocalAddresses(interfaces)) {
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now();
+  uint64_t elapsed_ms = last_sample_.time_since_epoch().count() == 0
+                            ? 0
+                            : std::chrono::duration_cast<std::chrono::milliseconds>(now - last_sample_).count();
+  last_sample_ = now;
+
+  generation_++;
+  for (auto &entry : processes_) {
+    entry.second.rx_delta = 0;
+    entry.second.tx_delta = 0;
+    entry.second.tcp_connections = 0;
+    entry.second.udp_sockets = 0;
+  }
+  if (!ReadTcp() || !ReadUdp()) {
+    return false;
+  }
+  // Closed connections take the bytes they moved since the last sample with them
+  for (auto it = connections_.begin(); it != connections_.end();) {
+    it = it->second.generation == generation_ ? std::next(it) : connections_.erase(it);
+  }
+
+  for (auto it = processes_.begin(); it != processes_.end();) {
+    Process &process = it->second;
+    bool present = process.generation == generation_;
+    if (present && process.rx_delta == 0 && process.tx_delta == 0 && process.tcp_connections == process.reported_tcp &&
+        process.udp_sockets == process.reported_udp) {
+      ++it;
+      continue;
+    }
+    if (changes->empty() || changes->back().tunnel_name != it->first.first) {
+      changes->push_back({it->first.first, {}});
+    }
+    ProcessTraffic traffic;
+    traffic.pid = it->first.second;
+    traffic.image = ImageName(traffic.pid);
+    traffic.rx_bytes = process.rx_bytes;
+    traffic.tx_bytes = process.tx_bytes;
+    if (elapsed_ms > 0) {
+      traffic.rx_bytes_per_second = process.rx_delta * 1000 / elapsed_ms;
+      traffic.tx_bytes_per_second = process.tx_delta * 1000 / elapsed_ms;
+    }
+    traffic.tcp_connections = process.tcp_connections;
+    traffic.udp_sockets = process.udp_sockets;
+    traffic.ended = !present;
+    changes->back().processes.push_back(std::move(traffic));
+    process.reported_tcp = process.tcp_connections;
+    process.reported_udp = process.udp_sockets;
+    if (present) {
+      ++it;
+    } else {
+      image_names_.erase(it->first.second);
+      it = processes_.erase(it);
+    }
+  }
+  return true;
+}
+
+void ProcessTrafficMeter::Reset() {
+  for (const auto &entry : connections_) {
+    if (entry.second.collecting) {
+      SetCollection(entry.second, false);
+    }
+  }
+  connections_.clear();
+  processes_.clear();
+  image_names_.clear();
+  last_sample_ = {};
+}
+
+bool ProcessTrafficMeter::ReadLocalAddresses(const std::vector<Interface> &interfaces) {
+  local_addresses_.clear();
+  tunnel_names_.clear();
+  for (const Interface &interface : interfaces) {
+    tunnel_names_.push_back(interface.tunnel_name);
+  }
+  if (interfaces.empty()) {
+    return true;
+  }
+
+  PMIB_UNICASTIPADDRESS_TABLE table = nullptr;
+  DWORD result = GetUnicastIpAddressTable(AF_UNSPEC, &table);
+  if (result != NO_ERROR) {
+    logger_->warn("Failed to read the unicast addresses for process traffic: {}", result);
+    return false;
+  }
+  for (ULONG i = 0; i < table->NumEntries; i++) {
+    const MIB_UNICASTIPADDRESS_ROW &row = table->Table[i];
+    for (size_t tunnel = 0; tunnel < interfaces.size(); tunnel++) {
+      if (row.InterfaceLuid.Value != interfaces[tunnel].luid.Value) {
+        continue;
+      }
+      LocalAddress local = {};
+      local.family = row.Address.si_family;
+      local.tunnel = tunnel;
+      if (local.family == AF_INET) {
+        std::memcpy(local.address, &row.Address.Ipv4.sin_addr, 4);
+      } else {
+        std::memcpy(local.address, &row.Address.Ipv6.sin6_addr, 16);
+      }
+      local_addresses_.push_back(local);
+    }
+  }
+  FreeMibTable(table);
+  return true;
+}
+
+size_t ProcessTrafficMeter::TunnelOf(ADDRESS_FAMILY family, const BYTE *address) const {
+  // A tunnel has a handful of addresses, a scan beats anything that has to be built
+  for (const LocalAddress &local : local_addresses_) {
+    if (local.family == family && std::memcmp(local.address, address, family == AF_INET ? 4 : 16) == 0) {
+      return local.tunnel;
+    }
+  }
+  return SIZE_MAX;
+}
+
+bool ProcessTrafficMeter::ReadTcp() {
+  if (local_addresses_.empty()) {
+    return true;
+  }
+  if (!ReadTable(tcp_buffer_, [](BYTE *data, ULONG *size) {
+        return GetTcpTable2(reinterpret_cast<PMIB_TCPTABLE2>(data), size, FALSE);
+      })) {
+    logger_->warn("Failed to read the TCP table for process traffic");
+    return false;
+  }
+  const auto *table4 = reinterpret_cast<const MIB_TCPTABLE2 *>(tcp_buffer_.data());
+  for (DWORD i = 0; i < table4->dwNumEntries; i++) {
+    const MIB_TCPROW2 &row = table4->table[i];
+    if (row.dwState == MIB_TCP_STATE_LISTEN) {
+      continue;
+    }
+    size_t tunnel = TunnelOf(AF_INET, reinterpret_cast<const BYTE *>(&row.dwLocalAddr));
+    if (tunnel == SIZE_MAX) {
+      continue;
+    }
+    ConnectionKey key = {};
+    key.family = AF_INET;
+    std::memcpy(key.local, &row.dwLocalAddr, 4);
+    std::memcpy(key.remote, &row.dwRemoteAddr, 4);
+    key.local_port = row.dwLocalPort;
+    key.remote_port = row.dwRemotePort;
+    MIB_TCPROW row4 = {};
+    row4.dwState = row.dwState;
+    row4.dwLocalAddr = row.dwLocalAddr;
+    row4.dwLocalPort = row.dwLocalPort;
+    row4.dwRemoteAddr = row.dwRemoteAddr;
+    row4.dwRemotePort = row.dwRemotePort;
+    Account(key, tunnel, row.dwOwningPid, &row4, nullptr);
+  }
+
+  if (!ReadTable(tcp_buffer_, [](BYTE *data, ULONG *size) {
+        return GetTcp6Table2(reinterpret_cast<PMIB_TCP6TABLE2>(data), size, FALSE);
+      })) {
+    logger_->warn("Failed to read the TCPv6 table for process traffic");
+    return false;
+  }
+  const auto *table6 = reinterpret_cast<const MIB_TCP6TABLE2 *>(tcp_buffer_.data());
+  for (DWORD i = 0; i < table6->dwNumEntries; i++) {
+    const MIB_TCP6ROW2 &row = table6->table[i];
+    if (row.State == MIB_TCP_STATE_LISTEN) {
+      continue;
+    }
+    size_t tunnel = TunnelOf(AF_INET6, reinterpret_cast<const BYTE *>(&row.LocalAddr));
+    if (tunnel == SIZE_MAX) {
+      continue;
+    }
+    ConnectionKey key = {};
+    key.family = AF_INET6;
+    std::memcpy(key.local, &row.LocalAddr, 16);
+    std::memcpy(key.remote, &row.RemoteAddr, 16);
+    key.local_port = row.dwLocalPort;
+    key.remote_port = row.dwRemotePort;
+    MIB_TCP6ROW row6 = {};
+    row6.State = row.State;
+    row6.LocalAddr = row.LocalAddr;
+    row6.dwLocalScopeId = row.dwLocalScopeId;
+    row6.dwLocalPort = row.dwLocalPort;
+    row6.RemoteAddr = row.RemoteAddr;
+    row6.dwRemoteScopeId = row.dwRemoteScopeId;
+    row6.dwRemotePort = row.dwRemotePort;
+    Account(key, tunnel, row.dwOwningPid, nullptr, &row6);
+  }
+  return true;
+}
+
+bool ProcessTrafficMeter::ReadUdp() {
+  if (local_addresses_.empty()) {
+    return true;
+  }
+  if (!ReadTable(udp_buffer_, [](BYTE *data, ULONG *size) {
+        return GetExtendedUdpTable(data, size, FALSE, AF_INET, UDP_TABLE_OWNER_PID, 0);
+      })) {
+    logger_->warn("Failed to read the UDP table for process traffic");
+    return false;
+  }
+  auto count = [this](size_t tunnel, DWORD pid) {
+    Process &process = processes_[{tunnel_names_[tunnel], pid}];
+    process.udp_sockets++;
+    process.generation = generation_;
+  };
+  const auto *table4 = reinterpret_cast<const MIB_UDPTABLE_OWNER_PID *>(udp_buffer_.data());
+  for (DWORD i = 0; i < table4->dwNumEntries; i++) {
+    const MIB_UDPROW_OWNER_PID &row = table4->table[i];
+    size_t tunnel = TunnelOf(AF_INET, reinterpret_cast<const BYTE *>(&row.dwLocalAddr));
+    if (tunnel != SIZE_MAX) {
+      count(tunnel, row.dwOwningPid);
+    }
+  }
+
+  if (!ReadTable(udp_buffer_, [](BYTE *data, ULONG *size) {
+        return GetExtendedUdpTable(data, size, FALSE, AF_INET6, UDP_TABLE_OWNER_PID, 0);
+      })) {
+    logger_->warn("Failed to read the UDPv6 table for process traffic");
+    return false;
+  }
+  const auto *table6 = reinterpret_cast<const MIB_UDP6TABLE_OWNER_PID *>(udp_buffer_.data());
+  for (DWORD i = 0; i < table6->dwNumEntries; i++) {
+    const MIB_UDP6ROW_OWNER_PID &row = table6->table[i];
+    size_t tunnel = TunnelOf(AF_INET6, row.ucLocalAddr);
+    if (tunnel != SIZE_MAX) {
+      count(tunnel, row.dwOwningPid);
+    }
+  }
+  return true;
+}
+
+void ProcessTrafficMeter::Account(const ConnectionKey &key, size_t tunnel, DWORD pid, const MIB_TCPROW *row4,
+                                  const MIB_TCP6ROW *row6) {
+  auto found = connections_.find(key);
+  bool is_new = found == connections_.end() || found->second.pid != pid;
+  if (is_new) {
+    Connection connection = {};
+    connection.family = key.family;
+    connection.tunnel = tunnel;
+    connection.pid = pid;
+    if (row4) {
+      connection.row4 = *row4;
+    } else {
+      connection.row6 = *row6;
+    }
+    SetCollection(connection, true);
+    DWORD error = GetLastError();
+    connection.collecting = error == NO_ERROR;
+    if (!connection.collecting && error == ERROR_ACCESS_DENIED && !access_denied_logged_) {
+      access_denied_logged_ = true;
+      logger_->warn("Per-connection statistics need elevation, process traffic only counts connections");
+    }
+    found = connections_.insert_or_assign(key, connection).first;
+  }
+  Connection &connection = found->second;
+  connection.generation = generation_;
+  connection.tunnel = tunnel;
+
+  Process &process = processes_[{tunnel_names_[tunnel], pid}];
+  process.tcp_connections++;
+  process.generation = generation_;
+  if (!connection.collecting) {
+    return;
+  }
+
+  TCP_ESTATS_DATA_ROD_v0 data = {};
+  ULONG result = row4 ? GetPerTcpConnectionEStats(const_cast<PMIB_TCPROW>(row4), TcpConnectionEstatsData, nullptr, 0,
+                                                  0, nullptr, 0, 0, reinterpret_cast<PUCHAR>(&data), 0, sizeof(data))
+                      : GetPerTcp6ConnectionEStats(const_cast<PMIB_TCP6ROW>(row6), TcpConnectionEstatsData, nullptr,
+                                                   0, 0, nullptr, 0, 0, reinterpret_cast<PUCHAR>(&data), 0,
+                                                   sizeof(data));
+  if (result != NO_ERROR) {
+    return;
+  }
+  // The first reading is the baseline: counters another tool turned on earlier hold bytes from before
+  if (!is_new && data.DataBytesIn >= connection.rx_bytes && data.DataBytesOut >= connection.tx_bytes) {
+    uint64_t rx_delta = data.DataBytesIn - connection.rx_bytes;
+    uint64_t tx_delta = data.DataBytesOut - connection.tx_bytes;
+    process.rx_delta += rx_delta;
+    process.tx_delta += tx_delta;
+    process.rx_bytes += rx_delta;
+    process.tx_bytes += tx_delta;
+  }
+  connection.rx_bytes = data.DataBytesIn;
+  connection.tx_bytes = data.DataBytesOut;
+}
+
+void ProcessTrafficMeter::SetCollection(const Connection &connection, bool enable) {
+  TCP_ESTATS_DATA_RW_v0 rw = {};
+  rw.EnableCollection = enable ? TRUE : FALSE;
+  ULONG result = connection.family == AF_INET
+                     ? SetPerTcpConnectionEStats(const_cast<PMIB_TCPROW>(&connection.row4), TcpConnectionEstatsData,
+                                                 reinterpret_cast<PUCHAR>(&rw), 0, sizeof(rw), 0)
+                     : SetPerTcp6ConnectionEStats(const_cast<PMIB_TCP6ROW>(&connection.row6),
+                                                  TcpConnectionEstatsData, reinterpret_cast<PUCHAR>(&rw), 0,
+                                                  sizeof(rw), 0);
+  SetLastError(result);
+}
+
+const std::string &ProcessTrafficMeter::ImageName(DWORD pid) {
+  auto found = image_names_.find(pid);
+  if (found != image_names_.end()) {
+    return found->second;
+  }
+  std::string &name = image_names_[pid];
+  HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+  if (!process) {
+    return name;
+  }
+  wchar_t path[MAX_PATH];
+  DWORD length = MAX_PATH;
+  if (QueryFullProcessImageNameW(process, 0, path, &length)) {
+    std::wstring_view image(path, length);
+    size_t separator = image.find_last_of(L'\\');
+    name = WideToUtf8(separator == std::wstring_view::npos ? image : image.substr(separator + 1));
+  }
+  CloseHandle(process);
+  return name;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+// What one process sent and received over a tunnel
+struct ProcessTraffic {
+  DWORD pid = 0;
+  // The file name of its executable, empty when the process cannot be opened
+  std::string image;
+  // Since the meter first saw the process on the tunnel
+  uint64_t rx_bytes = 0;
+  uint64_t tx_bytes = 0;
+  // Over the time since the sample before
+  uint64_t rx_bytes_per_second = 0;
+  uint64_t tx_bytes_per_second = 0;
+  uint32_t tcp_connections = 0;
+  uint32_t udp_sockets = 0;
+  // The process has no socket on the tunnel any more; it is not reported again until it has one
+  bool ended = false;
+};
+
+/**
+ * Which processes the traffic of the tunnels comes from. Each sample finds the TCP connections (GetTcpTable2,
+ * GetTcp6Table2) and UDP sockets (GetExtendedUdpTable) with their owning processes whose local address is one of a
+ * tunnel's interface addresses, turns on extended statistics for new connections and reads their data bytes
+ * (GetPerTcpConnectionEStats), and reports per tunnel only the processes whose bytes or sockets changed since the
+ * sample before. UDP has no per-socket counters, so UDP sockets are counted but not their bytes, and sockets bound
+ * to the wildcard address cannot be told to be on the tunnel at all. Turning statistics on takes elevation; without
+ * it the connections are counted but not their bytes.
+ *
+ * Only from one thread at a time; the table buffers are kept, so a sample only allocates for new connections.
+ */
+class ProcessTrafficMeter {
+public:
+  struct Interface {
+    std::string tunnel_name;
+    NET_LUID luid;
+  };
+  struct TunnelProcesses {
+    std::string tunnel_name;
+    std::vector<ProcessTraffic> processes;
+  };
+
+  ProcessTrafficMeter() = default;
+  ~ProcessTrafficMeter();
+
+  ProcessTrafficMeter(const ProcessTrafficMeter &) = delete;
+  ProcessTrafficMeter &operator=(const ProcessTrafficMeter &) = delete;
+
+  // Replace changes with the tunnels that have processes whose traffic or sockets changed; false when the tables
+  // could not be read
+  bool Sample(const std::vector<Interface> &interfaces, std::vector<TunnelProcesses> *changes);
+
+  // Turn statistics off for the connections it turned them on for and forget everything, so the next sample
+  // reports every process again
+  void Reset();
+
+private:
+  struct ConnectionKey {
+    ADDRESS_FAMILY family;
+    BYTE local[16];
+    BYTE remote[16];
+    DWORD local_port;
+    DWORD remote_port;
+
+    bool operator<(const ConnectionKey &other) const;
+  };
+  struct Connection {
+    ADDRESS_FAMILY family;
+    size_t tunnel;
+    DWORD pid;
+    // Only the row of the family is set, for turning statistics off again
+    MIB_TCPROW row4;
+    MIB_TCP6ROW row6;
+    bool collecting;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t generation;
+  };
+  struct LocalAddress {
+    ADDRESS_FAMILY family;
+    BYTE address[16];
+    size_t tunnel;
+  };
+  // Per tunnel and process, what was reported last
+  struct Process {
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+    uint64_t rx_delta = 0;
+    uint64_t tx_delta = 0;
+    uint32_t tcp_connections = 0;
+    uint32_t udp_sockets = 0;
+    uint32_t reported_tcp = 0;
+    uint32_t reported_udp = 0;
+    uint64_t generation = 0;
+  };
+
+  bool ReadLocalAddresses(const std::vector<Interface> &interfaces);
+  // The tunnel of the local address, or SIZE_MAX
+  size_t TunnelOf(ADDRESS_FAMILY family, const BYTE *address) const;
+  bool ReadTcp();
+  bool ReadUdp();
+  // Add the bytes the connection moved since it was last read to its process
+  void Account(const ConnectionKey &key, size_t tunnel, DWORD pid, const MIB_TCPROW *row4, const MIB_TCP6ROW *row6);
+  static void SetCollection(const Connection &connection, bool enable);
+  const std::string &ImageName(DWORD pid);
+
+  // Kept from one sample to the next, they only grow
+  std::vector<BYTE> tcp_buffer_;
+  std::vector<BYTE> udp_buffer_;
+  std::vector<LocalAddress> local_addresses_;
+  std::vector<std::string> tunnel_names_;
+
+  std::map<ConnectionKey, Connection> connections_;
+  std::map<std::pair<std::string, DWORD>, Process> processes_;
+  std::map<DWORD, std::string> image_names_;
+  uint64_t generation_ = 0;
+  std::chrono::steady_clock::time_point last_sample_;
+  bool access_denied_logged_ = false;
+
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,99 @@
+#include "route_lookup.h"
+
+#include <cstring>
+
+#include "prefix_aggregation.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+bool SamePrefixes(const std::vector<NetworkPrefix> &a, const std::vector<NetworkPrefix> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].family != b[i].family || a[i].prefix_length != b[i].prefix_length ||
+        memcmp(a[i].address, b[i].address, sizeof(a[i].address)) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t HashPrefixes(const std::vector<NetworkPrefix> &prefixes) {
+  uint64_t hash = kHashBytesSeed;
+  for (const auto &prefix : prefixes) {
+    hash = HashBytes(&prefix.family, sizeof(prefix.family), hash);
+    hash = HashBytes(&prefix.prefix_length, sizeof(prefix.prefix_length), hash);
+    hash = HashBytes(prefix.address, sizeof(prefix.address), hash);
+  }
+  return hash;
+}
+
+} // namespace
+
+void RouteLookup::SetTunnel(const std::string &tunnel_name, const WireguardConfigParser &config) {
+  Tunnel tunnel;
+  config.GetConfiguration().ForEachPeer(
+      [this, &tunnel](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+        PeerKey &key = tunnel.peers.emplace_back();
+        memcpy(key.data(), peer.PublicKey, key.size());
+        PrefixBlock block;
+        block.reserve(count);
+        for (DWORD i = 0; i < count; i++) {
+          NetworkPrefix prefix;
+          if (ToNetworkPrefix(allowed_ips[i], prefix)) {
+            block.push_back(prefix);
+          }
+        }
+        tunnel.allowed_ips.push_back(blocks_.Intern(
+            HashPrefixes(block), [&block](const PrefixBlock &shared) { return SamePrefixes(shared, block); },
+            [&block] { return block; }));
+      });
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  tunnels_[tunnel_name] = std::move(tunnel);
+  PublishLocked();
+}
+
+void RouteLookup::RemoveTunnel(const std::string &tunnel_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (tunnels_.erase(tunnel_name) != 0) {
+    PublishLocked();
+  }
+}
+
+size_t RouteLookup::MemoryBytes() const {
+  size_t bytes = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &[name, tunnel] : tunnels_) {
+      bytes += tunnel.peers.capacity() * sizeof(PeerKey) +
+               tunnel.allowed_ips.capacity() * sizeof(std::shared_ptr<const PrefixBlock>);
+    }
+  }
+  // The allowed IPs once, however many peers share them
+  blocks_.ForEach([&bytes](const PrefixBlock &block) { bytes += block.capacity() * sizeof(NetworkPrefix); });
+  std::shared_ptr<const Snapshot> current = Current();
+  return bytes + current->trie.MemoryBytes() + current->targets.capacity() * sizeof(Target);
+}
+
+void RouteLookup::PublishLocked() {
+  auto snapshot = std::make_shared<Snapshot>();
+  for (const auto &[name, tunnel] : tunnels_) {
+    uint32_t first = static_cast<uint32_t>(snapshot->targets.size());
+    for (const PeerKey &key : tunnel.peers) {
+      snapshot->targets.push_back(Target{name, key});
+    }
+    // The driver gives an allowed IP listed twice to the later peer, and the trie keeps the first it is given
+    for (size_t peer = tunnel.allowed_ips.size(); peer-- > 0;) {
+      for (const NetworkPrefix &prefix : *tunnel.allowed_ips[peer]) {
+        snapshot->trie.Insert(prefix, first + static_cast<uint32_t>(peer));
+      }
+    }
+  }
+  current_.store(std::shared_ptr<const Snapshot>(std::move(snapshot)));
+}
+
+} // namespace wireguard_dart
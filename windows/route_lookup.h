@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "intern_table.h"
+#include "peer_statistics.h"
+#include "wireguard_config_parser.h"
+#include "wireguard_core/ip_prefix.h"
+
+namespace wireguard_dart {
+
+/**
+ * Which tunnel and peer traffic to an address goes to: the longest of the allowed IPs of every applied
+ * configuration that holds it, the way WireGuard picks the peer within a tunnel. A tunnel's allowed IPs are set
+ * when its configuration is applied and dropped when it is removed; each change builds a PrefixTrie over all of
+ * them on the tunnel's worker and publishes it whole, so lookups take no lock and never wait for a rebuild. Of
+ * equal prefixes in two tunnels, the one of the tunnel first by name wins.
+ */
+class RouteLookup {
+public:
+  struct Target {
+    std::string tunnel_name;
+    PeerKey public_key;
+  };
+
+  // A published trie with what its values index, unchanged for as long as it is held
+  struct Snapshot {
+    PrefixTrie trie;
+    std::vector<Target> targets;
+
+    // The target of the address, 4 bytes for AF_INET and 16 for AF_INET6, or nullptr if no allowed IP holds it
+    const Target *Resolve(int family, const uint8_t *address) const {
+      uint32_t index = trie.Lookup(family, address);
+      return index == PrefixTrie::kNone ? nullptr : &targets[index];
+    }
+  };
+
+  // Take the allowed IPs of every peer of config as the tunnel's, replacing those it had
+  void SetTunnel(const std::string &tunnel_name, const WireguardConfigParser &config);
+  void RemoveTunnel(const std::string &tunnel_name);
+
+  // The latest snapshot, from any thread
+  std::shared_ptr<const Snapshot> Current() const { return current_.load(); }
+
+  // The allowed IPs kept per tunnel and the published trie
+  size_t MemoryBytes() const;
+
+private:
+  using PrefixBlock = std::vector<NetworkPrefix>;
+  struct Tunnel {
+    std::vector<PeerKey> peers;
+    // By peer; a peer listing the same allowed IPs as another, in this tunnel or another, shares them
+    std::vector<std::shared_ptr<const PrefixBlock>> allowed_ips;
+  };
+
+  // Build and publish a snapshot of tunnels_, with mutex_ held
+  void PublishLocked();
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Tunnel> tunnels_;
+  InternTable<PrefixBlock> blocks_;
+  std::atomic<std::shared_ptr<const Snapshot>> current_{std::make_shared<const Snapshot>()};
+};
+
+} // namespace wireguard_dart
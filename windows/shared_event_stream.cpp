@@ -0,0 +1,79 @@
+#include "shared_event_stream.h"
+
+#include <flutter/event_stream_handler_functions.h>
+
+namespace wireguard_dart {
+
+class SharedEventStream::FanOutSink : public flutter::EventSink<flutter::EncodableValue> {
+public:
+  explicit FanOutSink(std::shared_ptr<Sinks> sinks) : sinks_(std::move(sinks)) {}
+
+protected:
+  void SuccessInternal(const flutter::EncodableValue *event) override {
+    for (auto &entry : *sinks_) {
+      if (event) {
+        entry.second->Success(*event);
+      } else {
+        entry.second->Success();
+      }
+    }
+  }
+
+  void ErrorInternal(const std::string &error_code, const std::string &error_message,
+                     const flutter::EncodableValue *error_details) override {
+    for (auto &entry : *sinks_) {
+      if (error_details) {
+        entry.second->Error(error_code, error_message, *error_details);
+      } else {
+        entry.second->Error(error_code, error_message);
+      }
+    }
+  }
+
+  void EndOfStreamInternal() override {
+    for (auto &entry : *sinks_) {
+      entry.second->EndOfStream();
+    }
+  }
+
+private:
+  std::shared_ptr<Sinks> sinks_;
+};
+
+SharedEventStream::SharedEventStream(flutter::StreamHandler<flutter::EncodableValue> *handler)
+    : handler_(handler), sinks_(std::make_shared<Sinks>()) {}
+
+std::unique_ptr<flutter::StreamHandler<flutter::EncodableValue>> SharedEventStream::HandlerFor(uint64_t engine) {
+  return std::make_unique<flutter::StreamHandlerFunctions<>>(
+      [this, engine](const flutter::EncodableValue *arguments,
+                     std::unique_ptr<flutter::EventSink<>> &&events) -> std::unique_ptr<flutter::StreamHandlerError<>> {
+        return Listen(engine, arguments, std::move(events));
+      },
+      [this, engine](const flutter::EncodableValue *) -> std::unique_ptr<flutter::StreamHandlerError<>> {
+        return Cancel(engine);
+      });
+}
+
+std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+SharedEventStream::Listen(uint64_t engine, const flutter::EncodableValue *arguments,
+                          std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> events) {
+  bool first = sinks_->empty();
+  (*sinks_)[engine] = std::move(events);
+  if (!first) {
+    return nullptr;
+  }
+  auto error = handler_->OnListen(arguments, std::make_unique<FanOutSink>(sinks_));
+  if (error) {
+    sinks_->erase(engine);
+  }
+  return error;
+}
+
+std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>> SharedEventStream::Cancel(uint64_t engine) {
+  if (sinks_->erase(engine) == 0 || !sinks_->empty()) {
+    return nullptr;
+  }
+  return handler_->OnCancel(nullptr);
+}
+
+} // namespace wireguard_dart
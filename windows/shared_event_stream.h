@@ -0,0 +1,47 @@
+#pragma once
+
+#include <flutter/encodable_value.h>
+#include <flutter/event_channel.h>
+#include <flutter/event_sink.h>
+#include <flutter/event_stream_handler.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+
+namespace wireguard_dart {
+
+/**
+ * One event stream of the process-wide plugin, served to the channel of every Flutter engine attached to it. The
+ * first engine to listen starts the handler with a sink that sends each event to every engine listening, and later
+ * ones join that sink, getting the events from then on in the form the first listener's arguments asked for. The
+ * handler is cancelled once the last engine cancelled or went away, so the work behind a stream is done once
+ * however many engines listen. On the platform thread, which the engines of a process share.
+ */
+class SharedEventStream {
+public:
+  // The handler has to outlive the stream
+  explicit SharedEventStream(flutter::StreamHandler<flutter::EncodableValue> *handler);
+
+  SharedEventStream(const SharedEventStream &) = delete;
+  SharedEventStream &operator=(const SharedEventStream &) = delete;
+
+  // For the event channel of one engine
+  std::unique_ptr<flutter::StreamHandler<flutter::EncodableValue>> HandlerFor(uint64_t engine);
+
+  std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+  Listen(uint64_t engine, const flutter::EncodableValue *arguments,
+         std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> events);
+  // Also when the engine goes away, whose sink must not be used after
+  std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>> Cancel(uint64_t engine);
+
+private:
+  using Sinks = std::map<uint64_t, std::unique_ptr<flutter::EventSink<flutter::EncodableValue>>>;
+  class FanOutSink;
+
+  flutter::StreamHandler<flutter::EncodableValue> *handler_;
+  // Shared with the handler's sink, which it may keep past a cancel
+  std::shared_ptr<Sinks> sinks_;
+};
+
+} // namespace wireguard_dart
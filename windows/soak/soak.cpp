@@ -0,0 +1,386 @@
+#include <winsock2.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "key_generator.h"
+#include "perf_stats.h"
+#include "spdlog/spdlog.h"
+#include "wireguard_adapter.h"
+#include "wireguard_core/wireguard_key.h"
+#include "wireguard_library.h"
+
+// Connects and disconnects one tunnel over and over against a peer on a second adapter, reached over loopback, and
+// fails when the process or the system tables grow with the cycles or the phases get slower. Creates adapters and
+// routes, so it has to run elevated with wireguard.dll next to it. The tunnel addresses are in 10.213.0.0/24 and
+// the extra routes inside 198.18.0.0/15, the range reserved for benchmarking.
+
+namespace wireguard_dart {
+namespace {
+
+constexpr wchar_t kTunnelType[] = L"WireGuardDartSoak";
+constexpr wchar_t kTunnelName[] = L"WgDartSoak";
+constexpr wchar_t kPeerName[] = L"WgDartSoakPeer";
+constexpr int kPeerPort = 51871;
+constexpr std::chrono::seconds kHandshakeTimeout{10};
+
+struct Options {
+  int cycles = 200;
+  // Cycles run before the baseline is taken, while caches and the driver settle
+  int warm_up = 5;
+  int routes = 256;
+  bool handshake = true;
+  // Growth from the baseline to the end that fails the run
+  long handle_drift = 16;
+  long route_drift = 0;
+  long address_drift = 0;
+  long adapter_drift = 0;
+  long memory_drift_kb = 4096;
+  // How much slower the median of the last tenth of the cycles may be than that of the first
+  double latency_drift = 2.0;
+  bool verbose = false;
+};
+
+bool ParseOptions(int argc, char **argv, Options *options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    auto number = [&](long *out) {
+      if (!value) {
+        return false;
+      }
+      *out = std::strtol(value, nullptr, 10);
+      i++;
+      return true;
+    };
+    long parsed = 0;
+    if (arg == "--cycles" && number(&parsed)) {
+      options->cycles = static_cast<int>(parsed);
+    } else if (arg == "--warm-up" && number(&parsed)) {
+      options->warm_up = static_cast<int>(parsed);
+    } else if (arg == "--routes" && number(&parsed)) {
+      options->routes = static_cast<int>(parsed);
+    } else if (arg == "--handle-drift" && number(&options->handle_drift)) {
+    } else if (arg == "--route-drift" && number(&options->route_drift)) {
+    } else if (arg == "--address-drift" && number(&options->address_drift)) {
+    } else if (arg == "--adapter-drift" && number(&options->adapter_drift)) {
+    } else if (arg == "--memory-drift-kb" && number(&options->memory_drift_kb)) {
+    } else if (arg == "--latency-drift" && value) {
+      options->latency_drift = std::strtod(value, nullptr);
+      i++;
+    } else if (arg == "--no-handshake") {
+      options->handshake = false;
+    } else if (arg == "--verbose") {
+      options->verbose = true;
+    } else {
+      return false;
+    }
+  }
+  return options->cycles > options->warm_up && options->warm_up >= 0 && options->routes >= 0 &&
+         options->latency_drift > 0;
+}
+
+void PrintUsage() {
+  std::printf(
+      "Usage: wireguard_dart_soak [--cycles N] [--warm-up N] [--routes N] [--no-handshake] [--verbose]\n"
+      "                           [--handle-drift N] [--route-drift N] [--address-drift N] [--adapter-drift N]\n"
+      "                           [--memory-drift-kb N] [--latency-drift RATIO]\n");
+}
+
+// What the process and the system hold between two cycles
+struct Resources {
+  long handles = 0;
+  long routes = 0;
+  long addresses = 0;
+  // Interfaces named like the soak tunnel, which are left over if teardown leaks the device
+  long adapters = 0;
+  int64_t working_set = 0;
+};
+
+bool SampleResources(Resources *resources) {
+  DWORD handles = 0;
+  if (!GetProcessHandleCount(GetCurrentProcess(), &handles)) {
+    return false;
+  }
+  resources->handles = static_cast<long>(handles);
+
+  PMIB_IPFORWARD_TABLE2 routes = nullptr;
+  if (GetIpForwardTable2(AF_UNSPEC, &routes) != NO_ERROR) {
+    return false;
+  }
+  resources->routes = static_cast<long>(routes->NumEntries);
+  FreeMibTable(routes);
+
+  PMIB_UNICASTIPADDRESS_TABLE addresses = nullptr;
+  if (GetUnicastIpAddressTable(AF_UNSPEC, &addresses) != NO_ERROR) {
+    return false;
+  }
+  resources->addresses = static_cast<long>(addresses->NumEntries);
+  FreeMibTable(addresses);
+
+  PMIB_IF_TABLE2 interfaces = nullptr;
+  if (GetIfTable2(&interfaces) != NO_ERROR) {
+    return false;
+  }
+  resources->adapters = 0;
+  for (ULONG i = 0; i < interfaces->NumEntries; i++) {
+    if (wcscmp(interfaces->Table[i].Alias, kTunnelName) == 0) {
+      resources->adapters++;
+    }
+  }
+  FreeMibTable(interfaces);
+
+  resources->working_set = ProcessWorkingSetBytes();
+  return true;
+}
+
+struct KeyPair {
+  std::string public_key;
+  std::string private_key;
+};
+
+bool GenerateKeys(KeyPair *keys) {
+  uint8_t public_key[kWireguardKeyLength];
+  uint8_t private_key[kWireguardKeyLength];
+  if (!GenerateKeyPair(public_key, private_key)) {
+    return false;
+  }
+  keys->public_key = KeyToBase64(public_key);
+  keys->private_key = KeyToBase64(private_key);
+  SecureZeroMemory(private_key, sizeof(private_key));
+  return true;
+}
+
+std::string PeerConfig(const KeyPair &peer, const KeyPair &tunnel) {
+  return "[Interface]\nPrivateKey = " + peer.private_key + "\nListenPort = " + std::to_string(kPeerPort) +
+         "\nAddress = 10.213.0.1/32\n\n[Peer]\nPublicKey = " + tunnel.public_key + "\nAllowedIPs = 10.213.0.2/32\n";
+}
+
+std::string TunnelConfig(const KeyPair &tunnel, const KeyPair &peer, int routes) {
+  std::string text = "[Interface]\nPrivateKey = " + tunnel.private_key + "\nAddress = 10.213.0.2/32\n\n[Peer]\n" +
+                     "PublicKey = " + peer.public_key + "\nEndpoint = 127.0.0.1:" + std::to_string(kPeerPort) +
+                     "\nAllowedIPs = 10.213.0.1/32";
+  for (int i = 0; i < routes; i++) {
+    uint32_t address = 0xC6120000u + static_cast<uint32_t>(i); // 198.18.0.0 + i
+    text += ", " + std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xFF) + "." +
+            std::to_string((address >> 8) & 0xFF) + "." + std::to_string(address & 0xFF) + "/32";
+  }
+  return text + "\n";
+}
+
+// Set by the handshake waiter's thread, which may still report after the cycle that started it gave up
+struct HandshakeResult {
+  std::mutex mutex;
+  std::condition_variable done;
+  bool completed = false;
+  int64_t microseconds = 0;
+};
+
+// One setup, connect, disconnect and teardown; false with the phase that failed and its error
+bool RunCycle(const std::shared_ptr<WireguardLibrary> &library, const std::string &config, const Options &options,
+              PerfStats *stats, std::vector<std::pair<std::string, int64_t>> *phases, std::string *failed) {
+  PhaseTimer timer(stats);
+  auto adapter = WireguardAdapter::Create(library, kTunnelName, kTunnelType);
+  auto fail = [&adapter, failed](const char *phase) {
+    *failed = std::string(phase) + " (error " + std::to_string(GetLastError()) + ")";
+    // Leave no routes behind for the next run to count
+    if (adapter) {
+      adapter->CleanupNetworking();
+    }
+    return false;
+  };
+  if (!adapter) {
+    return fail("create");
+  }
+  timer.Lap("create");
+
+  if (!adapter->ApplyConfiguration(config, &timer)) {
+    return fail("apply");
+  }
+  if (!adapter->ConfigureNetworking(&timer)) {
+    return fail("networking");
+  }
+  if (!adapter->SetState(WIREGUARD_ADAPTER_STATE_UP)) {
+    return fail("connect");
+  }
+  timer.Lap("connect");
+
+  auto handshake = std::make_shared<HandshakeResult>();
+  if (options.handshake) {
+    adapter->TimeFirstHandshake(
+        [handshake](int64_t microseconds) {
+          std::lock_guard<std::mutex> lock(handshake->mutex);
+          handshake->completed = true;
+          handshake->microseconds = microseconds;
+          handshake->done.notify_all();
+        },
+        true);
+    std::unique_lock<std::mutex> lock(handshake->mutex);
+    if (!handshake->done.wait_for(lock, kHandshakeTimeout, [&handshake] { return handshake->completed; })) {
+      lock.unlock();
+      return fail("handshake");
+    }
+    stats->Record("handshake", handshake->microseconds);
+    lock.unlock();
+    timer.Skip();
+  }
+
+  if (!adapter->SetState(WIREGUARD_ADAPTER_STATE_DOWN)) {
+    return fail("disconnect");
+  }
+  timer.Lap("disconnect");
+  if (!adapter->CleanupNetworking()) {
+    return fail("cleanup");
+  }
+  timer.Lap("cleanup");
+  adapter.reset();
+  timer.Lap("teardown");
+
+  *phases = timer.Phases();
+  if (options.handshake) {
+    phases->emplace_back("handshake", handshake->microseconds);
+  }
+  return true;
+}
+
+int64_t Percentile(std::vector<int64_t> samples, double fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(fraction * static_cast<double>(samples.size() - 1) + 0.5);
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+bool CheckDrift(const char *what, long baseline, long last, long allowed) {
+  long growth = last - baseline;
+  bool ok = growth <= allowed;
+  std::printf("%-14s %10ld %10ld %+8ld  %s\n", what, baseline, last, growth, ok ? "ok" : "DRIFT");
+  return ok;
+}
+
+int RunSoak(const Options &options) {
+  std::shared_ptr<WireguardLibrary> library = WireguardLibrary::Create();
+  if (!library) {
+    std::fprintf(stderr, "Failed to load wireguard.dll, it has to be next to the executable\n");
+    return 2;
+  }
+
+  KeyPair peer_keys;
+  KeyPair tunnel_keys;
+  if (!GenerateKeys(&peer_keys) || !GenerateKeys(&tunnel_keys)) {
+    std::fprintf(stderr, "Failed to generate keys\n");
+    return 2;
+  }
+
+  // The peer stays up for the whole run, only the tunnel cycles
+  auto peer = WireguardAdapter::Create(library, kPeerName, kTunnelType);
+  if (!peer || !peer->ApplyConfiguration(PeerConfig(peer_keys, tunnel_keys)) || !peer->ConfigureNetworking() ||
+      !peer->SetState(WIREGUARD_ADAPTER_STATE_UP)) {
+    std::fprintf(stderr, "Failed to set up the peer adapter (error %lu), is the soak running elevated?\n",
+                 GetLastError());
+    return 2;
+  }
+
+  const std::string config = TunnelConfig(tunnel_keys, peer_keys, options.routes);
+  PerfStats stats;
+  // Per phase, its duration in every measured cycle in order
+  std::map<std::string, std::vector<int64_t>> samples;
+  Resources baseline;
+  int exit_code = 0;
+
+  for (int cycle = 0; cycle < options.cycles; cycle++) {
+    if (cycle == options.warm_up && !SampleResources(&baseline)) {
+      std::fprintf(stderr, "Failed to read the system tables\n");
+      exit_code = 2;
+      break;
+    }
+
+    std::vector<std::pair<std::string, int64_t>> phases;
+    std::string failed;
+    if (!RunCycle(library, config, options, &stats, &phases, &failed)) {
+      std::fprintf(stderr, "Cycle %d failed in phase %s\n", cycle + 1, failed.c_str());
+      exit_code = 1;
+      break;
+    }
+    if (cycle >= options.warm_up) {
+      for (const auto &phase : phases) {
+        samples[phase.first].push_back(phase.second);
+      }
+    }
+    if (options.verbose || (cycle + 1) % 50 == 0) {
+      std::printf("%d/%d cycles\n", cycle + 1, options.cycles);
+    }
+  }
+
+  peer->SetState(WIREGUARD_ADAPTER_STATE_DOWN);
+  peer->CleanupNetworking();
+  peer.reset();
+  if (exit_code != 0) {
+    return exit_code;
+  }
+
+  Resources last;
+  if (!SampleResources(&last)) {
+    std::fprintf(stderr, "Failed to read the system tables\n");
+    return 2;
+  }
+
+  // The median of the first and the last tenth of the measured cycles, for how the phase changed over the run
+  std::map<std::string, PerfStats::Summary> summaries = stats.Snapshot();
+  std::printf("\n%-14s %8s %10s %10s %10s %10s %10s %10s %12s\n", "phase", "count", "p50 us", "p90 us", "p99 us",
+              "max us", "first p50", "last p50", "max ws delta");
+  bool ok = true;
+  for (const auto &entry : samples) {
+    const std::vector<int64_t> &durations = entry.second;
+    size_t window = (std::max)(durations.size() / 10, size_t{1});
+    std::vector<int64_t> first(durations.begin(), durations.begin() + window);
+    std::vector<int64_t> recent(durations.end() - window, durations.end());
+    int64_t first_p50 = Percentile(first, 0.5);
+    int64_t last_p50 = Percentile(recent, 0.5);
+    // Below a millisecond the noise is larger than any slowdown worth failing a release over
+    bool slower = last_p50 > 1000 && static_cast<double>(last_p50) > options.latency_drift * first_p50;
+    ok = ok && !slower;
+    std::printf("%-14s %8zu %10lld %10lld %10lld %10lld %10lld %10lld %12lld%s\n", entry.first.c_str(),
+                durations.size(), Percentile(durations, 0.5), Percentile(durations, 0.9),
+                Percentile(durations, 0.99), *std::max_element(durations.begin(), durations.end()), first_p50,
+                last_p50, summaries[entry.first].max_working_set_delta, slower ? "  DRIFT" : "");
+  }
+
+  std::printf("\n%-14s %10s %10s %8s\n", "resource", "baseline", "last", "growth");
+  ok = CheckDrift("handles", baseline.handles, last.handles, options.handle_drift) && ok;
+  ok = CheckDrift("routes", baseline.routes, last.routes, options.route_drift) && ok;
+  ok = CheckDrift("addresses", baseline.addresses, last.addresses, options.address_drift) && ok;
+  ok = CheckDrift("adapters", baseline.adapters, last.adapters, options.adapter_drift) && ok;
+  ok = CheckDrift("working set kb", static_cast<long>(baseline.working_set / 1024),
+                  static_cast<long>(last.working_set / 1024), options.memory_drift_kb) &&
+       ok;
+
+  std::printf("\n%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+} // namespace
+} // namespace wireguard_dart
+
+int main(int argc, char **argv) {
+  wireguard_dart::Options options;
+  if (!wireguard_dart::ParseOptions(argc, argv, &options)) {
+    wireguard_dart::PrintUsage();
+    return 2;
+  }
+  spdlog::set_level(options.verbose ? spdlog::level::info : spdlog::level::warn);
+  return wireguard_dart::RunSoak(options);
+}
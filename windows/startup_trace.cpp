@@ -0,0 +1,49 @@
+#include "startup_trace.h"
+
+#include <algorithm>
+
+#include "perf_stats.h"
+
+namespace wireguard_dart {
+
+StartupTrace &StartupTrace::Instance() {
+  static StartupTrace instance;
+  return instance;
+}
+
+void StartupTrace::MarkRegistration() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (registered_us_ == 0) {
+    registered_us_ = PerfCounterMicroseconds();
+  }
+}
+
+void StartupTrace::Record(const char *subsystem, int64_t started_us) {
+  int64_t now_us = PerfCounterMicroseconds();
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool known = std::any_of(entries_.begin(), entries_.end(),
+                           [subsystem](const Entry &entry) { return entry.subsystem == subsystem; });
+  if (known) {
+    return;
+  }
+  Entry entry;
+  entry.subsystem = subsystem;
+  entry.at_us = registered_us_ != 0 ? started_us - registered_us_ : 0;
+  entry.took_us = now_us - started_us;
+  entries_.push_back(std::move(entry));
+}
+
+std::vector<StartupTrace::Entry> StartupTrace::Entries() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Entry> entries = entries_;
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const Entry &a, const Entry &b) { return a.at_us < b.at_us; });
+  return entries;
+}
+
+ScopedStartup::ScopedStartup(const char *subsystem)
+    : subsystem_(subsystem), started_us_(PerfCounterMicroseconds()) {}
+
+ScopedStartup::~ScopedStartup() { StartupTrace::Instance().Record(subsystem_, started_us_); }
+
+} // namespace wireguard_dart
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace wireguard_dart {
+
+/**
+ * When each native subsystem started. Registering the plugin starts none of them: the threads, the driver library,
+ * the notifications and the loggers each start at their first use, so an app that never connects in a session pays
+ * for none of them, and this tells which did start, when and at what cost. For the whole process, safe from any
+ * thread.
+ */
+class StartupTrace {
+public:
+  struct Entry {
+    std::string subsystem;
+    // From the registration of the first engine to the start, and how long the start took
+    int64_t at_us = 0;
+    int64_t took_us = 0;
+  };
+
+  static StartupTrace &Instance();
+
+  // Where the entries count from; only the first call counts
+  void MarkRegistration();
+  // The subsystem started at started_us, on the performance counter, and is ready now; only its first start is kept
+  void Record(const char *subsystem, int64_t started_us);
+  // In the order they started
+  std::vector<Entry> Entries() const;
+
+private:
+  mutable std::mutex mutex_;
+  int64_t registered_us_ = 0;
+  std::vector<Entry> entries_;
+};
+
+// Records its own lifetime as the start of the subsystem
+class ScopedStartup {
+public:
+  explicit ScopedStartup(const char *subsystem);
+  ~ScopedStartup();
+
+  ScopedStartup(const ScopedStartup &) = delete;
+  ScopedStartup &operator=(const ScopedStartup &) = delete;
+
+private:
+  const char *subsystem_;
+  int64_t started_us_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,239 @@
+#include "state_journal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
+#include <set>
+#include <string_view>
+
+#include "wireguard_config_parser.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x4a534757;  // "WGSJ"
+// Adapter names are limited to MAX_ADAPTER_NAME by the driver
+constexpr size_t kMaxName = 128;
+
+constexpr uint32_t kAddressesKnown = 1;
+constexpr uint32_t kRoutesKnown = 2;
+constexpr uint32_t kDnsConfigured = 4;
+
+struct JournalHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t reserved;
+};
+
+} // namespace
+
+// The checksum covers everything after it and is written last; zero marks a free slot
+struct StateJournal::Slot {
+  uint64_t checksum;
+  wchar_t name[kMaxName];
+  GUID guid;
+  uint64_t luid;
+  uint64_t text_hash;
+  uint64_t text_size;
+  uint32_t flags;
+  uint32_t address_count;
+  uint32_t route_count;
+  uint32_t reserved;
+  // The addresses, then the routes
+  IpPrefix rows[kMaxRows];
+};
+
+namespace {
+
+constexpr size_t kFileSize = sizeof(JournalHeader) + StateJournal::kSlots * sizeof(StateJournal::Slot);
+
+uint64_t SlotChecksum(const StateJournal::Slot &slot) {
+  const char *start = reinterpret_cast<const char *>(&slot) + sizeof(slot.checksum);
+  uint64_t checksum =
+      WireguardConfigParser::HashText(std::string_view(start, sizeof(slot) - sizeof(slot.checksum)));
+  // Never the free marker
+  return checksum == 0 ? 1 : checksum;
+}
+
+bool IsIntactSlot(const StateJournal::Slot &slot) {
+  return slot.checksum != 0 && slot.address_count + slot.route_count <= StateJournal::kMaxRows &&
+         wmemchr(slot.name, L'\0', kMaxName) != nullptr && SlotChecksum(slot) == slot.checksum;
+}
+
+} // namespace
+
+StateJournal::~StateJournal() {
+  if (view_) {
+    UnmapViewOfFile(view_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+  }
+}
+
+bool StateJournal::Open(const std::wstring &path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (view_) {
+    return true;
+  }
+
+  file_ = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size = {};
+  GetFileSizeEx(file_, &size);
+  bool fresh = static_cast<uint64_t>(size.QuadPart) != kFileSize;
+
+  // Mapping the file at its full size also grows a new or truncated one to it
+  mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(kFileSize), nullptr);
+  if (!mapping_) {
+    return false;
+  }
+  view_ = static_cast<BYTE *>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, kFileSize));
+  if (!view_) {
+    return false;
+  }
+
+  JournalHeader header;
+  memcpy(&header, view_, sizeof(header));
+  if (fresh || header.magic != kMagic || header.version != kVersion || header.slot_count != kSlots) {
+    memset(view_, 0, kFileSize);
+    header = {kMagic, kVersion, static_cast<uint32_t>(kSlots), 0};
+    memcpy(view_, &header, sizeof(header));
+  }
+  return true;
+}
+
+StateJournal::Slot *StateJournal::SlotAt(size_t index) const {
+  return reinterpret_cast<Slot *>(view_ + sizeof(JournalHeader)) + index;
+}
+
+void StateJournal::Record(const Entry &entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!view_ || entry.name.size() >= kMaxName) {
+    return;
+  }
+
+  // The slot the tunnel had, else the first free or torn one
+  Slot *target = nullptr;
+  for (size_t i = 0; i < kSlots; i++) {
+    Slot *slot = SlotAt(i);
+    bool intact = IsIntactSlot(*slot);
+    if (intact && entry.name == slot->name) {
+      target = slot;
+      break;
+    }
+    if (!target && !intact) {
+      target = slot;
+    }
+  }
+  if (!target) {
+    return;
+  }
+
+  // Free while it is rewritten, so a crash part way leaves no entry rather than a mix of two
+  target->checksum = 0;
+  memset(target->name, 0, sizeof(target->name));
+  memcpy(target->name, entry.name.c_str(), entry.name.size() * sizeof(wchar_t));
+  target->guid = entry.guid;
+  target->luid = entry.luid.Value;
+  target->text_hash = entry.text_hash;
+  target->text_size = entry.text_size;
+  target->reserved = 0;
+
+  const NetworkLedger &ledger = entry.ledger;
+  bool fits = ledger.addresses.size() + ledger.routes.size() <= kMaxRows;
+  target->flags = (entry.dns_configured ? kDnsConfigured : 0) |
+                  (fits && ledger.addresses_known ? kAddressesKnown : 0) |
+                  (fits && ledger.routes_known ? kRoutesKnown : 0);
+  target->address_count = fits ? static_cast<uint32_t>(ledger.addresses.size()) : 0;
+  target->route_count = fits ? static_cast<uint32_t>(ledger.routes.size()) : 0;
+  memset(target->rows, 0, sizeof(target->rows));
+  if (fits) {
+    IpPrefix *row = std::copy(ledger.addresses.begin(), ledger.addresses.end(), target->rows);
+    std::copy(ledger.routes.begin(), ledger.routes.end(), row);
+  }
+  target->checksum = SlotChecksum(*target);
+}
+
+void StateJournal::Forget(const std::wstring &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!view_) {
+    return;
+  }
+  for (size_t i = 0; i < kSlots; i++) {
+    Slot *slot = SlotAt(i);
+    if (slot->checksum != 0 && wcsncmp(slot->name, name.c_str(), kMaxName) == 0) {
+      slot->checksum = 0;
+    }
+  }
+}
+
+void StateJournal::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!view_) {
+    return;
+  }
+  for (size_t i = 0; i < kSlots; i++) {
+    SlotAt(i)->checksum = 0;
+  }
+}
+
+std::vector<StateJournal::Entry> StateJournal::Entries() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Entry> entries;
+  if (!view_) {
+    return entries;
+  }
+  for (size_t i = 0; i < kSlots; i++) {
+    const Slot *slot = SlotAt(i);
+    if (!IsIntactSlot(*slot)) {
+      continue;
+    }
+    Entry entry;
+    entry.name = slot->name;
+    entry.guid = slot->guid;
+    entry.luid.Value = slot->luid;
+    entry.text_hash = slot->text_hash;
+    entry.text_size = slot->text_size;
+    entry.dns_configured = (slot->flags & kDnsConfigured) != 0;
+    entry.ledger.addresses_known = (slot->flags & kAddressesKnown) != 0;
+    entry.ledger.routes_known = (slot->flags & kRoutesKnown) != 0;
+    entry.ledger.addresses.insert(slot->rows, slot->rows + slot->address_count);
+    entry.ledger.routes.insert(slot->rows + slot->address_count,
+                               slot->rows + slot->address_count + slot->route_count);
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+bool StateJournal::IsIntact(const NetworkLedger &ledger, const NET_LUID &luid, const NetworkTableSnapshot &snapshot) {
+  if (!ledger.addresses_known || !ledger.routes_known) {
+    return false;
+  }
+  const std::vector<MIB_UNICASTIPADDRESS_ROW> *address_rows = snapshot.AddressesOf(luid);
+  const std::vector<MIB_IPFORWARD_ROW2> *route_rows = snapshot.RoutesOf(luid);
+  if (!address_rows || !route_rows) {
+    return false;
+  }
+
+  std::set<IpPrefix> addresses;
+  for (const auto &row : *address_rows) {
+    addresses.insert(IpPrefix::FromAddress(row.Address, row.OnLinkPrefixLength));
+  }
+  std::set<IpPrefix> routes;
+  for (const auto &row : *route_rows) {
+    routes.insert(IpPrefix::From(row.DestinationPrefix.Prefix, row.DestinationPrefix.PrefixLength));
+  }
+  return std::includes(addresses.begin(), addresses.end(), ledger.addresses.begin(), ledger.addresses.end()) &&
+         std::includes(routes.begin(), routes.end(), ledger.routes.begin(), ledger.routes.end());
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <windows.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "wireguard_network_config.h"
+
+namespace wireguard_dart {
+
+/**
+ * What the plugin set up on each adapter, in a memory-mapped file that outlives a crash of the app: the adapter's
+ * name, GUID and LUID, the hash of the configuration text applied to it, and the ledger of the addresses and
+ * routes it created. The next nativeInit reattaches to the adapters that are still there and either adopts their
+ * state or removes exactly the recorded rows, instead of setting everything up again after a table scan.
+ *
+ * Every tunnel has a slot of fixed size that is written in place and sealed with a checksum last, so a slot torn
+ * by a crash part way through a write is ignored. The pages of a mapped file reach the disk after the process
+ * died, so nothing is flushed per write.
+ */
+class StateJournal {
+public:
+  // Bumped whenever the slot layout changes; a file of another version starts over empty
+  static constexpr uint32_t kVersion = 1;
+  static constexpr size_t kSlots = 32;
+  // A ledger with more rows is journaled as unknown, and its tunnel cleaned up with a table scan
+  static constexpr size_t kMaxRows = 256;
+
+  // One entry as it is laid out in the file, see state_journal.cpp
+  struct Slot;
+
+  struct Entry {
+    std::wstring name;
+    GUID guid = {};
+    NET_LUID luid = {};
+    uint64_t text_hash = 0;
+    uint64_t text_size = 0;
+    bool dns_configured = false;
+    NetworkLedger ledger;
+  };
+
+  StateJournal() = default;
+  ~StateJournal();
+
+  StateJournal(const StateJournal &) = delete;
+  StateJournal &operator=(const StateJournal &) = delete;
+
+  // Open the file at path, creating it if needed; false if it cannot be mapped
+  bool Open(const std::wstring &path);
+
+  // Replaces the entry of the same name, if there is one; a full journal drops the entry
+  void Record(const Entry &entry);
+  void Forget(const std::wstring &name);
+  void Clear();
+  // The intact entries
+  std::vector<Entry> Entries() const;
+
+  // Whether every row the ledger knows is still on the interface in the snapshot; false for an unknown ledger
+  static bool IsIntact(const NetworkLedger &ledger, const NET_LUID &luid, const NetworkTableSnapshot &snapshot);
+
+private:
+  Slot *SlotAt(size_t index) const;
+
+  mutable std::mutex mutex_;
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+  BYTE *view_ = nullptr;
+};
+
+} // namespace wireguard_dart
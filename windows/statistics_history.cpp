@@ -0,0 +1,189 @@
+#include "statistics_history.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+
+namespace wireguard_dart {
+
+StatisticsRing::StatisticsRing(size_t capacity) : capacity_(capacity), slots_(new Slot[capacity]) {}
+
+void StatisticsRing::Push(const Point &point) {
+  uint64_t written = written_.load(std::memory_order_relaxed);
+  Slot &slot = slots_[written % capacity_];
+
+  uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.time_ms.store(point.time_ms, std::memory_order_relaxed);
+  slot.rx_bytes.store(point.rx_bytes, std::memory_order_relaxed);
+  slot.tx_bytes.store(point.tx_bytes, std::memory_order_relaxed);
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+
+  written_.store(written + 1, std::memory_order_release);
+}
+
+void StatisticsRing::Read(uint64_t since_ms, std::vector<Point> &points) const {
+  uint64_t written = written_.load(std::memory_order_acquire);
+  uint64_t count = (std::min)(written, static_cast<uint64_t>(capacity_));
+  for (uint64_t i = written - count; i < written; i++) {
+    const Slot &slot = slots_[i % capacity_];
+    uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    Point point;
+    point.time_ms = slot.time_ms.load(std::memory_order_relaxed);
+    point.rx_bytes = slot.rx_bytes.load(std::memory_order_relaxed);
+    point.tx_bytes = slot.tx_bytes.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Overwritten while it was read, by a point newer than this read is about
+    if (slot.sequence.load(std::memory_order_relaxed) != before) {
+      continue;
+    }
+    if (point.time_ms >= since_ms) {
+      points.push_back(point);
+    }
+  }
+}
+
+TieredHistory::TieredHistory(const Capacities &capacities) {
+  for (size_t i = 0; i < kTiers; i++) {
+    tiers_[i] = std::make_unique<StatisticsRing>(capacities[i]);
+  }
+}
+
+void TieredHistory::Record(const StatisticsRing::Point &point) {
+  for (size_t i = 0; i < kTiers; i++) {
+    if (readings_ % kTierReadings[i] == 0) {
+      tiers_[i]->Push(point);
+    }
+  }
+  readings_++;
+}
+
+uint32_t TieredHistory::Read(std::chrono::milliseconds window, uint64_t now_ms,
+                             std::vector<StatisticsRing::Point> &points) const {
+  uint64_t window_ms = window.count() > 0 ? static_cast<uint64_t>(window.count()) : 0;
+  size_t tier = kTiers - 1;
+  for (size_t i = 0; i < kTiers; i++) {
+    if (tiers_[i]->Capacity() * kTierReadings[i] * 1000 >= window_ms) {
+      tier = i;
+      break;
+    }
+  }
+  tiers_[tier]->Read(now_ms > window_ms ? now_ms - window_ms : 0, points);
+  return kTierReadings[tier] * 1000;
+}
+
+size_t TieredHistory::MemoryBytes() const {
+  size_t bytes = 0;
+  for (const auto &tier : tiers_) {
+    bytes += tier->MemoryBytes();
+  }
+  return bytes;
+}
+
+void StatisticsHistory::Record(const std::string &tunnel_name, uint64_t rx_bytes, uint64_t tx_bytes,
+                               const std::vector<PeerStatistics> &peers, uint64_t now_ms) {
+  std::shared_ptr<Tunnel> tunnel;
+  bool peers_changed = false;
+  bool low_memory = low_memory_;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = tunnels_.find(tunnel_name);
+    // A tunnel recorded before the mode changed starts over
+    if (it != tunnels_.end() && it->second->low_memory == low_memory) {
+      tunnel = it->second;
+      peers_changed = tunnel->peers.size() != peers.size();
+      for (size_t i = 0; i < peers.size() && !peers_changed; i++) {
+        peers_changed = tunnel->peers.find(peers[i].public_key) == tunnel->peers.end();
+      }
+    }
+  }
+
+  // Only this thread changes the maps, so what was seen above still holds
+  if (!tunnel || peers_changed) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!tunnel) {
+      tunnel = std::make_shared<Tunnel>(low_memory);
+      tunnels_[tunnel_name] = tunnel;
+    }
+    std::unordered_set<PeerKey, PeerKeyHash> present;
+    for (const PeerStatistics &peer : peers) {
+      present.insert(peer.public_key);
+      if (tunnel->peers.find(peer.public_key) == tunnel->peers.end()) {
+        tunnel->peers[peer.public_key] = std::make_shared<TieredHistory>(
+            low_memory ? TieredHistory::kLowMemoryPeerCapacities : TieredHistory::kPeerCapacities);
+      }
+    }
+    for (auto it = tunnel->peers.begin(); it != tunnel->peers.end();) {
+      it = present.count(it->first) ? std::next(it) : tunnel->peers.erase(it);
+    }
+  }
+
+  StatisticsRing::Point point;
+  point.time_ms = now_ms;
+  point.rx_bytes = rx_bytes;
+  point.tx_bytes = tx_bytes;
+  tunnel->totals.Record(point);
+  for (const PeerStatistics &peer : peers) {
+    point.rx_bytes = peer.rx_bytes;
+    point.tx_bytes = peer.tx_bytes;
+    // The writer's own lookups need no lock, readers only ever read the map
+    tunnel->peers.find(peer.public_key)->second->Record(point);
+  }
+}
+
+std::vector<uint8_t> StatisticsHistory::Encode(const std::string &tunnel_name, const std::optional<PeerKey> &peer,
+                                               std::chrono::milliseconds window, uint64_t now_ms) const {
+  std::vector<StatisticsRing::Point> points;
+  uint32_t interval_ms = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto tunnel = tunnels_.find(tunnel_name);
+    if (tunnel != tunnels_.end()) {
+      if (!peer) {
+        interval_ms = tunnel->second->totals.Read(window, now_ms, points);
+      } else {
+        auto it = tunnel->second->peers.find(*peer);
+        if (it != tunnel->second->peers.end()) {
+          interval_ms = it->second->Read(window, now_ms, points);
+        }
+      }
+    }
+  }
+
+  std::vector<uint8_t> encoded(kHeaderSize + points.size() * kRecordSize);
+  uint8_t *out = encoded.data();
+  uint16_t version = kVersion;
+  uint16_t record_size = static_cast<uint16_t>(kRecordSize);
+  uint32_t count = static_cast<uint32_t>(points.size());
+  memcpy(out, &version, 2);
+  memcpy(out + 2, &record_size, 2);
+  memcpy(out + 4, &count, 4);
+  memcpy(out + 8, &interval_ms, 4);
+  out += kHeaderSize;
+  for (const StatisticsRing::Point &point : points) {
+    memcpy(out, &point.time_ms, 8);
+    memcpy(out + 8, &point.rx_bytes, 8);
+    memcpy(out + 16, &point.tx_bytes, 8);
+    out += kRecordSize;
+  }
+  return encoded;
+}
+
+size_t StatisticsHistory::MemoryBytes() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (const auto &tunnel : tunnels_) {
+    bytes += tunnel.second->totals.MemoryBytes();
+    for (const auto &peer : tunnel.second->peers) {
+      bytes += peer.second->MemoryBytes();
+    }
+  }
+  return bytes;
+}
+
+} // namespace wireguard_dart
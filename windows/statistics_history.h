@@ -0,0 +1,147 @@
+#pragma once
+
+#include <windows.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "peer_statistics.h"
+
+namespace wireguard_dart {
+
+/**
+ * A fixed number of the newest counter readings, written by one thread and read by any number of others
+ * without ever making the writer wait: each slot carries a sequence number that is odd while it is written,
+ * and readers skip a slot they saw change.
+ */
+class StatisticsRing {
+public:
+  struct Point {
+    // Milliseconds since 1970
+    uint64_t time_ms = 0;
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+  };
+
+  explicit StatisticsRing(size_t capacity);
+
+  StatisticsRing(const StatisticsRing &) = delete;
+  StatisticsRing &operator=(const StatisticsRing &) = delete;
+
+  size_t Capacity() const { return capacity_; }
+  size_t MemoryBytes() const { return capacity_ * sizeof(Slot); }
+
+  // From the writing thread only
+  void Push(const Point &point);
+  // Append the points from since_ms on, oldest first
+  void Read(uint64_t since_ms, std::vector<Point> &points) const;
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> time_ms{0};
+    std::atomic<uint64_t> rx_bytes{0};
+    std::atomic<uint64_t> tx_bytes{0};
+  };
+
+  size_t capacity_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<uint64_t> written_{0};
+};
+
+/**
+ * The readings of one tunnel or peer in tiers of one every second, ten seconds and minute. The counters are
+ * totals, so a coarser tier keeps every tenth or sixtieth reading and still gives the exact average rate
+ * between two of them.
+ */
+class TieredHistory {
+public:
+  static constexpr size_t kTiers = 3;
+  // Readings per point of each tier, at one reading a second
+  static constexpr std::array<uint32_t, kTiers> kTierReadings = {1, 10, 60};
+  using Capacities = std::array<size_t, kTiers>;
+
+  explicit TieredHistory(const Capacities &capacities);
+
+  // From the sampler thread, once per second
+  void Record(const StatisticsRing::Point &point);
+
+  // The points of the finest tier that spans the window; returns that tier's interval in milliseconds
+  uint32_t Read(std::chrono::milliseconds window, uint64_t now_ms, std::vector<StatisticsRing::Point> &points) const;
+
+  size_t MemoryBytes() const;
+
+  // For the tunnel totals: 5 minutes at 1s, an hour at 10s, a day at 60s
+  static constexpr Capacities kTunnelCapacities = {300, 360, 1440};
+  // Peers are many, so they keep a minute at 1s, 15 minutes at 10s and an hour at 60s
+  static constexpr Capacities kPeerCapacities = {60, 90, 60};
+  // In low-memory mode a tunnel keeps a minute at 1s, 15 minutes at 10s and 4 hours at 60s, a peer 15 minutes
+  static constexpr Capacities kLowMemoryTunnelCapacities = {60, 90, 240};
+  static constexpr Capacities kLowMemoryPeerCapacities = {10, 30, 15};
+
+private:
+  std::array<std::unique_ptr<StatisticsRing>, kTiers> tiers_;
+  // Only touched by the writer
+  uint64_t readings_ = 0;
+};
+
+/**
+ * The statistics history of every tunnel the sampler has seen, by tunnel name, with one history per peer.
+ * Peers missing from a reading lose their history; tunnels keep theirs, so a tunnel that is set up again
+ * continues its graph.
+ */
+class StatisticsHistory {
+public:
+  static constexpr uint16_t kVersion = 1;
+  static constexpr size_t kHeaderSize = 16;
+  static constexpr size_t kRecordSize = 24;
+
+  // From the sampler thread
+  void Record(const std::string &tunnel_name, uint64_t rx_bytes, uint64_t tx_bytes,
+              const std::vector<PeerStatistics> &peers, uint64_t now_ms);
+
+  /**
+   * The window of the tunnel's totals, or of one peer, as a little-endian blob: a header of uint16 version,
+   * uint16 record size, uint32 point count, uint32 interval of the points in milliseconds and 4 reserved
+   * bytes, then per point uint64 time in milliseconds since 1970, rx bytes and tx bytes. No points for a
+   * tunnel or peer without history.
+   */
+  std::vector<uint8_t> Encode(const std::string &tunnel_name, const std::optional<PeerKey> &peer,
+                              std::chrono::milliseconds window, uint64_t now_ms) const;
+
+  /**
+   * Keep the shorter histories of the kLowMemory capacities. Each tunnel starts over with the new capacities at
+   * its next reading, as the sampler thread alone replaces them.
+   */
+  void SetLowMemory(bool low_memory) { low_memory_ = low_memory; }
+
+  // Bytes the rings of every tunnel and peer take
+  size_t MemoryBytes() const;
+
+private:
+  struct Tunnel {
+    explicit Tunnel(bool low_memory)
+        : low_memory(low_memory),
+          totals(low_memory ? TieredHistory::kLowMemoryTunnelCapacities : TieredHistory::kTunnelCapacities) {}
+
+    bool low_memory;
+    TieredHistory totals;
+    std::unordered_map<PeerKey, std::shared_ptr<TieredHistory>, PeerKeyHash> peers;
+  };
+
+  std::atomic<bool> low_memory_{false};
+
+  // Exclusive only while a tunnel or peer is added or removed; the points themselves need no lock
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Tunnel>> tunnels_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,252 @@
+#include "statistics_recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+#include "background_threads.h"
+#include "cpu_accounting.h"
+#include "spdlog/spdlog.h"
+
+std::string GetLastErrorAsString(DWORD error_code);
+
+namespace wireguard_dart {
+
+namespace {
+
+// Read or write at the offset of a file opened for overlapped I/O and wait for it to complete
+bool TransferAt(HANDLE file, HANDLE event, void *data, DWORD size, uint64_t offset, bool write) {
+  OVERLAPPED overlapped{};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+  overlapped.hEvent = event;
+  BOOL started =
+      write ? WriteFile(file, data, size, nullptr, &overlapped) : ReadFile(file, data, size, nullptr, &overlapped);
+  if (!started && GetLastError() != ERROR_IO_PENDING) {
+    return false;
+  }
+  DWORD transferred = 0;
+  if (!GetOverlappedResult(file, &overlapped, &transferred, TRUE)) {
+    return false;
+  }
+  if (transferred != size) {
+    SetLastError(ERROR_HANDLE_EOF);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+StatisticsRecorder::StatisticsRecorder() {
+  write_event_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  data_event_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+  stop_event_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  flush_timer_ = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+}
+
+StatisticsRecorder::~StatisticsRecorder() {
+  Stop();
+  for (HANDLE event : {write_event_, data_event_, stop_event_, flush_timer_}) {
+    if (event) {
+      CloseHandle(event);
+    }
+  }
+}
+
+bool StatisticsRecorder::Start(const std::wstring &path) {
+  Stop();
+  if (!write_event_ || !data_event_ || !stop_event_ || !flush_timer_) {
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return false;
+  }
+
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    DWORD error_code = GetLastError();
+    CloseHandle(file);
+    SetLastError(error_code);
+    return false;
+  }
+
+  uint64_t file_size = static_cast<uint64_t>(size.QuadPart);
+  StatisticsRecordingHeader header{};
+  if (file_size == 0) {
+    std::memcpy(header.magic, kStatisticsRecordingMagic, sizeof(header.magic));
+    header.version = kStatisticsRecordingVersion;
+    header.record_size = sizeof(StatisticsRecord);
+    header.created_ms = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+            .count());
+    if (!TransferAt(file, write_event_, &header, sizeof(header), 0, true)) {
+      DWORD error_code = GetLastError();
+      CloseHandle(file);
+      SetLastError(error_code);
+      return false;
+    }
+    file_size = sizeof(header);
+  } else {
+    bool valid = file_size >= sizeof(header) && TransferAt(file, write_event_, &header, sizeof(header), 0, false) &&
+                 std::memcmp(header.magic, kStatisticsRecordingMagic, sizeof(header.magic)) == 0 &&
+                 header.version == kStatisticsRecordingVersion && header.record_size == sizeof(StatisticsRecord);
+    if (!valid) {
+      CloseHandle(file);
+      SetLastError(ERROR_INVALID_DATA);
+      return false;
+    }
+  }
+  // A record cut off by a crash is overwritten
+  file_offset_ = sizeof(header) + (file_size - sizeof(header)) / sizeof(StatisticsRecord) * sizeof(StatisticsRecord);
+
+  if (!ring_) {
+    ring_ = std::make_unique<StatisticsRecord[]>(kRingRecords);
+    buffers_[0] = std::make_unique<StatisticsRecord[]>(kBufferRecords);
+    buffers_[1] = std::make_unique<StatisticsRecord[]>(kBufferRecords);
+  }
+  file_ = file;
+  head_.store(0, std::memory_order_relaxed);
+  tail_.store(0, std::memory_order_relaxed);
+  written_.store(0, std::memory_order_relaxed);
+  dropped_.store(0, std::memory_order_relaxed);
+  ResetEvent(stop_event_);
+  ResetEvent(data_event_);
+  LARGE_INTEGER due;
+  due.QuadPart = -static_cast<LONGLONG>(kFlushIntervalMs) * 10000;
+  if (!SetWaitableTimerEx(flush_timer_, &due, kFlushIntervalMs, nullptr, nullptr, nullptr, kFlushToleranceMs)) {
+    // Without the coalescing then; without any timer partly filled buffers wait until they are full or for Stop
+    logger_->warn("Failed to set the coalescing flush timer: Windows error {}", GetLastError());
+    if (!SetWaitableTimer(flush_timer_, &due, kFlushIntervalMs, nullptr, nullptr, FALSE)) {
+      logger_->error("Failed to set the flush timer: Windows error {}", GetLastError());
+    }
+  }
+
+  try {
+    writer_ = std::thread(&StatisticsRecorder::Run, this);
+  } catch (const std::system_error &e) {
+    logger_->error("Failed to start the statistics recorder: {}", e.what());
+    CancelWaitableTimer(flush_timer_);
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+    return false;
+  }
+  recording_.store(true, std::memory_order_release);
+  logger_->info("Statistics recording started at offset {}", file_offset_);
+  return true;
+}
+
+void StatisticsRecorder::Stop() {
+  if (!writer_.joinable()) {
+    return;
+  }
+  recording_.store(false, std::memory_order_release);
+  SetEvent(stop_event_);
+  writer_.join();
+  CancelWaitableTimer(flush_timer_);
+  CloseHandle(file_);
+  file_ = INVALID_HANDLE_VALUE;
+  logger_->info("Statistics recording stopped: {} records written, {} dropped", RecordsWritten(), RecordsDropped());
+}
+
+void StatisticsRecorder::Push(const StatisticsRecord &record) {
+  if (!recording_.load(std::memory_order_acquire)) {
+    return;
+  }
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  uint64_t tail = tail_.load(std::memory_order_acquire);
+  if (head - tail >= kRingRecords) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring_[head % kRingRecords] = record;
+  head_.store(head + 1, std::memory_order_release);
+  if (head + 1 - tail == kRingRecords / 2) {
+    SetEvent(data_event_);
+  }
+}
+
+void StatisticsRecorder::Run() {
+  ThrottleCurrentThread();
+  ScopedThreadCpu cpu(BackgroundThread::kStatisticsRecorder);
+
+  HANDLE events[] = {stop_event_, data_event_, flush_timer_};
+  size_t current = 0;
+  size_t filled = 0;
+  bool stopping = false;
+  while (!stopping) {
+    DWORD wait = WaitForMultipleObjects(3, events, FALSE, INFINITE);
+    WakeupCounts::Instance().Count(BackgroundThread::kStatisticsRecorder);
+    stopping = wait != WAIT_OBJECT_0 + 1 && wait != WAIT_OBJECT_0 + 2;
+
+    // Full buffers go out as soon as they are full, the rest only on the flush interval and on stop
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    while (tail != head) {
+      size_t count = (std::min)(static_cast<size_t>(head - tail), kBufferRecords - filled);
+      for (size_t i = 0; i < count; i++) {
+        buffers_[current][filled + i] = ring_[(tail + i) % kRingRecords];
+      }
+      tail += count;
+      filled += count;
+      tail_.store(tail, std::memory_order_release);
+      if (filled == kBufferRecords) {
+        BeginWrite(buffers_[current].get(), filled);
+        current ^= 1;
+        filled = 0;
+      }
+    }
+    if (filled > 0 && wait != WAIT_OBJECT_0 + 1) {
+      BeginWrite(buffers_[current].get(), filled);
+      current ^= 1;
+      filled = 0;
+    }
+  }
+  FinishWrite();
+}
+
+void StatisticsRecorder::BeginWrite(const StatisticsRecord *records, size_t count) {
+  // The other buffer, which is filled next, may still be in flight
+  FinishWrite();
+
+  DWORD bytes = static_cast<DWORD>(count * sizeof(StatisticsRecord));
+  overlapped_ = OVERLAPPED{};
+  overlapped_.Offset = static_cast<DWORD>(file_offset_);
+  overlapped_.OffsetHigh = static_cast<DWORD>(file_offset_ >> 32);
+  overlapped_.hEvent = write_event_;
+  if (!WriteFile(file_, records, bytes, nullptr, &overlapped_) && GetLastError() != ERROR_IO_PENDING) {
+    DWORD error_code = GetLastError();
+    logger_->error("Statistics recording write failed. Windows Error Code: {} - {}", error_code,
+                   GetLastErrorAsString(error_code));
+    dropped_.fetch_add(count, std::memory_order_relaxed);
+    return;
+  }
+  write_pending_ = true;
+  pending_records_ = count;
+  file_offset_ += bytes;
+}
+
+void StatisticsRecorder::FinishWrite() {
+  if (!write_pending_) {
+    return;
+  }
+  write_pending_ = false;
+  DWORD transferred = 0;
+  if (!GetOverlappedResult(file_, &overlapped_, &transferred, TRUE)) {
+    DWORD error_code = GetLastError();
+    logger_->error("Statistics recording write failed. Windows Error Code: {} - {}", error_code,
+                   GetLastErrorAsString(error_code));
+  }
+  size_t completed = transferred / sizeof(StatisticsRecord);
+  // The next write goes where the failed one stopped
+  file_offset_ -= (pending_records_ - completed) * sizeof(StatisticsRecord);
+  written_.fetch_add(completed, std::memory_order_relaxed);
+  dropped_.fetch_add(pending_records_ - completed, std::memory_order_relaxed);
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "plugin_logger.h"
+
+namespace wireguard_dart {
+
+/**
+ * The file layout of a statistics recording, little endian: one StatisticsRecordingHeader, then fixed-width
+ * StatisticsRecords, one per tunnel and reading, oldest first. Starting a recording on an existing file appends
+ * to it, so a soak run survives restarts of the app.
+ */
+constexpr char kStatisticsRecordingMagic[4] = {'W', 'G', 'S', 'R'};
+constexpr uint16_t kStatisticsRecordingVersion = 1;
+
+struct StatisticsRecordingHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t record_size;
+  // When the file was created, in milliseconds since 1970
+  uint64_t created_ms;
+};
+static_assert(sizeof(StatisticsRecordingHeader) == 16, "The recording header is part of the file format");
+
+struct StatisticsRecord {
+  // Milliseconds since 1970
+  uint64_t time_ms;
+  // UTF-8, cut off at 31 bytes and padded with zeros
+  char tunnel_name[32];
+  uint64_t rx_bytes;
+  uint64_t tx_bytes;
+  // Milliseconds since 1970, or 0 if there was none
+  uint64_t last_handshake_ms;
+  // From MIB_IF_ROW2, 0 when the interface could not be read
+  uint64_t in_discards;
+  uint64_t out_discards;
+  uint64_t in_errors;
+  uint64_t out_errors;
+};
+static_assert(sizeof(StatisticsRecord) == 96, "The record size is part of the file format");
+
+/**
+ * Appends statistics records to a file, for hours-long soak runs. Push never blocks and never allocates: the
+ * records go into a fixed ring, and a writer thread moves them into one of two buffers, writing a full one with
+ * overlapped I/O while it fills the other. Partly filled buffers are written every kFlushIntervalMs, on a timer
+ * that may fire up to kFlushToleranceMs late so Windows can coalesce it with others. If the disk falls so far
+ * behind that the ring fills up, records are dropped and counted.
+ */
+class StatisticsRecorder {
+public:
+  static constexpr size_t kRingRecords = 4096;
+  static constexpr size_t kBufferRecords = 1024;
+  static constexpr DWORD kFlushIntervalMs = 5000;
+  static constexpr ULONG kFlushToleranceMs = 1000;
+
+  StatisticsRecorder();
+  ~StatisticsRecorder();
+
+  StatisticsRecorder(const StatisticsRecorder &) = delete;
+  StatisticsRecorder &operator=(const StatisticsRecorder &) = delete;
+
+  // Open or create the file and start the writer, stopping an earlier recording. False with the error in
+  // GetLastError, ERROR_INVALID_DATA for an existing file that is not a recording of this version.
+  bool Start(const std::wstring &path);
+  // Write what is left and close the file
+  void Stop();
+  bool IsRecording() const { return recording_.load(std::memory_order_acquire); }
+
+  // From one thread at a time, between Start and Stop
+  void Push(const StatisticsRecord &record);
+
+  // Of the current or last recording
+  uint64_t RecordsWritten() const { return written_.load(std::memory_order_relaxed); }
+  uint64_t RecordsDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  // The ring and the write buffers, allocated by the first Start and kept after it; from Start's thread
+  size_t MemoryBytes() const {
+    return ring_ ? (kRingRecords + 2 * kBufferRecords) * sizeof(StatisticsRecord) : 0;
+  }
+
+private:
+  void Run();
+  // Write the records at the end of the file once the write in flight completes
+  void BeginWrite(const StatisticsRecord *records, size_t count);
+  void FinishWrite();
+
+  // Written by Push, read by the writer; indices only grow, the slot is the index modulo kRingRecords
+  std::unique_ptr<StatisticsRecord[]> ring_;
+  std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> written_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<bool> recording_{false};
+
+  // Only used by the writer thread while it runs
+  std::unique_ptr<StatisticsRecord[]> buffers_[2];
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  OVERLAPPED overlapped_{};
+  HANDLE write_event_ = nullptr;
+  bool write_pending_ = false;
+  size_t pending_records_ = 0;
+  uint64_t file_offset_ = 0;
+
+  // Set by Push once the ring is half full, so the writer does not wait for the flush interval
+  HANDLE data_event_ = nullptr;
+  HANDLE stop_event_ = nullptr;
+  // Periodic, every kFlushIntervalMs while recording
+  HANDLE flush_timer_ = nullptr;
+  std::thread writer_;
+
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,472 @@
+#include "statistics_sampler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+
+#include "cpu_accounting.h"
+#include "encodable_keys.h"
+#include "perf_stats.h"
+#include "spdlog/spdlog.h"
+#include "startup_trace.h"
+#include "trace_events.h"
+#include "utils.h"
+
+namespace wireguard_dart {
+
+flutter::EncodableValue InterfaceCountersValue(const WireguardAdapter::InterfaceCounters &counters) {
+  flutter::EncodableMap value;
+  auto put = [&value](const char *name, uint64_t counter) {
+    value[flutter::EncodableValue(name)] = flutter::EncodableValue(static_cast<int64_t>(counter));
+  };
+  put("inOctets", counters.in_octets);
+  put("outOctets", counters.out_octets);
+  put("inPackets", counters.in_packets);
+  put("outPackets", counters.out_packets);
+  put("inDiscards", counters.in_discards);
+  put("outDiscards", counters.out_discards);
+  put("inErrors", counters.in_errors);
+  put("outErrors", counters.out_errors);
+  return flutter::EncodableValue(value);
+}
+
+flutter::EncodableValue ProcessTrafficValue(const std::vector<ProcessTraffic> &processes) {
+  flutter::EncodableList list;
+  list.reserve(processes.size());
+  for (const ProcessTraffic &process : processes) {
+    flutter::EncodableMap value;
+    value[keys::kPid] = flutter::EncodableValue(static_cast<int64_t>(process.pid));
+    value[keys::kImage] = flutter::EncodableValue(process.image);
+    value[keys::kRxBytes] = flutter::EncodableValue(static_cast<int64_t>(process.rx_bytes));
+    value[keys::kTxBytes] = flutter::EncodableValue(static_cast<int64_t>(process.tx_bytes));
+    value[keys::kRxBytesPerSecond] = flutter::EncodableValue(static_cast<int64_t>(process.rx_bytes_per_second));
+    value[keys::kTxBytesPerSecond] = flutter::EncodableValue(static_cast<int64_t>(process.tx_bytes_per_second));
+    value[keys::kTcpConnections] = flutter::EncodableValue(static_cast<int64_t>(process.tcp_connections));
+    value[keys::kUdpSockets] = flutter::EncodableValue(static_cast<int64_t>(process.udp_sockets));
+    value[keys::kEnded] = flutter::EncodableValue(process.ended);
+    list.push_back(flutter::EncodableValue(std::move(value)));
+  }
+  return flutter::EncodableValue(std::move(list));
+}
+
+StatisticsSampler::StatisticsSampler(Collect collect, PlatformTaskRunner *platform_tasks, StatisticsHistory *history,
+                                     LivenessChanged liveness_changed)
+    : collect_(std::move(collect)),
+      platform_tasks_(platform_tasks),
+      history_(history),
+      liveness_changed_(std::move(liveness_changed)) {}
+
+StatisticsSampler::~StatisticsSampler() { Stop(); }
+
+void StatisticsSampler::SetHistoryEnabled(bool enabled) {
+  if (enabled == history_enabled_) {
+    return;
+  }
+  history_enabled_ = enabled && history_;
+  logger_->info("Statistics history {}", history_enabled_ ? "enabled" : "disabled");
+  Restart();
+}
+
+void StatisticsSampler::SetRecorder(StatisticsRecorder *recorder) {
+  if (recorder == recorder_) {
+    return;
+  }
+  recorder_ = recorder;
+  Restart();
+}
+
+void StatisticsSampler::SetCumulativeCounters(CumulativeCounters *counters) {
+  if (counters == cumulative_counters_) {
+    return;
+  }
+  cumulative_counters_ = counters;
+  Restart();
+}
+
+void StatisticsSampler::SetStaleThreshold(std::chrono::seconds threshold) {
+  if (threshold.count() < 0) {
+    threshold = std::chrono::seconds(0);
+  }
+  if (threshold == stale_threshold_) {
+    return;
+  }
+  stale_threshold_ = threshold;
+  logger_->info("Handshake stale threshold set to {} s", stale_threshold_.count());
+  Restart();
+}
+
+void StatisticsSampler::SetRoamingInterval(std::chrono::seconds interval) {
+  if (interval.count() < 0) {
+    interval = std::chrono::seconds(0);
+  }
+  if (interval == roaming_interval_) {
+    return;
+  }
+  roaming_interval_ = interval;
+  logger_->info("Endpoint roaming checked every {} s", roaming_interval_.count());
+  Restart();
+}
+
+void StatisticsSampler::SetPowerSaving(bool saving) {
+  if (saving == power_saving_) {
+    return;
+  }
+  power_saving_ = saving;
+  Restart();
+}
+
+void StatisticsSampler::Stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker = std::move(worker_);
+  }
+  wake_.Notify();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+void StatisticsSampler::Restart() {
+  Stop();
+
+  // Without the platform thread to hand events to, the sink could only be used from the wrong thread
+  bool has_platform_thread = platform_tasks_ && platform_tasks_->IsValid();
+  std::vector<Subscription> subscriptions;
+  if (sink_ && has_platform_thread) {
+    Fields fields;
+    fields.interface_counters = stream_interface_counters_;
+    fields.luid = stream_process_traffic_;
+    bool process_traffic = stream_process_traffic_;
+    subscriptions.push_back({interval_, fields, [this, process_traffic](const std::vector<Sample> &samples) {
+                               EmitChanges(samples, process_traffic);
+                             }});
+  }
+  if (history_enabled_) {
+    Fields fields;
+    fields.peers = true;
+    subscriptions.push_back(
+        {kHistoryInterval, fields, [this](const std::vector<Sample> &samples) { RecordHistory(samples); }});
+  }
+  if (recorder_) {
+    Fields fields;
+    fields.interface_counters = true;
+    subscriptions.push_back(
+        {kRecordingInterval, fields, [this](const std::vector<Sample> &samples) { RecordToFile(samples); }});
+  }
+  if (cumulative_counters_) {
+    // By peer, so that a peer removed from the tunnel takes nothing away from its totals
+    Fields fields;
+    fields.peers = true;
+    fields.luid = true;
+    subscriptions.push_back(
+        {kCumulativeInterval, fields, [this](const std::vector<Sample> &samples) { AddCumulative(samples); }});
+  }
+  if (has_platform_thread && stale_threshold_.count() > 0) {
+    std::chrono::seconds threshold = stale_threshold_;
+    std::chrono::milliseconds interval = (std::max)(
+        kMinLivenessInterval,
+        (std::min)(std::chrono::duration_cast<std::chrono::milliseconds>(threshold) / 10, kMaxLivenessInterval));
+    Fields fields;
+    fields.peers = true;
+    subscriptions.push_back({interval, fields, [this, threshold](const std::vector<Sample> &samples) {
+                               CheckLiveness(samples, threshold);
+                             }});
+  }
+  if (roaming_interval_.count() > 0) {
+    // The collector does the work while reading the peers, so there is nothing to deliver
+    Fields fields;
+    fields.endpoints = true;
+    subscriptions.push_back({roaming_interval_, fields, [](const std::vector<Sample> &) {}});
+  }
+  if (subscriptions.empty()) {
+    return;
+  }
+  if (power_saving_) {
+    for (Subscription &subscription : subscriptions) {
+      subscription.interval = (std::max)(subscription.interval, kPowerSavingInterval);
+    }
+    logger_->info("Sampling statistics every {} ms at most while saving power", kPowerSavingInterval.count());
+  }
+  // A new listener gets every tunnel in its first event
+  last_emitted_.clear();
+  process_traffic_.Reset();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  try {
+    ScopedStartup startup("statisticsSampler");
+    worker_ = std::thread(&StatisticsSampler::Run, this, std::move(subscriptions));
+  } catch (const std::system_error &e) {
+    logger_->error("Failed to start the statistics sampler: {}", e.what());
+  }
+}
+
+std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+StatisticsSampler::OnListenInternal(const flutter::EncodableValue *arguments,
+                                    std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> &&events) {
+  sink_ = std::move(events);
+  if (!platform_tasks_ || !platform_tasks_->IsValid()) {
+    logger_->warn("Statistics stream not available without the platform task window");
+  }
+
+  std::chrono::milliseconds interval = kDefaultInterval;
+  const auto *args = arguments ? std::get_if<flutter::EncodableMap>(arguments) : nullptr;
+  const auto *interval_value = args ? ValueOrNull(*args, keys::kIntervalMs) : nullptr;
+  if (interval_value) {
+    if (const auto *value = std::get_if<int32_t>(interval_value)) {
+      interval = std::chrono::milliseconds(*value);
+    } else if (const auto *value = std::get_if<int64_t>(interval_value)) {
+      interval = std::chrono::milliseconds(*value);
+    }
+  }
+  interval_ = (std::max)(kMinInterval, (std::min)(interval, kMaxInterval));
+  const auto *interface_counters = args ? std::get_if<bool>(ValueOrNull(*args, keys::kInterfaceCounters)) : nullptr;
+  stream_interface_counters_ = interface_counters && *interface_counters;
+  const auto *process_traffic = args ? std::get_if<bool>(ValueOrNull(*args, keys::kProcessTraffic)) : nullptr;
+  stream_process_traffic_ = process_traffic && *process_traffic;
+
+  Restart();
+  logger_->info("Statistics sampling started every {} ms", interval_.count());
+  return nullptr;
+}
+
+std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+StatisticsSampler::OnCancelInternal(const flutter::EncodableValue *arguments) {
+  sink_.reset();
+  Restart();
+  logger_->info("Statistics sampling stopped");
+  return nullptr;
+}
+
+void StatisticsSampler::Run(std::vector<Subscription> subscriptions) {
+  ThrottleCurrentThread();
+  ScopedThreadCpu cpu(BackgroundThread::kStatisticsSampler);
+
+  // Kept across ticks, so a tick without changes does not allocate
+  std::vector<Sample> samples;
+
+  // On the grid, so that consumers with intervals that are multiples of each other stay in step
+  auto origin = std::chrono::steady_clock::now();
+  auto on_grid = [origin](std::chrono::steady_clock::time_point at) {
+    auto ticks = (at - origin + kTick - std::chrono::nanoseconds(1)) / kTick;
+    return origin + ticks * kTick;
+  };
+  auto shortest = std::chrono::milliseconds::max();
+  for (Subscription &subscription : subscriptions) {
+    subscription.next = origin;
+    shortest = (std::min)(shortest, subscription.interval);
+  }
+  const std::chrono::milliseconds tolerable_delay = shortest / 10;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    lock.unlock();
+    auto now = std::chrono::steady_clock::now();
+
+    Fields fields;
+    bool due = false;
+    for (const Subscription &subscription : subscriptions) {
+      if (subscription.next <= now) {
+        due = true;
+        fields.peers |= subscription.fields.peers;
+        fields.interface_counters |= subscription.fields.interface_counters;
+        fields.endpoints |= subscription.fields.endpoints;
+        fields.luid |= subscription.fields.luid;
+      }
+    }
+    if (due) {
+      TraceRegion trace_region("StatisticsSample");
+      collect_(samples, fields);
+    }
+
+    auto wake_at = std::chrono::steady_clock::time_point::max();
+    for (Subscription &subscription : subscriptions) {
+      if (subscription.next <= now) {
+        subscription.deliver(samples);
+        // On schedule, unless a slow tick fell behind by a whole interval
+        subscription.next = on_grid((std::max)(subscription.next + subscription.interval, now));
+      }
+      wake_at = (std::min)(wake_at, subscription.next);
+    }
+
+    lock.lock();
+    wake_.WaitUntil(lock, wake_at, tolerable_delay, [this] { return stopping_; });
+  }
+}
+
+void StatisticsSampler::EmitChanges(const std::vector<Sample> &samples, bool process_traffic) {
+  std::unordered_map<std::string, WireguardAdapter::Totals> &last = last_emitted_;
+  flutter::EncodableMap event;
+  // The samples were read just now
+  int64_t monotonic_us = PerfCounterMicroseconds();
+  process_changes_.clear();
+  if (process_traffic) {
+    process_interfaces_.resize(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+      process_interfaces_[i].tunnel_name = samples[i].tunnel_name;
+      process_interfaces_[i].luid = samples[i].luid;
+    }
+    process_traffic_.Sample(process_interfaces_, &process_changes_);
+  }
+  for (const Sample &sample : samples) {
+    auto processes = std::find_if(process_changes_.begin(), process_changes_.end(),
+                                  [&sample](const ProcessTrafficMeter::TunnelProcesses &tunnel) {
+                                    return tunnel.tunnel_name == sample.tunnel_name;
+                                  });
+    auto it = last.find(sample.tunnel_name);
+    if (it != last.end() && it->second.rx_bytes == sample.totals.rx_bytes &&
+        it->second.tx_bytes == sample.totals.tx_bytes && it->second.last_handshake == sample.totals.last_handshake &&
+        processes == process_changes_.end()) {
+      continue;
+    }
+    last[sample.tunnel_name] = sample.totals;
+
+    flutter::EncodableMap totals;
+    totals[keys::kTotalDownload] =
+        flutter::EncodableValue(static_cast<int64_t>(sample.totals.rx_bytes));
+    totals[keys::kTotalUpload] =
+        flutter::EncodableValue(static_cast<int64_t>(sample.totals.tx_bytes));
+    totals[keys::kLatestHandshake] =
+        flutter::EncodableValue(static_cast<int64_t>(sample.totals.LastHandshakeUnixMillis()));
+    if (sample.has_interface_counters) {
+      totals[keys::kInterface] = InterfaceCountersValue(sample.interface_counters);
+    }
+    if (processes != process_changes_.end()) {
+      totals[keys::kProcesses] = ProcessTrafficValue(processes->processes);
+    }
+    totals[keys::kMonotonicUs] = flutter::EncodableValue(monotonic_us);
+    event[flutter::EncodableValue(sample.tunnel_name)] = flutter::EncodableValue(totals);
+  }
+  // Tunnels that went away are sent again in full if they come back
+  if (last.size() > samples.size()) {
+    for (auto it = last.begin(); it != last.end();) {
+      bool present = std::any_of(samples.begin(), samples.end(),
+                                 [&it](const Sample &sample) { return sample.tunnel_name == it->first; });
+      it = present ? std::next(it) : last.erase(it);
+    }
+  }
+  if (!event.empty()) {
+    platform_tasks_->Post([this, event = std::move(event)]() mutable { Emit(std::move(event)); });
+  }
+}
+
+void StatisticsSampler::RecordHistory(const std::vector<Sample> &samples) {
+  uint64_t now_ms = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  for (const Sample &sample : samples) {
+    history_->Record(sample.tunnel_name, sample.totals.rx_bytes, sample.totals.tx_bytes, sample.peers, now_ms);
+  }
+}
+
+void StatisticsSampler::RecordToFile(const std::vector<Sample> &samples) {
+  uint64_t now_ms = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  for (const Sample &sample : samples) {
+    StatisticsRecord record{};
+    record.time_ms = now_ms;
+    std::memcpy(record.tunnel_name, sample.tunnel_name.data(),
+                (std::min)(sample.tunnel_name.size(), sizeof(record.tunnel_name) - 1));
+    record.rx_bytes = sample.totals.rx_bytes;
+    record.tx_bytes = sample.totals.tx_bytes;
+    record.last_handshake_ms = sample.totals.LastHandshakeUnixMillis();
+    if (sample.has_interface_counters) {
+      record.in_discards = sample.interface_counters.in_discards;
+      record.out_discards = sample.interface_counters.out_discards;
+      record.in_errors = sample.interface_counters.in_errors;
+      record.out_errors = sample.interface_counters.out_errors;
+    }
+    recorder_->Push(record);
+  }
+}
+
+void StatisticsSampler::AddCumulative(const std::vector<Sample> &samples) {
+  uint64_t now_ms = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  for (const Sample &sample : samples) {
+    // Another LUID reads as a new adapter whose counters all count, so without one the peers wait for the next
+    // tick rather than be counted twice
+    if (sample.luid.Value == 0) {
+      continue;
+    }
+    cumulative_counters_->Update(sample.tunnel_name, sample.luid, sample.if_index, sample.peers, now_ms);
+  }
+}
+
+void StatisticsSampler::CheckLiveness(const std::vector<Sample> &samples, std::chrono::seconds threshold) {
+  uint64_t generation = ++liveness_generation_;
+  FILETIME now_filetime;
+  GetSystemTimeAsFileTime(&now_filetime);
+  // In milliseconds since 1970, as the peers' handshakes
+  uint64_t now =
+      FiletimeToUnixMillis((static_cast<uint64_t>(now_filetime.dwHighDateTime) << 32) | now_filetime.dwLowDateTime);
+  uint64_t threshold_ms = static_cast<uint64_t>(threshold.count()) * 1000;
+
+  for (const Sample &sample : samples) {
+    TunnelLiveness &peers = liveness_[sample.tunnel_name];
+    for (const PeerStatistics &peer : sample.peers) {
+      auto inserted = peers.try_emplace(peer.public_key);
+      Liveness &state = inserted.first->second;
+      if (inserted.second) {
+        state.first_seen = now;
+      }
+      state.generation = generation;
+
+      uint64_t since = peer.last_handshake_ms != 0 ? peer.last_handshake_ms : state.first_seen;
+      bool stale = now > since && now - since > threshold_ms;
+      if (stale == state.stale) {
+        continue;
+      }
+      state.stale = stale;
+      PostLiveness(sample.tunnel_name, peer.public_key, stale, false, peer.last_handshake_ms);
+    }
+    // Peers that were removed are watched afresh if they come back, and are no longer stale until then
+    for (auto it = peers.begin(); it != peers.end();) {
+      if (it->second.generation == generation) {
+        ++it;
+        continue;
+      }
+      if (it->second.stale) {
+        PostLiveness(sample.tunnel_name, it->first, false, true, 0);
+      }
+      it = peers.erase(it);
+    }
+  }
+  if (liveness_.size() > samples.size()) {
+    for (auto it = liveness_.begin(); it != liveness_.end();) {
+      bool present = std::any_of(samples.begin(), samples.end(),
+                                 [&it](const Sample &sample) { return sample.tunnel_name == it->first; });
+      if (present) {
+        ++it;
+        continue;
+      }
+      for (const auto &peer : it->second) {
+        if (peer.second.stale) {
+          PostLiveness(it->first, peer.first, false, true, 0);
+        }
+      }
+      it = liveness_.erase(it);
+    }
+  }
+}
+
+void StatisticsSampler::PostLiveness(const std::string &tunnel_name, const PeerKey &public_key, bool stale,
+                                     bool removed, uint64_t last_handshake_ms) {
+  if (liveness_changed_) {
+    platform_tasks_->Post([this, tunnel_name, public_key, stale, removed, last_handshake_ms]() {
+      liveness_changed_(tunnel_name, public_key, stale, removed, last_handshake_ms);
+    });
+  }
+}
+
+void StatisticsSampler::Emit(flutter::EncodableMap event) {
+  if (sink_) {
+    sink_->Success(flutter::EncodableValue(std::move(event)));
+  }
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <flutter/encodable_value.h>
+#include <flutter/event_channel.h>
+
+#include <windows.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "background_threads.h"
+#include "cumulative_counters.h"
+#include "peer_statistics.h"
+#include "platform_task_runner.h"
+#include "plugin_logger.h"
+#include "process_traffic.h"
+#include "statistics_history.h"
+#include "statistics_recorder.h"
+#include "wireguard_adapter.h"
+
+namespace wireguard_dart {
+
+// The interface counters as sent to Dart, by their MIB_IF_ROW2 names
+flutter::EncodableValue InterfaceCountersValue(const WireguardAdapter::InterfaceCounters &counters);
+// The processes of a tunnel as sent to Dart, see ProcessTrafficMeter
+flutter::EncodableValue ProcessTrafficValue(const std::vector<ProcessTraffic> &processes);
+
+/**
+ * The one place the plugin polls the driver from. A single thread serves every consumer of the counters: the
+ * statistics stream, which sends the tunnels whose counters changed at the interval its listener asked for, the
+ * history, the recording to disk and the cumulative counters, each once a second, the stale handshake check and the
+ * endpoint roaming check.
+ * Their deadlines lie on a grid of kTick, so consumers due in the same tick share one read of all adapters, and the
+ * thread only wakes when one is due, or up to a tenth of the shortest interval later where Windows coalesces the
+ * wakeup with other timers. With no consumer nothing is sampled, and while power is saved none is sampled more
+ * often than kPowerSavingInterval.
+ */
+class StatisticsSampler : public flutter::StreamHandler<flutter::EncodableValue> {
+public:
+  struct Sample {
+    std::string tunnel_name;
+    WireguardAdapter::Totals totals;
+    // Only read when a due consumer asked for them
+    std::vector<PeerStatistics> peers;
+    bool has_interface_counters = false;
+    WireguardAdapter::InterfaceCounters interface_counters;
+    // Only set when a due consumer asked for the process traffic or the cumulative counters; 0 if it could not be
+    // read
+    NET_LUID luid = {};
+    // The interface index of the adapter at luid, set with it
+    NET_IFINDEX if_index = 0;
+  };
+  // What the consumers due in a tick need beyond the totals
+  struct Fields {
+    bool peers = false;
+    bool interface_counters = false;
+    // Read the peers and follow those the driver moved to another endpoint, see WireguardAdapter::TrackEndpoints
+    bool endpoints = false;
+    // The adapter's LUID, which the process traffic finds the tunnel's addresses by
+    bool luid = false;
+  };
+  // Replace the samples with those of every adapter, with the fields asked for; called on the sampler thread
+  using Collect = std::function<void(std::vector<Sample> &samples, Fields fields)>;
+  // A peer went stale or recovered, or was removed, with its tunnel or not, while stale; called on the platform
+  // thread, last_handshake_ms in milliseconds since 1970 or 0
+  using LivenessChanged = std::function<void(const std::string &tunnel_name, const PeerKey &public_key, bool stale,
+                                             bool removed, uint64_t last_handshake_ms)>;
+
+  // Deadlines are rounded up to it, the coarser it is the more consumers share a wakeup
+  static constexpr std::chrono::milliseconds kTick{100};
+  static constexpr std::chrono::milliseconds kDefaultInterval{1000};
+  static constexpr std::chrono::milliseconds kMinInterval{100};
+  static constexpr std::chrono::milliseconds kMaxInterval{60000};
+  static constexpr std::chrono::milliseconds kHistoryInterval{1000};
+  static constexpr std::chrono::milliseconds kRecordingInterval{1000};
+  static constexpr std::chrono::milliseconds kCumulativeInterval{1000};
+  // Staleness is checked ten times per threshold, within these bounds
+  static constexpr std::chrono::milliseconds kMinLivenessInterval{1000};
+  static constexpr std::chrono::milliseconds kMaxLivenessInterval{10000};
+  static constexpr std::chrono::seconds kDefaultRoamingInterval{5};
+  // The shortest interval of any consumer while power is saved
+  static constexpr std::chrono::milliseconds kPowerSavingInterval{10000};
+
+  // Events are sent through platform_tasks and readings recorded into history, which must outlive the sampler
+  StatisticsSampler(Collect collect, PlatformTaskRunner *platform_tasks, StatisticsHistory *history,
+                    LivenessChanged liveness_changed = nullptr);
+  virtual ~StatisticsSampler();
+
+  StatisticsSampler(const StatisticsSampler &) = delete;
+  StatisticsSampler &operator=(const StatisticsSampler &) = delete;
+
+  // Record the history whether or not the stream has a listener; on the platform thread
+  void SetHistoryEnabled(bool enabled);
+  // Push every tunnel's counters to the recorder while it is set, nullptr stops; on the platform thread
+  void SetRecorder(StatisticsRecorder *recorder);
+  // Keep every tunnel's and peer's running totals in the open counters while set, nullptr stops; on the platform
+  // thread
+  void SetCumulativeCounters(CumulativeCounters *counters);
+  // Report peers without a handshake for longer than the threshold, zero turns it off; on the platform thread
+  void SetStaleThreshold(std::chrono::seconds threshold);
+  // Check for peers that roamed to another endpoint this often, zero turns it off; on the platform thread
+  void SetRoamingInterval(std::chrono::seconds interval);
+  // On battery saver or with the display off, see PowerMonitor; on the platform thread
+  void SetPowerSaving(bool saving);
+
+  // Stop sampling until the next listener
+  void Stop();
+
+protected:
+  // The arguments may hold "intervalMs", "interfaceCounters" to add those to every tunnel sent, and
+  // "processTraffic" to add the processes whose traffic over the tunnel changed, see ProcessTrafficMeter
+  virtual std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+  OnListenInternal(const flutter::EncodableValue *arguments,
+                   std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> &&events) override;
+
+  virtual std::unique_ptr<flutter::StreamHandlerError<flutter::EncodableValue>>
+  OnCancelInternal(const flutter::EncodableValue *arguments) override;
+
+private:
+  // One consumer of the samples, called on the sampler thread every interval
+  struct Subscription {
+    std::chrono::milliseconds interval;
+    Fields fields;
+    std::function<void(const std::vector<Sample> &samples)> deliver;
+    std::chrono::steady_clock::time_point next;
+  };
+
+  // Whether a peer counts as stale, and since when it is watched for one that never completed a handshake
+  struct Liveness {
+    bool stale = false;
+    uint64_t first_seen = 0;
+    uint64_t generation = 0;
+  };
+  using TunnelLiveness = std::unordered_map<PeerKey, Liveness, PeerKeyHash>;
+
+  // Start the thread again for the current listener and settings, or leave it stopped
+  void Restart();
+  void Run(std::vector<Subscription> subscriptions);
+
+  // Send the tunnels whose totals differ from the last ones sent, or whose processes' traffic changed
+  void EmitChanges(const std::vector<Sample> &samples, bool process_traffic);
+  void RecordHistory(const std::vector<Sample> &samples);
+  void RecordToFile(const std::vector<Sample> &samples);
+  void AddCumulative(const std::vector<Sample> &samples);
+  void CheckLiveness(const std::vector<Sample> &samples, std::chrono::seconds threshold);
+  void PostLiveness(const std::string &tunnel_name, const PeerKey &public_key, bool stale, bool removed,
+                    uint64_t last_handshake_ms);
+  // On the platform thread
+  void Emit(flutter::EncodableMap event);
+
+  Collect collect_;
+  PlatformTaskRunner *platform_tasks_;
+  StatisticsHistory *history_;
+  LivenessChanged liveness_changed_;
+  // Only used on the platform thread
+  std::unique_ptr<flutter::EventSink<flutter::EncodableValue>> sink_;
+  std::chrono::milliseconds interval_ = kDefaultInterval;
+  bool stream_interface_counters_ = false;
+  bool stream_process_traffic_ = false;
+  bool history_enabled_ = false;
+  StatisticsRecorder *recorder_ = nullptr;
+  CumulativeCounters *cumulative_counters_ = nullptr;
+  std::chrono::seconds stale_threshold_{0};
+  std::chrono::seconds roaming_interval_{0};
+  bool power_saving_ = false;
+
+  std::mutex mutex_;
+  CoalescingWait wake_{BackgroundThread::kStatisticsSampler};
+  bool stopping_ = false;
+  std::thread worker_;
+
+  // Only used by the sampler thread; the last totals sent, by tunnel name
+  std::unordered_map<std::string, WireguardAdapter::Totals> last_emitted_;
+  // Only used by the sampler thread, and reset with last_emitted_ while it is stopped
+  ProcessTrafficMeter process_traffic_;
+  std::vector<ProcessTrafficMeter::Interface> process_interfaces_;
+  std::vector<ProcessTrafficMeter::TunnelProcesses> process_changes_;
+  // Only used by the sampler thread, kept across restarts so a stale peer is not reported again
+  std::unordered_map<std::string, TunnelLiveness> liveness_;
+  uint64_t liveness_generation_ = 0;
+
+  PluginLogger logger_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,118 @@
+#include "string_conversions.h"
+
+#include <windows.h>
+
+#include <type_traits>
+
+namespace wireguard_dart {
+
+namespace {
+
+template <typename Char> bool IsAscii(std::basic_string_view<Char> text) {
+  for (Char c : text) {
+    if (static_cast<std::make_unsigned_t<Char>>(c) >= 0x80) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename From, typename To> void CopyAscii(std::basic_string_view<From> from, To *out) {
+  for (size_t i = 0; i < from.size(); i++) {
+    out[i] = static_cast<To>(from[i]);
+  }
+}
+
+} // namespace
+
+std::string WideToUtf8(std::wstring_view wstr) {
+  std::string str;
+  WideToUtf8(wstr, &str);
+  return str;
+}
+
+std::wstring Utf8ToWide(std::string_view str) {
+  std::wstring wstr;
+  Utf8ToWide(str, &wstr);
+  return wstr;
+}
+
+bool WideToUtf8(std::wstring_view wstr, std::string *out) {
+  if (IsAscii(wstr)) {
+    out->resize(wstr.size());
+    CopyAscii(wstr, out->data());
+    return true;
+  }
+  // Sized for the worst case so that one call converts it, then trimmed to what it took
+  out->resize(wstr.size() * kMaxUtf8PerWide);
+  size_t written = WideToUtf8(wstr, out->data(), out->size());
+  out->resize(written);
+  return written > 0;
+}
+
+bool Utf8ToWide(std::string_view str, std::wstring *out) {
+  if (IsAscii(str)) {
+    out->resize(str.size());
+    CopyAscii(str, out->data());
+    return true;
+  }
+  out->resize(str.size());
+  size_t written = Utf8ToWide(str, out->data(), out->size());
+  out->resize(written);
+  return written > 0;
+}
+
+size_t WideToUtf8(std::wstring_view wstr, char *out, size_t capacity) {
+  if (wstr.empty()) {
+    return 0;
+  }
+  if (wstr.size() <= capacity && IsAscii(wstr)) {
+    CopyAscii(wstr, out);
+    return wstr.size();
+  }
+  int written = WideCharToMultiByte(CP_UTF8, 0, wstr.data(), static_cast<int>(wstr.size()), out,
+                                    static_cast<int>(capacity), nullptr, nullptr);
+  return written > 0 ? static_cast<size_t>(written) : 0;
+}
+
+size_t Utf8ToWide(std::string_view str, wchar_t *out, size_t capacity) {
+  if (str.empty()) {
+    return 0;
+  }
+  if (str.size() <= capacity && IsAscii(str)) {
+    CopyAscii(str, out);
+    return str.size();
+  }
+  int written =
+      MultiByteToWideChar(CP_UTF8, 0, str.data(), static_cast<int>(str.size()), out, static_cast<int>(capacity));
+  return written > 0 ? static_cast<size_t>(written) : 0;
+}
+
+std::string WideToAnsi(std::wstring_view wstr) {
+  if (wstr.empty()) {
+    return std::string();
+  }
+  // Sized and converted with the same length: sizing with -1 counted up to a terminator the view may not have
+  int size_needed = WideCharToMultiByte(CP_ACP, 0, wstr.data(), static_cast<int>(wstr.size()), nullptr, 0, nullptr,
+                                        nullptr);
+  std::string str(size_needed > 0 ? size_needed : 0, 0);
+  if (size_needed > 0) {
+    WideCharToMultiByte(CP_ACP, 0, wstr.data(), static_cast<int>(wstr.size()), str.data(), size_needed, nullptr,
+                        nullptr);
+  }
+  return str;
+}
+
+std::wstring AnsiToWide(std::string_view str) {
+  if (str.empty()) {
+    return std::wstring();
+  }
+  int size_needed = MultiByteToWideChar(CP_ACP, 0, str.data(), static_cast<int>(str.size()), nullptr, 0);
+  std::wstring wstr(size_needed > 0 ? size_needed : 0, 0);
+  if (size_needed > 0) {
+    MultiByteToWideChar(CP_ACP, 0, str.data(), static_cast<int>(str.size()), wstr.data(), size_needed);
+  }
+  return wstr;
+}
+
+}  // namespace wireguard_dart
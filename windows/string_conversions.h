@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace wireguard_dart {
+
+// Conversions between the wide strings of the Win32 API and the UTF-8 strings of Dart and spdlog. Text that is
+// all ASCII, like nearly every tunnel and adapter name, is copied unit by unit without calling Windows at all.
+
+// Each UTF-16 unit takes at most three UTF-8 bytes, and each UTF-8 byte at most one UTF-16 unit
+constexpr size_t kMaxUtf8PerWide = 3;
+
+std::string WideToUtf8(std::wstring_view wstr);
+
+std::wstring Utf8ToWide(std::string_view str);
+
+/**
+ * Convert into out, reusing its capacity, so a string kept across calls stops allocating once it is large enough
+ * @return false if the text could not be converted; out is then empty
+ */
+bool WideToUtf8(std::wstring_view wstr, std::string *out);
+
+bool Utf8ToWide(std::string_view str, std::wstring *out);
+
+/**
+ * Convert into caller-provided storage of capacity bytes, which takes wstr.size() * kMaxUtf8PerWide to always fit
+ * @return The bytes written, 0 if the text did not fit or could not be converted
+ */
+size_t WideToUtf8(std::wstring_view wstr, char *out, size_t capacity);
+
+// As above, the storage takes str.size() units to always fit
+size_t Utf8ToWide(std::string_view str, wchar_t *out, size_t capacity);
+
+std::string WideToAnsi(std::wstring_view wstr);
+
+std::wstring AnsiToWide(std::string_view str);
+
+/**
+ * A string converted into a buffer of the object itself when it holds no more than Inline units, and on the heap
+ * only when longer. Meant as a temporary for a single Win32 call or log line, e.g.
+ * `logger_->info("Adapter {}", WideAsUtf8(name_).view())`.
+ */
+template <typename From, typename To, size_t Inline> class StackConversion {
+public:
+  explicit StackConversion(std::basic_string_view<From> from) {
+    size_t needed = from.size() * (sizeof(From) == sizeof(wchar_t) ? kMaxUtf8PerWide : 1);
+    if (needed < Inline) {
+      size_ = Convert(from, inline_, Inline - 1);
+      inline_[size_] = 0;
+      data_ = inline_;
+    } else {
+      Convert(from, &heap_);
+      size_ = heap_.size();
+      data_ = heap_.c_str();
+    }
+  }
+
+  StackConversion(const StackConversion &) = delete;
+  StackConversion &operator=(const StackConversion &) = delete;
+
+  const To *c_str() const { return data_; }
+  size_t size() const { return size_; }
+  std::basic_string_view<To> view() const { return {data_, size_}; }
+
+private:
+  static size_t Convert(std::wstring_view from, char *out, size_t capacity) {
+    return WideToUtf8(from, out, capacity);
+  }
+  static size_t Convert(std::string_view from, wchar_t *out, size_t capacity) {
+    return Utf8ToWide(from, out, capacity);
+  }
+  static void Convert(std::wstring_view from, std::string *out) { WideToUtf8(from, out); }
+  static void Convert(std::string_view from, std::wstring *out) { Utf8ToWide(from, out); }
+
+  To inline_[Inline];
+  std::basic_string<To> heap_;
+  const To *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+using WideAsUtf8 = StackConversion<wchar_t, char, 256>;
+using Utf8AsWide = StackConversion<char, wchar_t, 128>;
+
+} // namespace wireguard_dart
@@ -0,0 +1,438 @@
+#include "structured_config.h"
+
+#include <winsock2.h>
+
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "config_export.h"
+#include "encodable_keys.h"
+#include "utils.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+// Shortest packed record, an IPv4 address with its family byte and prefix length
+constexpr size_t kMinPackedPrefixSize = 6;
+
+// Dart sends an int that does not fit 32 bits as a 64-bit one
+bool ReadInt(const flutter::EncodableValue *value, int64_t &out) {
+  if (const auto *value32 = std::get_if<int32_t>(value)) {
+    out = *value32;
+    return true;
+  }
+  if (const auto *value64 = std::get_if<int64_t>(value)) {
+    out = *value64;
+    return true;
+  }
+  return false;
+}
+
+// An optional unsigned setting no larger than max; false only if it is there and invalid
+template <typename T> bool ReadUnsigned(const flutter::EncodableValue *value, int64_t max, T &out, bool *present) {
+  *present = false;
+  if (!value) {
+    return true;
+  }
+  int64_t number;
+  if (!ReadInt(value, number) || number < 0 || number > max) {
+    return false;
+  }
+  out = static_cast<T>(number);
+  *present = true;
+  return true;
+}
+
+// An optional 32-byte key; false only if it is there and not 32 bytes
+bool ReadKey(const flutter::EncodableValue *value, BYTE *out, bool *present) {
+  *present = false;
+  if (!value) {
+    return true;
+  }
+  const auto *bytes = std::get_if<Bytes>(value);
+  if (!bytes || bytes->size() != WIREGUARD_KEY_LENGTH) {
+    return false;
+  }
+  memcpy(out, bytes->data(), WIREGUARD_KEY_LENGTH);
+  *present = true;
+  return true;
+}
+
+// Calls sink(family, prefix_length, address) for each packed record; with_prefix is false for bare addresses
+template <typename Sink> bool ReadPacked(const flutter::EncodableValue *value, bool with_prefix, Sink &&sink) {
+  if (!value) {
+    return true;
+  }
+  const auto *bytes = std::get_if<Bytes>(value);
+  if (!bytes) {
+    return false;
+  }
+  const uint8_t *pos = bytes->data();
+  const uint8_t *end = pos + bytes->size();
+  while (pos != end) {
+    size_t header = with_prefix ? 2 : 1;
+    if (static_cast<size_t>(end - pos) < header) {
+      return false;
+    }
+    ADDRESS_FAMILY family;
+    size_t address_size;
+    BYTE max_prefix;
+    if (pos[0] == 4) {
+      family = AF_INET;
+      address_size = sizeof(IN_ADDR);
+      max_prefix = 32;
+    } else if (pos[0] == 6) {
+      family = AF_INET6;
+      address_size = sizeof(IN6_ADDR);
+      max_prefix = 128;
+    } else {
+      return false;
+    }
+    BYTE prefix_length = with_prefix ? pos[1] : max_prefix;
+    if (prefix_length > max_prefix || static_cast<size_t>(end - pos) < header + address_size) {
+      return false;
+    }
+    sink(family, prefix_length, pos + header);
+    pos += header + address_size;
+  }
+  return true;
+}
+
+Bytes ToBytes(const void *data, size_t size) {
+  const auto *begin = static_cast<const uint8_t *>(data);
+  return Bytes(begin, begin + size);
+}
+
+WIREGUARD_ALLOWED_IP ToAllowedIP(ADDRESS_FAMILY family, BYTE prefix_length, const uint8_t *address) {
+  WIREGUARD_ALLOWED_IP allowed_ip = {};
+  allowed_ip.AddressFamily = family;
+  allowed_ip.Cidr = prefix_length;
+  memcpy(&allowed_ip.Address, address, family == AF_INET ? sizeof(IN_ADDR) : sizeof(IN6_ADDR));
+  return allowed_ip;
+}
+
+// A list of strings, appended to out; nothing if it was left out
+bool ReadStrings(const flutter::EncodableValue *value, std::vector<std::string> &out) {
+  if (!value) {
+    return true;
+  }
+  const auto *list = std::get_if<flutter::EncodableList>(value);
+  if (!list) {
+    return false;
+  }
+  for (const auto &item : *list) {
+    const auto *text = std::get_if<std::string>(&item);
+    if (!text) {
+      return false;
+    }
+    out.push_back(*text);
+  }
+  return true;
+}
+
+bool ReadInterface(const flutter::EncodableMap &config, WireguardConfigParser &parser, std::string *error) {
+  static const flutter::EncodableValue *const kInterfaceKeys[] = {
+      &keys::kPrivateKey, &keys::kPublicKey, &keys::kListenPort, &keys::kMtu,
+      &keys::kAddresses, &keys::kDnsServers, &keys::kDnsSearchDomains, &keys::kMetric,
+      &keys::kAutomaticMetric, &keys::kRouterDiscovery, &keys::kDadTransmits, &keys::kSplitDnsDomains,
+      &keys::kQosRules};
+  const flutter::EncodableValue *values[std::size(kInterfaceKeys)];
+  FindValues(config, kInterfaceKeys, values);
+
+  ParsedInterface &iface = parser.GetMutableInterface();
+  WIREGUARD_INTERFACE &wg_interface = parser.GetMutableConfiguration().Interface();
+  if (!ReadKey(values[0], wg_interface.PrivateKey, &iface.has_private_key)) {
+    *error = "privateKey must be 32 bytes";
+    return false;
+  }
+  if (!ReadKey(values[1], wg_interface.PublicKey, &iface.has_public_key)) {
+    *error = "publicKey must be 32 bytes";
+    return false;
+  }
+  if (!ReadUnsigned(values[2], 65535, iface.listen_port, &iface.has_listen_port)) {
+    *error = "listenPort must be a port number";
+    return false;
+  }
+
+  const auto *mtu_name = std::get_if<std::string>(values[3]);
+  bool has_mtu;
+  if (mtu_name && *mtu_name == "auto") {
+    iface.mtu_auto = true;
+  } else if (mtu_name || !ReadUnsigned(values[3], MAXDWORD, iface.mtu, &has_mtu)) {
+    *error = "mtu must be a number or \"auto\"";
+    return false;
+  }
+
+  bool addresses_valid = ReadPacked(values[4], true, [&iface](ADDRESS_FAMILY family, BYTE prefix_length,
+                                                               const uint8_t *address) {
+    iface.addresses.push_back(ToAllowedIP(family, prefix_length, address));
+  });
+  if (!addresses_valid) {
+    *error = "addresses must be packed prefixes";
+    return false;
+  }
+
+  bool dns_valid = ReadPacked(values[5], false, [&iface](ADDRESS_FAMILY family, BYTE, const uint8_t *address) {
+    SOCKADDR_INET server = {};
+    server.si_family = family;
+    if (family == AF_INET) {
+      memcpy(&server.Ipv4.sin_addr, address, sizeof(IN_ADDR));
+    } else {
+      memcpy(&server.Ipv6.sin6_addr, address, sizeof(IN6_ADDR));
+    }
+    iface.dns_servers.push_back(server);
+  });
+  if (!dns_valid) {
+    *error = "dnsServers must be packed addresses";
+    return false;
+  }
+
+  if (!ReadStrings(values[6], iface.dns_search_domains)) {
+    *error = "dnsSearchDomains must be a list of strings";
+    return false;
+  }
+  if (!ReadStrings(values[11], iface.dns_split_domains)) {
+    *error = "splitDnsDomains must be a list of strings";
+    return false;
+  }
+  std::vector<std::string> qos_rules;
+  bool qos_valid = ReadStrings(values[12], qos_rules);
+  for (size_t i = 0; qos_valid && i < qos_rules.size(); i++) {
+    iface.qos_rules.emplace_back();
+    qos_valid = WireguardConfigParser::ParseQosRule(qos_rules[i], iface.qos_rules.back());
+  }
+  if (!qos_valid) {
+    *error = "qosRules must be a list of QoS entries, as in the QoS key";
+    return false;
+  }
+
+  InterfaceProfile &profile = iface.profile;
+  if (!ReadUnsigned(values[7], MAXULONG, profile.metric, &profile.has_metric) ||
+      !ReadUnsigned(values[10], MAXULONG, profile.dad_transmits, &profile.has_dad_transmits)) {
+    *error = "metric and dadTransmits must be numbers";
+    return false;
+  }
+  if (const auto *automatic_metric = std::get_if<bool>(values[8])) {
+    profile.automatic_metric = *automatic_metric;
+    profile.has_automatic_metric = true;
+  }
+  if (const auto *router_discovery = std::get_if<bool>(values[9])) {
+    profile.router_discovery = *router_discovery;
+    profile.has_router_discovery = true;
+  }
+  return true;
+}
+
+bool ReadPeer(const flutter::EncodableMap &peer_map, WireguardConfigParser &parser, std::string *error) {
+  static const flutter::EncodableValue *const kPeerKeys[] = {&keys::kPublicKey, &keys::kPresharedKey,
+                                                             &keys::kPersistentKeepalive, &keys::kEndpoint,
+                                                             &keys::kEndpointPort, &keys::kAllowedIps,
+                                                             &keys::kProbeAddress};
+  const flutter::EncodableValue *values[std::size(kPeerKeys)];
+  FindValues(peer_map, kPeerKeys, values);
+
+  WireguardConfigBuffer &configuration = parser.GetMutableConfiguration();
+  WIREGUARD_PEER &peer = configuration.AppendPeer();
+  bool present;
+  if (!ReadKey(values[0], peer.PublicKey, &present) || !present) {
+    *error = "Every peer needs a publicKey of 32 bytes";
+    return false;
+  }
+  peer.Flags = WIREGUARD_PEER_HAS_PUBLIC_KEY;
+  if (!ReadKey(values[1], peer.PresharedKey, &present)) {
+    *error = "presharedKey must be 32 bytes";
+    return false;
+  }
+  if (present) {
+    peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | WIREGUARD_PEER_HAS_PRESHARED_KEY);
+  }
+  const auto *auto_keepalive = values[2] ? std::get_if<std::string>(values[2]) : nullptr;
+  if (auto_keepalive) {
+    if (!parser.AddAutoKeepalive(configuration.CurrentPeerOffset(), *auto_keepalive, peer)) {
+      *error = "persistentKeepalive must be a number of seconds, auto or auto:MIN-MAX";
+      return false;
+    }
+  } else if (!ReadUnsigned(values[2], 65535, peer.PersistentKeepalive, &present)) {
+    *error = "persistentKeepalive must be a number of seconds, auto or auto:MIN-MAX";
+    return false;
+  } else if (present) {
+    peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
+  }
+
+  if (values[3]) {
+    WORD port;
+    if (!ReadUnsigned(values[4], 65535, port, &present) || !present) {
+      *error = "An endpoint needs an endpointPort";
+      return false;
+    }
+    const auto *address = std::get_if<Bytes>(values[3]);
+    const auto *host = std::get_if<std::string>(values[3]);
+    if (address && address->size() == sizeof(IN_ADDR)) {
+      peer.Endpoint.Ipv4.sin_family = AF_INET;
+      peer.Endpoint.Ipv4.sin_port = htons(port);
+      memcpy(&peer.Endpoint.Ipv4.sin_addr, address->data(), sizeof(IN_ADDR));
+    } else if (address && address->size() == sizeof(IN6_ADDR)) {
+      peer.Endpoint.Ipv6.sin6_family = AF_INET6;
+      peer.Endpoint.Ipv6.sin6_port = htons(port);
+      memcpy(&peer.Endpoint.Ipv6.sin6_addr, address->data(), sizeof(IN6_ADDR));
+    } else if (!host || !parser.AddHostnameEndpoint(configuration.CurrentPeerOffset(), *host, port)) {
+      *error = "endpoint must be 4 or 16 address bytes or a hostname";
+      return false;
+    }
+    // A hostname is resolved by the adapter; the peer goes out without an endpoint until then
+    if (address) {
+      peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | WIREGUARD_PEER_HAS_ENDPOINT);
+    }
+  }
+
+  if (values[6]) {
+    const auto *address = std::get_if<Bytes>(values[6]);
+    SOCKADDR_INET probe = {};
+    if (address && address->size() == sizeof(IN_ADDR)) {
+      probe.si_family = AF_INET;
+      memcpy(&probe.Ipv4.sin_addr, address->data(), sizeof(IN_ADDR));
+    } else if (address && address->size() == sizeof(IN6_ADDR)) {
+      probe.si_family = AF_INET6;
+      memcpy(&probe.Ipv6.sin6_addr, address->data(), sizeof(IN6_ADDR));
+    } else {
+      *error = "probeAddress must be 4 or 16 address bytes";
+      return false;
+    }
+    parser.AddProbeAddress(configuration.CurrentPeerOffset(), probe);
+  }
+
+  // Appending may move the buffer, so peer is not used past here
+  bool allowed_ips_valid = ReadPacked(values[5], true, [&configuration](ADDRESS_FAMILY family,
+                                                                        BYTE prefix_length, const uint8_t *address) {
+    configuration.AppendAllowedIP(ToAllowedIP(family, prefix_length, address));
+  });
+  if (!allowed_ips_valid) {
+    *error = "allowedIps must be packed prefixes";
+    return false;
+  }
+  return true;
+}
+
+// Sized once up front from an upper bound on the allowed IPs, so the wire buffer is allocated only once
+void ReservePeers(const flutter::EncodableList &peers, WireguardConfigParser &parser) {
+  size_t size = sizeof(WIREGUARD_INTERFACE) + peers.size() * sizeof(WIREGUARD_PEER);
+  for (const auto &peer : peers) {
+    const auto *peer_map = std::get_if<flutter::EncodableMap>(&peer);
+    const auto *allowed_ips = peer_map ? ValueOrNull(*peer_map, keys::kAllowedIps) : nullptr;
+    if (const auto *bytes = allowed_ips ? std::get_if<Bytes>(allowed_ips) : nullptr) {
+      size += bytes->size() / kMinPackedPrefixSize * sizeof(WIREGUARD_ALLOWED_IP);
+    }
+  }
+  parser.GetMutableConfiguration().Reserve(size);
+}
+
+bool ReadPeers(const flutter::EncodableList &peers, WireguardConfigParser &parser, std::string *error) {
+  for (const auto &peer : peers) {
+    const auto *peer_map = std::get_if<flutter::EncodableMap>(&peer);
+    if (!peer_map) {
+      *error = "Every peer must be a map";
+      return false;
+    }
+    if (!ReadPeer(*peer_map, parser, error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool ParseStructuredConfig(const flutter::EncodableMap &config, WireguardConfigParser &parser, std::string *error) {
+  parser.BeginStructured();
+
+  const flutter::EncodableValue *peers_value = ValueOrNull(config, keys::kPeers);
+  const auto *peers = peers_value ? std::get_if<flutter::EncodableList>(peers_value) : nullptr;
+  if (peers_value && !peers) {
+    *error = "peers must be a list";
+    return false;
+  }
+  if (peers) {
+    ReservePeers(*peers, parser);
+  }
+
+  if (!ReadInterface(config, parser, error)) {
+    return false;
+  }
+  if (peers && !ReadPeers(*peers, parser, error)) {
+    return false;
+  }
+
+  parser.FinishStructured();
+  return true;
+}
+
+bool ParseStructuredPeers(const flutter::EncodableList &peers, WireguardConfigParser &parser, std::string *error) {
+  parser.BeginStructured();
+  ReservePeers(peers, parser);
+  if (!ReadPeers(peers, parser, error)) {
+    return false;
+  }
+  parser.FinishStructured();
+  return true;
+}
+
+flutter::EncodableMap ExportStructuredConfig(const BYTE *data, DWORD bytes, bool redact) {
+  flutter::EncodableMap config;
+  const WIREGUARD_INTERFACE *iface = DriverInterface(data, bytes);
+  if (!iface) {
+    return config;
+  }
+  if ((iface->Flags & WIREGUARD_INTERFACE_HAS_PRIVATE_KEY) && !redact) {
+    config[keys::kPrivateKey] = flutter::EncodableValue(ToBytes(iface->PrivateKey, WIREGUARD_KEY_LENGTH));
+  }
+  if (iface->Flags & WIREGUARD_INTERFACE_HAS_PUBLIC_KEY) {
+    config[keys::kPublicKey] = flutter::EncodableValue(ToBytes(iface->PublicKey, WIREGUARD_KEY_LENGTH));
+  }
+  if ((iface->Flags & WIREGUARD_INTERFACE_HAS_LISTEN_PORT) && iface->ListenPort != 0) {
+    config[keys::kListenPort] = flutter::EncodableValue(static_cast<int32_t>(iface->ListenPort));
+  }
+
+  flutter::EncodableList peers;
+  peers.reserve(iface->PeersCount);
+  ForEachDriverPeer(data, bytes, [&peers, redact](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips,
+                                            DWORD allowed_ip_count) {
+    flutter::EncodableMap value;
+    value[keys::kPublicKey] = flutter::EncodableValue(ToBytes(peer.PublicKey, WIREGUARD_KEY_LENGTH));
+    if ((peer.Flags & WIREGUARD_PEER_HAS_PRESHARED_KEY) && !IsZeroKey(peer.PresharedKey) && !redact) {
+      value[keys::kPresharedKey] = flutter::EncodableValue(ToBytes(peer.PresharedKey, WIREGUARD_KEY_LENGTH));
+    }
+    if ((peer.Flags & WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE) && peer.PersistentKeepalive != 0) {
+      value[keys::kPersistentKeepalive] = flutter::EncodableValue(static_cast<int32_t>(peer.PersistentKeepalive));
+    }
+    if (peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) {
+      const SOCKADDR_INET &endpoint = peer.Endpoint;
+      if (endpoint.si_family == AF_INET) {
+        value[keys::kEndpoint] = flutter::EncodableValue(ToBytes(&endpoint.Ipv4.sin_addr, sizeof(IN_ADDR)));
+        value[keys::kEndpointPort] = flutter::EncodableValue(static_cast<int32_t>(ntohs(endpoint.Ipv4.sin_port)));
+      } else if (endpoint.si_family == AF_INET6) {
+        value[keys::kEndpoint] = flutter::EncodableValue(ToBytes(&endpoint.Ipv6.sin6_addr, sizeof(IN6_ADDR)));
+        value[keys::kEndpointPort] = flutter::EncodableValue(static_cast<int32_t>(ntohs(endpoint.Ipv6.sin6_port)));
+      }
+    }
+    // Family byte, prefix length byte and address, back to back
+    Bytes packed;
+    packed.reserve(allowed_ip_count * (2 + sizeof(IN6_ADDR)));
+    for (DWORD i = 0; i < allowed_ip_count; i++) {
+      bool v4 = allowed_ips[i].AddressFamily == AF_INET;
+      packed.push_back(v4 ? 4 : 6);
+      packed.push_back(allowed_ips[i].Cidr);
+      const auto *address = reinterpret_cast<const uint8_t *>(&allowed_ips[i].Address);
+      packed.insert(packed.end(), address, address + (v4 ? sizeof(IN_ADDR) : sizeof(IN6_ADDR)));
+    }
+    value[keys::kAllowedIps] = flutter::EncodableValue(std::move(packed));
+    peers.emplace_back(std::move(value));
+  });
+  config[keys::kPeers] = flutter::EncodableValue(std::move(peers));
+  return config;
+}
+
+} // namespace wireguard_dart
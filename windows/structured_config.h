@@ -0,0 +1,42 @@
+#pragma once
+
+#include <flutter/encodable_value.h>
+
+#include <string>
+
+#include "wireguard_config_parser.h"
+
+namespace wireguard_dart {
+
+/**
+ * Fill parser with a configuration given as values by setupTunnelStructured. Keys, peers and allowed IPs are
+ * written straight into its wire buffer, with no text to format, tokenize or base64 decode on either side.
+ *
+ * config holds privateKey and publicKey (32 bytes), listenPort, mtu (an int or "auto"), addresses (packed
+ * prefixes), dnsServers (packed addresses), dnsSearchDomains and splitDnsDomains (strings), qosRules
+ * (strings, each an entry of the QoS key), metric, automaticMetric, routerDiscovery, dadTransmits and peers. Each peer
+ * is a map of publicKey and presharedKey (32 bytes), persistentKeepalive (an int, "auto" or "auto:MIN-MAX"),
+ * endpoint (4 or 16 address bytes, or a hostname) with endpointPort, allowedIps (packed prefixes) and probeAddress
+ * (4 or 16 address bytes). Everything but a peer's publicKey may be left out.
+ *
+ * Packed addresses are a family byte, 4 or 6, followed by 4 or 16 address bytes, back to back. Packed prefixes
+ * have a prefix length byte after the family byte.
+ *
+ * @return false, with error set, if config is malformed
+ */
+bool ParseStructuredConfig(const flutter::EncodableMap &config, WireguardConfigParser &parser, std::string *error);
+
+/**
+ * Fill parser with just peers, each a map as in the peers of ParseStructuredConfig, for addPeers. The interface
+ * is left empty.
+ * @return false, with error set, if a peer is malformed
+ */
+bool ParseStructuredPeers(const flutter::EncodableList &peers, WireguardConfigParser &parser, std::string *error);
+
+/**
+ * The configuration the driver runs, as WIREGUARD_GET_CONFIGURATION_FUNC reads it into data, as the values
+ * ParseStructuredConfig takes, for exportTunnelConfiguration; see ExportConfigurationText for what is left out
+ */
+flutter::EncodableMap ExportStructuredConfig(const BYTE *data, DWORD bytes, bool redact);
+
+} // namespace wireguard_dart
@@ -0,0 +1,244 @@
+#include "telemetry_exporter.h"
+
+#include <ws2tcpip.h>
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// Room for the longest header line a datagram can start with
+constexpr size_t kHeaderBytes = 96;
+
+} // namespace
+
+class TelemetryExporter::WarningSink : public spdlog::sinks::base_sink<std::mutex> {
+public:
+  WarningSink() { set_level(spdlog::level::off); }
+
+  // Hands over the lines of the records since the last call, and how many did not fit
+  uint64_t Take(std::vector<std::string> *lines) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lines->swap(lines_);
+    lines_.clear();
+    uint64_t dropped = dropped_;
+    dropped_ = 0;
+    return dropped;
+  }
+
+protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override {
+    if (lines_.size() >= kMaxPendingWarnings) {
+      dropped_++;
+      return;
+    }
+    auto level = spdlog::level::to_string_view(msg.level);
+    auto at_ms = std::chrono::duration_cast<std::chrono::milliseconds>(msg.time.time_since_epoch()).count();
+    std::string line = "!" + std::string(level.data(), level.size()) + " " + std::to_string(at_ms) + " ";
+    line.append(msg.payload.data(), msg.payload.size());
+    // One record, one line
+    std::replace(line.begin(), line.end(), '\n', ' ');
+    lines_.push_back(std::move(line));
+  }
+  void flush_() override {}
+
+private:
+  std::vector<std::string> lines_;
+  uint64_t dropped_ = 0;
+};
+
+TelemetryExporter::TelemetryExporter(Snapshot snapshot)
+    : snapshot_(std::move(snapshot)), warnings_(std::make_shared<WarningSink>()) {}
+
+TelemetryExporter::~TelemetryExporter() { Stop(); }
+
+bool TelemetryExporter::Start(const Options &options) {
+  thread_.Stop();
+  std::chrono::milliseconds interval = std::max(options.interval, kMinInterval);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CloseLocked();
+    options_ = options;
+    options_.interval = interval;
+    options_.max_datagrams = std::max(options.max_datagrams, uint32_t(1));
+    unresolved_logged_ = false;
+    batch_ = 0;
+    dropped_lines_ = 0;
+    last_values_.clear();
+  }
+  std::vector<std::string> stale;
+  warnings_->Take(&stale);
+  warnings_->set_level(options.min_level);
+  if (!thread_.Start(interval, interval / 10, [this]() { Tick(); })) {
+    warnings_->set_level(spdlog::level::off);
+    return false;
+  }
+  return true;
+}
+
+void TelemetryExporter::Stop() {
+  thread_.Stop();
+  warnings_->set_level(spdlog::level::off);
+  std::lock_guard<std::mutex> lock(mutex_);
+  CloseLocked();
+  last_values_.clear();
+}
+
+std::string TelemetryExporter::OpenMetricsFamilies() const {
+  static const char kDatagrams[] = "wireguard_dart_telemetry_datagrams";
+  std::string text;
+  text += std::string("# TYPE ") + kDatagrams + " counter\n";
+  text += std::string("# HELP ") + kDatagrams + " Telemetry datagrams, by whether they were sent, failed or were over "
+                                                "the limit of their interval.\n";
+  const std::pair<const char *, const std::atomic<uint64_t> *> results[] = {
+      {"sent", &sent_}, {"failed", &failed_}, {"limited", &limited_}};
+  for (const auto &result : results) {
+    uint64_t count = result.second->load(std::memory_order_relaxed);
+    if (count != 0) {
+      text += std::string(kDatagrams) + "_total{result=\"" + result.first + "\"} " + std::to_string(count) + "\n";
+    }
+  }
+  return text;
+}
+
+void TelemetryExporter::Tick() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> lines;
+  dropped_lines_ += warnings_->Take(&lines);
+  if (socket_ == INVALID_SOCKET && !ConnectLocked()) {
+    dropped_lines_ += lines.size();
+    return;
+  }
+
+  // Warnings first, so what the limit cuts off is samples, which the next full batch sends again
+  bool full = batch_ % kFullEvery == 0;
+  std::vector<std::string> samples = SampleLines(snapshot_(), full);
+  lines.insert(lines.end(), std::make_move_iterator(samples.begin()), std::make_move_iterator(samples.end()));
+
+  const size_t body_bytes = kMaxDatagramBytes - kHeaderBytes;
+  std::vector<std::string> bodies(1);
+  std::vector<size_t> body_lines(1, 0);
+  for (std::string &line : lines) {
+    if (line.size() + 1 > body_bytes) {
+      // Only a warning runs this long
+      line.resize(body_bytes - 1);
+    }
+    if (bodies.back().size() + line.size() + 1 > body_bytes) {
+      bodies.emplace_back();
+      body_lines.push_back(0);
+    }
+    bodies.back() += line;
+    bodies.back() += '\n';
+    body_lines.back()++;
+  }
+  // An empty delta still goes out as a header, which tells the collector the plugin is alive
+  size_t parts = std::min(bodies.size(), static_cast<size_t>(options_.max_datagrams));
+  for (size_t i = parts; i < bodies.size(); i++) {
+    dropped_lines_ += body_lines[i];
+    limited_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::string datagram;
+  datagram.reserve(kMaxDatagramBytes);
+  for (size_t i = 0; i < parts; i++) {
+    datagram = "wgd " + std::to_string(GetCurrentProcessId()) + " " + std::to_string(batch_) + " " +
+               std::to_string(i + 1) + "/" + std::to_string(parts) + (full ? " full " : " delta ") +
+               std::to_string(dropped_lines_) + "\n";
+    datagram += bodies[i];
+    if (send(socket_, datagram.data(), static_cast<int>(datagram.size()), 0) == SOCKET_ERROR) {
+      failed_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      sent_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  batch_++;
+}
+
+std::vector<std::string> TelemetryExporter::SampleLines(const std::string &metrics, bool full) {
+  std::vector<std::string> lines;
+  size_t start = 0;
+  while (start < metrics.size()) {
+    size_t end = metrics.find('\n', start);
+    if (end == std::string::npos) {
+      end = metrics.size();
+    }
+    if (end > start && metrics[start] != '#') {
+      std::string line = metrics.substr(start, end - start);
+      size_t space = line.rfind(' ');
+      if (space != std::string::npos) {
+        std::string &last = last_values_[line.substr(0, space)];
+        std::string value = line.substr(space + 1);
+        if (full || last != value) {
+          last = std::move(value);
+          lines.push_back(std::move(line));
+        }
+      }
+    }
+    start = end + 1;
+  }
+  return lines;
+}
+
+bool TelemetryExporter::ConnectLocked() {
+  if (!winsock_) {
+    WSADATA wsa_data;
+    int error = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+    if (error != 0) {
+      logger_->error("Failed to start Winsock for telemetry: Windows error {}", error);
+      return false;
+    }
+    winsock_ = true;
+  }
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_protocol = IPPROTO_UDP;
+  addrinfo *addresses = nullptr;
+  int error = getaddrinfo(options_.host.c_str(), std::to_string(options_.port).c_str(), &hints, &addresses);
+  for (addrinfo *address = error == 0 ? addresses : nullptr; address && socket_ == INVALID_SOCKET;
+       address = address->ai_next) {
+    SOCKET candidate = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (candidate == INVALID_SOCKET) {
+      error = WSAGetLastError();
+      continue;
+    }
+    // Connected, so each batch is sent without a route lookup per datagram
+    if (connect(candidate, address->ai_addr, static_cast<int>(address->ai_addrlen)) == SOCKET_ERROR) {
+      error = WSAGetLastError();
+      closesocket(candidate);
+      continue;
+    }
+    socket_ = candidate;
+  }
+  if (addresses) {
+    freeaddrinfo(addresses);
+  }
+  if (socket_ == INVALID_SOCKET) {
+    // Tried again every interval, but only logged once
+    if (!unresolved_logged_) {
+      logger_->warn("Failed to reach the telemetry collector {}:{}: Windows error {}", options_.host, options_.port,
+                    error);
+      unresolved_logged_ = true;
+    }
+    return false;
+  }
+  logger_->info("Exporting telemetry to {}:{} every {} ms", options_.host, options_.port, options_.interval.count());
+  return true;
+}
+
+void TelemetryExporter::CloseLocked() {
+  if (socket_ != INVALID_SOCKET) {
+    closesocket(socket_);
+    socket_ = INVALID_SOCKET;
+  }
+  if (winsock_) {
+    WSACleanup();
+    winsock_ = false;
+  }
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "background_threads.h"
+#include "plugin_logger.h"
+#include "spdlog/sinks/base_sink.h"
+
+namespace wireguard_dart {
+
+/**
+ * Ships the plugin's metrics and warnings to a collector over UDP, without the app in between. Every interval a
+ * thread of its own takes a getMetrics snapshot and the records the file logger logged at or above the minimum level
+ * since the last one, and sends them as datagrams of at most kMaxDatagramBytes, each a whole number of lines:
+ *
+ *   wgd <process id> <batch> <part>/<parts> <full|delta> <lines dropped so far>
+ *   wireguard_dart_call_latency_us_count{call="setConfiguration"} 12
+ *   !warn 1760512345678 Tunnel office is stale, failed over to tunnel office-backup
+ *
+ * Samples leave out the OpenMetrics comments, and a delta batch only the samples that changed since the batch
+ * before; every kFullEvery-th batch is full, so a collector that lost a datagram catches up. At most max_datagrams
+ * go out per interval, and warnings past kMaxPendingWarnings between two batches are dropped; both count in the
+ * header. Safe from any thread.
+ */
+class TelemetryExporter {
+public:
+  // Fits the minimum IPv6 MTU with its headers, so no datagram is fragmented
+  static constexpr size_t kMaxDatagramBytes = 1200;
+  static constexpr std::chrono::milliseconds kDefaultInterval{60000};
+  static constexpr std::chrono::milliseconds kMinInterval{1000};
+  static constexpr uint32_t kDefaultMaxDatagrams = 64;
+  static constexpr size_t kMaxPendingWarnings = 256;
+  static constexpr uint64_t kFullEvery = 10;
+
+  // The OpenMetrics text of getMetrics; called on the exporter's thread
+  using Snapshot = std::function<std::string()>;
+
+  struct Options {
+    std::string host;
+    uint16_t port = 0;
+    std::chrono::milliseconds interval = kDefaultInterval;
+    uint32_t max_datagrams = kDefaultMaxDatagrams;
+    spdlog::level::level_enum min_level = spdlog::level::warn;
+  };
+
+  explicit TelemetryExporter(Snapshot snapshot);
+  ~TelemetryExporter();
+
+  TelemetryExporter(const TelemetryExporter &) = delete;
+  TelemetryExporter &operator=(const TelemetryExporter &) = delete;
+
+  // Replaces an earlier export. The host is resolved on the exporter's thread, again each interval until it is.
+  bool Start(const Options &options);
+  // Returns once a batch in progress was sent
+  void Stop();
+
+  // For the sinks of the file logger; takes nothing while no export runs
+  spdlog::sink_ptr Sink() const { return warnings_; }
+
+  // The family wireguard_dart_telemetry_datagrams (counter), by result
+  std::string OpenMetricsFamilies() const;
+
+private:
+  class WarningSink;
+
+  void Tick();
+  bool ConnectLocked();
+  void CloseLocked();
+  // The sample lines to send, remembering their values for the next delta
+  std::vector<std::string> SampleLines(const std::string &metrics, bool full);
+
+  Snapshot snapshot_;
+  std::shared_ptr<WarningSink> warnings_;
+  PeriodicThread thread_{BackgroundThread::kTelemetry};
+  PluginLogger logger_;
+
+  // Set by Start while the thread is stopped, then only used by it
+  std::mutex mutex_;
+  Options options_;
+  SOCKET socket_ = INVALID_SOCKET;
+  bool winsock_ = false;
+  bool unresolved_logged_ = false;
+  uint64_t batch_ = 0;
+  uint64_t dropped_lines_ = 0;
+  std::unordered_map<std::string, std::string> last_values_;
+
+  std::atomic<uint64_t> sent_{0};
+  std::atomic<uint64_t> failed_{0};
+  std::atomic<uint64_t> limited_{0};
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,210 @@
+#include "text_scanner.h"
+
+#include <cstring>
+
+#if defined(_M_X64)
+#include <emmintrin.h>
+#include <intrin.h>
+#elif defined(_M_ARM64)
+#include <arm_neon.h>
+#include <intrin.h>
+#endif
+
+namespace wireguard_dart {
+
+namespace {
+
+inline size_t LowestBit(uint64_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return index;
+#else
+  return static_cast<size_t>(__builtin_ctzll(mask));
+#endif
+}
+
+BlockMasks ScanScalar(const char *block) {
+  BlockMasks masks;
+  for (size_t i = 0; i < kScanBlockSize; i++) {
+    uint64_t bit = uint64_t(1) << i;
+    switch (block[i]) {
+      case '\n':
+        masks.newlines |= bit;
+        break;
+      case '#':
+        masks.comments |= bit;
+        break;
+      case '=':
+        masks.equals |= bit;
+        break;
+      default:
+        break;
+    }
+  }
+  return masks;
+}
+
+#if defined(_M_X64)
+
+BlockMasks ScanSse2(const char *block) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i comment = _mm_set1_epi8('#');
+  const __m128i equals = _mm_set1_epi8('=');
+  BlockMasks masks;
+  for (size_t i = 0; i < kScanBlockSize; i += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i));
+    masks.newlines |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))) << i;
+    masks.comments |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comment)))) << i;
+    masks.equals |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, equals)))) << i;
+  }
+  return masks;
+}
+
+#elif defined(_M_ARM64)
+
+// NEON has no movemask: each lane keeps its own bit of a byte and pairwise adds fold 64 lanes into 64 bits
+inline uint64_t MoveMask(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2, uint8x16_t m3) {
+  static const uint8_t kBits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t bits = vld1q_u8(kBits);
+  uint8x16_t sum0 = vpaddq_u8(vandq_u8(m0, bits), vandq_u8(m1, bits));
+  uint8x16_t sum1 = vpaddq_u8(vandq_u8(m2, bits), vandq_u8(m3, bits));
+  sum0 = vpaddq_u8(sum0, sum1);
+  sum0 = vpaddq_u8(sum0, sum0);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+BlockMasks ScanNeon(const char *block) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(block);
+  uint8x16_t b0 = vld1q_u8(bytes);
+  uint8x16_t b1 = vld1q_u8(bytes + 16);
+  uint8x16_t b2 = vld1q_u8(bytes + 32);
+  uint8x16_t b3 = vld1q_u8(bytes + 48);
+  auto mask_of = [&](uint8_t c) {
+    uint8x16_t match = vdupq_n_u8(c);
+    return MoveMask(vceqq_u8(b0, match), vceqq_u8(b1, match), vceqq_u8(b2, match), vceqq_u8(b3, match));
+  };
+  BlockMasks masks;
+  masks.newlines = mask_of('\n');
+  masks.comments = mask_of('#');
+  masks.equals = mask_of('=');
+  return masks;
+}
+
+#endif
+
+} // namespace
+
+bool IsScanLevelSupported(ScanLevel level) {
+  switch (level) {
+    case ScanLevel::kScalar:
+      return true;
+#if defined(_M_X64)
+    case ScanLevel::kSse2:
+      return true;
+#elif defined(_M_ARM64)
+    case ScanLevel::kNeon:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+ScanLevel BestScanLevel() {
+  static const ScanLevel best = [] {
+    for (ScanLevel level : {ScanLevel::kNeon, ScanLevel::kSse2}) {
+      if (IsScanLevelSupported(level)) {
+        return level;
+      }
+    }
+    return ScanLevel::kScalar;
+  }();
+  return best;
+}
+
+const char *ScanLevelName(ScanLevel level) {
+  switch (level) {
+    case ScanLevel::kSse2:
+      return "sse2";
+    case ScanLevel::kNeon:
+      return "neon";
+    default:
+      return "scalar";
+  }
+}
+
+LineScanner::LineScanner(std::string_view text, ScanLevel level) : text_(text), scan_(&ScanScalar) {
+  if (!IsScanLevelSupported(level)) {
+    return;
+  }
+#if defined(_M_X64)
+  if (level == ScanLevel::kSse2) {
+    scan_ = &ScanSse2;
+  }
+#elif defined(_M_ARM64)
+  if (level == ScanLevel::kNeon) {
+    scan_ = &ScanNeon;
+  }
+#endif
+}
+
+bool LineScanner::Next(ScannedLine *line) {
+  if (pos_ >= text_.size()) {
+    return false;
+  }
+
+  size_t start = pos_;
+  size_t comment = std::string_view::npos;
+  size_t equals = std::string_view::npos;
+  while (true) {
+    // The masks only keep the bits from pos_ on, each line clears its own
+    if (masks_.newlines) {
+      uint64_t through = masks_.newlines ^ (masks_.newlines - 1);
+      if (comment == std::string_view::npos && (masks_.comments & through)) {
+        comment = block_ + LowestBit(masks_.comments) - start;
+      }
+      if (equals == std::string_view::npos && (masks_.equals & through)) {
+        equals = block_ + LowestBit(masks_.equals) - start;
+      }
+      size_t end = block_ + LowestBit(masks_.newlines);
+      masks_.newlines &= masks_.newlines - 1;
+      masks_.comments &= ~through;
+      masks_.equals &= ~through;
+      *line = {text_.substr(start, end - start), comment, equals, true};
+      pos_ = end + 1;
+      return true;
+    }
+
+    // The line goes on into the next block
+    if (comment == std::string_view::npos && masks_.comments) {
+      comment = block_ + LowestBit(masks_.comments) - start;
+    }
+    if (equals == std::string_view::npos && masks_.equals) {
+      equals = block_ + LowestBit(masks_.equals) - start;
+    }
+    size_t next = block_ == std::string_view::npos ? 0 : block_ + kScanBlockSize;
+    if (next >= text_.size()) {
+      break;
+    }
+    Load(next);
+  }
+
+  *line = {text_.substr(start), comment, equals, false};
+  pos_ = text_.size();
+  return true;
+}
+
+void LineScanner::Load(size_t base) {
+  block_ = base;
+  if (text_.size() - base >= kScanBlockSize) {
+    masks_ = scan_(text_.data() + base);
+    return;
+  }
+  // The last block is scanned from a zero-padded copy, so that nothing past the text is read or matched
+  char tail[kScanBlockSize] = {};
+  memcpy(tail, text_.data() + base, text_.size() - base);
+  masks_ = scan_(tail);
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace wireguard_dart {
+
+/**
+ * Instruction sets the scanner can use. BestScanLevel is picked once at runtime; the others are there for the
+ * benchmarks, and a level the processor lacks falls back to kScalar. A 64-byte block is four SSE2 compares per
+ * character, which AVX2 measured no faster on.
+ */
+enum class ScanLevel { kScalar, kSse2, kNeon };
+
+ScanLevel BestScanLevel();
+bool IsScanLevelSupported(ScanLevel level);
+const char *ScanLevelName(ScanLevel level);
+
+/**
+ * Bit i is set where byte i of a 64-byte block is the character
+ */
+struct BlockMasks {
+  uint64_t newlines = 0;
+  uint64_t comments = 0;
+  uint64_t equals = 0;
+};
+
+constexpr size_t kScanBlockSize = 64;
+
+/**
+ * A line of configuration text and where its delimiters are, as offsets into it
+ */
+struct ScannedLine {
+  std::string_view text;  // Without its '\n'
+  size_t comment = std::string_view::npos;  // The first '#'
+  size_t equals = std::string_view::npos;   // The first '='
+  bool terminated = false;  // False for a last line without '\n'
+};
+
+/**
+ * Splits text into lines, finding newlines, '#' and '=' a 64-byte block at a time instead of searching the text
+ * for each of them byte by byte. Does not copy the text, which has to outlive it.
+ */
+class LineScanner {
+public:
+  explicit LineScanner(std::string_view text, ScanLevel level = BestScanLevel());
+
+  // The next line, false once the text is used up
+  bool Next(ScannedLine *line);
+
+private:
+  using ScanBlock = BlockMasks (*)(const char *block);
+
+  // Masks of the block starting at base, which is a multiple of kScanBlockSize
+  void Load(size_t base);
+
+  std::string_view text_;
+  ScanBlock scan_;
+  size_t pos_ = 0;
+  size_t block_ = std::string_view::npos;
+  BlockMasks masks_;
+};
+
+} // namespace wireguard_dart
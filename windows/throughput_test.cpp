@@ -0,0 +1,326 @@
+#include "throughput_test.h"
+
+#include <mstcpip.h>
+#include <mswsock.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "plugin_logger.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int AddressLength(const SOCKADDR_INET &address) {
+  return address.si_family == AF_INET ? sizeof(SOCKADDR_IN) : sizeof(SOCKADDR_IN6);
+}
+
+// Send through the interface whatever the routes say, so that none of the test leaves outside the tunnel
+bool SetUnicastInterface(SOCKET socket, ADDRESS_FAMILY family, NET_IFINDEX index) {
+  if (family == AF_INET) {
+    // Only the IPv4 option takes it in network byte order
+    DWORD value = htonl(index);
+    return setsockopt(socket, IPPROTO_IP, IP_UNICAST_IF, reinterpret_cast<const char *>(&value), sizeof(value)) == 0;
+  }
+  DWORD value = index;
+  return setsockopt(socket, IPPROTO_IPV6, IPV6_UNICAST_IF, reinterpret_cast<const char *>(&value), sizeof(value)) ==
+         0;
+}
+
+LPFN_CONNECTEX LoadConnectEx(SOCKET socket) {
+  GUID guid = WSAID_CONNECTEX;
+  LPFN_CONNECTEX connect_ex = nullptr;
+  DWORD bytes;
+  if (WSAIoctl(socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &connect_ex, sizeof(connect_ex),
+               &bytes, nullptr, nullptr) != 0) {
+    return nullptr;
+  }
+  return connect_ex;
+}
+
+void AddTcpInfo(SOCKET socket, ThroughputTest::Result &result) {
+  DWORD version = 0;
+  TCP_INFO_v0 info = {};
+  DWORD bytes;
+  if (WSAIoctl(socket, SIO_TCP_INFO, &version, sizeof(version), &info, sizeof(info), &bytes, nullptr, nullptr) != 0) {
+    return;
+  }
+  result.mss = result.has_tcp_info ? std::min<uint32_t>(result.mss, info.Mss) : info.Mss;
+  result.has_tcp_info = true;
+  result.bytes_in_flight += info.BytesInFlight;
+  result.bytes_retransmitted += info.BytesRetrans;
+  result.fast_retransmits += info.FastRetrans;
+  result.timeout_episodes += info.TimeoutEpisodes;
+  result.rtt_us = std::max<uint32_t>(result.rtt_us, info.RttUs);
+}
+
+} // namespace
+
+struct ThroughputTest::Stream {
+  SOCKET socket = INVALID_SOCKET;
+  bool connected = false;
+  // Connecting or sending
+  bool active = false;
+};
+
+struct ThroughputTest::State {
+  State(IoReactor *reactor, const Options &options)
+      : reactor(reactor), options(options), streams(options.streams),
+        payload(options.protocol == Protocol::kTcp ? kSendSize : kDatagramSize) {}
+  ~State() {
+    if (winsock) {
+      WSACleanup();
+    }
+  }
+
+  IoReactor *reactor;
+  Options options;
+  bool winsock = false;
+  LPFN_CONNECTEX connect_ex = nullptr;
+
+  mutable std::mutex mutex;
+  bool stopped = false;
+  Clock::time_point started;
+  Clock::time_point deadline;
+  Clock::time_point last_sent;
+  std::vector<Stream> streams;
+  uint32_t active = 0;
+  // What every send hands over; only read, by all of them at once
+  std::vector<char> payload;
+  uint64_t bytes_sent = 0;
+  uint64_t send_errors = 0;
+  DWORD first_error = ERROR_SUCCESS;
+  // Once stopped
+  Result result;
+  PluginLogger logger;
+};
+
+ThroughputTest::ThroughputTest(IoReactor *reactor, const Options &options) {
+  Options clamped = options;
+  clamped.streams = std::clamp(options.streams, uint32_t(1), kMaxStreams);
+  clamped.duration = std::clamp(options.duration, std::chrono::milliseconds(1), kMaxDuration);
+  state_ = std::make_shared<State>(reactor, clamped);
+}
+
+ThroughputTest::~ThroughputTest() { Stop(); }
+
+bool ThroughputTest::Start() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  if (!state_->reactor->IsValid()) {
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return false;
+  }
+  WSADATA wsa_data;
+  int startup_error = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+  if (startup_error != 0) {
+    SetLastError(startup_error);
+    return false;
+  }
+  state_->winsock = true;
+
+  state_->started = Clock::now();
+  state_->deadline = state_->started + state_->options.duration;
+  state_->last_sent = state_->started;
+  DWORD error = ERROR_SUCCESS;
+  for (size_t index = 0; index < state_->streams.size(); index++) {
+    DWORD stream_error = OpenLocked(state_, index);
+    if (stream_error != ERROR_SUCCESS) {
+      error = stream_error;
+    }
+  }
+  if (state_->active == 0) {
+    SetLastError(error);
+    return false;
+  }
+  if (error != ERROR_SUCCESS) {
+    state_->logger->warn("Throughput test runs {} of its {} streams: Windows error {}", state_->active,
+                         state_->streams.size(), error);
+  }
+  return true;
+}
+
+DWORD ThroughputTest::OpenLocked(const std::shared_ptr<State> &state, size_t index) {
+  Stream &stream = state->streams[index];
+  const SOCKADDR_INET &target = state->options.target;
+  bool tcp = state->options.protocol == Protocol::kTcp;
+  stream.socket = WSASocketW(target.si_family, tcp ? SOCK_STREAM : SOCK_DGRAM, tcp ? IPPROTO_TCP : IPPROTO_UDP,
+                             nullptr, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_NO_HANDLE_INHERIT);
+  if (stream.socket == INVALID_SOCKET) {
+    return WSAGetLastError();
+  }
+  // Bound to no address in particular, the interface picks its own; ConnectEx needs the socket bound
+  SOCKADDR_INET local = {};
+  local.si_family = target.si_family;
+  if (!SetUnicastInterface(stream.socket, target.si_family, state->options.interface_index) ||
+      bind(stream.socket, reinterpret_cast<const sockaddr *>(&local), AddressLength(target)) != 0) {
+    return WSAGetLastError();
+  }
+  if (!state->reactor->Associate(reinterpret_cast<HANDLE>(stream.socket))) {
+    return GetLastError();
+  }
+
+  if (!tcp) {
+    // Connecting a datagram socket only sets where its sends go
+    if (connect(stream.socket, reinterpret_cast<const sockaddr *>(&target), AddressLength(target)) != 0) {
+      return WSAGetLastError();
+    }
+    stream.connected = true;
+    stream.active = true;
+    state->active++;
+    if (!SendLocked(state, index)) {
+      DWORD error = GetLastError();
+      EndLocked(*state, stream, error);
+      return error;
+    }
+    return ERROR_SUCCESS;
+  }
+
+  if (!state->connect_ex) {
+    state->connect_ex = LoadConnectEx(stream.socket);
+    if (!state->connect_ex) {
+      return WSAGetLastError();
+    }
+  }
+  SOCKET socket = stream.socket;
+  LPFN_CONNECTEX connect_ex = state->connect_ex;
+  bool started = state->reactor->StartIo(
+      [socket, connect_ex, &target](OVERLAPPED *overlapped) {
+        if (connect_ex(socket, reinterpret_cast<const sockaddr *>(&target), AddressLength(target), nullptr, 0,
+                       nullptr, overlapped)) {
+          return true;
+        }
+        int error = WSAGetLastError();
+        SetLastError(error);
+        return error == WSA_IO_PENDING;
+      },
+      [state, index](DWORD error, DWORD) { OnConnected(state, index, error); });
+  if (!started) {
+    return GetLastError();
+  }
+  stream.active = true;
+  state->active++;
+  return ERROR_SUCCESS;
+}
+
+bool ThroughputTest::SendLocked(const std::shared_ptr<State> &state, size_t index) {
+  SOCKET socket = state->streams[index].socket;
+  State *raw = state.get();
+  // A send completes as soon as the payload is in the socket's buffer, which does not keep it
+  return state->reactor->StartIo(
+      [socket, raw](OVERLAPPED *overlapped) {
+        WSABUF buffer = {static_cast<ULONG>(raw->payload.size()), raw->payload.data()};
+        if (WSASend(socket, &buffer, 1, nullptr, 0, overlapped, nullptr) == 0) {
+          return true;
+        }
+        int error = WSAGetLastError();
+        SetLastError(error);
+        return error == WSA_IO_PENDING;
+      },
+      [state, index](DWORD error, DWORD bytes) { OnSent(state, index, error, bytes); });
+}
+
+void ThroughputTest::EndLocked(State &state, Stream &stream, DWORD error) {
+  if (!stream.active) {
+    return;
+  }
+  stream.active = false;
+  state.active--;
+  if (error != ERROR_SUCCESS && state.first_error == ERROR_SUCCESS) {
+    state.first_error = error;
+  }
+}
+
+void ThroughputTest::OnConnected(const std::shared_ptr<State> &state, size_t index, DWORD error) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  if (state->stopped) {
+    return;
+  }
+  Stream &stream = state->streams[index];
+  // Without it the socket does not know it is connected, and SIO_TCP_INFO fails
+  if (error == ERROR_SUCCESS && setsockopt(stream.socket, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, nullptr, 0) != 0) {
+    error = WSAGetLastError();
+  }
+  if (error != ERROR_SUCCESS) {
+    state->logger->warn("Throughput test stream could not connect: Windows error {}", error);
+    EndLocked(*state, stream, error);
+    return;
+  }
+  stream.connected = true;
+  if (!SendLocked(state, index)) {
+    EndLocked(*state, stream, GetLastError());
+  }
+}
+
+void ThroughputTest::OnSent(const std::shared_ptr<State> &state, size_t index, DWORD error, DWORD bytes) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  if (state->stopped) {
+    return;
+  }
+  Stream &stream = state->streams[index];
+  state->bytes_sent += bytes;
+  state->last_sent = Clock::now();
+  if (error != ERROR_SUCCESS) {
+    // A broken connection stays broken, a datagram the endpoint refused or Windows had no room for does not
+    if (state->options.protocol == Protocol::kTcp) {
+      EndLocked(*state, stream, error);
+      return;
+    }
+    state->send_errors++;
+  }
+  if (state->last_sent >= state->deadline) {
+    EndLocked(*state, stream, ERROR_SUCCESS);
+    return;
+  }
+  if (!SendLocked(state, index)) {
+    EndLocked(*state, stream, GetLastError());
+  }
+}
+
+bool ThroughputTest::Finished() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->active == 0;
+}
+
+uint64_t ThroughputTest::BytesSent() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->bytes_sent;
+}
+
+ThroughputTest::Result ThroughputTest::Stop() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  Result &result = state_->result;
+  if (state_->stopped) {
+    return result;
+  }
+  state_->stopped = true;
+  result.error = state_->first_error;
+  result.elapsed_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(state_->last_sent - state_->started).count();
+  result.bytes_sent = state_->bytes_sent;
+  result.send_errors = state_->send_errors;
+  for (Stream &stream : state_->streams) {
+    if (stream.connected) {
+      result.streams_connected++;
+      if (state_->options.protocol == Protocol::kTcp) {
+        AddTcpInfo(stream.socket, result);
+      }
+    }
+    // The connects and sends in flight complete as cancelled and let go of the state
+    if (stream.socket != INVALID_SOCKET) {
+      closesocket(stream.socket);
+      stream.socket = INVALID_SOCKET;
+    }
+  }
+  // Stopped while the streams were still connecting
+  if (result.streams_connected == 0 && result.error == ERROR_SUCCESS) {
+    result.error = ERROR_TIMEOUT;
+  }
+  return result;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <winsock2.h>
+#include <ws2ipdef.h>
+#include <windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "io_reactor.h"
+
+namespace wireguard_dart {
+
+/**
+ * Sends as much as the tunnel takes to a cooperating endpoint for a while, to tell a slow link apart from a slow
+ * server or a poor MTU: parallel TCP streams, or UDP datagrams sent as fast as they go out. The endpoint only has
+ * to accept the connections, or the datagrams, and discard what it reads. The sockets are kept on the tunnel's
+ * interface with IP_UNICAST_IF and are overlapped on the reactor: each stream has one send in flight and issues
+ * the next from its completion, so no thread waits for the test.
+ */
+class ThroughputTest {
+public:
+  enum class Protocol { kTcp, kUdp };
+
+  static constexpr uint32_t kDefaultStreams = 4;
+  static constexpr uint32_t kMaxStreams = 16;
+  static constexpr std::chrono::milliseconds kDefaultDuration{10000};
+  static constexpr std::chrono::milliseconds kMaxDuration{60000};
+  // What one send of a TCP stream hands over
+  static constexpr DWORD kSendSize = 64 * 1024;
+  // Fits a tunnel of the IPv6 minimum MTU, so no datagram is fragmented
+  static constexpr DWORD kDatagramSize = 1200;
+  // How often runThroughputTest samples the tunnel's counters, as the statistics history does
+  static constexpr std::chrono::milliseconds kSampleInterval{1000};
+  // How long past its duration a test waits for streams that are still connecting
+  static constexpr std::chrono::milliseconds kConnectGrace{2000};
+
+  struct Options {
+    NET_IFINDEX interface_index = 0;
+    SOCKADDR_INET target = {};
+    Protocol protocol = Protocol::kTcp;
+    uint32_t streams = kDefaultStreams;
+    std::chrono::milliseconds duration = kDefaultDuration;
+  };
+
+  struct Result {
+    // ERROR_SUCCESS when every stream ran its time, else the first failure of one
+    DWORD error = ERROR_SUCCESS;
+    uint32_t streams_connected = 0;
+    // From the start until the last send completed
+    uint64_t elapsed_ms = 0;
+    // Handed to the sockets
+    uint64_t bytes_sent = 0;
+    // TCP only, summed over the streams from SIO_TCP_INFO as they were when the test stopped
+    bool has_tcp_info = false;
+    uint64_t bytes_in_flight = 0;
+    uint64_t bytes_retransmitted = 0;
+    uint32_t fast_retransmits = 0;
+    uint32_t timeout_episodes = 0;
+    // The largest smoothed round trip time and the smallest segment size of the streams
+    uint32_t rtt_us = 0;
+    uint32_t mss = 0;
+    // Sends that failed without ending their stream, as UDP ones do while the endpoint is not listening
+    uint64_t send_errors = 0;
+
+    // What the endpoint took, as far as it is known: for TCP less what was still unacknowledged
+    uint64_t BytesDelivered() const { return bytes_in_flight < bytes_sent ? bytes_sent - bytes_in_flight : 0; }
+    uint64_t GoodputBitsPerSecond() const { return elapsed_ms != 0 ? BytesDelivered() * 8000 / elapsed_ms : 0; }
+  };
+
+  // The reactor has to outlive the test
+  ThroughputTest(IoReactor *reactor, const Options &options);
+  ~ThroughputTest();
+
+  ThroughputTest(const ThroughputTest &) = delete;
+  ThroughputTest &operator=(const ThroughputTest &) = delete;
+
+  // Open the streams and start connecting them; false with GetLastError when none could be
+  bool Start();
+  // Every stream stopped, once its time was up or it failed
+  bool Finished() const;
+  // Handed to the sockets so far
+  uint64_t BytesSent() const;
+  // Close the streams, cancelling the sends in flight, and summarize; later calls return the same
+  Result Stop();
+
+private:
+  struct Stream;
+  struct State;
+
+  // With the state locked; ERROR_SUCCESS once the stream connects or, for UDP, sends
+  static DWORD OpenLocked(const std::shared_ptr<State> &state, size_t index);
+  static bool SendLocked(const std::shared_ptr<State> &state, size_t index);
+  static void EndLocked(State &state, Stream &stream, DWORD error);
+  // On a reactor thread
+  static void OnConnected(const std::shared_ptr<State> &state, size_t index, DWORD error);
+  static void OnSent(const std::shared_ptr<State> &state, size_t index, DWORD error, DWORD bytes);
+
+  // Shared with the completions, which may still run once the test is gone
+  std::shared_ptr<State> state_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,85 @@
+// Converts a statistics recording to CSV:
+//
+//   stats_recording_to_csv recording.wgsr [recording.csv]
+//
+// Without an output file the CSV goes to stdout. A record cut off at the end of the file is skipped.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "statistics_recorder.h"
+
+using wireguard_dart::kStatisticsRecordingMagic;
+using wireguard_dart::kStatisticsRecordingVersion;
+using wireguard_dart::StatisticsRecord;
+using wireguard_dart::StatisticsRecordingHeader;
+
+// Quoted when it holds a separator or quote, with its quotes doubled
+static std::string CsvField(const std::string &value) {
+  if (value.find_first_of(",\"\r\n") == std::string::npos) {
+    return value;
+  }
+  std::string quoted = "\"";
+  for (char c : value) {
+    quoted += c;
+    if (c == '"') {
+      quoted += '"';
+    }
+  }
+  return quoted + "\"";
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " <recording> [output.csv]" << std::endl;
+    return 2;
+  }
+
+  std::ifstream input(argv[1], std::ios::binary);
+  if (!input) {
+    std::cerr << "Cannot open " << argv[1] << std::endl;
+    return 1;
+  }
+  StatisticsRecordingHeader header;
+  if (!input.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, kStatisticsRecordingMagic, sizeof(header.magic)) != 0) {
+    std::cerr << argv[1] << " is not a statistics recording" << std::endl;
+    return 1;
+  }
+  if (header.version != kStatisticsRecordingVersion || header.record_size != sizeof(StatisticsRecord)) {
+    std::cerr << "Unsupported recording version " << header.version << " with records of " << header.record_size
+              << " bytes" << std::endl;
+    return 1;
+  }
+
+  std::ofstream file_output;
+  if (argc == 3) {
+    file_output.open(argv[2], std::ios::binary | std::ios::trunc);
+    if (!file_output) {
+      std::cerr << "Cannot create " << argv[2] << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &output = argc == 3 ? file_output : std::cout;
+
+  output << "time_ms,tunnel,rx_bytes,tx_bytes,last_handshake_ms,in_discards,out_discards,in_errors,out_errors\n";
+  StatisticsRecord record;
+  size_t count = 0;
+  while (input.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    std::string tunnel_name(record.tunnel_name, strnlen(record.tunnel_name, sizeof(record.tunnel_name)));
+    output << record.time_ms << ',' << CsvField(tunnel_name) << ',' << record.rx_bytes << ',' << record.tx_bytes
+           << ',' << record.last_handshake_ms << ',' << record.in_discards << ',' << record.out_discards << ','
+           << record.in_errors << ',' << record.out_errors << '\n';
+    count++;
+  }
+  output.flush();
+  if (!output) {
+    std::cerr << "Failed to write the CSV" << std::endl;
+    return 1;
+  }
+  std::cerr << count << " records" << std::endl;
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include "trace_events.h"
+
+#include <mutex>
+
+// 8ac93df4-e85f-5c13-bc10-cdee878b4a17, hashed from the name the way EventSource does, so that a session can enable
+// the provider as *WireguardDart
+TRACELOGGING_DEFINE_PROVIDER(g_wireguard_dart_trace_provider, "WireguardDart",
+                             (0x8ac93df4, 0xe85f, 0x5c13, 0xbc, 0x10, 0xcd, 0xee, 0x87, 0x8b, 0x4a, 0x17));
+
+namespace wireguard_dart {
+
+namespace {
+
+std::mutex registration_mutex;
+size_t registrations = 0;
+
+int64_t QueryCounter() {
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+}
+
+} // namespace
+
+void RegisterTraceProvider() {
+  std::lock_guard<std::mutex> lock(registration_mutex);
+  if (registrations++ == 0) {
+    TraceLoggingRegister(g_wireguard_dart_trace_provider);
+  }
+}
+
+void UnregisterTraceProvider() {
+  std::lock_guard<std::mutex> lock(registration_mutex);
+  if (registrations > 0 && --registrations == 0) {
+    TraceLoggingUnregister(g_wireguard_dart_trace_provider);
+  }
+}
+
+void TraceRegion::Start(int64_t items) {
+  EventActivityIdControl(EVENT_ACTIVITY_CTRL_CREATE_ID, &activity_id_);
+  start_qpc_ = QueryCounter();
+  TraceLoggingWriteActivity(g_wireguard_dart_trace_provider, "Region", &activity_id_, nullptr,
+                            TraceLoggingOpcode(WINEVENT_OPCODE_START), TraceLoggingString(name_, "Name"),
+                            TraceLoggingInt64(start_qpc_, "Qpc"), TraceLoggingInt64(items, "Items"));
+}
+
+void TraceRegion::Stop() {
+  int64_t stop_qpc = QueryCounter();
+  TraceLoggingWriteActivity(g_wireguard_dart_trace_provider, "Region", &activity_id_, nullptr,
+                            TraceLoggingOpcode(WINEVENT_OPCODE_STOP), TraceLoggingString(name_, "Name"),
+                            TraceLoggingInt64(stop_qpc, "Qpc"), TraceLoggingInt64(stop_qpc - start_qpc_, "Ticks"));
+}
+
+void TracePhase(const char *phase, int64_t duration_us) {
+  FlightRecorder::Instance().Record(FlightEvent::kPhase, phase, duration_us);
+  if (!TraceEnabled()) {
+    return;
+  }
+  TraceLoggingWrite(g_wireguard_dart_trace_provider, "Phase", TraceLoggingString(phase, "Name"),
+                    TraceLoggingInt64(QueryCounter(), "Qpc"), TraceLoggingInt64(duration_us, "DurationUs"));
+}
+
+} // namespace wireguard_dart
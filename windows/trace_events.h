@@ -0,0 +1,61 @@
+#pragma once
+
+#include <windows.h>
+
+#include <TraceLoggingProvider.h>
+
+#include <cstdint>
+
+#include "flight_recorder.h"
+
+// The WireguardDart TraceLogging provider, for recording the plugin's hot paths with WPR and reading them in WPA
+TRACELOGGING_DECLARE_PROVIDER(g_wireguard_dart_trace_provider);
+
+namespace wireguard_dart {
+
+// Counted, so a second plugin instance neither registers the provider twice nor unregisters it under the first
+void RegisterTraceProvider();
+void UnregisterTraceProvider();
+
+// Whether a trace session listens to the provider; one read of the provider's enabled level
+inline bool TraceEnabled() { return TraceLoggingProviderEnabled(g_wireguard_dart_trace_provider, 0, 0); }
+
+/**
+ * A start and a stop Region event around a scope, sharing an activity ID so that WPA pairs them, each with the
+ * performance counter it was written at and the stop one with the ticks in between. items is what the scope
+ * works through, like the routes of a route loop, or -1. When no session listens, the scope costs one check of
+ * the enabled level and one flight record on either end.
+ */
+class TraceRegion {
+public:
+  explicit TraceRegion(const char *name, int64_t items = -1) : name_(name) {
+    FlightRecorder::Instance().Record(FlightEvent::kRegionEnter, name, items);
+    if (TraceEnabled()) {
+      Start(items);
+    }
+  }
+  ~TraceRegion() {
+    if (start_qpc_ != 0) {
+      Stop();
+    }
+    FlightRecorder::Instance().Record(FlightEvent::kRegionExit, name_, 0);
+  }
+
+  TraceRegion(const TraceRegion &) = delete;
+  TraceRegion &operator=(const TraceRegion &) = delete;
+
+private:
+  void Start(int64_t items);
+  void Stop();
+
+  // A string literal, it is only written out when the events are
+  const char *name_;
+  // Zero unless the start event was written
+  int64_t start_qpc_ = 0;
+  GUID activity_id_;
+};
+
+// A Phase event and a flight record for a phase of a PhaseTimer that just ended, with its duration
+void TracePhase(const char *phase, int64_t duration_us);
+
+} // namespace wireguard_dart
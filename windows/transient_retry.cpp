@@ -0,0 +1,66 @@
+#include "transient_retry.h"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+
+#include "plugin_logger.h"
+#include "spdlog/spdlog.h"
+
+namespace wireguard_dart {
+
+bool IsTransientError(MeteredCall call, DWORD error) {
+  switch (error) {
+    case ERROR_BUSY:
+    case ERROR_RETRY:
+    case ERROR_NOT_READY:
+    case ERROR_DEVICE_NOT_AVAILABLE:
+    case ERROR_GEN_FAILURE:
+    case ERROR_SEM_TIMEOUT:
+    case ERROR_TIMEOUT:
+    case WAIT_TIMEOUT:
+    case ERROR_SHARING_VIOLATION:
+    case ERROR_LOCK_VIOLATION:
+    case ERROR_NO_SYSTEM_RESOURCES:
+      return true;
+    case ERROR_NOT_FOUND:
+    case ERROR_FILE_NOT_FOUND:
+      // The interface of a new adapter shows up in the IP stack a little after the adapter. Not for
+      // GetIpInterfaceEntry, which also answers it for good for a family that is disabled.
+      switch (call) {
+        case MeteredCall::kSetIpInterfaceEntry:
+        case MeteredCall::kCreateUnicastIpAddressEntry:
+        case MeteredCall::kCreateIpForwardEntry2:
+          return true;
+        default:
+          return false;
+      }
+    default:
+      return false;
+  }
+}
+
+std::chrono::milliseconds RetryDelay(const RetryPolicy &policy, int retry) {
+  std::chrono::milliseconds delay = policy.first_delay;
+  for (int i = 0; i < retry && delay < policy.max_delay; i++) {
+    delay *= 2;
+  }
+  delay = (std::min)(delay, policy.max_delay);
+  if (delay.count() < 2) {
+    return delay;
+  }
+  thread_local std::minstd_rand random(std::random_device{}());
+  std::uniform_int_distribution<std::chrono::milliseconds::rep> jitter(delay.count() / 2, delay.count());
+  return std::chrono::milliseconds(jitter(random));
+}
+
+void WaitBeforeRetry(MeteredCall call, DWORD error, int attempt, const RetryPolicy &policy) {
+  CallMetrics::Instance().RecordRetry(call);
+  std::chrono::milliseconds delay = RetryDelay(policy, attempt - 1);
+  PluginLogger logger;
+  logger->warn("{} failed with transient Windows error {}, attempt {} of {}, retrying in {} ms", MeteredCallName(call),
+               error, attempt, policy.attempts, delay.count());
+  std::this_thread::sleep_for(delay);
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <windows.h>
+
+#include <chrono>
+
+#include "call_metrics.h"
+#include "operation_counters.h"
+
+namespace wireguard_dart {
+
+/**
+ * Whether a Win32 error of the call may go away if the same call is made again shortly, such as the driver being
+ * busy, or, right after an adapter was created, its IP interface not being up in the stack yet. Errors about the
+ * arguments, access or the object already existing are permanent: retrying cannot change them.
+ */
+bool IsTransientError(MeteredCall call, DWORD error);
+
+// How a single step is retried: up to attempts calls, waiting between them from first_delay, doubled each time
+// up to max_delay, with jitter
+struct RetryPolicy {
+  int attempts = 4;
+  std::chrono::milliseconds first_delay{20};
+  std::chrono::milliseconds max_delay{250};
+};
+
+// The wait before retry number retry, from 0: the doubled delay with jitter down to half of it, so adapters set up
+// in parallel do not retry in step
+std::chrono::milliseconds RetryDelay(const RetryPolicy &policy, int retry);
+
+// Log and count the transient error of attempt, then wait for RetryDelay; the error is already taken
+void WaitBeforeRetry(MeteredCall call, DWORD error, int attempt, const RetryPolicy &policy);
+
+/**
+ * Make the call until it succeeds, fails with a permanent error or the policy's attempts ran out, and return its
+ * last error, ERROR_SUCCESS on success. attempt returns the call's Win32 error, taken right where it failed with
+ * GetLastError for the calls that set it, before anything else could overwrite it. Only this one step is made
+ * again, not the setup around it.
+ */
+template <typename Attempt>
+DWORD RetryTransient(MeteredCall call, const Attempt &attempt, const RetryPolicy &policy = RetryPolicy()) {
+  for (int i = 1;; i++) {
+    DWORD error = attempt();
+    if (error == ERROR_SUCCESS || i >= policy.attempts || !IsTransientError(call, error)) {
+      OperationCounters::Instance().CountCall(call, error);
+      return error;
+    }
+    WaitBeforeRetry(call, error, i, policy);
+  }
+}
+
+} // namespace wireguard_dart
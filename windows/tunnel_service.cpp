@@ -0,0 +1,343 @@
+#include "tunnel_service.h"
+
+#include <sddl.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+#include "string_conversions.h"
+
+namespace wireguard_dart {
+
+namespace tunnel_service {
+
+namespace {
+
+// The prefix WireGuardTunnelService expects, it derives the tunnel name from the service name
+constexpr wchar_t kServicePrefix[] = L"WireGuardTunnel$";
+constexpr wchar_t kHostExecutable[] = L"wireguard_dart_service.exe";
+constexpr wchar_t kHostLibrary[] = L"tunnel.dll";
+// Full control for SYSTEM and administrators only, inherited by the configurations
+constexpr wchar_t kDirectorySddl[] = L"O:SYD:P(A;OICI;FA;;;SY)(A;OICI;FA;;;BA)";
+// The same for the service host, which everyone else may read and run but not replace
+constexpr wchar_t kHostDirectorySddl[] = L"O:SYD:P(A;OICI;FA;;;SY)(A;OICI;FA;;;BA)(A;OICI;GRGX;;;BU)";
+
+struct ServiceHandleDeleter {
+  void operator()(SC_HANDLE handle) const { CloseServiceHandle(handle); }
+};
+using ServiceHandle = std::unique_ptr<std::remove_pointer_t<SC_HANDLE>, ServiceHandleDeleter>;
+
+std::wstring ServiceName(const std::string &tunnel_name) { return kServicePrefix + Utf8ToWide(tunnel_name); }
+
+std::wstring KnownDirectory(const wchar_t *variable, const wchar_t *fallback) {
+  wchar_t directory[MAX_PATH];
+  DWORD length = GetEnvironmentVariableW(variable, directory, MAX_PATH);
+  return length > 0 && length < MAX_PATH ? std::wstring(directory, length) : fallback;
+}
+
+std::wstring ConfigDirectory() {
+  return KnownDirectory(L"ProgramData", L"C:\\ProgramData") + L"\\wireguard_dart\\tunnels";
+}
+
+std::wstring ConfigPath(const std::string &tunnel_name) {
+  return ConfigDirectory() + L"\\" + Utf8ToWide(tunnel_name) + L".conf";
+}
+
+// Where the app executable is, and the bundled service host and libraries with it
+std::wstring AppDirectory() {
+  wchar_t module_path[MAX_PATH];
+  DWORD length = GetModuleFileNameW(nullptr, module_path, MAX_PATH);
+  std::wstring path(module_path, length);
+  auto separator = path.find_last_of(L'\\');
+  return separator == std::wstring::npos ? std::wstring() : path.substr(0, separator);
+}
+
+// The services run as LocalSystem, so not from the app directory, which its user may write to: they run a copy in
+// a directory of Program Files only administrators can change
+std::wstring HostDirectory() {
+  return KnownDirectory(L"ProgramFiles", L"C:\\Program Files") + L"\\wireguard_dart";
+}
+
+std::wstring HostPath() { return HostDirectory() + L"\\" + kHostExecutable; }
+
+// The directory, and its parent without a descriptor of its own, with the descriptor of sddl if it is created
+DWORD CreateProtectedDirectory(const std::wstring &directory, const wchar_t *sddl) {
+  std::wstring parent = directory.substr(0, directory.find_last_of(L'\\'));
+  if (!CreateDirectoryW(parent.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS) {
+    return GetLastError();
+  }
+
+  SECURITY_ATTRIBUTES attributes = {sizeof(attributes)};
+  if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl, SDDL_REVISION_1, &attributes.lpSecurityDescriptor,
+                                                            nullptr)) {
+    return GetLastError();
+  }
+  DWORD error = ERROR_SUCCESS;
+  if (!CreateDirectoryW(directory.c_str(), &attributes) && GetLastError() != ERROR_ALREADY_EXISTS) {
+    error = GetLastError();
+  }
+  LocalFree(attributes.lpSecurityDescriptor);
+  return error;
+}
+
+// Copies the bundled service host and tunnel.dll to HostDirectory, where they inherit its descriptor
+DWORD CopyHost() {
+  std::wstring host_directory = HostDirectory();
+  DWORD error = CreateProtectedDirectory(host_directory, kHostDirectorySddl);
+  if (error != ERROR_SUCCESS) {
+    return error;
+  }
+  std::wstring app_directory = AppDirectory();
+  for (const wchar_t *file : {kHostExecutable, kHostLibrary}) {
+    std::wstring target = host_directory + L"\\" + file;
+    if (!CopyFileW((app_directory + L"\\" + file).c_str(), target.c_str(), FALSE)) {
+      error = GetLastError();
+      // Run by the service of another tunnel, which keeps the copy it started with
+      bool in_use = error == ERROR_SHARING_VIOLATION || error == ERROR_USER_MAPPED_FILE;
+      if (!in_use || GetFileAttributesW(target.c_str()) == INVALID_FILE_ATTRIBUTES) {
+        return error;
+      }
+    }
+  }
+  return ERROR_SUCCESS;
+}
+
+// Once the last tunnel service is gone; files still in use by a service being deleted stay
+void RemoveHost() {
+  std::wstring host_directory = HostDirectory();
+  for (const wchar_t *file : {kHostExecutable, kHostLibrary}) {
+    DeleteFileW((host_directory + L"\\" + file).c_str());
+  }
+  RemoveDirectoryW(host_directory.c_str());
+}
+
+DWORD WriteConfig(const std::string &tunnel_name, std::string_view config) {
+  DWORD error = CreateProtectedDirectory(ConfigDirectory(), kDirectorySddl);
+  if (error != ERROR_SUCCESS) {
+    return error;
+  }
+  HANDLE file = CreateFileW(ConfigPath(tunnel_name).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return GetLastError();
+  }
+  DWORD written = 0;
+  if (!WriteFile(file, config.data(), static_cast<DWORD>(config.size()), &written, nullptr)) {
+    error = GetLastError();
+  } else if (written != config.size()) {
+    error = ERROR_WRITE_FAULT;
+  }
+  CloseHandle(file);
+  return error;
+}
+
+ServiceHandle OpenTunnelService(const std::string &tunnel_name, DWORD access) {
+  ServiceHandle manager(OpenSCManagerW(nullptr, nullptr, SC_MANAGER_CONNECT));
+  if (!manager) {
+    return nullptr;
+  }
+  ServiceHandle service(OpenServiceW(manager.get(), ServiceName(tunnel_name).c_str(), access));
+  // The caller reads why OpenServiceW failed, closing the manager must not overwrite it
+  DWORD error = GetLastError();
+  manager.reset();
+  SetLastError(error);
+  return service;
+}
+
+// ERROR_IO_PENDING while the service has not left the pending state, ERROR_SUCCESS if it ended up in target
+DWORD StateOf(SC_HANDLE service, DWORD target) {
+  SERVICE_STATUS_PROCESS status;
+  DWORD size;
+  if (!QueryServiceStatusEx(service, SC_STATUS_PROCESS_INFO, reinterpret_cast<BYTE *>(&status), sizeof(status),
+                            &size)) {
+    return GetLastError();
+  }
+  if (status.dwCurrentState == target) {
+    return ERROR_SUCCESS;
+  }
+  if (status.dwCurrentState == SERVICE_STOPPED) {
+    // A tunnel that failed to come up stops with the reason as its exit code
+    return status.dwWin32ExitCode == ERROR_SERVICE_SPECIFIC_ERROR ? status.dwServiceSpecificExitCode
+           : status.dwWin32ExitCode != ERROR_SUCCESS               ? status.dwWin32ExitCode
+                                                                   : ERROR_SERVICE_NOT_ACTIVE;
+  }
+  return ERROR_IO_PENDING;
+}
+
+// Polls until the service leaves the pending state, ERROR_SUCCESS if it ended up in target
+DWORD WaitForState(SC_HANDLE service, DWORD target) {
+  auto deadline = std::chrono::steady_clock::now() + kStateTimeout;
+  while (true) {
+    DWORD state = StateOf(service, target);
+    if (state != ERROR_IO_PENDING) {
+      return state;
+    }
+    if (std::chrono::steady_clock::now() > deadline) {
+      return ERROR_SERVICE_REQUEST_TIMEOUT;
+    }
+    std::this_thread::sleep_for(kStatePollInterval);
+  }
+}
+
+DWORD RequestStartOf(SC_HANDLE service) {
+  if (!StartServiceW(service, 0, nullptr) && GetLastError() != ERROR_SERVICE_ALREADY_RUNNING) {
+    return GetLastError();
+  }
+  return ERROR_SUCCESS;
+}
+
+// ERROR_SERVICE_NOT_ACTIVE when it is stopped already
+DWORD RequestStopOf(SC_HANDLE service) {
+  SERVICE_STATUS status;
+  return ControlService(service, SERVICE_CONTROL_STOP, &status) ? ERROR_SUCCESS : GetLastError();
+}
+
+DWORD StartAndWait(SC_HANDLE service) {
+  DWORD error = RequestStartOf(service);
+  return error != ERROR_SUCCESS ? error : WaitForState(service, SERVICE_RUNNING);
+}
+
+DWORD StopAndWait(SC_HANDLE service) {
+  DWORD error = RequestStopOf(service);
+  if (error != ERROR_SUCCESS) {
+    return error == ERROR_SERVICE_NOT_ACTIVE ? ERROR_SUCCESS : error;
+  }
+  return WaitForState(service, SERVICE_STOPPED);
+}
+
+} // namespace
+
+DWORD Install(const std::string &tunnel_name, std::string_view config) {
+  ServiceHandle manager(OpenSCManagerW(nullptr, nullptr, SC_MANAGER_ALL_ACCESS));
+  if (!manager) {
+    return GetLastError();
+  }
+  std::wstring service_name = ServiceName(tunnel_name);
+  std::wstring command_line = L"\"" + HostPath() + L"\" /service \"" + ConfigPath(tunnel_name) + L"\"";
+  // A running tunnel reads its configuration only when it starts
+  ServiceHandle service(OpenServiceW(manager.get(), service_name.c_str(), SERVICE_ALL_ACCESS));
+  if (service) {
+    DWORD error = StopAndWait(service.get());
+    if (error != ERROR_SUCCESS) {
+      return error;
+    }
+  }
+
+  DWORD error = CopyHost();
+  if (error != ERROR_SUCCESS) {
+    return error;
+  }
+  error = WriteConfig(tunnel_name, config);
+  if (error != ERROR_SUCCESS) {
+    return error;
+  }
+
+  // The dependencies are those of the WireGuard client's tunnel services
+  const wchar_t *dependencies = L"Nsi\0TcpIp\0";
+  std::wstring display_name = L"WireGuard Tunnel: " + Utf8ToWide(tunnel_name);
+  if (service) {
+    // The service may have been installed by a version that ran the host from the app directory
+    if (!ChangeServiceConfigW(service.get(), SERVICE_WIN32_OWN_PROCESS, SERVICE_AUTO_START, SERVICE_ERROR_NORMAL,
+                              command_line.c_str(), nullptr, nullptr, dependencies, nullptr, nullptr,
+                              display_name.c_str())) {
+      return GetLastError();
+    }
+  } else {
+    service.reset(CreateServiceW(manager.get(), service_name.c_str(), display_name.c_str(), SERVICE_ALL_ACCESS,
+                                 SERVICE_WIN32_OWN_PROCESS, SERVICE_AUTO_START, SERVICE_ERROR_NORMAL,
+                                 command_line.c_str(), nullptr, nullptr, dependencies, nullptr, nullptr));
+    if (!service) {
+      return GetLastError();
+    }
+  }
+
+  // WireGuardTunnelService restricts its own privileges, which needs a service SID
+  SERVICE_SID_INFO sid_info = {SERVICE_SID_TYPE_UNRESTRICTED};
+  if (!ChangeServiceConfig2W(service.get(), SERVICE_CONFIG_SERVICE_SID_INFO, &sid_info)) {
+    return GetLastError();
+  }
+  return StartAndWait(service.get());
+}
+
+DWORD Remove(const std::string &tunnel_name) {
+  ServiceHandle service = OpenTunnelService(tunnel_name, SERVICE_STOP | SERVICE_QUERY_STATUS | DELETE);
+  if (!service && GetLastError() != ERROR_SERVICE_DOES_NOT_EXIST) {
+    return GetLastError();
+  }
+  if (service) {
+    DWORD error = StopAndWait(service.get());
+    if (error != ERROR_SUCCESS) {
+      return error;
+    }
+    if (!DeleteService(service.get()) && GetLastError() != ERROR_SERVICE_MARKED_FOR_DELETE) {
+      return GetLastError();
+    }
+  }
+  if (!DeleteFileW(ConfigPath(tunnel_name).c_str()) && GetLastError() != ERROR_FILE_NOT_FOUND) {
+    return GetLastError();
+  }
+  if (InstalledTunnels().empty()) {
+    RemoveHost();
+  }
+  return ERROR_SUCCESS;
+}
+
+DWORD Start(const std::string &tunnel_name) {
+  ServiceHandle service = OpenTunnelService(tunnel_name, SERVICE_START | SERVICE_QUERY_STATUS);
+  return service ? StartAndWait(service.get()) : GetLastError();
+}
+
+DWORD Stop(const std::string &tunnel_name) {
+  ServiceHandle service = OpenTunnelService(tunnel_name, SERVICE_STOP | SERVICE_QUERY_STATUS);
+  return service ? StopAndWait(service.get()) : GetLastError();
+}
+
+DWORD RequestStart(const std::string &tunnel_name) {
+  ServiceHandle service = OpenTunnelService(tunnel_name, SERVICE_START);
+  return service ? RequestStartOf(service.get()) : GetLastError();
+}
+
+DWORD RequestStop(const std::string &tunnel_name) {
+  ServiceHandle service = OpenTunnelService(tunnel_name, SERVICE_STOP);
+  if (!service) {
+    return GetLastError();
+  }
+  DWORD error = RequestStopOf(service.get());
+  return error == ERROR_SERVICE_NOT_ACTIVE ? ERROR_SUCCESS : error;
+}
+
+DWORD CheckState(const std::string &tunnel_name, DWORD target) {
+  ServiceHandle service = OpenTunnelService(tunnel_name, SERVICE_QUERY_STATUS);
+  return service ? StateOf(service.get(), target) : GetLastError();
+}
+
+bool IsInstalled(const std::string &tunnel_name) {
+  return OpenTunnelService(tunnel_name, SERVICE_QUERY_STATUS) != nullptr;
+}
+
+bool IsRunning(const std::string &tunnel_name) {
+  ServiceHandle service = OpenTunnelService(tunnel_name, SERVICE_QUERY_STATUS);
+  SERVICE_STATUS status;
+  return service && QueryServiceStatus(service.get(), &status) && status.dwCurrentState == SERVICE_RUNNING;
+}
+
+std::vector<std::string> InstalledTunnels() {
+  std::vector<std::string> names;
+  WIN32_FIND_DATAW entry;
+  HANDLE find = FindFirstFileW((ConfigDirectory() + L"\\*.conf").c_str(), &entry);
+  if (find == INVALID_HANDLE_VALUE) {
+    return names;
+  }
+  do {
+    std::wstring file_name = entry.cFileName;
+    names.push_back(WideToUtf8(file_name.substr(0, file_name.size() - 5)));
+  } while (FindNextFileW(find, &entry));
+  FindClose(find);
+  return names;
+}
+
+} // namespace tunnel_service
+
+} // namespace wireguard_dart
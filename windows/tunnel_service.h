@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wireguard_dart {
+
+/**
+ * Tunnels run by a Windows service of their own instead of by the app, the way the WireGuard client runs them:
+ * the service WireGuardTunnel$<name> starts wireguard_dart_service.exe, which hands <name>.conf to
+ * WireGuardTunnelService of tunnel.dll. The service starts with Windows, so the tunnel is up before the app is,
+ * and stays up after it exits. It runs as LocalSystem, so Install copies both from the app directory, which its
+ * user may be able to write to, to %ProgramFiles%\wireguard_dart, which only administrators can change, and the
+ * service runs them from there; removing the last tunnel removes them again.
+ *
+ * The app reads the counters of a service's tunnel from the driver, over an adapter handle it opens once and
+ * reopens if the service restarts; tunnel.dll serves no UAPI pipe to ask instead.
+ *
+ * The configurations are kept in %ProgramData%\wireguard_dart\tunnels, which only SYSTEM and administrators can
+ * read, as they hold the private key. Every call needs an elevated app and returns a Windows error code.
+ */
+namespace tunnel_service {
+
+// Bringing a tunnel up includes creating its adapter, which can take a few seconds on a busy machine
+constexpr std::chrono::milliseconds kStateTimeout{30000};
+// How often the state of a starting or stopping service is asked for
+constexpr std::chrono::milliseconds kStatePollInterval{100};
+
+// Writes the configuration, creates the service or points an existing one at this app, and starts it
+DWORD Install(const std::string &tunnel_name, std::string_view config);
+// Stops and deletes the service and its configuration; ERROR_SUCCESS if it is not installed
+DWORD Remove(const std::string &tunnel_name);
+// Starting or stopping, waiting until the service got there
+DWORD Start(const std::string &tunnel_name);
+DWORD Stop(const std::string &tunnel_name);
+// Starting or stopping without waiting, for callers that poll CheckState without holding a thread
+DWORD RequestStart(const std::string &tunnel_name);
+DWORD RequestStop(const std::string &tunnel_name);
+// ERROR_IO_PENDING while the service is on its way, ERROR_SUCCESS once it is in target, or why it stopped instead
+DWORD CheckState(const std::string &tunnel_name, DWORD target);
+
+bool IsInstalled(const std::string &tunnel_name);
+bool IsRunning(const std::string &tunnel_name);
+// The names of the tunnels with a configuration in the directory
+std::vector<std::string> InstalledTunnels();
+
+} // namespace tunnel_service
+
+} // namespace wireguard_dart
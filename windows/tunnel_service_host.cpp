@@ -0,0 +1,27 @@
+// wireguard_dart_service.exe, the program the tunnel services of tunnel_service.h run. It only hands the
+// configuration to tunnel.dll, which connects to the service control manager, brings the tunnel up and keeps it
+// up until the service is stopped.
+
+#include <windows.h>
+
+#include <cwchar>
+
+#include "tunnel.h"
+
+int wmain(int argc, wchar_t **argv) {
+  if (argc != 3 || wcscmp(argv[1], L"/service") != 0) {
+    return ERROR_INVALID_PARAMETER;
+  }
+
+  // Bundled next to this program, never looked up anywhere else
+  HMODULE tunnel = LoadLibraryExW(L"tunnel.dll", nullptr, LOAD_LIBRARY_SEARCH_APPLICATION_DIR);
+  if (!tunnel) {
+    return static_cast<int>(GetLastError());
+  }
+  auto run_service =
+      reinterpret_cast<decltype(&WireGuardTunnelService)>(GetProcAddress(tunnel, "WireGuardTunnelService"));
+  if (!run_service) {
+    return static_cast<int>(GetLastError());
+  }
+  return run_service(reinterpret_cast<GoUint16 *>(argv[2])) ? 0 : 1;
+}
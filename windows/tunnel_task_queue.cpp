@@ -0,0 +1,169 @@
+#include "tunnel_task_queue.h"
+
+#include <system_error>
+
+#include "cpu_accounting.h"
+#include "startup_trace.h"
+
+namespace wireguard_dart {
+
+TunnelTaskQueue::Hold &TunnelTaskQueue::Hold::operator=(Hold &&other) noexcept {
+  if (this != &other) {
+    Release();
+    queue_ = other.queue_;
+    tunnel_name_ = std::move(other.tunnel_name_);
+    other.queue_ = nullptr;
+  }
+  return *this;
+}
+
+void TunnelTaskQueue::Hold::Release() {
+  if (!queue_) {
+    return;
+  }
+  TunnelTaskQueue *queue = queue_;
+  queue_ = nullptr;
+  std::lock_guard<std::mutex> lock(queue->mutex_);
+  queue->FinishLocked(tunnel_name_);
+}
+
+TunnelTaskQueue::TunnelTaskQueue(size_t workers, const char *name)
+    : worker_count_(workers > 0 ? workers : 1), name_(name) {}
+
+TunnelTaskQueue::~TunnelTaskQueue() {
+  // A queue that never started stays without workers, and one starting on another thread is waited for
+  std::call_once(workers_started_, [] {});
+  std::unique_lock<std::mutex> lock(mutex_);
+  stopping_ = true;
+  lock.unlock();
+  wake_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  // Held tasks go on without the workers, their continuations run where they are posted
+  lock.lock();
+  finished_.wait(lock, [this] { return running_.empty(); });
+}
+
+bool TunnelTaskQueue::StartWorkers() {
+  std::call_once(workers_started_, [this] {
+    ScopedStartup startup(name_);
+    for (size_t i = 0; i < worker_count_; i++) {
+      try {
+        workers_.emplace_back(&TunnelTaskQueue::Run, this);
+      } catch (const std::system_error &) {
+        break;
+      }
+    }
+  });
+  return !workers_.empty();
+}
+
+void TunnelTaskQueue::Post(const std::string &tunnel_name, Task task) {
+  // Without any worker the task runs right away, as it would have before there was a queue
+  if (!StartWorkers()) {
+    task();
+    return;
+  }
+  Enqueue(tunnel_name, Entry{std::move(task), nullptr});
+}
+
+void TunnelTaskQueue::PostHeld(const std::string &tunnel_name, HeldTask task) {
+  if (!StartWorkers()) {
+    // Nothing waits behind a tunnel that has no queue, so there is nothing to hold
+    task(Hold());
+    return;
+  }
+  Enqueue(tunnel_name, Entry{nullptr, std::move(task)});
+}
+
+void TunnelTaskQueue::PostContinuation(Task task) {
+  bool has_workers = StartWorkers();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (has_workers && !stopping_) {
+      continuations_.push_back(std::move(task));
+      task = nullptr;
+    }
+  }
+  if (task) {
+    task();
+    return;
+  }
+  wake_.notify_one();
+}
+
+void TunnelTaskQueue::Enqueue(const std::string &tunnel_name, Entry entry) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &queue = queues_[tunnel_name];
+    queue.push_back(std::move(entry));
+    if (queue.size() > 1 || running_.count(tunnel_name) > 0) {
+      return; // Already ready or running, the worker that finishes it picks this one up
+    }
+    ready_.push_back(tunnel_name);
+  }
+  wake_.notify_one();
+}
+
+void TunnelTaskQueue::Run() {
+  ScopedThreadCpu cpu(CpuComponent::kTunnelWorkers);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] { return stopping_ || !ready_.empty() || !continuations_.empty(); });
+    if (stopping_) {
+      // A continuation still queued runs here, its task would never let go of its tunnel otherwise
+      if (continuations_.empty()) {
+        return;
+      }
+    }
+
+    if (!continuations_.empty()) {
+      Task continuation = std::move(continuations_.front());
+      continuations_.pop_front();
+      lock.unlock();
+      continuation();
+      continuation = nullptr;
+      lock.lock();
+      continue;
+    }
+
+    std::string tunnel_name = std::move(ready_.front());
+    ready_.pop_front();
+    auto queue = queues_.find(tunnel_name);
+    Entry entry = std::move(queue->second.front());
+    queue->second.pop_front();
+    running_.insert(tunnel_name);
+    lock.unlock();
+
+    if (entry.held) {
+      // The hold finishes the tunnel, maybe before this returns
+      entry.held(Hold(this, tunnel_name));
+      entry = Entry();
+      lock.lock();
+      continue;
+    }
+    entry.task();
+    entry = Entry();
+
+    lock.lock();
+    FinishLocked(tunnel_name);
+  }
+}
+
+void TunnelTaskQueue::FinishLocked(const std::string &tunnel_name) {
+  running_.erase(tunnel_name);
+  finished_.notify_all();
+  auto queue = queues_.find(tunnel_name);
+  if (queue == queues_.end()) {
+    return;
+  }
+  if (queue->second.empty()) {
+    queues_.erase(queue);
+  } else if (!stopping_) {
+    ready_.push_back(tunnel_name);
+    wake_.notify_one();
+  }
+}
+
+} // namespace wireguard_dart
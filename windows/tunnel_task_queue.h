@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace wireguard_dart {
+
+/**
+ * Runs tasks on a few worker threads, one at a time per tunnel: tasks for the same tunnel run in the order
+ * they were posted, tasks for different tunnels run in parallel. Lets slow driver and IP helper calls run
+ * off the platform thread without two of them ever working on one adapter at once.
+ */
+class TunnelTaskQueue {
+public:
+  using Task = std::function<void()>;
+
+  /**
+   * Keeps the tunnel of a held task busy after the task returned, until the hold is released or destroyed. A
+   * coroutine handler keeps its tunnel across its suspensions this way without keeping a worker.
+   */
+  class Hold {
+  public:
+    Hold() = default;
+    Hold(Hold &&other) noexcept : queue_(other.queue_), tunnel_name_(std::move(other.tunnel_name_)) {
+      other.queue_ = nullptr;
+    }
+    Hold &operator=(Hold &&other) noexcept;
+    ~Hold() { Release(); }
+
+    Hold(const Hold &) = delete;
+    Hold &operator=(const Hold &) = delete;
+
+    void Release();
+
+  private:
+    friend class TunnelTaskQueue;
+    Hold(TunnelTaskQueue *queue, std::string tunnel_name) : queue_(queue), tunnel_name_(std::move(tunnel_name)) {}
+
+    TunnelTaskQueue *queue_ = nullptr;
+    std::string tunnel_name_;
+  };
+  using HeldTask = std::function<void(Hold hold)>;
+
+  static constexpr size_t kDefaultWorkers = 4;
+
+  // The workers start with the first task, so a queue that is never used costs no threads; name is for StartupTrace
+  explicit TunnelTaskQueue(size_t workers = kDefaultWorkers, const char *name = "tunnelWorkers");
+  // Waits for the running tasks and for the holds; the tasks still queued are dropped
+  ~TunnelTaskQueue();
+
+  TunnelTaskQueue(const TunnelTaskQueue &) = delete;
+  TunnelTaskQueue &operator=(const TunnelTaskQueue &) = delete;
+
+  void Post(const std::string &tunnel_name, Task task);
+  // Like Post, but the tunnel's next task waits until the task let go of its hold
+  void PostHeld(const std::string &tunnel_name, HeldTask task);
+  // Run a task on the next free worker, outside the order of the tunnels: the continuation of a held task, or work
+  // that belongs to no tunnel
+  void PostContinuation(Task task);
+
+private:
+  // One of task and held
+  struct Entry {
+    Task task;
+    HeldTask held;
+  };
+
+  // False when no worker could be started
+  bool StartWorkers();
+  void Enqueue(const std::string &tunnel_name, Entry entry);
+  void Run();
+  // The tunnel's task or hold is done, its next task is ready
+  void FinishLocked(const std::string &tunnel_name);
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  // Signalled whenever a tunnel finishes, for the destructor waiting on the holds
+  std::condition_variable finished_;
+  bool stopping_ = false;
+  // Queued tasks of each tunnel that has any
+  std::map<std::string, std::deque<Entry>> queues_;
+  // Continuations of held tasks, which run ahead of every tunnel's queue
+  std::deque<Task> continuations_;
+  // Tunnels with a task running or held right now, their next task waits for it
+  std::set<std::string> running_;
+  // Tunnels with queued tasks and none running, in the order they became ready
+  std::deque<std::string> ready_;
+  size_t worker_count_;
+  const char *name_;
+  std::once_flag workers_started_;
+  // Only read once workers_started_ is set
+  std::vector<std::thread> workers_;
+};
+
+} // namespace wireguard_dart
@@ -4,54 +4,44 @@
 #include <sstream>
 #include <string>
 
+#include "string_conversions.h"
+
 namespace wireguard_dart {
 
-const flutter::EncodableValue *ValueOrNull(const flutter::EncodableMap &map, const char *key) {
-  auto it = map.find(flutter::EncodableValue(key));
+const flutter::EncodableValue *ValueOrNull(const flutter::EncodableMap &map, const flutter::EncodableValue &key) {
+  auto it = map.find(key);
   if (it == map.end()) {
     return nullptr;
   }
   return &(it->second);
 }
 
+void FindValues(const flutter::EncodableMap &map, const flutter::EncodableValue *const *keys, size_t count,
+                const flutter::EncodableValue **values) {
+  for (size_t i = 0; i < count; i++) {
+    values[i] = nullptr;
+  }
+  // An argument map holds a handful of entries, so comparing each against every key beats a tree search per key
+  size_t found = 0;
+  for (auto it = map.begin(); it != map.end() && found < count; ++it) {
+    for (size_t i = 0; i < count; i++) {
+      if (!values[i] && it->first == *keys[i]) {
+        values[i] = &it->second;
+        found++;
+        break;
+      }
+    }
+  }
+}
+
 std::string ErrorWithCode(const char *msg, unsigned long error_code) {
   std::ostringstream builder;
   builder << msg << " (" << error_code << ")";
   return builder.str();
 }
 
-std::string WideToUtf8(const std::wstring &wstr) {
-  int size_needed = WideCharToMultiByte(CP_UTF8, 0, &wstr[0], (int)wstr.size(), NULL, 0, NULL, NULL);
-  std::string strTo(size_needed, 0);
-  WideCharToMultiByte(CP_UTF8, 0, &wstr[0], (int)wstr.size(), &strTo[0], size_needed, NULL, NULL);
-  return strTo;
-}
-
-std::wstring Utf8ToWide(const std::string &str) {
-  int size_needed = MultiByteToWideChar(CP_UTF8, 0, &str[0], (int)str.size(), NULL, 0);
-  std::wstring wstrTo(size_needed, 0);
-  MultiByteToWideChar(CP_UTF8, 0, &str[0], (int)str.size(), &wstrTo[0], size_needed);
-  return wstrTo;
-}
-
-std::string WideToAnsi(const std::wstring &wstr) {
-  int size_needed = WideCharToMultiByte(CP_ACP, 0, &wstr[0], -1, NULL, 0, NULL, NULL);
-  std::string strTo(size_needed, 0);
-  WideCharToMultiByte(CP_ACP, 0, &wstr[0], (int)wstr.size(), &strTo[0], size_needed, NULL, NULL);
-  return strTo;
-}
-
-std::wstring AnsiToWide(const std::string &str) {
-  int size_needed = MultiByteToWideChar(CP_ACP, 0, &str[0], (int)str.size(), NULL, 0);
-  std::wstring wstrTo(size_needed, 0);
-  MultiByteToWideChar(CP_ACP, 0, &str[0], (int)str.size(), &wstrTo[0], size_needed);
-  return wstrTo;
-}
-
 void DebugMessageBox(const char* msg) {
-    std::string s(msg);
-    std::wstring ws = Utf8ToWide(s);
-    MessageBox(NULL, &ws[0], L"Debug", MB_OK);
+    MessageBox(NULL, Utf8AsWide(msg).c_str(), L"Debug", MB_OK);
 }
 
 }  // namespace wireguard_dart
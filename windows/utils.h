@@ -4,22 +4,30 @@
 #include <flutter/encodable_value.h>
 #include <windows.h>
 
+#include <cstddef>
 #include <sstream>
 #include <string>
 
-namespace wireguard_dart {
-
-const flutter::EncodableValue *ValueOrNull(const flutter::EncodableMap &map, const char *key);
+#include "encodable_keys.h"
+#include "string_conversions.h"
 
-std::string ErrorWithCode(const char *msg, unsigned long error_code);
+namespace wireguard_dart {
 
-std::string WideToUtf8(const std::wstring &wstr);
+// key is one of keys::, so the lookup never builds an EncodableValue
+const flutter::EncodableValue *ValueOrNull(const flutter::EncodableMap &map, const flutter::EncodableValue &key);
 
-std::wstring Utf8ToWide(const std::string &str);
+// Finds every one of keys in one walk of map, for a handler that reads many arguments; values[i] is the value of
+// keys[i], or nullptr if map has none
+void FindValues(const flutter::EncodableMap &map, const flutter::EncodableValue *const *keys, size_t count,
+                const flutter::EncodableValue **values);
 
-std::string WideToAnsi(const std::wstring &wstr);
+template <size_t N>
+void FindValues(const flutter::EncodableMap &map, const flutter::EncodableValue *const (&keys)[N],
+                const flutter::EncodableValue *(&values)[N]) {
+  FindValues(map, keys, N, values);
+}
 
-std::wstring AnsiToWide(const std::string &str);
+std::string ErrorWithCode(const char *msg, unsigned long error_code);
 
 // Pops a message box (useful for debugging native code)
 void DebugMessageBox(const char* msg);
@@ -1,34 +1,93 @@
 #include "wireguard_adapter.h"
 
+#include <algorithm>
+#include <cstring>
+#include <set>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
+#include "endpoint_family_race.h"
+#include "wireguard_config_diff.h"
 #include "wireguard_config_parser.h"
 #include "wireguard_network_config.h"
+#include "prefix_aggregation.h"
 #include "spdlog/spdlog.h"
-#include "utils.h"
+#include "string_conversions.h"
+#include "transient_retry.h"
+#include "wireguard_core/activation_schedule.h"
 
 namespace wireguard_dart {
 
+namespace {
+
+SOCKADDR_INET WithPort(const SOCKADDR_INET &address, WORD port) {
+  SOCKADDR_INET endpoint = address;
+  if (endpoint.si_family == AF_INET6) {
+    endpoint.Ipv6.sin6_port = htons(port);
+  } else {
+    endpoint.Ipv4.sin_port = htons(port);
+  }
+  return endpoint;
+}
+
+bool SameEndpoint(const SOCKADDR_INET &a, const SOCKADDR_INET &b) {
+  if (a.si_family != b.si_family) {
+    return false;
+  }
+  if (a.si_family == AF_INET) {
+    return a.Ipv4.sin_addr.s_addr == b.Ipv4.sin_addr.s_addr && a.Ipv4.sin_port == b.Ipv4.sin_port;
+  }
+  return memcmp(&a.Ipv6.sin6_addr, &b.Ipv6.sin6_addr, sizeof(a.Ipv6.sin6_addr)) == 0 &&
+         a.Ipv6.sin6_port == b.Ipv6.sin6_port;
+}
+
+bool SameAddress(const SOCKADDR_INET &a, const SOCKADDR_INET &b) {
+  return SameEndpoint(WithPort(a, 0), WithPort(b, 0));
+}
+
+} // namespace
+
 std::unique_ptr<WireguardAdapter> WireguardAdapter::Create(const std::shared_ptr<WireguardLibrary> &library,
-                                                           const std::wstring &name, const std::wstring &tunnel_type) {
+                                                           const std::wstring &name, const std::wstring &tunnel_type,
+                                                           const GUID *requested_guid) {
   if (!library || !library->IsLoaded()) {
     return nullptr;
   }
 
   auto adapter = std::unique_ptr<WireguardAdapter>(new WireguardAdapter(library, name));
-  adapter->adapter_handle_ = library->CreateAdapter()(name.c_str(), tunnel_type.c_str(),
-                                                      nullptr // Let system choose GUID
-  );
+  // Without a GUID the system chooses a new one
+  adapter->adapter_handle_ = library->CreateAdapter()(name.c_str(), tunnel_type.c_str(), requested_guid);
 
   if (!adapter->adapter_handle_) {
     return nullptr;
   }
 
-  adapter->SetLogging(WIREGUARD_ADAPTER_LOG_ON);
+  adapter->SetLogMode(AdapterLogMode::kOn);
   return adapter;
 }
 
+GUID WireguardAdapter::StableGuid(const std::string &bundle_id, const std::wstring &name) {
+  // Two differently seeded 64-bit hashes of the same text make up the 128 bits. The GUID only has to be
+  // stable and distinct per tunnel, not unguessable.
+  std::string text = bundle_id + '\n' + WideToUtf8(name);
+  uint64_t high = WireguardConfigParser::HashText(text);
+  uint64_t low = WireguardConfigParser::HashText(text, high ^ 0x9E3779B97F4A7C15ull);
+
+  GUID guid;
+  guid.Data1 = static_cast<unsigned long>(high >> 32);
+  guid.Data2 = static_cast<unsigned short>(high >> 16);
+  // Version 8, for a name-based GUID of our own scheme
+  guid.Data3 = static_cast<unsigned short>((high & 0x0FFF) | 0x8000);
+  for (int i = 0; i < 8; i++) {
+    guid.Data4[i] = static_cast<unsigned char>(low >> (56 - 8 * i));
+  }
+  // RFC 4122 variant
+  guid.Data4[0] = static_cast<unsigned char>((guid.Data4[0] & 0x3F) | 0x80);
+  return guid;
+}
+
 std::unique_ptr<WireguardAdapter> WireguardAdapter::Open(const std::shared_ptr<WireguardLibrary> &library,
                                                          const std::wstring &name) {
   if (!library || !library->IsLoaded()) {
@@ -41,23 +100,27 @@ std::unique_ptr<WireguardAdapter> WireguardAdapter::Open(const std::shared_ptr<W
     return nullptr;
   }
 
-  adapter->SetLogging(WIREGUARD_ADAPTER_LOG_ON);
+  adapter->SetLogMode(AdapterLogMode::kOn);
+  // An adapter another process set up is in whatever state it left, which GetKnownState then has
+  adapter->GetState();
   return adapter;
 }
 
 WireguardAdapter::WireguardAdapter(const std::shared_ptr<WireguardLibrary> &library, const std::wstring &name)
-    : library_(library), name_(name) {
-  try {
-    logger_ = spdlog::get("wireguard_dart");
-    if (!logger_) {
-      logger_ = spdlog::default_logger();
-    }
-  } catch (const std::exception &) {
-    logger_ = spdlog::default_logger();
-  }
-}
+    : library_(library), name_(name) {}
 
 WireguardAdapter::~WireguardAdapter() {
+  // Wait for outstanding lookups and the handshake wait first, their callbacks use the adapter handle
+  resolver_.reset();
+  handshake_waiter_.Stop();
+  endpoint_failover_.Stop();
+  keepalive_tuning_.Stop();
+  activation_.Stop();
+  path_watcher_.Stop();
+
+  if (log_index_ != 0) {
+    AdapterLogs::Instance().Unregister(log_index_);
+  }
   if (adapter_handle_ && library_ && library_->IsLoaded()) {
     library_->CloseAdapter()(adapter_handle_);
     adapter_handle_ = nullptr;
@@ -69,7 +132,17 @@ bool WireguardAdapter::SetState(WIREGUARD_ADAPTER_STATE state) {
     return false;
   }
 
-  return library_->SetAdapterState()(adapter_handle_, state) != FALSE;
+  DWORD error = RetryTransient(MeteredCall::kWireGuardSetAdapterState, [this, state]() -> DWORD {
+    return library_->SetAdapterState()(adapter_handle_, state) ? ERROR_SUCCESS : GetLastError();
+  });
+  if (error != ERROR_SUCCESS) {
+    DumpDriverLog("WireGuardSetAdapterState failed");
+  } else {
+    known_state_.store(state, std::memory_order_relaxed);
+  }
+  // For the caller's log line
+  SetLastError(error);
+  return error == ERROR_SUCCESS;
 }
 
 WIREGUARD_ADAPTER_STATE WireguardAdapter::GetState() const {
@@ -79,18 +152,35 @@ WIREGUARD_ADAPTER_STATE WireguardAdapter::GetState() const {
 
   WIREGUARD_ADAPTER_STATE state;
   if (library_->GetAdapterState()(adapter_handle_, &state)) {
+    known_state_.store(state, std::memory_order_relaxed);
     return state;
   }
 
   return WIREGUARD_ADAPTER_STATE_DOWN;
 }
 
+std::optional<WIREGUARD_ADAPTER_STATE> WireguardAdapter::GetKnownState() const {
+  int state = known_state_.load(std::memory_order_relaxed);
+  if (state < 0) {
+    return std::nullopt;
+  }
+  return static_cast<WIREGUARD_ADAPTER_STATE>(state);
+}
+
 bool WireguardAdapter::SetConfiguration(const WIREGUARD_INTERFACE *config, DWORD bytes) {
   if (!IsValid() || !library_->IsLoaded() || !config) {
     return false;
   }
 
-  return library_->SetConfiguration()(adapter_handle_, config, bytes) != FALSE;
+  // Each peer of an update says what changes about it, so one the driver half applied comes out the same sent again
+  DWORD error = RetryTransient(MeteredCall::kWireGuardSetConfiguration, [this, config, bytes]() -> DWORD {
+    return library_->SetConfiguration()(adapter_handle_, config, bytes) ? ERROR_SUCCESS : GetLastError();
+  });
+  if (error != ERROR_SUCCESS) {
+    DumpDriverLog("WireGuardSetConfiguration failed");
+  }
+  SetLastError(error);
+  return error == ERROR_SUCCESS;
 }
 
 bool WireguardAdapter::GetLUID(NET_LUID *luid) const {
@@ -102,60 +192,1094 @@ bool WireguardAdapter::GetLUID(NET_LUID *luid) const {
   return true;
 }
 
-bool WireguardAdapter::SetLogging(WIREGUARD_ADAPTER_LOG_STATE log_state) {
+bool WireguardAdapter::SetLogMode(AdapterLogMode mode) {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
   if (!IsValid() || !library_->IsLoaded()) {
     return false;
   }
 
-  return library_->SetAdapterLogging()(adapter_handle_, log_state) != FALSE;
+  // The prefix is the interface index, by which AdapterLogs finds the ring of a line
+  NET_LUID luid;
+  NET_IFINDEX index = 0;
+  if (mode != AdapterLogMode::kOff && (!GetLUID(&luid) || ConvertInterfaceLuidToIndex(&luid, &index) != NO_ERROR)) {
+    // The lines still reach the file log, with the index
+    index = 0;
+  }
+  WIREGUARD_ADAPTER_LOG_STATE log_state =
+      mode == AdapterLogMode::kOff ? WIREGUARD_ADAPTER_LOG_OFF : WIREGUARD_ADAPTER_LOG_ON_WITH_PREFIX;
+  if (!library_->SetAdapterLogging()(adapter_handle_, log_state)) {
+    return false;
+  }
+
+  if (log_index_ != 0 && log_index_ != index) {
+    AdapterLogs::Instance().Unregister(log_index_);
+  }
+  log_index_ = index;
+  if (index != 0) {
+    AdapterLogs::Instance().Register(index, WideToUtf8(name_), mode, driver_log_);
+  }
+  log_mode_ = mode;
+  return true;
+}
+
+void WireguardAdapter::DumpDriverLog(std::string_view reason) const {
+  AdapterLogs::Dump(WideToUtf8(name_), *driver_log_, reason, spdlog::level::err);
 }
 
-bool WireguardAdapter::ApplyConfiguration(const std::string &config_text) {
-  logger_->info("Applying WireGuard configuration for adapter: {}", WideToUtf8(name_));
+bool WireguardAdapter::ApplyConfiguration(const std::string &config_text, PhaseTimer *timer) {
+  logger_->info("Applying WireGuard configuration for adapter: {}", WideAsUtf8(name_).view());
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
 
   if (!IsValid() || !library_->IsLoaded()) {
     logger_->error("Failed to apply configuration: adapter invalid or library not loaded");
     return false;
   }
 
+  // A released configuration is parsed again below, networking may need it
+  if (parsed_config_.has_value() &&
+      IsCurrentText(WireguardConfigParser::HashText(config_text), config_text.size())) {
+    logger_->info("Configuration unchanged, skipping driver update");
+    return true;
+  }
+
   WireguardConfigParser parser;
   if (!parser.Parse(config_text)) {
-    parsed_config_.reset(); // Clear any previous config
-    logger_->error("Failed to parse WireGuard configuration");
+    SetParsedConfigLocked(std::nullopt); // Clear any previous config
+    logger_->error("Failed to parse WireGuard configuration at line {}", parser.GetErrorLine());
     return false;
   }
+  if (timer) {
+    timer->Lap("parse");
+  }
+
+  return ApplyConfigurationLocked(std::move(parser), timer);
+}
+
+bool WireguardAdapter::ApplyConfiguration(WireguardConfigParser &&parser, PhaseTimer *timer) {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  return ApplyConfigurationLocked(std::move(parser), timer);
+}
 
-  // Calculate required buffer size
-  DWORD config_size = parser.CalculateConfigurationSize();
-  if (config_size == 0) {
-    parsed_config_.reset();
-    logger_->error("Configuration size calculation returned 0");
+bool WireguardAdapter::ApplyConfigurationLocked(WireguardConfigParser &&parser, PhaseTimer *timer) {
+  if (!IsValid() || !library_->IsLoaded()) {
+    logger_->error("Failed to apply configuration: adapter invalid or library not loaded");
     return false;
   }
 
-  // Allocate buffer and build configuration
-  std::vector<BYTE> config_buffer(config_size);
-  DWORD actual_size = parser.BuildConfiguration(config_buffer.data(), config_size);
-  if (actual_size == 0 || actual_size != config_size) {
-    parsed_config_.reset();
-    logger_->error("Failed to build configuration: expected {} bytes, got {} bytes", config_size, actual_size);
-    return false;
+  if (IsCurrentText(parser.GetTextHash(), parser.GetTextSize())) {
+    if (!parsed_config_.has_value()) {
+      // Released in low-memory mode; the driver still runs it, only the parse comes back
+      SetParsedConfigLocked(std::move(parser));
+    }
+    logger_->info("Configuration unchanged, skipping driver update");
+    return true;
+  }
+
+  std::map<std::string, std::vector<PendingEndpoint>> pending_endpoints = LookUpEndpointsLocked(parser);
+
+  // The parser writes the wire format directly, so there is no separate build step
+  const WireguardConfigBuffer *config_buffer = &parser.GetConfiguration();
+
+  // Against a configuration we applied before, only send the peers that changed so that the sessions of the
+  // others are left alone. Peers still waiting to be activated are not in the driver, so then every peer goes.
+  bool staged = activation_.IsRunning();
+  activation_.Stop();
+  WireguardConfigBuffer delta;
+  if (!staged && parsed_config_.has_value() &&
+      BuildConfigurationDelta(parsed_config_->GetConfiguration(), *config_buffer, delta)) {
+    logger_->info("Applying incremental configuration with {} changed peers", delta.Interface().PeersCount);
+    config_buffer = &delta;
+  }
+  if (timer) {
+    timer->Lap("build");
   }
 
-  const WIREGUARD_INTERFACE *config = reinterpret_cast<const WIREGUARD_INTERFACE *>(config_buffer.data());
-  if (!SetConfiguration(config, actual_size)) {
-    parsed_config_.reset();
-    logger_->error("Failed to set WireGuard configuration on adapter");
+  if (!SetConfiguration(config_buffer->Data(), config_buffer->Size())) {
+    DWORD set_error = GetLastError();
+    SetParsedConfigLocked(std::nullopt);
+    logger_->error("Failed to set WireGuard configuration on adapter: Windows error {}", set_error);
+    // Left for the caller, whatever the logging did to it
+    SetLastError(set_error);
     return false;
   }
+  if (timer) {
+    timer->Lap("setConfiguration");
+  }
 
-  parsed_config_ = std::move(parser);
+  SetParsedConfigLocked(std::move(parser));
+  networking_configured_ = false;
+  config_generation_++;
+  host_lookups_.clear();
   logger_->info("Successfully applied WireGuard configuration");
+
+  if (!pending_endpoints.empty()) {
+    ResolveEndpoints(std::move(pending_endpoints));
+  }
+  return true;
+}
+
+bool WireguardAdapter::ChangePeers(WireguardConfigParser &&added, const std::vector<PeerPublicKey> &removed,
+                                   std::string *error) {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  if (!IsValid() || !library_->IsLoaded()) {
+    *error = "Adapter invalid or library not loaded";
+    return false;
+  }
+  if (!parsed_config_.has_value()) {
+    *error = config_released_ ? "The applied configuration was released, update the tunnel in full instead"
+                              : "No configuration is applied";
+    return false;
+  }
+
+  std::map<std::string, std::vector<PendingEndpoint>> pending_endpoints = LookUpEndpointsLocked(added);
+  WireguardConfigBuffer delta;
+  if (!BuildPeerChange(parsed_config_->GetConfiguration(), added.GetConfiguration(), removed, delta)) {
+    *error = "Every peer needs a publicKey of its own";
+    return false;
+  }
+  if (delta.Interface().PeersCount > 0 && !SetConfiguration(delta.Data(), delta.Size())) {
+    // Which records the driver took is unknown, the next configuration replaces every peer
+    SetParsedConfigLocked(std::nullopt);
+    *error = "Failed to set WireGuard configuration on adapter";
+    return false;
+  }
+  logger_->info("Changed {} peers of adapter {}", delta.Interface().PeersCount, WideAsUtf8(name_).view());
+  DroppedPeers dropped;
+  parsed_config_->ChangePeers(added, removed, &dropped);
+  ForgetLookupsLocked(added, removed);
+  parsed_config_bytes_ = parsed_config_->MemoryBytes();
+
+  // Networking follows at the cost of the change: the routes that differ go to the route table, the endpoints of
+  // the new peers are let through, pinned and watched, and those of the peers that went are closed again
+  NET_LUID luid;
+  if (networking_configured_ && GetLUID(&luid)) {
+    std::vector<WIREGUARD_ALLOWED_IP> added_allowed_ips;
+    std::set<std::pair<IpPrefix, WORD>> added_endpoints;
+    auto let_through = [this, &added_endpoints](const SOCKADDR_INET &endpoint) {
+      added_endpoints.emplace(IpPrefix::FromAddress(endpoint, 0), endpoint.Ipv4.sin_port);
+      kill_switch_.AddEndpoint(endpoint);
+      bypass_routes_.AddEndpoint(endpoint, config_generation_);
+    };
+    added.GetConfiguration().ForEachPeer(
+        [&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD allowed_ip_count) {
+          added_allowed_ips.insert(added_allowed_ips.end(), allowed_ips, allowed_ips + allowed_ip_count);
+          if (peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) {
+            let_through(peer.Endpoint);
+            mtu_prober_.AddEndpoint(peer.Endpoint);
+            EndpointPathWatcher::Endpoint watched;
+            memcpy(watched.public_key, peer.PublicKey, sizeof(watched.public_key));
+            watched.address = peer.Endpoint;
+            path_watcher_.AddEndpoint(watched);
+          }
+        });
+    for (const auto &alternate : added.GetAlternateEndpoints()) {
+      let_through(alternate.address);
+    }
+    // A peer that was replaced keeps the endpoints it still has. Pins stay, a pin is per address and another peer
+    // may have an endpoint on it; the routes decide which are needed.
+    for (const SOCKADDR_INET &endpoint : dropped.endpoints) {
+      if (added_endpoints.count({IpPrefix::FromAddress(endpoint, 0), endpoint.Ipv4.sin_port}) == 0) {
+        kill_switch_.RemoveEndpoint(endpoint);
+      }
+    }
+    std::unordered_set<std::string_view> removed_keys;
+    for (const PeerPublicKey &key : removed) {
+      removed_keys.emplace(reinterpret_cast<const char *>(key.data()), key.size());
+    }
+    path_watcher_.RemoveEndpoints([&removed_keys](const BYTE *public_key) {
+      std::string_view key(reinterpret_cast<const char *>(public_key), WIREGUARD_KEY_LENGTH);
+      return removed_keys.count(key) > 0;
+    });
+
+    // Endpoints that fall inside new routes are pinned before those go in, and unpinned once the routes that no
+    // longer cover them are gone
+    std::vector<WIREGUARD_ALLOWED_IP> added_routes;
+    std::vector<WIREGUARD_ALLOWED_IP> removed_routes;
+    ChangeRoutes(route_set_, added_allowed_ips, dropped.allowed_ips, &added_routes, &removed_routes);
+    if (!added_routes.empty() || !removed_routes.empty()) {
+      bypass_routes_.ChangeRoutes(added_routes, {});
+      WireguardNetworkConfig net_config(luid, &network_ledger_);
+      if (!net_config.ChangeRoutes(added_routes, removed_routes)) {
+        logger_->warn("Failed to update the routes for the changed peers, networking is configured again");
+        networking_configured_ = false;
+      }
+      bypass_routes_.ChangeRoutes({}, removed_routes);
+    }
+    // Peers that were tuned go on from the keepalive they have
+    StartKeepaliveTuningLocked();
+  } else {
+    networking_configured_ = false;
+  }
+
+  if (!pending_endpoints.empty()) {
+    ResolveEndpoints(std::move(pending_endpoints));
+  }
+  return true;
+}
+
+bool WireguardAdapter::LookUpEndpoint(const std::string &host, SOCKADDR_INET &address) const {
+  SOCKADDR_INET alternate;
+  if (!resolver_ || !resolver_->Lookup(host, address, alternate)) {
+    return false;
+  }
+  NET_LUID luid = {};
+  GetLUID(&luid);
+  address = EndpointFamilyRace::Instance().Remembered(address, alternate, luid);
+  return true;
+}
+
+std::map<std::string, std::vector<WireguardAdapter::PendingEndpoint>>
+WireguardAdapter::LookUpEndpointsLocked(WireguardConfigParser &parser) {
+  // Endpoint hostnames with a cached address go out with the configuration. The others are looked up
+  // concurrently once it is applied, so a slow resolver does not hold up the tunnel.
+  if (!resolver_) {
+    resolver_ = std::make_unique<EndpointResolver>();
+  }
+  std::map<std::string, std::vector<PendingEndpoint>> pending_endpoints;
+  for (const auto &hostname_endpoint : parser.GetHostnameEndpoints()) {
+    SOCKADDR_INET address;
+    if (LookUpEndpoint(hostname_endpoint.host, address)) {
+      parser.SetPeerEndpoint(hostname_endpoint.peer_offset, WithPort(address, hostname_endpoint.port));
+      continue;
+    }
+
+    PendingEndpoint pending;
+    const auto *peer =
+        reinterpret_cast<const WIREGUARD_PEER *>(parser.GetConfiguration().At(hostname_endpoint.peer_offset));
+    memcpy(pending.public_key, peer->PublicKey, sizeof(pending.public_key));
+    pending.port = hostname_endpoint.port;
+    pending_endpoints[hostname_endpoint.host].push_back(pending);
+  }
+  return pending_endpoints;
+}
+
+void WireguardAdapter::ResolveEndpoints(std::map<std::string, std::vector<PendingEndpoint>> pending) {
+  std::vector<std::string> hosts;
+  for (const auto &entry : pending) {
+    hosts.push_back(entry.first);
+  }
+  logger_->info("Resolving {} endpoint hostnames", hosts.size());
+
+  uint64_t generation = config_generation_;
+  uint64_t lookup = ++last_lookup_;
+  for (const auto &entry : pending) {
+    HostLookup &host_lookup = host_lookups_[entry.first];
+    host_lookup.lookup = lookup;
+    host_lookup.peers.insert(host_lookup.peers.end(), entry.second.begin(), entry.second.end());
+  }
+  resolver_->ResolveAsync(hosts, [this, generation, lookup](const std::string &host, const SOCKADDR_INET *resolved,
+                                                             const SOCKADDR_INET *alternate) {
+    if (!resolved) {
+      logger_->error("Failed to resolve endpoint hostname: {}", host);
+      return;
+    }
+    if (!alternate) {
+      SetResolvedEndpoint(host, *resolved, generation, lookup);
+      return;
+    }
+    NET_LUID luid = {};
+    GetLUID(&luid);
+    if (!worker_post_) {
+      SetResolvedEndpoint(host, EndpointFamilyRace::Instance().Choose(*resolved, *alternate, luid), generation,
+                          lookup);
+      return;
+    }
+    // The race takes up to a second and a quarter, which is the tunnel worker's to wait, not the resolver's thread
+    worker_post_([this, host, first = *resolved, second = *alternate, luid, generation,
+                  lookup](WireguardAdapter *adapter) {
+      if (adapter == this) {
+        SetResolvedEndpoint(host, EndpointFamilyRace::Instance().Choose(first, second, luid), generation, lookup);
+      }
+    });
+  });
+}
+
+void WireguardAdapter::SetResolvedEndpoint(const std::string &host, const SOCKADDR_INET &chosen,
+                                           uint64_t generation, uint64_t lookup) {
+  // Nothing helper threads wait for is stopped under the exclusive lock, so this may block
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  auto host_lookup = host_lookups_.find(host);
+  if (generation != config_generation_ || host_lookup == host_lookups_.end() ||
+      host_lookup->second.lookup != lookup) {
+    return;
+  }
+  std::vector<PendingEndpoint> peers = std::move(host_lookup->second.peers);
+  host_lookups_.erase(host_lookup);
+  bypass_routes_.AddEndpoint(chosen, generation);
+  mtu_prober_.AddEndpoint(chosen);
+  for (const auto &peer_endpoint : peers) {
+    kill_switch_.AddEndpoint(WithPort(chosen, peer_endpoint.port));
+    EndpointPathWatcher::Endpoint watched;
+    memcpy(watched.public_key, peer_endpoint.public_key, sizeof(watched.public_key));
+    watched.address = WithPort(chosen, peer_endpoint.port);
+    path_watcher_.AddEndpoint(watched);
+  }
+
+  // Update just the endpoints of the peers using this hostname, leaving everything else as it is
+  WireguardConfigBuffer update;
+  for (const auto &peer_endpoint : peers) {
+    WIREGUARD_PEER &peer = update.AppendPeer();
+    peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_UPDATE | WIREGUARD_PEER_HAS_PUBLIC_KEY |
+                                                  WIREGUARD_PEER_HAS_ENDPOINT);
+    memcpy(peer.PublicKey, peer_endpoint.public_key, sizeof(peer.PublicKey));
+    peer.Endpoint = WithPort(chosen, peer_endpoint.port);
+  }
+
+  if (!SetConfiguration(update.Data(), update.Size())) {
+    logger_->error("Failed to set resolved endpoint for hostname: {}", host);
+  }
+}
+
+void WireguardAdapter::ForgetLookupsLocked(const WireguardConfigParser &added,
+                                           const std::vector<PeerPublicKey> &removed) {
+  if (host_lookups_.empty()) {
+    return;
+  }
+  std::unordered_set<std::string_view> keys;
+  for (const PeerPublicKey &key : removed) {
+    keys.emplace(reinterpret_cast<const char *>(key.data()), key.size());
+  }
+  added.GetConfiguration().ForEachPeer([&keys](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *, DWORD) {
+    keys.emplace(reinterpret_cast<const char *>(peer.PublicKey), sizeof(peer.PublicKey));
+  });
+  for (auto host_lookup = host_lookups_.begin(); host_lookup != host_lookups_.end();) {
+    std::vector<PendingEndpoint> &peers = host_lookup->second.peers;
+    peers.erase(std::remove_if(peers.begin(), peers.end(),
+                               [&keys](const PendingEndpoint &peer) {
+                                 std::string_view key(reinterpret_cast<const char *>(peer.public_key),
+                                                      sizeof(peer.public_key));
+                                 return keys.count(key) > 0;
+                               }),
+                peers.end());
+    host_lookup = peers.empty() ? host_lookups_.erase(host_lookup) : std::next(host_lookup);
+  }
+}
+
+void WireguardAdapter::ReapplyEndpoints(const std::vector<EndpointPathWatcher::Endpoint> &endpoints) {
+  // Networking being replaced stops the watcher and waits for it, and sets the endpoints up again anyway
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+  if (ReapplyEndpointsLocked(endpoints)) {
+    logger_->info("Set {} endpoints again for a handshake over the new network path", endpoints.size());
+  } else {
+    logger_->warn("Failed to set endpoints again after a network path change");
+  }
+}
+
+bool WireguardAdapter::ReapplyEndpointsLocked(const std::vector<EndpointPathWatcher::Endpoint> &endpoints) {
+  WireguardConfigBuffer update;
+  for (const auto &endpoint : endpoints) {
+    WIREGUARD_PEER &peer = update.AppendPeer();
+    peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_UPDATE | WIREGUARD_PEER_HAS_PUBLIC_KEY |
+                                                  WIREGUARD_PEER_HAS_ENDPOINT);
+    memcpy(peer.PublicKey, endpoint.public_key, sizeof(peer.PublicKey));
+    peer.Endpoint = endpoint.address;
+  }
+  return SetConfiguration(update.Data(), update.Size());
+}
+
+void WireguardAdapter::KickAfterResume() {
+  // Exclusive, as the pins and the endpoints of the driver are changed
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  if (!networking_configured_) {
+    return;
+  }
+  // The route changes of the network woken up on may come late, or not at all when it is the same one
+  bypass_routes_.Repin();
+
+  // The endpoints in use, which may be resolved or failed over to since the configuration was applied
+  std::vector<EndpointPathWatcher::Endpoint> endpoints;
+  ForEachDriverPeer([&endpoints](const WIREGUARD_PEER &peer) {
+    if (peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) {
+      EndpointPathWatcher::Endpoint endpoint;
+      memcpy(endpoint.public_key, peer.PublicKey, sizeof(endpoint.public_key));
+      endpoint.address = peer.Endpoint;
+      endpoints.push_back(endpoint);
+    }
+  });
+  if (endpoints.empty()) {
+    return;
+  }
+  if (ReapplyEndpointsLocked(endpoints)) {
+    logger_->info("Set {} endpoints again for a handshake after resuming from sleep", endpoints.size());
+  } else {
+    logger_->warn("Failed to set endpoints again after resuming from sleep");
+  }
+}
+
+void WireguardAdapter::SwitchEndpoint(const BYTE *public_key, const SOCKADDR_INET &endpoint) {
+  // Like ReapplyEndpoints; the failover checks the peer again on its next round
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+  WireguardConfigBuffer update;
+  WIREGUARD_PEER &peer = update.AppendPeer();
+  peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_UPDATE | WIREGUARD_PEER_HAS_PUBLIC_KEY |
+                                                WIREGUARD_PEER_HAS_ENDPOINT);
+  memcpy(peer.PublicKey, public_key, sizeof(peer.PublicKey));
+  peer.Endpoint = endpoint;
+  if (!SetConfiguration(update.Data(), update.Size())) {
+    logger_->warn("Failed to switch a peer to another of its endpoints");
+    return;
+  }
+
+  // A later path change sets the endpoint in use again, not the one that was configured
+  EndpointPathWatcher::Endpoint watched;
+  memcpy(watched.public_key, public_key, sizeof(watched.public_key));
+  watched.address = endpoint;
+  path_watcher_.AddEndpoint(watched);
+}
+
+void WireguardAdapter::StartKeepaliveTuningLocked() {
+  std::vector<KeepaliveTuning::Peer> tuned_peers;
+  for (const AutoKeepalive &keepalive : parsed_config_->GetAutoKeepalives()) {
+    const auto *peer =
+        reinterpret_cast<const WIREGUARD_PEER *>(parsed_config_->GetConfiguration().At(keepalive.peer_offset));
+    KeepaliveTuning::Peer tuned_peer;
+    memcpy(tuned_peer.public_key, peer->PublicKey, sizeof(tuned_peer.public_key));
+    tuned_peer.min = keepalive.min;
+    tuned_peer.max = keepalive.max;
+    tuned_peer.current = peer->PersistentKeepalive;
+    tuned_peers.push_back(tuned_peer);
+  }
+  if (!tuned_peers.empty()) {
+    logger_->info("Tuning the keepalive of {} peers", tuned_peers.size());
+  }
+  keepalive_tuning_.Start(
+      tuned_peers, [this](std::vector<PeerStatistics> *peers) { return GetPeerCounters(peers); },
+      [this](const BYTE *public_key, WORD keepalive) { return SetTunedKeepalive(public_key, keepalive); });
+}
+
+bool WireguardAdapter::SetTunedKeepalive(const BYTE *public_key, WORD keepalive) {
+  // Exclusive, as parsed_config_ is patched too; only tried, as the tuning is stopped with the lock held
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return false;
+  }
+  WireguardConfigBuffer update;
+  WIREGUARD_PEER &peer = update.AppendPeer();
+  peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_UPDATE | WIREGUARD_PEER_HAS_PUBLIC_KEY |
+                                                WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
+  memcpy(peer.PublicKey, public_key, sizeof(peer.PublicKey));
+  peer.PersistentKeepalive = keepalive;
+  if (!SetConfiguration(update.Data(), update.Size())) {
+    logger_->warn("Failed to set the tuned keepalive on a peer");
+    return false;
+  }
+  // So that drift checks, deltas and the warm-up restore start from the keepalive the peer has
+  if (parsed_config_.has_value()) {
+    parsed_config_->SetTunedKeepalive(public_key, keepalive);
+  }
   return true;
 }
 
-bool WireguardAdapter::ConfigureNetworking() {
-  logger_->info("Configuring network interface for adapter: {}", WideToUtf8(name_));
+bool WireguardAdapter::StagePeerActivation(const ActivationOptions &options, PeerActivation::Progress progress) {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  if (!parsed_config_.has_value() || options.batch_size == 0) {
+    return true;
+  }
+  const WireguardConfigBuffer &config = parsed_config_->GetConfiguration();
+  size_t total = config.Interface().PeersCount;
+  if (total <= options.batch_size) {
+    return true;
+  }
+  if (GetState() == WIREGUARD_ADAPTER_STATE_UP) {
+    logger_->info("Adapter {} is already up, its {} peers are not staged", WideAsUtf8(name_).view(), total);
+    return true;
+  }
+
+  // The driver keeps the peers' handshakes while the adapter is down, which tells the sessions last in use
+  std::unordered_map<PeerKey, uint64_t, PeerKeyHash> handshakes;
+  ForEachDriverPeer([&handshakes](const WIREGUARD_PEER &peer) {
+    if (peer.LastHandshake != 0) {
+      PeerKey key;
+      memcpy(key.data(), peer.PublicKey, key.size());
+      handshakes[key] = FiletimeToUnixMillis(peer.LastHandshake);
+    }
+  });
+  std::unordered_map<PeerKey, int32_t, PeerKeyHash> ranks;
+  for (size_t i = 0; i < options.priority.size(); i++) {
+    ranks.emplace(options.priority[i], static_cast<int32_t>(i));
+  }
+  std::vector<PeerKey> keys;
+  std::vector<ActivationSchedule::Peer> peers;
+  keys.reserve(total);
+  peers.reserve(total);
+  config.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *, DWORD) {
+    PeerKey &key = keys.emplace_back();
+    memcpy(key.data(), peer.PublicKey, key.size());
+    ActivationSchedule::Peer &scheduled = peers.emplace_back();
+    if (auto rank = ranks.find(key); rank != ranks.end()) {
+      scheduled.priority = rank->second;
+    }
+    if (auto handshake = handshakes.find(key); handshake != handshakes.end()) {
+      scheduled.last_handshake_ms = handshake->second;
+    }
+  });
+
+  ActivationSchedule schedule(peers, options.batch_size);
+  std::unordered_set<PeerKey, PeerKeyHash> first;
+  for (uint32_t index : schedule.Next()) {
+    first.insert(keys[index]);
+  }
+  // The interface as configured with the first batch only, replacing the peers the driver has
+  WireguardConfigBuffer staged;
+  staged.Interface() = config.Interface();
+  staged.Interface().PeersCount = 0;
+  config.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+    PeerKey key;
+    memcpy(key.data(), peer.PublicKey, key.size());
+    if (first.count(key) == 0) {
+      return;
+    }
+    staged.AppendPeer() = peer;
+    staged.CurrentPeer().AllowedIPsCount = 0;
+    for (DWORD i = 0; i < count; i++) {
+      staged.AppendAllowedIP(allowed_ips[i]);
+    }
+  });
+  if (!SetConfiguration(staged.Data(), staged.Size())) {
+    logger_->error("Failed to stage the peers of adapter {}", WideAsUtf8(name_).view());
+    return false;
+  }
+
+  std::vector<std::vector<PeerKey>> batches;
+  for (std::vector<uint32_t> batch = schedule.Next(); !batch.empty(); batch = schedule.Next()) {
+    std::vector<PeerKey> &batch_keys = batches.emplace_back();
+    for (uint32_t index : batch) {
+      batch_keys.push_back(keys[index]);
+    }
+  }
+  logger_->info("Adapter {} comes up with {} of {} peers, the others follow {} every {} ms",
+                WideAsUtf8(name_).view(), first.size(), total, options.batch_size, options.interval.count());
+  activation_.Start(
+      std::move(batches), first.size(), total, options.interval,
+      [this](const std::vector<PeerKey> &batch, size_t *added) { return AddActivationBatch(batch, added); },
+      std::move(progress));
+  return true;
+}
+
+bool WireguardAdapter::CancelPeerActivation() {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  if (!activation_.IsRunning()) {
+    return true;
+  }
+  activation_.Stop();
+  if (!parsed_config_.has_value()) {
+    return true;
+  }
+  const WireguardConfigBuffer &config = parsed_config_->GetConfiguration();
+  if (!SetConfiguration(config.Data(), config.Size())) {
+    logger_->error("Failed to give adapter {} its staged peers", WideAsUtf8(name_).view());
+    return false;
+  }
+  return true;
+}
+
+void WireguardAdapter::StopCallbacks() {
+  // Not under operation_mutex_, the waiter's restore takes it
+  handshake_waiter_.Stop();
+  activation_.Stop();
+}
+
+bool WireguardAdapter::AddActivationBatch(const std::vector<PeerKey> &batch, size_t *added) {
+  // Only tried, as the activation is stopped with the lock held; a batch that did not get it is retried
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return false;
+  }
+  // Kept while the activation runs; peers removed since are not in it any more
+  *added = 0;
+  if (!parsed_config_.has_value()) {
+    return true;
+  }
+  const WireguardConfigBuffer &config = parsed_config_->GetConfiguration();
+  std::unordered_set<PeerKey, PeerKeyHash> keys(batch.begin(), batch.end());
+
+  // Endpoint hostnames resolved since the configuration was applied only went to the peers the driver had
+  std::unordered_map<PeerKey, SOCKADDR_INET, PeerKeyHash> resolved;
+  for (const auto &hostname_endpoint : parsed_config_->GetHostnameEndpoints()) {
+    const auto *peer = reinterpret_cast<const WIREGUARD_PEER *>(config.At(hostname_endpoint.peer_offset));
+    PeerKey key;
+    memcpy(key.data(), peer->PublicKey, key.size());
+    SOCKADDR_INET address;
+    if (!(peer->Flags & WIREGUARD_PEER_HAS_ENDPOINT) && keys.count(key) != 0 &&
+        LookUpEndpoint(hostname_endpoint.host, address)) {
+      resolved[key] = WithPort(address, hostname_endpoint.port);
+    }
+  }
+
+  WireguardConfigBuffer update;
+  config.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+    PeerKey key;
+    memcpy(key.data(), peer.PublicKey, key.size());
+    if (keys.count(key) == 0) {
+      return;
+    }
+    WIREGUARD_PEER &added = update.AppendPeer();
+    added = peer;
+    added.AllowedIPsCount = 0;
+    if (auto endpoint = resolved.find(key); endpoint != resolved.end()) {
+      added.Flags = static_cast<WIREGUARD_PEER_FLAG>(added.Flags | WIREGUARD_PEER_HAS_ENDPOINT);
+      added.Endpoint = endpoint->second;
+    }
+    for (DWORD i = 0; i < count; i++) {
+      update.AppendAllowedIP(allowed_ips[i]);
+    }
+  });
+  if (update.Interface().PeersCount > 0 && !SetConfiguration(update.Data(), update.Size())) {
+    logger_->warn("Failed to activate {} peers, trying again", update.Interface().PeersCount);
+    return false;
+  }
+  *added = update.Interface().PeersCount;
+  return true;
+}
+
+bool WireguardAdapter::ReadDriverConfigLocked(DWORD *bytes) const {
+  if (!IsValid() || !library_->IsLoaded()) {
+    return false;
+  }
+
+  // Room for a few peers to start with, peers change size with their allowed IPs
+  if (driver_config_.empty()) {
+    DWORD initial = sizeof(WIREGUARD_INTERFACE) + 4 * (sizeof(WIREGUARD_PEER) + 4 * sizeof(WIREGUARD_ALLOWED_IP));
+    driver_config_.resize((initial + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  }
+  while (true) {
+    *bytes = static_cast<DWORD>(driver_config_.size() * sizeof(uint64_t));
+    auto *config = reinterpret_cast<WIREGUARD_INTERFACE *>(driver_config_.data());
+    if (library_->GetConfiguration()(adapter_handle_, config, bytes)) {
+      return true;
+    }
+    if (GetLastError() != ERROR_MORE_DATA) {
+      return false;
+    }
+    driver_config_.resize((*bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  }
+}
+
+bool WireguardAdapter::ForEachDriverPeer(const std::function<void(const WIREGUARD_PEER &peer)> &visit) const {
+  std::lock_guard<std::mutex> lock(driver_config_mutex_);
+  DWORD bytes;
+  if (!ReadDriverConfigLocked(&bytes)) {
+    return false;
+  }
+
+  const BYTE *data = reinterpret_cast<const BYTE *>(driver_config_.data());
+  const auto *config = reinterpret_cast<const WIREGUARD_INTERFACE *>(data);
+  size_t offset = sizeof(WIREGUARD_INTERFACE);
+  for (DWORD i = 0; i < config->PeersCount && offset + sizeof(WIREGUARD_PEER) <= bytes; i++) {
+    const auto *peer = reinterpret_cast<const WIREGUARD_PEER *>(data + offset);
+    visit(*peer);
+    offset += sizeof(WIREGUARD_PEER) + peer->AllowedIPsCount * sizeof(WIREGUARD_ALLOWED_IP);
+  }
+  return true;
+}
+
+bool WireguardAdapter::VerifyConfiguration(ConfigurationDrift *drift) const {
+  std::shared_lock<std::shared_mutex> operation_lock(operation_mutex_);
+  if (!parsed_config_.has_value()) {
+    return false;
+  }
+
+  WireguardConfigBuffer actual;
+  {
+    std::lock_guard<std::mutex> lock(driver_config_mutex_);
+    DWORD bytes;
+    // Records keep 8-byte alignment, so the size the driver reports is whole words
+    if (!ReadDriverConfigLocked(&bytes) || !actual.Assign(driver_config_.data(), bytes)) {
+      return false;
+    }
+  }
+
+  DiffConfigurations(parsed_config_->GetConfiguration(), actual, drift);
+  return true;
+}
+
+bool WireguardAdapter::ReadDriverConfiguration(const std::function<void(const BYTE *data, DWORD bytes)> &visit) const {
+  std::lock_guard<std::mutex> lock(driver_config_mutex_);
+  DWORD bytes;
+  if (!ReadDriverConfigLocked(&bytes)) {
+    return false;
+  }
+  visit(reinterpret_cast<const BYTE *>(driver_config_.data()), bytes);
+  return true;
+}
+
+bool WireguardAdapter::GetTotals(Totals *totals) const {
+  if (!totals) {
+    return false;
+  }
+  *totals = Totals();
+  bool read = ForEachDriverPeer([totals](const WIREGUARD_PEER &peer) {
+    totals->rx_bytes += peer.RxBytes;
+    totals->tx_bytes += peer.TxBytes;
+    if (peer.LastHandshake > totals->last_handshake) {
+      totals->last_handshake = peer.LastHandshake;
+    }
+  });
+  if (read) {
+    RememberHandshake(totals->last_handshake);
+  }
+  return read;
+}
+
+std::optional<uint64_t> WireguardAdapter::GetRecentHandshake(std::chrono::milliseconds max_age) const {
+  int64_t read_ns = recent_handshake_read_ns_.load(std::memory_order_acquire);
+  int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                       .count();
+  if (read_ns == 0 || now_ns - read_ns > std::chrono::duration_cast<std::chrono::nanoseconds>(max_age).count()) {
+    return std::nullopt;
+  }
+  return recent_handshake_.load(std::memory_order_relaxed);
+}
+
+std::optional<uint64_t> WireguardAdapter::GetKnownHandshake() const {
+  if (recent_handshake_read_ns_.load(std::memory_order_acquire) == 0) {
+    return std::nullopt;
+  }
+  return recent_handshake_.load(std::memory_order_relaxed);
+}
+
+void WireguardAdapter::RememberHandshake(uint64_t last_handshake) const {
+  recent_handshake_.store(last_handshake, std::memory_order_relaxed);
+  recent_handshake_read_ns_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now().time_since_epoch())
+                                      .count(),
+                                  std::memory_order_release);
+}
+
+bool WireguardAdapter::GetPeerCounters(std::vector<PeerStatistics> *peers,
+                                       std::vector<SOCKADDR_INET> *endpoints) const {
+  if (!peers) {
+    return false;
+  }
+  peers->clear();
+  if (endpoints) {
+    endpoints->clear();
+  }
+  uint64_t last_handshake = 0;
+  bool read = ForEachDriverPeer([peers, endpoints, &last_handshake](const WIREGUARD_PEER &peer) {
+    if (endpoints) {
+      endpoints->push_back((peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) ? peer.Endpoint : SOCKADDR_INET{});
+    }
+    PeerStatistics statistics;
+    memcpy(statistics.public_key.data(), peer.PublicKey, WIREGUARD_KEY_LENGTH);
+    statistics.rx_bytes = peer.RxBytes;
+    statistics.tx_bytes = peer.TxBytes;
+    statistics.last_handshake_ms = FiletimeToUnixMillis(peer.LastHandshake);
+    statistics.persistent_keepalive = peer.PersistentKeepalive;
+    peers->push_back(statistics);
+    last_handshake = (std::max)(last_handshake, static_cast<uint64_t>(peer.LastHandshake));
+  });
+  if (read) {
+    RememberHandshake(last_handshake);
+  }
+  return read;
+}
+
+std::vector<WireguardAdapter::EndpointRoam>
+WireguardAdapter::TrackEndpoints(const std::vector<PeerStatistics> &peers,
+                                 const std::vector<SOCKADDR_INET> &endpoints) {
+  std::vector<EndpointRoam> roams;
+  // Replaced networking starts from the configured endpoints, which the next call sees
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_, std::try_to_lock);
+  if (!lock.owns_lock() || !networking_configured_ || peers.size() != endpoints.size()) {
+    return roams;
+  }
+  std::lock_guard<std::mutex> endpoints_lock(peer_endpoints_mutex_);
+  uint64_t generation = config_generation_;
+  if (generation != peer_endpoints_generation_) {
+    peer_endpoints_.clear();
+    peer_endpoints_generation_ = generation;
+  }
+
+  std::unordered_map<PeerKey, SOCKADDR_INET, PeerKeyHash> current;
+  current.reserve(peers.size());
+  for (size_t index = 0; index < peers.size(); index++) {
+    const SOCKADDR_INET &endpoint = endpoints[index];
+    if (endpoint.si_family != AF_INET && endpoint.si_family != AF_INET6) {
+      continue;
+    }
+    const PeerKey &public_key = peers[index].public_key;
+    current.emplace(public_key, endpoint);
+    auto previous = peer_endpoints_.find(public_key);
+    if (previous != peer_endpoints_.end() && SameEndpoint(previous->second, endpoint)) {
+      continue;
+    }
+    // Also for a peer seen the first time, which may have roamed before; an endpoint already pinned stays as it is
+    bypass_routes_.AddEndpoint(endpoint, generation);
+    if (previous == peer_endpoints_.end()) {
+      continue;
+    }
+    kill_switch_.AddEndpoint(endpoint);
+    EndpointPathWatcher::Endpoint watched;
+    memcpy(watched.public_key, public_key.data(), sizeof(watched.public_key));
+    watched.address = endpoint;
+    path_watcher_.AddEndpoint(watched);
+    roams.push_back({public_key, previous->second, endpoint});
+  }
+
+  // Only once every peer's move is known, as two peers may share an address
+  for (const EndpointRoam &roam : roams) {
+    if (SameAddress(roam.previous, roam.current)) {
+      continue;
+    }
+    bool in_use = std::any_of(current.begin(), current.end(),
+                              [&roam](const auto &entry) { return SameAddress(entry.second, roam.previous); });
+    if (!in_use) {
+      bypass_routes_.RemoveEndpoint(roam.previous, generation);
+    }
+  }
+  peer_endpoints_ = std::move(current);
+  if (!roams.empty()) {
+    logger_->info("{} peer endpoints roamed", roams.size());
+  }
+  return roams;
+}
+
+bool WireguardAdapter::GetCounterSnapshot(CounterSnapshot *snapshot) {
+  if (!snapshot || !GetPeerStatistics(&snapshot->peers)) {
+    return false;
+  }
+
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  snapshot->time = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+  return GetInterfaceCounters(&snapshot->interface_counters);
+}
+
+bool WireguardAdapter::GetInterfaceCounters(InterfaceCounters *counters) const {
+  NET_LUID luid;
+  if (!counters || !GetLUID(&luid)) {
+    return false;
+  }
+
+  MIB_IF_ROW2 row = {};
+  row.InterfaceLuid = luid;
+  DWORD result = GetIfEntry2(&row);
+  if (result != NO_ERROR) {
+    SetLastError(result);
+    return false;
+  }
+  counters->in_octets = row.InOctets;
+  counters->out_octets = row.OutOctets;
+  counters->in_packets = row.InUcastPkts + row.InNUcastPkts;
+  counters->out_packets = row.OutUcastPkts + row.OutNUcastPkts;
+  counters->in_discards = row.InDiscards;
+  counters->out_discards = row.OutDiscards;
+  counters->in_errors = row.InErrors;
+  counters->out_errors = row.OutErrors;
+  return true;
+}
+
+bool WireguardAdapter::GetPeerStatistics(std::vector<PeerStatistics> *peers) {
+  if (!GetPeerCounters(peers)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(peer_rates_mutex_);
+  peer_rates_.Update(*peers, PerfCounterMicroseconds());
+  return true;
+}
+
+uint64_t WireguardAdapter::GetLatestHandshake() const {
+  Totals totals;
+  return GetTotals(&totals) ? totals.last_handshake : 0;
+}
+
+void WireguardAdapter::TimeFirstHandshake(HandshakeWaiter::Done done, bool warm_up) {
+  HandshakeWaiter::Finished finished;
+  // Released before the waiter starts, which waits for the restore of the one before
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  if (warm_up && parsed_config_.has_value()) {
+    // Both updates are built here, the restore runs on the waiting thread while a new configuration may go in
+    WireguardConfigBuffer warm;
+    auto restore = std::make_shared<WireguardConfigBuffer>();
+    parsed_config_->GetConfiguration().ForEachPeer(
+        [&warm, &restore](const WIREGUARD_PEER &configured, const WIREGUARD_ALLOWED_IP *, DWORD) {
+          auto flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_UPDATE | WIREGUARD_PEER_HAS_PUBLIC_KEY |
+                                                        WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
+          WIREGUARD_PEER &warm_peer = warm.AppendPeer();
+          warm_peer.Flags = flags;
+          memcpy(warm_peer.PublicKey, configured.PublicKey, sizeof(warm_peer.PublicKey));
+          warm_peer.PersistentKeepalive = kWarmUpKeepalive;
+
+          WIREGUARD_PEER &restored_peer = restore->AppendPeer();
+          restored_peer.Flags = flags;
+          memcpy(restored_peer.PublicKey, configured.PublicKey, sizeof(restored_peer.PublicKey));
+          restored_peer.PersistentKeepalive =
+              (configured.Flags & WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE) ? configured.PersistentKeepalive : 0;
+        });
+    // The driver sends a keepalive as soon as it is set, which starts the handshake
+    if (warm.Interface().PeersCount > 0 && SetConfiguration(warm.Data(), warm.Size())) {
+      logger_->info("Warming up {} peers with keepalives until the first handshake", warm.Interface().PeersCount);
+      uint64_t generation = config_generation_;
+      finished = [this, restore, generation]() {
+        std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+        // A configuration applied since replaced every peer, and the warm keepalives with them
+        if (generation != config_generation_) {
+          return;
+        }
+        // Peers changed, tuned or probed since have their keepalive in the parse now, and removed ones are not
+        // added back; a released parse leaves the keepalives they had when the warm-up started
+        const WireguardConfigBuffer *update = restore.get();
+        WireguardConfigBuffer current;
+        if (parsed_config_.has_value()) {
+          std::unordered_map<PeerKey, WORD, PeerKeyHash> keepalives;
+          parsed_config_->GetConfiguration().ForEachPeer(
+              [&keepalives](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *, DWORD) {
+                PeerKey key;
+                memcpy(key.data(), peer.PublicKey, key.size());
+                bool has_keepalive = peer.Flags & WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE;
+                keepalives[key] = has_keepalive ? peer.PersistentKeepalive : 0;
+              });
+          restore->ForEachPeer([&keepalives, &current](const WIREGUARD_PEER &restored, const WIREGUARD_ALLOWED_IP *,
+                                                       DWORD) {
+            PeerKey key;
+            memcpy(key.data(), restored.PublicKey, key.size());
+            auto keepalive = keepalives.find(key);
+            if (keepalive != keepalives.end()) {
+              WIREGUARD_PEER &peer = current.AppendPeer();
+              peer = restored;
+              peer.PersistentKeepalive = keepalive->second;
+            }
+          });
+          update = &current;
+        }
+        if (update->Interface().PeersCount > 0 && !SetConfiguration(update->Data(), update->Size())) {
+          logger_->warn("Failed to restore the configured keepalives after warming up");
+        }
+      };
+    }
+  }
+  lock.unlock();
+  handshake_waiter_.Start([this](uint64_t since) { return GetLatestHandshake() > since; }, std::move(done),
+                          std::move(finished));
+}
+
+void WireguardAdapter::SetProbing(bool probing) {
+  // Exclusive, as parsed_config_ is patched too
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  if (!probing && probed_peers_.empty()) {
+    return;
+  }
+  WireguardConfigBuffer update;
+  std::vector<PeerKey> keys;
+  ForEachDriverPeer([this, probing, &update, &keys](const WIREGUARD_PEER &driver_peer) {
+    PeerKey key;
+    memcpy(key.data(), driver_peer.PublicKey, key.size());
+    // A keepalive set since, by a new configuration or the tuning, is left alone
+    bool change = probing ? driver_peer.PersistentKeepalive == 0
+                          : probed_peers_.count(key) != 0 && driver_peer.PersistentKeepalive == kProbeKeepalive;
+    if (!change) {
+      return;
+    }
+    WIREGUARD_PEER &peer = update.AppendPeer();
+    peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_UPDATE | WIREGUARD_PEER_HAS_PUBLIC_KEY |
+                                                  WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
+    memcpy(peer.PublicKey, driver_peer.PublicKey, sizeof(peer.PublicKey));
+    peer.PersistentKeepalive = probing ? kProbeKeepalive : 0;
+    keys.push_back(key);
+  });
+  if (!probing) {
+    probed_peers_.clear();
+  }
+  if (keys.empty()) {
+    return;
+  }
+  if (!SetConfiguration(update.Data(), update.Size())) {
+    logger_->warn("Failed to {} probing the {} peers of adapter {}", probing ? "start" : "stop", keys.size(),
+                  WideAsUtf8(name_).view());
+    return;
+  }
+  std::unordered_set<PeerKey, PeerKeyHash> changed(keys.begin(), keys.end());
+  if (probing) {
+    probed_peers_.insert(keys.begin(), keys.end());
+  }
+  // So that drift checks, deltas and the warm-up restore start from the keepalive the peers have
+  if (parsed_config_.has_value()) {
+    parsed_config_->SetKeepalives(
+        [&changed](const BYTE *public_key) {
+          PeerKey key;
+          memcpy(key.data(), public_key, key.size());
+          return changed.count(key) != 0;
+        },
+        probing ? kProbeKeepalive : 0);
+  }
+  logger_->info("{} probing {} peers of adapter {} with keepalives", probing ? "Started" : "Stopped", keys.size(),
+                WideAsUtf8(name_).view());
+}
+
+bool WireguardAdapter::IsConfigurationApplied(const std::string &config_text) const {
+  std::shared_lock<std::shared_mutex> lock(operation_mutex_);
+  return networking_configured_ && IsCurrentText(WireguardConfigParser::HashText(config_text), config_text.size());
+}
+
+bool WireguardAdapter::IsConfigurationApplied(const WireguardConfigParser &parser) const {
+  std::shared_lock<std::shared_mutex> lock(operation_mutex_);
+  return networking_configured_ && IsCurrentText(parser.GetTextHash(), parser.GetTextSize());
+}
+
+bool WireguardAdapter::IsCurrentText(uint64_t text_hash, size_t text_size) const {
+  if (config_released_) {
+    return released_text_hash_ == text_hash && released_text_size_ == text_size;
+  }
+  return parsed_config_.has_value() && parsed_config_->GetTextHash() == text_hash &&
+         parsed_config_->GetTextSize() == text_size;
+}
+
+void WireguardAdapter::SetParsedConfigLocked(std::optional<WireguardConfigParser> config) {
+  parsed_config_ = std::move(config);
+  config_released_ = false;
+  parsed_config_bytes_ = parsed_config_.has_value() ? parsed_config_->MemoryBytes() : 0;
+}
+
+void WireguardAdapter::ReleaseAppliedConfiguration() {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  // Networking that still has to be configured needs the parse, and so do the peers still to be activated
+  if (!parsed_config_.has_value() || !networking_configured_ || activation_.IsRunning()) {
+    return;
+  }
+  released_text_hash_ = parsed_config_->GetTextHash();
+  released_text_size_ = parsed_config_->GetTextSize();
+  size_t released_bytes = parsed_config_->MemoryBytes();
+  parsed_config_.reset();
+  config_released_ = true;
+  parsed_config_bytes_ = 0;
+  // Only a peer change needs it, which a released configuration has to be replaced for
+  route_set_.Clear();
+  logger_->info("Released the parsed configuration of adapter {}, {} bytes", WideAsUtf8(name_).view(),
+                released_bytes);
+}
+
+void WireguardAdapter::GetMemoryUsage(MemoryUsage *usage) const {
+  *usage = MemoryUsage();
+  usage->parsed_config_bytes = parsed_config_bytes_;
+  {
+    std::lock_guard<std::mutex> lock(driver_config_mutex_);
+    usage->wire_buffer_bytes = driver_config_.capacity() * sizeof(uint64_t);
+  }
+  std::shared_lock<std::shared_mutex> lock(operation_mutex_, std::try_to_lock);
+  if (lock.owns_lock() && resolver_) {
+    usage->cache_bytes = resolver_->CacheBytes();
+  }
+}
+
+void WireguardAdapter::SetKillSwitchEnabled(bool enabled) {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  if (enabled != kill_switch_enabled_) {
+    kill_switch_enabled_ = enabled;
+    networking_configured_ = false;
+  }
+}
+
+bool WireguardAdapter::ConfigureNetworking(PhaseTimer *timer) {
+  logger_->info("Configuring network interface for adapter: {}", WideAsUtf8(name_).view());
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
 
   if (!parsed_config_.has_value()) {
     logger_->error("No parsed configuration available for network setup");
@@ -167,46 +1291,282 @@ bool WireguardAdapter::ConfigureNetworking() {
     return false;
   }
 
+  if (networking_configured_) {
+    logger_->info("Network interface already configured for the current configuration");
+    return true;
+  }
+
   NET_LUID luid;
   if (!GetLUID(&luid)) {
     logger_->error("Failed to get adapter LUID for network configuration");
     return false;
   }
 
-  WireguardNetworkConfig net_config(luid);
+  // Every change is logged, so a failure part way reverses just those and a retry starts from where this
+  // call began instead of from a full cleanup
+  NetworkUndoLog undo_log;
+  WireguardNetworkConfig net_config(luid, &network_ledger_, &undo_log);
   const auto &interface_config = parsed_config_->GetInterface();
+  auto roll_back = [this, &net_config, &undo_log]() {
+    mtu_prober_.Stop();
+    endpoint_failover_.Stop();
+    keepalive_tuning_.Stop();
+    path_watcher_.Stop();
+    if (undo_log.dns_changed) {
+      dns_configured_ = false;
+    }
+    if (!net_config.Rollback(undo_log)) {
+      logger_->warn("Network configuration was not fully rolled back");
+    }
+    // After the tunnel routes, as in CleanupNetworking; filters or bypass routes left behind would block or divert
+    // the endpoints' traffic with no tunnel to need it
+    bypass_routes_.Stop();
+    kill_switch_.Stop();
+    return false;
+  };
+  // Once the setup was cancelled or ran out of time, between phases, with the reason as the last error
+  auto abandoned = [this, timer, &roll_back]() {
+    DWORD reason = timer ? timer->Abandoned() : ERROR_SUCCESS;
+    if (reason == ERROR_SUCCESS) {
+      return false;
+    }
+    logger_->warn("Network configuration abandoned, rolling back");
+    roll_back();
+    SetLastError(reason);
+    return true;
+  };
+
+  // The allowed IPs of all peers, aggregated
+  std::shared_ptr<const SharedRoutes> shared_routes = parsed_config_->GetRoutes();
+  const std::vector<WIREGUARD_ALLOWED_IP> &routes = shared_routes->routes;
+  AssignRoutes(route_set_, shared_routes->allowed_ips);
+  AddressFamilies families = AddressFamilies::Of(interface_config.addresses, routes);
+  net_config.SetFamilies(families);
 
+  // MTU, metric, router discovery and DAD go out together, in one interface entry update per family
   logger_->info("Configuring MTU to {}", interface_config.mtu);
-  if (!net_config.ConfigureMTU(interface_config.mtu)) {
-    logger_->error("Failed to configure MTU");
+  if (!net_config.ConfigureInterface(interface_config.mtu, interface_config.profile)) {
+    logger_->error("Failed to configure interface");
+    return roll_back();
+  }
+  if (timer) {
+    timer->Lap("interface");
+  }
+  if (abandoned()) {
     return false;
   }
 
   logger_->info("Configuring IP addresses");
-  if (!net_config.ConfigureIPAddresses(interface_config.addresses)) {
+  if (!net_config.ReconcileIPAddresses(interface_config.addresses)) {
     logger_->error("Failed to configure IP addresses");
+    return roll_back();
+  }
+  if (timer) {
+    timer->Lap("addresses");
+  }
+  if (abandoned()) {
     return false;
   }
 
-  // Extract allowed IPs from all peers and configure routes
-  std::vector<WIREGUARD_ALLOWED_IP> all_allowed_ips;
-  const auto &peers = parsed_config_->GetPeers();
-  for (const auto &peer : peers) {
-    all_allowed_ips.insert(all_allowed_ips.end(), peer.allowed_ips.begin(), peer.allowed_ips.end());
+  if (shared_routes->default_split) {
+    logger_->info("Routing the default route as two /1 halves");
+  }
+
+  // Pinned before the routes go in, so handshakes never detour through the tunnel itself
+  ConfiguredEndpoints configured_endpoints;
+  CollectEndpointsLocked(&configured_endpoints);
+  const std::vector<SOCKADDR_INET> &endpoints = configured_endpoints.addresses;
+  const std::vector<EndpointPathWatcher::Endpoint> &watched_endpoints = configured_endpoints.watched;
+  const std::vector<EndpointFailover::Peer> &failover_peers = configured_endpoints.failover_peers;
+  if (!bypass_routes_.Start(luid, shared_routes, endpoints, config_generation_)) {
+    logger_->warn("Endpoint bypass routes will not follow network changes");
+  }
+  auto reapply = [this](const std::vector<EndpointPathWatcher::Endpoint> &moved) { ReapplyEndpoints(moved); };
+  if (!path_watcher_.Start(luid, watched_endpoints, reapply)) {
+    logger_->warn("Network path changes will not trigger a handshake");
+  }
+  if (!failover_peers.empty()) {
+    logger_->info("Probing the endpoints of {} peers with alternates", failover_peers.size());
+  }
+  endpoint_failover_.Start(
+      failover_peers, [this](std::vector<PeerStatistics> *peers) { return GetPeerCounters(peers); },
+      [this](const BYTE *public_key, const SOCKADDR_INET &endpoint) { SwitchEndpoint(public_key, endpoint); });
+  StartKeepaliveTuningLocked();
+
+  // Before the routes, so nothing leaks while they go in. A kill switch that was asked for and cannot be
+  // installed fails the setup rather than leave traffic unprotected.
+  if (kill_switch_enabled_) {
+    if (!kill_switch_.Start(luid, endpoints)) {
+      logger_->error("Failed to install the kill switch");
+      return roll_back();
+    }
+  } else {
+    kill_switch_.Stop();
+  }
+
+  // The configured MTU stays in place until the probe has measured the paths
+  if (interface_config.mtu_auto) {
+    logger_->info("Probing the path MTU to {} endpoints", endpoints.size());
+    auto apply_mtu = [luid, families, logger = logger_](DWORD mtu) {
+      WireguardNetworkConfig mtu_config(luid);
+      mtu_config.SetFamilies(families);
+      if (!mtu_config.ConfigureMTU(mtu)) {
+        logger->warn("Failed to apply probed MTU {}", mtu);
+      }
+    };
+    if (!mtu_prober_.Start(luid, endpoints, apply_mtu)) {
+      logger_->warn("Path MTU will not be probed again on network changes");
+    }
+  } else {
+    mtu_prober_.Stop();
   }
 
-  logger_->info("Configuring routes");
-  if (!net_config.ConfigureRoutes(all_allowed_ips)) {
+  logger_->info("Configuring {} routes for {} allowed IPs", routes.size(), configured_endpoints.allowed_ip_count);
+  if (!net_config.ReconcileRoutes(routes)) {
     logger_->error("Failed to configure routes");
+    return roll_back();
+  }
+  if (timer) {
+    timer->Lap("routes");
+  }
+  if (abandoned()) {
     return false;
   }
 
+  // With SplitDNS only names in those domains go to the tunnel's servers, through NRPT rules; the interface gets
+  // no servers of its own, so every other lookup stays with the local resolver
+  bool split_dns = !interface_config.dns_split_domains.empty() && !interface_config.dns_servers.empty();
+  const std::vector<SOCKADDR_INET> no_servers;
+  const std::vector<SOCKADDR_INET> &interface_servers = split_dns ? no_servers : interface_config.dns_servers;
+  bool has_dns = !interface_servers.empty() || !interface_config.dns_search_domains.empty();
+  if (has_dns || dns_configured_) {
+    logger_->info("Configuring DNS");
+    if (!net_config.ConfigureDNS(interface_servers, interface_config.dns_search_domains)) {
+      logger_->error("Failed to configure DNS");
+      return roll_back();
+    }
+    dns_configured_ = has_dns;
+    if (timer) {
+      timer->Lap("dns");
+    }
+  }
+  if (!interface_config.dns_split_domains.empty() && interface_config.dns_servers.empty()) {
+    logger_->warn("SplitDNS is ignored without DNS servers");
+  }
+  // Also once to find rules left behind by an earlier run, which the ledger then knows of
+  if (split_dns || !network_ledger_.nrpt_rules_known || !network_ledger_.nrpt_rules.empty()) {
+    static const std::vector<std::string> kNoDomains;
+    if (!net_config.ConfigureNrptRules(split_dns ? interface_config.dns_split_domains : kNoDomains,
+                                       split_dns ? interface_config.dns_servers : no_servers)) {
+      logger_->error("Failed to configure split DNS");
+      return roll_back();
+    }
+    if (timer && split_dns) {
+      timer->Lap("splitDns");
+    }
+  }
+
+  // The tunnel's own datagrams are told apart by the port they are sent from, which only ListenPort fixes
+  const std::vector<QosRule> &qos_rules = interface_config.qos_rules;
+  WORD qos_port = interface_config.has_listen_port ? interface_config.listen_port : 0;
+  bool has_tunnel_rule =
+      std::any_of(qos_rules.begin(), qos_rules.end(), [](const QosRule &rule) { return rule.tunnel; });
+  if (qos_port == 0 && has_tunnel_rule) {
+    logger_->warn("QoS tunnel rules are ignored without a ListenPort");
+  }
+  if (!qos_rules.empty() || !network_ledger_.qos_policies_known || !network_ledger_.qos_policies.empty()) {
+    if (!net_config.ConfigureQosPolicies(qos_rules, qos_port, interface_config.addresses)) {
+      logger_->error("Failed to configure QoS policies");
+      return roll_back();
+    }
+    if (timer && !qos_rules.empty()) {
+      timer->Lap("qos");
+    }
+  }
+
+  networking_configured_ = true;
   logger_->info("Successfully configured network interface");
   return true;
 }
 
-bool WireguardAdapter::CleanupNetworking() {
-  logger_->info("Cleaning up network configuration for adapter: {}", WideToUtf8(name_));
+void WireguardAdapter::CollectEndpointsLocked(ConfiguredEndpoints *configured) const {
+  std::vector<SOCKADDR_INET> &endpoints = configured->addresses;
+  std::vector<EndpointPathWatcher::Endpoint> &watched_endpoints = configured->watched;
+  parsed_config_->GetConfiguration().ForEachPeer(
+      [&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *, DWORD allowed_ips) {
+        configured->allowed_ip_count += allowed_ips;
+        if (peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) {
+          endpoints.push_back(peer.Endpoint);
+          EndpointPathWatcher::Endpoint watched;
+          memcpy(watched.public_key, peer.PublicKey, sizeof(watched.public_key));
+          watched.address = peer.Endpoint;
+          watched_endpoints.push_back(watched);
+        }
+      });
+  for (const auto &hostname_endpoint : parsed_config_->GetHostnameEndpoints()) {
+    SOCKADDR_INET address;
+    if (LookUpEndpoint(hostname_endpoint.host, address)) {
+      endpoints.push_back(WithPort(address, hostname_endpoint.port));
+      // The parsed configuration already has the endpoints that were cached when it was applied
+      const auto *peer = reinterpret_cast<const WIREGUARD_PEER *>(
+          parsed_config_->GetConfiguration().At(hostname_endpoint.peer_offset));
+      if (!(peer->Flags & WIREGUARD_PEER_HAS_ENDPOINT)) {
+        EndpointPathWatcher::Endpoint watched;
+        memcpy(watched.public_key, peer->PublicKey, sizeof(watched.public_key));
+        watched.address = WithPort(address, hostname_endpoint.port);
+        watched_endpoints.push_back(watched);
+      }
+    }
+  }
+  // Alternates are pinned and let through the kill switch as well, a failover must not have to wait for either
+  std::vector<EndpointFailover::Peer> &failover_peers = configured->failover_peers;
+  for (const auto &alternate : parsed_config_->GetAlternateEndpoints()) {
+    endpoints.push_back(alternate.address);
+    const auto *peer =
+        reinterpret_cast<const WIREGUARD_PEER *>(parsed_config_->GetConfiguration().At(alternate.peer_offset));
+    // Failover only moves between addresses; a hostname endpoint stays where its lookup put it
+    if (!(peer->Flags & WIREGUARD_PEER_HAS_ENDPOINT)) {
+      continue;
+    }
+    if (failover_peers.empty() ||
+        memcmp(failover_peers.back().public_key, peer->PublicKey, sizeof(peer->PublicKey)) != 0) {
+      EndpointFailover::Peer failover_peer;
+      memcpy(failover_peer.public_key, peer->PublicKey, sizeof(failover_peer.public_key));
+      failover_peer.candidates.push_back(peer->Endpoint);
+      failover_peers.push_back(std::move(failover_peer));
+    }
+    failover_peers.back().candidates.push_back(alternate.address);
+  }
+}
+
+bool WireguardAdapter::SetSplitTunnel(AppSplitTunnel::Mode mode, const std::vector<std::wstring> &apps,
+                                      std::string *error) {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  NET_LUID luid;
+  if (!GetLUID(&luid)) {
+    *error = "Failed to get adapter LUID";
+    return false;
+  }
+  return split_tunnel_.Apply(luid, mode, apps, error);
+}
+
+void WireguardAdapter::Recover(const NetworkLedger &ledger, bool dns_configured,
+                               std::optional<WireguardConfigParser> applied) {
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
+  network_ledger_ = ledger;
+  dns_configured_ = dns_configured;
+  if (applied) {
+    SetParsedConfigLocked(std::move(applied));
+    networking_configured_ = true;
+  }
+}
+
+bool WireguardAdapter::CleanupNetworking(const NetworkTableSnapshot *snapshot, bool tracked_only) {
+  if (service_owned_) {
+    return true;
+  }
+  logger_->info("Cleaning up network configuration for adapter: {}", WideAsUtf8(name_).view());
+  std::unique_lock<std::shared_mutex> lock(operation_mutex_);
 
   if (!IsValid()) {
     logger_->error("Adapter is not valid for network cleanup");
@@ -219,23 +1579,52 @@ bool WireguardAdapter::CleanupNetworking() {
     return false;
   }
 
-  WireguardNetworkConfig net_config(luid);
+  WireguardNetworkConfig net_config(luid, &network_ledger_);
+  networking_configured_ = false;
+  mtu_prober_.Stop();
 
   // Remove IP addresses and routes
   bool success = true;
 
   logger_->info("Removing IP addresses");
-  if (!net_config.RemoveIPAddresses()) {
+  if ((!tracked_only || network_ledger_.addresses_known) && !net_config.RemoveIPAddresses(snapshot)) {
     logger_->warn("Failed to remove some IP addresses");
     success = false;
   }
 
   logger_->info("Removing routes");
-  if (!net_config.RemoveRoutes()) {
+  if ((!tracked_only || network_ledger_.routes_known) && !net_config.RemoveRoutes(snapshot)) {
     logger_->warn("Failed to remove some routes");
     success = false;
   }
 
+  if (dns_configured_) {
+    logger_->info("Removing DNS settings");
+    if (net_config.RemoveDNS()) {
+      dns_configured_ = false;
+    } else {
+      logger_->warn("Failed to remove DNS settings");
+      success = false;
+    }
+  }
+
+  if ((!tracked_only || network_ledger_.nrpt_rules_known) && !net_config.RemoveNrptRules()) {
+    logger_->warn("Failed to remove NRPT rules");
+    success = false;
+  }
+
+  if ((!tracked_only || network_ledger_.qos_policies_known) && !net_config.RemoveQosPolicies()) {
+    logger_->warn("Failed to remove QoS policies");
+    success = false;
+  }
+
+  // Only once the tunnel routes are gone, as the bypass routes are what keeps the endpoints reachable
+  endpoint_failover_.Stop();
+  keepalive_tuning_.Stop();
+  path_watcher_.Stop();
+  bypass_routes_.Stop();
+  kill_switch_.Stop();
+
   if (success) {
     logger_->info("Successfully cleaned up network configuration");
   } else {
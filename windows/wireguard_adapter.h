@@ -2,30 +2,65 @@
 
 #include <windows.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "wireguard.h"
 #include "wireguard_library.h"
+#include "adapter_log.h"
 #include "wireguard_config_parser.h"
-
-namespace spdlog {
-class logger;
-} // namespace spdlog
+#include "wireguard_config_diff.h"
+#include "app_split_tunnel.h"
+#include "endpoint_bypass_routes.h"
+#include "endpoint_failover.h"
+#include "endpoint_path_watcher.h"
+#include "endpoint_resolver.h"
+#include "handshake_waiter.h"
+#include "keepalive_tuning.h"
+#include "kill_switch.h"
+#include "path_mtu_prober.h"
+#include "peer_activation.h"
+#include "peer_statistics.h"
+#include "perf_stats.h"
+#include "plugin_logger.h"
+#include "wireguard_network_config.h"
+#include "wireguard_core/ip_prefix.h"
 
 namespace wireguard_dart {
 
 /**
  * Represents a single WireGuard network adapter.
  * Manages the adapter lifecycle and provides methods for configuration.
+ *
+ * Calls that replace the applied configuration or the networking built from it (ApplyConfiguration,
+ * ConfigureNetworking, CleanupNetworking, Recover) hold the adapter's operation lock exclusively; the ones that read
+ * them, and the endpoint updates of the helper threads, share it. Statistics and status only read the driver, with
+ * the handle that stays open as long as the adapter is in the registry, so they never wait for a slow operation.
  */
 class WireguardAdapter {
 public:
+  /**
+   * Create the adapter, with the given GUID if there is one. With the same GUID every time, Windows finds the
+   * network profile of the earlier device again instead of classifying a new network.
+   */
   static std::unique_ptr<WireguardAdapter> Create(const std::shared_ptr<WireguardLibrary> &library,
                                                   const std::wstring &name,
-                                                  const std::wstring &tunnel_type = L"WireGuard");
+                                                  const std::wstring &tunnel_type = L"WireGuard",
+                                                  const GUID *requested_guid = nullptr);
+
+  // The GUID for a tunnel of an app, always the same for the same bundle ID and tunnel name
+  static GUID StableGuid(const std::string &bundle_id, const std::wstring &name);
 
   static std::unique_ptr<WireguardAdapter> Open(const std::shared_ptr<WireguardLibrary> &library,
                                                 const std::wstring &name);
@@ -42,32 +77,375 @@ public:
   const std::wstring &GetName() const { return name_; }
   bool IsValid() const { return adapter_handle_ != nullptr; }
 
+  // Opened on a tunnel that its service runs, see tunnel_service.h. The service configured the adapter and cleans
+  // it up when it stops, so CleanupNetworking leaves it alone.
+  void SetServiceOwned() { service_owned_ = true; }
+  bool IsServiceOwned() const { return service_owned_; }
+  // True for the first caller only, so that a handle gone stale with a restart of its service is reopened once
+  bool ClaimReopen() { return !reopen_claimed_.exchange(true); }
+
   // Adapter state management
   bool SetState(WIREGUARD_ADAPTER_STATE state);
   WIREGUARD_ADAPTER_STATE GetState() const;
+  // The state of the last SetState or GetState that reached the driver, without a driver read; unset before one
+  std::optional<WIREGUARD_ADAPTER_STATE> GetKnownState() const;
 
   // Configuration management
   bool SetConfiguration(const WIREGUARD_INTERFACE *config, DWORD bytes);
 
+  /**
+   * Runs a task on the tunnel's worker, with the tunnel's adapter then if it still has one. For work too slow for
+   * the system threads that call back, like racing the families of a resolved endpoint. Set before the first
+   * configuration is applied; without it that work is done on the thread that calls back.
+   */
+  using WorkerPost = std::function<void(std::function<void(WireguardAdapter *adapter)> task)>;
+  void SetWorkerPost(WorkerPost post) { worker_post_ = std::move(post); }
+
   // Utility methods
   bool GetLUID(NET_LUID *luid) const;
-  bool SetLogging(WIREGUARD_ADAPTER_LOG_STATE log_state);
 
-  // Configuration helper
-  bool ApplyConfiguration(const std::string &config_text);
+  /**
+   * Have the driver log about the adapter or not, see AdapterLogMode. Its lines go into a ring of the last
+   * AdapterLogs::kRingLines, which is kept across modes; adapters start with AdapterLogMode::kOn.
+   */
+  bool SetLogMode(AdapterLogMode mode);
+  AdapterLogMode GetLogMode() const {
+    std::shared_lock<std::shared_mutex> lock(operation_mutex_);
+    return log_mode_;
+  }
+  // The records of the driver log ring, oldest first
+  std::vector<spdlog::details::log_msg_buffer> GetDriverLog() const { return driver_log_->LastRaw(); }
+  // Write the driver log ring to the file log and empty it, after a driver call about the adapter failed
+  void DumpDriverLog(std::string_view reason) const;
+
+  // Configuration helper, timing its phases with the timer if there is one
+  bool ApplyConfiguration(const std::string &config_text, PhaseTimer *timer = nullptr);
+  // Applies a configuration that was already parsed, e.g. with WireguardConfigParser::Feed
+  bool ApplyConfiguration(WireguardConfigParser &&parser, PhaseTimer *timer = nullptr);
+
+  /**
+   * Add the peers of added, or change those the applied configuration already has, and remove the peers with the
+   * keys in removed, in one driver call that carries only those peers, see BuildPeerChange. Configured networking
+   * follows at the same cost. Needs the parsed configuration, which a release drops: the tunnel then has to be
+   * updated in full.
+   * @param added Peers only, see ParseStructuredPeers
+   * @return false, with error set, if nothing was changed or the driver refused the change
+   */
+  bool ChangePeers(WireguardConfigParser &&added, const std::vector<PeerPublicKey> &removed, std::string *error);
+
+  // How the peers are activated when the tunnel comes up, see StagePeerActivation
+  struct ActivationOptions {
+    // Peers per driver call, 0 for all at once
+    size_t batch_size = 0;
+    std::chrono::milliseconds interval{0};
+    // Peers that go first, in this order
+    std::vector<PeerKey> priority;
+  };
+  /**
+   * Before the interface comes up, leave all but the first batch of the applied configuration's peers out of the
+   * driver and add the others a batch every interval, so that a hub with thousands of peers does not have them
+   * all handshake at once; see ActivationSchedule for the order. Does nothing for a configuration of no more peers
+   * than a batch, or an adapter that is already up, whose sessions it would drop. Until the last batch the driver
+   * lacks the peers still to come, which VerifyConfiguration reports as missing; peers are added as the applied
+   * configuration has them then, changes included, and a configuration applied meanwhile replaces every peer.
+   * @param progress Called from the activation thread after each batch
+   * @return false if the driver refused the first batch
+   */
+  bool StagePeerActivation(const ActivationOptions &options, PeerActivation::Progress progress);
+  /**
+   * Stop a staged activation and give the driver the peers still to come at once, for a tunnel that did not come
+   * up after all
+   * @return false if the driver refused the peers
+   */
+  bool CancelPeerActivation();
+  // Wait for the activation and handshake threads to end, which call the progress and done callbacks given to
+  // the adapter; for an adapter whose teardown may outlive whatever those callbacks use
+  void StopCallbacks();
+
+  /**
+   * Whether config_text is the configuration last applied to this adapter and its
+   * networking is in place, so setting it up again would be a no-op.
+   */
+  bool IsConfigurationApplied(const std::string &config_text) const;
+  bool IsConfigurationApplied(const WireguardConfigParser &parser) const;
+
+  // The configuration last applied, or nullptr if none was; only on the tunnel's worker, which alone replaces it
+  const WireguardConfigParser *GetAppliedConfiguration() const {
+    return parsed_config_.has_value() ? &*parsed_config_ : nullptr;
+  }
+
+  /**
+   * Drop the parsed configuration once it is applied, keeping only the hash and length of its text and the network
+   * ledger, for low-memory mode. The driver keeps running it and the same text still counts as applied, but the
+   * next change replaces every peer instead of only the changed ones, VerifyConfiguration has nothing to compare
+   * with and a warm-up does nothing. Applying the same text again parses it back without touching the driver.
+   */
+  void ReleaseAppliedConfiguration();
+
+  // What the adapter holds on the heap, see GetMemoryUsage
+  struct MemoryUsage {
+    // 0 when no parsed configuration is kept
+    size_t parsed_config_bytes = 0;
+    // The buffer configurations are read back from the driver into
+    size_t wire_buffer_bytes = 0;
+    // Resolved endpoint hostnames
+    size_t cache_bytes = 0;
+  };
+  // Never waits for an operation in progress, the resolver cache is left out while one runs
+  void GetMemoryUsage(MemoryUsage *usage) const;
+
+  /**
+   * Block all traffic outside the tunnel while its networking is configured. Takes effect with the next
+   * ConfigureNetworking, which a change makes run again even for an unchanged configuration.
+   */
+  void SetKillSwitchEnabled(bool enabled);
+
+  // Which applications may use the tunnel, see AppSplitTunnel; takes effect at once and lasts as long as the adapter
+  bool SetSplitTunnel(AppSplitTunnel::Mode mode, const std::vector<std::wstring> &apps, std::string *error);
+
+  // Traffic and handshake totals over all peers, as the driver counts them
+  struct Totals {
+    uint64_t rx_bytes = 0;
+    uint64_t tx_bytes = 0;
+    // The most recent handshake of any peer, in 100ns intervals since 1601, or 0 if there was none
+    uint64_t last_handshake = 0;
+
+    // The last handshake in milliseconds since 1970, as Dart gets it, or 0 if there was none
+    uint64_t LastHandshakeUnixMillis() const { return FiletimeToUnixMillis(last_handshake); }
+  };
 
-  // Network configuration methods
-  bool ConfigureNetworking();
-  bool CleanupNetworking();
+  /**
+   * Read the totals from the driver into a buffer kept with the adapter, which only grows when the driver needs
+   * more room, so regular polling does not allocate
+   */
+  bool GetTotals(Totals *totals) const;
+  /**
+   * The latest handshake of the last GetTotals or GetPeerCounters, as a FILETIME, if one of them read the driver
+   * within max_age; the statistics sampler reads them every interval, so a caller that polls often rarely needs
+   * a driver read of its own
+   */
+  std::optional<uint64_t> GetRecentHandshake(std::chrono::milliseconds max_age) const;
+  // The same however old the read, unset before the first
+  std::optional<uint64_t> GetKnownHandshake() const;
+  // The interface counters from MIB_IF_ROW2, for drops and errors the peer counters do not show
+  struct InterfaceCounters {
+    uint64_t in_octets = 0;
+    uint64_t out_octets = 0;
+    uint64_t in_packets = 0;
+    uint64_t out_packets = 0;
+    uint64_t in_discards = 0;
+    uint64_t out_discards = 0;
+    uint64_t in_errors = 0;
+    uint64_t out_errors = 0;
+  };
+
+  // The peers and the interface read back to back, so rates and drop ratios from two snapshots agree
+  struct CounterSnapshot {
+    // Taken between the two reads, in 100ns intervals since 1601
+    uint64_t time = 0;
+    InterfaceCounters interface_counters;
+    std::vector<PeerStatistics> peers;
+  };
+  bool GetCounterSnapshot(CounterSnapshot *snapshot);
+  bool GetInterfaceCounters(InterfaceCounters *counters) const;
+
+  // Every peer's counters, without rates; clears the list first. With endpoints, also the endpoint the driver sends
+  // each peer's packets to, in the same order, AF_UNSPEC while it has none
+  bool GetPeerCounters(std::vector<PeerStatistics> *peers, std::vector<SOCKADDR_INET> *endpoints = nullptr) const;
+
+  // A peer whose endpoint the driver moved, as it does when authenticated packets arrive from another address
+  struct EndpointRoam {
+    PeerKey public_key;
+    SOCKADDR_INET previous;
+    SOCKADDR_INET current;
+  };
+  /**
+   * Compare the endpoints read by GetPeerCounters with those of the previous call and follow the peers that roamed:
+   * the new address is pinned past the tunnel routes, let through the kill switch and watched for path changes, and
+   * the old one's pin is removed once no peer uses it. Returns the roams, none on the first call after a
+   * configuration was applied. Skipped while an operation replaces the networking.
+   */
+  std::vector<EndpointRoam> TrackEndpoints(const std::vector<PeerStatistics> &peers,
+                                           const std::vector<SOCKADDR_INET> &endpoints);
+
+  /**
+   * After the system resumed from sleep: move the endpoint pins to the routes of the network the system woke up
+   * on and set every peer's endpoint again, which starts a handshake now instead of after the driver's timers.
+   * Waits for an operation in progress; not on the platform thread.
+   */
+  void KickAfterResume();
+
+  // Read the configuration back from the driver and compare it with the applied one; false if there is none or the
+  // driver cannot be read
+  bool VerifyConfiguration(ConfigurationDrift *drift) const;
+
+  // Read the configuration the driver runs and hand it to visit in the reusable read buffer, which stays locked and
+  // is only valid during the call; false if the driver cannot be read
+  bool ReadDriverConfiguration(const std::function<void(const BYTE *data, DWORD bytes)> &visit) const;
+  // Every peer's counters, with their throughput since the previous call
+  bool GetPeerStatistics(std::vector<PeerStatistics> *peers);
+  uint64_t GetLatestHandshake() const;
+  // Seconds between keepalives while warming up, the shortest WireGuard allows
+  static constexpr WORD kWarmUpKeepalive = 1;
+  /**
+   * Report the time until the first handshake after now, from a background thread; replaces an earlier wait.
+   * With warm_up, every peer sends keepalives until then instead of waiting for the app's first packet to start
+   * the handshake, and gets its configured keepalive back once the wait is over.
+   */
+  void TimeFirstHandshake(HandshakeWaiter::Done done, bool warm_up = false);
+  // The keepalive of peers without one while the tunnel is probed, WireGuard's suggestion for keeping NAT open
+  static constexpr WORD kProbeKeepalive = 25;
+  /**
+   * Give the peers without a keepalive kProbeKeepalive, so an idle tunnel keeps handshaking and its liveness shows
+   * whether it could carry traffic, or take it back from those it was given to. Peers added or configured anew get
+   * it only from the next call.
+   */
+  void SetProbing(bool probing);
+
+  // Network configuration methods. Stops between phases and rolls back once the timer's operation was abandoned,
+  // with ERROR_CANCELLED or ERROR_TIMEOUT as the last error.
+  bool ConfigureNetworking(PhaseTimer *timer = nullptr);
+  bool IsNetworkingConfigured() const { return networking_configured_; }
+  bool IsDnsConfigured() const { return dns_configured_; }
+  // The addresses and routes networking put on the interface, for the state journal
+  const NetworkLedger &GetNetworkLedger() const { return network_ledger_; }
+  /**
+   * Adopt the state a journal recorded for this adapter before the app restarted. With the configuration that
+   * was applied, the networking counts as configured, so setting up that configuration again changes nothing;
+   * without it, the next configuration or cleanup starts from the recorded rows instead of a table scan.
+   */
+  void Recover(const NetworkLedger &ledger, bool dns_configured, std::optional<WireguardConfigParser> applied);
+  /**
+   * With a snapshot shared by many adapters, addresses and routes the ledger does not know are found in it. With
+   * tracked_only they are left alone instead, for an adapter whose device is removed next and takes them with it.
+   */
+  bool CleanupNetworking(const NetworkTableSnapshot *snapshot = nullptr, bool tracked_only = false);
 
 private:
   WireguardAdapter(const std::shared_ptr<WireguardLibrary> &library, const std::wstring &name);
 
+  bool ApplyConfigurationLocked(WireguardConfigParser &&parser, PhaseTimer *timer);
+  // Replace parsed_config_, which also ends a release
+  void SetParsedConfigLocked(std::optional<WireguardConfigParser> config);
+
+  // The endpoints of the applied configuration that networking pins, lets through, watches and fails over
+  struct ConfiguredEndpoints {
+    std::vector<SOCKADDR_INET> addresses;
+    std::vector<EndpointPathWatcher::Endpoint> watched;
+    std::vector<EndpointFailover::Peer> failover_peers;
+    size_t allowed_ip_count = 0;
+  };
+  void CollectEndpointsLocked(ConfiguredEndpoints *configured) const;
+
+  // Read the configuration from the driver into driver_config_, with driver_config_mutex_ held
+  bool ReadDriverConfigLocked(DWORD *bytes) const;
+  // Read the configuration from the driver into driver_config_ and visit its peers, with the buffer locked
+  bool ForEachDriverPeer(const std::function<void(const WIREGUARD_PEER &peer)> &visit) const;
+
+  // Whether the text with this hash and length is the one parsed_config_ came from, or was released from
+  bool IsCurrentText(uint64_t text_hash, size_t text_size) const;
+
+  // A peer waiting for its endpoint hostname to resolve
+  struct PendingEndpoint {
+    BYTE public_key[WIREGUARD_KEY_LENGTH];
+    WORD port;
+  };
+
+  // The cached address of an endpoint hostname, of the family that won on the current network if it has both
+  bool LookUpEndpoint(const std::string &host, SOCKADDR_INET &address) const;
+  // Set the cached address of each endpoint hostname of parser on its peer and return the ones left to resolve
+  std::map<std::string, std::vector<PendingEndpoint>> LookUpEndpointsLocked(WireguardConfigParser &parser);
+  // Resolve endpoint hostnames that were not cached and set each peer's endpoint once its lookup completes, racing
+  // the families of hostnames with both, see EndpointFamilyRace
+  void ResolveEndpoints(std::map<std::string, std::vector<PendingEndpoint>> pending);
+  // Set the address a lookup chose on the peers still waiting for the hostname, unless a later lookup replaced it
+  void SetResolvedEndpoint(const std::string &host, const SOCKADDR_INET &chosen, uint64_t generation,
+                           uint64_t lookup);
+  // Peers a change removed or replaced stop waiting for the hostnames they were looked up for
+  void ForgetLookupsLocked(const WireguardConfigParser &added, const std::vector<PeerPublicKey> &removed);
+  // Set the endpoints on their peers again, which gets a handshake going over the path they are routed through now
+  void ReapplyEndpoints(const std::vector<EndpointPathWatcher::Endpoint> &endpoints);
+  // The same with operation_mutex_ held
+  bool ReapplyEndpointsLocked(const std::vector<EndpointPathWatcher::Endpoint> &endpoints);
+  // Move a peer with alternate endpoints to another of them, see EndpointFailover
+  void SwitchEndpoint(const BYTE *public_key, const SOCKADDR_INET &endpoint);
+  // Tune the keepalives of the peers of parsed_config_ with PersistentKeepalive = auto, see KeepaliveTuning
+  void StartKeepaliveTuningLocked();
+  // Set a keepalive the tuning chose on the peer and in parsed_config_, false if it has to be tried again
+  bool SetTunedKeepalive(const BYTE *public_key, WORD keepalive);
+  // Add the peers of parsed_config_ with these keys, false if it has to be tried again
+  bool AddActivationBatch(const std::vector<PeerKey> &batch, size_t *added);
+
   std::shared_ptr<WireguardLibrary> library_;
   std::wstring name_;
   WIREGUARD_ADAPTER_HANDLE adapter_handle_ = nullptr;
+  // Set on the platform thread or the tunnel's worker, one at a time
+  AdapterLogMode log_mode_ = AdapterLogMode::kOff;
+  // Under which the driver log ring is registered with AdapterLogs, 0 while it is not
+  NET_IFINDEX log_index_ = 0;
+  std::shared_ptr<LogRing> driver_log_ = std::make_shared<LogRing>(AdapterLogs::kRingLines);
+  // Exclusive while anything of the adapter is changed, the driver's configuration and networking included,
+  // shared while they are only read
+  mutable std::shared_mutex operation_mutex_;
   std::optional<WireguardConfigParser> parsed_config_;
-  std::shared_ptr<spdlog::logger> logger_;
+  // Of the text parsed_config_ came from, still known after ReleaseAppliedConfiguration
+  bool config_released_ = false;
+  uint64_t released_text_hash_ = 0;
+  size_t released_text_size_ = 0;
+  // MemoryBytes of parsed_config_, read without the operation lock
+  std::atomic<size_t> parsed_config_bytes_{0};
+  bool networking_configured_ = false;
+  bool service_owned_ = false;
+  std::atomic<bool> reopen_claimed_{false};
+  // Whether DNS settings were put on the interface and have to be cleared again
+  bool dns_configured_ = false;
+  bool kill_switch_enabled_ = false;
+  // What networking has put on the interface, so that it can be updated and torn down without table scans
+  NetworkLedger network_ledger_;
+  // The allowed IPs behind the routes networking installed, which ChangePeers changes the routes by
+  RouteSet route_set_;
+  EndpointBypassRoutes bypass_routes_;
+  EndpointPathWatcher path_watcher_;
+  EndpointFailover endpoint_failover_;
+  KeepaliveTuning keepalive_tuning_;
+  // The peers SetProbing gave kProbeKeepalive, under operation_mutex_
+  std::unordered_set<PeerKey, PeerKeyHash> probed_peers_;
+  PeerActivation activation_;
+  PathMtuProber mtu_prober_;
+  KillSwitch kill_switch_;
+  AppSplitTunnel split_tunnel_;
+  HandshakeWaiter handshake_waiter_;
+  // For GetTotals, which the platform thread and the handshake wait both call
+  mutable std::mutex driver_config_mutex_;
+  mutable std::vector<uint64_t> driver_config_;
+  // For GetRecentHandshake; the time is on the steady clock, 0 before the first read
+  mutable std::atomic<uint64_t> recent_handshake_{0};
+  mutable std::atomic<int64_t> recent_handshake_read_ns_{0};
+  void RememberHandshake(uint64_t last_handshake) const;
+  // For GetKnownState, -1 before the driver was reached
+  mutable std::atomic<int> known_state_{-1};
+  // Statistics are read from the platform thread and the FFI callers
+  std::mutex peer_rates_mutex_;
+  PeerRateTracker peer_rates_;
+  // For TrackEndpoints, the driver's endpoints at its previous call and the configuration they were read for
+  std::mutex peer_endpoints_mutex_;
+  std::unordered_map<PeerKey, SOCKADDR_INET, PeerKeyHash> peer_endpoints_;
+  uint64_t peer_endpoints_generation_ = 0;
+  PluginLogger logger_;
+
+  // Bumped on every applied configuration, so lookups started for an older one are ignored
+  std::atomic<uint64_t> config_generation_{0};
+  // The peers waiting for each endpoint hostname and the ResolveEndpoints call that looked it up last, under
+  // operation_mutex_. A peer change may look a hostname up again while an earlier lookup is still out; only the
+  // last answer is set, on every peer waiting for it.
+  struct HostLookup {
+    uint64_t lookup = 0;
+    std::vector<PendingEndpoint> peers;
+  };
+  std::map<std::string, HostLookup> host_lookups_;
+  uint64_t last_lookup_ = 0;
+  std::unique_ptr<EndpointResolver> resolver_;
+  WorkerPost worker_post_;
 };
 
 } // namespace wireguard_dart
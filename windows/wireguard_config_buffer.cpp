@@ -0,0 +1,105 @@
+#include "wireguard_config_buffer.h"
+
+#include <cstring>
+
+namespace wireguard_dart {
+
+WireguardConfigBuffer::WireguardConfigBuffer() { Clear(); }
+
+WIREGUARD_PEER &WireguardConfigBuffer::AppendPeer() {
+  current_peer_offset_ = size_;
+  Append(sizeof(WIREGUARD_PEER));
+  Interface().PeersCount++;
+  return CurrentPeer();
+}
+
+void WireguardConfigBuffer::AppendAllowedIP(const WIREGUARD_ALLOWED_IP &allowed_ip) {
+  *reinterpret_cast<WIREGUARD_ALLOWED_IP *>(Append(sizeof(WIREGUARD_ALLOWED_IP))) = allowed_ip;
+  CurrentPeer().AllowedIPsCount++;
+}
+
+void WireguardConfigBuffer::ReplaceAllowedIPs(const std::vector<WIREGUARD_ALLOWED_IP> &allowed_ips) {
+  size_ = current_peer_offset_ + sizeof(WIREGUARD_PEER);
+  ResizeStorage(size_ / sizeof(uint64_t));
+  CurrentPeer().AllowedIPsCount = 0;
+  for (const auto &allowed_ip : allowed_ips) {
+    AppendAllowedIP(allowed_ip);
+  }
+}
+
+size_t WireguardConfigBuffer::AppendPeers(const WireguardConfigBuffer &other) {
+  size_t shift = size_ - sizeof(WIREGUARD_INTERFACE);
+  size_t peers_size = other.size_ - sizeof(WIREGUARD_INTERFACE);
+  if (peers_size == 0) {
+    return shift;
+  }
+  memcpy(Append(peers_size), other.Bytes() + sizeof(WIREGUARD_INTERFACE), peers_size);
+  Interface().PeersCount += other.Interface().PeersCount;
+  current_peer_offset_ = other.current_peer_offset_ + shift;
+  return shift;
+}
+
+void WireguardConfigBuffer::Reserve(size_t bytes) {
+  size_t words = (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  if (words > storage_.capacity()) {
+    allocation_count_++;
+    storage_.reserve(words);
+  }
+}
+
+void WireguardConfigBuffer::Clear() {
+  storage_.clear();
+  size_ = 0;
+  current_peer_offset_ = 0;
+  Append(sizeof(WIREGUARD_INTERFACE));
+}
+
+bool WireguardConfigBuffer::Assign(const void *data, size_t size) {
+  Clear();
+  if (size < sizeof(WIREGUARD_INTERFACE) || size % sizeof(uint64_t) != 0) {
+    return false;
+  }
+
+  ResizeStorage(size / sizeof(uint64_t));
+  memcpy(storage_.data(), data, size);
+  size_ = size;
+
+  // Walk the records so that a damaged blob can never make ForEachPeer read past the end
+  size_t pos = sizeof(WIREGUARD_INTERFACE);
+  for (DWORD i = 0; i < Interface().PeersCount; i++) {
+    if (size - pos < sizeof(WIREGUARD_PEER)) {
+      Clear();
+      return false;
+    }
+    const auto *peer = reinterpret_cast<const WIREGUARD_PEER *>(Bytes() + pos);
+    if ((size - pos - sizeof(WIREGUARD_PEER)) / sizeof(WIREGUARD_ALLOWED_IP) < peer->AllowedIPsCount) {
+      Clear();
+      return false;
+    }
+    current_peer_offset_ = pos;
+    pos += sizeof(WIREGUARD_PEER) + peer->AllowedIPsCount * sizeof(WIREGUARD_ALLOWED_IP);
+  }
+
+  if (pos != size) {
+    Clear();
+    return false;
+  }
+  return true;
+}
+
+BYTE *WireguardConfigBuffer::Append(size_t bytes) {
+  size_t offset = size_;
+  size_ += bytes;
+  // resize() value-initializes the new words, so the region comes back zeroed
+  ResizeStorage(size_ / sizeof(uint64_t));
+  return Bytes() + offset;
+}
+
+void WireguardConfigBuffer::ResizeStorage(size_t words) {
+  if (words > storage_.capacity()) {
+    allocation_count_++;
+  }
+  storage_.resize(words);
+}
+
+} // namespace wireguard_dart
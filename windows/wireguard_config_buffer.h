@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "wireguard.h"
+
+namespace wireguard_dart {
+
+/**
+ * Growable, 8-byte aligned buffer holding a configuration in the layout expected by
+ * WireGuardSetConfiguration: a WIREGUARD_INTERFACE followed by each WIREGUARD_PEER and
+ * its WIREGUARD_ALLOWED_IP records. Records are appended in place and the interface
+ * PeersCount and the current peer's AllowedIPsCount are kept up to date as they are.
+ */
+class WireguardConfigBuffer {
+public:
+  WireguardConfigBuffer();
+
+  /**
+   * The interface header at the start of the buffer
+   */
+  WIREGUARD_INTERFACE &Interface() { return *reinterpret_cast<WIREGUARD_INTERFACE *>(storage_.data()); }
+  const WIREGUARD_INTERFACE &Interface() const {
+    return *reinterpret_cast<const WIREGUARD_INTERFACE *>(storage_.data());
+  }
+
+  /**
+   * Append a zeroed peer record and make it the current peer.
+   * References returned earlier are invalidated, as the buffer may grow.
+   */
+  WIREGUARD_PEER &AppendPeer();
+
+  /**
+   * The most recently appended peer. Only valid if HasPeer() is true.
+   */
+  WIREGUARD_PEER &CurrentPeer() { return *reinterpret_cast<WIREGUARD_PEER *>(Bytes() + current_peer_offset_); }
+  bool HasPeer() const { return current_peer_offset_ != 0; }
+
+  /**
+   * Offsets stay valid as the buffer grows, unlike references to its records
+   */
+  size_t CurrentPeerOffset() const { return current_peer_offset_; }
+  BYTE *At(size_t offset) { return Bytes() + offset; }
+  const BYTE *At(size_t offset) const { return Bytes() + offset; }
+
+  /**
+   * Append an allowed IP to the current peer. Only valid if HasPeer() is true.
+   */
+  void AppendAllowedIP(const WIREGUARD_ALLOWED_IP &allowed_ip);
+
+  /**
+   * Replace the allowed IPs of the current peer, which are the last records in the buffer. Only valid if
+   * HasPeer() is true.
+   */
+  void ReplaceAllowedIPs(const std::vector<WIREGUARD_ALLOWED_IP> &allowed_ips);
+
+  /**
+   * Append the peers of another buffer, with their allowed IPs, and make its last peer the current one
+   * @return How far the records moved: an offset into other plus this is the same record's offset here
+   */
+  size_t AppendPeers(const WireguardConfigBuffer &other);
+
+  /**
+   * Drop the peers that remove(peer) is true for, with their allowed IPs, moving the others down in place. The
+   * last peer kept becomes the current one.
+   * @param moved Called as moved(from_offset, to_offset) for each peer kept, in order
+   */
+  template <typename Remove, typename Moved> void RemovePeers(const Remove &remove, const Moved &moved);
+
+  /**
+   * Pre-allocate room for at least the given number of bytes
+   */
+  void Reserve(size_t bytes);
+
+  /**
+   * Reset to an empty interface with no peers. The memory is kept, so that every record of the next
+   * configuration goes into the same allocation and releasing this one costs nothing.
+   */
+  void Clear();
+
+  /**
+   * Replace the contents with a configuration built earlier, e.g. read back from disk
+   * @return false, leaving the buffer empty, if the records do not add up to exactly size bytes
+   */
+  bool Assign(const void *data, size_t size);
+
+  const WIREGUARD_INTERFACE *Data() const { return &Interface(); }
+  DWORD Size() const { return static_cast<DWORD>(size_); }
+
+  /**
+   * Number of times the buffer had to allocate since it was constructed, and the bytes it holds, for benchmarks
+   */
+  size_t AllocationCount() const { return allocation_count_; }
+  size_t CapacityBytes() const { return storage_.capacity() * sizeof(uint64_t); }
+
+  /**
+   * Walk the peers in order.
+   * @param fn Called as fn(const WIREGUARD_PEER &, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count)
+   */
+  template <typename Fn> void ForEachPeer(Fn &&fn) const {
+    const BYTE *pos = Bytes() + sizeof(WIREGUARD_INTERFACE);
+    for (DWORD i = 0; i < Interface().PeersCount; i++) {
+      const auto *peer = reinterpret_cast<const WIREGUARD_PEER *>(pos);
+      const auto *allowed_ips = reinterpret_cast<const WIREGUARD_ALLOWED_IP *>(pos + sizeof(WIREGUARD_PEER));
+      fn(*peer, allowed_ips, peer->AllowedIPsCount);
+      pos += sizeof(WIREGUARD_PEER) + peer->AllowedIPsCount * sizeof(WIREGUARD_ALLOWED_IP);
+    }
+  }
+
+private:
+  static_assert(sizeof(WIREGUARD_INTERFACE) % sizeof(uint64_t) == 0, "Records must keep 8-byte alignment");
+  static_assert(sizeof(WIREGUARD_PEER) % sizeof(uint64_t) == 0, "Records must keep 8-byte alignment");
+  static_assert(sizeof(WIREGUARD_ALLOWED_IP) % sizeof(uint64_t) == 0, "Records must keep 8-byte alignment");
+
+  BYTE *Bytes() { return reinterpret_cast<BYTE *>(storage_.data()); }
+  const BYTE *Bytes() const { return reinterpret_cast<const BYTE *>(storage_.data()); }
+
+  // Grows the buffer by bytes and returns the zeroed new region
+  BYTE *Append(size_t bytes);
+
+  // storage_.resize(), counting the allocations it makes
+  void ResizeStorage(size_t words);
+
+  // Backed by 64-bit words so that every record is 8-byte aligned
+  std::vector<uint64_t> storage_;
+  size_t size_ = 0;
+  size_t current_peer_offset_ = 0;
+  size_t allocation_count_ = 0;
+};
+
+template <typename Remove, typename Moved>
+void WireguardConfigBuffer::RemovePeers(const Remove &remove, const Moved &moved) {
+  size_t from = sizeof(WIREGUARD_INTERFACE);
+  size_t to = from;
+  DWORD kept = 0;
+  current_peer_offset_ = 0;
+  for (DWORD i = 0; i < Interface().PeersCount; i++) {
+    const auto *peer = reinterpret_cast<const WIREGUARD_PEER *>(Bytes() + from);
+    size_t record_size = sizeof(WIREGUARD_PEER) + peer->AllowedIPsCount * sizeof(WIREGUARD_ALLOWED_IP);
+    if (!remove(*peer)) {
+      if (to != from) {
+        memmove(Bytes() + to, Bytes() + from, record_size);
+      }
+      moved(from, to);
+      current_peer_offset_ = to;
+      to += record_size;
+      kept++;
+    }
+    from += record_size;
+  }
+  Interface().PeersCount = kept;
+  size_ = to;
+  ResizeStorage(size_ / sizeof(uint64_t));
+}
+
+} // namespace wireguard_dart
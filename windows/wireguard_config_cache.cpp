@@ -0,0 +1,251 @@
+#include "wireguard_config_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "utils.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x43444757;  // "WGDC"
+
+constexpr BYTE kHasPrivateKey = 1;
+constexpr BYTE kHasPublicKey = 2;
+constexpr BYTE kHasListenPort = 4;
+constexpr BYTE kMtuAuto = 8;
+
+// Profile flags, the has_ bits and the value bits of the booleans
+constexpr BYTE kHasMetric = 1;
+constexpr BYTE kHasAutomaticMetric = 2;
+constexpr BYTE kAutomaticMetric = 4;
+constexpr BYTE kHasRouterDiscovery = 8;
+constexpr BYTE kRouterDiscovery = 16;
+constexpr BYTE kHasDadTransmits = 32;
+
+// Followed by the wire format configuration, the interface addresses, the DNS servers and the search domains,
+// each domain NUL-terminated
+struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t text_hash;
+  uint64_t text_size;
+  uint64_t checksum;  // Of everything after the header
+  uint32_t config_size;
+  uint32_t mtu;
+  uint32_t address_count;
+  uint16_t listen_port;
+  BYTE flags;
+  BYTE reserved;
+  uint32_t dns_server_count;
+  uint32_t dns_search_size;
+  uint32_t metric;
+  uint32_t dad_transmits;
+  BYTE profile_flags;
+  BYTE profile_reserved[3];
+};
+
+uint64_t Checksum(const BYTE *data, size_t size) {
+  return WireguardConfigParser::HashText(std::string_view(reinterpret_cast<const char *>(data), size));
+}
+
+bool ReadMapped(const BYTE *data, size_t size, uint64_t text_hash, size_t text_size, WireguardConfigParser &parser) {
+  if (size < sizeof(CacheHeader)) {
+    return false;
+  }
+
+  CacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != kMagic || header.version != WireguardConfigCache::kVersion || header.text_hash != text_hash ||
+      header.text_size != text_size) {
+    return false;
+  }
+
+  const BYTE *payload = data + sizeof(header);
+  size_t payload_size = size - sizeof(header);
+  uint64_t addresses_size = uint64_t{header.address_count} * sizeof(WIREGUARD_ALLOWED_IP);
+  uint64_t servers_size = uint64_t{header.dns_server_count} * sizeof(SOCKADDR_INET);
+  if (payload_size != header.config_size + addresses_size + servers_size + header.dns_search_size ||
+      Checksum(payload, payload_size) != header.checksum) {
+    return false;
+  }
+
+  ParsedInterface iface;
+  iface.has_private_key = (header.flags & kHasPrivateKey) != 0;
+  iface.has_public_key = (header.flags & kHasPublicKey) != 0;
+  iface.has_listen_port = (header.flags & kHasListenPort) != 0;
+  iface.mtu_auto = (header.flags & kMtuAuto) != 0;
+  iface.listen_port = header.listen_port;
+  iface.mtu = header.mtu;
+  iface.profile.has_metric = (header.profile_flags & kHasMetric) != 0;
+  iface.profile.has_automatic_metric = (header.profile_flags & kHasAutomaticMetric) != 0;
+  iface.profile.automatic_metric = (header.profile_flags & kAutomaticMetric) != 0;
+  iface.profile.has_router_discovery = (header.profile_flags & kHasRouterDiscovery) != 0;
+  iface.profile.router_discovery = (header.profile_flags & kRouterDiscovery) != 0;
+  iface.profile.has_dad_transmits = (header.profile_flags & kHasDadTransmits) != 0;
+  iface.profile.metric = header.metric;
+  iface.profile.dad_transmits = header.dad_transmits;
+  iface.addresses.resize(header.address_count);
+  const BYTE *cursor = payload + header.config_size;
+  if (header.address_count > 0) {
+    memcpy(iface.addresses.data(), cursor, addresses_size);
+  }
+  cursor += addresses_size;
+  iface.dns_servers.resize(header.dns_server_count);
+  if (header.dns_server_count > 0) {
+    memcpy(iface.dns_servers.data(), cursor, servers_size);
+  }
+  cursor += servers_size;
+  std::string_view search(reinterpret_cast<const char *>(cursor), header.dns_search_size);
+  while (!search.empty()) {
+    size_t end = search.find('\0');
+    if (end == std::string_view::npos) {
+      return false;
+    }
+    iface.dns_search_domains.emplace_back(search.substr(0, end));
+    search.remove_prefix(end + 1);
+  }
+
+  return parser.Restore(iface, payload, header.config_size, text_hash, text_size);
+}
+
+} // namespace
+
+WireguardConfigCache::WireguardConfigCache(const std::wstring &directory) : directory_(directory) {}
+
+bool WireguardConfigCache::Load(const std::wstring &tunnel_name, uint64_t text_hash, size_t text_size,
+                                WireguardConfigParser &parser) const {
+  HANDLE file = CreateFileW(PathFor(tunnel_name).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(sizeof(CacheHeader))) {
+    CloseHandle(file);
+    return false;
+  }
+
+  // Mapped rather than read, so the blob goes from the page cache straight into the parser's buffer
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping) {
+    return false;
+  }
+
+  const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!view) {
+    return false;
+  }
+
+  bool loaded = ReadMapped(static_cast<const BYTE *>(view), static_cast<size_t>(file_size.QuadPart), text_hash,
+                           text_size, parser);
+  UnmapViewOfFile(view);
+  return loaded;
+}
+
+bool WireguardConfigCache::Store(const std::wstring &tunnel_name, const WireguardConfigParser &parser) const {
+  // Hostname endpoints have to be resolved on every start, and the wire format has room for one endpoint and
+  // one fixed keepalive per peer, so none of those can be cached; nor can split DNS domains, QoS rules or probe
+  // addresses, which the cache format has no place for
+  if (!parser.GetHostnameEndpoints().empty() || !parser.GetAlternateEndpoints().empty() ||
+      !parser.GetAutoKeepalives().empty() || !parser.GetInterface().dns_split_domains.empty() ||
+      !parser.GetInterface().qos_rules.empty() || !parser.GetProbeAddresses().empty()) {
+    return false;
+  }
+
+  const WireguardConfigBuffer &config = parser.GetConfiguration();
+  const ParsedInterface &iface = parser.GetInterface();
+
+  CacheHeader header = {};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.text_hash = parser.GetTextHash();
+  header.text_size = parser.GetTextSize();
+  header.config_size = config.Size();
+  header.mtu = iface.mtu;
+  header.address_count = static_cast<uint32_t>(iface.addresses.size());
+  header.listen_port = iface.listen_port;
+  header.dns_server_count = static_cast<uint32_t>(iface.dns_servers.size());
+  header.flags = (iface.has_private_key ? kHasPrivateKey : 0) | (iface.has_public_key ? kHasPublicKey : 0) |
+                 (iface.has_listen_port ? kHasListenPort : 0) | (iface.mtu_auto ? kMtuAuto : 0);
+  const InterfaceProfile &profile = iface.profile;
+  header.metric = profile.metric;
+  header.dad_transmits = profile.dad_transmits;
+  header.profile_flags = (profile.has_metric ? kHasMetric : 0) |
+                         (profile.has_automatic_metric ? kHasAutomaticMetric : 0) |
+                         (profile.automatic_metric ? kAutomaticMetric : 0) |
+                         (profile.has_router_discovery ? kHasRouterDiscovery : 0) |
+                         (profile.router_discovery ? kRouterDiscovery : 0) |
+                         (profile.has_dad_transmits ? kHasDadTransmits : 0);
+
+  std::string search;
+  for (const auto &domain : iface.dns_search_domains) {
+    search.append(domain);
+    search.push_back('\0');
+  }
+  header.dns_search_size = static_cast<uint32_t>(search.size());
+
+  size_t addresses_size = iface.addresses.size() * sizeof(WIREGUARD_ALLOWED_IP);
+  size_t servers_size = iface.dns_servers.size() * sizeof(SOCKADDR_INET);
+  std::vector<BYTE> contents(sizeof(header) + config.Size() + addresses_size + servers_size + search.size());
+  BYTE *cursor = contents.data() + sizeof(header);
+  memcpy(cursor, config.Data(), config.Size());
+  cursor += config.Size();
+  if (addresses_size > 0) {
+    memcpy(cursor, iface.addresses.data(), addresses_size);
+  }
+  cursor += addresses_size;
+  if (servers_size > 0) {
+    memcpy(cursor, iface.dns_servers.data(), servers_size);
+  }
+  cursor += servers_size;
+  memcpy(cursor, search.data(), search.size());
+  BYTE *payload = contents.data() + sizeof(header);
+  header.checksum = Checksum(payload, contents.size() - sizeof(header));
+  memcpy(contents.data(), &header, sizeof(header));
+
+  // Written aside and moved into place, so a crash never leaves a torn file behind
+  std::wstring path = PathFor(tunnel_name);
+  std::wstring temp_path = path + L".tmp";
+  HANDLE file =
+      CreateFileW(temp_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  DWORD written = 0;
+  bool ok = WriteFile(file, contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr) &&
+            written == contents.size();
+  CloseHandle(file);
+
+  if (!ok || !MoveFileExW(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+    DeleteFileW(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool WireguardConfigCache::Remove(const std::wstring &tunnel_name) const {
+  return DeleteFileW(PathFor(tunnel_name).c_str()) || GetLastError() == ERROR_FILE_NOT_FOUND;
+}
+
+std::wstring WireguardConfigCache::PathFor(const std::wstring &tunnel_name) const {
+  // Tunnel names may contain characters that are not allowed in file names, so the file is named by a hash
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx",
+           static_cast<unsigned long long>(WireguardConfigParser::HashText(WideToUtf8(tunnel_name))));
+
+  std::wstring path = directory_;
+  if (!path.empty() && path.back() != L'\\' && path.back() != L'/') {
+    path += L'\\';
+  }
+  return path + L"tunnel-" + Utf8ToWide(name) + L".wgcache";
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+
+#include <cstdint>
+#include <string>
+
+#include "wireguard_config_parser.h"
+
+namespace wireguard_dart {
+
+/**
+ * Persists parsed configurations as binary files, so that a tunnel can be brought up again on the next start
+ * without parsing its text. Each file holds the wire format configuration and the interface settings, and is
+ * keyed by the hash of the text it was parsed from.
+ *
+ * The files contain the private key just like the configuration text does, so the directory must be one
+ * only the user can read.
+ */
+class WireguardConfigCache {
+public:
+  // Bumped whenever the file layout or the wire format structures change
+  static constexpr uint32_t kVersion = 3;
+
+  explicit WireguardConfigCache(const std::wstring &directory);
+
+  /**
+   * Load the cached configuration of a tunnel if it was parsed from the text with this hash and length
+   * @param tunnel_name The tunnel the configuration belongs to
+   * @param text_hash Hash of the configuration text, see WireguardConfigParser::HashText
+   * @param text_size Length of the configuration text
+   * @param parser Receives the configuration on success
+   * @return true if a matching, intact cache file was found
+   */
+  bool Load(const std::wstring &tunnel_name, uint64_t text_hash, size_t text_size,
+            WireguardConfigParser &parser) const;
+
+  /**
+   * Write the configuration of a tunnel, replacing any earlier one
+   * @return true if the file was written
+   */
+  bool Store(const std::wstring &tunnel_name, const WireguardConfigParser &parser) const;
+
+  // Delete the configuration of a tunnel, with its private key; true also if there was none
+  bool Remove(const std::wstring &tunnel_name) const;
+
+private:
+  std::wstring PathFor(const std::wstring &tunnel_name) const;
+
+  std::wstring directory_;
+};
+
+} // namespace wireguard_dart
@@ -0,0 +1,388 @@
+#include "wireguard_config_diff.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+
+#include "wireguard_config_parser.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+struct PeerRecord {
+  const WIREGUARD_PEER *peer;
+  const WIREGUARD_ALLOWED_IP *allowed_ips;
+  DWORD allowed_ips_count;
+  bool matched;
+};
+
+std::string_view PublicKeyOf(const WIREGUARD_PEER &peer) {
+  return std::string_view(reinterpret_cast<const char *>(peer.PublicKey), WIREGUARD_KEY_LENGTH);
+}
+
+bool HasFlag(const WIREGUARD_PEER &peer, WIREGUARD_PEER_FLAG flag) { return (peer.Flags & flag) != 0; }
+
+void AddFlag(WIREGUARD_PEER &peer, WIREGUARD_PEER_FLAG flag) {
+  peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | flag);
+}
+
+// Only the significant bytes of the address union are compared
+bool SameAllowedIP(const WIREGUARD_ALLOWED_IP &a, const WIREGUARD_ALLOWED_IP &b) {
+  if (a.AddressFamily != b.AddressFamily || a.Cidr != b.Cidr) {
+    return false;
+  }
+  if (a.AddressFamily == AF_INET) {
+    return memcmp(&a.Address.V4, &b.Address.V4, sizeof(IN_ADDR)) == 0;
+  }
+  return memcmp(&a.Address.V6, &b.Address.V6, sizeof(IN6_ADDR)) == 0;
+}
+
+bool SameAllowedIPs(const PeerRecord &a, const PeerRecord &b) {
+  if (a.allowed_ips_count != b.allowed_ips_count) {
+    return false;
+  }
+  for (DWORD i = 0; i < a.allowed_ips_count; i++) {
+    if (!SameAllowedIP(a.allowed_ips[i], b.allowed_ips[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SameEndpoint(const SOCKADDR_INET &a, const SOCKADDR_INET &b) {
+  if (a.si_family != b.si_family) {
+    return false;
+  }
+  if (a.si_family == AF_INET) {
+    return a.Ipv4.sin_port == b.Ipv4.sin_port &&
+           memcmp(&a.Ipv4.sin_addr, &b.Ipv4.sin_addr, sizeof(IN_ADDR)) == 0;
+  }
+  return a.Ipv6.sin6_port == b.Ipv6.sin6_port &&
+         memcmp(&a.Ipv6.sin6_addr, &b.Ipv6.sin6_addr, sizeof(IN6_ADDR)) == 0;
+}
+
+void AppendAllowedIPs(WireguardConfigBuffer &delta, const PeerRecord &record) {
+  for (DWORD i = 0; i < record.allowed_ips_count; i++) {
+    delta.AppendAllowedIP(record.allowed_ips[i]);
+  }
+}
+
+// Appends an update for a peer present in both configurations, or nothing if it did not change
+void AppendPeerUpdate(WireguardConfigBuffer &delta, const PeerRecord &previous, const PeerRecord &next) {
+  const WIREGUARD_PEER &old_peer = *previous.peer;
+  const WIREGUARD_PEER &new_peer = *next.peer;
+
+  WIREGUARD_PEER update = {};
+  update.Flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_UPDATE | WIREGUARD_PEER_HAS_PUBLIC_KEY);
+  memcpy(update.PublicKey, new_peer.PublicKey, WIREGUARD_KEY_LENGTH);
+
+  bool changed = false;
+
+  // A preshared key or keepalive that is no longer set is cleared by sending zero
+  bool old_psk = HasFlag(old_peer, WIREGUARD_PEER_HAS_PRESHARED_KEY);
+  bool new_psk = HasFlag(new_peer, WIREGUARD_PEER_HAS_PRESHARED_KEY);
+  if (old_psk != new_psk ||
+      (new_psk && memcmp(old_peer.PresharedKey, new_peer.PresharedKey, WIREGUARD_KEY_LENGTH) != 0)) {
+    AddFlag(update, WIREGUARD_PEER_HAS_PRESHARED_KEY);
+    if (new_psk) {
+      memcpy(update.PresharedKey, new_peer.PresharedKey, WIREGUARD_KEY_LENGTH);
+    }
+    changed = true;
+  }
+
+  WORD old_keepalive = HasFlag(old_peer, WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE) ? old_peer.PersistentKeepalive : 0;
+  WORD new_keepalive = HasFlag(new_peer, WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE) ? new_peer.PersistentKeepalive : 0;
+  if (old_keepalive != new_keepalive) {
+    AddFlag(update, WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
+    update.PersistentKeepalive = new_keepalive;
+    changed = true;
+  }
+
+  // The driver cannot unset an endpoint, so a removed one is left as it is, like `wg setconf` does
+  if (HasFlag(new_peer, WIREGUARD_PEER_HAS_ENDPOINT) &&
+      (!HasFlag(old_peer, WIREGUARD_PEER_HAS_ENDPOINT) || !SameEndpoint(old_peer.Endpoint, new_peer.Endpoint))) {
+    AddFlag(update, WIREGUARD_PEER_HAS_ENDPOINT);
+    update.Endpoint = new_peer.Endpoint;
+    changed = true;
+  }
+
+  bool replace_allowed_ips = !SameAllowedIPs(previous, next);
+  if (replace_allowed_ips) {
+    AddFlag(update, WIREGUARD_PEER_REPLACE_ALLOWED_IPS);
+    changed = true;
+  }
+
+  if (!changed) {
+    return;
+  }
+
+  delta.AppendPeer() = update;
+  if (replace_allowed_ips) {
+    AppendAllowedIPs(delta, next);
+  }
+}
+
+// Family, address with the host bits cleared, then prefix length, so that sorting orders by address
+using CanonicalAllowedIP = std::array<BYTE, 18>;
+
+struct CanonicalPeer {
+  BYTE preshared_key[WIREGUARD_KEY_LENGTH] = {};
+  WORD keepalive = 0;
+  std::vector<CanonicalAllowedIP> allowed_ips;
+};
+
+CanonicalAllowedIP Canonical(const WIREGUARD_ALLOWED_IP &allowed_ip) {
+  CanonicalAllowedIP canonical = {};
+  bool ipv4 = allowed_ip.AddressFamily == AF_INET;
+  size_t length = ipv4 ? sizeof(IN_ADDR) : sizeof(IN6_ADDR);
+  BYTE cidr = (std::min)(allowed_ip.Cidr, static_cast<BYTE>(length * 8));
+  canonical[0] = ipv4 ? 4 : 6;
+  memcpy(&canonical[1], ipv4 ? static_cast<const void *>(&allowed_ip.Address.V4) : &allowed_ip.Address.V6, length);
+  for (size_t bit = cidr; bit < length * 8; bit++) {
+    canonical[1 + bit / 8] &= static_cast<BYTE>(~(0x80 >> (bit % 8)));
+  }
+  canonical[17] = cidr;
+  return canonical;
+}
+
+CanonicalPeer Canonical(const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+  CanonicalPeer canonical;
+  if (HasFlag(peer, WIREGUARD_PEER_HAS_PRESHARED_KEY)) {
+    memcpy(canonical.preshared_key, peer.PresharedKey, WIREGUARD_KEY_LENGTH);
+  }
+  if (HasFlag(peer, WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE)) {
+    canonical.keepalive = peer.PersistentKeepalive;
+  }
+  canonical.allowed_ips.reserve(count);
+  for (DWORD i = 0; i < count; i++) {
+    canonical.allowed_ips.push_back(Canonical(allowed_ips[i]));
+  }
+  std::sort(canonical.allowed_ips.begin(), canonical.allowed_ips.end());
+  return canonical;
+}
+
+struct CanonicalConfiguration {
+  bool has_private_key = false;
+  BYTE private_key[WIREGUARD_KEY_LENGTH] = {};
+  WORD listen_port = 0;
+  // By raw public key, which keeps them sorted
+  std::map<std::string, CanonicalPeer> peers;
+};
+
+CanonicalConfiguration Canonical(const WireguardConfigBuffer &config) {
+  CanonicalConfiguration canonical;
+  const WIREGUARD_INTERFACE &config_interface = config.Interface();
+  canonical.has_private_key = (config_interface.Flags & WIREGUARD_INTERFACE_HAS_PRIVATE_KEY) != 0;
+  if (canonical.has_private_key) {
+    memcpy(canonical.private_key, config_interface.PrivateKey, WIREGUARD_KEY_LENGTH);
+  }
+  if (config_interface.Flags & WIREGUARD_INTERFACE_HAS_LISTEN_PORT) {
+    canonical.listen_port = config_interface.ListenPort;
+  }
+  config.ForEachPeer([&canonical](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+    canonical.peers[std::string(PublicKeyOf(peer))] = Canonical(peer, allowed_ips, count);
+  });
+  return canonical;
+}
+
+void AppendBytes(std::string &out, const void *data, size_t size) {
+  out.append(static_cast<const char *>(data), size);
+}
+
+void AppendPeer(std::string &out, const CanonicalPeer &peer) {
+  AppendBytes(out, peer.preshared_key, WIREGUARD_KEY_LENGTH);
+  AppendBytes(out, &peer.keepalive, sizeof(peer.keepalive));
+  size_t count = peer.allowed_ips.size();
+  AppendBytes(out, &count, sizeof(count));
+  for (const auto &allowed_ip : peer.allowed_ips) {
+    AppendBytes(out, allowed_ip.data(), allowed_ip.size());
+  }
+}
+
+uint64_t Hash(const CanonicalConfiguration &config) {
+  std::string out;
+  AppendBytes(out, &config.has_private_key, sizeof(config.has_private_key));
+  AppendBytes(out, config.private_key, WIREGUARD_KEY_LENGTH);
+  AppendBytes(out, &config.listen_port, sizeof(config.listen_port));
+  for (const auto &entry : config.peers) {
+    out += entry.first;
+    AppendPeer(out, entry.second);
+  }
+  uint64_t hash = WireguardConfigParser::HashText(out);
+  SecureZeroMemory(out.data(), out.size());
+  return hash;
+}
+
+bool SamePeer(const CanonicalPeer &a, const CanonicalPeer &b) {
+  return memcmp(a.preshared_key, b.preshared_key, WIREGUARD_KEY_LENGTH) == 0 && a.keepalive == b.keepalive &&
+         a.allowed_ips == b.allowed_ips;
+}
+
+PeerPublicKey ToPublicKey(const std::string &key) {
+  PeerPublicKey public_key;
+  memcpy(public_key.data(), key.data(), WIREGUARD_KEY_LENGTH);
+  return public_key;
+}
+
+} // namespace
+
+bool BuildConfigurationDelta(const WireguardConfigBuffer &previous, const WireguardConfigBuffer &next,
+                             WireguardConfigBuffer &delta) {
+  const WIREGUARD_INTERFACE &old_interface = previous.Interface();
+  const WIREGUARD_INTERFACE &new_interface = next.Interface();
+
+  // A new private key invalidates every session anyway
+  bool old_has_private_key = (old_interface.Flags & WIREGUARD_INTERFACE_HAS_PRIVATE_KEY) != 0;
+  bool new_has_private_key = (new_interface.Flags & WIREGUARD_INTERFACE_HAS_PRIVATE_KEY) != 0;
+  if (old_has_private_key != new_has_private_key ||
+      memcmp(old_interface.PrivateKey, new_interface.PrivateKey, WIREGUARD_KEY_LENGTH) != 0) {
+    return false;
+  }
+
+  bool diffable = true;
+  std::unordered_map<std::string_view, PeerRecord> previous_peers;
+  previous_peers.reserve(old_interface.PeersCount);
+  previous.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+    if (!HasFlag(peer, WIREGUARD_PEER_HAS_PUBLIC_KEY) ||
+        !previous_peers.emplace(PublicKeyOf(peer), PeerRecord{&peer, allowed_ips, count, false}).second) {
+      diffable = false;
+    }
+  });
+  if (!diffable) {
+    return false;
+  }
+
+  delta.Clear();
+  WIREGUARD_INTERFACE &delta_interface = delta.Interface();
+  delta_interface = new_interface;
+  delta_interface.Flags =
+      static_cast<WIREGUARD_INTERFACE_FLAG>(new_interface.Flags & ~WIREGUARD_INTERFACE_REPLACE_PEERS);
+  delta_interface.PeersCount = 0;
+
+  std::unordered_map<std::string_view, bool> seen;
+  seen.reserve(new_interface.PeersCount);
+  next.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+    if (!diffable) {
+      return;
+    }
+    if (!HasFlag(peer, WIREGUARD_PEER_HAS_PUBLIC_KEY) || !seen.emplace(PublicKeyOf(peer), true).second) {
+      diffable = false;
+      return;
+    }
+
+    PeerRecord record{&peer, allowed_ips, count, false};
+    auto previous_it = previous_peers.find(PublicKeyOf(peer));
+    if (previous_it == previous_peers.end()) {
+      // New peer, added as parsed
+      delta.AppendPeer() = peer;
+      delta.CurrentPeer().AllowedIPsCount = 0;
+      AppendAllowedIPs(delta, record);
+      return;
+    }
+
+    previous_it->second.matched = true;
+    AppendPeerUpdate(delta, previous_it->second, record);
+  });
+  if (!diffable) {
+    return false;
+  }
+
+  // Peers that are gone, in their original order
+  previous.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *, DWORD) {
+    if (previous_peers.at(PublicKeyOf(peer)).matched) {
+      return;
+    }
+    WIREGUARD_PEER &removal = delta.AppendPeer();
+    removal.Flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_REMOVE | WIREGUARD_PEER_HAS_PUBLIC_KEY);
+    memcpy(removal.PublicKey, peer.PublicKey, WIREGUARD_KEY_LENGTH);
+  });
+
+  return true;
+}
+
+bool BuildPeerChange(const WireguardConfigBuffer &previous, const WireguardConfigBuffer &added,
+                     const std::vector<PeerPublicKey> &removed, WireguardConfigBuffer &delta) {
+  std::unordered_map<std::string_view, PeerRecord> previous_peers;
+  previous_peers.reserve(previous.Interface().PeersCount);
+  previous.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+    previous_peers.emplace(PublicKeyOf(peer), PeerRecord{&peer, allowed_ips, count, false});
+  });
+
+  delta.Clear();
+  delta.Reserve(sizeof(WIREGUARD_INTERFACE) + removed.size() * sizeof(WIREGUARD_PEER) + added.Size());
+
+  std::unordered_map<std::string_view, bool> seen;
+  seen.reserve(added.Interface().PeersCount);
+  bool valid = true;
+  added.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *, DWORD) {
+    if (!HasFlag(peer, WIREGUARD_PEER_HAS_PUBLIC_KEY) || !seen.emplace(PublicKeyOf(peer), true).second) {
+      valid = false;
+    }
+  });
+  if (!valid) {
+    return false;
+  }
+
+  // Removals first, the driver applies the records in order
+  for (const PeerPublicKey &key : removed) {
+    std::string_view key_view(reinterpret_cast<const char *>(key.data()), key.size());
+    if (previous_peers.count(key_view) == 0 || seen.count(key_view) > 0) {
+      continue;
+    }
+    WIREGUARD_PEER &removal = delta.AppendPeer();
+    removal.Flags = static_cast<WIREGUARD_PEER_FLAG>(WIREGUARD_PEER_REMOVE | WIREGUARD_PEER_HAS_PUBLIC_KEY);
+    memcpy(removal.PublicKey, key.data(), WIREGUARD_KEY_LENGTH);
+  }
+
+  added.ForEachPeer([&](const WIREGUARD_PEER &peer, const WIREGUARD_ALLOWED_IP *allowed_ips, DWORD count) {
+    PeerRecord record{&peer, allowed_ips, count, false};
+    auto previous_it = previous_peers.find(PublicKeyOf(peer));
+    if (previous_it != previous_peers.end()) {
+      AppendPeerUpdate(delta, previous_it->second, record);
+      return;
+    }
+    delta.AppendPeer() = peer;
+    delta.CurrentPeer().AllowedIPsCount = 0;
+    AppendAllowedIPs(delta, record);
+  });
+  return true;
+}
+
+void DiffConfigurations(const WireguardConfigBuffer &expected, const WireguardConfigBuffer &actual,
+                        ConfigurationDrift *drift) {
+  *drift = ConfigurationDrift();
+  CanonicalConfiguration expected_config = Canonical(expected);
+  CanonicalConfiguration actual_config = Canonical(actual);
+
+  // The driver reports the port it picked when none was configured
+  if (expected_config.listen_port == 0) {
+    actual_config.listen_port = 0;
+  }
+  drift->expected_hash = Hash(expected_config);
+  drift->actual_hash = Hash(actual_config);
+  if (drift->InSync()) {
+    return;
+  }
+
+  bool same_private_key = expected_config.has_private_key == actual_config.has_private_key &&
+                          memcmp(expected_config.private_key, actual_config.private_key, WIREGUARD_KEY_LENGTH) == 0;
+  drift->interface_changed = !same_private_key || expected_config.listen_port != actual_config.listen_port;
+  for (const auto &entry : expected_config.peers) {
+    auto actual_peer = actual_config.peers.find(entry.first);
+    if (actual_peer == actual_config.peers.end()) {
+      drift->missing_peers.push_back(ToPublicKey(entry.first));
+    } else if (!SamePeer(entry.second, actual_peer->second)) {
+      drift->changed_peers.push_back(ToPublicKey(entry.first));
+    }
+  }
+  for (const auto &entry : actual_config.peers) {
+    if (expected_config.peers.count(entry.first) == 0) {
+      drift->unexpected_peers.push_back(ToPublicKey(entry.first));
+    }
+  }
+}
+
+} // namespace wireguard_dart
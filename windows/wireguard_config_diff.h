@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "wireguard_config_buffer.h"
+
+namespace wireguard_dart {
+
+/**
+ * Build the smallest WIREGUARD_INTERFACE update that turns the previous configuration into the next one,
+ * matching peers by public key. New peers are added, changed peers are sent with WIREGUARD_PEER_UPDATE and
+ * only the fields that changed, missing peers are sent with WIREGUARD_PEER_REMOVE, and unchanged peers are
+ * left out so their sessions survive.
+ * @param previous The configuration currently applied to the adapter
+ * @param next The configuration to apply
+ * @param delta Receives the update
+ * @return false if the configurations cannot be diffed (a peer without a public key, duplicate public keys or a
+ *         changed private key); the caller should then apply next as a full replacement
+ */
+bool BuildConfigurationDelta(const WireguardConfigBuffer &previous, const WireguardConfigBuffer &next,
+                             WireguardConfigBuffer &delta);
+
+using PeerPublicKey = std::array<BYTE, WIREGUARD_KEY_LENGTH>;
+
+/**
+ * Build the update that adds the peers of added and removes those with the keys in removed, leaving every other
+ * peer out of it, for a hub that changes a few of its many peers at a time. A peer of added that previous already
+ * has is updated like BuildConfigurationDelta would, so its session survives; a key both added and removed is
+ * added. Keys previous does not have are not removed. The interface is sent without any flags, so its keys, port
+ * and the other peers stay as they are.
+ * @return false if a peer of added has no public key or the same one as another
+ */
+bool BuildPeerChange(const WireguardConfigBuffer &previous, const WireguardConfigBuffer &added,
+                     const std::vector<PeerPublicKey> &removed, WireguardConfigBuffer &delta);
+
+// How the configuration a driver runs differs from the one applied to it, see DiffConfigurations
+struct ConfigurationDrift {
+  uint64_t expected_hash = 0;
+  uint64_t actual_hash = 0;
+  // The private key, or the listen port where one was configured
+  bool interface_changed = false;
+  std::vector<PeerPublicKey> missing_peers;
+  std::vector<PeerPublicKey> unexpected_peers;
+  // Keys, keepalive or allowed IPs differ
+  std::vector<PeerPublicKey> changed_peers;
+
+  bool InSync() const { return expected_hash == actual_hash; }
+};
+
+/**
+ * Compare the configuration read back from the driver with the one applied to it. Both are brought to a canonical
+ * form first, peers sorted by public key and allowed IPs by address with their host bits cleared, and hashed; the
+ * peer by peer diff is only worked out when the hashes differ. Endpoints are not compared: the driver roams a peer
+ * to wherever its authenticated packets come from, and the adapter moves hostname and failover endpoints itself.
+ */
+void DiffConfigurations(const WireguardConfigBuffer &expected, const WireguardConfigBuffer &actual,
+                        ConfigurationDrift *drift);
+
+} // namespace wireguard_dart
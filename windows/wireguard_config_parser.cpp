@@ -1,271 +1,840 @@
 #include "wireguard_config_parser.h"
 
 #include <libbase64.h>
-#include <ws2tcpip.h>
+#include <winsock2.h>
 
 #include <algorithm>
-#include <sstream>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <unordered_set>
+#include <utility>
+
+#include "compute_pool.h"
+#include "ip_address_parser.h"
+#include "prefix_aggregation.h"
+#include "text_scanner.h"
+#include "wireguard_core/keepalive_tuner.h"
+#include "wireguard_core/wireguard_key.h"
+#include "x25519.h"
 
 namespace wireguard_dart {
 
-bool WireguardConfigParser::Parse(const std::string& config_text) {
-  Clear();
+namespace {
+
+// Base64 encoding of a 32 byte key: 43 significant characters plus one '=' of padding
+constexpr size_t kBase64KeyLength = 44;
+
+constexpr std::string_view kWhitespace = " \t\r\n";
+
+// Longest DNS name in text form
+constexpr size_t kMaxHostnameLength = 253;
+
+std::string_view Trim(std::string_view str) {
+  auto start = str.find_first_not_of(kWhitespace);
+  if (start == std::string_view::npos) {
+    return {};
+  }
+
+  auto end = str.find_last_not_of(kWhitespace);
+  return str.substr(start, end - start + 1);
+}
+
+// Parses the whole of str as an unsigned decimal number that fits into T
+template <typename T>
+bool ParseUnsigned(std::string_view str, T& out) {
+  unsigned long value = 0;
+  const char* end = str.data() + str.size();
+  auto [ptr, ec] = std::from_chars(str.data(), end, value);
+  if (ec != std::errc() || ptr != end || value > (std::numeric_limits<T>::max)()) {
+    return false;
+  }
+  out = static_cast<T>(value);
+  return true;
+}
 
-  std::istringstream stream(config_text);
-  std::string line;
-  std::string current_section;
-  std::string section_content;
+bool IsSectionHeader(std::string_view stripped) {
+  return !stripped.empty() && stripped.front() == '[' && stripped.back() == ']';
+}
 
-  while (std::getline(stream, line)) {
-    line = TrimString(line);
+bool ParseBool(std::string_view str, bool& out) {
+  if (str == "true" || str == "on" || str == "1") {
+    out = true;
+    return true;
+  }
+  if (str == "false" || str == "off" || str == "0") {
+    out = false;
+    return true;
+  }
+  return false;
+}
 
-    // Skip empty lines and comments
-    if (line.empty() || line[0] == '#' || line[0] == ';') {
-      continue;
+bool IsHostname(std::string_view host) {
+  if (host.empty() || host.size() > kMaxHostnameLength) {
+    return false;
+  }
+  for (char c : host) {
+    bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+    if (!valid) {
+      return false;
     }
+  }
+  return true;
+}
 
-    // Check for section headers
-    if (line[0] == '[' && line.back() == ']') {
-      // Process previous section
-      if (!current_section.empty()) {
-        if (current_section == "Interface") {
-          if (!ParseInterfaceSection(section_content)) {
-            return false;
-          }
-        } else if (current_section == "Peer") {
-          if (!ParsePeerSection(section_content)) {
-            return false;
-          }
+// A top-level domain is never all digits, so a host ending in such a label is an IPv4 literal that did not parse
+bool IsEndpointHostname(std::string_view host) {
+  if (!IsHostname(host)) {
+    return false;
+  }
+  // Of a fully qualified name, the label before the root's dot
+  std::string_view name = host.back() == '.' ? host.substr(0, host.size() - 1) : host;
+  std::string_view last_label = name.substr(name.rfind('.') + 1);
+  return !std::all_of(last_label.begin(), last_label.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+}  // namespace
+
+bool WireguardConfigParser::Parse(std::string_view config_text) {
+  BeginParse();
+
+  // With the whole text at hand the wire buffer can be sized once: every peer starts with '[' and every
+  // allowed IP has a '/'. Base64 keys and comments make this an overestimate, never an underestimate.
+  size_t sections = static_cast<size_t>(std::count(config_text.begin(), config_text.end(), '['));
+  size_t prefixes = static_cast<size_t>(std::count(config_text.begin(), config_text.end(), '/'));
+  configuration_.Reserve(sizeof(WIREGUARD_INTERFACE) + sections * sizeof(WIREGUARD_PEER) +
+                         prefixes * sizeof(WIREGUARD_ALLOWED_IP));
+
+  if (sections >= kParallelMinPeers) {
+    return ParseParallel(config_text);
+  }
+  return Feed(config_text) && Finish();
+}
+
+bool WireguardConfigParser::ParseParallel(std::string_view config_text) {
+  text_hash_ = HashText(config_text, text_hash_);
+  text_size_ = config_text.size();
+
+  // First pass: only lines starting with '[' are looked at, to cut the text into runs of up to kPeersPerArena
+  // [Peer] sections and the runs of everything else in between
+  struct Run {
+    size_t begin;
+    size_t first_line;
+    bool peers;
+  };
+  std::vector<Run> runs{{0, 1, false}};
+  size_t peer_runs = 0;
+  size_t run_peers = 0;
+  LineScanner scanner(config_text);
+  ScannedLine scanned;
+  for (size_t line = 1; scanner.Next(&scanned); line++) {
+    std::string_view text = scanned.text;
+    size_t first = text.find_first_not_of(kWhitespace);
+    if (first != std::string_view::npos && text[first] == '[') {
+      // Everything after '#' is a comment, as in wg-quick
+      std::string_view stripped = Trim(text.substr(0, scanned.comment));
+      size_t line_start = static_cast<size_t>(text.data() - config_text.data());
+      if (IsSectionHeader(stripped)) {
+        bool peer = stripped.substr(1, stripped.size() - 2) == "Peer";
+        if (peer && (!runs.back().peers || run_peers == kPeersPerArena)) {
+          runs.push_back({line_start, line, true});
+          peer_runs++;
+          run_peers = 0;
+        } else if (!peer && runs.back().peers) {
+          runs.push_back({line_start, line, false});
         }
+        run_peers += peer ? 1 : 0;
       }
+    }
+  }
 
-      // Start new section
-      current_section = line.substr(1, line.length() - 2);
-      section_content.clear();
-    } else {
-      // Add line to current section content
-      if (!section_content.empty()) {
-        section_content += "\n";
-      }
-      section_content += line;
+  auto run_text = [&](size_t i) {
+    size_t end = i + 1 < runs.size() ? runs[i + 1].begin : config_text.size();
+    return config_text.substr(runs[i].begin, end - runs[i].begin);
+  };
+
+  std::vector<WireguardConfigParser> arenas(peer_runs);
+  std::vector<size_t> arena_runs;
+  arena_runs.reserve(peer_runs);
+  for (size_t i = 0; i < runs.size(); i++) {
+    if (runs[i].peers) {
+      arena_runs.push_back(i);
     }
   }
+  ComputePool::Shared().ParallelFor(arenas.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      arenas[i].ParsePeerRun(run_text(arena_runs[i]), runs[arena_runs[i]].first_line);
+    }
+  });
 
-  // Process final section
-  if (!current_section.empty()) {
-    if (current_section == "Interface") {
-      if (!ParseInterfaceSection(section_content)) {
-        return false;
-      }
-    } else if (current_section == "Peer") {
-      if (!ParsePeerSection(section_content)) {
-        return false;
-      }
+  // The interface and any other sections, in order, on this thread
+  bool parsed = true;
+  for (size_t i = 0; parsed && i < runs.size(); i++) {
+    if (!runs[i].peers) {
+      parsed = ParseRun(run_text(i), runs[i].first_line);
     }
   }
+  parsed = parsed && FlushKeys();
 
+  // The first invalid line of the text, wherever it was found, is the one the serial parse stops at
+  for (const WireguardConfigParser& arena : arenas) {
+    if (arena.failed_) {
+      parsed = false;
+      NoteErrorLine(arena.error_line_);
+    }
+  }
+  if (!parsed) {
+    failed_ = true;
+    return false;
+  }
+
+  for (WireguardConfigParser& arena : arenas) {
+    size_t shift = configuration_.AppendPeers(arena.configuration_);
+    for (HostnameEndpoint& endpoint : arena.hostname_endpoints_) {
+      endpoint.peer_offset += shift;
+      hostname_endpoints_.push_back(std::move(endpoint));
+    }
+    for (AlternateEndpoint& alternate : arena.alternate_endpoints_) {
+      alternate.peer_offset += shift;
+      alternate_endpoints_.push_back(alternate);
+    }
+    for (AutoKeepalive& keepalive : arena.auto_keepalives_) {
+      keepalive.peer_offset += shift;
+      auto_keepalives_.push_back(keepalive);
+    }
+    for (ProbeAddress& probe : arena.probe_addresses_) {
+      probe.peer_offset += shift;
+      probe_addresses_.push_back(probe);
+    }
+  }
+  FinishInterface();
+  return true;
+}
+
+bool WireguardConfigParser::ParseRun(std::string_view text, size_t first_line) {
+  line_number_ = first_line - 1;
+  LineScanner scanner(text);
+  ScannedLine line;
+  while (scanner.Next(&line)) {
+    line_number_++;
+    if (!ParseLine(line, section_)) {
+      FailLine(line_number_);
+      return false;
+    }
+  }
   return true;
 }
 
-bool WireguardConfigParser::ParseInterfaceSection(const std::string& section_content) {
-  std::istringstream stream(section_content);
-  std::string line;
+void WireguardConfigParser::ParsePeerRun(std::string_view text, size_t first_line) {
+  size_t peers = static_cast<size_t>(std::count(text.begin(), text.end(), '['));
+  size_t prefixes = static_cast<size_t>(std::count(text.begin(), text.end(), '/'));
+  configuration_.Reserve(sizeof(WIREGUARD_INTERFACE) + peers * sizeof(WIREGUARD_PEER) +
+                         prefixes * sizeof(WIREGUARD_ALLOWED_IP));
 
-  while (std::getline(stream, line)) {
-    line = TrimString(line);
-    if (line.empty()) continue;
+  failed_ = !ParseRun(text, first_line) || !FlushKeys();
+  if (!failed_) {
+    FinishPeer();
+  }
+}
+
+void WireguardConfigParser::BeginParse() { Clear(); }
 
-    auto equals_pos = line.find('=');
-    if (equals_pos == std::string::npos) continue;
+bool WireguardConfigParser::Feed(std::string_view chunk) {
+  text_hash_ = HashText(chunk, text_hash_);
+  text_size_ += chunk.size();
+
+  if (failed_) {
+    return false;
+  }
 
-    std::string key = TrimString(line.substr(0, equals_pos));
-    std::string value = TrimString(line.substr(equals_pos + 1));
+  size_t line_start = 0;
 
-    if (!ParseKeyValue(key, value, interface_)) {
+  // Complete the line left over from the previous chunk
+  if (!pending_line_.empty()) {
+    size_t line_end = chunk.find('\n');
+    if (line_end == std::string_view::npos) {
+      pending_line_.append(chunk);
+      return true;
+    }
+
+    pending_line_.append(chunk.substr(0, line_end));
+    line_number_++;
+    bool parsed = ParseLine(pending_line_, section_);
+    pending_line_.clear();
+    if (!parsed) {
+      FailLine(line_number_);
       return false;
     }
+    line_start = line_end + 1;
+  }
+
+  LineScanner scanner(chunk.substr(line_start));
+  ScannedLine line;
+  while (scanner.Next(&line)) {
+    if (!line.terminated) {
+      // Keep the partial line until the next chunk or Finish
+      pending_line_.assign(line.text);
+      break;
+    }
+
+    line_number_++;
+    if (!ParseLine(line, section_)) {
+      FailLine(line_number_);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool WireguardConfigParser::Finish() {
+  if (!failed_ && !pending_line_.empty()) {
+    line_number_++;
+    if (!ParseLine(pending_line_, section_)) {
+      FailLine(line_number_);
+    }
+    pending_line_.clear();
   }
 
+  if (!failed_) {
+    failed_ = !FlushKeys();
+  }
+
+  if (failed_) {
+    return false;
+  }
+
+  FinishPeer();
+  FinishInterface();
   return true;
 }
 
-bool WireguardConfigParser::ParsePeerSection(const std::string& section_content) {
-  ParsedPeer peer;
-  std::istringstream stream(section_content);
-  std::string line;
+void WireguardConfigParser::FinishPeer() {
+  if (excluded_ips_.empty() || !configuration_.HasPeer()) {
+    excluded_ips_.clear();
+    return;
+  }
+
+  const auto* peer = reinterpret_cast<const WIREGUARD_PEER*>(configuration_.At(configuration_.CurrentPeerOffset()));
+  const auto* allowed_ips = reinterpret_cast<const WIREGUARD_ALLOWED_IP*>(peer + 1);
+  std::vector<WIREGUARD_ALLOWED_IP> allowed(allowed_ips, allowed_ips + peer->AllowedIPsCount);
+  configuration_.ReplaceAllowedIPs(SubtractPrefixes(allowed, excluded_ips_));
+  excluded_ips_.clear();
+}
+
+uint64_t WireguardConfigParser::HashText(std::string_view text, uint64_t hash) {
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+size_t WireguardConfigParser::ErrorColumn(std::string_view text, size_t line) {
+  if (line == 0) {
+    return 0;
+  }
+  size_t line_start = 0;
+  for (size_t i = 1; i < line; i++) {
+    line_start = text.find('\n', line_start);
+    if (line_start == std::string_view::npos) {
+      return 0;
+    }
+    line_start++;
+  }
+  if (line_start > text.size()) {
+    return 0;
+  }
 
-  while (std::getline(stream, line)) {
-    line = TrimString(line);
-    if (line.empty()) continue;
+  std::string_view line_text = text.substr(line_start, text.find('\n', line_start) - line_start);
+  line_text = line_text.substr(0, line_text.find('#'));
+  size_t equals_pos = line_text.find('=');
+  size_t value_start = equals_pos == std::string_view::npos ? 0 : equals_pos + 1;
+  size_t value_pos = line_text.find_first_not_of(kWhitespace, value_start);
+  if (value_pos == std::string_view::npos) {
+    // An empty value is rejected where it would have started
+    value_pos = equals_pos == std::string_view::npos ? 0 : line_text.size();
+  }
+  return value_pos + 1;
+}
 
-    auto equals_pos = line.find('=');
-    if (equals_pos == std::string::npos) continue;
+std::shared_ptr<const SharedRoutes> WireguardConfigParser::GetRoutes() const {
+  std::vector<WIREGUARD_ALLOWED_IP> all_allowed_ips;
+  configuration_.ForEachPeer([&all_allowed_ips](const WIREGUARD_PEER&, const WIREGUARD_ALLOWED_IP* allowed_ips,
+                                                DWORD count) {
+    all_allowed_ips.insert(all_allowed_ips.end(), allowed_ips, allowed_ips + count);
+  });
+  return AggregateRoutesShared(std::move(all_allowed_ips));
+}
 
-    std::string key = TrimString(line.substr(0, equals_pos));
-    std::string value = TrimString(line.substr(equals_pos + 1));
+void WireguardConfigParser::FinishInterface() {
+  // The interface section may appear anywhere in the text, so the header is filled in last
+  WIREGUARD_INTERFACE& wg_interface = configuration_.Interface();
 
-    if (!ParseKeyValue(key, value, peer)) {
-      return false;
+  wg_interface.Flags = WIREGUARD_INTERFACE_REPLACE_PEERS;
+  if (interface_.has_private_key) {
+    wg_interface.Flags =
+        static_cast<WIREGUARD_INTERFACE_FLAG>(wg_interface.Flags | WIREGUARD_INTERFACE_HAS_PRIVATE_KEY);
+  }
+  // Without a PublicKey line the driver still gets one, derived from the private key
+  if (interface_.has_private_key && !interface_.has_public_key) {
+    X25519PublicKey(wg_interface.PublicKey, wg_interface.PrivateKey);
+    interface_.has_public_key = true;
+  }
+  if (interface_.has_public_key) {
+    wg_interface.Flags =
+        static_cast<WIREGUARD_INTERFACE_FLAG>(wg_interface.Flags | WIREGUARD_INTERFACE_HAS_PUBLIC_KEY);
+  }
+  if (interface_.has_listen_port) {
+    wg_interface.Flags =
+        static_cast<WIREGUARD_INTERFACE_FLAG>(wg_interface.Flags | WIREGUARD_INTERFACE_HAS_LISTEN_PORT);
+    wg_interface.ListenPort = interface_.listen_port;
+  }
+}
+
+bool WireguardConfigParser::ParseLine(std::string_view line, Section& section) {
+  ScannedLine scanned;
+  scanned.text = line;
+  scanned.comment = line.find('#');
+  scanned.equals = line.find('=');
+  return ParseLine(scanned, section);
+}
+
+bool WireguardConfigParser::ParseLine(const ScannedLine& scanned, Section& section) {
+  // Everything after '#' is a comment, as in wg-quick
+  std::string_view text = scanned.text.substr(0, scanned.comment);
+  std::string_view line = Trim(text);
+
+  // Skip empty lines and ';' comments
+  if (line.empty() || line[0] == ';') {
+    return true;
+  }
+
+  // Check for section headers
+  if (IsSectionHeader(line)) {
+    FinishPeer();
+    std::string_view name = line.substr(1, line.size() - 2);
+    if (name == "Interface") {
+      section = Section::kInterface;
+    } else if (name == "Peer") {
+      // Peers are parsed in place at the end of the wire buffer
+      section = Section::kPeer;
+      configuration_.AppendPeer().Flags = WIREGUARD_PEER_REPLACE_ALLOWED_IPS;
+    } else {
+      section = Section::kUnknown;
     }
+    return true;
   }
 
-  peers_.push_back(peer);
-  return true;
+  // An '=' in the comment does not count
+  size_t equals_pos = scanned.equals;
+  if (equals_pos >= text.size()) {
+    return true;
+  }
+
+  std::string_view key = Trim(text.substr(0, equals_pos));
+  std::string_view value = Trim(text.substr(equals_pos + 1));
+
+  switch (section) {
+    case Section::kInterface:
+      return ParseKeyValue(key, value, interface_);
+    case Section::kPeer:
+      if (key == "AllowedIPs") {
+        // Appending may grow the buffer, so the peer is not held by reference across this
+        return ParseIPAddressList(
+            value, [this](const WIREGUARD_ALLOWED_IP& allowed_ip) { configuration_.AppendAllowedIP(allowed_ip); });
+      }
+      if (key == "ExcludedIPs") {
+        // Taken out of the allowed IPs once the peer is complete, they may come before or after them
+        return ParseIPAddressList(
+            value, [this](const WIREGUARD_ALLOWED_IP& excluded_ip) { excluded_ips_.push_back(excluded_ip); });
+      }
+      return ParseKeyValue(key, value, configuration_.CurrentPeer());
+    default:
+      // Keys outside of a known section are ignored
+      return true;
+  }
 }
 
-bool WireguardConfigParser::ParseKeyValue(const std::string& key, const std::string& value, ParsedInterface& iface) {
+bool WireguardConfigParser::ParseKeyValue(std::string_view key, std::string_view value, ParsedInterface& iface) {
   if (key == "PrivateKey") {
-    if (DecodeBase64Key(value, iface.private_key)) {
+    if (QueueKey(value, offsetof(WIREGUARD_INTERFACE, PrivateKey))) {
       iface.has_private_key = true;
       return true;
     }
     return false;
   } else if (key == "PublicKey") {
-    if (DecodeBase64Key(value, iface.public_key)) {
+    if (QueueKey(value, offsetof(WIREGUARD_INTERFACE, PublicKey))) {
       iface.has_public_key = true;
       return true;
     }
     return false;
   } else if (key == "ListenPort") {
-    try {
-      iface.listen_port = static_cast<WORD>(std::stoul(value));
+    if (ParseUnsigned(value, iface.listen_port)) {
       iface.has_listen_port = true;
       return true;
-    } catch (...) {
-      return false;
     }
+    return false;
   } else if (key == "MTU") {
-    try {
-      iface.mtu = static_cast<DWORD>(std::stoul(value));
+    if (value == "auto") {
+      iface.mtu_auto = true;
       return true;
-    } catch (...) {
-      return false;
     }
+    return ParseUnsigned(value, iface.mtu);
   } else if (key == "Address") {
-    // Parse comma-separated addresses
-    auto addresses = SplitString(value, ',');
-    for (const auto& addr_str : addresses) {
-      WIREGUARD_ALLOWED_IP allowed_ip;
-      if (ParseIPAddress(TrimString(addr_str), allowed_ip)) {
-        iface.addresses.push_back(allowed_ip);
-      } else {
-        return false;
-      }
+    return ParseIPAddressList(
+        value, [&iface](const WIREGUARD_ALLOWED_IP& allowed_ip) { iface.addresses.push_back(allowed_ip); });
+  } else if (key == "DNS") {
+    return ParseDnsList(value, iface);
+  } else if (key == "SplitDNS") {
+    return ParseSplitDnsList(value, iface);
+  } else if (key == "QoS") {
+    return ParseQosList(value, iface);
+  } else if (key == "Metric") {
+    if (ParseUnsigned(value, iface.profile.metric)) {
+      iface.profile.has_metric = true;
+      return true;
     }
-    return true;
+    return false;
+  } else if (key == "AutomaticMetric") {
+    if (ParseBool(value, iface.profile.automatic_metric)) {
+      iface.profile.has_automatic_metric = true;
+      return true;
+    }
+    return false;
+  } else if (key == "RouterDiscovery") {
+    if (ParseBool(value, iface.profile.router_discovery)) {
+      iface.profile.has_router_discovery = true;
+      return true;
+    }
+    return false;
+  } else if (key == "DadTransmits") {
+    if (ParseUnsigned(value, iface.profile.dad_transmits)) {
+      iface.profile.has_dad_transmits = true;
+      return true;
+    }
+    return false;
   }
 
   // Ignore unknown keys
   return true;
 }
 
-bool WireguardConfigParser::ParseKeyValue(const std::string& key, const std::string& value, ParsedPeer& peer) {
+bool WireguardConfigParser::ParseKeyValue(std::string_view key, std::string_view value, WIREGUARD_PEER& peer) {
   if (key == "PublicKey") {
-    if (DecodeBase64Key(value, peer.public_key)) {
-      peer.has_public_key = true;
+    if (QueueKey(value, configuration_.CurrentPeerOffset() + offsetof(WIREGUARD_PEER, PublicKey))) {
+      peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | WIREGUARD_PEER_HAS_PUBLIC_KEY);
       return true;
     }
     return false;
   } else if (key == "PresharedKey") {
-    if (DecodeBase64Key(value, peer.preshared_key)) {
-      peer.has_preshared_key = true;
+    if (QueueKey(value, configuration_.CurrentPeerOffset() + offsetof(WIREGUARD_PEER, PresharedKey))) {
+      peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | WIREGUARD_PEER_HAS_PRESHARED_KEY);
       return true;
     }
     return false;
   } else if (key == "PersistentKeepalive") {
-    try {
-      peer.persistent_keepalive = static_cast<WORD>(std::stoul(value));
-      peer.has_persistent_keepalive = true;
+    if (ParseUnsigned(value, peer.PersistentKeepalive)) {
+      peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
       return true;
-    } catch (...) {
+    }
+    return AddAutoKeepalive(configuration_.CurrentPeerOffset(), value, peer);
+  } else if (key == "ProbeAddress") {
+    SOCKADDR_INET address = {};
+    if (ParseIPv4Address(value, address.Ipv4.sin_addr)) {
+      address.si_family = AF_INET;
+    } else if (ParseIPv6Address(value, address.Ipv6.sin6_addr)) {
+      address.si_family = AF_INET6;
+    } else {
       return false;
     }
+    AddProbeAddress(configuration_.CurrentPeerOffset(), address);
+    return true;
   } else if (key == "Endpoint") {
-    if (ParseEndpoint(value, peer.endpoint)) {
-      peer.has_endpoint = true;
-      return true;
-    }
-    return false;
-  } else if (key == "AllowedIPs") {
-    // Parse comma-separated allowed IPs
-    auto ips = SplitString(value, ',');
-    for (const auto& ip_str : ips) {
-      WIREGUARD_ALLOWED_IP allowed_ip;
-      if (ParseIPAddress(TrimString(ip_str), allowed_ip)) {
-        peer.allowed_ips.push_back(allowed_ip);
-      } else {
+    // Endpoint lines after the first are alternates, see GetAlternateEndpoints
+    size_t peer_offset = configuration_.CurrentPeerOffset();
+    if ((peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) ||
+        (!hostname_endpoints_.empty() && hostname_endpoints_.back().peer_offset == peer_offset)) {
+      AlternateEndpoint alternate;
+      alternate.peer_offset = peer_offset;
+      if (!ParseEndpoint(value, alternate.address)) {
         return false;
       }
+      alternate_endpoints_.push_back(alternate);
+      return true;
     }
-    return true;
+
+    if (ParseEndpoint(value, peer.Endpoint)) {
+      peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | WIREGUARD_PEER_HAS_ENDPOINT);
+      return true;
+    }
+
+    // Hostnames are resolved by the adapter; the peer goes out without an endpoint until then
+    std::string_view host;
+    WORD port;
+    if (ParseHostnameEndpoint(value, host, port)) {
+      hostname_endpoints_.push_back({peer_offset, std::string(host), port});
+      return true;
+    }
+    return false;
   }
 
   // Ignore unknown keys
   return true;
 }
 
-bool WireguardConfigParser::DecodeBase64Key(const std::string& base64_key, BYTE* key_buffer) {
-  if (base64_key.empty()) {
+bool WireguardConfigParser::QueueKey(std::string_view base64_key, size_t offset) {
+  // Anything else cannot decode to exactly WIREGUARD_KEY_LENGTH bytes
+  if (base64_key.size() != kBase64KeyLength || base64_key.back() != '=') {
     return false;
   }
 
+  // Padding may only end the input, so the '=' is replaced by 'A' (zero bits). The block then decodes to one
+  // extra byte, which has to be zero too for the key to be canonical.
+  if (pending_key_offsets_.empty()) {
+    // No-ops once the first batch has sized them, as Clear() keeps the memory
+    pending_keys_.reserve(kKeyBatchSize * kBase64KeyLength);
+    pending_key_offsets_.reserve(kKeyBatchSize);
+    pending_key_lines_.reserve(kKeyBatchSize);
+  }
+  pending_keys_.append(base64_key.data(), kBase64KeyLength - 1);
+  pending_keys_.push_back('A');
+  pending_key_offsets_.push_back(offset);
+  pending_key_lines_.push_back(line_number_);
+
+  if (pending_key_offsets_.size() >= kKeyBatchSize) {
+    return FlushKeys();
+  }
+  return true;
+}
+
+bool WireguardConfigParser::FlushKeys() {
+  if (pending_key_offsets_.empty()) {
+    return true;
+  }
+
+  constexpr size_t kDecodedBlockLength = WIREGUARD_KEY_LENGTH + 1;
+  size_t key_count = pending_key_offsets_.size();
+  decoded_keys_.resize(key_count * kDecodedBlockLength);
+
+  // One call for the whole batch validates every character and lets the SIMD codecs work on long runs
   size_t decoded_size = 0;
-  if (base64_decode(base64_key.c_str(), base64_key.length(), (char*)key_buffer, &decoded_size, 0) != 1) {
-    return false;
+  int decoded = base64_decode(pending_keys_.data(), pending_keys_.size(), decoded_keys_.data(), &decoded_size, 0);
+  bool valid = decoded == 1 && decoded_size == decoded_keys_.size();
+
+  for (size_t i = 0; valid && i < key_count; i++) {
+    const char* key = decoded_keys_.data() + i * kDecodedBlockLength;
+    if (key[WIREGUARD_KEY_LENGTH] != 0) {
+      valid = false;
+      break;
+    }
+    memcpy(configuration_.At(pending_key_offsets_[i]), key, WIREGUARD_KEY_LENGTH);
+  }
+
+  if (!valid) {
+    // Only now each key on its own, to find the line of the first invalid one
+    for (size_t i = 0; i < key_count; i++) {
+      char key[kDecodedBlockLength];
+      size_t key_size = 0;
+      if (base64_decode(pending_keys_.data() + i * kBase64KeyLength, kBase64KeyLength, key, &key_size, 0) != 1 ||
+          key_size != kDecodedBlockLength || key[WIREGUARD_KEY_LENGTH] != 0) {
+        NoteErrorLine(pending_key_lines_[i]);
+        break;
+      }
+    }
   }
 
-  return decoded_size == WIREGUARD_KEY_LENGTH;
+  pending_keys_.clear();
+  pending_key_offsets_.clear();
+  pending_key_lines_.clear();
+  return valid;
 }
 
-bool WireguardConfigParser::ParseIPAddress(const std::string& ip_str, WIREGUARD_ALLOWED_IP& allowed_ip) {
-  auto slash_pos = ip_str.find('/');
-  if (slash_pos == std::string::npos) {
-    return false;
+void WireguardConfigParser::FailLine(size_t line) {
+  failed_ = true;
+  FlushKeys();
+  NoteErrorLine(line);
+}
+
+void WireguardConfigParser::NoteErrorLine(size_t line) {
+  // Keys given as values have no line
+  if (line != 0 && (error_line_ == 0 || line < error_line_)) {
+    error_line_ = line;
   }
+}
 
-  std::string addr_str = ip_str.substr(0, slash_pos);
-  std::string cidr_str = ip_str.substr(slash_pos + 1);
+template <typename Sink>
+bool WireguardConfigParser::ParseIPAddressList(std::string_view list, Sink&& sink) {
+  // Parse comma-separated addresses
+  while (!list.empty()) {
+    auto comma_pos = list.find(',');
+    std::string_view item = Trim(list.substr(0, comma_pos));
 
-  // Parse CIDR
-  try {
-    allowed_ip.Cidr = static_cast<BYTE>(std::stoul(cidr_str));
-  } catch (...) {
+    if (!item.empty()) {
+      WIREGUARD_ALLOWED_IP allowed_ip = {};
+      if (!ParseIPAddress(item, allowed_ip)) {
+        return false;
+      }
+      sink(allowed_ip);
+    }
+
+    if (comma_pos == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma_pos + 1);
+  }
+
+  return true;
+}
+
+bool WireguardConfigParser::ParseDnsList(std::string_view list, ParsedInterface& iface) {
+  // Comma-separated like wg-quick: server addresses and search domains in any order
+  while (!list.empty()) {
+    auto comma_pos = list.find(',');
+    std::string_view item = Trim(list.substr(0, comma_pos));
+
+    if (!item.empty()) {
+      SOCKADDR_INET server = {};
+      if (ParseIPv4Address(item, server.Ipv4.sin_addr)) {
+        server.si_family = AF_INET;
+        iface.dns_servers.push_back(server);
+      } else if (ParseIPv6Address(item, server.Ipv6.sin6_addr)) {
+        server.si_family = AF_INET6;
+        iface.dns_servers.push_back(server);
+      } else if (IsHostname(item)) {
+        iface.dns_search_domains.emplace_back(item);
+      } else {
+        return false;
+      }
+    }
+
+    if (comma_pos == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma_pos + 1);
+  }
+
+  return true;
+}
+
+bool WireguardConfigParser::ParseSplitDnsList(std::string_view list, ParsedInterface& iface) {
+  // Comma-separated domains, each also covering its subdomains; a leading "*." or "." says the same
+  while (!list.empty()) {
+    auto comma_pos = list.find(',');
+    std::string_view item = Trim(list.substr(0, comma_pos));
+    if (item.substr(0, 2) == "*.") {
+      item.remove_prefix(2);
+    } else if (item.substr(0, 1) == ".") {
+      item.remove_prefix(1);
+    }
+
+    if (!item.empty()) {
+      if (!IsHostname(item) || item.front() == '.') {
+        return false;
+      }
+      iface.dns_split_domains.emplace_back(item);
+    }
+
+    if (comma_pos == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma_pos + 1);
+  }
+
+  return true;
+}
+
+bool WireguardConfigParser::ParseQosList(std::string_view list, ParsedInterface& iface) {
+  while (!list.empty()) {
+    auto comma_pos = list.find(',');
+    std::string_view item = Trim(list.substr(0, comma_pos));
+
+    if (!item.empty()) {
+      QosRule rule;
+      if (!ParseQosRule(item, rule)) {
+        return false;
+      }
+      iface.qos_rules.push_back(std::move(rule));
+    }
+
+    if (comma_pos == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma_pos + 1);
+  }
+
+  return true;
+}
+
+bool WireguardConfigParser::ParseQosRule(std::string_view entry, QosRule& rule) {
+  // The last colon, as an application path has one after its drive letter
+  auto colon_pos = entry.rfind(':');
+  if (colon_pos == std::string_view::npos || !ParseUnsigned(Trim(entry.substr(colon_pos + 1)), rule.dscp) ||
+      rule.dscp > 63) {
+    return false;
+  }
+  std::string_view match = Trim(entry.substr(0, colon_pos));
+  if (match.empty()) {
     return false;
   }
 
-  // Try IPv4 first
-  IN_ADDR addr4;
-  if (inet_pton(AF_INET, addr_str.c_str(), &addr4) == 1) {
-    allowed_ip.AddressFamily = AF_INET;
-    allowed_ip.Address.V4 = addr4;
+  if (match == "tunnel") {
+    rule.tunnel = true;
     return true;
   }
-
-  // Try IPv6
-  IN6_ADDR addr6;
-  if (inet_pton(AF_INET6, addr_str.c_str(), &addr6) == 1) {
-    allowed_ip.AddressFamily = AF_INET6;
-    allowed_ip.Address.V6 = addr6;
+  auto slash_pos = match.find('/');
+  std::string_view protocol = match.substr(0, slash_pos);
+  if (slash_pos == std::string_view::npos || (protocol != "tcp" && protocol != "udp")) {
+    rule.application = std::string(match);
     return true;
   }
+  rule.protocol = protocol == "tcp" ? IPPROTO_TCP : IPPROTO_UDP;
+  std::string_view ports = match.substr(slash_pos + 1);
+  auto dash_pos = ports.find('-');
+  if (!ParseUnsigned(ports.substr(0, dash_pos), rule.first_port)) {
+    return false;
+  }
+  rule.last_port = rule.first_port;
+  if (dash_pos != std::string_view::npos && !ParseUnsigned(ports.substr(dash_pos + 1), rule.last_port)) {
+    return false;
+  }
+  return rule.first_port != 0 && rule.first_port <= rule.last_port;
+}
 
-  return false;
+bool WireguardConfigParser::ParseIPAddress(std::string_view ip_str, WIREGUARD_ALLOWED_IP& allowed_ip) {
+  auto slash_pos = ip_str.find('/');
+  if (slash_pos == std::string_view::npos) {
+    return false;
+  }
+
+  std::string_view addr_str = ip_str.substr(0, slash_pos);
+  std::string_view cidr_str = ip_str.substr(slash_pos + 1);
+
+  // Only IPv6 addresses contain a colon
+  if (addr_str.find(':') == std::string_view::npos) {
+    allowed_ip.AddressFamily = AF_INET;
+    return ParseIPv4Address(addr_str, allowed_ip.Address.V4) && ParseCidr(cidr_str, 32, allowed_ip.Cidr);
+  }
+
+  allowed_ip.AddressFamily = AF_INET6;
+  return ParseIPv6Address(addr_str, allowed_ip.Address.V6) && ParseCidr(cidr_str, 128, allowed_ip.Cidr);
 }
 
-bool WireguardConfigParser::ParseEndpoint(const std::string& endpoint_str, SOCKADDR_INET& endpoint) {
+bool WireguardConfigParser::ParseEndpoint(std::string_view endpoint_str, SOCKADDR_INET& endpoint) {
   // Parse format: "IP:PORT" or "[IPv6]:PORT"
 
   if (endpoint_str.empty()) {
     return false;
   }
 
-  std::string ip_str;
-  std::string port_str;
+  std::string_view ip_str;
+  std::string_view port_str;
 
   if (endpoint_str[0] == '[') {
     // IPv6 format: [::1]:51820
     auto close_bracket = endpoint_str.find(']');
-    if (close_bracket == std::string::npos || close_bracket + 1 >= endpoint_str.length() ||
+    if (close_bracket == std::string_view::npos || close_bracket + 1 >= endpoint_str.size() ||
         endpoint_str[close_bracket + 1] != ':') {
       return false;
     }
@@ -274,7 +843,7 @@ bool WireguardConfigParser::ParseEndpoint(const std::string& endpoint_str, SOCKA
   } else {
     // IPv4 format: 192.168.1.1:51820
     auto colon_pos = endpoint_str.rfind(':');
-    if (colon_pos == std::string::npos) {
+    if (colon_pos == std::string_view::npos) {
       return false;
     }
     ip_str = endpoint_str.substr(0, colon_pos);
@@ -283,142 +852,371 @@ bool WireguardConfigParser::ParseEndpoint(const std::string& endpoint_str, SOCKA
 
   // Parse port
   WORD port;
-  try {
-    port = static_cast<WORD>(std::stoul(port_str));
-  } catch (...) {
+  if (!ParsePort(port_str, port)) {
     return false;
   }
 
-  // Try IPv4 first
-  SOCKADDR_IN* addr4 = &endpoint.Ipv4;
-  if (inet_pton(AF_INET, ip_str.c_str(), &addr4->sin_addr) == 1) {
+  // Only IPv6 addresses contain a colon
+  if (ip_str.find(':') == std::string_view::npos) {
+    SOCKADDR_IN* addr4 = &endpoint.Ipv4;
+    if (!ParseIPv4Address(ip_str, addr4->sin_addr)) {
+      return false;
+    }
     endpoint.si_family = AF_INET;
     addr4->sin_family = AF_INET;
     addr4->sin_port = htons(port);
     return true;
   }
 
-  // Try IPv6
   SOCKADDR_IN6* addr6 = &endpoint.Ipv6;
-  if (inet_pton(AF_INET6, ip_str.c_str(), &addr6->sin6_addr) == 1) {
-    endpoint.si_family = AF_INET6;
-    addr6->sin6_family = AF_INET6;
-    addr6->sin6_port = htons(port);
-    return true;
+  if (!ParseIPv6Address(ip_str, addr6->sin6_addr)) {
+    return false;
   }
-
-  return false;
+  endpoint.si_family = AF_INET6;
+  addr6->sin6_family = AF_INET6;
+  addr6->sin6_port = htons(port);
+  return true;
 }
 
-DWORD WireguardConfigParser::CalculateConfigurationSize() const {
-  DWORD size = sizeof(WIREGUARD_INTERFACE);
+bool WireguardConfigParser::ParseHostnameEndpoint(std::string_view endpoint_str, std::string_view& host, WORD& port) {
+  // Parse format: "HOST:PORT"
+  auto colon_pos = endpoint_str.rfind(':');
+  if (colon_pos == std::string_view::npos || colon_pos == 0 || colon_pos > kMaxHostnameLength) {
+    return false;
+  }
 
-  for (const auto& peer : peers_) {
-    size += sizeof(WIREGUARD_PEER);
-    size += static_cast<DWORD>(peer.allowed_ips.size() * sizeof(WIREGUARD_ALLOWED_IP));
+  host = endpoint_str.substr(0, colon_pos);
+  if (!IsEndpointHostname(host)) {
+    return false;
   }
 
-  return size;
+  return ParsePort(endpoint_str.substr(colon_pos + 1), port);
 }
 
-DWORD WireguardConfigParser::BuildConfiguration(void* buffer, DWORD buffer_size) const {
-  DWORD required_size = CalculateConfigurationSize();
-  if (buffer_size < required_size) {
-    return 0;
+bool WireguardConfigParser::AddHostnameEndpoint(size_t peer_offset, std::string_view host, WORD port) {
+  if (host.size() > kMaxHostnameLength || !IsEndpointHostname(host)) {
+    return false;
   }
+  hostname_endpoints_.push_back({peer_offset, std::string(host), port});
+  return true;
+}
 
-  BYTE* current_pos = static_cast<BYTE*>(buffer);
-
-  // Build interface structure
-  WIREGUARD_INTERFACE* wg_interface = reinterpret_cast<WIREGUARD_INTERFACE*>(current_pos);
-  ZeroMemory(wg_interface, sizeof(WIREGUARD_INTERFACE));
-
-  wg_interface->Flags = WIREGUARD_INTERFACE_REPLACE_PEERS;
-  if (interface_.has_private_key) {
-    wg_interface->Flags =
-        static_cast<WIREGUARD_INTERFACE_FLAG>(wg_interface->Flags | WIREGUARD_INTERFACE_HAS_PRIVATE_KEY);
-    memcpy(wg_interface->PrivateKey, interface_.private_key, WIREGUARD_KEY_LENGTH);
+bool WireguardConfigParser::AddAutoKeepalive(size_t peer_offset, std::string_view value, WIREGUARD_PEER& peer) {
+  constexpr std::string_view kAuto = "auto";
+  if (value.substr(0, kAuto.size()) != kAuto) {
+    return false;
   }
-  if (interface_.has_public_key) {
-    wg_interface->Flags =
-        static_cast<WIREGUARD_INTERFACE_FLAG>(wg_interface->Flags | WIREGUARD_INTERFACE_HAS_PUBLIC_KEY);
-    memcpy(wg_interface->PublicKey, interface_.public_key, WIREGUARD_KEY_LENGTH);
+  WORD min = KeepaliveTuner::kDefaultMin;
+  WORD max = KeepaliveTuner::kDefaultMax;
+  std::string_view bounds = value.substr(kAuto.size());
+  if (!bounds.empty()) {
+    auto dash = bounds.find('-');
+    if (bounds.front() != ':' || dash == std::string_view::npos || !ParseUnsigned(bounds.substr(1, dash - 1), min) ||
+        !ParseUnsigned(bounds.substr(dash + 1), max) || min == 0 || min > max) {
+      return false;
+    }
   }
-  if (interface_.has_listen_port) {
-    wg_interface->Flags =
-        static_cast<WIREGUARD_INTERFACE_FLAG>(wg_interface->Flags | WIREGUARD_INTERFACE_HAS_LISTEN_PORT);
-    wg_interface->ListenPort = interface_.listen_port;
+  auto_keepalives_.push_back({peer_offset, min, max});
+  peer.PersistentKeepalive = KeepaliveTuner::InitialInterval(min, max);
+  peer.Flags = static_cast<WIREGUARD_PEER_FLAG>(peer.Flags | WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
+  return true;
+}
+
+void WireguardConfigParser::AddProbeAddress(size_t peer_offset, const SOCKADDR_INET& address) {
+  // The last line of a peer wins
+  if (!probe_addresses_.empty() && probe_addresses_.back().peer_offset == peer_offset) {
+    probe_addresses_.back().address = address;
+  } else {
+    probe_addresses_.push_back({peer_offset, address});
   }
+}
 
-  wg_interface->PeersCount = static_cast<DWORD>(peers_.size());
-  current_pos += sizeof(WIREGUARD_INTERFACE);
+void WireguardConfigParser::FinishStructured() {
+  FinishInterface();
+  HashConfiguration();
+}
 
-  // Build peer structures
-  for (const auto& parsed_peer : peers_) {
-    WIREGUARD_PEER* peer = reinterpret_cast<WIREGUARD_PEER*>(current_pos);
-    ZeroMemory(peer, sizeof(WIREGUARD_PEER));
+bool WireguardConfigParser::ApplyOverrides(const InterfaceOverrides& overrides) {
+  BYTE private_key[WIREGUARD_KEY_LENGTH];
+  bool private_key_valid = overrides.private_key.empty() || KeyFromBase64(overrides.private_key, private_key);
+  std::vector<WIREGUARD_ALLOWED_IP> addresses;
+  bool addresses_valid =
+      overrides.addresses.empty() ||
+      ParseIPAddressList(overrides.addresses,
+                         [&addresses](const WIREGUARD_ALLOWED_IP& allowed_ip) { addresses.push_back(allowed_ip); });
+  if (!private_key_valid || !addresses_valid) {
+    // It may have got part of the way
+    SecureZeroMemory(private_key, sizeof(private_key));
+    return false;
+  }
 
-    peer->Flags = WIREGUARD_PEER_REPLACE_ALLOWED_IPS;
+  WIREGUARD_INTERFACE& wg_interface = configuration_.Interface();
+  if (!overrides.private_key.empty()) {
+    memcpy(wg_interface.PrivateKey, private_key, sizeof(private_key));
+    SecureZeroMemory(private_key, sizeof(private_key));
+    // A PublicKey line of the template's belongs to its own private key
+    X25519PublicKey(wg_interface.PublicKey, wg_interface.PrivateKey);
+    interface_.has_private_key = true;
+    interface_.has_public_key = true;
+  }
+  if (!overrides.addresses.empty()) {
+    interface_.addresses = std::move(addresses);
+  }
+  if (overrides.listen_port) {
+    interface_.listen_port = *overrides.listen_port;
+    interface_.has_listen_port = true;
+  }
+  FinishInterface();
 
-    if (parsed_peer.has_public_key) {
-      peer->Flags = static_cast<WIREGUARD_PEER_FLAG>(peer->Flags | WIREGUARD_PEER_HAS_PUBLIC_KEY);
-      memcpy(peer->PublicKey, parsed_peer.public_key, WIREGUARD_KEY_LENGTH);
-    }
+  text_hash_ = kTextHashSeed;
+  HashConfiguration();
+  return true;
+}
 
-    if (parsed_peer.has_preshared_key) {
-      peer->Flags = static_cast<WIREGUARD_PEER_FLAG>(peer->Flags | WIREGUARD_PEER_HAS_PRESHARED_KEY);
-      memcpy(peer->PresharedKey, parsed_peer.preshared_key, WIREGUARD_KEY_LENGTH);
+void WireguardConfigParser::ChangePeers(const WireguardConfigParser& added, const std::vector<PeerPublicKey>& removed,
+                                        DroppedPeers* dropped_peers) {
+  auto key_of = [](const BYTE* key) {
+    return std::string_view(reinterpret_cast<const char*>(key), WIREGUARD_KEY_LENGTH);
+  };
+  std::unordered_set<std::string_view> dropped;
+  dropped.reserve(removed.size() + added.configuration_.Interface().PeersCount);
+  for (const PeerPublicKey& key : removed) {
+    dropped.insert(key_of(key.data()));
+  }
+  added.configuration_.ForEachPeer([&](const WIREGUARD_PEER& peer, const WIREGUARD_ALLOWED_IP*, DWORD) {
+    dropped.insert(key_of(peer.PublicKey));
+  });
+
+  // Endpoints, tuned keepalives and probe addresses refer to their peers by offset, which the peers kept are moved
+  // to a new one of
+  std::vector<std::pair<size_t, size_t>> moves;
+  moves.reserve(configuration_.Interface().PeersCount);
+  configuration_.RemovePeers(
+      [&](const WIREGUARD_PEER& peer) {
+        if (dropped.count(key_of(peer.PublicKey)) == 0) {
+          return false;
+        }
+        // The allowed IPs follow the peer, and it is only moved over once this returns
+        if (dropped_peers) {
+          const auto* allowed_ips = reinterpret_cast<const WIREGUARD_ALLOWED_IP*>(&peer + 1);
+          dropped_peers->allowed_ips.insert(dropped_peers->allowed_ips.end(), allowed_ips,
+                                            allowed_ips + peer.AllowedIPsCount);
+          if (peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) {
+            dropped_peers->endpoints.push_back(peer.Endpoint);
+          }
+        }
+        return true;
+      },
+      [&moves](size_t from, size_t to) { moves.emplace_back(from, to); });
+  auto move_offsets = [&moves](auto& endpoints, const auto& on_dropped) {
+    auto kept = std::remove_if(endpoints.begin(), endpoints.end(), [&](auto& endpoint) {
+      auto move = std::lower_bound(moves.begin(), moves.end(), std::make_pair(endpoint.peer_offset, size_t(0)));
+      if (move == moves.end() || move->first != endpoint.peer_offset) {
+        on_dropped(endpoint);
+        return true;
+      }
+      endpoint.peer_offset = move->second;
+      return false;
+    });
+    endpoints.erase(kept, endpoints.end());
+  };
+  auto ignore = [](const auto&) {};
+  move_offsets(hostname_endpoints_, ignore);
+  move_offsets(alternate_endpoints_, [dropped_peers](const AlternateEndpoint& endpoint) {
+    if (dropped_peers) {
+      dropped_peers->endpoints.push_back(endpoint.address);
     }
+  });
+  move_offsets(auto_keepalives_, ignore);
+  move_offsets(probe_addresses_, ignore);
 
-    if (parsed_peer.has_persistent_keepalive) {
-      peer->Flags = static_cast<WIREGUARD_PEER_FLAG>(peer->Flags | WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
-      peer->PersistentKeepalive = parsed_peer.persistent_keepalive;
-    }
+  size_t shift = configuration_.AppendPeers(added.configuration_);
+  for (const HostnameEndpoint& endpoint : added.hostname_endpoints_) {
+    hostname_endpoints_.push_back({endpoint.peer_offset + shift, endpoint.host, endpoint.port});
+  }
+  for (const AlternateEndpoint& endpoint : added.alternate_endpoints_) {
+    alternate_endpoints_.push_back({endpoint.peer_offset + shift, endpoint.address});
+  }
+  for (const AutoKeepalive& keepalive : added.auto_keepalives_) {
+    auto_keepalives_.push_back({keepalive.peer_offset + shift, keepalive.min, keepalive.max});
+  }
+  for (const ProbeAddress& probe : added.probe_addresses_) {
+    probe_addresses_.push_back({probe.peer_offset + shift, probe.address});
+  }
+
+  // The hash added got when it was finished stands for the peers it brings
+  for (const PeerPublicKey& key : removed) {
+    text_hash_ = HashText(key_of(key.data()), text_hash_);
+  }
+  text_hash_ = HashText(std::string_view(reinterpret_cast<const char*>(&added.text_hash_), sizeof(added.text_hash_)),
+                        text_hash_);
+}
 
-    if (parsed_peer.has_endpoint) {
-      peer->Flags = static_cast<WIREGUARD_PEER_FLAG>(peer->Flags | WIREGUARD_PEER_HAS_ENDPOINT);
-      peer->Endpoint = parsed_peer.endpoint;
+void WireguardConfigParser::HashConfiguration() {
+  // Everything that ends up applied, in a fixed order; never equal to the hash of a text by more than chance
+  auto hash_bytes = [this](const void* data, size_t size) {
+    text_hash_ = HashText(std::string_view(static_cast<const char*>(data), size), text_hash_);
+  };
+  hash_bytes(configuration_.Data(), configuration_.Size());
+  for (const WIREGUARD_ALLOWED_IP& address : interface_.addresses) {
+    hash_bytes(&address.AddressFamily, sizeof(address.AddressFamily));
+    hash_bytes(&address.Address, address.AddressFamily == AF_INET ? sizeof(IN_ADDR) : sizeof(IN6_ADDR));
+    hash_bytes(&address.Cidr, sizeof(address.Cidr));
+  }
+  for (const SOCKADDR_INET& server : interface_.dns_servers) {
+    if (server.si_family == AF_INET) {
+      hash_bytes(&server.Ipv4.sin_addr, sizeof(server.Ipv4.sin_addr));
+    } else {
+      hash_bytes(&server.Ipv6.sin6_addr, sizeof(server.Ipv6.sin6_addr));
     }
+  }
+  for (const std::string& domain : interface_.dns_search_domains) {
+    text_hash_ = HashText(domain, text_hash_);
+  }
+  // Told apart from the search domains by their count; nothing for configurations without them, whose hashes stay
+  // as they were
+  if (size_t split_domain_count = interface_.dns_split_domains.size()) {
+    hash_bytes(&split_domain_count, sizeof(split_domain_count));
+    for (const std::string& domain : interface_.dns_split_domains) {
+      text_hash_ = HashText(domain, text_hash_);
+    }
+  }
+  for (const QosRule& rule : interface_.qos_rules) {
+    text_hash_ = HashText(rule.application, text_hash_);
+    hash_bytes(&rule.protocol, sizeof(rule.protocol));
+    hash_bytes(&rule.first_port, sizeof(rule.first_port));
+    hash_bytes(&rule.last_port, sizeof(rule.last_port));
+    hash_bytes(&rule.tunnel, sizeof(rule.tunnel));
+    hash_bytes(&rule.dscp, sizeof(rule.dscp));
+  }
+  for (const HostnameEndpoint& endpoint : hostname_endpoints_) {
+    hash_bytes(&endpoint.peer_offset, sizeof(endpoint.peer_offset));
+    text_hash_ = HashText(endpoint.host, text_hash_);
+    hash_bytes(&endpoint.port, sizeof(endpoint.port));
+  }
+  for (const AutoKeepalive& keepalive : auto_keepalives_) {
+    hash_bytes(&keepalive.peer_offset, sizeof(keepalive.peer_offset));
+    hash_bytes(&keepalive.min, sizeof(keepalive.min));
+    hash_bytes(&keepalive.max, sizeof(keepalive.max));
+  }
+  for (const ProbeAddress& probe : probe_addresses_) {
+    hash_bytes(&probe.peer_offset, sizeof(probe.peer_offset));
+    hash_bytes(&probe.address, sizeof(probe.address));
+  }
+  hash_bytes(&interface_.mtu, sizeof(interface_.mtu));
+  hash_bytes(&interface_.mtu_auto, sizeof(interface_.mtu_auto));
+  const InterfaceProfile& profile = interface_.profile;
+  ULONG profile_values[] = {profile.has_metric ? profile.metric + 1 : 0,
+                            profile.has_automatic_metric ? profile.automatic_metric + 1u : 0,
+                            profile.has_router_discovery ? profile.router_discovery + 1u : 0,
+                            profile.has_dad_transmits ? profile.dad_transmits + 1 : 0};
+  hash_bytes(profile_values, sizeof(profile_values));
+  text_size_ = configuration_.Size();
+}
 
-    peer->AllowedIPsCount = static_cast<DWORD>(parsed_peer.allowed_ips.size());
-    current_pos += sizeof(WIREGUARD_PEER);
+void WireguardConfigParser::SetPeerEndpoint(size_t peer_offset, const SOCKADDR_INET& endpoint) {
+  auto* peer = reinterpret_cast<WIREGUARD_PEER*>(configuration_.At(peer_offset));
+  peer->Endpoint = endpoint;
+  peer->Flags = static_cast<WIREGUARD_PEER_FLAG>(peer->Flags | WIREGUARD_PEER_HAS_ENDPOINT);
+}
 
-    // Build allowed IPs
-    for (const auto& allowed_ip : parsed_peer.allowed_ips) {
-      WIREGUARD_ALLOWED_IP* wg_allowed_ip = reinterpret_cast<WIREGUARD_ALLOWED_IP*>(current_pos);
-      *wg_allowed_ip = allowed_ip;
-      current_pos += sizeof(WIREGUARD_ALLOWED_IP);
+bool WireguardConfigParser::SetTunedKeepalive(const BYTE* public_key, WORD keepalive) {
+  for (const AutoKeepalive& tuned : auto_keepalives_) {
+    auto* peer = reinterpret_cast<WIREGUARD_PEER*>(configuration_.At(tuned.peer_offset));
+    if (memcmp(peer->PublicKey, public_key, WIREGUARD_KEY_LENGTH) == 0) {
+      peer->PersistentKeepalive = keepalive;
+      return true;
     }
   }
-
-  return required_size;
+  return false;
 }
 
-void WireguardConfigParser::Clear() {
-  interface_ = ParsedInterface{};
-  peers_.clear();
+void WireguardConfigParser::SetKeepalives(const std::function<bool(const BYTE* public_key)>& selected,
+                                          WORD keepalive) {
+  const BYTE* start = configuration_.At(0);
+  configuration_.ForEachPeer([this, &selected, keepalive, start](const WIREGUARD_PEER& peer,
+                                                                 const WIREGUARD_ALLOWED_IP*, DWORD) {
+    if (!selected(peer.PublicKey)) {
+      return;
+    }
+    auto* target =
+        reinterpret_cast<WIREGUARD_PEER*>(configuration_.At(reinterpret_cast<const BYTE*>(&peer) - start));
+    target->Flags = static_cast<WIREGUARD_PEER_FLAG>(target->Flags | WIREGUARD_PEER_HAS_PERSISTENT_KEEPALIVE);
+    target->PersistentKeepalive = keepalive;
+  });
 }
 
-std::vector<std::string> WireguardConfigParser::SplitString(const std::string& str, char delimiter) {
-  std::vector<std::string> result;
-  std::istringstream stream(str);
-  std::string item;
+bool WireguardConfigParser::Restore(const ParsedInterface& iface, const void* config, size_t config_size,
+                                    uint64_t text_hash, size_t text_size) {
+  Clear();
+  if (!configuration_.Assign(config, config_size)) {
+    failed_ = true;
+    return false;
+  }
 
-  while (std::getline(stream, item, delimiter)) {
-    result.push_back(item);
+  interface_ = iface;
+  text_hash_ = text_hash;
+  text_size_ = text_size;
+  return true;
+}
+
+DWORD WireguardConfigParser::BuildConfiguration(void* buffer, DWORD buffer_size) const {
+  DWORD required_size = CalculateConfigurationSize();
+  if (buffer_size < required_size) {
+    return 0;
   }
 
-  return result;
+  memcpy(buffer, configuration_.Data(), required_size);
+  return required_size;
 }
 
-std::string WireguardConfigParser::TrimString(const std::string& str) {
-  auto start = str.find_first_not_of(" \t\r\n");
-  if (start == std::string::npos) {
-    return "";
+size_t WireguardConfigParser::MemoryBytes() const {
+  size_t bytes = configuration_.CapacityBytes();
+  bytes += interface_.addresses.capacity() * sizeof(WIREGUARD_ALLOWED_IP);
+  bytes += interface_.dns_servers.capacity() * sizeof(SOCKADDR_INET);
+  bytes += interface_.dns_search_domains.capacity() * sizeof(std::string);
+  for (const auto &domain : interface_.dns_search_domains) {
+    bytes += domain.capacity();
+  }
+  bytes += interface_.dns_split_domains.capacity() * sizeof(std::string);
+  for (const auto &domain : interface_.dns_split_domains) {
+    bytes += domain.capacity();
+  }
+  bytes += interface_.qos_rules.capacity() * sizeof(QosRule);
+  for (const auto &rule : interface_.qos_rules) {
+    bytes += rule.application.capacity();
   }
+  bytes += hostname_endpoints_.capacity() * sizeof(HostnameEndpoint);
+  for (const auto &hostname_endpoint : hostname_endpoints_) {
+    bytes += hostname_endpoint.host.capacity();
+  }
+  bytes += alternate_endpoints_.capacity() * sizeof(AlternateEndpoint);
+  bytes += auto_keepalives_.capacity() * sizeof(AutoKeepalive);
+  bytes += probe_addresses_.capacity() * sizeof(ProbeAddress);
+  bytes += excluded_ips_.capacity() * sizeof(WIREGUARD_ALLOWED_IP);
+  bytes += pending_line_.capacity() + pending_keys_.capacity() + decoded_keys_.capacity();
+  bytes += (pending_key_offsets_.capacity() + pending_key_lines_.capacity()) * sizeof(size_t);
+  return bytes;
+}
 
-  auto end = str.find_last_not_of(" \t\r\n");
-  return str.substr(start, end - start + 1);
+void WireguardConfigParser::Clear() {
+  interface_ = ParsedInterface{};
+  configuration_.Clear();
+  hostname_endpoints_.clear();
+  alternate_endpoints_.clear();
+  auto_keepalives_.clear();
+  probe_addresses_.clear();
+  excluded_ips_.clear();
+  section_ = Section::kNone;
+  pending_line_.clear();
+  failed_ = false;
+  line_number_ = 0;
+  error_line_ = 0;
+  text_hash_ = kTextHashSeed;
+  text_size_ = 0;
+  pending_keys_.clear();
+  pending_key_offsets_.clear();
+  pending_key_lines_.clear();
 }
 
 }  // namespace wireguard_dart
@@ -1,28 +1,22 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "text_scanner.h"
 #include "wireguard.h"
+#include "wireguard_config_buffer.h"
+#include "wireguard_config_diff.h"
+#include "wireguard_network_config.h"
 
 namespace wireguard_dart {
 
-/**
- * Represents a parsed WireGuard peer configuration
- */
-struct ParsedPeer {
-  bool has_public_key = false;
-  bool has_preshared_key = false;
-  bool has_persistent_keepalive = false;
-  bool has_endpoint = false;
-
-  BYTE public_key[WIREGUARD_KEY_LENGTH];
-  BYTE preshared_key[WIREGUARD_KEY_LENGTH];
-  WORD persistent_keepalive = 0;
-  SOCKADDR_INET endpoint;
-  std::vector<WIREGUARD_ALLOWED_IP> allowed_ips;
-};
+struct SharedRoutes;
 
 /**
  * Represents a parsed WireGuard interface configuration
@@ -32,28 +26,213 @@ struct ParsedInterface {
   bool has_public_key = false;
   bool has_listen_port = false;
 
-  BYTE private_key[WIREGUARD_KEY_LENGTH];
-  BYTE public_key[WIREGUARD_KEY_LENGTH];
+  // The keys themselves are decoded straight into the WIREGUARD_INTERFACE header
   WORD listen_port = 0;
   DWORD mtu = 1420;  // Default WireGuard MTU
+  // MTU = auto: mtu is only the starting point until the path to the endpoints is measured
+  bool mtu_auto = false;
   std::vector<WIREGUARD_ALLOWED_IP> addresses;
+  // DNS = entries: addresses are servers, anything else a search domain
+  std::vector<SOCKADDR_INET> dns_servers;
+  std::vector<std::string> dns_search_domains;
+  // SplitDNS = domains, an extension: only names in these domains are resolved by dns_servers, through NRPT
+  // rules, and everything else stays with the system's resolver
+  std::vector<std::string> dns_split_domains;
+  // QoS = app.exe:46, udp/3478-3481:46, tunnel:46, an extension: DSCP marking through policy-based QoS
+  std::vector<QosRule> qos_rules;
+  InterfaceProfile profile;
+};
+
+/**
+ * A peer Endpoint given as "host:port" that has to be resolved before it can be set
+ */
+struct HostnameEndpoint {
+  size_t peer_offset;  // Offset of the peer in the wire buffer
+  std::string host;
+  WORD port;
+};
+
+/**
+ * A further Endpoint line of a peer, an address the peer can also be reached at. The first Endpoint line is the
+ * one the peer is configured with; the adapter may move the peer to a faster or working alternate.
+ */
+struct AlternateEndpoint {
+  size_t peer_offset;  // Offset of the peer in the wire buffer
+  SOCKADDR_INET address;
+};
+
+// What a peer change took out of a configuration, for the networking to follow, see ChangePeers
+struct DroppedPeers {
+  std::vector<WIREGUARD_ALLOWED_IP> allowed_ips;
+  // The endpoints the peers had, alternates included
+  std::vector<SOCKADDR_INET> endpoints;
+};
+
+// The address inside the tunnel that the ProbeAddress of a peer, an extension, has its link quality measured to
+struct ProbeAddress {
+  size_t peer_offset;  // Offset of the peer in the wire buffer
+  SOCKADDR_INET address;
+};
+
+/**
+ * A peer with PersistentKeepalive = auto, whose keepalive the adapter tunes between min and max seconds. The
+ * peer goes out with KeepaliveTuner::InitialInterval until then.
+ */
+struct AutoKeepalive {
+  size_t peer_offset;  // Offset of the peer in the wire buffer
+  WORD min;
+  WORD max;
+};
+
+/**
+ * The interface values of a tunnel set up from a compiled configuration as a template, in the form its text would
+ * give them; an empty or unset one keeps the template's
+ */
+struct InterfaceOverrides {
+  std::string_view private_key;
+  // As in an Address line, e.g. "10.0.0.2/32, fd00::2/128"
+  std::string_view addresses;
+  std::optional<WORD> listen_port;
 };
 
 /**
  * Parses WireGuard INI-style configuration files and converts them to
- * WIREGUARD_INTERFACE structures suitable for the WireGuard API
+ * WIREGUARD_INTERFACE structures suitable for the WireGuard API.
+ * Peers and their allowed IPs are written straight into the wire buffer while parsing;
+ * only the interface section, which also carries the networking settings, is kept aside.
+ * A peer's ExcludedIPs, an extension, are taken out of its AllowedIPs once its section ends.
  */
 class WireguardConfigParser {
 public:
   /**
-   * Parse a WireGuard configuration from an INI-style string
+   * Parse a WireGuard configuration from an INI-style string.
+   * The text is tokenized in place, without copying lines or sections. From kParallelMinPeers sections on, a
+   * first pass finds the [Peer] sections and runs of up to kPeersPerArena of them are parsed on the compute pool,
+   * each into an arena of its own, which are then appended in the order of the text.
    * @param config_text The configuration text to parse
    * @return true if parsing was successful, false otherwise
    */
-  bool Parse(const std::string &config_text);
+  bool Parse(std::string_view config_text);
+
+  static constexpr size_t kParallelMinPeers = 2048;
+  static constexpr size_t kPeersPerArena = 512;
+
+  /**
+   * Start parsing a configuration that arrives in pieces. Completed peers are written to the
+   * wire buffer as each line is read, so besides the output only a partial line is kept.
+   */
+  void BeginParse();
+
+  /**
+   * Parse the next piece of a configuration started with BeginParse. Chunks may split lines anywhere.
+   * @param chunk The next piece of configuration text
+   * @return false if the configuration is invalid; further calls keep returning false
+   */
+  bool Feed(std::string_view chunk);
+
+  /**
+   * Complete a configuration started with BeginParse
+   * @return true if the whole configuration was parsed successfully
+   */
+  bool Finish();
 
   /**
-   * Build a WIREGUARD_INTERFACE structure from the parsed configuration
+   * Take over a configuration that was parsed before, e.g. one loaded by WireguardConfigCache,
+   * instead of parsing its text again
+   * @param iface The interface settings kept aside from the wire buffer
+   * @param config The wire format configuration
+   * @param config_size Size of config in bytes
+   * @param text_hash Hash of the text the configuration was parsed from, see GetTextHash
+   * @param text_size Length of that text
+   * @return false if config is not a well-formed wire format configuration
+   */
+  bool Restore(const ParsedInterface &iface, const void *config, size_t config_size, uint64_t text_hash,
+               size_t text_size);
+
+  /**
+   * Start a configuration given as values instead of text, as setupTunnelStructured sends it. Keys, peers and
+   * allowed IPs are written straight into GetMutableConfiguration() and the other interface settings into
+   * GetMutableInterface(); FinishStructured() then completes it like Finish().
+   */
+  void BeginStructured() { Clear(); }
+  ParsedInterface &GetMutableInterface() { return interface_; }
+  WireguardConfigBuffer &GetMutableConfiguration() { return configuration_; }
+
+  /**
+   * Have the adapter resolve host as the endpoint of the peer at peer_offset, like a hostname Endpoint line
+   * @return false if host is not a valid hostname
+   */
+  bool AddHostnameEndpoint(size_t peer_offset, std::string_view host, WORD port);
+
+  /**
+   * Have the adapter tune the keepalive of peer, at peer_offset, like PersistentKeepalive = value
+   * @return false if value is not "auto" or "auto:MIN-MAX" with 1 <= MIN <= MAX
+   */
+  bool AddAutoKeepalive(size_t peer_offset, std::string_view value, WIREGUARD_PEER &peer);
+
+  // Have the adapter probe the link quality of the peer at peer_offset at address, like ProbeAddress = address
+  void AddProbeAddress(size_t peer_offset, const SOCKADDR_INET &address);
+
+  /**
+   * Complete a configuration started with BeginStructured. With no text to hash, GetTextHash() is a hash of
+   * the resulting configuration, so the same values sent again are recognised as already applied.
+   */
+  void FinishStructured();
+
+  /**
+   * Make this copy of a compiled configuration one tunnel's: the overrides replace the template's private key,
+   * with the public key derived from it, its addresses and its listen port, in the wire buffer's header and the
+   * interface settings. The peers and everything else are kept as they were parsed, without parsing them again.
+   * The text hash becomes one of the result, as for a structured configuration.
+   * @return false if a value is invalid, with nothing changed
+   */
+  bool ApplyOverrides(const InterfaceOverrides &overrides);
+
+  /**
+   * Bring this configuration in line with a peer change sent to the driver, see BuildPeerChange: the peers with
+   * the keys in removed or in added are dropped and the peers of added appended, with their hostname endpoints.
+   * The text hash is chained over the change rather than taken over the result again, so the text this came from
+   * no longer counts as applied, and costs in proportion to the change.
+   * @param added A configuration of peers only, e.g. from ParseStructuredPeers
+   * @param dropped If set, gets the allowed IPs and endpoints of the peers dropped
+   */
+  void ChangePeers(const WireguardConfigParser &added, const std::vector<PeerPublicKey> &removed,
+                   DroppedPeers *dropped = nullptr);
+
+  /**
+   * 1-based line of the first invalid line of a configuration that failed to parse, 0 if there is none. The same
+   * whether the text was parsed serially, in parallel or streamed: an invalid key counts on the line it is on,
+   * although keys are only checked a batch at a time.
+   */
+  size_t GetErrorLine() const { return error_line_; }
+
+  /**
+   * 1-based column of the value on a line of text, for the line GetErrorLine gives. Values are all the parser
+   * rejects, so that is where the error is; the column of the line's first character for a line without '='.
+   * Counted in bytes, 0 if the text has fewer lines.
+   */
+  static size_t ErrorColumn(std::string_view text, size_t line);
+
+  /**
+   * Hash and length of the text parsed so far, to recognise a configuration that was already applied
+   */
+  uint64_t GetTextHash() const { return text_hash_; }
+  size_t GetTextSize() const { return text_size_; }
+
+  /**
+   * Running 64-bit FNV-1a hash of configuration text, as used by GetTextHash
+   */
+  static constexpr uint64_t kTextHashSeed = 14695981039346656037ULL;
+  static uint64_t HashText(std::string_view text, uint64_t hash = kTextHashSeed);
+
+  /**
+   * One entry of the QoS key, what it matches and the DSCP value after the last colon: an application's executable
+   * name or path, tcp/PORT[-PORT] or udp/PORT[-PORT] for remote ports, or tunnel for the tunnel's own datagrams
+   */
+  static bool ParseQosRule(std::string_view entry, QosRule &rule);
+
+  /**
+   * Copy the WIREGUARD_INTERFACE structure of the parsed configuration into a caller buffer
    * @param buffer Pointer to buffer to write the configuration
    * @param buffer_size Size of the buffer in bytes
    * @return Number of bytes written, or 0 if buffer is too small
@@ -64,7 +243,31 @@ public:
    * Calculate the required buffer size for the configuration
    * @return Required buffer size in bytes
    */
-  DWORD CalculateConfigurationSize() const;
+  DWORD CalculateConfigurationSize() const { return configuration_.Size(); }
+
+  /**
+   * Get the parsed configuration in the wire format passed to WireGuardSetConfiguration
+   */
+  const WireguardConfigBuffer &GetConfiguration() const { return configuration_; }
+
+  /**
+   * The routes a tunnel gets for this configuration: the allowed IPs of all peers aggregated, see
+   * AggregatePrefixes, with default routes split into halves; see AggregateRoutesShared.
+   */
+  std::shared_ptr<const SharedRoutes> GetRoutes() const;
+
+  /**
+   * Allocations the wire buffer has made over the lifetime of this parser, for benchmarks. A parser that is
+   * reused keeps its memory across Clear(), so parsing a configuration no larger than the last one allocates
+   * nothing for it.
+   */
+  size_t GetBufferAllocationCount() const { return configuration_.AllocationCount(); }
+  size_t GetBufferCapacity() const { return configuration_.CapacityBytes(); }
+
+  /**
+   * Bytes this parser holds on the heap, the wire buffer and everything kept besides it, by capacity
+   */
+  size_t MemoryBytes() const;
 
   /**
    * Get the parsed interface configuration
@@ -72,31 +275,111 @@ public:
   const ParsedInterface &GetInterface() const { return interface_; }
 
   /**
-   * Get the parsed peer configurations
+   * Get the peer endpoints that were given as hostnames. Those peers are sent without an endpoint
+   * until the hostname is resolved.
+   */
+  const std::vector<HostnameEndpoint> &GetHostnameEndpoints() const { return hostname_endpoints_; }
+
+  /**
+   * Get the endpoints of the Endpoint lines after a peer's first, in the order of the peers. Alternates have to
+   * be addresses, they are probed and switched to without a lookup.
+   */
+  const std::vector<AlternateEndpoint> &GetAlternateEndpoints() const { return alternate_endpoints_; }
+
+  /**
+   * Get the peers whose keepalive is tuned, in the order of the peers
+   */
+  const std::vector<AutoKeepalive> &GetAutoKeepalives() const { return auto_keepalives_; }
+
+  /**
+   * Get the peers probed inside the tunnel, in the order of the peers
    */
-  const std::vector<ParsedPeer> &GetPeers() const { return peers_; }
+  const std::vector<ProbeAddress> &GetProbeAddresses() const { return probe_addresses_; }
+
+  /**
+   * Set a resolved address as the endpoint of the peer at peer_offset in the wire buffer
+   */
+  void SetPeerEndpoint(size_t peer_offset, const SOCKADDR_INET &endpoint);
+
+  /**
+   * Set the keepalive the adapter tuned on the peer with public_key, one of GetAutoKeepalives()
+   * @return false if no such peer is tuned
+   */
+  bool SetTunedKeepalive(const BYTE *public_key, WORD keepalive);
+
+  /**
+   * Set the keepalive the adapter gave the peers that selected(public_key) is true for, see
+   * WireguardAdapter::SetProbing
+   */
+  void SetKeepalives(const std::function<bool(const BYTE *public_key)> &selected, WORD keepalive);
 
   /**
    * Clear all parsed data
    */
   void Clear();
 
+  // An IP address and port, like 10.0.0.1:51820 or [fd00::1]:51820, as an Endpoint line has it
+  static bool ParseEndpoint(std::string_view endpoint_str, SOCKADDR_INET &endpoint);
+
 private:
+  enum class Section { kNone, kInterface, kPeer, kUnknown };
+
   ParsedInterface interface_;
-  std::vector<ParsedPeer> peers_;
+  WireguardConfigBuffer configuration_;
+  std::vector<HostnameEndpoint> hostname_endpoints_;
+  std::vector<AlternateEndpoint> alternate_endpoints_;
+  std::vector<AutoKeepalive> auto_keepalives_;
+  std::vector<ProbeAddress> probe_addresses_;
+  // ExcludedIPs of the peer being parsed
+  std::vector<WIREGUARD_ALLOWED_IP> excluded_ips_;
+
+  // Streaming state
+  Section section_ = Section::kNone;
+  std::string pending_line_;
+  bool failed_ = false;
+  // Lines read so far, the current one included
+  size_t line_number_ = 0;
+  size_t error_line_ = 0;
+  uint64_t text_hash_ = kTextHashSeed;
+  size_t text_size_ = 0;
+
+  // Keys are decoded in batches with one base64_decode call instead of one call per key.
+  // pending_keys_ holds their text back to back, pending_key_offsets_ where each goes in configuration_ and
+  // pending_key_lines_ the line each is on.
+  static constexpr size_t kKeyBatchSize = 256;
+  std::string pending_keys_;
+  std::vector<size_t> pending_key_offsets_;
+  std::vector<size_t> pending_key_lines_;
+  std::vector<char> decoded_keys_;
 
   // Helper methods
-  bool ParseInterfaceSection(const std::string &section_content);
-  bool ParsePeerSection(const std::string &section_content);
-  bool ParseKeyValue(const std::string &key, const std::string &value, ParsedInterface &iface);
-  bool ParseKeyValue(const std::string &key, const std::string &value, ParsedPeer &peer);
+  bool ParseParallel(std::string_view config_text);
+  // Parse whole lines, the first of them being line first_line of the configuration
+  bool ParseRun(std::string_view text, size_t first_line);
+  // Parse a run of [Peer] sections on a pool thread, into this parser as the arena
+  void ParsePeerRun(std::string_view text, size_t first_line);
+  bool ParseLine(std::string_view line, Section &section);
+  bool ParseLine(const ScannedLine &line, Section &section);
+  bool ParseKeyValue(std::string_view key, std::string_view value, ParsedInterface &iface);
+  bool ParseKeyValue(std::string_view key, std::string_view value, WIREGUARD_PEER &peer);
+  void FinishInterface();
+  // Hash everything that ends up applied into text_hash_, for a configuration that has no text
+  void HashConfiguration();
+  // Subtract the peer's ExcludedIPs from its allowed IPs, at the end of its section
+  void FinishPeer();
+  bool QueueKey(std::string_view base64_key, size_t offset);
+  bool FlushKeys();
+  // Fail at line, unless a key queued on an earlier line turns out to be invalid
+  void FailLine(size_t line);
+  void NoteErrorLine(size_t line);
 
   // Parsing utilities
-  bool DecodeBase64Key(const std::string &base64_key, BYTE *key_buffer);
-  bool ParseIPAddress(const std::string &ip_str, WIREGUARD_ALLOWED_IP &allowed_ip);
-  bool ParseEndpoint(const std::string &endpoint_str, SOCKADDR_INET &endpoint);
-  std::vector<std::string> SplitString(const std::string &str, char delimiter);
-  std::string TrimString(const std::string &str);
+  static bool ParseIPAddress(std::string_view ip_str, WIREGUARD_ALLOWED_IP &allowed_ip);
+  template <typename Sink> static bool ParseIPAddressList(std::string_view list, Sink &&sink);
+  static bool ParseHostnameEndpoint(std::string_view endpoint_str, std::string_view &host, WORD &port);
+  static bool ParseDnsList(std::string_view list, ParsedInterface &iface);
+  static bool ParseSplitDnsList(std::string_view list, ParsedInterface &iface);
+  static bool ParseQosList(std::string_view list, ParsedInterface &iface);
 };
 
 } // namespace wireguard_dart
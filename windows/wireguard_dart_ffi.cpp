@@ -0,0 +1,110 @@
+#include "include/wireguard_dart/wireguard_dart_ffi.h"
+
+#include <cstring>
+#include <shared_mutex>
+#include <string>
+
+#include "peer_statistics.h"
+#include "wireguard_dart_plugin.h"
+
+namespace wireguard_dart {
+
+namespace {
+
+// Held shared by every call, so the plugin cannot be destroyed under one
+std::shared_mutex g_plugin_mutex;
+WireguardDartPlugin *g_plugin = nullptr;
+
+int32_t ReadResultCode(WireguardDartPlugin::ReadResult result) {
+  switch (result) {
+    case WireguardDartPlugin::ReadResult::kOk:
+      return 0;
+    case WireguardDartPlugin::ReadResult::kNotFound:
+      return WIREGUARD_DART_FFI_NOT_FOUND;
+    default:
+      return WIREGUARD_DART_FFI_READ_FAILED;
+  }
+}
+
+}  // namespace
+
+void SetFfiPlugin(WireguardDartPlugin *plugin) {
+  std::unique_lock<std::shared_mutex> lock(g_plugin_mutex);
+  g_plugin = plugin;
+}
+
+void ClearFfiPlugin(WireguardDartPlugin *plugin) {
+  std::unique_lock<std::shared_mutex> lock(g_plugin_mutex);
+  if (g_plugin == plugin) {
+    g_plugin = nullptr;
+  }
+}
+
+}  // namespace wireguard_dart
+
+using wireguard_dart::g_plugin;
+using wireguard_dart::g_plugin_mutex;
+
+int32_t WireguardDartFfiStatus(const char *tunnel_name) {
+  if (!tunnel_name) {
+    return WIREGUARD_DART_FFI_INVALID_ARGUMENT;
+  }
+  std::shared_lock<std::shared_mutex> lock(g_plugin_mutex);
+  if (!g_plugin) {
+    return WIREGUARD_DART_FFI_NO_PLUGIN;
+  }
+  try {
+    return static_cast<int32_t>(g_plugin->ReadStatus(tunnel_name));
+  } catch (const std::exception &) {
+    return WIREGUARD_DART_FFI_READ_FAILED;
+  }
+}
+
+int32_t WireguardDartFfiTotals(const char *tunnel_name, WireguardDartTotals *totals) {
+  if (!totals) {
+    return WIREGUARD_DART_FFI_INVALID_ARGUMENT;
+  }
+  std::shared_lock<std::shared_mutex> lock(g_plugin_mutex);
+  if (!g_plugin) {
+    return WIREGUARD_DART_FFI_NO_PLUGIN;
+  }
+  std::string name = tunnel_name ? tunnel_name : "";
+  wireguard_dart::WireguardAdapter::Totals adapter_totals;
+  auto result = g_plugin->ReadTotals(tunnel_name ? &name : nullptr, &adapter_totals);
+  if (result == wireguard_dart::WireguardDartPlugin::ReadResult::kOk) {
+    totals->rx_bytes = adapter_totals.rx_bytes;
+    totals->tx_bytes = adapter_totals.tx_bytes;
+    totals->latest_handshake = adapter_totals.LastHandshakeUnixMillis();
+  }
+  return wireguard_dart::ReadResultCode(result);
+}
+
+int64_t WireguardDartFfiPeerStatistics(const char *tunnel_name, uint8_t *buffer, int64_t capacity) {
+  if (capacity < 0 || (capacity > 0 && !buffer)) {
+    return WIREGUARD_DART_FFI_INVALID_ARGUMENT;
+  }
+  std::shared_lock<std::shared_mutex> lock(g_plugin_mutex);
+  if (!g_plugin) {
+    return WIREGUARD_DART_FFI_NO_PLUGIN;
+  }
+  std::string name = tunnel_name ? tunnel_name : "";
+  std::vector<wireguard_dart::PeerStatistics> peers;
+  auto result = g_plugin->ReadPeerStatistics(tunnel_name ? &name : nullptr, &peers);
+  if (result != wireguard_dart::WireguardDartPlugin::ReadResult::kOk) {
+    return wireguard_dart::ReadResultCode(result);
+  }
+  lock.unlock();
+
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  std::vector<uint8_t> snapshot;
+  wireguard_dart::EncodePeerStatistics(
+      peers,
+      wireguard_dart::FiletimeToUnixMillis((static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime),
+      &snapshot);
+  int64_t size = static_cast<int64_t>(snapshot.size());
+  if (size <= capacity) {
+    memcpy(buffer, snapshot.data(), snapshot.size());
+  }
+  return size;
+}
@@ -3,23 +3,57 @@
 #include <flutter/event_channel.h>
 #include <flutter/event_stream_handler_functions.h>
 #include <flutter/method_channel.h>
+#include <flutter/method_result_functions.h>
 #include <flutter/plugin_registrar_windows.h>
 #include <flutter/standard_method_codec.h>
 #include <libbase64.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cwchar>
+#include <iterator>
 #include <memory>
+#include <set>
 #include <sstream>
 
+#include "adapter_devices.h"
+#include "adapter_log.h"
+#include "adapter_teardown.h"
+#include "call_metrics.h"
+#include "compute_pool.h"
+#include "config_export.h"
 #include "connection_status.h"
+#include "cpu_accounting.h"
+#include "encodable_keys.h"
+#include "flight_recorder.h"
+#include "hang_watchdog.h"
+#include "ip_address_parser.h"
 #include "key_generator.h"
+#include "log_format.h"
+#include "log_ring.h"
+#include "log_stream.h"
+#include "mapped_file.h"
 #include "network_adapter_status_observer.h"
+#include "operation_counters.h"
+#include "perf_stats.h"
+#include "prefix_aggregation.h"
+#include "statistics_sampler.h"
+#include "structured_config.h"
+#include "throughput_test.h"
+#include "trace_events.h"
+#include "tunnel_service.h"
+#include "x25519.h"
+#include "spdlog/async.h"
 #include "spdlog/sinks/basic_file_sink.h"
+#include "spdlog/sinks/daily_file_sink.h"
+#include "spdlog/sinks/rotating_file_sink.h"
 #include "spdlog/spdlog.h"
-#include "tunnel.h"
+#include "startup_trace.h"
 #include "utils.h"
 #include "wireguard.h"
 #include "wireguard_adapter.h"
+#include "wireguard_config_cache.h"
 #include "wireguard_config_parser.h"
 #include "wireguard_library.h"
 
@@ -28,75 +62,468 @@ std::string GetLastErrorAsString(DWORD error_code);
 
 namespace wireguard_dart {
 
-// WireGuard library logger callback
-static VOID CALLBACK WireguardLoggerCallback(WIREGUARD_LOGGER_LEVEL Level, DWORD64 Timestamp, LPCWSTR Message) {
-  auto logger = spdlog::get("wireguard_dart");
-  if (!logger) {
-    logger = spdlog::default_logger();
+// The message of a failed tunnel service call, with the Windows error it returned
+static std::string TunnelServiceError(const char* what, DWORD error_code) {
+  return std::string(what) + " Windows Error Code: " + std::to_string(error_code) + ". Description: " +
+         GetLastErrorAsString(error_code);
+}
+
+// The tunnel type of every adapter the plugin creates, which is what the orphan sweep of nativeInit goes by. Not the
+// driver's usual "WireGuard", which the official client's adapters have and the sweep must leave alone.
+static const wchar_t kTunnelType[] = L"WireGuardDart";
+// No tunnel has an empty name, so the sweep queued under it holds up none of them
+static const char kAdapterSweepTask[] = "";
+
+// Lines waiting for the log thread, unless nativeInit sets logQueueSize
+static const size_t kDefaultLogQueueSize = 8192;
+// Lines getRecentLogs can answer from
+static const size_t kLogRingLines = 2000;
+// And in low-memory mode
+static const size_t kLowMemoryLogRingLines = 200;
+// Rotated log files kept besides the current one, unless nativeInit sets maxLogFiles
+static const size_t kDefaultLogFiles = 3;
+// Lines below error level are on disk within this
+static const std::chrono::seconds kLogFlushInterval{1};
+// How much later a flush may come, where Windows coalesces its wakeup with other timers
+static const std::chrono::milliseconds kLogFlushTolerance{250};
+
+// Status changes are coalesced over at least this while power is saved, so a burst wakes the platform thread once
+static const std::chrono::milliseconds kPowerSavingCoalesce{1000};
+// And while connectTunnels or disconnectTunnels runs, so the interface changes of a group cost one read per adapter
+static const std::chrono::milliseconds kGroupTransitionCoalesce{250};
+
+// Peer changes to a tunnel within this share one write of its cache, journal entry and route index
+static const std::chrono::milliseconds kPeerChangeSettle{1000};
+
+// Hostnames one connect may ask to prefetch, each at most as long as a DNS name can be
+static const size_t kMaxPrefetchHosts = 64;
+static const size_t kMaxHostnameLength = 253;
+
+// The synthetic peers benchmarkCall answers with at most, a large configuration's worth
+static const int64_t kMaxBenchmarkPeers = 100000;
+
+// The shortest and longest a staged activation may wait between batches
+static const int64_t kMinActivationIntervalMs = 10;
+static const int64_t kMaxActivationIntervalMs = 60000;
+
+// The log file sink nativeInit asks for: a new file every day, or one file rotated by size past max_bytes, keeping
+// max_files of the older ones; without either the single file of old
+static spdlog::sink_ptr CreateLogFileSink(const std::string& path, uint64_t max_bytes, size_t max_files, bool daily) {
+  if (daily) {
+    return std::make_shared<spdlog::sinks::daily_file_sink_mt>(path, 0, 0, false, static_cast<uint16_t>(max_files));
+  }
+  if (max_bytes > 0) {
+    return std::make_shared<spdlog::sinks::rotating_file_sink_mt>(path, static_cast<size_t>(max_bytes), max_files);
   }
+  return std::make_shared<spdlog::sinks::basic_file_sink_mt>(path, true /* truncate = false (append) */);
+}
 
-  std::string msg = WideToUtf8(Message);
+// The logOverflowPolicy of nativeInit; false for an unknown name
+static bool ParseLogOverflowPolicy(const std::string& name, spdlog::async_overflow_policy* policy) {
+  if (name == "overrunOldest") {
+    *policy = spdlog::async_overflow_policy::overrun_oldest;
+  } else if (name == "discardNew") {
+    *policy = spdlog::async_overflow_policy::discard_new;
+  } else if (name == "block") {
+    *policy = spdlog::async_overflow_policy::block;
+  } else {
+    return false;
+  }
+  return true;
+}
 
-  switch (Level) {
-    case WIREGUARD_LOG_INFO:
-      logger->info("[wireguard.dll] {}", msg);
-      break;
-    case WIREGUARD_LOG_WARN:
-      logger->warn("[wireguard.dll] {}", msg);
-      break;
-    case WIREGUARD_LOG_ERR:
-      logger->error("[wireguard.dll] {}", msg);
-      break;
+// Each peer's counters, handshake age and rates by base64 public key, now as a FILETIME
+static flutter::EncodableValue PeersValue(const std::vector<PeerStatistics>& peers, uint64_t now) {
+  uint64_t now_ms = FiletimeToUnixMillis(now);
+  flutter::EncodableMap peer_values;
+  for (const PeerStatistics& peer : peers) {
+    flutter::EncodableMap value;
+    value[keys::kRxBytes] = flutter::EncodableValue(static_cast<int64_t>(peer.rx_bytes));
+    value[keys::kTxBytes] = flutter::EncodableValue(static_cast<int64_t>(peer.tx_bytes));
+    value[keys::kLatestHandshake] = flutter::EncodableValue(static_cast<int64_t>(peer.last_handshake_ms));
+    // Null for a peer that never completed a handshake
+    value[keys::kHandshakeAgeMs] = peer.last_handshake_ms != 0 && now_ms >= peer.last_handshake_ms
+                                       ? flutter::EncodableValue(static_cast<int64_t>(now_ms - peer.last_handshake_ms))
+                                       : flutter::EncodableValue();
+    value[keys::kRxRate] = flutter::EncodableValue(peer.rx_rate);
+    value[keys::kTxRate] = flutter::EncodableValue(peer.tx_rate);
+    value[keys::kRxRateEwma] = flutter::EncodableValue(peer.rx_rate_ewma);
+    value[keys::kTxRateEwma] = flutter::EncodableValue(peer.tx_rate_ewma);
+    value[keys::kPersistentKeepalive] = flutter::EncodableValue(static_cast<int32_t>(peer.persistent_keepalive));
+    // Only for peers probed inside the tunnel
+    if (const LinkQuality& quality = peer.link_quality; quality.probes != 0) {
+      value[keys::kProbes] = flutter::EncodableValue(static_cast<int32_t>(quality.probes));
+      value[keys::kLossPercent] = flutter::EncodableValue(quality.LossPercent());
+      if (quality.lost != quality.probes) {
+        value[keys::kRttMinMs] = flutter::EncodableValue(static_cast<int32_t>(quality.rtt_min_ms));
+        value[keys::kRttP50Ms] = flutter::EncodableValue(static_cast<int32_t>(quality.rtt_p50_ms));
+        value[keys::kRttP90Ms] = flutter::EncodableValue(static_cast<int32_t>(quality.rtt_p90_ms));
+        value[keys::kRttMaxMs] = flutter::EncodableValue(static_cast<int32_t>(quality.rtt_max_ms));
+      }
+    }
+    peer_values[flutter::EncodableValue(KeyToBase64(peer.public_key.data()))] = flutter::EncodableValue(value);
+  }
+  return flutter::EncodableValue(peer_values);
+}
+
+// Phase durations in microseconds, by phase name
+static flutter::EncodableValue TimingsValue(const PhaseTimer& timer) {
+  flutter::EncodableMap timings;
+  for (const auto& phase : timer.Phases()) {
+    timings[flutter::EncodableValue(phase.first)] = flutter::EncodableValue(phase.second);
+  }
+  return flutter::EncodableValue(timings);
+}
+
+// An int argument, which the codec sends as int32_t or, when it does not fit, as int64_t
+static std::optional<int64_t> IntegerArgument(const flutter::EncodableValue* value) {
+  if (const auto* value32 = value ? std::get_if<int32_t>(value) : nullptr) {
+    return *value32;
+  }
+  if (const auto* value64 = value ? std::get_if<int64_t>(value) : nullptr) {
+    return *value64;
+  }
+  return std::nullopt;
+}
+
+// The running driver version as major.minor, or empty if the driver is not running
+static std::string DriverVersionString(DWORD version) {
+  if (version == 0) {
+    return "";
+  }
+  return std::to_string((version >> 16) & 0xffff) + "." + std::to_string(version & 0xffff);
+}
+
+// What setup found of the driver and whether it had to install it
+static flutter::EncodableValue DriverValue(DWORD version, bool installed, int64_t install_us) {
+  flutter::EncodableMap driver;
+  driver[keys::kVersion] = flutter::EncodableValue(DriverVersionString(version));
+  driver[keys::kInstalled] = flutter::EncodableValue(installed);
+  driver[keys::kInstallUs] = flutter::EncodableValue(install_us);
+  return flutter::EncodableValue(driver);
+}
+
+// The activation argument of connect and setupAndConnect, see WireguardAdapter::StagePeerActivation; without one
+// activation is left empty. False, with error set, if it is malformed.
+static bool ParseActivation(const flutter::EncodableMap& args,
+                            std::optional<WireguardAdapter::ActivationOptions>* activation, std::string* error) {
+  const flutter::EncodableValue* arg_activation = ValueOrNull(args, keys::kActivation);
+  if (!arg_activation) {
+    return true;
+  }
+  const auto* options = std::get_if<flutter::EncodableMap>(arg_activation);
+  std::optional<int64_t> batch_size = options ? IntegerArgument(ValueOrNull(*options, keys::kBatchSize)) : std::nullopt;
+  std::optional<int64_t> interval_ms =
+      options ? IntegerArgument(ValueOrNull(*options, keys::kIntervalMs)) : std::nullopt;
+  if (!batch_size || *batch_size < 1 || !interval_ms || *interval_ms < kMinActivationIntervalMs ||
+      *interval_ms > kMaxActivationIntervalMs) {
+    *error = "Argument 'activation' needs a batchSize of at least 1 and an intervalMs from " +
+             std::to_string(kMinActivationIntervalMs) + " to " + std::to_string(kMaxActivationIntervalMs);
+    return false;
   }
+  WireguardAdapter::ActivationOptions parsed;
+  parsed.batch_size = static_cast<size_t>(*batch_size);
+  parsed.interval = std::chrono::milliseconds(*interval_ms);
+  if (const auto* priority = std::get_if<flutter::EncodableList>(ValueOrNull(*options, keys::kPriority))) {
+    parsed.priority.reserve(priority->size());
+    for (const auto& value : *priority) {
+      const auto* key = std::get_if<std::vector<uint8_t>>(&value);
+      if (!key || key->size() != WIREGUARD_KEY_LENGTH) {
+        *error = "Argument 'activation' must have a priority of 32-byte public keys";
+        return false;
+      }
+      memcpy(parsed.priority.emplace_back().data(), key->data(), WIREGUARD_KEY_LENGTH);
+    }
+  }
+  activation->emplace(std::move(parsed));
+  return true;
 }
 
 // static
 void WireguardDartPlugin::RegisterWithRegistrar(flutter::PluginRegistrarWindows* registrar) {
-  auto channel = std::make_unique<flutter::MethodChannel<flutter::EncodableValue>>(
-      registrar->messenger(), "wireguard_dart", &flutter::StandardMethodCodec::GetInstance());
+  static std::atomic<uint64_t> next_engine{1};
+  StartupTrace::Instance().MarkRegistration();
+  registrar->AddPlugin(std::make_unique<Engine>(registrar, Acquire(), next_engine++));
+}
 
-  auto plugin = std::make_unique<WireguardDartPlugin>();
+std::shared_ptr<WireguardDartPlugin> WireguardDartPlugin::Acquire() {
+  static std::mutex mutex;
+  static std::weak_ptr<WireguardDartPlugin> shared;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<WireguardDartPlugin> plugin = shared.lock();
+  if (!plugin) {
+    plugin = std::make_shared<WireguardDartPlugin>();
+    shared = plugin;
+  }
+  return plugin;
+}
 
-  channel->SetMethodCallHandler([plugin_pointer = plugin.get()](const auto& call, auto result) {
-    plugin_pointer->HandleMethodCall(call, std::move(result));
+WireguardDartPlugin::Engine::Engine(flutter::PluginRegistrarWindows* registrar,
+                                    std::shared_ptr<WireguardDartPlugin> plugin, uint64_t id)
+    : plugin_(std::move(plugin)), id_(id) {
+  WireguardDartPlugin* plugin_pointer = plugin_.get();
+  auto channel = std::make_unique<flutter::MethodChannel<flutter::EncodableValue>>(
+      registrar->messenger(), "wireguard_dart", &flutter::StandardMethodCodec::GetInstance());
+  channel->SetMethodCallHandler([plugin_pointer, id = id_, pending = pending_](const auto& call, auto result) {
+    ScopedCpuCycles cycles(CpuComponent::kPlatformMethods);
+    plugin_pointer->HandleMethodCall(id, call, Track(pending, std::move(result)));
   });
 
   auto status_channel = std::make_unique<flutter::EventChannel<flutter::EncodableValue>>(
       registrar->messenger(), "wireguard_dart/status", &flutter::StandardMethodCodec::GetInstance());
+  status_channel->SetStreamHandler(plugin_->network_adapter_observer_->HandlerFor(id_));
+
+  auto statistics_channel = std::make_unique<flutter::EventChannel<flutter::EncodableValue>>(
+      registrar->messenger(), "wireguard_dart/statistics", &flutter::StandardMethodCodec::GetInstance());
+  statistics_channel->SetStreamHandler(plugin_->statistics_stream_->HandlerFor(id_));
+
+  auto logs_channel = std::make_unique<flutter::EventChannel<flutter::EncodableValue>>(
+      registrar->messenger(), "wireguard_dart/logs", &flutter::StandardMethodCodec::GetInstance());
+  logs_channel->SetStreamHandler(plugin_->logs_stream_->HandlerFor(id_));
+
+  auto benchmark_channel = std::make_unique<flutter::EventChannel<flutter::EncodableValue>>(
+      registrar->messenger(), "wireguard_dart/benchmark", &flutter::StandardMethodCodec::GetInstance());
+  benchmark_channel->SetStreamHandler(plugin_->benchmark_stream_->HandlerFor(id_));
+
+  // Large payloads are decoded and encoded off the platform thread, which is busy rendering frames
+  bulk_channel_ = std::make_unique<BackgroundMethodChannel>(
+      registrar->messenger(), "wireguard_dart/bulk", plugin_->platform_tasks_.get(),
+      [plugin_pointer, pending = pending_](const auto& call, auto result) {
+        plugin_pointer->HandleBulkMethodCall(call, Track(pending, std::move(result)));
+      });
+  plugin_->logger_->info("Flutter engine {} attached", id_);
+}
+
+WireguardDartPlugin::Engine::~Engine() {
+  // Waits for the bulk call being handled, which may post to the tunnel workers
+  bulk_channel_.reset();
+  // The engine's sinks and status subscriptions go with it, the other engines keep listening
+  plugin_->network_adapter_observer_->Cancel(id_);
+  plugin_->statistics_stream_->Cancel(id_);
+  plugin_->logs_stream_->Cancel(id_);
+  plugin_->benchmark_stream_->Cancel(id_);
+
+  // Calls still running on the workers would otherwise never be answered; the engine's messenger is still there
+  std::map<uint64_t, std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>>> unanswered;
+  {
+    std::lock_guard<std::mutex> lock(pending_->mutex);
+    pending_->detached = true;
+    unanswered.swap(pending_->results);
+  }
+  for (auto& entry : unanswered) {
+    entry.second->Error("ENGINE_DETACHED", "The Flutter engine was detached before the call completed");
+  }
+  plugin_->logger_->info("Flutter engine {} detached with {} calls unanswered", id_, unanswered.size());
+}
+
+// static
+std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> WireguardDartPlugin::Engine::Track(
+    const std::shared_ptr<PendingResults>& pending,
+    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  uint64_t key;
+  {
+    std::lock_guard<std::mutex> lock(pending->mutex);
+    key = pending->next++;
+    pending->results.emplace(key, std::move(result));
+  }
+  // The result once, taken out so that the detach does not answer it too; nullptr if it already did
+  auto take = [pending, key]() -> std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> {
+    std::lock_guard<std::mutex> lock(pending->mutex);
+    auto found = pending->results.find(key);
+    if (found == pending->results.end()) {
+      return nullptr;
+    }
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> taken = std::move(found->second);
+    pending->results.erase(found);
+    return taken;
+  };
+  return std::make_unique<flutter::MethodResultFunctions<flutter::EncodableValue>>(
+      [take](const flutter::EncodableValue* value) {
+        if (auto result = take()) {
+          value ? result->Success(*value) : result->Success();
+        }
+      },
+      [take](const std::string& code, const std::string& message, const flutter::EncodableValue* details) {
+        if (auto result = take()) {
+          details ? result->Error(code, message, *details) : result->Error(code, message);
+        }
+      },
+      [take]() {
+        if (auto result = take()) {
+          result->NotImplemented();
+        }
+      });
+}
+
+WireguardDartPlugin::WireguardDartPlugin() : log_level_(spdlog::level::debug) {
+  // Only what registering the channels needs, cheap allocations all; threads, notifications, the library and the
+  // loggers start at their first use, see StartupTrace
+  ScopedStartup startup("plugin");
+
+  // Setting up a tunnel can take seconds on the first run, which must not freeze the platform thread
+  platform_tasks_ = std::make_unique<PlatformTaskRunner>();
+  if (platform_tasks_->IsValid()) {
+    tunnel_tasks_ = std::make_unique<TunnelTaskQueue>();
+  } else {
+    logger_->warn("Failed to create the platform task window, tunnel calls run on the platform thread");
+  }
+  log_stream_ = std::make_unique<LogStream>(platform_tasks_.get());
+  log_ring_ = std::make_shared<LogRing>(kLogRingLines);
+  telemetry_ = std::make_unique<TelemetryExporter>([this]() { return MetricsText(); });
+  // Interface notifications come on system threads, the runner hands their events to the platform thread
+  network_adapter_observer_ = std::make_shared<NetworkAdapterStatusObserver>(platform_tasks_.get());
+  network_adapter_observer_->SetReadyCallback([this](const NET_LUID& luid) { PrefetchHosts(luid); });
 
-  plugin->network_adapter_observer_ = std::make_unique<NetworkAdapterStatusObserver>();
-  auto status_channel_handler = std::make_unique<flutter::StreamHandlerFunctions<>>(
-      [plugin_pointer = plugin.get()](
-          const flutter::EncodableValue* args,
-          std::unique_ptr<flutter::EventSink<>>&& events) -> std::unique_ptr<flutter::StreamHandlerError<>> {
-        return plugin_pointer->network_adapter_observer_->OnListen(args, std::move(events));
+  statistics_sampler_ = std::make_unique<StatisticsSampler>(
+      [this](std::vector<StatisticsSampler::Sample>& samples, StatisticsSampler::Fields fields) {
+        // Samples are overwritten in place, so their names keep their storage from one tick to the next
+        size_t count = 0;
+        auto lock = adapters_.LockShared();
+        adapters_.ForEachLocked([this, &samples, &count, fields](const std::string& name, WireguardAdapter* adapter) {
+          if (!adapter->IsValid()) {
+            return;
+          }
+          if (count == samples.size()) {
+            samples.emplace_back();
+          }
+          StatisticsSampler::Sample& sample = samples[count];
+          bool read;
+          if (fields.peers || fields.endpoints) {
+            // One driver read for both, the totals are the sums over the peers
+            std::vector<SOCKADDR_INET> endpoints;
+            read = adapter->GetPeerCounters(&sample.peers, fields.endpoints ? &endpoints : nullptr);
+            if (read && fields.endpoints) {
+              NotifyEndpointRoams(adapter, adapter->TrackEndpoints(sample.peers, endpoints));
+            }
+            sample.totals = WireguardAdapter::Totals();
+            for (const PeerStatistics& peer : sample.peers) {
+              sample.totals.rx_bytes += peer.rx_bytes;
+              sample.totals.tx_bytes += peer.tx_bytes;
+              sample.totals.last_handshake =
+                  (std::max)(sample.totals.last_handshake, UnixMillisToFiletime(peer.last_handshake_ms));
+            }
+          } else {
+            read = adapter->GetTotals(&sample.totals);
+          }
+          // Read right after the peers, for the same tick
+          sample.has_interface_counters =
+              read && fields.interface_counters && adapter->GetInterfaceCounters(&sample.interface_counters);
+          if (read && fields.luid &&
+              (!adapter->GetLUID(&sample.luid) ||
+               ConvertInterfaceLuidToIndex(&sample.luid, &sample.if_index) != NO_ERROR)) {
+            sample.luid.Value = 0;
+          }
+          if (read) {
+            sample.tunnel_name = name;
+            count++;
+          } else {
+            ReopenServiceTunnelLocked(adapter);
+          }
+        });
+        samples.resize(count);
       },
-      [plugin_pointer =
-           plugin.get()](const flutter::EncodableValue* args) -> std::unique_ptr<flutter::StreamHandlerError<>> {
-        return plugin_pointer->network_adapter_observer_->OnCancel(args);
+      platform_tasks_.get(), &statistics_history_,
+      [this](const std::string& tunnel_name, const PeerKey& public_key, bool stale, bool removed,
+             uint64_t last_handshake_ms) {
+        // Before anything else, so traffic moves as soon as it can
+        failover_groups_.OnLiveness(tunnel_name, public_key, stale);
+        // The app learns of removed peers from the removal itself
+        if (removed) {
+          return;
+        }
+        NET_LUID luid;
+        {
+          auto lock = adapters_.LockShared();
+          if (!adapters_.GetLuidLocked(tunnel_name, &luid)) {
+            return;
+          }
+        }
+        network_adapter_observer_->NotifyPeerLiveness(luid, KeyToBase64(public_key.data()), stale,
+                                                      static_cast<int64_t>(last_handshake_ms));
+        // Also for a first handshake that came after the wait for it timed out
+        if (!stale) {
+          network_adapter_observer_->NotifyHandshake(luid);
+        }
       });
 
-  status_channel->SetStreamHandler(std::move(status_channel_handler));
+  statistics_stream_ = std::make_unique<SharedEventStream>(statistics_sampler_.get());
+  logs_stream_ = std::make_unique<SharedEventStream>(log_stream_.get());
+  channel_benchmark_ = std::make_unique<ChannelBenchmarkStream>(platform_tasks_.get());
+  benchmark_stream_ = std::make_unique<SharedEventStream>(channel_benchmark_.get());
 
-  registrar->AddPlugin(std::move(plugin));
+  SetFfiPlugin(this);
 }
 
-WireguardDartPlugin::WireguardDartPlugin() {
-  // Initialize logger
-  try {
-    logger_ = spdlog::get("wireguard_dart");
-    if (!logger_) {
-      logger_ = spdlog::default_logger();
+void WireguardDartPlugin::EnsureStarted() {
+  std::call_once(started_, [this]() {
+    ScopedStartup startup("tracing");
+    RegisterTraceProvider();
+
+    // A logger the host app registered under the plugin's name, until nativeInit creates the file logger
+    std::shared_ptr<spdlog::logger> named_logger = spdlog::get("wireguard_dart");
+    if (named_logger) {
+      PluginLogger::Install(named_logger);
+    } else {
       logger_->info("WireguardDartPlugin initialized with default logger");
     }
-  } catch (const std::exception& e) {
-    // Fallback to default logger if initialization fails
-    logger_ = spdlog::default_logger();
-    logger_->warn("Failed to initialize named logger, using default: {}", e.what());
+  });
+}
+
+void WireguardDartPlugin::StartPowerMonitor() {
+  // Without the task window the callbacks would run the observer and the sampler on the system's thread
+  if (!platform_tasks_->IsValid()) {
+    return;
   }
+  std::call_once(power_monitor_started_, [this]() {
+    ScopedStartup startup("powerMonitor");
+    power_monitor_.Start(
+        [this](bool saving) { platform_tasks_->Post([this, saving]() { SetPowerSaving(saving); }); },
+        [this]() { KickTunnelsAfterResume(); });
+  });
 }
 
 WireguardDartPlugin::~WireguardDartPlugin() {
+  // Waits for the C ABI calls reading the adapters
+  ClearFfiPlugin(this);
+
+  // Its callbacks post to the platform thread and the tunnel workers
+  power_monitor_.Stop();
+
+  // Its snapshots read the plugin from its own thread
+  telemetry_->Stop();
+
+  // The sampler reads the adapters from its own thread
+  statistics_sampler_->Stop();
+
+  // The watches post reloads to the tunnel workers from the reactor
+  config_file_watcher_.UnwatchAll();
+
+  // Peer changes still to be written are written below, once no worker runs
+  std::map<std::string, IoReactor::TimerId> peer_changes;
+  {
+    std::lock_guard<std::mutex> lock(peer_change_mutex_);
+    peer_changes_closed_ = true;
+    peer_changes = peer_changes_;
+  }
+  for (const auto& entry : peer_changes) {
+    io_reactor_.Cancel(entry.second);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(worker_post_mutex_);
+    worker_posts_closed_ = true;
+  }
+  // No worker may still be using an adapter while they are torn down
+  tunnel_tasks_.reset();
+  // The queued writes were dropped with the workers, the ones that ran are no longer pending
+  for (const auto& entry : peer_changes) {
+    std::unique_lock<std::mutex> lock(peer_change_mutex_);
+    if (peer_changes_.count(entry.first) > 0) {
+      lock.unlock();
+      PersistPeerChanges(entry.first);
+    }
+  }
+
   // Disable WireGuard library logger before tearing down
   if (wg_library_ && wg_library_->IsLoaded()) {
     wg_library_->SetLogger()(nullptr);
@@ -104,342 +531,3307 @@ WireguardDartPlugin::~WireguardDartPlugin() {
 
   this->network_adapter_observer_->StopAllObserving();
 
-  // Clean up all adapters - don't fail destructor on errors
-  for (auto& adapter : adapters_) {
-    if (adapter && adapter->IsValid()) {
-      try {
-        if (!adapter->CleanupNetworking()) {
-          // Log warning but continue cleanup
-          logger_->warn("Failed to cleanup networking for adapter during shutdown");
-        }
-      } catch (...) {
-        // Log error but continue - destructor must not throw
-        logger_->error("Exception during network cleanup in destructor");
-      }
-    }
+  // Clean up all adapters in parallel - don't fail destructor on errors, and don't hold up app exit past the
+  // deadline. Workers past it may outlive the plugin, so nothing that calls back into it runs any more.
+  std::vector<std::unique_ptr<WireguardAdapter>> adapters = adapters_.RemoveAll();
+  for (const auto& adapter : adapters) {
+    adapter->StopCallbacks();
+  }
+  size_t left = TearDownAdapters(std::move(adapters), kTeardownDeadline);
+  // Nothing is left to recover after a clean exit
+  if (state_journal_ && left == 0) {
+    state_journal_->Clear();
   }
-  adapters_.clear();  // This will call destructors
+
+  // Only now, so that it still watches the teardown's driver calls
+  HangWatchdog::Instance().Stop();
 
   logger_->info("=========== Session end ===========");
   logger_->flush();
+  // The file logger's thread pool goes with the plugin; whatever still logs, like teardown workers past the
+  // deadline, logs to the default logger from here on
+  PluginLogger::Install(nullptr);
+  spdlog::drop("wireguard_dart");
+  // Registered by the first call, if any came
+  bool started = true;
+  std::call_once(started_, [&started]() { started = false; });
+  if (started) {
+    UnregisterTraceProvider();
+  }
 }
 
-WireguardAdapter* WireguardDartPlugin::FindAdapterByName(const std::wstring& adapter_name) {
-  auto adapter_it = std::find_if(adapters_.begin(), adapters_.end(),
-                                 [&adapter_name](const std::unique_ptr<WireguardAdapter>& adapter) {
-                                   return adapter && adapter->GetName() == adapter_name;
-                                 });
-
-  return (adapter_it != adapters_.end()) ? adapter_it->get() : nullptr;
-}
-
-void WireguardDartPlugin::RemoveAdapterByName(const std::wstring& adapter_name) {
-  auto adapter_it = std::find_if(adapters_.begin(), adapters_.end(),
-                                 [&adapter_name](const std::unique_ptr<WireguardAdapter>& adapter) {
-                                   return adapter && adapter->GetName() == adapter_name;
-                                 });
-
-  if (adapter_it != adapters_.end()) {
+void WireguardDartPlugin::RemoveAdapterByName(const std::string& tunnel_name) {
+  {
+    std::lock_guard<std::mutex> lock(correlation_mutex_);
+    correlation_ids_.erase(tunnel_name);
+  }
+  route_lookup_.RemoveTunnel(tunnel_name);
+  link_quality_prober_.RemoveTunnel(tunnel_name);
+  std::unique_ptr<WireguardAdapter> adapter = adapters_.Remove(tunnel_name);
+  if (adapter) {
     // Stop observing the adapter if it's being observed
     NET_LUID luid;
-    if ((*adapter_it)->GetLUID(&luid)) {
+    if (adapter->GetLUID(&luid)) {
       network_adapter_observer_->StopObserving(luid);
     }
-
-    // Remove adapter from vector
-    adapters_.erase(adapter_it);
   }
 }
 
-std::optional<WireguardMethod> WireguardDartPlugin::GetMethodFromString(const std::string& method_name) {
-  if (method_name == "generateKeyPair") return WireguardMethod::GENERATE_KEY_PAIR;
-  if (method_name == "checkTunnelConfiguration") return WireguardMethod::CHECK_TUNNEL_CONFIGURATION;
-  if (method_name == "nativeInit") return WireguardMethod::NATIVE_INIT;
-  if (method_name == "setupTunnel") return WireguardMethod::SETUP_TUNNEL;
-  if (method_name == "connect") return WireguardMethod::CONNECT;
-  if (method_name == "disconnect") return WireguardMethod::DISCONNECT;
-  if (method_name == "status") return WireguardMethod::STATUS;
-  return std::nullopt;
+void WireguardDartPlugin::PrewarmAdapter(const std::string& tunnel_name) {
+  if (adapters_.FindByName(tunnel_name)) {
+    return;
+  }
+
+  std::wstring adapter_name = Utf8ToWide(tunnel_name);
+  std::shared_ptr<WireguardLibrary> library = Library();
+  if (!library) {
+    logger_->warn("Failed to prewarm adapter {}: WireGuard library not available", tunnel_name);
+    return;
+  }
+  // Nothing to open before the driver runs
+  std::unique_ptr<WireguardAdapter> adapter;
+  if (library->GetRunningDriverVersion()() != 0) {
+    adapter = WireguardAdapter::Open(library, adapter_name);
+  }
+  if (!adapter) {
+    adapter = CreateAdapter(adapter_name, BundleId());
+  }
+  if (!adapter) {
+    logger_->warn("Failed to prewarm adapter {}: Windows error {}", tunnel_name, GetLastError());
+    return;
+  }
+
+  if (!adapter->SetState(WIREGUARD_ADAPTER_STATE_DOWN)) {
+    logger_->warn("Failed to set prewarmed adapter {} DOWN", tunnel_name);
+  }
+  adapter->SetWorkerPost(TunnelWorkerPost(tunnel_name));
+  adapters_.Add(std::move(adapter));
+  logger_->info("Prewarmed adapter: {}", tunnel_name);
 }
 
-void WireguardDartPlugin::HandleMethodCall(const flutter::MethodCall<flutter::EncodableValue>& call,
-                                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
-  const auto* args = std::get_if<flutter::EncodableMap>(call.arguments());
+void WireguardDartPlugin::RecoverFromJournal(const StateJournal::Entry& entry) {
+  std::string tunnel_name = WideToUtf8(entry.name);
+  if (adapters_.FindByName(tunnel_name)) {
+    return;
+  }
+
+  std::shared_ptr<WireguardLibrary> library = Library();
+  std::unique_ptr<WireguardAdapter> adapter;
+  if (library && library->GetRunningDriverVersion()() != 0) {
+    adapter = WireguardAdapter::Open(library, entry.name);
+  }
+  NET_LUID luid;
+  GUID guid;
+  if (!adapter || !adapter->GetLUID(&luid) || luid.Value != entry.luid.Value ||
+      ConvertInterfaceLuidToGuid(&luid, &guid) != NO_ERROR || !IsEqualGUID(guid, entry.guid)) {
+    // The adapter went away with the app, and its addresses and routes with it
+    logger_->info("Journaled adapter {} is gone, nothing to recover", tunnel_name);
+    state_journal_->Forget(entry.name);
+    return;
+  }
+
+  NetworkTableSnapshot snapshot;
+  bool has_snapshot = snapshot.Take();
+  if (has_snapshot && StateJournal::IsIntact(entry.ledger, luid, snapshot)) {
+    // Setting up the same configuration again is a no-op when its parsed form was cached
+    std::optional<WireguardConfigParser> applied;
+    WireguardConfigParser cached_config;
+    if (config_cache_ && config_cache_->Load(entry.name, entry.text_hash, entry.text_size, cached_config)) {
+      applied = std::move(cached_config);
+    }
+    bool adopted = applied.has_value();
+    adapter->Recover(entry.ledger, entry.dns_configured, std::move(applied));
+    logger_->info("Recovered adapter {} with its networking intact{}", tunnel_name,
+                  adopted ? "" : ", its configuration is applied again on setup");
+  } else {
+    // Exactly the recorded rows are removed, the ledger spares the table scans
+    adapter->Recover(entry.ledger, entry.dns_configured, std::nullopt);
+    if (!adapter->CleanupNetworking(has_snapshot ? &snapshot : nullptr)) {
+      logger_->warn("Failed to clean up the journaled networking of adapter {}", tunnel_name);
+    }
+    state_journal_->Forget(entry.name);
+    logger_->info("Recovered adapter {} and removed its stale networking", tunnel_name);
+  }
 
-  auto method = GetMethodFromString(call.method_name());
+  WireguardAdapter* recovered = adapter.get();
+  recovered->SetWorkerPost(TunnelWorkerPost(tunnel_name));
+  adapters_.Add(std::move(adapter));
+  WatchAdapter(tunnel_name, recovered, luid);
+  IndexTunnel(tunnel_name, recovered);
+  ReleaseIfLowMemory(recovered);
+}
 
-  if (!method.has_value()) {
-    result->NotImplemented();
+void WireguardDartPlugin::JournalAdapter(WireguardAdapter* adapter) {
+  const WireguardConfigParser* applied_config = adapter->GetAppliedConfiguration();
+  StateJournal::Entry entry;
+  if (!state_journal_ || !applied_config || !adapter->GetLUID(&entry.luid) ||
+      ConvertInterfaceLuidToGuid(&entry.luid, &entry.guid) != NO_ERROR) {
     return;
   }
+  entry.name = adapter->GetName();
+  entry.text_hash = applied_config->GetTextHash();
+  entry.text_size = applied_config->GetTextSize();
+  entry.dns_configured = adapter->IsDnsConfigured();
+  entry.ledger = adapter->GetNetworkLedger();
+  state_journal_->Record(entry);
+}
 
-  switch (method.value()) {
-    case WireguardMethod::GENERATE_KEY_PAIR:
-      HandleGenerateKeyPair(args, std::move(result));
-      break;
-    case WireguardMethod::CHECK_TUNNEL_CONFIGURATION:
-      HandleCheckTunnelConfiguration(args, std::move(result));
-      break;
-    case WireguardMethod::NATIVE_INIT:
-      HandleNativeInit(args, std::move(result));
-      break;
-    case WireguardMethod::SETUP_TUNNEL:
-      HandleSetupTunnel(args, std::move(result));
-      break;
-    case WireguardMethod::CONNECT:
-      HandleConnect(args, std::move(result));
-      break;
-    case WireguardMethod::DISCONNECT:
-      HandleDisconnect(args, std::move(result));
-      break;
-    case WireguardMethod::STATUS:
-      HandleStatus(args, std::move(result));
-      break;
+void WireguardDartPlugin::AttachServiceTunnel(const std::string& tunnel_name) {
+  std::shared_ptr<WireguardLibrary> library = Library();
+  std::unique_ptr<WireguardAdapter> adapter =
+      library ? WireguardAdapter::Open(library, Utf8ToWide(tunnel_name)) : nullptr;
+  if (!adapter) {
+    logger_->warn("Failed to attach to the service of tunnel {}: Windows error {}", tunnel_name, GetLastError());
+    return;
+  }
+  adapter->SetServiceOwned();
+  adapter->SetWorkerPost(TunnelWorkerPost(tunnel_name));
+
+  WireguardAdapter* attached = adapter.get();
+  adapters_.Add(std::move(adapter));
+  NET_LUID luid;
+  if (attached->GetLUID(&luid)) {
+    WatchAdapter(tunnel_name, attached, luid);
   }
+  logger_->info("Attached to the service of tunnel {}", tunnel_name);
 }
 
-void WireguardDartPlugin::HandleGenerateKeyPair(
-    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
-  logger_->info("Generate key pair initiated");
-  std::pair public_private_keypair = GenerateKeyPair();
-  std::map<flutter::EncodableValue, flutter::EncodableValue> return_value;
-  return_value[flutter::EncodableValue("publicKey")] = flutter::EncodableValue(public_private_keypair.first);
-  return_value[flutter::EncodableValue("privateKey")] = flutter::EncodableValue(public_private_keypair.second);
-  result->Success(flutter::EncodableValue(return_value));
-  logger_->info("Generate key pair completed successfully");
+void WireguardDartPlugin::ReopenServiceTunnelLocked(WireguardAdapter* adapter) {
+  // Only the worker may remove the adapter, and it is the one to ask again while the lock is held
+  if (!adapter->IsServiceOwned() || !tunnel_tasks_ || !adapter->ClaimReopen()) {
+    return;
+  }
+  std::string tunnel_name = WideToUtf8(adapter->GetName());
+  tunnel_tasks_->Post(tunnel_name, [this, tunnel_name]() {
+    WireguardAdapter* stale = adapters_.FindByName(tunnel_name);
+    if (!stale || !stale->IsServiceOwned()) {
+      return;
+    }
+    logger_->info("Reopening the adapter of tunnel service {}", tunnel_name);
+    RemoveAdapterByName(tunnel_name);
+    // A stopped service is disconnected until connect starts it again
+    if (tunnel_service::IsRunning(tunnel_name)) {
+      AttachServiceTunnel(tunnel_name);
+    }
+  });
 }
 
-void WireguardDartPlugin::HandleCheckTunnelConfiguration(
-    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
-  logger_->info("Check tunnel configuration initiated");
+void WireguardDartPlugin::NotifyEndpointRoams(WireguardAdapter* adapter,
+                                              const std::vector<WireguardAdapter::EndpointRoam>& roams) {
+  NET_LUID luid;
+  if (roams.empty() || !adapter->GetLUID(&luid)) {
+    return;
+  }
+  for (const WireguardAdapter::EndpointRoam& roam : roams) {
+    network_adapter_observer_->NotifyEndpointRoamed(luid, KeyToBase64(roam.public_key.data()), roam.previous,
+                                                    roam.current);
+  }
+}
 
-  // Check if we have any valid adapters created
-  bool has_adapter = !adapters_.empty() && adapters_.back() && adapters_.back()->IsValid();
-  bool is_configured = has_adapter;
+void WireguardDartPlugin::SetPowerSaving(bool saving) {
+  power_saving_ = saving;
+  statistics_sampler_->SetPowerSaving(saving);
+  link_quality_prober_.SetPowerSaving(saving);
+  ApplyStatusCoalesce();
+}
 
-  result->Success(flutter::EncodableValue(is_configured));
-  logger_->info("Check tunnel configuration completed - configured: {}, adapter: {}", is_configured, has_adapter);
+void WireguardDartPlugin::ApplyStatusCoalesce() {
+  std::chrono::milliseconds window = status_coalesce_;
+  if (power_saving_) {
+    window = (std::max)(window, kPowerSavingCoalesce);
+  }
+  if (group_transitions_ > 0) {
+    window = (std::max)(window, kGroupTransitionCoalesce);
+  }
+  network_adapter_observer_->SetCoalesceWindow(window);
 }
 
-void WireguardDartPlugin::HandleNativeInit(const flutter::EncodableMap* args,
-                                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
-  // Set up file logger if a log file path was provided by the host app
-  if (args) {
-    const auto* log_file_path = std::get_if<std::string>(ValueOrNull(*args, "logFilePath"));
-    if (log_file_path && !log_file_path->empty()) {
-      try {
-        // Drop any existing logger with the same name before re-creating
-        spdlog::drop("wireguard_dart");
-        auto file_logger =
-            spdlog::basic_logger_mt("wireguard_dart", *log_file_path, true /* truncate = false (append) */);
-        file_logger->set_level(spdlog::level::debug);
-        file_logger->flush_on(spdlog::level::debug);
-        logger_ = file_logger;
-      } catch (const std::exception& e) {
-        logger_->warn("Failed to create file logger at '{}': {}", *log_file_path, e.what());
+void WireguardDartPlugin::KickTunnelsAfterResume() {
+  std::vector<std::string> tunnel_names;
+  {
+    auto lock = adapters_.LockShared();
+    adapters_.ForEachLocked(
+        [&tunnel_names](const std::string& name, WireguardAdapter*) { tunnel_names.push_back(name); });
+  }
+  // On the tunnel's worker, behind whatever operation it is running; the monitor is only started with the workers
+  for (const std::string& tunnel_name : tunnel_names) {
+    auto kick = [this, tunnel_name]() {
+      auto lock = adapters_.LockShared();
+      if (WireguardAdapter* adapter = adapters_.FindByNameLocked(tunnel_name)) {
+        adapter->KickAfterResume();
       }
-    }
+    };
+    tunnel_tasks_->Post(tunnel_name, kick);
   }
+}
 
-  logger_->info("========== Session start ==========");
-  logger_->info("Native init initiated");
+std::string WireguardDartPlugin::BundleId() {
+  std::lock_guard<std::mutex> lock(bundle_id_mutex_);
+  return bundle_id_;
+}
 
-  // Initialize WireGuard library
-  wg_library_ = WireguardLibrary::Create();
+std::unique_ptr<WireguardAdapter> WireguardDartPlugin::CreateAdapter(const std::wstring& adapter_name,
+                                                                    const std::string& bundle_id) {
+  // Without one every app would derive the same GUIDs
+  if (bundle_id.empty()) {
+    logger_->error("Cannot create adapter {} without a bundle ID", WideToUtf8(adapter_name));
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return nullptr;
+  }
+  GUID guid = WireguardAdapter::StableGuid(bundle_id, adapter_name);
+  return WireguardAdapter::Create(Library(), adapter_name, kTunnelType, &guid);
+}
+
+WireguardAdapter::WorkerPost WireguardDartPlugin::TunnelWorkerPost(const std::string& tunnel_name) {
+  return [this, tunnel_name](std::function<void(WireguardAdapter*)> task) {
+    std::lock_guard<std::mutex> lock(worker_post_mutex_);
+    if (worker_posts_closed_ || !tunnel_tasks_) {
+      return;
+    }
+    tunnel_tasks_->Post(tunnel_name, [this, tunnel_name, task]() {
+      // Only this worker removes the tunnel's adapter, so it stays valid without the registry's lock
+      if (WireguardAdapter* adapter = adapters_.FindByName(tunnel_name)) {
+        task(adapter);
+      }
+    });
+  };
+}
+
+std::shared_ptr<WireguardLibrary> WireguardDartPlugin::Library() {
+  std::lock_guard<std::mutex> lock(library_mutex_);
   if (wg_library_) {
-    logger_->info("WireGuard library loaded successfully");
-    wg_library_->SetLogger()(WireguardLoggerCallback);
-    logger_->info("WireGuard library logger callback registered");
+    return wg_library_;
+  }
+
+  // Tried again on every call until it loads, the driver may be installed while the app runs
+  ScopedStartup startup("library");
+  PhaseTimer timer(perf_stats_.get());
+  wg_library_ = WireguardLibrary::Create();
+  if (!wg_library_) {
+    logger_->error("Failed to load WireGuard library - adapter management will not be possible");
+    return nullptr;
+  }
+  timer.Lap("libraryLoad");
+  DWORD driver_version = wg_library_->GetRunningDriverVersion()();
+  if (driver_version != 0) {
+    logger_->info("WireGuard library loaded successfully, driver {} running", DriverVersionString(driver_version));
   } else {
-    logger_->error(
-        "Failed to load WireGuard library - adapter management will "
-        "not be possible");
-    result->Error("Failed to load WireGuard library");
+    logger_->info("WireGuard library loaded successfully, driver not running yet");
+  }
+  wg_library_->SetLogger()(AdapterLogs::LoggerCallback);
+  logger_->info("WireGuard library logger callback registered");
+  return wg_library_;
+}
+
+void WireguardDartPlugin::HandleBulkMethodCall(
+    const flutter::MethodCall<flutter::EncodableValue>& call,
+    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  EnsureStarted();
+  const auto* args = std::get_if<flutter::EncodableMap>(call.arguments());
+
+  auto method = MethodFromName(call.method_name());
+  if (!method.has_value()) {
+    result->NotImplemented();
     return;
   }
+  result = CountedResult(method.value(), std::move(result));
 
-  result->Success();
-  logger_->info("Native init completed successfully");
+  switch (method.value()) {
+    case WireguardMethod::SETUP_TUNNELS:
+      // Without the tunnel workers the setups would run right here, next to the platform thread's own calls
+      if (!tunnel_tasks_) {
+        result->NotImplemented();
+        break;
+      }
+      HandleSetupTunnels(args, std::move(result));
+      break;
+    case WireguardMethod::GET_STATISTICS_HISTORY:
+      HandleGetStatisticsHistory(args, std::move(result));
+      break;
+    case WireguardMethod::GET_RECENT_LOGS:
+      HandleGetRecentLogs(args, std::move(result));
+      break;
+    case WireguardMethod::GET_METRICS:
+      HandleGetMetrics(args, std::move(result));
+      break;
+    default:
+      // Everything else touches state that is only safe on the platform thread
+      result->NotImplemented();
+      break;
+  }
 }
 
-void WireguardDartPlugin::HandleSetupTunnel(const flutter::EncodableMap* args,
-                                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
-  logger_->info("Setup tunnel initiated");
+void WireguardDartPlugin::RunForTunnel(const flutter::EncodableMap* args,
+                                       std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                                       MethodHandler handler) {
+  const auto* tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!tunnel_name || !tunnel_tasks_) {
+    (this->*handler)(args, std::move(result));
+    return;
+  }
 
-  const auto* cfg = std::get_if<std::string>(ValueOrNull(*args, "cfg"));
-  if (cfg == NULL) {
-    logger_->error("Setup tunnel failed: cfg argument missing");
-    result->Error("Argument 'cfg' is required");
+  // The handler answers from the worker
+  auto worker_result = std::make_shared<std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>>>(
+      PlatformResult(std::move(result)));
+  auto worker_args = std::make_shared<flutter::EncodableMap>(*args);
+  tunnel_tasks_->Post(*tunnel_name, [this, handler, worker_args, worker_result]() {
+    (this->*handler)(worker_args.get(), std::move(*worker_result));
+  });
+}
+
+void WireguardDartPlugin::RunOperationForTunnel(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    MethodHandler handler) {
+  std::optional<int64_t> id = args ? IntegerArgument(ValueOrNull(*args, keys::kOperationId)) : std::nullopt;
+  std::optional<int64_t> timeout_ms = args ? IntegerArgument(ValueOrNull(*args, keys::kTimeoutMs)) : std::nullopt;
+  if (!id && !timeout_ms) {
+    RunForTunnel(args, std::move(result), handler);
     return;
   }
 
-  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, "tunnelName"));
-  if (arg_tunnel_name == NULL) {
-    logger_->error("Setup tunnel failed: tunnelName argument missing");
-    result->Error("Argument 'tunnelName' is required");
+  OperationRegistry::Operation operation = operations_.Begin(id, std::chrono::milliseconds(timeout_ms.value_or(0)));
+  // With the id it is tracked by, also for calls that came without one
+  auto worker_args = std::make_shared<flutter::EncodableMap>(*args);
+  (*worker_args)[keys::kOperationId] = flutter::EncodableValue(operation.id);
+  const auto* tunnel_name = std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName));
+  if (!tunnel_name || !tunnel_tasks_) {
+    (this->*handler)(worker_args.get(), std::move(result));
+    operations_.End(operation);
     return;
   }
 
-  std::wstring adapter_name = Utf8ToWide(*arg_tunnel_name);
+  auto worker_result = std::make_shared<std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>>>(
+      PlatformResult(std::move(result)));
+  tunnel_tasks_->Post(*tunnel_name, [this, handler, worker_args, worker_result, operation]() {
+    (this->*handler)(worker_args.get(), std::move(*worker_result));
+    operations_.End(operation);
+  });
+}
 
-  // Check if WireGuard library is available
-  if (!wg_library_ || !wg_library_->IsLoaded()) {
-    logger_->error("Setup tunnel failed: WireGuard library not available");
-    result->Error("WIREGUARD_LIBRARY_NOT_AVAILABLE", "WireGuard library is not loaded");
+void WireguardDartPlugin::RunForTunnelAsync(const flutter::EncodableMap* args,
+                                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                                            AsyncMethodHandler handler) {
+  const auto* tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!tunnel_name || !tunnel_tasks_) {
+    // Its awaits block without the workers to resume on
+    (this->*handler)(args ? *args : flutter::EncodableMap(), std::move(result), TunnelTaskQueue::Hold());
     return;
   }
 
-  // Check if adapter already exists
-  WireguardAdapter* existing_adapter = FindAdapterByName(adapter_name);
-  if (existing_adapter) {
-    // Ensure the observer is started with the existing adapter
-    if (existing_adapter->IsValid()) {
+  auto worker_result = std::make_shared<std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>>>(
+      PlatformResult(std::move(result)));
+  auto worker_args = std::make_shared<flutter::EncodableMap>(*args);
+  tunnel_tasks_->PostHeld(*tunnel_name, [this, handler, worker_args, worker_result](TunnelTaskQueue::Hold hold) {
+    (this->*handler)(std::move(*worker_args), std::move(*worker_result), std::move(hold));
+  });
+}
+
+std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> WireguardDartPlugin::PlatformResult(
+    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  // Each answer is carried over to the platform thread
+  std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> platform_result(std::move(result));
+  PlatformTaskRunner* platform_tasks = platform_tasks_.get();
+  return std::make_unique<flutter::MethodResultFunctions<flutter::EncodableValue>>(
+      [platform_tasks, platform_result](const flutter::EncodableValue* value) {
+        std::optional<flutter::EncodableValue> copy;
+        if (value) {
+          copy = *value;
+        }
+        platform_tasks->Post([platform_result, copy]() {
+          copy ? platform_result->Success(*copy) : platform_result->Success();
+        });
+      },
+      [platform_tasks, platform_result](const std::string& code, const std::string& message,
+                                        const flutter::EncodableValue* details) {
+        std::optional<flutter::EncodableValue> copy;
+        if (details) {
+          copy = *details;
+        }
+        platform_tasks->Post([platform_result, code, message, copy]() {
+          copy ? platform_result->Error(code, message, *copy) : platform_result->Error(code, message);
+        });
+      },
+      [platform_tasks, platform_result]() {
+        platform_tasks->Post([platform_result]() { platform_result->NotImplemented(); });
+      });
+}
+
+AsyncContext WireguardDartPlugin::TunnelContext() {
+  if (!tunnel_tasks_) {
+    return AsyncContext();
+  }
+  TunnelTaskQueue* tunnel_tasks = tunnel_tasks_.get();
+  return AsyncContext{&io_reactor_, [tunnel_tasks](std::coroutine_handle<> handle) {
+                        tunnel_tasks->PostContinuation([handle]() { handle.resume(); });
+                      }};
+}
+
+void WireguardDartPlugin::WatchAdapter(const std::string& tunnel_name, WireguardAdapter* adapter,
+                                       const NET_LUID& luid) {
+  // Power matters once a tunnel is up
+  StartPowerMonitor();
+  {
+    // Before the first event, for an adapter the call set up
+    std::lock_guard<std::mutex> lock(correlation_mutex_);
+    auto correlation = correlation_ids_.find(tunnel_name);
+    if (correlation != correlation_ids_.end()) {
+      network_adapter_observer_->SetCorrelationId(luid, correlation->second);
+    }
+  }
+  // StartObserving is a no-op for an adapter that is already observed
+  network_adapter_observer_->StartObserving(luid, tunnel_name);
+  // An adapter that was up before it was observed is connected if it ever completed a handshake; bringing it up
+  // again starts over
+  if (adapter->GetLatestHandshake() != 0) {
+    network_adapter_observer_->NotifyHandshake(luid);
+  }
+
+  const WireguardConfigParser* applied_config = adapter->GetAppliedConfiguration();
+  if (applied_config) {
+    network_adapter_observer_->WatchAddressReadiness(luid, applied_config->GetInterface().addresses);
+    return;
+  }
+  // A configuration released in low-memory mode leaves the addresses networking put on the interface
+  const NetworkLedger& ledger = adapter->GetNetworkLedger();
+  if (ledger.addresses_known) {
+    std::vector<WIREGUARD_ALLOWED_IP> addresses;
+    for (const IpPrefix& prefix : ledger.addresses) {
+      WIREGUARD_ALLOWED_IP address = {};
+      address.AddressFamily = prefix.family;
+      address.Cidr = prefix.length;
+      memcpy(&address.Address, prefix.address, prefix.family == AF_INET ? 4 : 16);
+      addresses.push_back(address);
+    }
+    network_adapter_observer_->WatchAddressReadiness(luid, addresses);
+  }
+}
+
+void WireguardDartPlugin::PrefetchHosts(const NET_LUID& luid) {
+  std::vector<std::string> hosts;
+  EndpointResolver* resolver;
+  {
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    auto found = prefetch_hosts_.find(luid.Value);
+    if (found == prefetch_hosts_.end()) {
+      return;
+    }
+    // Once per connect; the addresses becoming ready again later finds nothing
+    hosts = std::move(found->second);
+    prefetch_hosts_.erase(found);
+    if (!prefetch_resolver_) {
+      prefetch_resolver_ = std::make_unique<EndpointResolver>();
+    }
+    resolver = prefetch_resolver_.get();
+  }
+
+  // All in flight at once through the system's resolver, which the tunnel's DNS configuration now sends them
+  // through, so that the app's first requests find their answers cached
+  struct Progress {
+    std::atomic<size_t> left;
+    std::atomic<size_t> resolved{0};
+    int64_t start_us;
+  };
+  auto progress = std::make_shared<Progress>();
+  progress->left = hosts.size();
+  progress->start_us = PerfCounterMicroseconds();
+  logger_->info("Prefetching {} hostnames after adapter LUID {} became ready", hosts.size(), luid.Value);
+  resolver->ResolveAsync(hosts, [progress, total = hosts.size(), luid_value = luid.Value](
+                                    const std::string& host, const SOCKADDR_INET* address, const SOCKADDR_INET*) {
+    PluginLogger logger;
+    if (address) {
+      progress->resolved++;
+    } else {
+      logger->warn("Failed to prefetch hostname {} for adapter LUID {}", host, luid_value);
+    }
+    if (--progress->left == 0) {
+      logger->info("Prefetched {} of {} hostnames for adapter LUID {} in {} us", progress->resolved.load(), total,
+                   luid_value, PerfCounterMicroseconds() - progress->start_us);
+    }
+  });
+}
+
+void WireguardDartPlugin::NoteCorrelation(const flutter::EncodableMap* args, const std::string& correlation_id) {
+  const auto* tunnel_name = std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName));
+  if (!tunnel_name) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(correlation_mutex_);
+    correlation_ids_[*tunnel_name] = correlation_id;
+  }
+  // An adapter observed already is tagged now, one the call sets up once it is watched
+  auto lock = adapters_.LockShared();
+  NET_LUID luid;
+  if (adapters_.GetLuidLocked(*tunnel_name, &luid)) {
+    network_adapter_observer_->SetCorrelationId(luid, correlation_id);
+  }
+}
+
+// static
+std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> WireguardDartPlugin::CorrelatedResult(
+    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result, const std::string& correlation_id) {
+  std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> inner(std::move(result));
+  auto stamp = [correlation_id](flutter::EncodableMap map) {
+    map[keys::kCorrelationId] = flutter::EncodableValue(correlation_id);
+    map[keys::kMonotonicUs] = flutter::EncodableValue(PerfCounterMicroseconds());
+    return flutter::EncodableValue(std::move(map));
+  };
+  return std::make_unique<flutter::MethodResultFunctions<flutter::EncodableValue>>(
+      [inner, stamp](const flutter::EncodableValue* value) {
+        // Answers of other types keep their form
+        const auto* map = value ? std::get_if<flutter::EncodableMap>(value) : nullptr;
+        if (map) {
+          inner->Success(stamp(*map));
+        } else if (value) {
+          inner->Success(*value);
+        } else {
+          inner->Success();
+        }
+      },
+      [inner, stamp](const std::string& code, const std::string& message, const flutter::EncodableValue* details) {
+        const auto* map = details ? std::get_if<flutter::EncodableMap>(details) : nullptr;
+        if (map || !details) {
+          inner->Error(code, message, stamp(map ? *map : flutter::EncodableMap()));
+        } else {
+          inner->Error(code, message, *details);
+        }
+      },
+      [inner]() { inner->NotImplemented(); });
+}
+
+// static
+std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> WireguardDartPlugin::CountedResult(
+    WireguardMethod method, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> inner(std::move(result));
+  return std::make_unique<flutter::MethodResultFunctions<flutter::EncodableValue>>(
+      [method, inner](const flutter::EncodableValue* value) {
+        OperationCounters::Instance().CountMethod(method);
+        value ? inner->Success(*value) : inner->Success();
+      },
+      [method, inner](const std::string& code, const std::string& message, const flutter::EncodableValue* details) {
+        ErrorClass error_class = ClassifyErrorCode(code);
+        OperationCounters::Instance().CountMethod(method, error_class);
+        // What led up to the error, unless the call itself was wrong or given up on
+        const char* name = method_table::kNames[static_cast<size_t>(method)].data();
+        FlightRecorder::Instance().Record(FlightEvent::kMethodError, name, 0, static_cast<uint32_t>(error_class));
+        if (error_class != ErrorClass::kInvalidArgument && error_class != ErrorClass::kCancelled) {
+          FlightRecorder::Instance().DumpInBackground(std::string(name) + " failed with " + code);
+        }
+        details ? inner->Error(code, message, *details) : inner->Error(code, message);
+      },
+      [method, inner]() {
+        OperationCounters::Instance().CountMethod(method, ErrorClass::kUnsupported);
+        inner->NotImplemented();
+      });
+}
+
+void WireguardDartPlugin::IndexTunnel(const std::string& tunnel_name, WireguardAdapter* adapter) {
+  // A configuration released in low-memory mode was indexed when it was applied
+  if (const WireguardConfigParser* applied_config = adapter->GetAppliedConfiguration()) {
+    route_lookup_.SetTunnel(tunnel_name, *applied_config);
+    link_quality_prober_.SetTunnel(tunnel_name, *applied_config);
+  }
+  // A new configuration or adapter starts without the probe keepalives
+  NET_LUID luid;
+  if (adapter->GetLUID(&luid) && failover_groups_.Reapply(tunnel_name, luid)) {
+    adapter->SetProbing(true);
+  }
+}
+
+void WireguardDartPlugin::ReleaseIfLowMemory(WireguardAdapter* adapter) {
+  if (low_memory_) {
+    adapter->ReleaseAppliedConfiguration();
+  }
+}
+
+void WireguardDartPlugin::HandleMethodCall(uint64_t engine, const flutter::MethodCall<flutter::EncodableValue>& call,
+                                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  EnsureStarted();
+  const auto* args = std::get_if<flutter::EncodableMap>(call.arguments());
+  // The app relates the events the call causes, and its answer, to the call by the ID it gave it
+  const auto* correlation_id = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kCorrelationId)) : nullptr;
+  if (correlation_id) {
+    NoteCorrelation(args, *correlation_id);
+    result = CorrelatedResult(std::move(result), *correlation_id);
+  }
+
+  auto method = MethodFromName(call.method_name());
+
+  if (!method.has_value()) {
+    result->NotImplemented();
+    return;
+  }
+  result = CountedResult(method.value(), std::move(result));
+
+  switch (method.value()) {
+    case WireguardMethod::GENERATE_KEY_PAIR:
+    case WireguardMethod::GENERATE_KEY_PAIR_BINARY:
+      HandleGenerateKeyPair(args, std::move(result), method.value() == WireguardMethod::GENERATE_KEY_PAIR_BINARY);
+      break;
+    case WireguardMethod::GENERATE_KEY_PAIRS:
+    case WireguardMethod::GENERATE_KEY_PAIRS_BINARY:
+      HandleGenerateKeyPairs(args, std::move(result), method.value() == WireguardMethod::GENERATE_KEY_PAIRS_BINARY);
+      break;
+    case WireguardMethod::GENERATE_PRESHARED_KEYS:
+    case WireguardMethod::GENERATE_PRESHARED_KEYS_BINARY:
+      HandleGeneratePresharedKeys(args, std::move(result),
+                                  method.value() == WireguardMethod::GENERATE_PRESHARED_KEYS_BINARY);
+      break;
+    case WireguardMethod::DERIVE_PUBLIC_KEY:
+      HandleDerivePublicKey(args, std::move(result));
+      break;
+    case WireguardMethod::DERIVE_PUBLIC_KEYS:
+      HandleDerivePublicKeys(args, std::move(result));
+      break;
+    case WireguardMethod::CHECK_TUNNEL_CONFIGURATION:
+      HandleCheckTunnelConfiguration(args, std::move(result));
+      break;
+    case WireguardMethod::VERIFY_TUNNEL_CONFIGURATION:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleVerifyTunnelConfiguration);
+      break;
+    case WireguardMethod::EXPORT_TUNNEL_CONFIGURATION:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleExportTunnelConfiguration);
+      break;
+    case WireguardMethod::REMOVE_TUNNEL_CONFIGURATION:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleRemoveTunnelConfiguration);
+      break;
+    case WireguardMethod::NATIVE_INIT:
+      HandleNativeInit(args, std::move(result));
+      break;
+    // Driver and IP helper work, queued per tunnel
+    case WireguardMethod::SETUP_TUNNEL:
+      RunOperationForTunnel(args, std::move(result), &WireguardDartPlugin::HandleSetupTunnel);
+      break;
+    // Queues each tunnel on its own worker
+    case WireguardMethod::SETUP_TUNNELS:
+      HandleSetupTunnels(args, std::move(result));
+      break;
+    case WireguardMethod::SETUP_AND_CONNECT:
+      RunOperationForTunnel(args, std::move(result), &WireguardDartPlugin::HandleSetupAndConnect);
+      break;
+    // setupTunnel with a config map in place of cfg, see structured_config.h
+    case WireguardMethod::SETUP_TUNNEL_STRUCTURED:
+      RunOperationForTunnel(args, std::move(result), &WireguardDartPlugin::HandleSetupTunnel);
+      break;
+    // setupTunnel with the path of a configuration file in place of cfg
+    case WireguardMethod::SETUP_TUNNEL_FROM_FILE:
+      RunOperationForTunnel(args, std::move(result), &WireguardDartPlugin::HandleSetupTunnel);
+      break;
+    // setupTunnel and updateTunnel with the handle of a compileConfig in place of cfg
+    case WireguardMethod::SETUP_TUNNEL_COMPILED:
+      RunOperationForTunnel(args, std::move(result), &WireguardDartPlugin::HandleSetupTunnel);
+      break;
+    // Right away on the platform thread, not behind the setup it cancels
+    case WireguardMethod::CANCEL_OPERATION:
+      HandleCancelOperation(args, std::move(result));
+      break;
+    case WireguardMethod::UPDATE_TUNNEL:
+    case WireguardMethod::UPDATE_TUNNEL_COMPILED:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleUpdateTunnel);
+      break;
+    case WireguardMethod::ADD_PEERS:
+    case WireguardMethod::REMOVE_PEERS:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleChangePeers);
+      break;
+    case WireguardMethod::COMPILE_CONFIG:
+      HandleCompileConfig(args, std::move(result));
+      break;
+    case WireguardMethod::RELEASE_CONFIG:
+      HandleReleaseConfig(args, std::move(result));
+      break;
+    case WireguardMethod::VALIDATE_CONFIG:
+      HandleValidateConfig(args, std::move(result));
+      break;
+    case WireguardMethod::RESOLVE_PEER_FOR_ADDRESSES:
+      HandleResolvePeerForAddresses(args, std::move(result));
+      break;
+    case WireguardMethod::WATCH_CONFIG_FILE:
+      HandleWatchConfigFile(args, std::move(result));
+      break;
+    case WireguardMethod::CONNECT:
+      RunForTunnelAsync(args, std::move(result), &WireguardDartPlugin::HandleConnectAsync);
+      break;
+    case WireguardMethod::DISCONNECT:
+      RunForTunnelAsync(args, std::move(result), &WireguardDartPlugin::HandleDisconnectAsync);
+      break;
+    // Queues each tunnel on its own worker
+    case WireguardMethod::CONNECT_TUNNELS:
+      HandleTransitionTunnels(args, std::move(result), true);
+      break;
+    case WireguardMethod::DISCONNECT_TUNNELS:
+      HandleTransitionTunnels(args, std::move(result), false);
+      break;
+    // Runs for seconds on the reactor, with the tunnel's other calls waiting behind it
+    case WireguardMethod::RUN_THROUGHPUT_TEST:
+      RunForTunnelAsync(args, std::move(result), &WireguardDartPlugin::HandleRunThroughputTestAsync);
+      break;
+    // Waits for the service control manager until the tunnel is up or down
+    case WireguardMethod::INSTALL_TUNNEL_SERVICE:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleInstallTunnelService);
+      break;
+    case WireguardMethod::REMOVE_TUNNEL_SERVICE:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleRemoveTunnelService);
+      break;
+    case WireguardMethod::SET_SPLIT_TUNNEL:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleSetSplitTunnel);
+      break;
+    case WireguardMethod::SET_ADAPTER_LOGGING:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleSetAdapterLogging);
+      break;
+    case WireguardMethod::GET_ADAPTER_LOG:
+      RunForTunnel(args, std::move(result), &WireguardDartPlugin::HandleGetAdapterLog);
+      break;
+    // Two tunnels at once, so on neither's worker; setting the metrics only takes a few IP Helper calls
+    case WireguardMethod::SET_FAILOVER_GROUP:
+      HandleSetFailoverGroup(args, std::move(result));
+      break;
+    case WireguardMethod::REMOVE_FAILOVER_GROUP:
+      HandleRemoveFailoverGroup(args, std::move(result));
+      break;
+    case WireguardMethod::TUNNEL_STATISTICS:
+      HandleTunnelStatistics(args, std::move(result));
+      break;
+    case WireguardMethod::PEER_STATISTICS:
+    case WireguardMethod::PEER_STATISTICS_BINARY:
+      HandlePeerStatistics(args, std::move(result), method.value() == WireguardMethod::PEER_STATISTICS_BINARY);
+      break;
+    case WireguardMethod::GET_STATISTICS_HISTORY:
+      HandleGetStatisticsHistory(args, std::move(result));
+      break;
+    case WireguardMethod::COUNTER_SNAPSHOT:
+      HandleCounterSnapshot(args, std::move(result));
+      break;
+    case WireguardMethod::GET_CUMULATIVE_STATISTICS:
+      HandleGetCumulativeStatistics(args, std::move(result));
+      break;
+    case WireguardMethod::START_STATS_RECORDING:
+      HandleStartStatsRecording(args, std::move(result));
+      break;
+    case WireguardMethod::STOP_STATS_RECORDING:
+      HandleStopStatsRecording(args, std::move(result));
+      break;
+    case WireguardMethod::GET_PERF_STATS:
+      HandleGetPerfStats(args, std::move(result));
+      break;
+    case WireguardMethod::GET_STARTUP_TRACE:
+      HandleGetStartupTrace(args, std::move(result));
+      break;
+    case WireguardMethod::BENCHMARK_CALL:
+      HandleBenchmarkCall(args, std::move(result));
+      break;
+    case WireguardMethod::START_TELEMETRY_EXPORT:
+      HandleStartTelemetryExport(args, std::move(result));
+      break;
+    case WireguardMethod::STOP_TELEMETRY_EXPORT:
+      HandleStopTelemetryExport(args, std::move(result));
+      break;
+    case WireguardMethod::GET_MEMORY_STATS:
+      HandleGetMemoryStats(args, std::move(result));
+      break;
+    case WireguardMethod::SET_LOW_MEMORY_MODE:
+      HandleSetLowMemoryMode(args, std::move(result));
+      break;
+    case WireguardMethod::GET_METRICS:
+      HandleGetMetrics(args, std::move(result));
+      break;
+    case WireguardMethod::STATUS:
+      HandleStatus(args, std::move(result));
+      break;
+    case WireguardMethod::STATUS_ALL:
+      HandleStatusAll(std::move(result));
+      break;
+    case WireguardMethod::SUBSCRIBE_STATUS:
+      HandleSubscribeStatus(engine, args, std::move(result));
+      break;
+    case WireguardMethod::UNSUBSCRIBE_STATUS:
+      HandleUnsubscribeStatus(engine, args, std::move(result));
+      break;
+    case WireguardMethod::BEGIN_TUNNEL_CONFIGURATION:
+      HandleBeginTunnelConfiguration(args, std::move(result));
+      break;
+    case WireguardMethod::APPEND_TUNNEL_CONFIGURATION:
+      HandleAppendTunnelConfiguration(args, std::move(result));
+      break;
+    case WireguardMethod::GET_RECENT_LOGS:
+      HandleGetRecentLogs(args, std::move(result));
+      break;
+    case WireguardMethod::SET_LOG_LEVEL:
+      HandleSetLogLevel(args, std::move(result));
+      break;
+  }
+}
+
+void WireguardDartPlugin::HandleGenerateKeyPair(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    bool binary) {
+  logger_->info("Generate key pair initiated");
+  // Bytes up to the answer, which only encodes them as base64 when Dart asked for text
+  std::vector<uint8_t> record(64);
+  bool from_pool = key_pool_ && key_pool_->Take(record.data(), record.data() + 32);
+  if (key_pool_) {
+    OperationCounters::Instance().CountLookup(CountedCache::kKeyPool, from_pool);
+  }
+  if (!from_pool && !GenerateKeyPair(record.data(), record.data() + 32)) {
+    logger_->error("Generate key pair failed: no random bytes from the system");
+    result->Error("KEY_GENERATION_FAILED", "Failed to generate random bytes");
+    return;
+  }
+
+  if (binary) {
+    result->Success(flutter::EncodableValue(std::move(record)));
+  } else {
+    std::map<flutter::EncodableValue, flutter::EncodableValue> return_value;
+    return_value[keys::kPublicKey] = flutter::EncodableValue(KeyToBase64(record.data()));
+    return_value[keys::kPrivateKey] = flutter::EncodableValue(KeyToBase64(record.data() + 32));
+    SecureZeroMemory(record.data(), record.size());
+    result->Success(flutter::EncodableValue(return_value));
+  }
+  logger_->info(from_pool ? "Generate key pair completed from the pool" : "Generate key pair completed successfully");
+}
+
+void WireguardDartPlugin::HandleGenerateKeyPairs(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    bool binary) {
+  const auto* count = args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kCount)) : nullptr;
+  if (!count || *count <= 0 || static_cast<size_t>(*count) > kMaxKeyPairBatch) {
+    logger_->error("Generate key pairs failed: count argument missing or out of range");
+    result->Error("Argument 'count' must be between 1 and " + std::to_string(kMaxKeyPairBatch));
+    return;
+  }
+
+  // One line for the whole batch, however many pairs it has
+  int64_t start_us = PerfCounterMicroseconds();
+  std::vector<uint8_t> records = GenerateKeyPairs(static_cast<size_t>(*count));
+  if (records.empty()) {
+    logger_->error("Generate key pairs failed: no random bytes from the system");
+    result->Error("KEY_GENERATION_FAILED", "Failed to generate random bytes");
+    return;
+  }
+  logger_->info("Generated {} key pairs in {} us", *count, PerfCounterMicroseconds() - start_us);
+
+  // Arrives in Dart as a Uint8List
+  if (binary) {
+    result->Success(flutter::EncodableValue(std::move(records)));
+    return;
+  }
+
+  flutter::EncodableList pairs;
+  pairs.reserve(static_cast<size_t>(*count));
+  for (size_t offset = 0; offset < records.size(); offset += 64) {
+    flutter::EncodableMap pair;
+    pair[keys::kPublicKey] = flutter::EncodableValue(KeyToBase64(records.data() + offset));
+    pair[keys::kPrivateKey] = flutter::EncodableValue(KeyToBase64(records.data() + offset + 32));
+    pairs.push_back(flutter::EncodableValue(std::move(pair)));
+  }
+  result->Success(flutter::EncodableValue(std::move(pairs)));
+}
+
+void WireguardDartPlugin::HandleGeneratePresharedKeys(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    bool binary) {
+  const auto* count = args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kCount)) : nullptr;
+  if (!count || *count <= 0 || static_cast<size_t>(*count) > kMaxPresharedKeyBatch) {
+    logger_->error("Generate preshared keys failed: count argument missing or out of range");
+    result->Error("Argument 'count' must be between 1 and " + std::to_string(kMaxPresharedKeyBatch));
+    return;
+  }
+
+  std::vector<uint8_t> keys = GeneratePresharedKeys(static_cast<size_t>(*count));
+  if (keys.empty()) {
+    logger_->error("Generate preshared keys failed: no random bytes from the system");
+    result->Error("KEY_GENERATION_FAILED", "Failed to generate random bytes");
+    return;
+  }
+  logger_->info("Generated {} preshared keys", *count);
+
+  if (binary) {
+    result->Success(flutter::EncodableValue(std::move(keys)));
+    return;
+  }
+
+  flutter::EncodableList list;
+  list.reserve(static_cast<size_t>(*count));
+  for (size_t offset = 0; offset < keys.size(); offset += 32) {
+    list.push_back(flutter::EncodableValue(KeyToBase64(keys.data() + offset)));
+  }
+  SecureZeroMemory(keys.data(), keys.size());
+  result->Success(flutter::EncodableValue(std::move(list)));
+}
+
+void WireguardDartPlugin::HandleDerivePublicKey(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* private_key_value = args ? ValueOrNull(*args, keys::kPrivateKey) : nullptr;
+  const auto* private_key_bytes = private_key_value ? std::get_if<std::vector<uint8_t>>(private_key_value) : nullptr;
+  if (private_key_bytes) {
+    if (private_key_bytes->size() != kX25519KeySize) {
+      logger_->error("Derive public key failed: not a 32 byte key");
+      result->Error("INVALID_KEY", "Argument 'privateKey' must be 32 bytes");
+      return;
+    }
+    std::vector<uint8_t> public_key(kX25519KeySize);
+    X25519PublicKey(public_key.data(), private_key_bytes->data());
+    result->Success(flutter::EncodableValue(std::move(public_key)));
+    return;
+  }
+
+  const auto* private_key = private_key_value ? std::get_if<std::string>(private_key_value) : nullptr;
+  if (!private_key) {
+    logger_->error("Derive public key failed: privateKey argument missing");
+    result->Error("Argument 'privateKey' is required");
+    return;
+  }
+
+  std::string public_key = DerivePublicKey(*private_key);
+  if (public_key.empty()) {
+    logger_->error("Derive public key failed: not a base64 32 byte key");
+    result->Error("INVALID_KEY", "Argument 'privateKey' must be a base64 32 byte key");
+    return;
+  }
+  result->Success(flutter::EncodableValue(std::move(public_key)));
+}
+
+void WireguardDartPlugin::HandleDerivePublicKeys(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* private_keys = args ? std::get_if<flutter::EncodableList>(ValueOrNull(*args, keys::kPrivateKeys)) : nullptr;
+  if (!private_keys || private_keys->size() > kMaxKeyPairBatch) {
+    logger_->error("Derive public keys failed: privateKeys argument missing or too long");
+    result->Error("Argument 'privateKeys' must be a list of at most " + std::to_string(kMaxKeyPairBatch) + " keys");
+    return;
+  }
+
+  std::vector<std::string_view> keys;
+  keys.reserve(private_keys->size());
+  for (const auto& value : *private_keys) {
+    const auto* key = std::get_if<std::string>(&value);
+    keys.push_back(key ? std::string_view(*key) : std::string_view());
+  }
+
+  int64_t start_us = PerfCounterMicroseconds();
+  std::vector<std::string> public_keys = DerivePublicKeys(keys);
+  flutter::EncodableList list;
+  list.reserve(public_keys.size());
+  for (size_t i = 0; i < public_keys.size(); i++) {
+    if (public_keys[i].empty()) {
+      logger_->error("Derive public keys failed: key {} is not a base64 32 byte key", i);
+      result->Error("INVALID_KEY", "Private key " + std::to_string(i) + " must be a base64 32 byte key");
+      return;
+    }
+    list.push_back(flutter::EncodableValue(std::move(public_keys[i])));
+  }
+  logger_->info("Derived {} public keys in {} us", list.size(), PerfCounterMicroseconds() - start_us);
+  result->Success(flutter::EncodableValue(std::move(list)));
+}
+
+void WireguardDartPlugin::HandleCheckTunnelConfiguration(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  logger_->info("Check tunnel configuration initiated");
+
+  // Check if we have any valid adapters created
+  auto lock = adapters_.LockShared();
+  WireguardAdapter* newest = adapters_.NewestLocked();
+  bool has_adapter = newest && newest->IsValid();
+  bool is_configured = has_adapter;
+  lock.unlock();
+
+  result->Success(flutter::EncodableValue(is_configured));
+  logger_->info("Check tunnel configuration completed - configured: {}, adapter: {}", is_configured, has_adapter);
+}
+
+void WireguardDartPlugin::HandleVerifyTunnelConfiguration(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!arg_tunnel_name) {
+    logger_->error("Verify tunnel configuration failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (!target_adapter) {
+    logger_->error("Verify tunnel configuration failed: adapter not found: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    return;
+  }
+
+  ConfigurationDrift drift;
+  if (!target_adapter->VerifyConfiguration(&drift)) {
+    logger_->error("Verify tunnel configuration failed: no applied configuration or driver read: {}",
+                   *arg_tunnel_name);
+    result->Error("VERIFY_FAILED", "No configuration was applied to the adapter, or the driver could not be read");
+    return;
+  }
+
+  auto key_list = [](const std::vector<PeerPublicKey>& public_keys) {
+    flutter::EncodableList list;
+    list.reserve(public_keys.size());
+    for (const auto& public_key : public_keys) {
+      list.emplace_back(KeyToBase64(public_key.data()));
+    }
+    return flutter::EncodableValue(std::move(list));
+  };
+  flutter::EncodableMap return_value;
+  return_value[keys::kInSync] = flutter::EncodableValue(drift.InSync());
+  return_value[keys::kHash] = flutter::EncodableValue(static_cast<int64_t>(drift.actual_hash));
+  return_value[keys::kExpectedHash] = flutter::EncodableValue(static_cast<int64_t>(drift.expected_hash));
+  return_value[keys::kInterfaceChanged] = flutter::EncodableValue(drift.interface_changed);
+  return_value[keys::kMissingPeers] = key_list(drift.missing_peers);
+  return_value[keys::kUnexpectedPeers] = key_list(drift.unexpected_peers);
+  return_value[keys::kChangedPeers] = key_list(drift.changed_peers);
+  result->Success(flutter::EncodableValue(std::move(return_value)));
+
+  if (drift.InSync()) {
+    logger_->info("Verify tunnel configuration completed - in sync: {}", *arg_tunnel_name);
+  } else {
+    logger_->warn("Verify tunnel configuration completed - {} drifted: {} missing, {} unexpected, {} changed peers{}",
+                  *arg_tunnel_name, drift.missing_peers.size(), drift.unexpected_peers.size(),
+                  drift.changed_peers.size(), drift.interface_changed ? ", interface changed" : "");
+  }
+}
+
+void WireguardDartPlugin::HandleExportTunnelConfiguration(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!arg_tunnel_name) {
+    logger_->error("Export tunnel configuration failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+  const auto* format = std::get_if<std::string>(ValueOrNull(*args, keys::kFormat));
+  if (format && *format != "ini" && *format != "structured") {
+    result->Error("Argument 'format' must be 'ini' or 'structured'");
+    return;
+  }
+  bool structured = format && *format == "structured";
+  // Keys stay out of an export unless asked for, as it is usually meant for someone else
+  const auto* redact_keys = std::get_if<bool>(ValueOrNull(*args, keys::kRedactKeys));
+  bool redact = !redact_keys || *redact_keys;
+
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (!target_adapter) {
+    logger_->error("Export tunnel configuration failed: adapter not found: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    return;
+  }
+
+  flutter::EncodableValue exported;
+  bool read = target_adapter->ReadDriverConfiguration([&exported, structured, redact](const BYTE* data, DWORD bytes) {
+    if (structured) {
+      exported = flutter::EncodableValue(ExportStructuredConfig(data, bytes, redact));
+    } else {
+      std::string text;
+      ExportConfigurationText(data, bytes, redact, &text);
+      exported = flutter::EncodableValue(std::move(text));
+    }
+  });
+  if (!read) {
+    logger_->error("Export tunnel configuration failed: the driver could not be read: {}", *arg_tunnel_name);
+    result->Error("EXPORT_FAILED", "The driver configuration could not be read");
+    return;
+  }
+  result->Success(exported);
+}
+
+void WireguardDartPlugin::HandleRemoveTunnelConfiguration(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  logger_->info("Remove tunnel configuration initiated");
+
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!arg_tunnel_name) {
+    logger_->error("Remove tunnel configuration failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+  // Its service keeps the adapter and brings it back with Windows
+  if (tunnel_service::IsInstalled(*arg_tunnel_name)) {
+    logger_->error("Remove tunnel configuration failed: {} runs as a tunnel service", *arg_tunnel_name);
+    result->Error("TUNNEL_SERVICE_INSTALLED", "The tunnel runs as a service. Call 'removeTunnelService' instead.");
+    return;
+  }
+  const auto* arg_bundle_id = std::get_if<std::string>(ValueOrNull(*args, keys::kBundleId));
+  if (arg_bundle_id && arg_bundle_id->empty()) {
+    logger_->error("Remove tunnel configuration failed: bundleId is empty");
+    result->Error("INVALID_ARGUMENT", "Argument 'bundleId' must not be empty");
+    return;
+  }
+  std::string bundle_id = arg_bundle_id ? *arg_bundle_id : BundleId();
+  std::wstring adapter_name = Utf8ToWide(*arg_tunnel_name);
+  config_file_watcher_.Unwatch(*arg_tunnel_name);
+
+  // An adapter of an earlier run of the app is opened to find its device
+  std::unique_ptr<WireguardAdapter> opened;
+  WireguardAdapter* adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (!adapter) {
+    std::shared_ptr<WireguardLibrary> library = Library();
+    if (library && library->GetRunningDriverVersion()() != 0) {
+      opened = WireguardAdapter::Open(library, adapter_name);
+      adapter = opened.get();
+    }
+  }
+
+  // The device of the stable GUID, and of whatever other GUID the adapter has, present or left behind
+  std::vector<GUID> devices;
+  if (!bundle_id.empty()) {
+    devices.push_back(WireguardAdapter::StableGuid(bundle_id, adapter_name));
+  }
+  NET_LUID luid;
+  GUID guid;
+  if (adapter && adapter->GetLUID(&luid) && ConvertInterfaceLuidToGuid(&luid, &guid) == NO_ERROR &&
+      (devices.empty() || !IsEqualGUID(guid, devices.front()))) {
+    devices.push_back(guid);
+  }
+  if (adapter) {
+    adapter->SetState(WIREGUARD_ADAPTER_STATE_DOWN);
+    // The rows the ledger does not know go with the device, there is no need to scan the tables for them
+    if (!adapter->CleanupNetworking(nullptr, true)) {
+      logger_->warn("Failed to clean up the networking of adapter {}", *arg_tunnel_name);
+    }
+  }
+  // Closing an adapter this process created deletes its device already
+  opened.reset();
+  RemoveAdapterByName(*arg_tunnel_name);
+
+  if (state_journal_) {
+    state_journal_->Forget(adapter_name);
+  }
+  if (config_cache_ && !config_cache_->Remove(adapter_name)) {
+    logger_->warn("Failed to delete the cached configuration of tunnel {}: Windows error {}", *arg_tunnel_name,
+                  GetLastError());
+  }
+
+  for (const GUID& device : devices) {
+    DWORD error_code = adapter_devices::Remove(device);
+    if (error_code != ERROR_SUCCESS) {
+      std::string error_message = "Failed to delete the adapter device. Windows Error Code: " +
+                                  std::to_string(error_code) + ". Description: " + GetLastErrorAsString(error_code);
+      logger_->error("Remove tunnel configuration failed: {}", error_message);
+      result->Error("DEVICE_REMOVAL_FAILED", error_message);
+      return;
+    }
+  }
+
+  result->Success();
+  logger_->info("Remove tunnel configuration completed successfully for tunnel: {}", *arg_tunnel_name);
+}
+
+void WireguardDartPlugin::SweepOrphanedAdapters() {
+  int64_t start_us = PerfCounterMicroseconds();
+  size_t failed = 0;
+  size_t removed = adapter_devices::RemoveOrphaned(kTunnelType, &failed);
+  if (failed > 0) {
+    logger_->warn("Removed {} orphaned adapter devices, {} could not be removed", removed, failed);
+  } else {
+    logger_->info("Removed {} orphaned adapter devices in {} us", removed, PerfCounterMicroseconds() - start_us);
+  }
+}
+
+void WireguardDartPlugin::SweepOrphanedPolicies() {
+  size_t failed = 0;
+  size_t removed = WireguardNetworkConfig::RemoveOrphanedNrptRules(&failed);
+  if (failed > 0) {
+    logger_->warn("Removed {} orphaned NRPT rules, {} could not be removed", removed, failed);
+  } else if (removed > 0) {
+    logger_->info("Removed {} orphaned NRPT rules", removed);
+  }
+  removed = WireguardNetworkConfig::RemoveOrphanedQosPolicies(&failed);
+  if (failed > 0) {
+    logger_->warn("Removed {} orphaned QoS policies, {} could not be removed", removed, failed);
+  } else if (removed > 0) {
+    logger_->info("Removed {} orphaned QoS policies", removed);
+  }
+}
+
+void WireguardDartPlugin::HandleNativeInit(const flutter::EncodableMap* args,
+                                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  // Set up file logger if a log file path was provided by the host app
+  if (args) {
+    const auto* log_file_path = std::get_if<std::string>(ValueOrNull(*args, keys::kLogFilePath));
+    if (log_file_path && !log_file_path->empty()) {
+      const auto* queue_size = std::get_if<int32_t>(ValueOrNull(*args, keys::kLogQueueSize));
+      const auto* policy_name = std::get_if<std::string>(ValueOrNull(*args, keys::kLogOverflowPolicy));
+      auto policy = spdlog::async_overflow_policy::overrun_oldest;
+      bool known_policy = !policy_name || ParseLogOverflowPolicy(*policy_name, &policy);
+      // Dart sends an int that does not fit 32 bits as a 64-bit one
+      const auto* max_bytes_value = ValueOrNull(*args, keys::kMaxLogBytes);
+      uint64_t max_bytes = 0;
+      if (const auto* max_bytes32 = max_bytes_value ? std::get_if<int32_t>(max_bytes_value) : nullptr) {
+        max_bytes = *max_bytes32 > 0 ? static_cast<uint64_t>(*max_bytes32) : 0;
+      } else if (const auto* max_bytes64 = max_bytes_value ? std::get_if<int64_t>(max_bytes_value) : nullptr) {
+        max_bytes = *max_bytes64 > 0 ? static_cast<uint64_t>(*max_bytes64) : 0;
+      }
+      const auto* max_files = std::get_if<int32_t>(ValueOrNull(*args, keys::kMaxLogFiles));
+      const auto* daily = std::get_if<bool>(ValueOrNull(*args, keys::kDailyLogFiles));
+      const auto* pattern = std::get_if<std::string>(ValueOrNull(*args, keys::kLogPattern));
+      if (pattern) {
+        log_pattern_ = *pattern;
+      }
+      try {
+        auto sink = CreateLogFileSink(*log_file_path, max_bytes,
+                                      max_files && *max_files > 0 ? static_cast<size_t>(*max_files) : kDefaultLogFiles,
+                                      daily && *daily);
+        // Written by one thread of its own, so a slow disk never holds up a tunnel call; a logger of an earlier
+        // nativeInit that another thread is still logging to keeps the pool, and so keeps working
+        if (!log_thread_pool_) {
+          log_thread_pool_ = std::make_shared<spdlog::details::thread_pool>(
+              queue_size && *queue_size > 0 ? static_cast<size_t>(*queue_size) : kDefaultLogQueueSize, 1,
+              []() { CpuAccounting::Instance().RegisterCurrentThread(CpuComponent::kLogWriter); },
+              []() { CpuAccounting::Instance().UnregisterCurrentThread(); });
+        }
+        spdlog::sinks_init_list sinks = {sink, log_ring_, log_stream_->Sink(), telemetry_->Sink()};
+        auto file_logger = std::make_shared<spdlog::async_logger>("wireguard_dart", sinks, log_thread_pool_, policy);
+        file_logger->set_level(log_level_);
+        file_logger->set_formatter(MakeLogFormatter(LogPatternFor(log_level_, log_pattern_)));
+        file_logger->flush_on(spdlog::level::err);
+        // Drop any existing logger with the same name before registering
+        spdlog::drop("wireguard_dart");
+        spdlog::register_logger(file_logger);
+        log_flusher_.Start(kLogFlushInterval, kLogFlushTolerance,
+                           []() { spdlog::apply_all([](std::shared_ptr<spdlog::logger> logger) { logger->flush(); }); });
+        PluginLogger::Install(file_logger);
+      } catch (const std::exception& e) {
+        logger_->warn("Failed to create file logger at '{}': {}", *log_file_path, e.what());
+      }
+      if (!known_policy) {
+        logger_->warn("Unknown log overflow policy '{}', overrunning the oldest lines", *policy_name);
+      }
+
+      // Parsed configurations are cached next to the log file when the host app asks for it
+      const auto* cache_configurations = std::get_if<bool>(ValueOrNull(*args, keys::kCacheConfigurations));
+      if (cache_configurations && *cache_configurations) {
+        std::wstring log_path = Utf8ToWide(*log_file_path);
+        auto separator = log_path.find_last_of(L"\\/");
+        config_cache_ = std::make_unique<WireguardConfigCache>(
+            separator == std::wstring::npos ? std::wstring(L".") : log_path.substr(0, separator));
+      }
+
+      // So is the journal of what was set up on each adapter, for the next start after a crash
+      const auto* journal_state = std::get_if<bool>(ValueOrNull(*args, keys::kJournalState));
+      if (journal_state && *journal_state && !state_journal_) {
+        std::wstring log_path = Utf8ToWide(*log_file_path);
+        auto separator = log_path.find_last_of(L"\\/");
+        std::wstring directory = separator == std::wstring::npos ? std::wstring(L".") : log_path.substr(0, separator);
+        auto journal = std::make_unique<StateJournal>();
+        if (journal->Open(directory + L"\\wireguard_dart.journal")) {
+          state_journal_ = std::move(journal);
+        } else {
+          logger_->warn("Failed to open the state journal in '{}': Windows error {}", WideToUtf8(directory),
+                        GetLastError());
+        }
+      }
+
+      // And the running totals of every tunnel and peer, which outlast the adapters' own counters
+      const auto* cumulative_counters = std::get_if<bool>(ValueOrNull(*args, keys::kCumulativeCounters));
+      if (cumulative_counters && *cumulative_counters && !cumulative_counters_.IsOpen()) {
+        std::wstring log_path = Utf8ToWide(*log_file_path);
+        auto separator = log_path.find_last_of(L"\\/");
+        std::wstring directory = separator == std::wstring::npos ? std::wstring(L".") : log_path.substr(0, separator);
+        if (cumulative_counters_.Open(directory + L"\\wireguard_dart.counters")) {
+          statistics_sampler_->SetCumulativeCounters(&cumulative_counters_);
+        } else {
+          logger_->warn("Failed to open the cumulative counters in '{}': Windows error {}", WideToUtf8(directory),
+                        GetLastError());
+        }
+      }
+
+      // The flight recorder always dumps there
+      std::wstring log_path = Utf8ToWide(*log_file_path);
+      auto separator = log_path.find_last_of(L"\\/");
+      FlightRecorder::Instance().SetDumpDirectory(
+          separator == std::wstring::npos ? std::wstring(L".") : log_path.substr(0, separator));
+    }
+  }
+
+  logger_->info("========== Session start ==========");
+  logger_->info("Native init initiated");
+
+  // The WireGuard library is loaded by the first call that needs the driver, see Library
+  const auto* bundle_id = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kBundleId)) : nullptr;
+  if (bundle_id && bundle_id->empty()) {
+    logger_->error("Native init failed: bundleId is empty");
+    result->Error("INVALID_ARGUMENT", "Argument 'bundleId' must not be empty");
+    return;
+  }
+  if (bundle_id) {
+    std::lock_guard<std::mutex> lock(bundle_id_mutex_);
+    bundle_id_ = *bundle_id;
+  }
+
+  // Dart sends an int that does not fit 32 bits as a 64-bit one
+  std::optional<int64_t> hang_deadline_ms =
+      args ? IntegerArgument(ValueOrNull(*args, keys::kHangDeadlineMs)) : std::nullopt;
+  if (hang_deadline_ms && (*hang_deadline_ms < 0 || *hang_deadline_ms > HangWatchdog::kMaxDeadline.count())) {
+    logger_->error("Native init failed: hangDeadlineMs {} is out of range", *hang_deadline_ms);
+    result->Error("INVALID_ARGUMENT", "Argument 'hangDeadlineMs' must be between 0 and " +
+                                          std::to_string(HangWatchdog::kMaxDeadline.count()));
+    return;
+  }
+
+  const auto* statistics_history = args ? std::get_if<bool>(ValueOrNull(*args, keys::kStatisticsHistory)) : nullptr;
+  if (statistics_history) {
+    statistics_sampler_->SetHistoryEnabled(*statistics_history);
+  }
+
+  const auto* stale_seconds = args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kHandshakeStaleSeconds)) : nullptr;
+  if (stale_seconds) {
+    statistics_sampler_->SetStaleThreshold(std::chrono::seconds(*stale_seconds));
+  }
+
+  // On unless turned off, as a server endpoint that roamed is otherwise routed into the tunnel
+  const auto* roaming_seconds =
+      args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kEndpointRoamingSeconds)) : nullptr;
+  statistics_sampler_->SetRoamingInterval(roaming_seconds ? std::chrono::seconds(*roaming_seconds)
+                                                          : StatisticsSampler::kDefaultRoamingInterval);
+
+  // Every driver and IP Helper call is watched for hangs unless turned off with zero; its reports go next to the
+  // flight recorder's dumps
+  const auto* hang_minidump = args ? std::get_if<bool>(ValueOrNull(*args, keys::kHangMinidump)) : nullptr;
+  HangWatchdog::Instance().Start(
+      hang_deadline_ms ? std::chrono::milliseconds(*hang_deadline_ms) : HangWatchdog::kDefaultDeadline,
+      hang_minidump && *hang_minidump);
+
+  // Filled in the background from now on; a new size starts a new pool, zero removes it
+  const auto* key_pool_size = args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kKeyPoolSize)) : nullptr;
+  if (key_pool_size) {
+    if (*key_pool_size <= 0) {
+      key_pool_.reset();
+    } else if (!key_pool_ || key_pool_->Capacity() != static_cast<size_t>(*key_pool_size)) {
+      key_pool_.reset();
+      key_pool_ = std::make_unique<KeyPool>(static_cast<size_t>(*key_pool_size));
+      logger_->info("Key pool of {} pairs started", key_pool_->Capacity());
+    }
+  }
+
+  const auto* coalesce_ms = args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kStatusCoalesceMs)) : nullptr;
+  if (coalesce_ms) {
+    status_coalesce_ = std::chrono::milliseconds(*coalesce_ms);
+    ApplyStatusCoalesce();
+  }
+
+  // Devices of adapters that are gone, of earlier versions or crashes; present ones are left to the driver
+  const auto* remove_orphans = args ? std::get_if<bool>(ValueOrNull(*args, keys::kRemoveOrphanAdapters)) : nullptr;
+  if (remove_orphans && *remove_orphans) {
+    if (tunnel_tasks_) {
+      tunnel_tasks_->Post(kAdapterSweepTask, [this]() { SweepOrphanedAdapters(); });
+    } else {
+      SweepOrphanedAdapters();
+    }
+  }
+
+  // NRPT rules and QoS policies of adapters that did not outlive a crash of the app, whose journal entries have
+  // nothing to clean up
+  if (tunnel_tasks_) {
+    tunnel_tasks_->Post(kAdapterSweepTask, [this]() { SweepOrphanedPolicies(); });
+  } else {
+    SweepOrphanedPolicies();
+  }
+
+  // Adapters that outlived a crash of the app are taken back first, so that prewarming finds them
+  if (state_journal_) {
+    for (const StateJournal::Entry& entry : state_journal_->Entries()) {
+      if (tunnel_tasks_) {
+        tunnel_tasks_->Post(WideToUtf8(entry.name), [this, entry]() { RecoverFromJournal(entry); });
+      } else {
+        RecoverFromJournal(entry);
+      }
+    }
+  }
+
+  // Queued like setupTunnel, so a setup for one of these tunnels waits for its adapter instead of racing it
+  const auto* prewarm_tunnel_names =
+      args ? std::get_if<flutter::EncodableList>(ValueOrNull(*args, keys::kPrewarmTunnelNames)) : nullptr;
+  if (prewarm_tunnel_names) {
+    for (const auto& value : *prewarm_tunnel_names) {
+      const auto* tunnel_name = std::get_if<std::string>(&value);
+      if (!tunnel_name || tunnel_name->empty()) {
+        continue;
+      }
+      if (tunnel_tasks_) {
+        tunnel_tasks_->Post(*tunnel_name, [this, name = *tunnel_name]() { PrewarmAdapter(name); });
+      } else {
+        PrewarmAdapter(*tunnel_name);
+      }
+    }
+  }
+
+  // Tunnels installed with installTunnelService came up with Windows; the app only reads them
+  for (const std::string& tunnel_name : tunnel_service::InstalledTunnels()) {
+    if (!tunnel_service::IsRunning(tunnel_name)) {
+      continue;
+    }
+    if (tunnel_tasks_) {
+      tunnel_tasks_->Post(tunnel_name, [this, tunnel_name]() { AttachServiceTunnel(tunnel_name); });
+    } else {
+      AttachServiceTunnel(tunnel_name);
+    }
+  }
+
+  result->Success();
+  logger_->info("Native init completed successfully");
+}
+
+void WireguardDartPlugin::HandleSetupTunnel(const flutter::EncodableMap* args,
+                                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  SetupTunnel(args, std::move(result), false);
+}
+
+void WireguardDartPlugin::HandleSetupAndConnect(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  SetupTunnel(args, std::move(result), true);
+}
+
+void WireguardDartPlugin::SetupTunnel(const flutter::EncodableMap* args,
+                                      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                                      bool connect) {
+  TraceRegion trace_region(connect ? "SetupAndConnect" : "SetupTunnel");
+  logger_->info(connect ? "Setup and connect initiated" : "Setup tunnel initiated");
+
+  // Each phase is answered with the result and goes into the stats for getPerfStats
+  PhaseTimer timer(perf_stats_.get());
+
+  static const flutter::EncodableValue* const kSetupKeys[] = {&keys::kTunnelName, &keys::kCfg, &keys::kKillSwitch,
+                                                              &keys::kBundleId, &keys::kConfig, &keys::kPath,
+                                                              &keys::kConfigHandle, &keys::kOperationId};
+  const flutter::EncodableValue* setup_values[std::size(kSetupKeys)];
+  FindValues(*args, kSetupKeys, setup_values);
+
+  // Checked between the phases once it is cancelled or timed out, see RunOperationForTunnel
+  if (std::optional<int64_t> operation_id = IntegerArgument(setup_values[7])) {
+    timer.SetOperation(operations_.Find(*operation_id));
+  }
+
+  const auto* arg_tunnel_name = std::get_if<std::string>(setup_values[0]);
+  if (arg_tunnel_name == NULL) {
+    logger_->error("Setup tunnel failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+  const auto* arg_bundle_id = std::get_if<std::string>(setup_values[3]);
+  if (arg_bundle_id && arg_bundle_id->empty()) {
+    logger_->error("Setup tunnel failed: bundleId is empty");
+    result->Error("INVALID_ARGUMENT", "Argument 'bundleId' must not be empty");
+    return;
+  }
+
+  std::wstring adapter_name = Utf8ToWide(*arg_tunnel_name);
+
+  // Probes the network while the adapter is set up, see ConnectPrecheck
+  std::optional<ConnectPrecheck> precheck;
+  const auto* arg_precheck = connect ? std::get_if<bool>(ValueOrNull(*args, keys::kPrecheck)) : nullptr;
+  if (arg_precheck && *arg_precheck) {
+    precheck.emplace();
+  }
+  std::optional<WireguardAdapter::ActivationOptions> activation;
+  std::string activation_error;
+  if (connect && !ParseActivation(*args, &activation, &activation_error)) {
+    logger_->error("Setup and connect failed: {}", activation_error);
+    result->Error("INVALID_ARGUMENT", activation_error);
+    return;
+  }
+
+  // Without cfg, use the configuration given as values, in a file or compiled before, or else the one streamed in
+  // with appendTunnelConfiguration
+  const auto* cfg = std::get_if<std::string>(setup_values[1]);
+  const auto* structured_config = std::get_if<flutter::EncodableMap>(setup_values[4]);
+  const auto* config_path = std::get_if<std::string>(setup_values[5]);
+  std::optional<int64_t> config_handle = IntegerArgument(setup_values[6]);
+  std::optional<WireguardConfigParser> parsed_config;
+  if (cfg == NULL && structured_config) {
+    if (!TakeStructuredConfiguration(*structured_config, "Setup tunnel", parsed_config, *result)) {
+      return;
+    }
+    timer.Lap("parse");
+  } else if (cfg == NULL && config_path) {
+    if (!TakeFileConfiguration(*config_path, "Setup tunnel", parsed_config, *result)) {
+      return;
+    }
+    timer.Lap("parse");
+  } else if (cfg == NULL && config_handle) {
+    if (!TakeCompiledConfiguration(*config_handle, "Setup tunnel", parsed_config, *result) ||
+        !ApplyConfigOverrides(*args, "Setup tunnel", *parsed_config, *result)) {
+      return;
+    }
+    timer.Lap("parse");
+  } else if (cfg == NULL && !TakeStreamedConfiguration(*arg_tunnel_name, "Setup tunnel", parsed_config, *result)) {
+    return;
+  }
+  if (AnswerIfAbandoned(timer, *arg_tunnel_name, *result)) {
+    return;
+  }
+
+  const auto* arg_kill_switch = std::get_if<bool>(setup_values[2]);
+  bool kill_switch = arg_kill_switch && *arg_kill_switch;
+
+  // Check if WireGuard library is available, loading it if this is the first tunnel
+  std::shared_ptr<WireguardLibrary> library = Library();
+  if (!library || !library->IsLoaded()) {
+    logger_->error("Setup tunnel failed: WireGuard library not available");
+    result->Error("WIREGUARD_LIBRARY_NOT_AVAILABLE", "WireGuard library is not loaded");
+    return;
+  }
+  // Installing the driver is most of a cold start, so setup reports whether it had to
+  DWORD driver_version = library->GetRunningDriverVersion()();
+  bool driver_installed = false;
+  int64_t driver_install_us = 0;
+
+  // Check if adapter already exists
+  WireguardAdapter* target_adapter = nullptr;
+  WireguardAdapter* existing_adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (existing_adapter ? existing_adapter->IsServiceOwned() : tunnel_service::IsInstalled(*arg_tunnel_name)) {
+    logger_->error("Setup tunnel failed: {} runs as a service", *arg_tunnel_name);
+    result->Error("TUNNEL_SERVICE_INSTALLED",
+                  "The tunnel runs as a service. Call 'installTunnelService' to change its configuration.");
+    return;
+  }
+  if (existing_adapter) {
+    // Ensure the observer is started with the existing adapter
+    if (existing_adapter->IsValid()) {
       NET_LUID luid;
       if (existing_adapter->GetLUID(&luid)) {
-        this->network_adapter_observer_->StartObserving(luid);
-        logger_->info("Setup tunnel completed - adapter already exists: {}", *arg_tunnel_name);
-        std::map<flutter::EncodableValue, flutter::EncodableValue> return_value;
-        return_value[flutter::EncodableValue("luid")] = flutter::EncodableValue(static_cast<int64_t>(luid.Value));
-        result->Success(flutter::EncodableValue(return_value));
+        // Turning the kill switch on or off counts as a change, even with the same configuration
+        existing_adapter->SetKillSwitchEnabled(kill_switch);
+        if (cfg ? existing_adapter->IsConfigurationApplied(*cfg)
+                : existing_adapter->IsConfigurationApplied(*parsed_config)) {
+          // Same configuration as last time, leave the driver and the IP helper tables alone
+          WatchAdapter(*arg_tunnel_name, existing_adapter, luid);
+          timer.Lap("adapter");
+          if (connect && !BringUp(existing_adapter, "Setup and connect", *result, &timer,
+                                  precheck ? &*precheck : nullptr, activation ? &*activation : nullptr)) {
+            return;
+          }
+          logger_->info("Setup tunnel completed - adapter already configured: {}", *arg_tunnel_name);
+          std::map<flutter::EncodableValue, flutter::EncodableValue> return_value;
+          return_value[keys::kLuid] = flutter::EncodableValue(static_cast<int64_t>(luid.Value));
+          return_value[keys::kTimings] = TimingsValue(timer);
+          return_value[keys::kDriver] = DriverValue(driver_version, false, 0);
+          result->Success(flutter::EncodableValue(return_value));
+          return;
+        }
+
+        // Configuration changed, apply it to the adapter we already have
+        logger_->info("Reconfiguring existing adapter: {}", *arg_tunnel_name);
+        target_adapter = existing_adapter;
+      }
+    }
+
+    if (!target_adapter) {
+      // Adapter was found but is not valid, remove it and it will be created again
+      logger_->info("Removing invalid adapter: {}", *arg_tunnel_name);
+      RemoveAdapterByName(*arg_tunnel_name);
+    }
+  }
+
+  std::unique_ptr<WireguardAdapter> adapter;
+  if (!target_adapter) {
+    // Try to open existing adapter first. Without a running driver there is none to open, and the driver is
+    // only installed by creating one.
+    if (driver_version != 0) {
+      adapter = WireguardAdapter::Open(library, adapter_name);
+    }
+    if (!adapter) {
+      // If opening fails, create a new adapter
+      logger_->info("Creating new WireGuard adapter: {}", *arg_tunnel_name);
+      int64_t create_start_us = PerfCounterMicroseconds();
+      adapter = CreateAdapter(adapter_name, arg_bundle_id ? *arg_bundle_id : BundleId());
+      if (adapter && driver_version == 0) {
+        driver_version = library->GetRunningDriverVersion()();
+        driver_installed = true;
+        driver_install_us = PerfCounterMicroseconds() - create_start_us;
+        perf_stats_->Record("driverInstall", driver_install_us);
+        logger_->info("WireGuard driver {} installed in {} us", DriverVersionString(driver_version),
+                      driver_install_us);
+      }
+
+      if (!adapter) {
+        DWORD error_code = GetLastError();
+        std::string error_message = "Failed to create WireGuard adapter: " + *arg_tunnel_name;
+        if (error_code != 0) {
+          error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+          error_message += " Description: " + GetLastErrorAsString(error_code);
+        }
+        logger_->error("Setup tunnel failed: {}", error_message);
+        result->Error("ADAPTER_CREATION_FAILED", error_message);
+        return;
+      }
+      logger_->info("WireGuard adapter created successfully: {}", *arg_tunnel_name);
+    } else {
+      logger_->info("Opened existing WireGuard adapter: {}", *arg_tunnel_name);
+    }
+    adapter->SetWorkerPost(TunnelWorkerPost(*arg_tunnel_name));
+    target_adapter = adapter.get();
+  }
+  timer.Lap("adapter");
+  // A new adapter goes away with it
+  if (AnswerIfAbandoned(timer, *arg_tunnel_name, *result)) {
+    return;
+  }
+
+  // A configuration cached on an earlier run is applied without parsing its text
+  bool from_cache = false;
+  if (cfg && config_cache_) {
+    WireguardConfigParser cached_config;
+    if (config_cache_->Load(adapter_name, WireguardConfigParser::HashText(*cfg), cfg->size(), cached_config)) {
+      logger_->info("Using cached configuration for tunnel: {}", *arg_tunnel_name);
+      parsed_config = std::move(cached_config);
+      from_cache = true;
+      timer.Lap("cache");
+    }
+    OperationCounters::Instance().CountLookup(CountedCache::kConfiguration, from_cache);
+  }
+
+  target_adapter->SetKillSwitchEnabled(kill_switch);
+
+  // Apply configuration to the adapter
+  try {
+    bool applied = parsed_config ? target_adapter->ApplyConfiguration(std::move(*parsed_config), &timer)
+                                 : target_adapter->ApplyConfiguration(*cfg, &timer);
+    if (!applied) {
+      DWORD error_code = GetLastError();
+      std::string error_message = "Failed to apply configuration to adapter";
+      if (error_code != 0) {
+        error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+        error_message += " Description: " + GetLastErrorAsString(error_code);
+      }
+      logger_->error("Setup tunnel failed: {}", error_message);
+      result->Error("CONFIGURATION_FAILED", error_message);
+      return;
+    }
+    if (AnswerIfAbandoned(timer, *arg_tunnel_name, *result)) {
+      return;
+    }
+
+    // Configure Windows networking for the adapter, which rolls back what it changed when abandoned between
+    // its phases
+    if (!target_adapter->ConfigureNetworking(&timer)) {
+      if (AnswerIfAbandoned(timer, *arg_tunnel_name, *result)) {
+        return;
+      }
+      DWORD error_code = GetLastError();
+      std::string error_message = "Failed to configure network interface";
+      if (error_code != 0) {
+        error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+        error_message += " Description: " + GetLastErrorAsString(error_code);
+      }
+      logger_->error("Setup tunnel failed: {}", error_message);
+      result->Error("NETWORK_CONFIGURATION_FAILED", error_message);
+      return;
+    }
+    logger_->info("Successfully configured network interface");
+
+    const WireguardConfigParser* applied_config = target_adapter->GetAppliedConfiguration();
+    if (config_cache_ && !from_cache && applied_config && !config_cache_->Store(adapter_name, *applied_config)) {
+      logger_->info("Configuration for tunnel {} was not cached", *arg_tunnel_name);
+    }
+    JournalAdapter(target_adapter);
+  } catch (const std::exception& e) {
+    DWORD error_code = GetLastError();
+    std::string error_message = "Exception while applying configuration: ";
+    error_message += e.what();
+    if (error_code != 0) {
+      error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+      error_message += " Description: " + GetLastErrorAsString(error_code);
+    }
+    logger_->error("Setup tunnel failed: {}", error_message);
+    result->Error("CONFIGURATION_EXCEPTION", error_message);
+    return;
+  } catch (...) {
+    DWORD error_code = GetLastError();
+    std::string error_message = "Unknown error occurred while applying configuration.";
+    if (error_code != 0) {
+      error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+      error_message += " Description: " + GetLastErrorAsString(error_code);
+    }
+    logger_->error("Setup tunnel failed: {}", error_message);
+    result->Error("UNKNOWN_ERROR", error_message);
+    return;
+  }
+
+  // Set a new adapter to DOWN state initially - connect will bring it up. setupAndConnect goes straight to UP
+  // below instead, so the adapter never passes through DOWN and no status event is sent for it.
+  if (adapter && !connect && !adapter->SetState(WIREGUARD_ADAPTER_STATE_DOWN)) {
+    DWORD error_code = GetLastError();
+    std::string error_message = "Failed to set adapter state to DOWN after configuration";
+    if (error_code != 0) {
+      error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+      error_message += " Description: " + GetLastErrorAsString(error_code);
+    }
+    logger_->warn("Setup tunnel warning: {}", error_message);
+    // Continue with setup even if setting state fails
+  }
+
+  // Store the adapter
+  NET_LUID luid;
+  std::map<flutter::EncodableValue, flutter::EncodableValue> return_value;
+  if (target_adapter->GetLUID(&luid)) {
+    WatchAdapter(*arg_tunnel_name, target_adapter, luid);
+    return_value[keys::kLuid] = flutter::EncodableValue(static_cast<int64_t>(luid.Value));
+  } else {
+    logger_->warn("Failed to get LUID for adapter: {}", *arg_tunnel_name);
+    return_value[keys::kLuid] = flutter::EncodableValue();
+  }
+  // Kept even if it does not come up, or is abandoned before it does, so that connect can try again without
+  // setting it up anew
+  DWORD abandoned = connect ? timer.Abandoned() : ERROR_SUCCESS;
+  bool brought_up = !connect;
+  if (connect && abandoned == ERROR_SUCCESS) {
+    brought_up = BringUp(target_adapter, "Setup and connect", *result, &timer, precheck ? &*precheck : nullptr,
+                         activation ? &*activation : nullptr);
+  }
+  if (adapter) {
+    adapters_.Add(std::move(adapter));
+  }
+  IndexTunnel(*arg_tunnel_name, target_adapter);
+  ReleaseIfLowMemory(target_adapter);
+  if (abandoned != ERROR_SUCCESS) {
+    AnswerAbandoned(abandoned, *arg_tunnel_name, *result);
+    return;
+  }
+  if (!brought_up) {
+    return;
+  }
+  return_value[keys::kTimings] = TimingsValue(timer);
+
+  result->Success(flutter::EncodableValue(return_value));
+  logger_->info("Setup tunnel completed successfully for adapter: {}", *arg_tunnel_name);
+}
+
+bool WireguardDartPlugin::AnswerIfAbandoned(const PhaseTimer& timer, const std::string& tunnel_name,
+                                            flutter::MethodResult<flutter::EncodableValue>& result) {
+  DWORD abandoned = timer.Abandoned();
+  if (abandoned == ERROR_SUCCESS) {
+    return false;
+  }
+  AnswerAbandoned(abandoned, tunnel_name, result);
+  return true;
+}
+
+void WireguardDartPlugin::AnswerAbandoned(DWORD abandoned, const std::string& tunnel_name,
+                                          flutter::MethodResult<flutter::EncodableValue>& result) {
+  if (abandoned == ERROR_TIMEOUT) {
+    logger_->error("Setup tunnel failed: {} did not finish within its timeout", tunnel_name);
+    result.Error("TIMEOUT", "Setup did not finish within timeoutMs");
+  } else {
+    logger_->warn("Setup tunnel cancelled: {}", tunnel_name);
+    result.Error("CANCELLED", "Setup was cancelled with cancelOperation");
+  }
+}
+
+void WireguardDartPlugin::HandleSetupTunnels(const flutter::EncodableMap* args,
+                                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  logger_->info("Setup tunnels initiated");
+
+  const auto* tunnels = args ? std::get_if<flutter::EncodableList>(ValueOrNull(*args, keys::kTunnels)) : nullptr;
+  if (tunnels == NULL) {
+    logger_->error("Setup tunnels failed: tunnels argument missing");
+    result->Error("Argument 'tunnels' is required");
+    return;
+  }
+
+  // Every tunnel needs its name, and a name twice would answer for one of them only
+  std::vector<std::shared_ptr<flutter::EncodableMap>> tunnel_args;
+  std::set<std::string> tunnel_names;
+  const auto* bundle_id = std::get_if<std::string>(ValueOrNull(*args, keys::kBundleId));
+  if (bundle_id && bundle_id->empty()) {
+    logger_->error("Setup tunnels failed: bundleId is empty");
+    result->Error("INVALID_ARGUMENT", "Argument 'bundleId' must not be empty");
+    return;
+  }
+  for (const auto& tunnel : *tunnels) {
+    const auto* tunnel_map = std::get_if<flutter::EncodableMap>(&tunnel);
+    const auto* tunnel_name = tunnel_map ? std::get_if<std::string>(ValueOrNull(*tunnel_map, keys::kTunnelName)) : nullptr;
+    if (tunnel_name == NULL || !tunnel_names.insert(*tunnel_name).second) {
+      logger_->error("Setup tunnels failed: every tunnel needs a tunnelName of its own");
+      result->Error("Argument 'tunnels' needs a distinct 'tunnelName' for every tunnel");
+      return;
+    }
+
+    auto setup_args = std::make_shared<flutter::EncodableMap>(*tunnel_map);
+    if (bundle_id && !ValueOrNull(*setup_args, keys::kBundleId)) {
+      (*setup_args)[keys::kBundleId] = flutter::EncodableValue(*bundle_id);
+    }
+    tunnel_args.push_back(std::move(setup_args));
+  }
+
+  if (tunnel_args.empty()) {
+    result->Success(flutter::EncodableValue(flutter::EncodableMap()));
+    return;
+  }
+
+  // Each tunnel is set up on its worker like a setupTunnel call, so they run in parallel with each other and in
+  // order with the other calls for the same tunnel. The last one to finish answers for all of them.
+  struct Batch {
+    std::mutex mutex;
+    flutter::EncodableMap results;
+    size_t remaining;
+  };
+  auto batch = std::make_shared<Batch>();
+  batch->remaining = tunnel_args.size();
+  std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> platform_result(std::move(result));
+  PlatformTaskRunner* platform_tasks = platform_tasks_.get();
+  auto record = [batch, platform_result, platform_tasks](const std::string& tunnel_name,
+                                                         flutter::EncodableValue tunnel_result) {
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->results[flutter::EncodableValue(tunnel_name)] = std::move(tunnel_result);
+    if (--batch->remaining > 0) {
+      return;
+    }
+    auto results = std::make_shared<flutter::EncodableMap>(std::move(batch->results));
+    lock.unlock();
+    platform_tasks->Post([platform_result, results]() { platform_result->Success(flutter::EncodableValue(*results)); });
+  };
+
+  for (auto& setup_args : tunnel_args) {
+    std::string tunnel_name = std::get<std::string>(*ValueOrNull(*setup_args, keys::kTunnelName));
+    auto tunnel_result = std::make_unique<flutter::MethodResultFunctions<flutter::EncodableValue>>(
+        [record, tunnel_name](const flutter::EncodableValue* value) {
+          record(tunnel_name, value ? *value : flutter::EncodableValue());
+        },
+        [record, tunnel_name](const std::string& code, const std::string& message, const flutter::EncodableValue*) {
+          flutter::EncodableMap error;
+          error[keys::kErrorCode] = flutter::EncodableValue(code);
+          error[keys::kErrorMessage] = flutter::EncodableValue(message);
+          record(tunnel_name, flutter::EncodableValue(error));
+        },
+        [record, tunnel_name]() { record(tunnel_name, flutter::EncodableValue()); });
+
+    if (!tunnel_tasks_) {
+      SetupTunnel(setup_args.get(), std::move(tunnel_result), false);
+      continue;
+    }
+    auto worker_result =
+        std::make_shared<std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>>>(std::move(tunnel_result));
+    tunnel_tasks_->Post(tunnel_name, [this, setup_args, worker_result]() {
+      SetupTunnel(setup_args.get(), std::move(*worker_result), false);
+    });
+  }
+  logger_->info("Setup of {} tunnels queued", tunnel_args.size());
+}
+
+void WireguardDartPlugin::HandleUpdateTunnel(const flutter::EncodableMap* args,
+                                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  logger_->info("Update tunnel initiated");
+
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName));
+  if (arg_tunnel_name == NULL) {
+    logger_->error("Update tunnel failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+
+  const auto* cfg = std::get_if<std::string>(ValueOrNull(*args, keys::kCfg));
+  const auto* structured_config = std::get_if<flutter::EncodableMap>(ValueOrNull(*args, keys::kConfig));
+  std::optional<int64_t> config_handle = IntegerArgument(ValueOrNull(*args, keys::kConfigHandle));
+  std::optional<WireguardConfigParser> parsed_config;
+  if (cfg == NULL && structured_config) {
+    if (!TakeStructuredConfiguration(*structured_config, "Update tunnel", parsed_config, *result)) {
+      return;
+    }
+  } else if (cfg == NULL && config_handle) {
+    if (!TakeCompiledConfiguration(*config_handle, "Update tunnel", parsed_config, *result) ||
+        !ApplyConfigOverrides(*args, "Update tunnel", *parsed_config, *result)) {
+      return;
+    }
+  } else if (cfg == NULL && !TakeStreamedConfiguration(*arg_tunnel_name, "Update tunnel", parsed_config, *result)) {
+    return;
+  }
+
+  // Unlike setupTunnel, never opens or creates an adapter: the point is to leave a running one running
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (!target_adapter) {
+    logger_->error("Update tunnel failed: adapter not found: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    return;
+  }
+  if (target_adapter->IsServiceOwned()) {
+    logger_->error("Update tunnel failed: {} runs as a service", *arg_tunnel_name);
+    result->Error("TUNNEL_SERVICE_INSTALLED",
+                  "The tunnel runs as a service. Call 'installTunnelService' to change its configuration.");
+    return;
+  }
+
+  NET_LUID luid;
+  if (!target_adapter->IsValid() || !target_adapter->GetLUID(&luid)) {
+    logger_->error("Update tunnel failed: adapter is not valid: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_INVALID", "Adapter is not valid");
+    return;
+  }
+
+  // The kill switch stays as it is unless the call says otherwise
+  const auto* arg_kill_switch = std::get_if<bool>(ValueOrNull(*args, keys::kKillSwitch));
+  if (arg_kill_switch) {
+    target_adapter->SetKillSwitchEnabled(*arg_kill_switch);
+  }
+
+  std::map<flutter::EncodableValue, flutter::EncodableValue> return_value;
+  return_value[keys::kLuid] = flutter::EncodableValue(static_cast<int64_t>(luid.Value));
+  if (cfg ? target_adapter->IsConfigurationApplied(*cfg) : target_adapter->IsConfigurationApplied(*parsed_config)) {
+    logger_->info("Update tunnel completed - configuration unchanged: {}", *arg_tunnel_name);
+    result->Success(flutter::EncodableValue(return_value));
+    return;
+  }
+
+  // The adapter state is not touched. Against the applied configuration only the changed peers go to the driver
+  // and the addresses and routes are reconciled, so the sessions of unchanged peers and the traffic over them
+  // carry on; a new private key is the one change that replaces every peer.
+  try {
+    bool applied = parsed_config ? target_adapter->ApplyConfiguration(std::move(*parsed_config))
+                                 : target_adapter->ApplyConfiguration(*cfg);
+    if (!applied) {
+      DWORD error_code = GetLastError();
+      std::string error_message = "Failed to apply configuration to adapter";
+      if (error_code != 0) {
+        error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+        error_message += " Description: " + GetLastErrorAsString(error_code);
+      }
+      logger_->error("Update tunnel failed: {}", error_message);
+      result->Error("CONFIGURATION_FAILED", error_message);
+      return;
+    }
+
+    if (!target_adapter->ConfigureNetworking()) {
+      DWORD error_code = GetLastError();
+      std::string error_message = "Failed to configure network interface";
+      if (error_code != 0) {
+        error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+        error_message += " Description: " + GetLastErrorAsString(error_code);
+      }
+      logger_->error("Update tunnel failed: {}", error_message);
+      result->Error("NETWORK_CONFIGURATION_FAILED", error_message);
+      return;
+    }
+
+    const WireguardConfigParser* applied_config = target_adapter->GetAppliedConfiguration();
+    if (config_cache_ && applied_config && !config_cache_->Store(target_adapter->GetName(), *applied_config)) {
+      logger_->info("Configuration for tunnel {} was not cached", *arg_tunnel_name);
+    }
+    JournalAdapter(target_adapter);
+  } catch (const std::exception& e) {
+    DWORD error_code = GetLastError();
+    std::string error_message = "Exception while applying configuration: ";
+    error_message += e.what();
+    if (error_code != 0) {
+      error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+      error_message += " Description: " + GetLastErrorAsString(error_code);
+    }
+    logger_->error("Update tunnel failed: {}", error_message);
+    result->Error("CONFIGURATION_EXCEPTION", error_message);
+    return;
+  } catch (...) {
+    DWORD error_code = GetLastError();
+    std::string error_message = "Unknown error occurred while applying configuration.";
+    if (error_code != 0) {
+      error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+      error_message += " Description: " + GetLastErrorAsString(error_code);
+    }
+    logger_->error("Update tunnel failed: {}", error_message);
+    result->Error("UNKNOWN_ERROR", error_message);
+    return;
+  }
+
+  // The addresses may have changed, so the ready event is armed for the new ones
+  WatchAdapter(*arg_tunnel_name, target_adapter, luid);
+  IndexTunnel(*arg_tunnel_name, target_adapter);
+  ReleaseIfLowMemory(target_adapter);
+
+  result->Success(flutter::EncodableValue(return_value));
+  logger_->info("Update tunnel completed successfully for adapter: {}", *arg_tunnel_name);
+}
+
+void WireguardDartPlugin::HandleChangePeers(const flutter::EncodableMap* args,
+                                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!arg_tunnel_name) {
+    logger_->error("Change peers failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+
+  // addPeers sends peers as setupTunnelStructured does, removePeers their 32-byte public keys
+  WireguardConfigParser added;
+  added.BeginStructured();
+  added.FinishStructured();
+  if (const flutter::EncodableValue* arg_peers = ValueOrNull(*args, keys::kPeers)) {
+    const auto* peers = std::get_if<flutter::EncodableList>(arg_peers);
+    std::string error_message = "Argument 'peers' must be a list";
+    if (!peers || !ParseStructuredPeers(*peers, added, &error_message)) {
+      logger_->error("Change peers failed: {}", error_message);
+      result->Error("INVALID_CONFIG", error_message);
+      return;
+    }
+  }
+  std::vector<PeerPublicKey> removed;
+  if (const flutter::EncodableValue* arg_public_keys = ValueOrNull(*args, keys::kPublicKeys)) {
+    const auto* public_keys = std::get_if<flutter::EncodableList>(arg_public_keys);
+    if (!public_keys) {
+      result->Error("INVALID_CONFIG", "Argument 'publicKeys' must be a list of 32-byte keys");
+      return;
+    }
+    removed.reserve(public_keys->size());
+    for (const auto& value : *public_keys) {
+      const auto* key = std::get_if<std::vector<uint8_t>>(&value);
+      if (!key || key->size() != WIREGUARD_KEY_LENGTH) {
+        result->Error("INVALID_CONFIG", "Argument 'publicKeys' must be a list of 32-byte keys");
         return;
       }
+      PeerPublicKey& public_key = removed.emplace_back();
+      memcpy(public_key.data(), key->data(), WIREGUARD_KEY_LENGTH);
+    }
+  }
+
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (!target_adapter) {
+    logger_->error("Change peers failed: adapter not found: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    return;
+  }
+  if (target_adapter->IsServiceOwned()) {
+    logger_->error("Change peers failed: {} runs as a service", *arg_tunnel_name);
+    result->Error("TUNNEL_SERVICE_INSTALLED",
+                  "The tunnel runs as a service. Call 'installTunnelService' to change its configuration.");
+    return;
+  }
+
+  size_t added_count = added.GetConfiguration().Interface().PeersCount;
+  std::string error_message;
+  if (!target_adapter->ChangePeers(std::move(added), removed, &error_message)) {
+    logger_->error("Change peers failed: {}", error_message);
+    result->Error("CONFIGURATION_FAILED", error_message);
+    return;
+  }
+  // A no-op unless the routes could not be changed in place
+  if (!target_adapter->ConfigureNetworking()) {
+    logger_->error("Change peers failed: could not configure the network interface");
+    result->Error("NETWORK_CONFIGURATION_FAILED", "Failed to configure network interface");
+    return;
+  }
+
+  DeferPeerChangePersist(*arg_tunnel_name);
+
+  result->Success();
+  logger_->info("Changed the peers of tunnel {}: {} added, {} removed", *arg_tunnel_name, added_count,
+                removed.size());
+}
+
+void WireguardDartPlugin::DeferPeerChangePersist(const std::string& tunnel_name) {
+  {
+    std::lock_guard<std::mutex> lock(peer_change_mutex_);
+    // A write still to come runs after this change on the tunnel's worker, and picks it up
+    if (peer_changes_.count(tunnel_name) > 0) {
+      return;
+    }
+    auto post = [this, tunnel_name]() {
+      std::lock_guard<std::mutex> lock(peer_change_mutex_);
+      if (!peer_changes_closed_) {
+        tunnel_tasks_->Post(tunnel_name, [this, tunnel_name]() { PersistPeerChanges(tunnel_name); });
+      }
+    };
+    IoReactor::TimerId timer = peer_changes_closed_ ? 0 : io_reactor_.Schedule(kPeerChangeSettle, post);
+    if (timer != 0) {
+      peer_changes_.emplace(tunnel_name, timer);
+      return;
+    }
+  }
+  PersistPeerChanges(tunnel_name);
+}
+
+void WireguardDartPlugin::PersistPeerChanges(const std::string& tunnel_name) {
+  {
+    std::lock_guard<std::mutex> lock(peer_change_mutex_);
+    peer_changes_.erase(tunnel_name);
+  }
+  WireguardAdapter* adapter = adapters_.FindByName(tunnel_name);
+  if (!adapter) {
+    return;
+  }
+  const WireguardConfigParser* applied_config = adapter->GetAppliedConfiguration();
+  if (config_cache_ && applied_config && !config_cache_->Store(adapter->GetName(), *applied_config)) {
+    logger_->info("Configuration for tunnel {} was not cached", tunnel_name);
+  }
+  JournalAdapter(adapter);
+  IndexTunnel(tunnel_name, adapter);
+  ReleaseIfLowMemory(adapter);
+}
+
+void WireguardDartPlugin::HandleWatchConfigFile(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!arg_tunnel_name) {
+    logger_->error("Watch config file failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+
+  // Without a path the tunnel's file is no longer watched
+  const auto* arg_path = std::get_if<std::string>(ValueOrNull(*args, keys::kPath));
+  if (!arg_path) {
+    config_file_watcher_.Unwatch(*arg_tunnel_name);
+    result->Success();
+    return;
+  }
+  // Reloads must not race the calls for the tunnel, which only the workers keep in order
+  if (!tunnel_tasks_) {
+    logger_->error("Watch config file failed: no tunnel workers");
+    result->Error("WATCH_FAILED", "Configuration files cannot be watched without the tunnel workers");
+    return;
+  }
+
+  std::string error_message;
+  if (!config_file_watcher_.Watch(
+          *arg_tunnel_name, Utf8ToWide(*arg_path),
+          [this](const std::string& tunnel_name, std::string text) { ReloadConfigFile(tunnel_name, std::move(text)); },
+          &error_message)) {
+    logger_->error("Watch config file failed: {}", error_message);
+    result->Error("WATCH_FAILED", error_message);
+    return;
+  }
+  result->Success();
+}
+
+void WireguardDartPlugin::ReloadConfigFile(const std::string& tunnel_name, std::string text) {
+  auto args = std::make_shared<flutter::EncodableMap>();
+  (*args)[keys::kTunnelName] = flutter::EncodableValue(tunnel_name);
+  (*args)[keys::kCfg] = flutter::EncodableValue(std::move(text));
+
+  // Nobody waits for the answer, it is only logged; updateTunnel leaves unchanged peers and routes alone
+  PluginLogger logger = logger_;
+  auto reload_result = std::make_shared<std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>>>(
+      std::make_unique<flutter::MethodResultFunctions<flutter::EncodableValue>>(
+          [logger, tunnel_name](const flutter::EncodableValue*) {
+            logger->info("Reloaded the configuration file of tunnel {}", tunnel_name);
+          },
+          [logger, tunnel_name](const std::string& code, const std::string& message, const flutter::EncodableValue*) {
+            logger->error("Reloading the configuration file of tunnel {} failed: {} {}", tunnel_name, code, message);
+          },
+          nullptr));
+  tunnel_tasks_->Post(tunnel_name, [this, args, reload_result]() {
+    HandleUpdateTunnel(args.get(), std::move(*reload_result));
+  });
+}
+
+bool WireguardDartPlugin::TakeStreamedConfiguration(const std::string& tunnel_name, const char* operation,
+                                                    std::optional<WireguardConfigParser>& parsed_config,
+                                                    flutter::MethodResult<flutter::EncodableValue>& result) {
+  std::unique_lock<std::mutex> lock(pending_configs_mutex_);
+  auto pending_it = pending_configs_.find(tunnel_name);
+  if (pending_it == pending_configs_.end()) {
+    logger_->error("{} failed: cfg argument missing", operation);
+    result.Error("Argument 'cfg' is required");
+    return false;
+  }
+
+  parsed_config = std::move(pending_it->second);
+  pending_configs_.erase(pending_it);
+  lock.unlock();
+  if (!parsed_config->Finish()) {
+    logger_->error("{} failed: streamed configuration is invalid at line {}", operation, parsed_config->GetErrorLine());
+    result.Error("CONFIGURATION_FAILED", "Failed to parse WireGuard configuration");
+    return false;
+  }
+  return true;
+}
+
+bool WireguardDartPlugin::TakeStructuredConfiguration(const flutter::EncodableMap& config, const char* operation,
+                                                      std::optional<WireguardConfigParser>& parsed_config,
+                                                      flutter::MethodResult<flutter::EncodableValue>& result) {
+  parsed_config.emplace();
+  std::string error;
+  if (!ParseStructuredConfig(config, *parsed_config, &error)) {
+    logger_->error("{} failed: {}", operation, error);
+    result.Error("CONFIGURATION_FAILED", error);
+    return false;
+  }
+  return true;
+}
+
+bool WireguardDartPlugin::TakeFileConfiguration(const std::string& path, const char* operation,
+                                                std::optional<WireguardConfigParser>& parsed_config,
+                                                flutter::MethodResult<flutter::EncodableValue>& result) {
+  MappedFile file;
+  if (!file.Open(Utf8ToWide(path))) {
+    DWORD error_code = GetLastError();
+    std::string error_message = "Failed to read configuration file " + path + ": " + GetLastErrorAsString(error_code);
+    logger_->error("{} failed: {}", operation, error_message);
+    result.Error("CONFIGURATION_FILE_FAILED", error_message);
+    return false;
+  }
+
+  // Parsed straight from the view, the wire buffer is the only copy; the parser keeps nothing that points into it
+  parsed_config.emplace();
+  bool parsed = false;
+  if (!file.Read([&parsed_config, &parsed](std::string_view text) { parsed = parsed_config->Parse(text); })) {
+    // Left midway through the text
+    parsed_config.reset();
+    std::string error_message = "Failed to read configuration file " + path + ": a page of it could not be read in";
+    logger_->error("{} failed: {}", operation, error_message);
+    result.Error("CONFIGURATION_FILE_FAILED", error_message);
+    return false;
+  }
+  if (!parsed) {
+    size_t error_line = parsed_config->GetErrorLine();
+    logger_->error("{} failed: configuration file is invalid at line {}", operation, error_line);
+    result.Error("CONFIGURATION_FAILED",
+                 "Failed to parse WireGuard configuration at line " + std::to_string(error_line));
+    return false;
+  }
+  return true;
+}
+
+bool WireguardDartPlugin::TakeCompiledConfiguration(int64_t handle, const char* operation,
+                                                    std::optional<WireguardConfigParser>& parsed_config,
+                                                    flutter::MethodResult<flutter::EncodableValue>& result) {
+  std::shared_ptr<const WireguardConfigParser> compiled;
+  {
+    std::lock_guard<std::mutex> lock(compiled_configs_mutex_);
+    auto compiled_it = compiled_configs_.find(handle);
+    if (compiled_it != compiled_configs_.end()) {
+      compiled = compiled_it->second;
+    }
+  }
+  if (!compiled) {
+    logger_->error("{} failed: no compiled configuration {}", operation, handle);
+    result.Error("CONFIG_HANDLE_INVALID", "Unknown configuration handle. Call 'compileConfig' first.");
+    return false;
+  }
+
+  // Applying fills in endpoints and keeps the parse, so each tunnel gets its own copy; a releaseConfig meanwhile
+  // only drops the handle's reference
+  parsed_config.emplace(*compiled);
+  return true;
+}
+
+bool WireguardDartPlugin::ApplyConfigOverrides(const flutter::EncodableMap& args, const char* operation,
+                                               WireguardConfigParser& parsed_config,
+                                               flutter::MethodResult<flutter::EncodableValue>& result) {
+  const auto* private_key = std::get_if<std::string>(ValueOrNull(args, keys::kPrivateKey));
+  const auto* address_list = std::get_if<flutter::EncodableList>(ValueOrNull(args, keys::kAddresses));
+  std::optional<int64_t> listen_port = IntegerArgument(ValueOrNull(args, keys::kListenPort));
+  if (!private_key && !address_list && !listen_port) {
+    return true;
+  }
+  if (listen_port && (*listen_port < 0 || *listen_port > 65535)) {
+    logger_->error("{} failed: listen port {} out of range", operation, *listen_port);
+    result.Error("INVALID_ARGUMENT", "Argument 'listenPort' must be between 0 and 65535");
+    return false;
+  }
+
+  // In the form of an Address line, so the parser checks them as it would the text's. An empty line would keep the
+  // template's addresses, so the list may neither be empty nor hold anything but addresses.
+  std::string addresses;
+  if (address_list) {
+    bool valid = !address_list->empty();
+    for (const auto& value : *address_list) {
+      const auto* address = std::get_if<std::string>(&value);
+      valid = valid && address && !address->empty();
+      if (!valid) {
+        break;
+      }
+      if (!addresses.empty()) {
+        addresses += ", ";
+      }
+      addresses += *address;
+    }
+    if (!valid) {
+      logger_->error("{} failed: addresses to override are empty or not all strings", operation);
+      result.Error("INVALID_ARGUMENT", "Argument 'addresses' must be a non-empty list of addresses");
+      return false;
+    }
+  }
+  InterfaceOverrides overrides;
+  if (private_key) {
+    overrides.private_key = *private_key;
+  }
+  overrides.addresses = addresses;
+  if (listen_port) {
+    overrides.listen_port = static_cast<WORD>(*listen_port);
+  }
+  if (!parsed_config.ApplyOverrides(overrides)) {
+    logger_->error("{} failed: invalid private key or addresses to override", operation);
+    result.Error("CONFIGURATION_FAILED", "Argument 'privateKey' or 'addresses' is invalid");
+    return false;
+  }
+  return true;
+}
+
+bool WireguardDartPlugin::BringUp(WireguardAdapter* adapter, const char* operation,
+                                  flutter::MethodResult<flutter::EncodableValue>& result, PhaseTimer* timer,
+                                  ConnectPrecheck* precheck, const WireguardAdapter::ActivationOptions* activation) {
+  if (precheck) {
+    bool passed = PassPrecheck(*precheck, adapter, operation, result);
+    if (timer) {
+      timer->Lap("precheck");
+    }
+    if (!passed) {
+      return false;
+    }
+  }
+
+  // Before the interface can come up, so that it is connecting until a handshake completes
+  std::optional<NET_LUID> luid;
+  NET_LUID adapter_luid;
+  if (adapter->GetLUID(&adapter_luid)) {
+    luid = adapter_luid;
+    network_adapter_observer_->NotifyConnecting(adapter_luid);
+  }
+  if (activation) {
+    StagePeers(adapter, *activation, luid);
+  }
+  if (adapter->SetState(WIREGUARD_ADAPTER_STATE_UP)) {
+    if (timer) {
+      timer->Lap("connect");
+    }
+    TimeFirstHandshake(adapter, luid);
+    return true;
+  }
+
+  DWORD error_code = GetLastError();
+  // The interface stays down, so the batches still to come would only go to a tunnel nobody connects
+  if (activation) {
+    adapter->CancelPeerActivation();
+  }
+  std::string error_message = "Failed to set adapter state to UP";
+  if (error_code != 0) {
+    error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
+    error_message += " Description: " + GetLastErrorAsString(error_code);
+  }
+  logger_->error("{} failed: {}", operation, error_message);
+  result.Error("ADAPTER_STATE_FAILED", error_message);
+  return false;
+}
+
+bool WireguardDartPlugin::PassPrecheck(ConnectPrecheck& precheck, WireguardAdapter* adapter, const char* operation,
+                                       flutter::MethodResult<flutter::EncodableValue>& result) {
+  // As the configuration has them; hostnames still being resolved are not probed
+  std::vector<SOCKADDR_INET> endpoints;
+  if (const WireguardConfigParser* config = adapter->GetAppliedConfiguration()) {
+    config->GetConfiguration().ForEachPeer([&endpoints](const WIREGUARD_PEER& peer, const WIREGUARD_ALLOWED_IP*,
+                                                        DWORD) {
+      if (peer.Flags & WIREGUARD_PEER_HAS_ENDPOINT) {
+        endpoints.push_back(peer.Endpoint);
+      }
+    });
+  }
+
+  ConnectPrecheckResult checked = precheck.Finish(endpoints);
+  switch (checked.verdict) {
+    case ConnectPrecheckResult::Verdict::kClear:
+      return true;
+    case ConnectPrecheckResult::Verdict::kCaptivePortal: {
+      std::string message = "The network has a captive portal";
+      if (!checked.detail.empty()) {
+        message += " at " + checked.detail;
+      }
+      logger_->error("{} failed: {}", operation, message);
+      result.Error("CAPTIVE_PORTAL", message + ". Sign in to it before connecting.");
+      return false;
+    }
+    case ConnectPrecheckResult::Verdict::kEndpointUnreachable:
+      logger_->error("{} failed: no endpoint is reachable, {}", operation, checked.detail);
+      result.Error("ENDPOINT_UNREACHABLE", "No peer endpoint is reachable: " + checked.detail);
+      return false;
+  }
+  return true;
+}
+
+void WireguardDartPlugin::StagePeers(WireguardAdapter* adapter, const WireguardAdapter::ActivationOptions& activation,
+                                     const std::optional<NET_LUID>& luid) {
+  // Shared, the activation thread may run on while the adapter is torn down
+  std::shared_ptr<NetworkAdapterStatusObserver> observer = network_adapter_observer_;
+  bool staged = adapter->StagePeerActivation(activation, [observer, luid](size_t activated, size_t total) {
+    if (luid) {
+      observer->NotifyActivation(*luid, activated, total);
+    }
+  });
+  // The driver still has the configuration as it was, so the tunnel comes up with every peer at once
+  if (!staged) {
+    logger_->warn("Staging the peers failed, adapter {} comes up with all of them", WideToUtf8(adapter->GetName()));
+  }
+}
+
+void WireguardDartPlugin::TimeFirstHandshake(WireguardAdapter* adapter, const std::optional<NET_LUID>& luid,
+                                             bool warm_up) {
+  // Shared like the observer of StagePeers
+  std::shared_ptr<PerfStats> perf_stats = perf_stats_;
+  std::shared_ptr<NetworkAdapterStatusObserver> observer = network_adapter_observer_;
+  adapter->TimeFirstHandshake(
+      [perf_stats, observer, luid](int64_t microseconds) {
+        perf_stats->Record("handshake", microseconds);
+        if (luid) {
+          observer->NotifyHandshake(*luid);
+        }
+      },
+      warm_up);
+}
+
+void WireguardDartPlugin::HandleGetPerfStats(const flutter::EncodableMap* args,
+                                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  flutter::EncodableMap phases;
+  for (const auto& entry : perf_stats_->Snapshot()) {
+    const PerfStats::Summary& summary = entry.second;
+    flutter::EncodableMap value;
+    value[keys::kCount] = flutter::EncodableValue(static_cast<int64_t>(summary.count));
+    value[keys::kLastUs] = flutter::EncodableValue(summary.last_us);
+    value[keys::kMinUs] = flutter::EncodableValue(summary.min_us);
+    value[keys::kMaxUs] = flutter::EncodableValue(summary.max_us);
+    value[keys::kMeanUs] = flutter::EncodableValue(summary.mean_us);
+    value[keys::kP50Us] = flutter::EncodableValue(summary.p50_us);
+    value[keys::kP90Us] = flutter::EncodableValue(summary.p90_us);
+    value[keys::kP99Us] = flutter::EncodableValue(summary.p99_us);
+    phases[flutter::EncodableValue(entry.first)] = flutter::EncodableValue(value);
+  }
+  result->Success(flutter::EncodableValue(phases));
+}
+
+void WireguardDartPlugin::HandleGetStartupTrace(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  flutter::EncodableList entries;
+  for (const StartupTrace::Entry& entry : StartupTrace::Instance().Entries()) {
+    flutter::EncodableMap value;
+    value[keys::kSubsystem] = flutter::EncodableValue(entry.subsystem);
+    value[keys::kAtUs] = flutter::EncodableValue(entry.at_us);
+    value[keys::kTookUs] = flutter::EncodableValue(entry.took_us);
+    entries.push_back(flutter::EncodableValue(value));
+  }
+  result->Success(flutter::EncodableValue(entries));
+}
+
+void WireguardDartPlugin::HandleBenchmarkCall(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  std::optional<int64_t> peer_count = args ? IntegerArgument(ValueOrNull(*args, keys::kPeers)) : std::nullopt;
+  if (!peer_count) {
+    result->Success();
+    return;
+  }
+  if (*peer_count < 0 || *peer_count > kMaxBenchmarkPeers) {
+    result->Error("Argument 'peers' must be between 0 and " + std::to_string(kMaxBenchmarkPeers));
+    return;
+  }
+
+  FILETIME now_filetime;
+  GetSystemTimeAsFileTime(&now_filetime);
+  uint64_t now = (static_cast<uint64_t>(now_filetime.dwHighDateTime) << 32) | now_filetime.dwLowDateTime;
+
+  // Counters of a busy tunnel, so the numbers take as many bytes on the channel as real ones
+  if (benchmark_peers_.size() != static_cast<size_t>(*peer_count)) {
+    benchmark_peers_.resize(static_cast<size_t>(*peer_count));
+    for (size_t i = 0; i < benchmark_peers_.size(); i++) {
+      PeerStatistics& peer = benchmark_peers_[i];
+      for (size_t byte = 0; byte < peer.public_key.size(); byte++) {
+        peer.public_key[byte] = static_cast<uint8_t>((i >> (8 * (byte % 4))) + byte * 37);
+      }
+      peer.rx_bytes = 10'000'000'000ull + i * 7919;
+      peer.tx_bytes = 2'000'000'000ull + i * 104729;
+      peer.last_handshake_ms = FiletimeToUnixMillis(now) - (i % 120) * 1000;
+      peer.persistent_keepalive = 25;
+      peer.rx_rate = peer.rx_rate_ewma = 125000.5 + static_cast<double>(i);
+      peer.tx_rate = peer.tx_rate_ewma = 31250.25 + static_cast<double>(i);
+    }
+  }
+
+  const auto* binary = args ? std::get_if<bool>(ValueOrNull(*args, keys::kBinary)) : nullptr;
+  if (binary && *binary) {
+    std::vector<uint8_t> encoded;
+    EncodePeerStatistics(benchmark_peers_, FiletimeToUnixMillis(now), &encoded);
+    result->Success(flutter::EncodableValue(std::move(encoded)));
+    return;
+  }
+  result->Success(PeersValue(benchmark_peers_, now));
+}
+
+void WireguardDartPlugin::HandleStartTelemetryExport(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* host = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kHost)) : nullptr;
+  const auto* port = args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kPort)) : nullptr;
+  if (!host || host->empty() || !port) {
+    result->Error("Arguments 'host' and 'port' are required");
+    return;
+  }
+  if (*port < 1 || *port > 65535) {
+    result->Error("Argument 'port' must be between 1 and 65535");
+    return;
+  }
+  TelemetryExporter::Options options;
+  options.host = *host;
+  options.port = static_cast<uint16_t>(*port);
+  const auto* interval_ms = std::get_if<int32_t>(ValueOrNull(*args, keys::kIntervalMs));
+  if (interval_ms && *interval_ms > 0) {
+    options.interval = std::chrono::milliseconds(*interval_ms);
+  }
+  const auto* max_datagrams = std::get_if<int32_t>(ValueOrNull(*args, keys::kMaxDatagrams));
+  if (max_datagrams && *max_datagrams > 0) {
+    options.max_datagrams = static_cast<uint32_t>(*max_datagrams);
+  }
+  if (const auto* min_level_name = std::get_if<std::string>(ValueOrNull(*args, keys::kMinLevel))) {
+    options.min_level = spdlog::level::from_str(*min_level_name);
+    if (options.min_level == spdlog::level::off && *min_level_name != "off") {
+      result->Error("Unknown log level: " + *min_level_name);
+      return;
+    }
+  }
+  if (!telemetry_->Start(options)) {
+    logger_->error("Start telemetry export failed: Windows error {}", GetLastError());
+    result->Error("TELEMETRY_FAILED", "Failed to start the telemetry thread");
+    return;
+  }
+  result->Success();
+}
+
+void WireguardDartPlugin::HandleStopTelemetryExport(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  telemetry_->Stop();
+  result->Success();
+}
+
+void WireguardDartPlugin::HandleGetMemoryStats(const flutter::EncodableMap* args,
+                                               std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  int64_t parsed_config_bytes = 0;
+  int64_t wire_buffer_bytes = 0;
+  int64_t cache_bytes = 0;
+  flutter::EncodableMap tunnels;
+  {
+    auto lock = adapters_.LockShared();
+    adapters_.ForEachLocked([&](const std::string& name, WireguardAdapter* adapter) {
+      WireguardAdapter::MemoryUsage usage;
+      adapter->GetMemoryUsage(&usage);
+      flutter::EncodableMap tunnel;
+      tunnel[keys::kParsedConfigBytes] = flutter::EncodableValue(static_cast<int64_t>(usage.parsed_config_bytes));
+      tunnel[keys::kWireBufferBytes] = flutter::EncodableValue(static_cast<int64_t>(usage.wire_buffer_bytes));
+      tunnel[keys::kCacheBytes] = flutter::EncodableValue(static_cast<int64_t>(usage.cache_bytes));
+      tunnels[flutter::EncodableValue(name)] = flutter::EncodableValue(tunnel);
+      parsed_config_bytes += usage.parsed_config_bytes;
+      wire_buffer_bytes += usage.wire_buffer_bytes;
+      cache_bytes += usage.cache_bytes;
+    });
+  }
+  {
+    // Streamed configurations not yet set up
+    std::lock_guard<std::mutex> lock(pending_configs_mutex_);
+    for (const auto& entry : pending_configs_) {
+      parsed_config_bytes += entry.second.MemoryBytes();
+    }
+  }
+  {
+    // Compiled configurations not yet released
+    std::lock_guard<std::mutex> lock(compiled_configs_mutex_);
+    for (const auto& entry : compiled_configs_) {
+      parsed_config_bytes += entry.second->MemoryBytes();
     }
+  }
+  parsed_config_bytes += validate_config_.MemoryBytes();
+  if (key_pool_) {
+    cache_bytes += key_pool_->MemoryBytes();
+  }
+  cache_bytes += static_cast<int64_t>(route_lookup_.MemoryBytes());
+  auto statistics_bytes = static_cast<int64_t>(statistics_history_.MemoryBytes() + statistics_recorder_.MemoryBytes());
+  auto log_bytes = static_cast<int64_t>(log_ring_->MemoryBytes() + AdapterLogs::Instance().MemoryBytes());
 
-    // Adapter was found but is not valid and did not return above, remove it and it will be created again
-    logger_->info("Removing invalid adapter: {}", *arg_tunnel_name);
-    RemoveAdapterByName(adapter_name);
+  flutter::EncodableMap phases;
+  for (const auto& entry : perf_stats_->Snapshot()) {
+    flutter::EncodableMap value;
+    value[keys::kLastWorkingSetDelta] = flutter::EncodableValue(entry.second.last_working_set_delta);
+    value[keys::kMaxWorkingSetDelta] = flutter::EncodableValue(entry.second.max_working_set_delta);
+    phases[flutter::EncodableValue(entry.first)] = flutter::EncodableValue(value);
   }
 
-  // Try to open existing adapter first
-  auto adapter = WireguardAdapter::Open(wg_library_, adapter_name);
-  if (!adapter) {
-    // If opening fails, create a new adapter
-    logger_->info("Creating new WireGuard adapter: {}", *arg_tunnel_name);
-    adapter = WireguardAdapter::Create(wg_library_, adapter_name, L"WireGuard");
+  flutter::EncodableMap stats;
+  stats[keys::kLowMemory] = flutter::EncodableValue(low_memory_.load());
+  stats[keys::kParsedConfigBytes] = flutter::EncodableValue(parsed_config_bytes);
+  stats[keys::kWireBufferBytes] = flutter::EncodableValue(wire_buffer_bytes);
+  stats[keys::kStatisticsBytes] = flutter::EncodableValue(statistics_bytes);
+  stats[keys::kLogBytes] = flutter::EncodableValue(log_bytes);
+  stats[keys::kCacheBytes] = flutter::EncodableValue(cache_bytes);
+  stats[keys::kTotalBytes] =
+      flutter::EncodableValue(parsed_config_bytes + wire_buffer_bytes + statistics_bytes + log_bytes + cache_bytes);
+  stats[keys::kWorkingSetBytes] = flutter::EncodableValue(ProcessWorkingSetBytes());
+  stats[keys::kTunnels] = flutter::EncodableValue(tunnels);
+  stats[keys::kPhases] = flutter::EncodableValue(phases);
+  result->Success(flutter::EncodableValue(stats));
+}
 
-    if (!adapter) {
-      DWORD error_code = GetLastError();
-      std::string error_message = "Failed to create WireGuard adapter: " + *arg_tunnel_name;
-      if (error_code != 0) {
-        error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
-        error_message += " Description: " + GetLastErrorAsString(error_code);
+void WireguardDartPlugin::HandleSetLowMemoryMode(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_enabled = args ? std::get_if<bool>(ValueOrNull(*args, keys::kEnabled)) : nullptr;
+  if (!arg_enabled) {
+    result->Error("Argument 'enabled' is required");
+    return;
+  }
+
+  bool enabled = *arg_enabled;
+  bool was_enabled = low_memory_.exchange(enabled);
+  statistics_history_.SetLowMemory(enabled);
+  log_ring_->SetCapacity(enabled ? kLowMemoryLogRingLines : kLogRingLines);
+  logger_->info("Low-memory mode {}", enabled ? "on" : "off");
+
+  // Tunnels already set up release their configuration on their workers, after the calls queued for them
+  if (enabled && !was_enabled) {
+    std::vector<std::string> names;
+    {
+      auto lock = adapters_.LockShared();
+      adapters_.ForEachLocked([&names](const std::string& name, WireguardAdapter*) { names.push_back(name); });
+    }
+    for (const auto& name : names) {
+      auto release = [this, name]() {
+        if (WireguardAdapter* adapter = adapters_.FindByName(name)) {
+          ReleaseIfLowMemory(adapter);
+        }
+      };
+      if (tunnel_tasks_) {
+        tunnel_tasks_->Post(name, release);
+      } else {
+        release();
       }
-      logger_->error("Setup tunnel failed: {}", error_message);
-      result->Error("ADAPTER_CREATION_FAILED", error_message);
-      return;
     }
-    logger_->info("WireGuard adapter created successfully: {}", *arg_tunnel_name);
+  }
+  result->Success();
+}
+
+void WireguardDartPlugin::HandleGetMetrics(const flutter::EncodableMap* args,
+                                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  result->Success(flutter::EncodableValue(MetricsText()));
+}
+
+std::string WireguardDartPlugin::MetricsText() const {
+  std::string families = ComputePool::Shared().OpenMetricsFamilies() + WakeupCounts::Instance().OpenMetricsFamilies() +
+                         CpuAccounting::Instance().OpenMetricsFamilies() +
+                         OperationCounters::Instance().OpenMetricsFamilies() + telemetry_->OpenMetricsFamilies();
+  return CallMetrics::Instance().OpenMetricsText(families);
+}
+
+void WireguardDartPlugin::HandleGetRecentLogs(const flutter::EncodableMap* args,
+                                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* max_lines = args ? std::get_if<int32_t>(ValueOrNull(*args, keys::kMaxLines)) : nullptr;
+  const auto* min_level_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kMinLevel)) : nullptr;
+  auto min_level = min_level_name ? spdlog::level::from_str(*min_level_name) : spdlog::level::trace;
+
+  // Empty until nativeInit creates the file logger. Lines still queued for the log thread are not in the ring yet.
+  std::vector<spdlog::details::log_msg_buffer> records = log_ring_->LastRaw();
+  size_t limit = max_lines && *max_lines > 0 ? static_cast<size_t>(*max_lines) : records.size();
+  size_t first = records.size();
+  size_t matching = 0;
+  while (first > 0 && matching < limit) {
+    if (records[first - 1].level >= min_level) {
+      matching++;
+    }
+    first--;
+  }
+
+  // In the lean pattern whatever the file has, the thread of a line means nothing to Dart
+  flutter::EncodableList lines;
+  auto formatter = MakeLogFormatter(kLeanLogPattern);
+  for (size_t i = first; i < records.size(); i++) {
+    if (records[i].level < min_level) {
+      continue;
+    }
+    spdlog::memory_buf_t formatted;
+    formatter->format(records[i], formatted);
+    size_t size = formatted.size();
+    while (size > 0 && (formatted.data()[size - 1] == '\n' || formatted.data()[size - 1] == '\r')) {
+      size--;
+    }
+    lines.push_back(flutter::EncodableValue(std::string(formatted.data(), size)));
+  }
+  result->Success(flutter::EncodableValue(lines));
+}
+
+void WireguardDartPlugin::HandleSetLogLevel(const flutter::EncodableMap* args,
+                                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* level_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kLevel)) : nullptr;
+  if (!level_name) {
+    result->Error("Argument 'level' is required");
+    return;
+  }
+  // from_str answers off for any name it does not know
+  spdlog::level::level_enum level = spdlog::level::from_str(*level_name);
+  if (level == spdlog::level::off && *level_name != "off") {
+    logger_->error("Set log level failed: unknown level '{}'", *level_name);
+    result->Error("Unknown log level: " + *level_name);
+    return;
+  }
+
+  spdlog::level::level_enum previous_level = log_level_;
+  log_level_ = level;
+  logger_->info("Log level set to {}", spdlog::level::to_string_view(level));
+  logger_->set_level(level);
+  // Into or out of debug level the lean pattern gains or loses the thread ID; only once there is a file logger
+  if (log_thread_pool_ && LogPatternFor(level, log_pattern_) != LogPatternFor(previous_level, log_pattern_)) {
+    logger_->set_formatter(MakeLogFormatter(LogPatternFor(level, log_pattern_)));
+  }
+  result->Success();
+}
+
+void WireguardDartPlugin::HandleBeginTunnelConfiguration(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName));
+  if (arg_tunnel_name == NULL) {
+    logger_->error("Begin tunnel configuration failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+
+  // Starting again discards whatever was streamed before for this tunnel
+  std::lock_guard<std::mutex> lock(pending_configs_mutex_);
+  pending_configs_[*arg_tunnel_name].BeginParse();
+  logger_->info("Streaming configuration started for tunnel: {}", *arg_tunnel_name);
+  result->Success();
+}
+
+void WireguardDartPlugin::HandleAppendTunnelConfiguration(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName));
+  if (arg_tunnel_name == NULL) {
+    logger_->error("Append tunnel configuration failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+
+  const auto* chunk = std::get_if<std::string>(ValueOrNull(*args, keys::kChunk));
+  if (chunk == NULL) {
+    logger_->error("Append tunnel configuration failed: chunk argument missing");
+    result->Error("Argument 'chunk' is required");
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(pending_configs_mutex_);
+  auto pending_it = pending_configs_.find(*arg_tunnel_name);
+  if (pending_it == pending_configs_.end()) {
+    logger_->error("Append tunnel configuration failed: not started for tunnel: {}", *arg_tunnel_name);
+    result->Error("CONFIGURATION_NOT_STARTED", "Call 'beginTunnelConfiguration' first.");
+    return;
+  }
+
+  if (!pending_it->second.Feed(*chunk)) {
+    logger_->error("Append tunnel configuration failed: invalid configuration at line {} for tunnel: {}",
+                   pending_it->second.GetErrorLine(), *arg_tunnel_name);
+    pending_configs_.erase(pending_it);
+    result->Error("CONFIGURATION_FAILED", "Failed to parse WireGuard configuration");
+    return;
+  }
+
+  result->Success();
+}
+
+void WireguardDartPlugin::HandleCompileConfig(const flutter::EncodableMap* args,
+                                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* cfg = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kCfg)) : nullptr;
+  if (cfg == NULL) {
+    logger_->error("Compile config failed: cfg argument missing");
+    result->Error("Argument 'cfg' is required");
+    return;
+  }
+  if (!tunnel_tasks_) {
+    CompileConfig(*cfg, std::move(result));
+    return;
+  }
+
+  // Compiles do not wait for any tunnel, nor the tunnels for them
+  auto worker_cfg = std::make_shared<std::string>(*cfg);
+  auto worker_result = std::make_shared<std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>>>(
+      PlatformResult(std::move(result)));
+  tunnel_tasks_->PostContinuation(
+      [this, worker_cfg, worker_result]() { CompileConfig(*worker_cfg, std::move(*worker_result)); });
+}
+
+void WireguardDartPlugin::CompileConfig(const std::string& cfg,
+                                        std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  auto compiled = std::make_shared<WireguardConfigParser>();
+  if (!compiled->Parse(cfg)) {
+    size_t error_line = compiled->GetErrorLine();
+    logger_->error("Compile config failed: invalid configuration at line {}", error_line);
+    result->Error("CONFIGURATION_FAILED",
+                  "Failed to parse WireGuard configuration at line " + std::to_string(error_line));
+    return;
+  }
+
+  int64_t handle;
+  {
+    std::lock_guard<std::mutex> lock(compiled_configs_mutex_);
+    handle = next_config_handle_++;
+    compiled_configs_.emplace(handle, std::move(compiled));
+  }
+  logger_->info("Compiled configuration {}", handle);
+  result->Success(flutter::EncodableValue(handle));
+}
+
+void WireguardDartPlugin::HandleCancelOperation(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  std::optional<int64_t> operation_id = args ? IntegerArgument(ValueOrNull(*args, keys::kOperationId)) : std::nullopt;
+  if (!operation_id) {
+    logger_->error("Cancel operation failed: operationId argument missing");
+    result->Error("Argument 'operationId' is required");
+    return;
+  }
+
+  // Cancelling one that already finished, or never was, is not an error
+  bool in_progress = operations_.Cancel(*operation_id);
+  logger_->info("Cancel operation {}: {}", *operation_id, in_progress ? "in progress" : "not in progress");
+  result->Success(flutter::EncodableValue(in_progress));
+}
+
+void WireguardDartPlugin::HandleReleaseConfig(const flutter::EncodableMap* args,
+                                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  std::optional<int64_t> handle = args ? IntegerArgument(ValueOrNull(*args, keys::kConfigHandle)) : std::nullopt;
+  if (!handle) {
+    logger_->error("Release config failed: configHandle argument missing");
+    result->Error("Argument 'configHandle' is required");
+    return;
+  }
+
+  // Releasing a handle twice, or one that never was, is not an error
+  std::lock_guard<std::mutex> lock(compiled_configs_mutex_);
+  compiled_configs_.erase(*handle);
+  result->Success();
+}
+
+void WireguardDartPlugin::HandleValidateConfig(const flutter::EncodableMap* args,
+                                               std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* cfg = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kCfg)) : nullptr;
+  if (cfg == NULL) {
+    logger_->error("Validate config failed: cfg argument missing");
+    result->Error("Argument 'cfg' is required");
+    return;
+  }
+
+  // Parsed and routed like setupTunnel would, without the driver, the resolver or the IP helper. The parser is
+  // reused, so validating on every edit allocates nothing once it has seen a configuration as large.
+  int64_t start_us = PerfCounterMicroseconds();
+  flutter::EncodableMap return_value;
+  bool valid = validate_config_.Parse(*cfg);
+  return_value[keys::kValid] = flutter::EncodableValue(valid);
+  if (valid) {
+    DWORD peer_count = validate_config_.GetConfiguration().Interface().PeersCount;
+    return_value[keys::kConfigurationSize] =
+        flutter::EncodableValue(static_cast<int64_t>(validate_config_.CalculateConfigurationSize()));
+    return_value[keys::kPeerCount] = flutter::EncodableValue(static_cast<int64_t>(peer_count));
+    return_value[keys::kRouteCount] =
+        flutter::EncodableValue(static_cast<int64_t>(validate_config_.GetRoutes()->routes.size()));
   } else {
-    logger_->info("Opened existing WireGuard adapter: {}", *arg_tunnel_name);
+    // Line 0 is an error of the configuration as a whole, such as a missing private key
+    size_t error_line = validate_config_.GetErrorLine();
+    return_value[keys::kErrorLine] = flutter::EncodableValue(static_cast<int64_t>(error_line));
+    return_value[keys::kErrorColumn] =
+        flutter::EncodableValue(static_cast<int64_t>(WireguardConfigParser::ErrorColumn(*cfg, error_line)));
   }
+  return_value[keys::kElapsedUs] = flutter::EncodableValue(PerfCounterMicroseconds() - start_us);
+  result->Success(flutter::EncodableValue(std::move(return_value)));
+}
 
-  // Apply configuration to the adapter
-  try {
-    if (!adapter->ApplyConfiguration(*cfg)) {
-      DWORD error_code = GetLastError();
-      std::string error_message = "Failed to apply configuration to adapter";
-      if (error_code != 0) {
-        error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
-        error_message += " Description: " + GetLastErrorAsString(error_code);
-      }
-      logger_->error("Setup tunnel failed: {}", error_message);
-      result->Error("CONFIGURATION_FAILED", error_message);
-      return;
+void WireguardDartPlugin::HandleResolvePeerForAddresses(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* addresses = args ? std::get_if<flutter::EncodableList>(ValueOrNull(*args, keys::kAddresses)) : nullptr;
+  if (addresses == NULL) {
+    logger_->error("Resolve peer for addresses failed: addresses argument missing");
+    result->Error("Argument 'addresses' is required");
+    return;
+  }
+
+  // One snapshot for the whole list, so every address is answered from the same configurations
+  std::shared_ptr<const RouteLookup::Snapshot> routes = route_lookup_.Current();
+  flutter::EncodableList resolved;
+  resolved.reserve(addresses->size());
+  for (const auto& value : *addresses) {
+    const auto* text = std::get_if<std::string>(&value);
+    uint8_t address[16];
+    const RouteLookup::Target* target = nullptr;
+    if (text && ParseIPv4Address(*text, address)) {
+      target = routes->Resolve(AF_INET, address);
+    } else if (text && ParseIPv6Address(*text, address)) {
+      target = routes->Resolve(AF_INET6, address);
+    }
+    if (!target) {
+      resolved.emplace_back();
+      continue;
     }
+    flutter::EncodableMap peer;
+    peer[keys::kTunnelName] = flutter::EncodableValue(target->tunnel_name);
+    peer[keys::kPublicKey] = flutter::EncodableValue(KeyToBase64(target->public_key.data()));
+    resolved.emplace_back(std::move(peer));
+  }
+  result->Success(flutter::EncodableValue(std::move(resolved)));
+}
 
-    // Configure Windows networking for the adapter
-    if (!adapter->ConfigureNetworking()) {
-      DWORD error_code = GetLastError();
-      std::string error_message = "Failed to configure network interface";
-      if (error_code != 0) {
-        error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
-        error_message += " Description: " + GetLastErrorAsString(error_code);
-      }
-      logger_->error("Setup tunnel failed: {}", error_message);
-      result->Error("NETWORK_CONFIGURATION_FAILED", error_message);
-      return;
+MethodTask WireguardDartPlugin::HandleConnectAsync(
+    flutter::EncodableMap args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    [[maybe_unused]] TunnelTaskQueue::Hold hold) {
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(args, keys::kTunnelName));
+  if (!arg_tunnel_name || !tunnel_service::IsInstalled(*arg_tunnel_name)) {
+    HandleConnect(&args, std::move(result));
+    co_return;
+  }
+
+  // The service brings the tunnel up, the app attaches to its adapter to read it
+  logger_->info("Connect initiated for tunnel service: {}", *arg_tunnel_name);
+  DWORD error_code = tunnel_service::RequestStart(*arg_tunnel_name);
+  if (error_code == ERROR_SUCCESS) {
+    // Creating the service's adapter can take seconds, the worker serves other tunnels meanwhile
+    DWORD waited = co_await WaitUntil(
+        TunnelContext(),
+        [arg_tunnel_name, &error_code]() {
+          error_code = tunnel_service::CheckState(*arg_tunnel_name, SERVICE_RUNNING);
+          return error_code != ERROR_IO_PENDING;
+        },
+        tunnel_service::kStatePollInterval, tunnel_service::kStateTimeout);
+    if (error_code == ERROR_IO_PENDING) {
+      error_code = waited == ERROR_TIMEOUT ? ERROR_SERVICE_REQUEST_TIMEOUT : waited;
     }
-    logger_->info("Successfully configured network interface");
-  } catch (const std::exception& e) {
-    DWORD error_code = GetLastError();
-    std::string error_message = "Exception while applying configuration: ";
-    error_message += e.what();
-    if (error_code != 0) {
-      error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
-      error_message += " Description: " + GetLastErrorAsString(error_code);
+  }
+  if (error_code != ERROR_SUCCESS) {
+    std::string error_message = TunnelServiceError("Failed to start the tunnel service.", error_code);
+    logger_->error("Connect failed: {}", error_message);
+    result->Error("TUNNEL_SERVICE_FAILED", error_message);
+    co_return;
+  }
+  if (!adapters_.FindByName(*arg_tunnel_name)) {
+    AttachServiceTunnel(*arg_tunnel_name);
+  }
+  result->Success();
+  logger_->info("Connect completed successfully for tunnel service: {}", *arg_tunnel_name);
+}
+
+MethodTask WireguardDartPlugin::HandleDisconnectAsync(
+    flutter::EncodableMap args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    [[maybe_unused]] TunnelTaskQueue::Hold hold) {
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(args, keys::kTunnelName));
+  if (!arg_tunnel_name || !tunnel_service::IsInstalled(*arg_tunnel_name)) {
+    HandleDisconnect(&args, std::move(result));
+    co_return;
+  }
+
+  // The adapter goes away with the service, and comes back with it on the next start of Windows
+  logger_->info("Disconnect initiated for tunnel service: {}", *arg_tunnel_name);
+  DWORD error_code = tunnel_service::RequestStop(*arg_tunnel_name);
+  if (error_code == ERROR_SUCCESS) {
+    DWORD waited = co_await WaitUntil(
+        TunnelContext(),
+        [arg_tunnel_name, &error_code]() {
+          error_code = tunnel_service::CheckState(*arg_tunnel_name, SERVICE_STOPPED);
+          return error_code != ERROR_IO_PENDING;
+        },
+        tunnel_service::kStatePollInterval, tunnel_service::kStateTimeout);
+    if (error_code == ERROR_IO_PENDING) {
+      error_code = waited == ERROR_TIMEOUT ? ERROR_SERVICE_REQUEST_TIMEOUT : waited;
     }
-    logger_->error("Setup tunnel failed: {}", error_message);
-    result->Error("CONFIGURATION_EXCEPTION", error_message);
+  }
+  if (error_code != ERROR_SUCCESS) {
+    std::string error_message = TunnelServiceError("Failed to stop the tunnel service.", error_code);
+    logger_->error("Disconnect failed: {}", error_message);
+    result->Error("TUNNEL_SERVICE_FAILED", error_message);
+    co_return;
+  }
+  RemoveAdapterByName(*arg_tunnel_name);
+  result->Success();
+  logger_->info("Disconnect completed successfully for tunnel service: {}", *arg_tunnel_name);
+}
+
+void WireguardDartPlugin::HandleTransitionTunnels(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    bool connect) {
+  const char* what = connect ? "Connect tunnels" : "Disconnect tunnels";
+  logger_->info("{} initiated", what);
+
+  const auto* tunnel_names =
+      args ? std::get_if<flutter::EncodableList>(ValueOrNull(*args, keys::kTunnelNames)) : nullptr;
+  if (tunnel_names == NULL) {
+    logger_->error("{} failed: tunnelNames argument missing", what);
+    result->Error("Argument 'tunnelNames' is required");
     return;
-  } catch (...) {
-    DWORD error_code = GetLastError();
-    std::string error_message = "Unknown error occurred while applying configuration.";
-    if (error_code != 0) {
-      error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
-      error_message += " Description: " + GetLastErrorAsString(error_code);
+  }
+  // A name twice would answer for one of them only
+  std::vector<std::string> names;
+  std::set<std::string> distinct_names;
+  for (const auto& value : *tunnel_names) {
+    const auto* tunnel_name = std::get_if<std::string>(&value);
+    if (tunnel_name == NULL || tunnel_name->empty() || !distinct_names.insert(*tunnel_name).second) {
+      logger_->error("{} failed: tunnelNames is not a list of distinct names", what);
+      result->Error("Argument 'tunnelNames' needs to be a list of distinct tunnel names");
+      return;
     }
-    logger_->error("Setup tunnel failed: {}", error_message);
-    result->Error("UNKNOWN_ERROR", error_message);
+    names.push_back(*tunnel_name);
+  }
+
+  if (names.empty()) {
+    flutter::EncodableMap answer;
+    answer[keys::kElapsedMs] = flutter::EncodableValue(static_cast<int64_t>(0));
+    answer[keys::kTunnels] = flutter::EncodableValue(flutter::EncodableMap());
+    result->Success(flutter::EncodableValue(std::move(answer)));
     return;
   }
 
-  // Set adapter to DOWN state initially - connect will bring it up
-  if (!adapter->SetState(WIREGUARD_ADAPTER_STATE_DOWN)) {
-    DWORD error_code = GetLastError();
-    std::string error_message = "Failed to set adapter state to DOWN after configuration";
-    if (error_code != 0) {
-      error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
-      error_message += " Description: " + GetLastErrorAsString(error_code);
+  // The interface changes of the whole group are read once per adapter rather than once per notification, and
+  // the status events they send come out in the same few drains
+  group_transitions_++;
+  ApplyStatusCoalesce();
+
+  // Each tunnel connects or disconnects on its worker like a connect or disconnect call, so they run in parallel
+  // with each other and in order with the other calls for the same tunnel. The last one to finish answers for all.
+  struct Group {
+    std::mutex mutex;
+    flutter::EncodableMap tunnels;
+    size_t remaining;
+    int64_t start_us;
+  };
+  auto group = std::make_shared<Group>();
+  group->remaining = names.size();
+  group->start_us = PerfCounterMicroseconds();
+  std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> platform_result(std::move(result));
+  PlatformTaskRunner* platform_tasks = platform_tasks_.get();
+  auto record = [this, group, platform_result, platform_tasks, what](const std::string& tunnel_name,
+                                                                     flutter::EncodableMap tunnel_result) {
+    int64_t elapsed_ms = (PerfCounterMicroseconds() - group->start_us) / 1000;
+    tunnel_result[keys::kElapsedMs] = flutter::EncodableValue(elapsed_ms);
+    std::unique_lock<std::mutex> lock(group->mutex);
+    group->tunnels[flutter::EncodableValue(tunnel_name)] = flutter::EncodableValue(std::move(tunnel_result));
+    if (--group->remaining > 0) {
+      return;
     }
-    logger_->warn("Setup tunnel warning: {}", error_message);
-    // Continue with setup even if setting state fails
+    auto answer = std::make_shared<flutter::EncodableMap>();
+    (*answer)[keys::kElapsedMs] = flutter::EncodableValue(elapsed_ms);
+    (*answer)[keys::kTunnels] = flutter::EncodableValue(std::move(group->tunnels));
+    lock.unlock();
+    logger_->info("{} completed in {} ms", what, elapsed_ms);
+    platform_tasks->Post([this, platform_result, answer]() {
+      group_transitions_--;
+      ApplyStatusCoalesce();
+      platform_result->Success(flutter::EncodableValue(*answer));
+    });
+  };
+
+  AsyncMethodHandler handler =
+      connect ? &WireguardDartPlugin::HandleConnectAsync : &WireguardDartPlugin::HandleDisconnectAsync;
+  for (const std::string& tunnel_name : names) {
+    // The options of the call apply to every tunnel
+    auto tunnel_args = std::make_shared<flutter::EncodableMap>(*args);
+    tunnel_args->erase(flutter::EncodableValue(keys::kTunnelNames));
+    (*tunnel_args)[keys::kTunnelName] = flutter::EncodableValue(tunnel_name);
+    auto tunnel_result = std::make_unique<flutter::MethodResultFunctions<flutter::EncodableValue>>(
+        [record, tunnel_name](const flutter::EncodableValue*) { record(tunnel_name, flutter::EncodableMap()); },
+        [record, tunnel_name](const std::string& code, const std::string& message, const flutter::EncodableValue*) {
+          flutter::EncodableMap error;
+          error[keys::kErrorCode] = flutter::EncodableValue(code);
+          error[keys::kErrorMessage] = flutter::EncodableValue(message);
+          record(tunnel_name, std::move(error));
+        },
+        [record, tunnel_name, what]() {
+          flutter::EncodableMap error;
+          error[keys::kErrorCode] = flutter::EncodableValue("NOT_IMPLEMENTED");
+          error[keys::kErrorMessage] = flutter::EncodableValue(std::string(what) + " is not implemented");
+          record(tunnel_name, std::move(error));
+        });
+
+    if (!tunnel_tasks_) {
+      (this->*handler)(std::move(*tunnel_args), std::move(tunnel_result), TunnelTaskQueue::Hold());
+      continue;
+    }
+    auto worker_result =
+        std::make_shared<std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>>>(std::move(tunnel_result));
+    tunnel_tasks_->PostHeld(tunnel_name, [this, handler, tunnel_args, worker_result](TunnelTaskQueue::Hold hold) {
+      (this->*handler)(std::move(*tunnel_args), std::move(*worker_result), std::move(hold));
+    });
+  }
+  logger_->info("{} queued for {} tunnels", what, names.size());
+}
+
+MethodTask WireguardDartPlugin::HandleRunThroughputTestAsync(
+    flutter::EncodableMap args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+    [[maybe_unused]] TunnelTaskQueue::Hold hold) {
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(args, keys::kTunnelName));
+  const auto* arg_target = std::get_if<std::string>(ValueOrNull(args, keys::kTarget));
+  if (!arg_tunnel_name || !arg_target) {
+    logger_->error("Throughput test failed: tunnelName or target argument missing");
+    result->Error("Arguments 'tunnelName' and 'target' are required");
+    co_return;
+  }
+  ThroughputTest::Options options;
+  if (!WireguardConfigParser::ParseEndpoint(*arg_target, options.target)) {
+    logger_->error("Throughput test failed: target is not an address and port: {}", *arg_target);
+    result->Error("INVALID_TARGET", "The target must be an IP address and port, such as 10.0.0.1:5201");
+    co_return;
+  }
+  const auto* arg_protocol = std::get_if<std::string>(ValueOrNull(args, keys::kProtocol));
+  if (arg_protocol && *arg_protocol == "udp") {
+    options.protocol = ThroughputTest::Protocol::kUdp;
+  }
+  if (std::optional<int64_t> streams = IntegerArgument(ValueOrNull(args, keys::kStreams)); streams && *streams > 0) {
+    options.streams = static_cast<uint32_t>(std::min<int64_t>(*streams, ThroughputTest::kMaxStreams));
+  }
+  if (std::optional<int64_t> duration_ms = IntegerArgument(ValueOrNull(args, keys::kDurationMs));
+      duration_ms && *duration_ms > 0) {
+    options.duration = std::min(std::chrono::milliseconds(*duration_ms), ThroughputTest::kMaxDuration);
   }
 
-  // Store the adapter
   NET_LUID luid;
-  std::map<flutter::EncodableValue, flutter::EncodableValue> return_value;
-  if (adapter->GetLUID(&luid)) {
-    this->network_adapter_observer_->StartObserving(luid);
-    return_value[flutter::EncodableValue("luid")] = flutter::EncodableValue(static_cast<int64_t>(luid.Value));
-  } else {
-    logger_->warn("Failed to get LUID for adapter: {}", *arg_tunnel_name);
-    return_value[flutter::EncodableValue("luid")] = flutter::EncodableValue();
+  bool found;
+  {
+    auto lock = adapters_.LockShared();
+    found = adapters_.GetLuidLocked(*arg_tunnel_name, &luid);
+  }
+  if (!found || ConvertInterfaceLuidToIndex(&luid, &options.interface_index) != NO_ERROR) {
+    logger_->error("Throughput test failed: adapter not found: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    co_return;
   }
-  adapters_.push_back(std::move(adapter));
 
-  result->Success(flutter::EncodableValue(return_value));
-  logger_->info("Setup tunnel completed successfully for adapter: {}", *arg_tunnel_name);
+  logger_->info("Throughput test initiated for tunnel {}: {} {} streams to {} for {} ms", *arg_tunnel_name,
+                options.streams, options.protocol == ThroughputTest::Protocol::kTcp ? "TCP" : "UDP", *arg_target,
+                options.duration.count());
+  ThroughputTest test(&io_reactor_, options);
+  if (!test.Start()) {
+    DWORD error_code = GetLastError();
+    logger_->error("Throughput test failed: could not open its streams. Windows Error Code: {} - {}", error_code,
+                   GetLastErrorAsString(error_code));
+    result->Error("THROUGHPUT_TEST_FAILED", "Failed to open the test streams: " + GetLastErrorAsString(error_code));
+    co_return;
+  }
+
+  // Once a second, what the test sent and what the tunnel's counters moved by, read the way the sampler reads them
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point started = Clock::now();
+  Clock::time_point give_up = started + options.duration + ThroughputTest::kConnectGrace;
+  WireguardAdapter::Totals previous;
+  bool has_previous = ReadTotals(arg_tunnel_name, &previous) == ReadResult::kOk;
+  uint64_t previous_sent = 0;
+  flutter::EncodableList samples;
+  while (!test.Finished() && Clock::now() < give_up) {
+    DWORD waited = co_await WaitUntil(
+        TunnelContext(), [&test]() { return test.Finished(); }, ThroughputTest::kSampleInterval,
+        ThroughputTest::kSampleInterval);
+    // Without a wait the loop would spin; the test stops with what it sent so far
+    if (waited != ERROR_SUCCESS && waited != ERROR_TIMEOUT) {
+      break;
+    }
+    uint64_t sent = test.BytesSent();
+    WireguardAdapter::Totals totals;
+    bool has_totals = ReadTotals(arg_tunnel_name, &totals) == ReadResult::kOk;
+    flutter::EncodableMap sample;
+    sample[keys::kElapsedMs] = flutter::EncodableValue(
+        static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count()));
+    sample[keys::kBytesSent] = flutter::EncodableValue(static_cast<int64_t>(sent - previous_sent));
+    // Counters that went back were reset along with the tunnel
+    if (has_totals && has_previous && totals.tx_bytes >= previous.tx_bytes && totals.rx_bytes >= previous.rx_bytes) {
+      sample[keys::kTxBytes] = flutter::EncodableValue(static_cast<int64_t>(totals.tx_bytes - previous.tx_bytes));
+      sample[keys::kRxBytes] = flutter::EncodableValue(static_cast<int64_t>(totals.rx_bytes - previous.rx_bytes));
+    }
+    samples.emplace_back(std::move(sample));
+    previous_sent = sent;
+    previous = totals;
+    has_previous = has_totals;
+  }
+
+  ThroughputTest::Result test_result = test.Stop();
+  if (test_result.streams_connected == 0) {
+    logger_->error("Throughput test failed: no stream reached {}. Windows Error Code: {} - {}", *arg_target,
+                   test_result.error, GetLastErrorAsString(test_result.error));
+    result->Error("THROUGHPUT_TEST_FAILED", "No stream reached the target: " + GetLastErrorAsString(test_result.error));
+    co_return;
+  }
+  flutter::EncodableMap value;
+  value[keys::kStreams] = flutter::EncodableValue(static_cast<int32_t>(test_result.streams_connected));
+  value[keys::kElapsedMs] = flutter::EncodableValue(static_cast<int64_t>(test_result.elapsed_ms));
+  value[keys::kBytesSent] = flutter::EncodableValue(static_cast<int64_t>(test_result.bytes_sent));
+  value[keys::kBytesDelivered] = flutter::EncodableValue(static_cast<int64_t>(test_result.BytesDelivered()));
+  value[keys::kGoodputBps] = flutter::EncodableValue(static_cast<int64_t>(test_result.GoodputBitsPerSecond()));
+  value[keys::kSendErrors] = flutter::EncodableValue(static_cast<int64_t>(test_result.send_errors));
+  // Only where Windows has SIO_TCP_INFO
+  if (test_result.has_tcp_info) {
+    value[keys::kBytesRetransmitted] = flutter::EncodableValue(static_cast<int64_t>(test_result.bytes_retransmitted));
+    value[keys::kFastRetransmits] = flutter::EncodableValue(static_cast<int32_t>(test_result.fast_retransmits));
+    value[keys::kTimeoutEpisodes] = flutter::EncodableValue(static_cast<int32_t>(test_result.timeout_episodes));
+    value[keys::kRttUs] = flutter::EncodableValue(static_cast<int32_t>(test_result.rtt_us));
+    value[keys::kMss] = flutter::EncodableValue(static_cast<int32_t>(test_result.mss));
+  }
+  // Why a stream stopped before its time was up
+  if (test_result.error != ERROR_SUCCESS) {
+    value[keys::kErrorMessage] = flutter::EncodableValue(GetLastErrorAsString(test_result.error));
+  }
+  value[keys::kSamples] = flutter::EncodableValue(std::move(samples));
+  logger_->info("Throughput test completed for tunnel {}: {} bit/s over {} ms", *arg_tunnel_name,
+                test_result.GoodputBitsPerSecond(), test_result.elapsed_ms);
+  result->Success(flutter::EncodableValue(std::move(value)));
 }
 
 void WireguardDartPlugin::HandleConnect(const flutter::EncodableMap* args,
                                         std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  TraceRegion trace_region("Connect");
   logger_->info("Connect initiated");
 
   // Get required arguments
-  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, "tunnelName"));
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName));
   if (arg_tunnel_name == NULL) {
     logger_->error("Connect failed: tunnelName argument missing");
     result->Error("Argument 'tunnelName' is required");
     return;
   }
 
-  // Find the adapter by name
-  std::wstring adapter_name = Utf8ToWide(*arg_tunnel_name);
-  WireguardAdapter* target_adapter = FindAdapterByName(adapter_name);
-
-  if (!target_adapter) {
-    logger_->error("Connect failed: adapter not found: {}", *arg_tunnel_name);
-    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+  // Find the adapter by name
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
+
+  if (!target_adapter) {
+    logger_->error("Connect failed: adapter not found: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    return;
+  }
+
+  if (!target_adapter->IsValid()) {
+    logger_->error("Connect failed: adapter is not valid: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_INVALID", "Adapter is not valid");
+    return;
+  }
+
+  // The probes run while the arguments are read and the adapter is watched
+  std::optional<ConnectPrecheck> precheck;
+  const auto* arg_precheck = std::get_if<bool>(ValueOrNull(*args, keys::kPrecheck));
+  if (arg_precheck && *arg_precheck) {
+    precheck.emplace();
+  }
+  std::optional<WireguardAdapter::ActivationOptions> activation;
+  std::string activation_error;
+  if (!ParseActivation(*args, &activation, &activation_error)) {
+    logger_->error("Connect failed: {}", activation_error);
+    result->Error("INVALID_ARGUMENT", activation_error);
+    return;
+  }
+
+  // Resolved once the tunnel's addresses are usable, see PrefetchHosts
+  std::vector<std::string> prefetch_hosts;
+  if (const auto* arg_hosts = std::get_if<flutter::EncodableList>(ValueOrNull(*args, keys::kPrefetchHosts))) {
+    bool valid = arg_hosts->size() <= kMaxPrefetchHosts;
+    for (size_t i = 0; valid && i < arg_hosts->size(); i++) {
+      const auto* host = std::get_if<std::string>(&(*arg_hosts)[i]);
+      valid = host && !host->empty() && host->size() <= kMaxHostnameLength;
+      if (valid) {
+        prefetch_hosts.push_back(*host);
+      }
+    }
+    if (!valid) {
+      logger_->error("Connect failed: prefetchHosts argument is not a list of hostnames");
+      result->Error("Argument 'prefetchHosts' must be a list of at most " + std::to_string(kMaxPrefetchHosts) +
+                    " hostnames");
+      return;
+    }
+  }
+
+  if (precheck && !PassPrecheck(*precheck, target_adapter, "Connect", *result)) {
     return;
   }
 
-  if (!target_adapter->IsValid()) {
-    logger_->error("Connect failed: adapter is not valid: {}", *arg_tunnel_name);
-    result->Error("ADAPTER_INVALID", "Adapter is not valid");
-    return;
+  // Armed before the adapter comes up, so that the ready event cannot be missed
+  NET_LUID luid;
+  bool has_luid = target_adapter->GetLUID(&luid);
+  if (has_luid) {
+    {
+      // Replaces what an earlier connect asked for that never got to run
+      std::lock_guard<std::mutex> lock(prefetch_mutex_);
+      if (prefetch_hosts.empty()) {
+        prefetch_hosts_.erase(luid.Value);
+      } else {
+        prefetch_hosts_[luid.Value] = std::move(prefetch_hosts);
+      }
+    }
+    WatchAdapter(*arg_tunnel_name, target_adapter, luid);
+    network_adapter_observer_->NotifyConnecting(luid);
+  }
+  if (activation) {
+    StagePeers(target_adapter, *activation, has_luid ? std::optional<NET_LUID>(luid) : std::nullopt);
   }
 
   // Set adapter state to UP
+  PhaseTimer timer(perf_stats_.get());
   try {
     if (!target_adapter->SetState(WIREGUARD_ADAPTER_STATE_UP)) {
       DWORD error_code = GetLastError();
@@ -475,14 +3867,11 @@ void WireguardDartPlugin::HandleConnect(const flutter::EncodableMap* args,
     return;
   }
 
-  // Start observing the adapter (it should already be started from setup, but
-  // ensure it's running)
-  NET_LUID luid;
-  if (target_adapter->GetLUID(&luid)) {
-    if (!this->network_adapter_observer_->IsMonitoring(luid)) {
-      this->network_adapter_observer_->StartObserving(luid);
-    }
-  }
+  timer.Lap("connect");
+  // The status turns connected with the handshake, a warm-up only makes it come without waiting for traffic
+  const auto* arg_warm_up = std::get_if<bool>(ValueOrNull(*args, keys::kWarmUp));
+  TimeFirstHandshake(target_adapter, has_luid ? std::optional<NET_LUID>(luid) : std::nullopt,
+                     arg_warm_up && *arg_warm_up);
 
   result->Success();
   logger_->info("Connect completed successfully for adapter: {}", *arg_tunnel_name);
@@ -490,10 +3879,11 @@ void WireguardDartPlugin::HandleConnect(const flutter::EncodableMap* args,
 
 void WireguardDartPlugin::HandleDisconnect(const flutter::EncodableMap* args,
                                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  TraceRegion trace_region("Disconnect");
   logger_->info("Disconnect initiated");
 
   // Get required arguments
-  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, "tunnelName"));
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName));
   if (arg_tunnel_name == NULL) {
     logger_->error("Disconnect failed: tunnelName argument missing");
     result->Error("Argument 'tunnelName' is required");
@@ -501,8 +3891,7 @@ void WireguardDartPlugin::HandleDisconnect(const flutter::EncodableMap* args,
   }
 
   // Find the adapter by name
-  std::wstring adapter_name = Utf8ToWide(*arg_tunnel_name);
-  WireguardAdapter* target_adapter = FindAdapterByName(adapter_name);
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
 
   if (!target_adapter) {
     logger_->error("Disconnect failed: adapter not found: {}", *arg_tunnel_name);
@@ -516,6 +3905,20 @@ void WireguardDartPlugin::HandleDisconnect(const flutter::EncodableMap* args,
     return;
   }
 
+  // Disconnecting until the interface is down, and back to what it was if it does not go down
+  NET_LUID luid;
+  bool has_luid = target_adapter->GetLUID(&luid);
+  if (has_luid) {
+    network_adapter_observer_->NotifyDisconnecting(luid);
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    prefetch_hosts_.erase(luid.Value);
+  }
+  auto cancel_disconnecting = [&]() {
+    if (has_luid) {
+      network_adapter_observer_->NotifyDisconnecting(luid, false);
+    }
+  };
+
   // Set adapter state to DOWN
   try {
     if (!target_adapter->SetState(WIREGUARD_ADAPTER_STATE_DOWN)) {
@@ -525,6 +3928,7 @@ void WireguardDartPlugin::HandleDisconnect(const flutter::EncodableMap* args,
         error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
         error_message += " Description: " + GetLastErrorAsString(error_code);
       }
+      cancel_disconnecting();
       logger_->error("Disconnect failed: {}", error_message);
       result->Error("ADAPTER_STATE_FAILED", error_message);
       return;
@@ -537,6 +3941,7 @@ void WireguardDartPlugin::HandleDisconnect(const flutter::EncodableMap* args,
       error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
       error_message += " Description: " + GetLastErrorAsString(error_code);
     }
+    cancel_disconnecting();
     logger_->error("Disconnect failed: {}", error_message);
     result->Error("ADAPTER_EXCEPTION", error_message);
     return;
@@ -547,6 +3952,7 @@ void WireguardDartPlugin::HandleDisconnect(const flutter::EncodableMap* args,
       error_message += " Windows Error Code: " + std::to_string(error_code) + ".";
       error_message += " Description: " + GetLastErrorAsString(error_code);
     }
+    cancel_disconnecting();
     logger_->error("Disconnect failed: {}", error_message);
     result->Error("UNKNOWN_ERROR", error_message);
     return;
@@ -556,46 +3962,655 @@ void WireguardDartPlugin::HandleDisconnect(const flutter::EncodableMap* args,
   logger_->info("Disconnect completed successfully for adapter: {}", *arg_tunnel_name);
 }
 
+void WireguardDartPlugin::HandleInstallTunnelService(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  TraceRegion trace_region("InstallTunnelService");
+  logger_->info("Install tunnel service initiated");
+
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  const auto* cfg = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kCfg)) : nullptr;
+  if (!arg_tunnel_name || !cfg) {
+    logger_->error("Install tunnel service failed: tunnelName or cfg argument missing");
+    result->Error("Arguments 'tunnelName' and 'cfg' are required");
+    return;
+  }
+
+  // The service creates an adapter of the same name; one the app set up itself makes way for it
+  route_lookup_.RemoveTunnel(*arg_tunnel_name);
+  link_quality_prober_.RemoveTunnel(*arg_tunnel_name);
+  std::unique_ptr<WireguardAdapter> previous = adapters_.Remove(*arg_tunnel_name);
+  if (previous) {
+    NET_LUID luid;
+    if (previous->GetLUID(&luid)) {
+      network_adapter_observer_->StopObserving(luid);
+    }
+    if (!previous->CleanupNetworking()) {
+      logger_->warn("Failed to clean up the networking of {} before installing its service", *arg_tunnel_name);
+    }
+    previous.reset();
+  }
+
+  DWORD error_code = tunnel_service::Install(*arg_tunnel_name, *cfg);
+  if (error_code != ERROR_SUCCESS) {
+    std::string error_message = TunnelServiceError("Failed to install the tunnel service.", error_code);
+    logger_->error("Install tunnel service failed: {}", error_message);
+    result->Error("TUNNEL_SERVICE_FAILED", error_message);
+    return;
+  }
+  AttachServiceTunnel(*arg_tunnel_name);
+
+  result->Success();
+  logger_->info("Install tunnel service completed successfully for tunnel: {}", *arg_tunnel_name);
+}
+
+void WireguardDartPlugin::HandleRemoveTunnelService(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  logger_->info("Remove tunnel service initiated");
+
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!arg_tunnel_name) {
+    logger_->error("Remove tunnel service failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+
+  WireguardAdapter* attached = adapters_.FindByName(*arg_tunnel_name);
+  if (attached && attached->IsServiceOwned()) {
+    RemoveAdapterByName(*arg_tunnel_name);
+  }
+  DWORD error_code = tunnel_service::Remove(*arg_tunnel_name);
+  if (error_code != ERROR_SUCCESS) {
+    std::string error_message = TunnelServiceError("Failed to remove the tunnel service.", error_code);
+    logger_->error("Remove tunnel service failed: {}", error_message);
+    result->Error("TUNNEL_SERVICE_FAILED", error_message);
+    return;
+  }
+
+  result->Success();
+  logger_->info("Remove tunnel service completed successfully for tunnel: {}", *arg_tunnel_name);
+}
+
+void WireguardDartPlugin::HandleSetSplitTunnel(const flutter::EncodableMap* args,
+                                               std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  logger_->info("Set split tunnel initiated");
+
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  const auto* arg_mode = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kMode)) : nullptr;
+  if (!arg_tunnel_name || !arg_mode) {
+    logger_->error("Set split tunnel failed: tunnelName or mode argument missing");
+    result->Error("Arguments 'tunnelName' and 'mode' are required");
+    return;
+  }
+
+  AppSplitTunnel::Mode mode;
+  if (*arg_mode == "include") {
+    mode = AppSplitTunnel::Mode::kInclude;
+  } else if (*arg_mode == "exclude") {
+    mode = AppSplitTunnel::Mode::kExclude;
+  } else if (*arg_mode == "off") {
+    mode = AppSplitTunnel::Mode::kOff;
+  } else {
+    result->Error("Argument 'mode' must be 'include', 'exclude' or 'off'");
+    return;
+  }
+
+  std::vector<std::wstring> apps;
+  if (const auto* arg_apps = std::get_if<flutter::EncodableList>(ValueOrNull(*args, keys::kApps))) {
+    for (const auto& value : *arg_apps) {
+      const auto* app = std::get_if<std::string>(&value);
+      if (!app || app->empty()) {
+        result->Error("Argument 'apps' must be a list of executable paths or package SIDs");
+        return;
+      }
+      apps.push_back(Utf8ToWide(*app));
+    }
+  }
+
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (!target_adapter) {
+    logger_->error("Set split tunnel failed: adapter not found: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    return;
+  }
+
+  std::string error_message;
+  if (!target_adapter->SetSplitTunnel(mode, apps, &error_message)) {
+    logger_->error("Set split tunnel failed: {}", error_message);
+    result->Error("SPLIT_TUNNEL_FAILED", error_message);
+    return;
+  }
+
+  result->Success();
+  logger_->info("Set split tunnel completed successfully for tunnel: {}", *arg_tunnel_name);
+}
+
+void WireguardDartPlugin::HandleSetAdapterLogging(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  const auto* arg_mode = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kMode)) : nullptr;
+  if (!arg_tunnel_name || !arg_mode) {
+    logger_->error("Set adapter logging failed: tunnelName or mode argument missing");
+    result->Error("Arguments 'tunnelName' and 'mode' are required");
+    return;
+  }
+
+  AdapterLogMode mode;
+  if (*arg_mode == "off") {
+    mode = AdapterLogMode::kOff;
+  } else if (*arg_mode == "on") {
+    mode = AdapterLogMode::kOn;
+  } else if (*arg_mode == "onWithPrefix") {
+    mode = AdapterLogMode::kOnWithPrefix;
+  } else {
+    result->Error("Argument 'mode' must be 'off', 'on' or 'onWithPrefix'");
+    return;
+  }
+
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (!target_adapter) {
+    logger_->error("Set adapter logging failed: adapter not found: {}", *arg_tunnel_name);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    return;
+  }
+
+  if (!target_adapter->SetLogMode(mode)) {
+    DWORD error_code = GetLastError();
+    logger_->error("Set adapter logging failed for tunnel {}. Windows Error Code: {} - {}", *arg_tunnel_name,
+                   error_code, GetLastErrorAsString(error_code));
+    result->Error("SET_ADAPTER_LOGGING_FAILED", "Failed to set the adapter's logging: " +
+                                                    GetLastErrorAsString(error_code));
+    return;
+  }
+
+  result->Success();
+  logger_->info("Adapter logging of tunnel {} set to {}", *arg_tunnel_name, *arg_mode);
+}
+
+void WireguardDartPlugin::HandleGetAdapterLog(const flutter::EncodableMap* args,
+                                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!arg_tunnel_name) {
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+  const auto* max_lines = std::get_if<int32_t>(ValueOrNull(*args, keys::kMaxLines));
+
+  WireguardAdapter* target_adapter = adapters_.FindByName(*arg_tunnel_name);
+  if (!target_adapter) {
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' first.");
+    return;
+  }
+
+  // Left in the ring, unlike a dump to the file log
+  std::vector<spdlog::details::log_msg_buffer> records = target_adapter->GetDriverLog();
+  size_t first = max_lines && *max_lines > 0 && static_cast<size_t>(*max_lines) < records.size()
+                     ? records.size() - static_cast<size_t>(*max_lines)
+                     : 0;
+  flutter::EncodableList lines;
+  auto formatter = MakeLogFormatter(kLeanLogPattern, "");
+  for (size_t i = first; i < records.size(); i++) {
+    spdlog::memory_buf_t formatted;
+    formatter->format(records[i], formatted);
+    lines.push_back(flutter::EncodableValue(std::string(formatted.data(), formatted.size())));
+  }
+  result->Success(flutter::EncodableValue(lines));
+}
+
+void WireguardDartPlugin::HandleSetFailoverGroup(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  logger_->info("Set failover group initiated");
+
+  const auto* arg_primary = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kPrimaryTunnel)) : nullptr;
+  const auto* arg_standby = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kStandbyTunnel)) : nullptr;
+  if (!arg_primary || !arg_standby || *arg_primary == *arg_standby) {
+    logger_->error("Set failover group failed: primaryTunnel or standbyTunnel argument missing or the same");
+    result->Error("Arguments 'primaryTunnel' and 'standbyTunnel' are required and must differ");
+    return;
+  }
+
+  NET_LUID primary_luid;
+  NET_LUID standby_luid;
+  bool found;
+  {
+    auto lock = adapters_.LockShared();
+    found = adapters_.GetLuidLocked(*arg_primary, &primary_luid) &&
+            adapters_.GetLuidLocked(*arg_standby, &standby_luid);
+  }
+  if (!found) {
+    logger_->error("Set failover group failed: adapter not found: {} or {}", *arg_primary, *arg_standby);
+    result->Error("ADAPTER_NOT_FOUND", "Adapter not found. Call 'setupTunnel' for both tunnels first.");
+    return;
+  }
+
+  // Tunnels leaving a group set before stop being probed, those of this one start
+  std::vector<std::string> probed = failover_groups_.Members(*arg_primary);
+  for (std::string& member : failover_groups_.Members(*arg_standby)) {
+    probed.push_back(std::move(member));
+  }
+  probed.push_back(*arg_primary);
+  probed.push_back(*arg_standby);
+  DWORD error_code = failover_groups_.Set(*arg_primary, primary_luid, *arg_standby, standby_luid);
+  UpdateFailoverProbes(probed);
+  if (error_code != ERROR_SUCCESS) {
+    logger_->error("Set failover group failed: could not set the interface metrics. Windows Error Code: {} - {}",
+                   error_code, GetLastErrorAsString(error_code));
+    result->Error("FAILOVER_FAILED", "Failed to set the interface metrics: " + GetLastErrorAsString(error_code));
+    return;
+  }
+  result->Success();
+  logger_->info("Set failover group completed successfully: {} to {}", *arg_primary, *arg_standby);
+}
+
+void WireguardDartPlugin::HandleRemoveFailoverGroup(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (!arg_tunnel_name) {
+    logger_->error("Remove failover group failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+  std::vector<std::string> members = failover_groups_.Members(*arg_tunnel_name);
+  bool removed = failover_groups_.Remove(*arg_tunnel_name);
+  UpdateFailoverProbes(members);
+  result->Success(flutter::EncodableValue(removed));
+}
+
+void WireguardDartPlugin::UpdateFailoverProbes(const std::vector<std::string>& tunnel_names) {
+  for (const std::string& tunnel_name : tunnel_names) {
+    auto probe = [this, tunnel_name]() {
+      if (WireguardAdapter* adapter = adapters_.FindByName(tunnel_name)) {
+        adapter->SetProbing(!failover_groups_.Members(tunnel_name).empty());
+      }
+    };
+    // On the worker, which alone removes the adapter
+    if (tunnel_tasks_) {
+      tunnel_tasks_->Post(tunnel_name, probe);
+    } else {
+      probe();
+    }
+  }
+}
+
 void WireguardDartPlugin::HandleStatus(const flutter::EncodableMap* args,
                                        std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
-  logger_->info("Status check initiated");
+  // Polled several times a second by some apps, so nothing here logs above debug
+  SPDLOG_LOGGER_DEBUG(logger_, "Status check initiated");
 
   // Get required arguments
-  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, "win32ServiceName"));
+  const auto* arg_tunnel_name = std::get_if<std::string>(ValueOrNull(*args, keys::kWin32ServiceName));
   if (arg_tunnel_name == NULL) {
     logger_->error("Status check failed: win32ServiceName argument missing");
     result->Error("Argument 'win32ServiceName' is required");
     return;
   }
 
-  // Find the adapter by name
-  std::wstring adapter_name = Utf8ToWide(*arg_tunnel_name);
-  WireguardAdapter* target_adapter = FindAdapterByName(adapter_name);
+  try {
+    ConnectionStatus status = ReadStatus(*arg_tunnel_name);
+    result->Success(ConnectionStatusToString(status));
+    SPDLOG_LOGGER_DEBUG(logger_, "Status check completed - adapter: {}, status: {}", *arg_tunnel_name,
+                        ConnectionStatusToString(status));
+  } catch (std::exception& e) {
+    logger_->error("Status check failed: {}", e.what());
+    result->Error(std::string(e.what()));
+  }
+}
 
-  if (!target_adapter) {
-    logger_->info("Status check completed - adapter not found, returning disconnected");
-    result->Success(ConnectionStatusToString(ConnectionStatus::disconnected));
+void WireguardDartPlugin::HandleSubscribeStatus(
+    uint64_t engine, const flutter::EncodableMap* args,
+    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  std::optional<int64_t> id = args ? IntegerArgument(ValueOrNull(*args, keys::kSubscription)) : std::nullopt;
+  if (!id) {
+    result->Error("Argument 'subscription' is required");
+    return;
+  }
+  NetworkAdapterStatusObserver::StatusFilter filter;
+  std::string error;
+  if (!NetworkAdapterStatusObserver::ParseFilter(*args, &filter, &error)) {
+    result->Error(error);
     return;
   }
+  network_adapter_observer_->Subscribe(engine, *id, std::move(filter));
+  result->Success();
+}
 
-  if (!target_adapter->IsValid()) {
-    logger_->info("Status check completed - adapter invalid, returning disconnected");
-    result->Success(ConnectionStatusToString(ConnectionStatus::disconnected));
+void WireguardDartPlugin::HandleUnsubscribeStatus(
+    uint64_t engine, const flutter::EncodableMap* args,
+    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  std::optional<int64_t> id = args ? IntegerArgument(ValueOrNull(*args, keys::kSubscription)) : std::nullopt;
+  if (!id) {
+    result->Error("Argument 'subscription' is required");
     return;
   }
+  network_adapter_observer_->Unsubscribe(engine, *id);
+  result->Success();
+}
 
-  try {
-    WIREGUARD_ADAPTER_STATE state = target_adapter->GetState();
-    ConnectionStatus status =
-        (state == WIREGUARD_ADAPTER_STATE_UP) ? ConnectionStatus::connected : ConnectionStatus::disconnected;
+void WireguardDartPlugin::HandleStatusAll(std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  // For dashboards that refresh every tunnel at once, so like status nothing here logs above debug
+  flutter::EncodableMap tunnels;
+  {
+    auto lock = adapters_.LockShared();
+    adapters_.ForEachLocked([this, &tunnels](const std::string& name, WireguardAdapter* adapter) {
+      if (!adapter->IsValid()) {
+        return;
+      }
+      flutter::EncodableMap tunnel;
+      NET_LUID luid;
+      bool has_luid = adapters_.GetLuidLocked(name, &luid);
+      std::optional<NetworkAdapterStatusObserver::ObservedStatus> observed;
+      if (has_luid) {
+        tunnel[keys::kLuid] = flutter::EncodableValue(static_cast<int64_t>(luid.Value));
+        observed = network_adapter_observer_->GetObservedTransition(luid);
+      }
+      if (observed && ConnectionStatusFromString(observed->status) != ConnectionStatus::unknown) {
+        tunnel[keys::kStatus] = flutter::EncodableValue(observed->status);
+        tunnel[keys::kChangedAt] = flutter::EncodableValue(observed->since_ms);
+        tunnel[keys::kChangedAtMonotonicUs] = flutter::EncodableValue(observed->since_monotonic_us);
+      } else {
+        // Not observed, which only a tunnel set up outside this process is: the state the workers last set or read,
+        // as the driver is not read here on the platform thread under the adapters lock
+        std::optional<WIREGUARD_ADAPTER_STATE> state = adapter->GetKnownState();
+        ConnectionStatus status = ConnectionStatus::unknown;
+        if (state) {
+          status = *state == WIREGUARD_ADAPTER_STATE_UP ? ConnectionStatus::connected : ConnectionStatus::disconnected;
+        }
+        tunnel[keys::kStatus] = flutter::EncodableValue(ConnectionStatusToString(status));
+      }
+      // The last read of the sampler or of a status or statistics call, for the same reason
+      std::optional<uint64_t> handshake = adapter->GetKnownHandshake();
+      if (handshake && *handshake != 0) {
+        tunnel[keys::kLatestHandshake] =
+            flutter::EncodableValue(static_cast<int64_t>(FiletimeToUnixMillis(*handshake)));
+      }
+      tunnels[flutter::EncodableValue(name)] = flutter::EncodableValue(std::move(tunnel));
+    });
+  }
+  SPDLOG_LOGGER_DEBUG(logger_, "Status of all {} tunnels read", tunnels.size());
+  result->Success(flutter::EncodableValue(std::move(tunnels)));
+}
 
-    result->Success(ConnectionStatusToString(status));
-    logger_->info("Status check completed - adapter: {}, status: {}", *arg_tunnel_name,
-                  ConnectionStatusToString(status));
-  } catch (std::exception& e) {
-    logger_->error("Status check failed: {}", e.what());
-    result->Error(std::string(e.what()));
+ConnectionStatus WireguardDartPlugin::ReadStatus(const std::string& tunnel_name) {
+  // Held throughout, so a worker cannot remove the adapter while its state is read
+  auto lock = adapters_.LockShared();
+  WireguardAdapter* target_adapter = adapters_.FindByNameLocked(tunnel_name);
+  if (!target_adapter || !target_adapter->IsValid()) {
+    return ConnectionStatus::disconnected;
+  }
+
+  // The observer keeps the status of observed adapters current from interface notifications
+  NET_LUID luid;
+  if (adapters_.GetLuidLocked(tunnel_name, &luid)) {
+    std::optional<std::string> observed = network_adapter_observer_->GetObservedStatus(luid);
+    if (observed) {
+      ConnectionStatus status = ConnectionStatusFromString(*observed);
+      if (status != ConnectionStatus::unknown) {
+        return status;
+      }
+    }
+  }
+
+  return target_adapter->GetState() == WIREGUARD_ADAPTER_STATE_UP ? ConnectionStatus::connected
+                                                                  : ConnectionStatus::disconnected;
+}
+
+WireguardDartPlugin::ReadResult WireguardDartPlugin::ReadTotals(const std::string* tunnel_name,
+                                                                WireguardAdapter::Totals* totals) {
+  // Held throughout, so a worker cannot remove the adapter while the driver is read
+  auto lock = adapters_.LockShared();
+  WireguardAdapter* target_adapter = tunnel_name ? adapters_.FindByNameLocked(*tunnel_name) : adapters_.NewestLocked();
+  if (!target_adapter || !target_adapter->IsValid()) {
+    return ReadResult::kNotFound;
+  }
+  if (!target_adapter->GetTotals(totals)) {
+    ReopenServiceTunnelLocked(target_adapter);
+    return ReadResult::kFailed;
+  }
+  return ReadResult::kOk;
+}
+
+WireguardDartPlugin::ReadResult WireguardDartPlugin::ReadPeerStatistics(const std::string* tunnel_name,
+                                                                        std::vector<PeerStatistics>* peers) {
+  auto lock = adapters_.LockShared();
+  WireguardAdapter* target_adapter = tunnel_name ? adapters_.FindByNameLocked(*tunnel_name) : adapters_.NewestLocked();
+  if (!target_adapter || !target_adapter->IsValid()) {
+    return ReadResult::kNotFound;
+  }
+  if (!target_adapter->GetPeerStatistics(peers)) {
+    ReopenServiceTunnelLocked(target_adapter);
+    return ReadResult::kFailed;
+  }
+  link_quality_prober_.Fill(tunnel_name ? *tunnel_name : WideToUtf8(target_adapter->GetName()), *peers);
+  return ReadResult::kOk;
+}
+
+void WireguardDartPlugin::HandleTunnelStatistics(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  // Polled like status, so nothing here logs above debug unless it fails
+  SPDLOG_LOGGER_DEBUG(logger_, "Tunnel statistics initiated");
+
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  WireguardAdapter::Totals totals;
+  ReadResult read = ReadTotals(arg_tunnel_name, &totals);
+  if (read == ReadResult::kNotFound) {
+    logger_->error("Tunnel statistics failed: adapter not found");
+    result->Error("ADAPTER_NOT_FOUND", "No tunnel to read statistics from");
+    return;
+  }
+  if (read == ReadResult::kFailed) {
+    DWORD error_code = GetLastError();
+    logger_->error("Tunnel statistics failed: could not read the configuration. Windows Error Code: {} - {}",
+                   error_code, GetLastErrorAsString(error_code));
+    result->Error("STATISTICS_FAILED", "Failed to read the tunnel configuration: " + GetLastErrorAsString(error_code));
+    return;
+  }
+
+  std::string json = "{\"totalDownload\":" + std::to_string(totals.rx_bytes) +
+                     ",\"totalUpload\":" + std::to_string(totals.tx_bytes) +
+                     ",\"latestHandshake\":" + std::to_string(totals.LastHandshakeUnixMillis()) + "}";
+  result->Success(flutter::EncodableValue(json));
+  SPDLOG_LOGGER_DEBUG(logger_, "Tunnel statistics completed - rx: {}, tx: {}", totals.rx_bytes, totals.tx_bytes);
+}
+
+void WireguardDartPlugin::HandlePeerStatistics(const flutter::EncodableMap* args,
+                                               std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                                               bool binary) {
+  SPDLOG_LOGGER_DEBUG(logger_, "Peer statistics initiated");
+
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  std::vector<PeerStatistics> peers;
+  ReadResult read = ReadPeerStatistics(arg_tunnel_name, &peers);
+  if (read == ReadResult::kNotFound) {
+    logger_->error("Peer statistics failed: adapter not found");
+    result->Error("ADAPTER_NOT_FOUND", "No tunnel to read statistics from");
+    return;
+  }
+  if (read == ReadResult::kFailed) {
+    DWORD error_code = GetLastError();
+    logger_->error("Peer statistics failed: could not read the configuration. Windows Error Code: {} - {}",
+                   error_code, GetLastErrorAsString(error_code));
+    result->Error("STATISTICS_FAILED", "Failed to read the tunnel configuration: " + GetLastErrorAsString(error_code));
+    return;
+  }
+
+  FILETIME now_filetime;
+  GetSystemTimeAsFileTime(&now_filetime);
+  uint64_t now = (static_cast<uint64_t>(now_filetime.dwHighDateTime) << 32) | now_filetime.dwLowDateTime;
+
+  // Arrives in Dart as a Uint8List, read in place
+  if (binary) {
+    std::vector<uint8_t> encoded;
+    EncodePeerStatistics(peers, FiletimeToUnixMillis(now), &encoded);
+    result->Success(flutter::EncodableValue(std::move(encoded)));
+    SPDLOG_LOGGER_DEBUG(logger_, "Peer statistics completed - {} peers, binary", peers.size());
+    return;
+  }
+
+  result->Success(PeersValue(peers, now));
+  SPDLOG_LOGGER_DEBUG(logger_, "Peer statistics completed - {} peers", peers.size());
+}
+
+void WireguardDartPlugin::HandleCounterSnapshot(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  SPDLOG_LOGGER_DEBUG(logger_, "Counter snapshot initiated");
+
+  // Held throughout, so a worker cannot remove the adapter while the driver is read
+  auto lock = adapters_.LockShared();
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  WireguardAdapter* target_adapter =
+      arg_tunnel_name ? adapters_.FindByNameLocked(*arg_tunnel_name) : adapters_.NewestLocked();
+  if (!target_adapter || !target_adapter->IsValid()) {
+    logger_->error("Counter snapshot failed: adapter not found");
+    result->Error("ADAPTER_NOT_FOUND", "No tunnel to read counters from");
+    return;
+  }
+
+  WireguardAdapter::CounterSnapshot snapshot;
+  if (!target_adapter->GetCounterSnapshot(&snapshot)) {
+    DWORD error_code = GetLastError();
+    logger_->error("Counter snapshot failed. Windows Error Code: {} - {}", error_code,
+                   GetLastErrorAsString(error_code));
+    result->Error("STATISTICS_FAILED", "Failed to read the tunnel counters: " + GetLastErrorAsString(error_code));
+    return;
+  }
+  link_quality_prober_.Fill(arg_tunnel_name ? *arg_tunnel_name : WideToUtf8(target_adapter->GetName()),
+                            snapshot.peers);
+  lock.unlock();
+
+  flutter::EncodableMap value;
+  value[keys::kTimestamp] =
+      flutter::EncodableValue(static_cast<int64_t>(FiletimeToUnixMillis(snapshot.time)));
+  value[keys::kInterface] = InterfaceCountersValue(snapshot.interface_counters);
+  value[keys::kPeers] = PeersValue(snapshot.peers, snapshot.time);
+  result->Success(flutter::EncodableValue(value));
+  SPDLOG_LOGGER_DEBUG(logger_, "Counter snapshot completed - {} peers", snapshot.peers.size());
+}
+
+void WireguardDartPlugin::HandleGetCumulativeStatistics(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  if (!cumulative_counters_.IsOpen()) {
+    logger_->error("Cumulative statistics failed: not kept without nativeInit(cumulativeCounters: true)");
+    result->Error("NOT_ENABLED", "Cumulative counters are kept with nativeInit(cumulativeCounters: true)");
+    return;
+  }
+  std::vector<std::string> names;
+  const auto* tunnel_names =
+      args ? std::get_if<flutter::EncodableList>(ValueOrNull(*args, keys::kTunnelNames)) : nullptr;
+  if (tunnel_names) {
+    for (const auto& value : *tunnel_names) {
+      if (const auto* tunnel_name = std::get_if<std::string>(&value)) {
+        names.push_back(*tunnel_name);
+      }
+    }
+    // An empty list names no tunnel rather than all of them
+    if (names.empty()) {
+      result->Success(flutter::EncodableValue(flutter::EncodableMap()));
+      return;
+    }
   }
+  const auto* reset = args ? std::get_if<bool>(ValueOrNull(*args, keys::kReset)) : nullptr;
+
+  auto counts_value = [](const CumulativeCounters::Counts& counts) {
+    flutter::EncodableMap value;
+    value[keys::kRxBytes] = flutter::EncodableValue(static_cast<int64_t>(counts.rx_bytes));
+    value[keys::kTxBytes] = flutter::EncodableValue(static_cast<int64_t>(counts.tx_bytes));
+    value[keys::kSinceMs] = flutter::EncodableValue(static_cast<int64_t>(counts.since_ms));
+    value[keys::kUpdatedMs] = flutter::EncodableValue(static_cast<int64_t>(counts.updated_ms));
+    return value;
+  };
+  uint64_t now_ms = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  flutter::EncodableMap value;
+  for (const auto& [tunnel_name, tunnel] : cumulative_counters_.Read(names, reset && *reset, now_ms)) {
+    flutter::EncodableMap tunnel_value = counts_value(tunnel.totals);
+    flutter::EncodableMap peers;
+    for (const auto& [public_key, counts] : tunnel.peers) {
+      peers[flutter::EncodableValue(KeyToBase64(public_key.data()))] = flutter::EncodableValue(counts_value(counts));
+    }
+    tunnel_value[keys::kPeers] = flutter::EncodableValue(std::move(peers));
+    value[flutter::EncodableValue(tunnel_name)] = flutter::EncodableValue(std::move(tunnel_value));
+  }
+  result->Success(flutter::EncodableValue(std::move(value)));
+}
+
+void WireguardDartPlugin::HandleGetStatisticsHistory(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_tunnel_name = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kTunnelName)) : nullptr;
+  if (arg_tunnel_name == NULL) {
+    logger_->error("Statistics history failed: tunnelName argument missing");
+    result->Error("Argument 'tunnelName' is required");
+    return;
+  }
+  const auto* window_value = ValueOrNull(*args, keys::kWindowMs);
+  std::optional<int64_t> window_ms;
+  if (const auto* value = window_value ? std::get_if<int32_t>(window_value) : nullptr) {
+    window_ms = *value;
+  } else if (const auto* value = window_value ? std::get_if<int64_t>(window_value) : nullptr) {
+    window_ms = *value;
+  }
+  if (!window_ms) {
+    logger_->error("Statistics history failed: windowMs argument missing");
+    result->Error("Argument 'windowMs' is required");
+    return;
+  }
+
+  // A peer's own history with its base64 public key
+  std::optional<PeerKey> peer;
+  const auto* arg_public_key = std::get_if<std::string>(ValueOrNull(*args, keys::kPublicKey));
+  if (arg_public_key) {
+    PeerKey key;
+    size_t decoded_size = 0;
+    if (arg_public_key->size() != 44 ||
+        !base64_decode(arg_public_key->data(), arg_public_key->size(), reinterpret_cast<char*>(key.data()),
+                       &decoded_size, 0) ||
+        decoded_size != key.size()) {
+      logger_->error("Statistics history failed: invalid publicKey");
+      result->Error("INVALID_PUBLIC_KEY", "Argument 'publicKey' is not a base64 key");
+      return;
+    }
+    peer = key;
+  }
+
+  uint64_t now_ms = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  result->Success(flutter::EncodableValue(
+      statistics_history_.Encode(*arg_tunnel_name, peer, std::chrono::milliseconds(*window_ms), now_ms)));
+}
+
+void WireguardDartPlugin::HandleStartStatsRecording(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  const auto* arg_path = args ? std::get_if<std::string>(ValueOrNull(*args, keys::kPath)) : nullptr;
+  if (arg_path == NULL || arg_path->empty()) {
+    logger_->error("Start stats recording failed: path argument missing");
+    result->Error("Argument 'path' is required");
+    return;
+  }
+
+  // The sampler must not push while the recorder switches files
+  statistics_sampler_->SetRecorder(nullptr);
+  if (!statistics_recorder_.Start(Utf8ToWide(*arg_path))) {
+    DWORD error_code = GetLastError();
+    logger_->error("Start stats recording failed. Windows Error Code: {} - {}", error_code,
+                   GetLastErrorAsString(error_code));
+    result->Error("RECORDING_FAILED", "Failed to open the recording: " + GetLastErrorAsString(error_code));
+    return;
+  }
+  statistics_sampler_->SetRecorder(&statistics_recorder_);
+  result->Success();
+}
+
+void WireguardDartPlugin::HandleStopStatsRecording(
+    const flutter::EncodableMap* args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result) {
+  statistics_sampler_->SetRecorder(nullptr);
+  statistics_recorder_.Stop();
+
+  flutter::EncodableMap value;
+  value[keys::kRecordsWritten] =
+      flutter::EncodableValue(static_cast<int64_t>(statistics_recorder_.RecordsWritten()));
+  value[keys::kRecordsDropped] =
+      flutter::EncodableValue(static_cast<int64_t>(statistics_recorder_.RecordsDropped()));
+  result->Success(flutter::EncodableValue(value));
 }
 }  // namespace wireguard_dart
 
@@ -4,34 +4,74 @@
 #include <flutter/method_channel.h>
 #include <flutter/plugin_registrar_windows.h>
 
+#include <atomic>
+#include <chrono>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 
+#include "adapter_registry.h"
+#include "background_method_channel.h"
+#include "background_threads.h"
+#include "channel_benchmark.h"
+#include "config_file_watcher.h"
+#include "connect_precheck.h"
+#include "connection_status.h"
+#include "cumulative_counters.h"
+#include "endpoint_resolver.h"
+#include "failover_groups.h"
+#include "io_reactor.h"
+#include "key_pool.h"
+#include "link_quality_prober.h"
+#include "log_stream.h"
+#include "method_task.h"
 #include "network_adapter_status_observer.h"
+#include "operation_token.h"
+#include "perf_stats.h"
+#include "platform_task_runner.h"
+#include "plugin_logger.h"
+#include "power_monitor.h"
+#include "route_lookup.h"
+#include "shared_event_stream.h"
+#include "statistics_history.h"
+#include "statistics_recorder.h"
+#include "statistics_sampler.h"
+#include "state_journal.h"
+#include "telemetry_exporter.h"
+#include "tunnel_task_queue.h"
 #include "wireguard_adapter.h"
+#include "wireguard_config_cache.h"
+#include "wireguard_config_parser.h"
 #include "wireguard_library.h"
+#include "wireguard_methods.h"
 
 namespace spdlog {
-class logger;
+namespace details {
+class thread_pool;
+} // namespace details
+namespace level {
+enum level_enum : int;
+} // namespace level
 } // namespace spdlog
 
 namespace wireguard_dart {
 
-enum class WireguardMethod {
-  GENERATE_KEY_PAIR,
-  CHECK_TUNNEL_CONFIGURATION,
-  NATIVE_INIT,
-  SETUP_TUNNEL,
-  CONNECT,
-  DISCONNECT,
-  STATUS
-};
+class LogRing;
 
-class WireguardDartPlugin : public flutter::Plugin {
+/**
+ * The plugin's native side, one per process however many Flutter engines the app runs, e.g. a main window and a
+ * tray popup: the library, the adapters, the observer, the sampler and the loggers are set up once, and their
+ * notifications are fanned out to the channels of every engine, see SharedEventStream. Each engine holds it through
+ * its Engine, and the last one to go away destroys it.
+ */
+class WireguardDartPlugin {
 public:
+  // Attach the engine's channels to the plugin, creating it for the first engine
   static void RegisterWithRegistrar(flutter::PluginRegistrarWindows *registrar);
 
+  // Use Acquire, there is only one per process
   WireguardDartPlugin();
 
   virtual ~WireguardDartPlugin();
@@ -40,39 +80,506 @@ public:
   WireguardDartPlugin(const WireguardDartPlugin &) = delete;
   WireguardDartPlugin &operator=(const WireguardDartPlugin &) = delete;
 
+  // The reads behind status, tunnelStatistics and peerStatistics, safe to call from any thread, which is how the
+  // C ABI of wireguard_dart_ffi.h calls them. A tunnel_name of nullptr reads the newest adapter.
+  enum class ReadResult { kOk, kNotFound, kFailed };
+  // Throws what reading the adapter state throws
+  ConnectionStatus ReadStatus(const std::string &tunnel_name);
+  // On kFailed GetLastError has the reason
+  ReadResult ReadTotals(const std::string *tunnel_name, WireguardAdapter::Totals *totals);
+  ReadResult ReadPeerStatistics(const std::string *tunnel_name, std::vector<PeerStatistics> *peers);
+
 private:
-  // Called when a method is called on this plugin's channel from Dart.
-  void HandleMethodCall(const flutter::MethodCall<flutter::EncodableValue> &method_call,
+  // The channels of one engine, which keep the plugin alive for as long as the engine lives
+  class Engine : public flutter::Plugin {
+  public:
+    Engine(flutter::PluginRegistrarWindows *registrar, std::shared_ptr<WireguardDartPlugin> plugin, uint64_t id);
+    ~Engine() override;
+
+  private:
+    // The engine's method calls not answered yet, by the order they came in
+    struct PendingResults {
+      std::mutex mutex;
+      uint64_t next = 0;
+      bool detached = false;
+      std::map<uint64_t, std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>>> results;
+    };
+    /**
+     * The result as the handlers answer it: once the engine is detached it is answered with ENGINE_DETACHED, and
+     * the handler's own answer that comes later is dropped. From any thread.
+     */
+    static std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>>
+    Track(const std::shared_ptr<PendingResults> &pending,
+          std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+
+    std::shared_ptr<WireguardDartPlugin> plugin_;
+    uint64_t id_;
+    std::shared_ptr<PendingResults> pending_ = std::make_shared<PendingResults>();
+    // Last, so that no bulk call is still running while the engine lets go of the plugin
+    std::unique_ptr<BackgroundMethodChannel> bulk_channel_;
+  };
+
+  // The plugin of the process, created if no engine holds it
+  static std::shared_ptr<WireguardDartPlugin> Acquire();
+
+  using MethodHandler = void (WireguardDartPlugin::*)(
+      const flutter::EncodableMap *args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // A handler that may co_await; it keeps its tunnel, not its worker, until it returns
+  using AsyncMethodHandler = MethodTask (WireguardDartPlugin::*)(
+      flutter::EncodableMap args, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+      TunnelTaskQueue::Hold hold);
+
+  // Called when a method is called on this plugin's channel from Dart, by the engine with the ID.
+  void HandleMethodCall(uint64_t engine, const flutter::MethodCall<flutter::EncodableValue> &method_call,
                         std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
 
+  // Called on the background thread of the wireguard_dart/bulk channel. Only the methods with large arguments or
+  // results that are safe off the platform thread are answered there: setupTunnels, getStatisticsHistory,
+  // getRecentLogs and getMetrics.
+  void HandleBulkMethodCall(const flutter::MethodCall<flutter::EncodableValue> &method_call,
+                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+
   // Helper methods for each supported method
-  std::optional<WireguardMethod> GetMethodFromString(const std::string &method_name);
+  // A key pair as a map of base64 keys, or with binary as 64 bytes, the public key followed by the private key
   void HandleGenerateKeyPair(const flutter::EncodableMap *args,
+                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result, bool binary);
+  // count key pairs in one answer, as a list of maps like generateKeyPair or with binary as one byte buffer of
+  // 64 byte records, the public key followed by the private key
+  void HandleGenerateKeyPairs(const flutter::EncodableMap *args,
+                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result, bool binary);
+  // count preshared keys as a list of base64 keys, or with binary as one byte buffer of 32 byte keys
+  void HandleGeneratePresharedKeys(const flutter::EncodableMap *args,
+                                   std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                                   bool binary);
+  // Answers in the form the private key came in, base64 text or 32 bytes
+  void HandleDerivePublicKey(const flutter::EncodableMap *args,
                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // The public keys of a list of private keys, in the same order
+  void HandleDerivePublicKeys(const flutter::EncodableMap *args,
+                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
   void HandleCheckTunnelConfiguration(const flutter::EncodableMap *args,
                                       std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Compare what the driver runs with the applied configuration, see DiffConfigurations
+  void HandleVerifyTunnelConfiguration(const flutter::EncodableMap *args,
+                                       std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // What the driver runs, as configuration text or structured values, see ExportConfigurationText
+  void HandleExportTunnelConfiguration(const flutter::EncodableMap *args,
+                                       std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Close the adapter, remove what its ledger knows it put on the interface and delete its device
+  void HandleRemoveTunnelConfiguration(const flutter::EncodableMap *args,
+                                       std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
   void HandleNativeInit(const flutter::EncodableMap *args,
                         std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
   void HandleSetupTunnel(const flutter::EncodableMap *args,
                          std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Sets up a list of tunnels in parallel and answers with the result or error of each, by tunnel name
+  void HandleSetupTunnels(const flutter::EncodableMap *args,
+                          std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Setting up and bringing the adapter up in one call, without the DOWN state in between
+  void HandleSetupAndConnect(const flutter::EncodableMap *args,
+                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleUpdateTunnel(const flutter::EncodableMap *args,
+                          std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // addPeers and removePeers: only the peers given go to the driver, see WireguardAdapter::ChangePeers
+  void HandleChangePeers(const flutter::EncodableMap *args,
+                         std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Update the tunnel whenever its configuration file is written, see config_file_watcher.h
+  void HandleWatchConfigFile(const flutter::EncodableMap *args,
+                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
   void HandleConnect(const flutter::EncodableMap *args,
                      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
   void HandleDisconnect(const flutter::EncodableMap *args,
                         std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Connect and disconnect, waiting for a tunnel service to get there without a worker waiting with them
+  MethodTask HandleConnectAsync(flutter::EncodableMap args,
+                                std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                                TunnelTaskQueue::Hold hold);
+  MethodTask HandleDisconnectAsync(flutter::EncodableMap args,
+                                   std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                                   TunnelTaskQueue::Hold hold);
+  // connectTunnels and disconnectTunnels: each tunnel on its worker in parallel, answered once all are done with
+  // the time and error of each
+  void HandleTransitionTunnels(const flutter::EncodableMap *args,
+                               std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result, bool connect);
+  // Measure the tunnel's throughput to a cooperating endpoint, see throughput_test.h
+  MethodTask HandleRunThroughputTestAsync(flutter::EncodableMap args,
+                                          std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                                          TunnelTaskQueue::Hold hold);
+  // Run the tunnel as a Windows service that starts with Windows, see tunnel_service.h
+  void HandleInstallTunnelService(const flutter::EncodableMap *args,
+                                  std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleRemoveTunnelService(const flutter::EncodableMap *args,
+                                 std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Which applications may use the tunnel, see app_split_tunnel.h
+  void HandleSetSplitTunnel(const flutter::EncodableMap *args,
+                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Whether the driver logs about the tunnel's adapter and where the lines go, see AdapterLogMode
+  void HandleSetAdapterLogging(const flutter::EncodableMap *args,
+                               std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // The formatted lines of the driver log ring of the tunnel's adapter, oldest first
+  void HandleGetAdapterLog(const flutter::EncodableMap *args,
+                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Fail over between two tunnels by their interface metrics, see failover_groups.h
+  void HandleSetFailoverGroup(const flutter::EncodableMap *args,
+                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleRemoveFailoverGroup(const flutter::EncodableMap *args,
+                                 std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Probe the named tunnels while they are in a failover group, and stop once they are not, on their workers
+  void UpdateFailoverProbes(const std::vector<std::string> &tunnel_names);
+  // The status, LUID, last transition and latest handshake of every tunnel by name, from the observer
+  void HandleStatusAll(std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Add or replace, or remove, a subscription of the engine's routed status stream, see NetworkAdapterStatusObserver
+  void HandleSubscribeStatus(uint64_t engine, const flutter::EncodableMap *args,
+                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleUnsubscribeStatus(uint64_t engine, const flutter::EncodableMap *args,
+                               std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
   void HandleStatus(const flutter::EncodableMap *args,
                     std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Traffic and the latest handshake of the tunnel, or of the newest one without a name, as a JSON string
+  void HandleTunnelStatistics(const flutter::EncodableMap *args,
+                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Counters, handshake age and throughput of every peer of the tunnel, by base64 public key, or with binary
+  // as one byte buffer in the layout of EncodePeerStatistics
+  void HandlePeerStatistics(const flutter::EncodableMap *args,
+                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result, bool binary);
+  // The peers and the interface counters of the tunnel, read back to back
+  void HandleCounterSnapshot(const flutter::EncodableMap *args,
+                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // The running totals of the named tunnels and their peers, or of all, see CumulativeCounters; with reset they
+  // start over from zero as they are read
+  void HandleGetCumulativeStatistics(const flutter::EncodableMap *args,
+                                     std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // The recorded history of a tunnel or one of its peers over a window, in the layout of StatisticsHistory::Encode
+  void HandleGetStatisticsHistory(const flutter::EncodableMap *args,
+                                  std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Append every tunnel's counters once a second to the file at path, in the layout of StatisticsRecord
+  void HandleStartStatsRecording(const flutter::EncodableMap *args,
+                                 std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Stop the recording and answer how many records were written and dropped
+  void HandleStopStatsRecording(const flutter::EncodableMap *args,
+                                std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // The latency histograms of the driver and IP Helper calls, in the OpenMetrics text format
+  void HandleGetMetrics(const flutter::EncodableMap *args,
+                        std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // The latest formatted lines of the file logger at or above a level, oldest first
+  void HandleGetRecentLogs(const flutter::EncodableMap *args,
+                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Log lines below the level are dropped from now on
+  void HandleSetLogLevel(const flutter::EncodableMap *args,
+                         std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleGetPerfStats(const flutter::EncodableMap *args,
+                          std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // The subsystems started so far, when and at what cost, see StartupTrace
+  void HandleGetStartupTrace(const flutter::EncodableMap *args,
+                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // For the channel benchmark: nothing without peers, else that many synthetic peers the way peerStatistics
+  // answers them, as a map or with binary as one byte buffer
+  void HandleBenchmarkCall(const flutter::EncodableMap *args,
+                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Send the metrics and warnings to a collector over UDP every interval, see TelemetryExporter
+  void HandleStartTelemetryExport(const flutter::EncodableMap *args,
+                                  std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleStopTelemetryExport(const flutter::EncodableMap *args,
+                                 std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Bytes the plugin holds by kind and by tunnel, the working set and how each setup phase changed it
+  void HandleGetMemoryStats(const flutter::EncodableMap *args,
+                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Keep less: applied configurations are released once set up, and the log and statistics rings shrink
+  void HandleSetLowMemoryMode(const flutter::EncodableMap *args,
+                              std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleBeginTunnelConfiguration(const flutter::EncodableMap *args,
+                                      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleAppendTunnelConfiguration(const flutter::EncodableMap *args,
+                                       std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Parse cfg once and answer a handle to it, which setupTunnelCompiled and updateTunnelCompiled take until
+  // releaseConfig. The parse runs on a worker, a large configuration would hold up the platform thread.
+  void HandleCompileConfig(const flutter::EncodableMap *args,
+                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void CompileConfig(const std::string &cfg, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  void HandleReleaseConfig(const flutter::EncodableMap *args,
+                           std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Parse cfg and answer its size, peers and routes, or the line and column it is invalid at, touching nothing
+  void HandleValidateConfig(const flutter::EncodableMap *args,
+                            std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // The tunnel and peer whose allowed IPs hold each of a list of addresses, see RouteLookup
+  void HandleResolvePeerForAddresses(const flutter::EncodableMap *args,
+                                     std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Abandon the setup with the operationId at the end of the phase it is in, see OperationToken
+  void HandleCancelOperation(const flutter::EncodableMap *args,
+                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+
+  /**
+   * Run the handler on a tunnel worker, after the calls queued before it for the same tunnel, with a result
+   * that answers on the platform thread. Calls without a tunnel name are handled right away.
+   */
+  void RunForTunnel(const flutter::EncodableMap *args,
+                    std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result, MethodHandler handler);
+  // The same for a coroutine handler, which is resumed on the tunnel workers and holds its tunnel until it returns
+  void RunForTunnelAsync(const flutter::EncodableMap *args,
+                         std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                         AsyncMethodHandler handler);
+  /**
+   * RunForTunnel for a setup with a timeoutMs or an operationId. Its OperationToken is made right away, so the
+   * timeout also covers the wait behind the tunnel's earlier calls and cancelOperation reaches it before it
+   * starts. The handler finds the token by the operationId in its arguments, set for calls that came without one.
+   */
+  void RunOperationForTunnel(const flutter::EncodableMap *args,
+                             std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result,
+                             MethodHandler handler);
+  // A result that answers on the platform thread, from whichever thread it is answered
+  std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> PlatformResult(
+      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // Where the awaits of coroutine handlers wait and resume
+  AsyncContext TunnelContext();
+
+  /**
+   * Take the configuration streamed in for the tunnel with appendTunnelConfiguration. Answers the result with
+   * an error and returns false when there is none or it does not parse.
+   */
+  bool TakeStreamedConfiguration(const std::string &tunnel_name, const char *operation,
+                                 std::optional<WireguardConfigParser> &parsed_config,
+                                 flutter::MethodResult<flutter::EncodableValue> &result);
+
+  /**
+   * Map the configuration file setupTunnelFromFile names and parse it in place. Answers the result with an error
+   * and returns false when it cannot be read or does not parse.
+   */
+  bool TakeFileConfiguration(const std::string &path, const char *operation,
+                             std::optional<WireguardConfigParser> &parsed_config,
+                             flutter::MethodResult<flutter::EncodableValue> &result);
+
+  /**
+   * Copy the configuration compileConfig parsed for the handle. Answers the result with an error and returns
+   * false when the handle is unknown or was released.
+   */
+  bool TakeCompiledConfiguration(int64_t handle, const char *operation,
+                                 std::optional<WireguardConfigParser> &parsed_config,
+                                 flutter::MethodResult<flutter::EncodableValue> &result);
+
+  /**
+   * Make a copy of a compiled configuration the tunnel's with the privateKey, addresses and listenPort the
+   * arguments give, see WireguardConfigParser::ApplyOverrides. Answers the result with an error and returns false
+   * when one of them is invalid.
+   */
+  bool ApplyConfigOverrides(const flutter::EncodableMap &args, const char *operation,
+                            WireguardConfigParser &parsed_config,
+                            flutter::MethodResult<flutter::EncodableValue> &result);
+
+  /**
+   * Take the configuration given as values by setupTunnelStructured. Answers the result with an error and
+   * returns false when it is malformed.
+   */
+  bool TakeStructuredConfiguration(const flutter::EncodableMap &config, const char *operation,
+                                   std::optional<WireguardConfigParser> &parsed_config,
+                                   flutter::MethodResult<flutter::EncodableValue> &result);
 
-  // Helper methods to manage adapters
-  WireguardAdapter *FindAdapterByName(const std::wstring &adapter_name);
-  void RemoveAdapterByName(const std::wstring &adapter_name);
+  // setupTunnel, and with connect setupAndConnect, which also answers the time each phase took
+  void SetupTunnel(const flutter::EncodableMap *args,
+                   std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result, bool connect);
+  // Answer the result with TIMEOUT or CANCELLED and return true once the operation of the timer was abandoned
+  bool AnswerIfAbandoned(const PhaseTimer &timer, const std::string &tunnel_name,
+                         flutter::MethodResult<flutter::EncodableValue> &result);
+  void AnswerAbandoned(DWORD abandoned, const std::string &tunnel_name,
+                       flutter::MethodResult<flutter::EncodableValue> &result);
+  // Set the adapter UP, answering the result with an error if that fails or the precheck, if any, fails; with an
+  // activation, its peers are staged first
+  bool BringUp(WireguardAdapter *adapter, const char *operation,
+               flutter::MethodResult<flutter::EncodableValue> &result, PhaseTimer *timer = nullptr,
+               ConnectPrecheck *precheck = nullptr, const WireguardAdapter::ActivationOptions *activation = nullptr);
+  // Finish the precheck with the endpoints of the adapter's configuration before it comes up; false, with the
+  // result answered CAPTIVE_PORTAL or ENDPOINT_UNREACHABLE, when the network is obviously not going to carry it
+  bool PassPrecheck(ConnectPrecheck &precheck, WireguardAdapter *adapter, const char *operation,
+                    flutter::MethodResult<flutter::EncodableValue> &result);
+  // Stage the peers of an adapter about to come up, sending the activation's progress on the status stream
+  void StagePeers(WireguardAdapter *adapter, const WireguardAdapter::ActivationOptions &activation,
+                  const std::optional<NET_LUID> &luid);
+  // Record the time the adapter that was just brought up takes to its first handshake, which also ends its
+  // connecting status
+  void TimeFirstHandshake(WireguardAdapter *adapter, const std::optional<NET_LUID> &luid, bool warm_up = false);
 
-  std::unique_ptr<NetworkAdapterStatusObserver> network_adapter_observer_;
-  std::shared_ptr<spdlog::logger> logger_;
+  // Index the allowed IPs of the configuration just applied to the adapter for resolvePeerForAddresses, and probe
+  // the link quality of its peers with a ProbeAddress
+  void IndexTunnel(const std::string &tunnel_name, WireguardAdapter *adapter);
+  // In low-memory mode, drop the adapter's parsed configuration once setting it up is done
+  void ReleaseIfLowMemory(WireguardAdapter *adapter);
+  // After changePeers, cache, journal and index the tunnel once its changes settle, on its worker; each of those
+  // costs as much as the whole configuration
+  void DeferPeerChangePersist(const std::string &tunnel_name);
+  void PersistPeerChanges(const std::string &tunnel_name);
 
+  // Apply the text of a watched configuration file like updateTunnel, on the tunnel's worker
+  void ReloadConfigFile(const std::string &tunnel_name, std::string text);
+
+  // Helper methods to manage adapters, safe to call from any thread
+  void RemoveAdapterByName(const std::string &tunnel_name);
+  // Open or create the adapter and park it DOWN, so that setting it up later only applies the configuration
+  void PrewarmAdapter(const std::string &tunnel_name);
+  // Remove the devices of our tunnel type that are no longer present, for nativeInit's removeOrphanAdapters
+  void SweepOrphanedAdapters();
+  // Remove the NRPT rules and QoS policies of interfaces that are gone, on every nativeInit
+  void SweepOrphanedPolicies();
+  // Register the trace provider and take the host app's logger, once, before the first call is handled
+  void EnsureStarted();
+  // Follow the power state from the first tunnel watched on, once; from any thread
+  void StartPowerMonitor();
+  // The WireGuard library, loaded on the first call that needs it; nullptr if it cannot be loaded
+  std::shared_ptr<WireguardLibrary> Library();
+  // The bundle ID nativeInit gave, empty before; from any thread
+  std::string BundleId();
+  // Create the adapter with its stable GUID for the bundle ID, which must not be empty
+  std::unique_ptr<WireguardAdapter> CreateAdapter(const std::wstring &adapter_name, const std::string &bundle_id);
+  // For the adapters of the tunnel, see WireguardAdapter::SetWorkerPost
+  WireguardAdapter::WorkerPost TunnelWorkerPost(const std::string &tunnel_name);
+  // Take back an adapter the journal recorded before the app restarted, see StateJournal
+  void RecoverFromJournal(const StateJournal::Entry &entry);
+  // Record what networking set up on the adapter, when nativeInit asked for the journal
+  void JournalAdapter(WireguardAdapter *adapter);
+  // Open the adapter of a running tunnel service and add it to the registry, so it is read like any other
+  void AttachServiceTunnel(const std::string &tunnel_name);
+  // With a lock from LockShared held, after a read of the adapter failed: a service-owned one is reopened on the
+  // tunnel's worker, as its service may have restarted with a new adapter of the same name
+  void ReopenServiceTunnelLocked(WireguardAdapter *adapter);
+  // Send the roams WireguardAdapter::TrackEndpoints found on the status stream; on the sampler thread
+  void NotifyEndpointRoams(WireguardAdapter *adapter, const std::vector<WireguardAdapter::EndpointRoam> &roams);
+  // Observe the adapter and arm the ready event for the addresses of its applied configuration
+  void WatchAdapter(const std::string &tunnel_name, WireguardAdapter *adapter, const NET_LUID &luid);
+  // Resolve the hostnames connect was given for the adapter, now that its addresses are usable; on the
+  // notification's thread
+  void PrefetchHosts(const NET_LUID &luid);
+  // Tag the tunnel's status events with the correlation ID of the call from now on, see SetCorrelationId
+  void NoteCorrelation(const flutter::EncodableMap *args, const std::string &correlation_id);
+  // A result that counts the method's outcome in OperationCounters as it is answered, and dumps the flight recorder
+  // on an error
+  static std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> CountedResult(
+      WireguardMethod method, std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+  // A result whose map answer or error details carry the correlation ID and when it was answered
+  static std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> CorrelatedResult(
+      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result, const std::string &correlation_id);
+  // What getMetrics answers, and the telemetry exporter sends
+  std::string MetricsText() const;
+  // Follow the power state with the sampler and the status coalescing, see PowerMonitor; on the platform thread
+  void SetPowerSaving(bool saving);
+  // What nativeInit asked for, widened while saving power and while a group of tunnels changes state
+  void ApplyStatusCoalesce();
+  // Re-pin and kick the handshakes of every tunnel on its worker once the system resumed from sleep
+  void KickTunnelsAfterResume();
+
+  // The async file logger only holds it weakly; first, so it outlives everything below that logs when destroyed
+  std::shared_ptr<spdlog::details::thread_pool> log_thread_pool_;
+  // Flushes the loggers every kLogFlushInterval once nativeInit created the file logger, in place of
+  // spdlog::flush_every, whose thread wakes on the exact interval at normal QoS
+  PeriodicThread log_flusher_{BackgroundThread::kLogFlush};
+  // The latest lines of the file logger, kept across nativeInit calls. Created with the plugin, so that
+  // getRecentLogs on the bulk channel never reads it while nativeInit sets it.
+  std::shared_ptr<LogRing> log_ring_;
+  // Its sink is one of the file logger's, kept across nativeInit calls like the ring
+  std::unique_ptr<TelemetryExporter> telemetry_;
+  // Of the file logger, also when nativeInit creates it after setLogLevel
+  spdlog::level::level_enum log_level_;
+  // The file logger's pattern nativeInit was given, empty for the lean one of the level, see LogPatternFor
+  std::string log_pattern_;
+  // Hostnames to resolve once the adapter's addresses are usable, by LUID, from the connect that asked for them
+  std::mutex prefetch_mutex_;
+  std::map<uint64_t, std::vector<std::string>> prefetch_hosts_;
+  // Created by the first prefetch. The point is the system's resolver cache, its own answers are never looked up.
+  std::unique_ptr<EndpointResolver> prefetch_resolver_;
+  // Shared with the callbacks given to adapters
+  std::shared_ptr<NetworkAdapterStatusObserver> network_adapter_observer_;
+  PluginLogger logger_;
+
+  // Only through Library, the tunnel workers may load it concurrently
   std::shared_ptr<WireguardLibrary> wg_library_;
-  std::vector<std::unique_ptr<WireguardAdapter>> adapters_;
+  std::mutex library_mutex_;
+  // The correlation ID of the latest call for each tunnel that had one, applied once its adapter is observed
+  std::mutex correlation_mutex_;
+  std::map<std::string, std::string> correlation_ids_;
+  // Durations of the setup and connect phases, for getPerfStats
+  std::shared_ptr<PerfStats> perf_stats_ = std::make_shared<PerfStats>();
+  // Setups with a timeout or an operationId until they answer, for cancelOperation
+  OperationRegistry operations_;
+  // Set by setLowMemoryMode, read by the tunnel workers
+  std::atomic<bool> low_memory_{false};
+  AdapterRegistry adapters_;
+
+  // Configurations being streamed in chunks, by tunnel name, until setupTunnel or updateTunnel picks them up
+  std::map<std::string, WireguardConfigParser> pending_configs_;
+  // Configurations parsed by compileConfig, by handle until releaseConfig. Never changed once parsed, so a setup
+  // holding a reference copies from one without the lock.
+  std::map<int64_t, std::shared_ptr<const WireguardConfigParser>> compiled_configs_;
+  int64_t next_config_handle_ = 1;
+  // What validateConfig parses into, only on the platform thread
+  WireguardConfigParser validate_config_;
+  // The allowed IPs of every applied configuration, set on the tunnel workers and read from anywhere
+  RouteLookup route_lookup_;
+
+  // Set by nativeInit when parsed configurations should be kept for the next start
+  std::unique_ptr<WireguardConfigCache> config_cache_;
+  // Set once by nativeInit with journalState, then written by the tunnel workers
+  std::unique_ptr<StateJournal> state_journal_;
+  // The status coalescing nativeInit asked for, widened while saving power; on the platform thread
+  std::chrono::milliseconds status_coalesce_{0};
+  bool power_saving_ = false;
+  // connectTunnels and disconnectTunnels calls still running; on the platform thread
+  int group_transitions_ = 0;
+  // From nativeInit, for the adapters created before a setupTunnel names its bundle ID; the workers read it too
+  std::mutex bundle_id_mutex_;
+  std::string bundle_id_;
+  // Set by nativeInit with keyPoolSize; generateKeyPair takes from it while it has pairs
+  std::unique_ptr<KeyPool> key_pool_;
+
+  // pending_configs_ is shared between the platform thread and the tunnel workers
+  std::mutex pending_configs_mutex_;
+  // compiled_configs_ likewise
+  std::mutex compiled_configs_mutex_;
+  std::unique_ptr<PlatformTaskRunner> platform_tasks_;
+  std::unique_ptr<TunnelTaskQueue> tunnel_tasks_;
+  // The threads everything that waits in the background shares, overlapped I/O, timers and posted tasks
+  IoReactor io_reactor_;
+  // Posts reloads to the tunnel workers from the reactor threads
+  ConfigFileWatcher config_file_watcher_{&io_reactor_};
+  // Sends its echoes on the reactor's timer, and is filled into the peer statistics
+  LinkQualityProber link_quality_prober_{&io_reactor_};
+  // Told about stale peers by the sampler, and sets the metrics again after each setup; times failbacks on the
+  // reactor
+  FailoverGroups failover_groups_{&io_reactor_};
+  // Tunnels whose peer changes are still to be written, with the reactor timer for the write; closed by the
+  // destructor, which writes them itself
+  std::mutex peer_change_mutex_;
+  std::map<std::string, IoReactor::TimerId> peer_changes_;
+  bool peer_changes_closed_ = false;
+  // The adapters post to the tunnel workers from the resolver's threads until the destructor closes this, before
+  // the workers are shut down
+  std::mutex worker_post_mutex_;
+  bool worker_posts_closed_ = false;
+  // After platform_tasks_, so that it stops taking log records before the runner it raises is gone
+  std::unique_ptr<LogStream> log_stream_;
+  // Written by the sampler from its thread
+  StatisticsHistory statistics_history_;
+  // Filled by the sampler from its thread while a recording runs
+  StatisticsRecorder statistics_recorder_;
+  // Opened by nativeInit with cumulativeCounters, then updated by the sampler from its thread
+  CumulativeCounters cumulative_counters_;
+  // After platform_tasks_, the history, the recorder and the cumulative counters, so that it is destroyed first
+  std::unique_ptr<StatisticsSampler> statistics_sampler_;
+  // The streams above as every engine's channels listen to them; empty by the time the plugin is destroyed. The
+  // status stream keeps each engine's listen options itself, see NetworkAdapterStatusObserver::HandlerFor.
+  std::unique_ptr<SharedEventStream> statistics_stream_;
+  std::unique_ptr<SharedEventStream> logs_stream_;
+  // Only measures the channel, see ChannelBenchmarkStream; after platform_tasks_ like the streams above
+  std::unique_ptr<ChannelBenchmarkStream> channel_benchmark_;
+  std::unique_ptr<SharedEventStream> benchmark_stream_;
+  // The synthetic peers of benchmarkCall, kept for the next call of the same size; on the platform thread
+  std::vector<PeerStatistics> benchmark_peers_;
+  // Posts to platform_tasks_ and tunnel_tasks_ from a system thread, stopped first
+  PowerMonitor power_monitor_;
+  std::once_flag power_monitor_started_;
+  std::once_flag started_;
 };
 
+// The plugin the C ABI reads from, set by its constructor; clearing it waits for the calls in progress
+void SetFfiPlugin(WireguardDartPlugin *plugin);
+void ClearFfiPlugin(WireguardDartPlugin *plugin);
+
 } // namespace wireguard_dart
 
 #endif // FLUTTER_PLUGIN_WIREGUARD_DART_PLUGIN_H_
@@ -1,6 +1,7 @@
 #include "wireguard_library.h"
 
 #include <stdexcept>
+#include <string>
 
 namespace wireguard_dart {
 
@@ -37,67 +38,31 @@ bool WireguardLibrary::LoadLibrary() {
 }
 
 void WireguardLibrary::LoadFunctions() {
-  // Load all required function pointers
-  create_adapter_ = reinterpret_cast<CreateAdapterFunc>(GetProcAddress(dll_handle_, "WireGuardCreateAdapter"));
-  if (!create_adapter_) {
-    throw std::runtime_error("Failed to load WireGuardCreateAdapter");
-  }
-
-  open_adapter_ = reinterpret_cast<OpenAdapterFunc>(GetProcAddress(dll_handle_, "WireGuardOpenAdapter"));
-  if (!open_adapter_) {
-    throw std::runtime_error("Failed to load WireGuardOpenAdapter");
-  }
-
-  close_adapter_ = reinterpret_cast<CloseAdapterFunc>(GetProcAddress(dll_handle_, "WireGuardCloseAdapter"));
-  if (!close_adapter_) {
-    throw std::runtime_error("Failed to load WireGuardCloseAdapter");
-  }
-
-  delete_driver_ = reinterpret_cast<DeleteDriverFunc>(GetProcAddress(dll_handle_, "WireGuardDeleteDriver"));
-  if (!delete_driver_) {
-    throw std::runtime_error("Failed to load WireGuardDeleteDriver");
-  }
-
-  get_adapter_luid_ = reinterpret_cast<GetAdapterLuidFunc>(GetProcAddress(dll_handle_, "WireGuardGetAdapterLUID"));
-  if (!get_adapter_luid_) {
-    throw std::runtime_error("Failed to load WireGuardGetAdapterLUID");
-  }
-
-  get_running_driver_version_ =
-      reinterpret_cast<GetRunningDriverVersionFunc>(GetProcAddress(dll_handle_, "WireGuardGetRunningDriverVersion"));
-  if (!get_running_driver_version_) {
-    throw std::runtime_error("Failed to load WireGuardGetRunningDriverVersion");
-  }
-
-  set_logger_ = reinterpret_cast<SetLoggerFunc>(GetProcAddress(dll_handle_, "WireGuardSetLogger"));
-  if (!set_logger_) {
-    throw std::runtime_error("Failed to load WireGuardSetLogger");
-  }
-
-  set_adapter_logging_ =
-      reinterpret_cast<SetAdapterLoggingFunc>(GetProcAddress(dll_handle_, "WireGuardSetAdapterLogging"));
-  if (!set_adapter_logging_) {
-    throw std::runtime_error("Failed to load WireGuardSetAdapterLogging");
-  }
-
-  set_adapter_state_ = reinterpret_cast<SetAdapterStateFunc>(GetProcAddress(dll_handle_, "WireGuardSetAdapterState"));
-  if (!set_adapter_state_) {
-    throw std::runtime_error("Failed to load WireGuardSetAdapterState");
-  }
-
-  get_adapter_state_ = reinterpret_cast<GetAdapterStateFunc>(GetProcAddress(dll_handle_, "WireGuardGetAdapterState"));
-  if (!get_adapter_state_) {
-    throw std::runtime_error("Failed to load WireGuardGetAdapterState");
-  }
-
-  set_configuration_ = reinterpret_cast<SetConfigurationFunc>(GetProcAddress(dll_handle_, "WireGuardSetConfiguration"));
-  if (!set_configuration_) {
-    throw std::runtime_error("Failed to load WireGuardSetConfiguration");
-  }
-
-  get_configuration_ = reinterpret_cast<GetConfigurationFunc>(GetProcAddress(dll_handle_, "WireGuardGetConfiguration"));
-  if (!get_configuration_) {
-    throw std::runtime_error("Failed to load WireGuardGetConfiguration");
+  // Every export the plugin uses, resolved in one pass; a missing one means an incompatible DLL
+  struct Export {
+    const char *name;
+    FARPROC *function;
+  };
+  const Export exports[] = {
+      {"WireGuardCreateAdapter", reinterpret_cast<FARPROC *>(&create_adapter_)},
+      {"WireGuardOpenAdapter", reinterpret_cast<FARPROC *>(&open_adapter_)},
+      {"WireGuardCloseAdapter", reinterpret_cast<FARPROC *>(&close_adapter_)},
+      {"WireGuardDeleteDriver", reinterpret_cast<FARPROC *>(&delete_driver_)},
+      {"WireGuardGetAdapterLUID", reinterpret_cast<FARPROC *>(&get_adapter_luid_)},
+      {"WireGuardGetRunningDriverVersion", reinterpret_cast<FARPROC *>(&get_running_driver_version_)},
+      {"WireGuardSetLogger", reinterpret_cast<FARPROC *>(&set_logger_)},
+      {"WireGuardSetAdapterLogging", reinterpret_cast<FARPROC *>(&set_adapter_logging_)},
+      {"WireGuardSetAdapterState", reinterpret_cast<FARPROC *>(&set_adapter_state_)},
+      {"WireGuardGetAdapterState", reinterpret_cast<FARPROC *>(&get_adapter_state_)},
+      {"WireGuardSetConfiguration", reinterpret_cast<FARPROC *>(&set_configuration_)},
+      {"WireGuardGetConfiguration", reinterpret_cast<FARPROC *>(&get_configuration_)},
+  };
+
+  for (const auto &entry : exports) {
+    *entry.function = GetProcAddress(dll_handle_, entry.name);
+    if (!*entry.function) {
+      throw std::runtime_error(std::string("Failed to load ") + entry.name);
+    }
   }
 }
 
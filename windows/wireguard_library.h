@@ -5,13 +5,15 @@
 #include <functional>
 #include <memory>
 
+#include "call_metrics.h"
 #include "wireguard.h"
 
 namespace wireguard_dart {
 
 /**
  * Manages the WireGuard DLL loading and function pointers.
- * Implements singleton pattern to ensure only one DLL instance is loaded.
+ * Implements singleton pattern to ensure only one DLL instance is loaded. The plugin creates it the first time a
+ * tunnel needs the driver, not at startup.
  */
 class WireguardLibrary {
  public:
@@ -38,19 +40,39 @@ class WireguardLibrary {
   WireguardLibrary(WireguardLibrary&&) = delete;
   WireguardLibrary& operator=(WireguardLibrary&&) = delete;
 
-  // Function accessors
-  CreateAdapterFunc CreateAdapter() const { return create_adapter_; }
-  OpenAdapterFunc OpenAdapter() const { return open_adapter_; }
-  CloseAdapterFunc CloseAdapter() const { return close_adapter_; }
-  DeleteDriverFunc DeleteDriver() const { return delete_driver_; }
-  GetAdapterLuidFunc GetAdapterLuid() const { return get_adapter_luid_; }
-  GetRunningDriverVersionFunc GetRunningDriverVersion() const { return get_running_driver_version_; }
-  SetLoggerFunc SetLogger() const { return set_logger_; }
-  SetAdapterLoggingFunc SetAdapterLogging() const { return set_adapter_logging_; }
-  SetAdapterStateFunc SetAdapterState() const { return set_adapter_state_; }
-  GetAdapterStateFunc GetAdapterState() const { return get_adapter_state_; }
-  SetConfigurationFunc SetConfiguration() const { return set_configuration_; }
-  GetConfigurationFunc GetConfiguration() const { return get_configuration_; }
+  // Function accessors, each call timed into CallMetrics
+  MeteredFunction<CreateAdapterFunc> CreateAdapter() const {
+    return {create_adapter_, MeteredCall::kWireGuardCreateAdapter};
+  }
+  MeteredFunction<OpenAdapterFunc> OpenAdapter() const { return {open_adapter_, MeteredCall::kWireGuardOpenAdapter}; }
+  MeteredFunction<CloseAdapterFunc> CloseAdapter() const {
+    return {close_adapter_, MeteredCall::kWireGuardCloseAdapter};
+  }
+  MeteredFunction<DeleteDriverFunc> DeleteDriver() const {
+    return {delete_driver_, MeteredCall::kWireGuardDeleteDriver};
+  }
+  MeteredFunction<GetAdapterLuidFunc> GetAdapterLuid() const {
+    return {get_adapter_luid_, MeteredCall::kWireGuardGetAdapterLUID};
+  }
+  MeteredFunction<GetRunningDriverVersionFunc> GetRunningDriverVersion() const {
+    return {get_running_driver_version_, MeteredCall::kWireGuardGetRunningDriverVersion};
+  }
+  MeteredFunction<SetLoggerFunc> SetLogger() const { return {set_logger_, MeteredCall::kWireGuardSetLogger}; }
+  MeteredFunction<SetAdapterLoggingFunc> SetAdapterLogging() const {
+    return {set_adapter_logging_, MeteredCall::kWireGuardSetAdapterLogging};
+  }
+  MeteredFunction<SetAdapterStateFunc> SetAdapterState() const {
+    return {set_adapter_state_, MeteredCall::kWireGuardSetAdapterState};
+  }
+  MeteredFunction<GetAdapterStateFunc> GetAdapterState() const {
+    return {get_adapter_state_, MeteredCall::kWireGuardGetAdapterState};
+  }
+  MeteredFunction<SetConfigurationFunc> SetConfiguration() const {
+    return {set_configuration_, MeteredCall::kWireGuardSetConfiguration};
+  }
+  MeteredFunction<GetConfigurationFunc> GetConfiguration() const {
+    return {get_configuration_, MeteredCall::kWireGuardGetConfiguration};
+  }
 
   bool IsLoaded() const { return dll_handle_ != nullptr; }
 
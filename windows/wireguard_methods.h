@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace wireguard_dart {
+
+// Every method of the wireguard_dart channel as X(enumerator, name), the one list the enum and the lookup below
+// are generated from. test/wireguard_dart_method_channel_test.dart checks it against the Dart method enum.
+#define WIREGUARD_DART_METHODS(X)                                  \
+  X(GENERATE_KEY_PAIR, "generateKeyPair")                          \
+  X(GENERATE_KEY_PAIR_BINARY, "generateKeyPairBinary")             \
+  X(GENERATE_KEY_PAIRS, "generateKeyPairs")                        \
+  X(GENERATE_KEY_PAIRS_BINARY, "generateKeyPairsBinary")           \
+  X(GENERATE_PRESHARED_KEYS, "generatePresharedKeys")              \
+  X(GENERATE_PRESHARED_KEYS_BINARY, "generatePresharedKeysBinary") \
+  X(DERIVE_PUBLIC_KEY, "derivePublicKey")                          \
+  X(DERIVE_PUBLIC_KEYS, "derivePublicKeys")                        \
+  X(CHECK_TUNNEL_CONFIGURATION, "checkTunnelConfiguration")        \
+  X(VERIFY_TUNNEL_CONFIGURATION, "verifyTunnelConfiguration")      \
+  X(REMOVE_TUNNEL_CONFIGURATION, "removeTunnelConfiguration")      \
+  X(NATIVE_INIT, "nativeInit")                                     \
+  X(SETUP_TUNNEL, "setupTunnel")                                   \
+  X(SETUP_TUNNELS, "setupTunnels")                                 \
+  X(SETUP_AND_CONNECT, "setupAndConnect")                          \
+  X(SETUP_TUNNEL_STRUCTURED, "setupTunnelStructured")              \
+  X(SETUP_TUNNEL_FROM_FILE, "setupTunnelFromFile")                 \
+  X(SETUP_TUNNEL_COMPILED, "setupTunnelCompiled")                  \
+  X(CANCEL_OPERATION, "cancelOperation")                           \
+  X(UPDATE_TUNNEL, "updateTunnel")                                 \
+  X(UPDATE_TUNNEL_COMPILED, "updateTunnelCompiled")                \
+  X(ADD_PEERS, "addPeers")                                         \
+  X(REMOVE_PEERS, "removePeers")                                   \
+  X(COMPILE_CONFIG, "compileConfig")                               \
+  X(RELEASE_CONFIG, "releaseConfig")                               \
+  X(VALIDATE_CONFIG, "validateConfig")                             \
+  X(RESOLVE_PEER_FOR_ADDRESSES, "resolvePeerForAddresses")         \
+  X(WATCH_CONFIG_FILE, "watchConfigFile")                          \
+  X(CONNECT, "connect")                                            \
+  X(DISCONNECT, "disconnect")                                      \
+  X(CONNECT_TUNNELS, "connectTunnels")                             \
+  X(DISCONNECT_TUNNELS, "disconnectTunnels")                       \
+  X(RUN_THROUGHPUT_TEST, "runThroughputTest")                      \
+  X(INSTALL_TUNNEL_SERVICE, "installTunnelService")                \
+  X(REMOVE_TUNNEL_SERVICE, "removeTunnelService")                  \
+  X(SET_SPLIT_TUNNEL, "setSplitTunnel")                            \
+  X(SET_ADAPTER_LOGGING, "setAdapterLogging")                      \
+  X(GET_ADAPTER_LOG, "getAdapterLog")                              \
+  X(SET_FAILOVER_GROUP, "setFailoverGroup")                        \
+  X(REMOVE_FAILOVER_GROUP, "removeFailoverGroup")                  \
+  X(STATUS, "status")                                              \
+  X(STATUS_ALL, "statusAll")                                       \
+  X(SUBSCRIBE_STATUS, "subscribeStatus")                           \
+  X(UNSUBSCRIBE_STATUS, "unsubscribeStatus")                       \
+  X(TUNNEL_STATISTICS, "tunnelStatistics")                         \
+  X(PEER_STATISTICS, "peerStatistics")                             \
+  X(PEER_STATISTICS_BINARY, "peerStatisticsBinary")                \
+  X(GET_STATISTICS_HISTORY, "getStatisticsHistory")                \
+  X(COUNTER_SNAPSHOT, "counterSnapshot")                           \
+  X(GET_CUMULATIVE_STATISTICS, "getCumulativeStatistics")          \
+  X(START_STATS_RECORDING, "startStatsRecording")                  \
+  X(STOP_STATS_RECORDING, "stopStatsRecording")                    \
+  X(GET_METRICS, "getMetrics")                                     \
+  X(GET_PERF_STATS, "getPerfStats")                                \
+  X(GET_MEMORY_STATS, "getMemoryStats")                            \
+  X(SET_LOW_MEMORY_MODE, "setLowMemoryMode")                       \
+  X(BEGIN_TUNNEL_CONFIGURATION, "beginTunnelConfiguration")        \
+  X(APPEND_TUNNEL_CONFIGURATION, "appendTunnelConfiguration")      \
+  X(GET_RECENT_LOGS, "getRecentLogs")                              \
+  X(SET_LOG_LEVEL, "setLogLevel")                                  \
+  X(GET_STARTUP_TRACE, "getStartupTrace")                          \
+  X(BENCHMARK_CALL, "benchmarkCall")                               \
+  X(START_TELEMETRY_EXPORT, "startTelemetryExport")                \
+  X(STOP_TELEMETRY_EXPORT, "stopTelemetryExport")                  \
+  X(EXPORT_TUNNEL_CONFIGURATION, "exportTunnelConfiguration")
+
+enum class WireguardMethod {
+#define WIREGUARD_DART_METHOD_ENUMERATOR(id, name) id,
+  WIREGUARD_DART_METHODS(WIREGUARD_DART_METHOD_ENUMERATOR)
+#undef WIREGUARD_DART_METHOD_ENUMERATOR
+};
+
+namespace method_table {
+
+constexpr std::string_view kNames[] = {
+#define WIREGUARD_DART_METHOD_NAME(id, name) name,
+    WIREGUARD_DART_METHODS(WIREGUARD_DART_METHOD_NAME)
+#undef WIREGUARD_DART_METHOD_NAME
+};
+constexpr size_t kCount = sizeof(kNames) / sizeof(kNames[0]);
+static_assert(kCount < 255, "slots hold a method index below kEmpty");
+
+// A power of two of at least kCount squared, so a seed without collisions is found within a few tries
+constexpr size_t SlotCount() {
+  size_t slots = 1;
+  while (slots < kCount * kCount) {
+    slots *= 2;
+  }
+  return slots;
+}
+constexpr size_t kSlotCount = SlotCount();
+constexpr uint8_t kEmpty = 0xff;
+
+// FNV-1a from a seeded basis, with the high bits folded into the low ones the slot is taken from
+constexpr uint32_t Hash(std::string_view name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (char c : name) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  return hash ^ (hash >> 16);
+}
+
+constexpr bool Collides(uint32_t seed) {
+  std::array<bool, kSlotCount> used{};
+  for (size_t i = 0; i < kCount; i++) {
+    size_t slot = Hash(kNames[i], seed) & (kSlotCount - 1);
+    if (used[slot]) {
+      return true;
+    }
+    used[slot] = true;
+  }
+  return false;
+}
+
+constexpr uint32_t kMaxSeed = 1024;
+constexpr uint32_t FindSeed() {
+  uint32_t seed = 0;
+  while (seed < kMaxSeed && Collides(seed)) {
+    seed++;
+  }
+  return seed;
+}
+constexpr uint32_t kSeed = FindSeed();
+static_assert(kSeed < kMaxSeed, "no seed hashes every method name to a slot of its own");
+
+constexpr std::array<uint8_t, kSlotCount> BuildSlots() {
+  std::array<uint8_t, kSlotCount> slots{};
+  for (size_t i = 0; i < kSlotCount; i++) {
+    slots[i] = kEmpty;
+  }
+  for (size_t i = 0; i < kCount; i++) {
+    slots[Hash(kNames[i], kSeed) & (kSlotCount - 1)] = static_cast<uint8_t>(i);
+  }
+  return slots;
+}
+constexpr std::array<uint8_t, kSlotCount> kSlots = BuildSlots();
+
+} // namespace method_table
+
+// One hash and one comparison, however many methods there are
+constexpr std::optional<WireguardMethod> MethodFromName(std::string_view name) {
+  uint8_t index = method_table::kSlots[method_table::Hash(name, method_table::kSeed) & (method_table::kSlotCount - 1)];
+  if (index == method_table::kEmpty || method_table::kNames[index] != name) {
+    return std::nullopt;
+  }
+  return static_cast<WireguardMethod>(index);
+}
+
+static_assert(MethodFromName("setupTunnel") == WireguardMethod::SETUP_TUNNEL);
+static_assert(!MethodFromName("noSuchMethod"));
+
+} // namespace wireguard_dart
@@ -1,103 +1,921 @@
 #include "wireguard_network_config.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cwchar>
+#include <iterator>
+#include <map>
+#include <set>
 #include <stdexcept>
+#include <system_error>
+#include <thread>
 #include <vector>
+#include <objbase.h>
 #include <ws2tcpip.h>
 
 #pragma comment(lib, "iphlpapi.lib")
 #pragma comment(lib, "ws2_32.lib")
 
+#include "call_metrics.h"
+#include "intern_table.h"
 #include "spdlog/spdlog.h"
+#include "string_conversions.h"
+#include "trace_events.h"
+#include "transient_retry.h"
 
 namespace wireguard_dart {
 
-WireguardNetworkConfig::WireguardNetworkConfig(const NET_LUID &luid) : luid_(luid) {
-  // Initialize logger
-  try {
-    logger_ = spdlog::get("wireguard_dart");
-    if (!logger_) {
-      logger_ = spdlog::default_logger();
+namespace {
+
+// SetInterfaceDnsSettings exists from Windows 10 2004 on and is looked up at runtime, so its structure is
+// declared here rather than depending on an SDK that has it
+struct DnsInterfaceSettings {
+  ULONG Version;
+  ULONG64 Flags;
+  PWSTR Domain;
+  PWSTR NameServer;
+  PWSTR SearchList;
+  ULONG RegistrationEnabled;
+  ULONG RegisterAdapterName;
+  ULONG EnableLLMNR;
+  ULONG QueryAdapterName;
+  PWSTR ProfileNameServer;
+};
+
+constexpr ULONG kDnsInterfaceSettingsVersion1 = 1;
+constexpr ULONG64 kDnsSettingIpv6 = 0x0001;
+constexpr ULONG64 kDnsSettingNameServer = 0x0002;
+constexpr ULONG64 kDnsSettingSearchList = 0x0004;
+
+using SetInterfaceDnsSettingsFn = DWORD(WINAPI *)(GUID, const DnsInterfaceSettings *);
+using DnsFlushResolverCacheEntryFn = BOOL(WINAPI *)(PCWSTR);
+
+SetInterfaceDnsSettingsFn LoadSetInterfaceDnsSettings() {
+  static const SetInterfaceDnsSettingsFn function = [] {
+    HMODULE iphlpapi = GetModuleHandleW(L"iphlpapi.dll");
+    return iphlpapi ? reinterpret_cast<SetInterfaceDnsSettingsFn>(GetProcAddress(iphlpapi, "SetInterfaceDnsSettings"))
+                    : nullptr;
+  }();
+  return function;
+}
+
+// Not documented, but exported by dnsapi.dll on every supported version; without it nothing is flushed
+DnsFlushResolverCacheEntryFn LoadDnsFlushResolverCacheEntry() {
+  static const DnsFlushResolverCacheEntryFn function = [] {
+    HMODULE dnsapi = LoadLibraryExW(L"dnsapi.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+    return dnsapi
+               ? reinterpret_cast<DnsFlushResolverCacheEntryFn>(GetProcAddress(dnsapi, "DnsFlushResolverCacheEntry_W"))
+               : nullptr;
+  }();
+  return function;
+}
+
+// In the registry's form, e.g. {5F8E1E2A-0C3B-4D6E-9A7F-1B2C3D4E5F60}
+std::wstring GuidToString(const GUID &guid) {
+  wchar_t text[40];
+  swprintf(text, sizeof(text) / sizeof(text[0]), L"{%08lX-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+           static_cast<unsigned long>(guid.Data1), guid.Data2, guid.Data3, guid.Data4[0], guid.Data4[1],
+           guid.Data4[2], guid.Data4[3], guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+  return text;
+}
+
+std::wstring AddressToWide(const SOCKADDR_INET &address) {
+  char text[INET6_ADDRSTRLEN] = {};
+  if (address.si_family == AF_INET) {
+    inet_ntop(AF_INET, &address.Ipv4.sin_addr, text, sizeof(text));
+  } else {
+    inet_ntop(AF_INET6, &address.Ipv6.sin6_addr, text, sizeof(text));
+  }
+  return Utf8ToWide(text);
+}
+
+// The NRPT rules that are not group policy, which the DNS client reads next to those
+constexpr wchar_t kDnsPolicyConfig[] = L"SYSTEM\\CurrentControlSet\\Services\\Dnscache\\Parameters\\DnsPolicyConfig";
+// Followed by the interface GUID and the rule's number, so the rules of an interface are found after a restart
+constexpr wchar_t kNrptRulePrefix[] = L"WireguardDart-";
+// The DNS client reads up to 50 names per rule, and each domain takes two: itself and, with a leading dot, the
+// names under it
+constexpr size_t kNrptDomainsPerRule = 25;
+constexpr DWORD kNrptRuleVersion = 2;
+constexpr DWORD kNrptGenericDnsServers = 0x8;
+
+// Have the DNS client read its rules again now rather than on its next poll; best effort
+void NotifyDnsClient() {
+  SC_HANDLE manager = OpenSCManagerW(nullptr, nullptr, SC_MANAGER_CONNECT);
+  if (!manager) {
+    return;
+  }
+  if (SC_HANDLE service = OpenServiceW(manager, L"Dnscache", SERVICE_PAUSE_CONTINUE)) {
+    SERVICE_STATUS status;
+    ControlService(service, SERVICE_CONTROL_PARAMCHANGE, &status);
+    CloseServiceHandle(service);
+  }
+  CloseServiceHandle(manager);
+}
+
+// Policy-based QoS policies of the local group policy, which are also applied outside a domain
+constexpr wchar_t kQosPolicies[] = L"SOFTWARE\\Policies\\Microsoft\\Windows\\QoS";
+// Followed by the interface GUID and the policy's number, as the NRPT rules
+constexpr wchar_t kQosPolicyPrefix[] = L"WireguardDart-";
+// Without "Do not use NLA", policies only mark traffic on interfaces of a domain network, which a tunnel never is.
+// The first time the plugin sets it, its value from before is kept next to it, of type REG_NONE if it had none, and
+// put back once the last policy of any tunnel is gone, also after a crash in between.
+constexpr wchar_t kQosParameters[] = L"SYSTEM\\CurrentControlSet\\Services\\Tcpip\\QoS";
+constexpr wchar_t kNlaValue[] = L"Do not use NLA";
+constexpr wchar_t kNlaBackupValue[] = L"WireguardDart Do not use NLA";
+
+using RefreshPolicyExFn = BOOL(WINAPI *)(BOOL, DWORD);
+
+RefreshPolicyExFn LoadRefreshPolicyEx() {
+  static const RefreshPolicyExFn function = [] {
+    HMODULE userenv = LoadLibraryExW(L"userenv.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+    return userenv ? reinterpret_cast<RefreshPolicyExFn>(GetProcAddress(userenv, "RefreshPolicyEx")) : nullptr;
+  }();
+  return function;
+}
+
+// The subkeys of HKLM\path whose names start with prefix; a missing key has none
+LSTATUS FindSubKeys(const wchar_t *path, const std::wstring &prefix, std::set<std::wstring> &found) {
+  HKEY parent;
+  LSTATUS status = RegOpenKeyExW(HKEY_LOCAL_MACHINE, path, 0, KEY_ENUMERATE_SUB_KEYS, &parent);
+  if (status == ERROR_SUCCESS) {
+    wchar_t name[256];
+    for (DWORD index = 0;; index++) {
+      DWORD length = static_cast<DWORD>(std::size(name));
+      status = RegEnumKeyExW(parent, index, name, &length, nullptr, nullptr, nullptr, nullptr);
+      if (status == ERROR_MORE_DATA) {
+        continue;
+      }
+      if (status != ERROR_SUCCESS) {
+        break;
+      }
+      if (wcsncmp(name, prefix.c_str(), prefix.size()) == 0) {
+        found.insert(name);
+      }
+    }
+    RegCloseKey(parent);
+  }
+  return status == ERROR_NO_MORE_ITEMS || status == ERROR_FILE_NOT_FOUND ? ERROR_SUCCESS : status;
+}
+
+// The keys of path named prefix{GUID}... whose interface GUID no longer belongs to an interface
+size_t RemoveKeysOfGoneInterfaces(const wchar_t *path, const wchar_t *prefix, size_t *failed) {
+  *failed = 0;
+  std::set<std::wstring> keys;
+  if (FindSubKeys(path, prefix, keys) != ERROR_SUCCESS || keys.empty()) {
+    return 0;
+  }
+  HKEY parent;
+  if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, path, 0, KEY_ENUMERATE_SUB_KEYS | DELETE, &parent) != ERROR_SUCCESS) {
+    *failed = keys.size();
+    return 0;
+  }
+  size_t removed = 0;
+  const size_t prefix_length = wcslen(prefix);
+  for (const auto &name : keys) {
+    // The interface GUID in braces follows the prefix
+    size_t end = name.find(L'}', prefix_length);
+    GUID guid;
+    NET_LUID luid;
+    if (end == std::wstring::npos ||
+        FAILED(IIDFromString(name.substr(prefix_length, end + 1 - prefix_length).c_str(), &guid)) ||
+        ConvertInterfaceGuidToLuid(&guid, &luid) == NO_ERROR) {
+      continue;
+    }
+    LSTATUS status = RegDeleteKeyW(parent, name.c_str());
+    if (status == ERROR_SUCCESS || status == ERROR_FILE_NOT_FOUND) {
+      removed++;
+    } else {
+      (*failed)++;
+    }
+  }
+  RegCloseKey(parent);
+  return removed;
+}
+
+// Sets "Do not use NLA", keeping the value from before unless it was kept already; best effort
+void SetQosWithoutNla() {
+  HKEY parameters;
+  if (RegCreateKeyExW(HKEY_LOCAL_MACHINE, kQosParameters, 0, nullptr, 0, KEY_QUERY_VALUE | KEY_SET_VALUE, nullptr,
+                      &parameters, nullptr) != ERROR_SUCCESS) {
+    return;
+  }
+  if (RegQueryValueExW(parameters, kNlaBackupValue, nullptr, nullptr, nullptr, nullptr) == ERROR_FILE_NOT_FOUND) {
+    BYTE previous[64];
+    DWORD type = REG_NONE;
+    DWORD size = sizeof(previous);
+    LSTATUS status = RegQueryValueExW(parameters, kNlaValue, nullptr, &type, previous, &size);
+    if (status == ERROR_FILE_NOT_FOUND) {
+      type = REG_NONE;
+      size = 0;
+    }
+    if ((status != ERROR_SUCCESS && status != ERROR_FILE_NOT_FOUND) ||
+        RegSetValueExW(parameters, kNlaBackupValue, 0, type, previous, size) != ERROR_SUCCESS) {
+      // Without a record of it, the value from before would be lost
+      RegCloseKey(parameters);
+      return;
+    }
+  }
+  static const wchar_t kOne[] = L"1";
+  RegSetValueExW(parameters, kNlaValue, 0, REG_SZ, reinterpret_cast<const BYTE *>(kOne), sizeof(kOne));
+  RegCloseKey(parameters);
+}
+
+// Puts back "Do not use NLA" as SetQosWithoutNla found it, once no policy of the plugin is left; best effort
+void RestoreQosNla() {
+  std::set<std::wstring> remaining;
+  if (FindSubKeys(kQosPolicies, kQosPolicyPrefix, remaining) != ERROR_SUCCESS || !remaining.empty()) {
+    return;
+  }
+  HKEY parameters;
+  if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, kQosParameters, 0, KEY_QUERY_VALUE | KEY_SET_VALUE, &parameters) !=
+      ERROR_SUCCESS) {
+    return;
+  }
+  BYTE previous[64];
+  DWORD type = REG_NONE;
+  DWORD size = sizeof(previous);
+  if (RegQueryValueExW(parameters, kNlaBackupValue, nullptr, &type, previous, &size) == ERROR_SUCCESS) {
+    LSTATUS status = type == REG_NONE ? RegDeleteValueW(parameters, kNlaValue)
+                                      : RegSetValueExW(parameters, kNlaValue, 0, type, previous, size);
+    if (status == ERROR_SUCCESS || status == ERROR_FILE_NOT_FOUND) {
+      RegDeleteValueW(parameters, kNlaBackupValue);
     }
-  } catch (const std::exception &) {
-    // Fallback to default logger if initialization fails
-    logger_ = spdlog::default_logger();
   }
+  RegCloseKey(parameters);
+}
+
+// The address of a tunnel address row, as policies and rules take it
+std::wstring AllowedIpAddressToWide(const WIREGUARD_ALLOWED_IP &allowed_ip) {
+  SOCKADDR_INET address = {};
+  address.si_family = allowed_ip.AddressFamily;
+  if (allowed_ip.AddressFamily == AF_INET) {
+    address.Ipv4.sin_addr = allowed_ip.Address.V4;
+  } else {
+    address.Ipv6.sin6_addr = allowed_ip.Address.V6;
+  }
+  return AddressToWide(address);
+}
+
+WIREGUARD_ALLOWED_IP ToAllowedIp(const IpPrefix &prefix) {
+  WIREGUARD_ALLOWED_IP allowed_ip = {};
+  allowed_ip.AddressFamily = prefix.family;
+  allowed_ip.Cidr = prefix.length;
+  memcpy(&allowed_ip.Address, prefix.address, prefix.family == AF_INET ? sizeof(IN_ADDR) : sizeof(IN6_ADDR));
+  return allowed_ip;
 }
 
-bool WireguardNetworkConfig::ConfigureMTU(DWORD mtu) {
-  logger_->info("Setting MTU to {} for both IPv4 and IPv6", mtu);
+} // namespace
+
+WireguardNetworkConfig::WireguardNetworkConfig(const NET_LUID &luid, NetworkLedger *ledger,
+                                               NetworkUndoLog *undo_log)
+    : luid_(luid), ledger_(ledger), undo_log_(undo_log) {}
+
+bool WireguardNetworkConfig::ConfigureMTU(DWORD mtu) { return ConfigureInterface(mtu, InterfaceProfile()); }
+
+bool WireguardNetworkConfig::ConfigureInterface(DWORD mtu, const InterfaceProfile &profile) {
+  logger_->info("Setting MTU to {} for {}", mtu,
+                families_.ipv4 && families_.ipv6 ? "both IPv4 and IPv6" : (families_.ipv4 ? "IPv4" : "IPv6"));
 
   for (ADDRESS_FAMILY family : {static_cast<ADDRESS_FAMILY>(AF_INET), static_cast<ADDRESS_FAMILY>(AF_INET6)}) {
+    bool used = families_.Uses(family);
     MIB_IPINTERFACE_ROW row;
     InitializeIpInterfaceEntry(&row);
     row.InterfaceLuid = luid_;
     row.Family = family;
 
-    DWORD result = GetIpInterfaceEntry(&row);
+    // Not found is transient for a family the tunnel uses, whose interface of a new adapter shows up in the IP
+    // stack a little after the adapter; IsTransientError cannot tell it from a family that is off for good
+    const RetryPolicy policy;
+    DWORD result;
+    for (int attempt = 1;; attempt++) {
+      result = RetryTransient(MeteredCall::kGetIpInterfaceEntry, [&row]() {
+        return MeteredInvoke(MeteredCall::kGetIpInterfaceEntry, GetIpInterfaceEntry, &row);
+      });
+      if (!used || result != ERROR_NOT_FOUND || attempt >= policy.attempts) {
+        break;
+      }
+      WaitBeforeRetry(MeteredCall::kGetIpInterfaceEntry, result, attempt, policy);
+    }
     if (result != NO_ERROR) {
-      logger_->warn("Failed to get IP interface entry for family {}: Windows error {}", family, result);
+      // Without the entry the tunnel would run with the default MTU and metric
+      if (used) {
+        logger_->error("Failed to get IP interface entry for family {}: Windows error {}", family, result);
+        return false;
+      }
+      // A family the tunnel does not use may well be unbound from the adapter or off on the machine
+      SPDLOG_LOGGER_DEBUG(logger_, "No IP interface entry for unused family {}: Windows error {}", family, result);
+      continue;
+    }
+
+    MIB_IPINTERFACE_ROW previous = row;
+    if (!used) {
+      if (row.DadTransmits == 0 && row.RouterDiscoveryBehavior == RouterDiscoveryDisabled) {
+        continue;
+      }
+      row.DadTransmits = 0;
+      row.RouterDiscoveryBehavior = RouterDiscoveryDisabled;
+      row.SitePrefixLength = 0;
+      result = RetryTransient(MeteredCall::kSetIpInterfaceEntry, [&row]() {
+        return MeteredInvoke(MeteredCall::kSetIpInterfaceEntry, SetIpInterfaceEntry, &row);
+      });
+      if (result != NO_ERROR) {
+        // Only quiets the stack, so the tunnel works without it
+        logger_->warn("Failed to quiet unused address family {}: Windows error {}", family, result);
+        continue;
+      }
+      if (undo_log_) {
+        undo_log_->interface_rows.push_back(previous);
+      }
+      SPDLOG_LOGGER_DEBUG(logger_, "Duplicate address detection and router discovery off for unused family {}",
+                          family);
       continue;
     }
 
     row.NlMtu = mtu;
     row.SitePrefixLength = 0;
+    if (profile.has_metric) {
+      row.Metric = profile.metric;
+      row.UseAutomaticMetric = FALSE;
+    }
+    if (profile.has_automatic_metric) {
+      row.UseAutomaticMetric = profile.automatic_metric ? TRUE : FALSE;
+    }
+    if (profile.has_router_discovery) {
+      row.RouterDiscoveryBehavior = profile.router_discovery ? RouterDiscoveryEnabled : RouterDiscoveryDisabled;
+    }
+    if (profile.has_dad_transmits) {
+      row.DadTransmits = profile.dad_transmits;
+    }
 
-    result = SetIpInterfaceEntry(&row);
+    result = RetryTransient(MeteredCall::kSetIpInterfaceEntry, [&row]() {
+      return MeteredInvoke(MeteredCall::kSetIpInterfaceEntry, SetIpInterfaceEntry, &row);
+    });
     if (result != NO_ERROR) {
-      logger_->error("Failed to set MTU for family {}: Windows error {}", family, result);
+      logger_->error("Failed to set interface settings for family {}: Windows error {}", family, result);
       return false;
     }
-    logger_->debug("MTU set to {} for address family {}", mtu, family);
+    if (undo_log_) {
+      undo_log_->interface_rows.push_back(previous);
+    }
+    SPDLOG_LOGGER_DEBUG(logger_, "MTU set to {} for address family {}", mtu, family);
   }
 
   return true;
 }
 
+bool WireguardNetworkConfig::ConfigureDNS(const std::vector<SOCKADDR_INET> &servers,
+                                          const std::vector<std::string> &search_domains) {
+  GUID guid;
+  DWORD result = ConvertInterfaceLuidToGuid(&luid_, &guid);
+  if (result != NO_ERROR) {
+    logger_->error("Failed to get interface GUID for DNS configuration: Windows error {}", result);
+    return false;
+  }
+
+  std::wstring search_list;
+  for (const auto &domain : search_domains) {
+    search_list += (search_list.empty() ? L"" : L",") + Utf8ToWide(domain);
+  }
+
+  SetInterfaceDnsSettingsFn set_dns_settings = LoadSetInterfaceDnsSettings();
+  bool success = true;
+  if (undo_log_) {
+    undo_log_->dns_changed = true;
+  }
+  for (ADDRESS_FAMILY family : {static_cast<ADDRESS_FAMILY>(AF_INET), static_cast<ADDRESS_FAMILY>(AF_INET6)}) {
+    std::wstring name_servers;
+    for (const auto &server : servers) {
+      if (server.si_family == family) {
+        name_servers += (name_servers.empty() ? L"" : L",") + AddressToWide(server);
+      }
+    }
+
+    if (!set_dns_settings) {
+      success = ConfigureDNSInRegistry(family, name_servers, search_list) && success;
+      continue;
+    }
+
+    DnsInterfaceSettings settings = {};
+    settings.Version = kDnsInterfaceSettingsVersion1;
+    settings.Flags = kDnsSettingNameServer | kDnsSettingSearchList | (family == AF_INET6 ? kDnsSettingIpv6 : 0);
+    settings.NameServer = const_cast<PWSTR>(name_servers.c_str());
+    settings.SearchList = const_cast<PWSTR>(search_list.c_str());
+    result = MeteredInvoke(MeteredCall::kSetInterfaceDnsSettings, set_dns_settings, guid, &settings);
+    if (result != NO_ERROR) {
+      logger_->error("Failed to set DNS settings for family {}: Windows error {}", family, result);
+      success = false;
+    }
+  }
+
+  // Each call drops the cached entry of exactly that name, not of the names under it. Those, and any other name the
+  // new servers answer differently, stay cached until their TTL runs out.
+  if (DnsFlushResolverCacheEntryFn flush_entry = LoadDnsFlushResolverCacheEntry()) {
+    for (const auto &domain : search_domains) {
+      MeteredInvoke(MeteredCall::kDnsFlushResolverCacheEntry, flush_entry, Utf8AsWide(domain).c_str());
+    }
+  }
+
+  if (success) {
+    logger_->info("Configured {} DNS servers and {} search domains", servers.size(), search_domains.size());
+  }
+  return success;
+}
+
+bool WireguardNetworkConfig::ConfigureDNSInRegistry(ADDRESS_FAMILY family, const std::wstring &servers,
+                                                    const std::wstring &search_list) {
+  GUID guid;
+  ConvertInterfaceLuidToGuid(&luid_, &guid);
+  std::wstring path = std::wstring(family == AF_INET6 ? L"SYSTEM\\CurrentControlSet\\Services\\Tcpip6"
+                                                      : L"SYSTEM\\CurrentControlSet\\Services\\Tcpip") +
+                      L"\\Parameters\\Interfaces\\" + GuidToString(guid);
+
+  HKEY key;
+  LSTATUS result = RegOpenKeyExW(HKEY_LOCAL_MACHINE, path.c_str(), 0, KEY_SET_VALUE, &key);
+  if (result != ERROR_SUCCESS) {
+    logger_->error("Failed to open the interface registry key for family {}: Windows error {}", family, result);
+    return false;
+  }
+
+  auto set_string = [key](const wchar_t *name, const std::wstring &value) {
+    return RegSetValueExW(key, name, 0, REG_SZ, reinterpret_cast<const BYTE *>(value.c_str()),
+                          static_cast<DWORD>((value.size() + 1) * sizeof(wchar_t)));
+  };
+  result = set_string(L"NameServer", servers);
+  if (result == ERROR_SUCCESS) {
+    result = set_string(L"SearchList", search_list);
+  }
+  RegCloseKey(key);
+
+  if (result != ERROR_SUCCESS) {
+    logger_->error("Failed to write DNS settings to the registry for family {}: Windows error {}", family, result);
+    return false;
+  }
+  return true;
+}
+
+bool WireguardNetworkConfig::ConfigureNrptRules(const std::vector<std::string> &domains,
+                                                const std::vector<SOCKADDR_INET> &servers) {
+  GUID guid;
+  DWORD result = ConvertInterfaceLuidToGuid(&luid_, &guid);
+  if (result != NO_ERROR) {
+    logger_->error("Failed to get interface GUID for NRPT rules: Windows error {}", result);
+    return false;
+  }
+  std::wstring prefix = kNrptRulePrefix + GuidToString(guid) + L"-";
+
+  std::wstring server_list;
+  for (const auto &server : servers) {
+    server_list += (server_list.empty() ? L"" : L";") + AddressToWide(server);
+  }
+  uint64_t content = HashBytes(server_list.data(), server_list.size() * sizeof(wchar_t));
+  for (const auto &domain : domains) {
+    content = HashBytes(domain.data(), domain.size() + 1, content);
+  }
+  if (ledger_ && ledger_->nrpt_rules_known && ledger_->nrpt_content == content) {
+    return true;
+  }
+
+  std::set<std::wstring> installed;
+  if (!GetInstalledNrptRules(prefix, installed)) {
+    return false;
+  }
+  if (domains.empty() && installed.empty()) {
+    return true;
+  }
+  if (undo_log_) {
+    undo_log_->nrpt_changed = true;
+  }
+
+  HKEY policies;
+  LSTATUS status = RegCreateKeyExW(HKEY_LOCAL_MACHINE, kDnsPolicyConfig, 0, nullptr, 0,
+                                   KEY_CREATE_SUB_KEY | KEY_ENUMERATE_SUB_KEYS | DELETE, nullptr, &policies, nullptr);
+  if (status != ERROR_SUCCESS) {
+    logger_->error("Failed to open the NRPT rules: Windows error {}", status);
+    return false;
+  }
+
+  // Rules holding at most kNrptDomainsPerRule domains each, numbered from 0
+  bool success = true;
+  std::set<std::wstring> written;
+  for (size_t first = 0; first < domains.size(); first += kNrptDomainsPerRule) {
+    std::wstring names;
+    for (size_t i = first; i < domains.size() && i < first + kNrptDomainsPerRule; i++) {
+      std::wstring domain = Utf8ToWide(domains[i]);
+      names.append(domain).push_back(L'\0');
+      names.append(L".").append(domain).push_back(L'\0');
+    }
+
+    std::wstring name = prefix + std::to_wstring(first / kNrptDomainsPerRule);
+    HKEY rule;
+    status = RegCreateKeyExW(policies, name.c_str(), 0, nullptr, 0, KEY_SET_VALUE, nullptr, &rule, nullptr);
+    if (status == ERROR_SUCCESS) {
+      auto set_dword = [rule](const wchar_t *value_name, DWORD value) {
+        return RegSetValueExW(rule, value_name, 0, REG_DWORD, reinterpret_cast<const BYTE *>(&value), sizeof(value));
+      };
+      auto set_string = [rule](const wchar_t *value_name, DWORD type, const std::wstring &value) {
+        return RegSetValueExW(rule, value_name, 0, type, reinterpret_cast<const BYTE *>(value.c_str()),
+                              static_cast<DWORD>((value.size() + 1) * sizeof(wchar_t)));
+      };
+      // The terminator set_string writes is the empty string that closes the REG_MULTI_SZ
+      LSTATUS statuses[] = {set_dword(L"Version", kNrptRuleVersion), set_string(L"Name", REG_MULTI_SZ, names),
+                            set_string(L"GenericDNSServers", REG_SZ, server_list),
+                            set_dword(L"ConfigOptions", kNrptGenericDnsServers),
+                            set_string(L"IPSECCARestriction", REG_SZ, L"")};
+      RegCloseKey(rule);
+      for (LSTATUS value_status : statuses) {
+        if (value_status != ERROR_SUCCESS) {
+          status = value_status;
+        }
+      }
+    }
+    // Recorded even when partly written, so a rollback or cleanup removes it
+    written.insert(name);
+    if (status != ERROR_SUCCESS) {
+      logger_->error("Failed to write NRPT rule {}: Windows error {}", WideAsUtf8(name).view(), status);
+      success = false;
+      break;
+    }
+  }
+
+  for (const auto &name : installed) {
+    if (written.count(name) == 0) {
+      status = RegDeleteKeyW(policies, name.c_str());
+      if (status != ERROR_SUCCESS && status != ERROR_FILE_NOT_FOUND) {
+        logger_->warn("Failed to remove NRPT rule {}: Windows error {}", WideAsUtf8(name).view(), status);
+        written.insert(name);
+        success = false;
+      }
+    }
+  }
+  RegCloseKey(policies);
+
+  if (ledger_) {
+    ledger_->nrpt_rules = written;
+    ledger_->nrpt_rules_known = true;
+    // A failed write is done again next time
+    ledger_->nrpt_content = success ? content : ~content;
+  }
+
+  NotifyDnsClient();
+  if (DnsFlushResolverCacheEntryFn flush_entry = LoadDnsFlushResolverCacheEntry()) {
+    for (const auto &domain : domains) {
+      MeteredInvoke(MeteredCall::kDnsFlushResolverCacheEntry, flush_entry, Utf8AsWide(domain).c_str());
+    }
+  }
+
+  if (success) {
+    logger_->info("Configured NRPT rules for {} split DNS domains", domains.size());
+  }
+  return success;
+}
+
+size_t WireguardNetworkConfig::RemoveOrphanedNrptRules(size_t *failed) {
+  size_t removed = RemoveKeysOfGoneInterfaces(kDnsPolicyConfig, kNrptRulePrefix, failed);
+  if (removed > 0) {
+    NotifyDnsClient();
+  }
+  return removed;
+}
+
+size_t WireguardNetworkConfig::RemoveOrphanedQosPolicies(size_t *failed) {
+  size_t removed = RemoveKeysOfGoneInterfaces(kQosPolicies, kQosPolicyPrefix, failed);
+  RestoreQosNla();
+  return removed;
+}
+
+bool WireguardNetworkConfig::GetInstalledNrptRules(const std::wstring &prefix, std::set<std::wstring> &installed) {
+  if (ledger_ && ledger_->nrpt_rules_known) {
+    installed = ledger_->nrpt_rules;
+    return true;
+  }
+
+  LSTATUS status = FindSubKeys(kDnsPolicyConfig, prefix, installed);
+  if (status != ERROR_SUCCESS) {
+    logger_->error("Failed to read the NRPT rules: Windows error {}", status);
+    return false;
+  }
+
+  // From here on the ledger tracks every change, so it is exact again
+  if (ledger_) {
+    ledger_->nrpt_rules = installed;
+    ledger_->nrpt_rules_known = true;
+    // Matches no content, so the rules found are written over
+    ledger_->nrpt_content = 0;
+  }
+  return true;
+}
+
+bool WireguardNetworkConfig::ConfigureQosPolicies(const std::vector<QosRule> &rules, WORD listen_port,
+                                                  const std::vector<WIREGUARD_ALLOWED_IP> &addresses) {
+  GUID guid;
+  DWORD result = ConvertInterfaceLuidToGuid(&luid_, &guid);
+  if (result != NO_ERROR) {
+    logger_->error("Failed to get interface GUID for QoS policies: Windows error {}", result);
+    return false;
+  }
+  std::wstring prefix = kQosPolicyPrefix + GuidToString(guid) + L"-";
+
+  // The tunnel's own datagrams are told apart by their port; everything else by being sent from one of the tunnel's
+  // addresses, a policy for each, so that the same application or port on other interfaces is left unmarked
+  struct Policy {
+    const QosRule *rule;
+    const WIREGUARD_ALLOWED_IP *address;
+  };
+  std::vector<Policy> applied;
+  uint64_t content = HashBytes(&listen_port, sizeof(listen_port));
+  for (const auto &address : addresses) {
+    content = HashBytes(&address.AddressFamily, sizeof(address.AddressFamily), content);
+    content = HashBytes(&address.Address, sizeof(address.Address), content);
+  }
+  for (const auto &rule : rules) {
+    if (rule.tunnel) {
+      if (listen_port == 0) {
+        continue;
+      }
+      applied.push_back({&rule, nullptr});
+    } else {
+      for (const auto &address : addresses) {
+        applied.push_back({&rule, &address});
+      }
+    }
+    content = HashBytes(rule.application.data(), rule.application.size() + 1, content);
+    const BYTE fields[] = {rule.protocol, static_cast<BYTE>(rule.first_port), static_cast<BYTE>(rule.first_port >> 8),
+                           static_cast<BYTE>(rule.last_port), static_cast<BYTE>(rule.last_port >> 8), rule.tunnel,
+                           rule.dscp};
+    content = HashBytes(fields, sizeof(fields), content);
+  }
+  if (ledger_ && ledger_->qos_policies_known && ledger_->qos_content == content) {
+    return true;
+  }
+
+  std::set<std::wstring> installed;
+  if (!GetInstalledQosPolicies(prefix, installed)) {
+    return false;
+  }
+  if (applied.empty() && installed.empty()) {
+    return true;
+  }
+  if (undo_log_) {
+    undo_log_->qos_changed = true;
+  }
+
+  HKEY policies;
+  LSTATUS status = RegCreateKeyExW(HKEY_LOCAL_MACHINE, kQosPolicies, 0, nullptr, 0,
+                                   KEY_CREATE_SUB_KEY | KEY_ENUMERATE_SUB_KEYS | DELETE, nullptr, &policies, nullptr);
+  if (status != ERROR_SUCCESS) {
+    logger_->error("Failed to open the QoS policies: Windows error {}", status);
+    return false;
+  }
+  if (!applied.empty()) {
+    SetQosWithoutNla();
+  }
+
+  // Policies numbered from 0; every value is a string, "*" matching anything
+  bool success = true;
+  std::set<std::wstring> written;
+  for (size_t i = 0; i < applied.size(); i++) {
+    const QosRule &rule = *applied[i].rule;
+    const WIREGUARD_ALLOWED_IP *address = applied[i].address;
+    std::wstring ports = L"*";
+    if (rule.tunnel) {
+      ports = std::to_wstring(listen_port);
+    } else if (rule.first_port != 0) {
+      ports = std::to_wstring(rule.first_port);
+      if (rule.last_port != rule.first_port) {
+        ports += L":" + std::to_wstring(rule.last_port);
+      }
+    }
+    const wchar_t *protocol = L"*";
+    if (rule.tunnel || rule.protocol == IPPROTO_UDP) {
+      protocol = L"UDP";
+    } else if (rule.protocol == IPPROTO_TCP) {
+      protocol = L"TCP";
+    }
+    std::wstring application = rule.application.empty() ? L"*" : Utf8ToWide(rule.application);
+
+    std::wstring name = prefix + std::to_wstring(i);
+    HKEY policy;
+    status = RegCreateKeyExW(policies, name.c_str(), 0, nullptr, 0, KEY_SET_VALUE, nullptr, &policy, nullptr);
+    if (status == ERROR_SUCCESS) {
+      auto set_string = [policy](const wchar_t *value_name, const std::wstring &value) {
+        return RegSetValueExW(policy, value_name, 0, REG_SZ, reinterpret_cast<const BYTE *>(value.c_str()),
+                              static_cast<DWORD>((value.size() + 1) * sizeof(wchar_t)));
+      };
+      LSTATUS statuses[] = {set_string(L"Version", L"1.0"),
+                            set_string(L"Application Name", application),
+                            set_string(L"Protocol", protocol),
+                            set_string(L"Local Port", rule.tunnel ? ports : L"*"),
+                            set_string(L"Local IP", address ? AllowedIpAddressToWide(*address) : L"*"),
+                            set_string(L"Local IP Prefix Length",
+                                       address ? (address->AddressFamily == AF_INET ? L"32" : L"128") : L"*"),
+                            set_string(L"Remote Port", rule.tunnel ? L"*" : ports),
+                            set_string(L"Remote IP", L"*"),
+                            set_string(L"Remote IP Prefix Length", L"*"),
+                            set_string(L"DSCP Value", std::to_wstring(rule.dscp)),
+                            set_string(L"Throttle Rate", L"-1")};
+      RegCloseKey(policy);
+      for (LSTATUS value_status : statuses) {
+        if (value_status != ERROR_SUCCESS) {
+          status = value_status;
+        }
+      }
+    }
+    // Recorded even when partly written, so a rollback or cleanup removes it
+    written.insert(name);
+    if (status != ERROR_SUCCESS) {
+      logger_->error("Failed to write QoS policy {}: Windows error {}", WideAsUtf8(name).view(), status);
+      success = false;
+      break;
+    }
+  }
+
+  for (const auto &name : installed) {
+    if (written.count(name) == 0) {
+      status = RegDeleteKeyW(policies, name.c_str());
+      if (status != ERROR_SUCCESS && status != ERROR_FILE_NOT_FOUND) {
+        logger_->warn("Failed to remove QoS policy {}: Windows error {}", WideAsUtf8(name).view(), status);
+        written.insert(name);
+        success = false;
+      }
+    }
+  }
+  RegCloseKey(policies);
+
+  if (ledger_) {
+    ledger_->qos_policies = written;
+    ledger_->qos_policies_known = true;
+    // A failed write is done again next time
+    ledger_->qos_content = success ? content : ~content;
+  }
+
+  if (applied.empty()) {
+    RestoreQosNla();
+  } else if (RefreshPolicyExFn refresh = LoadRefreshPolicyEx()) {
+    // The policies are read with the rest of the group policy: a refresh of the machine policy, not forced, has
+    // them applied soon rather than at the next background one; best effort. Removed ones stop at that next one.
+    refresh(TRUE, 0);
+  }
+
+  if (success) {
+    logger_->info("Configured {} QoS policies", applied.size());
+  }
+  return success;
+}
+
+bool WireguardNetworkConfig::GetInstalledQosPolicies(const std::wstring &prefix, std::set<std::wstring> &installed) {
+  if (ledger_ && ledger_->qos_policies_known) {
+    installed = ledger_->qos_policies;
+    return true;
+  }
+
+  LSTATUS status = FindSubKeys(kQosPolicies, prefix, installed);
+  if (status != ERROR_SUCCESS) {
+    logger_->error("Failed to read the QoS policies: Windows error {}", status);
+    return false;
+  }
+
+  if (ledger_) {
+    ledger_->qos_policies = installed;
+    ledger_->qos_policies_known = true;
+    ledger_->qos_content = 0;
+  }
+  return true;
+}
+
 bool WireguardNetworkConfig::ConfigureIPAddresses(const std::vector<WIREGUARD_ALLOWED_IP> &addresses) {
   if (addresses.empty()) {
     logger_->info("No IP addresses to configure");
     return true; // No IP addresses to configure - not an error
   }
 
-  logger_->debug("Configuring {} IP address(es)", addresses.size());
+  SPDLOG_LOGGER_DEBUG(logger_, "Configuring {} IP address(es)", addresses.size());
+  TraceRegion trace_region("ConfigureIPAddresses", static_cast<int64_t>(addresses.size()));
 
   for (const auto &addr : addresses) {
-    MIB_UNICASTIPADDRESS_ROW row;
-    InitializeUnicastIpAddressEntry(&row);
+    if (!AddIPAddress(addr)) {
+      return false;
+    }
+  }
 
-    row.InterfaceLuid = luid_;
-    row.DadState = IpDadStatePreferred;
-    row.ValidLifetime = 0xffffffff;     // INFINITE
-    row.PreferredLifetime = 0xffffffff; // INFINITE
-    row.OnLinkPrefixLength = addr.Cidr;
-
-    std::string addr_str = AddressWithCidrToString(addr);
-    if (addr.AddressFamily != AF_INET && addr.AddressFamily != AF_INET6) {
-      logger_->warn("Skipping unsupported address family: {}", addr.AddressFamily);
-      continue;
+  SPDLOG_LOGGER_DEBUG(logger_, "IP address configuration completed successfully");
+  return true;
+}
+
+bool WireguardNetworkConfig::ReconcileIPAddresses(const std::vector<WIREGUARD_ALLOWED_IP> &addresses) {
+  // Addresses are matched on the address itself and its on-link prefix length
+  std::map<IpPrefix, const WIREGUARD_ALLOWED_IP *> missing;
+  for (const auto &addr : addresses) {
+    if (addr.AddressFamily == AF_INET || addr.AddressFamily == AF_INET6) {
+      missing.emplace(IpPrefix::FromAddress(addr), &addr);
     }
+  }
 
-    if (addr.AddressFamily == AF_INET) {
-      row.Address.Ipv4.sin_family = AF_INET;
-      row.Address.Ipv4.sin_addr = addr.Address.V4;
-    } else if (addr.AddressFamily == AF_INET6) {
-      row.Address.Ipv6.sin6_family = AF_INET6;
-      row.Address.Ipv6.sin6_addr = addr.Address.V6;
+  std::set<IpPrefix> installed;
+  if (!GetInstalledIPAddresses(installed)) {
+    return false;
+  }
+
+  bool success = true;
+  size_t kept = 0;
+  size_t removed = 0;
+  for (const auto &prefix : installed) {
+    auto wanted = missing.find(prefix);
+    if (wanted != missing.end()) {
+      missing.erase(wanted);
+      kept++;
+    } else if (DeleteIPAddress(prefix)) {
+      removed++;
+    } else {
+      success = false;
     }
+  }
 
-    logger_->debug("Adding IP address: {}", addr_str);
-    DWORD result = CreateUnicastIpAddressEntry(&row);
-    if (result != NO_ERROR && result != ERROR_OBJECT_ALREADY_EXISTS) {
-      logger_->error("Failed to add IP address {}: Windows error {}", addr_str, result);
+  for (const auto &entry : missing) {
+    if (!AddIPAddress(*entry.second)) {
       return false;
-    } else if (result == ERROR_OBJECT_ALREADY_EXISTS) {
-      logger_->debug("IP address {} already exists", addr_str);
-    } else {
-      logger_->debug("Successfully added IP address: {}", addr_str);
     }
   }
 
-  logger_->debug("IP address configuration completed successfully");
+  logger_->info("Reconciled IP addresses: {} kept, {} added, {} removed", kept, missing.size(), removed);
+  return success;
+}
+
+bool WireguardNetworkConfig::GetInstalledIPAddresses(std::set<IpPrefix> &installed) {
+  if (ledger_ && ledger_->addresses_known) {
+    installed = ledger_->addresses;
+    return true;
+  }
+
+  PMIB_UNICASTIPADDRESS_TABLE table = nullptr;
+  DWORD result = MeteredInvoke(MeteredCall::kGetUnicastIpAddressTable, GetUnicastIpAddressTable, AF_UNSPEC, &table);
+  if (result != NO_ERROR) {
+    logger_->error("Failed to get unicast IP address table: Windows error {}", result);
+    return false;
+  }
+
+  // Link-local and other automatic addresses are left to the system
+  for (ULONG i = 0; i < table->NumEntries; i++) {
+    const MIB_UNICASTIPADDRESS_ROW &row = table->Table[i];
+    if (row.InterfaceLuid.Value == luid_.Value && row.PrefixOrigin == IpPrefixOriginManual) {
+      installed.insert(IpPrefix::FromAddress(row.Address, row.OnLinkPrefixLength));
+    }
+  }
+  FreeMibTable(table);
+
+  // From here on the ledger tracks every change, so it is exact again
+  if (ledger_) {
+    ledger_->addresses = installed;
+    ledger_->addresses_known = true;
+  }
+  return true;
+}
+
+bool WireguardNetworkConfig::AddIPAddress(const WIREGUARD_ALLOWED_IP &addr) {
+  MIB_UNICASTIPADDRESS_ROW row;
+  InitializeUnicastIpAddressEntry(&row);
+
+  row.InterfaceLuid = luid_;
+  row.DadState = IpDadStatePreferred;
+  row.ValidLifetime = 0xffffffff;     // INFINITE
+  row.PreferredLifetime = 0xffffffff; // INFINITE
+  row.OnLinkPrefixLength = addr.Cidr;
+
+  if (addr.AddressFamily != AF_INET && addr.AddressFamily != AF_INET6) {
+    logger_->warn("Skipping unsupported address family: {}", addr.AddressFamily);
+    return true;
+  }
+
+  if (addr.AddressFamily == AF_INET) {
+    row.Address.Ipv4.sin_family = AF_INET;
+    row.Address.Ipv4.sin_addr = addr.Address.V4;
+  } else if (addr.AddressFamily == AF_INET6) {
+    row.Address.Ipv6.sin6_family = AF_INET6;
+    row.Address.Ipv6.sin6_addr = addr.Address.V6;
+  }
+
+  // The address is only formatted for a line that is logged, debug lines are compiled out of release builds
+  SPDLOG_LOGGER_DEBUG(logger_, "Adding IP address: {}", AddressWithCidrToString(addr));
+  DWORD result = RetryTransient(MeteredCall::kCreateUnicastIpAddressEntry, [&row]() {
+    return MeteredInvoke(MeteredCall::kCreateUnicastIpAddressEntry, CreateUnicastIpAddressEntry, &row);
+  });
+  if (result != NO_ERROR && result != ERROR_OBJECT_ALREADY_EXISTS) {
+    logger_->error("Failed to add IP address {}: Windows error {}", AddressWithCidrToString(addr), result);
+    return false;
+  } else if (result == ERROR_OBJECT_ALREADY_EXISTS) {
+    // Not ours, so the ledger leaves it out and teardown leaves it in place
+    SPDLOG_LOGGER_DEBUG(logger_, "IP address {} already exists", AddressWithCidrToString(addr));
+  } else {
+    SPDLOG_LOGGER_DEBUG(logger_, "Successfully added IP address: {}", AddressWithCidrToString(addr));
+    if (ledger_) {
+      ledger_->addresses.insert(IpPrefix::FromAddress(addr));
+    }
+    if (undo_log_) {
+      undo_log_->added_addresses.push_back(IpPrefix::FromAddress(addr));
+    }
+  }
   return true;
 }
 
@@ -107,128 +925,588 @@ bool WireguardNetworkConfig::ConfigureRoutes(const std::vector<WIREGUARD_ALLOWED
     return true;
   }
 
-  logger_->debug("Configuring routes for {} allowed IP(s)", allowed_ips.size());
+  SPDLOG_LOGGER_DEBUG(logger_, "Configuring routes for {} allowed IP(s)", allowed_ips.size());
+  TraceRegion trace_region("ConfigureRoutes", static_cast<int64_t>(allowed_ips.size()));
 
+  std::vector<const WIREGUARD_ALLOWED_IP *> routes;
+  routes.reserve(allowed_ips.size());
   for (const auto &allowed_ip : allowed_ips) {
-    MIB_IPFORWARD_ROW2 route;
-    InitializeIpForwardEntry(&route);
-
-    route.InterfaceLuid = luid_;
-    route.Protocol = MIB_IPPROTO_LOCAL;
-    route.Metric = 0; // Use default metric
-    route.Age = 0;
-    route.ValidLifetime = 0xffffffff;     // INFINITE
-    route.PreferredLifetime = 0xffffffff; // INFINITE
-
-    std::string route_str = AddressWithCidrToString(allowed_ip);
-    if (allowed_ip.AddressFamily != AF_INET && allowed_ip.AddressFamily != AF_INET6) {
-      logger_->warn("Skipping route for unsupported address family: {}", allowed_ip.AddressFamily);
-      continue;
-    }
-
-    if (allowed_ip.AddressFamily == AF_INET) {
-      route.DestinationPrefix.Prefix.Ipv4.sin_family = AF_INET;
-      route.DestinationPrefix.Prefix.Ipv4.sin_addr = allowed_ip.Address.V4;
-      route.DestinationPrefix.PrefixLength = allowed_ip.Cidr;
+    routes.push_back(&allowed_ip);
+  }
+  if (!AddRoutes(routes)) {
+    return false;
+  }
 
-      // Set next hop to unspecified (0.0.0.0) for direct routing
-      route.NextHop.Ipv4.sin_family = AF_INET;
-      route.NextHop.Ipv4.sin_addr.s_addr = 0;
-    } else if (allowed_ip.AddressFamily == AF_INET6) {
-      route.DestinationPrefix.Prefix.Ipv6.sin6_family = AF_INET6;
-      route.DestinationPrefix.Prefix.Ipv6.sin6_addr = allowed_ip.Address.V6;
-      route.DestinationPrefix.PrefixLength = allowed_ip.Cidr;
+  SPDLOG_LOGGER_DEBUG(logger_, "Route configuration completed successfully");
+  return true;
+}
 
-      // Set next hop to unspecified (::) for direct routing
-      route.NextHop.Ipv6.sin6_family = AF_INET6;
-      memset(&route.NextHop.Ipv6.sin6_addr, 0, sizeof(route.NextHop.Ipv6.sin6_addr));
+bool WireguardNetworkConfig::ReconcileRoutes(const std::vector<WIREGUARD_ALLOWED_IP> &allowed_ips) {
+  std::map<IpPrefix, const WIREGUARD_ALLOWED_IP *> missing;
+  for (const auto &allowed_ip : allowed_ips) {
+    if (allowed_ip.AddressFamily == AF_INET || allowed_ip.AddressFamily == AF_INET6) {
+      missing.emplace(IpPrefix::From(allowed_ip), &allowed_ip);
     }
+  }
 
-    logger_->debug("Adding route: {}", route_str);
-    DWORD result = CreateIpForwardEntry2(&route);
-    if (result != NO_ERROR && result != ERROR_OBJECT_ALREADY_EXISTS) {
-      logger_->error("Failed to add route {}: Windows error {}", route_str, result);
-      return false;
-    } else if (result == ERROR_OBJECT_ALREADY_EXISTS) {
-      logger_->debug("Route {} already exists", route_str);
+  std::set<IpPrefix> installed;
+  if (!GetInstalledRoutes(installed)) {
+    return false;
+  }
+
+  // Routes we installed that are still wanted stay as they are, the rest go
+  bool success = true;
+  size_t kept = 0;
+  size_t removed = 0;
+  for (const auto &prefix : installed) {
+    auto wanted = missing.find(prefix);
+    if (wanted != missing.end()) {
+      missing.erase(wanted);
+      kept++;
+    } else if (DeleteRoute(prefix)) {
+      removed++;
     } else {
-      logger_->debug("Successfully added route: {}", route_str);
+      success = false;
     }
   }
 
-  logger_->debug("Route configuration completed successfully");
-  return true;
+  std::vector<const WIREGUARD_ALLOWED_IP *> routes;
+  routes.reserve(missing.size());
+  for (const auto &entry : missing) {
+    routes.push_back(entry.second);
+  }
+  if (!AddRoutes(routes)) {
+    return false;
+  }
+
+  logger_->info("Reconciled routes: {} kept, {} added, {} removed", kept, missing.size(), removed);
+  return success;
 }
 
-bool WireguardNetworkConfig::RemoveIPAddresses() {
-  PMIB_UNICASTIPADDRESS_TABLE table = nullptr;
+bool WireguardNetworkConfig::ChangeRoutes(const std::vector<WIREGUARD_ALLOWED_IP> &added,
+                                          const std::vector<WIREGUARD_ALLOWED_IP> &removed) {
+  std::vector<const WIREGUARD_ALLOWED_IP *> routes;
+  routes.reserve(added.size());
+  for (const auto &allowed_ip : added) {
+    routes.push_back(&allowed_ip);
+  }
+  if (!AddRoutes(routes)) {
+    return false;
+  }
 
-  DWORD result = GetUnicastIpAddressTable(AF_UNSPEC, &table);
+  bool success = true;
+  for (const auto &allowed_ip : removed) {
+    success = DeleteRoute(IpPrefix::From(allowed_ip)) && success;
+  }
+  logger_->info("Changed routes: {} added, {} removed", added.size(), removed.size());
+  return success;
+}
+
+bool WireguardNetworkConfig::GetInstalledRoutes(std::set<IpPrefix> &installed) {
+  if (ledger_ && ledger_->routes_known) {
+    installed = ledger_->routes;
+    return true;
+  }
+
+  PMIB_IPFORWARD_TABLE2 table = nullptr;
+  DWORD result = MeteredInvoke(MeteredCall::kGetIpForwardTable2, GetIpForwardTable2, AF_UNSPEC, &table);
   if (result != NO_ERROR) {
-    logger_->error("Failed to get unicast IP address table: Windows error {}", result);
+    logger_->error("Failed to get IP forward table: Windows error {}", result);
+    return false;
+  }
+
+  // Routes the system adds for the interface addresses are not ours to touch
+  for (ULONG i = 0; i < table->NumEntries; i++) {
+    const MIB_IPFORWARD_ROW2 &row = table->Table[i];
+    if (row.InterfaceLuid.Value == luid_.Value && row.Origin == NlroManual) {
+      installed.insert(IpPrefix::From(row.DestinationPrefix.Prefix, row.DestinationPrefix.PrefixLength));
+    }
+  }
+  FreeMibTable(table);
+
+  // From here on the ledger tracks every change, so it is exact again
+  if (ledger_) {
+    ledger_->routes = installed;
+    ledger_->routes_known = true;
+  }
+  return true;
+}
+
+bool WireguardNetworkConfig::DeleteRoute(const IpPrefix &prefix) {
+  // One the ledger does not have was there before the tunnel
+  if (ledger_ && ledger_->routes_known && ledger_->routes.count(prefix) == 0) {
+    return true;
+  }
+
+  // Our routes all have an unspecified next hop, which completes the row's key
+  MIB_IPFORWARD_ROW2 route;
+  InitializeIpForwardEntry(&route);
+  route.InterfaceLuid = luid_;
+  route.DestinationPrefix.Prefix = prefix.ToSockaddr();
+  route.DestinationPrefix.PrefixLength = prefix.length;
+  route.NextHop.si_family = prefix.family;
+
+  SPDLOG_LOGGER_DEBUG(logger_, "Removing route: {}",
+                      AddressWithCidrToString(route.DestinationPrefix.Prefix, prefix.length));
+  DWORD result = MeteredInvoke(MeteredCall::kDeleteIpForwardEntry2, DeleteIpForwardEntry2, &route);
+  if (result != NO_ERROR && result != ERROR_NOT_FOUND) {
+    logger_->error("Failed to remove route {}: Windows error {}",
+                   AddressWithCidrToString(route.DestinationPrefix.Prefix, prefix.length), result);
     return false;
   }
 
+  if (ledger_) {
+    ledger_->routes.erase(prefix);
+  }
+  if (undo_log_ && result == NO_ERROR) {
+    undo_log_->removed_routes.push_back(prefix);
+  }
+  return true;
+}
+
+bool WireguardNetworkConfig::DeleteIPAddress(const IpPrefix &address) {
+  if (ledger_ && ledger_->addresses_known && ledger_->addresses.count(address) == 0) {
+    return true;
+  }
+
+  MIB_UNICASTIPADDRESS_ROW row;
+  InitializeUnicastIpAddressEntry(&row);
+  row.InterfaceLuid = luid_;
+  row.Address = address.ToSockaddr();
+
+  SPDLOG_LOGGER_DEBUG(logger_, "Removing IP address: {}", AddressWithCidrToString(row.Address, address.length));
+  DWORD result = MeteredInvoke(MeteredCall::kDeleteUnicastIpAddressEntry, DeleteUnicastIpAddressEntry, &row);
+  if (result != NO_ERROR && result != ERROR_NOT_FOUND) {
+    logger_->error("Failed to remove IP address {}: Windows error {}",
+                   AddressWithCidrToString(row.Address, address.length), result);
+    return false;
+  }
+
+  if (ledger_) {
+    ledger_->addresses.erase(address);
+  }
+  if (undo_log_ && result == NO_ERROR) {
+    undo_log_->removed_addresses.push_back(address);
+  }
+  return true;
+}
+
+void WireguardNetworkConfig::BuildRouteRow(const WIREGUARD_ALLOWED_IP &allowed_ip, MIB_IPFORWARD_ROW2 &route) const {
+  InitializeIpForwardEntry(&route);
+
+  route.InterfaceLuid = luid_;
+  route.Protocol = MIB_IPPROTO_LOCAL;
+  route.Metric = 0; // Use default metric
+  route.Age = 0;
+  route.ValidLifetime = 0xffffffff;     // INFINITE
+  route.PreferredLifetime = 0xffffffff; // INFINITE
+
+  if (allowed_ip.AddressFamily == AF_INET) {
+    route.DestinationPrefix.Prefix.Ipv4.sin_family = AF_INET;
+    route.DestinationPrefix.Prefix.Ipv4.sin_addr = allowed_ip.Address.V4;
+    route.DestinationPrefix.PrefixLength = allowed_ip.Cidr;
+
+    // Set next hop to unspecified (0.0.0.0) for direct routing
+    route.NextHop.Ipv4.sin_family = AF_INET;
+    route.NextHop.Ipv4.sin_addr.s_addr = 0;
+  } else if (allowed_ip.AddressFamily == AF_INET6) {
+    route.DestinationPrefix.Prefix.Ipv6.sin6_family = AF_INET6;
+    route.DestinationPrefix.Prefix.Ipv6.sin6_addr = allowed_ip.Address.V6;
+    route.DestinationPrefix.PrefixLength = allowed_ip.Cidr;
+
+    // Set next hop to unspecified (::) for direct routing
+    route.NextHop.Ipv6.sin6_family = AF_INET6;
+    memset(&route.NextHop.Ipv6.sin6_addr, 0, sizeof(route.NextHop.Ipv6.sin6_addr));
+  }
+}
+
+bool WireguardNetworkConfig::AddRoutes(const std::vector<const WIREGUARD_ALLOWED_IP *> &allowed_ips) {
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<const WIREGUARD_ALLOWED_IP *> routes;
+  routes.reserve(allowed_ips.size());
+  for (const auto *allowed_ip : allowed_ips) {
+    if (allowed_ip->AddressFamily != AF_INET && allowed_ip->AddressFamily != AF_INET6) {
+      logger_->warn("Skipping route for unsupported address family: {}", allowed_ip->AddressFamily);
+      continue;
+    }
+    routes.push_back(allowed_ip);
+  }
+
+  std::vector<MIB_IPFORWARD_ROW2> rows(routes.size());
+  for (size_t i = 0; i < routes.size(); i++) {
+    BuildRouteRow(*routes[i], rows[i]);
+  }
+
+  // Every CreateIpForwardEntry2 is a kernel round-trip that mostly waits, so they are spread over a few
+  // workers pulling indices from a shared counter. Rows never attempted keep ERROR_CANCELLED.
+  std::vector<DWORD> results(rows.size(), ERROR_CANCELLED);
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  auto install = [&rows, &results, &next, &failed]() {
+    while (!failed.load(std::memory_order_relaxed)) {
+      size_t i = next.fetch_add(1, std::memory_order_relaxed);
+      if (i >= rows.size()) {
+        return;
+      }
+      // Only the failing route is made again, on the worker that had it
+      results[i] = RetryTransient(MeteredCall::kCreateIpForwardEntry2, [&rows, i]() {
+        return MeteredInvoke(MeteredCall::kCreateIpForwardEntry2, CreateIpForwardEntry2, &rows[i]);
+      });
+      if (results[i] != NO_ERROR && results[i] != ERROR_OBJECT_ALREADY_EXISTS) {
+        failed.store(true, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  size_t workers = (std::min)(static_cast<size_t>((std::max)(route_workers_, 1u)),
+                              (rows.size() + kRoutesPerWorker - 1) / kRoutesPerWorker);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < workers; i++) {
+    try {
+      threads.emplace_back(install);
+    } catch (const std::system_error &) {
+      break; // Fewer workers, the calling thread still takes part
+    }
+  }
+  install();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Results are read back in input order, so the reported failure is always the first one
   bool success = true;
+  size_t added = 0;
+  for (size_t i = 0; i < rows.size(); i++) {
+    DWORD result = results[i];
+    if (result == NO_ERROR || result == ERROR_OBJECT_ALREADY_EXISTS) {
+      added++;
+      // A route that was there before is not ours to remove
+      if (result == NO_ERROR && ledger_) {
+        ledger_->routes.insert(IpPrefix::From(*routes[i]));
+      }
+      if (undo_log_ && result == NO_ERROR) {
+        undo_log_->added_routes.push_back(IpPrefix::From(*routes[i]));
+      }
+    } else if (result != ERROR_CANCELLED && success) {
+      logger_->error("Failed to add route {}: Windows error {}", AddressWithCidrToString(*routes[i]), result);
+      success = false;
+    }
+  }
 
-  for (ULONG i = 0; i < table->NumEntries; i++) {
-    if (table->Table[i].InterfaceLuid.Value == luid_.Value) {
-      std::string addr_str = AddressWithCidrToString(table->Table[i].Address, table->Table[i].OnLinkPrefixLength);
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  logger_->info("Installed {} of {} routes with {} workers in {} ms", added, rows.size(), threads.size() + 1,
+                elapsed.count());
+  return success;
+}
 
-      logger_->debug("Removing IP address: {}", addr_str);
-      DWORD delete_result = DeleteUnicastIpAddressEntry(&table->Table[i]);
-      if (delete_result != NO_ERROR && delete_result != ERROR_NOT_FOUND) {
-        logger_->error("Failed to remove IP address {}: Windows error {}", addr_str, delete_result);
-        success = false;
+bool WireguardNetworkConfig::Rollback(NetworkUndoLog &undo_log) {
+  if (undo_log.Empty()) {
+    return true;
+  }
+
+  // The reversal itself is not recorded
+  NetworkUndoLog *recording = undo_log_;
+  undo_log_ = nullptr;
+
+  logger_->info("Rolling back {} addresses, {} routes and {} interface entries",
+                undo_log.added_addresses.size() + undo_log.removed_addresses.size(),
+                undo_log.added_routes.size() + undo_log.removed_routes.size(), undo_log.interface_rows.size());
+
+  // The reverse of the order ConfigureNetworking applies them in
+  bool success = true;
+  if (undo_log.dns_changed) {
+    success = RemoveDNS() && success;
+  }
+  if (undo_log.qos_changed) {
+    success = RemoveQosPolicies() && success;
+  }
+  if (undo_log.nrpt_changed) {
+    success = RemoveNrptRules() && success;
+  }
+
+  for (auto it = undo_log.added_routes.rbegin(); it != undo_log.added_routes.rend(); ++it) {
+    success = DeleteRoute(*it) && success;
+  }
+  std::vector<WIREGUARD_ALLOWED_IP> removed_routes;
+  for (const auto &prefix : undo_log.removed_routes) {
+    removed_routes.push_back(ToAllowedIp(prefix));
+  }
+  if (!removed_routes.empty()) {
+    success = ConfigureRoutes(removed_routes) && success;
+  }
+
+  for (auto it = undo_log.added_addresses.rbegin(); it != undo_log.added_addresses.rend(); ++it) {
+    success = DeleteIPAddress(*it) && success;
+  }
+  for (const auto &address : undo_log.removed_addresses) {
+    success = AddIPAddress(ToAllowedIp(address)) && success;
+  }
+
+  for (auto it = undo_log.interface_rows.rbegin(); it != undo_log.interface_rows.rend(); ++it) {
+    MIB_IPINTERFACE_ROW row = *it;
+    row.SitePrefixLength = 0;
+    DWORD result = MeteredInvoke(MeteredCall::kSetIpInterfaceEntry, SetIpInterfaceEntry, &row);
+    if (result != NO_ERROR) {
+      logger_->warn("Failed to restore interface settings for family {}: Windows error {}", row.Family, result);
+      success = false;
+    }
+  }
+
+  undo_log = NetworkUndoLog();
+  undo_log_ = recording;
+  if (!success) {
+    logger_->warn("Rollback left some changes in place");
+  }
+  return success;
+}
+
+bool WireguardNetworkConfig::RemoveIPAddresses(const NetworkTableSnapshot *snapshot) {
+  if (ledger_ && ledger_->addresses_known) {
+    // Exactly the rows we created, without copying the machine's whole address table
+    bool success = true;
+    std::set<IpPrefix> addresses = ledger_->addresses;
+    for (const auto &address : addresses) {
+      success &= DeleteIPAddress(address);
+    }
+    return success;
+  }
+
+  std::vector<MIB_UNICASTIPADDRESS_ROW> rows;
+  const auto *snapshot_rows = snapshot ? snapshot->AddressesOf(luid_) : nullptr;
+  if (snapshot_rows) {
+    rows = *snapshot_rows;
+  } else {
+    PMIB_UNICASTIPADDRESS_TABLE table = nullptr;
+
+    DWORD result = MeteredInvoke(MeteredCall::kGetUnicastIpAddressTable, GetUnicastIpAddressTable, AF_UNSPEC, &table);
+    if (result != NO_ERROR) {
+      logger_->error("Failed to get unicast IP address table: Windows error {}", result);
+      return false;
+    }
+    for (ULONG i = 0; i < table->NumEntries; i++) {
+      if (table->Table[i].InterfaceLuid.Value == luid_.Value) {
+        rows.push_back(table->Table[i]);
+      }
+    }
+    FreeMibTable(table);
+  }
+
+  bool success = true;
+
+  for (auto &row : rows) {
+    SPDLOG_LOGGER_DEBUG(logger_, "Removing IP address: {}",
+                        AddressWithCidrToString(row.Address, row.OnLinkPrefixLength));
+    DWORD delete_result = MeteredInvoke(MeteredCall::kDeleteUnicastIpAddressEntry, DeleteUnicastIpAddressEntry, &row);
+    if (delete_result != NO_ERROR && delete_result != ERROR_NOT_FOUND) {
+      logger_->error("Failed to remove IP address {}: Windows error {}",
+                     AddressWithCidrToString(row.Address, row.OnLinkPrefixLength), delete_result);
+      success = false;
+    } else {
+      if (delete_result == ERROR_NOT_FOUND) {
+        SPDLOG_LOGGER_DEBUG(logger_, "IP address {} was already removed",
+                            AddressWithCidrToString(row.Address, row.OnLinkPrefixLength));
       } else {
-        if (delete_result == ERROR_NOT_FOUND) {
-          logger_->debug("IP address {} was already removed", addr_str);
-        } else {
-          logger_->debug("Successfully removed IP address: {}", addr_str);
-        }
+        SPDLOG_LOGGER_DEBUG(logger_, "Successfully removed IP address: {}",
+                            AddressWithCidrToString(row.Address, row.OnLinkPrefixLength));
       }
     }
   }
 
-  FreeMibTable(table);
+  if (ledger_) {
+    ledger_->addresses.clear();
+    ledger_->addresses_known = success;
+  }
   return success;
 }
 
-bool WireguardNetworkConfig::RemoveRoutes() {
-  PMIB_IPFORWARD_TABLE2 table = nullptr;
+bool WireguardNetworkConfig::RemoveRoutes(const NetworkTableSnapshot *snapshot) {
+  if (ledger_ && ledger_->routes_known) {
+    // Exactly the rows we created, without copying the machine's whole routing table
+    bool success = true;
+    std::set<IpPrefix> routes = ledger_->routes;
+    for (const auto &route : routes) {
+      success &= DeleteRoute(route);
+    }
+    return success;
+  }
 
-  DWORD result = GetIpForwardTable2(AF_UNSPEC, &table);
-  if (result != NO_ERROR) {
-    logger_->error("Failed to get IP forward table: Windows error {}", result);
-    return false;
+  std::vector<MIB_IPFORWARD_ROW2> rows;
+  const auto *snapshot_rows = snapshot ? snapshot->RoutesOf(luid_) : nullptr;
+  if (snapshot_rows) {
+    rows = *snapshot_rows;
+  } else {
+    PMIB_IPFORWARD_TABLE2 table = nullptr;
+
+    DWORD result = MeteredInvoke(MeteredCall::kGetIpForwardTable2, GetIpForwardTable2, AF_UNSPEC, &table);
+    if (result != NO_ERROR) {
+      logger_->error("Failed to get IP forward table: Windows error {}", result);
+      return false;
+    }
+    for (ULONG i = 0; i < table->NumEntries; i++) {
+      if (table->Table[i].InterfaceLuid.Value == luid_.Value) {
+        rows.push_back(table->Table[i]);
+      }
+    }
+    FreeMibTable(table);
   }
 
   bool success = true;
 
-  for (ULONG i = 0; i < table->NumEntries; i++) {
-    if (table->Table[i].InterfaceLuid.Value == luid_.Value) {
-      std::string route_str = AddressWithCidrToString(table->Table[i].DestinationPrefix.Prefix,
-                                                      table->Table[i].DestinationPrefix.PrefixLength);
-
-      logger_->debug("Removing route: {}", route_str);
-      DWORD delete_result = DeleteIpForwardEntry2(&table->Table[i]);
-      if (delete_result != NO_ERROR && delete_result != ERROR_NOT_FOUND) {
-        logger_->error("Failed to remove route {}: Windows error {}", route_str, delete_result);
-        success = false;
+  for (auto &row : rows) {
+    SPDLOG_LOGGER_DEBUG(logger_, "Removing route: {}",
+                        AddressWithCidrToString(row.DestinationPrefix.Prefix, row.DestinationPrefix.PrefixLength));
+    DWORD delete_result = MeteredInvoke(MeteredCall::kDeleteIpForwardEntry2, DeleteIpForwardEntry2, &row);
+    if (delete_result != NO_ERROR && delete_result != ERROR_NOT_FOUND) {
+      logger_->error("Failed to remove route {}: Windows error {}",
+                     AddressWithCidrToString(row.DestinationPrefix.Prefix, row.DestinationPrefix.PrefixLength),
+                     delete_result);
+      success = false;
+    } else {
+      if (delete_result == ERROR_NOT_FOUND) {
+        SPDLOG_LOGGER_DEBUG(logger_, "Route {} was already removed",
+                            AddressWithCidrToString(row.DestinationPrefix.Prefix, row.DestinationPrefix.PrefixLength));
       } else {
-        if (delete_result == ERROR_NOT_FOUND) {
-          logger_->debug("Route {} was already removed", route_str);
-        } else {
-          logger_->debug("Successfully removed route: {}", route_str);
-        }
+        SPDLOG_LOGGER_DEBUG(logger_, "Successfully removed route: {}",
+                            AddressWithCidrToString(row.DestinationPrefix.Prefix, row.DestinationPrefix.PrefixLength));
       }
     }
   }
 
-  FreeMibTable(table);
+  if (ledger_) {
+    ledger_->routes.clear();
+    ledger_->routes_known = success;
+  }
   return success;
 }
 
+bool NetworkTableSnapshot::Take() {
+  addresses_.clear();
+  routes_.clear();
+
+  PMIB_UNICASTIPADDRESS_TABLE address_table = nullptr;
+  has_addresses_ = MeteredInvoke(MeteredCall::kGetUnicastIpAddressTable, GetUnicastIpAddressTable, AF_UNSPEC,
+                                 &address_table) == NO_ERROR;
+  if (has_addresses_) {
+    for (ULONG i = 0; i < address_table->NumEntries; i++) {
+      addresses_[address_table->Table[i].InterfaceLuid.Value].push_back(address_table->Table[i]);
+    }
+    FreeMibTable(address_table);
+  }
+
+  PMIB_IPFORWARD_TABLE2 route_table = nullptr;
+  has_routes_ =
+      MeteredInvoke(MeteredCall::kGetIpForwardTable2, GetIpForwardTable2, AF_UNSPEC, &route_table) == NO_ERROR;
+  if (has_routes_) {
+    for (ULONG i = 0; i < route_table->NumEntries; i++) {
+      routes_[route_table->Table[i].InterfaceLuid.Value].push_back(route_table->Table[i]);
+    }
+    FreeMibTable(route_table);
+  }
+  return has_addresses_ && has_routes_;
+}
+
+const std::vector<MIB_UNICASTIPADDRESS_ROW> *NetworkTableSnapshot::AddressesOf(const NET_LUID &luid) const {
+  static const std::vector<MIB_UNICASTIPADDRESS_ROW> kNone;
+  if (!has_addresses_) {
+    return nullptr;
+  }
+  auto it = addresses_.find(luid.Value);
+  return it != addresses_.end() ? &it->second : &kNone;
+}
+
+const std::vector<MIB_IPFORWARD_ROW2> *NetworkTableSnapshot::RoutesOf(const NET_LUID &luid) const {
+  static const std::vector<MIB_IPFORWARD_ROW2> kNone;
+  if (!has_routes_) {
+    return nullptr;
+  }
+  auto it = routes_.find(luid.Value);
+  return it != routes_.end() ? &it->second : &kNone;
+}
+
+AddressFamilies AddressFamilies::Of(const std::vector<WIREGUARD_ALLOWED_IP> &addresses,
+                                   const std::vector<WIREGUARD_ALLOWED_IP> &routes) {
+  AddressFamilies families{false, false};
+  for (const auto *list : {&addresses, &routes}) {
+    for (const WIREGUARD_ALLOWED_IP &allowed_ip : *list) {
+      families.ipv4 = families.ipv4 || allowed_ip.AddressFamily == AF_INET;
+      families.ipv6 = families.ipv6 || allowed_ip.AddressFamily == AF_INET6;
+    }
+  }
+  if (!families.ipv4 && !families.ipv6) {
+    return AddressFamilies();
+  }
+  return families;
+}
+
+IpPrefix IpPrefix::From(const WIREGUARD_ALLOWED_IP &allowed_ip) {
+  IpPrefix prefix = FromAddress(allowed_ip);
+  prefix.MaskHostBits();
+  return prefix;
+}
+
+IpPrefix IpPrefix::From(const SOCKADDR_INET &address, UINT8 length) {
+  IpPrefix prefix = FromAddress(address, length);
+  prefix.MaskHostBits();
+  return prefix;
+}
+
+IpPrefix IpPrefix::FromAddress(const WIREGUARD_ALLOWED_IP &allowed_ip) {
+  IpPrefix prefix = {};
+  prefix.family = allowed_ip.AddressFamily;
+  prefix.length = allowed_ip.Cidr;
+  if (allowed_ip.AddressFamily == AF_INET) {
+    memcpy(prefix.address, &allowed_ip.Address.V4, sizeof(IN_ADDR));
+  } else if (allowed_ip.AddressFamily == AF_INET6) {
+    memcpy(prefix.address, &allowed_ip.Address.V6, sizeof(IN6_ADDR));
+  }
+  return prefix;
+}
+
+IpPrefix IpPrefix::FromAddress(const SOCKADDR_INET &address, UINT8 length) {
+  IpPrefix prefix = {};
+  prefix.family = address.si_family;
+  prefix.length = length;
+  if (address.si_family == AF_INET) {
+    memcpy(prefix.address, &address.Ipv4.sin_addr, sizeof(IN_ADDR));
+  } else if (address.si_family == AF_INET6) {
+    memcpy(prefix.address, &address.Ipv6.sin6_addr, sizeof(IN6_ADDR));
+  }
+  return prefix;
+}
+
+SOCKADDR_INET IpPrefix::ToSockaddr() const {
+  SOCKADDR_INET sockaddr = {};
+  sockaddr.si_family = family;
+  if (family == AF_INET) {
+    memcpy(&sockaddr.Ipv4.sin_addr, address, sizeof(IN_ADDR));
+  } else if (family == AF_INET6) {
+    memcpy(&sockaddr.Ipv6.sin6_addr, address, sizeof(IN6_ADDR));
+  }
+  return sockaddr;
+}
+
+void IpPrefix::MaskHostBits() {
+  for (size_t i = 0; i < sizeof(address); i++) {
+    size_t bit = i * 8;
+    if (bit >= length) {
+      address[i] = 0;
+    } else if (bit + 8 > length) {
+      address[i] &= static_cast<BYTE>(0xFF << (8 - (length - bit)));
+    }
+  }
+}
+
+bool IpPrefix::operator<(const IpPrefix &other) const {
+  if (family != other.family) {
+    return family < other.family;
+  }
+  if (length != other.length) {
+    return length < other.length;
+  }
+  return memcmp(address, other.address, sizeof(address)) < 0;
+}
+
 std::string WireguardNetworkConfig::AddressWithCidrToString(const WIREGUARD_ALLOWED_IP &addr) {
   char ip_str[INET6_ADDRSTRLEN];
 
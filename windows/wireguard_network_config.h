@@ -6,43 +6,281 @@
 #include <iphlpapi.h>
 #include <netioapi.h>
 
+#include <cstdint>
 #include <vector>
 #include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include "plugin_logger.h"
 #include "wireguard.h"
 
-namespace spdlog {
-class logger;
-}
-
 namespace wireguard_dart {
 
+/**
+ * Interface settings beyond the MTU, from the [Interface] keys Metric, AutomaticMetric, RouterDiscovery and
+ * DadTransmits. Settings that were not given keep the value the system has.
+ */
+struct InterfaceProfile {
+  bool has_metric = false;
+  bool has_automatic_metric = false;
+  bool has_router_discovery = false;
+  bool has_dad_transmits = false;
+
+  // A fixed metric lets the tunnel win route selection without a metric on every route
+  ULONG metric = 0;
+  // Unless given, a fixed metric turns the automatic one off
+  bool automatic_metric = false;
+  bool router_discovery = false;
+  ULONG dad_transmits = 0;
+};
+
+/**
+ * The address families a tunnel uses, those of its addresses and its routes. An IPv4 tunnel that routes ::/0 to
+ * keep IPv6 from leaking uses both.
+ */
+struct AddressFamilies {
+  bool ipv4 = true;
+  bool ipv6 = true;
+
+  // Both while there are neither addresses nor routes to tell
+  static AddressFamilies Of(const std::vector<WIREGUARD_ALLOWED_IP> &addresses,
+                            const std::vector<WIREGUARD_ALLOWED_IP> &routes);
+  bool Uses(ADDRESS_FAMILY family) const { return family == AF_INET6 ? ipv6 : ipv4; }
+};
+
+/**
+ * An entry of the [Interface] key QoS, an extension: the DSCP value traffic is marked with, through a policy-based
+ * QoS policy. It matches the traffic of an application, traffic to a range of remote ports, or the tunnel's own
+ * datagrams, the ones routers along the path see.
+ */
+struct QosRule {
+  // An executable name or full path; empty unless the rule is for an application
+  std::string application;
+  // IPPROTO_TCP or IPPROTO_UDP with the remote ports, for a port rule
+  BYTE protocol = 0;
+  WORD first_port = 0;
+  WORD last_port = 0;
+  // The encrypted datagrams sent from the tunnel's ListenPort
+  bool tunnel = false;
+  BYTE dscp = 0;
+};
+
+/**
+ * An address family, address and prefix length, ordered so that routes and addresses can be matched in sets
+ */
+struct IpPrefix {
+  ADDRESS_FAMILY family;
+  BYTE length;
+  BYTE address[16];  // IPv4 addresses use the first 4 bytes
+
+  // As a route destination, without host bits
+  static IpPrefix From(const WIREGUARD_ALLOWED_IP &allowed_ip);
+  static IpPrefix From(const SOCKADDR_INET &address, UINT8 length);
+
+  // As an interface address, keeping the host bits
+  static IpPrefix FromAddress(const WIREGUARD_ALLOWED_IP &allowed_ip);
+  static IpPrefix FromAddress(const SOCKADDR_INET &address, UINT8 length);
+
+  SOCKADDR_INET ToSockaddr() const;
+
+  bool operator<(const IpPrefix &other) const;
+
+private:
+  void MaskHostBits();
+};
+
+/**
+ * The addresses and routes created on one interface, kept by its owner across WireguardNetworkConfig
+ * instances so that they can be replaced or removed directly instead of by copying and scanning the
+ * machine's tables. A row that already existed when it was to be added is left out. A part that is not
+ * known, e.g. after a restart, is rebuilt from one scan the next time it is needed.
+ */
+struct NetworkLedger {
+  bool addresses_known = false;
+  bool routes_known = false;
+  std::set<IpPrefix> addresses;
+  std::set<IpPrefix> routes;
+  // The NRPT rules of the interface by registry key name, and a hash of what they hold; unknown, they are found
+  // by the interface GUID in their names
+  bool nrpt_rules_known = false;
+  std::set<std::wstring> nrpt_rules;
+  uint64_t nrpt_content = 0;
+  // The same for the QoS policies
+  bool qos_policies_known = false;
+  std::set<std::wstring> qos_policies;
+  uint64_t qos_content = 0;
+};
+
+/**
+ * The changes one round of configuration made, so that a failure can reverse exactly those instead of
+ * tearing down everything with a full cleanup. Only rows that did not exist before are recorded as added.
+ */
+struct NetworkUndoLog {
+  // The interface entries as they were before they were changed
+  std::vector<MIB_IPINTERFACE_ROW> interface_rows;
+  std::vector<IpPrefix> added_addresses;
+  std::vector<IpPrefix> removed_addresses;
+  std::vector<IpPrefix> added_routes;
+  std::vector<IpPrefix> removed_routes;
+  bool dns_changed = false;
+  bool nrpt_changed = false;
+  bool qos_changed = false;
+
+  bool Empty() const {
+    return interface_rows.empty() && added_addresses.empty() && removed_addresses.empty() && added_routes.empty() &&
+           removed_routes.empty() && !dns_changed && !nrpt_changed && !qos_changed;
+  }
+};
+
+/**
+ * The unicast address and route tables read once, so that removing the rows of many interfaces, as on
+ * shutdown, does not copy both system tables for each of them.
+ */
+class NetworkTableSnapshot {
+public:
+  // false if a table could not be read; interfaces then scan that table themselves
+  bool Take();
+
+  // The rows of the interface, or nullptr if that table is not in the snapshot
+  const std::vector<MIB_UNICASTIPADDRESS_ROW> *AddressesOf(const NET_LUID &luid) const;
+  const std::vector<MIB_IPFORWARD_ROW2> *RoutesOf(const NET_LUID &luid) const;
+
+private:
+  bool has_addresses_ = false;
+  bool has_routes_ = false;
+  std::unordered_map<uint64_t, std::vector<MIB_UNICASTIPADDRESS_ROW>> addresses_;
+  std::unordered_map<uint64_t, std::vector<MIB_IPFORWARD_ROW2>> routes_;
+};
+
 /**
  * Handles network interface configuration for WireGuard adapters.
  * Manages IP addresses and routing table entries.
  */
 class WireguardNetworkConfig {
 public:
-  explicit WireguardNetworkConfig(const NET_LUID &luid);
+  // Without a ledger every reconcile and removal scans the system tables. With an undo log every change
+  // is recorded in it for Rollback.
+  explicit WireguardNetworkConfig(const NET_LUID &luid, NetworkLedger *ledger = nullptr,
+                                  NetworkUndoLog *undo_log = nullptr);
+
+  // Both unless set; the interface work below leaves the families the tunnel does not use alone
+  void SetFamilies(const AddressFamilies &families) { families_ = families; }
 
   // MTU configuration
   bool ConfigureMTU(DWORD mtu);
 
+  /**
+   * Set the MTU together with the profile, one read and one write of the interface entry per address family the
+   * tunnel uses. The entry of a family it does not use, where there is one, gets duplicate address detection and
+   * router discovery turned off instead, so the stack sends nothing on it; a missing one is no failure. The entry
+   * of a used family that is not there yet, right after the adapter was created, is waited for a little, then fails.
+   */
+  bool ConfigureInterface(DWORD mtu, const InterfaceProfile &profile);
+
+  /**
+   * Set the DNS servers and search domains of the interface, one call per address family. An empty
+   * list clears them. Afterwards the resolver cache entries of the search domain names themselves are flushed;
+   * other names, those under the domains included, keep their entries until the TTL runs out, and clearing
+   * flushes nothing.
+   */
+  bool ConfigureDNS(const std::vector<SOCKADDR_INET> &servers, const std::vector<std::string> &search_domains);
+  bool RemoveDNS() { return ConfigureDNS({}, {}); }
+
+  /**
+   * Send names in the domains, and their subdomains, to the servers with Name Resolution Policy Table rules,
+   * replacing the interface's earlier ones; everything else keeps the system's resolver. All rules are written
+   * before the DNS client is told once. Rules that hold the same as the ledger knows are left alone. An empty
+   * list removes them.
+   */
+  bool ConfigureNrptRules(const std::vector<std::string> &domains, const std::vector<SOCKADDR_INET> &servers);
+  bool RemoveNrptRules() { return ConfigureNrptRules({}, {}); }
+  /**
+   * Remove the NRPT rules of interfaces that no longer exist, which a crash left behind: they are global and would
+   * keep sending their domains to servers only the tunnel reached. Rules of interfaces still there are left to
+   * their adapter. How many were removed, with failed set to how many could not be.
+   */
+  static size_t RemoveOrphanedNrptRules(size_t *failed);
+  // The same for QoS policies, putting back the QoS setting the policies needed once none are left
+  static size_t RemoveOrphanedQosPolicies(size_t *failed);
+
+  /**
+   * Mark traffic with the rules' DSCP values through policy-based QoS policies, replacing the interface's earlier
+   * ones, and have them applied once all are written. Tunnel rules match UDP from listen_port and are skipped
+   * without one; the others match traffic from the tunnel's addresses only, a policy per rule and address.
+   * Policies that hold the same as the ledger knows are left alone. An empty list removes them.
+   */
+  bool ConfigureQosPolicies(const std::vector<QosRule> &rules, WORD listen_port,
+                            const std::vector<WIREGUARD_ALLOWED_IP> &addresses);
+  bool RemoveQosPolicies() { return ConfigureQosPolicies({}, 0, {}); }
+
   // IP address configuration
   bool ConfigureIPAddresses(const std::vector<WIREGUARD_ALLOWED_IP> &addresses);
-  bool RemoveIPAddresses();
+  // With a snapshot, the rows to remove come from it instead of a table scan of their own
+  bool RemoveIPAddresses(const NetworkTableSnapshot *snapshot = nullptr);
 
   // Route configuration
   bool ConfigureRoutes(const std::vector<WIREGUARD_ALLOWED_IP> &allowed_ips);
-  bool RemoveRoutes();
+  bool RemoveRoutes(const NetworkTableSnapshot *snapshot = nullptr);
+
+  /**
+   * Bring the interface to exactly these addresses or routes: one table snapshot is compared against
+   * them and only the missing rows are added and the stale ones deleted. Rows the system created
+   * itself, like link-local addresses and on-link routes, are left alone.
+   */
+  bool ReconcileIPAddresses(const std::vector<WIREGUARD_ALLOWED_IP> &addresses);
+  bool ReconcileRoutes(const std::vector<WIREGUARD_ALLOWED_IP> &allowed_ips);
+
+  /**
+   * Add and delete just these routes, e.g. what a peer change made of the tunnel's routes, see RouteSet. The new
+   * ones go in first, so traffic moving from a route to the narrower ones that replace it never goes without.
+   */
+  bool ChangeRoutes(const std::vector<WIREGUARD_ALLOWED_IP> &added, const std::vector<WIREGUARD_ALLOWED_IP> &removed);
+
+  /**
+   * Most threads that install routes at the same time; 1 installs them one by one on the calling thread
+   */
+  static constexpr unsigned kDefaultRouteWorkers = 4;
+  void SetRouteWorkers(unsigned workers) { route_workers_ = workers; }
+
+  /**
+   * Reverse the changes in the undo log, newest first, and clear it. DNS settings, NRPT rules and QoS policies that
+   * were changed are cleared rather than restored.
+   */
+  bool Rollback(NetworkUndoLog &undo_log);
 
 private:
+  // A worker is only worth starting for at least this many routes
+  static constexpr size_t kRoutesPerWorker = 64;
+
+  // For Windows builds without SetInterfaceDnsSettings
+  bool ConfigureDNSInRegistry(ADDRESS_FAMILY family, const std::wstring &servers, const std::wstring &search_list);
+
+  bool AddIPAddress(const WIREGUARD_ALLOWED_IP &addr);
+  void BuildRouteRow(const WIREGUARD_ALLOWED_IP &allowed_ip, MIB_IPFORWARD_ROW2 &route) const;
+  // Installs the routes in parallel, stopping at the first hard failure
+  bool AddRoutes(const std::vector<const WIREGUARD_ALLOWED_IP *> &allowed_ips);
+  // Leave a row alone that a known ledger does not have, as it existed before the tunnel
+  bool DeleteIPAddress(const IpPrefix &address);
+  bool DeleteRoute(const IpPrefix &prefix);
+
+  // The rows currently ours on the interface, from the ledger or else from a table scan
+  bool GetInstalledIPAddresses(std::set<IpPrefix> &installed);
+  bool GetInstalledRoutes(std::set<IpPrefix> &installed);
+  // The NRPT rules of the interface, from the ledger or else from the registry, by their names
+  bool GetInstalledNrptRules(const std::wstring &prefix, std::set<std::wstring> &installed);
+  bool GetInstalledQosPolicies(const std::wstring &prefix, std::set<std::wstring> &installed);
+
   // Helper methods for address string conversion
   static std::string AddressWithCidrToString(const WIREGUARD_ALLOWED_IP &addr);
   static std::string AddressWithCidrToString(const SOCKADDR_INET &addr, UINT8 cidr);
 
   NET_LUID luid_;
-  std::shared_ptr<spdlog::logger> logger_;
+  NetworkLedger *ledger_;
+  NetworkUndoLog *undo_log_;
+  AddressFamilies families_;
+  unsigned route_workers_ = kDefaultRouteWorkers;
+  PluginLogger logger_;
 };
 
 } // namespace wireguard_dart
@@ -0,0 +1,18 @@
+#include "x25519.h"
+
+#include <windows.h>
+
+#include <bcrypt.h>
+
+namespace wireguard_dart {
+
+bool X25519GeneratePrivateKey(uint8_t private_key[kX25519KeySize]) {
+  if (!BCRYPT_SUCCESS(BCryptGenRandom(nullptr, private_key, static_cast<ULONG>(kX25519KeySize),
+                                      BCRYPT_USE_SYSTEM_PREFERRED_RNG))) {
+    return false;
+  }
+  X25519Clamp(private_key);
+  return true;
+}
+
+} // namespace wireguard_dart
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "wireguard_core/x25519.h"
+
+namespace wireguard_dart {
+
+// A random private key from the system's generator, clamped like WireGuard's; false if the generator failed
+bool X25519GeneratePrivateKey(uint8_t private_key[kX25519KeySize]);
+
+} // namespace wireguard_dart